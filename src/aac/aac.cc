@@ -1,4 +1,6 @@
+#include <inttypes.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -9,6 +11,9 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/runtime.h>
 
+#include "../vfs-common/seek-index.h"
+#include "../trace-common/trace.h"
+
 class AACDecoder : public InputPlugin
 {
 public:
@@ -41,6 +46,8 @@ const char * const AACDecoder::mimes[] = {"audio/aac", nullptr};
  */
 #define BUFFER_SIZE (FAAD_MIN_STREAMSIZE * 16)
 
+#define SEEK_SPACING 2000   /* ms between seek index checkpoints */
+
 /*
  * These routines are derived from MPlayer.
  */
@@ -70,7 +77,7 @@ static int aac_parse_frame (unsigned char * buf, int * srate, int * num)
     fl =
      ((buf[i + 3] & 0x03) << 11) | (buf[i + 4] << 3) | ((buf[i +
      5] >> 5) & 0x07);
-    *num = (buf[i + 6] & 0x02) + 1;
+    *num = (buf[i + 6] & 0x03) + 1;
 
     return fl;
 }
@@ -277,21 +284,100 @@ bool AACDecoder::read_tag (const char * filename, VFSFile & file, Tuple & tuple,
     return true;
 }
 
-static void aac_seek (VFSFile & file, NeAACDecHandle dec, int time, int len,
- void * buf, int size, int * buflen)
+/* Reads ADTS frame headers, without decoding, from the last checkpoint (or
+ * from <first>, the first frame) on until the frame at <target> (ms), adding
+ * checkpoints as it goes.  A seek into a part of the file not played yet
+ * then lands exactly, and the next one there is a single read; the index is
+ * kept with the file, so the headers are only read once.  Returns the
+ * length of the file (ms) if the headers were read to its end, else -1. */
+static int64_t index_frames (VFSFile & file, SeekIndex & index, int64_t first,
+ int64_t target)
 {
-    /* == ESTIMATE BYTE OFFSET == */
+    int64_t offset = first, start = 0;
+    int64_t blocks = 0;     /* of 1024 samples since <start> */
+    int rate = 0;
 
-    int64_t total = file.fsize ();
-    if (total < 0)
+    if (index.points ().len ())
     {
-        AUDERR ("File is not seekable.\n");
-        return;
+        auto & last = index.points ()[index.points ().len () - 1];
+        offset = last.offset;
+        start = last.pos;
+    }
+
+    while (true)
+    {
+        int64_t pos = rate ? start + blocks * 1024 * 1000 / rate : start;
+        unsigned char header[8];
+        int frame_rate, num;
+
+        if (file.fseek (offset, VFS_SEEK_SET) < 0 ||
+            file.fread (header, 1, sizeof header) != sizeof header)
+            return pos;
+
+        int size = aac_parse_frame (header, & frame_rate, & num);
+        if (size < 8 || (rate && frame_rate != rate))
+        {
+            AUDWARN ("No ADTS frame at byte %" PRId64 ".\n", offset);
+            return -1;
+        }
+
+        rate = frame_rate;
+        index.add (pos, offset);
+
+        if (pos >= target)
+            return -1;
+
+        offset += size;
+        blocks += num;
     }
+}
+
+/* Encoder delay and padding, in samples, as iTunes writes them in an ID3v2
+ * comment named iTunSMPB: hex numbers for the delay, the padding and the
+ * length of the original audio.  Only frames in Latin-1 or UTF-8 are
+ * found; <tag> is the whole ID3v2 tag, or as much of it as was read. */
+static bool read_itunsmpb (const unsigned char * tag, int len, int64_t * delay,
+ int64_t * samples)
+{
+    static const char name[] = "iTunSMPB";
+    const unsigned char * end = tag + len;
+
+    for (auto p = tag; p + sizeof name < end; p ++)
+    {
+        if (memcmp (p, name, sizeof name - 1))
+            continue;
+
+        /* the value follows the null that ends the description */
+        p += sizeof name - 1;
+        while (p < end && ! * p)
+            p ++;
+
+        char value[128];
+        int n = aud::min<int> (end - p, sizeof value - 1);
+        memcpy (value, p, n);
+        value[n] = 0;
+
+        unsigned zero, pre, post;
+        uint64_t length;
+
+        if (sscanf (value, " %x %x %x %" SCNx64, & zero, & pre, & post, & length) != 4 ||
+            ! length)
+            return false;
+
+        * delay = pre;
+        * samples = length;
+        return true;
+    }
+
+    return false;
+}
 
+static void aac_seek (VFSFile & file, NeAACDecHandle dec, int64_t offset,
+ void * buf, int size, int * buflen)
+{
     /* == SEEK == */
 
-    if (file.fseek (total * time / len, VFS_SEEK_SET))
+    if (file.fseek (offset, VFS_SEEK_SET))
         return;
 
     * buflen = file.fread (buf, 1, size);
@@ -344,6 +430,23 @@ bool AACDecoder::play (const char * filename, VFSFile & file)
     Tuple tuple = get_playback_tuple ();
     int bitrate = 1000 * aud::max (0, tuple.get_int (Tuple::Bitrate));
 
+    /* Checkpoints are the offsets of frame headers and the time at which
+     * those frames start, as counted while decoding from the start of the
+     * file or from an earlier checkpoint.  After a seek by estimate the
+     * time is not known exactly, so none are recorded until the next. */
+    bool stream = (file.fsize () < 0);
+    SeekIndex seek_index (SEEK_SPACING);
+    int64_t played = 0;     /* samples per channel */
+    int64_t skip_to = -1;   /* audio before this is dropped */
+    bool timed = true;
+    int64_t first_frame = 0;
+
+    /* without encoder delay and padding, in samples of the decoded stream */
+    int64_t gapless_start = 0, gapless_end = -1;
+
+    if (! stream)
+        seek_index.load (filename);
+
     if ((decoder = NeAACDecOpen ()) == nullptr)
     {
         AUDERR ("Open Decoder Error\n");
@@ -365,6 +468,13 @@ bool AACDecoder::play (const char * filename, VFSFile & file)
     if (buflen >= 10 && ! strncmp ((char *) buf, "ID3", 3))
     {
         int tagsize = 10 + (buf[6] << 21) + (buf[7] << 14) + (buf[8] << 7) + buf[9];
+        int64_t samples;
+
+        if (read_itunsmpb (buf, aud::min (tagsize, buflen), & gapless_start, & samples))
+        {
+            gapless_end = gapless_start + samples;
+            skip_to = gapless_start;
+        }
 
         if (file.fseek (tagsize, VFS_SEEK_SET))
         {
@@ -393,6 +503,8 @@ bool AACDecoder::play (const char * filename, VFSFile & file)
         buflen += file.fread (buf + buflen, 1, sizeof buf - buflen);
     }
 
+    first_frame = file.ftell () - buflen;
+
     /* == START DECODING == */
 
     if ((used = NeAACDecInit (decoder, buf, buflen, & samplerate, & channels)) < 0)
@@ -423,15 +535,47 @@ bool AACDecoder::play (const char * filename, VFSFile & file)
 
     while (! check_stop ())
     {
+        TRACE_SPAN ("AAC play");
         /* == HANDLE SEEK REQUESTS == */
 
         int seek_value = check_seek ();
 
-        if (seek_value >= 0)
+        if (seek_value >= 0 && stream)
+            AUDERR ("File is not seekable.\n");
+        else if (seek_value >= 0)
         {
+            /* positions in the index are in the decoded stream */
+            int64_t target = seek_value + gapless_start * 1000 / samplerate;
             int length = tuple.get_int (Tuple::Length);
-            if (length > 0)
-                aac_seek (file, decoder, seek_value, length, buf, sizeof buf, & buflen);
+
+            auto point = seek_index.find (target);
+            if (! point)
+            {
+                int64_t total = index_frames (file, seek_index, first_frame, target);
+                point = seek_index.find (target);
+
+                /* the length was only an estimate */
+                if (total > 0 && gapless_end < 0 && total != length)
+                {
+                    tuple.set_int (Tuple::Length, total);
+                    set_playback_tuple (tuple.ref ());
+                }
+            }
+
+            if (point)
+            {
+                aac_seek (file, decoder, point->offset, buf, sizeof buf, & buflen);
+                played = point->pos * (int64_t) samplerate / 1000;
+                skip_to = target * samplerate / 1000;
+                timed = true;
+            }
+            else if (length > 0)
+            {
+                aac_seek (file, decoder, file.fsize () * seek_value / length,
+                 buf, sizeof buf, & buflen);
+                played = target * samplerate / 1000;
+                timed = false;
+            }
         }
 
         /* == CHECK FOR END OF FILE == */
@@ -446,12 +590,16 @@ bool AACDecoder::play (const char * filename, VFSFile & file)
 
         /* == DECODE A FRAME == */
 
+        if (timed && ! stream)
+            seek_index.add (played * 1000 / samplerate, file.ftell () - buflen);
+
         NeAACDecFrameInfo info;
         void * audio = NeAACDecDecode (decoder, & info, buf, buflen);
 
         if (info.error)
         {
             AUDERR ("%s.\n", NeAACDecGetErrorMessage (info.error));
+            timed = false;
 
             if (buflen)
             {
@@ -473,8 +621,29 @@ bool AACDecoder::play (const char * filename, VFSFile & file)
 
         /* == PLAY THE SOUND == */
 
-        if (audio && info.samples)
-            write_audio (audio, sizeof (float) * info.samples);
+        if (! audio || ! info.samples)
+            continue;
+
+        int frames = info.samples / info.channels;
+        int start = 0;
+
+        if (skip_to >= 0)
+        {
+            start = aud::clamp<int64_t> (skip_to - played, 0, frames);
+            if (start < frames)
+                skip_to = -1;
+        }
+
+        /* the padding at the end is dropped too */
+        int end = frames;
+        if (gapless_end >= 0)
+            end = aud::clamp<int64_t> (gapless_end - played, start, frames);
+
+        played += frames;
+
+        if (start < end)
+            write_audio ((float *) audio + start * info.channels,
+             sizeof (float) * (end - start) * info.channels);
     }
 
     NeAACDecClose (decoder);
@@ -20,15 +20,14 @@
 #include <QWidget>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
-#include <QGridLayout>
-#include <QScrollArea>
-#include <QLabel>
 #include <QPushButton>
+#include <QComboBox>
+#include <QProgressBar>
+#include <QElapsedTimer>
 #include <QLineEdit>
 #include <QFileDialog>
 #include <QPixmap>
-#include <QMouseEvent>
-#include <QEnterEvent>
+#include <QScrollBar>
 #include <QTimer>
 #include <QFile>
 #include <QDir>
@@ -36,43 +35,37 @@
 
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/drct.h>
 #include <libaudcore/playlist.h>
 #include <libaudcore/audstrings.h>
 #include <libaudcore/probe.h>
 #include <libaudcore/hook.h>
+#include <libaudcore/tuple.h>
 
 #include <libaudqt/libaudqt.h>
 
 #include "scanner.h"
 #include "album.h"
+#include "cache.h"
+#include "grid.h"
+#include "metadata.h"
+#include "pixcache.h"
+#include "prefetch.h"
+#include "facets.h"
+#include "search.h"
+#include "sort.h"
+#include "thumbnails.h"
+#include "watcher.h"
 #include <memory>
-#include <fstream>
 #include <algorithm>
-#include <map>
+#include <cstdio>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 
-class AlbumBrowserWidget;
-
-class AlbumTile : public QWidget
-{
-    Q_OBJECT
-    
-public:
-    AlbumTile(const Album& album, AlbumBrowserWidget* browser, QWidget* parent = nullptr);
-    
-    const Album& get_album() const { return album_; }
-    
-protected:
-    void enterEvent(QEnterEvent* event) override;
-    void leaveEvent(QEvent* event) override;
-    void mousePressEvent(QMouseEvent* event) override;
-    
-private:
-    Album album_;
-    AlbumBrowserWidget* browser_;
-    bool hovered_ = false;
-};
+#define CFG_ID "album-browser"
 
 class AlbumBrowserWidget : public QWidget
 {
@@ -83,12 +76,11 @@ public:
     ~AlbumBrowserWidget();
     
     void refresh_albums();
-    void update_albums(std::vector<Album> albums);
+    void update_albums(std::vector<Album>&& albums);
+    void append_albums(std::vector<Album>&& albums);
+    const Album& album_at(size_t index) const { return albums_[index]; }
     void add_album_to_playlist(const Album& album, bool clear_first);
     
-protected:
-    void resizeEvent(QResizeEvent* event) override;
-    
 private slots:
     void on_search_changed(const QString& text);
     void on_dir_button_clicked();
@@ -96,108 +88,207 @@ private slots:
     void filter_albums();
     
 private:
+    using AlbumReceiver = void (AlbumBrowserWidget::*)(std::vector<Album>&&);
+    Scanner::ScanCallback scan_callback(AlbumReceiver receiver = &AlbumBrowserWidget::update_albums);
+    void scan_progress(const ScanProgress& progress);
     void setup_file_monitor();
     void stop_file_monitor();
+    void library_changed(std::vector<std::string> dirs);
+    void rescan_changed();
+    void load_roots();
+    void roots_edited();
+    void apply_roots();
+    void apply_rendering();
+    void update_dir_button();
+    void mark_dirty(const std::string& directory);
     void save_cache();
-    void load_cache();
-    std::string get_cache_path();
-    bool album_matches_filter(const Album& album, const std::string& filter);
-    std::string to_lower(const std::string& str);
-    QPixmap load_cover_art(const Album& album);
+    bool load_cache();
+    bool open_next_shard();
+    void load_cache_chunk();
+    std::string get_cache_dir();
+    std::string get_cache_path(const std::string& root);
+    QVariant cover_for(size_t index, int row);
+    void thumbnail_ready(size_t index, const std::string& directory, QImage image);
+    void cancel_offscreen_thumbnails();
+    void tile_clicked(int row, bool left_button);
+    void tile_hovered(int row);
+    void prefetch_hovered();
+    Playlist find_album_playlist();
+    void playback_started();
+    void hold_scan();
+    void configure_scanner();
+    bool collect_library_tracks(std::vector<LibraryTrack>& tracks);
+    void library_scan_complete();
     
+    std::unique_ptr<ArtStore> art_store_;  // outlives scanner_ and thumbnails_
     std::unique_ptr<Scanner> scanner_;
+    std::unique_ptr<ThumbnailCache> thumbnail_cache_;  // outlives thumbnails_
+    std::unique_ptr<ThumbnailLoader> thumbnails_;
+    std::unique_ptr<LibraryWatcher> watcher_;
+    std::vector<std::string> pending_changes_;
     std::vector<Album> albums_;
-    std::map<std::string, QPixmap> pixbuf_cache_;
+    AlbumSearchIndex search_index_;
+    AlbumFacets facets_;  // cleared along with search_index_
+    AlbumSorter sorter_;  // cleared along with search_index_
+    bool albums_dirty_ = false;
+    std::set<std::string> dirty_roots_;  // whose shards are out of date
+    AlbumCache::Writer cache_writer_;
+    bool streaming_ = false;  // albums_ is being filled by a first scan
+    AlbumCache::Reader cache_reader_;  // one shard per music root
+    size_t cache_next_ = 0;  // next album to read from cache_reader_
+    size_t cache_shard_start_ = 0;  // first album of the open shard
+    std::vector<std::string> cache_roots_;  // shards still to be read
+    std::vector<std::vector<uint32_t>> cache_orders_;  // of the first shard
+    QElapsedTimer cache_timer_;  // since the first shard was opened
+    PixmapCache pixmap_cache_;
+    Prefetcher prefetcher_;
     
-    QWidget* grid_container_ = nullptr;
-    QGridLayout* grid_layout_ = nullptr;
-    QScrollArea* scroll_area_ = nullptr;
+    AlbumModel* model_ = nullptr;
+    AlbumGridView* grid_view_ = nullptr;
     QLineEdit* search_entry_ = nullptr;
+    QComboBox* sort_combo_ = nullptr;
+    QProgressBar* progress_bar_ = nullptr;
     QPushButton* dir_button_ = nullptr;
     
-    std::string music_directory_;
+    std::string music_directory_;  // the one chosen with dir_button_
+    std::vector<std::string> music_roots_;  // music_directory_, then the extra ones
     std::string search_filter_;
     std::string last_search_filter_;
-    int last_cols_per_row_ = 0;
+    SortMode sort_mode_ = SortMode::Title;
+    SortMode last_sort_mode_ = SortMode::Title;
     
-    QTimer* relayout_timer_ = nullptr;
     QTimer* search_timer_ = nullptr;
+    QTimer* prefetch_timer_ = nullptr;  // hover dwell
+    QTimer* roots_timer_ = nullptr;  // settles edits of the extra directories
+    Playlist album_playlist_;  // the one titled "Album", once found
+    
+    HookReceiver<AlbumBrowserWidget> playback_hook{"playback begin", this,
+        &AlbumBrowserWidget::playback_started};
+    HookReceiver<AlbumBrowserWidget> begin_hold_hook{"playback begin", this,
+        &AlbumBrowserWidget::hold_scan};
+    HookReceiver<AlbumBrowserWidget> seek_hold_hook{"playback seek", this,
+        &AlbumBrowserWidget::hold_scan};
+    HookReceiver<AlbumBrowserWidget> library_hook{"playlist scan complete", this,
+        &AlbumBrowserWidget::library_scan_complete};
+    HookReceiver<AlbumBrowserWidget> roots_hook{"album-browser roots changed", this,
+        &AlbumBrowserWidget::roots_edited};
+    HookReceiver<AlbumBrowserWidget> rendering_hook{"album-browser rendering changed", this,
+        &AlbumBrowserWidget::apply_rendering};
+    int library_entries_ = -1;  // in the search tool's library when last used
 };
 
 class AlbumBrowserPlugin : public GeneralPlugin
 {
 public:
+    static const char * const defaults[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
+
     static constexpr PluginInfo info = {
         N_("Album Browser"),
         PACKAGE,
         nullptr, // about
-        nullptr, // prefs
+        & prefs,
         PluginQtOnly
     };
 
     constexpr AlbumBrowserPlugin () : GeneralPlugin (info, false) {}
 
+    bool init () override;
     void * get_qt_widget () override;
 };
 
 EXPORT AlbumBrowserPlugin aud_plugin_instance;
 
-// AlbumTile implementation
-AlbumTile::AlbumTile(const Album& album, AlbumBrowserWidget* browser, QWidget* parent)
-    : QWidget(parent), album_(album), browser_(browser)
-{
-    setFixedSize(200, 250);
-    setMouseTracking(true);
-    setCursor(Qt::PointingHandCursor);
-    
-    // Set style for hover effect
-    setStyleSheet(
-        "AlbumTile {"
-        "  border-radius: 8px;"
-        "  padding: 5px;"
-        "}"
-        "AlbumTile:hover {"
-        "  background-color: rgba(128, 128, 255, 30);"
-        "}"
-    );
-}
-
-void AlbumTile::enterEvent(QEnterEvent*)
+static void extra_directories_changed ()
 {
-    hovered_ = true;
-    update();
+    hook_call ("album-browser roots changed", nullptr);
 }
 
-void AlbumTile::leaveEvent(QEvent*)
+static void rendering_changed ()
 {
-    hovered_ = false;
-    update();
+    hook_call ("album-browser rendering changed", nullptr);
 }
 
-void AlbumTile::mousePressEvent(QMouseEvent* event)
-{
-    if (event->button() == Qt::LeftButton)
-    {
-        browser_->add_album_to_playlist(album_, true);
-    }
-    else if (event->button() == Qt::RightButton)
-    {
-        browser_->add_album_to_playlist(album_, false);
-    }
-    QWidget::mousePressEvent(event);
-}
+const char * const AlbumBrowserPlugin::defaults[] = {
+    "scan_threads", "0",
+    "background_scan", "TRUE",
+    "scan_read_kib", "0",
+    "monitor", "TRUE",
+    "thumbnail_threads", "2",
+    "thumbnail_cache_mb", "200",
+    "pixmap_cache_mb", "128",
+    "name_patterns", "",
+    "cover_names", Scanner::DEFAULT_COVER_NAMES,
+    "group_by_tags", "FALSE",
+    "scan_settings", "",
+    "sort_mode", "0",
+    "fast_add", "FALSE",
+    "prefetch", "TRUE",
+    "gpu_grid", "FALSE",
+    "use_search_library", "FALSE",
+    "music_directory", "",
+    "extra_directories", "",
+    nullptr
+};
+
+const PreferencesWidget AlbumBrowserPlugin::widgets[] = {
+    WidgetSpin (N_("Scanner threads:"),
+        WidgetInt (CFG_ID, "scan_threads"),
+        {0, 64, 1, N_("(0 = automatic)")}),
+    WidgetCheck (N_("Scan at low priority, pausing when playback starts"),
+        WidgetBool (CFG_ID, "background_scan")),
+    WidgetSpin (N_("Scanner read limit:"),
+        WidgetInt (CFG_ID, "scan_read_kib"),
+        {0, 1048576, 256, N_("KiB/s (0 = unlimited)")}),
+    WidgetSpin (N_("Cover decoding threads:"),
+        WidgetInt (CFG_ID, "thumbnail_threads"),
+        {1, 16, 1}),
+    WidgetSpin (N_("Cover memory limit:"),
+        WidgetInt (CFG_ID, "pixmap_cache_mb"),
+        {8, 4096, 8, N_("MiB")}),
+    WidgetSpin (N_("Cover cache size:"),
+        WidgetInt (CFG_ID, "thumbnail_cache_mb"),
+        {0, 4096, 10, N_("MiB (0 = disabled)")}),
+    WidgetCheck (N_("Monitor music directory for changes"),
+        WidgetBool (CFG_ID, "monitor")),
+    WidgetCheck (N_("Group albums by tags (reads the first track of each)"),
+        WidgetBool (CFG_ID, "group_by_tags")),
+    WidgetCheck (N_("Take albums from the Search Tool library when there is one"),
+        WidgetBool (CFG_ID, "use_search_library")),
+    WidgetCheck (N_("Prepare the album under the pointer for playback"),
+        WidgetBool (CFG_ID, "prefetch")),
+    WidgetCheck (N_("Add albums without reading their tags first"),
+        WidgetBool (CFG_ID, "fast_add")),
+    WidgetCheck (N_("Draw the album grid with OpenGL"),
+        WidgetBool (CFG_ID, "gpu_grid", rendering_changed)),
+    WidgetEntry (N_("Additional music directories (separated by ;):"),
+        WidgetString (CFG_ID, "extra_directories", extra_directories_changed)),
+    WidgetEntry (N_("Directory name patterns:"),
+        WidgetString (CFG_ID, "name_patterns")),
+    WidgetEntry (N_("Cover file names:"),
+        WidgetString (CFG_ID, "cover_names"))
+};
+
+const PluginPreferences AlbumBrowserPlugin::prefs = {{widgets}};
 
 // AlbumBrowserWidget implementation
 AlbumBrowserWidget::AlbumBrowserWidget(QWidget* parent)
-    : QWidget(parent)
+    : QWidget(parent),
+      pixmap_cache_((size_t)std::max(8, aud_get_int(CFG_ID, "pixmap_cache_mb")) << 20)
 {
     setObjectName("AlbumBrowserWidget");
     
+    art_store_ = std::make_unique<ArtStore>(get_cache_dir() + "/album-browser-art");
     scanner_ = std::make_unique<Scanner>();
+    scanner_->set_art_store(art_store_.get());
+    scanner_->set_progress_callback([this](const ScanProgress& progress) {
+        QMetaObject::invokeMethod(this, [this, progress]() {
+            scan_progress(progress);
+        }, Qt::QueuedConnection);
+    });
     
-    // Get music directory
-    const char* home = getenv("HOME");
-    music_directory_ = std::string(home ? home : "") + "/Music";
+    load_roots();
     
     // Create main layout
     auto* main_layout = new QVBoxLayout(this);
@@ -207,50 +298,96 @@ AlbumBrowserWidget::AlbumBrowserWidget(QWidget* parent)
     auto* toolbar = new QHBoxLayout();
     
     // Directory button
-    dir_button_ = new QPushButton("~/Music", this);
+    dir_button_ = new QPushButton(this);
     connect(dir_button_, &QPushButton::clicked, this, &AlbumBrowserWidget::on_dir_button_clicked);
     toolbar->addWidget(dir_button_);
+    update_dir_button();
     
     // Search entry
     search_entry_ = new QLineEdit(this);
     search_entry_->setPlaceholderText("Search albums...");
     search_entry_->setMinimumWidth(300);
+    search_entry_->setToolTip("Words match title, artist, year, catalog number and path.\n"
+                              "Filters: artist:\"Name\",Other  decade:70s,1980s  format:flac\n"
+                              "cover:yes/no  tracks:5-12");
     connect(search_entry_, &QLineEdit::textChanged, this, &AlbumBrowserWidget::on_search_changed);
     toolbar->addWidget(search_entry_, 1);
     
+    // Sort order
+    sort_combo_ = new QComboBox(this);
+    sort_combo_->addItems({"Title", "Artist", "Year", "Date added", "Most played"});
+    int sort_mode = std::clamp(aud_get_int(CFG_ID, "sort_mode"), 0, AlbumSorter::N_MODES - 1);
+    sort_mode_ = last_sort_mode_ = (SortMode)sort_mode;
+    sort_combo_->setCurrentIndex(sort_mode);
+    connect(sort_combo_, &QComboBox::currentIndexChanged, this, [this](int index) {
+        if (index < 0)
+            return;
+        sort_mode_ = (SortMode)index;
+        aud_set_int(CFG_ID, "sort_mode", index);
+        relayout_grid();
+    });
+    toolbar->addWidget(sort_combo_);
+    
+    // Scan progress, only shown while scanning
+    progress_bar_ = new QProgressBar(this);
+    progress_bar_->setMaximumWidth(200);
+    progress_bar_->setTextVisible(true);
+    progress_bar_->hide();
+    toolbar->addWidget(progress_bar_);
+    
     main_layout->addLayout(toolbar);
     
-    // Create scroll area
-    scroll_area_ = new QScrollArea(this);
-    scroll_area_->setWidgetResizable(true);
-    scroll_area_->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    thumbnails_ = std::make_unique<ThumbnailLoader>(this, AlbumGrid::COVER_SIZE,
+        [this](size_t index, const std::string& directory, QImage image) {
+            thumbnail_ready(index, directory, std::move(image));
+        });
+    thumbnails_->set_thread_count(aud_get_int(CFG_ID, "thumbnail_threads"));
+    thumbnails_->set_art_store(art_store_.get());
     
-    // Create grid container
-    grid_container_ = new QWidget();
-    grid_layout_ = new QGridLayout(grid_container_);
-    grid_layout_->setSpacing(10);
-    grid_layout_->setContentsMargins(10, 10, 10, 10);
+    int cache_mb = aud_get_int(CFG_ID, "thumbnail_cache_mb");
+    if (cache_mb > 0)
+    {
+        thumbnail_cache_ = std::make_unique<ThumbnailCache>(get_cache_dir(),
+            (uint64_t)cache_mb << 20);
+        thumbnails_->set_disk_cache(thumbnail_cache_.get());
+    }
     
-    scroll_area_->setWidget(grid_container_);
-    main_layout->addWidget(scroll_area_);
+    // Create the grid; only visible tiles are ever painted
+    model_ = new AlbumModel(albums_, [this](size_t index, int row) {
+        return cover_for(index, row);
+    }, this);
     
-    // Create timers
-    relayout_timer_ = new QTimer(this);
-    relayout_timer_->setSingleShot(true);
-    relayout_timer_->setInterval(100);
-    connect(relayout_timer_, &QTimer::timeout, this, &AlbumBrowserWidget::relayout_grid);
+    grid_view_ = new AlbumGridView(this);
+    grid_view_->setModel(model_);
+    grid_view_->set_click_callback([this](int row, bool left_button) {
+        tile_clicked(row, left_button);
+    });
+    grid_view_->set_hover_callback([this](int row) { tile_hovered(row); });
+    apply_rendering();
+    main_layout->addWidget(grid_view_);
+    
+    connect(grid_view_->verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &AlbumBrowserWidget::cancel_offscreen_thumbnails);
     
+    // Create timers
     search_timer_ = new QTimer(this);
     search_timer_->setSingleShot(true);
     search_timer_->setInterval(300);
     connect(search_timer_, &QTimer::timeout, this, &AlbumBrowserWidget::filter_albums);
     
-    // Load cache and start scan
-    load_cache();
-    if (!albums_.empty())
-        relayout_grid();
+    prefetch_timer_ = new QTimer(this);
+    prefetch_timer_->setSingleShot(true);
+    prefetch_timer_->setInterval(400);
+    connect(prefetch_timer_, &QTimer::timeout, this, &AlbumBrowserWidget::prefetch_hovered);
     
-    refresh_albums();
+    roots_timer_ = new QTimer(this);
+    roots_timer_->setSingleShot(true);
+    roots_timer_->setInterval(1000);
+    connect(roots_timer_, &QTimer::timeout, this, &AlbumBrowserWidget::apply_roots);
+    
+    // Load cache and start scan (once the cache is in, if there is one)
+    if (!load_cache())
+        refresh_albums();
 }
 
 AlbumBrowserWidget::~AlbumBrowserWidget()
@@ -259,6 +396,16 @@ AlbumBrowserWidget::~AlbumBrowserWidget()
         scanner_->cancel();
     
     stop_file_monitor();
+    
+    if (!dirty_roots_.empty() && !cache_reader_.is_open())
+        save_cache();
+    
+    AUDINFO("Cover memory cache: %d hits, %d misses, %d pixmaps in %d KiB\n",
+            (int)pixmap_cache_.hits(), (int)pixmap_cache_.misses(),
+            (int)pixmap_cache_.size(), (int)(pixmap_cache_.bytes() >> 10));
+    if (thumbnail_cache_)
+        AUDINFO("Cover disk cache: %d hits, %d misses\n",
+                (int)thumbnail_cache_->hits(), (int)thumbnail_cache_->misses());
 }
 
 void AlbumBrowserWidget::refresh_albums()
@@ -266,24 +413,187 @@ void AlbumBrowserWidget::refresh_albums()
     if (scanner_->is_scanning())
         return;
     
-    scanner_->scan_async(music_directory_, [this](std::vector<Album> albums) {
-        QMetaObject::invokeMethod(this, [this, albums]() {
-            update_albums(albums);
+    configure_scanner();
+    
+    // Albums named under other patterns or another mode must all be
+    // processed again
+    String patterns = aud_get_str(CFG_ID, "name_patterns");
+    bool tag_mode = aud_get_bool(CFG_ID, "group_by_tags");
+    String covers = aud_get_str(CFG_ID, "cover_names");
+    bool use_library = aud_get_bool(CFG_ID, "use_search_library");
+    std::string settings = std::string(patterns) + (tag_mode ? "\ntags" : "") +
+                           (use_library ? "\nlibrary" : "");
+    if (strcmp(covers, Scanner::DEFAULT_COVER_NAMES))
+        settings += std::string("\ncovers=") + (const char*)covers;
+    bool settings_changed = settings != (const char*)aud_get_str(CFG_ID, "scan_settings");
+    
+    set_name_patterns((const char*)patterns);
+    scanner_->set_tag_mode(tag_mode);
+    scanner_->set_cover_names((const char*)covers);
+    aud_set_str(CFG_ID, "scan_settings", settings.c_str());
+    
+    auto callback = scan_callback();
+    
+    // The library has every tag read already, so nothing is walked and
+    // no track is opened
+    std::vector<LibraryTrack> tracks;
+    if (use_library && collect_library_tracks(tracks))
+    {
+        scanner_->scan_library_async(music_roots_, std::move(tracks), callback);
+        return;
+    }
+    
+    // Albums restored from the cache carry their directory stamps, so
+    // only directories that changed since then need to be processed
+    if (!albums_.empty() && !settings_changed)
+        scanner_->scan_incremental_async(music_roots_, albums_, callback);
+    else if (!albums_.empty())
+        scanner_->scan_async(music_roots_, callback);
+    else
+    {
+        // Nothing to show yet, so show albums as soon as they are found
+        streaming_ = true;
+        scanner_->scan_async(music_roots_, callback,
+                             scan_callback(&AlbumBrowserWidget::append_albums));
+    }
+}
+
+Scanner::ScanCallback AlbumBrowserWidget::scan_callback(AlbumReceiver receiver)
+{
+    // The queued functor has to be copyable; the shared pointer lets the
+    // result move from the scan thread to the GUI thread without a copy
+    return [this, receiver](std::vector<Album>&& albums) {
+        auto result = std::make_shared<std::vector<Album>>(std::move(albums));
+        QMetaObject::invokeMethod(this, [this, receiver, result]() {
+            (this->*receiver)(std::move(*result));
         }, Qt::QueuedConnection);
-    });
+    };
 }
 
-void AlbumBrowserWidget::update_albums(std::vector<Album> albums)
+void AlbumBrowserWidget::scan_progress(const ScanProgress& progress)
 {
-    albums_ = albums;
-    pixbuf_cache_.clear();
-    save_cache();
-    relayout_grid();
+    const ScanStats& stats = progress.stats;
+    
+    switch (progress.phase)
+    {
+    case ScanProgress::Walking:
+        // Busy indicator until the number of albums is known
+        progress_bar_->setRange(0, 0);
+        progress_bar_->setFormat(QString("Found %1 albums").arg(stats.albums_found));
+        progress_bar_->show();
+        break;
+    case ScanProgress::Processing:
+        progress_bar_->setRange(0, (int)stats.albums_found);
+        progress_bar_->setValue((int)stats.albums_done);
+        progress_bar_->setFormat("%v / %m albums");
+        progress_bar_->show();
+        break;
+    case ScanProgress::Done:
+        progress_bar_->hide();
+        break;
+    }
 }
 
-void AlbumBrowserWidget::resizeEvent(QResizeEvent*)
+void AlbumBrowserWidget::append_albums(std::vector<Album>&& albums)
 {
-    relayout_timer_->start();
+    // Batches are queued before the final result, which ends streaming
+    if (!streaming_)
+        return;
+    
+    for (auto& album : albums)
+    {
+        mark_dirty(album.directory_path);
+        albums_.push_back(std::move(album));
+    }
+    
+    // Appending keeps the search index and the sorter; the relayout is
+    // coalesced with the search timer so batches do not reset the grid
+    // one after another
+    albums_dirty_ = true;
+    if (!search_timer_->isActive())
+        search_timer_->start();
+}
+
+void AlbumBrowserWidget::update_albums(std::vector<Album>&& albums)
+{
+    streaming_ = false;
+    
+    // Only albums that were added, removed or changed lose their cached
+    // cover; if nothing visible changed there is no relayout at all
+    std::unordered_map<std::string, const Album*> old_albums;
+    old_albums.reserve(albums_.size());
+    for (const auto& album : albums_)
+        old_albums.emplace(album.directory_path, &album);
+    
+    bool changed = (albums.size() != albums_.size());
+    
+    for (size_t i = 0; i < albums.size(); i++)
+    {
+        auto it = old_albums.find(albums[i].directory_path);
+        
+        // Rescanned albums keep their history
+        if (it != old_albums.end())
+        {
+            if (it->second->date_added)
+                albums[i].date_added = it->second->date_added;
+            albums[i].play_count = it->second->play_count;
+        }
+        
+        if (it != old_albums.end() && it->second->same_content(albums[i]))
+        {
+            const Album& old = *it->second;
+            // Past the end of the old list every album has moved
+            if (i >= albums_.size() || &old != &albums_[i])
+            {
+                changed = true;  // moved within the grid
+                mark_dirty(albums[i].directory_path);
+            }
+            else if (old.dir_mtime != albums[i].dir_mtime || old.dir_inode != albums[i].dir_inode ||
+                     old.cover_mtime != albums[i].cover_mtime ||
+                     old.cover_size != albums[i].cover_size)
+                mark_dirty(albums[i].directory_path);
+            
+            old_albums.erase(it);
+            continue;
+        }
+        
+        changed = true;
+        mark_dirty(albums[i].directory_path);
+        pixmap_cache_.erase(albums[i].directory_path);
+    }
+    
+    // Whatever is left has been removed or replaced
+    for (const auto& entry : old_albums)
+    {
+        mark_dirty(entry.first);
+        pixmap_cache_.erase(entry.first);
+    }
+    
+    albums_ = std::move(albums);
+    
+    // Embedded art of tracks no album holds any more is dropped; the index
+    // is written with the next scan, or on exit
+    std::unordered_set<std::string> album_dirs;
+    album_dirs.reserve(albums_.size());
+    for (const auto& album : albums_)
+        album_dirs.insert(album.directory_path);
+    art_store_->prune(music_roots_, album_dirs);
+    
+    search_index_.clear(music_roots_);
+    facets_.clear();
+    sorter_.clear();
+    save_cache();
+    
+    if (changed)
+    {
+        albums_dirty_ = true;
+        relayout_grid();
+    }
+    
+    // Watch the directories of the new album set, then pick up anything
+    // that changed while the scan was running
+    setup_file_monitor();
+    rescan_changed();
 }
 
 void AlbumBrowserWidget::on_search_changed(const QString& text)
@@ -300,212 +610,446 @@ void AlbumBrowserWidget::on_dir_button_clicked()
         QString::fromStdString(music_directory_)
     );
     
-    if (!dir.isEmpty())
+    if (!dir.isEmpty() && dir.toStdString() != music_directory_)
+    {
+        aud_set_str(CFG_ID, "music_directory", dir.toUtf8().constData());
+        apply_roots();
+    }
+}
+
+static bool is_below(const std::string& path, const std::string& dir)
+{
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 &&
+           path[dir.size()] == '/';
+}
+
+void AlbumBrowserWidget::mark_dirty(const std::string& directory)
+{
+    for (const auto& root : music_roots_)
     {
-        music_directory_ = dir.toStdString();
+        if (is_below(directory, root))
+        {
+            dirty_roots_.insert(root);
+            return;
+        }
+    }
+}
+
+void AlbumBrowserWidget::load_roots()
+{
+    const char* home = getenv("HOME");
+    std::string home_dir = home ? home : "";
+    
+    String dir = aud_get_str(CFG_ID, "music_directory");
+    music_directory_ = dir[0] ? std::string(dir) : home_dir + "/Music";
+    while (music_directory_.size() > 1 && music_directory_.back() == '/')
+        music_directory_.pop_back();
+    
+    std::vector<std::string> paths = {music_directory_};
+    std::string extra = (const char*)aud_get_str(CFG_ID, "extra_directories");
+    for (size_t start = 0; start <= extra.size();)
+    {
+        size_t end = std::min(extra.find(';', start), extra.size());
+        std::string path = extra.substr(start, end - start);
+        start = end + 1;
         
-        // Update button label
-        QString home = QDir::homePath();
-        QString label = dir;
-        if (label.startsWith(home))
-            label = "~" + label.mid(home.length());
-        dir_button_->setText(label);
+        path.erase(0, path.find_first_not_of(' '));
+        path.erase(path.find_last_not_of(' ') + 1);
+        if (path.compare(0, 2, "~/") == 0)
+            path = home_dir + path.substr(1);
+        while (path.size() > 1 && path.back() == '/')
+            path.pop_back();
         
-        stop_file_monitor();
-        setup_file_monitor();
-        refresh_albums();
+        // Half-typed paths are ignored until they name a directory
+        if (!path.empty() && QDir(QString::fromStdString(path)).exists())
+            paths.push_back(std::move(path));
+    }
+    
+    // A root below another one would list its albums twice
+    music_roots_.clear();
+    for (auto& path : paths)
+    {
+        bool covered = false;
+        for (const auto& root : music_roots_)
+            covered = covered || path == root || is_below(path, root);
+        if (covered)
+            continue;
+        
+        music_roots_.erase(std::remove_if(music_roots_.begin(), music_roots_.end(),
+            [&](const std::string& root) { return is_below(root, path); }), music_roots_.end());
+        music_roots_.push_back(std::move(path));
     }
 }
 
-void AlbumBrowserWidget::relayout_grid()
+void AlbumBrowserWidget::roots_edited()
 {
-    if (albums_.empty())
+    roots_timer_->start();
+}
+
+void AlbumBrowserWidget::apply_rendering()
+{
+    if (!grid_view_->set_gpu_rendering(aud_get_bool(CFG_ID, "gpu_grid")))
+        AUDWARN("Album browser built without OpenGL; drawing the grid in software\n");
+}
+
+void AlbumBrowserWidget::apply_roots()
+{
+    // Play counts since the last save go into the old roots' shards
+    if (!dirty_roots_.empty() && !cache_reader_.is_open())
+        save_cache();
+    
+    std::vector<std::string> old_roots = music_roots_;
+    load_roots();
+    update_dir_button();
+    
+    if (music_roots_ == old_roots)
         return;
     
-    int window_width = scroll_area_->viewport()->width();
-    const int tile_width = 220;
-    int cols_per_row = std::max(1, window_width / tile_width);
+    // Whatever a scan of the old roots finds is of no use now
+    streaming_ = false;
+    scanner_->cancel_and_wait();
+    cache_reader_.close();
+    stop_file_monitor();
+    
+    // Every root that has been scanned before (this time or any earlier
+    // one) comes back from its shard and is then only checked for changes
+    albums_.clear();
+    search_index_.clear(music_roots_);
+    facets_.clear();
+    sorter_.clear();
+    albums_dirty_ = true;
+    relayout_grid();
+    
+    if (!load_cache())
+        refresh_albums();
+}
+
+void AlbumBrowserWidget::update_dir_button()
+{
+    QString home = QDir::homePath();
+    QString label = QString::fromStdString(music_directory_);
+    if (label.startsWith(home))
+        label = "~" + label.mid(home.length());
+    
+    QStringList roots;
+    for (const auto& root : music_roots_)
+        roots.append(QString::fromStdString(root));
     
+    if (music_roots_.size() > 1)
+        label += QString(" +%1").arg(music_roots_.size() - 1);
+    
+    dir_button_->setText(label);
+    dir_button_->setToolTip(roots.join('\n'));
+}
+
+void AlbumBrowserWidget::relayout_grid()
+{
     bool filter_changed = (search_filter_ != last_search_filter_);
-    bool columns_changed = (cols_per_row != last_cols_per_row_);
+    bool sort_changed = (sort_mode_ != last_sort_mode_);
     
-    if (!filter_changed && !columns_changed)
+    if (!albums_dirty_ && !filter_changed && !sort_changed)
         return;
     
-    last_cols_per_row_ = cols_per_row;
+    albums_dirty_ = false;
     last_search_filter_ = search_filter_;
+    last_sort_mode_ = sort_mode_;
     
-    // Clear existing grid
-    while (grid_layout_->count() > 0)
-    {
-        QLayoutItem* item = grid_layout_->takeAt(0);
-        if (item->widget())
-            delete item->widget();
-        delete item;
-    }
+    // The index and the sorter are cleared whenever the list is replaced,
+    // so anything past their end has just been appended
+    for (size_t index = search_index_.size(); index < albums_.size(); index++)
+        search_index_.add(albums_[index]);
+    for (size_t index = sorter_.size(); index < albums_.size(); index++)
+        sorter_.add(albums_[index]);
     
-    // Add matching album tiles
-    int row = 0, col = 0;
-    for (const auto& album : albums_)
+    FacetQuery facets;
+    std::string text;
+    parse_facets(search_filter_, facets, text);
+    
+    std::vector<size_t> rows;
+    if (facets.empty())
+        rows = search_index_.search(text);
+    else
     {
-        if (album_matches_filter(album, search_filter_))
+        for (size_t index = facets_.size(); index < albums_.size(); index++)
+            facets_.add(albums_[index]);
+        
+        AlbumBitset match = facets_.match(facets);
+        if (text.empty())
+            match.to_indices(rows);
+        else
         {
-            auto* tile = new AlbumTile(album, this);
-            auto* tile_layout = new QVBoxLayout(tile);
-            tile_layout->setSpacing(5);
-            tile_layout->setContentsMargins(5, 5, 5, 5);
-            
-            // Cover art
-            QPixmap pixmap = load_cover_art(album);
-            auto* image_label = new QLabel();
-            if (!pixmap.isNull())
-                image_label->setPixmap(pixmap.scaled(180, 180, Qt::KeepAspectRatio, Qt::SmoothTransformation));
-            else
-                image_label->setText("[No Cover]");
-            image_label->setAlignment(Qt::AlignCenter);
-            tile_layout->addWidget(image_label);
-            
-            // Title
-            auto* title_label = new QLabel(QString::fromStdString(album.title));
-            title_label->setWordWrap(true);
-            title_label->setAlignment(Qt::AlignCenter);
-            tile_layout->addWidget(title_label);
-            
-            // Artist
-            if (!album.artist.empty())
+            for (size_t index : search_index_.search(text))
             {
-                auto* artist_label = new QLabel(QString::fromStdString(album.artist));
-                artist_label->setWordWrap(true);
-                artist_label->setAlignment(Qt::AlignCenter);
-                artist_label->setStyleSheet("color: gray; font-size: 90%;");
-                tile_layout->addWidget(artist_label);
-            }
-            
-            tile_layout->addStretch();
-            
-            grid_layout_->addWidget(tile, row, col);
-            
-            col++;
-            if (col >= cols_per_row)
-            {
-                col = 0;
-                row++;
+                if (match.test(index))
+                    rows.push_back(index);
             }
         }
     }
     
-    grid_layout_->addItem(new QSpacerItem(0, 0, QSizePolicy::Minimum, QSizePolicy::Expanding), row + 1, 0);
+    if (rows.size() == albums_.size())
+    {
+        const auto& order = sorter_.order(sort_mode_, albums_);
+        rows.assign(order.begin(), order.end());
+    }
+    else
+    {
+        const auto& ranks = sorter_.ranks(sort_mode_, albums_);
+        std::sort(rows.begin(), rows.end(), [&ranks](size_t a, size_t b) {
+            return ranks[a] < ranks[b];
+        });
+    }
+    
+    // Pending thumbnails refer to album indices, which may have moved
+    thumbnails_->cancel_all();
+    model_->set_rows(std::move(rows));
 }
 
-void AlbumBrowserWidget::filter_albums()
+void AlbumBrowserWidget::tile_clicked(int row, bool left_button)
 {
-    relayout_grid();
+    add_album_to_playlist(albums_[model_->album_index(row)], left_button);
 }
 
-std::string AlbumBrowserWidget::to_lower(const std::string& str)
+// The search tool's playlist, once it is complete
+static Playlist find_library_playlist()
 {
-    return QString::fromStdString(str).toLower().toStdString();
+    for (int p = 0; p < Playlist::n_playlists(); p++)
+    {
+        Playlist playlist = Playlist::by_index(p);
+        if (!strcmp(playlist.get_title(), _("Library")))
+        {
+            if (playlist.add_in_progress() || playlist.scan_in_progress())
+                break;
+            return playlist;
+        }
+    }
+    
+    return Playlist();
 }
 
-bool AlbumBrowserWidget::album_matches_filter(const Album& album, const std::string& filter)
+bool AlbumBrowserWidget::collect_library_tracks(std::vector<LibraryTrack>& tracks)
 {
-    if (filter.empty())
-        return true;
-    
-    std::string filter_lower = to_lower(filter);
-    
-    if (to_lower(album.title).find(filter_lower) != std::string::npos)
-        return true;
-    
-    if (to_lower(album.artist).find(filter_lower) != std::string::npos)
-        return true;
+    Playlist library = find_library_playlist();
+    int entries = library.exists() ? library.n_entries() : 0;
+    if (entries == 0)
+        return false;
     
-    if (to_lower(album.directory_path).find(filter_lower) != std::string::npos)
-        return true;
+    tracks.reserve(entries);
     
-    if (album.year > 0)
+    for (int entry = 0; entry < entries; entry++)
     {
-        std::string year_str = std::to_string(album.year);
-        if (year_str.find(filter) != std::string::npos)
-            return true;
+        StringBuf path = uri_to_filename(library.entry_filename(entry));
+        if (!path)
+            continue;
+        
+        Tuple tuple = library.entry_tuple(entry, Playlist::NoWait);
+        String album = tuple.get_str(Tuple::Album);
+        String artist = tuple.get_str(Tuple::AlbumArtist);
+        if (!artist)
+            artist = tuple.get_str(Tuple::Artist);
+        
+        LibraryTrack track;
+        track.path = std::string(path);
+        track.album = album ? (const char*)album : "";
+        track.artist = artist ? (const char*)artist : "";
+        track.year = std::max(0, tuple.get_int(Tuple::Year));
+        
+        // As with tags read by the scanner, disc 1 of unknown many is none
+        int disc = tuple.get_int(Tuple::Disc);
+        track.disc = (disc > 1) ? disc : 0;
+        tracks.push_back(std::move(track));
     }
     
-    return false;
+    library_entries_ = entries;
+    return true;
+}
+
+// Any playlist may have finished; only a changed library matters
+void AlbumBrowserWidget::library_scan_complete()
+{
+    if (!aud_get_bool(CFG_ID, "use_search_library") || scanner_->is_scanning())
+        return;
+    
+    Playlist library = find_library_playlist();
+    if (library.exists() && library.n_entries() != library_entries_)
+        refresh_albums();
+}
+
+void AlbumBrowserWidget::configure_scanner()
+{
+    scanner_->set_worker_count(aud_get_int(CFG_ID, "scan_threads"));
+    scanner_->set_background(aud_get_bool(CFG_ID, "background_scan"));
+    scanner_->set_read_rate(aud_get_int(CFG_ID, "scan_read_kib"));
+}
+
+// Long enough for the decoder to fill its buffer from a busy disk
+static constexpr int SCAN_HOLD_MS = 3000;
+
+void AlbumBrowserWidget::hold_scan()
+{
+    if (scanner_->is_scanning() && aud_get_bool(CFG_ID, "background_scan"))
+        scanner_->pause_for(SCAN_HOLD_MS);
 }
 
-QPixmap AlbumBrowserWidget::load_cover_art(const Album& album)
+void AlbumBrowserWidget::playback_started()
 {
-    // Check cache first
-    auto cache_it = pixbuf_cache_.find(album.directory_path);
-    if (cache_it != pixbuf_cache_.end())
-        return cache_it->second;
+    String uri = aud_drct_get_filename();
+    StringBuf path = uri ? uri_to_filename(uri) : StringBuf();
+    if (!path)
+        return;
     
-    QPixmap pixmap;
+    // The innermost album directory holding the file (a disc directory
+    // counts towards its album)
+    Album* playing = nullptr;
+    std::string_view file((const char*)path);
     
-    // Try loading from file
-    if (album.has_cover_art())
+    for (auto& album : albums_)
     {
-        pixmap.load(QString::fromStdString(album.cover_art_path));
+        const std::string& dir = album.directory_path;
+        if (file.size() > dir.size() && file[dir.size()] == '/' &&
+            file.compare(0, dir.size(), dir) == 0 &&
+            (!playing || dir.size() > playing->directory_path.size()))
+            playing = &album;
     }
     
-    // Try embedded art
-    if (pixmap.isNull() && !album.audio_files.empty())
+    if (!playing)
+        return;
+    
+    playing->play_count++;
+    sorter_.invalidate(SortMode::MostPlayed);
+    mark_dirty(playing->directory_path);
+    
+    if (sort_mode_ == SortMode::MostPlayed)
     {
-        String uri = String(filename_to_uri(album.audio_files[0].c_str()));
-        AudArtPtr art = aud_art_request(uri, AUD_ART_DATA);
-        
-        if (art)
-        {
-            auto data = art.data();
-            if (data && data->len() > 0)
-            {
-                pixmap.loadFromData(reinterpret_cast<const uchar*>(data->begin()), data->len());
-            }
-        }
+        albums_dirty_ = true;
+        relayout_grid();
     }
+}
+
+void AlbumBrowserWidget::tile_hovered(int row)
+{
+    // Only a tile the pointer rests on is worth the disk reads
+    if (row >= 0 && aud_get_bool(CFG_ID, "prefetch"))
+        prefetch_timer_->start();
+    else
+        prefetch_timer_->stop();
+}
+
+void AlbumBrowserWidget::prefetch_hovered()
+{
+    int row = grid_view_->hovered_row();
+    if (row >= 0 && row < model_->rowCount())
+        prefetcher_.request(albums_[model_->album_index(row)]);
+}
+
+void AlbumBrowserWidget::filter_albums()
+{
+    relayout_grid();
+}
+
+QVariant AlbumBrowserWidget::cover_for(size_t index, int row)
+{
+    // A cached null pixmap means the album has no usable cover
+    const QPixmap* cached = pixmap_cache_.find(albums_[index].directory_path);
+    if (cached)
+        return QVariant::fromValue(*cached);
+    
+    // Decode in the background; tiles higher up the grid go first
+    thumbnails_->request(index, albums_[index], -row);
+    return QVariant();
+}
+
+void AlbumBrowserWidget::thumbnail_ready(size_t index, const std::string& directory, QImage image)
+{
+    pixmap_cache_.insert(directory, image.isNull() ? QPixmap() : QPixmap::fromImage(image));
+    
+    if (index < albums_.size() && albums_[index].directory_path == directory)
+        model_->cover_changed(index);
+}
+
+void AlbumBrowserWidget::cancel_offscreen_thumbnails()
+{
+    int first, last;
+    grid_view_->visible_rows(first, last);
     
-    // Cache it
-    pixbuf_cache_[album.directory_path] = pixmap;
+    // Keep what is on screen plus one screen of slack in either direction
+    int slack = last - first;
+    first = std::max(0, first - slack);
+    last = std::min(model_->rowCount(), last + slack);
     
-    return pixmap;
+    std::unordered_set<size_t> wanted;
+    for (int row = first; row < last; row++)
+        wanted.insert(model_->album_index(row));
+    
+    thumbnails_->cancel_unless([&](size_t index) { return wanted.count(index) > 0; });
+}
+
+// A tuple from what the scan already knows, so the playlist does not
+// have to read every file before showing it
+static Tuple album_track_tuple(const Album& album, size_t track, const char* uri)
+{
+    int number;
+    std::string title;
+    parse_track_name(album.track_name(track), number, title);
+    
+    Tuple tuple;
+    tuple.set_filename(uri);
+    tuple.set_str(Tuple::Title, title.c_str());
+    tuple.set_str(Tuple::Album, album.title.c_str());
+    
+    std::string artist = album.get_display_artist();
+    if (!artist.empty())
+        tuple.set_str(Tuple::Artist, artist.c_str());
+    if (number > 0)
+        tuple.set_int(Tuple::Track, number);
+    if (album.year > 0)
+        tuple.set_int(Tuple::Year, album.year);
+    if (album.disc > 0)
+        tuple.set_int(Tuple::Disc, album.disc);
+    
+    tuple.set_state(Tuple::Valid);
+    return tuple;
+}
+
+Playlist AlbumBrowserWidget::find_album_playlist()
+{
+    // Looked up again only if it was deleted or renamed meanwhile
+    if (album_playlist_.exists() && !strcmp(album_playlist_.get_title(), "Album"))
+        return album_playlist_;
+    
+    int n_playlists = Playlist::n_playlists();
+    for (int i = 0; i < n_playlists; i++)
+    {
+        Playlist pl = Playlist::by_index(i);
+        if (strcmp(pl.get_title(), "Album") == 0)
+            return album_playlist_ = pl;
+    }
+    
+    album_playlist_ = Playlist::new_playlist();
+    album_playlist_.set_title("Album");
+    return album_playlist_;
 }
 
 void AlbumBrowserWidget::add_album_to_playlist(const Album& album, bool clear_first)
 {
+    bool fast_add = aud_get_bool(CFG_ID, "fast_add");
+    
     Index<PlaylistAddItem> items;
-    for (const auto& file : album.audio_files)
+    for (size_t i = 0; i < album.n_tracks(); i++)
     {
-        String uri = String(filename_to_uri(file.c_str()));
-        items.append(uri);
+        String uri = String(filename_to_uri(album.track_path(i).c_str()));
+        if (fast_add)
+        {
+            Tuple tuple = album_track_tuple(album, i, uri);
+            items.append(std::move(uri), std::move(tuple));
+        }
+        else
+            items.append(std::move(uri));
     }
     
     if (clear_first)
     {
-        Playlist album_playlist;
-        int n_playlists = Playlist::n_playlists();
-        bool found = false;
-        
-        for (int i = 0; i < n_playlists; i++)
-        {
-            Playlist pl = Playlist::by_index(i);
-            if (strcmp(pl.get_title(), "Album") == 0)
-            {
-                album_playlist = pl;
-                found = true;
-                break;
-            }
-        }
-        
-        if (!found)
-        {
-            album_playlist = Playlist::new_playlist();
-            album_playlist.set_title("Album");
-        }
-        
-        bool should_autoplay = false;
-        Playlist playing_playlist = Playlist::playing_playlist();
-        if (playing_playlist.exists() && strcmp(playing_playlist.get_title(), "Album") == 0)
-            should_autoplay = true;
+        Playlist album_playlist = find_album_playlist();
+        bool should_autoplay = (Playlist::playing_playlist() == album_playlist);
         
         album_playlist.remove_all_entries();
         album_playlist.insert_items(0, std::move(items), should_autoplay);
@@ -520,144 +1064,290 @@ void AlbumBrowserWidget::add_album_to_playlist(const Album& album, bool clear_fi
 
 void AlbumBrowserWidget::setup_file_monitor()
 {
-    // Qt file monitoring would go here
-    // For now, skip it
+    if (!aud_get_bool(CFG_ID, "monitor"))
+    {
+        stop_file_monitor();
+        return;
+    }
+    
+    if (!watcher_)
+    {
+        watcher_ = std::make_unique<LibraryWatcher>([this](std::vector<std::string> dirs) {
+            library_changed(std::move(dirs));
+        });
+    }
+    
+    watcher_->watch(music_roots_, albums_);
 }
 
 void AlbumBrowserWidget::stop_file_monitor()
 {
-    // Qt file monitoring cleanup
+    if (watcher_)
+        watcher_->stop();
+    
+    pending_changes_.clear();
+}
+
+void AlbumBrowserWidget::library_changed(std::vector<std::string> dirs)
+{
+    pending_changes_.insert(pending_changes_.end(), dirs.begin(), dirs.end());
+    rescan_changed();
 }
 
-std::string AlbumBrowserWidget::get_cache_path()
+void AlbumBrowserWidget::rescan_changed()
+{
+    // A running scan calls update_albums() when done, which retries
+    if (pending_changes_.empty() || scanner_->is_scanning())
+        return;
+    
+    std::vector<std::string> dirs = std::move(pending_changes_);
+    pending_changes_.clear();
+    
+    configure_scanner();
+    scanner_->scan_subtrees_async(music_roots_, std::move(dirs), albums_, scan_callback());
+}
+
+std::string AlbumBrowserWidget::get_cache_dir()
 {
     QString cache_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
     QDir().mkpath(cache_dir);
-    return (cache_dir + "/album-browser-cache.dat").toStdString();
+    return cache_dir.toStdString();
+}
+
+// Caches written before there was one per root; read in place of the
+// first root's shard and removed once that has been written
+static constexpr const char* LEGACY_CACHE_NAME = "/album-browser-cache.dat";
+
+std::string AlbumBrowserWidget::get_cache_path(const std::string& root)
+{
+    // FNV-1a, so the name of a root's shard stays the same across builds
+    uint64_t hash = 14695981039346656037u;
+    for (unsigned char c : root)
+        hash = (hash ^ c) * 1099511628211u;
+    
+    char name[64];
+    snprintf(name, sizeof name, "/album-browser-cache-%016llx.dat", (unsigned long long)hash);
+    return get_cache_dir() + name;
 }
 
 void AlbumBrowserWidget::save_cache()
 {
-    std::string cache_file = get_cache_path();
-    std::ofstream out(cache_file, std::ios::binary);
+    // Shards that could not be written last time are tried again
+    for (auto& root : cache_writer_.take_failed())
+        dirty_roots_.insert(std::move(root));
     
-    if (!out.is_open())
+    if (dirty_roots_.empty())
         return;
     
-    uint32_t version = 1;
-    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    QElapsedTimer timer;
+    timer.start();
     
-    uint32_t dir_len = music_directory_.length();
-    out.write(reinterpret_cast<const char*>(&dir_len), sizeof(dir_len));
-    out.write(music_directory_.c_str(), dir_len);
+    for (size_t index = sorter_.size(); index < albums_.size(); index++)
+        sorter_.add(albums_[index]);
     
-    uint32_t album_count = albums_.size();
-    out.write(reinterpret_cast<const char*>(&album_count), sizeof(album_count));
+    std::vector<std::vector<uint32_t>> orders;
+    for (int mode = 0; mode < AlbumSorter::N_MODES; mode++)
+        orders.push_back(sorter_.order((SortMode)mode, albums_));
     
-    for (const auto& album : albums_)
+    // Every root keeps a shard of its own, and only the shards of roots
+    // where something changed are written again.  Shards of roots that
+    // have been removed are left alone: switching back to one is an
+    // incremental scan, not a full one.
+    std::vector<AlbumCache::Writer::Shard> shards;
+    std::vector<int> shard(albums_.size(), -1);
+    std::vector<uint32_t> position(albums_.size());
+    
+    for (const auto& root : music_roots_)
     {
-        uint32_t len = album.directory_path.length();
-        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
-        out.write(album.directory_path.c_str(), len);
-        
-        len = album.title.length();
-        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
-        out.write(album.title.c_str(), len);
-        
-        len = album.artist.length();
-        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
-        out.write(album.artist.c_str(), len);
-        
-        out.write(reinterpret_cast<const char*>(&album.year), sizeof(album.year));
-        
-        len = album.cover_art_path.length();
-        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
-        out.write(album.cover_art_path.c_str(), len);
-        
-        uint32_t file_count = album.audio_files.size();
-        out.write(reinterpret_cast<const char*>(&file_count), sizeof(file_count));
-        
-        for (const auto& file : album.audio_files)
+        if (dirty_roots_.count(root))
         {
-            len = file.length();
-            out.write(reinterpret_cast<const char*>(&len), sizeof(len));
-            out.write(file.c_str(), len);
+            shards.emplace_back();
+            shards.back().path = get_cache_path(root);
+            shards.back().root = root;
         }
     }
     
-    out.close();
+    size_t written = 0;
+    
+    for (size_t i = 0; i < albums_.size(); i++)
+    {
+        for (size_t r = 0; r < shards.size(); r++)
+        {
+            if (is_below(albums_[i].directory_path, shards[r].root))
+            {
+                shard[i] = r;
+                position[i] = shards[r].albums.size();
+                shards[r].albums.push_back(albums_[i]);
+                written++;
+                break;
+            }
+        }
+    }
+    
+    for (auto& target : shards)
+        target.orders.resize(orders.size());
+    
+    for (size_t mode = 0; mode < orders.size(); mode++)
+    {
+        for (uint32_t index : orders[mode])
+        {
+            if (shard[index] >= 0)
+                shards[shard[index]].orders[mode].push_back(position[index]);
+        }
+    }
+    
+    // The albums are copied, so that the writer need not hold albums_;
+    // their serialization and the disk are left to it
+    int count = shards.size();
+    cache_writer_.submit(std::move(shards), get_cache_dir() + LEGACY_CACHE_NAME);
+    dirty_roots_.clear();
+    
+    AUDINFO("Queued %d albums in %d of %d shards for the cache in %d ms\n", (int)written,
+            count, (int)music_roots_.size(), (int)timer.elapsed());
 }
 
-void AlbumBrowserWidget::load_cache()
+// Albums materialized before the first layout, enough to fill the window
+static constexpr size_t CACHE_FIRST_SCREEN = 64;
+static constexpr size_t CACHE_CHUNK = 2000;
+
+bool AlbumBrowserWidget::load_cache()
 {
-    std::string cache_file = get_cache_path();
-    std::ifstream in(cache_file, std::ios::binary);
+    // Shards read before a pending write would lose its changes
+    cache_writer_.wait();
     
-    if (!in.is_open())
-        return;
+    cache_timer_.start();
+    cache_roots_ = music_roots_;
+    cache_orders_.clear();
     
-    try {
-        uint32_t version;
-        in.read(reinterpret_cast<char*>(&version), sizeof(version));
-        if (version != 1)
-            return;
-        
-        uint32_t dir_len;
-        in.read(reinterpret_cast<char*>(&dir_len), sizeof(dir_len));
-        std::string cached_dir(dir_len, '\0');
-        in.read(&cached_dir[0], dir_len);
+    albums_.clear();
+    
+    if (!open_next_shard())
+        return false;
+    
+    albums_.reserve(cache_reader_.size());
+    search_index_.clear(music_roots_);
+    facets_.clear();
+    sorter_.clear();
+    
+    // Show the first screen right away, read the rest from the event loop
+    cache_next_ = std::min(cache_reader_.size(), CACHE_FIRST_SCREEN);
+    for (size_t i = 0; i < cache_next_; i++)
+    {
+        Album album;
+        if (cache_reader_.read(i, album))
+            albums_.push_back(std::move(album));
+    }
+    
+    albums_dirty_ = true;
+    relayout_grid();
+    
+    QTimer::singleShot(0, this, &AlbumBrowserWidget::load_cache_chunk);
+    return true;
+}
+
+// Opens the shard of the next root in cache_roots_ that has one
+bool AlbumBrowserWidget::open_next_shard()
+{
+    while (!cache_roots_.empty())
+    {
+        std::string root = std::move(cache_roots_.front());
+        cache_roots_.erase(cache_roots_.begin());
         
-        if (cached_dir != music_directory_)
-            return;
+        bool opened = cache_reader_.open(get_cache_path(root));
+        if (!opened && root == music_directory_)
+        {
+            // Moved into a shard of its own by the next save
+            opened = cache_reader_.open(get_cache_dir() + LEGACY_CACHE_NAME);
+            if (opened)
+                dirty_roots_.insert(root);
+        }
         
-        uint32_t album_count;
-        in.read(reinterpret_cast<char*>(&album_count), sizeof(album_count));
+        // A damaged shard is passed over before any album is built from it;
+        // its albums come back with the next scan
+        if (opened && cache_reader_.root() == root && !cache_reader_.verify_strings())
+        {
+            AUDWARN("Album cache of %s has a bad checksum, rescanning\n", root.c_str());
+            dirty_roots_.insert(root);
+            opened = false;
+        }
         
-        albums_.clear();
-        albums_.reserve(album_count);
+        if (opened && cache_reader_.root() == root)
+        {
+            cache_shard_start_ = albums_.size();
+            cache_next_ = 0;
+            return true;
+        }
         
-        for (uint32_t i = 0; i < album_count; i++)
+        cache_reader_.close();
+    }
+    
+    return false;
+}
+
+void AlbumBrowserWidget::load_cache_chunk()
+{
+    // Closed when the music directories were changed meanwhile
+    if (!cache_reader_.is_open())
+        return;
+    
+    size_t end = std::min(cache_reader_.size(), cache_next_ + CACHE_CHUNK);
+    
+    for (; cache_next_ < end; cache_next_++)
+    {
+        Album album;
+        if (cache_reader_.read(cache_next_, album))
+            albums_.push_back(std::move(album));
+    }
+    
+    if (cache_next_ < cache_reader_.size())
+    {
+        QTimer::singleShot(0, this, &AlbumBrowserWidget::load_cache_chunk);
+        return;
+    }
+    
+    if (cache_shard_start_ == 0 && albums_.size() == cache_reader_.size())
+    {
+        std::vector<uint32_t> order;
+        for (int mode = 0; mode < AlbumSorter::N_MODES; mode++)
         {
-            Album album;
-            uint32_t len;
-            
-            in.read(reinterpret_cast<char*>(&len), sizeof(len));
-            album.directory_path.resize(len);
-            in.read(&album.directory_path[0], len);
-            
-            in.read(reinterpret_cast<char*>(&len), sizeof(len));
-            album.title.resize(len);
-            in.read(&album.title[0], len);
-            
-            in.read(reinterpret_cast<char*>(&len), sizeof(len));
-            album.artist.resize(len);
-            in.read(&album.artist[0], len);
-            
-            in.read(reinterpret_cast<char*>(&album.year), sizeof(album.year));
-            
-            in.read(reinterpret_cast<char*>(&len), sizeof(len));
-            album.cover_art_path.resize(len);
-            in.read(&album.cover_art_path[0], len);
-            
-            uint32_t file_count;
-            in.read(reinterpret_cast<char*>(&file_count), sizeof(file_count));
-            
-            for (uint32_t j = 0; j < file_count; j++)
-            {
-                in.read(reinterpret_cast<char*>(&len), sizeof(len));
-                std::string file(len, '\0');
-                in.read(&file[0], len);
-                album.audio_files.push_back(file);
-            }
-            
-            albums_.push_back(album);
+            if (cache_reader_.read_order(mode, order))
+                cache_orders_.push_back(std::move(order));
         }
     }
-    catch (const std::exception&) {
-        albums_.clear();
+    
+    cache_reader_.close();
+    
+    if (open_next_shard())
+    {
+        QTimer::singleShot(0, this, &AlbumBrowserWidget::load_cache_chunk);
+        return;
     }
     
-    in.close();
+    // Saves sorting the whole list again for every mode; the stored orders
+    // only help when all albums came from a single shard
+    if (cache_orders_.size() == AlbumSorter::N_MODES && albums_.size() == cache_orders_[0].size())
+    {
+        for (size_t index = sorter_.size(); index < albums_.size(); index++)
+            sorter_.add(albums_[index]);
+        
+        for (int mode = 0; mode < AlbumSorter::N_MODES; mode++)
+            sorter_.set_order((SortMode)mode, std::move(cache_orders_[mode]));
+    }
+    cache_orders_.clear();
+    
+    AUDINFO("Read %d albums from the cache in %d ms\n", (int)albums_.size(),
+            (int)cache_timer_.elapsed());
+    
+    albums_dirty_ = true;
+    relayout_grid();
+    
+    refresh_albums();
+}
+
+bool AlbumBrowserPlugin::init()
+{
+    aud_config_set_defaults(CFG_ID, defaults);
+    return true;
 }
 
 void * AlbumBrowserPlugin::get_qt_widget()
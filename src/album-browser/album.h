@@ -20,30 +20,104 @@
 #ifndef ALBUM_H
 #define ALBUM_H
 
+#include "pool.h"
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 
 struct Album {
     std::string directory_path;
     std::string title;
-    std::string artist;
+    PooledString artist;
     int year;  // 0 if not available
+    int disc;  // 0 unless the directory holds one disc of a set
+    std::string catalog;
     std::string cover_art_path;
-    std::vector<std::string> audio_files;
     
-    Album() : year(0) {}
+    // Track file names relative to directory_path, packed back to back
+    // (NUL-terminated) so that a whole album costs two allocations
+    // instead of one full path per track
+    std::string track_names;
+    std::vector<uint32_t> track_offsets;
+    
+    // Modification time (nanoseconds) and inode of directory_path when it
+    // was scanned; incremental scans reuse the album while both match
+    int64_t dir_mtime;
+    uint64_t dir_inode;
+    
+    // Modification time (nanoseconds) and size of cover_art_path
+    int64_t cover_mtime;
+    uint64_t cover_size;
+    
+    // When the album first appeared (seconds since the epoch; the
+    // directory mtime for albums found by the first scan) and how often
+    // it has been played since.  Carried over when the album is rescanned.
+    int64_t date_added;
+    uint32_t play_count;
+    
+    Album() : year(0), disc(0), dir_mtime(0), dir_inode(0), cover_mtime(0), cover_size(0),
+              date_added(0), play_count(0) {}
     
     bool has_cover_art() const {
         return !cover_art_path.empty();
     }
     
     std::string get_display_title() const {
-        return title.empty() ? directory_path : title;
+        if (title.empty())
+            return directory_path;
+        return disc ? title + " (Disc " + std::to_string(disc) + ")" : title;
     }
     
     std::string get_display_artist() const {
         return artist;
     }
+    
+    size_t n_tracks() const {
+        return track_offsets.size();
+    }
+    
+    const char* track_name(size_t i) const {
+        return track_names.c_str() + track_offsets[i];
+    }
+    
+    std::string track_path(size_t i) const {
+        return directory_path + '/' + track_name(i);
+    }
+    
+    // Disc subdirectories (relative) of an album grouped from several
+    // directories; empty for a plain album
+    std::vector<std::string> subdirectories() const {
+        std::vector<std::string> dirs;
+        if (track_names.find('/') == std::string::npos)
+            return dirs;
+        
+        for (size_t i = 0; i < n_tracks(); i++)
+        {
+            const char* name = track_name(i);
+            const char* slash = strchr(name, '/');
+            if (slash && (dirs.empty() || dirs.back().compare(0, std::string::npos, name,
+                                                              slash - name) != 0))
+                dirs.emplace_back(name, slash - name);
+        }
+        
+        return dirs;
+    }
+    
+    // Same album as far as the grid is concerned (stamps are not compared)
+    bool same_content(const Album& other) const {
+        return directory_path == other.directory_path && title == other.title &&
+               artist == other.artist && year == other.year &&
+               disc == other.disc && catalog == other.catalog &&
+               cover_art_path == other.cover_art_path &&
+               track_names == other.track_names;
+    }
+    
+    void add_track(const std::string& name) {
+        track_offsets.push_back(track_names.size());
+        track_names.append(name);
+        track_names.push_back('\0');
+    }
 };
 
 #endif // ALBUM_H
@@ -0,0 +1,640 @@
+/*
+ * artprobe.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "artprobe.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Upper bounds for the structures read in full
+static constexpr uint64_t MAX_PICTURE = 32 << 20;
+static constexpr uint64_t MAX_TAG = 64 << 20;
+
+static constexpr uint32_t FRONT_COVER = 3;
+
+class ProbeFile
+{
+public:
+    explicit ProbeFile(const std::string& path)
+        : fd_(open(path.c_str(), O_RDONLY | O_CLOEXEC)) {}
+    ~ProbeFile()
+    {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+    
+    ProbeFile(const ProbeFile&) = delete;
+    ProbeFile& operator=(const ProbeFile&) = delete;
+    
+    bool is_open() const { return fd_ >= 0; }
+    uint64_t bytes_read() const { return bytes_read_; }
+    
+    uint64_t size() const
+    {
+        off_t end = lseek(fd_, 0, SEEK_END);
+        return end < 0 ? 0 : end;
+    }
+    
+    bool read(uint64_t offset, void* buffer, size_t length) const
+    {
+        ssize_t got = pread(fd_, buffer, length, offset);
+        if (got > 0)
+            bytes_read_ += got;
+        return got == (ssize_t)length;
+    }
+    
+    bool read(uint64_t offset, size_t length, std::string& out) const
+    {
+        out.resize(length);
+        return read(offset, &out[0], length);
+    }
+    
+private:
+    int fd_;
+    mutable uint64_t bytes_read_ = 0;
+};
+
+static uint32_t be32(const unsigned char* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint32_t be24(const unsigned char* p)
+{
+    return (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+}
+
+static uint32_t le32(const unsigned char* p)
+{
+    return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+static uint32_t syncsafe32(const unsigned char* p)
+{
+    return (uint32_t)(p[0] & 0x7f) << 21 | (uint32_t)(p[1] & 0x7f) << 14 |
+           (uint32_t)(p[2] & 0x7f) << 7 | (p[3] & 0x7f);
+}
+
+// Keeps the best picture seen so far: the first front cover, or else the
+// first picture of any type
+class PictureChoice
+{
+public:
+    bool done() const { return is_front_; }
+    bool found() const { return found_; }
+    
+    void offer(uint32_t type, const char* data, size_t length)
+    {
+        if (length == 0 || is_front_ || (found_ && type != FRONT_COVER))
+            return;
+        
+        picture_.assign(data, length);
+        found_ = true;
+        is_front_ = (type == FRONT_COVER);
+    }
+    
+    ProbeResult result(std::string& out)
+    {
+        if (!found_)
+            return ProbeResult::NoArt;
+        
+        out = std::move(picture_);
+        return ProbeResult::Found;
+    }
+    
+private:
+    std::string picture_;
+    bool found_ = false, is_front_ = false;
+};
+
+// The body of a FLAC PICTURE block, as also used (base64 encoded) in Ogg
+// comments
+static bool parse_flac_picture(const std::string& block, PictureChoice& choice)
+{
+    auto p = reinterpret_cast<const unsigned char*>(block.data());
+    size_t size = block.size(), pos = 0;
+    
+    auto field = [&](uint32_t& value) {
+        if (size - pos < 4)
+            return false;
+        value = be32(p + pos);
+        pos += 4;
+        return true;
+    };
+    
+    uint32_t type, mime_length, desc_length, unused, data_length;
+    if (!field(type) || !field(mime_length) || mime_length > size - pos)
+        return false;
+    pos += mime_length;
+    
+    if (!field(desc_length) || desc_length > size - pos)
+        return false;
+    pos += desc_length;
+    
+    // Width, height, depth and colour count
+    for (int i = 0; i < 4; i++)
+        if (!field(unused))
+            return false;
+    
+    if (!field(data_length) || data_length > size - pos)
+        return false;
+    
+    choice.offer(type, block.data() + pos, data_length);
+    return true;
+}
+
+// ID3v2 ----------------------------------------------------------------------
+
+static void remove_unsync(std::string& data)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[out++] = data[i];
+        if ((unsigned char)data[i] == 0xff && i + 1 < data.size() && data[i + 1] == 0)
+            i++;
+    }
+    data.resize(out);
+}
+
+// Offset just past the text terminator for the given ID3 encoding
+static size_t skip_id3_text(const std::string& frame, size_t pos, int encoding)
+{
+    if (encoding == 1 || encoding == 2)  // UTF-16: a 16-bit NUL
+    {
+        for (; pos + 1 < frame.size(); pos += 2)
+            if (!frame[pos] && !frame[pos + 1])
+                return pos + 2;
+        return std::string::npos;
+    }
+    
+    size_t end = frame.find('\0', pos);
+    return end == std::string::npos ? end : end + 1;
+}
+
+static void parse_apic(const std::string& frame, bool v22, PictureChoice& choice)
+{
+    if (frame.size() < 4)
+        return;
+    
+    int encoding = (unsigned char)frame[0];
+    size_t pos;
+    
+    if (v22)
+        pos = 4;  // three-character image format
+    else
+    {
+        pos = frame.find('\0', 1);
+        if (pos == std::string::npos)
+            return;
+        pos++;
+    }
+    
+    if (pos >= frame.size())
+        return;
+    
+    uint32_t type = (unsigned char)frame[pos++];
+    pos = skip_id3_text(frame, pos, encoding);
+    
+    if (pos != std::string::npos && pos < frame.size())
+        choice.offer(type, frame.data() + pos, frame.size() - pos);
+}
+
+// Size of the ID3v2 tag at offset (header and footer included), 0 if none
+static uint64_t id3v2_tag_size(const ProbeFile& file, uint64_t offset)
+{
+    unsigned char header[10];
+    if (!file.read(offset, header, sizeof(header)) || memcmp(header, "ID3", 3))
+        return 0;
+    
+    bool footer = header[3] == 4 && (header[5] & 0x10);
+    return 10 + syncsafe32(header + 6) + (footer ? 10 : 0);
+}
+
+static ProbeResult probe_id3v2(const ProbeFile& file, std::string& out)
+{
+    unsigned char header[10];
+    if (!file.read(0, header, sizeof(header)) || memcmp(header, "ID3", 3))
+        return ProbeResult::NoArt;  // an MP3 without a tag has no picture
+    
+    int version = header[3];
+    int flags = header[5];
+    uint32_t size = syncsafe32(header + 6);
+    
+    if (version < 2 || version > 4 || size > MAX_TAG)
+        return ProbeResult::Failed;
+    
+    // Compression in v2.2 was never specified
+    if (version == 2 && (flags & 0x40))
+        return ProbeResult::Failed;
+    
+    std::string tag;
+    if (!file.read(10, size, tag))
+        return ProbeResult::Failed;
+    
+    // Before v2.4 unsynchronisation applies to the whole tag
+    if (version < 4 && (flags & 0x80))
+        remove_unsync(tag);
+    
+    size_t pos = 0;
+    if (version > 2 && (flags & 0x40) && tag.size() >= 4)
+    {
+        auto p = reinterpret_cast<const unsigned char*>(tag.data());
+        pos = (version == 3) ? 4 + be32(p) : syncsafe32(p);
+    }
+    
+    bool v22 = (version == 2);
+    size_t header_size = v22 ? 6 : 10;
+    PictureChoice choice;
+    
+    while (pos + header_size <= tag.size() && !choice.done())
+    {
+        auto p = reinterpret_cast<const unsigned char*>(tag.data()) + pos;
+        if (!p[0])
+            break;  // padding
+        
+        uint32_t frame_size = v22 ? be24(p + 3) : (version == 4) ? syncsafe32(p + 4) : be32(p + 4);
+        int frame_flags = v22 ? 0 : (p[8] << 8 | p[9]);
+        
+        if (frame_size > tag.size() - pos - header_size)
+            break;
+        
+        bool is_picture = v22 ? !memcmp(p, "PIC", 3) : !memcmp(p, "APIC", 4);
+        
+        if (is_picture)
+        {
+            std::string frame = tag.substr(pos + header_size, frame_size);
+            
+            // Compressed or encrypted frames are left to TagLib
+            bool packed = (version == 3) ? (frame_flags & 0xc0) : (frame_flags & 0x0c);
+            if (packed)
+                return ProbeResult::Failed;
+            
+            if (version == 4)
+            {
+                if ((frame_flags & 0x01) && frame.size() >= 4)
+                    frame.erase(0, 4);  // data length indicator
+                if (frame_flags & 0x02)
+                    remove_unsync(frame);
+            }
+            
+            parse_apic(frame, v22, choice);
+        }
+        
+        pos += header_size + frame_size;
+    }
+    
+    return choice.result(out);
+}
+
+// FLAC -----------------------------------------------------------------------
+
+static ProbeResult probe_flac(const ProbeFile& file, std::string& out)
+{
+    // Some taggers put an ID3v2 tag in front of the stream
+    uint64_t pos = id3v2_tag_size(file, 0);
+    
+    char magic[4];
+    if (!file.read(pos, magic, sizeof(magic)) || memcmp(magic, "fLaC", 4))
+        return ProbeResult::Failed;
+    
+    pos += 4;
+    PictureChoice choice;
+    unsigned char header[4];
+    
+    while (!choice.done() && file.read(pos, header, sizeof(header)))
+    {
+        bool last = header[0] & 0x80;
+        int type = header[0] & 0x7f;
+        uint32_t length = be24(header + 1);
+        pos += 4;
+        
+        if (type == 6 && length <= MAX_PICTURE)
+        {
+            std::string block;
+            if (!file.read(pos, length, block) || !parse_flac_picture(block, choice))
+                return ProbeResult::Failed;
+        }
+        
+        pos += length;
+        if (last)
+            break;
+    }
+    
+    return choice.result(out);
+}
+
+// Ogg ------------------------------------------------------------------------
+
+static bool decode_base64(const char* in, size_t length, std::string& out)
+{
+    static signed char table[256];
+    static bool ready = [] {
+        memset(table, -1, sizeof(table));
+        const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; i++)
+            table[(unsigned char)chars[i]] = i;
+        return true;
+    }();
+    (void)ready;
+    
+    out.clear();
+    out.reserve(length / 4 * 3);
+    
+    uint32_t bits = 0;
+    int count = 0;
+    
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = in[i];
+        if (c == '=')
+            break;
+        if (table[c] < 0)
+            return false;
+        
+        bits = bits << 6 | table[c];
+        if (++count == 4)
+        {
+            out.push_back(bits >> 16);
+            out.push_back(bits >> 8);
+            out.push_back(bits);
+            bits = 0;
+            count = 0;
+        }
+    }
+    
+    if (count == 3)
+    {
+        out.push_back(bits >> 10);
+        out.push_back(bits >> 2);
+    }
+    else if (count == 2)
+        out.push_back(bits >> 4);
+    
+    return count != 1;
+}
+
+// Reads the first `wanted` packets of the first logical stream
+static bool read_ogg_packets(const ProbeFile& file, size_t wanted,
+                             std::vector<std::string>& packets)
+{
+    uint64_t pos = 0, total = 0;
+    uint32_t serial = 0;
+    std::string packet;
+    
+    while (packets.size() < wanted)
+    {
+        unsigned char header[27];
+        if (!file.read(pos, header, sizeof(header)) || memcmp(header, "OggS", 4))
+            return false;
+        
+        uint32_t page_serial = le32(header + 14);
+        if (pos == 0)
+            serial = page_serial;
+        
+        int n_segments = header[26];
+        unsigned char segments[255];
+        if (!file.read(pos + 27, segments, n_segments))
+            return false;
+        
+        uint64_t data_pos = pos + 27 + n_segments;
+        uint64_t page_size = 0;
+        for (int i = 0; i < n_segments; i++)
+            page_size += segments[i];
+        
+        // Pages of other multiplexed streams are skipped
+        if (page_serial == serial)
+        {
+            uint64_t offset = data_pos;
+            for (int i = 0; i < n_segments && packets.size() < wanted; i++)
+            {
+                total += segments[i];
+                if (total > MAX_TAG)
+                    return false;
+                
+                std::string piece;
+                if (!file.read(offset, segments[i], piece))
+                    return false;
+                
+                packet += piece;
+                offset += segments[i];
+                
+                // A segment shorter than 255 bytes ends the packet
+                if (segments[i] < 255)
+                {
+                    packets.push_back(std::move(packet));
+                    packet.clear();
+                }
+            }
+        }
+        
+        pos = data_pos + page_size;
+    }
+    
+    return true;
+}
+
+static bool key_matches(const char* comment, size_t length, const char* key)
+{
+    size_t key_length = strlen(key);
+    if (length <= key_length || comment[key_length] != '=')
+        return false;
+    
+    for (size_t i = 0; i < key_length; i++)
+        if (toupper((unsigned char)comment[i]) != key[i])
+            return false;
+    
+    return true;
+}
+
+static ProbeResult probe_ogg(const ProbeFile& file, std::string& out)
+{
+    std::vector<std::string> packets;
+    if (!read_ogg_packets(file, 2, packets))
+        return ProbeResult::Failed;
+    
+    const std::string& ident = packets[0];
+    const std::string& comments = packets[1];
+    size_t pos;
+    
+    if (!ident.compare(0, 7, "\x01vorbis") && !comments.compare(0, 7, "\x03vorbis"))
+        pos = 7;
+    else if (!ident.compare(0, 8, "OpusHead") && !comments.compare(0, 8, "OpusTags"))
+        pos = 8;
+    else
+        return ProbeResult::Failed;  // Ogg FLAC, Speex, Theora...
+    
+    auto p = reinterpret_cast<const unsigned char*>(comments.data());
+    size_t size = comments.size();
+    
+    if (size - pos < 4 || le32(p + pos) > size - pos - 4)
+        return ProbeResult::Failed;
+    pos += 4 + le32(p + pos);  // vendor string
+    
+    if (size - pos < 4)
+        return ProbeResult::Failed;
+    uint32_t count = le32(p + pos);
+    pos += 4;
+    
+    PictureChoice choice;
+    std::string decoded;
+    
+    for (uint32_t i = 0; i < count && !choice.done(); i++)
+    {
+        if (size - pos < 4 || le32(p + pos) > size - pos - 4)
+            return ProbeResult::Failed;
+        
+        uint32_t length = le32(p + pos);
+        const char* comment = comments.data() + pos + 4;
+        pos += 4 + length;
+        
+        if (key_matches(comment, length, "METADATA_BLOCK_PICTURE"))
+        {
+            size_t key = strlen("METADATA_BLOCK_PICTURE") + 1;
+            if (decode_base64(comment + key, length - key, decoded))
+                parse_flac_picture(decoded, choice);
+        }
+        else if (key_matches(comment, length, "COVERART"))
+        {
+            // The older, unofficial field: a bare base64 image
+            size_t key = strlen("COVERART") + 1;
+            if (decode_base64(comment + key, length - key, decoded))
+                choice.offer(0, decoded.data(), decoded.size());
+        }
+    }
+    
+    return choice.result(out);
+}
+
+// MP4 ------------------------------------------------------------------------
+
+// Finds the child atom of the given type within [begin, end) and returns
+// the range of its payload
+static bool find_atom(const ProbeFile& file, uint64_t begin, uint64_t end, const char* type,
+                      uint64_t& payload, uint64_t& payload_end)
+{
+    uint64_t pos = begin;
+    
+    while (pos + 8 <= end)
+    {
+        unsigned char header[16];
+        if (!file.read(pos, header, 8))
+            return false;
+        
+        uint64_t size = be32(header);
+        uint64_t header_size = 8;
+        
+        if (size == 1)
+        {
+            if (!file.read(pos + 8, header + 8, 8))
+                return false;
+            size = (uint64_t)be32(header + 8) << 32 | be32(header + 12);
+            header_size = 16;
+        }
+        else if (size == 0)
+            size = end - pos;  // extends to the end of its parent
+        
+        if (size < header_size || size > end - pos)
+            return false;
+        
+        if (!memcmp(header + 4, type, 4))
+        {
+            payload = pos + header_size;
+            payload_end = pos + size;
+            return true;
+        }
+        
+        pos += size;
+    }
+    
+    return false;
+}
+
+static ProbeResult probe_mp4(const ProbeFile& file, std::string& out)
+{
+    uint64_t file_size = file.size();
+    uint64_t begin, end;
+    
+    char ftyp[8];
+    if (!file.read(0, ftyp, sizeof(ftyp)) || memcmp(ftyp + 4, "ftyp", 4))
+        return ProbeResult::Failed;
+    
+    if (!find_atom(file, 0, file_size, "moov", begin, end))
+        return ProbeResult::Failed;
+    if (!find_atom(file, begin, end, "udta", begin, end) ||
+        !find_atom(file, begin, end, "meta", begin, end))
+        return ProbeResult::NoArt;
+    
+    // "meta" is a full box: version and flags come first
+    if (!find_atom(file, begin + 4, end, "ilst", begin, end) ||
+        !find_atom(file, begin, end, "covr", begin, end))
+        return ProbeResult::NoArt;
+    
+    // The first "data" atom holds the picture after type and locale words
+    uint64_t data_begin, data_end;
+    if (!find_atom(file, begin, end, "data", data_begin, data_end) ||
+        data_end - data_begin < 8 || data_end - data_begin - 8 > MAX_PICTURE)
+        return ProbeResult::Failed;
+    
+    if (!file.read(data_begin + 8, data_end - data_begin - 8, out))
+        return ProbeResult::Failed;
+    
+    return out.empty() ? ProbeResult::NoArt : ProbeResult::Found;
+}
+
+static ProbeResult probe_file(const ProbeFile& file, const std::string& ext, std::string& data)
+{
+    data.clear();
+    
+    if (ext == ".flac")
+        return probe_flac(file, data);
+    if (ext == ".mp3")
+        return probe_id3v2(file, data);
+    if (ext == ".ogg" || ext == ".oga" || ext == ".opus")
+        return probe_ogg(file, data);
+    if (ext == ".m4a" || ext == ".mp4")
+        return probe_mp4(file, data);
+    
+    return ProbeResult::Failed;
+}
+
+ProbeResult probe_embedded_art(const std::string& path, std::string& data,
+                               uint64_t* bytes_read)
+{
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos)
+        return ProbeResult::Failed;
+    
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    
+    ProbeFile file(path);
+    if (!file.is_open())
+        return ProbeResult::Failed;
+    
+    ProbeResult result = probe_file(file, ext, data);
+    if (bytes_read)
+        *bytes_read += file.bytes_read();
+    
+    return result;
+}
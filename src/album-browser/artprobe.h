@@ -0,0 +1,43 @@
+/*
+ * artprobe.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef ARTPROBE_H
+#define ARTPROBE_H
+
+#include <cstdint>
+#include <string>
+
+// Finds the cover picture embedded in an audio file by walking only the
+// tag structures that can hold one: FLAC PICTURE blocks, ID3v2 APIC/PIC
+// frames (in MP3 or in front of FLAC), Ogg Vorbis/Opus comment packets
+// with METADATA_BLOCK_PICTURE and MP4 "covr" atoms.  Everything else is
+// skipped with a seek, and every read is bounded, so probing costs a few
+// small reads per file and never a scan of the audio data.  When a file
+// holds several pictures the front cover is preferred.
+enum class ProbeResult {
+    Found,   // data holds the picture
+    NoArt,   // the tags were read and hold no picture
+    Failed   // not a format the probe knows, or a structure it cannot read
+};
+
+// The number of bytes read from the file is added to *bytes_read
+ProbeResult probe_embedded_art(const std::string& path, std::string& data,
+                               uint64_t* bytes_read = nullptr);
+
+#endif // ARTPROBE_H
@@ -0,0 +1,275 @@
+/*
+ * artstore.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "artstore.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libaudcore/runtime.h>
+
+static constexpr uint32_t INDEX_MAGIC = 0x54524142;  // "BART"
+static constexpr uint32_t INDEX_VERSION = 1;
+
+struct IndexRecord {
+    uint64_t size;
+    int64_t mtime;
+    uint32_t path_length;
+    uint32_t image_length;
+};
+
+// FNV-1a, 64-bit
+static uint64_t hash64(const char* data, size_t len)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+    return hash;
+}
+
+// Picks a suffix matching the actual image format
+static const char* image_suffix(const char* data, size_t length)
+{
+    auto starts_with = [&](const char* magic, size_t offset = 0) {
+        size_t len = strlen(magic);
+        return length >= offset + len && !memcmp(data + offset, magic, len);
+    };
+    
+    if (starts_with("\xff\xd8\xff"))
+        return ".jpg";
+    if (starts_with("\x89PNG"))
+        return ".png";
+    if (starts_with("GIF8"))
+        return ".gif";
+    if (starts_with("RIFF") && starts_with("WEBP", 8))
+        return ".webp";
+    if (starts_with("BM"))
+        return ".bmp";
+    
+    return ".img";
+}
+
+bool ArtStore::stat_file(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0)
+        return false;
+    
+#ifdef __APPLE__
+    mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    size = st.st_size;
+    return true;
+}
+
+ArtStore::ArtStore(const std::string& directory)
+    : directory_(directory), index_path_(directory + "/index")
+{
+    mkdir(directory_.c_str(), 0755);
+    load();
+}
+
+void ArtStore::load()
+{
+    FILE* file = fopen(index_path_.c_str(), "rb");
+    if (!file)
+        return;
+    
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, file) != 1 ||
+        header[0] != INDEX_MAGIC || header[1] != INDEX_VERSION)
+    {
+        fclose(file);
+        return;
+    }
+    
+    IndexRecord record;
+    std::string path, image;
+    
+    while (fread(&record, sizeof(record), 1, file) == 1)
+    {
+        path.resize(record.path_length);
+        image.resize(record.image_length);
+        
+        if (fread(&path[0], 1, path.size(), file) != path.size() ||
+            fread(&image[0], 1, image.size(), file) != image.size())
+            break;
+        
+        entries_[path] = {record.size, record.mtime, image};
+    }
+    
+    fclose(file);
+}
+
+void ArtStore::save()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (!dirty_)
+        return;
+    
+    std::string temp_path = index_path_ + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file)
+    {
+        AUDWARN("Cannot write embedded art index %s\n", temp_path.c_str());
+        return;
+    }
+    
+    uint32_t header[2] = {INDEX_MAGIC, INDEX_VERSION};
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+    
+    for (const auto& entry : entries_)
+    {
+        if (!ok)
+            break;
+        
+        IndexRecord record = {entry.second.size, entry.second.mtime,
+                              (uint32_t)entry.first.size(), (uint32_t)entry.second.image.size()};
+        ok = fwrite(&record, sizeof(record), 1, file) == 1 &&
+             fwrite(entry.first.data(), 1, entry.first.size(), file) == entry.first.size() &&
+             fwrite(entry.second.image.data(), 1, entry.second.image.size(), file) ==
+                 entry.second.image.size();
+    }
+    
+    ok = (fclose(file) == 0) && ok;
+    
+    if (!ok || rename(temp_path.c_str(), index_path_.c_str()) < 0)
+    {
+        AUDWARN("Cannot write embedded art index %s\n", index_path_.c_str());
+        unlink(temp_path.c_str());
+        return;
+    }
+    
+    dirty_ = false;
+}
+
+void ArtStore::prune(const std::vector<std::string>& roots,
+                     const std::unordered_set<std::string>& album_dirs)
+{
+    auto orphaned = [&](const std::string& file) {
+        bool below_root = false;
+        for (const auto& root : roots)
+        {
+            if (file.size() > root.size() && file.compare(0, root.size(), root) == 0 &&
+                file[root.size()] == '/')
+                below_root = true;
+        }
+        
+        if (!below_root)
+            return false;
+        
+        for (size_t slash = file.rfind('/'); slash != std::string::npos && slash > 0;
+             slash = file.rfind('/', slash - 1))
+        {
+            if (album_dirs.count(file.substr(0, slash)))
+                return false;
+        }
+        return true;
+    };
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    std::unordered_set<std::string> dropped;
+    for (auto it = entries_.begin(); it != entries_.end();)
+    {
+        if (!orphaned(it->first))
+        {
+            ++it;
+            continue;
+        }
+        
+        if (!it->second.image.empty())
+            dropped.insert(it->second.image);
+        
+        it = entries_.erase(it);
+        dirty_ = true;
+    }
+    
+    if (dropped.empty())
+        return;
+    
+    // Pictures are shared; keep those another file still holds
+    for (const auto& entry : entries_)
+        dropped.erase(entry.second.image);
+    
+    for (const auto& name : dropped)
+        unlink((directory_ + '/' + name).c_str());
+}
+
+bool ArtStore::lookup(const std::string& audio_file, uint64_t size, int64_t mtime,
+                      std::string& image)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = entries_.find(audio_file);
+    if (it == entries_.end() || it->second.size != size || it->second.mtime != mtime)
+        return false;
+    
+    if (it->second.image.empty())
+    {
+        image.clear();
+        return true;
+    }
+    
+    // The image may have been cleaned out of the cache behind our back
+    image = directory_ + '/' + it->second.image;
+    return access(image.c_str(), F_OK) == 0;
+}
+
+std::string ArtStore::store(const std::string& audio_file, uint64_t size, int64_t mtime,
+                            const char* data, size_t length)
+{
+    std::string name;
+    
+    if (length > 0)
+    {
+        char hash[24];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hash64(data, length));
+        name = std::string(hash) + '-' + std::to_string(length) + image_suffix(data, length);
+        
+        // Identical pictures map to the same file, which is written once
+        std::string path = directory_ + '/' + name;
+        if (access(path.c_str(), F_OK) < 0)
+        {
+            static std::atomic<unsigned> serial(0);
+            std::string temp_path = path + ".tmp" + std::to_string(serial++);
+            
+            FILE* file = fopen(temp_path.c_str(), "wb");
+            bool ok = file && fwrite(data, 1, length, file) == length;
+            ok = file && (fclose(file) == 0) && ok;
+            
+            if (!ok || rename(temp_path.c_str(), path.c_str()) < 0)
+            {
+                AUDWARN("Cannot store embedded art in %s\n", path.c_str());
+                unlink(temp_path.c_str());
+                return std::string();
+            }
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[audio_file] = {size, mtime, name};
+    dirty_ = true;
+    
+    return name.empty() ? std::string() : directory_ + '/' + name;
+}
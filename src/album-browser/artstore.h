@@ -0,0 +1,86 @@
+/*
+ * artstore.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef ARTSTORE_H
+#define ARTSTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Embedded cover art extracted from audio files, kept between sessions.
+// Each image is written once under a name derived from its content, so
+// the same picture embedded in every track of an album (or of a whole
+// box set) is stored only once.  An index remembers, for each audio file
+// with its size and modification time, which image it holds or that it
+// holds none; as long as the file is unchanged it is never opened again.
+// Shared by the scanner and the thumbnail loader; all methods may be
+// called from any thread.
+class ArtStore
+{
+public:
+    explicit ArtStore(const std::string& directory);
+    ~ArtStore() { save(); }
+    
+    ArtStore(const ArtStore&) = delete;
+    ArtStore& operator=(const ArtStore&) = delete;
+    
+    // True if the file (as stamped) is known; image is then the path of
+    // its picture, or empty if it has none
+    bool lookup(const std::string& audio_file, uint64_t size, int64_t mtime,
+                std::string& image);
+    
+    // Records the picture found in the file (none if length is 0) and
+    // returns the path it is stored at
+    std::string store(const std::string& audio_file, uint64_t size, int64_t mtime,
+                      const char* data, size_t length);
+    
+    // Forgets the files below the given roots that are in none of the
+    // album directories (or their subdirectories), and deletes the
+    // pictures only they held.  Files outside the roots are kept, as the
+    // cache shards of roots that were removed are.
+    void prune(const std::vector<std::string>& roots,
+               const std::unordered_set<std::string>& album_dirs);
+    
+    // Writes the index if anything has changed
+    void save();
+    
+    // The stamp lookup() and store() expect (mtime in nanoseconds)
+    static bool stat_file(const std::string& path, uint64_t& size, int64_t& mtime);
+    
+private:
+    struct Entry {
+        uint64_t size;
+        int64_t mtime;
+        std::string image;  // file name within directory_, or empty
+    };
+    
+    void load();
+    
+    std::mutex mutex_;
+    std::string directory_, index_path_;
+    bool dirty_ = false;
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+#endif // ARTSTORE_H
@@ -0,0 +1,405 @@
+/*
+ * bench.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+
+// Benchmark for the parts of the album browser that do not need a GUI:
+// generates a synthetic library, then times a full and an incremental
+// scan, the album cache, directory name parsing, searching and sorting.
+// Built with "make -f Makefile.standalone bench".
+
+#include "artstore.h"
+#include "cache.h"
+#include "metadata.h"
+#include "scanner.h"
+#include "search.h"
+#include "sort.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+enum class CoverKind {
+    None,
+    File,
+    Embedded
+};
+
+struct LibraryShape {
+    int artists = 100;
+    int albums = 10;  // per artist
+    int tracks = 10;  // per album
+    int depth = 0;    // directory levels above the artists
+    CoverKind covers = CoverKind::File;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: album-browser-bench [options]\n"
+        "  --artists N      artists in the library (100)\n"
+        "  --albums N       albums per artist (10)\n"
+        "  --tracks N       tracks per album (10)\n"
+        "  --depth N        directory levels above the artists (0)\n"
+        "  --covers KIND    none, file or embedded (file)\n"
+        "  --threads N      scanner threads, 0 = one per core (0)\n"
+        "  --read-rate N    scanner read limit in KiB/s, 0 = none (0)\n"
+        "  --foreground     scan at normal priority\n"
+        "  --dir PATH       where to generate the library (a temporary directory)\n"
+        "  --keep           do not delete the library afterwards\n");
+}
+
+static double now_ms()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Peak resident set size in KiB
+static long peak_rss_kib()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss >> 10;  // bytes
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static void report(const char* what, double ms, size_t items, const char* unit)
+{
+    printf("%-24s %10.1f ms %12.0f %s/s   peak RSS %ld MiB\n", what, ms,
+           ms > 0 ? items * 1000.0 / ms : 0.0, unit, peak_rss_kib() >> 10);
+}
+
+static void write_file(const fs::path& path, const std::string& data)
+{
+    std::ofstream out(path, std::ios::binary);
+    out.write(data.data(), data.size());
+}
+
+static void put_be32(std::string& out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((char)(value >> shift));
+}
+
+// Some bytes that look enough like a JPEG for the art store to name it
+static std::string fake_picture(int seed, size_t size)
+{
+    std::string data = "\xff\xd8\xff\xe0";
+    for (size_t i = data.size(); i < size; i++)
+        data.push_back((char)((i * 31 + seed * 17) & 0xff));
+    return data;
+}
+
+// A FLAC stream header with an empty STREAMINFO block and, optionally, a
+// front cover PICTURE block; no audio frames
+static std::string fake_flac(const std::string* picture)
+{
+    std::string data = "fLaC";
+    data.push_back(picture ? 0x00 : (char)0x80);
+    data.append("\x00\x00\x22", 3);
+    data.append(34, '\0');
+    
+    if (picture)
+    {
+        std::string block;
+        put_be32(block, 3);  // front cover
+        put_be32(block, 10);
+        block.append("image/jpeg");
+        put_be32(block, 0);
+        for (int i = 0; i < 4; i++)
+            put_be32(block, 0);
+        put_be32(block, picture->size());
+        block.append(*picture);
+        
+        data.push_back((char)0x86);
+        data.push_back((char)(block.size() >> 16));
+        data.push_back((char)(block.size() >> 8));
+        data.push_back((char)block.size());
+        data.append(block);
+    }
+    
+    return data;
+}
+
+static size_t generate_library(const fs::path& root, const LibraryShape& shape)
+{
+    size_t n_albums = 0;
+    char name[256];
+    
+    for (int a = 0; a < shape.artists; a++)
+    {
+        fs::path artist_dir = root;
+        for (int level = 0; level < shape.depth; level++)
+        {
+            snprintf(name, sizeof(name), "Level %d-%d", level, a % (level + 2));
+            artist_dir /= name;
+        }
+        
+        snprintf(name, sizeof(name), "Artist %04d", a);
+        artist_dir /= name;
+        
+        for (int b = 0; b < shape.albums; b++)
+        {
+            snprintf(name, sizeof(name), "(%d) Album %04d-%02d [CAT-%05d]", 1960 + (a + b) % 60,
+                     a, b, a * shape.albums + b);
+            fs::path album_dir = artist_dir / name;
+            fs::create_directories(album_dir);
+            
+            std::string picture = fake_picture(a * shape.albums + b, 8192);
+            if (shape.covers == CoverKind::File)
+                write_file(album_dir / "cover.jpg", picture);
+            
+            // One picture for the whole album, as taggers do
+            std::string track = fake_flac(shape.covers == CoverKind::Embedded ? &picture : nullptr);
+            for (int t = 0; t < shape.tracks; t++)
+            {
+                snprintf(name, sizeof(name), "%02d - Track %02d.flac", t + 1, t + 1);
+                write_file(album_dir / name, track);
+            }
+            
+            n_albums++;
+        }
+    }
+    
+    return n_albums;
+}
+
+static std::vector<Album> run_scan(Scanner& scanner, const std::string& root,
+                                   std::vector<Album>* previous)
+{
+    std::promise<std::vector<Album>> result;
+    auto callback = [&result](std::vector<Album>&& albums) {
+        result.set_value(std::move(albums));
+    };
+    
+    if (previous)
+        scanner.scan_incremental_async({root}, *previous, callback);
+    else
+        scanner.scan_async({root}, callback);
+    
+    return result.get_future().get();
+}
+
+struct ScanOptions {
+    int threads = 0;
+    int read_rate = 0;
+    bool background = true;
+};
+
+static int run_benchmark(const fs::path& base, const std::string& root, const ScanOptions& options)
+{
+    std::string cache_path = (base / "albums.dat").string();
+    
+    ArtStore art_store((base / "art").string());
+    Scanner scanner;
+    scanner.set_worker_count(options.threads);
+    scanner.set_background(options.background);
+    scanner.set_read_rate(options.read_rate);
+    scanner.set_art_store(&art_store);
+    
+    double start = now_ms();
+    std::vector<Album> albums = run_scan(scanner, root, nullptr);
+    report("full scan", now_ms() - start, albums.size(), "albums");
+    
+    ScanStats stats = scanner.get_stats();
+    printf("  %llu directories, %llu filesystem calls, %llu KiB read for embedded art\n",
+           (unsigned long long)stats.directories_listed, (unsigned long long)stats.syscalls,
+           (unsigned long long)(stats.bytes_read >> 10));
+    
+    start = now_ms();
+    albums = run_scan(scanner, root, &albums);
+    report("incremental scan", now_ms() - start, albums.size(), "albums");
+    
+    AlbumSorter sorter;
+    start = now_ms();
+    for (const auto& album : albums)
+        sorter.add(album);
+    
+    std::vector<std::vector<uint32_t>> orders;
+    for (int mode = 0; mode < AlbumSorter::N_MODES; mode++)
+        orders.push_back(sorter.order((SortMode)mode, albums));
+    report("sort (all modes)", now_ms() - start, albums.size(), "albums");
+    
+    start = now_ms();
+    AlbumCache::write(cache_path, root, albums, orders);
+    report("cache write", now_ms() - start, albums.size(), "albums");
+    
+    start = now_ms();
+    AlbumCache::Reader reader;
+    std::vector<Album> loaded;
+    if (reader.open(cache_path) && reader.verify_strings())
+    {
+        loaded.reserve(reader.size());
+        for (size_t i = 0; i < reader.size(); i++)
+        {
+            Album album;
+            if (reader.read(i, album))
+                loaded.push_back(std::move(album));
+        }
+    }
+    report("cache read", now_ms() - start, loaded.size(), "albums");
+    
+    if (loaded.size() != albums.size())
+    {
+        fprintf(stderr, "The cache returned %d of %d albums\n", (int)loaded.size(),
+                (int)albums.size());
+        return 1;
+    }
+    
+    start = now_ms();
+    for (const auto& album : albums)
+    {
+        Album parsed;
+        extract_metadata(album.directory_path, parsed);
+    }
+    report("extract_metadata", now_ms() - start, albums.size(), "albums");
+    
+    AlbumSearchIndex index;
+    start = now_ms();
+    index.clear({root});
+    for (const auto& album : albums)
+        index.add(album);
+    report("search index", now_ms() - start, albums.size(), "albums");
+    
+    // Typed one character at a time, as the search entry sees it
+    static const char* const queries[] = {"a", "al", "alb", "album 00", "artist 0042",
+                                          "cat-001", "1987", "track", "zzz"};
+    size_t n_results = 0;
+    start = now_ms();
+    for (const char* query : queries)
+        n_results += index.search(query).size();
+    report("search", now_ms() - start, sizeof(queries) / sizeof(queries[0]), "queries");
+    printf("  %d results\n", (int)n_results);
+    
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    LibraryShape shape;
+    ScanOptions options;
+    std::string dir;
+    bool keep = false;
+    
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        
+        if (!strcmp(arg, "--keep"))
+        {
+            keep = true;
+            continue;
+        }
+        
+        if (!strcmp(arg, "--foreground"))
+        {
+            options.background = false;
+            continue;
+        }
+        
+        if (!value)
+        {
+            usage();
+            return 1;
+        }
+        
+        i++;
+        
+        if (!strcmp(arg, "--artists"))
+            shape.artists = atoi(value);
+        else if (!strcmp(arg, "--albums"))
+            shape.albums = atoi(value);
+        else if (!strcmp(arg, "--tracks"))
+            shape.tracks = atoi(value);
+        else if (!strcmp(arg, "--depth"))
+            shape.depth = atoi(value);
+        else if (!strcmp(arg, "--threads"))
+            options.threads = atoi(value);
+        else if (!strcmp(arg, "--read-rate"))
+            options.read_rate = atoi(value);
+        else if (!strcmp(arg, "--dir"))
+            dir = value;
+        else if (!strcmp(arg, "--covers") && !strcmp(value, "none"))
+            shape.covers = CoverKind::None;
+        else if (!strcmp(arg, "--covers") && !strcmp(value, "file"))
+            shape.covers = CoverKind::File;
+        else if (!strcmp(arg, "--covers") && !strcmp(value, "embedded"))
+            shape.covers = CoverKind::Embedded;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    
+    bool temporary = dir.empty();
+    if (temporary)
+    {
+        char temp[] = "/tmp/album-browser-bench-XXXXXX";
+        if (!mkdtemp(temp))
+        {
+            perror("mkdtemp");
+            return 1;
+        }
+        dir = temp;
+    }
+    
+    fs::path base(dir);
+    std::string root = (base / "library").string();
+    
+    try {
+        double start = now_ms();
+        size_t n_albums = generate_library(root, shape);
+        report("generate", now_ms() - start, n_albums, "albums");
+    }
+    catch (const fs::filesystem_error& e) {
+        fprintf(stderr, "Cannot generate the library in %s: %s\n", dir.c_str(), e.what());
+        return 1;
+    }
+    
+    int status = run_benchmark(base, root, options);
+    
+    if (keep)
+        printf("Library kept in %s\n", dir.c_str());
+    else
+    {
+        // Only what was generated here, in case the directory was given
+        fs::remove_all(root);
+        fs::remove_all(base / "art");
+        fs::remove(base / "albums.dat");
+        if (temporary)
+            fs::remove(base);
+    }
+    
+    return status;
+}
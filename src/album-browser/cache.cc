@@ -0,0 +1,479 @@
+/*
+ * cache.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "cache.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libaudcore/runtime.h>
+
+namespace AlbumCache {
+
+static constexpr uint32_t MAGIC = 0x57524241;  // "ABRW"
+
+struct Header {
+    uint32_t version;  // first, like the older stream formats
+    uint32_t magic;
+    uint32_t album_count;
+    uint32_t track_count;
+    StrRef root;
+    uint64_t records_offset;
+    uint64_t tracks_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint32_t index_checksum;  // records, track references and orders
+    uint32_t strings_checksum;
+    uint64_t orders_offset;
+    uint32_t order_count;  // album permutations, album_count entries each
+    uint32_t reserved;
+};
+
+struct Record {
+    StrRef directory;
+    StrRef title;
+    StrRef artist;
+    StrRef cover;
+    StrRef catalog;
+    int32_t year;
+    int32_t disc;
+    uint32_t track_count;
+    uint32_t first_track;
+    int64_t dir_mtime;
+    uint64_t dir_inode;
+    int64_t cover_mtime;
+    uint64_t cover_size;
+    int64_t date_added;
+    uint32_t play_count;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(Header) % 8 == 0, "header must keep records aligned");
+static_assert(sizeof(Record) % 8 == 0, "records must stay aligned");
+
+// FNV-1a, continued from a previous value
+static uint32_t checksum(const void* data, size_t len, uint32_t hash = 2166136261u)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+class StringTable
+{
+public:
+    StrRef add(const std::string& str)
+    {
+        auto it = offsets_.find(str);
+        if (it != offsets_.end())
+            return {it->second, (uint32_t)str.size()};
+
+        uint32_t offset = data_.size();
+        data_.append(str);
+        offsets_.emplace(str, offset);
+        return {offset, (uint32_t)str.size()};
+    }
+
+    const std::string& data() const { return data_; }
+
+private:
+    std::string data_;
+    std::unordered_map<std::string, uint32_t> offsets_;
+};
+
+std::vector<unsigned char> serialize(const std::string& root, const std::vector<Album>& albums,
+                                     const std::vector<std::vector<uint32_t>>& orders,
+                                     const std::vector<uint32_t>* subset)
+{
+    StringTable strings;
+    std::vector<Record> records;
+    std::vector<StrRef> tracks;
+    size_t count = subset ? subset->size() : albums.size();
+
+    records.reserve(count);
+    StrRef root_ref = strings.add(root);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Album& album = albums[subset ? (*subset)[i] : i];
+        Record record = Record();
+        record.directory = strings.add(album.directory_path);
+        record.title = strings.add(album.title);
+        record.artist = strings.add(album.artist);
+        record.cover = strings.add(album.cover_art_path);
+        record.catalog = strings.add(album.catalog);
+        record.year = album.year;
+        record.disc = album.disc;
+        record.track_count = album.n_tracks();
+        record.first_track = tracks.size();
+        record.dir_mtime = album.dir_mtime;
+        record.dir_inode = album.dir_inode;
+        record.cover_mtime = album.cover_mtime;
+        record.cover_size = album.cover_size;
+        record.date_added = album.date_added;
+        record.play_count = album.play_count;
+
+        // Track names are relative to the album directory
+        for (size_t t = 0; t < album.n_tracks(); t++)
+            tracks.push_back(strings.add(album.track_name(t)));
+
+        records.push_back(record);
+    }
+
+    Header header = Header();
+    header.version = VERSION;
+    header.magic = MAGIC;
+    header.album_count = records.size();
+    header.track_count = tracks.size();
+    header.root = root_ref;
+    header.records_offset = sizeof(Header);
+    header.tracks_offset = header.records_offset + records.size() * sizeof(Record);
+    header.orders_offset = header.tracks_offset + tracks.size() * sizeof(StrRef);
+
+    std::vector<uint32_t> order_data;
+    for (const auto& order : orders)
+    {
+        if (order.size() != count)
+            break;
+        order_data.insert(order_data.end(), order.begin(), order.end());
+        header.order_count++;
+    }
+
+    header.strings_offset = header.orders_offset + order_data.size() * sizeof(uint32_t);
+    header.strings_size = strings.data().size();
+
+    header.index_checksum = checksum(order_data.data(), order_data.size() * sizeof(uint32_t),
+        checksum(tracks.data(), tracks.size() * sizeof(StrRef),
+        checksum(records.data(), records.size() * sizeof(Record))));
+    header.strings_checksum = checksum(strings.data().data(), strings.data().size());
+
+    std::vector<unsigned char> data(header.strings_offset + header.strings_size);
+    unsigned char* out = data.data();
+
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + header.records_offset, records.data(), records.size() * sizeof(Record));
+    memcpy(out + header.tracks_offset, tracks.data(), tracks.size() * sizeof(StrRef));
+    memcpy(out + header.orders_offset, order_data.data(), order_data.size() * sizeof(uint32_t));
+    memcpy(out + header.strings_offset, strings.data().data(), strings.data().size());
+
+    return data;
+}
+
+bool write_file(const std::string& path, const std::vector<unsigned char>& data)
+{
+    // Write a new file and rename it over the old one: a reader may still
+    // have the old file mapped, and truncating it in place would crash it.
+    // The data is flushed first, so that a crash leaves either file whole.
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        AUDWARN("Cannot write album cache %s\n", temp_path.c_str());
+        return false;
+    }
+
+    const unsigned char* pos = data.data();
+    size_t left = data.size();
+    bool ok = true;
+
+    while (ok && left > 0)
+    {
+        ssize_t written = ::write(fd, pos, left);
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        ok = (written > 0);
+        if (ok)
+        {
+            pos += written;
+            left -= written;
+        }
+    }
+
+    ok = ok && fdatasync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+
+    if (!ok || rename(temp_path.c_str(), path.c_str()) < 0)
+    {
+        AUDWARN("Cannot write album cache %s\n", path.c_str());
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool write(const std::string& path, const std::string& root, const std::vector<Album>& albums,
+           const std::vector<std::vector<uint32_t>>& orders, const std::vector<uint32_t>* subset)
+{
+    return write_file(path, serialize(root, albums, orders, subset));
+}
+
+bool Reader::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Header))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (map == MAP_FAILED)
+        return false;
+
+    data_ = static_cast<const unsigned char*>(map);
+    length_ = st.st_size;
+
+    Header header;
+    memcpy(&header, data_, sizeof(header));
+
+    if (header.version != VERSION || header.magic != MAGIC)
+    {
+        close();
+        return false;
+    }
+
+    uint64_t records_size = (uint64_t)header.album_count * sizeof(Record);
+    uint64_t tracks_size = (uint64_t)header.track_count * sizeof(StrRef);
+    uint64_t orders_size = (uint64_t)header.order_count * header.album_count * sizeof(uint32_t);
+
+    if (header.records_offset != sizeof(Header) ||
+        header.tracks_offset != header.records_offset + records_size ||
+        header.orders_offset != header.tracks_offset + tracks_size ||
+        header.strings_offset != header.orders_offset + orders_size ||
+        header.strings_offset + header.strings_size != length_)
+    {
+        AUDWARN("Album cache %s is truncated or damaged\n", path.c_str());
+        close();
+        return false;
+    }
+
+    uint32_t sum = checksum(data_ + header.orders_offset, orders_size,
+        checksum(data_ + header.tracks_offset, tracks_size,
+        checksum(data_ + header.records_offset, records_size)));
+
+    if (sum != header.index_checksum)
+    {
+        AUDWARN("Album cache %s has a bad checksum\n", path.c_str());
+        close();
+        return false;
+    }
+
+    count_ = header.album_count;
+    return true;
+}
+
+void Reader::close()
+{
+    if (data_)
+        munmap(const_cast<unsigned char*>(data_), length_);
+
+    data_ = nullptr;
+    length_ = 0;
+    count_ = 0;
+}
+
+std::string Reader::get_string(const StrRef& ref) const
+{
+    const Header* header = reinterpret_cast<const Header*>(data_);
+
+    if ((uint64_t)ref.offset + ref.length > header->strings_size)
+        return std::string();
+
+    auto chars = reinterpret_cast<const char*>(data_ + header->strings_offset + ref.offset);
+    return std::string(chars, ref.length);
+}
+
+std::string Reader::root() const
+{
+    if (!data_)
+        return std::string();
+
+    return get_string(reinterpret_cast<const Header*>(data_)->root);
+}
+
+bool Reader::read(size_t i, Album& album) const
+{
+    if (i >= count_)
+        return false;
+
+    const Header* header = reinterpret_cast<const Header*>(data_);
+    const Record& record = reinterpret_cast<const Record*>(data_ + header->records_offset)[i];
+    const StrRef* tracks = reinterpret_cast<const StrRef*>(data_ + header->tracks_offset);
+
+    if ((uint64_t)record.first_track + record.track_count > header->track_count)
+        return false;
+
+    album.directory_path = get_string(record.directory);
+    album.title = get_string(record.title);
+    album.artist = get_string(record.artist);
+    album.cover_art_path = get_string(record.cover);
+    album.catalog = get_string(record.catalog);
+    album.year = record.year;
+    album.disc = record.disc;
+    album.dir_mtime = record.dir_mtime;
+    album.dir_inode = record.dir_inode;
+    album.cover_mtime = record.cover_mtime;
+    album.cover_size = record.cover_size;
+    album.date_added = record.date_added;
+    album.play_count = record.play_count;
+
+    album.track_names.clear();
+    album.track_offsets.clear();
+    album.track_offsets.reserve(record.track_count);
+    for (uint32_t t = 0; t < record.track_count; t++)
+        album.add_track(get_string(tracks[record.first_track + t]));
+
+    return true;
+}
+
+size_t Reader::order_count() const
+{
+    return data_ ? reinterpret_cast<const Header*>(data_)->order_count : 0;
+}
+
+bool Reader::read_order(size_t n, std::vector<uint32_t>& order) const
+{
+    if (n >= order_count())
+        return false;
+
+    const Header* header = reinterpret_cast<const Header*>(data_);
+    auto first = reinterpret_cast<const uint32_t*>(data_ + header->orders_offset) + n * count_;
+    order.assign(first, first + count_);
+    return true;
+}
+
+bool Reader::verify_strings() const
+{
+    if (!data_)
+        return false;
+
+    const Header* header = reinterpret_cast<const Header*>(data_);
+    return checksum(data_ + header->strings_offset, header->strings_size) ==
+           header->strings_checksum;
+}
+
+Writer::Writer() : thread_(&Writer::run, this)
+{
+}
+
+Writer::~Writer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+
+    wake_.notify_one();
+    thread_.join();
+}
+
+void Writer::submit(std::vector<Shard> shards, const std::string& obsolete)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto& shard : shards)
+        {
+            auto it = std::find_if(queue_.begin(), queue_.end(),
+                [&shard](const Shard& queued) { return queued.path == shard.path; });
+
+            if (it != queue_.end())
+                *it = std::move(shard);
+            else
+                queue_.push_back(std::move(shard));
+        }
+
+        if (!obsolete.empty())
+            obsolete_ = obsolete;
+    }
+
+    wake_.notify_one();
+}
+
+void Writer::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return queue_.empty() && !busy_; });
+}
+
+std::vector<std::string> Writer::take_failed()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::move(failed_);
+}
+
+void Writer::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true)
+    {
+        // Whatever is waiting is still written when quitting
+        wake_.wait(lock, [this]() { return quit_ || !queue_.empty(); });
+
+        if (queue_.empty())
+            return;
+
+        Shard shard = std::move(queue_.front());
+        queue_.erase(queue_.begin());
+        busy_ = true;
+        lock.unlock();
+
+        bool ok = write_file(shard.path, serialize(shard.root, shard.albums, shard.orders));
+        if (ok)
+            AUDDBG("Wrote %d albums to %s\n", (int)shard.albums.size(), shard.path.c_str());
+
+        lock.lock();
+        busy_ = false;
+
+        if (!ok)
+        {
+            failed_.push_back(std::move(shard.root));
+            round_failed_ = true;
+        }
+
+        if (queue_.empty())
+        {
+            if (!round_failed_ && !obsolete_.empty())
+                unlink(obsolete_.c_str());
+
+            obsolete_.clear();
+            round_failed_ = false;
+            idle_.notify_all();
+        }
+    }
+}
+
+} // namespace AlbumCache
@@ -0,0 +1,142 @@
+/*
+ * cache.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "album.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// On-disk album cache.  The file is memory-mapped and never parsed as a
+// whole: a fixed header points to an array of fixed-size album records, an
+// array of track references and a deduplicated string table.  Every
+// reference is bounds-checked when it is read, so a truncated or damaged
+// file can at worst yield empty strings.  The records, the track arrays
+// and the stored orders are checksummed when the file is opened; the (much
+// larger) string table has its own checksum, checked by verify_strings()
+// before the caller reads any album from the file.
+
+namespace AlbumCache {
+
+static constexpr uint32_t VERSION = 8;
+
+// A string in the string table
+struct StrRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// The orders (album permutations, such as one per sort mode) are stored
+// along with the albums so they need not be recomputed on the next start.
+// With a subset, only those albums are written, in that order; the orders
+// then refer to positions in the subset.
+bool write(const std::string& path, const std::string& root, const std::vector<Album>& albums,
+           const std::vector<std::vector<uint32_t>>& orders = {},
+           const std::vector<uint32_t>* subset = nullptr);
+
+// The two halves of write(): the whole file in one buffer, and that buffer
+// written with one write() to a temporary file renamed over the old one
+std::vector<unsigned char> serialize(const std::string& root, const std::vector<Album>& albums,
+                                     const std::vector<std::vector<uint32_t>>& orders = {},
+                                     const std::vector<uint32_t>* subset = nullptr);
+bool write_file(const std::string& path, const std::vector<unsigned char>& data);
+
+// Writes shards on a thread of its own, so that saving never holds up the
+// GUI.  A shard still waiting when a newer copy of it is submitted is
+// replaced by that copy.
+class Writer
+{
+public:
+    struct Shard {
+        std::string path;
+        std::string root;
+        std::vector<Album> albums;  // a copy, in the order of the shard
+        std::vector<std::vector<uint32_t>> orders;
+    };
+
+    Writer();
+    ~Writer();  // writes whatever is waiting first
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // The obsolete file, if any, is removed once every shard waiting has
+    // been written without error
+    void submit(std::vector<Shard> shards, const std::string& obsolete = std::string());
+
+    // Blocks until every shard submitted so far is on disk (or has failed)
+    void wait();
+
+    // Roots whose shards could not be written since the last call
+    std::vector<std::string> take_failed();
+
+private:
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable wake_, idle_;
+    std::vector<Shard> queue_;
+    std::string obsolete_;
+    std::vector<std::string> failed_;
+    bool round_failed_ = false;
+    bool busy_ = false;
+    bool quit_ = false;
+    std::thread thread_;
+};
+
+class Reader
+{
+public:
+    Reader() = default;
+    ~Reader() { close(); }
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool is_open() const { return data_ != nullptr; }
+    size_t size() const { return count_; }
+    std::string root() const;
+
+    // Materializes album i from the mapping
+    bool read(size_t i, Album& album) const;
+    
+    size_t order_count() const;
+    bool read_order(size_t n, std::vector<uint32_t>& order) const;
+    bool verify_strings() const;
+
+private:
+    std::string get_string(const StrRef& ref) const;
+
+    const unsigned char* data_ = nullptr;
+    size_t length_ = 0;
+    size_t count_ = 0;
+};
+
+} // namespace AlbumCache
+
+#endif // CACHE_H
@@ -0,0 +1,408 @@
+/*
+ * dirscan.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "dirscan.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libaudcore/runtime.h>
+
+// IORING_OP_STATX came with Linux 5.6, along with this flag
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef IORING_FEAT_RW_CUR_POS
+#define HAVE_STATX_RING
+#endif
+#endif
+
+static EntryType type_of(mode_t mode)
+{
+    return S_ISDIR(mode) ? EntryType::Directory : S_ISREG(mode) ? EntryType::File
+                                                               : EntryType::Other;
+}
+
+// For what d_type does not say: stats the entry, and its target if it is
+// a symlink
+static void stat_entry(int dir_fd, DirEntry& entry, bool known_symlink, uint64_t& calls)
+{
+    entry.type = EntryType::Other;
+    entry.symlink = known_symlink;
+
+#ifdef STATX_TYPE
+    struct statx stx;
+    if (!known_symlink)
+    {
+        calls++;
+        if (statx(dir_fd, entry.name.c_str(), AT_SYMLINK_NOFOLLOW, STATX_TYPE, &stx) < 0)
+            return;
+        entry.symlink = S_ISLNK(stx.stx_mode);
+        entry.type = type_of(stx.stx_mode);
+    }
+
+    if (entry.symlink)
+    {
+        calls++;
+        if (statx(dir_fd, entry.name.c_str(), 0, STATX_TYPE, &stx) == 0)
+            entry.type = type_of(stx.stx_mode);
+    }
+#else
+    struct stat st;
+    if (!known_symlink)
+    {
+        calls++;
+        if (fstatat(dir_fd, entry.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) < 0)
+            return;
+        entry.symlink = S_ISLNK(st.st_mode);
+        entry.type = type_of(st.st_mode);
+    }
+
+    if (entry.symlink)
+    {
+        calls++;
+        if (fstatat(dir_fd, entry.name.c_str(), &st, 0) == 0)
+            entry.type = type_of(st.st_mode);
+    }
+#endif
+}
+
+int read_directory(const std::string& path, std::vector<DirEntry>& entries, uint64_t& calls)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return errno;
+
+    DIR* dir = fdopendir(fd);
+    if (!dir)
+    {
+        int error = errno;
+        close(fd);
+        return error;
+    }
+
+    // readdir() reads the entries in large getdents64() batches
+    struct dirent* ent;
+    errno = 0;
+    while ((ent = readdir(dir)))
+    {
+        const char* name = ent->d_name;
+        if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+
+        DirEntry entry;
+        entry.name = name;
+        entry.symlink = false;
+
+#ifdef DT_UNKNOWN
+        switch (ent->d_type)
+        {
+        case DT_DIR:
+            entry.type = EntryType::Directory;
+            break;
+        case DT_REG:
+            entry.type = EntryType::File;
+            break;
+        case DT_LNK:
+            stat_entry(fd, entry, true, calls);
+            break;
+        case DT_UNKNOWN:
+            stat_entry(fd, entry, false, calls);
+            break;
+        default:
+            entry.type = EntryType::Other;
+            break;
+        }
+#else
+        stat_entry(fd, entry, false, calls);
+#endif
+
+        entries.push_back(std::move(entry));
+        errno = 0;
+    }
+
+    int error = errno;
+    closedir(dir);
+    return error;
+}
+
+static void stamp_from(const struct stat& st, DirStamp& stamp)
+{
+#ifdef __APPLE__
+    stamp.mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    stamp.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    stamp.inode = st.st_ino;
+    stamp.ok = true;
+}
+
+#ifdef HAVE_STATX_RING
+
+// The parts of io_uring needed to submit a batch of statx() calls and wait
+// for all of them, without liburing
+struct StatBatch::Ring
+{
+    static constexpr unsigned ENTRIES = 64;
+
+    int fd = -1;
+    void* sq_map = MAP_FAILED;
+    void* cq_map = MAP_FAILED;
+    size_t sq_map_size = 0, cq_map_size = 0;
+    io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+    size_t sqes_size = 0;
+
+    // Written by the kernel; lives as long as the ring, so that no request
+    // can outlive the memory it writes to
+    std::unique_ptr<struct statx[]> results{new struct statx[ENTRIES]};
+
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    bool setup();
+    ~Ring();
+
+    // Returns the number of io_uring_enter() calls, or -1 if the kernel
+    // does not know the operation
+    int run(const std::vector<const std::string*>& paths, size_t first, size_t count,
+            std::vector<DirStamp>& stamps);
+};
+
+bool StatBatch::Ring::setup()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    fd = syscall(__NR_io_uring_setup, ENTRIES, &params);
+    if (fd < 0)
+        return false;
+
+    sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+
+    sq_map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                  IORING_OFF_SQ_RING);
+    if (sq_map == MAP_FAILED)
+        return false;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        cq_map = sq_map;
+    else
+    {
+        cq_map = mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_CQ_RING);
+        if (cq_map == MAP_FAILED)
+            return false;
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return false;
+
+    auto sq = (char*)sq_map;
+    auto cq = (char*)cq_map;
+
+    sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    sq_array = (unsigned*)(sq + params.sq_off.array);
+    cq_head = (unsigned*)(cq + params.cq_off.head);
+    cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+StatBatch::Ring::~Ring()
+{
+    if (sqes != MAP_FAILED)
+        munmap(sqes, sqes_size);
+    if (cq_map != MAP_FAILED && cq_map != sq_map)
+        munmap(cq_map, cq_map_size);
+    if (sq_map != MAP_FAILED)
+        munmap(sq_map, sq_map_size);
+    if (fd >= 0)
+        close(fd);
+}
+
+int StatBatch::Ring::run(const std::vector<const std::string*>& paths, size_t first,
+                         size_t count, std::vector<DirStamp>& stamps)
+{
+    unsigned tail = *sq_tail;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned slot = tail & *sq_mask;
+        io_uring_sqe* sqe = &sqes[slot];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)paths[first + i]->c_str();
+        sqe->len = STATX_TYPE | STATX_MTIME | STATX_INO;
+        sqe->off = (uint64_t)(uintptr_t)&results[i];
+        sqe->user_data = i;
+
+        sq_array[slot] = slot;
+        tail++;
+    }
+
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+    int calls = 0;
+    size_t submitted = 0, completed = 0;
+    bool unsupported = false, failed = false;
+
+    while (completed < count)
+    {
+        // Once submitting has failed, only what is already in flight is waited for
+        unsigned to_submit = failed ? 0 : (unsigned)(count - submitted);
+        unsigned to_wait = failed ? (unsigned)(submitted - completed) : (unsigned)(count - completed);
+        if (failed && !to_wait)
+            break;
+
+        int ret = syscall(__NR_io_uring_enter, fd, to_submit, to_wait, IORING_ENTER_GETEVENTS,
+                          nullptr, 0);
+        calls++;
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // The kernel still writes into results for whatever it has
+            // taken; if even waiting for that fails, results are never
+            // freed
+            if (failed)
+            {
+                results.release();
+                return -1;
+            }
+
+            failed = true;
+            continue;
+        }
+
+        if (!failed)
+            submitted += ret;
+
+        unsigned head = *cq_head;
+        unsigned ready = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != ready; head++)
+        {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            size_t i = cqe.user_data;
+            DirStamp& stamp = stamps[first + i];
+
+            if (cqe.res == -EINVAL)
+                unsupported = true;
+            else if (cqe.res == 0)
+            {
+                stamp.mtime = (int64_t)results[i].stx_mtime.tv_sec * 1000000000 +
+                              results[i].stx_mtime.tv_nsec;
+                stamp.inode = results[i].stx_ino;
+                stamp.ok = true;
+            }
+
+            completed++;
+        }
+
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // Entries never submitted are still in the queue, so the ring cannot
+    // be used again; the caller drops it and stamps what is left itself
+    return (unsupported || failed) ? -1 : calls;
+}
+
+StatBatch::StatBatch()
+{
+    auto ring = std::make_unique<Ring>();
+    if (ring->setup())
+        ring_ = std::move(ring);
+    else
+        AUDDBG("No io_uring, stamping directories one at a time\n");
+}
+
+#else
+
+struct StatBatch::Ring {};
+
+StatBatch::StatBatch()
+{
+}
+
+#endif
+
+StatBatch::~StatBatch()
+{
+}
+
+uint64_t StatBatch::stat(const std::vector<const std::string*>& paths,
+                         std::vector<DirStamp>& stamps)
+{
+    stamps.assign(paths.size(), DirStamp());
+    uint64_t calls = 0;
+    size_t done = 0;
+
+#ifdef HAVE_STATX_RING
+    while (ring_ && done < paths.size())
+    {
+        size_t count = std::min(paths.size() - done, (size_t)Ring::ENTRIES);
+        int ring_calls = ring_->run(paths, done, count, stamps);
+
+        // The kernel predates IORING_OP_STATX, or the ring failed; these
+        // are redone below
+        if (ring_calls < 0)
+        {
+            AUDDBG("io_uring cannot stat, stamping directories one at a time\n");
+            ring_.reset();
+            break;
+        }
+
+        calls += ring_calls;
+        done += count;
+    }
+#endif
+
+    for (size_t i = done; i < paths.size(); i++)
+    {
+        struct stat st;
+        calls++;
+        if (::stat(paths[i]->c_str(), &st) == 0)
+            stamp_from(st, stamps[i]);
+    }
+
+    return calls;
+}
@@ -0,0 +1,75 @@
+/*
+ * dirscan.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef DIRSCAN_H
+#define DIRSCAN_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Directory listing and stamping with as few system calls, and as few
+// round trips to a network filesystem, as the platform allows.  The type
+// of an entry is taken from the listing itself (d_type); only entries the
+// filesystem leaves untyped, and symlinks, cost a statx().  On Linux the
+// stamps of many directories are taken with one io_uring submission, so
+// that a network filesystem can answer them all at once.
+
+enum class EntryType { Directory, File, Other };
+
+struct DirEntry {
+    std::string name;
+    EntryType type;  // of the target, for a symlink
+    bool symlink;
+};
+
+// Lists path without "." and "..".  Returns 0 or an errno value; calls
+// counts the stats that the listing could not answer.
+int read_directory(const std::string& path, std::vector<DirEntry>& entries, uint64_t& calls);
+
+// Modification time (nanoseconds) and inode, as stat() gives them
+struct DirStamp {
+    int64_t mtime = 0;
+    uint64_t inode = 0;
+    bool ok = false;
+};
+
+// One per thread: the ring is not shared
+class StatBatch
+{
+public:
+    StatBatch();
+    ~StatBatch();
+
+    StatBatch(const StatBatch&) = delete;
+    StatBatch& operator=(const StatBatch&) = delete;
+
+    // Stamps every path (following symlinks) and returns the number of
+    // system calls it took
+    uint64_t stat(const std::vector<const std::string*>& paths, std::vector<DirStamp>& stamps);
+
+    bool batched() const { return ring_ != nullptr; }
+
+private:
+    struct Ring;
+    std::unique_ptr<Ring> ring_;
+};
+
+#endif // DIRSCAN_H
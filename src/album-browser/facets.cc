@@ -0,0 +1,307 @@
+/*
+ * facets.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "facets.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <libaudcore/audstrings.h>
+
+void AlbumBitset::set(size_t index)
+{
+    if (index / 64 >= words_.size())
+        words_.resize(index / 64 + 1);
+    words_[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+void AlbumBitset::fill(size_t size)
+{
+    words_.assign(size / 64, ~(uint64_t)0);
+    if (size % 64)
+        words_.push_back(((uint64_t)1 << (size % 64)) - 1);
+}
+
+void AlbumBitset::intersect(const AlbumBitset& other)
+{
+    // Anything past the end of either is not in the other
+    words_.resize(std::min(words_.size(), other.words_.size()));
+    for (size_t i = 0; i < words_.size(); i++)
+        words_[i] &= other.words_[i];
+}
+
+void AlbumBitset::unite(const AlbumBitset& other)
+{
+    if (other.words_.size() > words_.size())
+        words_.resize(other.words_.size());
+    for (size_t i = 0; i < other.words_.size(); i++)
+        words_[i] |= other.words_[i];
+}
+
+void AlbumBitset::subtract(const AlbumBitset& other)
+{
+    size_t n = std::min(words_.size(), other.words_.size());
+    for (size_t i = 0; i < n; i++)
+        words_[i] &= ~other.words_[i];
+}
+
+void AlbumBitset::to_indices(std::vector<size_t>& indices) const
+{
+    indices.clear();
+    for (size_t i = 0; i < words_.size(); i++)
+    {
+        for (uint64_t word = words_[i]; word; word &= word - 1)
+            indices.push_back(i * 64 + __builtin_ctzll(word));
+    }
+}
+
+static std::string fold(const std::string& str)
+{
+    StringBuf folded = str_tolower_utf8(str.c_str());
+    return std::string(folded);
+}
+
+// "1990s", "1990", "90s" and "90" are the 1990s; "none" is no year
+static bool parse_decade(const std::string& value, int& decade)
+{
+    if (value == "none" || value == "unknown")
+    {
+        decade = 0;
+        return true;
+    }
+    
+    char* end;
+    long year = strtol(value.c_str(), &end, 10);
+    if (end == value.c_str() || (*end && strcmp(end, "s")) || year < 0)
+        return false;
+    
+    if (end - value.c_str() <= 2)
+        year += (year < 30) ? 2000 : 1900;
+    
+    decade = year / 10 * 10;
+    return true;
+}
+
+// "5-12", "5-", "-12" or just "7"
+static bool parse_range(const std::string& value, int& min, int& max)
+{
+    size_t dash = value.find('-');
+    std::string low = value.substr(0, dash);
+    std::string high = (dash == std::string::npos) ? low : value.substr(dash + 1);
+    
+    min = low.empty() ? 0 : atoi(low.c_str());
+    max = high.empty() ? 0 : atoi(high.c_str());
+    return min > 0 || max > 0;
+}
+
+static bool parse_flag(const std::string& value, int& flag)
+{
+    if (value == "yes" || value == "true" || value == "1")
+        flag = 1;
+    else if (value == "no" || value == "false" || value == "0")
+        flag = 0;
+    else
+        return false;
+    
+    return true;
+}
+
+// Splits at commas outside quotes and drops the quotes
+static std::vector<std::string> split_values(const std::string& value)
+{
+    std::vector<std::string> values(1);
+    bool quoted = false;
+    
+    for (char c : value)
+    {
+        if (c == '"')
+            quoted = !quoted;
+        else if (c == ',' && !quoted)
+            values.emplace_back();
+        else
+            values.back() += c;
+    }
+    
+    values.erase(std::remove(values.begin(), values.end(), std::string()), values.end());
+    return values;
+}
+
+static bool apply_facet(const std::string& key, const std::string& value, FacetQuery& facets)
+{
+    if (key == "artist")
+    {
+        for (const auto& artist : split_values(value))
+            facets.artists.push_back(fold(artist));
+    }
+    else if (key == "decade")
+    {
+        for (const auto& decade : split_values(value))
+        {
+            int parsed;
+            if (parse_decade(fold(decade), parsed))
+                facets.decades.push_back(parsed);
+        }
+    }
+    else if (key == "format")
+    {
+        for (const auto& format : split_values(value))
+            facets.formats.push_back(fold(format[0] == '.' ? format.substr(1) : format));
+    }
+    else if (key == "cover")
+        parse_flag(fold(value), facets.cover);
+    else if (key == "tracks")
+        parse_range(value, facets.min_tracks, facets.max_tracks);
+    else
+        return false;
+    
+    return true;
+}
+
+void parse_facets(const std::string& query, FacetQuery& facets, std::string& text)
+{
+    facets = FacetQuery();
+    text.clear();
+    size_t pos = 0;
+    
+    while (pos < query.size())
+    {
+        if (query[pos] == ' ')
+        {
+            pos++;
+            continue;
+        }
+    
+        size_t end = query.find(' ', pos);
+        if (end == std::string::npos)
+            end = query.size();
+    
+        size_t colon = query.find(':', pos);
+        std::string key = (colon < end) ? fold(query.substr(pos, colon - pos)) : std::string();
+    
+        if (key == "artist" || key == "decade" || key == "format" || key == "cover" ||
+            key == "tracks")
+        {
+            // A quoted value runs on to the closing quote, spaces and all
+            bool quoted = false;
+            for (end = colon + 1; end < query.size(); end++)
+            {
+                if (query[end] == '"')
+                    quoted = !quoted;
+                else if (query[end] == ' ' && !quoted)
+                    break;
+            }
+    
+            apply_facet(key, query.substr(colon + 1, end - colon - 1), facets);
+        }
+        else
+        {
+            if (!text.empty())
+                text += ' ';
+            text.append(query, pos, end - pos);
+        }
+    
+        pos = end;
+    }
+}
+
+void AlbumFacets::clear()
+{
+    size_ = 0;
+    artists_.clear();
+    decades_.clear();
+    formats_.clear();
+    with_cover_ = AlbumBitset();
+    at_least_.clear();
+}
+
+void AlbumFacets::add(const Album& album)
+{
+    size_t index = size_++;
+    
+    artists_[fold(album.artist.c_str())].set(index);
+    decades_[album.year > 0 ? album.year / 10 * 10 : 0].set(index);
+    
+    if (album.has_cover_art())
+        with_cover_.set(index);
+    
+    if (at_least_.empty())
+        at_least_.resize(MAX_TRACKS);
+    size_t tracks = std::min(album.n_tracks(), (size_t)MAX_TRACKS);
+    for (size_t n = 0; n < tracks; n++)
+        at_least_[n].set(index);
+    
+    // Every format among the tracks, once
+    std::vector<std::string> formats;
+    for (size_t i = 0; i < album.n_tracks(); i++)
+    {
+        const char* name = album.track_name(i);
+        const char* dot = strrchr(name, '.');
+        if (!dot || strchr(dot, '/'))
+            continue;
+    
+        std::string format(dot + 1);
+        std::transform(format.begin(), format.end(), format.begin(), ::tolower);
+        if (std::find(formats.begin(), formats.end(), format) == formats.end())
+            formats.push_back(std::move(format));
+    }
+    
+    for (const auto& format : formats)
+        formats_[format].set(index);
+}
+
+template<class Key>
+static AlbumBitset any_of(const std::unordered_map<Key, AlbumBitset>& index,
+                          const std::vector<Key>& keys)
+{
+    AlbumBitset result;
+    for (const auto& key : keys)
+    {
+        auto it = index.find(key);
+        if (it != index.end())
+            result.unite(it->second);
+    }
+    return result;
+}
+
+AlbumBitset AlbumFacets::match(const FacetQuery& query) const
+{
+    AlbumBitset result;
+    result.fill(size_);
+    
+    if (!query.artists.empty())
+        result.intersect(any_of(artists_, query.artists));
+    if (!query.decades.empty())
+        result.intersect(any_of(decades_, query.decades));
+    if (!query.formats.empty())
+        result.intersect(any_of(formats_, query.formats));
+    
+    if (query.cover == 1)
+        result.intersect(with_cover_);
+    else if (query.cover == 0)
+        result.subtract(with_cover_);
+    
+    if (at_least_.empty())
+        return result;
+    
+    if (query.min_tracks > 0)
+        result.intersect(at_least_[std::min(query.min_tracks, MAX_TRACKS) - 1]);
+    if (query.max_tracks > 0 && query.max_tracks < MAX_TRACKS)
+        result.subtract(at_least_[query.max_tracks]);
+    
+    return result;
+}
@@ -0,0 +1,98 @@
+/*
+ * facets.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef FACETS_H
+#define FACETS_H
+
+#include "album.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A set of album numbers, one bit each
+class AlbumBitset
+{
+public:
+    void set(size_t index);
+    bool test(size_t index) const {
+        return index / 64 < words_.size() && (words_[index / 64] >> (index % 64) & 1);
+    }
+    
+    // Every album below size
+    void fill(size_t size);
+    
+    void intersect(const AlbumBitset& other);
+    void unite(const AlbumBitset& other);
+    void subtract(const AlbumBitset& other);
+    
+    // In ascending order
+    void to_indices(std::vector<size_t>& indices) const;
+    
+private:
+    std::vector<uint64_t> words_;
+};
+
+// Facet terms of a search, each a list of alternatives (any of which may
+// match); the facets themselves must all match
+struct FacetQuery {
+    std::vector<std::string> artists;  // folded
+    std::vector<int> decades;          // 1990 for the 1990s, 0 for no year
+    std::vector<std::string> formats;  // folded extension, without the dot
+    int cover = -1;                    // -1 either way, 0 without, 1 with
+    int min_tracks = 0, max_tracks = 0;  // 0 for no bound
+    
+    bool empty() const {
+        return artists.empty() && decades.empty() && formats.empty() && cover < 0 &&
+               !min_tracks && !max_tracks;
+    }
+};
+
+// Takes the facet terms out of a search query ("artist:", "decade:",
+// "format:", "cover:", "tracks:"), leaving the free text for the search
+// index.  Values may be quoted and hold several alternatives separated
+// by commas: artist:"Miles Davis",Coltrane decade:60s,70s tracks:3-8
+void parse_facets(const std::string& query, FacetQuery& facets, std::string& text);
+
+// Bitset indexes over the album list, one bitset per facet value, built
+// once per album as it is added.  A query is a few unions and
+// intersections of whole words, however the facets are combined.
+class AlbumFacets
+{
+public:
+    void clear();
+    
+    // Albums are numbered in the order they are added
+    void add(const Album& album);
+    size_t size() const { return size_; }
+    
+    AlbumBitset match(const FacetQuery& query) const;
+    
+private:
+    static constexpr int MAX_TRACKS = 100;  // longer albums count as this long
+    
+    size_t size_ = 0;
+    std::unordered_map<std::string, AlbumBitset> artists_;
+    std::unordered_map<int, AlbumBitset> decades_;
+    std::unordered_map<std::string, AlbumBitset> formats_;
+    AlbumBitset with_cover_;
+    std::vector<AlbumBitset> at_least_;  // [n - 1]: albums with n or more tracks
+};
+
+#endif // FACETS_H
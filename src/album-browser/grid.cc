@@ -0,0 +1,568 @@
+/*
+ * grid.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "grid.h"
+#include <QFontMetrics>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QTextLayout>
+#include <algorithm>
+#ifdef HAVE_GPU_GRID
+#include <QOpenGLWidget>
+#endif
+
+using namespace AlbumGrid;
+
+static constexpr int STEP_X = TILE_WIDTH + SPACING;
+static constexpr int STEP_Y = TILE_HEIGHT + SPACING;
+
+// AlbumModel implementation
+AlbumModel::AlbumModel(const std::vector<Album>& albums, CoverLoader cover_loader,
+                       QObject* parent)
+    : QAbstractListModel(parent), albums_(albums), cover_loader_(std::move(cover_loader))
+{
+}
+
+void AlbumModel::set_rows(std::vector<size_t> rows)
+{
+    beginResetModel();
+    rows_ = std::move(rows);
+
+    row_of_.clear();
+    for (size_t row = 0; row < rows_.size(); row++)
+    {
+        if (rows_[row] >= row_of_.size())
+            row_of_.resize(rows_[row] + 1, -1);
+        row_of_[rows_[row]] = row;
+    }
+
+    endResetModel();
+}
+
+void AlbumModel::cover_changed(size_t index)
+{
+    // Rows follow the sort order, not the album order
+    if (index >= row_of_.size() || row_of_[index] < 0)
+        return;
+
+    QModelIndex changed = createIndex(row_of_[index], 0);
+    emit dataChanged(changed, changed, {Qt::DecorationRole});
+}
+
+int AlbumModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : (int)rows_.size();
+}
+
+QVariant AlbumModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= (int)rows_.size())
+        return QVariant();
+
+    size_t album_index = rows_[index.row()];
+    if (album_index >= albums_.size())
+        return QVariant();
+
+    const Album& album = albums_[album_index];
+
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return QString::fromStdString(album.title);
+    case ArtistRole:
+        return QString::fromUtf8(album.artist.c_str());
+    case Qt::DecorationRole:
+        return cover_loader_ ? cover_loader_(album_index, index.row()) : QVariant();
+    case Qt::ToolTipRole:
+        return QString::fromStdString(album.directory_path);
+    case AlbumIndexRole:
+        return (qulonglong)album_index;
+    default:
+        return QVariant();
+    }
+}
+
+// AlbumTileDelegate implementation
+static constexpr int TEXT_GAP = 5;           // between the title and the artist
+static constexpr int MAX_CACHED_TEXTS = 4096;
+
+const AlbumTileDelegate::TileStyle& AlbumTileDelegate::style_for(
+    const QStyleOptionViewItem& option) const
+{
+    if (style_.palette_key == option.palette.cacheKey() && style_.title_font == option.font)
+        return style_;
+
+    style_.title_font = option.font;
+    style_.artist_font = option.font;
+    style_.artist_font.setPointSizeF(option.font.pointSizeF() * 0.9);
+    style_.title_height = QFontMetrics(style_.title_font).lineSpacing();
+    style_.artist_height = QFontMetrics(style_.artist_font).lineSpacing();
+
+    style_.text = option.palette.color(QPalette::Text);
+    style_.artist = Qt::gray;
+    style_.hover = QColor(128, 128, 255, 30);
+    style_.palette_key = option.palette.cacheKey();
+
+    // Laid out with the old fonts
+    text_cache_.clear();
+    return style_;
+}
+
+// Wraps text into at most max_lines lines of the given width, eliding the
+// last one if the text does not fit
+static QStringList wrap_text(const QString& text, const QFont& font, int width, int max_lines)
+{
+    QStringList lines;
+    QFontMetrics metrics(font);
+    QTextLayout layout(text, font);
+    QTextOption text_option;
+    text_option.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    layout.setTextOption(text_option);
+
+    layout.beginLayout();
+    while (lines.size() < max_lines)
+    {
+        QTextLine line = layout.createLine();
+        if (!line.isValid())
+            break;
+
+        line.setLineWidth(width);
+
+        if (lines.size() == max_lines - 1)
+            lines.append(metrics.elidedText(text.mid(line.textStart()).simplified(),
+                                            Qt::ElideRight, width));
+        else
+            lines.append(text.mid(line.textStart(), line.textLength()).trimmed());
+    }
+    layout.endLayout();
+
+    return lines;
+}
+
+const AlbumTileDelegate::TileText& AlbumTileDelegate::text_for(const QModelIndex& index,
+                                                               int width, int height) const
+{
+    size_t album_index = index.data(AlbumIndexRole).toULongLong();
+    auto found = text_cache_.find(album_index);
+    if (found != text_cache_.end())
+        return found->second;
+
+    // Only what has been on screen is ever laid out, but scrolling through
+    // a large library should not keep all of it
+    if (text_cache_.size() >= MAX_CACHED_TEXTS)
+        text_cache_.clear();
+
+    TileText& text = text_cache_[album_index];
+    QString title = index.data(Qt::DisplayRole).toString();
+    QString artist = index.data(ArtistRole).toString();
+
+    // The artist gets a line if the title leaves room for one
+    int title_lines = std::max(1, height / style_.title_height);
+    if (!artist.isEmpty())
+    {
+        int with_artist = (height - style_.artist_height - TEXT_GAP) / style_.title_height;
+        if (with_artist >= 1)
+            title_lines = with_artist;
+    }
+
+    text.title_lines = wrap_text(title, style_.title_font, width, title_lines);
+
+    int used = text.title_lines.size() * style_.title_height;
+    if (!artist.isEmpty() && used + TEXT_GAP + style_.artist_height <= height)
+    {
+        QFontMetrics metrics(style_.artist_font);
+        text.artist = metrics.elidedText(artist.simplified(), Qt::ElideRight, width);
+    }
+
+    return text;
+}
+
+void AlbumTileDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
+                              const QModelIndex& index) const
+{
+    const TileStyle& style = style_for(option);
+    painter->save();
+
+    // Hover effect
+    if (option.state & QStyle::State_MouseOver)
+    {
+        painter->setRenderHint(QPainter::Antialiasing);
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(style.hover);
+        painter->drawRoundedRect(option.rect, 8, 8);
+    }
+
+    QRect inner = option.rect.adjusted(10, 10, -10, -10);
+    QRect cover_rect(inner.left(), inner.top(), inner.width(), COVER_SIZE);
+
+    // Cover art; nothing is drawn while it is still loading
+    QVariant cover = index.data(Qt::DecorationRole);
+    QPixmap pixmap = qvariant_cast<QPixmap>(cover);
+    painter->setFont(style.title_font);
+    painter->setPen(style.text);
+
+    if (!pixmap.isNull())
+    {
+        QSize size = pixmap.size().scaled(cover_rect.size(), Qt::KeepAspectRatio);
+        QRect target(QPoint(0, 0), size);
+        target.moveCenter(cover_rect.center());
+        painter->drawPixmap(target, pixmap);
+    }
+    else if (cover.isValid())
+        painter->drawText(cover_rect, Qt::AlignCenter, "[No Cover]");
+
+    // Title
+    QRect text_rect(inner.left(), cover_rect.bottom() + 6, inner.width(),
+                    inner.bottom() - cover_rect.bottom() - 5);
+    const TileText& text = text_for(index, text_rect.width(), text_rect.height());
+    int flags = Qt::AlignHCenter | Qt::AlignTop;
+    int y = text_rect.top();
+
+    for (const QString& line : text.title_lines)
+    {
+        painter->drawText(QRect(text_rect.left(), y, text_rect.width(), style.title_height),
+                          flags, line);
+        y += style.title_height;
+    }
+
+    // Artist
+    if (!text.artist.isEmpty())
+    {
+        painter->setFont(style.artist_font);
+        painter->setPen(style.artist);
+        painter->drawText(QRect(text_rect.left(), y + TEXT_GAP, text_rect.width(),
+                                style.artist_height), flags, text.artist);
+    }
+
+    painter->restore();
+}
+
+QSize AlbumTileDelegate::sizeHint(const QStyleOptionViewItem&, const QModelIndex&) const
+{
+    return QSize(TILE_WIDTH, TILE_HEIGHT);
+}
+
+// AlbumGridView implementation
+AlbumGridView::AlbumGridView(QWidget* parent)
+    : QAbstractItemView(parent), delegate_(new AlbumTileDelegate(this))
+{
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setSelectionMode(QAbstractItemView::NoSelection);
+    setMouseTracking(true);
+    viewport()->setCursor(Qt::PointingHandCursor);
+    setItemDelegate(delegate_);
+}
+
+// The tiles are still painted with QPainter, but on an OpenGL viewport
+// Qt's OpenGL paint engine does the work: each cover pixmap is uploaded
+// once as a texture (keyed by its cacheKey, which the pixmap cache keeps
+// stable) and redrawn as a textured quad, and text is drawn from a cache
+// of glyph textures.  Scrolling then costs the GPU a frame and the CPU
+// only the handful of draw calls per visible tile.
+bool AlbumGridView::set_gpu_rendering(bool enable)
+{
+#ifdef HAVE_GPU_GRID
+    if (enable == gpu_)
+        return true;
+
+    // The old viewport is deleted by setViewport()
+    setViewport(enable ? new QOpenGLWidget : new QWidget);
+    viewport()->setMouseTracking(true);
+    viewport()->setCursor(Qt::PointingHandCursor);
+
+    gpu_ = enable;
+    viewport()->update();
+    return true;
+#else
+    return !enable;
+#endif
+}
+
+int AlbumGridView::columns() const
+{
+    return std::max(1, (viewport()->width() - 2 * MARGIN + SPACING) / STEP_X);
+}
+
+int AlbumGridView::row_count() const
+{
+    return model() ? model()->rowCount(rootIndex()) : 0;
+}
+
+int AlbumGridView::verticalOffset() const
+{
+    return verticalScrollBar()->value();
+}
+
+QRect AlbumGridView::tile_rect(int row) const
+{
+    int cols = columns();
+    int x = MARGIN + (row % cols) * STEP_X;
+    int y = MARGIN + (row / cols) * STEP_Y - verticalOffset();
+    return QRect(x, y, TILE_WIDTH, TILE_HEIGHT);
+}
+
+void AlbumGridView::visible_rows(int& first, int& last) const
+{
+    int cols = columns();
+    int top = verticalOffset() - MARGIN;
+    int bottom = top + viewport()->height();
+
+    first = std::max(0, top / STEP_Y) * cols;
+    last = std::min(row_count(), (bottom / STEP_Y + 1) * cols);
+    first = std::min(first, last);
+}
+
+QModelIndex AlbumGridView::indexAt(const QPoint& point) const
+{
+    int x = point.x() - MARGIN;
+    int y = point.y() + verticalOffset() - MARGIN;
+
+    // Outside the grid, or in the gap between two tiles
+    if (x < 0 || y < 0 || x % STEP_X >= TILE_WIDTH || y % STEP_Y >= TILE_HEIGHT)
+        return QModelIndex();
+
+    int cols = columns();
+    int col = x / STEP_X;
+    if (col >= cols)
+        return QModelIndex();
+
+    int row = (y / STEP_Y) * cols + col;
+    if (row >= row_count())
+        return QModelIndex();
+
+    return model()->index(row, 0, rootIndex());
+}
+
+QRect AlbumGridView::visualRect(const QModelIndex& index) const
+{
+    if (!index.isValid())
+        return QRect();
+
+    return tile_rect(index.row());
+}
+
+void AlbumGridView::scrollTo(const QModelIndex& index, ScrollHint hint)
+{
+    QRect rect = visualRect(index);
+    if (rect.isNull())
+        return;
+
+    QScrollBar* bar = verticalScrollBar();
+
+    if (hint == PositionAtTop || rect.top() < 0)
+        bar->setValue(bar->value() + rect.top() - MARGIN);
+    else if (hint == PositionAtBottom || rect.bottom() > viewport()->height())
+        bar->setValue(bar->value() + rect.bottom() - viewport()->height() + MARGIN);
+    else if (hint == PositionAtCenter)
+        bar->setValue(bar->value() + rect.center().y() - viewport()->height() / 2);
+}
+
+void AlbumGridView::reset()
+{
+    QAbstractItemView::reset();
+    delegate_->clear_text_cache();
+    hovered_row_ = -1;
+    updateGeometries();
+    viewport()->update();
+}
+
+QModelIndex AlbumGridView::moveCursor(CursorAction action, Qt::KeyboardModifiers)
+{
+    int count = row_count();
+    if (!count)
+        return QModelIndex();
+
+    int cols = columns();
+    int page = std::max(1, viewport()->height() / STEP_Y) * cols;
+    int row = currentIndex().isValid() ? currentIndex().row() : 0;
+
+    switch (action)
+    {
+    case MoveLeft:
+    case MovePrevious:
+        row--;
+        break;
+    case MoveRight:
+    case MoveNext:
+        row++;
+        break;
+    case MoveUp:
+        row -= cols;
+        break;
+    case MoveDown:
+        row += cols;
+        break;
+    case MovePageUp:
+        row -= page;
+        break;
+    case MovePageDown:
+        row += page;
+        break;
+    case MoveHome:
+        row = 0;
+        break;
+    case MoveEnd:
+        row = count - 1;
+        break;
+    }
+
+    return model()->index(std::clamp(row, 0, count - 1), 0, rootIndex());
+}
+
+void AlbumGridView::setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags flags)
+{
+    if (!selectionModel())
+        return;
+
+    QItemSelection selection;
+    int first, last;
+    visible_rows(first, last);
+
+    for (int row = first; row < last; row++)
+    {
+        if (tile_rect(row).intersects(rect))
+        {
+            QModelIndex index = model()->index(row, 0, rootIndex());
+            selection.select(index, index);
+        }
+    }
+
+    selectionModel()->select(selection, flags);
+}
+
+QRegion AlbumGridView::visualRegionForSelection(const QItemSelection& selection) const
+{
+    QRegion region;
+    int first, last;
+    visible_rows(first, last);
+
+    // Only the part of the selection that is on screen matters
+    for (const auto& range : selection)
+    {
+        for (int row = std::max(first, range.top()); row <= std::min(last - 1, range.bottom()); row++)
+            region += tile_rect(row);
+    }
+
+    return region;
+}
+
+void AlbumGridView::updateGeometries()
+{
+    int cols = columns();
+    int lines = (row_count() + cols - 1) / cols;
+    int height = lines ? 2 * MARGIN + lines * STEP_Y - SPACING : 0;
+
+    QScrollBar* bar = verticalScrollBar();
+    bar->setSingleStep(STEP_Y / 4);
+    bar->setPageStep(viewport()->height());
+    bar->setRange(0, std::max(0, height - viewport()->height()));
+
+    QAbstractItemView::updateGeometries();
+}
+
+void AlbumGridView::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(viewport());
+    int first, last;
+    visible_rows(first, last);
+
+    // An OpenGL viewport starts every frame from scratch, so every frame
+    // paints all of it, background included
+    QRect dirty = event->rect();
+    if (gpu_)
+    {
+        dirty = viewport()->rect();
+        painter.fillRect(dirty, viewport()->palette().brush(viewport()->backgroundRole()));
+    }
+
+    QStyleOptionViewItem option;
+    initViewItemOption(&option);
+
+    for (int row = first; row < last; row++)
+    {
+        QRect rect = tile_rect(row);
+        if (!rect.intersects(dirty))
+            continue;
+
+        QModelIndex index = model()->index(row, 0, rootIndex());
+
+        option.rect = rect;
+        option.state &= ~(QStyle::State_MouseOver | QStyle::State_Selected);
+        if (row == hovered_row_)
+            option.state |= QStyle::State_MouseOver;
+        if (selectionModel() && selectionModel()->isSelected(index))
+            option.state |= QStyle::State_Selected;
+
+        itemDelegateForIndex(index)->paint(&painter, option, index);
+    }
+}
+
+void AlbumGridView::resizeEvent(QResizeEvent* event)
+{
+    // Reflowing the columns is just a repaint with a different divisor
+    QAbstractItemView::resizeEvent(event);
+    updateGeometries();
+    viewport()->update();
+}
+
+void AlbumGridView::mousePressEvent(QMouseEvent* event)
+{
+    QModelIndex index = indexAt(event->pos());
+    QAbstractItemView::mousePressEvent(event);
+
+    if (!index.isValid() || !click_callback_)
+        return;
+
+    if (event->button() == Qt::LeftButton)
+        click_callback_(index.row(), true);
+    else if (event->button() == Qt::RightButton)
+        click_callback_(index.row(), false);
+}
+
+void AlbumGridView::set_hovered_row(int row)
+{
+    if (row == hovered_row_)
+        return;
+
+    int old_row = hovered_row_;
+    hovered_row_ = row;
+
+    if (old_row >= 0)
+        viewport()->update(tile_rect(old_row));
+    if (row >= 0)
+        viewport()->update(tile_rect(row));
+
+    if (hover_callback_)
+        hover_callback_(row);
+}
+
+void AlbumGridView::mouseMoveEvent(QMouseEvent* event)
+{
+    QModelIndex index = indexAt(event->pos());
+    set_hovered_row(index.isValid() ? index.row() : -1);
+    QAbstractItemView::mouseMoveEvent(event);
+}
+
+void AlbumGridView::leaveEvent(QEvent* event)
+{
+    set_hovered_row(-1);
+    QAbstractItemView::leaveEvent(event);
+}
@@ -0,0 +1,177 @@
+/*
+ * grid.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include "album.h"
+#include <QAbstractItemView>
+#include <QAbstractListModel>
+#include <QColor>
+#include <QFont>
+#include <QPixmap>
+#include <QStringList>
+#include <QStyledItemDelegate>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// Tile geometry shared by the view and the delegate
+namespace AlbumGrid {
+
+static constexpr int TILE_WIDTH = 200;
+static constexpr int TILE_HEIGHT = 250;
+static constexpr int COVER_SIZE = 180;
+static constexpr int SPACING = 10;
+static constexpr int MARGIN = 10;
+
+enum {
+    ArtistRole = Qt::UserRole,
+    AlbumIndexRole
+};
+
+} // namespace AlbumGrid
+
+// The albums currently shown (after filtering), as indices into the
+// browser's album list.  Covers are fetched on demand when a tile is
+// painted, so only visible albums ever get one.
+class AlbumModel : public QAbstractListModel
+{
+public:
+    // Returns the cover for an album shown in the given row: a QPixmap
+    // (null if there is none) or an invalid QVariant while it is loading
+    using CoverLoader = std::function<QVariant(size_t index, int row)>;
+
+    AlbumModel(const std::vector<Album>& albums, CoverLoader cover_loader,
+               QObject* parent = nullptr);
+
+    void set_rows(std::vector<size_t> rows);
+    size_t album_index(int row) const { return rows_[row]; }
+
+    // Repaints the tile(s) showing the given album
+    void cover_changed(size_t index);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role) const override;
+
+private:
+    const std::vector<Album>& albums_;
+    CoverLoader cover_loader_;
+    std::vector<size_t> rows_;
+    std::vector<int> row_of_;  // row showing each album, or -1
+};
+
+// Paints one tile: cover, title and artist, highlighted while hovered.
+// The fonts and colours are worked out once for all tiles, and the text
+// of each album is wrapped and elided once, not on every paint.
+class AlbumTileDelegate : public QStyledItemDelegate
+{
+public:
+    using QStyledItemDelegate::QStyledItemDelegate;
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option,
+               const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+
+    // For when the albums behind the rows have changed
+    void clear_text_cache() { text_cache_.clear(); }
+
+private:
+    struct TileStyle
+    {
+        QFont title_font, artist_font;
+        int title_height = 0, artist_height = 0;  // of a line
+        QColor text, artist, hover;
+        qint64 palette_key = -1;
+    };
+
+    struct TileText
+    {
+        QStringList title_lines;
+        QString artist;  // empty if there is no room for it
+    };
+
+    const TileStyle& style_for(const QStyleOptionViewItem& option) const;
+    const TileText& text_for(const QModelIndex& index, int width, int height) const;
+
+    mutable TileStyle style_;
+    mutable std::unordered_map<size_t, TileText> text_cache_;  // by album index
+};
+
+// A grid of fixed-size tiles whose positions are pure arithmetic on the
+// row number: scrolling, resizing and painting only ever look at the rows
+// that are actually visible, however many albums there are.
+class AlbumGridView : public QAbstractItemView
+{
+public:
+    // Called for a click on a tile, with the model row and whether the
+    // left (true) or right (false) button was used
+    using ClickCallback = std::function<void(int row, bool left_button)>;
+
+    // Called when the pointer moves onto another tile, or off all of
+    // them (row -1)
+    using HoverCallback = std::function<void(int row)>;
+
+    explicit AlbumGridView(QWidget* parent = nullptr);
+
+    void set_click_callback(ClickCallback callback) { click_callback_ = std::move(callback); }
+    void set_hover_callback(HoverCallback callback) { hover_callback_ = std::move(callback); }
+
+    // Draws the tiles through OpenGL instead of the software rasterizer.
+    // Returns false if the plugin was built without OpenGL support.
+    bool set_gpu_rendering(bool enable);
+
+    // Range [first, last) of rows at least partly on screen
+    void visible_rows(int& first, int& last) const;
+    int hovered_row() const { return hovered_row_; }
+
+    QModelIndex indexAt(const QPoint& point) const override;
+    QRect visualRect(const QModelIndex& index) const override;
+    void scrollTo(const QModelIndex& index, ScrollHint hint = EnsureVisible) override;
+    void reset() override;
+
+protected:
+    QModelIndex moveCursor(CursorAction action, Qt::KeyboardModifiers modifiers) override;
+    int horizontalOffset() const override { return 0; }
+    int verticalOffset() const override;
+    bool isIndexHidden(const QModelIndex&) const override { return false; }
+    void setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags flags) override;
+    QRegion visualRegionForSelection(const QItemSelection& selection) const override;
+    void updateGeometries() override;
+
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void leaveEvent(QEvent* event) override;
+
+private:
+    int columns() const;
+    int row_count() const;
+    QRect tile_rect(int row) const;  // in viewport coordinates
+    void set_hovered_row(int row);
+
+    AlbumTileDelegate* delegate_;
+    ClickCallback click_callback_;
+    HoverCallback hover_callback_;
+    int hovered_row_ = -1;
+    bool gpu_ = false;
+};
+
+#endif // GRID_H
@@ -18,54 +18,439 @@
  */
 
 #include "metadata.h"
+#include <atomic>
+#include <memory>
 #include <regex>
-#include <filesystem>
+#include <string_view>
+#include <libaudcore/runtime.h>
 
-namespace fs = std::filesystem;
+enum class NameField {
+    Ignore,
+    Year,
+    Title,
+    Artist,
+    Disc,
+    Catalog
+};
 
-void extract_metadata(const std::string& directory_path, Album& album)
+struct NamePattern {
+    std::regex regex;
+    std::vector<NameField> fields;
+};
+
+using NamePatterns = std::vector<NamePattern>;
+
+// Replaced as a whole, so a running scan keeps the set it started with
+static std::shared_ptr<const NamePatterns> s_name_patterns;
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static char lower_ascii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static std::string_view trim(std::string_view str)
+{
+    while (!str.empty() && is_space(str.front()))
+        str.remove_prefix(1);
+    while (!str.empty() && is_space(str.back()))
+        str.remove_suffix(1);
+    return str;
+}
+
+// Removes separators left over at the end of a title, as in "Album - CD1"
+static std::string_view trim_separators(std::string_view str)
+{
+    while (!str.empty() && (is_space(str.back()) || str.back() == '-' || str.back() == '_' ||
+                            str.back() == ','))
+        str.remove_suffix(1);
+    return str;
+}
+
+static bool parse_number(std::string_view str, int max_digits, int& value)
+{
+    if (str.empty() || (int)str.size() > max_digits)
+        return false;
+    
+    value = 0;
+    for (char c : str)
+    {
+        if (!is_digit(c))
+            return false;
+        value = value * 10 + (c - '0');
+    }
+    
+    return true;
+}
+
+static bool starts_with_nocase(std::string_view str, std::string_view prefix)
 {
-    fs::path path(directory_path);
+    if (str.size() < prefix.size())
+        return false;
     
-    // Get the album directory name (leaf)
-    std::string album_name = path.filename().string();
+    for (size_t i = 0; i < prefix.size(); i++)
+        if (lower_ascii(str[i]) != prefix[i])
+            return false;
     
-    // Get the parent directory name (potential artist)
-    std::string parent_name;
-    if (path.has_parent_path() && path.parent_path().has_filename())
+    return true;
+}
+
+bool parse_disc_name(std::string_view str, int& disc)
+{
+    str = trim(str);
+    
+    for (std::string_view word : {"disc", "disk", "cd"})
+    {
+        if (!starts_with_nocase(str, word))
+            continue;
+        
+        std::string_view rest = str.substr(word.size());
+        if (!rest.empty() && (is_space(rest[0]) || rest[0] == '_' || rest[0] == '-' ||
+                              rest[0] == '.'))
+            rest.remove_prefix(1);
+        
+        return parse_number(rest, 3, disc) && disc > 0;
+    }
+    
+    return false;
+}
+
+// A bracketed suffix "... (inner)" or "... [inner]"; returns the inner
+// text and leaves the part before it in head
+void parse_track_name(std::string_view name, int& number, std::string& title)
+{
+    size_t slash = name.rfind('/');
+    if (slash != std::string_view::npos)
+        name.remove_prefix(slash + 1);
+    
+    size_t dot = name.rfind('.');
+    if (dot != std::string_view::npos && dot > 0)
+        name = name.substr(0, dot);
+    
+    // A disc number in front of the track number: "1-03", "2.05"
+    size_t digits = 0;
+    while (digits < name.size() && is_digit(name[digits]))
+        digits++;
+    
+    if (digits > 0 && digits < 3 && digits + 1 < name.size() &&
+        (name[digits] == '-' || name[digits] == '.') && is_digit(name[digits + 1]))
     {
-        parent_name = path.parent_path().filename().string();
+        name.remove_prefix(digits + 1);
+        digits = 0;
+        while (digits < name.size() && is_digit(name[digits]))
+            digits++;
     }
     
-    // Pattern 1: Extract year from album name: "(YYYY) Album Name"
-    std::regex year_pattern(R"(^\((\d{4})\)\s+(.+)$)");
-    std::smatch year_match;
+    number = 0;
+    std::string_view rest = name.substr(digits);
     
-    if (std::regex_match(album_name, year_match, year_pattern))
+    // Only a number followed by a separator; "1984.flac" is a title
+    if (digits > 0 && digits <= 3 && !rest.empty() &&
+        (is_space(rest[0]) || rest[0] == '-' || rest[0] == '.' || rest[0] == '_'))
     {
-        // Extract year and album title
-        album.year = std::stoi(year_match[1].str());
-        album.title = year_match[2].str();
+        parse_number(name.substr(0, digits), 3, number);
+        while (!rest.empty() && (is_space(rest[0]) || rest[0] == '-' || rest[0] == '.' ||
+                                 rest[0] == '_'))
+            rest.remove_prefix(1);
+        if (!rest.empty())
+            name = rest;
     }
-    else
+    
+    title = std::string(trim(name));
+}
+
+static bool bracket_suffix(std::string_view str, std::string_view& head, std::string_view& inner)
+{
+    if (str.empty() || (str.back() != ')' && str.back() != ']'))
+        return false;
+    
+    char open = (str.back() == ')') ? '(' : '[';
+    size_t pos = str.rfind(open);
+    if (pos == std::string_view::npos || pos == 0)
+        return false;
+    
+    head = str.substr(0, pos);
+    inner = str.substr(pos + 1, str.size() - pos - 2);
+    return true;
+}
+
+static void strip_disc_suffix(std::string_view& title, int& disc)
+{
+    std::string_view head, inner;
+    if (bracket_suffix(title, head, inner))
     {
-        // No year pattern, use full album name as title
-        album.title = album_name;
-        album.year = 0;
+        if (parse_disc_name(inner, disc))
+            title = trim_separators(head);
+        return;
+    }
+    
+    // "Album CD2" or "Album - Disc 2": the marker is the last one or two
+    // words
+    size_t space = title.find_last_of(" \t");
+    for (int words = 0; words < 2 && space != std::string_view::npos && space > 0; words++)
+    {
+        if (parse_disc_name(title.substr(space + 1), disc))
+        {
+            std::string_view rest = trim_separators(title.substr(0, space));
+            if (!rest.empty())
+                title = rest;
+            return;
+        }
+        
+        space = title.find_last_of(" \t", space - 1);
+    }
+}
+
+// "[WARPCD92]", "[ABC-1234]": capitals, digits and a few separators, with
+// at least one of each of the first two
+static void strip_catalog_suffix(std::string_view& title, std::string& catalog)
+{
+    std::string_view head, inner;
+    if (title.empty() || title.back() != ']' || !bracket_suffix(title, head, inner))
+        return;
+    
+    if (inner.size() < 3 || inner.size() > 24)
+        return;
+    
+    bool letter = false, digit = false;
+    for (char c : inner)
+    {
+        if (c >= 'A' && c <= 'Z')
+            letter = true;
+        else if (is_digit(c))
+            digit = true;
+        else if (c != '-' && c != ' ' && c != '.')
+            return;
+    }
+    
+    head = trim_separators(head);
+    if (!letter || !digit || head.empty())
+        return;
+    
+    catalog.assign(inner.data(), inner.size());
+    title = head;
+}
+
+// "(YYYY) Album Name"
+static void strip_year_prefix(std::string_view& title, int& year)
+{
+    if (title.size() < 8 || title[0] != '(' || title[5] != ')' || !is_space(title[6]))
+        return;
+    
+    int value;
+    if (!parse_number(title.substr(1, 4), 4, value))
+        return;
+    
+    std::string_view rest = trim(title.substr(7));
+    if (rest.empty())
+        return;
+    
+    year = value;
+    title = rest;
+}
+
+static bool is_root_name(std::string_view name)
+{
+    return name == "Music" || name == "music" || name == "Albums" || name == "albums";
+}
+
+// Applies the first configured pattern that matches the whole name
+static bool match_patterns(const NamePatterns& patterns, std::string_view name, Album& album,
+                           bool& have_artist)
+{
+    std::cmatch match;
+    
+    for (const auto& pattern : patterns)
+    {
+        if (!std::regex_match(name.data(), name.data() + name.size(), match, pattern.regex))
+            continue;
+        
+        album.title.assign(name.data(), name.size());
+        
+        for (size_t i = 0; i < pattern.fields.size() && i + 1 < match.size(); i++)
+        {
+            std::string_view group(match[i + 1].first, match[i + 1].length());
+            int value;
+            
+            switch (pattern.fields[i])
+            {
+            case NameField::Year:
+                if (parse_number(group, 4, value))
+                    album.year = value;
+                break;
+            case NameField::Title:
+                album.title.assign(group.data(), group.size());
+                break;
+            case NameField::Artist:
+                album.artist = trim(group);
+                have_artist = true;
+                break;
+            case NameField::Disc:
+                if (parse_number(group, 3, value) || parse_disc_name(group, value))
+                    album.disc = value;
+                break;
+            case NameField::Catalog:
+                album.catalog.assign(group.data(), group.size());
+                break;
+            case NameField::Ignore:
+                break;
+            }
+        }
+        
+        return true;
+    }
+    
+    return false;
+}
+
+void extract_metadata(const std::string& directory_path, Album& album)
+{
+    std::string_view path(directory_path);
+    while (path.size() > 1 && path.back() == '/')
+        path.remove_suffix(1);
+    
+    // Splits off the last component of path
+    auto last_component = [](std::string_view& rest) {
+        size_t slash = rest.rfind('/');
+        std::string_view name = (slash == std::string_view::npos) ? rest : rest.substr(slash + 1);
+        rest = (slash == std::string_view::npos) ? std::string_view() : rest.substr(0, slash);
+        return name;
+    };
+    
+    std::string_view rest = path;
+    std::string_view name = last_component(rest);
+    std::string_view artist_name = last_component(rest);
+    
+    album.year = 0;
+    album.disc = 0;
+    album.catalog.clear();
+    
+    // "Album/CD1": the album is named by the directory above
+    int disc;
+    if (!artist_name.empty() && parse_disc_name(name, disc))
+    {
+        album.disc = disc;
+        name = artist_name;
+        artist_name = last_component(rest);
+    }
+    
+    bool have_artist = false;
+    auto patterns = std::atomic_load(&s_name_patterns);
+    
+    if (!patterns || !match_patterns(*patterns, name, album, have_artist))
+    {
+        std::string_view title = name;
+        strip_catalog_suffix(title, album.catalog);
+        if (!album.disc)
+            strip_disc_suffix(title, album.disc);
+        strip_year_prefix(title, album.year);
+        album.title.assign(title.data(), title.size());
     }
     
-    // Pattern 2: Extract artist from parent directory
     // Only use parent as artist if it's not a common root directory name
-    if (!parent_name.empty() && 
-        parent_name != "Music" && 
-        parent_name != "music" &&
-        parent_name != "Albums" &&
-        parent_name != "albums")
+    if (!have_artist)
     {
-        album.artist = parent_name;
+        if (!artist_name.empty() && !is_root_name(artist_name))
+            album.artist = artist_name;
+        else
+            album.artist = "";
     }
-    else
+}
+
+static bool parse_field(std::string_view name, NameField& field)
+{
+    static const std::pair<const char*, NameField> names[] = {
+        {"-", NameField::Ignore},
+        {"year", NameField::Year},
+        {"title", NameField::Title},
+        {"album", NameField::Title},
+        {"artist", NameField::Artist},
+        {"disc", NameField::Disc},
+        {"catalog", NameField::Catalog}
+    };
+    
+    for (const auto& entry : names)
+    {
+        if (name == entry.first)
+        {
+            field = entry.second;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool set_name_patterns(const std::string& spec)
+{
+    auto patterns = std::make_shared<NamePatterns>();
+    bool ok = true;
+    
+    std::string_view rest(spec);
+    while (!rest.empty())
     {
-        album.artist = "";
+        size_t end = rest.find(";;");
+        std::string_view item = trim(rest.substr(0, end));
+        rest = (end == std::string_view::npos) ? std::string_view() : rest.substr(end + 2);
+        
+        if (item.empty())
+            continue;
+        
+        size_t equals = item.find('=');
+        if (equals == std::string_view::npos)
+        {
+            AUDWARN("Name pattern without field list: %.*s\n", (int)item.size(), item.data());
+            ok = false;
+            continue;
+        }
+        
+        NamePattern pattern;
+        std::string_view fields = item.substr(0, equals);
+        bool fields_ok = true;
+        
+        while (!fields.empty())
+        {
+            size_t comma = fields.find(',');
+            NameField field;
+            if (!parse_field(trim(fields.substr(0, comma)), field))
+                fields_ok = false;
+            pattern.fields.push_back(field);
+            fields = (comma == std::string_view::npos) ? std::string_view() : fields.substr(comma + 1);
+        }
+        
+        std::string regex(item.substr(equals + 1));
+        
+        try {
+            pattern.regex.assign(regex, std::regex::ECMAScript | std::regex::optimize);
+        }
+        catch (const std::regex_error& e) {
+            AUDWARN("Invalid name pattern %s: %s\n", regex.c_str(), e.what());
+            fields_ok = false;
+        }
+        
+        if (!fields_ok || pattern.regex.mark_count() < pattern.fields.size())
+        {
+            AUDWARN("Ignoring name pattern %.*s\n", (int)item.size(), item.data());
+            ok = false;
+            continue;
+        }
+        
+        patterns->push_back(std::move(pattern));
     }
+    
+    std::shared_ptr<const NamePatterns> compiled;
+    if (!patterns->empty())
+        compiled = std::move(patterns);
+    
+    std::atomic_store(&s_name_patterns, compiled);
+    return ok;
 }
@@ -22,8 +22,30 @@
 
 #include "album.h"
 #include <string>
+#include <string_view>
 
-// Extract metadata from directory path and name
+// Extract metadata from directory path and name.  Understood by default:
+// a "(YYYY) " prefix for the year, a trailing "[CAT-123]" catalog number,
+// a disc marker such as "CD2" or "(Disc 2)" at the end of the name, and
+// album directories called just "CD1", "Disc 1"... inside the real
+// album directory.  The parent directory names the artist.
 void extract_metadata(const std::string& directory_path, Album& album);
 
+// True for a whole disc marker: "CD1", "cd 2", "Disc 3", "disk_1", "CD.2"
+bool parse_disc_name(std::string_view name, int& disc);
+
+// Track number and title from a track file name such as "03 - Title.flac",
+// "1-03. Title.mp3" or "Title.ogg" (number 0); any directory part is
+// ignored
+void parse_track_name(std::string_view name, int& number, std::string& title);
+
+// Additional directory name patterns, tried in order before the default
+// ones.  The spec holds patterns separated by ";;", each written as
+// "field,field,...=regex" with one field per capture group: year, title,
+// artist, disc, catalog or "-" to ignore the group.  For example:
+//     year,artist,title=^(\d{4}) - (.+) - (.+)$
+// The regexes are compiled once here.  Returns false (and keeps the other
+// patterns) if one of them is invalid.  Safe to call while a scan runs.
+bool set_name_patterns(const std::string& spec);
+
 #endif // METADATA_H
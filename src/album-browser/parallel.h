@@ -0,0 +1,136 @@
+/*
+ * parallel.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Resolves a configured worker count (0 = one per hardware thread)
+inline int resolve_worker_count(int requested)
+{
+    if (requested > 0)
+        return requested;
+
+    int hw = (int)std::thread::hardware_concurrency();
+    return std::max(1, hw);
+}
+
+// Calls fn(index) for every index in [0, count) using up to n_workers
+// threads (the calling thread included).  Each worker starts with an equal
+// slice of the range and takes items from the front of it; a worker whose
+// slice runs dry steals the back half of another worker's slice, so a few
+// slow items cannot leave the other threads idle.  Stops early as soon as
+// cancel becomes true.
+template<class F>
+void parallel_for_index(size_t count, int n_workers, const std::atomic<bool>& cancel, F fn)
+{
+    if (count == 0)
+        return;
+
+    n_workers = (int)std::min<size_t>(std::max(1, n_workers), count);
+
+    if (n_workers == 1)
+    {
+        for (size_t i = 0; i < count && !cancel; i++)
+            fn(i);
+        return;
+    }
+
+    struct Slice {
+        std::mutex mutex;
+        size_t begin = 0, end = 0;
+    };
+
+    std::unique_ptr<Slice[]> slices(new Slice[n_workers]);
+    for (int w = 0; w < n_workers; w++)
+    {
+        slices[w].begin = count * w / n_workers;
+        slices[w].end = count * (w + 1) / n_workers;
+    }
+
+    auto take_own = [&](int w, size_t& index) {
+        std::lock_guard<std::mutex> lock(slices[w].mutex);
+        if (slices[w].begin >= slices[w].end)
+            return false;
+        index = slices[w].begin++;
+        return true;
+    };
+
+    auto steal = [&](int w) {
+        for (int k = 1; k < n_workers; k++)
+        {
+            Slice& victim = slices[(w + k) % n_workers];
+            size_t begin, end;
+
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (victim.begin >= victim.end)
+                    continue;
+
+                size_t left = victim.end - victim.begin;
+                end = victim.end;
+                begin = end - (left + 1) / 2;
+                victim.end = begin;
+            }
+
+            std::lock_guard<std::mutex> lock(slices[w].mutex);
+            slices[w].begin = begin;
+            slices[w].end = end;
+            return true;
+        }
+
+        return false;
+    };
+
+    auto worker = [&](int w) {
+        size_t index;
+        while (!cancel)
+        {
+            if (!take_own(w, index))
+            {
+                // Nothing is ever added to the slices, so once stealing
+                // fails everywhere the whole range has been handed out.
+                if (!steal(w))
+                    return;
+                continue;
+            }
+
+            fn(index);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n_workers - 1);
+    for (int w = 1; w < n_workers; w++)
+        threads.emplace_back(worker, w);
+
+    worker(0);
+
+    for (auto& thread : threads)
+        thread.join();
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,91 @@
+/*
+ * pixcache.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "pixcache.h"
+
+// Bookkeeping per entry, also charged for null pixmaps
+static constexpr size_t ITEM_OVERHEAD = 128;
+
+static size_t pixmap_cost(const QPixmap& pixmap)
+{
+    if (pixmap.isNull())
+        return ITEM_OVERHEAD;
+    
+    return ITEM_OVERHEAD + (size_t)pixmap.width() * pixmap.height() * pixmap.depth() / 8;
+}
+
+void PixmapCache::set_max_bytes(size_t max_bytes)
+{
+    max_bytes_ = max_bytes;
+    evict();
+}
+
+const QPixmap* PixmapCache::find(const std::string& key)
+{
+    auto it = map_.find(key);
+    if (it == map_.end())
+    {
+        misses_++;
+        return nullptr;
+    }
+    
+    hits_++;
+    items_.splice(items_.begin(), items_, it->second);
+    return &it->second->pixmap;
+}
+
+void PixmapCache::insert(const std::string& key, QPixmap pixmap)
+{
+    erase(key);
+    
+    size_t cost = pixmap_cost(pixmap);
+    items_.push_front({key, std::move(pixmap), cost});
+    map_.emplace(key, items_.begin());
+    bytes_ += cost;
+    
+    evict();
+}
+
+void PixmapCache::erase(const std::string& key)
+{
+    auto it = map_.find(key);
+    if (it != map_.end())
+        remove(it->second);
+}
+
+void PixmapCache::clear()
+{
+    items_.clear();
+    map_.clear();
+    bytes_ = 0;
+}
+
+void PixmapCache::remove(ItemList::iterator it)
+{
+    bytes_ -= it->cost;
+    map_.erase(it->key);
+    items_.erase(it);
+}
+
+void PixmapCache::evict()
+{
+    // The newest entry always stays, even if it alone is over budget
+    while (bytes_ > max_bytes_ && items_.size() > 1)
+        remove(std::prev(items_.end()));
+}
@@ -0,0 +1,71 @@
+/*
+ * pixcache.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef PIXCACHE_H
+#define PIXCACHE_H
+
+#include <QPixmap>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+// Scaled cover pixmaps, keyed by album directory, within a fixed memory
+// budget.  The least recently used pixmaps are dropped first; they are
+// decoded again (or fetched from the disk cache) if their tile returns.
+// A null pixmap records that the album has no usable cover.
+class PixmapCache
+{
+public:
+    explicit PixmapCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+    
+    void set_max_bytes(size_t max_bytes);
+    
+    // Returns nullptr on a miss
+    const QPixmap* find(const std::string& key);
+    void insert(const std::string& key, QPixmap pixmap);
+    void erase(const std::string& key);
+    void clear();
+    
+    size_t size() const { return map_.size(); }
+    size_t bytes() const { return bytes_; }
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    
+private:
+    struct Item {
+        std::string key;
+        QPixmap pixmap;
+        size_t cost;
+    };
+    
+    using ItemList = std::list<Item>;
+    
+    void remove(ItemList::iterator it);
+    void evict();
+    
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    uint64_t hits_ = 0, misses_ = 0;
+    ItemList items_;  // most recently used first
+    std::unordered_map<std::string, ItemList::iterator> map_;
+};
+
+#endif // PIXCACHE_H
@@ -0,0 +1,85 @@
+/*
+ * pool.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "pool.h"
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+class StringPool
+{
+public:
+    const char* intern(std::string_view str)
+    {
+        if (str.empty())
+            return "";
+        
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        auto it = strings_.find(str);
+        if (it != strings_.end())
+            return it->data();
+        
+        char* copy = allocate(str.size() + 1);
+        memcpy(copy, str.data(), str.size());
+        copy[str.size()] = 0;
+        
+        strings_.insert(std::string_view(copy, str.size()));
+        return copy;
+    }
+    
+private:
+    char* allocate(size_t size)
+    {
+        // Oversized strings get a block of their own
+        if (size > BLOCK_SIZE / 4)
+        {
+            blocks_.emplace_back(new char[size]);
+            return blocks_.back().get();
+        }
+        
+        if (!current_ || used_ + size > BLOCK_SIZE)
+        {
+            blocks_.emplace_back(new char[BLOCK_SIZE]);
+            current_ = blocks_.back().get();
+            used_ = 0;
+        }
+        
+        char* ptr = current_ + used_;
+        used_ += size;
+        return ptr;
+    }
+    
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* current_ = nullptr;
+    size_t used_ = 0;
+    
+    // Views into the blocks, which never move
+    std::unordered_set<std::string_view> strings_;
+};
+
+const char* intern_string(std::string_view str)
+{
+    static StringPool pool;
+    return pool.intern(str);
+}
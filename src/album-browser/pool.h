@@ -0,0 +1,59 @@
+/*
+ * pool.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Returns the interned copy of str.  Interned strings are stored back to
+// back in large arena blocks, live until the plugin is unloaded and are
+// shared by every album that uses them.  Safe to call from any thread.
+const char* intern_string(std::string_view str);
+
+// A string that repeats across many albums (such as the artist), held as a
+// pointer into the string pool.  Copying one is as cheap as copying a
+// pointer.
+class PooledString
+{
+public:
+    PooledString() = default;
+    PooledString(const char* str) : str_(intern_string(str)) {}
+    PooledString(const std::string& str) : str_(intern_string(str)) {}
+    PooledString(std::string_view str) : str_(intern_string(str)) {}
+    
+    const char* c_str() const { return str_; }
+    bool empty() const { return !str_[0]; }
+    size_t length() const { return strlen(str_); }
+    std::string str() const { return str_; }
+    
+    operator std::string() const { return str_; }
+    operator std::string_view() const { return str_; }
+    
+    // Interned strings are unique, so pointers compare like values
+    bool operator==(const PooledString& other) const { return str_ == other.str_; }
+    bool operator!=(const PooledString& other) const { return str_ != other.str_; }
+    
+private:
+    const char* str_ = "";
+};
+
+#endif // POOL_H
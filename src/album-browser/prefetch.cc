@@ -0,0 +1,122 @@
+/*
+ * prefetch.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+
+#include "prefetch.h"
+#include <algorithm>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libaudcore/audstrings.h>
+#include <libaudcore/probe.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+// Reads (and drops) the start of a file, which leaves it in the page
+// cache.  The advice alone may be ignored by network filesystems.
+static void warm_file(const std::string& path, size_t length)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED);
+#endif
+    
+    static constexpr size_t CHUNK = 64 * 1024;
+    std::unique_ptr<char[]> buffer(new char[CHUNK]);
+    
+    for (size_t offset = 0; offset < length;)
+    {
+        ssize_t got = pread(fd, buffer.get(), std::min(CHUNK, length - offset), offset);
+        if (got <= 0)
+            break;
+        offset += got;
+    }
+    
+    close(fd);
+}
+
+Prefetcher::Prefetcher() : thread_(&Prefetcher::run, this)
+{
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    
+    wake_.notify_one();
+    thread_.join();
+}
+
+void Prefetcher::request(const Album& album)
+{
+    if (album.n_tracks() == 0)
+        return;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        track_ = album.track_path(0);
+        cover_ = album.cover_art_path;
+        pending_ = true;
+    }
+    
+    wake_.notify_one();
+}
+
+void Prefetcher::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    while (true)
+    {
+        wake_.wait(lock, [this]() { return quit_ || pending_; });
+        if (quit_)
+            return;
+        
+        std::string track = std::move(track_);
+        std::string cover = std::move(cover_);
+        pending_ = false;
+        
+        if (track == last_track_)
+            continue;
+        
+        last_track_ = track;
+        lock.unlock();
+        
+        warm_file(track, TRACK_BYTES);
+        
+        // Most covers fit in the same budget; embedded art is in the track
+        if (!cover.empty())
+            warm_file(cover, TRACK_BYTES);
+        
+        StringBuf uri = filename_to_uri(track.c_str());
+        if (uri)
+        {
+            VFSFile file;
+            aud_file_find_decoder(uri, false, file);
+        }
+        
+        lock.lock();
+    }
+}
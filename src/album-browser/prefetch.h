@@ -0,0 +1,63 @@
+/*
+ * prefetch.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "album.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Warms up the album under the pointer so that a click plays at once even
+// from a slow network share: the start of the first track and the cover
+// are read into the page cache, and Audacious probes the track for its
+// decoder (which opens it through VFS and loads the input plugin).  Works
+// on one thread of its own; a new request replaces one that has not
+// started yet, so sweeping the pointer across the grid costs nothing.
+class Prefetcher
+{
+public:
+    // Read from the start of the track; enough for the decoder to open it
+    // and fill its first buffers
+    static constexpr size_t TRACK_BYTES = 512 * 1024;
+    
+    Prefetcher();
+    ~Prefetcher();
+    
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+    
+    void request(const Album& album);
+    
+private:
+    void run();
+    
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool quit_ = false;
+    bool pending_ = false;
+    std::string track_, cover_;
+    std::string last_track_;  // warmed last, not done again right away
+    std::thread thread_;
+};
+
+#endif // PREFETCH_H
@@ -18,12 +18,32 @@
  */
 
 #include "scanner.h"
+#include "artprobe.h"
+#include "dirscan.h"
 #include "metadata.h"
+#include "parallel.h"
+#include "sort.h"
 #include <filesystem>
 #include <algorithm>
-#include <fstream>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <iterator>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 #include <libaudcore/runtime.h>
 #include <taglib/fileref.h>
+#include <taglib/tag.h>
+#include <taglib/tpropertymap.h>
 #include <taglib/flacfile.h>
 #include <taglib/mpegfile.h>
 #include <taglib/id3v2tag.h>
@@ -33,18 +53,102 @@
 
 namespace fs = std::filesystem;
 
-Scanner::Scanner() : scanning_(false), cancel_requested_(false)
+static int64_t now_us()
 {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Adds the time until it goes out of scope to a counter
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(std::atomic<uint64_t>& counter) : counter_(counter), start_(now_us()) {}
+    ~ScopedTimer() { counter_ += now_us() - start_; }
+    
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    
+private:
+    std::atomic<uint64_t>& counter_;
+    int64_t start_;
+};
+
+Scanner::Scanner() : scanning_(false), cancel_requested_(false), worker_count_(0),
+    background_(true), read_rate_(0), paused_until_us_(0), rate_clock_us_(0), tag_mode_(false), stat_directories_listed_(0), stat_albums_found_(0), stat_albums_done_(0),
+    stat_albums_reused_(0), stat_syscalls_(0), stat_bytes_read_(0), stat_art_lookups_(0),
+    stat_art_store_hits_(0), stat_walk_us_(0), stat_process_us_(0), stat_tags_us_(0),
+    stat_art_us_(0), stat_store_us_(0), last_progress_us_(0)
+{
+    set_cover_names(DEFAULT_COVER_NAMES);
 }
 
 Scanner::~Scanner()
 {
-    cancel();
-    if (scan_thread_.joinable())
-        scan_thread_.join();
+    cancel_and_wait();
+}
+
+// Threads started afterwards inherit the policy on Linux, but not on macOS,
+// so every worker calls this for itself
+static void lower_thread_priority()
+{
+    static thread_local bool lowered = false;
+    if (lowered)
+        return;
+    
+    lowered = true;
+    
+#ifdef __linux__
+    struct sched_param param = {};
+    if (sched_setscheduler(0, SCHED_IDLE, &param) < 0)
+        AUDWARN("Cannot lower the scan thread priority\n");
+    
+#ifdef SYS_ioprio_set
+    // Not in the C library headers: IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE
+    constexpr int IOPRIO_WHO_PROCESS = 1, IOPRIO_CLASS_IDLE = 3, IOPRIO_CLASS_SHIFT = 13;
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0)
+        AUDWARN("Cannot lower the scan thread I/O priority\n");
+#endif
+#elif defined(__APPLE__)
+    setpriority(PRIO_DARWIN_THREAD, 0, PRIO_DARWIN_BG);
+#endif
+}
+
+void Scanner::scan_async(const std::vector<std::string>& roots, ScanCallback callback,
+                         ScanCallback batch_callback)
+{
+    start_scan([this, roots]() {
+        return scan_directory_tree(roots, nullptr);
+    }, callback, std::move(batch_callback));
+}
+
+void Scanner::scan_incremental_async(const std::vector<std::string>& roots,
+                                     std::vector<Album> previous, ScanCallback callback)
+{
+    start_scan([this, roots, previous = std::move(previous)]() mutable {
+        return scan_directory_tree(roots, previous.empty() ? nullptr : &previous);
+    }, callback);
+}
+
+void Scanner::scan_subtrees_async(const std::vector<std::string>& roots,
+                                  std::vector<std::string> dirs, std::vector<Album> previous,
+                                  ScanCallback callback)
+{
+    start_scan([this, roots, dirs = std::move(dirs), previous = std::move(previous)]() mutable {
+        return scan_subtrees(roots, dirs, previous);
+    }, callback);
+}
+
+void Scanner::scan_library_async(const std::vector<std::string>& roots,
+                                 std::vector<LibraryTrack> tracks, ScanCallback callback)
+{
+    start_scan([this, roots, tracks = std::move(tracks)]() mutable {
+        return scan_library(roots, tracks);
+    }, callback);
 }
 
-void Scanner::scan_async(const std::string& root_path, ScanCallback callback)
+void Scanner::start_scan(std::function<std::vector<Album>()> job, ScanCallback callback,
+                         ScanCallback batch_callback)
 {
     if (scanning_)
         return;
@@ -55,16 +159,83 @@ void Scanner::scan_async(const std::string& root_path, ScanCallback callback)
     
     scanning_ = true;
     cancel_requested_ = false;
+    batch_callback_ = std::move(batch_callback);
     
-    scan_thread_ = std::thread([this, root_path, callback]() {
-        std::vector<Album> albums = scan_directory_tree(root_path);
+    scan_thread_ = std::thread([this, job = std::move(job), callback]() mutable {
+        if (background_)
+            lower_thread_priority();
+        
+        std::vector<Album> albums = job();
+        if (art_store_)
+        {
+            ScopedTimer timer(stat_store_us_);
+            art_store_->save();
+        }
+        
+        report_progress(ScanProgress::Done, true);
         scanning_ = false;
+        log_stats(albums.size());
         
         if (!cancel_requested_ && callback)
-            callback(albums);
+            callback(std::move(albums));
     });
 }
 
+void Scanner::add_to_batch(const Album& album)
+{
+    std::lock_guard<std::mutex> lock(batch_mutex_);
+    batch_.push_back(album);
+    
+    if (batch_.size() >= BATCH_SIZE)
+    {
+        batch_callback_(std::move(batch_));
+        batch_.clear();
+    }
+}
+
+void Scanner::flush_batch()
+{
+    std::lock_guard<std::mutex> lock(batch_mutex_);
+    
+    if (!batch_.empty() && !cancel_requested_)
+        batch_callback_(std::move(batch_));
+    batch_.clear();
+}
+
+void Scanner::pause_for(int ms)
+{
+    int64_t until = now_us() + (int64_t)ms * 1000;
+    int64_t current = paused_until_us_;
+    while (current < until && !paused_until_us_.compare_exchange_weak(current, until))
+        ;
+}
+
+// Called by the scan threads after each read.  The rate cap is shared by
+// all of them: every read moves a common clock on by the time it costs,
+// and whoever gets ahead of real time sleeps until the clock is reached.
+void Scanner::throttle(uint64_t bytes)
+{
+    static constexpr int64_t SLEEP_STEP_US = 50000;  // to notice cancel()
+    
+    while (!cancel_requested_ && now_us() < paused_until_us_)
+        std::this_thread::sleep_for(std::chrono::microseconds(SLEEP_STEP_US));
+    
+    int rate = read_rate_;
+    if (rate <= 0)
+        return;
+    
+    int64_t cost = (int64_t)(bytes * 1000000 / ((uint64_t)rate << 10));
+    int64_t now = now_us();
+    int64_t start = rate_clock_us_, end;
+    
+    do {
+        end = std::max(start, now) + cost;
+    } while (!rate_clock_us_.compare_exchange_weak(start, end));
+    
+    while (!cancel_requested_ && (now = now_us()) < end)
+        std::this_thread::sleep_for(std::chrono::microseconds(std::min(end - now, SLEEP_STEP_US)));
+}
+
 void Scanner::cancel()
 {
     cancel_requested_ = true;
@@ -75,296 +246,986 @@ bool Scanner::is_scanning() const
     return scanning_;
 }
 
-bool Scanner::is_leaf_directory(const std::string& path)
+void Scanner::cancel_and_wait()
 {
-    try {
-        for (const auto& entry : fs::directory_iterator(path))
+    cancel();
+    if (scan_thread_.joinable())
+        scan_thread_.join();
+}
+
+ScanStats Scanner::get_stats() const
+{
+    ScanStats stats;
+    stats.directories_listed = stat_directories_listed_;
+    stats.albums_found = stat_albums_found_;
+    stats.albums_done = stat_albums_done_;
+    stats.albums_reused = stat_albums_reused_;
+    stats.syscalls = stat_syscalls_;
+    stats.bytes_read = stat_bytes_read_;
+    stats.art_lookups = stat_art_lookups_;
+    stats.art_store_hits = stat_art_store_hits_;
+    stats.walk_us = stat_walk_us_;
+    stats.process_us = stat_process_us_;
+    stats.tags_us = stat_tags_us_;
+    stats.art_us = stat_art_us_;
+    stats.store_us = stat_store_us_;
+    return stats;
+}
+
+void Scanner::report_progress(ScanProgress::Phase phase, bool force)
+{
+    if (!progress_callback_)
+        return;
+    
+    // Of the workers that notice the interval is over, only one reports
+    int64_t now = now_us();
+    int64_t last = last_progress_us_;
+    if (force)
+        last_progress_us_ = now;
+    else if (now - last < PROGRESS_INTERVAL_MS * 1000 ||
+             !last_progress_us_.compare_exchange_strong(last, now))
+        return;
+    
+    ScanProgress progress;
+    progress.phase = phase;
+    progress.stats = get_stats();
+    progress_callback_(progress);
+}
+
+void Scanner::log_stats(size_t n_albums) const
+{
+    ScanStats stats = get_stats();
+    
+    AUDINFO("Scanned %d albums (%llu unchanged), %llu directories, "
+            "%llu filesystem calls\n", (int)n_albums,
+            (unsigned long long)stats.albums_reused,
+            (unsigned long long)stats.directories_listed,
+            (unsigned long long)stats.syscalls);
+    AUDINFO("Scan took %d ms walking, %d ms processing (%d ms tags, %d ms embedded art "
+            "over all workers), %d ms saving the art store\n",
+            (int)(stats.walk_us / 1000), (int)(stats.process_us / 1000),
+            (int)(stats.tags_us / 1000), (int)(stats.art_us / 1000),
+            (int)(stats.store_us / 1000));
+    AUDINFO("Embedded art: %llu lookups, %llu from the art store, %llu KiB read\n",
+            (unsigned long long)stats.art_lookups,
+            (unsigned long long)stats.art_store_hits,
+            (unsigned long long)(stats.bytes_read >> 10));
+}
+
+static std::string lower_extension(const fs::path& path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+// Only actual audio files count (not .cue or other metadata)
+static bool is_audio_extension(const std::string& ext)
+{
+    return ext == ".flac" || ext == ".mp3" || ext == ".ogg" || 
+           ext == ".opus" || ext == ".m4a" || ext == ".aac" ||
+           ext == ".wav" || ext == ".wv" || ext == ".ape";
+}
+
+static bool is_image_extension(const std::string& ext)
+{
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || 
+           ext == ".gif" || ext == ".bmp" || ext == ".webp";
+}
+
+bool Scanner::stat_path(const std::string& path, int64_t& mtime, uint64_t& inode,
+                        uint64_t* size)
+{
+    struct stat st;
+    
+    stat_syscalls_++;
+    if (stat(path.c_str(), &st) < 0)
+        return false;
+    
+#ifdef __APPLE__
+    mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    inode = st.st_ino;
+    if (size)
+        *size = st.st_size;
+    return true;
+}
+
+// What a directory listing counts as for the rate cap
+static constexpr uint64_t LISTING_COST = 4096;
+
+DirSummary Scanner::list_directory(const std::string& path)
+{
+    DirSummary summary;
+    
+    stat_directories_listed_++;
+    stat_syscalls_++;
+    throttle(LISTING_COST);
+    
+    std::vector<DirEntry> entries;
+    uint64_t calls = 0;
+    int error = read_directory(path, entries, calls);
+    stat_syscalls_ += calls;
+    
+    // Like skip_permission_denied, an unreadable directory is an empty one
+    if (error && error != EACCES)
+    {
+        AUDWARN("Cannot read directory %s: %s\n", path.c_str(), strerror(error));
+        return DirSummary();
+    }
+    
+    for (auto& entry : entries)
+    {
+        if (entry.type == EntryType::Directory)
         {
-            if (entry.is_directory())
-                return false;
+            summary.has_subdirs = true;
+            
+            // Like the old recursive walk, do not descend into symlinks
+            if (!entry.symlink)
+                summary.subdirs.push_back((fs::path(path) / entry.name).string());
+            continue;
         }
-        return true;
+        
+        // Skip hidden files, including macOS metadata files (._filename)
+        if (entry.type != EntryType::File || entry.name[0] == '.')
+            continue;
+        
+        std::string ext = lower_extension(entry.name);
+        
+        if (is_audio_extension(ext))
+            summary.audio_files.push_back(std::move(entry.name));
+        else if (is_image_extension(ext))
+            summary.images.push_back(std::move(entry.name));
     }
-    catch (const fs::filesystem_error& e) {
-        AUDWARN("Cannot read directory %s: %s\n", path.c_str(), e.what());
-        return false;
+    
+    summary.readable = true;
+    
+    // Sort audio files alphanumerically, subdirectories for a stable walk
+    std::sort(summary.audio_files.begin(), summary.audio_files.end());
+    std::sort(summary.subdirs.begin(), summary.subdirs.end());
+    
+    return summary;
+}
+
+static void ascii_lower(std::string& str)
+{
+    for (char& c : str)
+    {
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
     }
 }
 
-bool Scanner::contains_audio_files(const std::string& path)
+void Scanner::set_cover_names(const std::string& spec)
 {
-    try {
-        for (const auto& entry : fs::directory_iterator(path))
+    auto names = std::make_shared<std::vector<std::string>>();
+    
+    size_t pos = 0;
+    while (pos <= spec.size())
+    {
+        size_t end = std::min(spec.find(',', pos), spec.size());
+        size_t begin = spec.find_first_not_of(" \t", pos);
+        size_t last = spec.find_last_not_of(" \t", end - 1);
+        
+        if (begin < end && last != std::string::npos && last >= begin)
         {
-            if (entry.is_regular_file())
-            {
-                std::string filename = entry.path().filename().string();
-                
-                // Skip macOS metadata files (._filename)
-                if (filename.length() > 2 && filename[0] == '.' && filename[1] == '_')
-                    continue;
-                
-                // Skip hidden files
-                if (filename[0] == '.')
-                    continue;
-                
-                std::string ext = entry.path().extension().string();
-                std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-                
-                // Only check for actual audio files (not .cue or other metadata)
-                if (ext == ".flac" || ext == ".mp3" || ext == ".ogg" || 
-                    ext == ".opus" || ext == ".m4a" || ext == ".aac" ||
-                    ext == ".wav" || ext == ".wv" || ext == ".ape")
-                    return true;
-            }
+            std::string name = spec.substr(begin, last + 1 - begin);
+            ascii_lower(name);
+            names->push_back(std::move(name));
         }
-        return false;
+        
+        pos = end + 1;
     }
-    catch (const fs::filesystem_error& e) {
-        AUDWARN("Cannot read directory %s: %s\n", path.c_str(), e.what());
-        return false;
+    
+    if (names->empty() && spec != DEFAULT_COVER_NAMES)
+    {
+        set_cover_names(DEFAULT_COVER_NAMES);
+        return;
     }
+    
+    std::atomic_store(&cover_names_, std::shared_ptr<const std::vector<std::string>>(names));
 }
 
-std::string Scanner::find_cover_art(const std::string& path)
+// Image types preferred for a cover name given without an extension
+static constexpr int N_EXTENSION_RANKS = 4;
+
+static int extension_rank(std::string_view ext)
 {
-    // First try common cover art names with priority
-    const char* cover_names[] = {
-        // JPG variants
-        "Cover.jpg", "Folder.jpg", "cover.jpg", "folder.jpg", "front.jpg", "Front.jpg",
-        "album.jpg", "Album.jpg", "artwork.jpg", "Artwork.jpg",
-        // PNG variants
-        "Cover.png", "Folder.png", "cover.png", "folder.png", "front.png", "Front.png",
-        "album.png", "Album.png", "artwork.png", "Artwork.png",
-        // JPEG variants
-        "Cover.jpeg", "cover.jpeg", "Folder.jpeg", "folder.jpeg",
-        // Other common names
-        "cover.JPG", "COVER.JPG", "folder.JPG", "FOLDER.JPG"
-    };
+    if (ext == "jpg")
+        return 0;
+    if (ext == "png")
+        return 1;
+    if (ext == "jpeg")
+        return 2;
+    return 3;
+}
+
+// Works on the listing alone: no file is looked up by name
+std::string Scanner::find_cover_art(const std::string& path, const DirSummary& summary)
+{
+    if (summary.images.empty())
+        return "";
     
-    for (const char* name : cover_names)
-    {
-        fs::path cover_path = fs::path(path) / name;
-        if (fs::exists(cover_path) && fs::is_regular_file(cover_path))
-            return cover_path.string();
-    }
+    auto names = std::atomic_load(&cover_names_);
+    size_t best_rank = SIZE_MAX;
+    const std::string* best = &summary.images[0];
     
-    // If no common name found, look for ANY image file
-    try {
-        for (const auto& entry : fs::directory_iterator(path))
+    for (const auto& image : summary.images)
+    {
+        std::string lower = image;
+        ascii_lower(lower);
+        
+        // The listing only holds images with a known extension
+        size_t dot = lower.rfind('.');
+        std::string_view stem(lower.data(), dot);
+        std::string_view ext(lower.data() + dot + 1, lower.size() - dot - 1);
+        
+        for (size_t n = 0; n < names->size() && n * N_EXTENSION_RANKS < best_rank; n++)
         {
-            if (entry.is_regular_file())
+            const std::string& name = (*names)[n];
+            size_t rank;
+            
+            if (name == lower)
+                rank = n * N_EXTENSION_RANKS;
+            else if (name == stem)
+                rank = n * N_EXTENSION_RANKS + extension_rank(ext);
+            else
+                continue;
+            
+            if (rank < best_rank)
             {
-                std::string filename = entry.path().filename().string();
-                
-                // Skip macOS metadata files
-                if (filename.length() > 2 && filename[0] == '.' && filename[1] == '_')
-                    continue;
-                
-                // Skip hidden files
-                if (filename[0] == '.')
-                    continue;
-                
-                std::string ext = entry.path().extension().string();
-                std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-                
-                // Check for image extensions
-                if (ext == ".jpg" || ext == ".jpeg" || ext == ".png" || 
-                    ext == ".gif" || ext == ".bmp" || ext == ".webp")
-                {
-                    return entry.path().string();
-                }
+                best_rank = rank;
+                best = &image;
             }
+            break;
         }
     }
-    catch (const fs::filesystem_error& e) {
-        AUDWARN("Cannot read directory for cover art %s: %s\n", path.c_str(), e.what());
-    }
     
-    return "";
+    return (fs::path(path) / *best).string();
 }
 
 std::string Scanner::extract_embedded_art(const std::string& audio_file)
 {
+    if (!art_store_)
+        return "";
+    
+    std::string ext = lower_extension(audio_file);
+    bool taglib_fallback = (ext == ".flac" || ext == ".mp3");
+    if (!taglib_fallback && ext != ".ogg" && ext != ".opus" && ext != ".m4a")
+        return "";
+    
+    ScopedTimer timer(stat_art_us_);
+    stat_art_lookups_++;
+    
+    int64_t mtime;
+    uint64_t inode, size;
+    if (!stat_path(audio_file, mtime, inode, &size))
+        return "";
+    
+    // Unchanged since the last extraction
+    std::string image;
+    if (art_store_->lookup(audio_file, size, mtime, image))
+    {
+        stat_art_store_hits_++;
+        return image;
+    }
+    
+    // Remembered even when there is no picture, so the file is not
+    // opened again on the next scan
+    std::string data;
+    uint64_t bytes_read = 0;
+    ProbeResult result = probe_embedded_art(audio_file, data, &bytes_read);
+    stat_bytes_read_ += bytes_read;
+    throttle(bytes_read);
+    
+    switch (result)
+    {
+    case ProbeResult::Found:
+        return art_store_->store(audio_file, size, mtime, data.data(), data.size());
+    case ProbeResult::NoArt:
+        return art_store_->store(audio_file, size, mtime, nullptr, 0);
+    case ProbeResult::Failed:
+        break;
+    }
+    
+    // Structures the probe does not handle (compressed ID3 frames, for
+    // one) are left to TagLib; other formats to Audacious at load time
+    if (!taglib_fallback)
+        return "";
+    
+    TagLib::ByteVector picture;
+    
     try {
-        std::string ext = fs::path(audio_file).extension().string();
-        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-        
         if (ext == ".flac")
         {
             TagLib::FLAC::File file(audio_file.c_str());
             if (file.isValid() && !file.pictureList().isEmpty())
-            {
-                const TagLib::FLAC::Picture* picture = file.pictureList().front();
-                TagLib::ByteVector data = picture->data();
-                
-                if (data.size() > 0)
-                {
-                    // Create temp file in /tmp
-                    std::string temp_path = "/tmp/audacious_cover_" + 
-                        std::to_string(std::hash<std::string>{}(audio_file)) + ".jpg";
-                    
-                    std::ofstream out(temp_path, std::ios::binary);
-                    out.write(data.data(), data.size());
-                    out.close();
-                    
-                    return temp_path;
-                }
-            }
+                picture = file.pictureList().front()->data();
         }
-        else if (ext == ".mp3")
+        else
         {
             TagLib::MPEG::File file(audio_file.c_str());
             if (file.isValid() && file.ID3v2Tag())
             {
                 TagLib::ID3v2::FrameList frames = file.ID3v2Tag()->frameListMap()["APIC"];
                 if (!frames.isEmpty())
-                {
-                    TagLib::ID3v2::AttachedPictureFrame* frame = 
-                        static_cast<TagLib::ID3v2::AttachedPictureFrame*>(frames.front());
-                    TagLib::ByteVector data = frame->picture();
-                    
-                    if (data.size() > 0)
-                    {
-                        // Create temp file in /tmp
-                        std::string temp_path = "/tmp/audacious_cover_" + 
-                            std::to_string(std::hash<std::string>{}(audio_file)) + ".jpg";
-                        
-                        std::ofstream out(temp_path, std::ios::binary);
-                        out.write(data.data(), data.size());
-                        out.close();
-                        
-                        return temp_path;
-                    }
-                }
+                    picture = static_cast<TagLib::ID3v2::AttachedPictureFrame*>(frames.front())->picture();
             }
         }
     }
     catch (const std::exception& e) {
         AUDWARN("Failed to extract embedded art from %s: %s\n", audio_file.c_str(), e.what());
+        return "";
     }
     
-    return "";
+    // TagLib does not tell what it read; at least the picture was
+    stat_bytes_read_ += picture.size();
+    throttle(picture.size());
+    return art_store_->store(audio_file, size, mtime, picture.data(), picture.size());
 }
 
-Album Scanner::create_album_from_directory(const std::string& path)
+bool Scanner::read_tags(const std::string& track, TrackTags& tags)
+{
+    ScopedTimer timer(stat_tags_us_);
+    
+    // Audio properties are not needed, which saves reading any audio data
+    TagLib::FileRef file(track.c_str(), false);
+    if (file.isNull() || !file.tag())
+        return false;
+    
+    TagLib::Tag* tag = file.tag();
+    tags.album = tag->album().to8Bit(true);
+    tags.artist = tag->artist().to8Bit(true);
+    tags.year = tag->year();
+    
+    TagLib::PropertyMap properties = file.file()->properties();
+    
+    auto it = properties.find("ALBUMARTIST");
+    if (it != properties.end() && !it->second.isEmpty())
+        tags.artist = it->second.front().to8Bit(true);
+    
+    // "2" or "2/3"; one disc out of one is not worth showing
+    it = properties.find("DISCNUMBER");
+    if (it != properties.end() && !it->second.isEmpty())
+    {
+        std::string value = it->second.front().to8Bit(true);
+        int number = atoi(value.c_str());
+        size_t slash = value.find('/');
+        int total = (slash != std::string::npos) ? atoi(value.c_str() + slash + 1) : 0;
+        
+        if (total > 1 || (total == 0 && number > 1))
+            tags.disc = number;
+    }
+    
+    return true;
+}
+
+Album Scanner::create_album_from_directory(const AlbumSlot& slot, const TrackTags* tags)
 {
     Album album;
-    album.directory_path = path;
+    album.directory_path = slot.path;
     
     // Extract metadata from directory name
-    extract_metadata(path, album);
+    extract_metadata(slot.path, album);
+    
+    // Find cover art (file-based first), next to the discs if need be
+    album.cover_art_path = find_cover_art(slot.path, slot.summary);
+    for (const auto& disc : slot.discs)
+    {
+        if (album.cover_art_path.empty())
+            album.cover_art_path = find_cover_art(disc.path, disc.summary);
+    }
     
-    // Find cover art (file-based first)
-    album.cover_art_path = find_cover_art(path);
+    // The listing already filtered and sorted the audio files
+    for (const auto& name : slot.summary.audio_files)
+        album.add_track(name);
     
-    // Collect audio files
-    try {
-        for (const auto& entry : fs::directory_iterator(path))
+    // Tags override the directory names where they are set
+    TrackTags read;
+    if (tag_mode_ && !tags && album.n_tracks() > 0 && read_tags(album.track_path(0), read))
+        tags = &read;
+    
+    if (tags)
+    {
+        if (!tags->album.empty())
+            album.title = tags->album;
+        if (!tags->artist.empty())
+            album.artist = tags->artist;
+        if (tags->year > 0)
+            album.year = tags->year;
+        if (tags->disc > 0)
+            album.disc = tags->disc;
+    }
+    
+    // All discs of the set are in here
+    if (!slot.discs.empty())
+        album.disc = 0;
+    
+    // If no file-based cover art found, try extracting from first audio file
+    if (album.cover_art_path.empty() && album.n_tracks() > 0)
+        album.cover_art_path = extract_embedded_art(album.track_path(0));
+    
+    // The stamp of the cover lets the thumbnail cache tell whether its
+    // copy is still current without touching the file again
+    if (!album.cover_art_path.empty())
+    {
+        uint64_t inode;
+        stat_path(album.cover_art_path, album.cover_mtime, inode, &album.cover_size);
+    }
+    
+    return album;
+}
+
+void Scanner::reset_stats()
+{
+    stat_directories_listed_ = 0;
+    stat_albums_found_ = 0;
+    stat_albums_done_ = 0;
+    stat_albums_reused_ = 0;
+    stat_syscalls_ = 0;
+    stat_bytes_read_ = 0;
+    stat_art_lookups_ = 0;
+    stat_art_store_hits_ = 0;
+    stat_walk_us_ = 0;
+    stat_process_us_ = 0;
+    stat_tags_us_ = 0;
+    stat_art_us_ = 0;
+    stat_store_us_ = 0;
+    last_progress_us_ = 0;
+}
+
+// Stamps the paths not stamped already, in as few calls as the batch
+// allows.  Without io_uring there is nothing to gain by stamping early.
+void Scanner::stamp_ahead(StampAhead& ahead, const std::vector<std::string>& paths)
+{
+    if (!ahead.batch.batched())
+        return;
+    
+    std::vector<const std::string*> missing;
+    for (const auto& path : paths)
+    {
+        if (!ahead.stamps.count(path))
+            missing.push_back(&path);
+    }
+    
+    if (missing.empty())
+        return;
+    
+    std::vector<DirStamp> stamps;
+    stat_syscalls_ += ahead.batch.stat(missing, stamps);
+    
+    for (size_t i = 0; i < missing.size(); i++)
+        ahead.stamps.emplace(*missing[i], stamps[i]);
+}
+
+// A stamp taken ahead is used once; anything else is stamped now
+bool Scanner::take_stamp(StampAhead& ahead, const std::string& path, int64_t& mtime,
+                         uint64_t& inode)
+{
+    auto it = ahead.stamps.find(path);
+    if (it == ahead.stamps.end())
+        return stat_path(path, mtime, inode);
+    
+    DirStamp stamp = it->second;
+    ahead.stamps.erase(it);
+    
+    mtime = stamp.mtime;
+    inode = stamp.inode;
+    return stamp.ok;
+}
+
+// Stamps an album directory.  A grouped album also changes when one of
+// its disc directories does, so it takes the newest of their mtimes.
+bool Scanner::stat_album(const std::string& path, const Album* known, StampAhead& ahead,
+                         int64_t& mtime, uint64_t& inode)
+{
+    if (!take_stamp(ahead, path, mtime, inode))
+        return false;
+    
+    if (known)
+    {
+        for (const auto& dir : known->subdirectories())
         {
-            if (entry.is_regular_file())
+            int64_t disc_mtime;
+            uint64_t disc_inode;
+            if (take_stamp(ahead, path + '/' + dir, disc_mtime, disc_inode))
+                mtime = std::max(mtime, disc_mtime);
+        }
+    }
+    
+    return true;
+}
+
+// Turns a directory whose subdirectories are all discs ("CD1", "Disc 2"...)
+// into one album slot, with the track names relative to it.  Returns
+// false, leaving the slot alone, if it is anything else.
+bool Scanner::group_discs(AlbumSlot& slot, const AlbumMap& known, StampAhead& ahead)
+{
+    std::vector<std::pair<int, const std::string*>> order;
+    for (const auto& dir : slot.summary.subdirs)
+    {
+        int number;
+        if (!parse_disc_name(std::string_view(dir).substr(slot.path.size() + 1), number))
+            return false;
+        order.emplace_back(number, &dir);
+    }
+    
+    if (order.empty())
+        return false;
+    
+    std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first < b.first : *a.second < *b.second;
+    });
+    
+    stamp_ahead(ahead, slot.summary.subdirs);
+    
+    std::vector<AlbumSlot> discs;
+    for (const auto& entry : order)
+    {
+        AlbumSlot disc;
+        disc.path = *entry.second;
+        if (!take_stamp(ahead, disc.path, disc.mtime, disc.inode))
+            return false;
+        
+        // Discs kept apart by an earlier scan (their tags disagreed) stay
+        // apart until they change
+        auto it = known.find(disc.path);
+        if (it != known.end() && it->second->dir_mtime == disc.mtime &&
+            it->second->dir_inode == disc.inode)
+            return false;
+        
+        disc.summary = list_directory(disc.path);
+        if (!disc.summary.readable || disc.summary.has_subdirs)
+            return false;
+        
+        discs.push_back(std::move(disc));
+    }
+    
+    // The directory's own tracks (if any) come first
+    for (const auto& disc : discs)
+    {
+        std::string prefix = disc.path.substr(slot.path.size() + 1) + '/';
+        for (const auto& name : disc.summary.audio_files)
+            slot.summary.audio_files.push_back(prefix + name);
+        
+        slot.mtime = std::max(slot.mtime, disc.mtime);
+    }
+    
+    if (slot.summary.audio_files.empty())
+        return false;
+    
+    slot.discs = std::move(discs);
+    return true;
+}
+
+// How many directories a walk stamps in one go
+static constexpr size_t STAMP_AHEAD = 64;
+
+// Walks the trees below the pending directories, listing every directory
+// exactly once, and collects the leaf directories that contain audio files.
+// A directory's mtime only changes when entries are added, removed or
+// renamed, so a known album with the same stamp is still the same leaf with
+// the same tracks and does not need to be listed at all.
+void Scanner::walk_directories(std::vector<std::string> pending, const AlbumMap& known,
+                               std::vector<AlbumSlot>& slots)
+{
+    ScopedTimer timer(stat_walk_us_);
+    
+    // Depth-first, in sorted order
+    std::reverse(pending.begin(), pending.end());
+    
+    StampAhead ahead;
+    std::vector<std::string> batch;
+    
+    while (!pending.empty() && !cancel_requested_)
+    {
+        report_progress(ScanProgress::Walking);
+        
+        AlbumSlot slot;
+        slot.path = std::move(pending.back());
+        pending.pop_back();
+        
+        Album* candidate = nullptr;
+        if (!known.empty())
+        {
+            auto it = known.find(slot.path);
+            if (it != known.end())
+                candidate = it->second;
+        }
+        
+        // The directories next in line are stamped together with this one,
+        // and so are the discs of the known albums among them
+        if (ahead.batch.batched() && !ahead.stamps.count(slot.path))
+        {
+            batch.clear();
+            batch.push_back(slot.path);
+            
+            for (size_t i = pending.size(); i > 0 && batch.size() < STAMP_AHEAD; i--)
+                batch.push_back(pending[i - 1]);
+            
+            for (size_t i = 0, n = batch.size(); i < n && !known.empty(); i++)
             {
-                std::string filename = entry.path().filename().string();
-                
-                // Skip macOS metadata files (._filename)
-                if (filename.length() > 2 && filename[0] == '.' && filename[1] == '_')
-                    continue;
-                
-                // Skip hidden files
-                if (filename[0] == '.')
+                auto it = known.find(batch[i]);
+                if (it == known.end())
                     continue;
-                
-                std::string ext = entry.path().extension().string();
-                std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-                
-                // Only include actual audio files (exclude .cue and other metadata)
-                if (ext == ".flac" || ext == ".mp3" || ext == ".ogg" || 
-                    ext == ".opus" || ext == ".m4a" || ext == ".aac" ||
-                    ext == ".wav" || ext == ".wv" || ext == ".ape")
-                {
-                    // Verify file actually exists and is accessible
-                    std::string file_path = entry.path().string();
-                    if (fs::exists(file_path) && fs::is_regular_file(file_path))
-                    {
-                        album.audio_files.push_back(file_path);
-                    }
-                }
+                for (const auto& dir : it->second->subdirectories())
+                    batch.push_back(batch[i] + '/' + dir);
             }
+            
+            stamp_ahead(ahead, batch);
+        }
+        
+        if (!stat_album(slot.path, candidate, ahead, slot.mtime, slot.inode))
+            continue;
+        
+        if (candidate && candidate->dir_mtime == slot.mtime && candidate->dir_inode == slot.inode)
+        {
+            slot.reuse = candidate;
+            slots.push_back(std::move(slot));
+            stat_albums_found_++;
+            continue;
+        }
+        
+        slot.summary = list_directory(slot.path);
+        
+        if (!slot.summary.has_subdirs)
+        {
+            if (slot.summary.readable && !slot.summary.audio_files.empty())
+            {
+                slots.push_back(std::move(slot));
+                stat_albums_found_++;
+            }
+            continue;
+        }
+        
+        if (tag_mode_ && group_discs(slot, known, ahead))
+        {
+            slots.push_back(std::move(slot));
+            stat_albums_found_++;
+            continue;
+        }
+        
+        pending.insert(pending.end(), slot.summary.subdirs.rbegin(), slot.summary.subdirs.rend());
+    }
+}
+
+// Processes the albums (this is the slow part with metadata extraction)
+// on a pool of workers.  Every result lands in the slot of its directory so
+// the merge is deterministic.
+std::vector<Album> Scanner::process_slots(std::vector<AlbumSlot>& slots)
+{
+    ScopedTimer timer(stat_process_us_);
+    report_progress(ScanProgress::Processing, true);
+    
+    std::vector<Album> results(slots.size());
+    std::vector<Album> split;  // discs whose tags did not agree
+    std::mutex split_mutex;
+    
+    auto create = [this](const AlbumSlot& slot, const TrackTags* tags) {
+        Album album = create_album_from_directory(slot, tags);
+        album.dir_mtime = slot.mtime;
+        album.dir_inode = slot.inode;
+        album.date_added = slot.mtime / 1000000000;
+        return album;
+    };
+    
+    bool background = background_;
+    
+    auto process = [&](size_t i) {
+        if (background)
+            lower_thread_priority();
+        
+        const AlbumSlot& slot = slots[i];
+        if (slot.reuse)
+        {
+            results[i] = std::move(*slot.reuse);
+            stat_albums_reused_++;
+            return;
+        }
+        
+        if (slot.discs.empty())
+        {
+            results[i] = create(slot, slot.has_tags ? &slot.tags : nullptr);
+            return;
+        }
+        
+        // Only the first track of every disc is read
+        std::vector<TrackTags> tags(slot.discs.size());
+        bool agree = true;
+        
+        for (size_t d = 0; d < slot.discs.size(); d++)
+        {
+            const AlbumSlot& disc = slot.discs[d];
+            if (!disc.summary.audio_files.empty())
+                read_tags(disc.path + '/' + disc.summary.audio_files[0], tags[d]);
+            
+            if (tags[d].album != tags[0].album ||
+                (!tags[d].artist.empty() && !tags[0].artist.empty() &&
+                 tags[d].artist != tags[0].artist))
+                agree = false;
         }
         
-        // Sort audio files alphanumerically
-        std::sort(album.audio_files.begin(), album.audio_files.end());
+        if (agree)
+        {
+            results[i] = create(slot, &tags[0]);
+            return;
+        }
         
-        // If no file-based cover art found, try extracting from first audio file
-        if (album.cover_art_path.empty() && !album.audio_files.empty())
+        std::vector<Album> discs;
+        for (size_t d = 0; d < slot.discs.size(); d++)
         {
-            album.cover_art_path = extract_embedded_art(album.audio_files[0]);
+            if (!slot.discs[d].summary.audio_files.empty())
+                discs.push_back(create(slot.discs[d], &tags[d]));
         }
+        
+        std::lock_guard<std::mutex> lock(split_mutex);
+        for (auto& album : discs)
+            split.push_back(std::move(album));
+    };
+    
+    parallel_for_index(slots.size(), resolve_worker_count(worker_count_),
+        cancel_requested_, [&](size_t i) {
+            process(i);
+            stat_albums_done_++;
+            report_progress(ScanProgress::Processing);
+            
+            if (batch_callback_ && results[i].n_tracks() > 0)
+                add_to_batch(results[i]);
+        });
+    
+    std::vector<Album> albums;
+    if (cancel_requested_)
+        return albums;
+    
+    for (auto& album : split)
+    {
+        if (batch_callback_)
+            add_to_batch(album);
+        results.push_back(std::move(album));
     }
-    catch (const fs::filesystem_error& e) {
-        AUDWARN("Cannot read directory %s: %s\n", path.c_str(), e.what());
+    
+    if (batch_callback_)
+        flush_batch();
+    
+    albums.reserve(results.size());
+    for (auto& album : results)
+    {
+        if (album.n_tracks() > 0)
+            albums.push_back(std::move(album));
     }
     
-    return album;
+    return albums;
 }
 
-std::vector<Album> Scanner::scan_directory_tree(const std::string& root)
+static bool is_under(const std::string& path, const std::string& dir)
 {
-    std::vector<Album> albums;
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 &&
+           path[dir.size()] == '/';
+}
+
+static bool is_under_any(const std::string& path, const std::vector<std::string>& roots)
+{
+    for (const auto& root : roots)
+    {
+        if (is_under(path, root))
+            return true;
+    }
+    return false;
+}
+
+// Each root gets a thread of its own: the roots are usually separate disks
+// or shares, so walking them side by side overlaps their latencies
+void Scanner::walk_roots(const std::vector<std::string>& roots, const AlbumMap& known,
+                         std::vector<AlbumSlot>& slots)
+{
+    std::vector<std::vector<AlbumSlot>> root_slots(roots.size());
+    bool background = background_;
+    
+    parallel_for_index(roots.size(), (int)roots.size(), cancel_requested_, [&](size_t i) {
+        if (background)
+            lower_thread_priority();
+        
+        struct stat st;
+        stat_syscalls_++;
+        if (stat(roots[i].c_str(), &st) < 0 || !S_ISDIR(st.st_mode))
+        {
+            AUDERR("Music directory does not exist: %s\n", roots[i].c_str());
+            return;
+        }
+        
+        DirSummary root_summary = list_directory(roots[i]);
+        walk_directories(std::move(root_summary.subdirs), known, root_slots[i]);
+    });
+    
+    for (auto& found : root_slots)
+        std::move(found.begin(), found.end(), std::back_inserter(slots));
+}
+
+std::vector<Album> Scanner::scan_directory_tree(const std::vector<std::string>& roots,
+                                                std::vector<Album>* previous)
+{
+    reset_stats();
     
-    if (!fs::exists(root) || !fs::is_directory(root))
+    AlbumMap known;
+    if (previous)
     {
-        AUDERR("Music directory does not exist: %s\n", root.c_str());
-        return albums;
+        known.reserve(previous->size());
+        for (auto& album : *previous)
+            known.emplace(album.directory_path, &album);
     }
     
-    // First pass: collect all potential album directories
-    std::vector<std::string> album_dirs;
+    std::vector<AlbumSlot> slots;
+    walk_roots(roots, known, slots);
     
-    try {
-        // Recursive directory traversal - just collect paths
-        for (const auto& entry : fs::recursive_directory_iterator(root, 
-            fs::directory_options::skip_permission_denied))
+    std::vector<Album> albums = process_slots(slots);
+    sort_albums_by_title(albums);
+    return albums;
+}
+
+std::vector<Album> Scanner::scan_subtrees(const std::vector<std::string>& roots,
+                                          std::vector<std::string> dirs,
+                                          std::vector<Album>& previous)
+{
+    reset_stats();
+    
+    // Drop duplicates, directories outside the roots, and directories
+    // covered by an ancestor that is rescanned anyway.  Sorting puts every
+    // ancestor right before its descendants.
+    for (auto& dir : dirs)
+    {
+        while (dir.size() > 1 && dir.back() == '/')
+            dir.pop_back();
+    }
+    
+    // A change in one disc of a grouped album rescans the whole album
+    std::unordered_set<std::string> grouped;
+    for (const auto& album : previous)
+    {
+        if (album.track_names.find('/') != std::string::npos)
+            grouped.insert(album.directory_path);
+    }
+    
+    for (auto& dir : dirs)
+    {
+        size_t slash = dir.rfind('/');
+        if (!grouped.empty() && slash != std::string::npos && grouped.count(dir.substr(0, slash)))
+            dir.erase(slash);
+    }
+    
+    std::sort(dirs.begin(), dirs.end());
+    dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+    
+    std::vector<std::string> tops;
+    for (auto& dir : dirs)
+    {
+        bool is_root = std::find(roots.begin(), roots.end(), dir) != roots.end();
+        if (!is_root && !is_under_any(dir, roots))
+            continue;
+        if (!tops.empty() && (dir == tops.back() || is_under(dir, tops.back())))
+            continue;
+        tops.push_back(std::move(dir));
+    }
+    
+    // A root itself is never an album, so rescanning it means its children
+    std::vector<std::string> pending;
+    for (const auto& dir : tops)
+    {
+        if (std::find(roots.begin(), roots.end(), dir) != roots.end())
         {
-            if (cancel_requested_)
-                break;
-            
-            if (entry.is_directory())
-            {
-                std::string dir_path = entry.path().string();
-                
-                // Quick check: is this a leaf directory with audio files?
-                if (is_leaf_directory(dir_path) && contains_audio_files(dir_path))
-                {
-                    album_dirs.push_back(dir_path);
-                }
-            }
+            std::vector<std::string> children = list_directory(dir).subdirs;
+            pending.insert(pending.end(), children.begin(), children.end());
         }
+        else
+            pending.push_back(dir);
     }
-    catch (const fs::filesystem_error& e) {
-        AUDWARN("Error scanning directory tree: %s\n", e.what());
+    
+    auto affected = [&](const std::string& path) {
+        for (const auto& dir : tops)
+        {
+            if (path == dir || is_under(path, dir))
+                return true;
+        }
+        return false;
+    };
+    
+    // Albums below a rescanned directory may still be unchanged themselves
+    std::vector<Album> albums;
+    AlbumMap known;
+    for (auto& album : previous)
+    {
+        if (affected(album.directory_path))
+            known.emplace(album.directory_path, &album);
+        else
+            albums.push_back(std::move(album));
     }
     
-    // Second pass: process albums (this is the slow part with metadata extraction)
-    albums.reserve(album_dirs.size());
-    for (const auto& dir : album_dirs)
+    std::vector<AlbumSlot> slots;
+    walk_directories(std::move(pending), known, slots);
+    
+    std::vector<Album> found = process_slots(slots);
+    if (cancel_requested_)
+        return std::vector<Album>();
+    
+    for (auto& album : found)
+        albums.push_back(std::move(album));
+    
+    sort_albums_by_title(albums);
+    return albums;
+}
+
+std::vector<Album> Scanner::scan_library(const std::vector<std::string>& roots,
+                                         std::vector<LibraryTrack>& tracks)
+{
+    reset_stats();
+    
+    std::vector<AlbumSlot> slots;
+    
     {
-        if (cancel_requested_)
-            break;
+        ScopedTimer timer(stat_walk_us_);
+        std::unordered_map<std::string, size_t> dir_slots;
+        
+        for (auto& track : tracks)
+        {
+            if (cancel_requested_)
+                break;
             
-        Album album = create_album_from_directory(dir);
-        if (!album.audio_files.empty())
-            albums.push_back(album);
-    }
-    
-    // Sort albums by title
-    std::sort(albums.begin(), albums.end(), [](const Album& a, const Album& b) {
-        std::string title_a = a.title;
-        std::string title_b = b.title;
-        std::transform(title_a.begin(), title_a.end(), title_a.begin(), ::tolower);
-        std::transform(title_b.begin(), title_b.end(), title_b.begin(), ::tolower);
-        return title_a < title_b;
-    });
+            size_t slash = track.path.rfind('/');
+            if (slash == std::string::npos)
+                continue;
+            
+            std::string dir = track.path.substr(0, slash);
+            if (!is_under_any(dir, roots) || !dir_slots.emplace(dir, slots.size()).second)
+                continue;
+            
+            AlbumSlot slot;
+            slot.path = std::move(dir);
+            if (!stat_path(slot.path, slot.mtime, slot.inode))
+                continue;
+            
+            // The listing gives the cover and all tracks, including any
+            // the library does not have yet
+            slot.summary = list_directory(slot.path);
+            if (!slot.summary.readable || slot.summary.audio_files.empty())
+                continue;
+            
+            slot.has_tags = true;
+            slot.tags.album = std::move(track.album);
+            slot.tags.artist = std::move(track.artist);
+            slot.tags.year = track.year;
+            slot.tags.disc = track.disc;
+            
+            slots.push_back(std::move(slot));
+            stat_albums_found_++;
+            report_progress(ScanProgress::Walking);
+        }
+    }
+    
+    std::vector<Album> albums = process_slots(slots);
+    if (cancel_requested_)
+        return std::vector<Album>();
     
+    sort_albums_by_title(albums);
     return albums;
 }
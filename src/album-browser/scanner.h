@@ -21,33 +21,251 @@
 #define SCANNER_H
 
 #include "album.h"
+#include "artstore.h"
+#include "dirscan.h"
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <atomic>
+#include <cstdint>
 #include <thread>
+#include <unordered_map>
+
+// Everything the scanner needs to know about one directory, gathered from
+// a single listing.  Hidden files and macOS "._" metadata files are already
+// filtered out.
+struct DirSummary {
+    bool readable = false;
+    bool has_subdirs = false;              // including symlinked directories
+    std::vector<std::string> subdirs;      // full paths of real subdirectories
+    std::vector<std::string> audio_files;  // file names, sorted
+    std::vector<std::string> images;       // file names, in listing order
+};
+
+// A track whose tags have already been read elsewhere (by libaudcore,
+// for the search tool's library playlist)
+struct LibraryTrack {
+    std::string path;
+    std::string album, artist;  // album artist if there is one
+    int year = 0;
+    int disc = 0;
+};
+
+// Snapshot of the counters collected during the last scan.  Times are
+// wall-clock microseconds; the tag and art times are summed over all
+// workers, so they can exceed the processing time.
+struct ScanStats {
+    uint64_t directories_listed = 0;
+    uint64_t albums_found = 0;   // album directories found by the walk so far
+    uint64_t albums_done = 0;    // ... of which processed
+    uint64_t albums_reused = 0;  // unchanged albums taken from the previous scan
+    uint64_t syscalls = 0;  // listings count as one call each, plus every stat
+    uint64_t bytes_read = 0;  // from audio files, looking for embedded art
+    uint64_t art_lookups = 0;     // albums that needed embedded art
+    uint64_t art_store_hits = 0;  // ... found in the art store unchanged
+    uint64_t walk_us = 0;
+    uint64_t process_us = 0;
+    uint64_t tags_us = 0;
+    uint64_t art_us = 0;
+    uint64_t store_us = 0;  // saving the art store index
+};
+
+// Sent regularly while a scan runs
+struct ScanProgress {
+    enum Phase {
+        Walking,     // looking for album directories, the total is not known
+        Processing,  // reading the albums found
+        Done
+    };
+    
+    Phase phase = Walking;
+    ScanStats stats;
+};
 
 class Scanner {
 public:
-    using ScanCallback = std::function<void(std::vector<Album>)>;
+    // Receives the scan result, which it may take over
+    using ScanCallback = std::function<void(std::vector<Album>&&)>;
+    
+    // Called from the scan thread (or one of its workers), at most every
+    // PROGRESS_INTERVAL_MS and once more when the scan is over
+    using ProgressCallback = std::function<void(const ScanProgress&)>;
+    static constexpr int PROGRESS_INTERVAL_MS = 100;
     
     Scanner();
     ~Scanner();
     
-    void scan_async(const std::string& root_path, ScanCallback callback);
+    // Every scan covers a list of library roots (none of them below
+    // another), walked concurrently so a slow network share does not hold
+    // up a local disk; the albums of all roots come back as one list.
+    //
+    // With a batch callback, albums are also handed out in batches of
+    // BATCH_SIZE (and a last, smaller one) as soon as they are processed,
+    // in no particular order, so a first scan can show them long before
+    // it is over.  The batches are copies; the final result still holds
+    // every album, sorted.
+    static constexpr size_t BATCH_SIZE = 200;
+    void scan_async(const std::vector<std::string>& roots, ScanCallback callback,
+                    ScanCallback batch_callback = nullptr);
+    
+    // Like scan_async(), but albums from a previous scan whose directory
+    // mtime and inode are unchanged are reused instead of processed again.
+    // New and changed directories are scanned; vanished ones are dropped.
+    void scan_incremental_async(const std::vector<std::string>& roots,
+                                std::vector<Album> previous, ScanCallback callback);
+    
+    // Rescans only the given directories (and everything below them) and
+    // merges the result into the previous album list, which is otherwise
+    // passed through untouched.  Used for file monitor events.
+    void scan_subtrees_async(const std::vector<std::string>& roots, std::vector<std::string> dirs,
+                             std::vector<Album> previous, ScanCallback callback);
+    
+    // Builds the albums from a library that has been read already instead
+    // of walking the tree: every directory holding one of the tracks is an
+    // album, listed once for its cover and track files, and named by the
+    // tags of its first track.  Tracks outside the roots are ignored.
+    void scan_library_async(const std::vector<std::string>& roots, std::vector<LibraryTrack> tracks,
+                            ScanCallback callback);
     void cancel();
     bool is_scanning() const;
     
+    // Cancels the scan and waits for its thread, so another scan can be
+    // started right away
+    void cancel_and_wait();
+    
+    // Number of threads used to process album directories (0 = one per
+    // hardware thread); takes effect on the next scan
+    void set_worker_count(int count) { worker_count_ = count; }
+    
+    // Background mode runs the scan threads at idle CPU and I/O priority
+    // (SCHED_IDLE and the idle I/O class on Linux, the background policy
+    // on macOS); takes effect on the next scan.  The rate cap, in KiB/s
+    // (0 = none), limits the file data read for embedded art, counting
+    // each directory listing as one block; it applies right away.
+    void set_background(bool enabled) { background_ = enabled; }
+    void set_read_rate(int kib_per_second) { read_rate_ = kib_per_second; }
+    
+    // Holds all scan I/O for the given time, e.g. while playback starts
+    // and the decoder is filling its buffers
+    void pause_for(int ms);
+    
+    // Where embedded cover art is extracted to; without a store, albums
+    // that have no cover file get none from the scanner.  The store must
+    // outlive the scanner.
+    void set_art_store(ArtStore* store) { art_store_ = store; }
+    
+    // Takes album, artist, year and disc from the tags of each album's
+    // first track (falling back to the directory names), and groups disc
+    // subdirectories such as Album/CD1 and Album/CD2 into one album unless
+    // their tags disagree.  Takes effect on the next scan; albums reused
+    // from a previous scan keep what they were scanned with.
+    void set_tag_mode(bool enabled) { tag_mode_ = enabled; }
+    
+    // Comma-separated cover file names in order of preference, matched
+    // without regard to case.  A name without an extension matches any
+    // image type, .jpg before .png before .jpeg before the rest.  An
+    // album without a match takes its first image.  Takes effect on the
+    // next scan.
+    static constexpr const char* DEFAULT_COVER_NAMES = "cover,folder,front,album,artwork";
+    void set_cover_names(const std::string& spec);
+    
+    // Must not be changed while a scan is running
+    void set_progress_callback(ProgressCallback callback) { progress_callback_ = std::move(callback); }
+    
+    ScanStats get_stats() const;
+    
 private:
-    std::vector<Album> scan_directory_tree(const std::string& root);
-    bool is_leaf_directory(const std::string& path);
-    bool contains_audio_files(const std::string& path);
-    Album create_album_from_directory(const std::string& path);
-    std::string find_cover_art(const std::string& path);
+    struct TrackTags {
+        std::string album, artist;
+        int year = 0;
+        int disc = 0;
+    };
+    
+    // An album directory found by the walk: either freshly listed or, if
+    // its stamp is unchanged, carried over from the previous scan
+    struct AlbumSlot {
+        std::string path;
+        DirSummary summary;
+        int64_t mtime = 0;
+        uint64_t inode = 0;
+        Album* reuse = nullptr;  // moved from, the previous list is ours
+        std::vector<AlbumSlot> discs;  // disc subdirectories grouped into this one
+        bool has_tags = false;  // known in advance, see scan_library_async()
+        TrackTags tags;
+    };
+    
+    using AlbumMap = std::unordered_map<std::string, Album*>;
+    
+    // Stamps of the directories a walk is about to visit, taken in batches
+    // so that a network filesystem answers many of them in one round trip
+    struct StampAhead {
+        StatBatch batch;
+        std::unordered_map<std::string, DirStamp> stamps;
+    };
+    
+    void start_scan(std::function<std::vector<Album>()> job, ScanCallback callback,
+                    ScanCallback batch_callback = nullptr);
+    void add_to_batch(const Album& album);
+    void flush_batch();
+    std::vector<Album> scan_directory_tree(const std::vector<std::string>& roots,
+                                           std::vector<Album>* previous);
+    std::vector<Album> scan_subtrees(const std::vector<std::string>& roots,
+                                     std::vector<std::string> dirs, std::vector<Album>& previous);
+    std::vector<Album> scan_library(const std::vector<std::string>& roots,
+                                    std::vector<LibraryTrack>& tracks);
+    void reset_stats();
+    void throttle(uint64_t bytes);
+    void report_progress(ScanProgress::Phase phase, bool force = false);
+    void log_stats(size_t n_albums) const;
+    void walk_roots(const std::vector<std::string>& roots, const AlbumMap& known,
+                    std::vector<AlbumSlot>& slots);
+    void walk_directories(std::vector<std::string> pending, const AlbumMap& known,
+                          std::vector<AlbumSlot>& slots);
+    bool group_discs(AlbumSlot& slot, const AlbumMap& known, StampAhead& ahead);
+    bool stat_album(const std::string& path, const Album* known, StampAhead& ahead,
+                    int64_t& mtime, uint64_t& inode);
+    void stamp_ahead(StampAhead& ahead, const std::vector<std::string>& paths);
+    bool take_stamp(StampAhead& ahead, const std::string& path, int64_t& mtime,
+                    uint64_t& inode);
+    std::vector<Album> process_slots(std::vector<AlbumSlot>& slots);
+    bool stat_path(const std::string& path, int64_t& mtime, uint64_t& inode,
+                   uint64_t* size = nullptr);
+    DirSummary list_directory(const std::string& path);
+    Album create_album_from_directory(const AlbumSlot& slot, const TrackTags* tags);
+    bool read_tags(const std::string& track, TrackTags& tags);
+    std::string find_cover_art(const std::string& path, const DirSummary& summary);
     std::string extract_embedded_art(const std::string& audio_file);
     
     std::atomic<bool> scanning_;
     std::atomic<bool> cancel_requested_;
+    std::atomic<int> worker_count_;
+    std::atomic<bool> background_;
+    std::atomic<int> read_rate_;
+    std::atomic<int64_t> paused_until_us_;
+    std::atomic<int64_t> rate_clock_us_;  // when the bytes read so far are paid for
+    std::atomic<bool> tag_mode_;
+    std::atomic<uint64_t> stat_directories_listed_;
+    std::atomic<uint64_t> stat_albums_found_;
+    std::atomic<uint64_t> stat_albums_done_;
+    std::atomic<uint64_t> stat_albums_reused_;
+    std::atomic<uint64_t> stat_syscalls_;
+    std::atomic<uint64_t> stat_bytes_read_;
+    std::atomic<uint64_t> stat_art_lookups_;
+    std::atomic<uint64_t> stat_art_store_hits_;
+    std::atomic<uint64_t> stat_walk_us_;
+    std::atomic<uint64_t> stat_process_us_;
+    std::atomic<uint64_t> stat_tags_us_;
+    std::atomic<uint64_t> stat_art_us_;
+    std::atomic<uint64_t> stat_store_us_;
+    std::atomic<int64_t> last_progress_us_;
+    ProgressCallback progress_callback_;
+    ScanCallback batch_callback_;  // of the running scan
+    std::mutex batch_mutex_;
+    std::vector<Album> batch_;
+    ArtStore* art_store_ = nullptr;
+    std::shared_ptr<const std::vector<std::string>> cover_names_;  // lower case
     std::thread scan_thread_;
 };
 
@@ -0,0 +1,191 @@
+/*
+ * search.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "search.h"
+#include <algorithm>
+#include <cstring>
+#include <libaudcore/audstrings.h>
+
+static uint32_t trigram_at(const char* str)
+{
+    return (uint32_t)(unsigned char)str[0] << 16 | (uint32_t)(unsigned char)str[1] << 8 |
+           (unsigned char)str[2];
+}
+
+static std::vector<std::string> split_terms(const std::string& query)
+{
+    std::vector<std::string> terms;
+    size_t pos = 0;
+    
+    while (pos < query.size())
+    {
+        size_t end = query.find(' ', pos);
+        if (end == std::string::npos)
+            end = query.size();
+        if (end > pos)
+            terms.push_back(query.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    
+    return terms;
+}
+
+void AlbumSearchIndex::clear(const std::vector<std::string>& roots)
+{
+    roots_ = roots;
+    keys_.clear();
+    key_offsets_.clear();
+    trigrams_.clear();
+    have_last_ = false;
+    last_results_.clear();
+}
+
+void AlbumSearchIndex::add(const Album& album)
+{
+    std::string key = album.title;
+    key += '\n';
+    key += album.artist.c_str();
+    key += '\n';
+    
+    if (!album.catalog.empty())
+    {
+        key += album.catalog;
+        key += '\n';
+    }
+    
+    if (album.year > 0)
+    {
+        key += std::to_string(album.year);
+        key += '\n';
+    }
+    
+    // The root is the same for many albums and would match all of them
+    const std::string& path = album.directory_path;
+    size_t skip = 0;
+    for (const auto& root : roots_)
+    {
+        if (!root.empty() && path.size() > root.size() && !path.compare(0, root.size(), root) &&
+            path[root.size()] == '/')
+        {
+            skip = root.size() + 1;
+            break;
+        }
+    }
+    key.append(path, skip, std::string::npos);
+    
+    StringBuf folded = str_tolower_utf8(key.c_str());
+    const char* str = folded;
+    size_t length = strlen(str);
+    
+    uint32_t index = key_offsets_.size();
+    key_offsets_.push_back(keys_.size());
+    keys_.append(str, length + 1);
+    
+    if (length < 3)
+        return;
+    
+    std::vector<uint32_t> grams;
+    grams.reserve(length - 2);
+    for (size_t i = 0; i + 3 <= length; i++)
+        grams.push_back(trigram_at(str + i));
+    
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    
+    for (uint32_t gram : grams)
+        trigrams_[gram].push_back(index);
+    
+    // The previous results do not cover the new album
+    have_last_ = false;
+}
+
+// Keeps the results whose key contains term
+void AlbumSearchIndex::search_term(const std::string& term, std::vector<size_t>& results) const
+{
+    // The shortest posting list among the term's trigrams bounds the
+    // candidates; an absent trigram means no album can match
+    const std::vector<uint32_t>* postings = nullptr;
+    for (size_t i = 0; i + 3 <= term.size(); i++)
+    {
+        auto it = trigrams_.find(trigram_at(term.c_str() + i));
+        if (it == trigrams_.end())
+        {
+            results.clear();
+            return;
+        }
+        
+        if (!postings || it->second.size() < postings->size())
+            postings = &it->second;
+    }
+    
+    std::vector<size_t> kept;
+    
+    if (postings && postings->size() < results.size())
+    {
+        // Both lists are sorted
+        size_t r = 0;
+        for (uint32_t index : *postings)
+        {
+            while (r < results.size() && results[r] < index)
+                r++;
+            if (r == results.size())
+                break;
+            if (results[r] == index && strstr(key(index), term.c_str()))
+                kept.push_back(index);
+        }
+    }
+    else
+    {
+        for (size_t index : results)
+        {
+            if (strstr(key(index), term.c_str()))
+                kept.push_back(index);
+        }
+    }
+    
+    results = std::move(kept);
+}
+
+const std::vector<size_t>& AlbumSearchIndex::search(const std::string& query)
+{
+    StringBuf folded = str_tolower_utf8(query.c_str());
+    std::string lower = (const char*)folded;
+    
+    // Typing more can only remove matches: every old term is now a prefix
+    // of a new one, or still there as it was
+    bool narrow = have_last_ && lower.compare(0, last_query_.size(), last_query_) == 0;
+    
+    if (!narrow)
+    {
+        last_results_.resize(size());
+        for (size_t i = 0; i < last_results_.size(); i++)
+            last_results_[i] = i;
+    }
+    
+    for (const auto& term : split_terms(lower))
+    {
+        if (last_results_.empty())
+            break;
+        search_term(term, last_results_);
+    }
+    
+    last_query_ = std::move(lower);
+    have_last_ = true;
+    return last_results_;
+}
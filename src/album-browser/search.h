@@ -0,0 +1,67 @@
+/*
+ * search.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "album.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Search over the album list.  Every album gets one folded (lowercased)
+// key holding its title, artist, catalog number, year and directory
+// relative to its music root, built once when the album is added.  A
+// trigram index over the keys narrows each search term to a few
+// candidates, which are then checked against the keys themselves.
+// Queries are split at spaces and every term must match (as in the
+// search tool).  A query that extends the previous one only looks at the
+// previous results.
+class AlbumSearchIndex
+{
+public:
+    // Drops all albums; album paths below one of the roots are indexed
+    // relative to it
+    void clear(const std::vector<std::string>& roots);
+    
+    // Albums are numbered in the order they are added
+    void add(const Album& album);
+    size_t size() const { return key_offsets_.size(); }
+    
+    // Matching album numbers in ascending order (all of them for an
+    // empty query)
+    const std::vector<size_t>& search(const std::string& query);
+    
+private:
+    const char* key(size_t index) const { return keys_.c_str() + key_offsets_[index]; }
+    void search_term(const std::string& term, std::vector<size_t>& results) const;
+    
+    std::vector<std::string> roots_;
+    std::string keys_;  // NUL-terminated, back to back
+    std::vector<uint32_t> key_offsets_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams_;
+    
+    // The last search, for narrowing
+    bool have_last_ = false;
+    std::string last_query_;
+    std::vector<size_t> last_results_;
+};
+
+#endif // SEARCH_H
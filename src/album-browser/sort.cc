@@ -0,0 +1,173 @@
+/*
+ * sort.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "sort.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <libaudcore/audstrings.h>
+
+static std::string fold(const std::string& str)
+{
+    return std::string((const char*)str_tolower_utf8(str.c_str()));
+}
+
+void AlbumSorter::clear()
+{
+    title_keys_.clear();
+    artist_keys_.clear();
+    
+    for (int m = 0; m < N_MODES; m++)
+    {
+        orders_[m].clear();
+        ranks_[m].clear();
+    }
+}
+
+void AlbumSorter::add(const Album& album)
+{
+    title_keys_.push_back(fold(album.get_display_title()));
+    artist_keys_.push_back(fold(album.artist));
+    
+    for (int m = 0; m < N_MODES; m++)
+    {
+        orders_[m].clear();
+        ranks_[m].clear();
+    }
+}
+
+void AlbumSorter::invalidate(SortMode mode)
+{
+    orders_[(int)mode].clear();
+    ranks_[(int)mode].clear();
+}
+
+void AlbumSorter::set_order(SortMode mode, std::vector<uint32_t> order)
+{
+    if (order.size() != size())
+        return;
+    
+    // Every album exactly once
+    std::vector<uint32_t> ranks(order.size(), UINT32_MAX);
+    for (uint32_t pos = 0; pos < order.size(); pos++)
+    {
+        if (order[pos] >= ranks.size() || ranks[order[pos]] != UINT32_MAX)
+            return;
+        ranks[order[pos]] = pos;
+    }
+    
+    orders_[(int)mode] = std::move(order);
+    ranks_[(int)mode] = std::move(ranks);
+}
+
+void AlbumSorter::compute(SortMode mode, const std::vector<Album>& albums)
+{
+    std::vector<uint32_t>& order = orders_[(int)mode];
+    order.resize(size());
+    std::iota(order.begin(), order.end(), 0);
+    
+    auto by_title = [this](uint32_t a, uint32_t b) {
+        return title_keys_[a] < title_keys_[b];
+    };
+    
+    switch (mode)
+    {
+    case SortMode::Title:
+        std::stable_sort(order.begin(), order.end(), by_title);
+        break;
+    
+    case SortMode::ArtistYear:
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            int cmp = strcmp(artist_keys_[a].c_str(), artist_keys_[b].c_str());
+            if (cmp != 0)
+                return cmp < 0;
+            if (albums[a].year != albums[b].year)
+                return albums[a].year < albums[b].year;
+            return by_title(a, b);
+        });
+        break;
+    
+    case SortMode::Year:
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            int year_a = albums[a].year > 0 ? albums[a].year : INT32_MAX;
+            int year_b = albums[b].year > 0 ? albums[b].year : INT32_MAX;
+            return year_a != year_b ? year_a < year_b : by_title(a, b);
+        });
+        break;
+    
+    case SortMode::DateAdded:
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            if (albums[a].date_added != albums[b].date_added)
+                return albums[a].date_added > albums[b].date_added;
+            return by_title(a, b);
+        });
+        break;
+    
+    case SortMode::MostPlayed:
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            if (albums[a].play_count != albums[b].play_count)
+                return albums[a].play_count > albums[b].play_count;
+            return by_title(a, b);
+        });
+        break;
+    
+    case SortMode::Count:
+        break;
+    }
+    
+    std::vector<uint32_t>& ranks = ranks_[(int)mode];
+    ranks.resize(order.size());
+    for (uint32_t pos = 0; pos < order.size(); pos++)
+        ranks[order[pos]] = pos;
+}
+
+const std::vector<uint32_t>& AlbumSorter::order(SortMode mode, const std::vector<Album>& albums)
+{
+    if (orders_[(int)mode].size() != size())
+        compute(mode, albums);
+    return orders_[(int)mode];
+}
+
+const std::vector<uint32_t>& AlbumSorter::ranks(SortMode mode, const std::vector<Album>& albums)
+{
+    if (ranks_[(int)mode].size() != size())
+        compute(mode, albums);
+    return ranks_[(int)mode];
+}
+
+void sort_albums_by_title(std::vector<Album>& albums)
+{
+    std::vector<std::string> keys;
+    keys.reserve(albums.size());
+    for (const auto& album : albums)
+        keys.push_back(fold(album.title));
+    
+    std::vector<uint32_t> order(albums.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return keys[a] < keys[b];
+    });
+    
+    std::vector<Album> sorted;
+    sorted.reserve(albums.size());
+    for (uint32_t index : order)
+        sorted.push_back(std::move(albums[index]));
+    
+    albums = std::move(sorted);
+}
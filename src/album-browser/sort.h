@@ -0,0 +1,79 @@
+/*
+ * sort.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SORT_H
+#define SORT_H
+
+#include "album.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class SortMode {
+    Title,
+    ArtistYear,  // artist, then year, then title
+    Year,        // oldest first, albums without a year last
+    DateAdded,   // newest first
+    MostPlayed,
+    Count
+};
+
+// Orderings of the album list.  The folded sort keys are computed once
+// per album as it is added; each order is computed when first asked for
+// (or taken from the album cache) and kept until the list changes, so
+// switching modes only swaps one permutation for another.
+class AlbumSorter
+{
+public:
+    static constexpr int N_MODES = (int)SortMode::Count;
+    
+    // Drops all albums and orders
+    void clear();
+    
+    // Albums are numbered in the order they are added
+    void add(const Album& album);
+    size_t size() const { return title_keys_.size(); }
+    
+    // Album numbers in display order for the mode
+    const std::vector<uint32_t>& order(SortMode mode, const std::vector<Album>& albums);
+    
+    // Position of each album in the order for the mode
+    const std::vector<uint32_t>& ranks(SortMode mode, const std::vector<Album>& albums);
+    
+    // A previously computed order; ignored unless it is a permutation of
+    // all albums added so far
+    void set_order(SortMode mode, std::vector<uint32_t> order);
+    
+    // For orders that depend on counters that have changed
+    void invalidate(SortMode mode);
+    
+private:
+    void compute(SortMode mode, const std::vector<Album>& albums);
+    
+    std::vector<std::string> title_keys_;
+    std::vector<PooledString> artist_keys_;
+    std::vector<uint32_t> orders_[N_MODES];
+    std::vector<uint32_t> ranks_[N_MODES];
+};
+
+// Sorts the album list itself by folded title (the order albums are
+// scanned and cached in), computing each key only once
+void sort_albums_by_title(std::vector<Album>& albums);
+
+#endif // SORT_H
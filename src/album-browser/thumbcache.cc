@@ -0,0 +1,280 @@
+/*
+ * thumbcache.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "thumbcache.h"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libaudcore/runtime.h>
+
+static constexpr uint32_t INDEX_MAGIC = 0x4e485441;  // "ATHN"
+static constexpr uint32_t INDEX_VERSION = 1;
+
+// Stores between index writes; a crash loses at most these entries
+static constexpr int FLUSH_INTERVAL = 256;
+
+// Compaction keeps this share of the budget, so it does not rerun at once
+static constexpr uint64_t COMPACT_PERCENT = 75;
+
+struct IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t clock;
+};
+
+struct IndexEntry {
+    uint64_t key;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t last_used;
+};
+
+static_assert(sizeof(IndexEntry) == 24, "index entries must be packed");
+
+// FNV-1a, 64-bit, continued from a previous value
+static uint64_t hash64(const void* data, size_t len, uint64_t hash = 14695981039346656037ull)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+uint64_t ThumbnailCache::make_key(const std::string& source, uint64_t size, int64_t mtime,
+                                  int thumb_size)
+{
+    uint64_t hash = hash64(source.data(), source.size());
+    hash = hash64(&size, sizeof(size), hash);
+    hash = hash64(&mtime, sizeof(mtime), hash);
+    return hash64(&thumb_size, sizeof(thumb_size), hash);
+}
+
+ThumbnailCache::ThumbnailCache(const std::string& directory, uint64_t max_bytes)
+    : pack_path_(directory + "/album-browser-thumbs.pack"),
+      index_path_(directory + "/album-browser-thumbs.idx"),
+      max_bytes_(max_bytes)
+{
+    fd_ = open(pack_path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        AUDWARN("Cannot open thumbnail cache %s\n", pack_path_.c_str());
+        return;
+    }
+    
+    struct stat st;
+    if (fstat(fd_, &st) == 0)
+        pack_size_ = st.st_size;
+    
+    load_index();
+    
+    // Without an index the pack is unreachable; start over
+    if (entries_.empty() && pack_size_ > 0 && ftruncate(fd_, 0) == 0)
+        pack_size_ = 0;
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    flush();
+    
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void ThumbnailCache::load_index()
+{
+    FILE* file = fopen(index_path_.c_str(), "rb");
+    if (!file)
+        return;
+    
+    IndexHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != INDEX_MAGIC || header.version != INDEX_VERSION)
+    {
+        fclose(file);
+        return;
+    }
+    
+    std::vector<IndexEntry> records(header.count);
+    if (fread(records.data(), sizeof(IndexEntry), records.size(), file) != records.size())
+        records.clear();
+    
+    fclose(file);
+    
+    clock_ = header.clock;
+    entries_.reserve(records.size());
+    
+    for (const auto& record : records)
+    {
+        // Entries past the end of the pack belong to a pack that was lost
+        if (record.offset + record.length > pack_size_)
+            continue;
+        
+        entries_[record.key] = {record.offset, record.length, record.last_used};
+    }
+}
+
+void ThumbnailCache::save_index()
+{
+    std::vector<IndexEntry> records;
+    records.reserve(entries_.size());
+    for (const auto& entry : entries_)
+        records.push_back({entry.first, entry.second.offset, entry.second.length,
+                           entry.second.last_used});
+    
+    IndexHeader header = {INDEX_MAGIC, INDEX_VERSION, (uint32_t)records.size(), clock_};
+    
+    // The pack is synced first, so the index never points at missing data
+    fdatasync(fd_);
+    
+    std::string temp_path = index_path_ + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file)
+    {
+        AUDWARN("Cannot write thumbnail index %s\n", temp_path.c_str());
+        return;
+    }
+    
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(records.data(), sizeof(IndexEntry), records.size(), file) == records.size();
+    ok = (fclose(file) == 0) && ok;
+    
+    if (!ok || rename(temp_path.c_str(), index_path_.c_str()) < 0)
+    {
+        AUDWARN("Cannot write thumbnail index %s\n", index_path_.c_str());
+        unlink(temp_path.c_str());
+        return;
+    }
+    
+    unsaved_ = 0;
+}
+
+bool ThumbnailCache::lookup(uint64_t key, std::vector<char>& data)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = entries_.find(key);
+    if (it == entries_.end())
+    {
+        misses_++;
+        return false;
+    }
+    
+    data.resize(it->second.length);
+    if (it->second.length > 0 &&
+        pread(fd_, data.data(), data.size(), it->second.offset) != (ssize_t)data.size())
+    {
+        entries_.erase(it);
+        misses_++;
+        return false;
+    }
+    
+    it->second.last_used = ++clock_;
+    hits_++;
+    return true;
+}
+
+void ThumbnailCache::store(uint64_t key, const char* data, size_t length)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (fd_ < 0 || max_bytes_ == 0 || length > max_bytes_)
+        return;
+    
+    if (length > 0 && pwrite(fd_, data, length, pack_size_) != (ssize_t)length)
+        return;
+    
+    // A replaced entry leaves its old bytes behind until the next compaction
+    entries_[key] = {pack_size_, (uint32_t)length, ++clock_};
+    pack_size_ += length;
+    
+    if (pack_size_ > max_bytes_)
+        compact();
+    else if (++unsaved_ >= FLUSH_INTERVAL)
+        save_index();
+}
+
+void ThumbnailCache::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (fd_ >= 0 && unsaved_ > 0)
+        save_index();
+}
+
+void ThumbnailCache::compact()
+{
+    std::vector<std::pair<uint64_t, Entry>> order(entries_.begin(), entries_.end());
+    std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) {
+        return a.second.last_used > b.second.last_used;
+    });
+    
+    std::string temp_path = pack_path_ + ".tmp";
+    int out = open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0)
+    {
+        AUDWARN("Cannot write thumbnail cache %s\n", temp_path.c_str());
+        return;
+    }
+    
+    uint64_t budget = max_bytes_ * COMPACT_PERCENT / 100;
+    uint64_t written = 0;
+    std::unordered_map<uint64_t, Entry> kept;
+    std::vector<char> buffer;
+    
+    for (const auto& item : order)
+    {
+        const Entry& entry = item.second;
+        if (written + entry.length > budget)
+            break;
+        
+        buffer.resize(entry.length);
+        if (entry.length > 0 &&
+            (pread(fd_, buffer.data(), entry.length, entry.offset) != (ssize_t)entry.length ||
+             pwrite(out, buffer.data(), entry.length, written) != (ssize_t)entry.length))
+            continue;
+        
+        kept[item.first] = {written, entry.length, entry.last_used};
+        written += entry.length;
+    }
+    
+    // Until the new index is written the old one would point into the new
+    // pack; with no index at all the next start just begins afresh
+    unlink(index_path_.c_str());
+    
+    if (rename(temp_path.c_str(), pack_path_.c_str()) < 0)
+    {
+        AUDWARN("Cannot replace thumbnail cache %s\n", pack_path_.c_str());
+        close(out);
+        unlink(temp_path.c_str());
+        save_index();
+        return;
+    }
+    
+    AUDINFO("Thumbnail cache compacted: kept %d of %d entries\n",
+            (int)kept.size(), (int)entries_.size());
+    
+    close(fd_);
+    fd_ = out;
+    pack_size_ = written;
+    entries_ = std::move(kept);
+    save_index();
+}
@@ -0,0 +1,83 @@
+/*
+ * thumbcache.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef THUMBCACHE_H
+#define THUMBCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Encoded thumbnails kept on local disk between sessions, so a warm start
+// can paint every tile without reading a single cover from the library
+// (which may well be on a NAS).  All thumbnails are appended to one pack
+// file; a small index file maps each key to its place in the pack.  Keys
+// hash the cover's path, size and modification time together with the
+// thumbnail size, so a replaced cover simply misses and its old entry
+// ages out.  When the pack outgrows its budget, the least recently used
+// entries are dropped and the survivors are copied into a fresh pack.
+// All methods may be called from any thread.
+class ThumbnailCache
+{
+public:
+    ThumbnailCache(const std::string& directory, uint64_t max_bytes);
+    ~ThumbnailCache();
+    
+    ThumbnailCache(const ThumbnailCache&) = delete;
+    ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+    
+    static uint64_t make_key(const std::string& source, uint64_t size, int64_t mtime,
+                             int thumb_size);
+    
+    // An empty entry records that the album has no usable cover
+    bool lookup(uint64_t key, std::vector<char>& data);
+    void store(uint64_t key, const char* data, size_t length);
+    
+    // Writes the index; also done every so often by store() and on exit
+    void flush();
+    
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    
+private:
+    struct Entry {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t last_used;
+    };
+    
+    void load_index();
+    void save_index();
+    void compact();
+    
+    std::mutex mutex_;
+    std::string pack_path_, index_path_;
+    uint64_t max_bytes_;
+    int fd_ = -1;
+    uint64_t pack_size_ = 0;
+    uint32_t clock_ = 0;  // bumped on every use, for the LRU order
+    int unsaved_ = 0;
+    std::unordered_map<uint64_t, Entry> entries_;
+    std::atomic<uint64_t> hits_{0}, misses_{0};
+};
+
+#endif // THUMBCACHE_H
@@ -0,0 +1,256 @@
+/*
+ * thumbnails.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "thumbnails.h"
+#include <QBuffer>
+#include <QImageReader>
+#include <QRunnable>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/probe.h>
+
+static QImage read_scaled(QImageReader& reader, int size)
+{
+    // Most decoders (JPEG in particular) can decode at a reduced size
+    QSize full = reader.size();
+    if (full.isValid() && (full.width() > size || full.height() > size))
+        reader.setScaledSize(full.scaled(size, size, Qt::KeepAspectRatio));
+    
+    QImage image = reader.read();
+    
+    // Formats that cannot scale while decoding are scaled afterwards
+    if (!image.isNull() && (image.width() > size || image.height() > size))
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    
+    return image;
+}
+
+// Embedded art as Audacious extracts it, for formats the scanner does not
+// read itself
+static QImage request_embedded_art(const std::string& track, int size, ArtStore* art_store)
+{
+    uint64_t file_size = 0;
+    int64_t mtime = 0;
+    bool stamped = art_store && ArtStore::stat_file(track, file_size, mtime);
+    
+    std::string stored;
+    if (stamped && art_store->lookup(track, file_size, mtime, stored))
+    {
+        if (stored.empty())
+            return QImage();
+        
+        QImageReader reader(QString::fromStdString(stored));
+        return read_scaled(reader, size);
+    }
+    
+    QImage image;
+    const char* bytes_in = nullptr;
+    size_t length = 0;
+    
+    String uri = String(filename_to_uri(track.c_str()));
+    AudArtPtr art = aud_art_request(uri, AUD_ART_DATA);
+    auto data = art ? art.data() : nullptr;
+    
+    if (data && data->len() > 0)
+    {
+        bytes_in = data->begin();
+        length = data->len();
+        
+        QByteArray bytes = QByteArray::fromRawData(bytes_in, length);
+        QBuffer buffer(&bytes);
+        QImageReader reader(&buffer);
+        image = read_scaled(reader, size);
+    }
+    
+    if (stamped)
+        art_store->store(track, file_size, mtime, bytes_in, length);
+    
+    return image;
+}
+
+QImage decode_thumbnail(const Album& album, int size, ArtStore* art_store)
+{
+    QImage image;
+    
+    // Try loading from file
+    if (album.has_cover_art())
+    {
+        QImageReader reader(QString::fromStdString(album.cover_art_path));
+        image = read_scaled(reader, size);
+    }
+    
+    // Try embedded art
+    if (image.isNull() && album.n_tracks() > 0)
+        image = request_embedded_art(album.track_path(0), size, art_store);
+    
+    return image;
+}
+
+// Key of an album's thumbnail in the disk cache.  An album without a
+// cover file is keyed by its first track and directory stamp instead, so
+// that finding no cover (or only an embedded one) is remembered as well.
+static uint64_t disk_cache_key(const Album& album, int size)
+{
+    if (album.has_cover_art())
+        return ThumbnailCache::make_key(album.cover_art_path, album.cover_size,
+                                        album.cover_mtime, size);
+    
+    std::string first = album.n_tracks() > 0 ? album.track_path(0) : album.directory_path;
+    return ThumbnailCache::make_key(first, 0, album.dir_mtime, size);
+}
+
+static QImage load_thumbnail(const Album& album, int size, ThumbnailCache* cache,
+                             ArtStore* art_store)
+{
+    if (!cache)
+        return decode_thumbnail(album, size, art_store);
+    
+    uint64_t key = disk_cache_key(album, size);
+    std::vector<char> data;
+    
+    if (cache->lookup(key, data))
+    {
+        if (data.empty())
+            return QImage();
+        
+        QImage image = QImage::fromData(reinterpret_cast<const uchar*>(data.data()), data.size());
+        if (!image.isNull())
+            return image;
+    }
+    
+    QImage image = decode_thumbnail(album, size, art_store);
+    
+    if (image.isNull())
+    {
+        cache->store(key, nullptr, 0);
+        return image;
+    }
+    
+    // JPEG is far smaller for photos; keep PNG where there is transparency
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    if (image.hasAlphaChannel() ? image.save(&buffer, "PNG") : image.save(&buffer, "JPG", 90))
+        cache->store(key, bytes.constData(), bytes.size());
+    
+    return image;
+}
+
+class ThumbnailTask : public QRunnable
+{
+public:
+    using Done = std::function<void(QImage)>;
+    
+    ThumbnailTask(const Album& album, int size, ThumbnailCache* cache, ArtStore* art_store,
+                  std::shared_ptr<std::atomic<bool>> cancelled, Done done)
+        : album_(album), size_(size), cache_(cache), art_store_(art_store),
+          cancelled_(std::move(cancelled)),
+          done_(std::move(done))
+    {
+    }
+    
+    void run() override
+    {
+        // Cancelled while waiting in the queue
+        if (*cancelled_)
+            return;
+        
+        done_(load_thumbnail(album_, size_, cache_, art_store_));
+    }
+    
+private:
+    Album album_;  // a private copy, the browser's list may change meanwhile
+    int size_;
+    ThumbnailCache* cache_;
+    ArtStore* art_store_;
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+    Done done_;
+};
+
+ThumbnailLoader::ThumbnailLoader(QObject* context, int size, ReadyCallback ready)
+    : context_(context), size_(size), ready_(std::move(ready))
+{
+    pool_.setMaxThreadCount(2);
+}
+
+ThumbnailLoader::~ThumbnailLoader()
+{
+    cancel_all();
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+void ThumbnailLoader::set_thread_count(int count)
+{
+    pool_.setMaxThreadCount(count > 0 ? count : 2);
+}
+
+void ThumbnailLoader::request(size_t index, const Album& album, int priority)
+{
+    if (pending_.count(index))
+        return;
+    
+    auto flag = std::make_shared<std::atomic<bool>>(false);
+    pending_.emplace(index, flag);
+    
+    std::string directory = album.directory_path;
+    auto done = [this, index, flag, directory](QImage image) {
+        // Back to the GUI thread; dropped by Qt if the context is gone
+        QMetaObject::invokeMethod(context_, [this, index, flag, directory, image]() {
+            finished(index, flag, directory, image);
+        }, Qt::QueuedConnection);
+    };
+    
+    pool_.start(new ThumbnailTask(album, size_, disk_cache_, art_store_, flag, done), priority);
+}
+
+void ThumbnailLoader::finished(size_t index, const CancelFlag& flag,
+                               const std::string& directory, QImage image)
+{
+    // Cancelled after the decode had already started
+    if (*flag)
+        return;
+    
+    auto it = pending_.find(index);
+    if (it != pending_.end() && it->second == flag)
+        pending_.erase(it);
+    
+    if (ready_)
+        ready_(index, directory, std::move(image));
+}
+
+void ThumbnailLoader::cancel_unless(const std::function<bool(size_t index)>& keep)
+{
+    for (auto it = pending_.begin(); it != pending_.end();)
+    {
+        if (keep(it->first))
+        {
+            ++it;
+            continue;
+        }
+        
+        *it->second = true;
+        it = pending_.erase(it);
+    }
+}
+
+void ThumbnailLoader::cancel_all()
+{
+    cancel_unless([](size_t) { return false; });
+}
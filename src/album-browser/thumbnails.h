@@ -0,0 +1,91 @@
+/*
+ * thumbnails.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef THUMBNAILS_H
+#define THUMBNAILS_H
+
+#include "album.h"
+#include "artstore.h"
+#include "thumbcache.h"
+#include <QImage>
+#include <QObject>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Decodes album covers into thumbnails on a small pool of worker threads.
+// Images are decoded straight at thumbnail size where the format allows
+// it (QImageReader::setScaledSize), so a 3000x3000 JPEG is never expanded
+// in full.  Requests made with a higher priority are decoded first, and
+// pending requests can be cancelled once their tile has scrolled away.
+// Results are delivered on the GUI thread.  With a ThumbnailCache, decoded
+// thumbnails are kept on disk and later requests are served from there.
+class ThumbnailLoader
+{
+public:
+    // Receives the album index the request was made for, the album
+    // directory and the decoded image (null if the album has no usable
+    // cover)
+    using ReadyCallback = std::function<void(size_t index, const std::string& directory,
+                                             QImage image)>;
+    
+    ThumbnailLoader(QObject* context, int size, ReadyCallback ready);
+    ~ThumbnailLoader();
+    
+    void set_thread_count(int count);
+    
+    // The cache must outlive the loader; nullptr disables it
+    void set_disk_cache(ThumbnailCache* cache) { disk_cache_ = cache; }
+    
+    // Embedded art found by Audacious is kept here too; must outlive the
+    // loader
+    void set_art_store(ArtStore* store) { art_store_ = store; }
+    
+    // Ignored if the album already has a request pending
+    void request(size_t index, const Album& album, int priority);
+    bool is_pending(size_t index) const { return pending_.count(index) > 0; }
+    
+    // Drops the pending requests whose album index fails the predicate
+    void cancel_unless(const std::function<bool(size_t index)>& keep);
+    void cancel_all();
+    
+private:
+    using CancelFlag = std::shared_ptr<std::atomic<bool>>;
+    
+    void finished(size_t index, const CancelFlag& flag, const std::string& directory,
+                  QImage image);
+    
+    QObject* context_;
+    int size_;
+    ReadyCallback ready_;
+    ThumbnailCache* disk_cache_ = nullptr;
+    ArtStore* art_store_ = nullptr;
+    QThreadPool pool_;
+    std::unordered_map<size_t, CancelFlag> pending_;
+};
+
+// Decodes one cover at (at most) size x size, keeping the aspect ratio.
+// Falls back to the art embedded in the first track, which is looked up
+// in (and added to) the art store if there is one.
+QImage decode_thumbnail(const Album& album, int size, ArtStore* art_store = nullptr);
+
+#endif // THUMBNAILS_H
@@ -0,0 +1,179 @@
+/*
+ * watcher.cc
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "watcher.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+
+// Quiet period that ends a burst of events, and the longest a burst may
+// delay a rescan (copying a whole album produces events for a while)
+static constexpr int BATCH_DELAY = 500;
+static constexpr int MAX_BATCH_AGE = 5000;
+
+LibraryWatcher::LibraryWatcher(ChangeCallback callback)
+    : callback_(std::move(callback))
+{
+    batch_timer_.setSingleShot(true);
+    batch_timer_.setInterval(BATCH_DELAY);
+    
+    QObject::connect(&batch_timer_, &QTimer::timeout, [this]() { flush(); });
+    QObject::connect(&watcher_, &QFileSystemWatcher::directoryChanged,
+                     [this](const QString& path) { directory_changed(path); });
+}
+
+void LibraryWatcher::watch(const std::vector<std::string>& roots, const std::vector<Album>& albums)
+{
+    QSet<QString> wanted;
+    for (const auto& root : roots)
+        wanted.insert(QString::fromStdString(root));
+    
+    // Album directories plus their ancestors up to their root, so that new
+    // albums next to existing ones are noticed too.  Every album is below
+    // one of the roots, which are all wanted already.
+    for (const auto& album : albums)
+    {
+        // The discs of a grouped album change on their own
+        for (const auto& subdir : album.subdirectories())
+            wanted.insert(QString::fromStdString(album.directory_path + '/' + subdir));
+        
+        QString dir = QString::fromStdString(album.directory_path);
+        while (!wanted.contains(dir))
+        {
+            wanted.insert(dir);
+            int slash = dir.lastIndexOf('/');
+            if (slash <= 0)
+                break;
+            dir.truncate(slash);
+        }
+    }
+    
+    // Directories that appeared after the last scan stay watched while
+    // they are below a root, since they may be empty still and so not
+    // (yet) an album
+    for (auto it = created_.begin(); it != created_.end();)
+    {
+        bool below_root = false;
+        for (const auto& root : roots)
+        {
+            if (it->startsWith(QString::fromStdString(root) + '/'))
+                below_root = true;
+        }
+        
+        if (below_root && QFileInfo(*it).isDir())
+        {
+            wanted.insert(*it);
+            ++it;
+        }
+        else
+            it = created_.erase(it);
+    }
+    
+    QStringList stale, added;
+    const QStringList current = watcher_.directories();
+    QSet<QString> have(current.begin(), current.end());
+    
+    for (const QString& dir : current)
+    {
+        if (!wanted.contains(dir))
+            stale.append(dir);
+    }
+    
+    for (const QString& dir : wanted)
+    {
+        if (!have.contains(dir))
+            added.append(dir);
+    }
+    
+    if (!stale.isEmpty())
+        watcher_.removePaths(stale);
+    if (!added.isEmpty())
+        watcher_.addPaths(added);
+    
+    const QStringList now = watcher_.directories();
+    watched_ = QSet<QString>(now.begin(), now.end());
+}
+
+void LibraryWatcher::stop()
+{
+    batch_timer_.stop();
+    pending_.clear();
+    
+    const QStringList current = watcher_.directories();
+    if (!current.isEmpty())
+        watcher_.removePaths(current);
+    watched_.clear();
+    created_.clear();
+}
+
+void LibraryWatcher::directory_changed(const QString& path)
+{
+    if (pending_.empty())
+        batch_age_.start();
+    
+    pending_.insert(path.toStdString());
+    
+    // A watch goes away with its directory; one of the same name may be
+    // created again later
+    if (QFileInfo(path).isDir())
+        watch_new_subdirs(path);
+    else
+    {
+        watched_.remove(path);
+        created_.remove(path);
+    }
+    
+    // Keep extending the batch while events arrive, up to a limit
+    if (batch_age_.elapsed() < MAX_BATCH_AGE || !batch_timer_.isActive())
+        batch_timer_.start();
+}
+
+// The change may have been a directory created (or moved in) below path,
+// perhaps with more below it already (mkdir -p, a move).  Each new one gets
+// a watch and is rescanned with the rest of the batch.  Symlinks are not
+// followed, so that a link to an ancestor cannot loop.
+void LibraryWatcher::watch_new_subdirs(const QString& path)
+{
+    const QStringList subdirs = QDir(path).entryList(QDir::Dirs | QDir::NoDotAndDotDot |
+                                                     QDir::NoSymLinks);
+    
+    for (const QString& name : subdirs)
+    {
+        QString dir = path + '/' + name;
+        if (watched_.contains(dir) || !watcher_.addPath(dir))
+            continue;
+        
+        watched_.insert(dir);
+        created_.insert(dir);
+        pending_.insert(dir.toStdString());
+        watch_new_subdirs(dir);
+    }
+}
+
+void LibraryWatcher::flush()
+{
+    if (pending_.empty())
+        return;
+    
+    std::vector<std::string> dirs(pending_.begin(), pending_.end());
+    pending_.clear();
+    
+    if (callback_)
+        callback_(std::move(dirs));
+}
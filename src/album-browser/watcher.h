@@ -0,0 +1,66 @@
+/*
+ * watcher.h
+ * Copyright 2024 Album Browser Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include "album.h"
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+// Watches the music roots, every album directory and the directories in
+// between for created, deleted and moved entries (QFileSystemWatcher uses
+// inotify on Linux).  Directories created below a watched one are watched
+// as they appear, so that an album copied in is seen as it fills up rather
+// than only as the empty directory first created.  Events are coalesced: the callback receives the set
+// of changed directories once the tree has been quiet for a short while, or
+// at the latest a few seconds after the first event of a burst.
+class LibraryWatcher
+{
+public:
+    using ChangeCallback = std::function<void(std::vector<std::string>)>;
+    
+    explicit LibraryWatcher(ChangeCallback callback);
+    
+    // Replaces the watched set with the directories of the given albums
+    void watch(const std::vector<std::string>& roots, const std::vector<Album>& albums);
+    void stop();
+    
+private:
+    void directory_changed(const QString& path);
+    void watch_new_subdirs(const QString& path);
+    void flush();
+    
+    ChangeCallback callback_;
+    QFileSystemWatcher watcher_;
+    QSet<QString> watched_;  // what watcher_.directories() would list
+    QSet<QString> created_;  // watched as they appeared
+    QTimer batch_timer_;
+    QElapsedTimer batch_age_;
+    std::set<std::string> pending_;
+};
+
+#endif // WATCHER_H
@@ -29,6 +29,8 @@
 
 #include <libaudqt/libaudqt.h>
 
+#include "../ui-common/art-cache-qt.h"
+
 class AlbumArtQt : public GeneralPlugin
 {
 public:
@@ -67,7 +69,7 @@ public:
 
     void update_art ()
     {
-        origPixmap = QPixmap (audqt::art_request_current (0, 0));
+        origPixmap = ArtCache::pixmap_current (0, 0);
         qreal r = qApp->devicePixelRatio ();
         origPixmap.setDevicePixelRatio (r);
         origSize = origPixmap.size ();
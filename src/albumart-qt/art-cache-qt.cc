@@ -0,0 +1 @@
+#include "../ui-common/art-cache-qt.cc"
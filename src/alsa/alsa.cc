@@ -21,20 +21,33 @@
  * Because ALSA is not thread-safe (despite claims to the contrary) we use non-
  * blocking output in the pump thread with the mutex locked, then unlock the
  * mutex and wait for more room in the buffer with poll() while other threads
- * lock the mutex and read the output time.  We poll a pipe of our own as well
- * as the ALSA file descriptors so that we can wake up the pump thread when
- * needed.
+ * lock the mutex and read the output time.  We poll an eventfd of our own as
+ * well as the ALSA file descriptors so that we can wake up the pump thread
+ * when needed.
  *
- * When paused, or when it comes to the end of the data given it, the pump will
- * wait on alsa_cond for the signal to continue.  When it has more data waiting,
- * however, it will be sitting in poll() waiting for ALSA's signal that more
- * data can be written.
+ * Our buffer is a single-producer, single-consumer ring: write_audio() adds
+ * to it without taking the mutex, so that it never waits for the pump to
+ * finish talking to ALSA.  Everything that takes data out of it (the pump,
+ * flush() and close_audio()) does so with the mutex locked.
  *
- * * After adding more data to the buffer, and after resuming from pause,
- *   signal on alsa_cond to wake the pump.  (There is no need to signal when
- *   entering pause.)
- * * After setting the pump_quit flag, signal on alsa_cond AND the poll_pipe
+ * When paused, the pump will wait on alsa_cond for the signal to continue.
+ * When it comes to the end of the data given it, it will poll the eventfd
+ * alone until write_audio() wakes it.  When it has more data waiting, it will
+ * be sitting in poll() waiting for ALSA's signal that more data can be
+ * written.
+ *
+ * * After adding more data to the buffer, wake the pump through the eventfd
+ *   if it is idle.  After resuming from pause, signal on alsa_cond.  (There
+ *   is no need to signal when entering pause.)
+ * * After taking data out of the buffer, signal on space_cond to wake
+ *   period_wait().
+ * * After setting the pump_quit flag, signal on alsa_cond AND the eventfd
  *   before joining the thread.
+ *
+ * With memory-mapped access, the pump copies into the hardware buffer itself
+ * (snd_pcm_mmap_begin/commit) rather than through snd_pcm_writei(), and while
+ * our buffer is empty, write_audio() copies straight into the hardware buffer
+ * as far as it has room, skipping our buffer altogether.
  */
 
 #include <assert.h>
@@ -42,13 +55,23 @@
 #include <poll.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include <alsa/asoundlib.h>
-#include <libaudcore/ringbuf.h>
+#include <libaudcore/index.h>
 
 #include "alsa.h"
+#include "../output-common/adaptive.h"
+#include "../output-common/audio-ring.h"
+#include "../output-common/bitperfect.h"
+#include "../output-common/realtime.h"
+#include "../output-common/telemetry.h"
+#include "../trace-common/trace.h"
 
 EXPORT ALSAPlugin aud_plugin_instance;
 
@@ -56,6 +79,10 @@ EXPORT ALSAPlugin aud_plugin_instance;
 do { \
     (value) = function (__VA_ARGS__); \
     if ((value) < 0) { \
+        if ((value) == -EPIPE) { \
+            telemetry_xrun (); \
+            adaptive_underrun (); \
+        } \
         CHECK (snd_pcm_recover, alsa_handle, (value), 0); \
         CHECK_VAL ((value), function, __VA_ARGS__); \
     } \
@@ -71,20 +98,28 @@ static snd_pcm_t * alsa_handle;
 static pthread_mutex_t alsa_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t alsa_cond = PTHREAD_COND_INITIALIZER;
 
+/* held only briefly, never while calling ALSA */
+static pthread_mutex_t space_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t space_cond = PTHREAD_COND_INITIALIZER;
+
 static snd_pcm_format_t alsa_format;
 static int alsa_channels, alsa_rate;
 
-static RingBuf<char> alsa_buffer;
+static AudioRing alsa_buffer;
 static int alsa_period; /* milliseconds */
+static snd_pcm_uframes_t alsa_hw_frames, alsa_period_frames;
+static bool alsa_mmap;
 
 static bool alsa_prebuffer, alsa_paused;
+static bool alsa_draining; /* running dry is not an underrun */
 static int alsa_paused_delay; /* milliseconds */
 
-static int poll_pipe[2];
+static int poll_event;
 static int poll_count;
 static pollfd * poll_handles;
 
 static bool pump_quit;
+static std::atomic<bool> pump_idle; /* waiting for data on the eventfd */
 static pthread_t pump_thread;
 
 static snd_mixer_t * alsa_mixer;
@@ -92,23 +127,17 @@ static snd_mixer_elem_t * alsa_mixer_element;
 
 static bool poll_setup ()
 {
-    if (pipe (poll_pipe))
-    {
-        AUDERR ("Failed to create pipe: %s.\n", strerror (errno));
-        return false;
-    }
+    poll_event = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
 
-    if (fcntl (poll_pipe[0], F_SETFL, O_NONBLOCK))
+    if (poll_event < 0)
     {
-        AUDERR ("Failed to set O_NONBLOCK on pipe: %s.\n", strerror (errno));
-        close (poll_pipe[0]);
-        close (poll_pipe[1]);
+        AUDERR ("Failed to create eventfd: %s.\n", strerror (errno));
         return false;
     }
 
     poll_count = 1 + snd_pcm_poll_descriptors_count (alsa_handle);
     poll_handles = new pollfd[poll_count];
-    poll_handles[0].fd = poll_pipe[0];
+    poll_handles[0].fd = poll_event;
     poll_handles[0].events = POLLIN;
     poll_count = 1 + snd_pcm_poll_descriptors (alsa_handle, poll_handles + 1,
      poll_count - 1);
@@ -116,9 +145,10 @@ static bool poll_setup ()
     return true;
 }
 
-static void poll_sleep ()
+/* with <alsa_fds> false, sleeps until woken through the eventfd only */
+static void poll_sleep (bool alsa_fds)
 {
-    if (poll (poll_handles, poll_count, -1) < 0)
+    if (poll (poll_handles, alsa_fds ? poll_count : 1, -1) < 0)
     {
         AUDERR ("Failed to poll: %s.\n", strerror (errno));
         return;
@@ -126,28 +156,115 @@ static void poll_sleep ()
 
     if (poll_handles[0].revents & POLLIN)
     {
-        char c;
-        while (read (poll_pipe[0], & c, 1) == 1)
-            ;
+        uint64_t count;
+        if (read (poll_event, & count, sizeof count) < 0 && errno != EAGAIN)
+            AUDERR ("Failed to read from eventfd: %s.\n", strerror (errno));
     }
 }
 
 static void poll_wake ()
 {
-    const char c = 0;
-    if (write (poll_pipe[1], & c, 1) < 0)
-        AUDERR ("Failed to write to pipe: %s.\n", strerror (errno));
+    const uint64_t one = 1;
+    if (write (poll_event, & one, sizeof one) < 0)
+        AUDERR ("Failed to write to eventfd: %s.\n", strerror (errno));
 }
 
 static void poll_cleanup ()
 {
-    close (poll_pipe[0]);
-    close (poll_pipe[1]);
+    close (poll_event);
     delete[] poll_handles;
 }
 
+/* called by the pump, unlocked, when it has written all the data given it;
+ * the flag is set before looking at the buffer again so that write_audio()
+ * either sees it or has added its data before the look.  Each side stores
+ * and then loads, so both need a full fence between the two; an acquire or
+ * release alone lets a weakly ordered CPU see neither store, and the pump
+ * then sleeps with the buffer full. */
+static void wait_for_data ()
+{
+    pump_idle.store (true, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+
+    if (! alsa_buffer.len ())
+        poll_sleep (false);
+
+    pump_idle.store (false, std::memory_order_relaxed);
+}
+
+static void signal_space ()
+{
+    pthread_mutex_lock (& space_mutex);
+    pthread_cond_broadcast (& space_cond);
+    pthread_mutex_unlock (& space_mutex);
+}
+
+/* Copies up to <frames> frames into the hardware buffer and starts the PCM
+ * if it was waiting for them, as snd_pcm_writei() would.  Returns the number
+ * of frames copied, or a negative error code. */
+static snd_pcm_sframes_t mmap_write (const char * data, snd_pcm_uframes_t frames)
+{
+    snd_pcm_uframes_t done = 0;
+
+    while (done < frames)
+    {
+        const snd_pcm_channel_area_t * areas;
+        snd_pcm_uframes_t offset, count = frames - done;
+
+        int error = snd_pcm_mmap_begin (alsa_handle, & areas, & offset, & count);
+        if (error < 0)
+            return error;
+        if (! count)
+            break;
+
+        /* interleaved, so the first area holds all the channels */
+        char * dest = (char *) areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+        memcpy (dest, data + snd_pcm_frames_to_bytes (alsa_handle, done),
+         snd_pcm_frames_to_bytes (alsa_handle, count));
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit (alsa_handle, offset, count);
+        if (committed < 0)
+            return committed;
+
+        done += committed;
+
+        /* the end of the hardware buffer splits a transfer in two */
+        if ((snd_pcm_uframes_t) committed < count)
+            break;
+    }
+
+    if (done && snd_pcm_state (alsa_handle) == SND_PCM_STATE_PREPARED)
+    {
+        int error = snd_pcm_start (alsa_handle);
+        if (error < 0)
+            return error;
+    }
+
+    return done;
+}
+
+/* With our buffer empty, the hardware may still hold most of its own; that
+ * is an underrun only once less than a period is left there.  In mmap mode,
+ * write_audio() fills the hardware buffer directly and ours is normally
+ * empty. */
+static bool hardware_low ()
+{
+    snd_pcm_sframes_t avail = snd_pcm_avail_update (alsa_handle);
+    return avail >= 0 && (snd_pcm_uframes_t) avail + alsa_period_frames > alsa_hw_frames;
+}
+
+static snd_pcm_sframes_t write_frames (const char * data, snd_pcm_uframes_t frames)
+{
+    if (alsa_mmap)
+        return mmap_write (data, frames);
+    else
+        return snd_pcm_writei (alsa_handle, data, frames);
+}
+
 static void * pump (void *)
 {
+    realtime_enter ("ALSA output", alsa_buffer.data (), alsa_buffer.size ());
+
     pthread_mutex_lock (& alsa_mutex);
 
     bool failed_once = false;
@@ -156,11 +273,25 @@ static void * pump (void *)
 
     while (! pump_quit)
     {
+        if (alsa_prebuffer || alsa_paused)
+        {
+            pthread_cond_wait (& alsa_cond, & alsa_mutex);
+            continue;
+        }
+
         int writable = snd_pcm_bytes_to_frames (alsa_handle, alsa_buffer.linear ());
 
-        if (alsa_prebuffer || alsa_paused || ! writable)
+        if (! writable)
         {
-            pthread_cond_wait (& alsa_cond, & alsa_mutex);
+            /* the adaptive target only grows for real xruns (above) */
+            if (! alsa_draining && hardware_low ())
+                telemetry_underrun ();
+
+            pthread_mutex_unlock (& alsa_mutex);
+            wait_for_data ();
+            telemetry_wakeup (alsa_buffer.len (), alsa_buffer.size ());
+            adaptive_wakeup ();
+            pthread_mutex_lock (& alsa_mutex);
             continue;
         }
 
@@ -169,17 +300,19 @@ static void * pump (void *)
 
         if (avail)
         {
+            TRACE_SPAN ("ALSA pump write");
             wakeups_since_write = 0;
 
             int written;
-            CHECK_VAL_RECOVER (written, snd_pcm_writei, alsa_handle,
-             & alsa_buffer[0], aud::min (writable, avail));
+            CHECK_VAL_RECOVER (written, write_frames, alsa_buffer.peek (),
+             aud::min (writable, avail));
 
             failed_once = false;
 
             alsa_buffer.discard (snd_pcm_frames_to_bytes (alsa_handle, written));
 
             pthread_cond_broadcast (& alsa_cond); /* signal write complete */
+            signal_space ();
 
             if (writable < avail)
                 continue;
@@ -200,10 +333,13 @@ static void * pump (void *)
         }
         else
         {
-            poll_sleep ();
+            poll_sleep (true);
             wakeups_since_write ++;
         }
 
+        telemetry_wakeup (alsa_buffer.len (), alsa_buffer.size ());
+        adaptive_wakeup ();
+
         pthread_mutex_lock (& alsa_mutex);
         continue;
 
@@ -260,6 +396,9 @@ bool ALSAPlugin::init ()
 {
     AUDDBG ("Initialize.\n");
     init_config ();
+    adaptive_init ();
+    bitperfect_init ();
+    realtime_init ();
     open_mixer ();
     return true;
 }
@@ -314,6 +453,8 @@ bool ALSAPlugin::open_audio (int aud_format, int rate, int channels, String & er
     int total_buffer, hard_buffer, soft_buffer, buffer_frames;
     unsigned useconds;
     int direction;
+    bool bit_perfect = bitperfect_enabled ();
+    const char * path = nullptr;
 
     pthread_mutex_lock (& alsa_mutex);
 
@@ -330,13 +471,33 @@ bool ALSAPlugin::open_audio (int aud_format, int rate, int channels, String & er
 
     AUDINFO ("Opening PCM device %s for %s, %d channels, %d Hz.\n",
      (const char *) pcm, snd_pcm_format_name (format), channels, rate);
-    CHECK_STR (error, snd_pcm_open, & alsa_handle, pcm, SND_PCM_STREAM_PLAYBACK, 0);
+    /* in bit-perfect mode, the plug layer may not convert anything */
+    CHECK_STR (error, snd_pcm_open, & alsa_handle, pcm, SND_PCM_STREAM_PLAYBACK,
+     bit_perfect ? (SND_PCM_NO_AUTO_RESAMPLE | SND_PCM_NO_AUTO_CHANNELS |
+     SND_PCM_NO_AUTO_FORMAT | SND_PCM_NO_SOFTVOL) : 0);
 
     snd_pcm_hw_params_t * params;
     snd_pcm_hw_params_alloca (& params);
     CHECK_STR (error, snd_pcm_hw_params_any, alsa_handle, params);
-    CHECK_STR (error, snd_pcm_hw_params_set_access, alsa_handle, params,
-     SND_PCM_ACCESS_RW_INTERLEAVED);
+
+    alsa_mmap = aud_get_bool ("alsa", "mmap") && snd_pcm_hw_params_set_access
+     (alsa_handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+
+    if (alsa_mmap)
+        AUDINFO ("Using memory-mapped access.\n");
+    else
+        CHECK_STR (error, snd_pcm_hw_params_set_access, alsa_handle, params,
+         SND_PCM_ACCESS_RW_INTERLEAVED);
+
+    if (bit_perfect && (snd_pcm_hw_params_test_format (alsa_handle, params, format) < 0 ||
+     snd_pcm_hw_params_test_channels (alsa_handle, params, channels) < 0 ||
+     snd_pcm_hw_params_test_rate (alsa_handle, params, rate, 0) < 0))
+    {
+        error = String (str_printf (_("The PCM device %s cannot play %s, %d "
+         "channels, %d Hz as it is, which bit-perfect output requires."),
+         (const char *) pcm, snd_pcm_format_name (format), channels, rate));
+        goto FAILED;
+    }
 
     CHECK_STR (error, snd_pcm_hw_params_set_format, alsa_handle, params, format);
     CHECK_STR (error, snd_pcm_hw_params_set_channels, alsa_handle, params, channels);
@@ -360,6 +521,13 @@ bool ALSAPlugin::open_audio (int aud_format, int rate, int channels, String & er
     alsa_period = useconds / 1000;
 
     CHECK_STR (error, snd_pcm_hw_params, alsa_handle, params);
+    CHECK_STR (error, snd_pcm_get_params, alsa_handle, & alsa_hw_frames,
+     & alsa_period_frames);
+
+    /* a dmix or dshare device (or any other but hw:) still mixes */
+    if (bit_perfect && ! (path = bitperfect_check ()))
+        path = (snd_pcm_type (alsa_handle) == SND_PCM_TYPE_HW) ?
+         _("bit-perfect") : _("not a hardware device");
 
     soft_buffer = aud::max (total_buffer / 2, total_buffer - hard_buffer);
     AUDINFO ("Buffer: hardware %d ms, software %d ms, period %d ms.\n",
@@ -375,6 +543,13 @@ bool ALSAPlugin::open_audio (int aud_format, int rate, int channels, String & er
     if (! poll_setup ())
         goto FAILED;
 
+    telemetry_open ("ALSA");
+    adaptive_open (soft_buffer);
+
+    if (path)
+        telemetry_path (path);
+
+    realtime_prepare ();
     pump_start ();
 
     pthread_mutex_unlock (& alsa_mutex);
@@ -402,6 +577,8 @@ void ALSAPlugin::close_audio ()
     CHECK (snd_pcm_drop, alsa_handle);
 
 FAILED:
+    telemetry_close ();
+    realtime_leave (alsa_buffer.data (), alsa_buffer.size ());
     alsa_buffer.destroy ();
     poll_cleanup ();
     snd_pcm_close (alsa_handle);
@@ -410,42 +587,86 @@ FAILED:
     pthread_mutex_unlock (& alsa_mutex);
 }
 
+/* what write_audio() may add; with adaptive buffering, only as much as
+ * brings the buffer up to the target fill */
+static int alsa_space ()
+{
+    int space = alsa_buffer.space ();
+    int target = adaptive_target ();
+
+    if (! target)
+        return space;
+
+    int frames = aud::rescale (target, 1000, alsa_rate);
+    int limit = snd_pcm_frames_to_bytes (alsa_handle, frames) - alsa_buffer.len ();
+    return aud::clamp (limit, 0, space);
+}
+
 int ALSAPlugin::write_audio (const void * data, int length)
 {
-    pthread_mutex_lock (& alsa_mutex);
+    TRACE_SPAN ("ALSA write_audio");
+    int direct = 0;
+
+    /* Going straight to the hardware buffer needs the mutex; rather than wait
+     * for the pump to let go of it, our buffer is used.  Errors are left for
+     * the pump to deal with. */
+    if (alsa_mmap && ! alsa_buffer.len () && ! pthread_mutex_trylock (& alsa_mutex))
+    {
+        if (! alsa_prebuffer && ! alsa_paused)
+        {
+            snd_pcm_sframes_t avail = snd_pcm_avail_update (alsa_handle);
+            int frames = snd_pcm_bytes_to_frames (alsa_handle, length);
+
+            if (avail > 0 && frames > 0)
+            {
+                snd_pcm_sframes_t written = mmap_write ((const char *) data,
+                 aud::min<snd_pcm_sframes_t> (avail, frames));
+
+                if (written > 0)
+                    direct = snd_pcm_frames_to_bytes (alsa_handle, written);
+            }
+        }
+
+        pthread_mutex_unlock (& alsa_mutex);
+    }
 
-    length = aud::min (length, alsa_buffer.space ());
-    alsa_buffer.copy_in ((const char *) data, length);
+    length = direct + aud::min (length - direct, alsa_space ());
+    alsa_buffer.copy_in ((const char *) data + direct, length - direct);
 
     AUDDBG ("Buffer fill levels: low = %d%%, high = %d%%.\n",
-            (alsa_buffer.len () - length) * 100 / alsa_buffer.size (),
+            (alsa_buffer.len () - (length - direct)) * 100 / alsa_buffer.size (),
             alsa_buffer.len () * 100 / alsa_buffer.size ());
 
-    if (! alsa_prebuffer && ! alsa_paused)
-        pthread_cond_broadcast (& alsa_cond);
+    /* pairs with the fence in wait_for_data() */
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+
+    if (length > direct && pump_idle.exchange (false))
+        poll_wake ();
 
-    pthread_mutex_unlock (& alsa_mutex);
     return length;
 }
 
 void ALSAPlugin::period_wait ()
 {
-    pthread_mutex_lock (& alsa_mutex);
+    if (alsa_space ())
+        return;
 
-    while (! alsa_buffer.space ())
-    {
-        if (! alsa_paused)
-        {
-            if (alsa_prebuffer)
-                start_playback ();
-            else
-                pthread_cond_broadcast (& alsa_cond);
-        }
+    TRACE_SPAN ("ALSA period_wait");
 
-        pthread_cond_wait (& alsa_cond, & alsa_mutex);
-    }
+    /* a full buffer is what ends prebuffering */
+    pthread_mutex_lock (& alsa_mutex);
+
+    if (alsa_prebuffer && ! alsa_paused)
+        start_playback ();
 
     pthread_mutex_unlock (& alsa_mutex);
+
+    pthread_mutex_lock (& space_mutex);
+
+    while (! alsa_space ())
+        pthread_cond_wait (& space_cond, & space_mutex);
+
+    pthread_mutex_unlock (& space_mutex);
 }
 
 void ALSAPlugin::drain ()
@@ -458,6 +679,8 @@ void ALSAPlugin::drain ()
     if (alsa_prebuffer)
         start_playback ();
 
+    alsa_draining = true;
+
     while (snd_pcm_bytes_to_frames (alsa_handle, alsa_buffer.len ()))
         pthread_cond_wait (& alsa_cond, & alsa_mutex);
 
@@ -485,6 +708,7 @@ void ALSAPlugin::drain ()
         pthread_cond_timedwait (& alsa_cond, & alsa_mutex, & ts);
     }
 
+    alsa_draining = false;
     pthread_mutex_unlock (& alsa_mutex);
 }
 
@@ -501,7 +725,7 @@ int ALSAPlugin::get_delay ()
         delay += get_delay_locked ();
 
     pthread_mutex_unlock (& alsa_mutex);
-    return delay;
+    return telemetry_latency (delay);
 }
 
 void ALSAPlugin::flush ()
@@ -518,7 +742,7 @@ FAILED:
     alsa_paused_delay = 0;
 
     poll_wake (); /* wake pump so it's ready */
-    pthread_cond_broadcast (& alsa_cond); /* interrupt period wait */
+    signal_space (); /* interrupt period wait */
     pthread_mutex_unlock (& alsa_mutex);
 }
 
@@ -23,6 +23,9 @@
 #include <libaudcore/preferences.h>
 
 #include "alsa.h"
+#include "../output-common/adaptive.h"
+#include "../output-common/bitperfect.h"
+#include "../output-common/realtime.h"
 
 const char ALSAPlugin::about[] =
  N_("ALSA Output Plugin for Audacious\n"
@@ -241,6 +244,7 @@ static void guess_element ()
 const char * const ALSAPlugin::defaults[] = {
     "pcm", "default",
     "mixer", "default",
+    "mmap", "FALSE",
     nullptr
 };
 
@@ -301,7 +305,12 @@ const PreferencesWidget ALSAPlugin::widgets[] = {
         {nullptr, mixer_combo_fill}),
     WidgetCombo (N_("Mixer element:"),
         WidgetString ("alsa", "mixer-element", element_changed, "alsa mixer changed"),
-        {nullptr, element_combo_fill})
+        {nullptr, element_combo_fill}),
+    WidgetCheck (N_("Write directly to the hardware buffer (mmap)"),
+        WidgetBool ("alsa", "mmap", pcm_changed)),
+    BITPERFECT_WIDGETS,
+    ADAPTIVE_WIDGETS,
+    REALTIME_WIDGETS
 };
 
 static void alsa_prefs_init ()
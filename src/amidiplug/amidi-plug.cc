@@ -22,6 +22,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <mutex>
+#include <thread>
+
+#include <glib.h>
+
 #include <libaudcore/runtime.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
@@ -30,6 +35,7 @@
 #include "i_configure.h"
 #include "i_fileinfo.h"
 #include "i_midi.h"
+#include "../trace-common/trace.h"
 
 class AMIDIPlug : public InputPlugin
 {
@@ -64,8 +70,11 @@ public:
 protected:
     bool m_backend_initialized = false;
 
+    void backend_prepare ();
+
     static bool audio_init ();
     static void audio_generate (double seconds);
+    static void audio_flush ();
     static void audio_cleanup ();
 
     static void generate_ticks (midifile_t & midifile, int num_ticks);
@@ -78,8 +87,16 @@ EXPORT AMIDIPlug aud_plugin_instance;
 const char * const AMIDIPlug::exts[] = {"mid", "midi", "rmi", "rmid", nullptr};
 const char * const AMIDIPlug::mimes[] = {"audio/midi", nullptr};
 
+/* the backend stays up from one song to the next, with its soundfonts
+   loaded; the mutex keeps play() from using it while it is preloaded */
+static std::mutex s_backend_mutex;
+static std::thread s_preload;
+
 void AMIDIPlug::cleanup ()
 {
+    if (s_preload.joinable ())
+        s_preload.join ();
+
     if (m_backend_initialized)
     {
         backend_cleanup ();
@@ -98,6 +115,10 @@ bool AMIDIPlug::init ()
         "fsyn_synth_polyphony", "-1",
         "fsyn_synth_reverb", "-1",
         "fsyn_synth_chorus", "-1",
+        "fsyn_synth_cpu_cores", "1",
+        "fsyn_block_ms", "50",
+        "fsyn_polyphony_governor", "TRUE",
+        "fsyn_preload", "FALSE",
         "skip_leading", "FALSE",
         "skip_trailing", "FALSE",
         nullptr
@@ -105,6 +126,10 @@ bool AMIDIPlug::init ()
 
     aud_config_set_defaults ("amidiplug", defaults);
 
+    /* load the soundfonts now rather than when the first song plays */
+    if (aud_get_bool ("amidiplug", "fsyn_preload"))
+        s_preload = std::thread ([this] () { backend_prepare (); });
+
     return true;
 }
 
@@ -163,7 +188,10 @@ bool AMIDIPlug::read_tag (const char * filename, VFSFile & file, Tuple & tuple,
 
 
 static int s_samplerate, s_channels;
-static int s_bufsize;
+static int s_bufsize;          /* bytes in a block */
+static int s_buffill;          /* bytes of the block rendered so far */
+static int64_t s_rendertime;   /* microseconds spent rendering them */
+static bool s_govern;
 static int16_t * s_buf;
 
 bool AMIDIPlug::audio_init ()
@@ -177,8 +205,15 @@ bool AMIDIPlug::audio_init ()
 
     open_audio (FMT_S16_NE, s_samplerate, s_channels);
 
-    s_bufsize = 2 * s_channels * (s_samplerate / 4);
+    /* the audio is written out a block at a time, however short the gaps
+       between events are */
+    int block_ms = aud::clamp (aud_get_int ("amidiplug", "fsyn_block_ms"), 5, 1000);
+
+    s_bufsize = 2 * s_channels * aud::max (s_samplerate * block_ms / 1000, 1);
     s_buf = new int16_t[s_bufsize / 2];
+    s_buffill = 0;
+    s_rendertime = 0;
+    s_govern = aud_get_bool ("amidiplug", "fsyn_polyphony_governor");
 
     return true;
 }
@@ -189,24 +224,49 @@ void AMIDIPlug::audio_generate (double seconds)
 
     while (total)
     {
-        int chunk = (total < s_bufsize) ? total : s_bufsize;
+        int chunk = aud::min (total, s_bufsize - s_buffill);
 
-        backend_generate_audio (s_buf, chunk);
-        write_audio (s_buf, chunk);
+        int64_t start = g_get_monotonic_time ();
+        backend_generate_audio ((char *) s_buf + s_buffill, chunk);
+        s_rendertime += g_get_monotonic_time () - start;
 
+        s_buffill += chunk;
         total -= chunk;
+
+        if (s_buffill == s_bufsize)
+        {
+            /* how much of the time the block plays for it took to render */
+            if (s_govern)
+            {
+                int64_t playtime = (int64_t) s_bufsize * 1000000 / (2 * s_channels * s_samplerate);
+                backend_govern ((double) s_rendertime / aud::max (playtime, (int64_t) 1));
+            }
+
+            audio_flush ();
+        }
     }
 }
 
+void AMIDIPlug::audio_flush ()
+{
+    if (s_buffill)
+        write_audio (s_buf, s_buffill);
+
+    s_buffill = 0;
+    s_rendertime = 0;
+}
+
 void AMIDIPlug::audio_cleanup ()
 {
     delete[] s_buf;
 }
 
-bool AMIDIPlug::play (const char * filename, VFSFile & file)
+void AMIDIPlug::backend_prepare ()
 {
+    std::lock_guard<std::mutex> lock (s_backend_mutex);
+
     if (__sync_bool_compare_and_swap (& backend_settings_changed, true, false)
-     && m_backend_initialized)
+     && m_backend_initialized && ! backend_update ())
     {
         AUDDBG ("Settings changed, reinitializing backend\n");
         backend_cleanup ();
@@ -218,6 +278,11 @@ bool AMIDIPlug::play (const char * filename, VFSFile & file)
         backend_init ();
         m_backend_initialized = true;
     }
+}
+
+bool AMIDIPlug::play (const char * filename, VFSFile & file)
+{
+    backend_prepare ();
 
     if (! audio_init ())
         return false;
@@ -256,9 +321,15 @@ void AMIDIPlug::play_loop (midifile_t & midifile)
 
     while (! (stopped = check_stop ()))
     {
+        TRACE_SPAN ("AMIDI-Plug play");
         int seektime = check_seek ();
         if (seektime >= 0)
+        {
+            /* the rest of the block is from before the seek */
+            s_buffill = 0;
+            s_rendertime = 0;
             tick = skip_to (midifile, seektime);
+        }
 
         midievent_t * event = nullptr;
         midifile_track_t * event_track = nullptr;
@@ -345,7 +416,10 @@ void AMIDIPlug::play_loop (midifile_t & midifile)
     }
 
     if (! stopped)
+    {
         generate_ticks (midifile, midifile.max_tick - tick);
+        audio_flush ();
+    }
 
     backend_reset ();
 }
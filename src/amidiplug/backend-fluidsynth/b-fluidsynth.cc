@@ -36,6 +36,12 @@ typedef struct
     fluid_synth_t * synth;
 
     Index<int> soundfont_ids;
+    Index<String> soundfont_files;  /* the file each of them came from */
+
+    int max_polyphony;  /* as configured; the governor stays below it */
+
+    /* settings that only take effect in a new synth */
+    int samplerate, cpu_cores, reverb, chorus;
 }
 sequencer_client_t;
 
@@ -43,36 +49,48 @@ sequencer_client_t;
 static sequencer_client_t sc;
 /* options */
 
+static void i_synth_apply ();
 static void i_soundfont_load ();
 
 void backend_init ()
 {
     sc.settings = new_fluid_settings();
 
-    fluid_settings_setnum (sc.settings, "synth.sample-rate",
-     aud_get_int ("amidiplug", "fsyn_synth_samplerate"));
-
-    int gain = aud_get_int ("amidiplug", "fsyn_synth_gain");
-    int polyphony = aud_get_int ("amidiplug", "fsyn_synth_polyphony");
-    int reverb = aud_get_int ("amidiplug", "fsyn_synth_reverb");
-    int chorus = aud_get_int ("amidiplug", "fsyn_synth_chorus");
+    sc.samplerate = aud_get_int ("amidiplug", "fsyn_synth_samplerate");
+    sc.cpu_cores = aud::clamp (aud_get_int ("amidiplug", "fsyn_synth_cpu_cores"), 1, 256);
+    sc.reverb = aud_get_int ("amidiplug", "fsyn_synth_reverb");
+    sc.chorus = aud_get_int ("amidiplug", "fsyn_synth_chorus");
 
-    if (gain != -1)
-        fluid_settings_setnum (sc.settings, "synth.gain", gain / 10.0);
+    fluid_settings_setnum (sc.settings, "synth.sample-rate", sc.samplerate);
 
-    if (polyphony != -1)
-        fluid_settings_setint (sc.settings, "synth.polyphony", polyphony);
+    if (sc.reverb != -1)
+        fluid_settings_setint (sc.settings, "synth.reverb.active", sc.reverb);
 
-    if (reverb != -1)
-        fluid_settings_setint (sc.settings, "synth.reverb.active", reverb);
+    if (sc.chorus != -1)
+        fluid_settings_setint (sc.settings, "synth.chorus.active", sc.chorus);
 
-    if (chorus != -1)
-        fluid_settings_setint (sc.settings, "synth.chorus.active", chorus);
+    /* render the voices on this many threads */
+    fluid_settings_setint (sc.settings, "synth.cpu-cores", sc.cpu_cores);
 
     sc.synth = new_fluid_synth (sc.settings);
+    i_synth_apply ();
 
     /* load soundfonts */
-    i_soundfont_load();
+    i_soundfont_load ();
+}
+
+
+bool backend_update ()
+{
+    if (sc.samplerate != aud_get_int ("amidiplug", "fsyn_synth_samplerate") ||
+        sc.cpu_cores != aud::clamp (aud_get_int ("amidiplug", "fsyn_synth_cpu_cores"), 1, 256) ||
+        sc.reverb != aud_get_int ("amidiplug", "fsyn_synth_reverb") ||
+        sc.chorus != aud_get_int ("amidiplug", "fsyn_synth_chorus"))
+        return false;
+
+    i_synth_apply ();
+    i_soundfont_load ();
+    return true;
 }
 
 
@@ -83,6 +101,7 @@ void backend_cleanup ()
         fluid_synth_sfunload (sc.synth, id, 0);
 
     sc.soundfont_ids.clear ();
+    sc.soundfont_files.clear ();
     delete_fluid_synth (sc.synth);
     delete_fluid_settings (sc.settings);
 }
@@ -91,6 +110,9 @@ void backend_cleanup ()
 void backend_reset ()
 {
     fluid_synth_system_reset (sc.synth);  /* all notes off and channels reset */
+
+    if (fluid_synth_get_polyphony (sc.synth) != sc.max_polyphony)
+        fluid_synth_set_polyphony (sc.synth, sc.max_polyphony);
 }
 
 
@@ -186,6 +208,23 @@ void backend_generate_audio (void * buf, int bufsize)
 }
 
 
+void backend_govern (double load)
+{
+    int polyphony = fluid_synth_get_polyphony (sc.synth);
+
+    /* the voices over the limit are dropped, the quietest first */
+    if (load > 0.8 && polyphony > 16)
+        polyphony = aud::max (polyphony * 3 / 4, 16);
+    else if (load < 0.4 && polyphony < sc.max_polyphony)
+        polyphony = aud::min (polyphony + polyphony / 8 + 1, sc.max_polyphony);
+    else
+        return;
+
+    AUDDBG ("render load %.2f, polyphony now %d\n", load, polyphony);
+    fluid_synth_set_polyphony (sc.synth, polyphony);
+}
+
+
 void backend_audio_info (int * channels, int * bitdepth, int * samplerate)
 {
     *channels = 2;
@@ -198,30 +237,66 @@ void backend_audio_info (int * channels, int * bitdepth, int * samplerate)
    *** INTERNALS ****************************************************
    ****************************************************************** */
 
+/* gain and polyphony, which a synth can be given while it runs; the
+   defaults are those of FluidSynth */
+static void i_synth_apply ()
+{
+    int gain = aud_get_int ("amidiplug", "fsyn_synth_gain");
+    int polyphony = aud_get_int ("amidiplug", "fsyn_synth_polyphony");
+
+    fluid_synth_set_gain (sc.synth, (gain != -1) ? gain / 10.0 : 0.2);
+    fluid_synth_set_polyphony (sc.synth, (polyphony != -1) ? polyphony : 256);
+
+    sc.max_polyphony = fluid_synth_get_polyphony (sc.synth);
+}
+
+
+/* brings the loaded soundfonts in line with the configured list; those at
+   the start of the list that are loaded already are kept, so that adding a
+   soundfont does not load again the ones before it */
 static void i_soundfont_load ()
 {
     String soundfont_file = aud_get_str ("amidiplug", "fsyn_soundfont_file");
+    Index<String> sffiles;
 
     if (soundfont_file[0])
+        sffiles = str_list_to_index (soundfont_file, ";");
+    else
+        AUDWARN ("FluidSynth backend was selected, but no SoundFont has been specified\n");
+
+    int keep = 0;
+    while (keep < sc.soundfont_files.len () && keep < sffiles.len () &&
+           sc.soundfont_files[keep] == sffiles[keep])
+        keep ++;
+
+    if (keep == sffiles.len () && keep == sc.soundfont_files.len ())
+        return;
+
+    for (int i = sc.soundfont_ids.len () - 1; i >= keep; i --)
     {
-        Index<String> sffiles = str_list_to_index (soundfont_file, ";");
+        AUDDBG ("unloading soundfont %s\n", (const char *) sc.soundfont_files[i]);
+        fluid_synth_sfunload (sc.synth, sc.soundfont_ids[i], 0);
+    }
+
+    sc.soundfont_ids.remove (keep, -1);
+    sc.soundfont_files.remove (keep, -1);
+
+    for (int i = keep; i < sffiles.len (); i ++)
+    {
+        const char * sffile = sffiles[i];
+
+        AUDDBG ("loading soundfont %s\n", sffile);
+        int sf_id = fluid_synth_sfload (sc.synth, sffile, 0);
 
-        for (const char * sffile : sffiles)
+        if (sf_id == -1)
+            AUDWARN ("unable to load SoundFont file %s\n", sffile);
+        else
         {
-            AUDDBG ("loading soundfont %s\n", sffile);
-            int sf_id = fluid_synth_sfload (sc.synth, sffile, 0);
-
-            if (sf_id == -1)
-                AUDWARN ("unable to load SoundFont file %s\n", sffile);
-            else
-            {
-                AUDDBG ("soundfont %s successfully loaded\n", sffile);
-                sc.soundfont_ids.append (sf_id);
-            }
+            AUDDBG ("soundfont %s successfully loaded\n", sffile);
+            sc.soundfont_ids.append (sf_id);
+            sc.soundfont_files.append (sffiles[i]);
         }
-
-        fluid_synth_system_reset (sc.synth);
     }
-    else
-        AUDWARN ("FluidSynth backend was selected, but no SoundFont has been specified\n");
+
+    fluid_synth_system_reset (sc.synth);
 }
@@ -27,9 +27,18 @@ void backend_init ();
 void backend_cleanup ();
 void backend_reset ();
 
+/* applies changed settings to the synth, keeping the soundfonts that are
+   loaded; false if it has to be made again with backend_cleanup and
+   backend_init */
+bool backend_update ();
+
 void backend_audio_info (int *, int *, int *);
 void backend_generate_audio (void * buf, int bufsize);
 
+/* load is how long the last block took to render over how long it plays
+   for; the polyphony is lowered as it nears 1 and raised back after */
+void backend_govern (double load);
+
 void seq_event_noteon (midievent_t *);
 void seq_event_noteoff (midievent_t *);
 void seq_event_allnoteoff (int);
@@ -152,7 +152,17 @@ static const PreferencesWidget amidiplug_widgets[] = {
     WidgetBox ({{chorus_widgets}, true}),
     WidgetSpin (N_("Sample rate:"),
         WidgetInt ("amidiplug", "fsyn_synth_samplerate", backend_change),
-        {22050, 96000, 1, N_("Hz")})
+        {22050, 96000, 1, N_("Hz")}),
+    WidgetSpin (N_("Rendering threads:"),
+        WidgetInt ("amidiplug", "fsyn_synth_cpu_cores", backend_change),
+        {1, 64, 1}),
+    WidgetSpin (N_("Render block:"),
+        WidgetInt ("amidiplug", "fsyn_block_ms"),
+        {5, 1000, 5, N_("ms")}),
+    WidgetCheck (N_("Lower polyphony when rendering falls behind"),
+        WidgetBool ("amidiplug", "fsyn_polyphony_governor")),
+    WidgetCheck (N_("Load SoundFonts at startup"),
+        WidgetBool ("amidiplug", "fsyn_preload"))
 };
 
 const PluginPreferences amidiplug_prefs = {
@@ -58,9 +58,11 @@ static void vfsAsyncCb(const char* url, const Index<char>& data, void* callback)
 
 static Index<PlaylistAddItem> toAddItems(const UrlList& urls)
 {
+    // sized once; a whole artist or album may be tens of thousands of songs
     Index<PlaylistAddItem> addItems;
-    for (auto& url: urls)
-        addItems.append(String(url.c_str()));
+    addItems.resize(urls.size());
+    for (size_t i = 0; i < urls.size(); i++)
+        addItems[i].filename = String(urls[i].c_str());
 
     return addItems;
 }
@@ -92,10 +92,67 @@ struct GhosdData
 };
 
 
+/* The OSD last rendered, with what it was rendered from: the same message
+   in the same style (a replayed song, pausing and unpausing) is shown
+   without being laid out and drawn again.  The surface lives in the X
+   server, so it is only good for as long as the Ghosd object. */
+struct GhosdSurfaceCache
+{
+  String markup_message;
+  aosd_cfg_osd_text_t text;
+  aosd_cfg_osd_decoration_t decoration;
+  int max_width = 0, width = 0, height = 0;
+  cairo_surface_t * surface = nullptr;
+
+  void clear ()
+  {
+    if (surface)
+      cairo_surface_destroy (surface);
+
+    surface = nullptr;
+    markup_message = String ();
+  }
+};
+
+
 static int osd_source_id = 0;
 static int osd_status = AOSD_STATUS_HIDDEN;
 static Ghosd *osd;
 static SmartPtr<GhosdData> osd_data;
+static GhosdSurfaceCache osd_surface_cache;
+
+
+static bool
+aosd_color_equal ( const aosd_color_t & a , const aosd_color_t & b )
+{
+  return a.red == b.red && a.green == b.green && a.blue == b.blue && a.alpha == b.alpha;
+}
+
+
+static bool
+aosd_style_equal ( const aosd_cfg_osd_text_t & text_a , const aosd_cfg_osd_decoration_t & deco_a ,
+                   const aosd_cfg_osd_text_t & text_b , const aosd_cfg_osd_decoration_t & deco_b )
+{
+  for ( int i = 0 ; i < AOSD_TEXT_FONTS_NUM ; i++ )
+  {
+    if ( text_a.fonts_name[i] != text_b.fonts_name[i] ||
+         ! aosd_color_equal( text_a.fonts_color[i] , text_b.fonts_color[i] ) ||
+         text_a.fonts_draw_shadow[i] != text_b.fonts_draw_shadow[i] ||
+         ! aosd_color_equal( text_a.fonts_shadow_color[i] , text_b.fonts_shadow_color[i] ) )
+      return false;
+  }
+
+  if ( deco_a.code != deco_b.code )
+    return false;
+
+  for ( int i = 0 ; i < AOSD_DECO_STYLE_MAX_COLORS ; i++ )
+  {
+    if ( ! aosd_color_equal( deco_a.colors[i] , deco_b.colors[i] ) )
+      return false;
+  }
+
+  return true;
+}
 
 
 static void
@@ -270,6 +327,20 @@ G_GNUC_END_IGNORE_DEPRECATIONS
   osd_data->fade_data.user_data = &style_data;
   osd_data->fade_data.width = layout_width + pad_left + pad_right;
   osd_data->fade_data.height = layout_height + pad_top + pad_bottom;
+
+  /* the body is rendered once, then only blended in and out */
+  GhosdSurfaceCache & cache = osd_surface_cache;
+  bool cached = ( cache.surface != nullptr &&
+                  cache.markup_message == osd_data->markup_message &&
+                  cache.max_width == max_width &&
+                  cache.width == osd_data->fade_data.width &&
+                  cache.height == osd_data->fade_data.height &&
+                  aosd_style_equal( cache.text , cache.decoration ,
+                    osd_data->cfg_osd->text , osd_data->cfg_osd->decoration ) );
+
+  if ( cached )
+    osd_data->fade_data.surface = cairo_surface_reference( cache.surface );
+
   osd_data->fade_data.alpha = 0;
   osd_data->fade_data.deco_code = osd_data->cfg_osd->decoration.code;
   osd_data->dalpha_in = 1.0 / ( osd_data->cfg_osd->animation.timing_fadein / (float)AOSD_TIMING );
@@ -279,6 +350,22 @@ G_GNUC_END_IGNORE_DEPRECATIONS
 
   /* show the osd (with alpha 0, invisible) */
   ghosd_show( osd );
+
+  /* style_data goes out of scope; the body has been rendered by now */
+  osd_data->fade_data.user_data = nullptr;
+
+  if ( ! cached && osd_data->fade_data.surface != nullptr )
+  {
+    cache.clear();
+    cache.markup_message = osd_data->markup_message;
+    cache.text = osd_data->cfg_osd->text;
+    cache.decoration = osd_data->cfg_osd->decoration;
+    cache.max_width = max_width;
+    cache.width = osd_data->fade_data.width;
+    cache.height = osd_data->fade_data.height;
+    cache.surface = cairo_surface_reference( osd_data->fade_data.surface );
+  }
+
   return;
 }
 
@@ -451,6 +538,7 @@ aosd_osd_cleanup ( void )
   if ( osd != nullptr )
   {
     /* destroy Ghosd object */
+    osd_surface_cache.clear();
     ghosd_destroy( osd );
     osd = nullptr;
   }
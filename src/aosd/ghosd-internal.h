@@ -28,6 +28,13 @@ typedef struct {
   int set;
 } GhosdBackground;
 
+/* the pixmap each frame is drawn into, kept while the window keeps its size */
+typedef struct {
+  Pixmap pixmap;
+  cairo_surface_t *surf;
+  int width, height;
+} GhosdBacking;
+
 struct _Ghosd {
   Display *dpy;
   Window win;
@@ -41,6 +48,7 @@ struct _Ghosd {
   int x, y, width, height;
 
   GhosdBackground background;
+  GhosdBacking backing;
   RenderCallback render;
   EventButtonCallback eventbutton;
 };
@@ -95,67 +95,88 @@ take_snapshot(Ghosd *ghosd) {
   return pixmap;
 }
 
+static void
+free_backing(Ghosd *ghosd) {
+  if (ghosd->backing.surf)
+    cairo_surface_destroy(ghosd->backing.surf);
+  if (ghosd->backing.pixmap)
+    XFreePixmap(ghosd->dpy, ghosd->backing.pixmap);
+
+  ghosd->backing.surf = NULL;
+  ghosd->backing.pixmap = None;
+}
+
+/* A fade only changes how the rendered OSD is blended, so the pixmap and
+ * the cairo surface drawing into it are made once for all its frames. */
+static void
+make_backing(Ghosd *ghosd) {
+  XRenderPictFormat *xrformat;
+
+  if (ghosd->backing.pixmap &&
+      ghosd->backing.width == ghosd->width && ghosd->backing.height == ghosd->height)
+    return;
+
+  free_backing(ghosd);
+
+  if (ghosd->composite) {
+    ghosd->backing.pixmap = XCreatePixmap(ghosd->dpy, ghosd->win,
+      ghosd->width, ghosd->height, 32);
+    xrformat = XRenderFindVisualFormat(ghosd->dpy, ghosd->visual);
+    ghosd->backing.surf = cairo_xlib_surface_create_with_xrender_format(
+      ghosd->dpy, ghosd->backing.pixmap,
+      ScreenOfDisplay(ghosd->dpy, ghosd->screen_num),
+      xrformat, ghosd->width, ghosd->height);
+  } else {
+    ghosd->backing.pixmap = XCreatePixmap(ghosd->dpy, ghosd->win,
+      ghosd->width, ghosd->height,
+      DefaultDepth(ghosd->dpy, DefaultScreen(ghosd->dpy)));
+    xrformat = XRenderFindVisualFormat(ghosd->dpy,
+      DefaultVisual(ghosd->dpy, DefaultScreen(ghosd->dpy)));
+    ghosd->backing.surf = cairo_xlib_surface_create_with_xrender_format(
+      ghosd->dpy, ghosd->backing.pixmap,
+      ScreenOfDisplay(ghosd->dpy, DefaultScreen(ghosd->dpy)),
+      xrformat, ghosd->width, ghosd->height);
+  }
+
+  ghosd->backing.width = ghosd->width;
+  ghosd->backing.height = ghosd->height;
+}
+
 void
 ghosd_render(Ghosd *ghosd) {
   Pixmap pixmap;
   GC gc;
 
-  if (ghosd->composite)
-  {
-    pixmap = XCreatePixmap(ghosd->dpy, ghosd->win, ghosd->width, ghosd->height, 32);
-    gc = XCreateGC(ghosd->dpy, pixmap, 0, NULL);
+  make_backing(ghosd);
+  pixmap = ghosd->backing.pixmap;
+
+  /* cairo may hold drawing back; it has to be done before X draws too */
+  cairo_surface_flush(ghosd->backing.surf);
+
+  gc = XCreateGC(ghosd->dpy, pixmap, 0, NULL);
+  if ((!ghosd->composite) && ghosd->transparent) {
+    /* start from our own copy of the background. */
+    XCopyArea(ghosd->dpy, ghosd->background.pixmap, pixmap, gc,
+      0, 0, ghosd->width, ghosd->height, 0, 0);
+  } else {
     XFillRectangle(ghosd->dpy, pixmap, gc,
       0, 0, ghosd->width, ghosd->height);
   }
-  else
-  {
-    pixmap = XCreatePixmap(ghosd->dpy, ghosd->win, ghosd->width, ghosd->height,
-      DefaultDepth(ghosd->dpy, DefaultScreen(ghosd->dpy)));
-    gc = XCreateGC(ghosd->dpy, pixmap, 0, NULL);
-    if (ghosd->transparent) {
-      /* make our own copy of the background pixmap as the initial surface. */
-      XCopyArea(ghosd->dpy, ghosd->background.pixmap, pixmap, gc,
-        0, 0, ghosd->width, ghosd->height, 0, 0);
-    } else {
-      XFillRectangle(ghosd->dpy, pixmap, gc,
-        0, 0, ghosd->width, ghosd->height);
-    }
-  }
   XFreeGC(ghosd->dpy, gc);
 
+  cairo_surface_mark_dirty(ghosd->backing.surf);
+
   /* render with cairo. */
   if (ghosd->render.func) {
-    /* create cairo surface using the pixmap. */
-    XRenderPictFormat *xrformat;
-    cairo_surface_t *surf;
-    if (ghosd->composite) {
-      xrformat = XRenderFindVisualFormat(ghosd->dpy, ghosd->visual);
-      surf = cairo_xlib_surface_create_with_xrender_format(
-               ghosd->dpy, pixmap,
-               ScreenOfDisplay(ghosd->dpy, ghosd->screen_num),
-               xrformat, ghosd->width, ghosd->height);
-    } else {
-      xrformat = XRenderFindVisualFormat(ghosd->dpy,
-                   DefaultVisual(ghosd->dpy, DefaultScreen(ghosd->dpy)));
-      surf = cairo_xlib_surface_create_with_xrender_format(
-               ghosd->dpy, pixmap,
-               ScreenOfDisplay(ghosd->dpy, DefaultScreen(ghosd->dpy)),
-               xrformat, ghosd->width, ghosd->height);
-    }
-
-    /* draw some stuff. */
-    cairo_t *cr = cairo_create(surf);
+    cairo_t *cr = cairo_create(ghosd->backing.surf);
     ghosd->render.func(ghosd, cr, ghosd->render.data);
     cairo_destroy(cr);
-    cairo_surface_destroy(surf);
+    cairo_surface_flush(ghosd->backing.surf);
   }
 
-  /* point window at its new backing pixmap. */
+  /* point window at its new backing pixmap.  The server may have copied
+   * it before, so it is set again every frame. */
   XSetWindowBackgroundPixmap(ghosd->dpy, ghosd->win, pixmap);
-  /* I think it's ok to free it here because XCreatePixmap(3X11) says: "the X
-   * server frees the pixmap storage when there are no references to it".
-   */
-  XFreePixmap(ghosd->dpy, pixmap);
 
   /* and tell the window to redraw with this pixmap. */
   XClearWindow(ghosd->dpy, ghosd->win);
@@ -299,6 +320,9 @@ ghosd_set_position(Ghosd *ghosd, int x, int y, int width, int height) {
     y = dpy_height - height + y;
   }
 
+  if (width != ghosd->width || height != ghosd->height)
+    free_backing(ghosd);
+
   ghosd->x      = x;
   ghosd->y      = y;
   ghosd->width  = width;
@@ -439,6 +463,7 @@ ghosd_check_composite_mgr(void)
 
 void
 ghosd_destroy(Ghosd* ghosd) {
+  free_backing(ghosd);
   if (ghosd->background.set)
   {
     XFreePixmap(ghosd->dpy, ghosd->background.pixmap);
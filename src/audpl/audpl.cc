@@ -1,6 +1,7 @@
 /*
  * Audacious playlist format plugin
  * Copyright 2011-2016 John Lindgren
+ * Copyright 2024 Audacious Plugins Authors
  *
  * Redistribution and use in source and binary forms, with or without
  * modification, are permitted provided that the following conditions are met:
@@ -104,9 +105,11 @@ private:
                     return;
 
                 auto type = Tuple::field_get_type (field);
+                /* most values have nothing encoded; those are set as
+                 * they are, without a copy to decode into */
                 if (type == Tuple::String)
-                    tuple.set_str (field, (field == Tuple::AudioFile) ? value :
-                     str_decode_percent (value));
+                    tuple.set_str (field, (field == Tuple::AudioFile ||
+                     ! strchr (value, '%')) ? value : str_decode_percent (value));
                 else if (type == Tuple::Int)
                     tuple.set_int (field, atoi (value));
                 else if (type == Tuple::DateTime)
@@ -22,7 +22,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
-#include <libaudcore/ringbuf.h>
+#include <libaudcore/index.h>
 
 /**
  * Tools to detect perceived loudness.
@@ -77,49 +77,32 @@ struct Loudness
     }
 };
 
+/**
+ * Measures perceived loudness as the maximum of windowed RMS values over a
+ * range of window sizes. The window sums are kept as integers, so they
+ * cannot drift. They are stored as arrays, one entry per window size, so
+ * that the per-sample update is a single loop over the sizes without any
+ * branches.
+ */
 class PerceptiveRMS
 {
     static constexpr int STEPS = 24;
+    static constexpr int WINDOWS = STEPS + 1;
     static constexpr float INPUT_SCALE = 4e9f;
     static constexpr float OUTPUT_SCALE = 1.0f / INPUT_SCALE;
 
-    class WindowedRMS
-    {
-        uint64_t window_sum_ = 0;
-        int window_size_ = 0;
-        int latency_minus_one = 0;
-        float scale_ = 0.0;
-        float output_ = 0.0;
+    /*
+     * Squared input history, a power of two long so that a position is
+     * found with a mask.
+     */
+    Index<uint64_t> history_;
+    unsigned history_mask_ = 0;
+    unsigned position_ = 0;
 
-    public:
-
-        float add_and_take_and_get(uint64_t add, uint64_t take)
-        {
-            window_sum_ += add;
-            window_sum_ -= take;
-            const auto sum = static_cast<float>(window_sum_);
-            output_ = scale_ * sum;
-            return output_;
-        }
-
-        void configure(const Loudness::Metrics & metrics)
-        {
-            window_size_ = metrics.window_samples;
-            latency_minus_one = std::max(0, metrics.latency_samples - 1);
-            scale_ = metrics.weight * metrics.weight /
-                     static_cast<float>(window_size_);
-            window_sum_ = 0;
-            output_ = 0;
-        }
+    uint64_t window_sums_[WINDOWS] = {};
+    unsigned delays_[WINDOWS] = {};
+    float scales_[WINDOWS] = {};
 
-        [[nodiscard]] int delayed_sample_index() const
-        {
-            return latency_minus_one;
-        }
-    };
-
-    RingBuf<uint64_t> buffer_;
-    WindowedRMS rms_[STEPS + 1];
     int sample_rate_ = 0;
     int latency_ = 0;
     FastAttackSmoothRelease smooth_release_;
@@ -132,11 +115,29 @@ class PerceptiveRMS
         smooth_release_.set_samples(max_metrics.window_samples,
                                     max_metrics.window_samples);
 
-        for (int step = 0; step <= STEPS; step++)
+        for (int step = 0; step < WINDOWS; step++)
         {
-            rms_[step].configure(
-                Loudness::get_metrics(step, STEPS, sample_rate_));
+            const auto metrics = Loudness::get_metrics(step, STEPS, sample_rate_);
+            window_sums_[step] = 0;
+            scales_[step] = metrics.weight * metrics.weight /
+                            static_cast<float>(metrics.window_samples);
+            /*
+             * The widest window drops the oldest sample in the history, the
+             * others the sample at their own latency.
+             */
+            delays_[step] =
+                step ? std::max(0, metrics.latency_samples - 1) : latency_;
         }
+
+        unsigned size = 1;
+        while (size <= static_cast<unsigned>(latency_))
+        {
+            size *= 2;
+        }
+        history_.resize(size);
+        history_.erase(0, -1);
+        history_mask_ = size - 1;
+        position_ = 0;
     }
 
     [[nodiscard]] uint64_t static squared_value_to_internal_value(
@@ -155,9 +156,6 @@ public:
         }
         sample_rate_ = sample_rate;
         init_detection();
-        buffer_.discard();
-        buffer_.alloc(latency_);
-        buffer_.fill_with(0);
 
         for (int i = 0; i <= latency_; i++)
         {
@@ -171,21 +169,21 @@ public:
     {
         const uint64_t internal_value =
             squared_value_to_internal_value(squared_input);
-        const uint64_t oldest = buffer_.pop();
-        buffer_.push(internal_value);
+        const unsigned now = position_++;
+        uint64_t * history = history_.begin();
+        history[now & history_mask_] = internal_value;
 
-        float max = rms_[0].add_and_take_and_get(internal_value, oldest);
-        max = std::max(max, static_cast<float>(internal_value) * peak_weight_);
+        float max = static_cast<float>(internal_value) * peak_weight_;
 
-        for (int step = 1; step <= STEPS; step++)
+        for (int step = 0; step < WINDOWS; step++)
         {
-            WindowedRMS & rms = rms_[step];
-            const auto delayed_input =
-                buffer_.nth_from_last(rms.delayed_sample_index());
-            const auto step_value =
-                rms.add_and_take_and_get(internal_value, delayed_input);
-            max = std::max(max, step_value);
+            const uint64_t taken =
+                history[(now - delays_[step]) & history_mask_];
+            window_sums_[step] += internal_value - taken;
+            max = std::max(
+                max, scales_[step] * static_cast<float>(window_sums_[step]));
         }
+
         max *= OUTPUT_SCALE;
         return smooth_release_.get_envelope(max);
     }
@@ -43,9 +43,10 @@ class LoudnessFrameProcessor
     float maximum_amplification = 1;
     float perception_slow_balance = 0.3;
     float minimum_detection = 1e-6;
-    RingBuf<float> read_ahead_buffer;
     int channels_ = 0;
-    int processed_frames = 0;
+    Index<float> delayed_; /* input not yet output, interleaved */
+    Index<float> squares_;
+    Index<float> gains_;
 
     static float get_clamped_value(const char * variable, const double minimum,
                                    const double maximum)
@@ -63,6 +64,84 @@ class LoudnessFrameProcessor
         return powf(10.0f, 0.05f * decibels);
     }
 
+    /**
+     * Per frame: the mean of the squared samples plus the largest of them.
+     * Inlined with a constant channel count for mono and stereo.
+     */
+    static inline void measure_frames(const float * __restrict in,
+                                      float * __restrict squares,
+                                      const int frames, const int channels)
+    {
+        for (int frame = 0; frame < frames; frame++)
+        {
+            float square_sum = 0.0;
+            float square_max = 0.0;
+            for (int channel = 0; channel < channels; channel++)
+            {
+                const float sample = in[frame * channels + channel];
+                const float square = sample * sample;
+                square_max = std::max(square_max, square);
+                square_sum += square;
+            }
+            squares[frame] =
+                square_sum / static_cast<float>(channels) + square_max;
+        }
+    }
+
+    void measure(const float * in, float * squares, const int frames) const
+    {
+        if (channels_ == 1)
+        {
+            measure_frames(in, squares, frames, 1);
+        }
+        else if (channels_ == 2)
+        {
+            measure_frames(in, squares, frames, 2);
+        }
+        else
+        {
+            measure_frames(in, squares, frames, channels_);
+        }
+    }
+
+    float get_gain(const float square_sum)
+    {
+        const float perceived = FAST_VU_FUDGE_FACTOR *
+                                perceivedLoudness.get_mean_squared(square_sum);
+        const double weighted =
+            std::max(long_integration.integrate(square_sum), perceived);
+
+        const double rms = sqrt(weighted);
+
+        return target_level /
+               std::max(minimum_detection,
+                        static_cast<float>(release_integration.get_envelope(rms)));
+    }
+
+    void apply_gains(const float * __restrict in,
+                     const float * __restrict gains, float * __restrict out,
+                     const int frames) const
+    {
+        if (channels_ == 2)
+        {
+            for (int frame = 0; frame < frames; frame++)
+            {
+                out[2 * frame] = in[2 * frame] * gains[frame];
+                out[2 * frame + 1] = in[2 * frame + 1] * gains[frame];
+            }
+            return;
+        }
+
+        for (int frame = 0; frame < frames; frame++)
+        {
+            for (int channel = 0; channel < channels_; channel++)
+            {
+                out[frame * channels_ + channel] =
+                    in[frame * channels_ + channel] * gains[frame];
+            }
+        }
+    }
+
 public:
     [[nodiscard]] int latency() const { return perceivedLoudness.latency(); }
 
@@ -84,7 +163,7 @@ public:
     {
         update_config();
         channels_ = channels;
-        processed_frames = 0;
+        delayed_.resize(0);
         release_integration.set_seconds_for_rate(SHORT_INTEGRATION, rate, 0);
         long_integration.set_seconds_for_rate(LONG_INTEGRATION / 2.0, rate,
                                               slow_weight);
@@ -97,12 +176,6 @@ public:
          * must therefore half the integration time.
          */
         perceivedLoudness.set_rate_and_value(rate, target_level);
-        const int alloc_size = channels_ * latency();
-
-        if (read_ahead_buffer.size() < alloc_size)
-        {
-            read_ahead_buffer.alloc(alloc_size);
-        }
     }
 
     void update_config()
@@ -122,63 +195,45 @@ public:
         long_integration.set_scale(slow_weight);
     }
 
-    bool process_has_output(const Index<float> & frame_in,
-                            Index<float> & frame_out)
+    /**
+     * Processes a block of whole frames, appending those that are ready to
+     * output. Output trails input by the read-ahead latency, so the first
+     * frames after a start or flush produce nothing.
+     *
+     * Detection is a chain of recursive filters and has to run frame by
+     * frame, but it only needs one value per frame: the loudness measure and
+     * the gains are computed in separate passes over the block, so those
+     * loops stay free of the detection state.
+     */
+    void process_block(const Index<float> & in, Index<float> & out)
     {
-        bool has_output_data = processed_frames >= latency();
-        if (has_output_data)
-        {
-            read_ahead_buffer.move_out(frame_out.begin(), channels_);
-        }
-        else
-        {
-            processed_frames++;
-        }
-        read_ahead_buffer.copy_in(frame_in.begin(), channels_);
+        const int frames = in.len() / channels_;
+        const int held = delayed_.len() / channels_;
 
-        /*
-         * Following calculations need to happen to anticipate the (future)
-         * output.
-         */
+        squares_.resize(frames);
+        gains_.resize(frames);
+        measure(in.begin(), squares_.begin(), frames);
 
-        float square_sum = 0.0;
-        float square_max = 0.0;
-        for (const float sample : frame_in)
+        for (int frame = 0; frame < frames; frame++)
         {
-            const float square = sample * sample;
-            square_max = std::max(square_max, square);
-            square_sum += square;
+            gains_[frame] = get_gain(squares_[frame]);
         }
-        square_sum /= static_cast<float>(channels_);
-        square_sum += square_max;
-        const float perceived = FAST_VU_FUDGE_FACTOR *
-                                perceivedLoudness.get_mean_squared(square_sum);
-        const double weighted =
-            std::max(long_integration.integrate(square_sum), perceived);
 
-        const double rms = sqrt(weighted);
+        delayed_.insert(in.begin(), -1, frames * channels_);
 
-        const float gain =
-            target_level /
-            std::max(minimum_detection,
-                     static_cast<float>(release_integration.get_envelope(rms)));
+        /* delayed frame i takes the gain found latency() frames later */
+        const int ready = std::max(0, held + frames - latency());
+        const int first_gain = latency() - held;
 
-        if (has_output_data)
-        {
-            for (float & sample : frame_out)
-            {
-                sample *= gain;
-            }
-        }
+        const int start = out.len();
+        out.insert(-1, ready * channels_);
+        apply_gains(delayed_.begin(), gains_.begin() + first_gain,
+                    out.begin() + start, ready);
 
-        return has_output_data;
+        delayed_.remove(0, ready * channels_);
     }
 
-    void flush()
-    {
-        processed_frames = 0;
-        read_ahead_buffer.discard();
-    }
+    void flush() { delayed_.resize(0); }
 };
 
 #endif // AUDACIOUS_PLUGINS_BGM_LOUDNESS_FRAME_PROCESSOR_H
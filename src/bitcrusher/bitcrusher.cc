@@ -24,6 +24,8 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../trace-common/trace.h"
+
 static const char * const bitcrusher_defaults[] = {
  "depth", "32",
  "downsample", "1.0",
@@ -94,6 +96,7 @@ Bitcrusher::start (int & channels, int & rate)
 Index<float> &
 Bitcrusher::process (Index<float> & data)
 {
+    TRACE_SPAN ("Bitcrusher process");
     float downsample_ratio = aud_get_double ("bitcrusher", "downsample");
     float bit_depth = aud_get_double ("bitcrusher", "depth");
 
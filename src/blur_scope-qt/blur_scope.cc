@@ -2,6 +2,7 @@
  *  Blur Scope plugin for Audacious
  *  Copyright (C) 2010-2012 John Lindgren
  *  Copyright (C) 2019 William Pitcock
+ *  Copyright 2024 Audacious Plugins Authors
  *
  *  Based on BMP - Cross-platform multimedia player:
  *  Copyright (C) 2003-2004  BMP development team.
@@ -28,6 +29,12 @@
 #include <string.h>
 #include <glib.h>
 
+#include <utility>
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
 #include <QWidget>
 #include <QImage>
 #include <QPainter>
@@ -38,39 +45,60 @@
 #include <libaudcore/preferences.h>
 #include <libaudqt/colorbutton.h>
 
+#include "../ui-common/vis-frame-qt.h"
+
 static void /* QWidget */ * bscope_get_color_chooser ();
 
 static const PreferencesWidget bscope_widgets[] = {
     WidgetLabel (N_("<b>Color</b>")),
-    WidgetCustomQt (bscope_get_color_chooser)
+    WidgetCustomQt (bscope_get_color_chooser),
+    WidgetLabel (N_("<b>Performance</b>")),
+    WidgetCheck (N_("Draw at half resolution"),
+        WidgetBool ("BlurScope", "half_size"))
 };
 
 static const PluginPreferences bscope_prefs = {{bscope_widgets}};
 
 static const char * const bscope_defaults[] = {
  "color", aud::numeric_string<0xFF3F7F>::str,
+ "half_size", "FALSE",
  nullptr};
 
 static int bscope_color;
 
+/* The scope is drawn in paintEvent() rather than as each buffer comes in,
+ * so that nothing is done for buffers that never reach the screen.  The
+ * buffers since the last paint are kept, up to a few, and each still fades
+ * the image by one step, so that the trail is as long at any frame rate. */
 class BlurScopeWidget : public QWidget {
 public:
     BlurScopeWidget (QWidget * parent = nullptr);
     ~BlurScopeWidget ();
 
-    void resize (int w, int h);
-
     void clear ();
-    void blur ();
-    void draw_vert_line (int x, int y1, int y2);
+    void add_pcm (const float * pcm);
 
 protected:
     void resizeEvent (QResizeEvent *) override;
     void paintEvent (QPaintEvent *) override;
 
 private:
+    static constexpr int MAX_PENDING = 4;
+
+    void resize_image ();
+    void blur ();
+    void draw_pcm (const float * pcm);
+    void draw_vert_line (int x, int y1, int y2);
+
+    int m_scale = 1;
     int m_width = 0, m_height = 0, m_image_size = 0;
     uint32_t * m_image = nullptr, * m_corner = nullptr;
+    uint32_t * m_back = nullptr, * m_back_corner = nullptr;
+
+    float m_pcm[MAX_PENDING][512];
+    int m_pending = 0;
+
+    VisFrame m_frame {this};
 };
 
 static BlurScopeWidget *s_widget = nullptr;
@@ -78,61 +106,136 @@ static BlurScopeWidget *s_widget = nullptr;
 BlurScopeWidget::BlurScopeWidget (QWidget * parent) :
     QWidget (parent)
 {
-    resize (width (), height ());
+    setAttribute (Qt::WA_OpaquePaintEvent);
+    resize_image ();
 }
 
 BlurScopeWidget::~BlurScopeWidget ()
 {
     g_free(m_image);
+    g_free(m_back);
     m_image = nullptr;
+    m_back = nullptr;
     s_widget = nullptr;
 }
 
 void BlurScopeWidget::paintEvent (QPaintEvent *)
 {
-    QImage img((unsigned char *) m_image, m_width, m_height, QImage::Format_RGB32);
+    if ((aud_get_bool ("BlurScope", "half_size") ? 2 : 1) != m_scale)
+        resize_image ();
+
+    for (int i = 0; i < m_pending; i ++)
+    {
+        blur ();
+        draw_pcm (m_pcm[i]);
+    }
+
+    m_pending = 0;
+
+    QImage img((unsigned char *) m_corner, m_width, m_height, QImage::Format_RGB32);
     QPainter p (this);
 
-    p.drawImage (0, 0, img);
+    if (m_scale > 1)
+        p.drawImage (QRect (0, 0, m_width * m_scale, m_height * m_scale), img);
+    else
+        p.drawImage (0, 0, img);
 }
 
 void BlurScopeWidget::resizeEvent (QResizeEvent *)
 {
-    resize (width (), height ());
+    resize_image ();
 }
 
-void BlurScopeWidget::resize (int w, int h)
+/* There is a blank row above and below the image, and a pixel beyond each
+ * end of those, so that blur() needs no special case at the edges. */
+void BlurScopeWidget::resize_image ()
 {
-    m_width = w;
-    m_height = h;
-    m_image_size = (m_width << 2) * (m_height + 2);
-    m_image = (uint32_t *) g_realloc (m_image, m_image_size);
-    memset (m_image, 0, m_image_size);
+    m_scale = aud_get_bool ("BlurScope", "half_size") ? 2 : 1;
+    m_width = (width () + m_scale - 1) / m_scale;
+    m_height = (height () + m_scale - 1) / m_scale;
+    m_image_size = 4 * (m_width * (m_height + 2) + 2);
+
+    g_free (m_image);
+    g_free (m_back);
+    m_image = (uint32_t *) g_malloc0 (m_image_size);
+    m_back = (uint32_t *) g_malloc0 (m_image_size);
     m_corner = m_image + m_width + 1;
+    m_back_corner = m_back + m_width + 1;
 }
 
 void BlurScopeWidget::clear ()
 {
     memset (m_image, 0, m_image_size);
+    m_pending = 0;
     update ();
 }
 
+void BlurScopeWidget::add_pcm (const float * pcm)
+{
+    if (m_pending == MAX_PENDING)
+    {
+        memmove (m_pcm[0], m_pcm[1], sizeof m_pcm[0] * (MAX_PENDING - 1));
+        m_pending --;
+    }
+
+    memcpy (m_pcm[m_pending ++], pcm, sizeof m_pcm[0]);
+    m_frame.schedule ();
+}
+
+/* Each pixel becomes the average of the four around it, taken from the
+ * image before blurring, so the pixels can be done in any order, four at a
+ * time where there is SSE2.  The left and right neighbours at the ends of a
+ * row are on the rows beside it, as they always have been. */
 void BlurScopeWidget::blur ()
 {
-    for (int y = 0; y < m_height; y ++)
+    const uint32_t * src = m_corner;
+    uint32_t * dest = m_back_corner;
+    int stride = m_width;
+    int n = m_width * m_height;
+    int i = 0;
+
+#if defined(__SSE2__) || defined(__x86_64__)
+    const __m128i mask = _mm_set1_epi32 (0xFCFCFC);
+
+    for (; i + 4 <= n; i += 4)
     {
-        uint32_t * p = m_corner + m_width * y;
-        uint32_t * end = p + m_width;
-        uint32_t * plast = p - m_width;
-        uint32_t * pnext = p + m_width;
-
-        /* We do a quick and dirty average of four color values, first masking
-         * off the lowest two bits.  Over a large area, this masking has the net
-         * effect of subtracting 1.5 from each value, which by a happy chance
-         * is just right for a gradual fade effect. */
-        for (; p < end; p ++)
-            * p = ((* plast ++ & 0xFCFCFC) + (p[-1] & 0xFCFCFC) + (p[1] &
-             0xFCFCFC) + (* pnext ++ & 0xFCFCFC)) >> 2;
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (src + i - stride));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (src + i - 1));
+        __m128i c = _mm_loadu_si128 ((const __m128i *) (src + i + 1));
+        __m128i d = _mm_loadu_si128 ((const __m128i *) (src + i + stride));
+
+        __m128i sum = _mm_add_epi32 (_mm_add_epi32 (_mm_and_si128 (a, mask),
+         _mm_and_si128 (b, mask)), _mm_add_epi32 (_mm_and_si128 (c, mask),
+         _mm_and_si128 (d, mask)));
+
+        _mm_storeu_si128 ((__m128i *) (dest + i), _mm_srli_epi32 (sum, 2));
+    }
+#endif
+
+    /* We do a quick and dirty average of four color values, first masking
+     * off the lowest two bits.  Over a large area, this masking has the net
+     * effect of subtracting 1.5 from each value, which by a happy chance
+     * is just right for a gradual fade effect.  Since no channel carries
+     * into the next, the sum can be done on whole pixels. */
+    for (; i < n; i ++)
+        dest[i] = ((src[i - stride] & 0xFCFCFC) + (src[i - 1] & 0xFCFCFC) +
+         (src[i + 1] & 0xFCFCFC) + (src[i + stride] & 0xFCFCFC)) >> 2;
+
+    std::swap (m_image, m_back);
+    std::swap (m_corner, m_back_corner);
+}
+
+void BlurScopeWidget::draw_pcm (const float * pcm)
+{
+    int prev_y = (0.5 + pcm[0]) * m_height;
+    prev_y = aud::clamp (prev_y, 0, m_height - 1);
+
+    for (int i = 0; i < m_width; i ++)
+    {
+        int y = (0.5 + pcm[i * 512 / m_width]) * m_height;
+        y = aud::clamp (y, 0, m_height - 1);
+        draw_vert_line (i, prev_y, y);
+        prev_y = y;
     }
 }
 
@@ -196,24 +299,7 @@ void BlurScopeQt::clear ()
 void BlurScopeQt::render_mono_pcm (const float * pcm)
 {
     g_assert(s_widget);
-
-    s_widget->blur ();
-
-    int width = s_widget->width ();
-    int height = s_widget->height ();
-
-    int prev_y = (0.5 + pcm[0]) * height;
-    prev_y = aud::clamp (prev_y, 0, height - 1);
-
-    for (int i = 0; i < width; i ++)
-    {
-        int y = (0.5 + pcm[i * 512 / width]) * height;
-        y = aud::clamp (y, 0, height - 1);
-        s_widget->draw_vert_line (i, prev_y, y);
-        prev_y = y;
-    }
-
-    s_widget->update ();
+    s_widget->add_pcm (pcm);
 }
 
 void * BlurScopeQt::get_qt_widget ()
@@ -0,0 +1,169 @@
+/*
+ * Audacious bs2b effect plugin
+ * Copyright (C) 2009, Sebastian Pipping <sebastian@pipping.org>
+ * Copyright (C) 2009, Tony Vroon <chainsaw@gentoo.org>
+ * Copyright (C) 2010, John Lindgren <john.lindgren@tds.net>
+ * Copyright (C) 2011, Michał Lipski <tallica@o2.pl>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include <libaudcore/objects.h>
+
+#include "crossfeed.h"
+
+/* The filter state is checked for values too small to hear after every
+ * block; left alone, it decays into denormals during silence, which are
+ * many times slower to compute with on most CPUs. */
+#define BLOCK 64
+#define TINY 1e-20
+
+template<class T>
+void CrossfeedLanes<T>::clear ()
+{
+    for (int k = 0; k < 4; k ++)
+        in[k] = out[k] = 0;
+}
+
+template<class T>
+void CrossfeedLanes<T>::run (float * data, int frames)
+{
+    T x1[4], y[4];
+
+    for (int k = 0; k < 4; k ++)
+    {
+        x1[k] = in[k];
+        y[k] = out[k];
+    }
+
+    for (int i = 0; i < frames; i ++, data += 2)
+    {
+        T x[4] = {data[0], data[1], data[0], data[1]};
+
+        /* a1 is zero in the lowpass lanes */
+        for (int k = 0; k < 4; k ++)
+        {
+            y[k] = a0[k] * x[k] + a1[k] * x1[k] + b1[k] * y[k];
+            x1[k] = x[k];
+        }
+
+        /* the boost is there to even out the attenuation of the lows */
+        data[0] = aud::clamp ((y[2] + y[1]) * gain, (T) -1, (T) 1);
+        data[1] = aud::clamp ((y[3] + y[0]) * gain, (T) -1, (T) 1);
+    }
+
+    for (int k = 0; k < 4; k ++)
+    {
+        in[k] = x1[k];
+        out[k] = (fabs (y[k]) < (T) TINY) ? 0 : y[k];
+    }
+}
+
+template struct CrossfeedLanes<float>;
+template struct CrossfeedLanes<double>;
+
+template<class T>
+static void set_lanes (CrossfeedLanes<T> & lanes, double a0_lo, double b1_lo,
+ double a0_hi, double a1_hi, double b1_hi, double gain)
+{
+    for (int c = 0; c < 2; c ++)
+    {
+        lanes.a0[c] = a0_lo;
+        lanes.a1[c] = 0;
+        lanes.b1[c] = b1_lo;
+        lanes.a0[2 + c] = a0_hi;
+        lanes.a1[2 + c] = a1_hi;
+        lanes.b1[2 + c] = b1_hi;
+    }
+
+    lanes.gain = gain;
+}
+
+/* the arithmetic of libbs2b's init(), in double precision for both paths */
+void Crossfeed::update ()
+{
+    double level = m_feed / 10.0;
+
+    double gb_lo = level * -5.0 / 6.0 - 3.0;
+    double gb_hi = level / 6.0 - 3.0;
+
+    double g_lo = pow (10, gb_lo / 20.0);
+    double g_hi = 1.0 - pow (10, gb_hi / 20.0);
+    double fc_hi = m_fcut * pow (2.0, (gb_lo - 20.0 * log10 (g_hi)) / 12.0);
+
+    double x_lo = exp (-2.0 * M_PI * m_fcut / m_rate);
+    double x_hi = exp (-2.0 * M_PI * fc_hi / m_rate);
+
+    double a0_lo = g_lo * (1.0 - x_lo);
+    double a0_hi = 1.0 - g_hi * (1.0 - x_hi);
+    double gain = 1.0 / (1.0 - g_hi + g_lo);
+
+    set_lanes (m_single, a0_lo, x_lo, a0_hi, -x_hi, x_hi, gain);
+    set_lanes (m_dual, a0_lo, x_lo, a0_hi, -x_hi, x_hi, gain);
+}
+
+void Crossfeed::set_level (int feed, int fcut)
+{
+    /* out of range levels mean the default, as in libbs2b */
+    if (feed < BS2B_MINFEED || feed > BS2B_MAXFEED ||
+     fcut < BS2B_MINFCUT || fcut > BS2B_MAXFCUT)
+    {
+        feed = BS2B_DEFAULT_CLEVEL >> 16;
+        fcut = BS2B_DEFAULT_CLEVEL & 0xffff;
+    }
+
+    m_feed = feed;
+    m_fcut = fcut;
+    update ();
+}
+
+void Crossfeed::set_rate (int rate)
+{
+    if (rate < BS2B_MINSRATE || rate > BS2B_MAXSRATE)
+        rate = BS2B_DEFAULT_SRATE;
+
+    m_rate = rate;
+    update ();
+    clear ();
+}
+
+void Crossfeed::set_double (bool use_double)
+{
+    if (use_double != m_double)
+    {
+        m_double = use_double;
+        clear ();
+    }
+}
+
+void Crossfeed::clear ()
+{
+    m_single.clear ();
+    m_dual.clear ();
+}
+
+void Crossfeed::process (float * data, int frames)
+{
+    for (int done = 0; done < frames; done += BLOCK)
+    {
+        int block = aud::min (frames - done, BLOCK);
+
+        if (m_double)
+            m_dual.run (data + 2 * done, block);
+        else
+            m_single.run (data + 2 * done, block);
+    }
+}
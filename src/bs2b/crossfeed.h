@@ -0,0 +1,77 @@
+/*
+ * Audacious bs2b effect plugin
+ * Copyright (C) 2009, Sebastian Pipping <sebastian@pipping.org>
+ * Copyright (C) 2009, Tony Vroon <chainsaw@gentoo.org>
+ * Copyright (C) 2010, John Lindgren <john.lindgren@tds.net>
+ * Copyright (C) 2011, Michał Lipski <tallica@o2.pl>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUD_BS2B_CROSSFEED_H
+#define AUD_BS2B_CROSSFEED_H
+
+#include <stdint.h>
+
+/* the same limits and presets as libbs2b; a preset is (feed << 16) | fcut,
+ * with the feed level in tenths of a dB and the cut frequency in Hz */
+#define BS2B_MINFEED 10
+#define BS2B_MAXFEED 150
+#define BS2B_MINFCUT 300
+#define BS2B_MAXFCUT 2000
+#define BS2B_MINSRATE 2000
+#define BS2B_MAXSRATE 384000
+#define BS2B_DEFAULT_SRATE 44100
+
+#define BS2B_DEFAULT_CLEVEL ((uint32_t) 700 | ((uint32_t) 45 << 16))
+#define BS2B_CMOY_CLEVEL ((uint32_t) 700 | ((uint32_t) 60 << 16))
+#define BS2B_JMEIER_CLEVEL ((uint32_t) 650 | ((uint32_t) 95 << 16))
+
+/* Four first-order sections run side by side, one per lane: the lowpass of
+ * each channel, which is fed to the other side, and the high boost of each
+ * channel, which stays on its own side.  In single precision the lanes fill
+ * one vector register. */
+template<class T>
+struct CrossfeedLanes {
+    T a0[4], a1[4], b1[4];  /* lowpass L, R, high boost L, R */
+    T gain;
+    T in[4], out[4];        /* the previous frame */
+
+    void clear ();
+    void run (float * data, int frames);
+};
+
+/* Bauer stereophonic-to-binaural crossfeed, with the filters of libbs2b.
+ * The double precision path gives the same output as libbs2b. */
+class Crossfeed
+{
+public:
+    void set_level (int feed, int fcut);
+    void set_rate (int rate);
+    void set_double (bool use_double);
+
+    void clear ();
+    void process (float * data, int frames);  /* interleaved stereo */
+
+private:
+    void update ();
+
+    int m_feed = 45, m_fcut = 700, m_rate = BS2B_DEFAULT_SRATE;
+    bool m_double = false;
+
+    CrossfeedLanes<float> m_single;
+    CrossfeedLanes<double> m_dual;
+};
+
+#endif
@@ -19,13 +19,16 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
+
 #include <libaudcore/hook.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
-#include <bs2b.h>
+#include "crossfeed.h"
+#include "../trace-common/trace.h"
 
 class BS2BPlugin : public EffectPlugin
 {
@@ -44,7 +47,6 @@ public:
     constexpr BS2BPlugin () : EffectPlugin (info, 0, true) {}
 
     bool init () override;
-    void cleanup () override;
 
     void start (int & channels, int & rate) override;
     Index<float> & process (Index<float> & data) override;
@@ -52,56 +54,59 @@ public:
 
 EXPORT BS2BPlugin aud_plugin_instance;
 
-static t_bs2bdp bs2b = nullptr;
+/* only touched by the audio thread; the settings are read again there
+ * after they change */
+static Crossfeed bs2b;
 static int bs2b_channels;
+static std::atomic<bool> settings_changed;
 
 const char * const BS2BPlugin::defaults[] = {
  "feed", "45",
  "fcut", "700",
+ "double_precision", "FALSE",
  nullptr};
 
 bool BS2BPlugin::init ()
 {
     aud_config_set_defaults ("bs2b", defaults);
-    bs2b = bs2b_open ();
-
-    if (! bs2b)
-        return false;
-
-    bs2b_set_level_feed (bs2b, aud_get_int ("bs2b", "feed"));
-    bs2b_set_level_fcut (bs2b, aud_get_int ("bs2b", "fcut"));
-
+    settings_changed = true;
     return true;
 }
 
-void BS2BPlugin::cleanup ()
-{
-    bs2b_close (bs2b);
-    bs2b = nullptr;
-}
-
 void BS2BPlugin::start (int & channels, int & rate)
 {
     bs2b_channels = channels;
-    bs2b_set_srate (bs2b, rate);
+    bs2b.set_rate (rate);
 }
 
 Index<float> & BS2BPlugin::process (Index<float> & data)
 {
+    TRACE_SPAN ("BS2B process");
+    if (settings_changed.exchange (false))
+    {
+        bs2b.set_level (aud_get_int ("bs2b", "feed"), aud_get_int ("bs2b", "fcut"));
+        bs2b.set_double (aud_get_bool ("bs2b", "double_precision"));
+    }
+
     if (bs2b_channels == 2)
-        bs2b_cross_feed_f (bs2b, data.begin (), data.len () / 2);
+        bs2b.process (data.begin (), data.len () / 2);
 
     return data;
 }
 
 static void feed_value_changed ()
 {
-    bs2b_set_level_feed (bs2b, aud_get_int ("bs2b", "feed"));
+    settings_changed = true;
 }
 
 static void fcut_value_changed ()
 {
-    bs2b_set_level_fcut (bs2b, aud_get_int ("bs2b", "fcut"));
+    settings_changed = true;
+}
+
+static void precision_changed ()
+{
+    settings_changed = true;
 }
 
 static void set_preset (uint32_t preset)
@@ -111,9 +116,7 @@ static void set_preset (uint32_t preset)
 
     aud_set_int ("bs2b", "feed", feed);
     aud_set_int ("bs2b", "fcut", fcut);
-
-    bs2b_set_level_feed (bs2b, feed);
-    bs2b_set_level_fcut (bs2b, fcut);
+    settings_changed = true;
 
     hook_call ("bs2b preset loaded", nullptr);
 }
@@ -139,6 +142,8 @@ const PreferencesWidget BS2BPlugin::widgets[] = {
     WidgetSpin (N_("Cut frequency:"),
         WidgetInt ("bs2b", "fcut", fcut_value_changed, "bs2b preset loaded"),
         {BS2B_MINFCUT, BS2B_MAXFCUT, 1, N_("Hz")}),
+    WidgetCheck (N_("Double precision (slower, as libbs2b)"),
+        WidgetBool ("bs2b", "double_precision", precision_changed)),
     WidgetBox ({{preset_widgets}, true})
 };
 
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* prevent libcdio from redefining PACKAGE, VERSION, etc. */
 #define EXTERNAL_LIBCDIO_CONFIG_H
@@ -48,17 +49,23 @@
 #include <libaudcore/i18n.h>
 #include <libaudcore/interface.h>
 #include <libaudcore/mainloop.h>
+#include <libaudcore/multihash.h>
 #include <libaudcore/playlist.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 
+#include "../trace-common/trace.h"
+
 #define MIN_DISC_SPEED 2
 #define MAX_DISC_SPEED 24
 
 #define MAX_RETRIES 10
 #define MAX_SKIPS 10
 
+#define MIN_READ_AHEAD 1
+#define MAX_READ_AHEAD 600
+
 static const char * const cdaudio_schemes[] = {"cdda", nullptr};
 
 class CDAudio : public InputPlugin
@@ -110,6 +117,10 @@ static cdrom_drive_t *pcdrom_drive = nullptr;
 static Index<trackinfo_t> trackinfo;
 static QueuedFunc purge_func;
 
+/* the track info of the discs seen before, so that CD-Text and CDDB are not
+ * asked again when one is put in again */
+static SimpleHash<String, Index<trackinfo_t>> disc_cache;
+
 static bool scan_cd ();
 static bool refresh_trackinfo (bool warning);
 static void reset_trackinfo ();
@@ -125,6 +136,8 @@ const char CDAudio::about[] =
 
 const char * const CDAudio::defaults[] = {
  "disc_speed", "2",
+ "read_ahead", "10",
+ "read_ahead_track", "FALSE",
  "use_cdtext", "TRUE",
 #ifdef HAVE_LIBCDDB
  "use_cddb", "TRUE",
@@ -140,6 +153,11 @@ const PreferencesWidget CDAudio::widgets[] = {
     WidgetSpin (N_("Read speed:"),
         WidgetInt ("CDDA", "disc_speed"),
         {MIN_DISC_SPEED, MAX_DISC_SPEED, 1}),
+    WidgetSpin (N_("Read ahead:"),
+        WidgetInt ("CDDA", "read_ahead"),
+        {MIN_READ_AHEAD, MAX_READ_AHEAD, 1, N_("seconds")}),
+    WidgetCheck (N_("Read whole track ahead"),
+        WidgetBool ("CDDA", "read_ahead_track")),
     WidgetEntry (N_("Override device:"),
         WidgetString ("CDDA", "device")),
     WidgetLabel (N_("<b>Metadata</b>")),
@@ -241,6 +259,147 @@ bool CDAudio::is_our_file (const char * filename, VFSFile & file)
     return !strncmp (filename, "cdda://", 7);
 }
 
+/* Sectors are read ahead of playback by a thread of their own, as fast as
+ * the drive gives them, into a ring buffer that holds seconds or the whole
+ * track.  The drive so reads in long runs instead of a little at a time,
+ * and a slow read at a bad spot is covered by what was read before it.
+ * Once the buffer is full, it is drained to half before reading goes on,
+ * so that the drive is left to spin down in between. */
+struct ReadAhead
+{
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+    /* capacity sectors, count of which are buffered from first on */
+    Index<unsigned char> buffer;
+    int capacity = 0, first = 0, count = 0;
+
+    int batch = 0;              /* sectors read at once */
+    int readlsn = 0, endlsn = 0;
+    int generation = 0;         /* counts seeks outside the buffer */
+
+    bool resting = false;
+    bool failed = false;
+    bool stop = false;
+
+    void drop (int sectors)
+    {
+        first = (first + sectors) % capacity;
+        count -= sectors;
+    }
+};
+
+static void timed_wait (pthread_cond_t * cond, pthread_mutex_t * lock, int ms)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_REALTIME, & ts);
+
+    ts.tv_nsec += ms * 1000000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+
+    pthread_cond_timedwait (cond, lock, & ts);
+}
+
+static void * read_ahead_thread (void * data)
+{
+    ReadAhead & ra = * (ReadAhead *) data;
+
+    int sectors = ra.batch;
+    int retry_count = 0, skip_count = 0;
+    int generation = -1;
+
+    Index<unsigned char> buffer;
+    buffer.insert (0, 2352 * ra.batch);
+
+    pthread_mutex_lock (& ra.lock);
+
+    while (! ra.stop)
+    {
+        /* playback has gone somewhere else */
+        if (ra.generation != generation)
+        {
+            generation = ra.generation;
+            retry_count = 0;
+            skip_count = 0;
+        }
+
+        int room = ra.capacity - ra.count;
+
+        if (room < ra.batch)
+            ra.resting = true;
+        else if (room >= ra.capacity / 2)
+            ra.resting = false;
+
+        if (ra.failed || ra.resting || ra.readlsn > ra.endlsn)
+        {
+            pthread_cond_wait (& ra.cond, & ra.lock);
+            continue;
+        }
+
+        int readlsn = ra.readlsn;
+        int n = aud::min (aud::min (sectors, room), ra.endlsn + 1 - readlsn);
+
+        pthread_mutex_unlock (& ra.lock);
+
+        int ret = cdio_read_audio_sectors (pcdrom_drive->p_cdio,
+         buffer.begin (), readlsn, n);
+
+        pthread_mutex_lock (& ra.lock);
+
+        /* what was read is of no use after a seek */
+        if (ra.generation != generation)
+            continue;
+
+        if (ret == DRIVER_OP_SUCCESS)
+        {
+            for (int i = 0; i < n; i ++)
+            {
+                int pos = (ra.first + ra.count + i) % ra.capacity;
+                memcpy (& ra.buffer[2352 * pos], & buffer[2352 * i], 2352);
+            }
+
+            ra.count += n;
+            ra.readlsn += n;
+            retry_count = 0;
+            skip_count = 0;
+
+            pthread_cond_broadcast (& ra.cond);
+        }
+        else if (sectors > 16)
+        {
+            /* maybe a smaller read size will help */
+            sectors /= 2;
+        }
+        else if (retry_count < MAX_RETRIES)
+        {
+            /* still failed; retry a few times */
+            retry_count ++;
+        }
+        else if (skip_count < MAX_SKIPS)
+        {
+            /* maybe the disk is scratched; try skipping ahead, which can
+             * only be done with nothing buffered past the bad spot */
+            if (! ra.count)
+            {
+                ra.readlsn = aud::min (ra.readlsn + 75, ra.endlsn + 1);
+                skip_count ++;
+            }
+            else
+                pthread_cond_wait (& ra.cond, & ra.lock);
+        }
+        else
+        {
+            /* still failed; give it up */
+            ra.failed = true;
+            pthread_cond_broadcast (& ra.cond);
+        }
+    }
+
+    pthread_mutex_unlock (& ra.lock);
+    return nullptr;
+}
+
 /* play thread only */
 bool CDAudio::play (const char * name, VFSFile & file)
 {
@@ -281,65 +440,95 @@ bool CDAudio::play (const char * name, VFSFile & file)
     int buffer_size = aud_get_int ("output_buffer_size");
     int speed = aud_get_int ("CDDA", "disc_speed");
     speed = aud::clamp (speed, MIN_DISC_SPEED, MAX_DISC_SPEED);
-    int sectors = aud::clamp (buffer_size / 2, 50, 250) * speed * 75 / 1000;
-    int currlsn = startlsn;
-    int retry_count = 0, skip_count = 0;
 
-    Index<unsigned char> buffer;
-    buffer.insert (0, 2352 * sectors);
+    int capacity;
+    if (aud_get_bool ("CDDA", "read_ahead_track"))
+        capacity = endlsn + 1 - startlsn;
+    else
+        capacity = aud::clamp (aud_get_int ("CDDA", "read_ahead"),
+         MIN_READ_AHEAD, MAX_READ_AHEAD) * 75;
+
+    ReadAhead ra;
+    ra.batch = aud::clamp (buffer_size / 2, 50, 250) * speed * 75 / 1000;
+    ra.capacity = aud::max (capacity, 2 * ra.batch);
+    ra.buffer.insert (0, 2352 * ra.capacity);
+    ra.readlsn = startlsn;
+    ra.endlsn = endlsn;
+
+    /* the drive handle stays open while playing is set, so it may be used
+     * without the mutex */
+    pthread_mutex_unlock (& mutex);
+
+    pthread_t thread;
+    pthread_create (& thread, nullptr, read_ahead_thread, & ra);
+
+    pthread_mutex_lock (& ra.lock);
 
     while (! check_stop ())
     {
+        TRACE_SPAN ("Audio CD play");
+        /* the next sector to play, which is the oldest one in the buffer */
+        int currlsn = ra.readlsn - ra.count;
+
         int seek_time = check_seek ();
         if (seek_time >= 0)
-            currlsn = startlsn + (seek_time * 75 / 1000);
-
-        sectors = aud::min (sectors, endlsn + 1 - currlsn);
-        if (sectors < 1)
-            break;
+        {
+            int seeklsn = aud::min (startlsn + (seek_time * 75 / 1000), endlsn + 1);
 
-        /* unlock mutex here to avoid blocking
-         * other threads must be careful not to close drive handle */
-        pthread_mutex_unlock (& mutex);
+            if (seeklsn >= currlsn && seeklsn < currlsn + ra.count)
+            {
+                /* it's buffered already */
+                ra.drop (seeklsn - currlsn);
+            }
+            else
+            {
+                ra.first = ra.count = 0;
+                ra.readlsn = seeklsn;
+                ra.generation ++;
+                ra.failed = false;
+            }
 
-        int ret = cdio_read_audio_sectors (pcdrom_drive->p_cdio,
-         buffer.begin (), currlsn, sectors);
+            currlsn = seeklsn;
+            pthread_cond_broadcast (& ra.cond);
+        }
 
-        if (ret == DRIVER_OP_SUCCESS)
-            write_audio (buffer.begin (), 2352 * sectors);
+        if (! ra.count)
+        {
+            if (ra.failed)
+            {
+                cdaudio_error (_("Error reading audio CD."));
+                break;
+            }
 
-        pthread_mutex_lock (& mutex);
+            if (currlsn > endlsn)
+                break;
 
-        if (ret == DRIVER_OP_SUCCESS)
-        {
-            currlsn += sectors;
-            retry_count = 0;
-            skip_count = 0;
-        }
-        else if (sectors > 16)
-        {
-            /* maybe a smaller read size will help */
-            sectors /= 2;
-        }
-        else if (retry_count < MAX_RETRIES)
-        {
-            /* still failed; retry a few times */
-            retry_count ++;
-        }
-        else if (skip_count < MAX_SKIPS)
-        {
-            /* maybe the disk is scratched; try skipping ahead */
-            currlsn = aud::min (currlsn + 75, endlsn + 1);
-            skip_count ++;
-        }
-        else
-        {
-            /* still failed; give it up */
-            cdaudio_error (_("Error reading audio CD."));
-            break;
+            /* wait a while, then look for stop and seek again */
+            timed_wait (& ra.cond, & ra.lock, 50);
+            continue;
         }
+
+        /* the sectors stay in the buffer until they have been written */
+        int sectors = aud::min (ra.count, ra.capacity - ra.first);
+        sectors = aud::min (sectors, ra.batch);
+        unsigned char * data = & ra.buffer[2352 * ra.first];
+
+        pthread_mutex_unlock (& ra.lock);
+        write_audio (data, 2352 * sectors);
+        pthread_mutex_lock (& ra.lock);
+
+        ra.drop (sectors);
+        pthread_cond_broadcast (& ra.cond);
     }
 
+    ra.stop = true;
+    pthread_cond_broadcast (& ra.cond);
+    pthread_mutex_unlock (& ra.lock);
+
+    pthread_join (thread, nullptr);
+
+    pthread_mutex_lock (& mutex);
+
     playing = false;
 
     pthread_mutex_unlock (& mutex);
@@ -352,6 +541,7 @@ void CDAudio::cleanup ()
     pthread_mutex_lock (& mutex);
 
     reset_trackinfo ();
+    disc_cache.clear ();
     purge_func.stop ();
 
 #ifdef HAVE_LIBCDDB
@@ -488,6 +678,32 @@ static bool check_disc_mode (bool warning)
     return true;
 }
 
+/* mutex must be locked */
+static String get_disc_id ()
+{
+    /* the CDDB disc ID, with the length in sectors to tell apart discs whose
+     * IDs are the same, and the settings the info was looked up with */
+    unsigned sum = 0;
+    for (int trackno = firsttrackno; trackno <= lasttrackno; trackno ++)
+    {
+        for (int secs = cdio_get_track_lba (pcdrom_drive->p_cdio, trackno) / 75; secs; secs /= 10)
+            sum += secs % 10;
+    }
+
+    int first = cdio_get_track_lba (pcdrom_drive->p_cdio, firsttrackno);
+    int leadout = cdio_get_track_lba (pcdrom_drive->p_cdio, CDIO_CDROM_LEADOUT_TRACK);
+    unsigned id = ((sum % 0xff) << 24) | ((leadout / 75 - first / 75) << 8) |
+     (lasttrackno - firsttrackno + 1);
+
+    bool use_cddb = false;
+#ifdef HAVE_LIBCDDB
+    use_cddb = aud_get_bool ("CDDA", "use_cddb");
+#endif
+
+    return String (str_printf ("%08x-%d-%d%d", id, leadout,
+     (int) aud_get_bool ("CDDA", "use_cdtext"), (int) use_cddb));
+}
+
 /* mutex must be locked */
 static bool scan_cd ()
 {
@@ -546,6 +762,26 @@ static bool scan_cd ()
             n_audio_tracks++;
     }
 
+    String disc_id = get_disc_id ();
+    Index<trackinfo_t> * cached = disc_cache.lookup (disc_id);
+
+    if (cached && cached->len () == trackinfo.len ())
+    {
+        AUDDBG ("using cached track info for disc %s\n", (const char *) disc_id);
+
+        for (int trackno = 0; trackno <= lasttrackno; trackno ++)
+        {
+            trackinfo[trackno].performer = (* cached)[trackno].performer;
+            trackinfo[trackno].name = (* cached)[trackno].name;
+            trackinfo[trackno].genre = (* cached)[trackno].genre;
+        }
+
+        return true;
+    }
+
+    /* not kept if the lookup failed, so that it is tried again */
+    bool lookup_failed = false;
+
     /* get trackinfo[0] cdtext information (the disc) */
     cdtext_t *pcdtext = nullptr;
     if (aud_get_bool ("CDDA", "use_cdtext"))
@@ -620,7 +856,10 @@ static bool scan_cd ()
         {
             pcddb_conn = cddb_new ();
             if (pcddb_conn == nullptr)
+            {
                 cdaudio_error (_("Failed to create the CDDB connection."));
+                lookup_failed = true;
+            }
             else
             {
                 AUDDBG ("getting CDDB info\n");
@@ -694,6 +933,7 @@ static bool scan_cd ()
 
                     cddb_disc_destroy (pcddb_disc);
                     pcddb_disc = nullptr;
+                    lookup_failed = true;
                 }
                 else
                 {
@@ -717,6 +957,7 @@ static bool scan_cd ()
                                                            (pcddb_conn)));
                             cddb_disc_destroy (pcddb_disc);
                             pcddb_disc = nullptr;
+                            lookup_failed = true;
                         }
                         else
                         {
@@ -750,6 +991,17 @@ static bool scan_cd ()
 #endif /* HAVE_LIBCDDB */
     }
 
+    if (! lookup_failed)
+    {
+        Index<trackinfo_t> info;
+        info.insert (0, trackinfo.len ());
+
+        for (int trackno = 0; trackno < trackinfo.len (); trackno ++)
+            info[trackno] = trackinfo[trackno];
+
+        disc_cache.add (disc_id, std::move (info));
+    }
+
     return true;
 }
 
@@ -27,6 +27,9 @@
 #include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
+#include "../effect-common/lookahead-peak.h"
+#include "../trace-common/trace.h"
+
 /* Response time adjustments.  Maybe this should be adjustable? */
 #define CHUNK_TIME 0.2f /* seconds */
 #define CHUNKS 5
@@ -37,6 +40,8 @@
 static const char * const compressor_defaults[] = {
     "center", "0.5",
     "range", "0.5",
+    "lookahead_mode", "FALSE",
+    "lookahead", "10",
      nullptr
 };
 
@@ -47,7 +52,13 @@ static const PreferencesWidget compressor_widgets[] = {
         {0.1, 1, 0.1}),
     WidgetSpin (N_("Dynamic range:"),
         WidgetFloat ("compressor", "range"),
-        {0.0, 3.0, 0.1})
+        {0.0, 3.0, 0.1}),
+    WidgetCheck (N_("Look ahead (lower latency)"),
+        WidgetBool ("compressor", "lookahead_mode")),
+    WidgetSpin (N_("Lookahead:"),
+        WidgetInt ("compressor", "lookahead"),
+        {1, 100, 1, N_("ms")},
+        WIDGET_CHILD)
 };
 
 static const PluginPreferences compressor_prefs = {{compressor_widgets}};
@@ -91,6 +102,17 @@ static int chunk_size;
 static float current_peak;
 static int current_channels, current_rate;
 
+/* In lookahead mode, the gain for each frame is known before the frame itself
+ * is output, from the loudest frame within the lookahead; LookaheadPeak ramps
+ * the gain down over the lookahead, reaching its full value just as the loud
+ * frame comes out.  The latency is the lookahead alone. */
+
+static bool lookahead_mode;
+static int lookahead;          /* frames */
+static LookaheadPeak lookahead_peak;
+static float envelope, release;
+static RingBuf<float> delayed; /* frames not yet output */
+
 /* I used to find the maximum sample and take that as the peak, but that doesn't
  * work well on badly clipped tracks.  Now, I use the highly sophisticated
  * method of averaging the absolute value of the samples and multiplying by 6, a
@@ -140,18 +162,85 @@ void Compressor::start (int & channels, int & rate)
     current_channels = channels;
     current_rate = rate;
 
-    chunk_size = channels * (int) (rate * CHUNK_TIME);
+    lookahead_mode = aud_get_bool ("compressor", "lookahead_mode");
+
+    if (lookahead_mode)
+    {
+        int ms = aud::clamp (aud_get_int ("compressor", "lookahead"), 1, 100);
+        lookahead = aud::max (1, aud::rescale (ms, 1000, rate));
+
+        lookahead_peak.init (lookahead);
+        delayed.alloc (lookahead * channels);
+
+        /* decay as fast as the chunked mode does */
+        release = powf (1.0f - DECAY, 1.0f / (rate * CHUNK_TIME));
+
+        buffer.destroy ();
+        peaks.destroy ();
+    }
+    else
+    {
+        chunk_size = channels * (int) (rate * CHUNK_TIME);
 
-    buffer.alloc (chunk_size * CHUNKS);
-    peaks.alloc (CHUNKS);
+        buffer.alloc (chunk_size * CHUNKS);
+        peaks.alloc (CHUNKS);
+
+        delayed.destroy ();
+        lookahead_peak.clear ();
+    }
 
     flush (true);
 }
 
+static void process_lookahead (const float * data, int frames)
+{
+    float center = aud_get_double ("compressor", "center");
+    float range = aud_get_double ("compressor", "range");
+
+    int channels = current_channels;
+    float frame[AUD_MAX_CHANNELS];
+
+    int out = output.len ();
+    output.resize (out + frames * channels);
+
+    for (int f = 0; f < frames; f ++, data += channels)
+    {
+        float level = 0;
+        for (int c = 0; c < channels; c ++)
+            level = aud::max (level, fabsf (data[c]));
+
+        float average = lookahead_peak.push (level);
+        envelope = aud::max (average, envelope * release);
+
+        if (delayed.len () < delayed.size ())
+        {
+            delayed.copy_in (data, channels);
+            continue;
+        }
+
+        float gain = powf (aud::max (0.01f, envelope) / center, range - 1);
+
+        delayed.move_out (frame, channels);
+        delayed.copy_in (data, channels);
+
+        for (int c = 0; c < channels; c ++)
+            output[out ++] = frame[c] * gain;
+    }
+
+    output.resize (out);
+}
+
 Index<float> & Compressor::process (Index<float> & data)
 {
+    TRACE_SPAN ("Compressor process");
     output.resize (0);
 
+    if (lookahead_mode)
+    {
+        process_lookahead (data.begin (), data.len () / current_channels);
+        return output;
+    }
+
     int offset = 0;
     int remain = data.len ();
 
@@ -198,6 +287,11 @@ bool Compressor::flush (bool force)
     peaks.discard ();
 
     current_peak = 0.0f;
+
+    lookahead_peak.reset ();
+    envelope = 0.0f;
+    delayed.discard ();
+
     return true;
 }
 
@@ -205,6 +299,22 @@ Index<float> & Compressor::finish (Index<float> & data, bool end_of_playlist)
 {
     output.resize (0);
 
+    if (lookahead_mode)
+    {
+        process_lookahead (data.begin (), data.len () / current_channels);
+
+        /* whatever is left sees silence ahead of it; a whole lookahead of
+         * silence pushes every held frame out, even when the track was too
+         * short to fill the delay line */
+        Index<float> silence;
+        silence.resize (delayed.size ());
+        silence.erase (0, -1);
+        process_lookahead (silence.begin (), silence.len () / current_channels);
+
+        flush (true);
+        return output;
+    }
+
     peaks.discard ();
 
     while (buffer.len ())
@@ -227,5 +337,6 @@ Index<float> & Compressor::finish (Index<float> & data, bool end_of_playlist)
 
 int Compressor::adjust_delay (int delay)
 {
-    return delay + aud::rescale<int64_t> (buffer.len () / current_channels, current_rate, 1000);
+    int held = lookahead_mode ? delayed.len () : buffer.len ();
+    return delay + aud::rescale<int64_t> (held / current_channels, current_rate, 1000);
 }
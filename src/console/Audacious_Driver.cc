@@ -8,17 +8,38 @@
 
 #include <math.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include <libaudcore/audstrings.h>
+#include <libaudcore/multihash.h>
 #include <libaudcore/runtime.h>
 
 #include "configure.h"
 #include "plugin.h"
 #include "Music_Emu.h"
 #include "Gzip_Reader.h"
+#include "../trace-common/trace.h"
 
 static const int fade_threshold = 10 * 1000;
 static const int fade_length    = 8 * 1000;
 
+/* seconds of play between saved emulator states, which seeking goes on from */
+static const int snapshot_interval = 10;
+
+/* for finding the length of untimed tracks: the rate they are emulated at,
+ * how many calls of the play routine must go on as before to be a loop, the
+ * most seconds that are played, and the most threads for one file */
+static const int scan_rate = 11025;
+static const int scan_confirm_frames = 120;
+static const int scan_max_length = 10 * 60;
+static const int scan_max_threads = 8;
+
+/* most bytes of inflated files kept for loading them again */
+static const int64_t max_cached_image_bytes = 32 << 20;
+
 static bool log_err(blargg_err_t err)
 {
     if (err)
@@ -33,6 +54,69 @@ static void log_warning(Music_Emu * emu)
         AUDWARN("%s\n", str);
 }
 
+/* A whole file in memory, shared by the emulators loaded from it */
+using FileImage = std::shared_ptr<const Index<char>>;
+
+/* Inflated copies of the compressed files loaded last, so that playing
+ * the subtunes of a .vgz or .nsf.gz one after another, or playing a file
+ * just scanned, does not inflate it again.  A file is known by its path
+ * and compressed size; the least recently used ones go first. */
+struct CachedImage
+{
+    String path;
+    int64_t packed_size;
+    FileImage image;
+};
+
+static Index<CachedImage> s_images;  /* most recently used last */
+static int64_t s_image_bytes;
+static std::mutex s_images_mutex;
+
+static FileImage lookup_image(const String &path, int64_t packed_size)
+{
+    std::lock_guard<std::mutex> lock(s_images_mutex);
+
+    for (int i = 0; i < s_images.len(); i++)
+    {
+        if (s_images[i].path == path && s_images[i].packed_size == packed_size)
+        {
+            CachedImage hit = std::move(s_images[i]);
+            s_images.remove(i, 1);
+            s_images.append(std::move(hit));
+            return s_images[s_images.len() - 1].image;
+        }
+    }
+
+    return FileImage();
+}
+
+static void cache_image(const String &path, int64_t packed_size, const FileImage &image)
+{
+    if (packed_size < 0 || image->len() > max_cached_image_bytes / 2)
+        return;
+
+    std::lock_guard<std::mutex> lock(s_images_mutex);
+
+    for (int i = 0; i < s_images.len(); i++)
+    {
+        if (s_images[i].path == path)
+        {
+            s_image_bytes -= s_images[i].image->len();
+            s_images.remove(i, 1);
+            break;
+        }
+    }
+
+    while (s_images.len() && s_image_bytes + image->len() > max_cached_image_bytes)
+    {
+        s_image_bytes -= s_images[0].image->len();
+        s_images.remove(0, 1);
+    }
+
+    s_images.append(CachedImage{path, packed_size, image});
+    s_image_bytes += image->len();
+}
+
 /* Handles URL parsing, file opening and identification, and file
  * loading. Keeps file header around when loading rest of file to
  * avoid seeking and re-reading.
@@ -48,14 +132,21 @@ public:
     ConsoleFileHandler(const char* path, VFSFile &fd);
 
     // Creates emulator and returns 0. If this wasn't a music file or
-    // emulator couldn't be created, returns 1.
-    int load(int sample_rate);
+    // emulator couldn't be created, returns 1. If keep_data is set, the
+    // emulator is loaded from a copy of the whole file kept in m_data.
+    // Compressed files are always loaded that way, from the image cache
+    // if they are in it.  Info-only loads otherwise read just the parts
+    // of the file they need, inflating the rest without keeping it.
+    int load(int sample_rate, bool keep_data = false);
+
+    FileImage m_data;
 
     // Deletes owned emu and closes file
     ~ConsoleFileHandler();
 
 private:
     char m_header[4];
+    int64_t m_packed_size;
     Vfs_File_Reader vfs_in;
     Gzip_Reader gzip_in;
 };
@@ -65,6 +156,7 @@ ConsoleFileHandler::ConsoleFileHandler(const char *path, VFSFile &fd)
     m_emu   = nullptr;
     m_type  = 0;
     m_track = -1;
+    m_packed_size = fd.fsize();
 
     const char * sub;
     uri_parse (path, nullptr, nullptr, & sub, & m_track);
@@ -97,7 +189,7 @@ ConsoleFileHandler::~ConsoleFileHandler()
     gme_delete(m_emu);
 }
 
-int ConsoleFileHandler::load(int sample_rate)
+int ConsoleFileHandler::load(int sample_rate, bool keep_data)
 {
     if (!m_type)
         return 1;
@@ -111,7 +203,38 @@ int ConsoleFileHandler::load(int sample_rate)
 
     // combine header with remaining file data
     Remaining_Reader reader(m_header, sizeof(m_header), &gzip_in);
-    if (log_err(m_emu->load(reader)))
+    bool packed = gzip_in.deflated();
+    bool whole = keep_data || (packed && sample_rate != gme_info_only);
+
+    if (packed)
+        m_data = lookup_image(m_path, m_packed_size);
+
+    if (!m_data && whole)
+    {
+        long size = reader.remain();
+        if (size < 0)
+        {
+            log_err("Cannot find the size of the file.");
+            return 1;
+        }
+
+        auto image = std::make_shared<Index<char>>();
+        image->resize(size);
+        if (log_err(reader.read(image->begin(), image->len())))
+            return 1;
+
+        m_data = image;
+        if (packed)
+            cache_image(m_path, m_packed_size, m_data);
+    }
+
+    // the emulator may go on reading from m_data, which outlives it
+    if (m_data)
+    {
+        if (log_err(m_emu->load_mem(m_data->begin(), m_data->len())))
+            return 1;
+    }
+    else if (log_err(m_emu->load(reader)))
         return 1;
 
     // files can be closed now
@@ -142,6 +265,152 @@ int ConsoleFileHandler::load(int sample_rate)
     return 0;
 }
 
+/* The length found by emulating a track, in the form of track_info_t:
+ * either a length, where the track stopped, or an intro and a loop. */
+struct ScannedLength
+{
+    int length = -1, intro_length = -1, loop_length = -1;
+};
+
+struct ScanKey
+{
+    uint64_t value;
+
+    bool operator==(const ScanKey &b) const { return value == b.value; }
+    unsigned hash() const { return value ^ (value >> 32); }
+};
+
+static SimpleHash<String, ScannedLength> s_scanned;
+static std::mutex s_scanned_mutex;
+
+static bool lookup_scanned(const char *filename, track_info_t &info)
+{
+    std::lock_guard<std::mutex> lock(s_scanned_mutex);
+
+    ScannedLength *scanned = s_scanned.lookup(String(filename));
+    if (!scanned)
+        return false;
+
+    info.length = scanned->length;
+    info.intro_length = scanned->intro_length;
+    info.loop_length = scanned->loop_length;
+    return true;
+}
+
+/* Memory hashes at each call of the play routine, and the earlier call
+ * that the latest ones repeat, from match on. */
+struct LengthScan
+{
+    Index<uint64_t> hashes;
+    SimpleHash<ScanKey, int> first_frame;
+    int match = -1, match_at = -1;
+    int frames = 0;
+    bool unsupported = false;
+
+    bool found() const
+        { return match >= 0 && hashes.len() - match_at > scan_confirm_frames; }
+
+    static void add_frame(void *data, uint64_t hash);
+};
+
+void LengthScan::add_frame(void *data, uint64_t hash)
+{
+    auto scan = (LengthScan *)data;
+    int i = scan->hashes.len();
+    scan->frames++;
+
+    if (!hash)
+        scan->unsupported = true;
+    if (scan->unsupported || scan->found())
+        return;
+
+    scan->hashes.append(hash);
+
+    /* a match holds while each frame is as the one as far before it */
+    if (scan->match >= 0 && scan->hashes[scan->match + (i - scan->match_at)] != hash)
+        scan->match = -1;
+
+    if (scan->match < 0)
+    {
+        int *first = scan->first_frame.lookup({hash});
+        if (first)
+        {
+            scan->match = *first;
+            scan->match_at = i;
+        }
+        else
+            scan->first_frame.add({hash}, int(i));
+    }
+}
+
+/* Plays a track without sound, keeping a hash of the emulated memory at
+ * each call of its play routine.  Once the memory is as it was at an
+ * earlier call, and the calls after are too, the track is going round a
+ * loop; the track has stopped if the loop is short. */
+static ScannedLength scan_length(Music_Emu *emu, int track)
+{
+    ScannedLength result;
+
+    if (!emu->memory_hash())
+        return result;
+
+    emu->ignore_silence(true);
+    if (log_err(emu->start_track(track)))
+        return result;
+
+    emu->mute_voices(-1);
+
+    LengthScan scan;
+    emu->set_frame_func(LengthScan::add_frame, &scan);
+
+    Index<Music_Emu::sample_t> buf;
+    buf.resize(emu->sample_rate() / 10 * 2);
+
+    while (!scan.found() && !scan.unsupported && !emu->track_ended() &&
+           emu->tell() < scan_max_length * 1000)
+        emu->play(buf.len(), buf.begin());
+
+    emu->set_frame_func(nullptr);
+
+    if (scan.found())
+    {
+        /* the play routine is called at a steady rate */
+        auto frames_to_ms = [&](int frames)
+            { return (int)((int64_t)frames * emu->tell() / scan.frames); };
+
+        int intro = frames_to_ms(scan.match);
+        int loop = frames_to_ms(scan.match_at - scan.match);
+
+        if (loop < 1000)
+            result.length = intro;
+        else
+        {
+            result.intro_length = intro;
+            result.loop_length = loop;
+        }
+    }
+    else if (emu->track_ended())
+        result.length = emu->tell();
+
+    return result;
+}
+
+/* the length of an untimed track, found once per file and track */
+static void find_length(const char *filename, Music_Emu *emu, int track, track_info_t &info)
+{
+    if (info.length > 0 || info.loop_length > 0 || lookup_scanned(filename, info))
+        return;
+
+    ScannedLength scanned = scan_length(emu, track);
+
+    std::lock_guard<std::mutex> lock(s_scanned_mutex);
+    s_scanned.add(String(filename), ScannedLength(scanned));
+
+    info.length = scanned.length;
+    info.intro_length = scanned.intro_length;
+    info.loop_length = scanned.loop_length;
+}
+
 static int get_track_length(const track_info_t &info)
 {
     int length = info.length;
@@ -156,45 +425,221 @@ static int get_track_length(const track_info_t &info)
     return length;
 }
 
-bool ConsolePlugin::read_tag(const char *filename, VFSFile &file, Tuple &tuple, Index<char> *image)
+/* What the tuple of a track is made from, without the fixed-size buffers
+ * of track_info_t. */
+struct SubtuneInfo
 {
-    ConsoleFileHandler fh(filename, file);
-
-    if (!fh.m_type)
-        return false;
-
-    if (fh.load(gme_info_only))
-        return false;
+    String artist, album, title, copyright, codec, comment;
+    int length = -1;
+    int track_count = 0;
+};
 
-    track_info_t info;
-    if (log_err(fh.m_emu->track_info(&info, fh.m_track < 0 ? 0 : fh.m_track)))
-        return false;
+static SubtuneInfo get_subtune_info(const track_info_t &info)
+{
+    auto str = [](const char *s)
+        { return s[0] ? String(s) : String(); };
+
+    SubtuneInfo subtune;
+    subtune.artist = str(info.author);
+    subtune.album = str(info.game);
+    subtune.title = str(info.song);
+    subtune.copyright = str(info.copyright);
+    subtune.codec = str(info.system);
+    subtune.comment = str(info.comment);
+    subtune.length = get_track_length(info);
+    subtune.track_count = info.track_count;
+
+    return subtune;
+}
 
-    auto set_str = [&tuple](Tuple::Field f, const char *s)
-        { if (s[0]) tuple.set_str(f, s); };
+static void set_tuple(Tuple &tuple, const SubtuneInfo &info, int track)
+{
+    auto set_str = [&tuple](Tuple::Field f, const String &s)
+        { if (s) tuple.set_str(f, s); };
 
-    set_str(Tuple::Artist, info.author);
-    set_str(Tuple::Album, info.game);
-    set_str(Tuple::Title, info.song);
+    set_str(Tuple::Artist, info.artist);
+    set_str(Tuple::Album, info.album);
+    set_str(Tuple::Title, info.title);
     set_str(Tuple::Copyright, info.copyright);
-    set_str(Tuple::Codec, info.system);
+    set_str(Tuple::Codec, info.codec);
     set_str(Tuple::Comment, info.comment);
 
-    if (fh.m_track >= 0)
+    if (track >= 0)
     {
-        tuple.set_int(Tuple::Track, fh.m_track + 1);
-        tuple.set_int(Tuple::Subtune, fh.m_track + 1);
+        tuple.set_int(Tuple::Track, track + 1);
+        tuple.set_int(Tuple::Subtune, track + 1);
         tuple.set_int(Tuple::NumSubtunes, info.track_count);
     }
     else
         tuple.set_subtunes(info.track_count, nullptr);
 
-    tuple.set_int (Tuple::Length, get_track_length (info));
+    tuple.set_int (Tuple::Length, info.length);
     tuple.set_int (Tuple::Channels, 2);
+}
+
+/* The info of the subtunes of files read as a whole, so that each subtune
+ * is read without loading the file again.  A file is dropped once all its
+ * subtunes have been taken, or the whole cache if too many are waiting. */
+struct SubtuneCache
+{
+    Index<SubtuneInfo> subtunes;
+    int untaken;
+};
+
+static const int max_cached_files = 64;
+
+static SimpleHash<String, SubtuneCache> s_subtunes;
+static std::mutex s_subtunes_mutex;
+
+static void cache_subtunes(const String &path, Index<SubtuneInfo> &&subtunes)
+{
+    std::lock_guard<std::mutex> lock(s_subtunes_mutex);
+
+    if (s_subtunes.n_items() >= max_cached_files)
+        s_subtunes.clear();
+
+    int count = subtunes.len();
+    s_subtunes.add(path, {std::move(subtunes), count});
+}
+
+static bool take_subtune(const String &path, int track, SubtuneInfo &info)
+{
+    std::lock_guard<std::mutex> lock(s_subtunes_mutex);
+
+    SubtuneCache *cache = s_subtunes.lookup(path);
+    if (!cache || track >= cache->subtunes.len())
+        return false;
+
+    info = cache->subtunes[track];
+    if (!--cache->untaken)
+        s_subtunes.remove(path);
 
     return true;
 }
 
+/* Finds the length of the untimed subtunes of a file held in memory, taking
+ * the next one not yet started until there are none left. */
+static void scan_subtunes(gme_type_t type, const Index<char> &data, const String &path,
+ Index<SubtuneInfo> &subtunes, const Index<int> &untimed, std::atomic<int> &next)
+{
+    Music_Emu *emu = gme_new_emu(type, scan_rate);
+    if (!emu || log_err(emu->load_mem(data.begin(), data.len())))
+    {
+        gme_delete(emu);
+        return;
+    }
+
+    int i;
+    while ((i = next++) < untimed.len())
+    {
+        int track = untimed[i];
+        track_info_t info;
+
+        if (log_err(emu->track_info(&info, track)))
+            continue;
+
+        /* a file of one track is played without a subtune number */
+        StringBuf filename = (subtunes.len() > 1) ?
+         str_printf("%s?%d", (const char *)path, track + 1) : str_copy(path);
+
+        find_length(filename, emu, track, info);
+        subtunes[track].length = get_track_length(info);
+    }
+
+    gme_delete(emu);
+}
+
+/* Reads all the subtunes of a file at once; the untimed ones are played
+ * through on as many threads as there are processors, if so set. */
+static Index<SubtuneInfo> read_subtunes(ConsoleFileHandler &fh, int count, bool scan)
+{
+    Index<SubtuneInfo> subtunes;
+    Index<int> untimed;
+
+    for (int track = 0; track < count; track++)
+    {
+        track_info_t info;
+        if (log_err(fh.m_emu->track_info(&info, track)))
+            info = track_info_t();
+
+        subtunes.append(get_subtune_info(info));
+
+        if (scan && info.length <= 0 && info.loop_length <= 0)
+            untimed.append(track);
+    }
+
+    if (!untimed.len())
+        return subtunes;
+
+    int cpus = std::thread::hardware_concurrency();
+    int n_threads = aud::clamp(aud::min(cpus, untimed.len()), 1, scan_max_threads);
+
+    std::atomic<int> next(0);
+    std::thread threads[scan_max_threads];
+
+    for (int i = 1; i < n_threads; i++)
+        threads[i] = std::thread(scan_subtunes, fh.m_type, std::cref(*fh.m_data),
+         std::cref(fh.m_path), std::ref(subtunes), std::cref(untimed), std::ref(next));
+
+    scan_subtunes(fh.m_type, *fh.m_data, fh.m_path, subtunes, untimed, next);
+
+    for (int i = 1; i < n_threads; i++)
+        threads[i].join();
+
+    return subtunes;
+}
+
+bool ConsolePlugin::read_tag(const char *filename, VFSFile &file, Tuple &tuple, Index<char> *image)
+{
+    ConsoleFileHandler fh(filename, file);
+
+    if (!fh.m_type)
+        return false;
+
+    SubtuneInfo subtune;
+    if (fh.m_track >= 0 && take_subtune(fh.m_path, fh.m_track, subtune))
+    {
+        set_tuple(tuple, subtune, fh.m_track);
+        return true;
+    }
+
+    /* untimed tracks are played through to find their length; when the
+     * whole file is read, that is done for all its subtunes, from a copy
+     * of the file in memory */
+    bool scan = audcfg.scan_length;
+
+    if (fh.load((scan && fh.m_track >= 0) ? scan_rate : gme_info_only, scan && fh.m_track < 0))
+        return false;
+
+    if (fh.m_track < 0)
+    {
+        track_info_t info;
+        if (log_err(fh.m_emu->track_info(&info, 0)))
+            return false;
+
+        Index<SubtuneInfo> subtunes = read_subtunes(fh, info.track_count, scan);
+        if (!subtunes.len())
+            return false;
+
+        set_tuple(tuple, subtunes[0], -1);
+
+        if (info.track_count > 1)
+            cache_subtunes(fh.m_path, std::move(subtunes));
+
+        return true;
+    }
+
+    track_info_t info;
+    if (log_err(fh.m_emu->track_info(&info, fh.m_track)))
+        return false;
+
+    if (scan)
+        find_length(filename, fh.m_emu, fh.m_track, info);
+
+    set_tuple(tuple, get_subtune_info(info), fh.m_track);
+    return true;
+}
+
 bool ConsolePlugin::play(const char *filename, VFSFile &file)
 {
     int length, sample_rate;
@@ -246,11 +691,15 @@ bool ConsolePlugin::play(const char *filename, VFSFile &file)
     {
         if (fh.m_type == gme_spc_type && audcfg.ignore_spc_length)
             info.length = -1;
+        else if (info.length <= 0 && info.loop_length <= 0)
+            lookup_scanned(filename, info);
 
         length = get_track_length(info);
         set_stream_bitrate(fh.m_emu->voice_count() * 1000);
     }
 
+    fh.m_emu->set_snapshot_interval(snapshot_interval);
+
     // start track
     if (log_err(fh.m_emu->start_track(fh.m_track)))
         return false;
@@ -266,20 +715,23 @@ bool ConsolePlugin::play(const char *filename, VFSFile &file)
         length -= fade_length / 2;
     fh.m_emu->set_fade(length, fade_length);
 
+    // one block of stereo samples, rendered and written at a time
+    int block_length = aud::clamp(audcfg.block_length, 10, 500);
+    Index<Music_Emu::sample_t> buf;
+    buf.resize(sample_rate * block_length / 1000 * 2);
+
     while (!check_stop())
     {
+        TRACE_SPAN("Game Console play");
         /* Perform seek, if requested */
         int seek_value = check_seek();
         if (seek_value >= 0)
             fh.m_emu->seek(seek_value);
 
         /* Fill and play buffer of audio */
-        int const buf_size = 1024;
-        Music_Emu::sample_t buf[buf_size];
-
-        fh.m_emu->play(buf_size, buf);
+        fh.m_emu->play(buf.len(), buf.begin());
 
-        write_audio(buf, sizeof(buf));
+        write_audio(buf.begin(), buf.len() * sizeof buf[0]);
 
         if (fh.m_emu->track_ended())
             break;
@@ -88,6 +88,10 @@ blargg_err_t Classic_Emu::setup_buffer( long rate )
 	return 0;
 }
 
+blargg_err_t Classic_Emu::save_buffer( Emu_State& out ) const { return buf->save_state( out ); }
+
+void Classic_Emu::load_buffer( Emu_State& in ) { buf->load_state( in ); }
+
 blargg_err_t Classic_Emu::start_track_( int track )
 {
 	RETURN_ERR( Music_Emu::start_track_( track ) );
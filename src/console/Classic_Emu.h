@@ -21,6 +21,10 @@ protected:
 	long clock_rate() const { return clock_rate_; }
 	void change_clock_rate( long ); // experimental
 
+	// For save_state_(): samples in buffer not yet played
+	blargg_err_t save_buffer( Emu_State& ) const;
+	void load_buffer( Emu_State& );
+
 	// Overridable
 	virtual void set_voice( int index, Blip_Buffer* center,
 			Blip_Buffer* left, Blip_Buffer* right ) = 0;
@@ -118,8 +122,10 @@ public:
 	#define GME_APU_HOOK( emu, addr, data ) ((void) 0)
 #endif
 
+// Called where the play routine is called. The default passes the memory hash to
+// the frame function of Music_Emu, if one is set.
 #ifndef GME_FRAME_HOOK
-	#define GME_FRAME_HOOK( emu ) ((void) 0)
+	#define GME_FRAME_HOOK( emu ) ((emu)->frame_hook())
 #else
 	#define GME_FRAME_HOOK_DEFINED 1
 #endif
@@ -127,6 +127,18 @@ blargg_err_t Remaining_Reader::read( void* out, long count )
 	return in->read( (char*) out + first, second );
 }
 
+blargg_err_t Remaining_Reader::skip( long count )
+{
+	long first = header_end - header;
+	if ( first > count )
+		first = count;
+	header += first;
+	count -= first;
+	if ( !count )
+		return 0;
+	return in->skip( count );
+}
+
 // Mem_File_Reader
 
 Mem_File_Reader::Mem_File_Reader( const void* p, long s ) :
@@ -2,6 +2,7 @@
 
 #include "Effects_Buffer.h"
 
+#include "Music_Emu.h"
 #include <string.h>
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
@@ -107,6 +108,30 @@ void Effects_Buffer::bass_freq( int freq )
 		bufs [i].bass_freq( freq );
 }
 
+blargg_err_t Effects_Buffer::save_state( Emu_State& out ) const
+{
+	for ( int i = 0; i < buf_count; i++ )
+		RETURN_ERR( save_blip_state( out, bufs [i] ) );
+	RETURN_ERR( out.save( stereo_remain ) );
+	RETURN_ERR( out.save( effect_remain ) );
+	RETURN_ERR( out.save( echo_buf.begin(), echo_buf.size() * sizeof echo_buf [0] ) );
+	RETURN_ERR( out.save( reverb_buf.begin(), reverb_buf.size() * sizeof reverb_buf [0] ) );
+	RETURN_ERR( out.save( echo_pos ) );
+	return out.save( reverb_pos );
+}
+
+void Effects_Buffer::load_state( Emu_State& in )
+{
+	for ( int i = 0; i < buf_count; i++ )
+		load_blip_state( in, bufs [i] );
+	in.load( stereo_remain );
+	in.load( effect_remain );
+	in.load( echo_buf.begin(), echo_buf.size() * sizeof echo_buf [0] );
+	in.load( reverb_buf.begin(), reverb_buf.size() * sizeof reverb_buf [0] );
+	in.load( echo_pos );
+	in.load( reverb_pos );
+}
+
 void Effects_Buffer::clear()
 {
 	stereo_remain = 0;
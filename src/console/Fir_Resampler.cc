@@ -52,6 +52,8 @@ static void gen_sinc( double rolloff, int width, double offset, double spacing,
 	}
 }
 
+bool Fir_Resampler_::use_sse2 = true;
+
 Fir_Resampler_::Fir_Resampler_( int width, sample_t* impulses_ ) :
 	width_( width ),
 	write_offset( width * stereo - stereo ),
@@ -236,6 +236,30 @@ blargg_err_t Gbs_Emu::start_track_( int track )
 	return 0;
 }
 
+blargg_err_t Gbs_Emu::save_state_( Emu_State& out )
+{
+	RETURN_ERR( save_buffer( out ) );
+	RETURN_ERR( out.save( static_cast<Gb_Cpu const&> (*this) ) );
+	RETURN_ERR( out.save( cpu_time ) );
+	RETURN_ERR( out.save( play_period ) );
+	RETURN_ERR( out.save( next_play ) );
+	RETURN_ERR( out.save( ram ) );
+	return out.save( apu );
+}
+
+void Gbs_Emu::load_state_( Emu_State& in )
+{
+	load_buffer( in );
+	in.load( static_cast<Gb_Cpu&> (*this) );
+	in.load( cpu_time );
+	in.load( play_period );
+	in.load( next_play );
+	in.load( ram );
+	in.load( apu );
+}
+
+uint64_t Gbs_Emu::memory_hash_() const { return hash_memory( ram, sizeof ram ); }
+
 blargg_err_t Gbs_Emu::run_clocks( blip_time_t& duration, int )
 {
 	cpu_time = 0;
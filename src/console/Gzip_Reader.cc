@@ -106,3 +106,18 @@ long Gzip_Reader::read_avail( void* out, long count )
 		count = -1;
 	return count;
 }
+
+// Inflates what is skipped in large blocks, keeping none of it
+blargg_err_t Gzip_Reader::skip( long count )
+{
+	char buf [16 * 1024L];
+	while ( count )
+	{
+		long n = sizeof buf;
+		if ( n > count )
+			n = count;
+		RETURN_ERR( read( buf, n ) );
+		count -= n;
+	}
+	return 0;
+}
@@ -12,12 +12,16 @@ public:
 	error_t open( File_Reader* );
 	void close();
 
+	// True if the file is gzipped
+	bool deflated() const { return inflater.deflated(); }
+
 public:
 	Gzip_Reader();
 	~Gzip_Reader();
 	long remain() const;
 	error_t read( void*, long );
 	long read_avail( void*, long );
+	error_t skip( long );
 private:
 	File_Reader* in;
 	long tell_;
@@ -2,6 +2,9 @@
 
 #include "Multi_Buffer.h"
 
+#include "Music_Emu.h"
+#include <string.h>
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -28,6 +31,26 @@ Multi_Buffer::Multi_Buffer( int spf ) : samples_per_frame_( spf )
 
 blargg_err_t Multi_Buffer::set_channel_count( int ) { return 0; }
 
+blargg_err_t Multi_Buffer::save_state( Emu_State& ) const { return "Can't save buffer state"; }
+
+blargg_err_t save_blip_state( Emu_State& out, Blip_Buffer const& b )
+{
+	RETURN_ERR( out.save( b.offset_ ) );
+	RETURN_ERR( out.save( b.reader_accum_ ) );
+	return out.save( b.buffer_, (b.samples_avail() + blip_buffer_extra_) * sizeof *b.buffer_ );
+}
+
+void load_blip_state( Emu_State& in, Blip_Buffer& b )
+{
+	in.load( b.offset_ );
+	in.load( b.reader_accum_ );
+
+	// rest of buffer is always kept clear
+	long count = b.samples_avail() + blip_buffer_extra_;
+	in.load( b.buffer_, count * sizeof *b.buffer_ );
+	memset( b.buffer_ + count, 0, (b.buffer_size_ - b.samples_avail()) * sizeof *b.buffer_ );
+}
+
 // Silent_Buffer
 
 Silent_Buffer::Silent_Buffer() : Multi_Buffer( 1 ) // 0 channels would probably confuse
@@ -55,6 +78,10 @@ blargg_err_t Mono_Buffer::set_sample_rate( long rate, int msec )
 	return Multi_Buffer::set_sample_rate( buf.sample_rate(), buf.length() );
 }
 
+blargg_err_t Mono_Buffer::save_state( Emu_State& out ) const { return save_blip_state( out, buf ); }
+
+void Mono_Buffer::load_state( Emu_State& in ) { load_blip_state( in, buf ); }
+
 // Stereo_Buffer
 
 Stereo_Buffer::Stereo_Buffer() : Multi_Buffer( 2 )
@@ -73,6 +100,22 @@ blargg_err_t Stereo_Buffer::set_sample_rate( long rate, int msec )
 	return Multi_Buffer::set_sample_rate( bufs [0].sample_rate(), bufs [0].length() );
 }
 
+blargg_err_t Stereo_Buffer::save_state( Emu_State& out ) const
+{
+	for ( int i = 0; i < buf_count; i++ )
+		RETURN_ERR( save_blip_state( out, bufs [i] ) );
+	RETURN_ERR( out.save( stereo_added ) );
+	return out.save( was_stereo );
+}
+
+void Stereo_Buffer::load_state( Emu_State& in )
+{
+	for ( int i = 0; i < buf_count; i++ )
+		load_blip_state( in, bufs [i] );
+	in.load( stereo_added );
+	in.load( was_stereo );
+}
+
 void Stereo_Buffer::clock_rate( long rate )
 {
 	for ( int i = 0; i < buf_count; i++ )
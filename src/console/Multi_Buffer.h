@@ -7,6 +7,8 @@
 #include "blargg_common.h"
 #include "Blip_Buffer.h"
 
+class Emu_State;
+
 // Interface to one or more Blip_Buffers mapped to one or more channels
 // consisting of left, center, and right buffers.
 class Multi_Buffer {
@@ -51,6 +53,11 @@ public:
 	virtual long read_samples( blip_sample_t*, long ) = 0;
 	virtual long samples_avail() const = 0;
 
+	// Save samples not yet read, or load them back into the same buffer, for
+	// Music_Emu snapshots. Saving fails by default.
+	virtual blargg_err_t save_state( Emu_State& ) const;
+	virtual void load_state( Emu_State& ) { }
+
 protected:
 	void channels_changed() { channels_changed_count_++; }
 private:
@@ -83,6 +90,8 @@ public:
 	long read_samples( blip_sample_t* p, long s ) { return buf.read_samples( p, s ); }
 	channel_t channel( int, int ) { return chan; }
 	void end_frame( blip_time_t t ) { buf.end_frame( t ); }
+	blargg_err_t save_state( Emu_State& ) const;
+	void load_state( Emu_State& );
 };
 
 // Uses three buffers (one for center) and outputs stereo sample pairs.
@@ -106,6 +115,8 @@ public:
 
 	long samples_avail() const { return bufs [0].samples_avail() * 2; }
 	long read_samples( blip_sample_t*, long );
+	blargg_err_t save_state( Emu_State& ) const;
+	void load_state( Emu_State& );
 
 private:
 	enum { buf_count = 3 };
@@ -132,8 +143,14 @@ public:
 	void end_frame( blip_time_t ) { }
 	long samples_avail() const { return 0; }
 	long read_samples( blip_sample_t*, long ) { return 0; }
+	blargg_err_t save_state( Emu_State& ) const { return 0; }
 };
 
+// Blip_Buffer state for Multi_Buffer::save_state(): its time, bass filter and the
+// samples not yet read, with the tails of the impulses beyond them
+blargg_err_t save_blip_state( Emu_State&, Blip_Buffer const& );
+void load_blip_state( Emu_State&, Blip_Buffer& );
+
 
 inline blargg_err_t Multi_Buffer::set_sample_rate( long rate, int msec )
 {
@@ -45,6 +45,8 @@ void Music_Emu::unload()
 {
 	voice_count_ = 0;
 	clear_track_vars();
+	clear_snapshots();
+	snapshot_track = -1;
 	Gme_File::unload();
 }
 
@@ -69,10 +71,19 @@ Music_Emu::Music_Emu()
 		"Voice 5", "Voice 6", "Voice 7", "Voice 8"
 	};
 	set_voice_names( names );
+
+	snapshot_count    = 0;
+	snapshot_interval = 0;
+	frame_func        = 0;
+	frame_data        = 0;
 	Music_Emu::unload(); // non-virtual
 }
 
-Music_Emu::~Music_Emu() { delete effects_buffer; }
+Music_Emu::~Music_Emu()
+{
+	clear_snapshots();
+	delete effects_buffer;
+}
 
 blargg_err_t Music_Emu::set_sample_rate( long rate )
 {
@@ -93,6 +104,7 @@ void Music_Emu::set_equalizer( equalizer_t const& eq )
 {
 	equalizer_ = eq;
 	set_equalizer_( eq );
+	clear_snapshots();
 }
 
 void Music_Emu::mute_voice( int index, bool mute )
@@ -121,6 +133,7 @@ void Music_Emu::set_tempo( double t )
 	if ( t > max ) t = max;
 	tempo_ = t;
 	set_tempo_( t );
+	clear_snapshots();
 }
 
 void Music_Emu::post_load_()
@@ -133,6 +146,11 @@ blargg_err_t Music_Emu::start_track( int track )
 {
 	clear_track_vars();
 
+	// snapshots of the same track stay good when it is started again
+	if ( track != snapshot_track )
+		clear_snapshots();
+	snapshot_track = track;
+
 	int remapped = track;
 	RETURN_ERR( remap_track_( &remapped ) );
 	current_track_ = track;
@@ -187,8 +205,23 @@ long Music_Emu::tell() const
 blargg_err_t Music_Emu::seek( long msec )
 {
 	blargg_long time = msec_to_samples( msec );
-	if ( time < out_time )
+
+	// go on from last snapshot before time, unless current position is closer
+	snapshot_t* s = 0;
+	for ( int i = snapshot_count; i--; )
+	{
+		if ( snapshots [i]->time <= time )
+		{
+			s = snapshots [i];
+			break;
+		}
+	}
+
+	if ( s && (time < out_time || s->time > out_time) )
+		load_snapshot( *s );
+	else if ( time < out_time )
 		RETURN_ERR( start_track( current_track_ ) );
+
 	return skip( time - out_time );
 }
 
@@ -249,6 +282,110 @@ blargg_err_t Music_Emu::skip_( long count )
 	return 0;
 }
 
+// Snapshots
+
+blargg_err_t Emu_State::save( void const* in, long size )
+{
+	RETURN_ERR( data.resize( size_ + size ) );
+	memcpy( &data [size_], in, size );
+	size_ += size;
+	return 0;
+}
+
+void Emu_State::load( void* out, long size )
+{
+	assert( pos + size <= size_ );
+	memcpy( out, &data [pos], size );
+	pos += size;
+}
+
+blargg_err_t Music_Emu::save_state_( Emu_State& ) { return "Can't save emulator state"; }
+
+void Music_Emu::set_frame_func( frame_func_t func, void* data )
+{
+	frame_func = func;
+	frame_data = data;
+}
+
+void Music_Emu::set_snapshot_interval( int sec )
+{
+	snapshot_interval = sec;
+	clear_snapshots();
+}
+
+void Music_Emu::clear_snapshots()
+{
+	while ( snapshot_count )
+		delete snapshots [--snapshot_count];
+
+	snapshot_period = snapshot_interval * sample_rate() * stereo;
+}
+
+void Music_Emu::take_snapshot()
+{
+	if ( snapshot_count == max_snapshots )
+	{
+		// keep every other one, and take them further apart from now on
+		int n = 0;
+		for ( int i = 0; i < snapshot_count; i++ )
+		{
+			if ( i & 1 )
+				delete snapshots [i];
+			else
+				snapshots [n++] = snapshots [i];
+		}
+		snapshot_count = n;
+		snapshot_period *= 2;
+	}
+
+	snapshot_t* s = BLARGG_NEW snapshot_t;
+	if ( !s || save_state_( s->state ) )
+	{
+		// emulator can't save state, or out of memory
+		delete s;
+		snapshot_period = 0;
+		return;
+	}
+
+	s->time = out_time + s->state.ahead;
+	snapshots [snapshot_count++] = s;
+}
+
+void Music_Emu::load_snapshot( snapshot_t& s )
+{
+	s.state.pos = 0;
+	load_state_( s.state );
+	remute_voices();
+
+	out_time         = s.time;
+	emu_time         = s.time;
+	emu_track_ended_ = false;
+	track_ended_     = false;
+	silence_time     = s.time;
+	silence_count    = 0;
+	buf_remain       = 0;
+}
+
+// 64-bit FNV-1a over whole words, folded so that high bits reach the low ones
+uint64_t Music_Emu::hash_memory( void const* in, long size, uint64_t hash )
+{
+	uint64_t const prime = 0x100000001B3ull;
+	unsigned char const* p = (unsigned char const*) in;
+
+	for ( ; size >= 8; size -= 8, p += 8 )
+	{
+		uint64_t word;
+		memcpy( &word, p, 8 );
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 32;
+	}
+
+	for ( ; size; size-- )
+		hash = (hash ^ *p++) * prime;
+
+	return hash;
+}
+
 // Fading
 
 void Music_Emu::set_fade( long start_msec, long length_msec )
@@ -339,6 +476,11 @@ blargg_err_t Music_Emu::play( long out_count, sample_t* out )
 
 		assert( emu_time >= out_time );
 
+		// only while emulator is caught up, so its state is at out_time
+		if ( snapshot_period && !(silence_count | buf_remain) && emu_time == out_time &&
+				out_time >= (snapshot_count ? snapshots [snapshot_count - 1]->time : 0) + snapshot_period )
+			take_snapshot();
+
 		// prints nifty graph of how far ahead we are when searching for silence
 		//debug_printf( "%*s \n", int ((emu_time - out_time) * 7 / sample_rate()), "*" );
 
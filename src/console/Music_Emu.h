@@ -7,6 +7,33 @@
 #include "Gme_File.h"
 class Multi_Buffer;
 
+// Saved emulator state, for going back to a point in a track without emulating
+// again from its start. State is always loaded into the emulator it was saved
+// from, so objects that keep all their state within themselves (including
+// pointers to each other) can simply be copied whole.
+class Emu_State {
+public:
+	Emu_State() : ahead( 0 ), size_( 0 ), pos( 0 ) { }
+
+	// Appends copy of object
+	blargg_err_t save( void const*, long size );
+	template<class T> blargg_err_t save( T const& t ) { return save( &t, sizeof t ); }
+
+	// Copies objects back, in the order they were saved
+	void load( void*, long size );
+	template<class T> void load( T& t ) { load( &t, sizeof t ); }
+
+	// Number of samples emulated past those played when state was saved, which
+	// are lost when it is loaded
+	long ahead;
+
+private:
+	blargg_vector<unsigned char> data;
+	long size_;
+	long pos;
+	friend struct Music_Emu;
+};
+
 struct Music_Emu : public Gme_File {
 public:
 // Basic functionality (see Gme_File.h for file loading/track info functions)
@@ -47,6 +74,21 @@ public:
 	// Skip n samples
 	blargg_err_t skip( long n );
 
+	// Save emulator state every 'sec' seconds while playing, so that seek() can go on
+	// from the nearest point instead of emulating again from the beginning of the
+	// track. Only some emulators support this; it has no effect on others. 0 disables.
+	void set_snapshot_interval( int sec );
+
+	// Hash of memory the emulated program keeps its state in, which comes back to an
+	// earlier value when a track starts repeating, or 0 if the emulator can't tell
+	uint64_t memory_hash() const { return memory_hash_(); }
+
+	// Call func( data, memory_hash() ) each time the track's play routine is about to
+	// be called, while playing. Only emulators of players with a play routine called
+	// at a steady rate do this. Pass 0 to stop.
+	typedef void (*frame_func_t)( void* data, uint64_t memory_hash );
+	void set_frame_func( frame_func_t func, void* data = 0 );
+
 	// True if a track has reached its end
 	bool track_ended() const;
 
@@ -122,6 +164,16 @@ protected:
 	virtual blargg_err_t start_track_( int ) = 0; // tempo is set before this
 	virtual blargg_err_t play_( long count, sample_t* out ) = 0;
 	virtual blargg_err_t skip_( long count );
+
+	// Save state that changes during play, or load it back. Saving fails by default.
+	virtual blargg_err_t save_state_( Emu_State& );
+	virtual void load_state_( Emu_State& ) { }
+
+	virtual uint64_t memory_hash_() const { return 0; }
+	static uint64_t hash_memory( void const*, long size, uint64_t hash = 0xCBF29CE484222325ull );
+
+	// Called by emulators just before they call the play routine (see GME_FRAME_HOOK)
+	void frame_hook() { if ( frame_func ) frame_func( frame_data, memory_hash_() ); }
 protected:
 	virtual void unload();
 	virtual void pre_load();
@@ -154,6 +206,10 @@ private:
 	void handle_fade( long count, sample_t* out );
 
 	// silence detection
+	// frame hook
+	frame_func_t frame_func;
+	void* frame_data;
+
 	int silence_lookahead; // speed to run emulator when looking ahead for silence
 	bool ignore_silence_;
 	long silence_time;     // number of samples where most recent silence began
@@ -164,6 +220,22 @@ private:
 	void fill_buf();
 	void emu_play( long count, sample_t* out );
 
+	// snapshots, oldest first
+	struct snapshot_t
+	{
+		blargg_long time;
+		Emu_State state;
+	};
+	enum { max_snapshots = 64 };
+	snapshot_t* snapshots [max_snapshots];
+	int snapshot_count;
+	int snapshot_track;
+	int snapshot_interval;     // seconds
+	blargg_long snapshot_period;  // samples, 0 if disabled
+	void clear_snapshots();
+	void take_snapshot();
+	void load_snapshot( snapshot_t& );
+
 	Multi_Buffer* effects_buffer;
 	friend Music_Emu* gme_new_emu( gme_type_t, int );
 	friend void gme_set_stereo_depth( Music_Emu*, double );
@@ -485,6 +485,50 @@ blargg_err_t Nsf_Emu::start_track_( int track )
 	return 0;
 }
 
+blargg_err_t Nsf_Emu::save_state_( Emu_State& out )
+{
+	RETURN_ERR( save_buffer( out ) );
+	RETURN_ERR( out.save( static_cast<Nes_Cpu const&> (*this) ) );
+	RETURN_ERR( out.save( saved_state ) );
+	RETURN_ERR( out.save( next_play ) );
+	RETURN_ERR( out.save( play_extra ) );
+	RETURN_ERR( out.save( play_ready ) );
+	RETURN_ERR( out.save( apu ) );
+	RETURN_ERR( out.save( sram ) );
+	#if !NSF_EMU_APU_ONLY
+	{
+		if ( namco ) RETURN_ERR( out.save( *namco ) );
+		if ( vrc6  ) RETURN_ERR( out.save( *vrc6  ) );
+		if ( fme7  ) RETURN_ERR( out.save( *fme7  ) );
+	}
+	#endif
+	return 0;
+}
+
+void Nsf_Emu::load_state_( Emu_State& in )
+{
+	load_buffer( in );
+	in.load( static_cast<Nes_Cpu&> (*this) );
+	in.load( saved_state );
+	in.load( next_play );
+	in.load( play_extra );
+	in.load( play_ready );
+	in.load( apu );
+	in.load( sram );
+	#if !NSF_EMU_APU_ONLY
+	{
+		if ( namco ) in.load( *namco );
+		if ( vrc6  ) in.load( *vrc6  );
+		if ( fme7  ) in.load( *fme7  );
+	}
+	#endif
+}
+
+uint64_t Nsf_Emu::memory_hash_() const
+{
+	return hash_memory( sram, sizeof sram, hash_memory( low_mem, sizeof low_mem ) );
+}
+
 blargg_err_t Nsf_Emu::run_clocks( blip_time_t& duration, int )
 {
 	set_time( 0 );
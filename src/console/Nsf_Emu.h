@@ -61,6 +61,9 @@ protected:
 	void set_voice( int, Blip_Buffer*, Blip_Buffer*, Blip_Buffer* );
 	void update_eq( blip_eq_t const& );
 	void unload();
+	blargg_err_t save_state_( Emu_State& );
+	void load_state_( Emu_State& );
+	uint64_t memory_hash_() const;
 protected:
 	enum { bank_count = 8 };
 	byte initial_banks [bank_count];
@@ -302,6 +302,20 @@ blargg_err_t Spc_Emu::start_track_( int track )
 	return 0;
 }
 
+blargg_err_t Spc_Emu::save_state_( Emu_State& out )
+{
+	out.ahead = (sample_rate() != native_sample_rate) ? resampler.avail() : 0;
+	RETURN_ERR( out.save( apu ) );
+	return out.save( filter );
+}
+
+void Spc_Emu::load_state_( Emu_State& in )
+{
+	resampler.clear();
+	in.load( apu );
+	in.load( filter );
+}
+
 blargg_err_t Spc_Emu::play_and_filter( long count, sample_t out [] )
 {
 	RETURN_ERR( apu.play( count, out ) );
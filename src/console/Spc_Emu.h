@@ -67,6 +67,8 @@ protected:
 	void mute_voices_( int );
 	void set_tempo_( double );
 	void enable_accuracy_( bool );
+	blargg_err_t save_state_( Emu_State& );
+	void load_state_( Emu_State& );
 private:
 	byte const* file_data;
 	long        file_size;
@@ -406,6 +406,36 @@ blargg_err_t Vgm_Emu::run_clocks( blip_time_t& time_io, int msec )
 	return 0;
 }
 
+// only without FM sound, whose emulators keep their state elsewhere
+blargg_err_t Vgm_Emu::save_state_( Emu_State& out )
+{
+	if ( uses_fm )
+		return Music_Emu::save_state_( out );
+
+	RETURN_ERR( save_buffer( out ) );
+	RETURN_ERR( out.save( vgm_time ) );
+	RETURN_ERR( out.save( pos ) );
+	RETURN_ERR( out.save( pcm_data ) );
+	RETURN_ERR( out.save( pcm_pos ) );
+	RETURN_ERR( out.save( dac_amp ) );
+	RETURN_ERR( out.save( dac_disabled ) );
+	RETURN_ERR( out.save( psg ) );
+	return out.save( dac_synth );
+}
+
+void Vgm_Emu::load_state_( Emu_State& in )
+{
+	load_buffer( in );
+	in.load( vgm_time );
+	in.load( pos );
+	in.load( pcm_data );
+	in.load( pcm_pos );
+	in.load( dac_amp );
+	in.load( dac_disabled );
+	in.load( psg );
+	in.load( dac_synth );
+}
+
 blargg_err_t Vgm_Emu::play_( long count, sample_t* out )
 {
 	if ( !uses_fm )
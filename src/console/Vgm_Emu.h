@@ -70,6 +70,8 @@ protected:
 	void mute_voices_( int mask );
 	void set_voice( int, Blip_Buffer*, Blip_Buffer*, Blip_Buffer* );
 	void update_eq( blip_eq_t const& );
+	blargg_err_t save_state_( Emu_State& );
+	void load_state_( Emu_State& );
 private:
 	// removed; use disable_oversampling() and set_tempo() instead
 	Vgm_Emu( bool oversample, double tempo = 1.0 );
@@ -10,6 +10,7 @@
 
 #include "configure.h"
 #include "plugin.h"
+#include "Fir_Resampler.h"
 
 #include <libaudcore/runtime.h>
 
@@ -26,6 +27,9 @@ const char * const ConsolePlugin::defaults[] = {
  "ignore_spc_length", "FALSE",
  "echo", "0",
  "inc_spc_reverb", "FALSE",
+ "block_length", "50",
+ "scan_length", "FALSE",
+ "scalar_resampler", "FALSE",
  nullptr};
 
 bool ConsolePlugin::init ()
@@ -40,6 +44,11 @@ bool ConsolePlugin::init ()
     audcfg.ignore_spc_length = aud_get_bool (CON_CFGID, "ignore_spc_length");
     audcfg.echo = aud_get_int (CON_CFGID, "echo");
     audcfg.inc_spc_reverb = aud_get_bool (CON_CFGID, "inc_spc_reverb");
+    audcfg.block_length = aud_get_int (CON_CFGID, "block_length");
+    audcfg.scan_length = aud_get_bool (CON_CFGID, "scan_length");
+
+    /* not in the settings window; for checking the SSE2 resampler */
+    Fir_Resampler_::use_sse2 = ! aud_get_bool (CON_CFGID, "scalar_resampler");
 
     return true;
 }
@@ -54,4 +63,6 @@ void ConsolePlugin::cleanup ()
     aud_set_bool (CON_CFGID, "ignore_spc_length", audcfg.ignore_spc_length);
     aud_set_int (CON_CFGID, "echo", audcfg.echo);
     aud_set_bool (CON_CFGID, "inc_spc_reverb", audcfg.inc_spc_reverb);
+    aud_set_int (CON_CFGID, "block_length", audcfg.block_length);
+    aud_set_bool (CON_CFGID, "scan_length", audcfg.scan_length);
 }
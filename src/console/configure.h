@@ -18,6 +18,8 @@ typedef struct {
 	bool ignore_spc_length; /* if true, ignore length from SPC tags */
 	int echo;                  /* 0 to +100 */
 	bool inc_spc_reverb;    /* if true, increases the default reverb */
+	int block_length;          /* milliseconds of audio rendered at a time */
+	bool scan_length;       /* find length of untimed tracks by emulating them */
 } AudaciousConsoleConfig;
 
 extern AudaciousConsoleConfig audcfg;
@@ -39,6 +39,11 @@ const PreferencesWidget ConsolePlugin::widgets[] = {
     WidgetSpin (N_("Default song length:"),
         WidgetInt (audcfg.loop_length),
         {1, 7200, 1, N_("seconds")}),
+    WidgetCheck (N_("Find length of untimed songs by emulating them"),
+        WidgetBool (audcfg.scan_length)),
+    WidgetSpin (N_("Render block:"),
+        WidgetInt (audcfg.block_length),
+        {10, 500, 10, N_("ms")}),
     WidgetLabel (N_("<b>Resampling</b>")),
     WidgetCheck (N_("Enable audio resampling"),
         WidgetBool (audcfg.resample)),
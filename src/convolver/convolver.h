@@ -0,0 +1,123 @@
+/*
+ * Convolution Plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_CONVOLVER_H
+#define AUD_CONVOLVER_H
+
+#include <libaudcore/index.h>
+
+/* frames convolved at a time on the audio thread, and so the latency */
+#define BLOCK_SIZE 256
+
+struct FFTComplex
+{
+    float re, im;
+};
+
+/* A real FFT of a power of two size, done as a complex FFT of half the
+ * size on the even and odd samples.  Spectra are kept split, the real
+ * parts of the size / 2 bins and then their imaginary parts, so that
+ * multiplying them is a loop over contiguous floats; bin 0 has the DC
+ * part as its real and the Nyquist part as its imaginary value, both of
+ * which are real. */
+class RealFFT
+{
+public:
+    explicit RealFFT (int size);
+
+    int size () const { return m_size; }
+
+    /* size samples to a spectrum of size floats, with work holding
+     * size / 2 values */
+    void forward (const float * in, float * out, FFTComplex * work) const;
+
+    /* back again, times size */
+    void inverse (const float * in, float * out, FFTComplex * work) const;
+
+private:
+    void transform (FFTComplex * work, const FFTComplex * twiddle) const;
+
+    int m_size;
+    Index<int> m_reverse;           /* of the half-size FFT */
+    Index<FFTComplex> m_twiddle;    /* exp(-2 pi i k / (size / 2)) */
+    Index<FFTComplex> m_untwiddle;  /* its conjugate */
+    Index<FFTComplex> m_split;      /* exp(-2 pi i k / size) */
+};
+
+/* an input channel heard on an output channel through a channel of the
+ * impulse response */
+struct ConvolverPath
+{
+    int in, out, ir;
+};
+
+struct Stage;
+
+/* Uniformly partitioned convolution at several partition sizes: the head
+ * of the impulse response in partitions of BLOCK_SIZE, convolved as each
+ * block comes in, and the rest in partitions four times longer each time,
+ * up to MAX_PARTITION.  Each longer stage starts twice its partition size
+ * into the response and so has a whole partition of time to work; it
+ * runs on a thread of its own, which the audio thread waits for only if
+ * it is late.  The cost per sample grows with the log of the length. */
+class Convolver
+{
+public:
+    /* ir holds each channel of the response after the other, frames
+     * samples of each; made off the audio thread, as that takes a while */
+    Convolver (int channels, int rate, const Index<ConvolverPath> & paths,
+     const Index<float> & ir, int frames);
+    ~Convolver ();
+
+    Convolver (const Convolver &) = delete;
+    Convolver & operator= (const Convolver &) = delete;
+
+    int channels () const { return m_channels; }
+    int rate () const { return m_rate; }
+
+    /* adds the convolution of BLOCK_SIZE interleaved frames to out */
+    void process (const float * in, float * out);
+
+    /* forgets the audio heard so far */
+    void reset ();
+
+private:
+    int m_channels, m_rate;
+    Index<ConvolverPath> m_paths;
+    Index<Stage *> m_stages;   /* the first one runs on the audio thread */
+};
+
+/* The impulse response is read and prepared for the format of the audio
+ * on a thread of its own (loader.cc); the audio passes through unchanged
+ * until it is ready. */
+
+/* as playback starts: keeps the convolver if it is for the same format,
+ * and otherwise has one made for it */
+void loader_start (Convolver * & current, int channels, int rate);
+
+/* as the setting changes */
+void loader_reload ();
+
+/* takes a new convolver if one is ready and hands over the old one to be
+ * freed; never waits */
+void loader_poll (Convolver * & current);
+
+void loader_stop (Convolver * & current);
+
+#endif
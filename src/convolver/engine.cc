@@ -0,0 +1,359 @@
+/*
+ * Convolution Plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include <utility>
+
+#include <libaudcore/runtime.h>
+
+#include "convolver.h"
+
+#define GROWTH 4                /* from one partition size to the next */
+#define MAX_PARTITION 16384     /* frames */
+
+/* One partition size.  A block of <size> frames is convolved with every
+ * partition at once, as the sum of the products of their spectra with
+ * those of the last <parts> blocks, and then comes out twice <size>
+ * after the start of the block, for the later stages. */
+struct Stage
+{
+    Stage (int size, int parts, int channels, int paths) :
+        size (size),
+        parts (parts),
+        channels (channels),
+        fft (2 * size)
+    {
+        kernel.insert (0, paths * parts * 2 * size);
+        spectra.insert (0, channels * parts * 2 * size);
+        window.insert (0, channels * 2 * size);
+        sum.insert (0, 2 * size);
+        temp.insert (0, 2 * size);
+        work.insert (0, size);
+
+        input.insert (0, channels * size);
+        result.insert (0, channels * size);
+        gather.insert (0, channels * size);
+        current.insert (0, channels * size);
+    }
+
+    void compute (const Index<ConvolverPath> & paths);
+    void clear ();
+
+    const int size, parts, channels;
+    const RealFFT fft;
+
+    Index<float> kernel;        /* [path][part], spectra */
+    Index<float> spectra;       /* [channel][part], of the last blocks */
+    int head = 0;               /* the part of the newest block */
+    Index<float> window;        /* [channel], the last two blocks */
+    Index<float> sum, temp;
+    Index<FFTComplex> work;
+
+    Index<float> input, result; /* [channel][frame], of the computation */
+
+    /* only for the later stages, on the audio thread */
+    Index<float> gather;        /* the block coming in */
+    Index<float> current;       /* what comes out meanwhile */
+    int pos = 0;
+
+    /* the thread of a later stage, if it could be started */
+    bool threaded = false;
+    pthread_t thread;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    bool busy = false, quit = false;
+};
+
+/* sum += x * h, in the split form of RealFFT */
+static void multiply_add (float * sum, const float * x, const float * h, int bins)
+{
+    float * sum_re = sum, * sum_im = sum + bins;
+    const float * x_re = x, * x_im = x + bins;
+    const float * h_re = h, * h_im = h + bins;
+
+    /* DC and Nyquist are real */
+    float dc = sum_re[0] + x_re[0] * h_re[0];
+    float nyquist = sum_im[0] + x_im[0] * h_im[0];
+
+    for (int k = 0; k < bins; k ++)
+    {
+        sum_re[k] += x_re[k] * h_re[k] - x_im[k] * h_im[k];
+        sum_im[k] += x_re[k] * h_im[k] + x_im[k] * h_re[k];
+    }
+
+    sum_re[0] = dc;
+    sum_im[0] = nyquist;
+}
+
+void Stage::compute (const Index<ConvolverPath> & paths)
+{
+    int length = 2 * size;
+
+    for (int c = 0; c < channels; c ++)
+    {
+        float * w = & window[c * length];
+        memmove (w, w + size, sizeof (float) * size);
+        memcpy (w + size, & input[c * size], sizeof (float) * size);
+
+        fft.forward (w, & spectra[(c * parts + head) * length], work.begin ());
+    }
+
+    for (int c = 0; c < channels; c ++)
+    {
+        bool heard = false;
+        sum.erase (0, -1);
+
+        for (int p = 0; p < paths.len (); p ++)
+        {
+            if (paths[p].out != c)
+                continue;
+
+            for (int part = 0; part < parts; part ++)
+            {
+                int block = head - part;
+                if (block < 0)
+                    block += parts;
+
+                multiply_add (sum.begin (),
+                 & spectra[(paths[p].in * parts + block) * length],
+                 & kernel[(p * parts + part) * length], size);
+            }
+
+            heard = true;
+        }
+
+        float * out = & result[c * size];
+
+        if (heard)
+        {
+            fft.inverse (sum.begin (), temp.begin (), work.begin ());
+
+            /* the first half wrapped around */
+            memcpy (out, & temp[size], sizeof (float) * size);
+        }
+        else
+            memset (out, 0, sizeof (float) * size);
+    }
+
+    if (++ head == parts)
+        head = 0;
+}
+
+void Stage::clear ()
+{
+    spectra.erase (0, -1);
+    window.erase (0, -1);
+    input.erase (0, -1);
+    result.erase (0, -1);
+    gather.erase (0, -1);
+    current.erase (0, -1);
+    head = pos = 0;
+}
+
+struct StageThread
+{
+    Stage * stage;
+    const Index<ConvolverPath> * paths;
+};
+
+static void * stage_thread (void * data)
+{
+    auto args = (StageThread *) data;
+    Stage * stage = args->stage;
+    const Index<ConvolverPath> & paths = * args->paths;
+    delete args;
+
+    pthread_mutex_lock (& stage->mutex);
+
+    while (! stage->quit)
+    {
+        if (! stage->busy)
+        {
+            pthread_cond_wait (& stage->cond, & stage->mutex);
+            continue;
+        }
+
+        pthread_mutex_unlock (& stage->mutex);
+        stage->compute (paths);
+        pthread_mutex_lock (& stage->mutex);
+
+        stage->busy = false;
+        pthread_cond_broadcast (& stage->cond);
+    }
+
+    pthread_mutex_unlock (& stage->mutex);
+    return nullptr;
+}
+
+/* at the end of each block of a later stage: what the thread made of the
+ * last block comes out during the next one, while it works on this one */
+static void hand_over (Stage * stage, const Index<ConvolverPath> & paths)
+{
+    if (! stage->threaded)
+    {
+        std::swap (stage->result, stage->current);
+        std::swap (stage->input, stage->gather);
+        stage->compute (paths);
+        return;
+    }
+
+    pthread_mutex_lock (& stage->mutex);
+
+    while (stage->busy)
+        pthread_cond_wait (& stage->cond, & stage->mutex);
+
+    std::swap (stage->result, stage->current);
+    std::swap (stage->input, stage->gather);
+
+    stage->busy = true;
+    pthread_cond_broadcast (& stage->cond);
+    pthread_mutex_unlock (& stage->mutex);
+}
+
+Convolver::Convolver (int channels, int rate, const Index<ConvolverPath> & paths,
+ const Index<float> & ir, int frames) :
+    m_channels (channels),
+    m_rate (rate)
+{
+    m_paths.insert (paths.begin (), 0, paths.len ());
+
+    /* the first stage holds the response up to where the second starts,
+     * and so on; the last one holds the rest */
+    int start = 0;
+    int size = BLOCK_SIZE;
+
+    while (start < frames)
+    {
+        int next = size * GROWTH;
+        int end = (next <= MAX_PARTITION) ? aud::min (frames, 2 * next) : frames;
+        int parts = (end - start + size - 1) / size;
+
+        auto stage = new Stage (size, parts, channels, paths.len ());
+        int length = 2 * size;
+
+        for (int p = 0; p < paths.len (); p ++)
+        {
+            const float * response = & ir[paths[p].ir * frames];
+
+            for (int part = 0; part < parts; part ++)
+            {
+                int from = start + part * size;
+                int count = aud::min (size, frames - from);
+
+                /* zero-padded to twice the partition, and scaled for
+                 * RealFFT::inverse() */
+                for (int i = 0; i < count; i ++)
+                    stage->temp[i] = response[from + i] / length;
+                for (int i = count; i < length; i ++)
+                    stage->temp[i] = 0;
+
+                stage->fft.forward (stage->temp.begin (),
+                 & stage->kernel[(p * parts + part) * length], stage->work.begin ());
+            }
+        }
+
+        if (m_stages.len ())
+        {
+            auto args = new StageThread {stage, & m_paths};
+
+            if (pthread_create (& stage->thread, nullptr, stage_thread, args) == 0)
+                stage->threaded = true;
+            else
+            {
+                AUDWARN ("Cannot start a convolution thread; working on the audio thread.\n");
+                delete args;
+            }
+        }
+
+        m_stages.append (stage);
+
+        start = end;
+        size = next;
+    }
+
+    AUDDBG ("Convolving %d frames in %d stages.\n", frames, m_stages.len ());
+}
+
+Convolver::~Convolver ()
+{
+    for (Stage * stage : m_stages)
+    {
+        if (stage->threaded)
+        {
+            pthread_mutex_lock (& stage->mutex);
+            stage->quit = true;
+            pthread_cond_broadcast (& stage->cond);
+            pthread_mutex_unlock (& stage->mutex);
+
+            pthread_join (stage->thread, nullptr);
+        }
+
+        delete stage;
+    }
+}
+
+void Convolver::process (const float * in, float * out)
+{
+    int channels = m_channels;
+
+    for (int s = 0; s < m_stages.len (); s ++)
+    {
+        Stage * stage = m_stages[s];
+        float * to = s ? & stage->gather[stage->pos] : stage->input.begin ();
+
+        for (int c = 0; c < channels; c ++)
+        {
+            for (int f = 0; f < BLOCK_SIZE; f ++)
+                to[c * stage->size + f] = in[f * channels + c];
+        }
+
+        if (! s)
+            stage->compute (m_paths);
+
+        const float * from = s ? & stage->current[stage->pos] : stage->result.begin ();
+
+        for (int c = 0; c < channels; c ++)
+        {
+            for (int f = 0; f < BLOCK_SIZE; f ++)
+                out[f * channels + c] += from[c * stage->size + f];
+        }
+
+        if (s && (stage->pos += BLOCK_SIZE) == stage->size)
+        {
+            stage->pos = 0;
+            hand_over (stage, m_paths);
+        }
+    }
+}
+
+void Convolver::reset ()
+{
+    for (Stage * stage : m_stages)
+    {
+        pthread_mutex_lock (& stage->mutex);
+
+        while (stage->busy)
+            pthread_cond_wait (& stage->cond, & stage->mutex);
+
+        stage->clear ();
+        pthread_mutex_unlock (& stage->mutex);
+    }
+}
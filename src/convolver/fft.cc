@@ -0,0 +1,151 @@
+/*
+ * Convolution Plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "convolver.h"
+
+#include <math.h>
+
+static FFTComplex complex_mul (FFTComplex a, FFTComplex b)
+{
+    return {a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re};
+}
+
+static FFTComplex unit_root (int k, int n)
+{
+    double angle = -2 * M_PI * k / n;
+    return {(float) cos (angle), (float) sin (angle)};
+}
+
+RealFFT::RealFFT (int size) :
+    m_size (size)
+{
+    int half = size / 2;
+    int bits = 0;
+
+    while ((1 << bits) < half)
+        bits ++;
+
+    m_reverse.insert (0, half);
+
+    for (int i = 0; i < half; i ++)
+    {
+        int r = 0;
+        for (int b = 0; b < bits; b ++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+
+        m_reverse[i] = r;
+    }
+
+    m_twiddle.insert (0, half / 2);
+    m_untwiddle.insert (0, half / 2);
+
+    for (int k = 0; k < half / 2; k ++)
+    {
+        m_twiddle[k] = unit_root (k, half);
+        m_untwiddle[k] = {m_twiddle[k].re, -m_twiddle[k].im};
+    }
+
+    m_split.insert (0, half);
+    for (int k = 0; k < half; k ++)
+        m_split[k] = unit_root (k, size);
+}
+
+/* radix-2 butterflies on bit-reversed input; the inner loop runs over
+ * contiguous values, which the compiler can vectorize */
+void RealFFT::transform (FFTComplex * work, const FFTComplex * twiddle) const
+{
+    int half = m_size / 2;
+
+    for (int len = 2, step = half / 2; len <= half; len *= 2, step /= 2)
+    {
+        int mid = len / 2;
+
+        for (int start = 0; start < half; start += len)
+        {
+            FFTComplex * a = work + start;
+            FFTComplex * b = a + mid;
+
+            for (int j = 0; j < mid; j ++)
+            {
+                FFTComplex t = complex_mul (twiddle[j * step], b[j]);
+                b[j] = {a[j].re - t.re, a[j].im - t.im};
+                a[j] = {a[j].re + t.re, a[j].im + t.im};
+            }
+        }
+    }
+}
+
+void RealFFT::forward (const float * in, float * out, FFTComplex * work) const
+{
+    int half = m_size / 2;
+    float * re = out, * im = out + half;
+
+    for (int i = 0; i < half; i ++)
+        work[m_reverse[i]] = {in[2 * i], in[2 * i + 1]};
+
+    transform (work, m_twiddle.begin ());
+
+    /* the spectra of the even and odd samples are the symmetric and
+     * antisymmetric parts of the one just computed */
+    re[0] = work[0].re + work[0].im;
+    im[0] = work[0].re - work[0].im;
+
+    for (int k = 1; k < half; k ++)
+    {
+        FFTComplex z = work[k];
+        FFTComplex w = work[half - k];
+
+        FFTComplex even = {(z.re + w.re) * 0.5f, (z.im - w.im) * 0.5f};
+        FFTComplex odd = {(z.im + w.im) * 0.5f, (w.re - z.re) * 0.5f};
+        FFTComplex x = complex_mul (m_split[k], odd);
+
+        re[k] = even.re + x.re;
+        im[k] = even.im + x.im;
+    }
+}
+
+void RealFFT::inverse (const float * in, float * out, FFTComplex * work) const
+{
+    int half = m_size / 2;
+    const float * re = in, * im = in + half;
+
+    /* the spectra of the even and odd samples, put back together as the
+     * one of the even samples plus i times the odd ones */
+    work[0] = {re[0] + im[0], re[0] - im[0]};
+
+    for (int k = 1; k < half; k ++)
+    {
+        FFTComplex x = {re[k], im[k]};
+        FFTComplex y = {re[half - k], -im[half - k]};
+
+        FFTComplex even = {x.re + y.re, x.im + y.im};
+        FFTComplex odd = complex_mul ({x.re - y.re, x.im - y.im},
+         {m_split[k].re, -m_split[k].im});
+
+        work[m_reverse[k]] = {even.re - odd.im, even.im + odd.re};
+    }
+
+    transform (work, m_untwiddle.begin ());
+
+    for (int i = 0; i < half; i ++)
+    {
+        out[2 * i] = work[i].re;
+        out[2 * i + 1] = work[i].im;
+    }
+}
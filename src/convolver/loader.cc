@@ -0,0 +1,363 @@
+/*
+ * Convolution Plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <sndfile.h>
+
+#include <utility>
+
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+#include "convolver.h"
+
+#define MAX_SECONDS 20      /* of the impulse response */
+#define SINC_ZEROS 32       /* on each side, of the resampling filter */
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_t thread;
+static bool running, quit;
+
+/* what is wanted, and what has been made of it */
+static int want_channels, want_rate;    /* 0 before playback */
+static int want_serial, done_serial;
+static int ready_serial;
+static Convolver * ready;               /* for ready_serial */
+static int taken_serial;                /* by the audio thread */
+static Index<Convolver *> retired;      /* to be freed on the thread */
+
+/* Virtual file access for libsndfile, as in the sndfile plugin */
+static sf_count_t sf_get_filelen (void * user_data)
+{
+    int64_t size = ((VFSFile *) user_data)->fsize ();
+    return (size < 0) ? SF_COUNT_MAX : size;
+}
+
+static sf_count_t sf_vseek (sf_count_t offset, int whence, void * user_data)
+{
+    if (((VFSFile *) user_data)->fseek (offset, to_vfs_seek_type (whence)) != 0)
+        return -1;
+
+    return ((VFSFile *) user_data)->ftell ();
+}
+
+static sf_count_t sf_vread (void * ptr, sf_count_t count, void * user_data)
+{
+    return ((VFSFile *) user_data)->fread (ptr, 1, count);
+}
+
+static sf_count_t sf_vwrite_dummy (const void * ptr, sf_count_t count, void * user_data)
+{
+    return 0;
+}
+
+static sf_count_t sf_tell (void * user_data)
+{
+    return ((VFSFile *) user_data)->ftell ();
+}
+
+static SF_VIRTUAL_IO sf_virtual_io = {
+    sf_get_filelen,
+    sf_vseek,
+    sf_vread,
+    sf_vwrite_dummy,
+    sf_tell
+};
+
+/* A windowed sinc, which is plenty for a response resampled once.  The
+ * samples are scaled by the ratio of the rates, so that the convolution
+ * is as loud at either one. */
+static Index<float> resample (const float * in, int frames, int from, int to)
+{
+    double ratio = (double) to / from;
+    double cutoff = aud::min (1.0, ratio);
+    double reach = SINC_ZEROS / cutoff;
+    int out_frames = ceil (frames * ratio);
+
+    Index<float> out;
+    out.insert (0, out_frames);
+
+    for (int n = 0; n < out_frames; n ++)
+    {
+        double t = n / ratio;
+        int first = aud::max (0, (int) ceil (t - reach));
+        int last = aud::min (frames - 1, (int) floor (t + reach));
+        double sum = 0;
+
+        for (int i = first; i <= last; i ++)
+        {
+            double x = (t - i) * cutoff;
+            double sinc = (x == 0) ? 1 : sin (M_PI * x) / (M_PI * x);
+            double window = 0.42 + 0.5 * cos (M_PI * x / SINC_ZEROS)
+             + 0.08 * cos (2 * M_PI * x / SINC_ZEROS);
+
+            sum += in[i] * sinc * window;
+        }
+
+        out[n] = sum * cutoff / ratio;
+    }
+
+    return out;
+}
+
+/* A mono response is used for every channel; one with as many channels
+ * as the audio, for each channel; one with four for stereo audio, as a
+ * true stereo response: left to left, left to right, right to left and
+ * right to right. */
+static bool make_paths (int ir_channels, int channels, Index<ConvolverPath> & paths)
+{
+    if (ir_channels == 1 || ir_channels == channels)
+    {
+        for (int c = 0; c < channels; c ++)
+            paths.append (ConvolverPath {c, c, (ir_channels == 1) ? 0 : c});
+
+        return true;
+    }
+
+    if (ir_channels == 4 && channels == 2)
+    {
+        paths.append (ConvolverPath {0, 0, 0});
+        paths.append (ConvolverPath {0, 1, 1});
+        paths.append (ConvolverPath {1, 0, 2});
+        paths.append (ConvolverPath {1, 1, 3});
+        return true;
+    }
+
+    return false;
+}
+
+static Convolver * load (const char * uri, int channels, int rate)
+{
+    if (! uri[0])
+        return nullptr;
+
+    VFSFile file (uri, "r");
+    if (! file)
+    {
+        AUDERR ("Cannot open impulse response %s: %s.\n", uri, file.error ());
+        return nullptr;
+    }
+
+    SF_INFO info = SF_INFO ();
+    SNDFILE * sndfile = sf_open_virtual (& sf_virtual_io, SFM_READ, & info, & file);
+
+    if (! sndfile)
+    {
+        AUDERR ("Cannot read impulse response %s: %s.\n", uri, sf_strerror (nullptr));
+        return nullptr;
+    }
+
+    Index<ConvolverPath> paths;
+    if (! make_paths (info.channels, channels, paths))
+    {
+        AUDERR ("An impulse response with %d channels cannot be used for %d "
+         "channels of audio.\n", info.channels, channels);
+        sf_close (sndfile);
+        return nullptr;
+    }
+
+    int frames = aud::min (info.frames, (sf_count_t) MAX_SECONDS * info.samplerate);
+
+    Index<float> interleaved;
+    interleaved.insert (0, frames * info.channels);
+    frames = sf_readf_float (sndfile, interleaved.begin (), frames);
+    sf_close (sndfile);
+
+    if (frames <= 0)
+    {
+        AUDERR ("Impulse response %s is empty.\n", uri);
+        return nullptr;
+    }
+
+    /* one channel after the other, at the rate of the audio */
+    int out_frames = (info.samplerate == rate) ? frames :
+     (int) ceil (frames * ((double) rate / info.samplerate));
+
+    Index<float> ir, planar;
+    ir.insert (0, out_frames * info.channels);
+    planar.insert (0, frames);
+
+    for (int c = 0; c < info.channels; c ++)
+    {
+        for (int f = 0; f < frames; f ++)
+            planar[f] = interleaved[f * info.channels + c];
+
+        if (info.samplerate != rate)
+            planar = resample (planar.begin (), frames, info.samplerate, rate);
+
+        for (int f = 0; f < out_frames; f ++)
+            ir[c * out_frames + f] = planar[f];
+
+        planar.resize (frames);
+    }
+
+    AUDINFO ("Loaded impulse response %s: %d channels, %d Hz, %d frames.\n",
+     uri, info.channels, info.samplerate, frames);
+
+    return new Convolver (channels, rate, paths, ir, out_frames);
+}
+
+static void * loader_thread (void *)
+{
+    pthread_mutex_lock (& mutex);
+
+    while (! quit)
+    {
+        if (retired.len ())
+        {
+            Index<Convolver *> old = std::move (retired);
+            pthread_mutex_unlock (& mutex);
+
+            for (Convolver * convolver : old)
+                delete convolver;
+
+            pthread_mutex_lock (& mutex);
+            continue;
+        }
+
+        if (done_serial != want_serial && want_rate)
+        {
+            int serial = want_serial;
+            int channels = want_channels, rate = want_rate;
+            pthread_mutex_unlock (& mutex);
+
+            String uri = aud_get_str ("convolver", "file");
+            Convolver * convolver = load (uri, channels, rate);
+
+            pthread_mutex_lock (& mutex);
+
+            /* well out of date if the format has changed meanwhile */
+            if (serial == want_serial)
+            {
+                if (ready)
+                    retired.append (ready);
+
+                ready = convolver;
+                ready_serial = serial;
+            }
+            else if (convolver)
+                retired.append (convolver);
+
+            done_serial = serial;
+            continue;
+        }
+
+        pthread_cond_wait (& cond, & mutex);
+    }
+
+    pthread_mutex_unlock (& mutex);
+    return nullptr;
+}
+
+/* with the mutex locked */
+static void request ()
+{
+    want_serial ++;
+
+    if (! running)
+    {
+        quit = false;
+        running = ! pthread_create (& thread, nullptr, loader_thread, nullptr);
+
+        if (! running)
+            AUDERR ("Cannot start the thread to load impulse responses.\n");
+    }
+
+    pthread_cond_broadcast (& cond);
+}
+
+void loader_start (Convolver * & current, int channels, int rate)
+{
+    pthread_mutex_lock (& mutex);
+
+    if (current && (current->channels () != channels || current->rate () != rate))
+    {
+        retired.append (current);
+        current = nullptr;
+    }
+
+    if (channels != want_channels || rate != want_rate)
+    {
+        want_channels = channels;
+        want_rate = rate;
+        request ();
+    }
+
+    pthread_mutex_unlock (& mutex);
+}
+
+void loader_reload ()
+{
+    pthread_mutex_lock (& mutex);
+
+    if (want_rate)
+        request ();
+
+    pthread_mutex_unlock (& mutex);
+}
+
+void loader_poll (Convolver * & current)
+{
+    if (pthread_mutex_trylock (& mutex))
+        return;
+
+    if (ready_serial != taken_serial && ready_serial == want_serial)
+    {
+        if (current)
+        {
+            retired.append (current);
+            pthread_cond_broadcast (& cond);
+        }
+
+        current = ready;
+        ready = nullptr;
+        taken_serial = ready_serial;
+    }
+
+    pthread_mutex_unlock (& mutex);
+}
+
+void loader_stop (Convolver * & current)
+{
+    pthread_mutex_lock (& mutex);
+    quit = true;
+    pthread_cond_broadcast (& cond);
+    pthread_mutex_unlock (& mutex);
+
+    if (running)
+        pthread_join (thread, nullptr);
+
+    running = false;
+
+    for (Convolver * convolver : retired)
+        delete convolver;
+
+    retired.clear ();
+
+    delete ready;
+    ready = nullptr;
+
+    delete current;
+    current = nullptr;
+
+    want_channels = want_rate = 0;
+    done_serial = ready_serial = taken_serial = want_serial;
+}
@@ -0,0 +1,211 @@
+/*
+ * Convolution Plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
+
+#include "convolver.h"
+#include "../trace-common/trace.h"
+
+static const char * const convolver_defaults[] = {
+    "file", "",
+    "mix", "100",
+    "gain", "0",
+    nullptr
+};
+
+static const PreferencesWidget convolver_widgets[] = {
+    WidgetLabel (N_("<b>Impulse Response</b>")),
+    WidgetFileEntry (N_("File:"),
+        WidgetString ("convolver", "file", loader_reload),
+        {FileSelectMode::File}),
+    WidgetLabel (N_("<b>Mix</b>")),
+    WidgetSpin (N_("Convolved signal:"),
+        WidgetInt ("convolver", "mix"),
+        {0, 100, 1, N_("%")}),
+    WidgetSpin (N_("Gain of the convolved signal:"),
+        WidgetFloat ("convolver", "gain"),
+        {-24, 24, 0.5, N_("dB")})
+};
+
+static const PluginPreferences convolver_prefs = {{convolver_widgets}};
+
+static const char convolver_about[] =
+ N_("Convolution Plugin for Audacious\n"
+    "Copyright 2026 Audacious Plugins Authors\n\n"
+    "Plays the audio through an impulse response, for reverb or room "
+    "correction.  The response is read with libsndfile and can be mono, "
+    "have a channel for each channel of the audio, or, for stereo audio, "
+    "have four channels: left to left, left to right, right to left and "
+    "right to right.  Responses of several seconds are convolved in "
+    "partitions of growing length, the longer ones on threads of their own.");
+
+class ConvolverPlugin : public EffectPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("Convolver"),
+        PACKAGE,
+        convolver_about,
+        & convolver_prefs
+    };
+
+    constexpr ConvolverPlugin () : EffectPlugin (info, 0, true) {}
+
+    bool init () override;
+    void cleanup () override;
+
+    void start (int & channels, int & rate) override;
+    Index<float> & process (Index<float> & data) override;
+    bool flush (bool force) override;
+    Index<float> & finish (Index<float> & data, bool end_of_playlist) override;
+    int adjust_delay (int delay) override;
+};
+
+EXPORT ConvolverPlugin aud_plugin_instance;
+
+/* Each frame comes out after BLOCK_SIZE others have gone in, so that the
+ * latency is always the same, however the audio comes. */
+
+static Convolver * convolver;
+static int current_channels, current_rate;
+static Index<float> in_block, out_block, wet;
+static int filled;  /* frames */
+
+static void run_block ()
+{
+    int samples = BLOCK_SIZE * current_channels;
+
+    if (! convolver)
+    {
+        memcpy (out_block.begin (), in_block.begin (), sizeof (float) * samples);
+        return;
+    }
+
+    float mix = aud::clamp (aud_get_int ("convolver", "mix"), 0, 100) / 100.0f;
+    float gain = powf (10, aud_get_double ("convolver", "gain") / 20);
+    float dry = 1 - mix;
+    float amp = mix * gain;
+
+    wet.erase (0, -1);
+    convolver->process (in_block.begin (), wet.begin ());
+
+    for (int i = 0; i < samples; i ++)
+        out_block[i] = in_block[i] * dry + wet[i] * amp;
+}
+
+bool ConvolverPlugin::init ()
+{
+    aud_config_set_defaults ("convolver", convolver_defaults);
+    return true;
+}
+
+void ConvolverPlugin::cleanup ()
+{
+    loader_stop (convolver);
+
+    in_block.clear ();
+    out_block.clear ();
+    wet.clear ();
+}
+
+void ConvolverPlugin::start (int & channels, int & rate)
+{
+    current_channels = channels;
+    current_rate = rate;
+
+    loader_start (convolver, channels, rate);
+
+    in_block.resize (BLOCK_SIZE * channels);
+    out_block.resize (BLOCK_SIZE * channels);
+    wet.resize (BLOCK_SIZE * channels);
+
+    flush (true);
+}
+
+Index<float> & ConvolverPlugin::process (Index<float> & data)
+{
+    TRACE_SPAN ("Convolver process");
+
+    int channels = current_channels;
+    int frames = data.len () / channels;
+
+    for (int done = 0; done < frames; )
+    {
+        /* a new response is taken only between blocks */
+        if (! filled)
+            loader_poll (convolver);
+
+        int count = aud::min (frames - done, BLOCK_SIZE - filled);
+        float * audio = & data[done * channels];
+        int offset = filled * channels;
+
+        for (int i = 0; i < count * channels; i ++)
+        {
+            in_block[offset + i] = audio[i];
+            audio[i] = out_block[offset + i];
+        }
+
+        done += count;
+
+        if ((filled += count) == BLOCK_SIZE)
+        {
+            run_block ();
+            filled = 0;
+        }
+    }
+
+    return data;
+}
+
+bool ConvolverPlugin::flush (bool force)
+{
+    in_block.erase (0, -1);
+    out_block.erase (0, -1);
+    filled = 0;
+
+    if (convolver)
+        convolver->reset ();
+
+    return true;
+}
+
+Index<float> & ConvolverPlugin::finish (Index<float> & data, bool end_of_playlist)
+{
+    /* the next song goes on from here */
+    if (! end_of_playlist)
+        return process (data);
+
+    /* what is still held comes out as silence goes in */
+    data.insert (-1, BLOCK_SIZE * current_channels);
+    process (data);
+
+    flush (true);
+    return data;
+}
+
+int ConvolverPlugin::adjust_delay (int delay)
+{
+    return delay + aud::rescale (BLOCK_SIZE, current_rate, 1000);
+}
@@ -23,6 +23,8 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../trace-common/trace.h"
+
 static const char * const cryst_defaults[] = {
  "intensity", "1",
  nullptr};
@@ -81,6 +83,7 @@ void Crystalizer::start (int & channels, int & rate)
 
 Index<float> & Crystalizer::process (Index<float> & data)
 {
+    TRACE_SPAN ("Crystalizer process");
     float value = aud_get_double ("crystalizer", "intensity");
     float * f = data.begin ();
     float * end = data.end ();
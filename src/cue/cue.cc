@@ -1,6 +1,7 @@
 /*
  * Cue Sheet Plugin for Audacious
  * Copyright (c) 2009-2015 William Pitcock and John Lindgren
+ * Copyright 2024 Audacious Plugins Authors
  *
  * Redistribution and use in source and binary forms, with or without
  * modification, are permitted provided that the following conditions are met:
@@ -19,6 +20,7 @@
 
 #include <string.h>
 #include <pthread.h>
+#include <sys/stat.h>
 
 #ifdef HAVE_LIBCUE2
 #include <libcue.h>
@@ -30,7 +32,9 @@ extern "C" {
 
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/multihash.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/plugins.h>
 #include <libaudcore/probe.h>
 #include <libaudcore/runtime.h>
 
@@ -57,8 +61,142 @@ static bool is_year (const char * s)
            is_digit (s[2]) && is_digit (s[3]) && ! s[4];
 }
 
-bool CueLoader::load (const char * cue_filename, VFSFile & file, String & title,
+/* Cue sheets already read are kept, with the tracks found in them, so that
+ * loading a playlist of many cue-indexed albums again (or refreshing it)
+ * neither parses the sheets again nor probes the audio files they refer
+ * to.  An entry is used only while the sheet and each of its audio files
+ * still have the size and modification time they had when it was read,
+ * and their decoders are still enabled; only local files are kept. */
+
+#define CACHE_SIZE 4096
+
+struct FileStamp
+{
+    int64_t size, mtime;
+
+    bool operator== (const FileStamp & b) const
+        { return size == b.size && mtime == b.mtime; }
+};
+
+struct AudioFile
+{
+    String filename;
+    FileStamp stamp;
+
+    AudioFile (const String & filename, const FileStamp & stamp) :
+        filename (filename), stamp (stamp) {}
+};
+
+struct CachedCue
+{
+    FileStamp stamp;
+    Index<AudioFile> files;
+    Index<PlaylistAddItem> items;
+    int64_t used;
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SimpleHash<String, CachedCue> cache;
+static int64_t cache_clock;
+
+/* false for anything but a regular local file */
+static bool get_file_stamp (const char * filename, FileStamp & stamp)
+{
+    if (strncmp (filename, "file://", 7))
+        return false;
+
+    StringBuf path = uri_to_filename (filename);
+    struct stat st;
+
+    if (! path || stat (path, & st) < 0 || ! S_ISREG (st.st_mode))
+        return false;
+
+    stamp.size = st.st_size;
+    stamp.mtime = st.st_mtime;
+    return true;
+}
+
+static void copy_items (const Index<PlaylistAddItem> & from, Index<PlaylistAddItem> & to)
+{
+    for (const PlaylistAddItem & item : from)
+        to.append (item.filename, item.tuple.ref (), item.decoder);
+}
+
+static bool cache_lookup (const String & cue_filename, const FileStamp & stamp,
  Index<PlaylistAddItem> & items)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    CachedCue * cached = cache.lookup (cue_filename);
+    bool valid = cached && cached->stamp == stamp;
+
+    if (valid)
+    {
+        for (const AudioFile & file : cached->files)
+        {
+            FileStamp file_stamp;
+            if (! get_file_stamp (file.filename, file_stamp) || ! (file_stamp == file.stamp))
+                valid = false;
+        }
+
+        for (const PlaylistAddItem & item : cached->items)
+        {
+            if (item.decoder && ! aud_plugin_get_enabled (item.decoder))
+                valid = false;
+        }
+    }
+
+    if (valid)
+    {
+        copy_items (cached->items, items);
+        cached->used = ++ cache_clock;
+    }
+    else if (cached)
+        cache.remove (cue_filename);
+
+    pthread_mutex_unlock (& cache_mutex);
+
+    if (valid)
+        AUDDBG ("Using cached tracks of %s\n", (const char *) cue_filename);
+
+    return valid;
+}
+
+static void cache_add (const String & cue_filename, const FileStamp & stamp,
+ Index<AudioFile> && files, const Index<PlaylistAddItem> & items)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    /* the least recently used one goes */
+    if (cache.n_items () >= CACHE_SIZE && ! cache.lookup (cue_filename))
+    {
+        const String * oldest = nullptr;
+        int64_t oldest_used = 0;
+
+        cache.iterate ([&] (const String & key, CachedCue & cached) {
+            if (! oldest || cached.used < oldest_used)
+            {
+                oldest = & key;
+                oldest_used = cached.used;
+            }
+        });
+
+        cache.remove (String (* oldest));
+    }
+
+    CachedCue cached;
+    cached.stamp = stamp;
+    cached.files = std::move (files);
+    copy_items (items, cached.items);
+    cached.used = ++ cache_clock;
+
+    cache.add (cue_filename, std::move (cached));
+
+    pthread_mutex_unlock (& cache_mutex);
+}
+
+static bool parse_cue (const char * cue_filename, VFSFile & file,
+ Index<PlaylistAddItem> & items, Index<AudioFile> & files, bool & cacheable)
 {
     // XXX: cue_parse_string crashes if called concurrently
     static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -75,13 +213,20 @@ bool CueLoader::load (const char * cue_filename, VFSFile & file, String & title,
 
     int tracks = cd ? cd_get_ntrack (cd) : 0;
     if (tracks < 1)
+    {
+        if (cd)
+            cd_delete (cd);
         return false;
+    }
 
     Track * cur = cd_get_track (cd, 1);
     const char * cur_name = cur ? track_get_filename (cur) : nullptr;
 
     if (! cur_name)
+    {
+        cd_delete (cd);
         return false;
+    }
 
     bool same_file = false;
     String filename;
@@ -97,6 +242,12 @@ bool CueLoader::load (const char * cue_filename, VFSFile & file, String & title,
             base_tuple = Tuple ();
 
             VFSFile file;
+            FileStamp stamp;
+
+            if (filename && get_file_stamp (filename, stamp))
+                files.append (filename, stamp);
+            else
+                cacheable = false;
 
             if (filename)
                 decoder = aud_file_find_decoder (filename, false, file);
@@ -206,5 +357,26 @@ bool CueLoader::load (const char * cue_filename, VFSFile & file, String & title,
         cur_name = next_name;
     }
 
+    cd_delete (cd);
+    return true;
+}
+
+bool CueLoader::load (const char * cue_filename, VFSFile & file, String & title,
+ Index<PlaylistAddItem> & items)
+{
+    String key (cue_filename);
+    FileStamp stamp;
+    bool cacheable = get_file_stamp (cue_filename, stamp);
+
+    if (cacheable && cache_lookup (key, stamp, items))
+        return true;
+
+    Index<AudioFile> files;
+    if (! parse_cue (cue_filename, file, items, files, cacheable))
+        return false;
+
+    if (cacheable)
+        cache_add (key, stamp, std::move (files), items);
+
     return true;
 }
@@ -0,0 +1,452 @@
+/*
+ * Synthetic Tunes for the Decoder Benchmark
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Tunes for the console plugin, made up so that the benchmark has a corpus
+ * of its own that can be handed out with the source.  Each one keeps one
+ * part of the emulator busy for as long as it plays:
+ *
+ *   busy.nsf    the 6502 of Nes_Cpu, in a play routine that takes about 80%
+ *               of each frame
+ *   busy.sap    the same on the 6502 of Sap_Cpu
+ *   busy.kss    the same on the Z80 of Kss_Cpu
+ *   busy.spc    the SPC700 of Spc_Cpu, in a loop that rewrites the pitch of
+ *               one voice
+ *   voices.spc  Spc_Dsp, with all eight voices playing the same looped
+ *               sample through the echo, at pitches around $0800
+ *   voices-high.spc  the same around $2000, where BRR decoding costs more
+ *   busy-ym2612.vgm  Ym2612_Emu, with all six channels keyed on
+ *   busy-ym2413.vgm  Ym2413_Emu, with all nine melodic channels keyed on
+ *
+ * None of them has a length, so they play until the benchmark stops them.
+ * The bytes are all fixed here, so every build writes the same files. */
+
+#include "console-tunes.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/index.h>
+
+typedef Index<unsigned char> Tune;
+
+static void put (Tune & tune, std::initializer_list<int> bytes)
+{
+    for (int byte : bytes)
+        tune.append (byte);
+}
+
+static void put_str (Tune & tune, const char * str)
+{
+    tune.insert ((const unsigned char *) str, -1, strlen (str));
+}
+
+static void set16 (Tune & tune, int pos, int value)
+{
+    tune[pos] = value;
+    tune[pos + 1] = value >> 8;
+}
+
+/* the same noise on every machine, unlike rand() */
+static unsigned char noise (unsigned & state)
+{
+    state = state * 1103515245 + 12345;
+    return state >> 16;
+}
+
+static Tune busy_nsf ()
+{
+    Tune tune;
+    tune.insert (0, 0x80);
+
+    memcpy (tune.begin (), "NESM\x1a", 5);
+    tune[5] = 1;            /* version */
+    tune[6] = 1;            /* songs */
+    tune[7] = 1;            /* first song */
+    set16 (tune, 8, 0x8000);    /* load */
+    set16 (tune, 10, 0x8000);   /* init */
+    set16 (tune, 12, 0x800b);   /* play */
+    strcpy ((char *) & tune[0x0e], "Busy 6502");
+    set16 (tune, 0x6e, 16666);  /* us per frame */
+
+    /* init: square 1 on, constant volume */
+    put (tune, {0xa9, 0x0f, 0x8d, 0x15, 0x40,   /* lda #$0f; sta $4015 */
+                0xa9, 0xbf, 0x8d, 0x00, 0x40,   /* lda #$bf; sta $4000 */
+                0x60});                         /* rts */
+
+    /* play: 6 x 256 x 16 cycles over a page of RAM, then a new pitch */
+    put (tune, {0xa0, 0x06,                     /* ldy #6 */
+                0xa2, 0x00,                     /* l1: ldx #0 */
+                0xbd, 0x00, 0x02,               /* l2: lda $0200,x */
+                0x69, 0x01,                     /* adc #1 */
+                0x9d, 0x00, 0x02,               /* sta $0200,x */
+                0xe8,                           /* inx */
+                0xd0, 0xf5,                     /* bne l2 */
+                0x88,                           /* dey */
+                0xd0, 0xf0,                     /* bne l1 */
+                0xe6, 0x00,                     /* inc $00 */
+                0xa5, 0x00, 0x8d, 0x02, 0x40,   /* lda $00; sta $4002 */
+                0x29, 0x07, 0x8d, 0x03, 0x40,   /* and #7; sta $4003 */
+                0x60});                         /* rts */
+
+    tune.resize (0x80 + 0x1000);
+    return tune;
+}
+
+static Tune busy_sap ()
+{
+    Tune tune;
+    put_str (tune, "SAP\r\nNAME \"Busy 6502\"\r\nTYPE B\r\nINIT 2000\r\nPLAYER 2006\r\n");
+
+    /* one block at $2000; its last address is set below */
+    put (tune, {0xff, 0xff, 0x00, 0x20, 0x00, 0x00});
+    int block = tune.len ();
+
+    /* init: channel 1 a pure tone at volume 8 */
+    put (tune, {0xa9, 0xa8, 0x8d, 0x01, 0xd2,   /* lda #$a8; sta $d201 */
+                0x60});                         /* rts */
+
+    /* play: 7 x 256 x 16 cycles, then a new pitch */
+    put (tune, {0xa0, 0x07,                     /* ldy #7 */
+                0xa2, 0x00,                     /* l1: ldx #0 */
+                0xbd, 0x00, 0x06,               /* l2: lda $0600,x */
+                0x69, 0x01,                     /* adc #1 */
+                0x9d, 0x00, 0x06,               /* sta $0600,x */
+                0xe8,                           /* inx */
+                0xd0, 0xf5,                     /* bne l2 */
+                0x88,                           /* dey */
+                0xd0, 0xf0,                     /* bne l1 */
+                0xe6, 0x80,                     /* inc $80 */
+                0xa5, 0x80, 0x8d, 0x00, 0xd2,   /* lda $80; sta $d200 */
+                0x60});                         /* rts */
+
+    set16 (tune, block - 2, 0x2000 + tune.len () - block - 1);
+    return tune;
+}
+
+static Tune busy_kss ()
+{
+    Tune tune;
+    put_str (tune, "KSCC");
+    tune.insert (-1, 12);
+    set16 (tune, 4, 0x4000);    /* load */
+    set16 (tune, 8, 0x4000);    /* init */
+    set16 (tune, 10, 0x4011);   /* play */
+
+    /* init: tone A on, at full volume */
+    put (tune, {0x3e, 0x07, 0xd3, 0xa0,         /* ld a,7; out ($a0),a */
+                0x3e, 0x3e, 0xd3, 0xa1,         /* ld a,$3e; out ($a1),a */
+                0x3e, 0x08, 0xd3, 0xa0,         /* ld a,8; out ($a0),a */
+                0x3e, 0x0f, 0xd3, 0xa1,         /* ld a,$0f; out ($a1),a */
+                0xc9});                         /* ret */
+
+    /* play: 6 x 256 x 30 T-states over a page of RAM, then a new pitch */
+    put (tune, {0x16, 0x06,                     /* ld d,6 */
+                0x21, 0x00, 0xc0,               /* l1: ld hl,$c000 */
+                0x06, 0x00,                     /* ld b,0 */
+                0x34,                           /* l2: inc (hl) */
+                0x23,                           /* inc hl */
+                0x10, 0xfc,                     /* djnz l2 */
+                0x15,                           /* dec d */
+                0x20, 0xf4,                     /* jr nz,l1 */
+                0x3e, 0x00, 0xd3, 0xa0,         /* ld a,0; out ($a0),a */
+                0x3a, 0x00, 0xc1,               /* ld a,($c100) */
+                0x3c,                           /* inc a */
+                0x32, 0x00, 0xc1,               /* ld ($c100),a */
+                0xd3, 0xa1,                     /* out ($a1),a */
+                0xc9});                         /* ret */
+
+    set16 (tune, 6, tune.len () - 16);  /* load size */
+    return tune;
+}
+
+/* An SPC file is the whole of the sound module at one moment: the CPU's
+ * registers, its 64 KiB of RAM and the DSP's 128 registers.  The test
+ * sample is 16 blocks of BRR noise, looping, in the first entry of a
+ * sample directory at $0200. */
+enum {
+    SPC_RAM = 0x100,
+    SPC_DSP = 0x10100,
+    SPC_SIZE = 0x10200,
+    SPC_DIR = 0x200,
+    SPC_SAMPLE = 0x1000,
+    SPC_CODE = 0x400
+};
+
+static Tune spc_base (const char * title)
+{
+    Tune tune;
+    tune.insert (0, SPC_SIZE);
+
+    strcpy ((char *) tune.begin (), "SNES-SPC700 Sound File Data v0.30");
+    tune[0x21] = 26;
+    tune[0x22] = 26;
+    tune[0x23] = 26;        /* with an ID666 tag */
+    tune[0x24] = 30;
+    set16 (tune, 0x25, SPC_CODE);   /* PC */
+    tune[0x2a] = 0x02;      /* PSW */
+    tune[0x2b] = 0xef;      /* SP */
+    strcpy ((char *) & tune[0x2e], title);
+
+    unsigned char * ram = & tune[SPC_RAM];
+    unsigned char * dsp = & tune[SPC_DSP];
+
+    ram[SPC_DIR] = ram[SPC_DIR + 2] = SPC_SAMPLE & 0xff;    /* start, loop */
+    ram[SPC_DIR + 1] = ram[SPC_DIR + 3] = SPC_SAMPLE >> 8;
+
+    unsigned state = 1;
+    for (int b = 0; b < 16; b ++)
+    {
+        unsigned char * block = ram + SPC_SAMPLE + 9 * b;
+
+        /* shift 11, filters 0 to 2; the last block loops */
+        block[0] = (b == 15) ? 0xb3 : 0xb0 | (b % 3) << 2;
+        for (int i = 1; i < 9; i ++)
+            block[i] = noise (state);
+    }
+
+    dsp[0x0c] = dsp[0x1c] = 0x40;   /* main volume */
+    dsp[0x5d] = SPC_DIR >> 8;
+    dsp[0x6c] = 0x20;               /* echo writes off */
+
+    return tune;
+}
+
+/* one voice, whose pitch the CPU sets over and over */
+static Tune busy_spc ()
+{
+    Tune tune = spc_base ("Busy SPC700");
+    unsigned char * ram = & tune[SPC_RAM];
+    unsigned char * dsp = & tune[SPC_DSP];
+
+    dsp[0x00] = dsp[0x01] = 0x40;   /* volume */
+    dsp[0x03] = 0x10;               /* pitch */
+    dsp[0x05] = 0x8f;               /* ADSR */
+    dsp[0x06] = 0xe0;
+
+    static const unsigned char code[] = {
+        0x8f, 0x4c, 0xf2,           /* mov $f2,#$4c (key on) */
+        0x8f, 0x01, 0xf3,           /* mov $f3,#1 */
+        0xab, 0x00,                 /* l: inc $00 */
+        0xe4, 0x00,                 /* mov a,$00 */
+        0x8f, 0x02, 0xf2,           /* mov $f2,#2 (pitch, low byte) */
+        0xc4, 0xf3,                 /* mov $f3,a */
+        0x2f, 0xf5                  /* bra l */
+    };
+
+    memcpy (ram + SPC_CODE, code, sizeof code);
+    return tune;
+}
+
+/* eight voices keyed on by the CPU, which then waits */
+static Tune voices_spc (const char * title, int pitch)
+{
+    Tune tune = spc_base (title);
+    unsigned char * ram = & tune[SPC_RAM];
+    unsigned char * dsp = & tune[SPC_DSP];
+
+    for (int v = 0; v < 8; v ++)
+    {
+        unsigned char * voice = dsp + 0x10 * v;
+        int p = pitch + 0x40 * v;   /* not quite in step */
+
+        voice[0x00] = voice[0x01] = 0x10;
+        voice[0x02] = p & 0xff;
+        voice[0x03] = p >> 8;
+        voice[0x05] = 0x8f;
+        voice[0x06] = 0xe0;
+    }
+
+    dsp[0x2c] = dsp[0x3c] = 0x20;   /* echo volume */
+    dsp[0x0d] = 0x30;               /* echo feedback */
+    dsp[0x0f] = 0x7f;               /* echo filter, first tap */
+    dsp[0x4d] = 0xff;               /* echo on for every voice */
+    dsp[0x6c] = 0x00;               /* echo writes on */
+    dsp[0x6d] = 0x80;               /* echo buffer at $8000 */
+    dsp[0x7d] = 2;                  /* 32 ms of it */
+
+    static const unsigned char code[] = {
+        0x8f, 0x4c, 0xf2,           /* mov $f2,#$4c (key on) */
+        0x8f, 0xff, 0xf3,           /* mov $f3,#$ff */
+        0x2f, 0xfe                  /* l: bra l */
+    };
+
+    memcpy (ram + SPC_CODE, code, sizeof code);
+    return tune;
+}
+
+static Tune voices_low () { return voices_spc ("Eight voices", 0x0800); }
+static Tune voices_high () { return voices_spc ("Eight voices, high", 0x2000); }
+
+/* A VGM file is a log of writes to the sound chips, with waits between
+ * them in samples at 44.1 kHz.  These set up every FM channel and key it
+ * on, then loop for ever over a second in which the pitch of one channel
+ * changes each frame.  There is no GD3 tag. */
+enum {
+    VGM_DATA = 0x40,
+    VGM_FRAME = 0x62        /* wait 735 samples */
+};
+
+static void set32 (Tune & tune, int pos, int value)
+{
+    set16 (tune, pos, value);
+    set16 (tune, pos + 2, value >> 16);
+}
+
+static Tune vgm_base (int clock_pos, int clock)
+{
+    Tune tune;
+    tune.insert (0, VGM_DATA);
+
+    memcpy (tune.begin (), "Vgm ", 4);
+    set32 (tune, 0x08, 0x150);      /* version */
+    set32 (tune, clock_pos, clock);
+    set32 (tune, 0x34, VGM_DATA - 0x34);
+
+    return tune;
+}
+
+static void vgm_loop (Tune & tune, int loop)
+{
+    tune.append (0x66);             /* end, back to the loop */
+    set32 (tune, 0x04, tune.len () - 0x04);
+    set32 (tune, 0x1c, loop - 0x1c);
+}
+
+/* the six channels of the YM2612, with the LFO on */
+static Tune busy_ym2612 ()
+{
+    Tune tune = vgm_base (0x2c, 7670453);
+
+    auto write = [& tune] (int port, int reg, int value)
+        { put (tune, {0x52 + port, reg, value}); };
+
+    write (0, 0x22, 0x0b);          /* LFO */
+
+    for (int port = 0; port < 2; port ++)
+    {
+        for (int ch = 0; ch < 3; ch ++)
+        {
+            for (int op = 0; op < 4; op ++)
+            {
+                int reg = ch + 4 * op;
+                write (port, 0x30 + reg, 0x71);     /* detune, multiple */
+                write (port, 0x40 + reg, (op == 3) ? 0x18 : 0x20);  /* level */
+                write (port, 0x50 + reg, 0x1f);     /* attack */
+                write (port, 0x60 + reg, 0x05);     /* decay */
+                write (port, 0x70 + reg, 0x02);     /* sustain */
+                write (port, 0x80 + reg, 0x11);     /* release */
+            }
+
+            write (port, 0xb0 + ch, 0x30 + (ch + 3 * port) % 8);   /* algorithm */
+            write (port, 0xb4 + ch, 0xc7);          /* both sides, LFO depth */
+            write (port, 0xa4 + ch, 0x22 + ch);     /* block, pitch */
+            write (port, 0xa0 + ch, 0x69 + 0x10 * port);
+        }
+    }
+
+    for (int ch = 0; ch < 6; ch ++)
+        write (0, 0x28, 0xf0 | (ch < 3 ? ch : ch + 1));    /* key on */
+
+    int loop = tune.len ();
+
+    for (int frame = 0; frame < 60; frame ++)
+    {
+        int ch = frame % 6;
+        write (ch / 3, 0xa0 + ch % 3, 0x40 + 3 * frame);
+        tune.append (VGM_FRAME);
+    }
+
+    vgm_loop (tune, loop);
+    return tune;
+}
+
+/* the nine melodic channels of the YM2413, each with another instrument */
+static Tune busy_ym2413 ()
+{
+    Tune tune = vgm_base (0x10, 3579545);
+
+    auto write = [& tune] (int reg, int value)
+        { put (tune, {0x51, reg, value}); };
+
+    for (int ch = 0; ch < 9; ch ++)
+    {
+        write (0x30 + ch, (ch + 1) << 4 | 0x02);    /* instrument, volume */
+        write (0x10 + ch, 0x40 + 0x10 * ch);        /* pitch */
+        write (0x20 + ch, 0x30 | (2 + ch % 3) << 1 | 1);  /* key on, block */
+    }
+
+    int loop = tune.len ();
+
+    for (int frame = 0; frame < 60; frame ++)
+    {
+        write (0x10 + frame % 9, 0x40 + 3 * frame);
+        tune.append (VGM_FRAME);
+    }
+
+    vgm_loop (tune, loop);
+    return tune;
+}
+
+static const struct {
+    const char * name;
+    Tune (* make) ();
+} tunes[] = {
+    {"busy.nsf", busy_nsf},
+    {"busy.sap", busy_sap},
+    {"busy.kss", busy_kss},
+    {"busy.spc", busy_spc},
+    {"voices.spc", voices_low},
+    {"voices-high.spc", voices_high},
+    {"busy-ym2612.vgm", busy_ym2612},
+    {"busy-ym2413.vgm", busy_ym2413}
+};
+
+bool write_tune (const char * dir, const char * name, const Index<unsigned char> & tune)
+{
+    StringBuf path = filename_build ({dir, name});
+
+    FILE * file = fopen (path, "wb");
+    if (! file)
+    {
+        perror (path);
+        return false;
+    }
+
+    bool ok = (fwrite (tune.begin (), 1, tune.len (), file) == (size_t) tune.len ());
+
+    if (fclose (file) < 0 || ! ok)
+    {
+        perror (path);
+        return false;
+    }
+
+    return true;
+}
+
+bool write_console_tunes (const char * dir)
+{
+    for (auto & t : tunes)
+    {
+        if (! write_tune (dir, t.name, t.make ()))
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,31 @@
+/*
+ * Synthetic Tunes for the Decoder Benchmark
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef DECODER_BENCH_CONSOLE_TUNES_H
+#define DECODER_BENCH_CONSOLE_TUNES_H
+
+#include <libaudcore/index.h>
+
+/* writes one file of a synthetic tune into dir */
+bool write_tune (const char * dir, const char * name, const Index<unsigned char> & tune);
+
+/* writes the synthetic tunes for the console plugin into dir */
+bool write_console_tunes (const char * dir);
+
+#endif
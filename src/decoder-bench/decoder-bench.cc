@@ -0,0 +1,849 @@
+/*
+ * Decoder Benchmark for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Loads input plugins outside Audacious and times them decoding a corpus of
+ * files into nothing.  Every file (directories are searched all the way
+ * down) goes to the plugin Audacious would pick for it, whose play() is run
+ * to the end, or for the given number of seconds of audio, and for each one
+ * the table shows:
+ *
+ *   x realtime  seconds of audio decoded per second of wall-clock time
+ *   cpu ms      user and system time of the whole process, all threads
+ *   peak MiB    the highest resident set size while decoding
+ *   allocs      heap allocations while decoding, on any thread
+ *   allocs/s    the same per second of audio
+ *
+ * followed by the totals for each format.  With --json, all of it is also
+ * written to a file in a form that is easy to compare between releases,
+ * along with a hash of the audio decoded from each file.  Given such a file
+ * from an earlier run, --check compares the hashes and fails if any file
+ * decodes differently, which makes it a test that a faster decoder still
+ * gives the same output, sample for sample.
+ *
+ * --write-tunes writes synthetic tunes for the console and xsf plugins (see
+ * console-tunes.cc and xsf-tunes.cc) into a directory, as a corpus that is
+ * always at hand.  --set changes a setting of a plugin for the run, as
+ * --set xsf.arm7_code_cache=TRUE does.
+ *
+ * Built with "meson setup -Ddecoder-bench=true"; if -Ddecoder-bench-corpus
+ * names a directory, "meson test --benchmark" runs it on the plugins in the
+ * build tree.  Plugins are loaded from the files or directories (searched
+ * one level deep) given with --plugins, or from the installed input plugin
+ * directory.
+ *
+ * Instead of playback in libaudcore, play() calls the functions at the end
+ * of this file, which the dynamic linker finds here before it finds them in
+ * libaudcore; so this only works with ELF shared objects. */
+
+#include <atomic>
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <libaudcore/audio.h>
+#include <libaudcore/audstrings.h>
+#include <libaudcore/index.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/tuple.h>
+#include <libaudcore/vfs.h>
+
+#include "console-tunes.h"
+#include "xsf-tunes.h"
+
+#ifdef INPUT_PLUGIN_DIR
+static const char * const default_dir = INPUT_PLUGIN_DIR;
+#else
+static const char * const default_dir = nullptr;
+#endif
+
+struct Options {
+    double seconds = 0;     /* of audio per file, 0 for all of it */
+    const char * only = nullptr;
+    const char * json = nullptr;
+    const char * check = nullptr;
+};
+
+/* As in effect-bench, allocations are counted by wrapping the C library's
+ * malloc(); here, decoders that start threads of their own are counted
+ * with the rest, so the count is kept for the whole process. */
+#ifdef __GLIBC__
+extern "C" {
+void * __libc_malloc (size_t size);
+void * __libc_calloc (size_t n, size_t size);
+void * __libc_realloc (void * ptr, size_t size);
+void __libc_free (void * ptr);
+
+static std::atomic<bool> counting;
+static std::atomic<long> allocations;
+
+void * malloc (size_t size)
+{
+    if (counting.load (std::memory_order_relaxed))
+        allocations.fetch_add (1, std::memory_order_relaxed);
+    return __libc_malloc (size);
+}
+
+void * calloc (size_t n, size_t size)
+{
+    if (counting.load (std::memory_order_relaxed))
+        allocations.fetch_add (1, std::memory_order_relaxed);
+    return __libc_calloc (n, size);
+}
+
+void * realloc (void * ptr, size_t size)
+{
+    if (counting.load (std::memory_order_relaxed))
+        allocations.fetch_add (1, std::memory_order_relaxed);
+    return __libc_realloc (ptr, size);
+}
+
+void free (void * ptr)
+{
+    __libc_free (ptr);
+}
+}
+#define HAVE_ALLOC_COUNT 1
+#else
+static bool counting;
+static long allocations;
+#define HAVE_ALLOC_COUNT 0
+#endif
+
+/* what play() has written so far, instead of an output plugin */
+static struct {
+    int format, rate, channels;
+    int64_t bytes;
+    double seconds;         /* in earlier formats, if it changed */
+    int64_t limit;          /* bytes in the current format, 0 for none */
+    double limit_seconds;
+    uint64_t hash;          /* of what was written, up to the limit */
+    Tuple tuple;
+} sink;
+
+/* FNV-1a, 64 bits */
+static const uint64_t hash_start = 0xcbf29ce484222325;
+
+static uint64_t hash_bytes (uint64_t hash, const void * data, int64_t len)
+{
+    auto bytes = (const unsigned char *) data;
+
+    for (int64_t i = 0; i < len; i ++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
+
+    return hash;
+}
+
+static double sink_seconds ()
+{
+    if (! sink.rate || ! sink.channels)
+        return sink.seconds;
+
+    return sink.seconds + (double) sink.bytes /
+     (FMT_SIZEOF (sink.format) * sink.channels * sink.rate);
+}
+
+static double now_s ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpu_s ()
+{
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, & usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+     usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+/* The peak resident set size is only kept for the whole process, but
+ * Linux lets it be set back to the current size; elsewhere, the column
+ * shows the peak since the benchmark started. */
+static void reset_peak_rss ()
+{
+    FILE * file = fopen ("/proc/self/clear_refs", "w");
+    if (file)
+    {
+        fputs ("5", file);
+        fclose (file);
+    }
+}
+
+static double peak_rss_mib ()
+{
+    FILE * file = fopen ("/proc/self/status", "r");
+    if (file)
+    {
+        char line[256];
+        long kib = -1;
+
+        while (fgets (line, sizeof line, file))
+        {
+            if (! strncmp (line, "VmHWM:", 6))
+            {
+                kib = atol (line + 6);
+                break;
+            }
+        }
+
+        fclose (file);
+
+        if (kib >= 0)
+            return kib / 1024.0;
+    }
+
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, & usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+struct LoadedPlugin {
+    InputPlugin * plugin;
+    String path;
+    bool tried = false, ready = false;  /* init() is called when first needed */
+};
+
+enum class Check {None, Same, Differs, Missing};
+
+struct Result {
+    String file, format, plugin;
+    bool ok;
+    double audio, wall, cpu, rss;
+    long allocs;
+    uint64_t hash;
+    Check check;
+};
+
+/* a file's hash from the run given with --check, found by its name alone,
+ * since the corpus may be somewhere else by now */
+struct Reference {
+    String name;
+    uint64_t hash;
+};
+
+static Index<LoadedPlugin> plugins;
+static Index<Result> results;
+static Index<Reference> references;
+
+static const char * base_name (const char * path)
+{
+    const char * slash = strrchr (path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static InputPlugin * load_plugin (const char * path)
+{
+    void * handle = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+    if (! handle)
+    {
+        fprintf (stderr, "%s\n", dlerror ());
+        return nullptr;
+    }
+
+    auto plugin = (Plugin *) dlsym (handle, "aud_plugin_instance");
+
+    if (! plugin || plugin->magic != _AUD_PLUGIN_MAGIC ||
+     plugin->version != _AUD_PLUGIN_VERSION || plugin->type != PluginType::Input)
+    {
+        dlclose (handle);  /* not a decoder, or built for another version */
+        return nullptr;
+    }
+
+    return (InputPlugin *) plugin;
+}
+
+static bool is_module (const char * name)
+{
+    const char * ext = strrchr (name, '.');
+    return ext && (! strcmp (ext, ".so") || ! strcmp (ext, ".dylib") || ! strcmp (ext, ".dll"));
+}
+
+static Index<String> list_dir (const char * path)
+{
+    Index<String> names;
+    DIR * dir = opendir (path);
+    if (! dir)
+        return names;
+
+    struct dirent * entry;
+    while ((entry = readdir (dir)))
+    {
+        if (entry->d_name[0] != '.')
+            names.append (String (entry->d_name));
+    }
+
+    closedir (dir);
+
+    names.sort ([] (const String & a, const String & b)
+        { return strcmp (a, b); });
+
+    return names;
+}
+
+static void add_plugins (const char * path, int depth)
+{
+    DIR * dir = opendir (path);
+
+    if (! dir)
+    {
+        InputPlugin * plugin = is_module (path) ? load_plugin (path) : nullptr;
+        if (plugin)
+            plugins.append (LoadedPlugin {plugin, String (path)});
+        return;
+    }
+
+    closedir (dir);
+
+    for (const String & name : list_dir (path))
+    {
+        StringBuf full = filename_build ({path, name});
+
+        if (is_module (name) || depth > 0)
+            add_plugins (full, is_module (name) ? 0 : depth - 1);
+    }
+}
+
+static bool has_ext (InputPlugin * plugin, const char * ext)
+{
+    auto exts = plugin->input_info.keys[InputPlugin::Ext];
+
+    for (int i = 0; ext && exts && exts[i]; i ++)
+    {
+        if (! strcmp_nocase (exts[i], ext))
+            return true;
+    }
+
+    return false;
+}
+
+static bool ready (LoadedPlugin & loaded)
+{
+    if (! loaded.tried)
+    {
+        loaded.tried = true;
+        loaded.ready = loaded.plugin->init ();
+
+        if (! loaded.ready)
+            fprintf (stderr, "%s: init() failed\n", (const char *) loaded.path);
+    }
+
+    return loaded.ready;
+}
+
+/* the way Audacious probes: plugins for the extension first, in order of
+ * priority, trusting the extension if none of them recognizes the file;
+ * then any plugin that recognizes it */
+static LoadedPlugin * find_plugin (const char * uri, VFSFile & file)
+{
+    StringBuf ext = uri_get_extension (uri);
+    LoadedPlugin * by_ext = nullptr;
+
+    for (LoadedPlugin & loaded : plugins)
+    {
+        if (! has_ext (loaded.plugin, ext) || ! ready (loaded))
+            continue;
+
+        if (! by_ext)
+            by_ext = & loaded;
+
+        if (! file.fseek (0, VFS_SEEK_SET) && loaded.plugin->is_our_file (uri, file))
+            return & loaded;
+    }
+
+    if (by_ext)
+        return by_ext;
+
+    for (LoadedPlugin & loaded : plugins)
+    {
+        if (ready (loaded) && ! file.fseek (0, VFS_SEEK_SET) &&
+         loaded.plugin->is_our_file (uri, file))
+            return & loaded;
+    }
+
+    return nullptr;
+}
+
+static void run_file (const char * path, const Options & opts)
+{
+    if (opts.only && ! strstr (path, opts.only))
+        return;
+
+    StringBuf uri = filename_to_uri (path);
+    VFSFile probe (uri, "r");
+    if (! probe)
+    {
+        fprintf (stderr, "%s: %s\n", path, probe.error ());
+        return;
+    }
+
+    LoadedPlugin * loaded = find_plugin (uri, probe);
+    if (! loaded)
+        return;  /* not audio */
+
+    InputPlugin * plugin = loaded->plugin;
+
+    /* playback reads the tag first, untimed here */
+    Tuple tuple;
+    tuple.set_filename (uri);
+    if (! probe.fseek (0, VFS_SEEK_SET))
+        plugin->read_tag (uri, probe, tuple, nullptr);
+
+    probe = VFSFile ();
+
+    VFSFile file (uri, "r");
+    if (! file)
+        return;
+
+    sink.format = sink.rate = sink.channels = 0;
+    sink.bytes = sink.limit = 0;
+    sink.seconds = 0;
+    sink.limit_seconds = opts.seconds;
+    sink.hash = hash_start;
+    sink.tuple = std::move (tuple);
+
+    reset_peak_rss ();
+
+    allocations.store (0);
+    counting.store (true);
+
+    double wall = now_s (), cpu = cpu_s ();
+    bool ok = plugin->play (uri, file);
+    wall = now_s () - wall;
+    cpu = cpu_s () - cpu;
+
+    counting.store (false);
+
+    StringBuf ext = uri_get_extension (uri);
+    StringBuf format = str_tolower (ext ? (const char *) ext : "");
+    Result & result = results.append (Result {String (path), String (format),
+     String (plugin->info.name), ok, sink_seconds (), wall, cpu, peak_rss_mib (),
+     allocations.load (), sink.hash, Check::None});
+
+    sink.tuple = Tuple ();
+
+    if (opts.check)
+    {
+        result.check = Check::Missing;
+
+        for (const Reference & ref : references)
+        {
+            if (! strcmp (ref.name, base_name (path)))
+                result.check = (ref.hash == result.hash) ? Check::Same : Check::Differs;
+        }
+    }
+
+    char allocs_str[16], rate_str[16];
+    if (HAVE_ALLOC_COUNT)
+    {
+        snprintf (allocs_str, sizeof allocs_str, "%ld", result.allocs);
+        snprintf (rate_str, sizeof rate_str, "%.1f",
+         result.audio > 0 ? result.allocs / result.audio : 0.0);
+    }
+    else
+    {
+        strcpy (allocs_str, "-");
+        strcpy (rate_str, "-");
+    }
+
+    static const char * const check_str[] = {"", "", "  (differs)", "  (new)"};
+
+    printf ("%-32.32s %-6s %-20.20s %9.2f %10.1f %8.1f %9.1f %10s %9s%s%s\n", base_name (path),
+     (const char *) result.format, (const char *) result.plugin, result.audio,
+     result.audio / aud::max (wall, 1e-9), cpu * 1000, result.rss, allocs_str,
+     rate_str, ok ? "" : "  (failed)", check_str[(int) result.check]);
+}
+
+static void run_path (const char * path, const Options & opts)
+{
+    DIR * dir = opendir (path);
+
+    if (! dir)
+    {
+        run_file (path, opts);
+        return;
+    }
+
+    closedir (dir);
+
+    for (const String & name : list_dir (path))
+        run_path (filename_build ({path, name}), opts);
+}
+
+struct FormatTotal {
+    String format, plugin;
+    int files = 0;
+    double audio = 0, wall = 0, cpu = 0, rss = 0;
+    long allocs = 0;
+};
+
+static Index<FormatTotal> format_totals ()
+{
+    Index<FormatTotal> totals;
+
+    for (const Result & result : results)
+    {
+        FormatTotal * total = nullptr;
+
+        for (FormatTotal & t : totals)
+        {
+            if (t.format == result.format && t.plugin == result.plugin)
+                total = & t;
+        }
+
+        if (! total)
+            total = & totals.append (FormatTotal {result.format, result.plugin});
+
+        total->files ++;
+        total->audio += result.audio;
+        total->wall += result.wall;
+        total->cpu += result.cpu;
+        total->rss = aud::max (total->rss, result.rss);
+        total->allocs += result.allocs;
+    }
+
+    totals.sort ([] (const FormatTotal & a, const FormatTotal & b)
+        { return strcmp (a.format, b.format); });
+
+    return totals;
+}
+
+static void json_string (FILE * file, const char * str)
+{
+    fputc ('"', file);
+
+    for (; * str; str ++)
+    {
+        unsigned char c = * str;
+
+        if (c == '"' || c == '\\')
+            fprintf (file, "\\%c", c);
+        else if (c < 0x20)
+            fprintf (file, "\\u%04x", c);
+        else
+            fputc (c, file);
+    }
+
+    fputc ('"', file);
+}
+
+static void json_numbers (FILE * file, double audio, double wall, double cpu,
+ double rss, long allocs)
+{
+    fprintf (file, ", \"audio_s\": %.3f, \"wall_s\": %.6f, \"realtime\": %.3f, "
+     "\"cpu_s\": %.6f, \"peak_rss_mib\": %.1f", audio, wall,
+     audio / aud::max (wall, 1e-9), cpu, rss);
+
+    if (HAVE_ALLOC_COUNT)
+        fprintf (file, ", \"allocs\": %ld", allocs);
+    else
+        fprintf (file, ", \"allocs\": null");
+}
+
+static bool write_json (const char * path, const Options & opts,
+ const Index<FormatTotal> & totals)
+{
+    FILE * file = fopen (path, "w");
+    if (! file)
+    {
+        perror (path);
+        return false;
+    }
+
+    fprintf (file, "{\n  \"seconds_limit\": %g,\n  \"files\": [", opts.seconds);
+
+    for (int i = 0; i < results.len (); i ++)
+    {
+        const Result & result = results[i];
+
+        fprintf (file, "%s\n    {\"file\": ", i ? "," : "");
+        json_string (file, result.file);
+        fprintf (file, ", \"format\": ");
+        json_string (file, result.format);
+        fprintf (file, ", \"plugin\": ");
+        json_string (file, result.plugin);
+        fprintf (file, ", \"ok\": %s", result.ok ? "true" : "false");
+        json_numbers (file, result.audio, result.wall, result.cpu, result.rss, result.allocs);
+        fprintf (file, ", \"hash\": \"%016llx\"}", (unsigned long long) result.hash);
+    }
+
+    fprintf (file, "\n  ],\n  \"formats\": [");
+
+    for (int i = 0; i < totals.len (); i ++)
+    {
+        const FormatTotal & total = totals[i];
+
+        fprintf (file, "%s\n    {\"format\": ", i ? "," : "");
+        json_string (file, total.format);
+        fprintf (file, ", \"plugin\": ");
+        json_string (file, total.plugin);
+        fprintf (file, ", \"files\": %d", total.files);
+        json_numbers (file, total.audio, total.wall, total.cpu, total.rss, total.allocs);
+        fputc ('}', file);
+    }
+
+    fprintf (file, "\n  ]\n}\n");
+
+    if (fclose (file) < 0)
+    {
+        perror (path);
+        return false;
+    }
+
+    return true;
+}
+
+/* Reads back the file list of write_json(), which puts one file on each
+ * line: the name is the first string, and the hash the last. */
+static bool read_references (const char * path)
+{
+    FILE * file = fopen (path, "r");
+    if (! file)
+    {
+        perror (path);
+        return false;
+    }
+
+    char line[4096];
+    while (fgets (line, sizeof line, file))
+    {
+        const char * start = strstr (line, "{\"file\": \"");
+        const char * hash = strstr (line, "\"hash\": \"");
+        if (! start || ! hash)
+            continue;
+
+        char name[sizeof line];
+        int len = 0;
+
+        for (const char * c = start + 10; * c && * c != '"'; c ++)
+        {
+            if (* c == '\\' && c[1])
+                c ++;
+
+            name[len ++] = * c;
+        }
+
+        name[len] = 0;
+
+        references.append (Reference {String (base_name (name)),
+         (uint64_t) strtoull (hash + 9, nullptr, 16)});
+    }
+
+    fclose (file);
+
+    if (! references.len ())
+    {
+        fprintf (stderr, "%s: no files in it\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+static void usage ()
+{
+    fprintf (stderr,
+     "Usage: decoder-bench [options] FILE|DIR...\n"
+     "  --plugins PATH    input plugin or directory of them (may be repeated)\n"
+     "  --seconds N       decode at most N seconds of each file (all)\n"
+     "  --only TEXT       only files whose path contains TEXT\n"
+     "  --json FILE       also write the results to FILE\n"
+     "  --check FILE      compare the output with a JSON file from an earlier run\n"
+     "  --set S.NAME=VAL  set NAME in section S of the config (may be repeated)\n"
+     "   or: decoder-bench --write-tunes DIR\n");
+}
+
+int main (int argc, char * * argv)
+{
+    Options opts;
+    Index<const char *> paths, plugin_paths, settings;
+
+    for (int i = 1; i < argc; i ++)
+    {
+        const char * arg = argv[i];
+        const char * value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (arg[0] != '-')
+            paths.append (arg);
+        else if (! value)
+        {
+            usage ();
+            return 1;
+        }
+        else if (! strcmp (arg, "--plugins"))
+            plugin_paths.append (value), i ++;
+        else if (! strcmp (arg, "--seconds"))
+            opts.seconds = aud::max (0.0, atof (value)), i ++;
+        else if (! strcmp (arg, "--only"))
+            opts.only = value, i ++;
+        else if (! strcmp (arg, "--json"))
+            opts.json = value, i ++;
+        else if (! strcmp (arg, "--check"))
+            opts.check = value, i ++;
+        else if (! strcmp (arg, "--set"))
+            settings.append (value), i ++;
+        else if (! strcmp (arg, "--write-tunes"))
+            return (write_console_tunes (value) && write_xsf_tunes (value)) ? 0 : 1;
+        else
+        {
+            usage ();
+            return 1;
+        }
+    }
+
+    if (! plugin_paths.len () && default_dir)
+        plugin_paths.append (default_dir);
+
+    if (! paths.len () || ! plugin_paths.len ())
+    {
+        usage ();
+        return 1;
+    }
+
+    if (opts.check && ! read_references (opts.check))
+        return 1;
+
+    for (const char * setting : settings)
+    {
+        const char * dot = strchr (setting, '.');
+        const char * equals = dot ? strchr (dot, '=') : nullptr;
+
+        if (! equals)
+        {
+            usage ();
+            return 1;
+        }
+
+        aud_set_str (str_copy (setting, dot - setting),
+         str_copy (dot + 1, equals - dot - 1), equals + 1);
+    }
+
+    aud_init_paths ();
+
+    for (const char * path : plugin_paths)
+        add_plugins (path, 1);
+
+    plugins.sort ([] (const LoadedPlugin & a, const LoadedPlugin & b)
+        { return a.plugin->input_info.priority - b.plugin->input_info.priority; });
+
+    printf ("%-32s %-6s %-20s %9s %10s %8s %9s %10s %9s\n", "file", "format",
+     "plugin", "audio s", "x realtime", "cpu ms", "peak MiB", "allocs", "allocs/s");
+
+    for (const char * path : paths)
+        run_path (path, opts);
+
+    auto totals = format_totals ();
+
+    printf ("\n%-8s %-20s %5s %9s %10s %9s %9s %9s\n", "format", "plugin",
+     "files", "audio s", "x realtime", "cpu/s", "peak MiB", "allocs/s");
+
+    for (const FormatTotal & total : totals)
+    {
+        char rate_str[16];
+        if (HAVE_ALLOC_COUNT)
+            snprintf (rate_str, sizeof rate_str, "%.1f",
+             total.audio > 0 ? total.allocs / total.audio : 0.0);
+        else
+            strcpy (rate_str, "-");
+
+        printf ("%-8s %-20.20s %5d %9.1f %10.1f %9.4f %9.1f %9s\n",
+         (const char *) total.format, (const char *) total.plugin, total.files,
+         total.audio, total.audio / aud::max (total.wall, 1e-9),
+         total.audio > 0 ? total.cpu / total.audio : 0.0, total.rss, rate_str);
+    }
+
+    bool written = ! opts.json || write_json (opts.json, opts, totals);
+
+    int differ = 0;
+    for (const Result & result : results)
+    {
+        if (result.check == Check::Differs)
+            differ ++;
+    }
+
+    if (differ)
+        printf ("\n%d of %d files do not decode as in %s.\n", differ, results.len (), opts.check);
+
+    for (LoadedPlugin & loaded : plugins)
+    {
+        if (loaded.ready)
+            loaded.plugin->cleanup ();
+    }
+
+    results.clear ();
+    plugins.clear ();
+
+    aud_cleanup_paths ();
+    return (written && ! differ) ? 0 : 1;
+}
+
+/* InputPlugin's side of playback, with nothing behind it */
+
+void InputPlugin::open_audio (int format, int rate, int channels)
+{
+    sink.seconds = sink_seconds ();
+    sink.format = format;
+    sink.rate = rate;
+    sink.channels = channels;
+    sink.bytes = 0;
+
+    double left = sink.limit_seconds - sink.seconds;
+    sink.limit = (sink.limit_seconds > 0) ?
+     aud::max ((int64_t) 1, (int64_t) (left * FMT_SIZEOF (format) * channels * rate)) : 0;
+}
+
+void InputPlugin::set_replay_gain (const ReplayGainInfo & gain) {}
+
+void InputPlugin::write_audio (const void * data, int length)
+{
+    int64_t hashed = length;
+    if (sink.limit)
+        hashed = aud::clamp (sink.limit - sink.bytes, (int64_t) 0, hashed);
+
+    sink.hash = hash_bytes (sink.hash, data, hashed);
+    sink.bytes += length;
+}
+
+Tuple InputPlugin::get_playback_tuple ()
+{
+    return sink.tuple.ref ();
+}
+
+void InputPlugin::set_playback_tuple (Tuple && tuple)
+{
+    sink.tuple = std::move (tuple);
+}
+
+void InputPlugin::set_stream_bitrate (int bitrate) {}
+
+bool InputPlugin::check_stop ()
+{
+    return sink.limit && sink.bytes >= sink.limit;
+}
+
+int InputPlugin::check_seek ()
+{
+    return -1;
+}
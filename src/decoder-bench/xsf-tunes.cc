@@ -0,0 +1,234 @@
+/*
+ * Synthetic Tunes for the Decoder Benchmark
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Tunes for the xsf plugin, in the spirit of console-tunes.cc.  Both keep
+ * the ARM7 in a sequencer loop for as long as they play, as 2SF drivers
+ * do, which is the case the ARM7 code cache (CommonSettings.arm7_code_cache)
+ * is for:
+ *
+ *   busy.2sf     an ARM loop in main memory that sets new pitches on three
+ *                channels from time to time
+ *   patched.2sf  a Thumb loop, copied into main memory first, that rewrites
+ *                one of its own instructions every 2048 turns of the loop,
+ *                so that the cache must throw away what it holds there
+ *
+ * Channel 0 plays the ARM7's own code as an 8-bit sample.  Neither tune has
+ * a length, so the plugin plays its default length, longer than the
+ * benchmark plays any file. */
+
+#include "xsf-tunes.h"
+#include "console-tunes.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include <libaudcore/audstrings.h>
+
+typedef Index<unsigned char> Tune;
+
+static void put32 (Tune & tune, uint32_t value)
+{
+    for (int i = 0; i < 4; i ++)
+        tune.append (value >> (8 * i));
+}
+
+static void put16 (Tune & tune, uint16_t value)
+{
+    tune.append (value);
+    tune.append (value >> 8);
+}
+
+static void set32 (Tune & tune, int pos, uint32_t value)
+{
+    for (int i = 0; i < 4; i ++)
+        tune[pos + i] = value >> (8 * i);
+}
+
+/* the ARM9 waits for an interrupt that never comes */
+static const uint32_t arm9_code[] = {
+    0xe3a00000,     /* mov r0,#0 */
+    0xee070f90,     /* l: mcr p15,0,r0,c7,c0,4 */
+    0xeafffffd      /* b l */
+};
+
+/* how both tunes start, turning channel 0 on; pool is the offset in the
+ * first ldr, from it to the literal pool */
+#define ARM7_START(pool) \
+    0xe59f0000 | (pool), /* ldr r0,=$04000500 (SOUNDCNT) */ \
+    0xe59f1000 | (pool), /* ldr r1,=$807f */ \
+    0xe1c010b0,     /* strh r1,[r0] (on, at full volume) */ \
+    0xe59f0000 | ((pool) - 4), /* ldr r0,=$04000400 (channel 0) */ \
+    0xe3a0178e,     /* mov r1,#$02380000 */ \
+    0xe5801004,     /* str r1,[r0,#4] (source) */ \
+    0xe3a01cfe,     /* mov r1,#$fe00 */ \
+    0xe1c010b8,     /* strh r1,[r0,#8] (timer) */ \
+    0xe3a01000,     /* mov r1,#0 */ \
+    0xe1c010ba,     /* strh r1,[r0,#10] (loop start) */ \
+    0xe3a01c01,     /* mov r1,#$100 */ \
+    0xe580100c,     /* str r1,[r0,#12] (length) */ \
+    0xe59f1000 | ((pool) - 0x24), /* ldr r1,=$a8400040 */ \
+    0xe5801000      /* str r1,[r0] (8-bit, looped, at half volume) */
+
+static const uint32_t busy_code[] = {
+    ARM7_START (0x80),
+    0xe3a04000,     /* mov r4,#0 */
+    0xe3a06000,     /* mov r6,#0 */
+    0xe2844001,     /* l: add r4,r4,#1 */
+    0xe1b05604,     /* movs r5,r4,lsl #12 */
+    0x1afffffc,     /* bne l */
+    0xe59f0044,     /* ldr r0,=$04000480 (channel 8) */
+    0xe1a01624,     /* mov r1,r4,lsr #12 */
+    0xe3811b3e,     /* orr r1,r1,#$f800 */
+    0xe1c010b8,     /* strh r1,[r0,#8] */
+    0xe59f1038,     /* ldr r1,=$e3400040 */
+    0xe2266001,     /* eor r6,r6,#1 */
+    0xe3560000,     /* cmp r6,#0 */
+    0x03a01000,     /* moveq r1,#0 */
+    0xe5801000,     /* str r1,[r0] (a square wave, every other time) */
+    0xe59f0028,     /* ldr r0,=$040004e0 (channel 14) */
+    0xe3a01b3f,     /* mov r1,#$fc00 */
+    0xe1c010b8,     /* strh r1,[r0,#8] */
+    0xe59f1020,     /* ldr r1,=$e0400020 */
+    0xe5801000,     /* str r1,[r0] (noise) */
+    0xeaffffed,     /* b l */
+    0x04000500, 0x0000807f, 0x04000400, 0xa8400040,
+    0x04000480, 0xe3400040, 0x040004e0, 0xe0400020
+};
+
+static const uint32_t patched_code[] = {
+    ARM7_START (0x54),
+    0xe28f0038,     /* adr r0,t */
+    0xe59f1028,     /* ldr r1,=$02390000 */
+    0xe59f2028,     /* ldr r2,=$40 */
+    0xe4903004,     /* c: ldr r3,[r0],#4 */
+    0xe4813004,     /* str r3,[r1],#4 */
+    0xe2522004,     /* subs r2,r2,#4 */
+    0xcafffffb,     /* bgt c */
+    0xe59f0018,     /* ldr r0,=$02390001 */
+    0xe12fff10,     /* bx r0 */
+    0x04000500, 0x0000807f, 0x04000400, 0xa8400040,
+    0x02390000, 0x00000040, 0x02390001
+};
+
+/* t: what is copied to $02390000 */
+static const uint16_t patched_thumb[] = {
+    0x2400,         /* movs r4,#0 */
+    0x4809,         /* l1: ldr r0,=$04000400 */
+    0x2500,         /* movs r5,#0 */
+    0x1c6d,         /* l2: adds r5,r5,#1 */
+    0x056e,         /* lsls r6,r5,#21 */
+    0xd1fc,         /* bne l2 */
+    0x230a,         /* p: movs r3,#10 */
+    0x18e4,         /* adds r4,r4,r3 */
+    0x4906,         /* ldr r1,=$fff */
+    0x4021,         /* ands r1,r4 */
+    0x4a06,         /* ldr r2,=$f000 */
+    0x4311,         /* orrs r1,r2 */
+    0x8101,         /* strh r1,[r0,#8] (a new pitch for channel 0) */
+    0x4a06,         /* ldr r2,=p */
+    0x4906,         /* ldr r1,=$ff */
+    0x4021,         /* ands r1,r4 */
+    0x4f06,         /* ldr r7,=$2300 */
+    0x4339,         /* orrs r1,r7 */
+    0x8011,         /* strh r1,[r2] (a new step at p) */
+    0xe7ec          /* b l1 */
+};
+
+static const uint32_t patched_thumb_pool[] = {
+    0x04000400, 0x00000fff, 0x0000f000, 0x0239000c, 0x000000ff, 0x00002300
+};
+
+/* A 2SF file holds, compressed, a part of a DS cartridge and where it goes;
+ * here the whole of one that has nothing but the code for both CPUs, the
+ * ARM9's at $200 and the ARM7's at $400. */
+enum {
+    ROM_ARM9 = 0x200,
+    ROM_ARM7 = 0x400,
+    ROM_SIZE = 0x1000
+};
+
+static Tune make_2sf (const Tune & arm7, const char * title)
+{
+    Tune program;
+    put32 (program, 0);             /* offset in the ROM */
+    put32 (program, ROM_SIZE);
+
+    Tune rom;
+    rom.insert (0, ROM_SIZE);
+    set32 (rom, 0x20, ROM_ARM9);
+    set32 (rom, 0x24, 0x02000000);  /* entry */
+    set32 (rom, 0x28, 0x02000000);  /* load */
+    set32 (rom, 0x2c, sizeof arm9_code);
+    set32 (rom, 0x30, ROM_ARM7);
+    set32 (rom, 0x34, 0x02380000);
+    set32 (rom, 0x38, 0x02380000);
+    set32 (rom, 0x3c, arm7.len ());
+
+    memcpy (& rom[ROM_ARM9], arm9_code, sizeof arm9_code);
+    memcpy (& rom[ROM_ARM7], arm7.begin (), arm7.len ());
+    program.insert (rom.begin (), -1, rom.len ());
+
+    uLongf size = compressBound (program.len ());
+    Tune packed;
+    packed.insert (0, size);
+    compress2 (packed.begin (), & size, program.begin (), program.len (), 9);
+    packed.remove (size, -1);
+
+    Tune tune;
+    tune.insert ((const unsigned char *) "PSF\x24", -1, 4);
+    put32 (tune, 0);                /* reserved area */
+    put32 (tune, packed.len ());
+    put32 (tune, crc32 (0, packed.begin (), packed.len ()));
+    tune.insert (packed.begin (), -1, packed.len ());
+
+    StringBuf tags = str_concat ({"[TAG]title=", title, "\n"});
+    tune.insert ((const unsigned char *) (const char *) tags, -1, tags.len ());
+
+    return tune;
+}
+
+static Tune busy_2sf ()
+{
+    Tune arm7;
+    for (uint32_t word : busy_code)
+        put32 (arm7, word);
+
+    return make_2sf (arm7, "Busy ARM7");
+}
+
+static Tune patched_2sf ()
+{
+    Tune arm7;
+    for (uint32_t word : patched_code)
+        put32 (arm7, word);
+    for (uint16_t half : patched_thumb)
+        put16 (arm7, half);
+    for (uint32_t word : patched_thumb_pool)
+        put32 (arm7, word);
+
+    return make_2sf (arm7, "Self-modifying ARM7");
+}
+
+bool write_xsf_tunes (const char * dir)
+{
+    return write_tune (dir, "busy.2sf", busy_2sf ()) &&
+     write_tune (dir, "patched.2sf", patched_2sf ());
+}
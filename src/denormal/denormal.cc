@@ -0,0 +1,163 @@
+/*
+ * Denormal Protection Plugin for Audacious
+ * Copyright 2024 Denormal Protection Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Feedback paths (echo, compressor and crossfade ramps, recursive filters)
+ * decay towards zero during silence and fade-outs, and on the way pass
+ * through the denormal range, where each operation can take a hundred
+ * times longer on x86.  This plugin does nothing to the sound itself; it
+ * keeps the rest of the effect chain out of that range in one of two ways:
+ *
+ *   Flush to zero: the CPU is told to treat denormals as zero (FTZ and DAZ
+ *   on x86, FZ on ARM).  This is a setting of the thread, so it covers every
+ *   effect that runs after this one on the playback thread, and from the
+ *   second buffer on, the ones before it as well.
+ *
+ *   Add noise: white noise at about -400 dB is added to the audio, which
+ *   keeps the following effects from decaying below it.  This also works on
+ *   CPUs without a flush-to-zero mode, but only for effects after this one. */
+
+#include <atomic>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define HAVE_FLUSH_TO_ZERO 1
+#elif defined(__aarch64__)
+#define HAVE_FLUSH_TO_ZERO 1
+#else
+#define HAVE_FLUSH_TO_ZERO 0
+#endif
+
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
+
+#include "../trace-common/trace.h"
+
+#define NOISE_LEVEL 1e-20f
+
+enum {
+    MODE_FLUSH_TO_ZERO,
+    MODE_NOISE
+};
+
+static const char * const denormal_defaults[] = {
+    "mode", aud::numeric_string<HAVE_FLUSH_TO_ZERO ? MODE_FLUSH_TO_ZERO : MODE_NOISE>::str,
+    nullptr
+};
+
+static std::atomic<bool> settings_changed;
+
+static void changed ()
+{
+    settings_changed = true;
+}
+
+static const PreferencesWidget denormal_widgets[] = {
+    WidgetLabel (N_("<b>Protection</b>")),
+    WidgetRadio (N_("Flush denormals to zero (fastest)"),
+        WidgetInt ("denormal", "mode", changed),
+        {MODE_FLUSH_TO_ZERO}),
+    WidgetRadio (N_("Add inaudible noise"),
+        WidgetInt ("denormal", "mode", changed),
+        {MODE_NOISE})
+};
+
+static const PluginPreferences denormal_prefs = {{denormal_widgets}};
+
+static const char denormal_about[] =
+ N_("Denormal Protection Plugin for Audacious\n"
+    "Copyright 2024 Denormal Protection Plugin Authors\n\n"
+    "Keeps the effects from slowing down during silence and fade-outs, "
+    "when very small numbers (denormals) appear in their feedback paths.  "
+    "The audio is not changed audibly.");
+
+class DenormalProtection : public EffectPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("Denormal Protection"),
+        PACKAGE,
+        denormal_about,
+        & denormal_prefs
+    };
+
+    constexpr DenormalProtection () : EffectPlugin (info, 0, true) {}
+
+    bool init () override;
+    Index<float> & process (Index<float> & data) override;
+};
+
+EXPORT DenormalProtection aud_plugin_instance;
+
+static int mode;
+static uint32_t noise_seed = 1;
+
+bool DenormalProtection::init ()
+{
+    aud_config_set_defaults ("denormal", denormal_defaults);
+    settings_changed = true;
+    return true;
+}
+
+/* cheap enough to check for every buffer, which also covers a new playback
+ * thread being started */
+static void set_flush_to_zero ()
+{
+#if defined(__SSE2__) || defined(__x86_64__)
+    /* FTZ is bit 15 and DAZ bit 6 of MXCSR */
+    unsigned csr = _mm_getcsr ();
+    if ((csr & 0x8040) != 0x8040)
+        _mm_setcsr (csr | 0x8040);
+#elif defined(__aarch64__)
+    /* FZ is bit 24 of FPCR */
+    uint64_t fpcr;
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+    if (! (fpcr & (1 << 24)))
+        __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr | (1 << 24)));
+#endif
+}
+
+static void add_noise (float * data, int samples)
+{
+    uint32_t seed = noise_seed;
+
+    for (int i = 0; i < samples; i ++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        data[i] += (int32_t) seed * (NOISE_LEVEL / 2147483648.0f);
+    }
+
+    noise_seed = seed;
+}
+
+Index<float> & DenormalProtection::process (Index<float> & data)
+{
+    TRACE_SPAN ("Denormal Protection process");
+    if (settings_changed.exchange (false))
+        mode = aud_get_int ("denormal", "mode");
+
+    if (mode == MODE_FLUSH_TO_ZERO && HAVE_FLUSH_TO_ZERO)
+        set_flush_to_zero ();
+    else
+        add_noise (data.begin (), data.len ());
+
+    return data;
+}
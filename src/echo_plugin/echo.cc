@@ -1,8 +1,12 @@
+#include <atomic>
+
 #include <libaudcore/i18n.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../trace-common/trace.h"
+
 #define MAX_DELAY 1000
 
 static const char echo_about[] =
@@ -17,16 +21,18 @@ static const char * const echo_defaults[] = {
  "volume", "50",
  nullptr};
 
+static void update_settings ();
+
 static const PreferencesWidget echo_widgets[] = {
     WidgetLabel (N_("<b>Echo</b>")),
     WidgetSpin (N_("Delay:"),
-        WidgetInt ("echo_plugin", "delay"),
+        WidgetInt ("echo_plugin", "delay", update_settings),
         {0, MAX_DELAY, 10, N_("ms")}),
     WidgetSpin (N_("Feedback:"),
-        WidgetInt ("echo_plugin", "feedback"),
+        WidgetInt ("echo_plugin", "feedback", update_settings),
         {0, 100, 1, "%"}),
     WidgetSpin (N_("Volume:"),
-        WidgetInt ("echo_plugin", "volume"),
+        WidgetInt ("echo_plugin", "volume", update_settings),
         {0, 100, 1, "%"})
 };
 
@@ -56,20 +62,38 @@ EXPORT EchoPlugin aud_plugin_instance;
 static Index<float> buffer;
 static int w_ofs;
 
+static int echo_channels = 0;
+static int echo_rate = 0;
+
+/* settings, read once when they change rather than for every buffer; the
+ * preferences window writes them while process() runs on the audio thread */
+static std::atomic<int> echo_delay (0);
+static std::atomic<float> echo_feedback (0);
+static std::atomic<float> echo_volume (0);
+
+static void update_settings ()
+{
+    echo_delay.store (aud_get_int ("echo_plugin", "delay"), std::memory_order_relaxed);
+    echo_feedback.store (aud_get_int ("echo_plugin", "feedback") / 100.0f,
+     std::memory_order_relaxed);
+    echo_volume.store (aud_get_int ("echo_plugin", "volume") / 100.0f,
+     std::memory_order_relaxed);
+}
+
 bool EchoPlugin::init ()
 {
     aud_config_set_defaults ("echo_plugin", echo_defaults);
+    update_settings ();
     return true;
 }
 
 void EchoPlugin::cleanup ()
 {
     buffer.clear ();
+    echo_channels = 0;
+    echo_rate = 0;
 }
 
-static int echo_channels = 0;
-static int echo_rate = 0;
-
 void EchoPlugin::start (int & channels, int & rate)
 {
     if (channels != echo_channels || rate != echo_rate)
@@ -82,33 +106,104 @@ void EchoPlugin::start (int & channels, int & rate)
 
         w_ofs = 0;
     }
+
+    update_settings ();
+}
+
+/* samples per block; a whole block is one or two vector operations with
+ * SSE, AVX or NEON */
+#define ECHO_BLOCK 8
+
+/* no sample depends on another one within a span, and blocks of a fixed
+ * size let the compiler vectorize this loop even at -O2 */
+static inline void echo_kernel (float * __restrict data, const float * r, float * w,
+ int len, float feedback, float volume)
+{
+    int i = 0;
+
+    for (; i + ECHO_BLOCK <= len; i += ECHO_BLOCK)
+    {
+        for (int j = 0; j < ECHO_BLOCK; j ++)
+        {
+            float in = data[i + j];
+            float buf = r[i + j];
+
+            data[i + j] = in + buf * volume;
+            w[i + j] = in + buf * feedback;
+        }
+    }
+
+    for (; i < len; i ++)
+    {
+        float in = data[i];
+        float buf = r[i];
+
+        data[i] = in + buf * volume;
+        w[i] = in + buf * feedback;
+    }
+}
+
+/* the part of the ring buffer read and the part written are disjoint ... */
+static void echo_span (float * __restrict data, const float * __restrict r,
+ float * __restrict w, int len, float feedback, float volume)
+{
+    echo_kernel (data, r, w, len, feedback, volume);
+}
+
+/* ... or the same, when the delay is zero or the whole buffer */
+static void echo_span_in_place (float * __restrict data, float * __restrict buf,
+ int len, float feedback, float volume)
+{
+    echo_kernel (data, buf, buf, len, feedback, volume);
 }
 
 Index<float> & EchoPlugin::process (Index<float> & data)
 {
-    int delay = aud_get_int ("echo_plugin", "delay");
-    float feedback = aud_get_int ("echo_plugin", "feedback") / 100.0f;
-    float volume = aud_get_int ("echo_plugin", "volume") / 100.0f;
+    TRACE_SPAN ("Echo process");
+    int len = buffer.len ();
+    if (! len)
+        return data;
+
+    /* one snapshot of the settings for the whole buffer */
+    int delay = echo_delay.load (std::memory_order_relaxed);
+    float feedback = echo_feedback.load (std::memory_order_relaxed);
+    float volume = echo_volume.load (std::memory_order_relaxed);
 
     int interval = aud::rescale (delay, 1000, echo_rate) * echo_channels;
-    interval = aud::clamp (interval, 0, buffer.len ());  // sanity check
+    interval = aud::clamp (interval, 0, len);  // sanity check
 
     int r_ofs = w_ofs - interval;
     if (r_ofs < 0)
-        r_ofs += buffer.len ();
-
-    float * end = data.end ();
+        r_ofs += len;
 
-    for (float * f = data.begin (); f < end; f++)
-    {
-        float in = * f;
-        float buf = buffer[r_ofs];
+    float * f = data.begin ();
+    int remain = data.len ();
 
-        * f = in + buf * volume;
-        buffer[w_ofs] = in + buf * feedback;
+    /* walk the ring buffer in contiguous spans: neither offset may wrap
+     * within one, and the part read may not overlap the part written */
+    int gap = aud::min (interval, len - interval);
 
-        r_ofs = (r_ofs + 1) % buffer.len ();
-        w_ofs = (w_ofs + 1) % buffer.len ();
+    while (remain > 0)
+    {
+        int span = aud::min (remain, aud::min (len - r_ofs, len - w_ofs));
+
+        if (gap > 0)
+        {
+            span = aud::min (span, gap);
+            echo_span (f, & buffer[r_ofs], & buffer[w_ofs], span, feedback, volume);
+        }
+        else
+            echo_span_in_place (f, & buffer[w_ofs], span, feedback, volume);
+
+        f += span;
+        remain -= span;
+
+        r_ofs += span;
+        if (r_ofs == len)
+            r_ofs = 0;
+        w_ofs += span;
+        if (w_ofs == len)
+            w_ofs = 0;
     }
 
     return data;
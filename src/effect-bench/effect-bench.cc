@@ -0,0 +1,449 @@
+/*
+ * Effect Plugin Benchmark for Audacious
+ * Copyright 2024 Effect Benchmark Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Loads effect plugins outside Audacious and times them on synthetic audio.
+ * Each plugin is run through start(), process(), flush() and finish() the
+ * way the output code does, for every combination of the requested rates
+ * and channel counts, and for each one the table shows:
+ *
+ *   ns/frame    time per input frame in process(), after a warm-up
+ *   allocs      heap allocations per process() call in the steady state
+ *   frees       the same for deallocations
+ *   total       allocations from start() to finish(), warm-up included
+ *   latency     what adjust_delay() adds, in milliseconds
+ *   out/in      output frames per input frame
+ *
+ * Built with "meson setup -Deffect-bench=true"; "meson test --benchmark"
+ * runs it on the plugins in the build tree.  Plugins are loaded from the
+ * files or directories (searched one level deep) given on the command line,
+ * or from the installed effect plugin directory.
+ *
+ * With --silence, each second of audio is a short burst followed by digital
+ * silence, which is where feedback paths decay into denormals; running that
+ * again with "--before denormal.so" shows what the Denormal Protection
+ * plugin saves. */
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/index.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/runtime.h>
+
+#ifdef EFFECT_PLUGIN_DIR
+static const char * const default_dir = EFFECT_PLUGIN_DIR;
+#else
+static const char * const default_dir = nullptr;
+#endif
+
+struct Options {
+    Index<int> rates, channels;
+    int block = 1024;       /* frames per process() call */
+    double seconds = 5;     /* of audio timed per case */
+    const char * only = nullptr;
+    double warn = 0;        /* steady-state allocations per call */
+    bool silence = false;   /* mostly silent signal */
+    EffectPlugin * before = nullptr;  /* run untimed ahead of each plugin */
+};
+
+/* Counting allocations works by wrapping the C library's malloc(), which
+ * operator new and Index both end up in; only calls made by the benchmark
+ * thread between start() and finish() are counted, so threads a plugin
+ * starts itself are left out.  A realloc() counts as an allocation, since
+ * moving the block is what costs time. */
+#ifdef __GLIBC__
+extern "C" {
+void * __libc_malloc (size_t size);
+void * __libc_calloc (size_t n, size_t size);
+void * __libc_realloc (void * ptr, size_t size);
+void __libc_free (void * ptr);
+
+static __thread bool counting;
+static __thread long allocations, deallocations;
+
+void * malloc (size_t size)
+{
+    if (counting)
+        allocations ++;
+    return __libc_malloc (size);
+}
+
+void * calloc (size_t n, size_t size)
+{
+    if (counting)
+        allocations ++;
+    return __libc_calloc (n, size);
+}
+
+void * realloc (void * ptr, size_t size)
+{
+    if (counting)
+        allocations ++;
+    return __libc_realloc (ptr, size);
+}
+
+void free (void * ptr)
+{
+    if (counting && ptr)
+        deallocations ++;
+    __libc_free (ptr);
+}
+}
+#define HAVE_ALLOC_COUNT 1
+#else
+static bool counting;
+static long allocations, deallocations;
+#define HAVE_ALLOC_COUNT 0
+#endif
+
+static double now_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* noise at -20 dBFS with a 1 kHz tone on top, different in each channel;
+ * if silent, only the first 100 ms */
+static void make_signal (Index<float> & signal, int channels, int rate,
+ int frames, bool silent)
+{
+    uint32_t seed = 12345;
+
+    signal.resize (channels * frames);
+
+    int loud = silent ? aud::min (frames, rate / 10) : frames;
+
+    for (int i = 0; i < loud; i ++)
+    {
+        for (int c = 0; c < channels; c ++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            float noise = (int32_t) seed * (0.1f / 2147483648.0f);
+            float tone = 0.25f * sinf (2 * M_PI * 1000 * i / rate + c);
+            signal[i * channels + c] = noise + tone;
+        }
+    }
+}
+
+static EffectPlugin * load_plugin (const char * path)
+{
+    void * handle = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+    if (! handle)
+    {
+        fprintf (stderr, "%s\n", dlerror ());
+        return nullptr;
+    }
+
+    auto plugin = (Plugin *) dlsym (handle, "aud_plugin_instance");
+
+    if (! plugin || plugin->magic != _AUD_PLUGIN_MAGIC ||
+     plugin->version != _AUD_PLUGIN_VERSION || plugin->type != PluginType::Effect)
+    {
+        dlclose (handle);  /* not an effect, or built for another version */
+        return nullptr;
+    }
+
+    return (EffectPlugin *) plugin;
+}
+
+static void format_count (char * buf, int size, double count)
+{
+    if (HAVE_ALLOC_COUNT)
+        snprintf (buf, size, "%.2f", count);
+    else
+        snprintf (buf, size, "-");
+}
+
+/* false if the plugin allocates in the steady state */
+static bool run_case (EffectPlugin * plugin, const Options & opts, int channels, int rate)
+{
+    Index<float> signal;
+    make_signal (signal, channels, rate, rate, opts.silence);  /* one second, looped */
+
+    Index<float> data;
+    data.resize (opts.block * channels);  /* so that filling it never allocates */
+
+    allocations = deallocations = 0;
+    counting = true;
+
+    if (opts.before)
+    {
+        int before_channels = channels, before_rate = rate;
+        opts.before->start (before_channels, before_rate);
+    }
+
+    int out_channels = channels, out_rate = rate;
+    plugin->start (out_channels, out_rate);
+
+    int signal_frames = signal.len () / channels;
+    int warmup_calls = aud::max (1, rate / opts.block);
+    int calls = aud::max (1, (int) (opts.seconds * rate / opts.block));
+
+    int pos = 0;
+    int64_t in_frames = 0, out_samples = 0;
+    double elapsed = 0;
+    long allocs = 0, frees = 0;
+
+    for (int i = 0; i < warmup_calls + calls; i ++)
+    {
+        int block = aud::min (opts.block, signal_frames - pos);
+
+        data.resize (0);
+        data.insert (& signal[pos * channels], 0, block * channels);
+        pos = (pos + block) % signal_frames;
+
+        if (opts.before)
+            opts.before->process (data);
+
+        bool timed = (i >= warmup_calls);
+
+        long allocs_before = allocations, frees_before = deallocations;
+        double start = now_ns ();
+
+        Index<float> & out = plugin->process (data);
+
+        double end = now_ns ();
+
+        if (timed)
+        {
+            elapsed += end - start;
+            allocs += allocations - allocs_before;
+            frees += deallocations - frees_before;
+            in_frames += block;
+            out_samples += out.len ();
+        }
+    }
+
+    int latency = plugin->adjust_delay (0);
+
+    /* the other calls are not timed, but should not crash */
+    plugin->flush (false);
+    data.resize (0);
+    data.insert (signal.begin (), 0, opts.block * channels);
+    plugin->process (data);
+    plugin->finish (data, true);
+
+    counting = false;
+
+    char allocs_str[16], frees_str[16], total_str[16];
+    format_count (allocs_str, sizeof allocs_str, (double) allocs / calls);
+    format_count (frees_str, sizeof frees_str, (double) frees / calls);
+    format_count (total_str, sizeof total_str, allocations);
+
+    printf ("%-28s %6d %3d  %10.2f %8s %8s %8s %9d %8.3f\n", plugin->info.name,
+     rate, channels, elapsed / in_frames, allocs_str, frees_str, total_str,
+     latency, (double) out_samples / out_channels / in_frames);
+
+    return ! HAVE_ALLOC_COUNT || (double) allocs / calls <= opts.warn;
+}
+
+static int warnings;
+
+static void run_plugin (const char * path, const Options & opts)
+{
+    EffectPlugin * plugin = load_plugin (path);
+    if (! plugin)
+        return;
+
+    if (opts.only && ! strstr_nocase (plugin->info.name, opts.only) &&
+     ! strstr (path, opts.only))
+        return;
+
+    /* nothing should run behind the benchmark's back */
+    aud_set_bool ("loudness", "scan", false);
+
+    if (! plugin->init ())
+    {
+        fprintf (stderr, "%s: init() failed\n", path);
+        return;
+    }
+
+    bool steady = true;
+
+    for (int rate : opts.rates)
+    {
+        for (int channels : opts.channels)
+            steady = run_case (plugin, opts, channels, rate) && steady;
+    }
+
+    plugin->cleanup ();
+
+    if (! steady)
+    {
+        fprintf (stderr, "warning: %s allocates more than %g times per "
+         "process() call in the steady state\n", plugin->info.name, opts.warn);
+        warnings ++;
+    }
+}
+
+static bool is_module (const char * name)
+{
+    const char * ext = strrchr (name, '.');
+    return ext && (! strcmp (ext, ".so") || ! strcmp (ext, ".dylib") || ! strcmp (ext, ".dll"));
+}
+
+static void run_path (const char * path, const Options & opts, int depth)
+{
+    DIR * dir = opendir (path);
+
+    if (! dir)
+    {
+        if (is_module (path))
+            run_plugin (path, opts);
+        return;
+    }
+
+    Index<String> names;
+    struct dirent * entry;
+
+    while ((entry = readdir (dir)))
+    {
+        if (entry->d_name[0] != '.')
+            names.append (String (entry->d_name));
+    }
+
+    closedir (dir);
+
+    names.sort ([] (const String & a, const String & b)
+        { return strcmp (a, b); });
+
+    for (const String & name : names)
+    {
+        StringBuf full = filename_build ({path, name});
+
+        if (is_module (name))
+            run_plugin (full, opts);
+        else if (depth > 0)
+            run_path (full, opts, depth - 1);
+    }
+}
+
+static void parse_list (const char * arg, Index<int> & list)
+{
+    list.clear ();
+    for (const String & item : str_list_to_index (arg, ","))
+        list.append (atoi (item));
+}
+
+static void usage ()
+{
+    fprintf (stderr,
+     "Usage: effect-bench [options] [PLUGIN.so|DIR]...\n"
+     "  --rates LIST      sample rates (44100,48000,96000)\n"
+     "  --channels LIST   channel counts (1,2,6)\n"
+     "  --block N         frames per process() call (1024)\n"
+     "  --seconds N       seconds of audio timed per case (5)\n"
+     "  --only NAME       only plugins whose name or path contains NAME\n"
+     "  --warn N          warn about more steady-state allocations per call (0)\n"
+     "  --strict          fail if there were any warnings\n"
+     "  --silence         time a short burst followed by silence\n"
+     "  --before PLUGIN   run another effect (untimed) ahead of each\n");
+}
+
+int main (int argc, char * * argv)
+{
+    Options opts;
+    Index<const char *> paths;
+    bool strict = false;
+    const char * before_path = nullptr;
+
+    parse_list ("44100,48000,96000", opts.rates);
+    parse_list ("1,2,6", opts.channels);
+
+    for (int i = 1; i < argc; i ++)
+    {
+        const char * arg = argv[i];
+        const char * value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (arg[0] != '-')
+            paths.append (arg);
+        else if (! strcmp (arg, "--strict"))
+            strict = true;
+        else if (! strcmp (arg, "--silence"))
+            opts.silence = true;
+        else if (! value)
+        {
+            usage ();
+            return 1;
+        }
+        else if (! strcmp (arg, "--rates"))
+            parse_list (value, opts.rates), i ++;
+        else if (! strcmp (arg, "--channels"))
+            parse_list (value, opts.channels), i ++;
+        else if (! strcmp (arg, "--block"))
+            opts.block = aud::max (1, atoi (value)), i ++;
+        else if (! strcmp (arg, "--seconds"))
+            opts.seconds = aud::max (0.1, atof (value)), i ++;
+        else if (! strcmp (arg, "--only"))
+            opts.only = value, i ++;
+        else if (! strcmp (arg, "--warn"))
+            opts.warn = aud::max (0.0, atof (value)), i ++;
+        else if (! strcmp (arg, "--before"))
+            before_path = value, i ++;
+        else
+        {
+            usage ();
+            return 1;
+        }
+    }
+
+    if (! paths.len ())
+    {
+        if (! default_dir)
+        {
+            usage ();
+            return 1;
+        }
+
+        paths.append (default_dir);
+    }
+
+    aud_init_paths ();
+
+    if (before_path)
+    {
+        opts.before = load_plugin (before_path);
+
+        if (! opts.before || ! opts.before->init ())
+        {
+            fprintf (stderr, "%s: cannot be used with --before\n", before_path);
+            aud_cleanup_paths ();
+            return 1;
+        }
+    }
+
+    printf ("%-28s %6s %3s  %10s %8s %8s %8s %9s %8s\n", "plugin", "rate", "ch",
+     "ns/frame", "allocs", "frees", "total", "latency", "out/in");
+
+    for (const char * path : paths)
+        run_path (path, opts, 1);
+
+    if (opts.before)
+        opts.before->cleanup ();
+
+    aud_cleanup_paths ();
+    return (strict && warnings) ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * lookahead-peak.h
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_LOOKAHEAD_PEAK_H
+#define AUD_LOOKAHEAD_PEAK_H
+
+#include <libaudcore/index.h>
+#include <libaudcore/templates.h>
+
+/* The level that a gain stage with a lookahead of <lookahead> frames works
+ * from, for a plugin that holds each frame back that long in a delay line.
+ * Each frame's level is pushed in as it arrives; what comes back is the
+ * maximum over the last lookahead + 1 levels, averaged over the last
+ * <lookahead> of those maximums.  It thus ramps up over the lookahead and
+ * reaches a loud level just as that frame comes out of the delay line.
+ *
+ * The maximum is kept with a monotonic queue, so each frame costs the same
+ * however long the lookahead is.  The compressor (in its lookahead mode)
+ * and the limiter of the multiband compressor use this. */
+class LookaheadPeak
+{
+public:
+    void init (int lookahead)
+    {
+        m_window = lookahead + 1;
+        m_pos.resize (m_window);
+        m_val.resize (m_window);
+        m_averaged.resize (lookahead);
+        reset ();
+    }
+
+    void clear ()
+    {
+        m_pos.clear ();
+        m_val.clear ();
+        m_averaged.clear ();
+        m_window = 0;
+    }
+
+    void reset ()
+    {
+        m_head = m_count = m_time = 0;
+        m_averaged.erase (0, -1);
+        m_sum = 0;
+        m_average_pos = 0;
+    }
+
+    float push (float level)
+    {
+        float peak = push_max (level);
+
+        m_sum += peak - m_averaged[m_average_pos];
+        m_averaged[m_average_pos] = peak;
+        if (++ m_average_pos == m_averaged.len ())
+            m_average_pos = 0;
+
+        /* rounding can leave the sum a hair below zero after silence */
+        return aud::max (0.0f, (float) (m_sum / m_averaged.len ()));
+    }
+
+private:
+    /* the maximum of the last <m_window> values */
+    float push_max (float value)
+    {
+        /* drop values that can never be the maximum again ... */
+        while (m_count && m_val[back ()] <= value)
+            m_count --;
+
+        /* ... and the one that has left the window */
+        if (m_count && m_time - m_pos[m_head] >= (unsigned) m_window)
+            pop_front ();
+
+        int slot = m_head + m_count;
+        if (slot >= m_window)
+            slot -= m_window;
+
+        m_pos[slot] = m_time ++;
+        m_val[slot] = value;
+        m_count ++;
+
+        return m_val[m_head];
+    }
+
+    int back () const
+    {
+        int slot = m_head + m_count - 1;
+        return (slot >= m_window) ? slot - m_window : slot;
+    }
+
+    void pop_front ()
+    {
+        if (++ m_head == m_window)
+            m_head = 0;
+        m_count --;
+    }
+
+    Index<unsigned> m_pos;      /* when each value was pushed */
+    Index<float> m_val;
+    int m_window = 0, m_head = 0, m_count = 0;
+    unsigned m_time = 0;        /* wraps around harmlessly */
+
+    Index<float> m_averaged;    /* last <lookahead> maximums */
+    double m_sum = 0;
+    int m_average_pos = 0;
+};
+
+#endif
@@ -32,6 +32,9 @@
 #include <libaudcore/multihash.h>
 #include <libaudcore/runtime.h>
 
+#include "../vfs-common/track-prefetch.h"
+#include "../trace-common/trace.h"
+
 #if CHECK_LIBAVFORMAT_VERSION (57, 33, 100)
 #define ALLOC_CONTEXT 1
 #endif
@@ -40,6 +43,10 @@
 #define SEND_PACKET 1
 #endif
 
+/* limits for avformat_find_stream_info() when only reading tags */
+#define LIGHT_PROBESIZE (256 * 1024)
+#define LIGHT_ANALYZE_DURATION (AV_TIME_BASE / 2)
+
 class FFaudio : public InputPlugin
 {
 public:
@@ -113,11 +120,8 @@ struct ScopedPacket
     ScopedPacket () { ptr = av_packet_alloc (); }
     ~ScopedPacket () { av_packet_free (& ptr); }
 
-    void clear ()
-    {
-        av_packet_free (& ptr);
-        ptr = av_packet_alloc ();
-    }
+    /* leaves an empty packet, as from av_packet_alloc() */
+    void clear () { av_packet_unref (ptr); }
 #else
     ScopedPacket ()
     {
@@ -227,6 +231,8 @@ bool FFaudio::init ()
 void FFaudio::cleanup ()
 {
     extension_dict.clear ();
+    io_context_cleanup ();
+    track_prefetch_cleanup ();
 
 #if ! CHECK_LIBAVCODEC_VERSION(58, 9, 100)
     av_lockmgr_register (nullptr);
@@ -372,10 +378,8 @@ static void close_input_file (AVFormatContext * c)
     io_context_free (io);
 }
 
-static bool find_codec (AVFormatContext * c, CodecInfo * cinfo)
+static bool find_audio_stream (AVFormatContext * c, CodecInfo * cinfo)
 {
-    avformat_find_stream_info (c, nullptr);
-
     for (unsigned i = 0; i < c->nb_streams; i++)
     {
         AVStream * stream = c->streams[i];
@@ -402,6 +406,40 @@ static bool find_codec (AVFormatContext * c, CodecInfo * cinfo)
     return false;
 }
 
+/* in milliseconds, or -1 if not known yet */
+static int64_t get_length (AVFormatContext * c, const CodecInfo & cinfo)
+{
+    if (c->duration > 0)
+        return c->duration / 1000;
+
+    AVStream * stream = cinfo.stream;
+    if (stream->duration > 0 && stream->duration != (int64_t) AV_NOPTS_VALUE)
+        return av_rescale_q (stream->duration, stream->time_base, {1, 1000});
+
+    return -1;
+}
+
+/* With light set, the stream info is not read if the container headers
+ * already give the codec and length, as they do for most files with an
+ * index (MP4, Matroska, Ogg, ASF, WAV and so on); avformat_find_stream_info()
+ * decodes frames to fill in whatever is missing.  If it does have to run,
+ * it is limited to the start of the file, since only the tags and a rough
+ * length are wanted. */
+static bool find_codec (AVFormatContext * c, CodecInfo * cinfo, bool light = false)
+{
+    if (light)
+    {
+        if (find_audio_stream (c, cinfo) && get_length (c, * cinfo) >= 0)
+            return true;
+
+        c->probesize = LIGHT_PROBESIZE;
+        c->max_analyze_duration = LIGHT_ANALYZE_DURATION;
+    }
+
+    avformat_find_stream_info (c, nullptr);
+    return find_audio_stream (c, cinfo);
+}
+
 bool FFaudio::is_our_file (const char * filename, VFSFile & file)
 {
     return (bool) get_format (filename, file);
@@ -462,13 +500,21 @@ bool FFaudio::read_tag (const char * filename, VFSFile & file, Tuple & tuple, In
         return false;
 
     CodecInfo cinfo;
-    if (! find_codec (ic.get (), & cinfo))
+    if (! find_codec (ic.get (), & cinfo, true))
         return false;
 
-    if (ic->duration > 0 && ic->duration / 1000 <= INT_MAX)
-        tuple.set_int (Tuple::Length, ic->duration / 1000);
-    if (ic->bit_rate > 0 && ic->bit_rate / 1000 <= INT_MAX)
-        tuple.set_int (Tuple::Bitrate, ic->bit_rate / 1000);
+    int64_t length = get_length (ic.get (), cinfo);
+    if (length > 0 && length <= INT_MAX)
+        tuple.set_int (Tuple::Length, length);
+
+    /* without the stream info, the overall bitrate may not be known yet */
+    int64_t bitrate = ic->bit_rate;
+    int64_t size = ic->pb ? avio_size (ic->pb) : -1;
+    if (bitrate <= 0 && size > 0 && length > 0)
+        bitrate = size * 8000 / length;
+
+    if (bitrate > 0 && bitrate / 1000 <= INT_MAX)
+        tuple.set_int (Tuple::Bitrate, bitrate / 1000);
 
     if (cinfo.codec->long_name)
         tuple.set_str (Tuple::Codec, cinfo.codec->long_name);
@@ -562,10 +608,23 @@ bool FFaudio::play (const char * filename, VFSFile & file)
     set_stream_bitrate(ic->bit_rate);
     open_audio(out_fmt, context->sample_rate, channels);
 
+    TrackPrefetch prefetch (get_playback_tuple ().get_int (Tuple::Length));
+    prefetch.set_format (out_fmt, context->sample_rate, channels);
+
     int errcount = 0;
     bool eof = false;
 
+    /* one packet and frame for the whole stream; FFmpeg keeps the buffers
+     * they refer to in pools of its own */
+    ScopedPacket pkt;
+    ScopedFrame frame;
+
+    /* a mono stream needs no interleaving */
+    bool interlace = planar && channels > 1;
+
     Index<char> buf;
+    if (interlace && context->frame_size > 0)
+        buf.resize (FMT_SIZEOF (out_fmt) * channels * context->frame_size);
 
     while (! eof && ! check_stop ())
     {
@@ -576,10 +635,12 @@ bool FFaudio::play (const char * filename, VFSFile & file)
             if (LOG (av_seek_frame, ic.get (), -1, (int64_t) seek_value *
              AV_TIME_BASE / 1000, AVSEEK_FLAG_ANY) >= 0)
                 errcount = 0;
+
+            prefetch.seeked (seek_value);
         }
 
         /* Read next frame (or more) of data */
-        ScopedPacket pkt;
+        pkt.clear ();
         int ret = LOG (av_read_frame, ic.get (), pkt.ptr);
 
         if (ret < 0)
@@ -615,8 +676,7 @@ bool FFaudio::play (const char * filename, VFSFile & file)
 
         while (! check_stop ())
         {
-            ScopedFrame frame;
-
+            TRACE_SPAN ("FFmpeg play");
 #ifdef SEND_PACKET
             if (LOG (avcodec_receive_frame, context.ptr, frame.ptr) < 0)
                 break; /* read next packet (continue past errors) */
@@ -641,7 +701,7 @@ bool FFaudio::play (const char * filename, VFSFile & file)
 
             int size = FMT_SIZEOF (out_fmt) * channels * frame->nb_samples;
 
-            if (planar)
+            if (interlace)
             {
                 if (size > buf.len ())
                     buf.resize (size);
@@ -652,6 +712,8 @@ bool FFaudio::play (const char * filename, VFSFile & file)
             }
             else
                 write_audio (frame->data[0], size);
+
+            prefetch.written (size);
         }
     }
 
@@ -19,7 +19,16 @@
 #define WANT_VFS_STDIO_COMPAT
 #include "ffaudio-stdinc.h"
 
+#include <pthread.h>
+
 #define IOBUF 4096
+#define POOL_SIZE 4
+
+/* Buffers are kept for the next file rather than freed, since a playlist
+ * scan opens one context after another, several of them at once. */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void * pool[POOL_SIZE];
+static int pooled;
 
 static int read_cb (void * file, unsigned char * buf, int size)
 {
@@ -38,12 +47,42 @@ static int64_t seek_cb (void * file, int64_t offset, int whence)
 
 AVIOContext * io_context_new (VFSFile & file)
 {
-    void * buf = av_malloc (IOBUF);
+    void * buf = nullptr;
+
+    pthread_mutex_lock (& pool_mutex);
+    if (pooled)
+        buf = pool[-- pooled];
+    pthread_mutex_unlock (& pool_mutex);
+
+    if (! buf)
+        buf = av_malloc (IOBUF);
+
     return avio_alloc_context ((unsigned char *) buf, IOBUF, 0, & file, read_cb, nullptr, seek_cb);
 }
 
 void io_context_free (AVIOContext * io)
 {
-    av_free (io->buffer);
+    /* FFmpeg may have replaced the buffer with one of another size */
+    bool keep = false;
+
+    if (io->buffer_size == IOBUF)
+    {
+        pthread_mutex_lock (& pool_mutex);
+        if ((keep = (pooled < POOL_SIZE)))
+            pool[pooled ++] = io->buffer;
+        pthread_mutex_unlock (& pool_mutex);
+    }
+
+    if (! keep)
+        av_free (io->buffer);
+
     av_free (io);
 }
+
+void io_context_cleanup ()
+{
+    pthread_mutex_lock (& pool_mutex);
+    while (pooled)
+        av_free (pool[-- pooled]);
+    pthread_mutex_unlock (& pool_mutex);
+}
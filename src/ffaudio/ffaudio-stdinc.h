@@ -34,5 +34,6 @@ extern "C" {
 
 AVIOContext * io_context_new (VFSFile & file);
 void io_context_free (AVIOContext * context);
+void io_context_cleanup ();
 
 #endif
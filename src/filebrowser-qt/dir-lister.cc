@@ -0,0 +1,187 @@
+/*
+ * File Browser Plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "dir-lister.h"
+
+#include <QDir>
+#include <QFileInfo>
+
+#include <libaudcore/runtime.h>
+
+DirLister::DirLister(CheckFunc checked, CoverFunc covered)
+    : m_checked(std::move(checked)), m_covered(std::move(covered))
+{
+    m_thread = std::thread(&DirLister::run, this);
+}
+
+DirLister::~DirLister()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+        m_cond.notify_all();
+    }
+
+    m_thread.join();
+    m_deliver.stop();
+}
+
+void DirLister::submit(Job && job)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    /* a folder waiting to be looked at already is not queued twice */
+    for (const Job & queued : m_jobs)
+    {
+        if (queued.type == job.type && queued.path == job.path)
+            return;
+    }
+
+    m_jobs.append(std::move(job));
+    m_cond.notify_all();
+}
+
+void DirLister::checkDirectory(const QString & path)
+{
+    submit({Job::Check, path});
+}
+
+void DirLister::lookUpCover(const QString & path)
+{
+    submit({Job::Cover, path});
+}
+
+bool DirLister::cachedCover(const QString & path, QString & cover, bool refresh)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_listings.find(path);
+        if (it == m_listings.end())
+            return false;
+
+        it->used = ++m_clock;
+        cover = findCover(*it, path);
+    }
+
+    if (refresh)
+        lookUpCover(path);
+
+    return true;
+}
+
+/* as the cover names are set now, so that a change applies at once */
+QString DirLister::findCover(const Listing & listing, const QString & path) const
+{
+    String coverNames = aud_get_str("cover_name_include");
+    QStringList nameFilter = QString(coverNames).remove(' ').split(',');
+
+    for (const QString & name : listing.images)
+    {
+        if (nameFilter.contains(QFileInfo(name).baseName(), Qt::CaseInsensitive))
+            return QDir(path).filePath(name);
+    }
+
+    return QString();
+}
+
+void DirLister::deliver()
+{
+    Index<Result> results;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        results = std::move(m_results);
+    }
+
+    for (const Result & result : results)
+    {
+        if (result.job.type == Job::Check)
+            m_checked(result.job.path, result.ok);
+        else
+            m_covered(result.job.path);
+    }
+}
+
+void DirLister::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_quit)
+    {
+        if (!m_jobs.len())
+        {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        Job job = std::move(m_jobs[0]);
+        m_jobs.remove(0, 1);
+
+        QDateTime known;
+        auto cached = m_listings.find(job.path);
+        if (job.type == Job::Cover && cached != m_listings.end())
+            known = cached->modified;
+
+        lock.unlock();
+
+        QFileInfo info(job.path);
+        bool ok = info.isDir() && info.isExecutable() && info.isReadable();
+        bool listed = false;
+        Listing listing;
+
+        /* one stat tells whether the folder changed since it was listed */
+        if (job.type == Job::Cover && ok)
+        {
+            listing.modified = info.lastModified();
+
+            if (!known.isValid() || listing.modified != known)
+            {
+                QStringList extFilter = {"*.jpg", "*.jpeg", "*.png", "*.webp"};
+                listing.images = QDir(job.path).entryList(extFilter, QDir::Files);
+                listed = true;
+            }
+        }
+
+        lock.lock();
+
+        if (listed)
+        {
+            listing.used = ++m_clock;
+            m_listings.insert(job.path, std::move(listing));
+
+            while (m_listings.size() > max_listings)
+            {
+                auto oldest = m_listings.begin();
+                for (auto it = m_listings.begin(); it != m_listings.end(); ++it)
+                {
+                    if (it->used < oldest->used)
+                        oldest = it;
+                }
+
+                m_listings.erase(oldest);
+            }
+        }
+        else if (job.type == Job::Cover && !ok)
+            m_listings.remove(job.path);
+
+        m_results.append(Result{std::move(job), ok});
+        m_deliver.queue(aud::obj_member<DirLister, &DirLister::deliver>, this);
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * File Browser Plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef FILEBROWSER_DIR_LISTER_H
+#define FILEBROWSER_DIR_LISTER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+#include <libaudcore/index.h>
+#include <libaudcore/mainloop.h>
+
+/* Does what the file browser needs of the file system, besides the listing
+ * QFileSystemModel does itself, on a thread of its own, so that a slow
+ * network share never holds up the user interface.  The image files of the
+ * folders looked at are kept, with the time the folder was last changed, so
+ * that the cover of a folder looked at before is known at once; a folder is
+ * only listed again once that time changes.  Results come back in the main
+ * thread, through the callbacks given. */
+class DirLister
+{
+public:
+    /* the folder can be shown (or not), and the cover of a folder is known */
+    using CheckFunc = std::function<void(const QString & path, bool ok)>;
+    using CoverFunc = std::function<void(const QString & path)>;
+
+    DirLister(CheckFunc checked, CoverFunc covered);
+    ~DirLister();
+
+    void checkDirectory(const QString & path);
+    void lookUpCover(const QString & path);
+
+    /* false if the folder has not been listed yet; otherwise the cover
+     * found there (if any), which with <refresh> is looked up again in the
+     * background, in case the folder has changed */
+    bool cachedCover(const QString & path, QString & cover, bool refresh = true);
+
+private:
+    struct Job
+    {
+        enum { Check, Cover } type;
+        QString path;
+    };
+
+    struct Listing
+    {
+        QDateTime modified;
+        QStringList images;  /* file names */
+        qint64 used = 0;
+    };
+
+    struct Result
+    {
+        Job job;
+        bool ok;
+    };
+
+    static constexpr int max_listings = 256;
+
+    void run();
+    void deliver();
+    void submit(Job && job);
+    QString findCover(const Listing & listing, const QString & path) const;
+
+    CheckFunc m_checked;
+    CoverFunc m_covered;
+
+    /* shared with the thread, under m_mutex */
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_quit = false;
+    Index<Job> m_jobs;
+    Index<Result> m_results;
+    QHash<QString, Listing> m_listings;
+    qint64 m_clock = 0;
+
+    QueuedFunc m_deliver;
+    std::thread m_thread;
+};
+
+#endif
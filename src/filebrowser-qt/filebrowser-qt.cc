@@ -27,6 +27,7 @@
 #include <QHeaderView>
 #include <QLineEdit>
 #include <QMenu>
+#include <QPersistentModelIndex>
 #include <QPointer>
 #include <QSortFilterProxyModel>
 #include <QStandardPaths>
@@ -41,6 +42,8 @@
 #include <libaudcore/runtime.h>
 #include <libaudqt/libaudqt.h>
 
+#include "dir-lister.h"
+
 #define CFG_ID "filebrowser"
 #define CFG_FILE_PATH "file_path"
 
@@ -75,16 +78,21 @@ public:
     {
     }
 
+    /* the filter only applies to the items of the folder shown */
+    void setSourceRoot(const QModelIndex & root) { m_root = root; }
+
 protected:
     bool filterAcceptsRow(int sourceRow,
                           const QModelIndex & sourceParent) const override
     {
-        auto model = qobject_cast<QFileSystemModel *>(sourceModel());
-        if (model->index(model->rootPath()) != sourceParent)
+        if (m_root != sourceParent)
             return true;
 
         return QSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent);
     }
+
+private:
+    QPersistentModelIndex m_root;
 };
 
 class FileBrowserWidget : public QWidget
@@ -104,26 +112,40 @@ private:
     void openCover();
 
     bool hasMultiSelection() const;
-    bool searchCover(QString & result) const;
+    void addCoverAction(QMenu * menu);
     QString selectedPath() const;
     QStringList selectedPaths() const;
     QStringList supportedFileExtensions() const;
 
     void initMusicDirectory();
     void setCurrentDirectory(const QString & path);
+    void onDirectoryChecked(const QString & path, bool ok);
+    void onCoverFound(const QString & path);
     void onTreeViewActivated(const QModelIndex & index);
 
+    DirLister m_lister;
+    QString m_fallbackDir; /* if the folder set cannot be shown */
+
     QTreeView * m_treeView;
     QFileSystemModel * m_fileSystemModel;
     FileSystemFilterProxyModel * m_proxyModel;
     QToolButton * m_upButton;
     QLineEdit * m_filterLineEdit;
     QString m_coverPath;
+
+    /* the context menu open, whose cover is still being looked for */
+    QPointer<QMenu> m_menu;
+    QString m_menuPath;
 };
 
 static QPointer<FileBrowserWidget> s_widget;
 
 FileBrowserWidget::FileBrowserWidget()
+    : m_lister(
+          [this](const QString & path, bool ok) {
+              onDirectoryChecked(path, ok);
+          },
+          [this](const QString & path) { onCoverFound(path); })
 {
     m_treeView = new QTreeView(this);
     m_treeView->setDragEnabled(true);
@@ -139,6 +161,10 @@ FileBrowserWidget::FileBrowserWidget()
     m_fileSystemModel->setNameFilters(supportedFileExtensions());
     m_fileSystemModel->setFilter(QDir::AllDirs | QDir::Files |
                                  QDir::NoDotAndDotDot);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    // each folder would be read for an icon of its own
+    m_fileSystemModel->setOption(QFileSystemModel::DontUseCustomDirectoryIcons);
+#endif
 
     m_proxyModel = new FileSystemFilterProxyModel(this);
     m_proxyModel->setFilterCaseSensitivity(Qt::CaseInsensitive);
@@ -176,11 +202,20 @@ FileBrowserWidget::FileBrowserWidget()
             });
 
     connect(upAction, &QAction::triggered, [this]() {
-        QDir dir = m_fileSystemModel->rootDirectory();
-        if (dir.cdUp())
-            setCurrentDirectory(dir.path());
+        QString root = m_fileSystemModel->rootPath();
+        QString parent = QFileInfo(root).path();
+        if (parent != root)
+            setCurrentDirectory(parent);
     });
 
+    // the cover is looked for before the context menu is opened
+    connect(m_treeView->selectionModel(), &QItemSelectionModel::selectionChanged,
+            [this]() {
+                QString path = selectedPath();
+                if (!path.isEmpty())
+                    m_lister.lookUpCover(path);
+            });
+
     initMusicDirectory();
 }
 
@@ -207,14 +242,42 @@ void FileBrowserWidget::contextMenuEvent(QContextMenuEvent * event)
     if (!hasMultiSelection())
         menu->addAction(newAction(N_("_Open Folder Externally"), "folder", menu,
                                   &FileBrowserWidget::openFolder));
-    if (searchCover(m_coverPath))
-        menu->addAction(newAction(N_("Open Co_ver Art"), "image-x-generic",
-                                  menu, &FileBrowserWidget::openCover));
+
+    // if the folder has not been looked at yet, the action is added to the
+    // menu once the cover is found
+    m_coverPath = QString();
+    m_menu = menu;
+    m_menuPath = selectedPath();
+
+    if (!m_menuPath.isEmpty())
+    {
+        if (!m_lister.cachedCover(m_menuPath, m_coverPath))
+            m_lister.lookUpCover(m_menuPath);
+        else if (!m_coverPath.isEmpty())
+            addCoverAction(menu);
+    }
 
     menu->setAttribute(Qt::WA_DeleteOnClose);
     menu->popup(event->globalPos());
 }
 
+void FileBrowserWidget::addCoverAction(QMenu * menu)
+{
+    auto action = new QAction(QIcon::fromTheme("image-x-generic"),
+                              audqt::translate_str(N_("Open Co_ver Art")), menu);
+    connect(action, &QAction::triggered, this, &FileBrowserWidget::openCover);
+    menu->addAction(action);
+}
+
+void FileBrowserWidget::onCoverFound(const QString & path)
+{
+    if (!m_menu || path != m_menuPath || !m_coverPath.isEmpty())
+        return;
+
+    if (m_lister.cachedCover(path, m_coverPath, false) && !m_coverPath.isEmpty())
+        addCoverAction(m_menu);
+}
+
 void FileBrowserWidget::addSelectedItems(bool play)
 {
     Playlist list = Playlist::active_playlist();
@@ -264,40 +327,13 @@ bool FileBrowserWidget::hasMultiSelection() const
     return m_treeView->selectionModel()->selectedRows().size() > 1;
 }
 
-bool FileBrowserWidget::searchCover(QString & result) const
-{
-    QString path = selectedPath();
-    if (path.isEmpty())
-    {
-        result = QString();
-        return false;
-    }
-
-    String coverNames = aud_get_str("cover_name_include");
-    QStringList nameFilter = QString(coverNames).remove(' ').split(',');
-    QStringList extFilter = {"*.jpg", "*.jpeg", "*.png", "*.webp"};
-    QFileInfoList foundFiles = QDir(path).entryInfoList(extFilter, QDir::Files);
-
-    for (const QFileInfo & info : foundFiles)
-    {
-        if (nameFilter.contains(info.baseName(), Qt::CaseInsensitive))
-        {
-            result = info.canonicalFilePath();
-            return true;
-        }
-    }
-
-    result = QString();
-    return false;
-}
-
 QString FileBrowserWidget::selectedPath() const
 {
     QModelIndexList indexes = m_treeView->selectionModel()->selectedRows();
     auto nSelected = indexes.size();
 
     if (nSelected == 0)
-        return m_fileSystemModel->rootDirectory().canonicalPath();
+        return m_fileSystemModel->rootPath();
 
     if (nSelected != 1)
         return QString();
@@ -340,32 +376,48 @@ QStringList FileBrowserWidget::supportedFileExtensions() const
 void FileBrowserWidget::initMusicDirectory()
 {
     auto musicDir = QString(aud_get_str(CFG_ID, CFG_FILE_PATH));
+    QStringList locations =
+        QStandardPaths::standardLocations(QStandardPaths::MusicLocation);
+    QString defaultDir = locations.value(0, QDir::homePath());
 
-    if (musicDir.isEmpty() || !QDir(musicDir).exists())
-    {
-        QStringList locations =
-            QStandardPaths::standardLocations(QStandardPaths::MusicLocation);
-        musicDir = locations.value(0, QDir::homePath());
-    }
+    if (musicDir.isEmpty())
+        musicDir = defaultDir;
+    else if (musicDir != defaultDir)
+        m_fallbackDir = defaultDir;
 
     setCurrentDirectory(musicDir);
 }
 
+/* The folder is looked at in the background; it is shown if it can be. */
 void FileBrowserWidget::setCurrentDirectory(const QString & path)
 {
-    auto info = QFileInfo(path);
-    if (!info.isDir() || !info.isExecutable() || !info.isReadable())
+    m_lister.checkDirectory(path);
+}
+
+void FileBrowserWidget::onDirectoryChecked(const QString & path, bool ok)
+{
+    if (!ok)
+    {
+        if (!m_fallbackDir.isEmpty())
+            setCurrentDirectory(m_fallbackDir);
+
+        m_fallbackDir = QString();
         return;
+    }
+
+    m_fallbackDir = QString();
 
     QModelIndex index = m_fileSystemModel->setRootPath(path);
     if (!index.isValid())
         return;
 
+    auto info = QFileInfo(path);
     m_upButton->setEnabled(!info.isRoot());
+    m_proxyModel->setSourceRoot(index);
     m_treeView->setRootIndex(m_proxyModel->mapFromSource(index));
 
     QString dirName = info.baseName();
-    QString cleanPath = m_fileSystemModel->rootDirectory().canonicalPath();
+    QString cleanPath = QDir::cleanPath(info.absoluteFilePath());
     StringBuf text =
         dirName.isEmpty()
             ? str_copy(_("Search"))
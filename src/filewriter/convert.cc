@@ -1,5 +1,6 @@
 #include "convert.h"
 
+#include <stdint.h>
 #include <string.h>
 
 #include <libaudcore/audio.h>
@@ -11,26 +12,205 @@ static int out_fmt;
 static Index<char> convert_output;
 static Index<float> convert_temp;
 
+/* The formats the core plays in (16, 24 or 32 bits in native byte order,
+ * or floating point) are converted here directly, without a trip through
+ * floating point from one integer format to another, and in loops simple
+ * enough for the compiler to vectorize (the float-to-int ones only with
+ * -fno-trapping-math, because of their clamping); anything else goes
+ * through libaudcore.
+ *
+ * The float kernels round to nearest even, as lrintf() does in
+ * audio_to_int(), by adding and taking away a "magic" number: the sum has
+ * no bits left for a fraction.  Doubles are used for 24 and 32 bits, where
+ * a float sum would lose the integer part as well.  24-bit samples are
+ * sign-extended from their low three bytes on the way in. */
+#define MAGIC_FLOAT 12582912.0f             /* 1.5 * 2^23 */
+#define MAGIC_DOUBLE 6755399441055744.0     /* 1.5 * 2^52 */
+
+enum {NONE, S16, S24, S32};
+
+static int native_int (int fmt)
+{
+    switch (fmt)
+    {
+        case FMT_S16_NE: return S16;
+        case FMT_S24_NE: return S24;
+        case FMT_S32_NE: return S32;
+        default: return NONE;
+    }
+}
+
+static int bits (int type)
+{
+    return (type == S16) ? 16 : (type == S24) ? 24 : 32;
+}
+
+#define BLOCK 64
+
+/* <op> is a lambda and is inlined, so each conversion becomes one loop of
+ * BLOCK samples without a call in it, plus a loop for the rest */
+template<class In, class Out, class Op>
+static void convert_loop (const In * __restrict in, Out * __restrict out,
+ int samples, Op op)
+{
+    int i = 0;
+
+    for (; i + BLOCK <= samples; i += BLOCK)
+    {
+        for (int j = 0; j < BLOCK; j ++)
+            out[i + j] = op (in[i + j]);
+    }
+
+    for (; i < samples; i ++)
+        out[i] = op (in[i]);
+}
+
+static inline int32_t sign_extend (int32_t x, int unused)
+{
+    return (int32_t) ((uint32_t) x << unused) >> unused;
+}
+
+static void float_to_s16 (const float * in, int16_t * out, int samples)
+{
+    convert_loop (in, out, samples, [] (float f) {
+        f *= 32768;
+        f = (f < -32768) ? -32768 : (f > 32767) ? 32767 : f;
+        return (int16_t) (int32_t) ((f + MAGIC_FLOAT) - MAGIC_FLOAT);
+    });
+}
+
+static void float_to_s32 (const float * in, int32_t * out, int samples, int out_bits)
+{
+    double range = (double) (1u << (out_bits - 1));
+
+    convert_loop (in, out, samples, [range] (float f) {
+        double d = f * range;
+        d = (d < -range) ? -range : (d > range - 1) ? range - 1 : d;
+        return (int32_t) ((d + MAGIC_DOUBLE) - MAGIC_DOUBLE);
+    });
+}
+
+static void s16_to_float (const int16_t * in, float * out, int samples)
+{
+    convert_loop (in, out, samples, [] (int16_t x) {
+        return x * (1.0f / 32768);
+    });
+}
+
+static void s32_to_float (const int32_t * in, float * out, int samples, int in_bits)
+{
+    float scale = 1.0f / (1u << (in_bits - 1));
+    int unused = 32 - in_bits;
+
+    convert_loop (in, out, samples, [scale, unused] (int32_t x) {
+        return sign_extend (x, unused) * scale;
+    });
+}
+
+static void s16_to_s32 (const int16_t * in, int32_t * out, int samples, int out_bits)
+{
+    int shift = out_bits - 16;
+
+    convert_loop (in, out, samples, [shift] (int16_t x) {
+        return (int32_t) ((uint32_t) (int32_t) x << shift);
+    });
+}
+
+static void s32_to_s32_up (const int32_t * in, int32_t * out, int samples,
+ int in_bits, int out_bits)
+{
+    int unused = 32 - in_bits;
+    int shift = out_bits - in_bits;
+
+    convert_loop (in, out, samples, [unused, shift] (int32_t x) {
+        return (int32_t) ((uint32_t) sign_extend (x, unused) << shift);
+    });
+}
+
+/* Dropping bits adds triangular (TPDF) dither of one LSB of the output, so
+ * that quiet passages fade into noise instead of distortion.  The noise
+ * generator is a plain LCG, which is plenty; its state carries over from
+ * one buffer to the next. */
+static uint32_t dither_state = 1;
+
+static inline int32_t dither_noise (int shift)
+{
+    dither_state = dither_state * 1664525 + 1013904223;
+    int32_t a = (dither_state >> 8) & ((1 << shift) - 1);
+    dither_state = dither_state * 1664525 + 1013904223;
+    int32_t b = (dither_state >> 8) & ((1 << shift) - 1);
+    return a - b;
+}
+
+template<class Out>
+static void s32_to_int_down (const int32_t * in, Out * out, int samples,
+ int in_bits, int out_bits)
+{
+    int shift = in_bits - out_bits;
+    int64_t half = (int64_t) 1 << (shift - 1);
+    int64_t max = ((int64_t) 1 << (out_bits - 1)) - 1;
+
+    for (int i = 0; i < samples; i ++)
+    {
+        int64_t x = sign_extend (in[i], 32 - in_bits);
+        x = (x + dither_noise (shift) + half) >> shift;
+        out[i] = (Out) ((x < -max - 1) ? -max - 1 : (x > max) ? max : x);
+    }
+}
+
 void convert_init (int input_fmt, int output_fmt)
 {
     in_fmt = input_fmt;
     out_fmt = output_fmt;
 }
 
+/* true if done here */
+static bool convert_native (const void * ptr, void * out, int samples)
+{
+    int from = native_int (in_fmt);
+    int to = native_int (out_fmt);
+
+    if (in_fmt == FMT_FLOAT && to == S16)
+        float_to_s16 ((const float *) ptr, (int16_t *) out, samples);
+    else if (in_fmt == FMT_FLOAT && to != NONE)
+        float_to_s32 ((const float *) ptr, (int32_t *) out, samples, bits (to));
+    else if (from == S16 && out_fmt == FMT_FLOAT)
+        s16_to_float ((const int16_t *) ptr, (float *) out, samples);
+    else if (from != NONE && out_fmt == FMT_FLOAT)
+        s32_to_float ((const int32_t *) ptr, (float *) out, samples, bits (from));
+    else if (from == NONE || to == NONE)
+        return false;
+    else if (from == S16)
+        s16_to_s32 ((const int16_t *) ptr, (int32_t *) out, samples, bits (to));
+    else if (bits (to) > bits (from))
+        s32_to_s32_up ((const int32_t *) ptr, (int32_t *) out, samples, bits (from), bits (to));
+    else if (to == S16)
+        s32_to_int_down ((const int32_t *) ptr, (int16_t *) out, samples, bits (from), 16);
+    else
+        s32_to_int_down ((const int32_t *) ptr, (int32_t *) out, samples, bits (from), bits (to));
+
+    return true;
+}
+
 const Index<char> & convert_process (const void * ptr, int length)
 {
     int samples = length / FMT_SIZEOF (in_fmt);
 
+    /* Index keeps its capacity, so this allocates only while the buffers
+     * coming in grow */
     convert_output.resize (FMT_SIZEOF (out_fmt) * samples);
 
     if (in_fmt == out_fmt)
         memcpy (convert_output.begin (), ptr, FMT_SIZEOF (in_fmt) * samples);
+    else if (convert_native (ptr, convert_output.begin (), samples))
+        return convert_output;
     else if (in_fmt == FMT_FLOAT)
         audio_to_int ((const float *) ptr, convert_output.begin (), out_fmt, samples);
     else if (out_fmt == FMT_FLOAT)
         audio_from_int (ptr, in_fmt, (float *) convert_output.begin (), samples);
     else
     {
+        /* other integer formats (byte-swapped, packed 24-bit) are rare */
         convert_temp.resize (samples);
         audio_from_int (ptr, in_fmt, convert_temp.begin (), samples);
         audio_to_int (convert_temp.begin (), convert_output.begin (), out_fmt, samples);
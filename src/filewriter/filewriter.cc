@@ -25,6 +25,7 @@
 
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/playlist.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
@@ -33,6 +34,10 @@
 #include <lame/lame.h>
 #endif
 
+#ifdef FILEWRITER_FLAC
+#include <FLAC/export.h>
+#endif
+
 #include "filewriter.h"
 #include "convert.h"
 
@@ -109,6 +114,9 @@ enum fileext_t
 #endif
 #ifdef FILEWRITER_FLAC
     FLAC,
+#endif
+#ifdef FILEWRITER_OPUS
+    OPUS,
 #endif
     FILEEXT_MAX
 };
@@ -123,13 +131,25 @@ static const char *fileext_str[FILEEXT_MAX] =
     ".ogg",
 #endif
 #ifdef FILEWRITER_FLAC
-    ".flac"
+    ".flac",
+#endif
+#ifdef FILEWRITER_OPUS
+    ".opus"
 #endif
 };
 
 static FileWriterImpl *plugin;
 static VFSFile output_file;
 
+/* As the main output, FileWriter takes audio as fast as it is decoded (it
+ * never waits and has no delay), so converting a playlist runs through it
+ * as fast as the decoder and encoder allow.  How fast that is gets logged
+ * for each file and for the files written since the plugin was loaded. */
+static int bytes_per_frame, out_rate;
+static int64_t open_time;       /* microseconds */
+static int64_t written_frames;
+static double total_audio, total_time;      /* seconds */
+
 FileWriterImpl *plugins[FILEEXT_MAX] = {
     &wav_plugin,
 #ifdef FILEWRITER_MP3
@@ -141,6 +161,9 @@ FileWriterImpl *plugins[FILEEXT_MAX] = {
 #ifdef FILEWRITER_FLAC
     &flac_plugin,
 #endif
+#ifdef FILEWRITER_OPUS
+    &opus_plugin,
+#endif
 };
 
 const char * const FileWriter::defaults[] = {
@@ -304,6 +327,11 @@ bool FileWriter::open_audio (int fmt, int rate, int nch, String & error)
     int out_fmt = plugin->format_required (fmt);
     convert_init (fmt, out_fmt);
 
+    bytes_per_frame = FMT_SIZEOF (fmt) * nch;
+    out_rate = rate;
+    open_time = g_get_monotonic_time ();
+    written_frames = 0;
+
     output_file = safe_create (filename);
     if (output_file)
     {
@@ -328,13 +356,33 @@ int FileWriter::write_audio (const void * ptr, int length)
     auto & buf = convert_process (ptr, length);
     plugin->write (output_file, buf.begin (), buf.len ());
 
+    written_frames += length / bytes_per_frame;
     return length;
 }
 
+static void log_stats ()
+{
+    double audio = (double) written_frames / out_rate;
+    double time = (g_get_monotonic_time () - open_time) / 1e6;
+
+    total_audio += audio;
+    total_time += time;
+
+    auto playlist = Playlist::playing_playlist ();
+    int seconds = audio;
+
+    AUDINFO ("Wrote %s (%d of %d): %d:%02d of audio in %.1f s, %.1fx real time; "
+     "%.1fx over %.0f s so far.\n", output_file.filename (),
+     playlist.get_position () + 1, playlist.n_entries (), seconds / 60,
+     seconds % 60, time, audio / aud::max (time, 0.001),
+     total_audio / aud::max (total_time, 0.001), total_time);
+}
+
 void FileWriter::close_audio ()
 {
     plugin->close (output_file);
     convert_free ();
+    log_stats ();
 
     plugin = nullptr;
     output_file = VFSFile ();
@@ -378,6 +426,9 @@ static const ComboItem plugin_combo[] = {
 #ifdef FILEWRITER_FLAC
     ,ComboItem ("FLAC", FLAC)
 #endif
+#ifdef FILEWRITER_OPUS
+    ,ComboItem ("Opus", OPUS)
+#endif
 };
 
 static const PreferencesWidget main_widgets[] = {
@@ -568,6 +619,42 @@ static const PreferencesWidget vorbis_widgets[] = {
 };
 #endif
 
+#ifdef FILEWRITER_FLAC
+static const ComboItem flac_block_sizes[] = {
+    ComboItem(N_("Auto"), 0),
+    ComboItem("576", 576),
+    ComboItem("1152", 1152),
+    ComboItem("2304", 2304),
+    ComboItem("4096", 4096),
+    ComboItem("4608", 4608)
+};
+
+static const PreferencesWidget flac_widgets[] = {
+    WidgetSpin(N_("Compression level (0-8):"),
+        WidgetInt("filewriter_flac", "compression_level"),
+        {0, 8, 1}),
+    WidgetCombo(N_("Block size:"),
+        WidgetInt("filewriter_flac", "block_size"),
+        {{flac_block_sizes}}),
+#if FLAC_API_VERSION_CURRENT >= 14
+    WidgetSpin(N_("Encoder threads:"),
+        WidgetInt("filewriter_flac", "threads"),
+        {0, 64, 1, N_("(0 = one per core)")})
+#endif
+};
+#endif
+
+#ifdef FILEWRITER_OPUS
+static const PreferencesWidget opus_widgets[] = {
+    WidgetSpin(N_("Bitrate:"),
+        WidgetInt("filewriter_opus", "bitrate"),
+        {6, 510, 1, N_("kbit/s")}),
+    WidgetSpin(N_("Complexity (0-10):"),
+        WidgetInt("filewriter_opus", "complexity"),
+        {0, 10, 1})
+};
+#endif
+
 static const NotebookTab tabs[] = {
     {N_("General"), {main_widgets}}
 #ifdef FILEWRITER_MP3
@@ -576,6 +663,12 @@ static const NotebookTab tabs[] = {
 #ifdef FILEWRITER_VORBIS
     ,{"Vorbis", {vorbis_widgets}}
 #endif
+#ifdef FILEWRITER_FLAC
+    ,{"FLAC", {flac_widgets}}
+#endif
+#ifdef FILEWRITER_OPUS
+    ,{"Opus", {opus_widgets}}
+#endif
 };
 
 const PreferencesWidget FileWriter::widgets[] = {
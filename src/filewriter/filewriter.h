@@ -57,4 +57,8 @@ extern FileWriterImpl vorbis_plugin;
 extern FileWriterImpl flac_plugin;
 #endif
 
+#ifdef FILEWRITER_OPUS
+extern FileWriterImpl opus_plugin;
+#endif
+
 #endif
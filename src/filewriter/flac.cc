@@ -23,14 +23,32 @@
 
 #ifdef FILEWRITER_FLAC
 
+#include <thread>
+
 #include <FLAC/all.h>
 
 #include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
 
 static int channels;
 static FLAC__StreamEncoder *flac_encoder;
 static FLAC__StreamMetadata *flac_metadata;
 
+/* a block size of 0 leaves it to the compression level; 0 threads means
+ * one per core (libFLAC 1.5 and later only) */
+static const char * const flac_defaults[] = {
+ "compression_level", "5",
+ "block_size", "0",
+ "threads", "0",
+ nullptr};
+
+#define GET_INT(n) aud_get_int("filewriter_flac", n)
+
+static void flac_init ()
+{
+    aud_config_set_defaults ("filewriter_flac", flac_defaults);
+}
+
 static FLAC__StreamEncoderWriteStatus flac_write_cb(const FLAC__StreamEncoder *encoder,
     const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void * data)
 {
@@ -101,6 +119,23 @@ static bool flac_open (VFSFile & file, const format_info & info, const Tuple & t
     FLAC__stream_encoder_set_channels(flac_encoder, info.channels);
     FLAC__stream_encoder_set_sample_rate(flac_encoder, info.frequency);
 
+    /* the compression level sets the block size too, so it goes first */
+    FLAC__stream_encoder_set_compression_level(flac_encoder, GET_INT("compression_level"));
+
+    int block_size = GET_INT("block_size");
+    if (block_size > 0)
+        FLAC__stream_encoder_set_blocksize(flac_encoder, block_size);
+
+#if FLAC_API_VERSION_CURRENT >= 14
+    int threads = GET_INT("threads");
+    if (threads <= 0)
+        threads = std::thread::hardware_concurrency();
+
+    if (threads > 1 && FLAC__stream_encoder_set_num_threads(flac_encoder,
+     threads) != FLAC__STREAM_ENCODER_SET_NUM_THREADS_OK)
+        AUDWARN("Cannot encode FLAC on %d threads.\n", threads);
+#endif
+
     flac_metadata = FLAC__metadata_object_new(FLAC__METADATA_TYPE_VORBIS_COMMENT);
 
     insert_vorbis_comment (flac_metadata, "TITLE", tuple, Tuple::Title);
@@ -115,8 +150,20 @@ static bool flac_open (VFSFile & file, const format_info & info, const Tuple & t
 
     FLAC__stream_encoder_set_metadata(flac_encoder, &flac_metadata, 1);
 
-    FLAC__stream_encoder_init_stream(flac_encoder, flac_write_cb, flac_seek_cb,
-     flac_tell_cb, nullptr, &file);
+    auto status = FLAC__stream_encoder_init_stream(flac_encoder, flac_write_cb,
+     flac_seek_cb, flac_tell_cb, nullptr, &file);
+
+    if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+    {
+        AUDERR("Error initializing FLAC encoder: %s\n",
+         FLAC__StreamEncoderInitStatusString[status]);
+
+        FLAC__stream_encoder_delete(flac_encoder);
+        flac_encoder = nullptr;
+        FLAC__metadata_object_delete(flac_metadata);
+        flac_metadata = nullptr;
+        return false;
+    }
 
     channels = info.channels;
     return true;
@@ -192,7 +239,7 @@ static int flac_format_required (int fmt)
 }
 
 FileWriterImpl flac_plugin = {
-    nullptr,  // init
+    flac_init,
     flac_open,
     flac_write,
     flac_close,
@@ -24,11 +24,23 @@
 
 #ifdef FILEWRITER_MP3
 
+#include <pthread.h>
+#include <string.h>
+
 #include <lame/lame.h>
 
 #include <libaudcore/audstrings.h>
+#include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
+/* LAME runs on a thread of its own, fed through a ring buffer, so that the
+ * output thread only has to copy the audio in.  What it encodes is gathered
+ * and written out WRITE_SIZE bytes at a time, at offsets that are multiples
+ * of WRITE_SIZE (the ID3v2 tag goes through the same buffer): slow USB and
+ * network targets spend most of their time on many small writes. */
+#define RING_FRAMES 65536
+#define WRITE_SIZE (1 << 20)
+
 static lame_global_flags *gfp;
 static unsigned char encbuffer[LAME_MAXMP3BUFFER];
 static int id3v2_size;
@@ -37,6 +49,15 @@ static int channels;
 static unsigned long numsamples;
 static Index<unsigned char> write_buffer;
 
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
+static RingBuf<float> ring;
+static pthread_t encoder_thread;
+static bool encoder_running, encoder_quit;
+
+static VFSFile * out_file;
+static Index<unsigned char> out_buffer;
+
 static void lame_debugf(const char *format, va_list ap)
 {
     (void) vprintf(format, ap);
@@ -74,6 +95,84 @@ static void mp3_init ()
     aud_config_set_defaults ("filewriter_mp3", mp3_defaults);
 }
 
+/* writes out as much of out_buffer as fills whole blocks, or all of it */
+static void write_output (bool all)
+{
+    int length = all ? out_buffer.len () : out_buffer.len () / WRITE_SIZE * WRITE_SIZE;
+    if (! length)
+        return;
+
+    if (out_file->fwrite (out_buffer.begin (), 1, length) != length)
+        AUDERR ("write error\n");
+
+    out_buffer.remove (0, length);
+}
+
+static void add_output (const unsigned char * data, int length)
+{
+    out_buffer.insert (data, -1, length);
+
+    if (out_buffer.len () >= WRITE_SIZE)
+        write_output (false);
+}
+
+static void encode (const float * data, int frames)
+{
+    int encoded;
+
+    if (! write_buffer.len ())
+        write_buffer.resize (8192);
+
+    while (1)
+    {
+        if (channels == 1)
+            encoded = lame_encode_buffer_ieee_float (gfp, data, data, frames,
+             write_buffer.begin (), write_buffer.len ());
+        else
+            encoded = lame_encode_buffer_interleaved_ieee_float (gfp, data,
+             frames, write_buffer.begin (), write_buffer.len ());
+
+        if (encoded != -1)
+            break;
+
+        write_buffer.resize (write_buffer.len () * 2);
+    }
+
+    if (encoded > 0)
+        add_output (write_buffer.begin (), encoded);
+}
+
+/* the output thread only adds to the ring, so the linear part at the start
+ * stays put while it is encoded unlocked */
+static void * mp3_encoder (void *)
+{
+    pthread_mutex_lock (& ring_mutex);
+
+    while (true)
+    {
+        int length = ring.linear ();
+
+        if (! length)
+        {
+            if (encoder_quit)
+                break;
+
+            pthread_cond_wait (& ring_cond, & ring_mutex);
+            continue;
+        }
+
+        pthread_mutex_unlock (& ring_mutex);
+        encode (& ring[0], length / channels);
+        pthread_mutex_lock (& ring_mutex);
+
+        ring.discard (length);
+        pthread_cond_broadcast (& ring_cond);
+    }
+
+    pthread_mutex_unlock (& ring_mutex);
+    return nullptr;
+}
+
 static bool mp3_open (VFSFile & file, const format_info & info, const Tuple & tuple)
 {
     int imp3;
@@ -161,9 +260,11 @@ static bool mp3_open (VFSFile & file, const format_info & info, const Tuple & tu
     /* write id3v2 header */
     imp3 = lame_get_id3v2_tag(gfp, encbuffer, sizeof(encbuffer));
 
+    out_file = & file;
+    out_buffer.resize (0);
+
     if (imp3 > 0) {
-        if (file.fwrite (encbuffer, 1, imp3) != imp3)
-            AUDERR ("write error\n");
+        out_buffer.insert (encbuffer, -1, imp3);
         id3v2_size = imp3;
     }
     else {
@@ -172,55 +273,85 @@ static bool mp3_open (VFSFile & file, const format_info & info, const Tuple & tu
 
     channels = info.channels;
     numsamples = 0;
+
+    /* whole frames, so that the linear part of the ring always is too */
+    ring.alloc (RING_FRAMES * channels);
+    encoder_quit = false;
+    encoder_running = ! pthread_create (& encoder_thread, nullptr, mp3_encoder, nullptr);
+
     return true;
 }
 
 static void mp3_write (VFSFile & file, const void * data, int length)
 {
-    int encoded;
+    auto samples = (const float *) data;
+    int count = length / sizeof (float);
 
-    if (! write_buffer.len ())
-        write_buffer.resize (8192);
+    numsamples += length / (2 * channels);
 
-    while (1)
+    if (! encoder_running)
     {
-        if (channels == 1)
-            encoded = lame_encode_buffer_ieee_float (gfp, (const float *) data,
-             (const float *) data, length / sizeof (float),
-             write_buffer.begin (), write_buffer.len ());
-        else
-            encoded = lame_encode_buffer_interleaved_ieee_float (gfp,
-             (const float *) data, length / (2 * sizeof (float)),
-             write_buffer.begin (), write_buffer.len ());
+        encode (samples, count / channels);
+        return;
+    }
 
-        if (encoded != -1)
-            break;
+    pthread_mutex_lock (& ring_mutex);
 
-        write_buffer.resize (write_buffer.len () * 2);
-    }
+    while (count)
+    {
+        int space = ring.space ();
 
-    if (encoded > 0 && file.fwrite (write_buffer.begin (), 1, encoded) != encoded)
-        AUDERR ("write error\n");
+        if (! space)
+        {
+            pthread_cond_wait (& ring_cond, & ring_mutex);
+            continue;
+        }
 
-    numsamples += length / (2 * channels);
+        int copy = aud::min (space, count);
+        ring.copy_in (samples, copy);
+        samples += copy;
+        count -= copy;
+
+        pthread_cond_broadcast (& ring_cond);
+    }
+
+    pthread_mutex_unlock (& ring_mutex);
 }
 
 static void mp3_close (VFSFile & file)
 {
     int imp3, encout;
 
+    /* encode what is left in the ring */
+    if (encoder_running)
+    {
+        pthread_mutex_lock (& ring_mutex);
+        encoder_quit = true;
+        pthread_cond_broadcast (& ring_cond);
+        pthread_mutex_unlock (& ring_mutex);
+
+        pthread_join (encoder_thread, nullptr);
+        encoder_running = false;
+    }
+
+    ring.destroy ();
+
     /* write remaining mp3 data */
     encout = lame_encode_flush_nogap(gfp, encbuffer, LAME_MAXMP3BUFFER);
-    if (file.fwrite (encbuffer, 1, encout) != encout)
-        AUDERR ("write error\n");
+    if (encout > 0)
+        add_output (encbuffer, encout);
 
     /* set gfp->num_samples for valid TLEN tag */
     lame_set_num_samples(gfp, numsamples);
 
     /* append v1 tag */
     imp3 = lame_get_id3v1_tag(gfp, encbuffer, sizeof(encbuffer));
-    if (imp3 > 0 && file.fwrite (encbuffer, 1, imp3) != imp3)
-        AUDERR ("write error\n");
+    if (imp3 > 0)
+        add_output (encbuffer, imp3);
+
+    write_output (true);
+    out_buffer.clear ();
+    out_file = nullptr;
 
     /* update v2 tag */
     imp3 = lame_get_id3v2_tag(gfp, encbuffer, sizeof(encbuffer));
@@ -0,0 +1,146 @@
+/*  FileWriter Opus Plugin
+ *  Copyright (c) 2024 Audacious Plugins Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "filewriter.h"
+
+#ifdef FILEWRITER_OPUS
+
+#include <opusenc.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+
+/* libopusenc resamples to 48 kHz itself and does the Ogg framing */
+
+static OggOpusEnc * encoder;
+static int channels;
+
+static const char * const opus_defaults[] = {
+ "bitrate", "128",
+ "complexity", "10",
+ nullptr};
+
+#define GET_INT(n) aud_get_int("filewriter_opus", n)
+
+static void opus_init ()
+{
+    aud_config_set_defaults ("filewriter_opus", opus_defaults);
+}
+
+static int opus_write_cb (void * user_data, const unsigned char * ptr, opus_int32 len)
+{
+    VFSFile * file = (VFSFile *) user_data;
+    return (file->fwrite (ptr, 1, len) == len) ? 0 : 1;
+}
+
+static int opus_close_cb (void * user_data)
+{
+    return 0;  /* the file is closed by FileWriter */
+}
+
+static void add_string_from_tuple (OggOpusComments * comments, const char * name,
+ const Tuple & tuple, Tuple::Field field)
+{
+    String val = tuple.get_str (field);
+    if (val)
+        ope_comments_add (comments, name, val);
+}
+
+static void add_int_from_tuple (OggOpusComments * comments, const char * name,
+ const Tuple & tuple, Tuple::Field field)
+{
+    int val = tuple.get_int (field);
+    if (val > 0)
+        ope_comments_add (comments, name, int_to_str (val));
+}
+
+static bool opus_open (VFSFile & file, const format_info & info, const Tuple & tuple)
+{
+    static const OpusEncCallbacks callbacks = {opus_write_cb, opus_close_cb};
+
+    OggOpusComments * comments = ope_comments_create ();
+    if (! comments)
+        return false;
+
+    add_string_from_tuple (comments, "TITLE", tuple, Tuple::Title);
+    add_string_from_tuple (comments, "ARTIST", tuple, Tuple::Artist);
+    add_string_from_tuple (comments, "ALBUM", tuple, Tuple::Album);
+    add_string_from_tuple (comments, "GENRE", tuple, Tuple::Genre);
+    add_string_from_tuple (comments, "DATE", tuple, Tuple::Date);
+    add_string_from_tuple (comments, "COMMENT", tuple, Tuple::Comment);
+    add_int_from_tuple (comments, "TRACKNUMBER", tuple, Tuple::Track);
+    add_int_from_tuple (comments, "DISCNUMBER", tuple, Tuple::Disc);
+
+    /* family 1 has the Vorbis channel layouts, for up to 8 channels */
+    int family = (info.channels <= 2) ? 0 : (info.channels <= 8) ? 1 : 255;
+    int error = 0;
+
+    encoder = ope_encoder_create_callbacks (& callbacks, & file, comments,
+     info.frequency, info.channels, family, & error);
+
+    ope_comments_destroy (comments);
+
+    if (! encoder)
+    {
+        AUDERR ("Error creating Opus encoder: %s\n", ope_strerror (error));
+        return false;
+    }
+
+    ope_encoder_ctl (encoder, OPUS_SET_BITRATE (GET_INT ("bitrate") * 1000));
+    ope_encoder_ctl (encoder, OPUS_SET_COMPLEXITY (GET_INT ("complexity")));
+
+    channels = info.channels;
+    return true;
+}
+
+static void opus_write (VFSFile & file, const void * data, int length)
+{
+    int error = ope_encoder_write_float (encoder, (const float *) data,
+     length / (sizeof (float) * channels));
+
+    if (error != OPE_OK)
+        AUDERR ("Error encoding Opus: %s\n", ope_strerror (error));
+}
+
+static void opus_close (VFSFile & file)
+{
+    if (! encoder)
+        return;
+
+    int error = ope_encoder_drain (encoder);
+    if (error != OPE_OK)
+        AUDERR ("Error encoding Opus: %s\n", ope_strerror (error));
+
+    ope_encoder_destroy (encoder);
+    encoder = nullptr;
+}
+
+static int opus_format_required (int fmt)
+{
+    return FMT_FLOAT;
+}
+
+FileWriterImpl opus_plugin = {
+    opus_init,
+    opus_open,
+    opus_write,
+    opus_close,
+    opus_format_required,
+};
+
+#endif
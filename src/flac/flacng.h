@@ -25,17 +25,21 @@
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
 
+#include "../vfs-common/local-reader.h"
+
 class FLACng : public InputPlugin
 {
 public:
     static const char about[];
     static const char *const exts[];
     static const char *const mimes[];
+    static const PluginPreferences prefs;
 
     static constexpr PluginInfo info = {
         N_("FLAC Decoder"),
         PACKAGE,
-        about
+        about,
+        &prefs
     };
 
     constexpr FLACng() : InputPlugin(info, InputInfo(FlagWritesTag)
@@ -64,15 +68,17 @@ struct callback_info
     unsigned sample_rate = 0;
     unsigned channels = 0;
     unsigned long total_samples = 0;
-    Index<int32_t> output_buffer;
-    int32_t *write_pointer = nullptr;
-    unsigned buffer_used = 0;
-    VFSFile *fd = nullptr;
+    Index<char> output_buffer;      /* interleaved, in SAMPLE_FMT */
+    char *write_pointer = nullptr;
+    unsigned buffer_used = 0;       /* samples */
+    LocalReader *fd = nullptr;
     int bitrate = 0;
+    uint64_t frame_sample = 0;      /* first of the last frame decoded */
+    unsigned frame_frames = 0;      /* in it, 0 if there is none */
 
     void alloc()
     {
-        output_buffer.resize(BUFFER_SIZE_SAMP);
+        output_buffer.resize(BUFFER_SIZE_BYTE);
         reset();
     }
 
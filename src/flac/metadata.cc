@@ -138,6 +138,37 @@ static void insert_int_tuple_to_vc (FLAC__StreamMetadata * vc_block,
         vc_block->data.vorbis_comment.num_comments, entry, true);
 }
 
+/* Room left after the metadata when the whole file has to be written anew,
+ * so that tags edited later still fit and only the metadata is written. */
+#define PADDING_SIZE 8192
+
+static void add_padding(FLAC__Metadata_Chain *chain)
+{
+    FLAC__Metadata_Iterator *iter = FLAC__metadata_iterator_new();
+    FLAC__metadata_iterator_init(iter, chain);
+
+    /* after sorting, all the padding is in the last block */
+    while (FLAC__metadata_iterator_next(iter))
+        ;
+
+    if (FLAC__metadata_iterator_get_block_type(iter) == FLAC__METADATA_TYPE_PADDING)
+    {
+        FLAC__StreamMetadata *padding = FLAC__metadata_iterator_get_block(iter);
+        if (padding->length < PADDING_SIZE)
+            padding->length = PADDING_SIZE;
+    }
+    else
+    {
+        FLAC__StreamMetadata *padding = FLAC__metadata_object_new(FLAC__METADATA_TYPE_PADDING);
+        padding->length = PADDING_SIZE;
+
+        if (!FLAC__metadata_iterator_insert_block_after(iter, padding))
+            FLAC__metadata_object_delete(padding);
+    }
+
+    FLAC__metadata_iterator_delete(iter);
+}
+
 bool FLACng::write_tuple(const char *filename, VFSFile &file, const Tuple &tuple)
 {
     if (is_ogg_flac(file))
@@ -198,6 +229,8 @@ bool FLACng::write_tuple(const char *filename, VFSFile &file, const Tuple &tuple
 
     if (FLAC__metadata_chain_check_if_tempfile_needed(chain, true))
     {
+        add_padding(chain);
+
         auto temp = VFSFile::tmpfile();
         if (!temp)
             goto ERR_RETURN;
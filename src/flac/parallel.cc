@@ -0,0 +1,590 @@
+/*
+ *  A FLAC decoder plugin for the Audacious Media Player
+ *  Copyright (C) 2024 Audacious Plugins Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <thread>
+
+#include <libaudcore/objects.h>
+#include <libaudcore/runtime.h>
+
+#include "parallel.h"
+
+#define JOB_FRAMES 8
+#define READ_SIZE (256 * 1024)
+#define MAX_HEADER 16
+#define MAX_FRAME (4 * 1024 * 1024)   /* about twice the largest possible */
+
+struct ParallelWorker : callback_info
+{
+    ParallelDecoder *owner = nullptr;
+    FLAC__StreamDecoder *decoder = nullptr;
+    pthread_t thread;
+
+    const char *input = nullptr;
+    int64_t input_left = 0;
+};
+
+struct CRCTables
+{
+    uint8_t crc8[256];      /* of frame headers */
+    uint16_t crc16[256];    /* of whole frames */
+
+    CRCTables()
+    {
+        for (unsigned i = 0; i < 256; i++)
+        {
+            unsigned c8 = i, c16 = i << 8;
+
+            for (int bit = 0; bit < 8; bit++)
+            {
+                c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+                c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+            }
+
+            crc8[i] = c8;
+            crc16[i] = c16;
+        }
+    }
+};
+
+static const CRCTables crc_tables;
+
+static FLAC__StreamDecoderReadStatus worker_read(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+    auto worker = static_cast<ParallelWorker *>((callback_info *) client_data);
+    size_t copy = aud::min((size_t) worker->input_left, *bytes);
+
+    *bytes = copy;
+    if (!copy)
+        return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+
+    memcpy(buffer, worker->input, copy);
+    worker->input += copy;
+    worker->input_left -= copy;
+
+    return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+/* a frame that fails to decode shows up as missing samples */
+static void worker_error(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+    AUDDBG("FLAC decoder error in worker thread: %d\n", status);
+}
+
+static void *worker_thread(void *data)
+{
+    auto worker = (ParallelWorker *) data;
+    worker->owner->work(worker);
+    return nullptr;
+}
+
+static void delete_worker(ParallelWorker *worker)
+{
+    if (worker->decoder)
+        FLAC__stream_decoder_delete(worker->decoder);
+
+    delete worker;
+}
+
+ParallelDecoder::ParallelDecoder(const callback_info &info, LocalReader &reader, int threads) :
+    m_channels(info.channels),
+    m_bits_per_sample(info.bits_per_sample),
+    m_sample_rate(info.sample_rate),
+    m_reader(reader)
+{
+    if (!read_streaminfo())
+        return;
+
+    for (int i = 0; i < aud::min(threads, PARALLEL_MAX_THREADS); i++)
+    {
+        auto worker = new ParallelWorker;
+
+        worker->owner = this;
+        worker->channels = m_channels;
+        worker->bits_per_sample = m_bits_per_sample;
+        worker->sample_rate = m_sample_rate;
+
+        /* each decoder reads the STREAMINFO block once, then only frames */
+        worker->input = m_streaminfo.begin();
+        worker->input_left = m_streaminfo.len();
+
+        worker->decoder = FLAC__stream_decoder_new();
+
+        if (!worker->decoder ||
+            FLAC__stream_decoder_init_stream(worker->decoder, worker_read,
+             nullptr, nullptr, nullptr, nullptr, write_callback, nullptr,
+             worker_error, (callback_info *) worker) != FLAC__STREAM_DECODER_INIT_STATUS_OK ||
+            !FLAC__stream_decoder_process_until_end_of_metadata(worker->decoder) ||
+            pthread_create(&worker->thread, nullptr, worker_thread, worker))
+        {
+            AUDERR("Could not start a FLAC decoder thread.\n");
+            delete_worker(worker);
+            break;
+        }
+
+        m_workers.append(worker);
+    }
+
+    AUDDBG("Decoding on %d threads.\n", m_workers.len());
+}
+
+ParallelDecoder::~ParallelDecoder()
+{
+    stop();
+
+    pthread_mutex_lock(&m_mutex);
+    m_quit = true;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+
+    for (ParallelWorker *worker : m_workers)
+    {
+        pthread_join(worker->thread, nullptr);
+        delete_worker(worker);
+    }
+}
+
+/* leaves the reader where the main decoder had it */
+int64_t ParallelDecoder::read_at(int64_t offset, void *buf, int64_t len)
+{
+    int64_t pos = m_reader.ftell();
+    int64_t got = -1;
+
+    if (m_reader.fseek(offset, VFS_SEEK_SET) == 0)
+        got = m_reader.fread(buf, 1, len);
+
+    if (pos < 0 || m_reader.fseek(pos, VFS_SEEK_SET) != 0)
+        AUDWARN("Could not restore the read position.\n");
+
+    return got;
+}
+
+bool ParallelDecoder::read_streaminfo()
+{
+    unsigned char id3[10];
+    int64_t offset = 0;
+
+    if (read_at(0, id3, sizeof id3) != sizeof id3)
+        return false;
+
+    /* libFLAC skips an ID3v2 tag before the stream */
+    if (!memcmp(id3, "ID3", 3))
+    {
+        offset = 10 + ((id3[6] & 0x7f) << 21 | (id3[7] & 0x7f) << 14 |
+                       (id3[8] & 0x7f) << 7 | (id3[9] & 0x7f));
+        if (id3[5] & 0x10)
+            offset += 10;
+    }
+
+    /* the STREAMINFO block always comes first */
+    m_streaminfo.resize(8 + FLAC__STREAM_METADATA_STREAMINFO_LENGTH);
+    auto p = (unsigned char *) m_streaminfo.begin();
+
+    if (read_at(offset, p, m_streaminfo.len()) != m_streaminfo.len() ||
+        memcmp(p, "fLaC", 4) || (p[4] & 0x7f) != FLAC__METADATA_TYPE_STREAMINFO ||
+        (unsigned) (p[5] << 16 | p[6] << 8 | p[7]) != FLAC__STREAM_METADATA_STREAMINFO_LENGTH)
+    {
+        m_streaminfo.clear();
+        return false;
+    }
+
+    /* and for the workers, it is the last */
+    p[4] |= 0x80;
+
+    m_max_blocksize = p[10] << 8 | p[11];
+    return true;
+}
+
+/* reads on until the buffer reaches the given offset or the end of the file */
+void ParallelDecoder::ensure(int64_t upto)
+{
+    while (!m_eof && m_buffer_pos + m_buffer.len() < upto)
+    {
+        /* what has been scanned is not needed any more */
+        if (m_scan_pos > m_buffer_pos)
+        {
+            m_buffer.remove(0, m_scan_pos - m_buffer_pos);
+            m_buffer_pos = m_scan_pos;
+        }
+
+        int used = m_buffer.len();
+        m_buffer.resize(used + READ_SIZE);
+
+        int64_t got = aud::max<int64_t>(0,
+         read_at(m_buffer_pos + used, &m_buffer[used], READ_SIZE));
+
+        m_buffer.resize(used + got);
+        if (got < READ_SIZE)
+            m_eof = true;
+    }
+}
+
+bool ParallelDecoder::parse_header(int64_t offset, FrameHeader &header)
+{
+    int64_t avail = m_buffer_pos + m_buffer.len() - offset;
+    if (avail < 6)
+        return false;
+
+    auto p = (const unsigned char *) &m_buffer[offset - m_buffer_pos];
+
+    if (p[0] != 0xff || (p[1] & 0xfe) != 0xf8)
+        return false;
+
+    unsigned blocksize_code = p[2] >> 4;
+    unsigned rate_code = p[2] & 15;
+    unsigned assignment = p[3] >> 4;
+    unsigned size_code = (p[3] >> 1) & 7;
+
+    if (!blocksize_code || rate_code == 15 || assignment > 10 ||
+        size_code == 3 || (p[3] & 1))
+        return false;
+
+    if ((assignment < 8 ? assignment + 1 : 2) != m_channels)
+        return false;
+
+    /* the frame or sample number, coded as in UTF-8 */
+    int ones = 0;
+    while (ones < 8 && (p[4] & (0x80 >> ones)))
+        ones++;
+
+    if (ones == 1 || ones == 8)
+        return false;
+
+    uint64_t number = p[4] & (0x7f >> ones);
+    int len = 5;
+
+    for (int i = 1; i < ones; i++, len++)
+    {
+        if (len >= avail || (p[len] & 0xc0) != 0x80)
+            return false;
+
+        number = number << 6 | (p[len] & 0x3f);
+    }
+
+    unsigned blocksize;
+
+    if (blocksize_code == 1)
+        blocksize = 192;
+    else if (blocksize_code <= 5)
+        blocksize = 576 << (blocksize_code - 2);
+    else if (blocksize_code == 6)
+    {
+        if (len >= avail)
+            return false;
+        blocksize = p[len++] + 1;
+    }
+    else if (blocksize_code == 7)
+    {
+        if (len + 1 >= avail)
+            return false;
+        blocksize = (p[len] << 8 | p[len + 1]) + 1;
+        len += 2;
+    }
+    else
+        blocksize = 256 << (blocksize_code - 8);
+
+    if (rate_code == 12)
+        len += 1;
+    else if (rate_code == 13 || rate_code == 14)
+        len += 2;
+
+    if (len >= avail)
+        return false;
+
+    uint8_t crc = 0;
+    for (int i = 0; i < len; i++)
+        crc = crc_tables.crc8[crc ^ p[i]];
+
+    if (crc != p[len])
+        return false;
+
+    header.variable = p[1] & 1;
+    header.blocksize = blocksize;
+    header.first_sample = header.variable ? number : number * m_max_blocksize;
+    header.length = len + 1;
+
+    return true;
+}
+
+/* The frame at m_scan_pos ends where the next header starts for which the
+ * CRC-16 of everything before matches, or else at the end of the file.
+ * Returns its length, 0 if there are no more frames, or -1 if there is no
+ * valid frame (a damaged one, or anything after the last). */
+int64_t ParallelDecoder::find_frame(FrameHeader &header)
+{
+    ensure(m_scan_pos + MAX_HEADER);
+
+    if (m_scan_pos >= m_buffer_pos + m_buffer.len())
+        return 0;
+    if (!parse_header(m_scan_pos, header))
+        return -1;
+
+    uint16_t crc = 0;
+    int64_t crc_pos = m_scan_pos;
+    int64_t pos = m_scan_pos + header.length + 2;
+
+    while (pos - m_scan_pos <= MAX_FRAME)
+    {
+        ensure(pos + MAX_HEADER);
+
+        /* m_buffer[0] is at m_buffer_pos */
+        auto data = (const unsigned char *) m_buffer.begin();
+        int64_t end = m_buffer_pos + m_buffer.len();
+        int64_t candidate = end;
+
+        if (pos < end)
+        {
+            auto hit = (const unsigned char *) memchr(data + (pos - m_buffer_pos), 0xff, end - pos);
+            if (hit)
+                candidate = m_buffer_pos + (hit - data);
+        }
+
+        if (candidate + MAX_HEADER > end && !m_eof)
+        {
+            pos = candidate;  /* read on */
+            continue;
+        }
+
+        /* the last frame must end the file exactly */
+        FrameHeader next;
+        if (candidate == end ||
+            (parse_header(candidate, next) && next.variable == header.variable))
+        {
+            for (; crc_pos < candidate - 2; crc_pos++)
+                crc = crc << 8 ^ crc_tables.crc16[(crc >> 8) ^ data[crc_pos - m_buffer_pos]];
+
+            const unsigned char *footer = data + (candidate - 2 - m_buffer_pos);
+            if (crc == (footer[0] << 8 | footer[1]))
+                return candidate - m_scan_pos;
+
+            if (candidate == end)
+                break;
+        }
+
+        pos = candidate + 1;
+    }
+
+    AUDWARN("No FLAC frame found at byte %ld.\n", (long) m_scan_pos);
+    return -1;
+}
+
+bool ParallelDecoder::scan_job(Job &job)
+{
+    job.input.resize(0);
+    job.frames = 0;
+    job.samples = 0;
+
+    while (m_scan_state == Scanning && job.frames < JOB_FRAMES)
+    {
+        FrameHeader header;
+        int64_t length = find_frame(header);
+
+        if (length <= 0)
+        {
+            m_scan_state = length ? Failed : Ended;
+            break;
+        }
+
+        if (!job.frames)
+            job.first_sample = header.first_sample;
+
+        job.input.insert(&m_buffer[m_scan_pos - m_buffer_pos], -1, length);
+        job.frames++;
+        job.samples += header.blocksize;
+
+        m_scan_pos += length;
+        m_next_sample = header.first_sample + header.blocksize;
+    }
+
+    return job.frames > 0;
+}
+
+bool ParallelDecoder::start(uint64_t offset)
+{
+    stop();
+
+    m_buffer.resize(0);
+    m_buffer_pos = m_scan_pos = offset;
+    m_eof = false;
+
+    ensure(m_scan_pos + MAX_HEADER);
+
+    FrameHeader header;
+    if (!parse_header(m_scan_pos, header))
+        return false;
+
+    m_scan_state = Scanning;
+    m_next_sample = header.first_sample;
+    return true;
+}
+
+void ParallelDecoder::stop()
+{
+    pthread_mutex_lock(&m_mutex);
+
+    for (Job &job : m_jobs)
+    {
+        if (job.state == Job::Queued)
+            job.state = Job::Free;
+    }
+
+    for (Job &job : m_jobs)
+    {
+        while (job.state == Job::Busy)
+            pthread_cond_wait(&m_cond, &m_mutex);
+
+        job.state = Job::Free;
+    }
+
+    m_head = m_tail = 0;
+    m_returned = false;
+
+    pthread_mutex_unlock(&m_mutex);
+
+    m_scan_state = Ended;
+}
+
+ParallelDecoder::Result ParallelDecoder::next(const Index<char> *&audio, uint64_t &resume)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    if (m_returned)
+    {
+        m_jobs[m_head].state = Job::Free;
+        m_head = (m_head + 1) % PARALLEL_QUEUE;
+        m_returned = false;
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+
+    /* keep the queue full; only this thread touches a free job */
+    while (true)
+    {
+        pthread_mutex_lock(&m_mutex);
+        bool room = (m_jobs[m_tail].state == Job::Free);
+        pthread_mutex_unlock(&m_mutex);
+
+        if (!room || !scan_job(m_jobs[m_tail]))
+            break;
+
+        pthread_mutex_lock(&m_mutex);
+        m_jobs[m_tail].state = Job::Queued;
+        m_tail = (m_tail + 1) % PARALLEL_QUEUE;
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    Job &job = m_jobs[m_head];
+
+    pthread_mutex_lock(&m_mutex);
+
+    while (job.state == Job::Queued || job.state == Job::Busy)
+        pthread_cond_wait(&m_cond, &m_mutex);
+
+    bool done = (job.state == Job::Done);
+
+    pthread_mutex_unlock(&m_mutex);
+
+    if (!done)
+    {
+        resume = m_next_sample;
+        return (m_scan_state == Failed) ? Fallback : End;
+    }
+
+    if (!job.ok)
+    {
+        AUDWARN("FLAC frames at sample %lu did not decode.\n", (unsigned long) job.first_sample);
+        resume = job.first_sample;
+        return Fallback;
+    }
+
+    audio = &job.output;
+    m_returned = true;
+    return Audio;
+}
+
+void ParallelDecoder::work(ParallelWorker *worker)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    while (!m_quit)
+    {
+        /* the oldest job first */
+        Job *job = nullptr;
+
+        for (int i = 0; i < PARALLEL_QUEUE && !job; i++)
+        {
+            Job &queued = m_jobs[(m_head + i) % PARALLEL_QUEUE];
+            if (queued.state == Job::Queued)
+                job = &queued;
+        }
+
+        if (!job)
+        {
+            pthread_cond_wait(&m_cond, &m_mutex);
+            continue;
+        }
+
+        job->state = Job::Busy;
+        pthread_mutex_unlock(&m_mutex);
+
+        decode(worker, *job);
+
+        pthread_mutex_lock(&m_mutex);
+        job->state = Job::Done;
+        pthread_cond_broadcast(&m_cond);
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+/* the frames are interleaved straight into the job's output buffer, which
+ * is sized from their headers */
+void ParallelDecoder::decode(ParallelWorker *worker, Job &job)
+{
+    unsigned samples = job.samples * m_channels;
+    job.output.resize(samples * SAMPLE_SIZE(m_bits_per_sample));
+
+    worker->output_buffer = std::move(job.output);
+    worker->reset();
+
+    worker->input = job.input.begin();
+    worker->input_left = job.input.len();
+
+    FLAC__stream_decoder_flush(worker->decoder);
+
+    for (int i = 0; i < job.frames; i++)
+    {
+        if (!FLAC__stream_decoder_process_single(worker->decoder) ||
+            FLAC__stream_decoder_get_state(worker->decoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+            break;
+    }
+
+    job.ok = (worker->buffer_used == samples);
+    job.output = std::move(worker->output_buffer);
+}
+
+int parallel_threads()
+{
+    if (!aud_get_bool("flacng", "parallel_decode"))
+        return 0;
+
+    int cpus = std::thread::hardware_concurrency();
+    return (cpus > 1) ? aud::min(cpus, PARALLEL_MAX_THREADS) : 0;
+}
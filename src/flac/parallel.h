@@ -0,0 +1,122 @@
+/*
+ *  A FLAC decoder plugin for the Audacious Media Player
+ *  Copyright (C) 2024 Audacious Plugins Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef FLACNG_PARALLEL_H
+#define FLACNG_PARALLEL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "flacng.h"
+
+#define PARALLEL_MAX_THREADS 4
+#define PARALLEL_QUEUE (2 * PARALLEL_MAX_THREADS)
+
+struct ParallelWorker;
+
+/* Decodes a native FLAC file several frames at a time on worker threads.
+ * The frame boundaries are found ahead of the decoders by their headers and
+ * CRCs, and each run of frames goes, with a copy of the STREAMINFO block, to
+ * a decoder of its own; the audio comes back in order.  The main decoder is
+ * still the one that seeks, after which the scan restarts where it left off,
+ * so seeking works exactly as in a serial decode. */
+class ParallelDecoder
+{
+public:
+    enum Result {
+        Audio,      /* the next part of the stream */
+        End,
+        Fallback    /* decode serially from the given sample on */
+    };
+
+    ParallelDecoder(const callback_info &info, LocalReader &reader, int threads);
+    ~ParallelDecoder();
+
+    /* false if the file cannot be decoded in parallel */
+    bool ready() const { return m_workers.len() > 0; }
+
+    /* scans from a frame at the given byte offset; false if there is none */
+    bool start(uint64_t offset);
+
+    /* the audio stays valid until the next call */
+    Result next(const Index<char> *&audio, uint64_t &resume);
+
+    /* drops all the frames scanned so far */
+    void stop();
+
+    /* for the workers */
+    void work(ParallelWorker *worker);
+
+private:
+    struct FrameHeader
+    {
+        bool variable;          /* blocking strategy */
+        unsigned blocksize;
+        uint64_t first_sample;
+        int length;
+    };
+
+    struct Job
+    {
+        enum { Free, Queued, Busy, Done } state = Free;
+        Index<char> input;      /* whole frames */
+        int frames = 0;
+        unsigned samples = 0;   /* per channel */
+        uint64_t first_sample = 0;
+        Index<char> output;
+        bool ok = false;
+    };
+
+    bool read_streaminfo();
+    int64_t read_at(int64_t offset, void *buf, int64_t len);
+    void ensure(int64_t upto);
+    bool parse_header(int64_t offset, FrameHeader &header);
+    int64_t find_frame(FrameHeader &header);
+    bool scan_job(Job &job);
+    void decode(ParallelWorker *worker, Job &job);
+
+    unsigned m_channels, m_bits_per_sample, m_sample_rate;
+    unsigned m_max_blocksize = 0;
+    LocalReader &m_reader;
+    Index<char> m_streaminfo;   /* "fLaC" and the STREAMINFO block */
+
+    /* read ahead of the scan, from m_buffer_pos on */
+    Index<char> m_buffer;
+    int64_t m_buffer_pos = 0;
+    bool m_eof = false;
+
+    /* where the next frame starts */
+    enum { Scanning, Ended, Failed } m_scan_state = Ended;
+    int64_t m_scan_pos = 0;
+    uint64_t m_next_sample = 0;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_cond = PTHREAD_COND_INITIALIZER;
+    bool m_quit = false;
+
+    Job m_jobs[PARALLEL_QUEUE];
+    int m_head = 0, m_tail = 0;     /* oldest job, next free slot */
+    bool m_returned = false;        /* the oldest job is being played */
+
+    Index<ParallelWorker *> m_workers;
+};
+
+int parallel_threads();
+
+#endif
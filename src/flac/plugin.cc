@@ -20,18 +20,81 @@
 
 #include <string.h>
 
+#include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 
 #include "flacng.h"
+#include "parallel.h"
+#include "../vfs-common/track-prefetch.h"
+#include "../trace-common/trace.h"
 
 EXPORT FLACng aud_plugin_instance;
 
+static const char *const flac_defaults[] = {
+    "parallel_decode", "FALSE",
+    nullptr
+};
+
+static const PreferencesWidget flac_widgets[] = {
+    WidgetCheck(N_("Decode on several threads (for high-resolution files)"),
+        WidgetBool("flacng", "parallel_decode"))
+};
+
+const PluginPreferences FLACng::prefs = {{flac_widgets}};
+
 using StreamDecoderPtr = SmartPtr<FLAC__StreamDecoder, FLAC__stream_decoder_delete>;
 static StreamDecoderPtr s_decoder, s_ogg_decoder;
 static callback_info s_cinfo;
 
+/* When play() is stopped in the middle of a native FLAC file, the decoder
+ * and the last frame it decoded are kept.  The next track of a cue sheet of
+ * one file starts with a seek to where the last one ended, which falls in
+ * that frame; then the decoder goes on from there, without reading the
+ * metadata again or seeking. */
+struct Continuation
+{
+    String filename;
+    int64_t size = -1;
+    int64_t pos = -1;       /* where the decoder had read up to */
+};
+
+static Continuation s_continuation;
+
+static void drop_continuation()
+{
+    if (s_continuation.filename && FLAC__stream_decoder_flush(s_decoder.get()) == false)
+        AUDERR("Could not flush decoder state!\n");
+
+    s_continuation = Continuation();
+    s_cinfo = callback_info();
+}
+
+/* the rest of the last frame from the given sample on, or false */
+static bool resume(const char *filename, LocalReader &reader, int seek_value)
+{
+    if (!s_continuation.filename || strcmp(filename, s_continuation.filename) ||
+        reader.fsize() != s_continuation.size || seek_value < 0 || !s_cinfo.frame_frames)
+        return false;
+
+    uint64_t sample = (uint64_t) seek_value * s_cinfo.sample_rate / 1000;
+    uint64_t end = s_cinfo.frame_sample + s_cinfo.frame_frames;
+
+    if (sample < s_cinfo.frame_sample || sample >= end ||
+        reader.fseek(s_continuation.pos, VFS_SEEK_SET) != 0)
+        return false;
+
+    int frame_size = s_cinfo.channels * SAMPLE_SIZE(s_cinfo.bits_per_sample);
+    s_cinfo.write_pointer = s_cinfo.output_buffer.begin() + (sample - s_cinfo.frame_sample) * frame_size;
+    s_cinfo.buffer_used = (end - sample) * s_cinfo.channels;
+
+    s_continuation = Continuation();
+    return true;
+}
+
 bool FLACng::init()
 {
+    aud_config_set_defaults("flacng", flac_defaults);
+
     /* Callback structure and decoder for main decoding loop */
     auto flac_decoder = StreamDecoderPtr(FLAC__stream_decoder_new());
     if (!flac_decoder)
@@ -81,6 +144,9 @@ bool FLACng::init()
 
 void FLACng::cleanup()
 {
+    track_prefetch_cleanup();
+    drop_continuation();
+
     s_decoder.clear();
     s_ogg_decoder.clear();
 }
@@ -96,43 +162,15 @@ bool FLACng::is_our_file(const char *filename, VFSFile &file)
     return ! strncmp (buf, "fLaC", sizeof buf);
 }
 
-static void squeeze_audio(int32_t* src, void* dst, unsigned count, unsigned res)
-{
-    int32_t* rp = src;
-    int8_t*  wp = (int8_t*) dst;
-    int16_t* wp2 = (int16_t*) dst;
-    int32_t* wp4 = (int32_t*) dst;
-
-    switch (res)
-    {
-        case 8:
-            for (unsigned i = 0; i < count; i++, wp++, rp++)
-                *wp = *rp & 0xff;
-            break;
-
-        case 16:
-            for (unsigned i = 0; i < count; i++, wp2++, rp++)
-                *wp2 = *rp & 0xffff;
-            break;
-
-        case 24:
-        case 32:
-            for (unsigned i = 0; i < count; i++, wp4++, rp++)
-                *wp4 = *rp;
-            break;
-
-        default:
-            AUDERR("Can not convert to %u bps\n", res);
-    }
-}
-
 bool FLACng::play(const char *filename, VFSFile &file)
 {
-    Index<char> play_buffer;
-    bool error = false;
+    bool error = false, stopped = false;
     bool stream = (file.fsize() < 0);
+    int threads = 0;
+    SmartPtr<ParallelDecoder> parallel;
     bool _is_ogg_flac = is_ogg_flac(file);
-    auto tuple = stream ? get_playback_tuple() : Tuple();
+    auto tuple = get_playback_tuple();
+    TrackPrefetch prefetch(tuple.get_int(Tuple::Length));
     auto decoder = _is_ogg_flac && FLAC_API_SUPPORTS_OGG_FLAC
                        ? s_ogg_decoder.get() : s_decoder.get();
 
@@ -142,29 +180,70 @@ bool FLACng::play(const char *filename, VFSFile &file)
                 "this format. Falling back to the main FLAC decoder.\n");
     }
 
-    s_cinfo.fd = &file;
+    LocalReader reader(file);
+
+    /* a cue track starts with a seek to where it begins */
+    int pending_seek = check_seek();
+    bool resumed = !stream && !_is_ogg_flac && resume(filename, reader, pending_seek);
 
-    if (read_metadata(decoder, &s_cinfo) == false)
+    if (!resumed)
+        drop_continuation();
+
+    s_cinfo.fd = &reader;
+
+    if (resumed)
+    {
+        AUDDBG("Going on from the last track in %s.\n", filename);
+    }
+    else if (read_metadata(decoder, &s_cinfo) == false)
     {
         AUDERR("Could not prepare file for playing!\n");
         error = true;
         goto ERR;
     }
 
-    play_buffer.resize(BUFFER_SIZE_BYTE);
-
     if (stream && tuple.fetch_stream_info(file))
         set_playback_tuple(tuple.ref());
 
     set_stream_bitrate(s_cinfo.bitrate);
     open_audio(SAMPLE_FMT(s_cinfo.bits_per_sample), s_cinfo.sample_rate, s_cinfo.channels);
+    prefetch.set_format(SAMPLE_FMT(s_cinfo.bits_per_sample), s_cinfo.sample_rate, s_cinfo.channels);
+
+    if (resumed)
+    {
+        prefetch.seeked(pending_seek);
+        pending_seek = -1;
+
+        int bytes = s_cinfo.buffer_used * SAMPLE_SIZE(s_cinfo.bits_per_sample);
+        write_audio(s_cinfo.write_pointer, bytes);
+        prefetch.written(bytes);
+
+        s_cinfo.reset();
+    }
+
+    if (!stream && !_is_ogg_flac && (threads = parallel_threads()))
+    {
+        FLAC__uint64 offset;
+        parallel.capture(new ParallelDecoder(s_cinfo, reader, threads));
+
+        if (!parallel->ready() ||
+            !FLAC__stream_decoder_get_decode_position(decoder, &offset) ||
+            !parallel->start(offset))
+            parallel.clear();
+    }
 
     while (FLAC__stream_decoder_get_state(decoder) != FLAC__STREAM_DECODER_END_OF_STREAM)
     {
+        TRACE_SPAN ("FLAC play");
         if (check_stop ())
+        {
+            stopped = true;
             break;
+        }
+
+        int seek_value = (pending_seek >= 0) ? pending_seek : check_seek ();
+        pending_seek = -1;
 
-        int seek_value = check_seek ();
         if (seek_value >= 0)
         {
             uint64_t sample = (uint64_t) seek_value * s_cinfo.sample_rate / 1000;
@@ -173,12 +252,64 @@ bool FLACng::play(const char *filename, VFSFile &file)
             if (s_cinfo.total_samples > 0)
                 sample = aud::min<uint64_t>(sample, s_cinfo.total_samples - 1);
 
+            if (parallel)
+                parallel->stop();
+
+            prefetch.seeked(seek_value);
+
             if (! FLAC__stream_decoder_seek_absolute(decoder, sample))
             {
                 AUDERR("Error while seeking!\n");
                 error = true;
                 break;
             }
+
+            /* the main decoder has the frame that was sought to; the workers
+             * go on from the one after it */
+            if (parallel)
+            {
+                FLAC__uint64 offset;
+                if (!FLAC__stream_decoder_get_decode_position(decoder, &offset) ||
+                    !parallel->start(offset))
+                    parallel.clear();
+
+                int bytes = s_cinfo.buffer_used * SAMPLE_SIZE(s_cinfo.bits_per_sample);
+                write_audio(s_cinfo.output_buffer.begin(), bytes);
+                prefetch.written(bytes);
+
+                s_cinfo.reset();
+                continue;
+            }
+        }
+
+        if (parallel)
+        {
+            const Index<char> *audio;
+            uint64_t resume;
+
+            auto result = parallel->next(audio, resume);
+            if (result == ParallelDecoder::End)
+                break;
+
+            if (result == ParallelDecoder::Audio)
+            {
+                write_audio(audio->begin(), audio->len());
+                prefetch.written(audio->len());
+                continue;
+            }
+
+            /* go on serially from the first sample not played */
+            parallel.clear();
+
+            if (s_cinfo.total_samples > 0 && resume >= s_cinfo.total_samples)
+                break;
+
+            if (! FLAC__stream_decoder_seek_absolute(decoder, resume))
+            {
+                AUDERR("Error while seeking!\n");
+                error = true;
+                break;
+            }
         }
 
         /* Try to decode a single frame of audio */
@@ -192,16 +323,28 @@ bool FLACng::play(const char *filename, VFSFile &file)
         if (stream && tuple.fetch_stream_info(file))
             set_playback_tuple(tuple.ref());
 
-        squeeze_audio(s_cinfo.output_buffer.begin(), play_buffer.begin(),
-         s_cinfo.buffer_used, s_cinfo.bits_per_sample);
-        write_audio(play_buffer.begin(), s_cinfo.buffer_used *
-         SAMPLE_SIZE(s_cinfo.bits_per_sample));
+        int bytes = s_cinfo.buffer_used * SAMPLE_SIZE(s_cinfo.bits_per_sample);
+        write_audio(s_cinfo.output_buffer.begin(), bytes);
+        prefetch.written(bytes);
 
         s_cinfo.reset();
     }
 
 ERR:
+    /* the parallel decoder reads ahead of the main one */
+    bool keep = stopped && !parallel && !stream && !_is_ogg_flac;
+
+    parallel.clear();
     s_cinfo.reset();
+    s_cinfo.fd = nullptr;
+
+    if (keep)
+    {
+        s_continuation.filename = String(filename);
+        s_continuation.size = reader.fsize();
+        s_continuation.pos = reader.ftell();
+        return true;
+    }
 
     if (FLAC__stream_decoder_flush(decoder) == false)
         AUDERR("Could not flush decoder state!\n");
@@ -112,6 +112,36 @@ FLAC__StreamDecoderLengthStatus length_callback(const FLAC__StreamDecoder *decod
     return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
 }
 
+/* libFLAC decodes each channel into a buffer of its own, with the samples
+ * in the low bits of an int32_t.  They are interleaved and narrowed to the
+ * output format in the same pass; the stereo loop is the common case. */
+template<class T>
+static void interleave(const FLAC__int32 *const buffer[], unsigned channels,
+ unsigned frames, unsigned shift, T *out)
+{
+    if (channels == 2 && !shift)
+    {
+        const FLAC__int32 *left = buffer[0], *right = buffer[1];
+
+        for (unsigned i = 0; i < frames; i++)
+        {
+            out[2 * i] = (T) left[i];
+            out[2 * i + 1] = (T) right[i];
+        }
+
+        return;
+    }
+
+    for (unsigned channel = 0; channel < channels; channel++)
+    {
+        const FLAC__int32 *in = buffer[channel];
+        T *wp = out + channel;
+
+        for (unsigned i = 0; i < frames; i++, wp += channels)
+            *wp = (T) ((uint32_t) in[i] << shift);
+    }
+}
+
 FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 *const buffer[], void *client_data)
 {
     callback_info *info = (callback_info*) client_data;
@@ -125,15 +155,41 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
     if (!info->output_buffer.len())
         info->alloc();
 
-    for (unsigned sample = 0; sample < frame->header.blocksize; sample++)
+    unsigned bits = info->bits_per_sample;
+    unsigned frames = frame->header.blocksize;
+    unsigned samples = frames * info->channels;
+
+    if (info->write_pointer + samples * SAMPLE_SIZE(bits) > info->output_buffer.end())
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+    switch (SAMPLE_SIZE(bits))
     {
-        for (unsigned channel = 0; channel < frame->header.channels; channel++)
-        {
-            *(info->write_pointer++) = buffer[channel][sample];
-            info->buffer_used += 1;
-        }
+        case 1:
+            interleave(buffer, info->channels, frames, 0, (int8_t *) info->write_pointer);
+            break;
+
+        case 2:
+            interleave(buffer, info->channels, frames, 0, (int16_t *) info->write_pointer);
+            break;
+
+        default:
+            /* 24 and 32 bits are output as they are; any other depth is
+             * scaled up to 32 bits */
+            interleave(buffer, info->channels, frames, (bits == 24) ? 0 : 32 - bits,
+             (int32_t *) info->write_pointer);
+            break;
     }
 
+    info->write_pointer += samples * SAMPLE_SIZE(bits);
+    info->buffer_used += samples;
+
+    if (frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER)
+        info->frame_sample = frame->header.number.sample_number;
+    else
+        info->frame_sample = (uint64_t) frame->header.number.frame_number * frames;
+
+    info->frame_frames = frames;
+
     return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
@@ -28,8 +28,11 @@
 #include <libaudcore/i18n.h>
 #include <libaudcore/interface.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 
+#include "readahead.h"
+
 static const char gio_about[] =
  N_("GIO Plugin for Audacious\n"
     "Copyright 2009-2012 John Lindgren");
@@ -39,10 +42,21 @@ static const char * const gio_schemes[] = {"ftp", "sftp", "smb", "mtp"};
 class GIOTransport : public TransportPlugin
 {
 public:
-    static constexpr PluginInfo info = {N_("GIO Plugin"), PACKAGE, gio_about};
+    static const char * const defaults[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
+
+    static constexpr PluginInfo info = {
+        N_("GIO Plugin"),
+        PACKAGE,
+        gio_about,
+        & prefs
+    };
 
     constexpr GIOTransport () : TransportPlugin (info, gio_schemes) {}
 
+    bool init () override;
+
     VFSImpl * fopen (const char * path, const char * mode, String & error) override;
     VFSFileTest test_file (const char * filename, VFSFileTest test, String & error) override;
     Index<String> read_folder (const char * filename, String & error) override;
@@ -50,6 +64,25 @@ public:
 
 EXPORT GIOTransport aud_plugin_instance;
 
+const char * const GIOTransport::defaults[] = {
+    "readahead_kb", "1024",
+    nullptr
+};
+
+const PreferencesWidget GIOTransport::widgets[] = {
+    WidgetSpin (N_("Read-ahead:"),
+        WidgetInt ("gio", "readahead_kb"),
+        {0, 65536, 256, N_("KiB (0 = disabled)")})
+};
+
+const PluginPreferences GIOTransport::prefs = {{widgets}};
+
+bool GIOTransport::init ()
+{
+    aud_config_set_defaults ("gio", defaults);
+    return true;
+}
+
 class GIOFile : public VFSImpl
 {
 public:
@@ -81,6 +114,7 @@ private:
     GInputStream * m_istream = nullptr;
     GOutputStream * m_ostream = nullptr;
     GSeekable * m_seekable = nullptr;
+    ReadAhead * m_ahead = nullptr;  /* for files opened only for reading */
     bool m_eof = false;
 };
 
@@ -125,6 +159,10 @@ GIOFile::GIOFile (const char * filename, const char * mode) :
             m_istream = (GInputStream *) g_file_read (m_file, 0, & error);
             CHECK_AND_SAVE_ERROR ("open", filename);
             m_seekable = (GSeekable *) m_istream;
+
+            int window = aud_get_int ("gio", "readahead_kb");
+            if (window > 0)
+                m_ahead = new ReadAhead (m_istream, m_seekable, 1024 * window);
         }
         break;
     case 'w':
@@ -177,6 +215,8 @@ GIOFile::~GIOFile ()
 {
     GError * error = nullptr;
 
+    delete m_ahead;
+
     if (m_iostream)
     {
         g_io_stream_close (m_iostream, 0, & error);
@@ -223,6 +263,15 @@ int64_t GIOFile::fread (void * buf, int64_t size, int64_t nitems)
     int64_t total = 0;
     int64_t remain = size * nitems;
 
+    if (m_ahead)
+    {
+        total = m_ahead->read (buf, remain, & error);
+        CHECK_ERROR ("read from", m_filename);
+
+        m_eof = (total < remain);
+        remain = 0;
+    }
+
     while (remain > 0)
     {
         int64_t part = g_input_stream_read (m_istream, buf, remain, 0, & error);
@@ -293,7 +342,11 @@ int GIOFile::fseek (int64_t offset, VFSSeekType whence)
         return -1;
     }
 
-    g_seekable_seek (m_seekable, offset, gwhence, nullptr, & error);
+    if (m_ahead)
+        m_ahead->seek (offset, gwhence, & error);
+    else
+        g_seekable_seek (m_seekable, offset, gwhence, nullptr, & error);
+
     CHECK_ERROR ("seek within", m_filename);
 
     m_eof = (whence == VFS_SEEK_END && offset == 0);
@@ -306,7 +359,7 @@ FAILED:
 
 int64_t GIOFile::ftell ()
 {
-    return g_seekable_tell (m_seekable);
+    return m_ahead ? m_ahead->tell () : g_seekable_tell (m_seekable);
 }
 
 bool GIOFile::feof ()
@@ -335,16 +388,30 @@ int64_t GIOFile::fsize ()
         return -1;
 
     GError * error = nullptr;
-    int64_t saved_pos = g_seekable_tell (m_seekable);
+    GFileInfo * info = nullptr;
+    int64_t saved_pos = ftell ();
     int64_t size = -1;
 
-    g_seekable_seek (m_seekable, 0, G_SEEK_END, nullptr, & error);
-    CHECK_ERROR ("seek within", m_filename);
+    /* the stream belongs to the read-ahead thread, so ask the file */
+    if (m_ahead)
+    {
+        info = g_file_query_info (m_file, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+         G_FILE_QUERY_INFO_NONE, nullptr, & error);
+        CHECK_ERROR ("query size of", m_filename);
 
-    size = g_seekable_tell (m_seekable);
+        size = g_file_info_get_size (info);
+        g_object_unref (info);
+    }
+    else
+    {
+        g_seekable_seek (m_seekable, 0, G_SEEK_END, nullptr, & error);
+        CHECK_ERROR ("seek within", m_filename);
 
-    g_seekable_seek (m_seekable, saved_pos, G_SEEK_SET, nullptr, & error);
-    CHECK_ERROR ("seek within", m_filename);
+        size = g_seekable_tell (m_seekable);
+
+        g_seekable_seek (m_seekable, saved_pos, G_SEEK_SET, nullptr, & error);
+        CHECK_ERROR ("seek within", m_filename);
+    }
 
     m_eof = (saved_pos >= size);
 
@@ -0,0 +1,226 @@
+/*
+ * GIO Transport Plugin for Audacious
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "readahead.h"
+
+#include <libaudcore/objects.h>
+
+/* Four reads fill the window, so there is always room for the next one
+ * soon after the decoder starts taking data out. */
+ReadAhead::ReadAhead (GInputStream * stream, GSeekable * seekable, int window) :
+    m_stream (stream),
+    m_seekable (seekable),
+    m_cancel (g_cancellable_new ())
+{
+    int block = aud::clamp (window / 4, 16384, 262144);
+
+    m_buffer.alloc (aud::max (window, 2 * block));
+    m_block.resize (block);
+
+    pthread_create (& m_thread, nullptr, run_thread, this);
+}
+
+ReadAhead::~ReadAhead ()
+{
+    pthread_mutex_lock (& m_mutex);
+    m_quit = true;
+    g_cancellable_cancel (m_cancel);
+    pthread_cond_broadcast (& m_cond);
+    pthread_mutex_unlock (& m_mutex);
+
+    pthread_join (m_thread, nullptr);
+
+    g_clear_error (& m_error);
+    g_object_unref (m_cancel);
+}
+
+/* called with m_mutex held */
+void ReadAhead::do_seek ()
+{
+    int64_t offset = m_seek_offset;
+    GSeekType whence = m_seek_whence;
+
+    g_cancellable_reset (m_cancel);
+    pthread_mutex_unlock (& m_mutex);
+
+    GError * error = nullptr;
+    int64_t pos = -1;
+
+    if (g_seekable_seek (m_seekable, offset, whence, m_cancel, & error))
+        pos = g_seekable_tell (m_seekable);
+
+    pthread_mutex_lock (& m_mutex);
+
+    /* if the seek fails, the stream is still where m_buffer ends */
+    if (pos >= 0)
+    {
+        m_buffer.discard ();
+        m_pos = pos;
+        m_end = false;
+        g_clear_error (& m_error);
+    }
+
+    m_seek_pending = false;
+    m_seek_done = true;
+    m_seek_error = error;
+    pthread_cond_broadcast (& m_cond);
+}
+
+void ReadAhead::run ()
+{
+    int block = m_block.len ();
+
+    pthread_mutex_lock (& m_mutex);
+
+    while (! m_quit)
+    {
+        if (m_seek_pending)
+        {
+            do_seek ();
+            continue;
+        }
+
+        if (m_end || m_error || m_buffer.space () < block)
+        {
+            pthread_cond_wait (& m_cond, & m_mutex);
+            continue;
+        }
+
+        m_reading = true;
+        pthread_mutex_unlock (& m_mutex);
+
+        GError * error = nullptr;
+        int64_t part = g_input_stream_read (m_stream, m_block.begin (), block, m_cancel, & error);
+
+        pthread_mutex_lock (& m_mutex);
+        m_reading = false;
+
+        /* data read just before a seek is kept, in case the seek fails */
+        if (error)
+        {
+            if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+                g_error_free (error);
+            else
+                m_error = error;
+        }
+        else if (! part)
+            m_end = true;
+        else
+            m_buffer.copy_in (m_block.begin (), part);
+
+        pthread_cond_broadcast (& m_cond);
+    }
+
+    pthread_mutex_unlock (& m_mutex);
+}
+
+int64_t ReadAhead::read (void * buf, int64_t len, GError * * error)
+{
+    int64_t total = 0;
+
+    pthread_mutex_lock (& m_mutex);
+
+    while (total < len)
+    {
+        if (m_buffer.len ())
+        {
+            int part = aud::min (len - total, (int64_t) m_buffer.len ());
+            m_buffer.move_out ((char *) buf + total, part);
+
+            m_pos += part;
+            total += part;
+
+            pthread_cond_broadcast (& m_cond);
+        }
+        else if (m_error)
+        {
+            /* the data before the error goes out first */
+            if (! total)
+            {
+                g_propagate_error (error, m_error);
+                m_error = nullptr;
+                pthread_cond_broadcast (& m_cond);
+            }
+
+            break;
+        }
+        else if (m_end)
+            break;
+        else
+            pthread_cond_wait (& m_cond, & m_mutex);
+    }
+
+    pthread_mutex_unlock (& m_mutex);
+
+    return total;
+}
+
+bool ReadAhead::seek (int64_t offset, GSeekType whence, GError * * error)
+{
+    pthread_mutex_lock (& m_mutex);
+
+    if (whence == G_SEEK_CUR)
+    {
+        offset += m_pos;
+        whence = G_SEEK_SET;
+    }
+
+    if (whence == G_SEEK_SET && offset >= m_pos && offset <= m_pos + m_buffer.len ())
+    {
+        m_buffer.discard (offset - m_pos);
+        m_pos = offset;
+
+        pthread_cond_broadcast (& m_cond);
+        pthread_mutex_unlock (& m_mutex);
+        return true;
+    }
+
+    m_seek_pending = true;
+    m_seek_done = false;
+    m_seek_offset = offset;
+    m_seek_whence = whence;
+
+    if (m_reading)
+        g_cancellable_cancel (m_cancel);
+
+    pthread_cond_broadcast (& m_cond);
+
+    while (! m_seek_done)
+        pthread_cond_wait (& m_cond, & m_mutex);
+
+    bool success = ! m_seek_error;
+    if (m_seek_error)
+    {
+        g_propagate_error (error, m_seek_error);
+        m_seek_error = nullptr;
+    }
+
+    pthread_mutex_unlock (& m_mutex);
+
+    return success;
+}
+
+int64_t ReadAhead::tell ()
+{
+    pthread_mutex_lock (& m_mutex);
+    int64_t pos = m_pos;
+    pthread_mutex_unlock (& m_mutex);
+
+    return pos;
+}
@@ -0,0 +1,83 @@
+/*
+ * GIO Transport Plugin for Audacious
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef GIO_READAHEAD_H
+#define GIO_READAHEAD_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <gio/gio.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/ringbuf.h>
+
+/* Reads a stream ahead of the decoder in a thread of its own, in large
+ * blocks, so that the round trip to an SMB or SFTP server is not paid for
+ * every small read.  A seek within the window just moves forward in it;
+ * any other seek cancels the read in progress and starts over from the new
+ * position.
+ *
+ * Once this is set up, only the thread touches the stream. */
+class ReadAhead
+{
+public:
+    ReadAhead (GInputStream * stream, GSeekable * seekable, int window);
+    ~ReadAhead ();
+
+    ReadAhead (const ReadAhead &) = delete;
+    ReadAhead & operator= (const ReadAhead &) = delete;
+
+    /* returns less than len only at the end of the stream or on error */
+    int64_t read (void * buf, int64_t len, GError * * error);
+    bool seek (int64_t offset, GSeekType whence, GError * * error);
+    int64_t tell ();
+
+private:
+    GInputStream * m_stream;
+    GSeekable * m_seekable;
+    GCancellable * m_cancel;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_cond = PTHREAD_COND_INITIALIZER;
+    pthread_t m_thread;
+
+    RingBuf<char> m_buffer;
+    Index<char> m_block;        /* where the thread reads into */
+
+    int64_t m_pos = 0;          /* of the first byte in m_buffer */
+    bool m_end = false;         /* no more after m_buffer */
+    GError * m_error = nullptr; /* after m_buffer */
+
+    bool m_reading = false;     /* the thread is in g_input_stream_read() */
+    bool m_quit = false;
+
+    bool m_seek_pending = false, m_seek_done = false;
+    int64_t m_seek_offset = 0;
+    GSeekType m_seek_whence = G_SEEK_SET;
+    GError * m_seek_error = nullptr;
+
+    void run ();
+    void do_seek ();
+
+    static void * run_thread (void * data)
+        { ((ReadAhead *) data)->run (); return nullptr; }
+};
+
+#endif // GIO_READAHEAD_H
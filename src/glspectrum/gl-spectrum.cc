@@ -1,6 +1,7 @@
 /*
  * OpenGL Spectrum Analyzer for Audacious
  * Copyright 2013 Christophe Budé, John Lindgren, and Carlo Bramini
+ * Copyright 2024 Audacious Plugins Authors
  *
  * Based on the XMMS plugin:
  * Copyright 1998-2000 Peter Alm, Mikael Alm, Olle Hallnas, Thomas Nilsson, and
@@ -181,56 +182,65 @@ void GLSpectrum::clear ()
         gtk_widget_queue_draw (s_widget);
 }
 
-static void draw_rectangle (float x1, float y1, float z1, float x2, float y2,
+/* four quads for each bar, filled in and then drawn in one call */
+#define BAR_VERTICES 16
+
+static float s_vertices[NUM_BANDS * NUM_BANDS * BAR_VERTICES][3];
+static float s_colors[NUM_BANDS * NUM_BANDS * BAR_VERTICES][3];
+static int s_count;
+
+static void add_vertex (float x, float y, float z, float r, float g, float b)
+{
+    float * vertex = s_vertices[s_count];
+    float * color = s_colors[s_count];
+
+    vertex[0] = x;
+    vertex[1] = y;
+    vertex[2] = z;
+    color[0] = r;
+    color[1] = g;
+    color[2] = b;
+
+    s_count ++;
+}
+
+static void add_rectangle (float x1, float y1, float z1, float x2, float y2,
  float z2, float r, float g, float b)
 {
-    glColor3f (r, g, b);
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x1, y2, z1);
-    glVertex3f (x2, y2, z1);
-    glVertex3f (x2, y2, z2);
-    glVertex3f (x1, y2, z2);
-    glEnd ();
-
-    glColor3f (0.65f * r, 0.65f * g, 0.65f * b);
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x1, y1, z1);
-    glVertex3f (x1, y2, z1);
-    glVertex3f (x1, y2, z2);
-    glVertex3f (x1, y1, z2);
-    glEnd ();
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x2, y2, z1);
-    glVertex3f (x2, y1, z1);
-    glVertex3f (x2, y1, z2);
-    glVertex3f (x2, y2, z2);
-    glEnd ();
-
-    glColor3f (0.8f * r, 0.8f * g, 0.8f * b);
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x1, y1, z1);
-    glVertex3f (x2, y1, z1);
-    glVertex3f (x2, y2, z1);
-    glVertex3f (x1, y2, z1);
-    glEnd ();
+    add_vertex (x1, y2, z1, r, g, b);
+    add_vertex (x2, y2, z1, r, g, b);
+    add_vertex (x2, y2, z2, r, g, b);
+    add_vertex (x1, y2, z2, r, g, b);
+
+    float sr = 0.65f * r, sg = 0.65f * g, sb = 0.65f * b;
+
+    add_vertex (x1, y1, z1, sr, sg, sb);
+    add_vertex (x1, y2, z1, sr, sg, sb);
+    add_vertex (x1, y2, z2, sr, sg, sb);
+    add_vertex (x1, y1, z2, sr, sg, sb);
+
+    add_vertex (x2, y2, z1, sr, sg, sb);
+    add_vertex (x2, y1, z1, sr, sg, sb);
+    add_vertex (x2, y1, z2, sr, sg, sb);
+    add_vertex (x2, y2, z2, sr, sg, sb);
+
+    float fr = 0.8f * r, fg = 0.8f * g, fb = 0.8f * b;
+
+    add_vertex (x1, y1, z1, fr, fg, fb);
+    add_vertex (x2, y1, z1, fr, fg, fb);
+    add_vertex (x2, y2, z1, fr, fg, fb);
+    add_vertex (x1, y2, z1, fr, fg, fb);
 }
 
-static void draw_bar (float x, float z, float h, float r, float g, float b)
+static void add_bar (float x, float z, float h, float r, float g, float b)
 {
-    draw_rectangle (x, 0, z, x + BAR_WIDTH, h, z + BAR_WIDTH,
+    add_rectangle (x, 0, z, x + BAR_WIDTH, h, z + BAR_WIDTH,
      r * (0.2f + 0.8f * h), g * (0.2f + 0.8f * h), b * (0.2f + 0.8f * h));
 }
 
 static void draw_bars ()
 {
-    glPushMatrix ();
-    glTranslatef (0.0f, -0.5f, -5.0f);
-    glRotatef (38.0f, 1.0f, 0.0f, 0.0f);
-    glRotatef (s_angle + 180.0f, 0.0f, 1.0f, 0.0f);
+    s_count = 0;
 
     for (int i = 0; i < NUM_BANDS; i ++)
     {
@@ -238,12 +248,29 @@ static void draw_bars ()
 
         for (int j = 0; j < NUM_BANDS; j ++)
         {
-            draw_bar (1.6f - BAR_SPACING * j, z,
+            add_bar (1.6f - BAR_SPACING * j, z,
              s_bars[(s_pos + i) % NUM_BANDS][j] * 1.6,
              colors[i][j][0], colors[i][j][1], colors[i][j][2]);
         }
     }
 
+    glPushMatrix ();
+    glTranslatef (0.0f, -0.5f, -5.0f);
+    glRotatef (38.0f, 1.0f, 0.0f, 0.0f);
+    glRotatef (s_angle + 180.0f, 0.0f, 1.0f, 0.0f);
+
+    /* OpenGL 1.1, which is all that Windows gives without an extension
+     * loader, but one call rather than six for each face */
+    glEnableClientState (GL_VERTEX_ARRAY);
+    glEnableClientState (GL_COLOR_ARRAY);
+    glVertexPointer (3, GL_FLOAT, 0, s_vertices);
+    glColorPointer (3, GL_FLOAT, 0, s_colors);
+
+    glDrawArrays (GL_QUADS, 0, s_count);
+
+    glDisableClientState (GL_COLOR_ARRAY);
+    glDisableClientState (GL_VERTEX_ARRAY);
+
     glPopMatrix ();
 }
 
@@ -0,0 +1,434 @@
+/*
+ * Graphic Equalizer Plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <atomic>
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#endif
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
+
+#include "../trace-common/trace.h"
+
+#define MAX_BANDS 64
+#define LANES 4                 /* channels filtered side by side */
+#define MAX_GROUPS ((AUD_MAX_CHANNELS + LANES - 1) / LANES)
+#define CHUNK 16                /* frames between steps of the coefficients */
+#define RAMP_STEPS 64           /* steps from one setting to the next */
+#define SETTLED 1e-9f           /* state left in a flat band, when it is dropped */
+
+/* -400 dB of DC, which keeps the filters out of denormals in silence */
+#define ANTI_DENORMAL 1e-20f
+
+static const char * const graphic_eq_defaults[] = {
+    "gains", "0,0,0,0,0,0,0,0,0,0",
+    "parametric", "",
+    "preamp", "0",
+    nullptr
+};
+
+static std::atomic<bool> settings_changed;
+
+static void changed ()
+{
+    settings_changed = true;
+}
+
+static const PreferencesWidget graphic_eq_widgets[] = {
+    WidgetLabel (N_("<b>Graphic Equalizer</b>")),
+    WidgetEntry (N_("Gains in dB, from the lowest band up:"),
+        WidgetString ("graphic_eq", "gains", changed)),
+    WidgetLabel (N_("10, 15 or 31 gains use the ISO octave, 2/3 octave or "
+     "1/3 octave bands; any other number of them is spread evenly from "
+     "25 Hz to 16 kHz.")),
+    WidgetLabel (N_("<b>Parametric Bands</b>")),
+    WidgetEntry (N_("Frequency:gain:Q of each band, e.g. 60:3:0.7 3000:-2:2"),
+        WidgetString ("graphic_eq", "parametric", changed)),
+    WidgetLabel (N_("<b>Output</b>")),
+    WidgetSpin (N_("Preamp:"),
+        WidgetFloat ("graphic_eq", "preamp", changed),
+        {-20, 20, 0.5, N_("dB")})
+};
+
+static const PluginPreferences graphic_eq_prefs = {{graphic_eq_widgets}};
+
+static const char graphic_eq_about[] =
+ N_("Graphic Equalizer Plugin for Audacious\n"
+    "Copyright 2026 Audacious Plugins Authors\n\n"
+    "Any number of bands, each a peaking filter, in a cascade.  Changes "
+    "fade in over about 20 ms, and bands left at 0 dB cost nothing.");
+
+class GraphicEQ : public EffectPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("Graphic Equalizer"),
+        PACKAGE,
+        graphic_eq_about,
+        & graphic_eq_prefs
+    };
+
+    constexpr GraphicEQ () : EffectPlugin (info, 0, true) {}
+
+    bool init () override;
+
+    void start (int & channels, int & rate) override;
+    Index<float> & process (Index<float> & data) override;
+    bool flush (bool force) override;
+};
+
+EXPORT GraphicEQ aud_plugin_instance;
+
+/* ISO center frequencies */
+static const float octave_bands[10] = {31.5, 63, 125, 250, 500, 1000, 2000,
+ 4000, 8000, 16000};
+static const float two_thirds_bands[15] = {25, 40, 63, 100, 160, 250, 400,
+ 630, 1000, 1600, 2500, 4000, 6300, 10000, 16000};
+static const float third_bands[31] = {20, 25, 31.5, 40, 50, 63, 80, 100, 125,
+ 160, 200, 250, 315, 400, 500, 630, 800, 1000, 1250, 1600, 2000, 2500, 3150,
+ 4000, 5000, 6300, 8000, 10000, 12500, 16000, 20000};
+
+struct Coefs
+{
+    float b0, b1, b2, a1, a2;
+};
+
+struct BandSetting
+{
+    float freq, gain, q;
+};
+
+/* Each band ramps from its coefficients to those of the setting in
+ * RAMP_STEPS steps, one every CHUNK frames; as the transposed direct form
+ * II is, along a straight line between two stable filters the filter
+ * stays stable. */
+struct Band
+{
+    BandSetting setting;
+    Coefs now, step, target;
+    int steps;      /* left in the ramp */
+    bool active;    /* false once flat and settled */
+};
+
+static int current_channels, current_rate;
+static Band bands[MAX_BANDS];
+static int n_bands;
+static float preamp, preamp_step, preamp_target;
+static int preamp_steps;
+
+/* [band][group][z1, z2][lane], with a group of LANES channels in each
+ * vector */
+static float state[MAX_BANDS][MAX_GROUPS][2][LANES];
+
+/* the peaking filter of the Audio EQ Cookbook */
+static Coefs peaking (const BandSetting & band, int rate)
+{
+    float amp = powf (10, band.gain / 40);
+    float w = 2 * (float) M_PI * band.freq / rate;
+    float cw = cosf (w);
+    float alpha = sinf (w) / (2 * band.q);
+    float a0 = 1 + alpha / amp;
+
+    return {(1 + alpha * amp) / a0, -2 * cw / a0, (1 - alpha * amp) / a0,
+     -2 * cw / a0, (1 - alpha / amp) / a0};
+}
+
+static float bandwidth_q (float octaves)
+{
+    float ratio = exp2f (octaves);
+    return sqrtf (ratio) / (ratio - 1);
+}
+
+static int read_bands (BandSetting * out)
+{
+    int count = 0;
+
+    auto gains = str_list_to_index (aud_get_str ("graphic_eq", "gains"), " ,;");
+    int n = aud::min (gains.len (), MAX_BANDS);
+
+    for (int i = 0; i < n; i ++)
+    {
+        BandSetting & band = out[count ++];
+        band.gain = aud::clamp (str_to_double (gains[i]), -24.0, 24.0);
+
+        if (n == 10 || n == 15 || n == 31)
+        {
+            const float * freqs = (n == 10) ? octave_bands :
+             (n == 15) ? two_thirds_bands : third_bands;
+
+            band.freq = freqs[i];
+            band.q = bandwidth_q ((n == 10) ? 1 : (n == 15) ? 2 / 3.0f : 1 / 3.0f);
+        }
+        else
+        {
+            float octaves = log2f (16000 / 25.0f);
+            float spacing = (n > 1) ? octaves / (n - 1) : octaves;
+
+            band.freq = (n > 1) ? 25 * exp2f (spacing * i) : 1000;
+            band.q = bandwidth_q (spacing);
+        }
+    }
+
+    for (const String & item : str_list_to_index (aud_get_str ("graphic_eq", "parametric"), " ,;"))
+    {
+        if (count == MAX_BANDS)
+            break;
+
+        auto fields = str_list_to_index (item, ":");
+        if (fields.len () < 2)
+            continue;
+
+        BandSetting & band = out[count ++];
+        band.freq = aud::max (str_to_double (fields[0]), 10.0);
+        band.gain = aud::clamp (str_to_double (fields[1]), -24.0, 24.0);
+        band.q = (fields.len () > 2) ? aud::clamp (str_to_double (fields[2]), 0.1, 30.0) : 1;
+    }
+
+    return count;
+}
+
+/* With the same bands as before, only the gains move and the filters
+ * ramp from where they are.  Otherwise the new bands start out flat and
+ * ramp from there; if ramp is false, they start out at the setting. */
+static void update (bool ramp)
+{
+    BandSetting settings[MAX_BANDS];
+    int count = read_bands (settings);
+
+    bool same = (count == n_bands);
+    for (int b = 0; same && b < count; b ++)
+    {
+        same = (settings[b].freq == bands[b].setting.freq &&
+         settings[b].q == bands[b].setting.q);
+    }
+
+    for (int b = 0; b < count; b ++)
+    {
+        Band & band = bands[b];
+        BandSetting & setting = settings[b];
+
+        /* too close to the Nyquist frequency, the band is left flat */
+        if (setting.freq >= current_rate * 0.49f)
+            setting.gain = 0;
+
+        band.setting = setting;
+        band.target = peaking (setting, current_rate);
+        band.active = true;
+
+        if (! same)
+        {
+            band.now = {1, 0, 0, 0, 0};
+            memset (state[b], 0, sizeof state[b]);
+        }
+
+        if (! ramp)
+        {
+            band.now = band.target;
+            band.steps = 0;
+            continue;
+        }
+
+        band.step = {
+            (band.target.b0 - band.now.b0) / RAMP_STEPS,
+            (band.target.b1 - band.now.b1) / RAMP_STEPS,
+            (band.target.b2 - band.now.b2) / RAMP_STEPS,
+            (band.target.a1 - band.now.a1) / RAMP_STEPS,
+            (band.target.a2 - band.now.a2) / RAMP_STEPS
+        };
+
+        band.steps = RAMP_STEPS;
+    }
+
+    n_bands = count;
+
+    preamp_target = powf (10, aud::clamp (aud_get_double ("graphic_eq", "preamp"), -20.0, 20.0) / 20);
+    preamp_steps = ramp ? RAMP_STEPS : 0;
+    preamp_step = (preamp_target - preamp) / RAMP_STEPS;
+
+    if (! ramp)
+        preamp = preamp_target;
+}
+
+static void step_ramps (int groups)
+{
+    for (int b = 0; b < n_bands; b ++)
+    {
+        Band & band = bands[b];
+
+        if (band.steps)
+        {
+            if (-- band.steps)
+            {
+                band.now.b0 += band.step.b0;
+                band.now.b1 += band.step.b1;
+                band.now.b2 += band.step.b2;
+                band.now.a1 += band.step.a1;
+                band.now.a2 += band.step.a2;
+            }
+            else
+                band.now = band.target;
+        }
+        else if (band.active && band.setting.gain == 0)
+        {
+            /* a flat filter still has to lose what it has in it */
+            bool settled = true;
+            for (int g = 0; g < groups; g ++)
+            {
+                for (int l = 0; l < LANES; l ++)
+                {
+                    settled = settled && fabsf (state[b][g][0][l]) < SETTLED &&
+                     fabsf (state[b][g][1][l]) < SETTLED;
+                }
+            }
+
+            if (settled)
+            {
+                memset (state[b], 0, sizeof state[b]);
+                band.active = false;
+            }
+        }
+    }
+
+    if (preamp_steps)
+        preamp = (-- preamp_steps) ? preamp + preamp_step : preamp_target;
+}
+
+#if defined(__SSE2__) || defined(__x86_64__)
+
+static void run_band (const Coefs & c, float (* z)[LANES], float (* buf)[LANES], int frames)
+{
+    const __m128 b0 = _mm_set1_ps (c.b0), b1 = _mm_set1_ps (c.b1), b2 = _mm_set1_ps (c.b2);
+    const __m128 a1 = _mm_set1_ps (c.a1), a2 = _mm_set1_ps (c.a2);
+
+    __m128 z1 = _mm_loadu_ps (z[0]);
+    __m128 z2 = _mm_loadu_ps (z[1]);
+
+    for (int f = 0; f < frames; f ++)
+    {
+        __m128 x = _mm_loadu_ps (buf[f]);
+        __m128 y = _mm_add_ps (_mm_mul_ps (b0, x), z1);
+
+        z1 = _mm_add_ps (_mm_sub_ps (_mm_mul_ps (b1, x), _mm_mul_ps (a1, y)), z2);
+        z2 = _mm_sub_ps (_mm_mul_ps (b2, x), _mm_mul_ps (a2, y));
+
+        _mm_storeu_ps (buf[f], y);
+    }
+
+    _mm_storeu_ps (z[0], z1);
+    _mm_storeu_ps (z[1], z2);
+}
+
+#else
+
+static void run_band (const Coefs & c, float (* z)[LANES], float (* buf)[LANES], int frames)
+{
+    for (int f = 0; f < frames; f ++)
+    {
+        for (int l = 0; l < LANES; l ++)
+        {
+            float x = buf[f][l];
+            float y = c.b0 * x + z[0][l];
+
+            z[0][l] = c.b1 * x - c.a1 * y + z[1][l];
+            z[1][l] = c.b2 * x - c.a2 * y;
+            buf[f][l] = y;
+        }
+    }
+}
+
+#endif
+
+bool GraphicEQ::init ()
+{
+    aud_config_set_defaults ("graphic_eq", graphic_eq_defaults);
+    return true;
+}
+
+void GraphicEQ::start (int & channels, int & rate)
+{
+    current_channels = channels;
+    current_rate = rate;
+
+    settings_changed = false;
+    n_bands = 0;
+    update (false);
+
+    flush (true);
+}
+
+Index<float> & GraphicEQ::process (Index<float> & data)
+{
+    TRACE_SPAN ("Graphic Equalizer process");
+
+    if (settings_changed.exchange (false))
+        update (true);
+
+    int channels = current_channels;
+    int groups = (channels + LANES - 1) / LANES;
+    int frames = data.len () / channels;
+    float buf[CHUNK][LANES];
+
+    for (int start = 0; start < frames; start += CHUNK)
+    {
+        int count = aud::min (CHUNK, frames - start);
+        float * audio = & data[start * channels];
+
+        step_ramps (groups);
+
+        for (int g = 0; g < groups; g ++)
+        {
+            int first = g * LANES;
+            int width = aud::min (LANES, channels - first);
+
+            for (int f = 0; f < count; f ++)
+            {
+                for (int l = 0; l < LANES; l ++)
+                    buf[f][l] = ((l < width) ? audio[f * channels + first + l] : 0) + ANTI_DENORMAL;
+            }
+
+            for (int b = 0; b < n_bands; b ++)
+            {
+                if (bands[b].active)
+                    run_band (bands[b].now, state[b][g], buf, count);
+            }
+
+            for (int f = 0; f < count; f ++)
+            {
+                for (int l = 0; l < width; l ++)
+                    audio[f * channels + first + l] = buf[f][l] * preamp;
+            }
+        }
+    }
+
+    return data;
+}
+
+bool GraphicEQ::flush (bool force)
+{
+    memset (state, 0, sizeof state);
+    return true;
+}
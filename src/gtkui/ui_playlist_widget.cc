@@ -132,11 +132,27 @@ struct PlaylistWidgetData
     int popup_pos = -1;
     QueuedFunc popup_timer;
 
+    /* GTK asks for a row one column at a time; the tuple is fetched once
+     * per row and kept until the playlist next changes */
+    int cached_row = -1;
+    Tuple cached_tuple;
+
     void show_popup ()
     {
         GtkWindow * parent = get_main_window ();
         audgui_infopopup_show (parent, list, popup_pos);
     }
+
+    const Tuple & tuple_at (int row)
+    {
+        if (row != cached_row)
+        {
+            cached_tuple = list.entry_tuple (row, Playlist::NoWait);
+            cached_row = row;
+        }
+
+        return cached_tuple;
+    }
 };
 
 static void set_int_from_tuple (GValue * value, const Tuple & tuple, Tuple::Field field)
@@ -205,10 +221,9 @@ static void get_value (void * user, int row, int column, GValue * value)
 
     column = pw_cols[column];
 
-    Tuple tuple;
-
-    if (column != PW_COL_NUMBER && column != PW_COL_QUEUED)
-        tuple = data->list.entry_tuple (row, Playlist::NoWait);
+    static const Tuple blank;
+    const Tuple & tuple = (column != PW_COL_NUMBER && column != PW_COL_QUEUED) ?
+     data->tuple_at (row) : blank;
 
     switch (column)
     {
@@ -475,11 +490,45 @@ GtkWidget * ui_playlist_widget_new (Playlist playlist)
             g_object_set_data ((GObject *) column, "playlist-sort-type", sort_type_ptr);
             g_signal_connect (column, "clicked", (GCallback) column_clicked_cb, data);
         }
+
+        gtk_tree_view_column_set_sizing (gtk_tree_view_get_column
+         ((GtkTreeView *) list, i), GTK_TREE_VIEW_COLUMN_FIXED);
     }
 
+    /* Every row is one line of the same font, so GTK can take the height of
+     * the first row for all of them instead of measuring each one.  Column
+     * widths come from the config (see apply_column_widths) rather than from
+     * the contents. */
+    gtk_tree_view_set_fixed_height_mode ((GtkTreeView *) list, true);
+
     return list;
 }
 
+/* The model is virtual: rows are formatted only when GTK draws them, so rows
+ * that are scrolled out of view need no notification.  A tag scan of a large
+ * playlist then costs one signal per visible row rather than one per entry. */
+static void update_visible_rows (GtkWidget * widget, int row, int count)
+{
+    GtkTreePath * start, * end;
+
+    if (gtk_tree_view_get_visible_range ((GtkTreeView *) widget, & start, & end))
+    {
+        int first = gtk_tree_path_get_indices (start)[0];
+        int last = gtk_tree_path_get_indices (end)[0];
+        gtk_tree_path_free (start);
+        gtk_tree_path_free (end);
+
+        int from = aud::max (row, first);
+        int to = aud::min (row + count, last + 1);
+
+        row = from;
+        count = aud::max (to - from, 0);
+    }
+
+    if (count > 0)
+        audgui_list_update_rows (widget, row, count);
+}
+
 void ui_playlist_widget_update (GtkWidget * widget)
 {
     PlaylistWidgetData * data = (PlaylistWidgetData *) audgui_list_get_user (widget);
@@ -490,6 +539,9 @@ void ui_playlist_widget_update (GtkWidget * widget)
     if (update.level == Playlist::NoUpdate)
         return;
 
+    data->cached_row = -1;
+    data->cached_tuple = Tuple ();
+
     int entries = data->list.n_entries ();
     int changed = entries - update.before - update.after;
 
@@ -509,15 +561,31 @@ void ui_playlist_widget_update (GtkWidget * widget)
         ui_playlist_widget_scroll (widget);
     }
     else if (update.level == Playlist::Metadata || update.queue_changed)
-        audgui_list_update_rows (widget, update.before, changed);
+        update_visible_rows (widget, update.before, changed);
 
     if (update.queue_changed)
     {
+        /* queued entries outside the changed range still need their queue
+         * numbers redrawn; runs of adjacent entries go in one update */
+        Index<int> rows;
+
         for (int i = data->list.n_queued (); i --; )
         {
             int entry = data->list.queue_get_entry (i);
             if (entry < update.before || entry >= entries - update.after)
-                audgui_list_update_rows (widget, entry, 1);
+                rows.append (entry);
+        }
+
+        rows.sort ([] (const int & a, const int & b) { return a - b; });
+
+        for (int i = 0; i < rows.len (); )
+        {
+            int j = i + 1;
+            while (j < rows.len () && rows[j] == rows[j - 1] + 1)
+                j ++;
+
+            update_visible_rows (widget, rows[i], rows[j - 1] + 1 - rows[i]);
+            i = j;
         }
     }
 
@@ -28,20 +28,33 @@
 #include <libaudcore/runtime.h>
 
 #include <algorithm>
+#include <atomic>
 #include <iterator>
 
 #include <assert.h>
 #include <pthread.h>
+#include <string.h>
 #include <sys/time.h>
+#include <time.h>
 
 /* jack/types.h uses "register" as a parameter name :( */
 #define register register_
 #include <jack/jack.h>
+#include <jack/ringbuffer.h>
 #undef register
 
+#include "../output-common/realtime.h"
+#include "../output-common/telemetry.h"
+#include "../trace-common/trace.h"
+
 static_assert(std::is_same<jack_default_audio_sample_t, float>::value,
  "JACK must be compiled to use float samples");
 
+/* In lock-free mode, the JACK thread copies audio out of the ring buffer
+ * through this, a chunk at a time. */
+static constexpr int scratch_frames = 1024;
+static float s_scratch[scratch_frames * AUD_MAX_CHANNELS];
+
 class JACKOutput : public OutputPlugin
 {
 public:
@@ -82,13 +95,39 @@ private:
     bool connect_ports (int channels, String & error);
     void generate (jack_nframes_t frames);
 
+    /* lock-free mode */
+    void generate_lock_free (jack_nframes_t frames);
+    int copy_frames (float * * out, int frames, StereoVolume volume);
+    int resample_frames (float * * out, int frames, double step, StereoVolume volume);
+    void reset_resampler ();
+    int ring_space () const;
+    void wait_period ();
+    void report_rate ();
+
     static void error_cb (const char * error)
         { AUDWARN ("%s\n", error); }
+
     static int generate_cb (jack_nframes_t frames, void * obj)
-        { ((JACKOutput *) obj)->generate (frames); return 0; }
+    {
+        TRACE_SPAN ("JACK process");
+        auto self = (JACKOutput *) obj;
+        if (self->m_lock_free)
+            self->generate_lock_free (frames);
+        else
+            self->generate (frames);
+        return 0;
+    }
+
+    /* the ring buffer belongs to RingBuf and cannot be locked from here;
+     * in lock-free mode, open_audio() locks its own */
+    static void thread_init_cb (void *)
+        { realtime_enter ("JACK output", s_scratch, sizeof s_scratch); }
+    static int xrun_cb (void *)
+        { telemetry_xrun (); return 0; }
 
     int m_rate = 0, m_channels = 0;
-    bool m_paused = false, m_prebuffer = false;
+    std::atomic<bool> m_paused {false}, m_prebuffer {false};
+    std::atomic<bool> m_draining {false};  /* from drain () until more is written */
 
     int m_last_write_frames = 0;
     timeval m_last_write_time = timeval ();
@@ -101,6 +140,29 @@ private:
 
     pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
     pthread_cond_t m_cond = PTHREAD_COND_INITIALIZER;
+
+    /* In lock-free mode, the player thread writes into m_ring and the JACK
+     * thread reads from it, and neither ever waits for the other: the
+     * player thread polls instead, half a period at a time.  What the JACK
+     * thread needs from the player thread is passed in atomics, and a
+     * flush is a request that the JACK thread carries out at the start of
+     * its next cycle. */
+    bool m_lock_free = false;
+    jack_ringbuffer_t * m_ring = nullptr;
+    int m_ring_bytes = 0, m_frame_bytes = 0;
+
+    std::atomic<int> m_volume_left {0}, m_volume_right {0};
+    std::atomic<int> m_flush_request {0}, m_flush_done {0};
+    std::atomic<int> m_server_rate {0};
+    std::atomic<int> m_cycle_frames {0};  /* played in the last cycle */
+    std::atomic<jack_nframes_t> m_cycle_start {0};
+    int m_reported_rate = 0;
+
+    /* The resampler, only used by the JACK thread; it interpolates between
+     * the middle two of the last four input frames. */
+    float m_history[4][AUD_MAX_CHANNELS] = {};
+    double m_phase = 0;
+    bool m_resampling = false;
 };
 
 // must be separate in order for JACKOutput() to be constexpr
@@ -117,6 +179,7 @@ const char * const JACKOutput::defaults[] = {
     "ports_ignore", "FALSE",
     "ports_physical", "TRUE",
     "ports_upmix", "2",
+    "lock_free", "FALSE",
     "volume_left", "100",
     "volume_right", "100",
     nullptr
@@ -142,7 +205,10 @@ const PreferencesWidget JACKOutput::widgets[] = {
         WIDGET_CHILD),
     WidgetCheck (N_("Ignore insufficient number of ports"),
         WidgetBool ("jack", "ports_ignore"),
-        WIDGET_CHILD)
+        WIDGET_CHILD),
+    WidgetCheck (N_("Lock-free processing (resamples to the server's rate)"),
+        WidgetBool ("jack", "lock_free")),
+    REALTIME_WIDGETS
 };
 
 const PluginPreferences JACKOutput::prefs = {{widgets}};
@@ -150,6 +216,7 @@ const PluginPreferences JACKOutput::prefs = {{widgets}};
 bool JACKOutput::init ()
 {
     aud_config_set_defaults ("jack", defaults);
+    realtime_init ();
     return true;
 }
 
@@ -157,6 +224,9 @@ void JACKOutput::set_volume (StereoVolume v)
 {
     aud_set_int ("jack", "volume_left", v.left);
     aud_set_int ("jack", "volume_right", v.right);
+
+    m_volume_left.store (v.left, std::memory_order_relaxed);
+    m_volume_right.store (v.right, std::memory_order_relaxed);
 }
 
 StereoVolume JACKOutput::get_volume ()
@@ -224,6 +294,7 @@ fail:
 bool JACKOutput::open_audio (int format, int rate, int channels, String & error)
 {
     int buffer_time;
+    bool realtime;
 
     if (format != FMT_FLOAT)
     {
@@ -246,6 +317,8 @@ bool JACKOutput::open_audio (int format, int rate, int channels, String & error)
         goto fail;
     }
 
+    telemetry_open ("JACK");
+
     for (int i = 0; i < channels; i ++)
     {
         StringBuf name = str_printf ("out_%d", i);
@@ -257,19 +330,51 @@ bool JACKOutput::open_audio (int format, int rate, int channels, String & error)
         }
     }
 
+    realtime = realtime_prepare ();
     buffer_time = aud_get_int ("output_buffer_size");
-    m_buffer.alloc (aud::rescale (buffer_time, 1000, rate) * channels);
+    m_lock_free = aud_get_bool ("jack", "lock_free");
+
+    if (m_lock_free)
+    {
+        m_frame_bytes = sizeof (float) * channels;
+        m_ring_bytes = aud::rescale (buffer_time, 1000, rate) * m_frame_bytes;
+
+        if (! (m_ring = jack_ringbuffer_create (m_ring_bytes + m_frame_bytes)))
+        {
+            AUDERR ("jack_ringbuffer_create() failed\n");
+            goto fail;
+        }
+
+        if (realtime && jack_ringbuffer_mlock (m_ring) != 0)
+            AUDWARN ("Cannot lock the ring buffer into memory.\n");
+
+        m_flush_request = m_flush_done = 0;
+        m_cycle_frames = 0;
+        m_cycle_start = 0;
+        m_server_rate = jack_get_sample_rate (m_client);
+        m_reported_rate = rate;
+        reset_resampler ();
+        m_resampling = false;
+    }
+    else
+        m_buffer.alloc (aud::rescale (buffer_time, 1000, rate) * channels);
+
+    m_volume_left = aud_get_int ("jack", "volume_left");
+    m_volume_right = aud_get_int ("jack", "volume_right");
 
     m_rate = rate;
     m_channels = channels;
     m_paused = false;
     m_prebuffer = true;
+    m_draining = false;
 
     m_last_write_frames = 0;
     m_last_write_time = timeval ();
     m_rate_mismatch = false;
 
     jack_set_process_callback (m_client, generate_cb, this);
+    jack_set_thread_init_callback (m_client, thread_init_cb, nullptr);
+    jack_set_xrun_callback (m_client, xrun_cb, nullptr);
 
     if (jack_activate (m_client) != 0)
     {
@@ -293,12 +398,24 @@ fail:
 void JACKOutput::close_audio ()
 {
     if (m_client)
+    {
         jack_client_close (m_client);
+        realtime_leave (s_scratch, sizeof s_scratch);
+        telemetry_close ();
+    }
 
     m_buffer.destroy ();
 
+    /* the JACK thread has stopped with the client */
+    if (m_ring)
+    {
+        jack_ringbuffer_free (m_ring);
+        m_ring = nullptr;
+    }
+
     std::fill (m_ports, std::end (m_ports), nullptr);
     m_client = nullptr;
+    m_lock_free = false;
 }
 
 void JACKOutput::generate (jack_nframes_t frames)
@@ -308,6 +425,8 @@ void JACKOutput::generate (jack_nframes_t frames)
     m_last_write_frames = 0;
     gettimeofday (& m_last_write_time, nullptr);
 
+    telemetry_wakeup (m_buffer.len (), m_buffer.size ());
+
     float * out[AUD_MAX_CHANNELS];
     for (int i = 0; i < m_channels; i ++)
         out[i] = (float *) jack_port_get_buffer (m_ports[i], frames);
@@ -353,6 +472,9 @@ void JACKOutput::generate (jack_nframes_t frames)
         frames -= frames_to_copy;
     }
 
+    if (frames && ! m_draining)
+        telemetry_underrun ();
+
 silence:
     for (int i = 0; i < m_channels; i ++)
         std::fill (out[i], out[i] + frames, 0.0);
@@ -361,8 +483,213 @@ silence:
     pthread_mutex_unlock (& m_mutex);
 }
 
+void JACKOutput::reset_resampler ()
+{
+    for (auto & frame : m_history)
+        std::fill (frame, std::end (frame), 0.0f);
+
+    m_phase = 0;
+}
+
+/* whole frames that fit before the ring holds the buffer size set in
+ * Audacious's settings; the ring itself may be a little larger */
+int JACKOutput::ring_space () const
+{
+    int space = m_ring_bytes - (int) jack_ringbuffer_read_space (m_ring);
+    return aud::max (space, 0) / m_frame_bytes;
+}
+
+void JACKOutput::wait_period ()
+{
+    int rate = aud::max (m_server_rate.load (std::memory_order_relaxed), 1);
+    int64_t us = (int64_t) jack_get_buffer_size (m_client) * 500000 / rate;
+    us = aud::clamp (us, (int64_t) 500, (int64_t) 50000);
+
+    timespec ts = {(time_t) (us / 1000000), (long) (us % 1000000) * 1000};
+    nanosleep (& ts, nullptr);
+}
+
+/* logged from the player thread on behalf of the JACK thread */
+void JACKOutput::report_rate ()
+{
+    int rate = m_server_rate.load (std::memory_order_relaxed);
+    if (rate == m_reported_rate)
+        return;
+
+    if (rate != m_rate)
+        AUDINFO ("Resampling from %d Hz to the JACK server's %d Hz.\n", m_rate, rate);
+
+    m_reported_rate = rate;
+}
+
+/* the ring, a chunk at a time, straight into the ports */
+int JACKOutput::copy_frames (float * * out, int frames, StereoVolume volume)
+{
+    int done = 0;
+
+    while (done < frames)
+    {
+        int avail = jack_ringbuffer_read_space (m_ring) / m_frame_bytes;
+        int chunk = aud::min (aud::min (frames - done, avail), scratch_frames);
+        if (! chunk)
+            break;
+
+        jack_ringbuffer_read (m_ring, (char *) s_scratch, chunk * m_frame_bytes);
+        audio_amplify (s_scratch, m_channels, chunk, volume);
+
+        float * dest[AUD_MAX_CHANNELS];
+        for (int i = 0; i < m_channels; i ++)
+            dest[i] = out[i] + done;
+
+        audio_deinterlace (s_scratch, FMT_FLOAT, m_channels, (void * const *) dest, chunk);
+        done += chunk;
+    }
+
+    return done;
+}
+
+/* jack_ringbuffer_peek() is missing from older versions of JACK 1 */
+static void ring_peek (jack_ringbuffer_t * ring, char * dest, size_t bytes)
+{
+    jack_ringbuffer_data_t vec[2];
+    jack_ringbuffer_get_read_vector (ring, vec);
+
+    size_t first = aud::min (bytes, vec[0].len);
+    memcpy (dest, vec[0].buf, first);
+    memcpy (dest + first, vec[1].buf, bytes - first);
+}
+
+/* Cubic (Catmull-Rom) interpolation, stepping through the input by step
+ * frames for each frame output.  The input is peeked at and only what has
+ * been used is taken out of the ring, so that the rest is there for the
+ * next cycle. */
+int JACKOutput::resample_frames (float * * out, int frames, double step, StereoVolume volume)
+{
+    int done = 0;
+
+    while (done < frames)
+    {
+        int avail = jack_ringbuffer_read_space (m_ring) / m_frame_bytes;
+        int chunk = aud::min (avail, scratch_frames);
+
+        ring_peek (m_ring, (char *) s_scratch, chunk * m_frame_bytes);
+        audio_amplify (s_scratch, m_channels, chunk, volume);
+
+        int used = 0;
+
+        while (done < frames)
+        {
+            while (m_phase >= 1 && used < chunk)
+            {
+                memmove (m_history[0], m_history[1], sizeof m_history - sizeof m_history[0]);
+                memcpy (m_history[3], s_scratch + used * m_channels, m_frame_bytes);
+
+                used ++;
+                m_phase -= 1;
+            }
+
+            if (m_phase >= 1)
+                break;
+
+            float t = m_phase;
+
+            for (int i = 0; i < m_channels; i ++)
+            {
+                float a = m_history[0][i], b = m_history[1][i];
+                float c = m_history[2][i], d = m_history[3][i];
+
+                out[i][done] = b + 0.5f * t * (c - a + t * (2 * a - 5 * b +
+                 4 * c - d + t * (3 * (b - c) + d - a)));
+            }
+
+            done ++;
+            m_phase += step;
+        }
+
+        jack_ringbuffer_read_advance (m_ring, used * m_frame_bytes);
+
+        /* all there was has been used */
+        if (chunk < scratch_frames)
+            break;
+    }
+
+    return done;
+}
+
+/* Nothing in here waits for the player thread or calls into Audacious
+ * beyond the plain loops of audio_amplify() and audio_deinterlace(). */
+void JACKOutput::generate_lock_free (jack_nframes_t frames)
+{
+    m_cycle_start.store (jack_last_frame_time (m_client), std::memory_order_relaxed);
+
+    float * out[AUD_MAX_CHANNELS];
+    for (int i = 0; i < m_channels; i ++)
+        out[i] = (float *) jack_port_get_buffer (m_ports[i], frames);
+
+    int flush = m_flush_request.load (std::memory_order_acquire);
+    if (flush != m_flush_done.load (std::memory_order_relaxed))
+    {
+        size_t avail = jack_ringbuffer_read_space (m_ring);
+        jack_ringbuffer_read_advance (m_ring, avail - avail % m_frame_bytes);
+        reset_resampler ();
+        m_flush_done.store (flush, std::memory_order_release);
+    }
+
+    int jack_rate = jack_get_sample_rate (m_client);
+    m_server_rate.store (jack_rate, std::memory_order_relaxed);
+
+    telemetry_wakeup (jack_ringbuffer_read_space (m_ring), m_ring_bytes);
+
+    int done = 0;
+
+    if (! m_paused && ! m_prebuffer)
+    {
+        StereoVolume volume = {m_volume_left.load (std::memory_order_relaxed),
+                               m_volume_right.load (std::memory_order_relaxed)};
+
+        if (jack_rate == m_rate)
+        {
+            /* what is held from before would be stale next time */
+            if (m_resampling)
+            {
+                reset_resampler ();
+                m_resampling = false;
+            }
+
+            done = copy_frames (out, frames, volume);
+        }
+        else
+        {
+            m_resampling = true;
+            done = resample_frames (out, frames, (double) m_rate / jack_rate, volume);
+        }
+
+        if (done < (int) frames && ! m_draining)
+            telemetry_underrun ();
+    }
+
+    m_cycle_frames.store (done, std::memory_order_relaxed);
+
+    for (int i = 0; i < m_channels; i ++)
+        std::fill (out[i] + done, out[i] + frames, 0.0);
+}
+
 void JACKOutput::period_wait ()
 {
+    TRACE_SPAN ("JACK period_wait");
+
+    if (m_lock_free)
+    {
+        while (! ring_space ())
+        {
+            m_prebuffer = false;
+            wait_period ();
+        }
+
+        report_rate ();
+        return;
+    }
+
     pthread_mutex_lock (& m_mutex);
 
     while (! m_buffer.space ())
@@ -376,6 +703,22 @@ void JACKOutput::period_wait ()
 
 int JACKOutput::write_audio (const void * data, int size)
 {
+    TRACE_SPAN ("JACK write_audio");
+
+    if (m_lock_free)
+    {
+        assert (size % m_frame_bytes == 0);
+
+        int bytes = aud::min (size / m_frame_bytes, ring_space ()) * m_frame_bytes;
+        jack_ringbuffer_write (m_ring, (const char *) data, bytes);
+        m_draining = false;
+
+        if ((int) jack_ringbuffer_read_space (m_ring) >= m_ring_bytes / 4)
+            m_prebuffer = false;
+
+        return bytes;
+    }
+
     pthread_mutex_lock (& m_mutex);
 
     int samples = size / sizeof (float);
@@ -384,6 +727,7 @@ int JACKOutput::write_audio (const void * data, int size)
     samples = aud::min (samples, m_buffer.space ());
 
     m_buffer.copy_in ((const float *) data, samples);
+    m_draining = false;
 
     if (m_buffer.len () >= m_buffer.size () / 4)
         m_prebuffer = false;
@@ -394,13 +738,25 @@ int JACKOutput::write_audio (const void * data, int size)
 
 void JACKOutput::drain ()
 {
+    if (m_lock_free)
+    {
+        m_prebuffer = false;
+        m_draining = true;
+
+        while ((int) jack_ringbuffer_read_space (m_ring) >= m_frame_bytes ||
+         m_cycle_frames.load (std::memory_order_relaxed))
+            wait_period ();
+
+        return;
+    }
+
     pthread_mutex_lock (& m_mutex);
 
     m_prebuffer = false;
+    m_draining = true;
 
     while (m_buffer.len () || m_last_write_frames)
         pthread_cond_wait (& m_cond, & m_mutex);
-
     pthread_mutex_unlock (& m_mutex);
 }
 
@@ -409,6 +765,24 @@ int JACKOutput::get_delay ()
     auto timediff = [] (const timeval & a, const timeval & b) -> int64_t
         { return 1000 * (int64_t) (b.tv_sec - a.tv_sec) + (b.tv_usec - a.tv_usec) / 1000; };
 
+    if (m_lock_free)
+    {
+        int frames = jack_ringbuffer_read_space (m_ring) / m_frame_bytes;
+        int delay = aud::rescale (frames, m_rate, 1000);
+
+        int played = m_cycle_frames.load (std::memory_order_relaxed);
+        if (played)
+        {
+            int32_t elapsed = jack_frame_time (m_client) -
+             m_cycle_start.load (std::memory_order_relaxed);
+            int rate = aud::max (m_server_rate.load (std::memory_order_relaxed), 1);
+
+            delay += aud::rescale (aud::max (played - elapsed, 0), rate, 1000);
+        }
+
+        return telemetry_latency (delay);
+    }
+
     pthread_mutex_lock (& m_mutex);
 
     int delay = aud::rescale (m_buffer.len (), m_channels * m_rate, 1000);
@@ -423,7 +797,7 @@ int JACKOutput::get_delay ()
     }
 
     pthread_mutex_unlock (& m_mutex);
-    return delay;
+    return telemetry_latency (delay);
 }
 
 void JACKOutput::pause (bool pause)
@@ -436,6 +810,27 @@ void JACKOutput::pause (bool pause)
 
 void JACKOutput::flush ()
 {
+    if (m_lock_free)
+    {
+        m_prebuffer = true;
+
+        /* Until the JACK thread has emptied the ring, nothing more may be
+         * written; give up after a second in case the server has stopped
+         * calling us, and let the JACK thread catch up whenever it does. */
+        int request = m_flush_request.load (std::memory_order_relaxed) + 1;
+        m_flush_request.store (request, std::memory_order_release);
+
+        for (int waited = 0; waited < 1000 &&
+         m_flush_done.load (std::memory_order_acquire) != request; waited ++)
+        {
+            timespec ts = {0, 1000000};
+            nanosleep (& ts, nullptr);
+        }
+
+        m_cycle_frames.store (0, std::memory_order_relaxed);
+        return;
+    }
+
     pthread_mutex_lock (& m_mutex);
 
     m_buffer.discard ();
@@ -18,14 +18,23 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
 #include "ladspa.h"
 #include "plugin.h"
 
 #include <libaudcore/runtime.h>
 
+#include "../trace-common/trace.h"
+
 static int ladspa_channels, ladspa_rate;
 
+/* The chain runs on one buffer per channel: the audio is de-interleaved
+ * once per block, and every plugin reads from and writes back to these
+ * buffers.  Plugins that cannot work in place get output buffers of their
+ * own, copied back after each run. */
+static Index<Index<float>> planar_bufs;
+
 static void start_plugin (LoadedPlugin & loaded)
 {
     if (loaded.active)
@@ -34,7 +43,7 @@ static void start_plugin (LoadedPlugin & loaded)
     loaded.active = 1;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int ports = plugin.in_ports.len ();
 
@@ -52,9 +61,10 @@ static void start_plugin (LoadedPlugin & loaded)
     }
 
     int instances = ladspa_channels / ports;
+    bool in_place = ! LADSPA_IS_INPLACE_BROKEN (desc.Properties);
 
-    loaded.in_bufs.insert (0, ladspa_channels);
-    loaded.out_bufs.insert (0, ladspa_channels);
+    if (! in_place)
+        loaded.out_bufs.insert (0, ladspa_channels);
 
     for (int i = 0; i < instances; i ++)
     {
@@ -69,13 +79,17 @@ static void start_plugin (LoadedPlugin & loaded)
         {
             int channel = ports * i + p;
 
-            Index<float> & in = loaded.in_bufs[channel];
-            in.insert (0, LADSPA_BUFLEN);
-            desc.connect_port (handle, plugin.in_ports[p], in.begin ());
+            float * in = planar_bufs[channel].begin ();
+            desc.connect_port (handle, plugin.in_ports[p], in);
 
-            Index<float> & out = loaded.out_bufs[channel];
-            out.insert (0, LADSPA_BUFLEN);
-            desc.connect_port (handle, plugin.out_ports[p], out.begin ());
+            if (in_place)
+                desc.connect_port (handle, plugin.out_ports[p], in);
+            else
+            {
+                Index<float> & out = loaded.out_bufs[channel];
+                out.insert (0, LADSPA_BUFLEN);
+                desc.connect_port (handle, plugin.out_ports[p], out.begin ());
+            }
         }
 
         if (desc.activate)
@@ -83,54 +97,59 @@ static void start_plugin (LoadedPlugin & loaded)
     }
 }
 
-static void run_plugin (LoadedPlugin & loaded, float * data, int samples)
+static void run_plugin (LoadedPlugin & loaded, int frames)
 {
     if (! loaded.instances.len ())
         return;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int ports = plugin.in_ports.len ();
     int instances = loaded.instances.len ();
     assert (ports * instances == ladspa_channels);
 
+    for (int i = 0; i < instances; i ++)
+        desc.run (loaded.instances[i], frames);
+
+    for (int channel = 0; channel < loaded.out_bufs.len (); channel ++)
+        memcpy (planar_bufs[channel].begin (), loaded.out_bufs[channel].begin (),
+         sizeof (float) * frames);
+}
+
+/* runs the whole chain on interleaved data, one block at a time */
+static void run_chain (float * data, int samples)
+{
     while (samples / ladspa_channels > 0)
     {
         int frames = aud::min (samples / ladspa_channels, LADSPA_BUFLEN);
 
-        for (int i = 0; i < instances; i ++)
+        for (int channel = 0; channel < ladspa_channels; channel ++)
         {
-            LADSPA_Handle handle = loaded.instances[i];
+            float * get = data + channel;
+            float * in = planar_bufs[channel].begin ();
+            float * in_end = in + frames;
 
-            for (int p = 0; p < ports; p ++)
+            while (in < in_end)
             {
-                int channel = ports * i + p;
-                float * get = data + channel;
-                float * in = loaded.in_bufs[channel].begin ();
-                float * in_end = in + frames;
-
-                while (in < in_end)
-                {
-                    * in ++ = * get;
-                    get += ladspa_channels;
-                }
+                * in ++ = * get;
+                get += ladspa_channels;
             }
+        }
+
+        for (auto & loaded : loadeds)
+            run_plugin (* loaded, frames);
 
-            desc.run (handle, frames);
+        for (int channel = 0; channel < ladspa_channels; channel ++)
+        {
+            float * set = data + channel;
+            float * out = planar_bufs[channel].begin ();
+            float * out_end = out + frames;
 
-            for (int p = 0; p < ports; p ++)
+            while (out < out_end)
             {
-                int channel = ports * i + p;
-                float * set = data + channel;
-                float * out = loaded.out_bufs[channel].begin ();
-                float * out_end = out + frames;
-
-                while (out < out_end)
-                {
-                    * set = * out ++;
-                    set += ladspa_channels;
-                }
+                * set = * out ++;
+                set += ladspa_channels;
             }
         }
 
@@ -145,7 +164,7 @@ static void flush_plugin (LoadedPlugin & loaded)
         return;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int instances = loaded.instances.len ();
     for (int i = 0; i < instances; i ++)
@@ -167,7 +186,7 @@ void shutdown_plugin_locked (LoadedPlugin & loaded)
         return;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int instances = loaded.instances.len ();
     for (int i = 0; i < instances; i ++)
@@ -181,7 +200,6 @@ void shutdown_plugin_locked (LoadedPlugin & loaded)
     }
 
     loaded.instances.clear ();
-    loaded.in_bufs.clear ();
     loaded.out_bufs.clear ();
 }
 
@@ -189,24 +207,44 @@ void LADSPAHost::start (int & channels, int & rate)
 {
     pthread_mutex_lock (& mutex);
 
+    /* Instances already running in the same format are kept from one song
+     * to the next, so that plugins that are slow to set up, such as reverbs
+     * loading impulse responses, are not set up again each time; the sound
+     * simply goes on, as it would within a song.  An instance is created
+     * for one sample rate, so a change of format means starting over. */
+    if (channels == ladspa_channels && rate == ladspa_rate &&
+        planar_bufs.len () == channels)
+    {
+        pthread_mutex_unlock (& mutex);
+        return;
+    }
+
     for (auto & loaded : loadeds)
         shutdown_plugin_locked (* loaded);
 
     ladspa_channels = channels;
     ladspa_rate = rate;
 
+    /* the plugins are connected to these, so they never move while any
+     * plugin is running */
+    planar_bufs.clear ();
+    planar_bufs.insert (0, channels);
+
+    for (auto & buf : planar_bufs)
+        buf.insert (0, LADSPA_BUFLEN);
+
     pthread_mutex_unlock (& mutex);
 }
 
 Index<float> & LADSPAHost::process (Index<float> & data)
 {
+    TRACE_SPAN ("LADSPA process");
     pthread_mutex_lock (& mutex);
 
     for (auto & loaded : loadeds)
-    {
         start_plugin (* loaded);
-        run_plugin (* loaded, data.begin (), data.len ());
-    }
+
+    run_chain (data.begin (), data.len ());
 
     pthread_mutex_unlock (& mutex);
     return data;
@@ -228,11 +266,13 @@ Index<float> & LADSPAHost::finish (Index<float> & data, bool end_of_playlist)
     pthread_mutex_lock (& mutex);
 
     for (auto & loaded : loadeds)
-    {
         start_plugin (* loaded);
-        run_plugin (* loaded, data.begin (), data.len ());
 
-        if (end_of_playlist)
+    run_chain (data.begin (), data.len ());
+
+    if (end_of_playlist)
+    {
+        for (auto & loaded : loadeds)
             shutdown_plugin_locked (* loaded);
     }
 
@@ -21,6 +21,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <algorithm>
 
@@ -105,13 +106,12 @@ static ControlData parse_control (const LADSPA_Descriptor & desc, int port)
     return control;
 }
 
-static void open_plugin (const char * path, const LADSPA_Descriptor & desc)
+static void parse_ports (PluginData & plugin, const LADSPA_Descriptor & desc)
 {
-    const char * slash = strrchr (path, G_DIR_SEPARATOR);
-    g_return_if_fail (slash && slash[1]);
-    g_return_if_fail (desc.Label && desc.Name);
-
-    PluginData & plugin = * plugins.append (new PluginData (slash + 1, desc));
+    plugin.port_count = desc.PortCount;
+    plugin.controls.clear ();
+    plugin.in_ports.clear ();
+    plugin.out_ports.clear ();
 
     for (unsigned i = 0; i < desc.PortCount; i ++)
     {
@@ -126,9 +126,28 @@ static void open_plugin (const char * path, const LADSPA_Descriptor & desc)
     }
 }
 
-static GModule * open_module (const char * path)
+static void open_plugin (const char * path, int index, const LADSPA_Descriptor & desc)
+{
+    const char * slash = strrchr (path, G_DIR_SEPARATOR);
+    g_return_if_fail (slash && slash[1]);
+    g_return_if_fail (desc.Label && desc.Name);
+
+    PluginData & plugin = * plugins.append (new PluginData (slash + 1, path, index));
+
+    plugin.label = String (desc.Label);
+    plugin.name = String (desc.Name);
+    plugin.desc = & desc;
+
+    parse_ports (plugin, desc);
+}
+
+/* loaded is set to false if the module could not be loaded at all, as when
+ * a library it needs is missing, which may change without the module */
+static LADSPA_Descriptor_Function open_module (const char * path, bool & loaded)
 {
     GModule * handle = g_module_open (path, G_MODULE_BIND_LOCAL);
+    loaded = (handle != nullptr);
+
     if (! handle)
     {
         AUDERR ("Failed to open module %s: %s\n", path, g_module_error ());
@@ -143,13 +162,205 @@ static GModule * open_module (const char * path)
         return nullptr;
     }
 
-    LADSPA_Descriptor_Function descfun = (LADSPA_Descriptor_Function) sym;
+    modules.append (handle);
+    return (LADSPA_Descriptor_Function) sym;
+}
 
-    const LADSPA_Descriptor * desc;
-    for (int i = 0; (desc = descfun (i)); i ++)
-        open_plugin (path, * desc);
+/* The plugins found in each module are cached in a key file, one group for
+ * each module, so that listing them does not mean loading every library on
+ * the path.  A group is used for as long as the size and modification time
+ * of the module are the same; a module that has no plugins gets a group too,
+ * so that it is not opened again either. */
 
-    return handle;
+static StringBuf cache_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "ladspa-cache"});
+}
+
+static GKeyFile * old_cache, * new_cache;
+
+static void cache_module (const char * path, const struct stat & st)
+{
+    g_key_file_set_int64 (new_cache, path, "size", st.st_size);
+    g_key_file_set_int64 (new_cache, path, "mtime", st.st_mtime);
+
+    int count = 0;
+
+    for (auto & ptr : plugins)
+    {
+        PluginData & plugin = * ptr;
+        if (strcmp (plugin.module, path))
+            continue;
+
+        int controls = plugin.controls.len ();
+        Index<int> ports, toggles;
+        Index<double> ranges;
+        Index<const char *> names;
+
+        for (auto & control : plugin.controls)
+        {
+            ports.append (control.port);
+            toggles.append (control.is_toggle);
+            ranges.append (control.min);
+            ranges.append (control.max);
+            ranges.append (control.def);
+            names.append (control.name);
+        }
+
+        auto key = [count] (const char * name)
+            { return str_printf ("plugin%d_%s", count, name); };
+
+        g_key_file_set_integer (new_cache, path, key ("index"), plugin.index);
+        g_key_file_set_string (new_cache, path, key ("label"), plugin.label);
+        g_key_file_set_string (new_cache, path, key ("name"), plugin.name);
+        g_key_file_set_integer (new_cache, path, key ("port_count"), plugin.port_count);
+        g_key_file_set_integer_list (new_cache, path, key ("in_ports"),
+         plugin.in_ports.begin (), plugin.in_ports.len ());
+        g_key_file_set_integer_list (new_cache, path, key ("out_ports"),
+         plugin.out_ports.begin (), plugin.out_ports.len ());
+        g_key_file_set_integer (new_cache, path, key ("controls"), controls);
+        g_key_file_set_integer_list (new_cache, path, key ("control_ports"),
+         ports.begin (), controls);
+        g_key_file_set_integer_list (new_cache, path, key ("control_toggles"),
+         toggles.begin (), controls);
+        g_key_file_set_double_list (new_cache, path, key ("control_ranges"),
+         ranges.begin (), 3 * controls);
+        g_key_file_set_string_list (new_cache, path, key ("control_names"),
+         names.begin (), controls);
+
+        count ++;
+    }
+
+    g_key_file_set_integer (new_cache, path, "plugins", count);
+}
+
+/* an empty list is read as nullptr, which is fine as long as it is expected
+ * to be empty */
+static bool get_ints (GKeyFile * cache, const char * group, const char * key,
+ Index<int> & list, int expect = -1)
+{
+    gsize len = 0;
+    GError * error = nullptr;
+    int * ints = g_key_file_get_integer_list (cache, group, key, & len, & error);
+
+    bool valid = ints ? (expect < 0 || (int) len == expect) : (! error && expect <= 0);
+
+    if (valid)
+        list.insert (ints, 0, len);
+
+    g_free (ints);
+    if (error)
+        g_error_free (error);
+
+    return valid;
+}
+
+static bool read_cached_plugin (const char * path, int i)
+{
+    auto key = [i] (const char * name)
+        { return str_printf ("plugin%d_%s", i, name); };
+
+    const char * slash = strrchr (path, G_DIR_SEPARATOR);
+    int index = g_key_file_get_integer (old_cache, path, key ("index"), nullptr);
+    CharPtr label (g_key_file_get_string (old_cache, path, key ("label"), nullptr));
+    CharPtr name (g_key_file_get_string (old_cache, path, key ("name"), nullptr));
+    int controls = g_key_file_get_integer (old_cache, path, key ("controls"), nullptr);
+
+    if (! slash || ! slash[1] || ! label || ! name || controls < 0)
+        return false;
+
+    SmartPtr<PluginData> plugin (new PluginData (slash + 1, path, index));
+    plugin->label = String (label);
+    plugin->name = String (name);
+    plugin->port_count = g_key_file_get_integer (old_cache, path, key ("port_count"), nullptr);
+
+    Index<int> ports, toggles;
+
+    if (! get_ints (old_cache, path, key ("in_ports"), plugin->in_ports) ||
+        ! get_ints (old_cache, path, key ("out_ports"), plugin->out_ports) ||
+        ! get_ints (old_cache, path, key ("control_ports"), ports, controls) ||
+        ! get_ints (old_cache, path, key ("control_toggles"), toggles, controls))
+        return false;
+
+    gsize n_ranges = 0, n_names = 0;
+    double * ranges = g_key_file_get_double_list (old_cache, path,
+     key ("control_ranges"), & n_ranges, nullptr);
+    char * * names = g_key_file_get_string_list (old_cache, path,
+     key ("control_names"), & n_names, nullptr);
+
+    bool valid = (! controls || (ranges && names)) &&
+     (int) n_ranges == 3 * controls && (int) n_names == controls;
+
+    for (int c = 0; valid && c < controls; c ++)
+    {
+        ControlData control;
+        control.port = ports[c];
+        control.name = String (names[c]);
+        control.is_toggle = toggles[c];
+        control.min = ranges[3 * c];
+        control.max = ranges[3 * c + 1];
+        control.def = ranges[3 * c + 2];
+        plugin->controls.append (control);
+    }
+
+    g_free (ranges);
+    g_strfreev (names);
+
+    if (valid)
+        plugins.append (std::move (plugin));
+
+    return valid;
+}
+
+/* false if the module has changed since it was cached */
+static bool read_cached_module (const char * path, const struct stat & st)
+{
+    if (! old_cache || ! g_key_file_has_group (old_cache, path) ||
+        g_key_file_get_int64 (old_cache, path, "size", nullptr) != st.st_size ||
+        g_key_file_get_int64 (old_cache, path, "mtime", nullptr) != st.st_mtime)
+        return false;
+
+    int first = plugins.len ();
+    int count = g_key_file_get_integer (old_cache, path, "plugins", nullptr);
+
+    for (int i = 0; i < count; i ++)
+    {
+        if (! read_cached_plugin (path, i))
+        {
+            AUDWARN ("Invalid cache entry for %s\n", path);
+            plugins.remove (first, -1);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void scan_module (const char * path)
+{
+    struct stat st;
+    if (stat (path, & st) < 0)
+    {
+        AUDERR ("Failed to read module %s: %s\n", path, strerror (errno));
+        return;
+    }
+
+    if (! read_cached_module (path, st))
+    {
+        AUDINFO ("Scanning module %s\n", path);
+
+        bool loaded;
+        LADSPA_Descriptor_Function descfun = open_module (path, loaded);
+
+        const LADSPA_Descriptor * desc;
+        for (int i = 0; descfun && (desc = descfun (i)); i ++)
+            open_plugin (path, i, * desc);
+
+        if (! loaded)
+            return;
+    }
+
+    cache_module (path, st);
 }
 
 static void open_modules_for_path (const char * path)
@@ -167,10 +378,7 @@ static void open_modules_for_path (const char * path)
         if (! str_has_suffix_nocase (name, G_MODULE_SUFFIX))
             continue;
 
-        GModule * handle = open_module (filename_build ({path, name}));
-
-        if (handle)
-            modules.append (handle);
+        scan_module (filename_build ({path, name}));
     }
 
     g_dir_close (folder);
@@ -189,10 +397,40 @@ static void open_modules_for_paths (const char * paths)
     g_strfreev (split);
 }
 
+/* lists the plugins, from the cache where it can; the cache is written
+ * anew if anything has changed */
 static void open_modules ()
 {
+    StringBuf path = cache_path ();
+
+    old_cache = g_key_file_new ();
+    if (! g_key_file_load_from_file (old_cache, path, G_KEY_FILE_NONE, nullptr))
+    {
+        g_key_file_free (old_cache);
+        old_cache = nullptr;
+    }
+
+    new_cache = g_key_file_new ();
+
     open_modules_for_paths (getenv ("LADSPA_PATH"));
     open_modules_for_paths (module_path);
+
+    CharPtr old_data (old_cache ? g_key_file_to_data (old_cache, nullptr, nullptr) : nullptr);
+    CharPtr new_data (g_key_file_to_data (new_cache, nullptr, nullptr));
+
+    GError * error = nullptr;
+    if ((! old_data || strcmp (old_data, new_data)) &&
+        ! g_file_set_contents (path, new_data, -1, & error))
+    {
+        AUDERR ("Failed to write %s: %s\n", (const char *) path, error->message);
+        g_error_free (error);
+    }
+
+    if (old_cache)
+        g_key_file_free (old_cache);
+
+    g_key_file_free (new_cache);
+    old_cache = new_cache = nullptr;
 }
 
 static void close_modules ()
@@ -201,16 +439,66 @@ static void close_modules ()
 
     for (GModule * module : modules)
         g_module_close (module);
+
+    modules.clear ();
+}
+
+/* Opens the module of a plugin listed from the cache, and points all the
+ * plugins listed from it to their descriptors.  The ports are taken from
+ * the descriptor again if it does not look like the one cached, in case
+ * the module was rebuilt with the same size and time. */
+static bool load_descriptor (PluginData & plugin)
+{
+    if (plugin.desc)
+        return true;
+
+    AUDINFO ("Opening module %s\n", (const char *) plugin.module);
+
+    bool loaded;
+    LADSPA_Descriptor_Function descfun = open_module (plugin.module, loaded);
+    if (! descfun)
+        return false;
+
+    const LADSPA_Descriptor * desc;
+    for (int i = 0; (desc = descfun (i)); i ++)
+    {
+        if (! desc->Label || ! desc->Name)
+            continue;
+
+        for (auto & other : plugins)
+        {
+            if (other->desc || strcmp (other->module, plugin.module) ||
+                strcmp (other->label, desc->Label))
+                continue;
+
+            if (other->index != i || other->port_count != (int) desc->PortCount)
+            {
+                other->index = i;
+                parse_ports (* other, * desc);
+            }
+
+            other->desc = desc;
+        }
+    }
+
+    if (! plugin.desc)
+        AUDERR ("Plugin %s is no longer in %s\n", (const char *) plugin.label,
+         (const char *) plugin.module);
+
+    return plugin.desc != nullptr;
 }
 
-LoadedPlugin & enable_plugin_locked (PluginData & plugin)
+LoadedPlugin * enable_plugin_locked (PluginData & plugin)
 {
+    if (! load_descriptor (plugin))
+        return nullptr;
+
     LoadedPlugin & loaded = * loadeds.append (new LoadedPlugin (plugin));
 
     for (auto & control : plugin.controls)
         loaded.values.append (control.def);
 
-    return loaded;
+    return & loaded;
 }
 
 void disable_plugin_locked (LoadedPlugin & loaded)
@@ -225,7 +513,7 @@ static PluginData * find_plugin (const char * path, const char * label)
 {
     for (auto & plugin : plugins)
     {
-        if (! strcmp (plugin->path, path) && ! strcmp (plugin->desc.Label, label))
+        if (! strcmp (plugin->path, path) && ! strcmp (plugin->label, label))
             return plugin.get ();
     }
 
@@ -243,7 +531,7 @@ static void save_enabled_to_config ()
         LoadedPlugin & loaded = * loadeds[i];
 
         aud_set_str ("ladspa", str_printf ("plugin%d_path", i), loaded.plugin.path);
-        aud_set_str ("ladspa", str_printf ("plugin%d_label", i), loaded.plugin.desc.Label);
+        aud_set_str ("ladspa", str_printf ("plugin%d_label", i), loaded.plugin.label);
 
         Index<double> temp;
         temp.insert (0, loaded.values.len ());
@@ -278,7 +566,11 @@ static void load_enabled_from_config ()
         if (! plugin)
             continue;
 
-        LoadedPlugin & loaded = enable_plugin_locked (* plugin);
+        LoadedPlugin * ptr = enable_plugin_locked (* plugin);
+        if (! ptr)
+            continue;
+
+        LoadedPlugin & loaded = * ptr;
 
         String controls = aud_get_str ("ladspa", str_printf ("plugin%d_controls", i));
 
@@ -323,7 +615,6 @@ void LADSPAHost::cleanup ()
     save_enabled_to_config ();
     close_modules ();
 
-    modules.clear ();
     plugins.clear ();
     loadeds.clear ();
 
@@ -413,7 +704,7 @@ static void configure_plugin (LoadedPlugin & loaded)
 
     PluginData & plugin = loaded.plugin;
 
-    StringBuf title = str_printf (_("%s Settings"), plugin.desc.Name);
+    StringBuf title = str_printf (_("%s Settings"), (const char *) plugin.name);
     loaded.settings_win = gtk_dialog_new_with_buttons (title, nullptr,
      (GtkDialogFlags) 0, _("_Close"), GTK_RESPONSE_CLOSE, nullptr);
     gtk_window_set_resizable ((GtkWindow *) loaded.settings_win, 0);
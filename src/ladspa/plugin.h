@@ -39,17 +39,24 @@ struct ControlData {
     float min, max, def;
 };
 
+/* Everything but desc may come from the cache of module scans, in which
+ * case the module is not opened until the plugin is enabled. */
 struct PluginData
 {
-    String path;
-    const LADSPA_Descriptor & desc;
+    String path;    /* the file name of the module, as saved in the config */
+    String module;  /* the whole path of the module */
+    int index;      /* of the descriptor in the module */
+    String label, name;
+    int port_count = 0;
     Index<ControlData> controls;
     Index<int> in_ports, out_ports;
+    const LADSPA_Descriptor * desc = nullptr;
     bool selected = false;
 
-    PluginData (const char * path, const LADSPA_Descriptor & desc) :
+    PluginData (const char * path, const char * module, int index) :
         path (path),
-        desc (desc) {}
+        module (module),
+        index (index) {}
 };
 
 struct LoadedPlugin
@@ -59,7 +66,7 @@ struct LoadedPlugin
     bool selected = false;
     bool active = false;
     Index<LADSPA_Handle> instances;
-    Index<Index<float>> in_bufs, out_bufs;
+    Index<Index<float>> out_bufs;  /* if the plugin cannot run in place */
     GtkWidget * settings_win = nullptr;
 
     LoadedPlugin (PluginData & plugin) :
@@ -100,14 +107,15 @@ public:
 
 extern pthread_mutex_t mutex;
 extern String module_path;
-extern Index<GModule *> modules;
+extern Index<GModule *> modules;  /* those opened so far */
 extern Index<SmartPtr<PluginData>> plugins;
 extern Index<SmartPtr<LoadedPlugin>> loadeds;
 
 extern GtkWidget * plugin_list;
 extern GtkWidget * loaded_list;
 
-LoadedPlugin & enable_plugin_locked (PluginData & plugin);
+/* opens the plugin's module if need be; nullptr if it cannot be loaded */
+LoadedPlugin * enable_plugin_locked (PluginData & plugin);
 void disable_plugin_locked (LoadedPlugin & loaded);
 
 /* effect.c */
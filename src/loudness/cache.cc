@@ -0,0 +1,187 @@
+/*
+ * Loudness Normalizer for Audacious
+ * Copyright 2024 Loudness Normalizer Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/multihash.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+#include "loudness.h"
+#include "../vfs-common/atomic-file.h"
+
+/* One line per file:
+ *   <size> <mtime> <integrated> <true peak> <range> <URI>
+ * with "-" for the three values if the file could not be analysed, so that
+ * it is not tried again until it changes. */
+#define CACHE_HEADER "# Audacious loudness cache 1"
+
+struct CacheEntry {
+    int64_t size, mtime;
+    LoudnessInfo info;
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SimpleHash<String, CacheEntry> cache;
+static bool cache_changed;
+
+static StringBuf cache_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "loudness-cache"});
+}
+
+bool get_file_stamp (const char * filename, int64_t & size, int64_t & mtime)
+{
+    StringBuf path = uri_to_filename (filename);
+    struct stat st;
+
+    if (! path || stat (path, & st) < 0 || ! S_ISREG (st.st_mode))
+        return false;
+
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+static void parse_line (char * line)
+{
+    CacheEntry entry = CacheEntry ();
+    int offset = 0;
+
+    if (sscanf (line, "%" SCNd64 " %" SCNd64 " %f %f %f %n", & entry.size,
+     & entry.mtime, & entry.info.integrated, & entry.info.true_peak,
+     & entry.info.range, & offset) == 5 && offset)
+        entry.info.valid = true;
+    else if (sscanf (line, "%" SCNd64 " %" SCNd64 " - - - %n", & entry.size,
+     & entry.mtime, & offset) != 2 || ! offset)
+        return;
+
+    if (line[offset])
+        cache.add (String (line + offset), std::move (entry));
+}
+
+void cache_load ()
+{
+    VFSFile file (cache_path (), "r");
+    if (! file)
+        return;
+
+    Index<char> data = file.read_all ();
+    data.append (0);
+
+    pthread_mutex_lock (& cache_mutex);
+
+    char * line = data.begin ();
+    bool first = true;
+
+    while (* line)
+    {
+        char * end = strchr (line, '\n');
+        if (end)
+            * end = 0;
+
+        if (first && strcmp (line, CACHE_HEADER))
+            break;  /* unknown format */
+
+        if (! first)
+            parse_line (line);
+
+        first = false;
+        line = end ? end + 1 : line + strlen (line);
+    }
+
+    cache_changed = false;
+    pthread_mutex_unlock (& cache_mutex);
+}
+
+void cache_save ()
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    if (! cache_changed)
+    {
+        pthread_mutex_unlock (& cache_mutex);
+        return;
+    }
+
+    bool saved = write_file_atomic (cache_path (), [] (FILE * file) {
+        fprintf (file, "%s\n", CACHE_HEADER);
+
+        cache.iterate ([file] (const String & filename, CacheEntry & entry) {
+            if (entry.info.valid)
+                fprintf (file, "%" PRId64 " %" PRId64 " %.2f %.2f %.2f %s\n",
+                 entry.size, entry.mtime, entry.info.integrated,
+                 entry.info.true_peak, entry.info.range, (const char *) filename);
+            else
+                fprintf (file, "%" PRId64 " %" PRId64 " - - - %s\n",
+                 entry.size, entry.mtime, (const char *) filename);
+        });
+    });
+
+    if (saved)
+        cache_changed = false;
+
+    pthread_mutex_unlock (& cache_mutex);
+}
+
+/* called for each song as it starts, so it does not touch the file; the
+ * scanner replaces results for files that have changed */
+bool cache_lookup (const char * filename, LoudnessInfo & info)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    CacheEntry * entry = cache.lookup (String (filename));
+    if (entry)
+        info = entry->info;
+
+    pthread_mutex_unlock (& cache_mutex);
+    return entry && info.valid;
+}
+
+bool cache_is_current (const char * filename, int64_t size, int64_t mtime)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    CacheEntry * entry = cache.lookup (String (filename));
+    bool current = entry && entry->size == size && entry->mtime == mtime;
+
+    pthread_mutex_unlock (& cache_mutex);
+    return current;
+}
+
+void cache_store (const char * filename, int64_t size, int64_t mtime, const LoudnessInfo & info)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    String key (filename);
+    CacheEntry * entry = cache.lookup (key);
+
+    if (entry)
+        * entry = {size, mtime, info};
+    else
+        cache.add (key, {size, mtime, info});
+
+    cache_changed = true;
+    pthread_mutex_unlock (& cache_mutex);
+}
@@ -0,0 +1,80 @@
+/*
+ * Loudness Normalizer for Audacious
+ * Copyright 2024 Loudness Normalizer Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_LOUDNESS_H
+#define AUD_LOUDNESS_H
+
+#include <stdint.h>
+
+#include <libaudcore/audio.h>
+#include <libaudcore/index.h>
+
+/* the result of analysing one file */
+struct LoudnessInfo {
+    bool valid;         /* false if the file could not be decoded or is silent */
+    float integrated;   /* LUFS */
+    float true_peak;    /* dBTP */
+    float range;        /* LU */
+};
+
+/* Measures a whole stream as specified by ITU-R BS.1770-4 and EBU Tech 3342:
+ * K-weighting, gated integrated loudness over 400 ms blocks, loudness range
+ * over 3 s blocks, and the true peak with 4x oversampling.  Only the mean
+ * square of each 100 ms sub-block is kept, so memory grows by a few bytes
+ * per second of audio. */
+class R128Analyzer
+{
+public:
+    void start (int channels, int rate);
+    void process (const float * data, int frames);  /* interleaved */
+    LoudnessInfo finish ();
+
+private:
+    void process_part (const float * data, int frames);
+
+    int m_channels = 0, m_rate = 0;
+    int m_subblock = 0, m_filled = 0;   /* frames per 100 ms, frames so far */
+    double m_energy = 0;                /* weighted sum for the sub-block so far */
+    float m_peak = 0;
+
+    double m_shelf[5], m_highpass[5];   /* b0, b1, b2, a1, a2 */
+    double m_state[AUD_MAX_CHANNELS][4];
+    float m_weights[AUD_MAX_CHANNELS];
+
+    Index<float> m_planar;              /* true-peak history, then one channel */
+    Index<float> m_history;             /* per channel, between calls */
+    Index<double> m_subblocks;          /* mean square of each sub-block */
+};
+
+/* results of earlier analyses, keyed by URI and checked against the file's
+ * size and modification time (cache.cc) */
+void cache_load ();
+void cache_save ();
+bool cache_lookup (const char * filename, LoudnessInfo & info);
+bool cache_is_current (const char * filename, int64_t size, int64_t mtime);
+void cache_store (const char * filename, int64_t size, int64_t mtime, const LoudnessInfo & info);
+
+/* local file stamps; false for remote URIs */
+bool get_file_stamp (const char * filename, int64_t & size, int64_t & mtime);
+
+/* background analysis of playlist entries (scan.cc) */
+void scan_start ();
+void scan_stop ();
+
+#endif
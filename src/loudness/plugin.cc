@@ -0,0 +1,151 @@
+/*
+ * Loudness Normalizer for Audacious
+ * Copyright 2024 Loudness Normalizer Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+
+#include <libaudcore/drct.h>
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
+
+#include "loudness.h"
+#include "../trace-common/trace.h"
+
+/* Files are analysed in the background ahead of time (scan.cc), so playing
+ * one costs a table lookup and a multiply per sample.  A file that has not
+ * been analysed yet plays at the fallback gain. */
+
+static const char * const loudness_defaults[] = {
+    "target", "-18",
+    "prevent_clipping", "TRUE",
+    "ceiling", "-1",
+    "fallback", "0",
+    "scan", "TRUE",
+    nullptr
+};
+
+static void scan_changed ()
+{
+    if (aud_get_bool ("loudness", "scan"))
+        scan_start ();
+    else
+        scan_stop ();
+}
+
+static const PreferencesWidget loudness_widgets[] = {
+    WidgetLabel (N_("<b>Normalization</b>")),
+    WidgetSpin (N_("Target loudness:"),
+        WidgetFloat ("loudness", "target"),
+        {-31, -5, 0.5, N_("LUFS")}),
+    WidgetCheck (N_("Prevent clipping"),
+        WidgetBool ("loudness", "prevent_clipping")),
+    WidgetSpin (N_("Peak ceiling:"),
+        WidgetFloat ("loudness", "ceiling"),
+        {-6, 0, 0.1, N_("dBTP")},
+        WIDGET_CHILD),
+    WidgetSpin (N_("Gain for files not yet analysed:"),
+        WidgetFloat ("loudness", "fallback"),
+        {-20, 20, 0.5, N_("dB")}),
+    WidgetLabel (N_("<b>Analysis</b>")),
+    WidgetCheck (N_("Analyse playlist files in the background"),
+        WidgetBool ("loudness", "scan", scan_changed))
+};
+
+static const PluginPreferences loudness_prefs = {{loudness_widgets}};
+
+static const char loudness_about[] =
+ N_("Loudness Normalizer for Audacious\n"
+    "Copyright 2024 Loudness Normalizer Plugin Authors\n\n"
+    "Plays every file at the same loudness, measured as specified by "
+    "EBU R128, without analysing the audio during playback.  Files are "
+    "decoded with libsndfile at idle priority and the results are kept "
+    "until a file changes.");
+
+class LoudnessNormalizer : public EffectPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("Loudness Normalizer"),
+        PACKAGE,
+        loudness_about,
+        & loudness_prefs
+    };
+
+    constexpr LoudnessNormalizer () : EffectPlugin (info, 0, true) {}
+
+    bool init () override;
+    void cleanup () override;
+
+    void start (int & channels, int & rate) override;
+    Index<float> & process (Index<float> & data) override;
+};
+
+EXPORT LoudnessNormalizer aud_plugin_instance;
+
+static float gain;
+
+bool LoudnessNormalizer::init ()
+{
+    aud_config_set_defaults ("loudness", loudness_defaults);
+
+    cache_load ();
+
+    if (aud_get_bool ("loudness", "scan"))
+        scan_start ();
+
+    return true;
+}
+
+void LoudnessNormalizer::cleanup ()
+{
+    scan_stop ();
+    cache_save ();
+}
+
+/* called as each song starts */
+void LoudnessNormalizer::start (int & channels, int & rate)
+{
+    String filename = aud_drct_get_filename ();
+    LoudnessInfo info;
+    double db;
+
+    if (filename && cache_lookup (filename, info))
+    {
+        db = aud_get_double ("loudness", "target") - info.integrated;
+
+        if (aud_get_bool ("loudness", "prevent_clipping"))
+            db = aud::min (db, aud_get_double ("loudness", "ceiling") - info.true_peak);
+    }
+    else
+        db = aud_get_double ("loudness", "fallback");
+
+    gain = powf (10, db / 20);
+}
+
+Index<float> & LoudnessNormalizer::process (Index<float> & data)
+{
+    TRACE_SPAN ("Loudness process");
+    float g = gain;
+
+    for (float & sample : data)
+        sample *= g;
+
+    return data;
+}
@@ -0,0 +1,324 @@
+/*
+ * Loudness Normalizer for Audacious
+ * Copyright 2024 Loudness Normalizer Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "loudness.h"
+
+#define CHUNK 1024          /* frames deinterleaved at a time */
+#define BLOCK 8             /* partial sums kept in the true-peak loop */
+
+#define TP_PHASES 4
+#define TP_TAPS 12          /* per phase */
+
+#define ABSOLUTE_GATE -70.0
+#define RELATIVE_GATE -10.0 /* LU, for the integrated loudness */
+#define RANGE_GATE -20.0    /* LU, for the loudness range */
+
+/* the oversampling filter: a windowed sinc, one row per phase with the taps
+ * in reverse so that each output is a plain dot product */
+static float tp_coefs[TP_PHASES][TP_TAPS];
+
+static void design_oversampler ()
+{
+    if (tp_coefs[0][0] || tp_coefs[0][1])
+        return;
+
+    const int len = TP_PHASES * TP_TAPS;
+    const double center = (len - 1) / 2.0;
+
+    for (int i = 0; i < len; i ++)
+    {
+        double x = (i - center) / TP_PHASES;
+        double sinc = x ? sin (M_PI * x) / (M_PI * x) : 1;
+        double blackman = 0.42 - 0.5 * cos (2 * M_PI * (i + 0.5) / len)
+         + 0.08 * cos (4 * M_PI * (i + 0.5) / len);
+
+        tp_coefs[i % TP_PHASES][TP_TAPS - 1 - i / TP_PHASES] = sinc * blackman;
+    }
+}
+
+static double energy_to_lufs (double energy)
+{
+    return -0.691 + 10 * log10 (energy);
+}
+
+static double lufs_to_energy (double lufs)
+{
+    return pow (10, (lufs + 0.691) / 10);
+}
+
+/* the two K-weighting stages, recomputed for the sample rate from the
+ * analog prototypes of BS.1770 (the published coefficients are for 48 kHz) */
+void R128Analyzer::start (int channels, int rate)
+{
+    design_oversampler ();
+
+    m_channels = aud::min (channels, AUD_MAX_CHANNELS);
+    m_rate = rate;
+    m_subblock = aud::max (rate / 10, 1);
+    m_filled = 0;
+    m_energy = 0;
+    m_peak = 0;
+
+    double K = tan (M_PI * 1681.974450955533 / rate);
+    double Q = 0.7071752369554196;
+    double Vh = pow (10, 3.999843853973347 / 20);
+    double Vb = pow (Vh, 0.4996667741545416);
+    double a0 = 1 + K / Q + K * K;
+
+    m_shelf[0] = (Vh + Vb * K / Q + K * K) / a0;
+    m_shelf[1] = 2 * (K * K - Vh) / a0;
+    m_shelf[2] = (Vh - Vb * K / Q + K * K) / a0;
+    m_shelf[3] = 2 * (K * K - 1) / a0;
+    m_shelf[4] = (1 - K / Q + K * K) / a0;
+
+    K = tan (M_PI * 38.13547087602444 / rate);
+    Q = 0.5003270373238773;
+    a0 = 1 + K / Q + K * K;
+
+    m_highpass[0] = 1;
+    m_highpass[1] = -2;
+    m_highpass[2] = 1;
+    m_highpass[3] = 2 * (K * K - 1) / a0;
+    m_highpass[4] = (1 - K / Q + K * K) / a0;
+
+    memset (m_state, 0, sizeof m_state);
+
+    /* surround channels count 1.5 dB more; the LFE channel not at all */
+    for (int c = 0; c < m_channels; c ++)
+        m_weights[c] = 1;
+
+    if (m_channels >= 6)
+    {
+        m_weights[3] = 0;
+        for (int c = 4; c < m_channels; c ++)
+            m_weights[c] = 1.41;
+    }
+
+    m_planar.resize (TP_TAPS - 1 + CHUNK);
+    m_history.resize (m_channels * (TP_TAPS - 1));
+    m_history.erase (0, -1);
+    m_subblocks.clear ();
+}
+
+/* the IIR filters are serial in time, so this works on one channel at a
+ * time with the state in registers; the true-peak FIR is independent per
+ * output and is computed BLOCK outputs at once */
+void R128Analyzer::process_part (const float * data, int frames)
+{
+    float * buf = m_planar.begin ();
+    float * samples = buf + TP_TAPS - 1;
+    float peak = m_peak;
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        float * history = & m_history[c * (TP_TAPS - 1)];
+
+        memcpy (buf, history, sizeof (float) * (TP_TAPS - 1));
+        for (int i = 0; i < frames; i ++)
+            samples[i] = data[i * m_channels + c];
+        memcpy (history, buf + frames, sizeof (float) * (TP_TAPS - 1));
+
+        if (m_weights[c])
+        {
+            const double * s = m_shelf, * h = m_highpass;
+            double z1 = m_state[c][0], z2 = m_state[c][1];
+            double z3 = m_state[c][2], z4 = m_state[c][3];
+            double sum = 0;
+
+            for (int i = 0; i < frames; i ++)
+            {
+                double x = samples[i];
+                double y = s[0] * x + z1;
+                z1 = s[1] * x - s[3] * y + z2;
+                z2 = s[2] * x - s[4] * y;
+
+                double w = y + z3;
+                z3 = h[1] * y - h[3] * w + z4;
+                z4 = y - h[4] * w;
+
+                sum += w * w;
+            }
+
+            m_state[c][0] = z1;
+            m_state[c][1] = z2;
+            m_state[c][2] = z3;
+            m_state[c][3] = z4;
+
+            m_energy += m_weights[c] * sum;
+        }
+
+        for (int p = 0; p < TP_PHASES; p ++)
+        {
+            const float * __restrict coefs = tp_coefs[p];
+            int i = 0;
+
+            for (; i + BLOCK <= frames; i += BLOCK)
+            {
+                float acc[BLOCK] = {};
+                const float * __restrict x = buf + i;
+
+                for (int k = 0; k < TP_TAPS; k ++)
+                    for (int j = 0; j < BLOCK; j ++)
+                        acc[j] += coefs[k] * x[j + k];
+
+                for (int j = 0; j < BLOCK; j ++)
+                    peak = aud::max (peak, fabsf (acc[j]));
+            }
+
+            for (; i < frames; i ++)
+            {
+                float acc = 0;
+                for (int k = 0; k < TP_TAPS; k ++)
+                    acc += coefs[k] * buf[i + k];
+
+                peak = aud::max (peak, fabsf (acc));
+            }
+        }
+
+        /* the filter only approximates the samples themselves */
+        for (int i = 0; i < frames; i ++)
+            peak = aud::max (peak, fabsf (samples[i]));
+    }
+
+    m_peak = peak;
+}
+
+void R128Analyzer::process (const float * data, int frames)
+{
+    while (frames > 0)
+    {
+        /* a chunk never straddles two sub-blocks */
+        int part = aud::min (aud::min (frames, CHUNK), m_subblock - m_filled);
+
+        process_part (data, part);
+
+        data += part * m_channels;
+        frames -= part;
+        m_filled += part;
+
+        if (m_filled == m_subblock)
+        {
+            m_subblocks.append (m_energy / m_subblock);
+            m_energy = 0;
+            m_filled = 0;
+        }
+    }
+}
+
+/* computes the gate for a set of blocks: the absolute gate or, if higher,
+ * the given level relative to the mean of the blocks above the absolute
+ * gate; false if there are none */
+static bool gate_threshold (const Index<double> & blocks, double relative_gate,
+ double & threshold)
+{
+    threshold = lufs_to_energy (ABSOLUTE_GATE);
+
+    double sum = 0;
+    int count = 0;
+
+    for (double energy : blocks)
+    {
+        if (energy > threshold)
+        {
+            sum += energy;
+            count ++;
+        }
+    }
+
+    if (! count)
+        return false;
+
+    threshold = aud::max (threshold, sum / count * pow (10, relative_gate / 10));
+    return true;
+}
+
+/* energies of blocks of <len> sub-blocks, starting every <step> */
+static Index<double> sliding_blocks (const Index<double> & subblocks, int len, int step)
+{
+    Index<double> blocks;
+    double sum = 0;
+
+    for (int i = 0; i < subblocks.len (); i ++)
+    {
+        sum += subblocks[i];
+        if (i >= len)
+            sum -= subblocks[i - len];
+
+        if (i >= len - 1 && (i - (len - 1)) % step == 0)
+            blocks.append (aud::max (sum, 0.0) / len);
+    }
+
+    return blocks;
+}
+
+LoudnessInfo R128Analyzer::finish ()
+{
+    LoudnessInfo info = LoudnessInfo ();
+
+    /* 400 ms blocks overlapping by 75% */
+    auto blocks = sliding_blocks (m_subblocks, 4, 1);
+    double threshold;
+
+    if (! gate_threshold (blocks, RELATIVE_GATE, threshold))
+        return info;
+
+    double sum = 0;
+    int count = 0;
+
+    for (double energy : blocks)
+    {
+        if (energy > threshold)
+        {
+            sum += energy;
+            count ++;
+        }
+    }
+
+    info.valid = true;
+    info.integrated = energy_to_lufs (sum / count);
+    info.true_peak = m_peak ? 20 * log10f (m_peak) : -INFINITY;
+
+    /* 3 s blocks every second; the range is the spread between the 10th
+     * and 95th percentiles of those above the gates */
+    auto short_term = sliding_blocks (m_subblocks, 30, 10);
+
+    if (gate_threshold (short_term, RANGE_GATE, threshold))
+    {
+        Index<double> gated;
+        for (double energy : short_term)
+        {
+            if (energy > threshold)
+                gated.append (energy);
+        }
+
+        std::sort (gated.begin (), gated.end ());
+
+        int n = gated.len ();
+        double low = gated[(int) lround ((n - 1) * 0.10)];
+        double high = gated[(int) lround ((n - 1) * 0.95)];
+        info.range = energy_to_lufs (high) - energy_to_lufs (low);
+    }
+
+    m_subblocks.clear ();
+    return info;
+}
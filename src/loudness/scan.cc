@@ -0,0 +1,305 @@
+/*
+ * Loudness Normalizer for Audacious
+ * Copyright 2024 Loudness Normalizer Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <sndfile.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <libaudcore/hook.h>
+#include <libaudcore/multihash.h>
+#include <libaudcore/playlist.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+#include "loudness.h"
+
+#define READ_FRAMES 4096
+#define SAVE_EVERY 32       /* results between writes of the cache */
+#define UPCOMING 8          /* entries after the playing one to do first */
+
+static pthread_mutex_t scan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scan_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t scan_thread;
+static bool scan_running, scan_quit;
+
+static Index<String> pending;
+static SimpleHash<String, bool> queued;  /* this session, so each once */
+
+/* Virtual file access for libsndfile, as in the sndfile plugin; only local
+ * files are scanned, so they are always seekable */
+static sf_count_t sf_get_filelen (void * user_data)
+{
+    int64_t size = ((VFSFile *) user_data)->fsize ();
+    return (size < 0) ? SF_COUNT_MAX : size;
+}
+
+static sf_count_t sf_vseek (sf_count_t offset, int whence, void * user_data)
+{
+    if (((VFSFile *) user_data)->fseek (offset, to_vfs_seek_type (whence)) != 0)
+        return -1;
+
+    return ((VFSFile *) user_data)->ftell ();
+}
+
+static sf_count_t sf_vread (void * ptr, sf_count_t count, void * user_data)
+{
+    return ((VFSFile *) user_data)->fread (ptr, 1, count);
+}
+
+static sf_count_t sf_vwrite_dummy (const void * ptr, sf_count_t count, void * user_data)
+{
+    return 0;
+}
+
+static sf_count_t sf_tell (void * user_data)
+{
+    return ((VFSFile *) user_data)->ftell ();
+}
+
+static SF_VIRTUAL_IO sf_virtual_io = {
+    sf_get_filelen,
+    sf_vseek,
+    sf_vread,
+    sf_vwrite_dummy,
+    sf_tell
+};
+
+static bool stopping ()
+{
+    pthread_mutex_lock (& scan_mutex);
+    bool quit = scan_quit;
+    pthread_mutex_unlock (& scan_mutex);
+    return quit;
+}
+
+/* the scan should never be heard: it runs only when the CPU and the disk
+ * would otherwise be idle */
+static void lower_priority ()
+{
+#ifdef __linux__
+    struct sched_param param = {};
+    if (sched_setscheduler (0, SCHED_IDLE, & param) < 0)
+        AUDWARN ("Cannot lower the loudness scan priority\n");
+
+#ifdef SYS_ioprio_set
+    /* not in the C library headers: IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE */
+    constexpr int IOPRIO_WHO_PROCESS = 1, IOPRIO_CLASS_IDLE = 3, IOPRIO_CLASS_SHIFT = 13;
+    if (syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0)
+        AUDWARN ("Cannot lower the loudness scan I/O priority\n");
+#endif
+#elif defined(__APPLE__)
+    setpriority (PRIO_DARWIN_THREAD, 0, PRIO_DARWIN_BG);
+#endif
+}
+
+/* false if the scan was stopped before the end of the file */
+static bool analyse (const char * filename, LoudnessInfo & info)
+{
+    info = LoudnessInfo ();
+
+    VFSFile file (filename, "r");
+    if (! file)
+        return true;
+
+    SF_INFO sfinfo {};  /* must be zeroed before sf_open() */
+    SNDFILE * sndfile = sf_open_virtual (& sf_virtual_io, SFM_READ, & sfinfo, & file);
+    if (! sndfile)
+        return true;
+
+    bool finished = true;
+
+    if (sfinfo.channels > 0 && sfinfo.channels <= AUD_MAX_CHANNELS && sfinfo.samplerate > 0)
+    {
+        R128Analyzer analyzer;
+        analyzer.start (sfinfo.channels, sfinfo.samplerate);
+
+        Index<float> buffer;
+        buffer.resize (READ_FRAMES * sfinfo.channels);
+
+        sf_count_t frames;
+        while ((frames = sf_readf_float (sndfile, buffer.begin (), READ_FRAMES)) > 0)
+        {
+            analyzer.process (buffer.begin (), frames);
+
+            if (stopping ())
+            {
+                finished = false;
+                break;
+            }
+        }
+
+        if (finished)
+            info = analyzer.finish ();
+    }
+
+    sf_close (sndfile);
+    return finished;
+}
+
+static void * scan_worker (void *)
+{
+    lower_priority ();
+
+    int unsaved = 0;
+
+    pthread_mutex_lock (& scan_mutex);
+
+    while (! scan_quit)
+    {
+        if (! pending.len ())
+        {
+            if (unsaved)
+            {
+                pthread_mutex_unlock (& scan_mutex);
+                cache_save ();
+                pthread_mutex_lock (& scan_mutex);
+                unsaved = 0;
+                continue;
+            }
+
+            pthread_cond_wait (& scan_cond, & scan_mutex);
+            continue;
+        }
+
+        String filename = std::move (pending[0]);
+        pending.remove (0, 1);
+
+        pthread_mutex_unlock (& scan_mutex);
+
+        int64_t size, mtime;
+        LoudnessInfo info;
+
+        if (get_file_stamp (filename, size, mtime) &&
+         ! cache_is_current (filename, size, mtime) && analyse (filename, info))
+        {
+            cache_store (filename, size, mtime, info);
+
+            if (++ unsaved >= SAVE_EVERY)
+            {
+                cache_save ();
+                unsaved = 0;
+            }
+        }
+
+        pthread_mutex_lock (& scan_mutex);
+    }
+
+    pthread_mutex_unlock (& scan_mutex);
+    return nullptr;
+}
+
+/* To be called with scan_mutex held.  Whether the file is up to date is
+ * checked later by the scan thread, which can afford the stat(). */
+static void queue_file (const String & filename, bool urgent)
+{
+    if (strncmp (filename, "file://", 7))
+        return;
+
+    if (urgent)
+        pending.insert (& filename, 0, 1);
+    else if (! queued.lookup (filename))
+        pending.append (filename);
+
+    if (! queued.lookup (filename))
+        queued.add (filename, true);
+}
+
+static void add_playlists ()
+{
+    pthread_mutex_lock (& scan_mutex);
+
+    for (int p = 0; p < Playlist::n_playlists (); p ++)
+    {
+        Playlist list = Playlist::by_index (p);
+        int entries = list.n_entries ();
+
+        for (int e = 0; e < entries; e ++)
+            queue_file (list.entry_filename (e), false);
+    }
+
+    pthread_cond_signal (& scan_cond);
+    pthread_mutex_unlock (& scan_mutex);
+}
+
+static void playlist_update (void * data, void *)
+{
+    if (aud::from_ptr<Playlist::UpdateLevel> (data) >= Playlist::Structure)
+        add_playlists ();
+}
+
+/* the songs about to play go to the front of the queue, in order */
+static void add_upcoming (void *, void *)
+{
+    Playlist list = Playlist::playing_playlist ();
+    int pos = list.get_position ();
+    if (pos < 0)
+        return;
+
+    int last = aud::min (pos + UPCOMING, list.n_entries () - 1);
+
+    pthread_mutex_lock (& scan_mutex);
+
+    for (int e = last; e >= pos; e --)
+        queue_file (list.entry_filename (e), true);
+
+    pthread_cond_signal (& scan_cond);
+    pthread_mutex_unlock (& scan_mutex);
+}
+
+void scan_start ()
+{
+    if (scan_running)
+        return;
+
+    scan_quit = false;
+    pthread_create (& scan_thread, nullptr, scan_worker, nullptr);
+    scan_running = true;
+
+    hook_associate ("playlist update", playlist_update, nullptr);
+    hook_associate ("playback begin", add_upcoming, nullptr);
+
+    add_playlists ();
+    add_upcoming (nullptr, nullptr);
+}
+
+void scan_stop ()
+{
+    if (! scan_running)
+        return;
+
+    hook_dissociate ("playlist update", playlist_update);
+    hook_dissociate ("playback begin", add_upcoming);
+
+    pthread_mutex_lock (& scan_mutex);
+    scan_quit = true;
+    pthread_cond_signal (& scan_cond);
+    pthread_mutex_unlock (& scan_mutex);
+
+    pthread_join (scan_thread, nullptr);
+    scan_running = false;
+
+    pending.clear ();
+    queued.clear ();
+}
@@ -0,0 +1,530 @@
+/*
+ * LV2 Host for Audacious
+ * Copyright 2024 LV2 Host Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plugin.h"
+
+#include <libaudcore/runtime.h>
+
+#include "../trace-common/trace.h"
+
+static int lv2_channels, lv2_rate;
+
+/* The chain runs on blocks of one buffer per channel, LV2_BLOCK frames
+ * each.  Input is held back until a whole block has arrived, so every plugin
+ * always sees exactly LV2_BLOCK frames per run. */
+static AlignedBuffer planar_bufs;
+static Index<float> pending;  /* interleaved, less than one block */
+static Index<float> output;
+
+bool pipeline_enabled;
+
+bool AlignedBuffer::alloc (int len)
+{
+    clear ();
+
+    void * data;
+    if (posix_memalign (& data, LV2_ALIGN, sizeof (float) * len))
+        return false;
+
+    m_data = (float *) data;
+    memset (m_data, 0, sizeof (float) * len);
+    return true;
+}
+
+static void start_plugin (LoadedPlugin & loaded)
+{
+    if (loaded.active)
+        return;
+
+    loaded.active = 1;
+
+    PluginData & plugin = loaded.plugin;
+
+    int ports = plugin.in_ports.len ();
+
+    if (ports == 0 || ports != plugin.out_ports.len ())
+    {
+        AUDERR ("Plugin has unusable port configuration: %s\n", (const char *) plugin.name);
+        return;
+    }
+
+    if (lv2_channels % ports != 0)
+    {
+        AUDERR ("Plugin cannot be used with %d channels: %s\n",
+         lv2_channels, (const char *) plugin.name);
+        return;
+    }
+
+    int instances = lv2_channels / ports;
+
+    if (plugin.in_place_broken && ! loaded.out_bufs.alloc (lv2_channels * LV2_BLOCK))
+        return;
+
+    loaded.control_outs.insert (0, plugin.control_outs.len ());
+
+    for (int i = 0; i < instances; i ++)
+    {
+        Worker & worker = * loaded.workers.append (new Worker);
+        worker_setup (worker);
+
+        Index<const LV2_Feature *> features;
+        get_features (worker, features);
+
+        LilvInstance * instance = lilv_plugin_instantiate (plugin.lilv, lv2_rate, features.begin ());
+        if (! instance)
+        {
+            AUDERR ("Failed to instantiate plugin: %s\n", (const char *) plugin.name);
+            shutdown_plugin_locked (loaded);
+            loaded.active = 1;  /* don't keep trying */
+            return;
+        }
+
+        loaded.instances.append (instance);
+
+        int controls = plugin.controls.len ();
+        for (int c = 0; c < controls; c ++)
+            lilv_instance_connect_port (instance, plugin.controls[c].port, & loaded.values[c]);
+
+        int control_outs = plugin.control_outs.len ();
+        for (int c = 0; c < control_outs; c ++)
+            lilv_instance_connect_port (instance, plugin.control_outs[c], & loaded.control_outs[c]);
+
+        for (int port : plugin.optional_ports)
+            lilv_instance_connect_port (instance, port, nullptr);
+
+        lilv_instance_activate (instance);
+        worker_attach (worker, instance);
+    }
+}
+
+/* The audio ports are connected to the block being processed just before
+ * each run, which lets a pipelined chain work on several blocks at once. */
+static void run_plugin (LoadedPlugin & loaded, AlignedBuffer & block)
+{
+    if (! loaded.instances.len ())
+        return;
+
+    PluginData & plugin = loaded.plugin;
+
+    int ports = plugin.in_ports.len ();
+    int instances = loaded.instances.len ();
+    assert (ports * instances == lv2_channels);
+
+    for (int i = 0; i < instances; i ++)
+    {
+        LilvInstance * instance = loaded.instances[i];
+
+        for (int p = 0; p < ports; p ++)
+        {
+            int channel = ports * i + p;
+
+            lilv_instance_connect_port (instance, plugin.in_ports[p], block[channel]);
+            lilv_instance_connect_port (instance, plugin.out_ports[p],
+             plugin.in_place_broken ? loaded.out_bufs[channel] : block[channel]);
+        }
+
+        lilv_instance_run (instance, LV2_BLOCK);
+        worker_deliver (* loaded.workers[i]);
+    }
+
+    if (plugin.in_place_broken)
+    {
+        for (int channel = 0; channel < lv2_channels; channel ++)
+            memcpy (block[channel], loaded.out_bufs[channel], sizeof (float) * LV2_BLOCK);
+    }
+}
+
+static void deinterleave (const float * data, AlignedBuffer & block)
+{
+    for (int channel = 0; channel < lv2_channels; channel ++)
+    {
+        const float * get = data + channel;
+        float * in = block[channel];
+        float * in_end = in + LV2_BLOCK;
+
+        while (in < in_end)
+        {
+            * in ++ = * get;
+            get += lv2_channels;
+        }
+    }
+}
+
+/* appends a processed block to <dest> */
+static void interleave (AlignedBuffer & block, Index<float> & dest)
+{
+    int start = dest.len ();
+    dest.insert (-1, lv2_channels * LV2_BLOCK);
+
+    for (int channel = 0; channel < lv2_channels; channel ++)
+    {
+        float * set = & dest[start + channel];
+        float * out = block[channel];
+        float * out_end = out + LV2_BLOCK;
+
+        while (out < out_end)
+        {
+            * set = * out ++;
+            set += lv2_channels;
+        }
+    }
+}
+
+/* Pipelined mode: every plugin in the chain runs on a thread of its own,
+ * each on a different block.  Blocks are handed from stage to stage through
+ * single-producer, single-consumer queues.  The audio thread deinterleaves
+ * and runs the first stage, then collects finished blocks from the last
+ * queue, so the output trails the input by the blocks still in flight. */
+
+#define MAX_STAGES 16
+
+class BlockQueue
+{
+public:
+    void init ()
+    {
+        m_head = m_tail = 0;
+        sem_init (& m_ready, 0, 0);
+    }
+
+    void destroy ()
+        { sem_destroy (& m_ready); }
+
+    /* There are never more blocks than slots, so this cannot overflow.  The
+     * semaphore counts the blocks queued and orders the slot accesses. */
+    void push (AlignedBuffer * block)
+    {
+        m_slots[m_tail] = block;
+        m_tail = (m_tail + 1) % (MAX_STAGES + 1);
+        sem_post (& m_ready);
+    }
+
+    /* returns false if no block is queued and <wait> is false */
+    bool pop (AlignedBuffer * & block, bool wait)
+    {
+        while (wait ? sem_wait (& m_ready) : sem_trywait (& m_ready))
+        {
+            if (! wait || errno != EINTR)
+                return false;
+        }
+
+        block = m_slots[m_head];
+        m_head = (m_head + 1) % (MAX_STAGES + 1);
+        return true;
+    }
+
+private:
+    AlignedBuffer * m_slots[MAX_STAGES + 1];
+    int m_head, m_tail;  /* each touched only by one side */
+    sem_t m_ready;
+};
+
+static int stage_count;
+static LoadedPlugin * stages[MAX_STAGES];
+static BlockQueue queues[MAX_STAGES];  /* queues[s] feeds stage s; queues[0] holds finished blocks */
+static pthread_t threads[MAX_STAGES];
+
+static AlignedBuffer blocks[MAX_STAGES];
+static Index<AlignedBuffer *> free_blocks;
+static Index<float> drained;  /* finished while the pipeline was stopping */
+
+static BlockQueue & next_queue (int stage)
+    { return queues[(stage + 1) % stage_count]; }
+
+static void * stage_main (void * arg)
+{
+    int stage = (int) (intptr_t) arg;
+    AlignedBuffer * block;
+
+    /* a null block means stop */
+    while (queues[stage].pop (block, true) && block)
+    {
+        run_plugin (* stages[stage], * block);
+        next_queue (stage).push (block);
+    }
+
+    return nullptr;
+}
+
+static bool pipeline_running ()
+    { return stage_count > 0; }
+
+static int blocks_in_flight ()
+    { return pipeline_running () ? stage_count - free_blocks.len () : 0; }
+
+static void collect_block (bool wait, Index<float> & dest)
+{
+    AlignedBuffer * block;
+    if (queues[0].pop (block, wait))
+    {
+        interleave (* block, dest);
+        free_blocks.append (block);
+    }
+}
+
+static void pipeline_drain (Index<float> & dest)
+{
+    while (blocks_in_flight ())
+        collect_block (true, dest);
+}
+
+static void pipeline_start ()
+{
+    int count = 0;
+
+    for (auto & loaded : loadeds)
+    {
+        if (loaded->instances.len () && count < MAX_STAGES)
+            stages[count ++] = loaded.get ();
+    }
+
+    /* nothing to overlap with a single plugin */
+    if (count < 2)
+        return;
+
+    for (int s = 0; s < count; s ++)
+    {
+        if (! blocks[s].alloc (lv2_channels * LV2_BLOCK))
+        {
+            for (int b = 0; b < s; b ++)
+                blocks[b].clear ();
+
+            return;
+        }
+    }
+
+    for (int s = 0; s < count; s ++)
+    {
+        queues[s].init ();
+        free_blocks.append (& blocks[s]);
+    }
+
+    stage_count = count;
+
+    for (int s = 1; s < count; s ++)
+        pthread_create (& threads[s], nullptr, stage_main, (void *) (intptr_t) s);
+}
+
+void pipeline_stop_locked ()
+{
+    if (! pipeline_running ())
+        return;
+
+    pipeline_drain (drained);
+
+    for (int s = 1; s < stage_count; s ++)
+    {
+        queues[s].push (nullptr);
+        pthread_join (threads[s], nullptr);
+    }
+
+    for (int s = 0; s < stage_count; s ++)
+    {
+        queues[s].destroy ();
+        blocks[s].clear ();
+    }
+
+    free_blocks.clear ();
+    stage_count = 0;
+}
+
+static void run_block (const float * data)
+{
+    if (! pipeline_running ())
+    {
+        deinterleave (data, planar_bufs);
+
+        for (auto & loaded : loadeds)
+            run_plugin (* loaded, planar_bufs);
+
+        interleave (planar_bufs, output);
+        return;
+    }
+
+    if (! free_blocks.len ())
+        collect_block (true, output);
+
+    AlignedBuffer * block = free_blocks[free_blocks.len () - 1];
+    free_blocks.remove (free_blocks.len () - 1, 1);
+
+    deinterleave (data, * block);
+    run_plugin (* stages[0], * block);
+    next_queue (0).push (block);
+}
+
+static void run_pending ()
+{
+    int block = lv2_channels * LV2_BLOCK;
+    int done = 0;
+
+    while (pending.len () - done >= block)
+    {
+        run_block (& pending[done]);
+        done += block;
+    }
+
+    pending.remove (0, done);
+
+    /* pick up whatever else is ready, without waiting */
+    for (int n = blocks_in_flight (); n > 0; n --)
+        collect_block (false, output);
+}
+
+static void flush_plugin (LoadedPlugin & loaded)
+{
+    for (LilvInstance * instance : loaded.instances)
+    {
+        lilv_instance_deactivate (instance);
+        lilv_instance_activate (instance);
+    }
+}
+
+void shutdown_plugin_locked (LoadedPlugin & loaded)
+{
+    pipeline_stop_locked ();
+
+    loaded.active = 0;
+
+    for (auto & worker : loaded.workers)
+        worker_detach (* worker);
+
+    for (LilvInstance * instance : loaded.instances)
+    {
+        lilv_instance_deactivate (instance);
+        lilv_instance_free (instance);
+    }
+
+    loaded.instances.clear ();
+    loaded.workers.clear ();
+    loaded.control_outs.clear ();
+    loaded.out_bufs.clear ();
+}
+
+void LV2Host::start (int & channels, int & rate)
+{
+    pthread_mutex_lock (& mutex);
+
+    for (auto & loaded : loadeds)
+        shutdown_plugin_locked (* loaded);
+
+    pipeline_stop_locked ();
+
+    lv2_channels = channels;
+    lv2_rate = rate;
+
+    planar_bufs.alloc (channels * LV2_BLOCK);
+    pending.resize (0);
+    drained.resize (0);
+
+    pthread_mutex_unlock (& mutex);
+}
+
+Index<float> & LV2Host::process (Index<float> & data)
+{
+    TRACE_SPAN ("LV2 process");
+    pthread_mutex_lock (& mutex);
+
+    /* with nothing to run, pass the audio through without the extra block
+     * of latency */
+    if (! loadeds.len () && ! pending.len () && ! drained.len ())
+    {
+        pthread_mutex_unlock (& mutex);
+        return data;
+    }
+
+    for (auto & loaded : loadeds)
+        start_plugin (* loaded);
+
+    if (pipeline_enabled && ! pipeline_running ())
+        pipeline_start ();
+
+    output.resize (0);
+    output.move_from (drained, 0, 0, -1, true, true);
+
+    pending.insert (data.begin (), -1, data.len ());
+    run_pending ();
+
+    pthread_mutex_unlock (& mutex);
+    return output;
+}
+
+bool LV2Host::flush (bool force)
+{
+    pthread_mutex_lock (& mutex);
+
+    Index<float> discard;
+    pipeline_drain (discard);
+
+    for (auto & loaded : loadeds)
+        flush_plugin (* loaded);
+
+    pending.resize (0);
+    drained.resize (0);
+
+    pthread_mutex_unlock (& mutex);
+    return true;
+}
+
+Index<float> & LV2Host::finish (Index<float> & data, bool end_of_playlist)
+{
+    Index<float> & result = process (data);
+
+    if (! end_of_playlist || & result == & data)
+        return result;
+
+    pthread_mutex_lock (& mutex);
+
+    /* run the last partial block padded with silence, then drop the frames
+     * that were not real once everything has come out */
+    int padding = 0;
+    if (pending.len ())
+    {
+        padding = lv2_channels * LV2_BLOCK - pending.len ();
+        pending.insert (-1, padding);
+        run_block (pending.begin ());
+        pending.resize (0);
+    }
+
+    pipeline_drain (output);
+    output.remove (output.len () - padding, -1);
+
+    for (auto & loaded : loadeds)
+        shutdown_plugin_locked (* loaded);
+
+    pthread_mutex_unlock (& mutex);
+    return output;
+}
+
+int LV2Host::adjust_delay (int delay)
+{
+    pthread_mutex_lock (& mutex);
+
+    int held = pending.len () + drained.len ();
+    int frames = lv2_channels ? held / lv2_channels + blocks_in_flight () * LV2_BLOCK : 0;
+
+    pthread_mutex_unlock (& mutex);
+
+    return delay + aud::rescale<int64_t> (frames, lv2_rate, 1000);
+}
@@ -0,0 +1,123 @@
+/*
+ * LV2 Host for Audacious
+ * Copyright 2024 LV2 Host Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <string.h>
+
+#include <lv2/atom/atom.h>
+#include <lv2/buf-size/buf-size.h>
+#include <lv2/options/options.h>
+#include <lv2/urid/urid.h>
+
+#include "plugin.h"
+
+/* The URID map hands out small integers for URIs.  Plugins may call it from
+ * any thread, hence the lock; after instantiation it is rarely used. */
+static pthread_mutex_t urid_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Index<String> urids;  /* URID n is urids[n - 1] */
+
+static LV2_URID map_uri (LV2_URID_Map_Handle, const char * uri)
+{
+    pthread_mutex_lock (& urid_mutex);
+
+    int n;
+    for (n = 0; n < urids.len (); n ++)
+    {
+        if (! strcmp (urids[n], uri))
+            break;
+    }
+
+    if (n == urids.len ())
+        urids.append (String (uri));
+
+    pthread_mutex_unlock (& urid_mutex);
+    return n + 1;
+}
+
+static const char * unmap_uri (LV2_URID_Unmap_Handle, LV2_URID urid)
+{
+    pthread_mutex_lock (& urid_mutex);
+    /* String data stays put when the index grows */
+    const char * uri = (urid > 0 && (int) urid <= urids.len ()) ? (const char *) urids[urid - 1] : nullptr;
+    pthread_mutex_unlock (& urid_mutex);
+
+    return uri;
+}
+
+static LV2_URID_Map urid_map = {nullptr, map_uri};
+static LV2_URID_Unmap urid_unmap = {nullptr, unmap_uri};
+
+static const int32_t block_length = LV2_BLOCK;
+static LV2_Options_Option options[4];
+
+static const LV2_Feature map_feature = {LV2_URID__map, & urid_map};
+static const LV2_Feature unmap_feature = {LV2_URID__unmap, & urid_unmap};
+static const LV2_Feature options_feature = {LV2_OPTIONS__options, options};
+static const LV2_Feature fixed_feature = {LV2_BUF_SIZE__fixedBlockLength, nullptr};
+static const LV2_Feature bounded_feature = {LV2_BUF_SIZE__boundedBlockLength, nullptr};
+static const LV2_Feature power_of_2_feature = {LV2_BUF_SIZE__powerOf2BlockLength, nullptr};
+
+static const LV2_Feature * const static_features[] = {
+    & map_feature,
+    & unmap_feature,
+    & options_feature,
+    & fixed_feature,
+    & bounded_feature,
+    & power_of_2_feature
+};
+
+void features_init ()
+{
+    LV2_URID int_type = map_uri (nullptr, LV2_ATOM__Int);
+
+    options[0] = {LV2_OPTIONS_INSTANCE, 0, map_uri (nullptr, LV2_BUF_SIZE__minBlockLength),
+     sizeof block_length, int_type, & block_length};
+    options[1] = {LV2_OPTIONS_INSTANCE, 0, map_uri (nullptr, LV2_BUF_SIZE__maxBlockLength),
+     sizeof block_length, int_type, & block_length};
+    options[2] = {LV2_OPTIONS_INSTANCE, 0, map_uri (nullptr, LV2_BUF_SIZE__nominalBlockLength),
+     sizeof block_length, int_type, & block_length};
+    options[3] = {LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, nullptr};
+}
+
+void features_cleanup ()
+{
+    pthread_mutex_lock (& urid_mutex);
+    urids.clear ();
+    pthread_mutex_unlock (& urid_mutex);
+}
+
+void get_features (Worker & worker, Index<const LV2_Feature *> & features)
+{
+    features.insert (static_features, 0, aud::n_elems (static_features));
+    features.append (& worker.feature);
+    features.append (nullptr);
+}
+
+bool feature_supported (const char * uri)
+{
+    if (! strcmp (uri, LV2_WORKER__schedule))
+        return true;
+
+    for (const LV2_Feature * feature : static_features)
+    {
+        if (! strcmp (uri, feature->URI))
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,505 @@
+/*
+ * LV2 Host for Audacious
+ * Copyright 2024 LV2 Host Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <gtk/gtk.h>
+#include <lv2/core/lv2.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
+#include <libaudgui/gtk-compat.h>
+#include <libaudgui/libaudgui-gtk.h>
+
+#include "plugin.h"
+
+const char * const LV2Host::defaults[] = {
+ "plugin_count", "0",
+ "pipeline", "FALSE",
+ nullptr};
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+LilvWorld * world;
+Index<SmartPtr<PluginData>> plugins;
+Index<SmartPtr<LoadedPlugin>> loadeds;
+
+GtkWidget * plugin_list;
+GtkWidget * loaded_list;
+
+static struct {
+    LilvNode * audio_port, * control_port;
+    LilvNode * input_port, * output_port;
+    LilvNode * toggled, * optional, * in_place_broken;
+} nodes;
+
+static void create_nodes ()
+{
+    nodes.audio_port = lilv_new_uri (world, LV2_CORE__AudioPort);
+    nodes.control_port = lilv_new_uri (world, LV2_CORE__ControlPort);
+    nodes.input_port = lilv_new_uri (world, LV2_CORE__InputPort);
+    nodes.output_port = lilv_new_uri (world, LV2_CORE__OutputPort);
+    nodes.toggled = lilv_new_uri (world, LV2_CORE__toggled);
+    nodes.optional = lilv_new_uri (world, LV2_CORE__connectionOptional);
+    nodes.in_place_broken = lilv_new_uri (world, LV2_CORE__inPlaceBroken);
+}
+
+static void free_nodes ()
+{
+    for (LilvNode * node : {nodes.audio_port, nodes.control_port, nodes.input_port,
+     nodes.output_port, nodes.toggled, nodes.optional, nodes.in_place_broken})
+        lilv_node_free (node);
+}
+
+static bool has_features (const LilvPlugin * lilv)
+{
+    LilvNodes * required = lilv_plugin_get_required_features (lilv);
+    bool ok = true;
+
+    LILV_FOREACH (nodes, i, required)
+    {
+        const char * uri = lilv_node_as_uri (lilv_nodes_get (required, i));
+        if (! feature_supported (uri))
+        {
+            AUDDBG ("Plugin needs unsupported feature: %s\n", uri);
+            ok = false;
+        }
+    }
+
+    lilv_nodes_free (required);
+    return ok;
+}
+
+static ControlData parse_control (const LilvPlugin * lilv, int port, float min, float max, float def)
+{
+    const LilvPort * lilv_port = lilv_plugin_get_port_by_index (lilv, port);
+    LilvNode * name = lilv_port_get_name (lilv, lilv_port);
+
+    ControlData control;
+    control.port = port;
+    control.name = String (name ? lilv_node_as_string (name) : "");
+    control.is_toggle = lilv_port_has_property (lilv, lilv_port, nodes.toggled);
+
+    control.min = ! isnan (min) ? min : ! isnan (max) ? max - 100 : -100;
+    control.max = ! isnan (max) ? max : control.min + 100;
+    control.def = ! isnan (def) ? def : control.min;
+
+    lilv_node_free (name);
+    return control;
+}
+
+static void open_plugin (const LilvPlugin * lilv)
+{
+    if (! has_features (lilv))
+        return;
+
+    int ports = lilv_plugin_get_num_ports (lilv);
+
+    Index<float> mins, maxs, defs;
+    mins.insert (0, ports);
+    maxs.insert (0, ports);
+    defs.insert (0, ports);
+    lilv_plugin_get_port_ranges_float (lilv, mins.begin (), maxs.begin (), defs.begin ());
+
+    LilvNode * name = lilv_plugin_get_name (lilv);
+    SmartPtr<PluginData> plugin (new PluginData (lilv_node_as_uri (lilv_plugin_get_uri (lilv)),
+     name ? lilv_node_as_string (name) : "", lilv));
+    lilv_node_free (name);
+
+    for (int i = 0; i < ports; i ++)
+    {
+        const LilvPort * port = lilv_plugin_get_port_by_index (lilv, i);
+        bool input = lilv_port_is_a (lilv, port, nodes.input_port);
+
+        if (lilv_port_is_a (lilv, port, nodes.audio_port))
+            (input ? plugin->in_ports : plugin->out_ports).append (i);
+        else if (lilv_port_is_a (lilv, port, nodes.control_port))
+        {
+            if (input)
+                plugin->controls.append (parse_control (lilv, i, mins[i], maxs[i], defs[i]));
+            else
+                plugin->control_outs.append (i);
+        }
+        else if (lilv_port_has_property (lilv, port, nodes.optional))
+            plugin->optional_ports.append (i);
+        else
+        {
+            /* event and CV ports are not supported */
+            AUDDBG ("Plugin has unsupported ports: %s\n", (const char *) plugin->name);
+            return;
+        }
+    }
+
+    plugin->in_place_broken = lilv_plugin_has_feature (lilv, nodes.in_place_broken);
+    plugins.append (std::move (plugin));
+}
+
+static void open_plugins ()
+{
+    world = lilv_world_new ();
+    lilv_world_load_all (world);
+    create_nodes ();
+
+    const LilvPlugins * all = lilv_world_get_all_plugins (world);
+
+    LILV_FOREACH (plugins, i, all)
+        open_plugin (lilv_plugins_get (all, i));
+}
+
+static void close_plugins ()
+{
+    plugins.clear ();
+
+    free_nodes ();
+    lilv_world_free (world);
+    world = nullptr;
+}
+
+LoadedPlugin & enable_plugin_locked (PluginData & plugin)
+{
+    pipeline_stop_locked ();
+
+    LoadedPlugin & loaded = * loadeds.append (new LoadedPlugin (plugin));
+
+    for (auto & control : plugin.controls)
+        loaded.values.append (control.def);
+
+    return loaded;
+}
+
+void disable_plugin_locked (LoadedPlugin & loaded)
+{
+    if (loaded.settings_win)
+        gtk_widget_destroy (loaded.settings_win);
+
+    shutdown_plugin_locked (loaded);
+}
+
+static PluginData * find_plugin (const char * uri)
+{
+    for (auto & plugin : plugins)
+    {
+        if (! strcmp (plugin->uri, uri))
+            return plugin.get ();
+    }
+
+    return nullptr;
+}
+
+static void save_enabled_to_config ()
+{
+    int count = loadeds.len ();
+    int old_count = aud_get_int ("lv2", "plugin_count");
+    aud_set_int ("lv2", "plugin_count", count);
+
+    for (int i = 0; i < count; i ++)
+    {
+        LoadedPlugin & loaded = * loadeds[i];
+
+        aud_set_str ("lv2", str_printf ("plugin%d_uri", i), loaded.plugin.uri);
+
+        Index<double> temp;
+        temp.insert (0, loaded.values.len ());
+        std::copy (loaded.values.begin (), loaded.values.end (), temp.begin ());
+
+        aud_set_str ("lv2", str_printf ("plugin%d_controls", i),
+         double_array_to_str (temp.begin (), temp.len ()));
+
+        disable_plugin_locked (loaded);
+    }
+
+    loadeds.clear ();
+
+    for (int i = count; i < old_count; i ++)
+    {
+        aud_set_str ("lv2", str_printf ("plugin%d_uri", i), "");
+        aud_set_str ("lv2", str_printf ("plugin%d_controls", i), "");
+    }
+}
+
+static void load_enabled_from_config ()
+{
+    int count = aud_get_int ("lv2", "plugin_count");
+
+    for (int i = 0; i < count; i ++)
+    {
+        String uri = aud_get_str ("lv2", str_printf ("plugin%d_uri", i));
+
+        PluginData * plugin = find_plugin (uri);
+        if (! plugin)
+            continue;
+
+        LoadedPlugin & loaded = enable_plugin_locked (* plugin);
+
+        String controls = aud_get_str ("lv2", str_printf ("plugin%d_controls", i));
+
+        Index<double> temp;
+        temp.insert (0, loaded.values.len ());
+
+        if (str_to_double_array (controls, temp.begin (), temp.len ()))
+            std::copy (temp.begin (), temp.end (), loaded.values.begin ());
+    }
+}
+
+bool LV2Host::init ()
+{
+    pthread_mutex_lock (& mutex);
+
+    aud_config_set_defaults ("lv2", defaults);
+    pipeline_enabled = aud_get_bool ("lv2", "pipeline");
+
+    features_init ();
+    worker_init ();
+    open_plugins ();
+    load_enabled_from_config ();
+
+    pthread_mutex_unlock (& mutex);
+    return true;
+}
+
+void LV2Host::cleanup ()
+{
+    pthread_mutex_lock (& mutex);
+
+    save_enabled_to_config ();
+    close_plugins ();
+    worker_cleanup ();
+    features_cleanup ();
+
+    loadeds.clear ();
+
+    pthread_mutex_unlock (& mutex);
+}
+
+static void enable_selected ()
+{
+    pthread_mutex_lock (& mutex);
+
+    for (auto & plugin : plugins)
+    {
+        if (plugin->selected)
+            enable_plugin_locked (* plugin);
+    }
+
+    pthread_mutex_unlock (& mutex);
+
+    if (loaded_list)
+        update_loaded_list (loaded_list);
+}
+
+static void disable_selected ()
+{
+    pthread_mutex_lock (& mutex);
+
+    for (int i = 0; i < loadeds.len (); )
+    {
+        if (loadeds[i]->selected)
+        {
+            disable_plugin_locked (* loadeds[i]);
+            loadeds.remove (i, 1);
+        }
+        else
+            i ++;
+    }
+
+    pthread_mutex_unlock (& mutex);
+
+    if (loaded_list)
+        update_loaded_list (loaded_list);
+}
+
+static void control_toggled (GtkToggleButton * toggle, float * value)
+{
+    pthread_mutex_lock (& mutex);
+    * value = gtk_toggle_button_get_active (toggle) ? 1 : 0;
+    pthread_mutex_unlock (& mutex);
+}
+
+static void control_changed (GtkSpinButton * spin, float * value)
+{
+    pthread_mutex_lock (& mutex);
+    * value = gtk_spin_button_get_value (spin);
+    pthread_mutex_unlock (& mutex);
+}
+
+static void configure_plugin (LoadedPlugin & loaded)
+{
+    if (loaded.settings_win)
+    {
+        gtk_window_present ((GtkWindow *) loaded.settings_win);
+        return;
+    }
+
+    PluginData & plugin = loaded.plugin;
+
+    StringBuf title = str_printf (_("%s Settings"), (const char *) plugin.name);
+    loaded.settings_win = gtk_dialog_new_with_buttons (title, nullptr,
+     (GtkDialogFlags) 0, _("_Close"), GTK_RESPONSE_CLOSE, nullptr);
+    gtk_window_set_resizable ((GtkWindow *) loaded.settings_win, 0);
+
+    GtkWidget * vbox = gtk_dialog_get_content_area ((GtkDialog *) loaded.settings_win);
+
+    int count = plugin.controls.len ();
+    for (int i = 0; i < count; i ++)
+    {
+        ControlData & control = plugin.controls[i];
+
+        GtkWidget * hbox = audgui_hbox_new (6);
+        gtk_box_pack_start ((GtkBox *) vbox, hbox, 0, 0, 0);
+
+        if (control.is_toggle)
+        {
+            GtkWidget * toggle = gtk_check_button_new_with_label (control.name);
+            gtk_toggle_button_set_active ((GtkToggleButton *) toggle, (loaded.values[i] > 0) ? 1 : 0);
+            gtk_box_pack_start ((GtkBox *) hbox, toggle, 0, 0, 0);
+
+            g_signal_connect (toggle, "toggled", (GCallback) control_toggled, & loaded.values[i]);
+        }
+        else
+        {
+            GtkWidget * label = gtk_label_new (str_printf ("%s:", (const char *) control.name));
+            gtk_box_pack_start ((GtkBox *) hbox, label, 0, 0, 0);
+
+            GtkWidget * spin = gtk_spin_button_new_with_range (control.min, control.max, 0.01);
+            gtk_spin_button_set_value ((GtkSpinButton *) spin, loaded.values[i]);
+            gtk_box_pack_start ((GtkBox *) hbox, spin, 0, 0, 0);
+
+            g_signal_connect (spin, "value-changed", (GCallback) control_changed, & loaded.values[i]);
+        }
+    }
+
+    g_signal_connect (loaded.settings_win, "response", (GCallback) gtk_widget_destroy, nullptr);
+    g_signal_connect (loaded.settings_win, "destroy", (GCallback)
+     gtk_widget_destroyed, & loaded.settings_win);
+
+    gtk_widget_show_all (loaded.settings_win);
+}
+
+static void configure_selected ()
+{
+    pthread_mutex_lock (& mutex);
+
+    for (auto & loaded : loadeds)
+    {
+        if (loaded->selected)
+            configure_plugin (* loaded);
+    }
+
+    pthread_mutex_unlock (& mutex);
+}
+
+static void * make_config_widget ()
+{
+    int dpi = audgui_get_dpi ();
+
+    GtkWidget * vbox = audgui_vbox_new (6);
+    gtk_widget_set_size_request (vbox, 5 * dpi, 4 * dpi);
+
+    GtkWidget * label = gtk_label_new (0);
+    gtk_label_set_markup ((GtkLabel *) label,
+     _("<small>Plugins are loaded from the standard LV2 locations and LV2_PATH.\n"
+     "Plugins needing MIDI, CV or unsupported features are not listed.</small>"));
+#ifdef USE_GTK3
+    gtk_widget_set_halign (label, GTK_ALIGN_START);
+#else
+    gtk_misc_set_alignment ((GtkMisc *) label, 0, 0);
+#endif
+    gtk_box_pack_start ((GtkBox *) vbox, label, 0, 0, 0);
+
+    GtkWidget * hbox = audgui_hbox_new (6);
+    gtk_box_pack_start ((GtkBox *) vbox, hbox, 1, 1, 0);
+
+    GtkWidget * vbox2 = audgui_vbox_new (6);
+    gtk_box_pack_start ((GtkBox *) hbox, vbox2, 1, 1, 0);
+
+    label = gtk_label_new (_("Available plugins:"));
+    gtk_box_pack_start ((GtkBox *) vbox2, label, 0, 0, 0);
+
+    GtkWidget * scrolled = gtk_scrolled_window_new (nullptr, nullptr);
+    gtk_scrolled_window_set_shadow_type ((GtkScrolledWindow *) scrolled, GTK_SHADOW_IN);
+    gtk_box_pack_start ((GtkBox *) vbox2, scrolled, 1, 1, 0);
+
+    plugin_list = create_plugin_list ();
+    gtk_container_add ((GtkContainer *) scrolled, plugin_list);
+
+    GtkWidget * hbox2 = audgui_hbox_new (6);
+    gtk_box_pack_start ((GtkBox *) vbox2, hbox2, 0, 0, 0);
+
+    GtkWidget * enable_button = gtk_button_new_with_label (_("Enable"));
+    gtk_box_pack_end ((GtkBox *) hbox2, enable_button, 0, 0, 0);
+
+    vbox2 = audgui_vbox_new (6);
+    gtk_box_pack_start ((GtkBox *) hbox, vbox2, 1, 1, 0);
+
+    label = gtk_label_new (_("Enabled plugins:"));
+    gtk_box_pack_start ((GtkBox *) vbox2, label, 0, 0, 0);
+
+    scrolled = gtk_scrolled_window_new (nullptr, nullptr);
+    gtk_scrolled_window_set_shadow_type ((GtkScrolledWindow *) scrolled, GTK_SHADOW_IN);
+    gtk_box_pack_start ((GtkBox *) vbox2, scrolled, 1, 1, 0);
+
+    loaded_list = create_loaded_list ();
+    gtk_container_add ((GtkContainer *) scrolled, loaded_list);
+
+    hbox2 = audgui_hbox_new (6);
+    gtk_box_pack_start ((GtkBox *) vbox2, hbox2, 0, 0, 0);
+
+    GtkWidget * disable_button = gtk_button_new_with_label (_("Disable"));
+    gtk_box_pack_end ((GtkBox *) hbox2, disable_button, 0, 0, 0);
+
+    GtkWidget * settings_button = gtk_button_new_with_label (_("Settings"));
+    gtk_box_pack_end ((GtkBox *) hbox2, settings_button, 0, 0, 0);
+
+    g_signal_connect (plugin_list, "destroy", (GCallback) gtk_widget_destroyed, & plugin_list);
+    g_signal_connect (enable_button, "clicked", (GCallback) enable_selected, nullptr);
+    g_signal_connect (loaded_list, "destroy", (GCallback) gtk_widget_destroyed, & loaded_list);
+    g_signal_connect (disable_button, "clicked", (GCallback) disable_selected, nullptr);
+    g_signal_connect (settings_button, "clicked", (GCallback) configure_selected, nullptr);
+
+    return vbox;
+}
+
+const char LV2Host::about[] =
+ N_("LV2 Host for Audacious\n"
+    "Copyright 2024 LV2 Host Plugin Authors");
+
+static void pipeline_changed ()
+{
+    pthread_mutex_lock (& mutex);
+
+    pipeline_enabled = aud_get_bool ("lv2", "pipeline");
+    if (! pipeline_enabled)
+        pipeline_stop_locked ();
+
+    pthread_mutex_unlock (& mutex);
+}
+
+const PreferencesWidget LV2Host::widgets[] = {
+    WidgetCustomGTK (make_config_widget),
+    WidgetCheck (N_("Run each plugin on a thread of its own (adds latency)"),
+        WidgetBool ("lv2", "pipeline", pipeline_changed))
+};
+
+const PluginPreferences LV2Host::prefs = {{widgets}};
+
+EXPORT LV2Host aud_plugin_instance;
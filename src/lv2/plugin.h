@@ -0,0 +1,206 @@
+/*
+ * LV2 Host for Audacious
+ * Copyright 2024 LV2 Host Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_LV2_PLUGIN_H
+#define AUD_LV2_PLUGIN_H
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <gtk/gtk.h>
+#include <lilv/lilv.h>
+#include <lv2/worker/worker.h>
+
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/ringbuf.h>
+
+/* Plugins are always run on blocks of exactly this many frames, which lets
+ * us offer the fixed block length that FFT-based plugins ask for. */
+#define LV2_BLOCK 1024
+
+/* buffers are aligned for the widest vector loads */
+#define LV2_ALIGN 64
+
+struct PreferencesWidget;
+
+struct ControlData {
+    int port;
+    String name;
+    bool is_toggle;
+    float min, max, def;
+};
+
+struct PluginData
+{
+    String uri;
+    String name;
+    const LilvPlugin * lilv;
+    Index<ControlData> controls;
+    Index<int> in_ports, out_ports;
+    Index<int> control_outs;    /* connected to scratch values */
+    Index<int> optional_ports;  /* left unconnected */
+    bool in_place_broken = false;
+    bool selected = false;
+
+    PluginData (const char * uri, const char * name, const LilvPlugin * lilv) :
+        uri (uri),
+        name (name),
+        lilv (lilv) {}
+};
+
+/* audio buffers for the ports, allocated once when a plugin is started */
+class AlignedBuffer
+{
+public:
+    AlignedBuffer () {}
+    ~AlignedBuffer ()
+        { free (m_data); }
+
+    AlignedBuffer (const AlignedBuffer &) = delete;
+    void operator= (const AlignedBuffer &) = delete;
+
+    bool alloc (int len);
+    void clear ()
+        { free (m_data); m_data = nullptr; }
+
+    float * operator[] (int block)
+        { return m_data + block * LV2_BLOCK; }
+
+private:
+    float * m_data = nullptr;
+};
+
+/* Runs the non-realtime part of a plugin implementing the worker extension
+ * (file loading, impulse response preparation and the like) on the host's
+ * worker thread instead of the audio thread. */
+struct Worker
+{
+    LV2_Worker_Schedule schedule;
+    LV2_Feature feature;
+    const LV2_Worker_Interface * iface = nullptr;
+    LV2_Handle handle = nullptr;
+    RingBuf<char> requests, responses;
+    Index<char> response;  /* the one being delivered */
+};
+
+struct LoadedPlugin
+{
+    PluginData & plugin;
+    Index<float> values;
+    Index<float> control_outs;
+    bool selected = false;
+    bool active = false;
+    Index<LilvInstance *> instances;
+    Index<SmartPtr<Worker>> workers;
+    AlignedBuffer out_bufs;  /* if the plugin cannot run in place */
+    GtkWidget * settings_win = nullptr;
+
+    LoadedPlugin (PluginData & plugin) :
+        plugin (plugin) {}
+};
+
+class LV2Host : public EffectPlugin
+{
+public:
+    static const char about[];
+    static const char * const defaults[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
+
+    static constexpr PluginInfo info = {
+        N_("LV2 Host"),
+        PACKAGE,
+        about,
+        & prefs
+    };
+
+    constexpr LV2Host () : EffectPlugin (info, 0, true) {}
+
+    bool init () override;
+    void cleanup () override;
+
+    void start (int & channels, int & rate) override;
+    Index<float> & process (Index<float> & data) override;
+    bool flush (bool force) override;
+    Index<float> & finish (Index<float> & data, bool end_of_playlist) override;
+    int adjust_delay (int delay) override;
+};
+
+/* plugin.cc */
+
+/* The mutex needs to be locked when the main thread is writing to the data
+ * structures below (but not when it is only reading from them) and when the
+ * audio thread is reading from them. */
+
+extern pthread_mutex_t mutex;
+extern LilvWorld * world;
+extern Index<SmartPtr<PluginData>> plugins;
+extern Index<SmartPtr<LoadedPlugin>> loadeds;
+
+extern GtkWidget * plugin_list;
+extern GtkWidget * loaded_list;
+
+LoadedPlugin & enable_plugin_locked (PluginData & plugin);
+void disable_plugin_locked (LoadedPlugin & loaded);
+
+/* features.cc */
+
+void features_init ();
+void features_cleanup ();
+
+/* fills in the null-terminated feature list for a new instance */
+void get_features (Worker & worker, Index<const LV2_Feature *> & features);
+bool feature_supported (const char * uri);
+
+/* worker.cc */
+
+void worker_init ();
+void worker_cleanup ();
+
+/* before instantiation, so the plugin can be given the schedule feature */
+void worker_setup (Worker & worker);
+
+/* after instantiation, if the plugin has the worker interface */
+void worker_attach (Worker & worker, LilvInstance * instance);
+void worker_detach (Worker & worker);
+
+/* hands the responses of finished work to the plugin (audio thread) */
+void worker_deliver (Worker & worker);
+
+/* effect.cc */
+
+extern bool pipeline_enabled;
+
+void shutdown_plugin_locked (LoadedPlugin & loaded);
+
+/* must be called before the chain changes; blocks still in the pipeline
+ * come out with the next output */
+void pipeline_stop_locked ();
+
+/* plugin-list.cc */
+
+GtkWidget * create_plugin_list ();
+void update_plugin_list (GtkWidget * list);
+
+/* loaded-list.cc */
+
+GtkWidget * create_loaded_list ();
+void update_loaded_list (GtkWidget * list);
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * LV2 Host for Audacious
+ * Copyright 2024 LV2 Host Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <libaudcore/runtime.h>
+
+#include "plugin.h"
+
+/* Messages in either direction are a uint32_t size followed by the data.
+ * The audio thread holds worker_mutex only long enough to copy a message
+ * in or out; the work itself runs with the lock released. */
+#define QUEUE_SIZE 65536
+
+static pthread_mutex_t worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t worker_thread;
+static bool worker_running, worker_quit;
+
+static Index<Worker *> workers;
+static Worker * busy_worker;  /* whose work is running now */
+
+static bool queue_message (RingBuf<char> & queue, uint32_t size, const void * data)
+{
+    if ((uint32_t) queue.space () < sizeof size + size)
+        return false;
+
+    queue.copy_in ((const char *) & size, sizeof size);
+    queue.copy_in ((const char *) data, size);
+    return true;
+}
+
+static bool take_message (RingBuf<char> & queue, Index<char> & data)
+{
+    uint32_t size;
+    if (queue.len () < (int) sizeof size)
+        return false;
+
+    queue.move_out ((char *) & size, sizeof size);
+    data.resize (size);
+    queue.move_out (data.begin (), size);
+    return true;
+}
+
+/* called by the plugin during run() */
+static LV2_Worker_Status schedule_work (LV2_Worker_Schedule_Handle handle,
+ uint32_t size, const void * data)
+{
+    auto worker = (Worker *) handle;
+
+    pthread_mutex_lock (& worker_mutex);
+    bool queued = queue_message (worker->requests, size, data);
+    pthread_cond_signal (& worker_cond);
+    pthread_mutex_unlock (& worker_mutex);
+
+    return queued ? LV2_WORKER_SUCCESS : LV2_WORKER_ERR_NO_SPACE;
+}
+
+/* called by the plugin during work() */
+static LV2_Worker_Status respond (LV2_Worker_Respond_Handle handle,
+ uint32_t size, const void * data)
+{
+    auto worker = (Worker *) handle;
+
+    pthread_mutex_lock (& worker_mutex);
+    bool queued = queue_message (worker->responses, size, data);
+    pthread_mutex_unlock (& worker_mutex);
+
+    return queued ? LV2_WORKER_SUCCESS : LV2_WORKER_ERR_NO_SPACE;
+}
+
+static void * worker_main (void *)
+{
+    Index<char> message;
+
+    pthread_mutex_lock (& worker_mutex);
+
+    while (! worker_quit)
+    {
+        busy_worker = nullptr;
+
+        for (Worker * worker : workers)
+        {
+            if (take_message (worker->requests, message))
+            {
+                busy_worker = worker;
+                break;
+            }
+        }
+
+        if (! busy_worker)
+        {
+            pthread_cond_wait (& worker_cond, & worker_mutex);
+            continue;
+        }
+
+        Worker * worker = busy_worker;
+        pthread_mutex_unlock (& worker_mutex);
+
+        worker->iface->work (worker->handle, respond, worker, message.len (), message.begin ());
+
+        pthread_mutex_lock (& worker_mutex);
+        busy_worker = nullptr;
+        pthread_cond_broadcast (& worker_cond);
+    }
+
+    pthread_mutex_unlock (& worker_mutex);
+    return nullptr;
+}
+
+void worker_init ()
+{
+    worker_quit = false;
+    worker_running = ! pthread_create (& worker_thread, nullptr, worker_main, nullptr);
+
+    if (! worker_running)
+        AUDERR ("Failed to start the worker thread.\n");
+}
+
+void worker_cleanup ()
+{
+    if (! worker_running)
+        return;
+
+    pthread_mutex_lock (& worker_mutex);
+    worker_quit = true;
+    pthread_cond_broadcast (& worker_cond);
+    pthread_mutex_unlock (& worker_mutex);
+
+    pthread_join (worker_thread, nullptr);
+    worker_running = false;
+}
+
+void worker_setup (Worker & worker)
+{
+    worker.schedule = {& worker, schedule_work};
+    worker.feature = {LV2_WORKER__schedule, & worker.schedule};
+}
+
+void worker_attach (Worker & worker, LilvInstance * instance)
+{
+    auto iface = (const LV2_Worker_Interface *)
+     lilv_instance_get_extension_data (instance, LV2_WORKER__interface);
+
+    if (! iface || ! iface->work || ! worker_running)
+        return;
+
+    pthread_mutex_lock (& worker_mutex);
+
+    worker.iface = iface;
+    worker.handle = lilv_instance_get_handle (instance);
+    worker.requests.alloc (QUEUE_SIZE);
+    worker.responses.alloc (QUEUE_SIZE);
+    workers.append (& worker);
+
+    pthread_mutex_unlock (& worker_mutex);
+}
+
+void worker_detach (Worker & worker)
+{
+    if (! worker.iface)
+        return;
+
+    pthread_mutex_lock (& worker_mutex);
+
+    /* let work already started on this instance finish */
+    while (busy_worker == & worker)
+        pthread_cond_wait (& worker_cond, & worker_mutex);
+
+    for (int i = 0; i < workers.len (); i ++)
+    {
+        if (workers[i] == & worker)
+        {
+            workers.remove (i, 1);
+            break;
+        }
+    }
+
+    worker.requests.destroy ();
+    worker.responses.destroy ();
+    worker.iface = nullptr;
+
+    pthread_mutex_unlock (& worker_mutex);
+}
+
+void worker_deliver (Worker & worker)
+{
+    if (! worker.iface)
+        return;
+
+    Index<char> & message = worker.response;
+
+    for (;;)
+    {
+        pthread_mutex_lock (& worker_mutex);
+        bool taken = take_message (worker.responses, message);
+        pthread_mutex_unlock (& worker_mutex);
+
+        if (! taken)
+            break;
+
+        if (worker.iface->work_response)
+            worker.iface->work_response (worker.handle, message.len (), message.begin ());
+    }
+
+    if (worker.iface->end_run)
+        worker.iface->end_run (worker.handle);
+}
@@ -18,52 +18,13 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <errno.h>
 #include <string.h>
 
-#include <glib/gstdio.h>
-
 #include "lyrics.h"
-#include "preferences.h"
 
 void FileProvider::cache (LyricsState state)
 {
-    auto uri = cache_uri_for_entry (state);
-    if (! uri)
-        return;
-
-    bool exists = VFSFile::test_file (uri, VFS_IS_REGULAR);
-    if (exists)
-        return;
-
-    AUDINFO ("Add to cache: %s\n", (const char *) uri);
-    VFSFile::write_file (uri, state.lyrics, strlen (state.lyrics));
-}
-
-#ifdef S_IRGRP
-#define DIRMODE (S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH)
-#else
-#define DIRMODE (S_IRWXU)
-#endif
-
-String FileProvider::cache_uri_for_entry (LyricsState state)
-{
-    if (! state.artist)
-        return String ();
-
-    auto user_dir = aud_get_path (AudPath::UserDir);
-    StringBuf base_path = filename_build ({user_dir, "lyrics"});
-    StringBuf artist_path = filename_build ({base_path, state.artist});
-
-    if (aud_get_bool (CFG_SECTION, "enable-cache"))
-    {
-        if (g_mkdir_with_parents (artist_path, DIRMODE) < 0)
-            AUDERR ("Failed to create '%s': %s\n", (const char *) artist_path, strerror (errno));
-    }
-
-    StringBuf title_path = str_concat ({filename_build({artist_path, state.title}), ".lrc"});
-
-    return String (filename_to_uri (title_path));
+    lyrics_cache.add (state);
 }
 
 String FileProvider::local_uri_for_entry (LyricsState state)
@@ -101,21 +62,23 @@ void FileProvider::fetch (LyricsState state)
     persist_state (state);
 }
 
-void FileProvider::cache_fetch (LyricsState state)
+bool FileProvider::cache_fetch (LyricsState state)
 {
-    String path = cache_uri_for_entry (state);
-    if (! path)
-        return;
-
-    auto data = VFSFile::read_file (path, VFS_APPEND_NULL);
-    if (! data.len ())
-        return;
+    state.lyrics = lyrics_cache.lookup (state);
+    if (! state.lyrics)
+        return false;
 
-    state.lyrics = String (data.begin ());
     state.source = LyricsState::Source::Local;
 
     update_lyrics_window (state.title, state.artist, state.lyrics);
     persist_state (state);
+    return true;
+}
+
+bool FileProvider::has_local_file (LyricsState state)
+{
+    String path = local_uri_for_entry (state);
+    return path && VFSFile::test_file (path, VFS_IS_REGULAR);
 }
 
 bool FileProvider::match (LyricsState state)
@@ -128,20 +91,7 @@ bool FileProvider::match (LyricsState state)
 
     bool exists = VFSFile::test_file (path, VFS_IS_REGULAR);
     if (exists)
-    {
         fetch (state);
-        return true;
-    }
-
-    path = cache_uri_for_entry (state);
-    if (! path)
-        return false;
-
-    AUDINFO ("Checking for cache lyric file: '%s'\n", (const char *) path);
-
-    exists = VFSFile::test_file (path, VFS_IS_REGULAR);
-    if (exists)
-        cache_fetch (state);
 
     return exists;
 }
@@ -20,6 +20,15 @@
 
 #include "lyrics.h"
 
+StringBuf LrcLibProvider::fetch_uri (LyricsState state)
+{
+    auto artist = str_encode_percent (state.artist, -1);
+    auto title = str_encode_percent (state.title, -1);
+
+    return str_concat(
+        {m_base_url, "/api/get?artist_name=", artist, "&track_name=", title});
+}
+
 bool LrcLibProvider::match (LyricsState state)
 {
     fetch (state);
@@ -57,15 +66,22 @@ void LrcLibProvider::fetch (LyricsState state)
         persist_state (new_state);
     };
 
-    auto artist = str_copy (state.artist);
-    artist = str_encode_percent (state.artist, -1);
+    http_fetch (fetch_uri (state), handle_result_cb);
+    update_lyrics_window_message (state, _("Looking for lyrics ..."));
+}
 
-    auto title = str_copy (state.title);
-    title = str_encode_percent (state.title, -1);
+bool LrcLibProvider::prefetch (LyricsState state, PrefetchFunc done)
+{
+    auto handle_result_cb = [=] (const char * uri, const Index<char> & buf) {
+        LyricsState new_state = state;
 
-    auto fetch_uri = str_concat(
-        {m_base_url, "/api/get?artist_name=", artist, "&track_name=", title});
+        if (! buf.len () || ! try_parse_json (buf, "plainLyrics", new_state.lyrics))
+            new_state.lyrics = String ();
 
-    vfs_async_file_get_contents (fetch_uri, handle_result_cb);
-    update_lyrics_window_message (state, _("Looking for lyrics ..."));
+        new_state.source = LyricsState::Source::LrcLib;
+        done (new_state);
+    };
+
+    http_fetch (fetch_uri (state), handle_result_cb);
+    return true;
 }
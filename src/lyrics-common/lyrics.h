@@ -22,14 +22,20 @@
 #ifndef AUDACIOUS_LYRICS_H
 #define AUDACIOUS_LYRICS_H
 
+#include <stdint.h>
+#include <stdio.h>
+
 #define AUD_GLIB_INTEGRATION
 #include <libaudcore/audstrings.h>
 #include <libaudcore/drct.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/multihash.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/vfs.h>
 #include <libaudcore/vfs_async.h>
 
+#include "../vfs-common/http-fetch.h"
+
 struct LyricsState {
     String filename; // of song file
     String title, artist;
@@ -47,6 +53,9 @@ struct LyricsState {
 };
 
 
+// called with the state that was prefetched, without lyrics if none were found
+typedef void (* PrefetchFunc) (LyricsState state);
+
 // LyricProvider encapsulates an entire strategy for fetching lyrics,
 // for example from lrclib.net, lyrics.ovh or local storage.
 class LyricProvider
@@ -55,6 +64,44 @@ public:
     virtual bool match (LyricsState state) = 0;
     virtual void fetch (LyricsState state) = 0;
     virtual String edit_uri (LyricsState state) = 0;
+
+    // fetches lyrics without showing them; false if the provider cannot,
+    // in which case done is not called
+    virtual bool prefetch (LyricsState state, PrefetchFunc done) { return false; }
+};
+
+
+// LyricsCache keeps fetched lyrics in a single file in the user directory.
+// Where each song's lyrics are in the file is held in memory, so a lookup
+// is one read.  When the file grows too big, the lyrics used longest ago
+// are dropped.
+class LyricsCache
+{
+public:
+    struct Entry {
+        int64_t offset;
+        uint32_t length;
+        uint32_t used;
+    };
+
+    bool contains (LyricsState state);
+    String lookup (LyricsState state);
+    void add (LyricsState state);
+    void cleanup ();
+
+private:
+    bool open ();
+    void close ();
+    bool start_file (const char * path);
+    bool append (const char * key, const char * lyrics);
+    void compact ();
+
+    FILE * m_file = nullptr;
+    bool m_tried = false;
+    bool m_legacy = false;
+    SimpleHash<String, Entry> m_entries;
+    int64_t m_size = 0, m_live = 0;
+    uint32_t m_clock = 0;
 };
 
 
@@ -71,11 +118,11 @@ public:
 
     void save (LyricsState state);
     void cache (LyricsState state);
-    void cache_fetch (LyricsState state);
+    bool cache_fetch (LyricsState state);
+    bool has_local_file (LyricsState state);
 
 private:
     String local_uri_for_entry (LyricsState state);
-    String cache_uri_for_entry (LyricsState state);
 };
 
 
@@ -88,8 +135,11 @@ public:
     bool match (LyricsState state) override;
     void fetch (LyricsState state) override;
     String edit_uri (LyricsState state) override { return String (); }
+    bool prefetch (LyricsState state, PrefetchFunc done) override;
 
 private:
+    StringBuf fetch_uri (LyricsState state);
+
     const char * m_base_url = "https://lrclib.net";
 };
 
@@ -104,12 +154,16 @@ public:
     bool match (LyricsState state) override;
     void fetch (LyricsState state) override;
     String edit_uri (LyricsState state) override { return String (); }
+    bool prefetch (LyricsState state, PrefetchFunc done) override;
 
 private:
+    StringBuf fetch_uri (LyricsState state);
+
     const char * m_base_url = "https://api.lyrics.ovh";
 };
 
 
+extern LyricsCache lyrics_cache;
 extern FileProvider file_provider;
 extern LrcLibProvider lrclib_provider;
 extern LyricsOVHProvider lyrics_ovh_provider;
@@ -126,5 +180,6 @@ void update_lyrics_window_notfound (LyricsState state);
 bool try_parse_json (const Index<char> & buf, const char * key, String & output);
 
 void lyrics_playback_began ();
+void lyrics_cleanup_common ();
 
 #endif // AUDACIOUS_LYRICS_H
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2026 Audacious Plugins Authors
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "lyrics.h"
+
+// The file is the magic, then one record for each song: a RecordHeader,
+// the key and the lyrics, without terminating nulls.  Records are only ever
+// appended; when the file gets too big, it is written anew with the lyrics
+// used most recently, oldest first, so that the order of the records is
+// also the order in which they were last used.
+#define CACHE_MAGIC "Lyrics cache 1\n"
+
+struct RecordHeader {
+    uint32_t key_len, lyrics_len;
+};
+
+static constexpr int64_t max_live_bytes = 8 << 20;
+static constexpr int max_key_len = 4096;
+
+static StringBuf cache_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "lyrics-cache"});
+}
+
+// where fetched lyrics were cached before, one file for each song
+static StringBuf legacy_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "lyrics"});
+}
+
+static String key_for_state (const LyricsState & state)
+{
+    if (! state.artist || ! state.title)
+        return String ();
+
+    return String (str_concat ({state.artist, "\n", state.title}));
+}
+
+static int64_t record_size (const String & key, const LyricsCache::Entry & entry)
+{
+    return sizeof (RecordHeader) + strlen (key) + entry.length;
+}
+
+bool LyricsCache::start_file (const char * path)
+{
+    m_file = fopen (path, "w+b");
+    if (! m_file || fwrite (CACHE_MAGIC, 1, sizeof CACHE_MAGIC, m_file) != sizeof CACHE_MAGIC)
+    {
+        AUDERR ("Cannot write %s: %s\n", path, strerror (errno));
+        if (m_file)
+            fclose (m_file);
+
+        m_file = nullptr;
+        return false;
+    }
+
+    fflush (m_file);
+    m_size = sizeof CACHE_MAGIC;
+    return true;
+}
+
+// reads the keys of all records, skipping over the lyrics
+bool LyricsCache::open ()
+{
+    if (m_tried)
+        return m_file != nullptr;
+
+    m_tried = true;
+    m_legacy = VFSFile::test_file (filename_to_uri (legacy_path ()), VFS_IS_DIR);
+
+    StringBuf path = cache_path ();
+    m_file = fopen (path, "a+b");
+    if (! m_file)
+        return start_file (path);
+
+    char magic[sizeof CACHE_MAGIC];
+    if (fseek (m_file, 0, SEEK_SET) < 0 ||
+        fread (magic, 1, sizeof magic, m_file) != sizeof magic ||
+        memcmp (magic, CACHE_MAGIC, sizeof magic))
+    {
+        fclose (m_file);
+        return start_file (path);
+    }
+
+    int64_t offset = sizeof CACHE_MAGIC;
+    bool truncated = false;
+    char key[max_key_len + 1];
+    RecordHeader header;
+
+    while (fread (& header, sizeof header, 1, m_file) == 1)
+    {
+        if (! header.key_len || header.key_len > max_key_len ||
+            fread (key, 1, header.key_len, m_file) != header.key_len ||
+            fseek (m_file, header.lyrics_len, SEEK_CUR) < 0)
+        {
+            truncated = true;
+            break;
+        }
+
+        key[header.key_len] = 0;
+        String name (key);
+        Entry entry = {offset + (int64_t) sizeof header + header.key_len,
+                       header.lyrics_len, ++ m_clock};
+
+        Entry * old = m_entries.lookup (name);
+        if (old)
+            m_live -= record_size (name, * old);
+
+        m_entries.add (name, std::move (entry));
+        m_live += sizeof header + header.key_len + header.lyrics_len;
+        offset += sizeof header + header.key_len + header.lyrics_len;
+    }
+
+    // fseek() past the end of the file does not fail
+    if (fseek (m_file, 0, SEEK_END) < 0 || ftell (m_file) != offset)
+        truncated = true;
+
+    m_size = offset;
+
+    AUDINFO ("Lyrics cache: %d songs.\n", m_entries.n_items ());
+
+    // a write was cut short; write what can be read into a new file
+    if (truncated)
+        compact ();
+
+    return m_file != nullptr;
+}
+
+void LyricsCache::close ()
+{
+    if (m_file)
+        fclose (m_file);
+
+    m_file = nullptr;
+    m_entries.clear ();
+    m_size = m_live = 0;
+    m_clock = 0;
+}
+
+void LyricsCache::cleanup ()
+{
+    close ();
+    m_tried = false;
+}
+
+static bool read_lyrics (FILE * file, const LyricsCache::Entry & entry, Index<char> & buf)
+{
+    buf.resize (entry.length + 1);
+
+    if (fseek (file, entry.offset, SEEK_SET) < 0 ||
+        fread (buf.begin (), 1, entry.length, file) != entry.length)
+        return false;
+
+    buf[entry.length] = 0;
+    return true;
+}
+
+bool LyricsCache::append (const char * key, const char * lyrics)
+{
+    RecordHeader header = {(uint32_t) strlen (key), (uint32_t) strlen (lyrics)};
+
+    if (header.key_len > max_key_len || fseek (m_file, 0, SEEK_END) < 0 ||
+        fwrite (& header, sizeof header, 1, m_file) != 1 ||
+        fwrite (key, 1, header.key_len, m_file) != header.key_len ||
+        fwrite (lyrics, 1, header.lyrics_len, m_file) != header.lyrics_len ||
+        fflush (m_file) < 0)
+    {
+        AUDERR ("Cannot write lyrics cache: %s\n", strerror (errno));
+        return false;
+    }
+
+    Entry entry = {m_size + (int64_t) sizeof header + header.key_len,
+                   header.lyrics_len, ++ m_clock};
+
+    m_entries.add (String (key), std::move (entry));
+    m_size += sizeof header + header.key_len + header.lyrics_len;
+    m_live += sizeof header + header.key_len + header.lyrics_len;
+    return true;
+}
+
+struct KeptEntry {
+    String key;
+    LyricsCache::Entry entry;
+};
+
+static int compare_used (const KeptEntry & a, const KeptEntry & b)
+{
+    return (a.entry.used > b.entry.used) - (a.entry.used < b.entry.used);
+}
+
+// writes the lyrics used most recently, up to 3/4 of the limit, to a new
+// file, which then replaces the old one
+void LyricsCache::compact ()
+{
+    Index<KeptEntry> kept;
+    m_entries.iterate ([&] (const String & key, Entry & entry) {
+        kept.append (KeptEntry {key, entry});
+    });
+
+    kept.sort (compare_used);
+
+    int first = kept.len ();
+    int64_t bytes = 0;
+
+    while (first > 0 && bytes + record_size (kept[first - 1].key,
+           kept[first - 1].entry) <= max_live_bytes * 3 / 4)
+    {
+        first --;
+        bytes += record_size (kept[first].key, kept[first].entry);
+    }
+
+    StringBuf path = cache_path ();
+    StringBuf temp = str_concat ({path, ".tmp"});
+    FILE * old = m_file;
+
+    m_file = nullptr;
+    m_entries.clear ();
+    m_live = 0;
+
+    if (! start_file (temp))
+    {
+        // go on with the old file as it is
+        m_file = old;
+        fseek (m_file, 0, SEEK_END);
+        m_size = ftell (m_file);
+
+        for (KeptEntry & item : kept)
+        {
+            m_live += record_size (item.key, item.entry);
+            m_entries.add (item.key, std::move (item.entry));
+        }
+
+        return;
+    }
+
+    Index<char> buf;
+    bool failed = false;
+
+    for (int i = first; i < kept.len () && ! failed; i ++)
+    {
+        if (read_lyrics (old, kept[i].entry, buf) && ! append (kept[i].key, buf.begin ()))
+            failed = true;
+    }
+
+    fclose (old);
+
+    if (failed || fflush (m_file) < 0 || rename (temp, path) < 0)
+    {
+        AUDERR ("Cannot write %s: %s\n", (const char *) path, strerror (errno));
+        close ();
+        remove (temp);
+        start_file (path);
+        return;
+    }
+
+    AUDINFO ("Lyrics cache compacted: kept %d of %d songs.\n",
+             m_entries.n_items (), kept.len ());
+}
+
+bool LyricsCache::contains (LyricsState state)
+{
+    String key = key_for_state (state);
+    return key && open () && m_entries.lookup (key);
+}
+
+String LyricsCache::lookup (LyricsState state)
+{
+    String key = key_for_state (state);
+    if (! key || ! open ())
+        return String ();
+
+    Entry * entry = m_entries.lookup (key);
+    if (entry)
+    {
+        Index<char> buf;
+        if (! read_lyrics (m_file, * entry, buf))
+            return String ();
+
+        entry->used = ++ m_clock;
+        return String (buf.begin ());
+    }
+
+    if (! m_legacy)
+        return String ();
+
+    StringBuf artist_path = filename_build ({legacy_path (), state.artist});
+    StringBuf title_path = str_concat ({filename_build ({artist_path, state.title}), ".lrc"});
+
+    auto data = VFSFile::read_file (filename_to_uri (title_path), VFS_APPEND_NULL);
+    if (! data.len () || ! data[0])
+        return String ();
+
+    // move it into the single file, where it is found next time
+    AUDINFO ("Moving to cache: %s\n", (const char *) title_path);
+    append (key, data.begin ());
+
+    return String (data.begin ());
+}
+
+void LyricsCache::add (LyricsState state)
+{
+    String key = key_for_state (state);
+    if (! key || ! state.lyrics || ! open () || m_entries.lookup (key))
+        return;
+
+    AUDINFO ("Add to cache: %s\n", (const char *) key);
+
+    if (append (key, state.lyrics) && m_live > max_live_bytes)
+        compact ();
+}
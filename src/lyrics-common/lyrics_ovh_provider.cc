@@ -21,6 +21,14 @@
 
 #include "lyrics.h"
 
+StringBuf LyricsOVHProvider::fetch_uri (LyricsState state)
+{
+    auto artist = str_encode_percent (state.artist, -1);
+    auto title = str_encode_percent (state.title, -1);
+
+    return str_concat ({m_base_url, "/v1/", artist, "/", title});
+}
+
 bool LyricsOVHProvider::match (LyricsState state)
 {
     fetch (state);
@@ -58,14 +66,22 @@ void LyricsOVHProvider::fetch (LyricsState state)
         persist_state (new_state);
     };
 
-    auto artist = str_copy (state.artist);
-    artist = str_encode_percent (state.artist, -1);
+    http_fetch (fetch_uri (state), handle_result_cb);
+    update_lyrics_window_message (state, _("Looking for lyrics ..."));
+}
 
-    auto title = str_copy (state.title);
-    title = str_encode_percent (state.title, -1);
+bool LyricsOVHProvider::prefetch (LyricsState state, PrefetchFunc done)
+{
+    auto handle_result_cb = [=] (const char * uri, const Index<char> & buf) {
+        LyricsState new_state = state;
 
-    auto fetch_uri = str_concat ({m_base_url, "/v1/", artist, "/", title});
+        if (! buf.len () || ! try_parse_json (buf, "lyrics", new_state.lyrics))
+            new_state.lyrics = String ();
 
-    vfs_async_file_get_contents (fetch_uri, handle_result_cb);
-    update_lyrics_window_message (state, _("Looking for lyrics ..."));
+        new_state.source = LyricsState::Source::LyricsOVH;
+        done (new_state);
+    };
+
+    http_fetch (fetch_uri (state), handle_result_cb);
+    return true;
 }
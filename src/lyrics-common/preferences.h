@@ -31,6 +31,7 @@ static const char * const defaults[] = {
     "remote-source", "lyrics.ovh",
     "enable-file-provider", "TRUE",
     "enable-cache", "TRUE",
+    "prefetch-count", "2",
     "split-title-on-chars", "FALSE",
     "split-on-chars", "-",
     "truncate-fields-on-chars", "FALSE",
@@ -71,6 +72,9 @@ static const PreferencesWidget widgets[] = {
         {{remote_sources}}),
     WidgetCheck (N_("Store fetched lyrics in local cache"),
         WidgetBool (CFG_SECTION, "enable-cache")),
+    WidgetSpin (N_("Fetch lyrics of upcoming songs:"),
+        WidgetInt (CFG_SECTION, "prefetch-count"),
+        {0, 10, 1}),
     WidgetLabel (N_("<b>Local Storage</b>")),
     WidgetCheck (N_("Load lyric files (.lrc) from local storage"),
         WidgetBool (CFG_SECTION, "enable-file-provider"))
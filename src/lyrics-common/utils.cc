@@ -21,6 +21,9 @@
 
 #include <string.h>
 
+#include <libaudcore/mainloop.h>
+#include <libaudcore/playlist.h>
+
 #include "lyrics.h"
 #include "preferences.h"
 
@@ -71,7 +74,7 @@ static char * truncate_by_pattern (const char * input, const char * pattern)
     return result;
 }
 
-static void split_title_and_truncate ()
+static void split_title_and_truncate (LyricsState & state)
 {
     StringBuf split_pattern = str_concat ({
         "^(.*)\\s+[", aud_get_str (CFG_SECTION, "split-on-chars"), "]\\s+(.*)$"
@@ -80,7 +83,7 @@ static void split_title_and_truncate ()
     GMatchInfo * match_info;
     GRegex * split_regex = g_regex_new (split_pattern, G_REGEX_CASELESS, (GRegexMatchFlags) 0, nullptr);
 
-    if (g_regex_match (split_regex, g_state.title, (GRegexMatchFlags) 0, & match_info))
+    if (g_regex_match (split_regex, state.title, (GRegexMatchFlags) 0, & match_info))
     {
         CharPtr artist (g_match_info_fetch (match_info, 1));
         CharPtr title (g_match_info_fetch (match_info, 2));
@@ -99,20 +102,126 @@ static void split_title_and_truncate ()
             title = CharPtr (truncate_by_pattern (title, title_pattern));
         }
 
-        g_state.artist = String ();
-        g_state.title = String ();
-        g_state.artist = String (artist);
-        g_state.title = String (title);
+        state.artist = String ();
+        state.title = String ();
+        state.artist = String (artist);
+        state.title = String (title);
     }
 
     g_match_info_free (match_info);
     g_regex_unref (split_regex);
 }
 
+// Lyrics of the songs coming up are fetched into the cache one at a time,
+// after a pause, so that they do not hold up the fetch for the song playing.
+static constexpr int prefetch_delay = 3000;
+
+static Index<LyricsState> prefetch_queue;
+static QueuedFunc prefetch_timer;
+static bool prefetch_busy;
+
+static void prefetch_next (void * = nullptr);
+
+static void prefetch_done (LyricsState state)
+{
+    prefetch_busy = false;
+
+    if (state.lyrics && state.lyrics[0])
+        file_provider.cache (state);
+
+    if (prefetch_queue.len ())
+        prefetch_timer.queue (prefetch_delay, prefetch_next, nullptr);
+}
+
+static void prefetch_next (void *)
+{
+    LyricProvider * remote_provider = remote_source ();
+
+    while (! prefetch_busy && prefetch_queue.len ())
+    {
+        LyricsState state = std::move (prefetch_queue[0]);
+        prefetch_queue.remove (0, 1);
+
+        if (! remote_provider || lyrics_cache.contains (state) ||
+            (aud_get_bool (CFG_SECTION, "enable-file-provider") &&
+             file_provider.has_local_file (state)))
+            continue;
+
+        AUDDBG ("Prefetching lyrics: %s - %s\n", (const char *) state.artist,
+                (const char *) state.title);
+
+        prefetch_busy = remote_provider->prefetch (state, prefetch_done);
+    }
+}
+
+static void queue_prefetch ()
+{
+    prefetch_queue.clear ();
+
+    int count = aud_get_int (CFG_SECTION, "prefetch-count");
+
+    // which song comes next is not known when shuffling
+    if (count <= 0 || aud_get_bool ("shuffle") ||
+        ! aud_get_bool (CFG_SECTION, "enable-cache") || ! remote_source ())
+        return;
+
+    Playlist playlist = Playlist::playing_playlist ();
+    int n_entries = playlist.n_entries ();
+    int entry = playlist.get_position ();
+
+    for (int i = 0; entry >= 0 && i < count && i < n_entries - 1; i ++)
+    {
+        if (++ entry == n_entries)
+        {
+            if (! aud_get_bool ("repeat"))
+                break;
+
+            entry = 0;
+        }
+
+        // songs that have not been scanned yet are skipped, not scanned
+        Tuple tuple = playlist.entry_tuple (entry, Playlist::NoWait);
+
+        if (aud_get_bool (CFG_SECTION, "use-embedded"))
+        {
+            String embedded_lyrics = tuple.get_str (Tuple::Lyrics);
+            if (embedded_lyrics && embedded_lyrics[0])
+                continue;
+        }
+
+        LyricsState state;
+        state.filename = playlist.entry_filename (entry);
+        state.title = tuple.get_str (Tuple::Title);
+        state.artist = tuple.get_str (Tuple::Artist);
+
+        if (aud_get_bool (CFG_SECTION, "split-title-on-chars"))
+            split_title_and_truncate (state);
+
+        if (state.artist && state.title && ! lyrics_cache.contains (state))
+            prefetch_queue.append (std::move (state));
+    }
+
+    // one that is being fetched goes on with the new queue when it is done
+    if (prefetch_queue.len () && ! prefetch_busy)
+        prefetch_timer.queue (prefetch_delay, prefetch_next, nullptr);
+}
+
+void lyrics_cleanup_common ()
+{
+    prefetch_timer.stop ();
+    prefetch_queue.clear ();
+    prefetch_busy = false;
+
+    http_fetch_cleanup ();
+    lyrics_cache.cleanup ();
+}
+
 void lyrics_playback_began ()
 {
     // FIXME: Cancel previous VFS requests (not possible with current API)
 
+    queue_prefetch ();
+
     g_state.filename = aud_drct_get_filename ();
 
     Tuple tuple = aud_drct_get_tuple ();
@@ -135,9 +244,10 @@ void lyrics_playback_began ()
     }
 
     if (aud_get_bool (CFG_SECTION, "split-title-on-chars"))
-        split_title_and_truncate ();
+        split_title_and_truncate (g_state);
 
-    if (! aud_get_bool (CFG_SECTION, "enable-file-provider") || ! file_provider.match (g_state))
+    if (! (aud_get_bool (CFG_SECTION, "enable-file-provider") && file_provider.match (g_state)) &&
+        ! file_provider.cache_fetch (g_state))
     {
         if (! g_state.artist || ! g_state.title)
         {
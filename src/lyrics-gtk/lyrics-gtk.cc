@@ -51,6 +51,7 @@ EXPORT LyricsGtk aud_plugin_instance;
 
 const PluginPreferences LyricsGtk::prefs = {{widgets}};
 
+LyricsCache lyrics_cache;
 FileProvider file_provider;
 LrcLibProvider lrclib_provider;
 LyricsOVHProvider lyrics_ovh_provider;
@@ -124,6 +125,7 @@ static void destroy_cb ()
 
     hook_dissociate ("tuple change", (HookFunction) lyrics_playback_began);
     hook_dissociate ("playback ready", (HookFunction) lyrics_playback_began);
+    lyrics_cleanup_common ();
 
     textview = nullptr;
     textbuffer = nullptr;
@@ -64,6 +64,7 @@ EXPORT LyricsQt aud_plugin_instance;
 
 const PluginPreferences LyricsQt::prefs = {{widgets}};
 
+LyricsCache lyrics_cache;
 FileProvider file_provider;
 LrcLibProvider lrclib_provider;
 LyricsOVHProvider lyrics_ovh_provider;
@@ -126,6 +127,7 @@ static void lyrics_cleanup (QObject * object = nullptr)
 
     hook_dissociate ("tuple change", (HookFunction) lyrics_playback_began);
     hook_dissociate ("playback ready", (HookFunction) lyrics_playback_began);
+    lyrics_cleanup_common ();
 
     textedit = nullptr;
 }
@@ -2,6 +2,7 @@
  * Audacious: A cross-platform multimedia player
  * Copyright (c) 2006-2010 William Pitcock, Tony Vroon, George Averill, Giacomo
  *  Lozito, Derek Pomery and Yoshiki Yazawa, and John Lindgren.
+ * Copyright 2024 Audacious Plugins Authors
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -18,6 +19,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <libaudcore/audstrings.h>
@@ -56,6 +58,41 @@ static char * split_line (char * line)
     return feed + 1;
 }
 
+/* "#EXTINF:<seconds>[ <attributes>],<title>" gives a stream a name, which
+ * is kept so that it need not be connected to when the playlist is loaded;
+ * a local file is still read for its own tags */
+static Tuple extinf_tuple (const char * extinf, const char * uri)
+{
+    Tuple tuple;
+
+    if (! extinf || ! strncmp (uri, "file://", 7))
+        return tuple;
+
+    /* an attribute value in quotes may have a comma of its own */
+    const char * title = extinf;
+    bool quoted = false;
+
+    while (* title && (quoted || * title != ','))
+    {
+        if (* title == '"')
+            quoted = ! quoted;
+        title ++;
+    }
+
+    if (! title[0] || ! title[1])
+        return tuple;
+
+    tuple.set_filename (uri);
+    tuple.set_str (Tuple::Title, title + 1);
+
+    int length = atoi (extinf);
+    if (length > 0)
+        tuple.set_int (Tuple::Length, length * 1000);
+
+    tuple.set_state (Tuple::Valid);
+    return tuple;
+}
+
 bool M3ULoader::load (const char * filename, VFSFile & file, String & title,
  Index<PlaylistAddItem> & items)
 {
@@ -67,6 +104,7 @@ bool M3ULoader::load (const char * filename, VFSFile & file, String & title,
 
     bool firstline = true;
     bool extm3u = false;
+    const char * extinf = nullptr;
 
     char * parse = text.begin ();
     if (! strncmp (parse, "\xef\xbb\xbf", 3)) /* byte order mark */
@@ -85,12 +123,16 @@ bool M3ULoader::load (const char * filename, VFSFile & file, String & title,
                 extm3u = true;
             else if (extm3u && ! strncmp (parse, "#EXT-X-", 7))
                 goto HLS;
+            else if (extm3u && ! strncmp (parse, "#EXTINF:", 8))
+                extinf = parse + 8;
         }
         else if (* parse)
         {
             StringBuf s = uri_construct (parse, filename);
             if (s)
-                items.append (String (s));
+                items.append (String (s), extinf_tuple (extinf, s));
+
+            extinf = nullptr;
         }
 
         firstline = false;
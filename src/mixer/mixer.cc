@@ -17,8 +17,7 @@
  * the use of this software.
  */
 
-/* TODO: implement more surround converters.
-         There should be more options for in * out cases (for example,
+/* TODO: There should be more options for in * out cases (for example,
          the user may wish to mix stereo up to quadro but keep 5.1 as-is,
          rather than downmixing 5.1 to quadro). A possible design might
          be a choice of output channels for each input channel count that
@@ -26,11 +25,14 @@
 
 #include <stdlib.h>
 
+#include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../trace-common/trace.h"
+
 class ChannelMixer : public EffectPlugin
 {
 public:
@@ -140,9 +142,10 @@ static Index<float> & stereo_to_quadro (Index<float> & data)
     return mixer_buf;
 }
 
-static Index<float> & surround_5p1_to_stereo (Index<float> & data)
+/* 5 channels case. Quad + center channel */
+static Index<float> & quadro_5_to_stereo (Index<float> & data)
 {
-    int frames = data.len () / 6;
+    int frames = data.len () / 5;
     mixer_buf.resize (2 * frames);
 
     float * get = data.begin ();
@@ -153,41 +156,188 @@ static Index<float> & surround_5p1_to_stereo (Index<float> & data)
         float front_left  = * get ++;
         float front_right = * get ++;
         float center = * get ++;
-        float lfe    = * get ++;
         float rear_left   = * get ++;
         float rear_right  = * get ++;
-        * set ++ = front_left + (center * 0.5) + (lfe * 0.5) + (rear_left * 0.5);
-        * set ++ = front_right + (center * 0.5) + (lfe * 0.5) + (rear_right * 0.5);
+        * set ++ = front_left + (center * 0.5) + rear_left;
+        * set ++ = front_right + (center * 0.5) + rear_right;
     }
 
     return mixer_buf;
 }
 
-/* 5 channels case. Quad + center channel */
-static Index<float> & quadro_5_to_stereo (Index<float> & data)
+/* Matrix mode: every output channel is a weighted sum of the input
+ * channels.  Channels are in the usual WAVE order: front left, front right,
+ * center, LFE, rear left, rear right, then (7.1) side left and side right. */
+
+enum {
+    LFE_DISCARD,
+    LFE_MIX
+};
+
+static int matrix_in, matrix_out;
+static float matrix[AUD_MAX_CHANNELS * AUD_MAX_CHANNELS];  /* [out][in] */
+
+typedef void (* MixKernel) (const float * get, float * set, int frames);
+
+/* With the channel counts known at compile time, both inner loops are
+ * unrolled and the weights stay in registers; the compiler vectorizes
+ * across the output channels. */
+template<int in, int out>
+static void mix_fixed (const float * __restrict get, float * __restrict set, int frames)
 {
-    int frames = data.len () / 5;
-    mixer_buf.resize (2 * frames);
+    const float * __restrict m = matrix;
 
-    float * get = data.begin ();
-    float * set = mixer_buf.begin ();
+    while (frames --)
+    {
+        for (int o = 0; o < out; o ++)
+        {
+            float sum = 0;
+            for (int i = 0; i < in; i ++)
+                sum += m[o * in + i] * get[i];
+
+            set[o] = sum;
+        }
+
+        get += in;
+        set += out;
+    }
+}
+
+static void mix_any (const float * __restrict get, float * __restrict set, int frames)
+{
+    const float * __restrict m = matrix;
 
     while (frames --)
     {
-        float front_left  = * get ++;
-        float front_right = * get ++;
-        float center = * get ++;
-        float rear_left   = * get ++;
-        float rear_right  = * get ++;
-        * set ++ = front_left + (center * 0.5) + rear_left;
-        * set ++ = front_right + (center * 0.5) + rear_right;
+        for (int o = 0; o < matrix_out; o ++)
+        {
+            float sum = 0;
+            for (int i = 0; i < matrix_in; i ++)
+                sum += m[o * matrix_in + i] * get[i];
+
+            set[o] = sum;
+        }
+
+        get += matrix_in;
+        set += matrix_out;
     }
+}
+
+static const struct {
+    int in, out;
+    MixKernel kernel;
+} mix_kernels[] = {
+    {6, 2, mix_fixed<6, 2>},
+    {8, 2, mix_fixed<8, 2>},
+    {8, 6, mix_fixed<8, 6>},
+    {6, 1, mix_fixed<6, 1>},
+    {8, 1, mix_fixed<8, 1>}
+};
+
+static MixKernel mix_kernel;
+
+static Index<float> & mix_matrix (Index<float> & data)
+{
+    int frames = data.len () / matrix_in;
+    mixer_buf.resize (matrix_out * frames);
+
+    mix_kernel (data.begin (), mixer_buf.begin (), frames);
 
     return mixer_buf;
 }
 
+static void set_weight (int out, int in, float weight)
+{
+    matrix[out * matrix_in + in] = weight;
+}
+
+/* built-in downmixes from 5.1 and 7.1 */
+static bool preset_matrix (int in, int out, int lfe_mode)
+{
+    if ((in != 6 && in != 8) || (out != 1 && out != 2 && ! (in == 8 && out == 6)))
+        return false;
+
+    float lfe = (lfe_mode == LFE_MIX) ? 0.5 : 0;
+
+    if (out == 6)
+    {
+        /* 7.1 to 5.1: fold each side channel into the rear one */
+        for (int c = 0; c < 6; c ++)
+            set_weight (c, c, 1);
+
+        set_weight (4, 6, 0.7);
+        set_weight (5, 7, 0.7);
+        return true;
+    }
+
+    for (int o = 0; o < 2; o ++)
+    {
+        set_weight (o, o, 1);        /* front */
+        set_weight (o, 2, 0.5);      /* center */
+        set_weight (o, 3, lfe);
+        set_weight (o, 4 + o, 0.5);  /* rear */
+
+        if (in == 8)
+            set_weight (o, 6 + o, 0.5);  /* side */
+    }
+
+    if (out == 1)
+    {
+        /* mono: the average of the stereo downmix */
+        for (int i = 0; i < in; i ++)
+            matrix[i] = (matrix[i] + matrix[in + i]) / 2;
+    }
+
+    return true;
+}
+
+/* a user matrix: <out> rows of <in> weights */
+static bool custom_matrix (int in, int out)
+{
+    auto weights = str_list_to_index (aud_get_str ("mixer", "matrix"), " ,;");
+
+    if (weights.len () != in * out)
+        return false;
+
+    for (int i = 0; i < in * out; i ++)
+        matrix[i] = str_to_double (weights[i]);
+
+    return true;
+}
+
+static bool setup_matrix (int in, int out)
+{
+    matrix_in = in;
+    matrix_out = out;
+
+    for (float & weight : matrix)
+        weight = 0;
+
+    bool ok = (aud_get_bool ("mixer", "use_matrix") && custom_matrix (in, out)) ||
+     preset_matrix (in, out, aud_get_int ("mixer", "lfe"));
+
+    if (! ok)
+        return false;
+
+    mix_kernel = mix_any;
+
+    for (auto & k : mix_kernels)
+    {
+        if (k.in == in && k.out == out)
+            mix_kernel = k.kernel;
+    }
+
+    return true;
+}
+
 static Converter get_converter (int in, int out)
 {
+    if (aud_get_bool ("mixer", "use_matrix") || in == 6 || in == 8)
+    {
+        if (setup_matrix (in, out))
+            return mix_matrix;
+    }
+
     if (in == 1 && out == 2)
         return mono_to_stereo;
     if (in == 2 && out == 1)
@@ -198,23 +348,23 @@ static Converter get_converter (int in, int out)
         return quadro_to_stereo;
     if (in == 5 && out == 2)
         return quadro_5_to_stereo;
-    if (in == 6 && out == 2)
-        return surround_5p1_to_stereo;
 
     return nullptr;
 }
 
 static int input_channels, output_channels;
+static Converter converter;
 
 void ChannelMixer::start (int & channels, int & rate)
 {
     input_channels = channels;
     output_channels = aud_get_int ("mixer", "channels");
+    converter = nullptr;
 
     if (input_channels == output_channels)
         return;
 
-    if (! get_converter (input_channels, output_channels))
+    if (! (converter = get_converter (input_channels, output_channels)))
     {
         AUDERR ("Converting %d to %d channels is not implemented.\n",
          input_channels, output_channels);
@@ -226,10 +376,7 @@ void ChannelMixer::start (int & channels, int & rate)
 
 Index<float> & ChannelMixer::process (Index<float> & data)
 {
-    if (input_channels == output_channels)
-        return data;
-
-    Converter converter = get_converter (input_channels, output_channels);
+    TRACE_SPAN ("Channel Mixer process");
     if (converter)
         return converter (data);
 
@@ -238,6 +385,9 @@ Index<float> & ChannelMixer::process (Index<float> & data)
 
 const char * const ChannelMixer::defaults[] = {
  "channels", "2",
+ "lfe", aud::numeric_string<LFE_MIX>::str,
+ "use_matrix", "FALSE",
+ "matrix", "",
   nullptr};
 
 bool ChannelMixer::init ()
@@ -255,11 +405,26 @@ const char ChannelMixer::about[] =
  N_("Channel Mixer Plugin for Audacious\n"
     "Copyright 2011-2012 John Lindgren and Michał Lipski");
 
+static const ComboItem lfe_list[] = {
+    ComboItem (N_("Discard"), LFE_DISCARD),
+    ComboItem (N_("Mix in at half level"), LFE_MIX)
+};
+
 const PreferencesWidget ChannelMixer::widgets[] = {
     WidgetLabel (N_("<b>Channel Mixer</b>")),
     WidgetSpin (N_("Output channels:"),
         WidgetInt ("mixer", "channels"),
-        {1, AUD_MAX_CHANNELS, 1})
+        {1, AUD_MAX_CHANNELS, 1}),
+    WidgetLabel (N_("<b>Surround Downmix</b>")),
+    WidgetCombo (N_("LFE channel:"),
+        WidgetInt ("mixer", "lfe"),
+        {{lfe_list}}),
+    WidgetCheck (N_("Use a custom mixing matrix"),
+        WidgetBool ("mixer", "use_matrix")),
+    WidgetEntry (N_("Weights, one row per output channel:"),
+        WidgetString ("mixer", "matrix"),
+        {false},
+        WIDGET_CHILD)
 };
 
 const PluginPreferences ChannelMixer::prefs = {{widgets}};
@@ -17,34 +17,303 @@
  * the use of this software.
  */
 
+#include <errno.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
 #include <libmms/mms.h>
 #include <libmms/mmsh.h>
 
+#include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
+#define BANDWIDTH (128 * 1024)  /* bits per second asked of the server */
+#define BLOCK_SIZE 4096         /* read from the network at once */
+#define MAX_RETRIES 5           /* reconnections in a row before giving up */
+#define RETRY_DELAY_MS 1000
+#define CONNECT_TIMEOUT_S 10
+#define STOP_TIMEOUT_MS 1000    /* for a read in progress, before it is cut short */
+
 static const char * const mms_schemes[] = {"mms"};
 
 class MMSTransport : public TransportPlugin
 {
 public:
-    static constexpr PluginInfo info = {N_("MMS Plugin"), PACKAGE};
+    static const char * const defaults[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
+
+    static constexpr PluginInfo info = {
+        N_("MMS Plugin"),
+        PACKAGE,
+        nullptr,
+        & prefs
+    };
 
     constexpr MMSTransport () : TransportPlugin (info, mms_schemes) {}
 
+    bool init () override;
+
     VFSImpl * fopen (const char * path, const char * mode, String & error) override;
 };
 
 EXPORT MMSTransport aud_plugin_instance;
 
+const char * const MMSTransport::defaults[] = {
+    "buffer_secs", "10",
+    nullptr
+};
+
+const PreferencesWidget MMSTransport::widgets[] = {
+    WidgetSpin (N_("Read-ahead:"),
+        WidgetInt ("mms", "buffer_secs"),
+        {0, 120, 1, N_("seconds (0 = disabled)")})
+};
+
+const PluginPreferences MMSTransport::prefs = {{widgets}};
+
+bool MMSTransport::init ()
+{
+    aud_config_set_defaults ("mms", defaults);
+    return true;
+}
+
+/* Either protocol, whichever the server speaks.  The socket is opened here
+ * rather than by libmms, so that a read waiting on a server gone quiet can be
+ * cut short from another thread.  Every operation fails while there is no
+ * connection. */
+struct MMSConnection
+{
+    mms_t * mms = nullptr;
+    mmsh_t * mmsh = nullptr;
+
+    MMSConnection ();
+    ~MMSConnection ();
+
+    MMSConnection (const MMSConnection &) = delete;
+    MMSConnection & operator= (const MMSConnection &) = delete;
+
+    bool connect (const char * path);
+    void close ();
+
+    /* from another thread: the read or connection in progress fails, and so
+     * does every connection until reset () */
+    void abort ();
+    bool aborted ();
+    void reset ();
+
+    bool is_open () const
+        { return mms || mmsh; }
+
+    int64_t read (char * buf, int64_t len)
+    {
+        return mms ? mms_read (nullptr, mms, buf, len) :
+         mmsh ? mmsh_read (nullptr, mmsh, buf, len) : -1;
+    }
+
+    int64_t seek (int64_t offset)
+    {
+        return mms ? mms_seek (nullptr, mms, offset, SEEK_SET) :
+         mmsh ? mmsh_seek (nullptr, mmsh, offset, SEEK_SET) : -1;
+    }
+
+    int64_t pos ()
+        { return mms ? mms_get_current_pos (mms) : mmsh ? mmsh_get_current_pos (mmsh) : -1; }
+    int64_t length ()
+        { return mms ? mms_get_length (mms) : mmsh ? mmsh_get_length (mmsh) : -1; }
+    int64_t header_len ()
+        { return mms ? mms_get_asf_header_len (mms) : mmsh ? mmsh_get_asf_header_len (mmsh) : -1; }
+
+private:
+    mms_io_t io;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    int sock = -1;          /* a duplicate of the socket last opened */
+    bool abort_flag = false;
+
+    static int tcp_connect (void * data, const char * host, int port);
+};
+
+MMSConnection::MMSConnection () :
+    io (* mms_get_default_io_impl ())
+{
+    io.connect = tcp_connect;
+    io.connect_data = this;
+}
+
+MMSConnection::~MMSConnection ()
+{
+    close ();
+    pthread_mutex_destroy (& lock);
+}
+
+bool MMSConnection::connect (const char * path)
+{
+    if ((mmsh = mmsh_connect (& io, nullptr, path, BANDWIDTH)))
+        return true;
+
+    if (aborted ())
+        return false;
+
+    AUDDBG ("Failed to connect with MMSH protocol; trying MMS.\n");
+
+    if ((mms = mms_connect (& io, nullptr, path, BANDWIDTH)))
+        return true;
+
+    close ();
+    return false;
+}
+
+void MMSConnection::close ()
+{
+    if (mms)
+        mms_close (mms);
+    if (mmsh)
+        mmsh_close (mmsh);
+
+    mms = nullptr;
+    mmsh = nullptr;
+
+    pthread_mutex_lock (& lock);
+
+    if (sock >= 0)
+        ::close (sock);
+
+    sock = -1;
+    pthread_mutex_unlock (& lock);
+}
+
+/* A socket shut down makes a read waiting on it return at once, whichever
+ * of its copies it is waiting on; holding a copy of our own, we cannot shut
+ * down some other file that happens to get the same number. */
+void MMSConnection::abort ()
+{
+    pthread_mutex_lock (& lock);
+
+    if (sock >= 0)
+        shutdown (sock, SHUT_RDWR);
+
+    abort_flag = true;
+    pthread_mutex_unlock (& lock);
+}
+
+bool MMSConnection::aborted ()
+{
+    pthread_mutex_lock (& lock);
+    bool ret = abort_flag;
+    pthread_mutex_unlock (& lock);
+    return ret;
+}
+
+void MMSConnection::reset ()
+{
+    pthread_mutex_lock (& lock);
+    abort_flag = false;
+    pthread_mutex_unlock (& lock);
+}
+
+/* As libmms does it, but not waiting on an unanswered connection for longer
+ * than CONNECT_TIMEOUT_S */
+int MMSConnection::tcp_connect (void * data, const char * host, int port)
+{
+    auto conn = (MMSConnection *) data;
+
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo * list;
+    if (getaddrinfo (host, int_to_str (port), & hints, & list))
+    {
+        AUDERR ("Cannot resolve %s.\n", host);
+        return -1;
+    }
+
+    int s = -1;
+
+    for (addrinfo * a = list; a && s < 0; a = a->ai_next)
+    {
+        if ((s = socket (a->ai_family, a->ai_socktype, a->ai_protocol)) < 0)
+            continue;
+
+        timeval timeout = {CONNECT_TIMEOUT_S, 0};
+        setsockopt (s, SOL_SOCKET, SO_SNDTIMEO, & timeout, sizeof timeout);
+
+        if (::connect (s, a->ai_addr, a->ai_addrlen) < 0)
+        {
+            ::close (s);
+            s = -1;
+            continue;
+        }
+
+        timeout = {0, 0};
+        setsockopt (s, SOL_SOCKET, SO_SNDTIMEO, & timeout, sizeof timeout);
+    }
+
+    freeaddrinfo (list);
+
+    if (s < 0)
+    {
+        AUDERR ("Cannot connect to %s:%d: %s.\n", host, port, strerror (errno));
+        return -1;
+    }
+
+    pthread_mutex_lock (& conn->lock);
+
+    bool ok = ! conn->abort_flag;
+    if (ok)
+    {
+        if (conn->sock >= 0)
+            ::close (conn->sock);
+
+        conn->sock = dup (s);
+    }
+
+    pthread_mutex_unlock (& conn->lock);
+
+    if (! ok)
+    {
+        ::close (s);
+        return -1;
+    }
+
+    return s;
+}
+
+static timespec deadline_after (int ms)
+{
+    timespec t;
+    clock_gettime (CLOCK_REALTIME, & t);
+
+    t.tv_sec += ms / 1000;
+    t.tv_nsec += ms % 1000 * 1000000;
+
+    if (t.tv_nsec >= 1000000000)
+    {
+        t.tv_sec ++;
+        t.tv_nsec -= 1000000000;
+    }
+
+    return t;
+}
+
+/* With read-ahead, a thread of its own reads from the server into a ring
+ * buffer of so many seconds of the stream, and the decoder reads from the
+ * buffer.  When the connection fails, the thread connects again and goes on
+ * from where it was (or, in a live stream, from where the stream is now),
+ * while the decoder plays what is buffered. */
 class MMSFile : public VFSImpl
 {
 public:
-    MMSFile (const char * path, mms_t * mms, mmsh_t * mmsh) :
-        m_mms (mms),
-        m_mmsh (mmsh) {}
-
+    MMSFile (const char * path);
     ~MMSFile () override;
 
     class OpenError {};  // exception
@@ -60,51 +329,73 @@ public:
     int fflush () override;
 
 private:
-    mms_t * m_mms;
-    mmsh_t * m_mmsh;
+    String m_path;
+    MMSConnection m_conn;   /* used by the reader while there is one */
+    int64_t m_length = 0;
+    int64_t m_pos = 0;      /* read by the decoder */
+
+    RingBuf<char> m_rb;
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_cond = PTHREAD_COND_INITIALIZER;
+    pthread_t m_reader;
+    bool m_reading = false, m_quit = false;
+    bool m_eof = false;     /* nothing more will come into the buffer */
+
+    int64_t read_direct (char * buf, int64_t len);
+    bool reconnect (int64_t fetched);
+
+    void start_reader ();
+    void stop_reader ();
+    void reader ();
+
+    static void * reader_thread (void * data)
+        { ((MMSFile *) data)->reader (); return nullptr; }
 };
 
 VFSImpl * MMSTransport::fopen (const char * path, const char * mode, String & error)
 {
-    mms_t * mms = nullptr;
-    mmsh_t * mmsh = nullptr;
-
-    if (! (mmsh = mmsh_connect (nullptr, nullptr, path, 128 * 1024)))
+    try
     {
-        AUDDBG ("Failed to connect with MMSH protocol; trying MMS.\n");
-
-        if (! (mms = mms_connect (nullptr, nullptr, path, 128 * 1024)))
-        {
-            AUDERR ("Failed to open %s.\n", path);
-            error = String (_("Error connecting to MMS server"));
-            return nullptr;
-        }
+        return new MMSFile (path);
     }
+    catch (MMSFile::OpenError)
+    {
+        AUDERR ("Failed to open %s.\n", path);
+        error = String (_("Error connecting to MMS server"));
+        return nullptr;
+    }
+}
 
-    return new MMSFile (path, mms, mmsh);
+MMSFile::MMSFile (const char * path) :
+    m_path (path)
+{
+    if (! m_conn.connect (path))
+        throw OpenError ();
+
+    m_length = m_conn.length ();
+
+    int secs = aud_get_int ("mms", "buffer_secs");
+    if (secs > 0)
+    {
+        m_rb.alloc (aud::max (secs * (BANDWIDTH / 8), 16 * BLOCK_SIZE));
+        start_reader ();
+    }
 }
 
 MMSFile::~MMSFile ()
 {
-    if (m_mms)
-        mms_close (m_mms);
-    else
-        mmsh_close (m_mmsh);
+    if (m_reading)
+        stop_reader ();
+
 }
 
-int64_t MMSFile::fread (void * buf, int64_t size, int64_t count)
+int64_t MMSFile::read_direct (char * buf, int64_t len)
 {
-    int64_t bytes_total = size * count;
     int64_t bytes_read = 0;
 
-    while (bytes_read < bytes_total)
+    while (bytes_read < len)
     {
-        int64_t readsize;
-
-        if (m_mms)
-            readsize = mms_read (nullptr, m_mms, (char *) buf + bytes_read, bytes_total - bytes_read);
-        else
-            readsize = mmsh_read (nullptr, m_mmsh, (char *) buf + bytes_read, bytes_total - bytes_read);
+        int64_t readsize = m_conn.read (buf + bytes_read, len - bytes_read);
 
         if (readsize < 0)
             AUDERR ("Read failed.\n");
@@ -115,9 +406,179 @@ int64_t MMSFile::fread (void * buf, int64_t size, int64_t count)
         bytes_read += readsize;
     }
 
-    return size ? bytes_read / size : 0;
+    return bytes_read;
+}
+
+/* Connects again and goes on from fetched.  A live stream cannot seek, so
+ * it goes on from its next packet, after the header that it sends again. */
+bool MMSFile::reconnect (int64_t fetched)
+{
+    m_conn.close ();
+
+    if (! m_conn.connect (m_path))
+        return false;
+
+    if (m_conn.seek (fetched) == fetched)
+        return true;
+
+    AUDDBG ("Cannot seek after reconnecting; joining the stream as it is now.\n");
+
+    int64_t header = m_conn.header_len ();
+    char skip[BLOCK_SIZE];
+
+    while (m_conn.pos () < header)
+    {
+        if (m_conn.read (skip, aud::min (header - m_conn.pos (), (int64_t) BLOCK_SIZE)) <= 0)
+            return false;
+    }
+
+    return true;
+}
+
+void MMSFile::start_reader ()
+{
+    m_quit = false;
+    m_eof = false;
+    m_conn.reset ();
+    m_reading = ! pthread_create (& m_reader, nullptr, reader_thread, this);
+
+    if (! m_reading)
+        AUDERR ("Cannot start the read-ahead thread; reading directly.\n");
+}
+
+void MMSFile::stop_reader ()
+{
+    pthread_mutex_lock (& m_mutex);
+    m_quit = true;
+    pthread_cond_broadcast (& m_cond);
+
+    /* a read from a server gone quiet may never return by itself */
+    timespec deadline = deadline_after (STOP_TIMEOUT_MS);
+    while (! m_eof && pthread_cond_timedwait (& m_cond, & m_mutex, & deadline) != ETIMEDOUT)
+        continue;
+
+    if (! m_eof)
+    {
+        AUDDBG ("Cutting short a read in progress.\n");
+        m_conn.abort ();
+    }
+
+    pthread_mutex_unlock (& m_mutex);
+
+    pthread_join (m_reader, nullptr);
+    m_reading = false;
+}
+
+void MMSFile::reader ()
+{
+    char buf[BLOCK_SIZE];
+    int64_t fetched = m_pos;
+    int retries = 0;
+
+    pthread_mutex_lock (& m_mutex);
+
+    while (! m_quit)
+    {
+        if (m_rb.space () < BLOCK_SIZE)
+        {
+            pthread_cond_wait (& m_cond, & m_mutex);
+            continue;
+        }
+
+        /* after a failed reconnection there is nothing to read from */
+        int64_t readsize = -1;
+
+        if (m_conn.is_open ())
+        {
+            pthread_mutex_unlock (& m_mutex);
+            readsize = m_conn.read (buf, BLOCK_SIZE);
+            pthread_mutex_lock (& m_mutex);
+        }
+
+        if (readsize > 0)
+        {
+            m_rb.copy_in (buf, readsize);
+            fetched += readsize;
+            retries = 0;
+            pthread_cond_broadcast (& m_cond);
+            continue;
+        }
+
+        /* the end of a file, rather than a failure */
+        if (! readsize && m_length > 0 && fetched >= m_length)
+            break;
+
+        /* a read cut short by stop_reader () */
+        if (m_quit)
+            break;
+
+        if (retries ++ == MAX_RETRIES)
+        {
+            AUDERR ("Read failed.\n");
+            break;
+        }
+
+        AUDWARN ("Connection lost; reconnecting (%d of %d).\n", retries, MAX_RETRIES);
+
+        if (retries > 1)
+        {
+            timespec deadline = deadline_after (RETRY_DELAY_MS);
+            while (! m_quit && pthread_cond_timedwait (& m_cond, & m_mutex, & deadline) != ETIMEDOUT)
+                continue;
+
+            if (m_quit)
+                break;
+        }
+
+        /* the buffer plays on meanwhile */
+        pthread_mutex_unlock (& m_mutex);
+        bool ok = reconnect (fetched);
+        pthread_mutex_lock (& m_mutex);
+
+        if (ok)
+            AUDDBG ("Reconnected at %" PRId64 ".\n", fetched);
+    }
+
+    m_eof = true;
+    pthread_cond_broadcast (& m_cond);
+    pthread_mutex_unlock (& m_mutex);
 }
 
+int64_t MMSFile::fread (void * buf, int64_t size, int64_t count)
+{
+    int64_t bytes_total = size * count;
+    int64_t bytes_read = 0;
+
+    if (! m_reading)
+    {
+        bytes_read = read_direct ((char *) buf, bytes_total);
+        m_pos += bytes_read;
+        return size ? bytes_read / size : 0;
+    }
+
+    pthread_mutex_lock (& m_mutex);
+
+    while (bytes_read < bytes_total)
+    {
+        int64_t len = aud::min (bytes_total - bytes_read, (int64_t) m_rb.len ());
+
+        if (len)
+        {
+            m_rb.move_out ((char *) buf + bytes_read, len);
+            bytes_read += len;
+            pthread_cond_broadcast (& m_cond);
+        }
+        else if (m_eof)
+            break;
+        else
+            pthread_cond_wait (& m_cond, & m_mutex);
+    }
+
+    pthread_mutex_unlock (& m_mutex);
+
+    m_pos += bytes_read;
+    return size ? bytes_read / size : 0;
+}
 int64_t MMSFile::fwrite (const void * data, int64_t size, int64_t count)
 {
     AUDERR ("Writing is not supported.\n");
@@ -127,50 +588,82 @@ int64_t MMSFile::fwrite (const void * data, int64_t size, int64_t count)
 int MMSFile::fseek (int64_t offset, VFSSeekType whence)
 {
     if (whence == VFS_SEEK_CUR)
-    {
-        if (m_mms)
-            offset += mms_get_current_pos (m_mms);
-        else
-            offset += mmsh_get_current_pos (m_mmsh);
-    }
+        offset += m_pos;
     else if (whence == VFS_SEEK_END)
+        offset += m_length;
+
+    /* a short skip forward is taken out of the buffer */
+    if (m_reading && offset >= m_pos)
     {
-        if (m_mms)
-            offset += mms_get_length (m_mms);
-        else
-            offset += mmsh_get_length (m_mmsh);
+        pthread_mutex_lock (& m_mutex);
+
+        bool buffered = (offset - m_pos <= m_rb.len ());
+        if (buffered)
+        {
+            m_rb.discard (offset - m_pos);
+            pthread_cond_broadcast (& m_cond);
+        }
+
+        pthread_mutex_unlock (& m_mutex);
+
+        if (buffered)
+        {
+            m_pos = offset;
+            return 0;
+        }
     }
 
-    int64_t ret;
+    bool restart = m_reading;
+    if (restart)
+        stop_reader ();
 
-    if (m_mms)
-        ret = mms_seek (nullptr, m_mms, offset, SEEK_SET);
-    else
-        ret = mmsh_seek (nullptr, m_mmsh, offset, SEEK_SET);
+    m_rb.discard ();
 
-    if (ret < 0 || ret != offset)
+    /* a connection cut short by stop_reader () or lost by the reader */
+    if (m_conn.aborted () || ! m_conn.is_open ())
     {
-        AUDERR ("Seek failed.\n");
-        return -1;
+        m_conn.close ();
+        m_conn.reset ();
+
+        if (! m_conn.connect (m_path))
+            AUDERR ("Cannot connect again.\n");
     }
 
-    return 0;
+    int64_t ret = m_conn.seek (offset);
+    bool ok = (ret >= 0 && ret == offset);
+
+    /* what was buffered is gone either way; without a connection, the
+     * reader connects again and goes on from the decoder's position */
+    if (ok)
+        m_pos = offset;
+    else if (m_conn.is_open ())
+        m_pos = m_conn.pos ();
+
+    if (! ok)
+        AUDERR ("Seek failed.\n");
+
+    if (restart)
+        start_reader ();
+
+    return ok ? 0 : -1;
 }
 
 int64_t MMSFile::ftell ()
 {
-    if (m_mms)
-        return mms_get_current_pos (m_mms);
-    else
-        return mmsh_get_current_pos (m_mmsh);
+    return m_pos;
 }
 
 bool MMSFile::feof ()
 {
-    if (m_mms)
-        return (mms_get_current_pos (m_mms) < (int64_t) mms_get_length (m_mms));
-    else
-        return (mmsh_get_current_pos (m_mmsh) < (int64_t) mmsh_get_length (m_mmsh));
+    if (m_reading)
+    {
+        pthread_mutex_lock (& m_mutex);
+        bool eof = m_eof && ! m_rb.len ();
+        pthread_mutex_unlock (& m_mutex);
+        return eof;
+    }
+
+    return m_length > 0 && m_pos >= m_length;
 }
 
 int MMSFile::ftruncate (int64_t size)
@@ -181,10 +674,7 @@ int MMSFile::ftruncate (int64_t size)
 
 int64_t MMSFile::fsize ()
 {
-    if (m_mms)
-        return mms_get_length (m_mms);
-    else
-        return mmsh_get_length (m_mmsh);
+    return m_length;
 }
 
 int MMSFile::fflush ()
@@ -0,0 +1,55 @@
+/* Modplug XMMS Plugin
+ * Authors: Kenton Varda <temporal@gauge3d.org>
+ *
+ * This source code is public domain.
+ */
+
+#include "arch_gzip.h"
+
+#include <string.h>
+
+using namespace std;
+
+arch_Gzip::arch_Gzip(const string& aFileName)
+{
+    mSize = 0;
+    mMap = nullptr;
+
+    VFSFile lFile(aFileName.c_str(), "r");
+    if (!lFile)
+        return;
+
+    int64_t lPacked = lFile.fsize();
+    auto lData = Cached(aFileName, lPacked);
+    if (lData)
+    {
+        Use(lData);
+        return;
+    }
+
+    // the unpacked size (modulo 4 GiB) ends the file
+    int64_t lHint = -1;
+    unsigned char lTrailer[4];
+
+    if (lPacked >= 18 && !lFile.fseek(-4, VFS_SEEK_END) &&
+        lFile.fread(lTrailer, 1, 4) == 4)
+        lHint = lTrailer[0] | (lTrailer[1] << 8) | (lTrailer[2] << 16) |
+         ((int64_t)lTrailer[3] << 24);
+
+    if (lFile.fseek(0, VFS_SEEK_SET))
+        return;
+
+    // 32 for zlib to take gzip and zlib headers both
+    auto lModule = make_shared<Index<char>>();
+    if (!Inflate(lFile, -1, 15 + 32, *lModule, lHint) || !lModule->len())
+        return;
+
+    Cache(aFileName, lPacked, lModule);
+    Use(lModule);
+}
+
+bool arch_Gzip::ContainsMod(const string& aFileName)
+{
+    arch_Gzip lArchive(aFileName);
+    return lArchive.Size() != 0;
+}
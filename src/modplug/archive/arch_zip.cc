@@ -0,0 +1,164 @@
+/* Modplug XMMS Plugin
+ * Authors: Kenton Varda <temporal@gauge3d.org>
+ *
+ * This source code is public domain.
+ */
+
+#include "arch_zip.h"
+
+#include <string.h>
+
+#include <libaudcore/runtime.h>
+
+using namespace std;
+
+// the end of central directory record, and the most a comment can add
+#define EOCD_SIZE 22
+#define EOCD_SEARCH (EOCD_SIZE + 65535)
+
+static inline unsigned Get16(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t Get32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+struct ZipMember
+{
+    unsigned mMethod;
+    uint32_t mPacked, mSize, mOffset;
+};
+
+// The first module in the central directory; member names are only
+// trusted from there, as the local headers may leave the sizes out.
+static bool FindModule(VFSFile& aFile, int64_t aFileSize, ZipMember& aMember,
+ bool (*aIsModule)(const string&))
+{
+    int64_t lTail = aud::min(aFileSize, (int64_t)EOCD_SEARCH);
+    Index<unsigned char> lBuf;
+    lBuf.resize(lTail);
+
+    if (lTail < EOCD_SIZE || aFile.fseek(aFileSize - lTail, VFS_SEEK_SET) ||
+        aFile.fread(lBuf.begin(), 1, lTail) != lTail)
+        return false;
+
+    const unsigned char* lEnd = nullptr;
+    for (int64_t i = lTail - EOCD_SIZE; i >= 0 && !lEnd; i--)
+    {
+        if (!memcmp(&lBuf[i], "PK\5\6", 4))
+            lEnd = &lBuf[i];
+    }
+
+    if (!lEnd)
+        return false;
+
+    unsigned lEntries = Get16(lEnd + 10);
+    uint32_t lDirSize = Get32(lEnd + 12);
+    uint32_t lDirOffset = Get32(lEnd + 16);
+
+    if (lDirOffset + (int64_t)lDirSize > aFileSize)
+        return false;
+
+    Index<unsigned char> lDir;
+    lDir.resize(lDirSize);
+
+    if (aFile.fseek(lDirOffset, VFS_SEEK_SET) ||
+        aFile.fread(lDir.begin(), 1, lDirSize) != lDirSize)
+        return false;
+
+    const unsigned char* p = lDir.begin();
+    const unsigned char* lDirEnd = lDir.end();
+
+    for (unsigned i = 0; i < lEntries && lDirEnd - p >= 46 && !memcmp(p, "PK\1\2", 4); i++)
+    {
+        unsigned lFlags = Get16(p + 8);
+        unsigned lNameLen = Get16(p + 28);
+        unsigned lSkip = 46 + lNameLen + Get16(p + 30) + Get16(p + 32);
+
+        if (lDirEnd - p < lSkip)
+            break;
+
+        string lName((const char*)p + 46, lNameLen);
+        unsigned lMethod = Get16(p + 10);
+
+        // encrypted members cannot be played
+        if (!(lFlags & 1) && (lMethod == 0 || lMethod == 8) && aIsModule(lName))
+        {
+            aMember.mMethod = lMethod;
+            aMember.mPacked = Get32(p + 20);
+            aMember.mSize = Get32(p + 24);
+            aMember.mOffset = Get32(p + 42);
+            return true;
+        }
+
+        p += lSkip;
+    }
+
+    return false;
+}
+
+arch_Zip::arch_Zip(const string& aFileName)
+{
+    mSize = 0;
+    mMap = nullptr;
+
+    VFSFile lFile(aFileName.c_str(), "r");
+    if (!lFile)
+        return;
+
+    int64_t lFileSize = lFile.fsize();
+    auto lData = Cached(aFileName, lFileSize);
+    if (lData)
+    {
+        Use(lData);
+        return;
+    }
+
+    ZipMember lMember;
+    if (lFileSize <= 0 || !FindModule(lFile, lFileSize, lMember, IsOurFile))
+    {
+        AUDERR("No module in %s.\n", aFileName.c_str());
+        return;
+    }
+
+    unsigned char lLocal[30];
+    if (lFile.fseek(lMember.mOffset, VFS_SEEK_SET) ||
+        lFile.fread(lLocal, 1, 30) != 30 || memcmp(lLocal, "PK\3\4", 4) ||
+        lFile.fseek(Get16(lLocal + 26) + Get16(lLocal + 28), VFS_SEEK_CUR))
+        return;
+
+    auto lModule = make_shared<Index<char>>();
+
+    if (lMember.mMethod == 8)
+    {
+        // raw deflate, with no zlib header
+        if (!Inflate(lFile, lMember.mPacked, -15, *lModule, lMember.mSize))
+            return;
+    }
+    else
+    {
+        if (lMember.mSize > MAX_MODULE_SIZE)
+            return;
+
+        lModule->resize(lMember.mSize);
+        if (lFile.fread(lModule->begin(), 1, lMember.mSize) != lMember.mSize)
+            return;
+    }
+
+    if (!lModule->len())
+        return;
+
+    Cache(aFileName, lFileSize, lModule);
+    Use(lModule);
+}
+
+bool arch_Zip::ContainsMod(const string& aFileName)
+{
+    VFSFile lFile(aFileName.c_str(), "r");
+    ZipMember lMember;
+
+    return lFile && FindModule(lFile, lFile.fsize(), lMember, IsOurFile);
+}
@@ -0,0 +1,20 @@
+/* Modplug XMMS Plugin
+ * Authors: Kenton Varda <temporal@gauge3d.org>
+ *
+ * This source code is public domain.
+ */
+
+#ifndef __MODPLUG_ARCH_ZIP_H__INCLUDED__
+#define __MODPLUG_ARCH_ZIP_H__INCLUDED__
+
+#include "archive.h"
+
+class arch_Zip: public Archive
+{
+public:
+    arch_Zip(const std::string& aFileName);
+
+    static bool ContainsMod(const std::string& aFileName);
+};
+
+#endif
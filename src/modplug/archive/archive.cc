@@ -6,19 +6,152 @@
 
 #include "archive.h"
 
+#include <mutex>
+#include <vector>
+
+#include <zlib.h>
+
+#include <libaudcore/runtime.h>
+
 using namespace std;
 
-///* Open a read pipe */ File f;
-//f=popen("gzip -d compressed.file.name","r");
-///* Read some data in the usual manner, for example */
-//fscanf(f,"%d %f %f",name,&age,$id);
-///* Close the pipe */
-//pclose(f);
+#define CACHE_ENTRIES 4
+#define CACHE_SIZE (64 << 20)
+
+struct CacheEntry
+{
+    string mName;
+    int64_t mPacked;
+    shared_ptr<const Index<char>> mData;
+};
+
+// most recently used last
+static vector<CacheEntry> sCache;
+static mutex sCacheMutex;
 
 Archive::~Archive()
 {
 }
 
+void Archive::Use(const shared_ptr<const Index<char>>& aData)
+{
+    mData = aData;
+    mMap = (void*)aData->begin();
+    mSize = aData->len();
+}
+
+bool Archive::Inflate(VFSFile& aFile, int64_t aPacked, int aWindowBits,
+ Index<char>& aOut, int64_t aSizeHint)
+{
+    z_stream lStream {};
+    if (inflateInit2(&lStream, aWindowBits) != Z_OK)
+        return false;
+
+    // the size in the archive may be wrong; grow the buffer when it is
+    if (aSizeHint <= 0 || aSizeHint > MAX_MODULE_SIZE)
+        aSizeHint = 1 << 20;
+
+    aOut.resize(aSizeHint);
+
+    unsigned char lIn[65536];
+    int64_t lDone = 0;
+    int lRet = Z_OK;
+
+    while (lRet != Z_STREAM_END)
+    {
+        if (!lStream.avail_in)
+        {
+            int64_t lWant = sizeof lIn;
+            if (aPacked >= 0)
+                lWant = aud::min(aPacked, lWant);
+
+            int64_t lGot = lWant ? aFile.fread(lIn, 1, lWant) : 0;
+            if (lGot <= 0)
+                break;
+
+            if (aPacked >= 0)
+                aPacked -= lGot;
+
+            lStream.next_in = lIn;
+            lStream.avail_in = lGot;
+        }
+
+        if (lDone == aOut.len())
+        {
+            if (aOut.len() >= MAX_MODULE_SIZE)
+                break;
+
+            aOut.resize(aud::min(2 * aOut.len(), MAX_MODULE_SIZE));
+        }
+
+        lStream.next_out = (Bytef*)&aOut[lDone];
+        lStream.avail_out = aOut.len() - lDone;
+
+        lRet = inflate(&lStream, Z_NO_FLUSH);
+        lDone = aOut.len() - lStream.avail_out;
+
+        if (lRet != Z_OK && lRet != Z_STREAM_END && lRet != Z_BUF_ERROR)
+            break;
+    }
+
+    inflateEnd(&lStream);
+    aOut.resize(lDone);
+
+    if (lRet != Z_STREAM_END)
+    {
+        AUDERR("Cannot decompress %s.\n", aFile.filename());
+        return false;
+    }
+
+    return true;
+}
+
+shared_ptr<const Index<char>> Archive::Cached(const string& aFileName, int64_t aPacked)
+{
+    lock_guard<mutex> lLock(sCacheMutex);
+
+    for (auto it = sCache.begin(); it != sCache.end(); it++)
+    {
+        if (it->mName == aFileName && it->mPacked == aPacked)
+        {
+            CacheEntry lEntry = std::move(*it);
+            sCache.erase(it);
+            sCache.push_back(std::move(lEntry));
+            return sCache.back().mData;
+        }
+    }
+
+    return nullptr;
+}
+
+void Archive::Cache(const string& aFileName, int64_t aPacked,
+ const shared_ptr<const Index<char>>& aData)
+{
+    lock_guard<mutex> lLock(sCacheMutex);
+
+    for (auto it = sCache.begin(); it != sCache.end(); it++)
+    {
+        if (it->mName == aFileName)
+        {
+            sCache.erase(it);
+            break;
+        }
+    }
+
+    sCache.push_back({aFileName, aPacked, aData});
+
+    int64_t lTotal = 0;
+    for (const CacheEntry& lEntry : sCache)
+        lTotal += lEntry.mData->len();
+
+    // the one just added stays, even if it is bigger than the limit
+    while (sCache.size() > 1 && (sCache.size() > CACHE_ENTRIES || lTotal > CACHE_SIZE))
+    {
+        lTotal -= sCache.front().mData->len();
+        sCache.erase(sCache.begin());
+    }
+}
+
 bool Archive::IsOurFile(const string& aFileName)
 {
     string lExt;
@@ -8,17 +8,42 @@
 #define __MODPLUG_ARCHIVE_H__INCLUDED__
 
 #include <stdint.h>
+#include <memory>
 #include <string>
 
+#include <libaudcore/index.h>
+#include <libaudcore/vfs.h>
+
+#define MAX_MODULE_SIZE (256 << 20)  // what a broken archive may unpack to
+
 class Archive
 {
 protected:
     uint32_t mSize;
     void* mMap;
 
+    // Set by archives that decompress the module; shared with the cache.
+    std::shared_ptr<const Index<char>> mData;
+
     //This version of IsOurFile is slightly different...
     static bool IsOurFile(const std::string& aFileName);
 
+    // Inflates aPacked bytes (or up to the end of the file if -1) from the
+    // current position, straight into aOut.  aSizeHint is how big the
+    // module is said to be, -1 if not known.
+    static bool Inflate(VFSFile& aFile, int64_t aPacked, int aWindowBits,
+     Index<char>& aOut, int64_t aSizeHint);
+
+    // Modules decompressed lately, so that probing, reading the tag and
+    // playing a file decompress it once.  aPacked is the size of the
+    // archive, which tells a file that was replaced from the one cached.
+    static std::shared_ptr<const Index<char>> Cached(const std::string& aFileName,
+     int64_t aPacked);
+    static void Cache(const std::string& aFileName, int64_t aPacked,
+     const std::shared_ptr<const Index<char>>& aData);
+
+    void Use(const std::shared_ptr<const Index<char>>& aData);
+
 public:
     virtual ~Archive();
 
@@ -5,11 +5,70 @@
  */
 
 #include "open.h"
+#include "arch_gzip.h"
 #include "arch_raw.h"
+#include "arch_zip.h"
+
+#include <string.h>
+
+#include <libaudcore/audstrings.h>
 
 using namespace std;
 
+enum ArchiveType {RAW, GZIP, ZIP};
+
+// .mdz, .s3z, .xmz and .itz are zip files, and .mdgz and the like gzip
+static ArchiveType GetType(const string& aFileName)
+{
+    static const char * const lZip[] = {"zip", "mdz", "s3z", "xmz", "itz"};
+    static const char * const lGzip[] = {"gz", "mdgz", "s3gz", "xmgz", "itgz"};
+
+    StringBuf lExt = uri_get_extension(aFileName.c_str());
+    if (!lExt)
+        return RAW;
+
+    for (const char* lName : lZip)
+    {
+        if (!strcmp_nocase(lExt, lName))
+            return ZIP;
+    }
+
+    for (const char* lName : lGzip)
+    {
+        if (!strcmp_nocase(lExt, lName))
+            return GZIP;
+    }
+
+    return RAW;
+}
+
 Archive* OpenArchive(const string& aFileName) //aFilename is url --yaz
 {
-    return new arch_Raw(aFileName);
+    switch (GetType(aFileName))
+    {
+    case ZIP:
+        return new arch_Zip(aFileName);
+    case GZIP:
+        return new arch_Gzip(aFileName);
+    default:
+        return new arch_Raw(aFileName);
+    }
+}
+
+bool IsArchive(const string& aFileName)
+{
+    return GetType(aFileName) != RAW;
+}
+
+bool ContainsMod(const string& aFileName)
+{
+    switch (GetType(aFileName))
+    {
+    case ZIP:
+        return arch_Zip::ContainsMod(aFileName);
+    case GZIP:
+        return arch_Gzip::ContainsMod(aFileName);
+    default:
+        return arch_Raw::ContainsMod(aFileName);
+    }
 }
@@ -17,6 +17,7 @@
 #include <libaudcore/i18n.h>
 
 #include "archive/open.h"
+#include "../trace-common/trace.h"
 
 using namespace std;
 
@@ -36,6 +37,10 @@ bool ModplugXMMS::is_our_file (const char * filename, VFSFile & file)
     const int magicSize = 32;
     char magic[magicSize];
 
+    // the module is looked for inside; it is kept for playing
+    if (IsArchive(filename))
+        return ContainsMod(filename);
+
     if (file.fread (magic, 1, magicSize) < magicSize)
         return false;
     if (!memcmp(magic, UMX_MAGIC, 4))
@@ -152,6 +157,7 @@ void ModplugXMMS::PlayLoop()
 
     while (! check_stop ())
     {
+        TRACE_SPAN ("ModPlug play");
         int seek_time = check_seek ();
         if (seek_time != -1)
             mSoundFile->SetCurrentPos (seek_time * (int64_t)
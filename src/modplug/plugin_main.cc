@@ -21,7 +21,7 @@ EXPORT ModplugXMMS aud_plugin_instance;
 const char * const ModplugXMMS::exts[] =
     { "amf", "ams", "dbm", "dbf", "dsm", "far", "mdl", "stm", "ult", "mt2",
       "mod", "s3m", "dmf", "umx", "it", "669", "xm", "mtm", "psm", "ft2",
-      nullptr };
+      "mdz", "s3z", "xmz", "itz", "mdgz", "s3gz", "xmgz", "itgz", nullptr };
 
 const char * const ModplugXMMS::defaults[] = {
  "Channels", "2",
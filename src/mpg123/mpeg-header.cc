@@ -0,0 +1,223 @@
+/*
+ * mpeg-header.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "mpeg-header.h"
+
+#include <string.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/objects.h>
+#include <libaudcore/vfs.h>
+
+// how far past the ID3v2 tag to look for the first frame
+#define SEARCH_BYTES 65536
+
+struct Frame
+{
+    int version, layer, rate, channels, bitrate;
+    int samples, size;
+};
+
+static const uint16_t bitrates[2][3][15] = {
+    {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+     {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+     {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}},
+    {{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}}};
+
+static const int rates[3][3] = {
+    {44100, 48000, 32000}, {22050, 24000, 16000}, {11025, 12000, 8000}};
+
+static uint32_t read_be32(const unsigned char * p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// free-format streams (bitrate index 0) are left to mpg123
+static bool parse_frame(const unsigned char * p, Frame & f)
+{
+    uint32_t h = read_be32(p);
+
+    int version_bits = (h >> 19) & 3;
+    int layer_bits = (h >> 17) & 3;
+    int bitrate_index = (h >> 12) & 15;
+    int rate_index = (h >> 10) & 3;
+
+    if ((h & 0xffe00000) != 0xffe00000 || version_bits == 1 || !layer_bits ||
+        !bitrate_index || bitrate_index == 15 || rate_index == 3)
+        return false;
+
+    f.version = (version_bits == 3) ? 0 : (version_bits == 2) ? 1 : 2;
+    f.layer = 4 - layer_bits;
+    f.rate = rates[f.version][rate_index];
+    f.channels = (((h >> 6) & 3) == 3) ? 1 : 2;
+    f.bitrate = bitrates[f.version ? 1 : 0][f.layer - 1][bitrate_index];
+
+    int padding = (h >> 9) & 1;
+
+    if (f.layer == 1)
+    {
+        f.samples = 384;
+        f.size = (12000 * f.bitrate / f.rate + padding) * 4;
+    }
+    else if (f.layer == 2 || !f.version)
+    {
+        f.samples = 1152;
+        f.size = 144000 * f.bitrate / f.rate + padding;
+    }
+    else
+    {
+        f.samples = 576;
+        f.size = 72000 * f.bitrate / f.rate + padding;
+    }
+
+    return true;
+}
+
+static bool same_stream(const Frame & a, const Frame & b)
+{
+    return a.version == b.version && a.layer == b.layer && a.rate == b.rate;
+}
+
+// samples in the stream according to a Xing/Info or VBRI header in the
+// first frame, or -1; the first frame itself is not audio then
+static int64_t header_samples(const unsigned char * p, int len, const Frame & f)
+{
+    int side_info = f.version ? (f.channels == 1 ? 9 : 17)
+                              : (f.channels == 1 ? 17 : 32);
+    int xing = 4 + side_info;
+
+    if (f.layer == 3 && xing + 8 <= len &&
+        (!memcmp(p + xing, "Xing", 4) || !memcmp(p + xing, "Info", 4)))
+    {
+        const unsigned char * q = p + xing + 4;
+        uint32_t flags = read_be32(q);
+        q += 4;
+
+        if (!(flags & 1) || q + 4 > p + len)
+            return -1;
+
+        int64_t frames = read_be32(q);
+        q += 4;
+
+        if (flags & 2)
+            q += 4;  // bytes
+        if (flags & 4)
+            q += 100;  // seek table
+        if (flags & 8)
+            q += 4;  // quality
+
+        // the LAME tag, if present, gives the encoder delay and padding,
+        // which mpg123 leaves out in gapless mode
+        int trimmed = 0;
+        if (q + 24 <= p + len &&
+            (!memcmp(q, "LAME", 4) || !memcmp(q, "Lavf", 4) ||
+             !memcmp(q, "Lavc", 4)))
+        {
+            int delay = (q[21] << 4) | (q[22] >> 4);
+            int padding = ((q[22] & 15) << 8) | q[23];
+            trimmed = delay + padding;
+        }
+
+        return aud::max<int64_t>(0, frames * f.samples - trimmed);
+    }
+
+    if (36 + 18 <= len && !memcmp(p + 36, "VBRI", 4))
+        return (int64_t)read_be32(p + 36 + 14) * f.samples;
+
+    return -1;
+}
+
+bool read_mpeg_header(VFSFile & file, MPEGHeaderInfo & info)
+{
+    int64_t size = file.fsize();
+    if (size <= 0 || file.fseek(0, VFS_SEEK_SET) < 0)
+        return false;
+
+    unsigned char id3[10];
+    int64_t start = 0;
+
+    if (file.fread(id3, 1, sizeof id3) == sizeof id3 && !memcmp(id3, "ID3", 3))
+    {
+        // the size is stored 7 bits to a byte
+        start = 10 + ((id3[6] & 0x7f) << 21 | (id3[7] & 0x7f) << 14 |
+                      (id3[8] & 0x7f) << 7 | (id3[9] & 0x7f));
+        if (id3[5] & 0x10)
+            start += 10;  // footer
+    }
+
+    // a corrupt tag size can point past the end of the file
+    if (start >= size)
+        return false;
+
+    Index<unsigned char> buf;
+    buf.resize(aud::min<int64_t>(SEARCH_BYTES, size - start));
+
+    if (!buf.len() || file.fseek(start, VFS_SEEK_SET) < 0 ||
+        file.fread(buf.begin(), 1, buf.len()) != buf.len())
+        return false;
+
+    const unsigned char * p = buf.begin();
+    int len = buf.len();
+
+    // a frame counts only if the next one follows it, or if it ends the file
+    for (int pos = 0; pos + 4 <= len; pos++)
+    {
+        Frame f, next;
+
+        if (p[pos] != 0xff || !parse_frame(p + pos, f))
+            continue;
+
+        int next_pos = pos + f.size;
+        bool at_end = (start + next_pos >= size);
+
+        if (!at_end && (next_pos + 4 > len || !parse_frame(p + next_pos, next) ||
+                        !same_stream(f, next)))
+            continue;
+
+        info.version = f.version;
+        info.layer = f.layer;
+        info.rate = f.rate;
+        info.channels = f.channels;
+        info.bitrate = f.bitrate;
+
+        int64_t samples = header_samples(p + pos, aud::min(f.size, len - pos), f);
+        info.exact = (samples >= 0);
+
+        if (samples >= 0)
+            info.length = aud::rescale<int64_t>(samples, f.rate, 1000);
+        else
+        {
+            int64_t bytes = size - (start + pos);
+
+            // leave out an ID3v1 tag at the end
+            char tag[3];
+            if (bytes > 128 && file.fseek(-128, VFS_SEEK_END) == 0 &&
+                file.fread(tag, 1, 3) == 3 && !memcmp(tag, "TAG", 3))
+                bytes -= 128;
+
+            info.length = aud::rescale<int64_t>(bytes, f.bitrate, 8);
+        }
+
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,45 @@
+/*
+ * mpeg-header.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef MPG123_MPEG_HEADER_H
+#define MPG123_MPEG_HEADER_H
+
+#include <stdint.h>
+
+class VFSFile;
+
+struct MPEGHeaderInfo
+{
+    int version;    // 0 = MPEG-1, 1 = MPEG-2, 2 = MPEG-2.5, as in mpg123
+    int layer;
+    int rate;
+    int channels;
+    int bitrate;    // kbps, of the first frame
+    int length;     // ms, or -1 if unknown
+    bool exact;     // length from a Xing/Info or VBRI header
+};
+
+// Reads the stream format and length of a seekable MP3 file from the frame
+// headers alone, without decoding: the length comes from a Xing/Info or
+// VBRI header if there is one, or else from the bitrate of the first frame.
+// At most a few tens of kilobytes are read, and nothing is shared between
+// calls, so any number of files can be done in parallel.
+bool read_mpeg_header(VFSFile & file, MPEGHeaderInfo & info);
+
+#endif
@@ -21,6 +21,8 @@
 
 #include <string.h>
 
+#include <mutex>
+
 #undef EXPORT
 #include <mpg123.h>
 
@@ -38,10 +40,17 @@
 #include <audacious/audtag.h>
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/multihash.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 
+#include "../vfs-common/local-reader.h"
+#include "../vfs-common/seek-index.h"
+#include "../vfs-common/track-prefetch.h"
+#include "mpeg-header.h"
+#include "../trace-common/trace.h"
+
 class MPG123Plugin : public InputPlugin
 {
 public:
@@ -93,15 +102,15 @@ const PluginPreferences MPG123Plugin::prefs = {{widgets}};
 
 static ssize_t replace_read(void * file, void * buffer, size_t length)
 {
-    return ((VFSFile *)file)->fread(buffer, 1, length);
+    return ((LocalReader *)file)->fread(buffer, 1, length);
 }
 
 static off_t replace_lseek(void * file, off_t to, int whence)
 {
-    if (((VFSFile *)file)->fseek(to, to_vfs_seek_type(whence)) < 0)
+    if (((LocalReader *)file)->fseek(to, to_vfs_seek_type(whence)) < 0)
         return -1;
 
-    return ((VFSFile *)file)->ftell();
+    return ((LocalReader *)file)->ftell();
 }
 
 static off_t replace_lseek_dummy(void * file, off_t to, int whence)
@@ -122,28 +131,130 @@ bool MPG123Plugin::init()
 void MPG123Plugin::cleanup()
 {
     AUDDBG("deinitializing mpg123 library\n");
+    track_prefetch_cleanup();
     mpg123_exit();
 }
 
+// A full scan reads the whole file, so its results (the exact length and
+// the seek index) are kept for the files scanned lately, checked against
+// the file size, and given back to mpg123 when one of them is opened again.
+struct ScanResult
+{
+    int64_t size;
+    int64_t length; // samples
+    Index<off_t> offsets;
+    off_t step;
+};
+
+#define SCAN_CACHE_SIZE 64
+
+static std::mutex scan_mutex;
+static SimpleHash<String, ScanResult> scan_cache;
+
+static bool scan_file(const char * filename, mpg123_handle * dec,
+                      int64_t size, int64_t & length)
+{
+    String key(filename);
+
+    {
+        std::lock_guard<std::mutex> lock(scan_mutex);
+        auto cached = scan_cache.lookup(key);
+
+        if (cached && cached->size == size)
+        {
+            length = cached->length;
+            return !cached->offsets.len() ||
+                   mpg123_set_index(dec, cached->offsets.begin(), cached->step,
+                                    cached->offsets.len()) == MPG123_OK;
+        }
+    }
+
+    if (mpg123_scan(dec) < 0)
+        return false;
+
+    ScanResult result = {size, mpg123_length(dec)};
+    length = result.length;
+
+    off_t * offsets;
+    off_t step;
+    size_t fill;
+
+    if (mpg123_index(dec, &offsets, &step, &fill) == MPG123_OK && fill)
+    {
+        result.offsets.insert(offsets, 0, fill);
+        result.step = step;
+    }
+
+    std::lock_guard<std::mutex> lock(scan_mutex);
+
+    if (scan_cache.n_items() >= SCAN_CACHE_SIZE)
+        scan_cache.clear();
+
+    scan_cache.add(key, std::move(result));
+    return true;
+}
+
+// mpg123 builds an index of frame offsets as it decodes, which lets it seek
+// exactly (instead of guessing from the bitrate or the Xing table of
+// contents) within the part of the file it has played; the index it had at
+// the end of the last playback is given back to it the next time
+static void restore_index(mpg123_handle * dec, const SeekIndex & index)
+{
+    auto & points = index.points();
+    if (points.len() < 2 || points[0].pos != 0)
+        return;
+
+    off_t step = points[1].pos;
+    Index<off_t> offsets;
+
+    for (int i = 0; i < points.len(); i++)
+    {
+        if (points[i].pos != i * step)
+            return;
+
+        offsets.append(points[i].offset);
+    }
+
+    mpg123_set_index(dec, offsets.begin(), step, offsets.len());
+}
+
+static void store_index(mpg123_handle * dec, SeekIndex & index)
+{
+    off_t * offsets;
+    off_t step;
+    size_t fill;
+
+    if (mpg123_index(dec, &offsets, &step, &fill) != MPG123_OK ||
+        (int)fill <= index.points().len())
+        return;
+
+    index.clear();
+    for (size_t i = 0; i < fill; i++)
+        index.add(i * step, offsets[i]);
+}
+
 struct DecodeState
 {
+    LocalReader reader;
     mpg123_handle * dec = nullptr;
 
     DecodeState(const char * filename, VFSFile & file, bool probing,
-                bool stream);
+                bool stream, bool scan = false);
     ~DecodeState() { mpg123_delete(dec); }
 
     bool valid() const { return dec != nullptr; }
 
     long rate;
     int channels, encoding;
+    int64_t length = -1; // samples, if scanned
     mpg123_frameinfo info;
     size_t bytes_read;
     float buf[4096];
 };
 
 DecodeState::DecodeState(const char * filename, VFSFile & file, bool probing,
-                         bool stream)
+                         bool stream, bool scan)
+    : reader(file)
 {
     dec = mpg123_new(nullptr, nullptr);
     mpg123_param(dec, MPG123_ADD_FLAGS, DECODE_OPTIONS, 0);
@@ -162,10 +273,10 @@ DecodeState::DecodeState(const char * filename, VFSFile & file, bool probing,
         mpg123_format(dec, rate, MPG123_MONO | MPG123_STEREO,
                       MPG123_ENC_FLOAT_32);
 
-    if (mpg123_open_handle(dec, &file) < 0)
+    if (mpg123_open_handle(dec, &reader) < 0)
         goto err;
 
-    if (!stream && aud_get_bool("mpg123", "full_scan") && mpg123_scan(dec) < 0)
+    if (scan && !scan_file(filename, dec, reader.fsize(), length))
         goto err;
 
     while (1)
@@ -216,10 +327,10 @@ static bool detect_id3(VFSFile & file)
     return is_id3;
 }
 
-static StringBuf make_format_string(const mpg123_frameinfo * info)
+static StringBuf make_format_string(int version, int layer)
 {
     static const char * vers[] = {"1", "2", "2.5"};
-    return str_printf("MPEG-%s layer %d", vers[info->version], info->layer);
+    return str_printf("MPEG-%s layer %d", vers[version], layer);
 }
 
 bool MPG123Plugin::is_our_file(const char * filename, VFSFile & file)
@@ -236,42 +347,67 @@ bool MPG123Plugin::is_our_file(const char * filename, VFSFile & file)
     if (!s.valid())
         return false;
 
-    auto fmt = make_format_string(&s.info);
+    auto fmt = make_format_string(s.info.version, s.info.layer);
     AUDDBG("Accepted as %s: %s.\n", &fmt[0], filename);
     return true;
 }
 
+static void set_format_info(Tuple & tuple, int version, int layer,
+                            int channels, int rate, int bitrate)
+{
+    tuple.set_int(Tuple::Bitrate, bitrate);
+    tuple.set_str(Tuple::Codec, make_format_string(version, layer));
+    tuple.set_int(Tuple::Channels, channels);
+
+    const char * chan_str = (channels == 2)
+                                ? _("Stereo")
+                                : (channels > 2) ? _("Surround") : _("Mono");
+    tuple.set_str(Tuple::Quality, str_printf("%s, %d Hz", chan_str, rate));
+}
+
+static void set_length(Tuple & tuple, int length, int64_t size)
+{
+    if (length > 0)
+    {
+        tuple.set_int(Tuple::Length, length);
+        tuple.set_int(Tuple::Bitrate, aud::rdiv<int64_t>(8 * size, length));
+    }
+}
+
 static bool read_mpg123_info(const char * filename, VFSFile & file,
                              Tuple & tuple)
 {
     int64_t size = file.fsize();
     bool stream = (size < 0);
 
-    DecodeState s(filename, file, false, stream);
-    if (!s.valid())
+    // unless asked for an accurate length, the frame headers are enough and
+    // nothing needs to be decoded; a Xing/Info or VBRI header gives the
+    // accurate length anyway
+    bool full_scan = aud_get_bool("mpg123", "full_scan");
+    MPEGHeaderInfo header;
+
+    if (!stream && read_mpeg_header(file, header) &&
+        (!full_scan || header.exact))
+    {
+        set_format_info(tuple, header.version, header.layer, header.channels,
+                        header.rate, header.bitrate);
+        set_length(tuple, header.length, size);
+        return true;
+    }
+
+    if (!stream && file.fseek(0, VFS_SEEK_SET) < 0)
         return false;
 
-    tuple.set_int(Tuple::Bitrate, s.info.bitrate);
-    tuple.set_str(Tuple::Codec, make_format_string(&s.info));
-    tuple.set_int(Tuple::Channels, s.channels);
+    DecodeState s(filename, file, false, stream, !stream && full_scan);
+    if (!s.valid())
+        return false;
 
-    const char * chan_str = (s.channels == 2)
-                                ? _("Stereo")
-                                : (s.channels > 2) ? _("Surround") : _("Mono");
-    tuple.set_str(Tuple::Quality,
-                  str_printf("%s, %d Hz", chan_str, (int)s.rate));
+    set_format_info(tuple, s.info.version, s.info.layer, s.channels, s.rate,
+                    s.info.bitrate);
 
+    int64_t samples = (s.length >= 0) ? s.length : mpg123_length(s.dec);
     if (!stream && s.rate > 0)
-    {
-        int64_t samples = mpg123_length(s.dec);
-        int length = aud::rescale<int64_t>(samples, s.rate, 1000);
-
-        if (length > 0)
-        {
-            tuple.set_int(Tuple::Length, length);
-            tuple.set_int(Tuple::Bitrate, aud::rdiv<int64_t>(8 * size, length));
-        }
-    }
+        set_length(tuple, aud::rescale<int64_t>(samples, s.rate, 1000), size);
 
     return true;
 }
@@ -301,18 +437,39 @@ bool MPG123Plugin::play(const char * filename, VFSFile & file)
 {
     bool stream = (file.fsize() < 0);
 
-    Tuple tuple;
+    Tuple tuple = get_playback_tuple();
+    TrackPrefetch prefetch(tuple.get_int(Tuple::Length));
+
     if (stream)
     {
-        tuple = get_playback_tuple();
         if (detect_id3(file) && audtag::read_tag(file, tuple, nullptr))
             set_playback_tuple(tuple.ref());
     }
 
-    DecodeState s(filename, file, false, stream);
+    // the seek index from a scan is only needed without a Xing/Info or VBRI
+    // header, since mpg123 seeks by its table of contents otherwise
+    bool scan = false;
+    if (!stream && aud_get_bool("mpg123", "full_scan"))
+    {
+        MPEGHeaderInfo header;
+        scan = !read_mpeg_header(file, header) || !header.exact;
+
+        if (file.fseek(0, VFS_SEEK_SET) < 0)
+            return false;
+    }
+
+    DecodeState s(filename, file, false, stream, scan);
     if (!s.valid())
         return false;
 
+    // positions are frame numbers
+    SeekIndex seek_index(1);
+    if (!stream && !scan)
+    {
+        seek_index.load(filename);
+        restore_index(s.dec, seek_index);
+    }
+
     int bitrate = s.info.bitrate * 1000;
     int bitrate_sum = 0, bitrate_count = 0;
     int error_count = 0;
@@ -323,9 +480,11 @@ bool MPG123Plugin::play(const char * filename, VFSFile & file)
         set_playback_tuple(tuple.ref());
 
     open_audio(FMT_FLOAT, s.rate, s.channels);
+    prefetch.set_format(FMT_FLOAT, s.rate, s.channels);
 
     while (!check_stop())
     {
+        TRACE_SPAN("mpg123 play");
         int seek = check_seek();
 
         if (seek >= 0)
@@ -335,6 +494,7 @@ bool MPG123Plugin::play(const char * filename, VFSFile & file)
                 print_mpg123_error(filename, s.dec);
 
             s.bytes_read = 0;
+            prefetch.seeked(seek);
         }
 
         mpg123_info(s.dec, &s.info);
@@ -383,10 +543,14 @@ bool MPG123Plugin::play(const char * filename, VFSFile & file)
             error_count = 0;
 
             write_audio(s.buf, s.bytes_read);
+            prefetch.written(s.bytes_read);
             s.bytes_read = 0;
         }
     }
 
+    if (!stream && !scan)
+        store_index(s.dec, seek_index);
+
     return true;
 }
 
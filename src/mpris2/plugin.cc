@@ -161,7 +161,7 @@ static void add_g_variant_arr_str (const char * key_str,
     elems.append (g_variant_new_dict_entry (key, var));
 }
 
-static void update_metadata (void * data, GObject * object)
+static void publish_metadata (GObject * object, bool reload_art)
 {
     MPRIS2Metadata meta;
 
@@ -196,12 +196,19 @@ static void update_metadata (void * data, GObject * object)
         }
     }
 
-    if (meta == last_meta)
-        return;
-
-    if (meta.file != last_meta.file)
+    /* the reference to the art is kept for as long as the song plays, so
+     * the core's cache holds it and it is requested once */
+    if (meta.file != last_meta.file || reload_art)
         meta.image =
             meta.file ? aud_art_request (meta.file, AUD_ART_FILE) : AudArtPtr ();
+    else
+        meta.image = std::move (last_meta.image);
+
+    if (meta == last_meta && ! reload_art)
+    {
+        last_meta.image = std::move (meta.image);
+        return;
+    }
 
     Index<GVariant *> elems;
 
@@ -248,6 +255,18 @@ static void update_metadata (void * data, GObject * object)
     last_meta = std::move (meta);
 }
 
+static void update_metadata (void * data, GObject * object)
+{
+    publish_metadata (object, false);
+}
+
+/* the art of the song playing was not loaded yet when it was requested */
+static void art_ready (void * filename, GObject * object)
+{
+    if (last_meta.file && filename && ! strcmp ((const char *) filename, last_meta.file))
+        publish_metadata (object, true);
+}
+
 static void volume_changed (GObject * object)
 {
     double vol;
@@ -255,24 +274,42 @@ static void volume_changed (GObject * object)
     aud_drct_set_volume_main (round (vol * 100));
 }
 
-static void update (void * object)
+/* Position is not signalled (clients extrapolate it from the playback
+ * status and the rate), so it is set when it jumps and whenever a client
+ * reads the properties; nothing is polled for it. */
+static void update_position (GObject * object)
 {
     int64_t pos = 0;
-    int vol = 0;
 
     if (aud_drct_get_playing () && aud_drct_get_ready ())
         pos = (int64_t) aud_drct_get_time () * 1000;
 
-    vol = aud_drct_get_volume_main ();
+    g_object_set (object, "position", pos, nullptr);
+}
+
+/* The core has no hook for the volume, so it is looked at once a second
+ * while playing, and published only when it has changed. */
+static int last_volume = -1;
+
+static void update_volume (void * object)
+{
+    int vol = aud_drct_get_volume_main ();
+    if (vol == last_volume)
+        return;
+
+    last_volume = vol;
 
     g_signal_handlers_block_by_func (object, (void *) volume_changed, nullptr);
-    g_object_set ((GObject *) object, "position", pos, "volume", (double) vol / 100, nullptr);
+    g_object_set ((GObject *) object, "volume", (double) vol / 100, nullptr);
     g_signal_handlers_unblock_by_func (object, (void *) volume_changed, nullptr);
 }
 
+static bool volume_timer = false;
+
 static void update_playback_status (void * data, GObject * object)
 {
     const char * status;
+    bool playing = aud_drct_get_playing () && ! aud_drct_get_paused ();
 
     if (aud_drct_get_playing ())
         status = aud_drct_get_paused () ? "Paused" : "Playing";
@@ -280,14 +317,36 @@ static void update_playback_status (void * data, GObject * object)
         status = "Stopped";
 
     g_object_set (object, "playback-status", status, nullptr);
-    update (object);
+    update_position (object);
+    update_volume (object);
+
+    if (playing && ! volume_timer)
+        timer_add (TimerRate::Hz1, update_volume, object);
+    else if (! playing && volume_timer)
+        timer_remove (TimerRate::Hz1, update_volume, object);
+
+    volume_timer = playing;
 }
 
 static void emit_seek (void * data, GObject * object)
 {
+    update_position (object);
     g_signal_emit_by_name (object, "seeked", (int64_t) aud_drct_get_time () * 1000);
 }
 
+/* Called for every method, including Get and GetAll of the properties,
+ * before the skeleton answers.  GIO runs it on a worker thread, where
+ * aud_drct_get_time() is safe, and the skeleton's properties are locked. */
+static gboolean authorize_cb (GDBusInterfaceSkeleton * object,
+ GDBusMethodInvocation * call, void * unused)
+{
+    if (! strcmp (g_dbus_method_invocation_get_interface_name (call),
+     "org.freedesktop.DBus.Properties"))
+        update_position ((GObject *) object);
+
+    return true;
+}
+
 static gboolean next_cb (MprisMediaPlayer2Player * object, GDBusMethodInvocation *
  call, void * unused)
 {
@@ -376,11 +435,16 @@ void MPRIS2Plugin::cleanup ()
     hook_dissociate ("playback ready", (HookFunction) update_metadata);
     hook_dissociate ("playback stop", (HookFunction) update_metadata);
     hook_dissociate ("tuple change", (HookFunction) update_metadata);
+    hook_dissociate ("current art ready", (HookFunction) art_ready);
 
     hook_dissociate ("playback ready", (HookFunction) emit_seek);
     hook_dissociate ("playback seek", (HookFunction) emit_seek);
 
-    timer_remove (TimerRate::Hz4, update, object_player);
+    if (volume_timer)
+        timer_remove (TimerRate::Hz1, update_volume, object_player);
+
+    volume_timer = false;
+    last_volume = -1;
 
     g_object_unref (object_core);
     g_object_unref (object_player);
@@ -445,12 +509,11 @@ bool MPRIS2Plugin::init ()
     hook_associate ("playback ready", (HookFunction) update_metadata, object_player);
     hook_associate ("playback stop", (HookFunction) update_metadata, object_player);
     hook_associate ("tuple change", (HookFunction) update_metadata, object_player);
+    hook_associate ("current art ready", (HookFunction) art_ready, object_player);
 
     hook_associate ("playback ready", (HookFunction) emit_seek, object_player);
     hook_associate ("playback seek", (HookFunction) emit_seek, object_player);
 
-    timer_add (TimerRate::Hz4, update, object_player);
-
     g_signal_connect (object_player, "handle-next", (GCallback) next_cb, nullptr);
     g_signal_connect (object_player, "handle-pause", (GCallback) pause_cb, nullptr);
     g_signal_connect (object_player, "handle-play", (GCallback) play_cb, nullptr);
@@ -461,6 +524,7 @@ bool MPRIS2Plugin::init ()
     g_signal_connect (object_player, "handle-stop", (GCallback) stop_cb, nullptr);
 
     g_signal_connect (object_player, "notify::volume", (GCallback) volume_changed, nullptr);
+    g_signal_connect (object_player, "g-authorize-method", (GCallback) authorize_cb, nullptr);
 
     if (! g_dbus_interface_skeleton_export ((GDBusInterfaceSkeleton *)
      object_core, bus, "/org/mpris/MediaPlayer2", & error) ||
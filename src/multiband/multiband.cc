@@ -0,0 +1,620 @@
+/*
+ * Multiband Compression Plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/ringbuf.h>
+#include <libaudcore/runtime.h>
+
+#include "../effect-common/lookahead-peak.h"
+#include "../trace-common/trace.h"
+
+#define MAX_BANDS 5
+#define MAX_LANES 8             /* MAX_BANDS in whole vectors of four */
+#define LOOKAHEAD_MS 5          /* of the limiter, and so the latency */
+#define LIMITER_RELEASE 0.05f   /* seconds */
+#define MIN_LEVEL 1e-9f         /* -180 dB, to keep log2() finite */
+
+/* -360 dB of DC, which keeps the filters out of denormals in silence */
+#define ANTI_DENORMAL 1e-18
+
+/* from dB to the log2 of the amplitude */
+#define DB_TO_LOG2 0.16609640f
+
+static const char * const multiband_defaults[] = {
+    "bands", "3",
+    "crossover1", "200",
+    "crossover2", "2000",
+    "crossover3", "6000",
+    "crossover4", "12000",
+    "threshold1", "-20",
+    "threshold2", "-20",
+    "threshold3", "-20",
+    "threshold4", "-20",
+    "threshold5", "-20",
+    "ratio", "3",
+    "attack", "10",
+    "release", "150",
+    "gain", "0",
+    "limiter", "TRUE",
+    "ceiling", "-1",
+    nullptr
+};
+
+static const char * const crossover_names[MAX_BANDS - 1] = {
+    "crossover1", "crossover2", "crossover3", "crossover4"
+};
+
+static const char * const threshold_names[MAX_BANDS] = {
+    "threshold1", "threshold2", "threshold3", "threshold4", "threshold5"
+};
+
+static const PreferencesWidget multiband_widgets[] = {
+    WidgetLabel (N_("<b>Bands</b>")),
+    WidgetSpin (N_("Bands:"),
+        WidgetInt ("multiband", "bands"),
+        {3, MAX_BANDS, 1}),
+    WidgetSpin (N_("Crossover 1:"),
+        WidgetInt ("multiband", "crossover1"),
+        {20, 20000, 10, N_("Hz")}),
+    WidgetSpin (N_("Crossover 2:"),
+        WidgetInt ("multiband", "crossover2"),
+        {20, 20000, 10, N_("Hz")}),
+    WidgetSpin (N_("Crossover 3 (4 or 5 bands):"),
+        WidgetInt ("multiband", "crossover3"),
+        {20, 20000, 10, N_("Hz")}),
+    WidgetSpin (N_("Crossover 4 (5 bands):"),
+        WidgetInt ("multiband", "crossover4"),
+        {20, 20000, 10, N_("Hz")}),
+    WidgetLabel (N_("<b>Compression</b>")),
+    WidgetSpin (N_("Threshold of band 1:"),
+        WidgetFloat ("multiband", "threshold1"),
+        {-60, 0, 0.5, N_("dB")}),
+    WidgetSpin (N_("Threshold of band 2:"),
+        WidgetFloat ("multiband", "threshold2"),
+        {-60, 0, 0.5, N_("dB")}),
+    WidgetSpin (N_("Threshold of band 3:"),
+        WidgetFloat ("multiband", "threshold3"),
+        {-60, 0, 0.5, N_("dB")}),
+    WidgetSpin (N_("Threshold of band 4:"),
+        WidgetFloat ("multiband", "threshold4"),
+        {-60, 0, 0.5, N_("dB")}),
+    WidgetSpin (N_("Threshold of band 5:"),
+        WidgetFloat ("multiband", "threshold5"),
+        {-60, 0, 0.5, N_("dB")}),
+    WidgetSpin (N_("Ratio:"),
+        WidgetFloat ("multiband", "ratio"),
+        {1, 20, 0.5}),
+    WidgetSpin (N_("Attack:"),
+        WidgetFloat ("multiband", "attack"),
+        {0.1, 200, 0.1, N_("ms")}),
+    WidgetSpin (N_("Release:"),
+        WidgetFloat ("multiband", "release"),
+        {10, 2000, 10, N_("ms")}),
+    WidgetSpin (N_("Makeup gain:"),
+        WidgetFloat ("multiband", "gain"),
+        {0, 24, 0.5, N_("dB")}),
+    WidgetLabel (N_("<b>Limiter</b>")),
+    WidgetCheck (N_("Limit peaks (5 ms latency)"),
+        WidgetBool ("multiband", "limiter")),
+    WidgetSpin (N_("Ceiling:"),
+        WidgetFloat ("multiband", "ceiling"),
+        {-12, 0, 0.1, N_("dB")},
+        WIDGET_CHILD)
+};
+
+static const PluginPreferences multiband_prefs = {{multiband_widgets}};
+
+static const char multiband_about[] =
+ N_("Multiband Compression Plugin for Audacious\n"
+    "Copyright 2026 Audacious Plugins Authors\n\n"
+    "Splits the audio into 3 to 5 bands with Linkwitz-Riley crossovers, "
+    "which add back up to the input when nothing is compressed, and "
+    "compresses each band on its own.  The number of bands, the crossovers "
+    "and the limiter take effect with the next song.");
+
+class Multiband : public EffectPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("Multiband Compressor"),
+        PACKAGE,
+        multiband_about,
+        & multiband_prefs
+    };
+
+    constexpr Multiband () : EffectPlugin (info, 0, true) {}
+
+    bool init () override;
+    void cleanup () override;
+
+    void start (int & channels, int & rate) override;
+    Index<float> & process (Index<float> & data) override;
+    bool flush (bool force) override;
+    Index<float> & finish (Index<float> & data, bool end_of_playlist) override;
+    int adjust_delay (int delay) override;
+};
+
+EXPORT Multiband aud_plugin_instance;
+
+/* Each crossover is a 4th order Linkwitz-Riley lowpass and highpass, both
+ * two 2nd order Butterworth sections.  Their sum is the 2nd order allpass
+ * at the same frequency, so the input is split at the lowest crossover,
+ * what is above it at the next one, and so on; and each band goes through
+ * the allpasses of the crossovers it did not, after which all of them have
+ * the same phase and add back up to the input. */
+
+struct Biquad
+{
+    double b0, b1, b2, a1, a2;
+
+    /* transposed direct form II */
+    double run (double x, double * z) const
+    {
+        double y = b0 * x + z[0];
+        z[0] = b1 * x - a1 * y + z[1];
+        z[1] = b2 * x - a2 * y;
+        return y;
+    }
+};
+
+struct Crossover
+{
+    Biquad low, high, all;
+};
+
+struct ChannelState
+{
+    double low[MAX_BANDS - 1][2][2];
+    double high[MAX_BANDS - 1][2][2];
+    double all[MAX_BANDS - 1][MAX_BANDS - 1][2];  /* [band][crossover] */
+};
+
+static int current_channels, current_rate;
+static int bands, lanes;
+static Crossover crossovers[MAX_BANDS - 1];
+static ChannelState states[AUD_MAX_CHANNELS];
+
+/* The envelope followers and gain computers of all bands run side by side,
+ * a band in each lane, on the level of the loudest channel in the band.
+ * The lanes past the last band stay silent. */
+
+static float band_out[AUD_MAX_CHANNELS][MAX_LANES];
+static float level[MAX_LANES], envelope[MAX_LANES], gain[MAX_LANES];
+static float threshold[MAX_LANES];   /* log2 */
+static float attack, release, slope;
+static float makeup;
+
+/* The limiter holds each frame back for the lookahead, like the compressor
+ * does in its lookahead mode: a moving average of the loudest frame within
+ * the lookahead ramps the gain down, to just the ceiling as the loud frame
+ * comes out.  Once the first lookahead has passed, the latency stays the
+ * same. */
+
+static bool limiting;
+static int lookahead;           /* frames */
+static LookaheadPeak lookahead_peak;
+static float limit_envelope, limit_release, ceiling;
+static RingBuf<float> delayed;  /* frames not yet output */
+
+static Index<float> output;
+
+enum FilterType {Lowpass, Highpass, Allpass};
+
+/* Butterworth (Q = 1/sqrt(2)) sections from the Audio EQ Cookbook */
+static Biquad design (FilterType type, double freq, int rate)
+{
+    double w = 2 * M_PI * freq / rate;
+    double cw = cos (w);
+    double alpha = sin (w) * M_SQRT1_2;
+    double a0 = 1 + alpha;
+    double b0, b1, b2;
+
+    switch (type)
+    {
+    case Lowpass:
+        b0 = b2 = (1 - cw) / 2;
+        b1 = 1 - cw;
+        break;
+    case Highpass:
+        b0 = b2 = (1 + cw) / 2;
+        b1 = -(1 + cw);
+        break;
+    default:
+        b0 = 1 - alpha;
+        b1 = -2 * cw;
+        b2 = 1 + alpha;
+        break;
+    }
+
+    return {b0 / a0, b1 / a0, b2 / a0, -2 * cw / a0, (1 - alpha) / a0};
+}
+
+static void split (ChannelState & state, float in, float * out)
+{
+    double rest = in + ANTI_DENORMAL;
+
+    for (int i = 0; i < bands - 1; i ++)
+    {
+        const Crossover & x = crossovers[i];
+
+        double low = x.low.run (x.low.run (rest, state.low[i][0]), state.low[i][1]);
+        rest = x.high.run (x.high.run (rest, state.high[i][0]), state.high[i][1]);
+
+        for (int j = i + 1; j < bands - 1; j ++)
+            low = crossovers[j].all.run (low, state.all[i][j]);
+
+        out[i] = low;
+    }
+
+    out[bands - 1] = rest;
+}
+
+/* log2() and exp2() to about 1e-4 and 4e-6, with polynomials over the
+ * mantissa and the fraction; the vector and scalar versions give the same
+ * results */
+
+#define LOG2_POLY(m, mul, add, set) \
+    add (mul (add (mul (add (mul (add (mul (set (-0.080010869f), m), \
+     set (0.63551107f)), m), set (-2.0994022f)), m), set (4.0496168f)), m), \
+     set (-2.5056146f))
+
+#define EXP2_POLY(f, mul, add, set) \
+    add (mul (add (mul (add (mul (add (mul (set (0.013683983f), f), \
+     set (0.051717735f)), f), set (0.24162132f)), f), set (0.69296955f)), f), \
+     set (1.0000036f))
+
+#if defined(__SSE2__) || defined(__x86_64__)
+
+/* for x of at least MIN_LEVEL */
+static inline __m128 log2_ps (__m128 x)
+{
+    __m128i bits = _mm_castps_si128 (x);
+    __m128 e = _mm_cvtepi32_ps (_mm_sub_epi32 (_mm_srli_epi32 (bits, 23), _mm_set1_epi32 (127)));
+    __m128 m = _mm_castsi128_ps (_mm_or_si128 (_mm_and_si128 (bits,
+     _mm_set1_epi32 (0x7fffff)), _mm_set1_epi32 (0x3f800000)));
+
+    return _mm_add_ps (e, LOG2_POLY (m, _mm_mul_ps, _mm_add_ps, _mm_set1_ps));
+}
+
+/* for x of at most 0 */
+static inline __m128 exp2_ps (__m128 x)
+{
+    x = _mm_max_ps (x, _mm_set1_ps (-126));
+
+    /* floor(), from the truncation toward zero */
+    __m128i i = _mm_cvttps_epi32 (x);
+    __m128 fi = _mm_cvtepi32_ps (i);
+    __m128 above = _mm_cmpgt_ps (fi, x);
+    i = _mm_add_epi32 (i, _mm_castps_si128 (above));
+    fi = _mm_sub_ps (fi, _mm_and_ps (above, _mm_set1_ps (1)));
+
+    __m128 f = _mm_sub_ps (x, fi);
+    __m128 scale = _mm_castsi128_ps (_mm_slli_epi32 (_mm_add_epi32 (i, _mm_set1_epi32 (127)), 23));
+
+    return _mm_mul_ps (EXP2_POLY (f, _mm_mul_ps, _mm_add_ps, _mm_set1_ps), scale);
+}
+
+static void measure (int channels)
+{
+    const __m128 sign = _mm_set1_ps (-0.0f);
+
+    for (int i = 0; i < lanes; i += 4)
+    {
+        __m128 peak = _mm_setzero_ps ();
+        for (int c = 0; c < channels; c ++)
+            peak = _mm_max_ps (peak, _mm_andnot_ps (sign, _mm_loadu_ps (band_out[c] + i)));
+
+        _mm_storeu_ps (level + i, peak);
+    }
+}
+
+static void update_gains ()
+{
+    const __m128 zero = _mm_setzero_ps ();
+    const __m128 min_level = _mm_set1_ps (MIN_LEVEL);
+    const __m128 att = _mm_set1_ps (attack);
+    const __m128 rel = _mm_set1_ps (release);
+    const __m128 k = _mm_set1_ps (slope);
+
+    for (int i = 0; i < lanes; i += 4)
+    {
+        __m128 in = _mm_loadu_ps (level + i);
+        __m128 env = _mm_loadu_ps (envelope + i);
+
+        __m128 rising = _mm_cmpgt_ps (in, env);
+        __m128 coef = _mm_or_ps (_mm_and_ps (rising, att), _mm_andnot_ps (rising, rel));
+        env = _mm_add_ps (in, _mm_mul_ps (coef, _mm_sub_ps (env, in)));
+        _mm_storeu_ps (envelope + i, env);
+
+        __m128 over = _mm_sub_ps (log2_ps (_mm_max_ps (env, min_level)), _mm_loadu_ps (threshold + i));
+        _mm_storeu_ps (gain + i, exp2_ps (_mm_mul_ps (_mm_max_ps (over, zero), k)));
+    }
+}
+
+static float mix (const float * band)
+{
+    __m128 sum = _mm_setzero_ps ();
+    for (int i = 0; i < lanes; i += 4)
+        sum = _mm_add_ps (sum, _mm_mul_ps (_mm_loadu_ps (band + i), _mm_loadu_ps (gain + i)));
+
+    sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+    sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 1));
+    return _mm_cvtss_f32 (sum);
+}
+
+#else
+
+#define MUL(a, b) ((a) * (b))
+#define ADD(a, b) ((a) + (b))
+#define SET(a) (a)
+
+static inline float log2_fast (float x)
+{
+    uint32_t bits;
+    memcpy (& bits, & x, sizeof bits);
+
+    float e = (int) (bits >> 23) - 127;
+    bits = (bits & 0x7fffff) | 0x3f800000;
+
+    float m;
+    memcpy (& m, & bits, sizeof m);
+
+    return e + LOG2_POLY (m, MUL, ADD, SET);
+}
+
+static inline float exp2_fast (float x)
+{
+    x = aud::max (x, -126.0f);
+
+    float fi = floorf (x);
+    float f = x - fi;
+    uint32_t bits = (uint32_t) ((int) fi + 127) << 23;
+
+    float scale;
+    memcpy (& scale, & bits, sizeof scale);
+
+    return EXP2_POLY (f, MUL, ADD, SET) * scale;
+}
+
+static void measure (int channels)
+{
+    for (int i = 0; i < lanes; i ++)
+    {
+        float peak = 0;
+        for (int c = 0; c < channels; c ++)
+            peak = aud::max (peak, fabsf (band_out[c][i]));
+
+        level[i] = peak;
+    }
+}
+
+static void update_gains ()
+{
+    for (int i = 0; i < lanes; i ++)
+    {
+        float coef = (level[i] > envelope[i]) ? attack : release;
+        envelope[i] = level[i] + coef * (envelope[i] - level[i]);
+
+        float over = log2_fast (aud::max (envelope[i], MIN_LEVEL)) - threshold[i];
+        gain[i] = exp2_fast (aud::max (over, 0.0f) * slope);
+    }
+}
+
+static float mix (const float * band)
+{
+    float sum = 0;
+    for (int i = 0; i < lanes; i ++)
+        sum += band[i] * gain[i];
+
+    return sum;
+}
+
+#endif
+
+static void read_settings ()
+{
+    for (int b = 0; b < bands; b ++)
+    {
+        float db = aud_get_double ("multiband", threshold_names[b]);
+        threshold[b] = aud::clamp (db, -60.0f, 0.0f) * DB_TO_LOG2;
+    }
+
+    float ratio = aud::clamp (aud_get_double ("multiband", "ratio"), 1.0, 20.0);
+    float attack_ms = aud::clamp (aud_get_double ("multiband", "attack"), 0.1, 200.0);
+    float release_ms = aud::clamp (aud_get_double ("multiband", "release"), 10.0, 2000.0);
+    float gain_db = aud::clamp (aud_get_double ("multiband", "gain"), 0.0, 24.0);
+    float ceiling_db = aud::clamp (aud_get_double ("multiband", "ceiling"), -12.0, 0.0);
+
+    slope = 1 / ratio - 1;
+    attack = expf (-1000 / (attack_ms * current_rate));
+    release = expf (-1000 / (release_ms * current_rate));
+    makeup = powf (10, gain_db / 20);
+    ceiling = powf (10, ceiling_db / 20);
+}
+
+/* false while the lookahead fills up */
+static bool limit (float * frame, int channels)
+{
+    float loudest = 0;
+    for (int c = 0; c < channels; c ++)
+        loudest = aud::max (loudest, fabsf (frame[c]));
+
+    float average = lookahead_peak.push (loudest);
+    limit_envelope = aud::max (average, limit_envelope * limit_release);
+
+    if (delayed.len () < delayed.size ())
+    {
+        delayed.copy_in (frame, channels);
+        return false;
+    }
+
+    float amp = (limit_envelope > ceiling) ? ceiling / limit_envelope : 1.0f;
+    float out[AUD_MAX_CHANNELS];
+
+    delayed.move_out (out, channels);
+    delayed.copy_in (frame, channels);
+
+    for (int c = 0; c < channels; c ++)
+        frame[c] = out[c] * amp;
+
+    return true;
+}
+
+static void process_frames (const float * data, int frames)
+{
+    int channels = current_channels;
+    float frame[AUD_MAX_CHANNELS];
+
+    int out = output.len ();
+    output.resize (out + frames * channels);
+
+    for (int f = 0; f < frames; f ++, data += channels)
+    {
+        for (int c = 0; c < channels; c ++)
+            split (states[c], data[c], band_out[c]);
+
+        measure (channels);
+        update_gains ();
+
+        for (int c = 0; c < channels; c ++)
+            frame[c] = mix (band_out[c]) * makeup;
+
+        if (limiting && ! limit (frame, channels))
+            continue;
+
+        for (int c = 0; c < channels; c ++)
+            output[out ++] = frame[c];
+    }
+
+    output.resize (out);
+}
+
+bool Multiband::init ()
+{
+    aud_config_set_defaults ("multiband", multiband_defaults);
+    return true;
+}
+
+void Multiband::cleanup ()
+{
+    delayed.destroy ();
+    lookahead_peak.clear ();
+    output.clear ();
+}
+
+void Multiband::start (int & channels, int & rate)
+{
+    current_channels = channels;
+    current_rate = rate;
+
+    bands = aud::clamp (aud_get_int ("multiband", "bands"), 3, MAX_BANDS);
+    lanes = (bands + 3) & ~3;
+
+    /* in order, and below the Nyquist frequency */
+    double freq = 0;
+    for (int i = 0; i < bands - 1; i ++)
+    {
+        int setting = aud_get_int ("multiband", crossover_names[i]);
+        freq = aud::clamp ((double) setting, aud::max (freq, 20.0), rate * 0.45);
+
+        crossovers[i].low = design (Lowpass, freq, rate);
+        crossovers[i].high = design (Highpass, freq, rate);
+        crossovers[i].all = design (Allpass, freq, rate);
+    }
+
+    memset (band_out, 0, sizeof band_out);
+    memset (threshold, 0, sizeof threshold);
+
+    limiting = aud_get_bool ("multiband", "limiter");
+
+    if (limiting)
+    {
+        lookahead = aud::max (1, aud::rescale (LOOKAHEAD_MS, 1000, rate));
+
+        lookahead_peak.init (lookahead);
+        delayed.alloc (lookahead * channels);
+
+        limit_release = expf (-1 / (rate * LIMITER_RELEASE));
+    }
+    else
+    {
+        delayed.destroy ();
+        lookahead_peak.clear ();
+    }
+
+    flush (true);
+}
+
+Index<float> & Multiband::process (Index<float> & data)
+{
+    TRACE_SPAN ("Multiband Compressor process");
+
+    read_settings ();
+
+    output.resize (0);
+    process_frames (data.begin (), data.len () / current_channels);
+    return output;
+}
+
+bool Multiband::flush (bool force)
+{
+    memset (states, 0, sizeof states);
+    memset (envelope, 0, sizeof envelope);
+
+    lookahead_peak.reset ();
+    limit_envelope = 0;
+    delayed.discard ();
+
+    return true;
+}
+
+Index<float> & Multiband::finish (Index<float> & data, bool end_of_playlist)
+{
+    read_settings ();
+
+    output.resize (0);
+    process_frames (data.begin (), data.len () / current_channels);
+
+    if (limiting)
+    {
+        /* whatever is left sees silence ahead of it */
+        Index<float> silence;
+        silence.resize (delayed.len ());
+        silence.erase (0, -1);
+        process_frames (silence.begin (), silence.len () / current_channels);
+    }
+
+    flush (true);
+    return output;
+}
+
+int Multiband::adjust_delay (int delay)
+{
+    return delay + aud::rescale<int64_t> (delayed.len () / current_channels, current_rate, 1000);
+}
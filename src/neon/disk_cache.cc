@@ -0,0 +1,409 @@
+/*
+ *  Persistent cache of remote files
+ *  Copyright (C) 2024 Audacious Plugins Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/index.h>
+#include <libaudcore/runtime.h>
+
+#include "disk_cache.h"
+#include "../vfs-common/atomic-file.h"
+
+#define INDEX_HEADER "Audacious neon cache 1"
+
+struct Span
+{
+    int64_t start, end;
+};
+
+struct DiskCacheEntry
+{
+    String url;
+    String base;            /* path of the files, without suffix */
+    int64_t size = -1;
+    String validator;
+    String content_type;
+    Index<Span> spans;      /* sorted, neither overlapping nor adjacent */
+
+    FILE * data = nullptr;
+    int refs = 0;
+
+    bool complete () const
+        { return spans.len () == 1 && spans[0].start == 0 && spans[0].end == size; }
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Index<DiskCacheEntry *> open_entries;
+
+static int64_t cache_limit ()
+{
+    return (int64_t) 1024 * 1024 * aud_get_int ("neon", "disk_cache_mb");
+}
+
+static StringBuf cache_dir ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "neon-cache"});
+}
+
+static StringBuf entry_path (const DiskCacheEntry * entry, const char * suffix)
+{
+    return str_concat ({entry->base, suffix});
+}
+
+static void add_span (Index<Span> & spans, int64_t start, int64_t end)
+{
+    int i = 0;
+    while (i < spans.len () && spans[i].end < start)
+        i ++;
+
+    int j = i;
+    while (j < spans.len () && spans[j].start <= end)
+    {
+        start = aud::min (start, spans[j].start);
+        end = aud::max (end, spans[j].end);
+        j ++;
+    }
+
+    spans.remove (i, j - i);
+    spans.insert (i, 1);
+    spans[i] = {start, end};
+}
+
+static const Span * find_span (const DiskCacheEntry * entry, int64_t pos)
+{
+    for (const Span & span : entry->spans)
+    {
+        if (span.start <= pos && pos < span.end)
+            return & span;
+    }
+
+    return nullptr;
+}
+
+/* called with cache_mutex held */
+static void load_index (DiskCacheEntry * entry)
+{
+    char * contents = nullptr;
+    if (! g_file_get_contents (entry_path (entry, ".index"), & contents, nullptr, nullptr))
+        return;
+
+    char * * lines = g_strsplit (contents, "\n", -1);
+    g_free (contents);
+
+    int n_lines = g_strv_length (lines);
+
+    if (n_lines >= 5 && ! strcmp (lines[0], INDEX_HEADER) && ! strcmp (lines[1], entry->url))
+    {
+        entry->size = str_to_int64 (lines[2]);
+        entry->validator = String (lines[3]);
+        entry->content_type = String (lines[4]);
+
+        for (int i = 5; i < n_lines; i ++)
+        {
+            int64_t start, end;
+            if (sscanf (lines[i], "%" SCNd64 " %" SCNd64, & start, & end) == 2 &&
+             start >= 0 && start < end && end <= entry->size)
+                add_span (entry->spans, start, end);
+        }
+    }
+
+    g_strfreev (lines);
+
+    /* the index is of no use without the data */
+    StringBuf data_path = entry_path (entry, ".data");
+    if (entry->spans.len () && ! (entry->data = g_fopen (data_path, "r+b")))
+        entry->spans.clear ();
+}
+
+static void save_index (DiskCacheEntry * entry)
+{
+    write_file_atomic (entry_path (entry, ".index"), [entry] (FILE * file) {
+        fprintf (file, "%s\n%s\n%" PRId64 "\n%s\n%s\n", INDEX_HEADER,
+         (const char *) entry->url, entry->size, (const char *) entry->validator,
+         (const char *) entry->content_type);
+
+        for (const Span & span : entry->spans)
+            fprintf (file, "%" PRId64 " %" PRId64 "\n", span.start, span.end);
+    });
+}
+
+static bool is_open (const char * base)
+{
+    for (DiskCacheEntry * entry : open_entries)
+    {
+        if (! strcmp (entry->base, base))
+            return true;
+    }
+
+    return false;
+}
+
+struct CachedFile
+{
+    String base;
+    int64_t used;     /* mtime of the index */
+    int64_t bytes;    /* on disk, which for a sparse file is less than its size */
+
+    CachedFile (String && base, int64_t used, int64_t bytes) :
+        base (std::move (base)), used (used), bytes (bytes) {}
+};
+
+/* called with cache_mutex held; files in use are left alone */
+static void trim_cache (int64_t limit)
+{
+    StringBuf dir_path = cache_dir ();
+    GDir * dir = g_dir_open (dir_path, 0, nullptr);
+    if (! dir)
+        return;
+
+    Index<CachedFile> files;
+    int64_t total = 0;
+    const char * name;
+
+    while ((name = g_dir_read_name (dir)))
+    {
+        if (! str_has_suffix_nocase (name, ".index"))
+            continue;
+
+        StringBuf base = filename_build ({dir_path, str_copy (name, strlen (name) - 6)});
+        GStatBuf index_st, data_st;
+
+        if (g_stat (str_concat ({base, ".index"}), & index_st) < 0)
+            continue;
+
+        int64_t bytes = 0;
+        if (g_stat (str_concat ({base, ".data"}), & data_st) == 0)
+#ifdef _WIN32
+            bytes = data_st.st_size;
+#else
+            bytes = (int64_t) data_st.st_blocks * 512;
+#endif
+
+        total += bytes;
+
+        if (! is_open (base))
+            files.append (String (base), (int64_t) index_st.st_mtime, bytes);
+    }
+
+    g_dir_close (dir);
+
+    if (total <= limit)
+        return;
+
+    files.sort ([] (const CachedFile & a, const CachedFile & b)
+        { return (a.used > b.used) - (a.used < b.used); });
+
+    for (const CachedFile & file : files)
+    {
+        if (total <= limit)
+            break;
+
+        AUDDBG ("Removing %s from the cache\n", (const char *) file.base);
+        g_remove (str_concat ({file.base, ".data"}));
+        g_remove (str_concat ({file.base, ".index"}));
+        total -= file.bytes;
+    }
+}
+
+/* called with cache_mutex held */
+static DiskCacheEntry * get_entry (const char * url)
+{
+    for (DiskCacheEntry * entry : open_entries)
+    {
+        if (! strcmp (entry->url, url))
+        {
+            entry->refs ++;
+            return entry;
+        }
+    }
+
+    StringBuf dir_path = cache_dir ();
+    if (g_mkdir_with_parents (dir_path, 0755) < 0)
+        return nullptr;
+
+    char * hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, url, -1);
+
+    auto entry = new DiskCacheEntry ();
+    entry->url = String (url);
+    entry->base = String (filename_build ({dir_path, hash}));
+    entry->refs = 1;
+
+    g_free (hash);
+
+    load_index (entry);
+    open_entries.append (entry);
+
+    return entry;
+}
+
+/* called with cache_mutex held */
+static void put_entry (DiskCacheEntry * entry)
+{
+    if (-- entry->refs)
+        return;
+
+    /* saved even if unchanged, since its mtime tells when it was last used */
+    if (entry->size >= 0)
+        save_index (entry);
+
+    if (entry->data)
+        fclose (entry->data);
+
+    /* while still open, which keeps this entry from being removed */
+    trim_cache (cache_limit ());
+
+    open_entries.remove (open_entries.find (entry), 1);
+    delete entry;
+}
+
+DiskCacheEntry * disk_cache_get_complete (const char * url)
+{
+    if (cache_limit () <= 0)
+        return nullptr;
+
+    pthread_mutex_lock (& cache_mutex);
+
+    DiskCacheEntry * entry = get_entry (url);
+    if (entry && ! entry->complete ())
+    {
+        put_entry (entry);
+        entry = nullptr;
+    }
+
+    pthread_mutex_unlock (& cache_mutex);
+
+    if (entry)
+        AUDDBG ("Reading %s from the disk cache\n", url);
+
+    return entry;
+}
+
+DiskCacheEntry * disk_cache_get (const char * url, const char * validator,
+ int64_t size, const char * content_type)
+{
+    if (cache_limit () <= 0)
+        return nullptr;
+
+    pthread_mutex_lock (& cache_mutex);
+
+    DiskCacheEntry * entry = get_entry (url);
+
+    if (entry && (entry->size != size || ! entry->validator ||
+     strcmp (entry->validator, validator)))
+    {
+        if (entry->spans.len ())
+            AUDDBG ("%s has changed, dropping the cached copy\n", url);
+
+        entry->spans.clear ();
+        entry->size = size;
+        entry->validator = String (validator);
+
+        if (entry->data)
+            fclose (entry->data);
+
+        entry->data = g_fopen (entry_path (entry, ".data"), "w+b");
+    }
+    else if (entry && ! entry->data)
+    {
+        StringBuf data_path = entry_path (entry, ".data");
+        if (! (entry->data = g_fopen (data_path, "r+b")))
+            entry->data = g_fopen (data_path, "w+b");
+    }
+
+    if (entry && content_type)
+        entry->content_type = String (content_type);
+
+    pthread_mutex_unlock (& cache_mutex);
+
+    return entry;
+}
+
+void disk_cache_put (DiskCacheEntry * entry)
+{
+    pthread_mutex_lock (& cache_mutex);
+    put_entry (entry);
+    pthread_mutex_unlock (& cache_mutex);
+}
+
+int64_t disk_cache_size (DiskCacheEntry * entry)
+{
+    pthread_mutex_lock (& cache_mutex);
+    int64_t size = entry->size;
+    pthread_mutex_unlock (& cache_mutex);
+
+    return size;
+}
+
+String disk_cache_content_type (DiskCacheEntry * entry)
+{
+    pthread_mutex_lock (& cache_mutex);
+    String type = entry->content_type;
+    pthread_mutex_unlock (& cache_mutex);
+
+    return type;
+}
+
+bool disk_cache_has (DiskCacheEntry * entry, int64_t pos)
+{
+    pthread_mutex_lock (& cache_mutex);
+    bool found = entry->data && find_span (entry, pos);
+    pthread_mutex_unlock (& cache_mutex);
+
+    return found;
+}
+
+int64_t disk_cache_read (DiskCacheEntry * entry, int64_t pos, void * data, int64_t len)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    const Span * span = entry->data ? find_span (entry, pos) : nullptr;
+
+    if (span && fseeko (entry->data, pos, SEEK_SET) == 0)
+        len = fread (data, 1, aud::min (len, span->end - pos), entry->data);
+    else
+        len = 0;
+
+    pthread_mutex_unlock (& cache_mutex);
+
+    return len;
+}
+
+void disk_cache_write (DiskCacheEntry * entry, int64_t pos, const void * data, int64_t len)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    if (entry->data && pos >= 0 && pos + len <= entry->size &&
+     fseeko (entry->data, pos, SEEK_SET) == 0 &&
+     (int64_t) fwrite (data, 1, len, entry->data) == len)
+    {
+        add_span (entry->spans, pos, pos + len);
+    }
+
+    pthread_mutex_unlock (& cache_mutex);
+}
@@ -0,0 +1,64 @@
+/*
+ *  Persistent cache of remote files
+ *  Copyright (C) 2024 Audacious Plugins Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef NEON_DISK_CACHE_H
+#define NEON_DISK_CACHE_H
+
+#include <stdint.h>
+
+#include <libaudcore/objects.h>
+
+/* Whatever is read of a remote file that can be seeked in, and that the
+ * server gives an ETag or Last-Modified date for, is written to a sparse
+ * file in the user's config directory.  An index file next to it lists the
+ * byte ranges written so far, along with the URL, the size, the validator
+ * and the content type.
+ *
+ * A response whose validator or size differs from the stored one throws
+ * away what was stored.  A file whose whole content is on disk is opened
+ * without asking the server at all.
+ *
+ * The total size on disk is kept under the configured limit by removing
+ * the files used longest ago, whenever an entry is released.  Entries are
+ * shared by every open file with the same URL; all functions are safe to
+ * call from any thread. */
+
+struct DiskCacheEntry;
+
+/* returns nullptr unless the whole of the file is on disk */
+DiskCacheEntry * disk_cache_get_complete (const char * url);
+
+/* returns nullptr if the cache is disabled */
+DiskCacheEntry * disk_cache_get (const char * url, const char * validator,
+ int64_t size, const char * content_type);
+
+void disk_cache_put (DiskCacheEntry * entry);
+
+int64_t disk_cache_size (DiskCacheEntry * entry);
+String disk_cache_content_type (DiskCacheEntry * entry);
+
+/* true if a range holds the byte at pos */
+bool disk_cache_has (DiskCacheEntry * entry, int64_t pos);
+
+/* copies up to len bytes starting at pos and returns how many there were */
+int64_t disk_cache_read (DiskCacheEntry * entry, int64_t pos, void * data, int64_t len);
+
+void disk_cache_write (DiskCacheEntry * entry, int64_t pos, const void * data, int64_t len);
+
+#endif // NEON_DISK_CACHE_H
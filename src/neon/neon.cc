@@ -28,6 +28,7 @@
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
 #include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
@@ -45,6 +46,9 @@
 #endif
 
 #include "cert_verification.h"
+#include "disk_cache.h"
+#include "range_cache.h"
+#include "session_pool.h"
 
 #define NEON_NETBLKSIZE     (4096)
 #define NEON_ICY_BUFSIZE    (4096)
@@ -99,7 +103,16 @@ static const char * const neon_schemes[] = {"http", "https"};
 class NeonTransport : public TransportPlugin
 {
 public:
-    static constexpr PluginInfo info = {N_("Neon HTTP/HTTPS Plugin"), PACKAGE};
+    static const char * const defaults[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
+
+    static constexpr PluginInfo info = {
+        N_("Neon HTTP/HTTPS Plugin"),
+        PACKAGE,
+        nullptr,
+        & prefs
+    };
 
     constexpr NeonTransport () : TransportPlugin (info, neon_schemes) {}
 
@@ -111,8 +124,31 @@ public:
 
 EXPORT NeonTransport aud_plugin_instance;
 
+const char * const NeonTransport::defaults[] = {
+    "readahead_kb", "0",
+    "cache_kb", "1024",
+    "disk_cache_mb", "0",
+    nullptr
+};
+
+const PreferencesWidget NeonTransport::widgets[] = {
+    WidgetSpin (N_("Read-ahead:"),
+        WidgetInt ("neon", "readahead_kb"),
+        {0, 16384, 64, N_("KiB (0 = network buffer size)")}),
+    WidgetSpin (N_("Cache for seeks while probing:"),
+        WidgetInt ("neon", "cache_kb"),
+        {0, 65536, 256, N_("KiB (0 = disabled)")}),
+    WidgetSpin (N_("Disk cache:"),
+        WidgetInt ("neon", "disk_cache_mb"),
+        {0, 1048576, 64, N_("MiB (0 = disabled)")})
+};
+
+const PluginPreferences NeonTransport::prefs = {{widgets}};
+
 bool NeonTransport::init ()
 {
+    aud_config_set_defaults ("neon", defaults);
+
     int ret = ne_sock_init ();
 
     if (ret != 0)
@@ -126,6 +162,8 @@ bool NeonTransport::init ()
 
 void NeonTransport::cleanup ()
 {
+    session_pool_clear ();
+    range_cache_clear ();
     ne_sock_exit ();
 }
 
@@ -136,6 +174,7 @@ public:
     ~NeonFile () override;
 
     int open_handle (int64_t startbyte, String * error = nullptr);
+    bool open_cached ();
 
 protected:
     int64_t fread (void * ptr, int64_t size, int64_t nmemb) override;
@@ -168,28 +207,37 @@ private:
     int m_icy_len = 0;                  /* Bytes in current metadata block */
 
     bool m_eof = false;
+    bool m_from_cache = false;          /* true while reads are served from
+                                           the range or disk cache, with no
+                                           request */
+    int64_t m_record_left = 0;          /* Bytes still to be added to the
+                                           range cache since the last seek */
+    String m_validator;                 /* ETag or Last-Modified, if sent */
+    DiskCacheEntry * m_disk = nullptr;  /* Where the content is kept on disk */
 
     RingBuf<char> m_rb;           /* Ringbuffer for our data */
     Index<char> m_icy_buf;        /* Buffer for ICY metadata */
     icy_metadata m_icy_metadata;  /* Current ICY metadata */
 
-    ne_session * m_session = nullptr;
+    NeonSession * m_conn = nullptr;     /* From the pool, or created for us */
+    ne_session * m_session = nullptr;   /* m_conn->session */
     ne_request * m_request = nullptr;
+    bool m_request_done = false;        /* true once the whole response is read */
 
     pthread_t m_reader;
     reader_status m_reader_status;
 
     void kill_reader ();
-    int server_auth (const char * realm, int attempt, char * username, char * password);
     void handle_headers ();
+    void attach_disk_cache ();
+    void get_session ();
+    void put_session (bool reusable);
     int open_request (int64_t startbyte, String * error);
+    void end_request ();
     FillBufferResult fill_buffer ();
     void reader ();
     int64_t try_fread (void * ptr, int64_t size, int64_t nmemb, bool & data_read);
-
-    static int server_auth_callback (void * data, const char * realm, int attempt,
-     char * username, char * password)
-        { return ((NeonFile *) data)->server_auth (realm, attempt, username, password); }
+    int64_t read_cached (void * ptr, int64_t size, int64_t nmemb, bool & data_read);
 
     static void * reader_thread (void * data)
         { ((NeonFile *) data)->reader (); return nullptr; }
@@ -198,8 +246,11 @@ private:
 NeonFile::NeonFile (const char * url) :
     m_url (url)
 {
-    int buffer_kb = aud_get_int ("net_buffer_kb");
-    m_rb.alloc (1024 * aud::clamp (buffer_kb, 16, 1024));
+    int buffer_kb = aud_get_int ("neon", "readahead_kb");
+    if (! buffer_kb)
+        buffer_kb = aud_get_int ("net_buffer_kb");
+
+    m_rb.alloc (1024 * aud::clamp (buffer_kb, 16, 16384));
 }
 
 NeonFile::~NeonFile ()
@@ -207,10 +258,12 @@ NeonFile::~NeonFile ()
     if (m_reader_status.reading)
         kill_reader ();
 
-    if (m_request)
-        ne_request_destroy (m_request);
-    if (m_session)
-        ne_session_destroy (m_session);
+    end_request ();
+
+    if (m_conn)
+        put_session (true);
+    if (m_disk)
+        disk_cache_put (m_disk);
 
     ne_uri_free (& m_purl);
 }
@@ -331,15 +384,18 @@ void NeonFile::kill_reader ()
     AUDDBG ("Reader thread has died\n");
 }
 
-int NeonFile::server_auth (const char * realm, int attempt, char * username, char * password)
+static int server_auth_cb (void * userdata, const char * realm, int attempt,
+ char * username, char * password)
 {
-    if (! m_purl.userinfo || ! m_purl.userinfo[0])
+    auto conn = (NeonSession *) userdata;
+
+    if (! conn->userinfo[0])
     {
         AUDERR ("Authentication required, but no credentials set\n");
         return 1;
     }
 
-    char * * authtok = g_strsplit (m_purl.userinfo, ":", 2);
+    char * * authtok = g_strsplit (conn->userinfo, ":", 2);
 
     if (strlen (authtok[1]) > NE_ABUFSIZ - 1 || strlen (authtok[0]) > NE_ABUFSIZ - 1)
     {
@@ -394,6 +450,17 @@ void NeonFile::handle_headers ()
             else
                 AUDERR ("Invalid content length header: %s\n", value);
         }
+        else if (str_has_prefix_nocase (name, "etag"))
+        {
+            /* Tells whether what is cached on disk is still current */
+            m_validator = String (value);
+        }
+        else if (str_has_prefix_nocase (name, "last-modified"))
+        {
+            /* The same, if the server sends no ETag */
+            if (! m_validator)
+                m_validator = String (value);
+        }
         else if (str_has_prefix_nocase (name, "content-type"))
         {
             /* The server sent us a content type. Save it for later */
@@ -431,6 +498,38 @@ void NeonFile::handle_headers ()
     }
 }
 
+/* Only a file that can be seeked in has ranges worth keeping, and only a
+ * validator tells whether they are still current the next time. */
+void NeonFile::attach_disk_cache ()
+{
+    if (m_content_length < 0 || ! m_can_ranges || m_icy_metaint || ! m_validator)
+        return;
+
+    DiskCacheEntry * entry = disk_cache_get (m_url, m_validator,
+     m_content_start + m_content_length, m_icy_metadata.stream_contenttype);
+
+    if (m_disk)
+        disk_cache_put (m_disk);
+
+    m_disk = entry;
+}
+
+/* A file whose whole content is on disk is read from there, with no
+ * request at all. */
+bool NeonFile::open_cached ()
+{
+    if (! (m_disk = disk_cache_get_complete (m_url)))
+        return false;
+
+    m_content_start = 0;
+    m_content_length = disk_cache_size (m_disk);
+    m_can_ranges = true;
+    m_icy_metadata.stream_contenttype = disk_cache_content_type (m_disk);
+    m_from_cache = true;
+
+    return true;
+}
+
 static int neon_proxy_auth_cb (void * userdata, const char * realm, int attempt,
  char * username, char * password)
 {
@@ -506,7 +605,11 @@ int NeonFile::open_request (int64_t startbyte, String * error)
             AUDDBG ("<%p> URL opened OK\n", this);
             m_content_start = startbyte;
             m_pos = startbyte;
+            m_request_done = false;
+            m_record_left = RANGE_CACHE_RECORD;
+            m_validator = String ();
             handle_headers ();
+            attach_disk_cache ();
             return 0;
         }
 
@@ -573,9 +676,36 @@ static void trust_win32_root_certs (ne_session * m_session)
 }
 #endif
 
-int NeonFile::open_handle (int64_t startbyte, String * error)
+/* Sessions are told apart by everything that goes into setting one up. */
+static StringBuf session_key (const ne_uri & uri)
 {
-    int ret;
+    StringBuf key = str_printf ("%s://%s@%s:%d", uri.scheme,
+     uri.userinfo ? uri.userinfo : "", uri.host, uri.port);
+
+    if (aud_get_bool ("use_proxy"))
+    {
+        String proxy_host = aud_get_str ("proxy_host");
+        key.insert (-1, str_printf (" via %s:%d:%d:%d", (const char *) proxy_host,
+         aud_get_int ("proxy_port"), aud_get_bool ("socks_proxy"),
+         aud_get_int ("socks_type")));
+    }
+
+    return key;
+}
+
+void NeonFile::get_session ()
+{
+    if (! m_purl.port)
+        m_purl.port = ne_uri_defaultport (m_purl.scheme);
+
+    StringBuf key = session_key (m_purl);
+
+    if ((m_conn = session_pool_take (key)))
+    {
+        m_session = m_conn->session;
+        return;
+    }
+
     String proxy_host;
     int proxy_port = 0;
     String proxy_user (""); // ne_session_socks_proxy requires non NULL user and password
@@ -604,65 +734,109 @@ int NeonFile::open_handle (int64_t startbyte, String * error)
         }
     }
 
-    m_redircount = 0;
+    AUDDBG ("<%p> Creating session to %s://%s:%d\n", this,
+     m_purl.scheme, m_purl.host, m_purl.port);
 
-    AUDDBG ("<%p> Parsing URL\n", this);
+    m_conn = new NeonSession ();
+    m_conn->key = String (key);
+    m_conn->userinfo = String (m_purl.userinfo ? m_purl.userinfo : "");
 
-    if (ne_uri_parse (m_url, & m_purl) != 0)
-    {
-        if (error)
-            * error = String (_("Error parsing URL"));
+    m_session = m_conn->session = ne_session_create (m_purl.scheme,
+     m_purl.host, m_purl.port);
+    ne_redirect_register (m_session);
+    ne_add_server_auth (m_session, NE_AUTH_BASIC, server_auth_cb, m_conn);
+    ne_set_session_flag (m_session, NE_SESSFLAG_ICYPROTO, 1);
+    ne_set_session_flag (m_session, NE_SESSFLAG_PERSIST, 1);
+    ne_set_connect_timeout (m_session, 10);
+    ne_set_read_timeout (m_session, 10);
+    ne_set_useragent (m_session, "Audacious/" PACKAGE_VERSION);
 
-        AUDERR ("<%p> Could not parse URL '%s'\n", this, (const char *) m_url);
-        return -1;
-    }
-
-    while (m_redircount < 10)
+    if (use_proxy)
     {
-        if (! m_purl.port)
-            m_purl.port = ne_uri_defaultport (m_purl.scheme);
-
-        AUDDBG ("<%p> Creating session to %s://%s:%d\n", this,
-         m_purl.scheme, m_purl.host, m_purl.port);
-        m_session = ne_session_create (m_purl.scheme,
-         m_purl.host, m_purl.port);
-        ne_redirect_register (m_session);
-        ne_add_server_auth (m_session, NE_AUTH_BASIC, server_auth_callback, this);
-        ne_set_session_flag (m_session, NE_SESSFLAG_ICYPROTO, 1);
-        ne_set_session_flag (m_session, NE_SESSFLAG_PERSIST, 0);
-        ne_set_connect_timeout (m_session, 10);
-        ne_set_read_timeout (m_session, 10);
-        ne_set_useragent (m_session, "Audacious/" PACKAGE_VERSION);
-
-        if (use_proxy)
+        AUDDBG ("<%p> Using proxy: %s:%d\n", this, (const char *) proxy_host, proxy_port);
+        if (socks_proxy)
         {
-            AUDDBG ("<%p> Using proxy: %s:%d\n", this, (const char *) proxy_host, proxy_port);
-            if (socks_proxy)
-            {
-                ne_session_socks_proxy (m_session, socks_type, proxy_host, proxy_port, proxy_user, proxy_pass);
-            }
-            else
-            {
-                ne_session_proxy (m_session, proxy_host, proxy_port);
-            }
-
-            if (use_proxy_auth)
-            {
-                AUDDBG ("<%p> Using proxy authentication\n", this);
-                ne_add_proxy_auth (m_session, NE_AUTH_BASIC,
-                 neon_proxy_auth_cb, (void *) this);
-            }
+            ne_session_socks_proxy (m_session, socks_type, proxy_host, proxy_port, proxy_user, proxy_pass);
+        }
+        else
+        {
+            ne_session_proxy (m_session, proxy_host, proxy_port);
         }
 
-        if (! strcmp ("https", m_purl.scheme))
+        if (use_proxy_auth)
         {
-            ne_ssl_trust_default_ca (m_session);
+            AUDDBG ("<%p> Using proxy authentication\n", this);
+            ne_add_proxy_auth (m_session, NE_AUTH_BASIC,
+             neon_proxy_auth_cb, nullptr);
+        }
+    }
+
+    if (! strcmp ("https", m_purl.scheme))
+    {
+        ne_ssl_trust_default_ca (m_session);
 #ifdef _WIN32
-            trust_win32_root_certs (m_session);
+        trust_win32_root_certs (m_session);
 #endif
-            ne_ssl_set_verify (m_session,
-             neon_vfs_verify_environment_ssl_certs, m_session);
+        ne_ssl_set_verify (m_session,
+         neon_vfs_verify_environment_ssl_certs, m_session);
+    }
+}
+
+/* A session that failed is not reused. */
+void NeonFile::put_session (bool reusable)
+{
+    if (reusable)
+        session_pool_give (m_conn);
+    else
+        session_pool_destroy (m_conn);
+
+    m_conn = nullptr;
+    m_session = nullptr;
+}
+
+/* A response that was not read to the end leaves the connection in the
+ * middle of it, so the connection is closed.  The session stays for the
+ * next request. */
+void NeonFile::end_request ()
+{
+    if (! m_request)
+        return;
+
+    if (! m_request_done)
+        ne_close_connection (m_session);
+
+    ne_request_destroy (m_request);
+    m_request = nullptr;
+}
+
+/* After a seek, the session is still there, for the URL that we were
+ * redirected to if any. */
+int NeonFile::open_handle (int64_t startbyte, String * error)
+{
+    int ret;
+
+    if (! m_session)
+    {
+        m_redircount = 0;
+
+        AUDDBG ("<%p> Parsing URL\n", this);
+
+        ne_uri_free (& m_purl);
+
+        if (ne_uri_parse (m_url, & m_purl) != 0)
+        {
+            if (error)
+                * error = String (_("Error parsing URL"));
+
+            AUDERR ("<%p> Could not parse URL '%s'\n", this, (const char *) m_url);
+            return -1;
         }
+    }
+
+    while (m_redircount < 10)
+    {
+        if (! m_session)
+            get_session ();
 
         AUDDBG ("<%p> Creating request\n", this);
         ret = open_request (startbyte, error);
@@ -672,14 +846,12 @@ int NeonFile::open_handle (int64_t startbyte, String * error)
 
         if (ret == -1)
         {
-            ne_session_destroy (m_session);
-            m_session = nullptr;
+            put_session (false);
             return -1;
         }
 
         AUDDBG ("<%p> Following redirect...\n", this);
-        ne_session_destroy (m_session);
-        m_session = nullptr;
+        put_session (true);
     }
 
     /* If we get here, our redirect count exceeded */
@@ -695,6 +867,10 @@ FillBufferResult NeonFile::fill_buffer ()
     char buffer[NEON_NETBLKSIZE];
     int to_read;
 
+    /* the response was read to the end already */
+    if (m_request_done)
+        return FILL_BUFFER_EOF;
+
     pthread_mutex_lock (& m_reader_status.mutex);
     to_read = aud::min (m_rb.space (), NEON_NETBLKSIZE);
     pthread_mutex_unlock (& m_reader_status.mutex);
@@ -704,6 +880,11 @@ FillBufferResult NeonFile::fill_buffer ()
     if (! bsize)
     {
         AUDDBG ("<%p> End of file encountered\n", this);
+
+        /* lets neon keep the connection for the next request */
+        if (ne_end_request (m_request) == NE_OK)
+            m_request_done = true;
+
         return FILL_BUFFER_EOF;
     }
 
@@ -778,6 +959,9 @@ VFSImpl * NeonTransport::fopen (const char * path, const char * mode, String & e
 
     AUDDBG ("<%p> Trying to open '%s' with neon\n", file, path);
 
+    if (file->open_cached ())
+        return file;
+
     if (file->open_handle (0, & error) != 0)
     {
         AUDERR ("<%p> Could not open URL\n", file);
@@ -970,12 +1154,56 @@ int64_t NeonFile::try_fread (void * ptr, int64_t size, int64_t nmemb, bool & dat
 
     pthread_mutex_unlock (& m_reader_status.mutex);
 
+    /* only files that can be seeked in are worth caching */
+    if (m_record_left > 0 && ! m_icy_metaint && m_content_length >= 0 && m_can_ranges)
+    {
+        int64_t len = aud::min (nmemb * size, m_record_left);
+        range_cache_add (m_url, m_content_start + m_content_length, m_pos, ptr, len);
+        m_record_left -= len;
+    }
+
+    if (m_disk)
+        disk_cache_write (m_disk, m_pos, ptr, nmemb * size);
+
     m_pos += nmemb * size;
     m_icy_metaleft -= nmemb * size;
 
     return nmemb;
 }
 
+/* Reads from memory, or else from disk.  Once the cached range runs out, a
+ * request is made from where it ends. */
+int64_t NeonFile::read_cached (void * ptr, int64_t size, int64_t nmemb, bool & data_read)
+{
+    int64_t content_length = m_content_start + m_content_length;
+    int64_t len = range_cache_read (m_url, content_length, m_pos, ptr, size * nmemb);
+    if (! len && m_disk)
+        len = disk_cache_read (m_disk, m_pos, ptr, size * nmemb);
+
+    int64_t part = len / size;
+
+    if (part > 0)
+    {
+        m_pos += part * size;
+        data_read = true;
+        return part;
+    }
+
+    m_from_cache = false;
+
+    if (m_pos >= content_length)
+    {
+        m_eof = true;
+        return 0;
+    }
+
+    AUDDBG ("<%p> Leaving the cache at %" PRId64 "\n", this, m_pos);
+
+    /* nothing read yet, but the caller should go on from the network */
+    data_read = (open_handle (m_pos) == 0);
+    return 0;
+}
+
 /* try_fread will do only a partial read if the buffer underruns, so we
  * must call it repeatedly until we have read the full request. */
 int64_t NeonFile::fread (void * buffer, int64_t size, int64_t count)
@@ -987,7 +1215,9 @@ int64_t NeonFile::fread (void * buffer, int64_t size, int64_t count)
     while (count > 0)
     {
         bool data_read = false;
-        int64_t part = try_fread (buffer, size, count, data_read);
+        int64_t part = m_from_cache ?
+         read_cached (buffer, size, count, data_read) :
+         try_fread (buffer, size, count, data_read);
         if (! data_read)
             break;
 
@@ -1094,30 +1324,56 @@ int NeonFile::fseek (int64_t offset, VFSSeekType whence)
     if (newpos == m_pos)
         return 0;
 
+    /* A short skip forward is taken out of the ringbuffer. */
+    if (newpos > m_pos && m_request && ! m_icy_metaint)
+    {
+        pthread_mutex_lock (& m_reader_status.mutex);
+
+        bool buffered = (newpos - m_pos <= m_rb.len ());
+        if (buffered)
+        {
+            m_rb.discard (newpos - m_pos);
+            pthread_cond_broadcast (& m_reader_status.cond);
+        }
+
+        pthread_mutex_unlock (& m_reader_status.mutex);
+
+        if (buffered)
+        {
+            AUDDBG ("<%p> Skipped forward within the buffer\n", this);
+            m_pos = newpos;
+            return 0;
+        }
+    }
+
     /* To seek to the new position we have to
      * - stop the current reader thread, if there is one
-     * - destroy the current request
+     * - end the current request, keeping the session
      * - dump all data currently in the ringbuffer
-     * - create a new request starting at newpos */
+     * - create a new request starting at newpos, unless one of the caches
+     *   has the data there */
     if (m_reader_status.reading)
         kill_reader ();
 
-    if (m_request)
-    {
-        ne_request_destroy (m_request);
-        m_request = nullptr;
-    }
-
-    if (m_session)
-    {
-        ne_session_destroy (m_session);
-        m_session = nullptr;
-    }
+    end_request ();
 
     m_rb.discard ();
     m_icy_buf.clear ();
     m_icy_len = 0;
 
+    if (range_cache_has (m_url, content_length, newpos) ||
+     (m_disk && disk_cache_has (m_disk, newpos)))
+    {
+        AUDDBG ("<%p> Reading from the cache at %" PRId64 "\n", this, newpos);
+        m_from_cache = true;
+        m_record_left = 0;
+        m_pos = newpos;
+        m_eof = false;
+        return 0;
+    }
+
+    m_from_cache = false;
+
     if (open_handle (newpos) != 0)
     {
         AUDERR ("<%p> Error while creating new request!\n", this);
@@ -0,0 +1,183 @@
+/*
+ *  Cache of recently read ranges of remote files
+ *  Copyright (C) 2024 Audacious Plugins Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/objects.h>
+#include <libaudcore/runtime.h>
+
+#include "range_cache.h"
+
+#define RANGE_MAX (256 * 1024)  /* a range grows while it is read on from */
+
+struct CachedRange
+{
+    String url;
+    int64_t size;
+    int64_t start;
+    Index<char> data;
+    int64_t used;
+
+    int64_t end () const
+        { return start + data.len (); }
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Index<CachedRange *> ranges;
+static int64_t cached_bytes;
+static int64_t use_count;
+
+/* called with cache_mutex held */
+static void drop_range (int i)
+{
+    cached_bytes -= ranges[i]->data.len ();
+    delete ranges[i];
+    ranges.remove (i, 1);
+}
+
+/* called with cache_mutex held; also drops ranges of the URL that were
+ * recorded for another size, since the file has changed */
+static CachedRange * find_range (const char * url, int64_t size, int64_t pos, bool at_end)
+{
+    CachedRange * found = nullptr;
+
+    for (int i = 0; i < ranges.len ();)
+    {
+        CachedRange * range = ranges[i];
+
+        if (strcmp (range->url, url))
+            i ++;
+        else if (range->size != size)
+            drop_range (i);
+        else
+        {
+            if (! found && range->start <= pos &&
+             (pos < range->end () || (at_end && pos == range->end ())))
+                found = range;
+
+            i ++;
+        }
+    }
+
+    if (found)
+        found->used = ++ use_count;
+
+    return found;
+}
+
+/* called with cache_mutex held */
+static void evict (int64_t limit)
+{
+    while (cached_bytes > limit)
+    {
+        int oldest = 0;
+        for (int i = 1; i < ranges.len (); i ++)
+        {
+            if (ranges[i]->used < ranges[oldest]->used)
+                oldest = i;
+        }
+
+        drop_range (oldest);
+    }
+}
+
+void range_cache_add (const char * url, int64_t size, int64_t pos,
+ const void * data, int64_t len)
+{
+    int64_t limit = (int64_t) 1024 * aud_get_int ("neon", "cache_kb");
+
+    pthread_mutex_lock (& cache_mutex);
+
+    CachedRange * range = find_range (url, size, pos, true);
+
+    if (range)
+    {
+        int64_t skip = range->end () - pos;   /* already cached */
+
+        if (skip < len)
+        {
+            len = aud::min (len - skip, (int64_t) RANGE_MAX - range->data.len ());
+
+            if (len > 0)
+            {
+                range->data.insert ((const char *) data + skip, -1, len);
+                cached_bytes += len;
+            }
+        }
+    }
+    else if (limit > 0)
+    {
+        range = new CachedRange ();
+        range->url = String (url);
+        range->size = size;
+        range->start = pos;
+        range->used = ++ use_count;
+
+        len = aud::min (len, (int64_t) RANGE_MAX);
+        range->data.insert ((const char *) data, 0, len);
+        cached_bytes += len;
+
+        ranges.append (range);
+    }
+
+    evict (limit);
+
+    pthread_mutex_unlock (& cache_mutex);
+}
+
+bool range_cache_has (const char * url, int64_t size, int64_t pos)
+{
+    pthread_mutex_lock (& cache_mutex);
+    bool found = (find_range (url, size, pos, false) != nullptr);
+    pthread_mutex_unlock (& cache_mutex);
+
+    return found;
+}
+
+int64_t range_cache_read (const char * url, int64_t size, int64_t pos,
+ void * data, int64_t len)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    CachedRange * range = find_range (url, size, pos, false);
+
+    if (range)
+    {
+        len = aud::min (len, range->end () - pos);
+        memcpy (data, & range->data[pos - range->start], len);
+    }
+    else
+        len = 0;
+
+    pthread_mutex_unlock (& cache_mutex);
+
+    return len;
+}
+
+void range_cache_clear ()
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    while (ranges.len ())
+        drop_range (ranges.len () - 1);
+
+    pthread_mutex_unlock (& cache_mutex);
+}
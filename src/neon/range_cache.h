@@ -0,0 +1,49 @@
+/*
+ *  Cache of recently read ranges of remote files
+ *  Copyright (C) 2024 Audacious Plugins Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef NEON_RANGE_CACHE_H
+#define NEON_RANGE_CACHE_H
+
+#include <stdint.h>
+
+/* The first bytes read after opening a file and after each seek, shared by
+ * every open file with the same URL.  Probing a remote file reads its head,
+ * seeks to the end for tags and back, and then the file is opened again
+ * for playback; with this, those seeks back are served without a request.
+ *
+ * Ranges are dropped least recently used first, once the total goes over
+ * the configured size.  The size of the file is stored along with them, and
+ * ranges recorded for another size are not used. */
+
+#define RANGE_CACHE_RECORD (64 * 1024)  /* bytes recorded after a seek */
+
+/* adds to the range ending at (or overlapping) pos, or starts one */
+void range_cache_add (const char * url, int64_t size, int64_t pos,
+ const void * data, int64_t len);
+
+/* true if a range holds the byte at pos */
+bool range_cache_has (const char * url, int64_t size, int64_t pos);
+
+/* copies up to len bytes starting at pos and returns how many there were */
+int64_t range_cache_read (const char * url, int64_t size, int64_t pos,
+ void * data, int64_t len);
+
+void range_cache_clear ();
+
+#endif // NEON_RANGE_CACHE_H
@@ -0,0 +1,106 @@
+/*
+ *  Reuse of neon sessions between requests
+ *  Copyright (C) 2024 Audacious Plugins Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/runtime.h>
+
+#include "session_pool.h"
+
+#define POOL_SIZE 4
+#define POOL_IDLE_USEC (60 * G_USEC_PER_SEC)
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Index<NeonSession *> pool;   /* oldest first */
+
+/* called with pool_mutex held */
+static void expire_idle (int64_t now)
+{
+    while (pool.len () && now - pool[0]->idle_since > POOL_IDLE_USEC)
+    {
+        AUDDBG ("Expiring idle session %s\n", (const char *) pool[0]->key);
+        session_pool_destroy (pool[0]);
+        pool.remove (0, 1);
+    }
+}
+
+NeonSession * session_pool_take (const char * key)
+{
+    NeonSession * found = nullptr;
+
+    pthread_mutex_lock (& pool_mutex);
+    expire_idle (g_get_monotonic_time ());
+
+    /* the most recently used one is the likeliest to be still connected */
+    for (int i = pool.len () - 1; i >= 0; i --)
+    {
+        if (! strcmp (pool[i]->key, key))
+        {
+            found = pool[i];
+            pool.remove (i, 1);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock (& pool_mutex);
+
+    if (found)
+        AUDDBG ("Reusing session %s\n", key);
+
+    return found;
+}
+
+void session_pool_give (NeonSession * session)
+{
+    int64_t now = g_get_monotonic_time ();
+    session->idle_since = now;
+
+    pthread_mutex_lock (& pool_mutex);
+    expire_idle (now);
+
+    if (pool.len () == POOL_SIZE)
+    {
+        session_pool_destroy (pool[0]);
+        pool.remove (0, 1);
+    }
+
+    pool.append (session);
+    pthread_mutex_unlock (& pool_mutex);
+}
+
+void session_pool_destroy (NeonSession * session)
+{
+    ne_session_destroy (session->session);
+    delete session;
+}
+
+void session_pool_clear ()
+{
+    pthread_mutex_lock (& pool_mutex);
+
+    for (NeonSession * session : pool)
+        session_pool_destroy (session);
+
+    pool.clear ();
+    pthread_mutex_unlock (& pool_mutex);
+}
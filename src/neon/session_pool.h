@@ -0,0 +1,55 @@
+/*
+ *  Reuse of neon sessions between requests
+ *  Copyright (C) 2024 Audacious Plugins Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef NEON_SESSION_POOL_H
+#define NEON_SESSION_POOL_H
+
+#include <stdint.h>
+
+#include <libaudcore/objects.h>
+
+#include <ne_session.h>
+
+/* A session, and the credentials its authentication callback answers with.
+ * The callbacks of a session get this as their user data rather than the
+ * file that created it, since the session may outlive the file. */
+struct NeonSession
+{
+    ne_session * session;
+    String key;         /* scheme, host, port, credentials and proxy */
+    String userinfo;
+    int64_t idle_since; /* monotonic time, while in the pool */
+};
+
+/* Sessions are kept per host once a file is done with them: a session that
+ * still has its connection open sends the next request over it, and one
+ * whose connection is gone still resumes the TLS session it had.  Opening
+ * a file again after probing it thus costs no full handshake.  Idle
+ * sessions expire after a minute. */
+
+/* returns nullptr if there is no idle session with the given key */
+NeonSession * session_pool_take (const char * key);
+
+/* keeps the session for reuse, or destroys it if the pool is full */
+void session_pool_give (NeonSession * session);
+
+void session_pool_destroy (NeonSession * session);
+void session_pool_clear ();
+
+#endif // NEON_SESSION_POOL_H
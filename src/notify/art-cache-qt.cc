@@ -0,0 +1,3 @@
+#ifdef USE_QT
+#include "../ui-common/art-cache-qt.cc"
+#endif
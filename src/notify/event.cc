@@ -33,6 +33,7 @@
 #endif
 #ifdef USE_QT
 #include <libaudqt/libaudqt.h>
+#include "../ui-common/art-cache-qt.h"
 #endif
 
 static String last_title, last_message;
@@ -78,7 +79,7 @@ static void get_album_art ()
 #ifdef USE_QT
     if (aud_get_mainloop_type () == MainloopType::Qt)
     {
-        QImage image = audqt::art_request_current (96, 96, false).toImage ();
+        QImage image = ArtCache::request_current (96, 96, false);
         if (! image.isNull ())
             qimage = image.convertToFormat (QImage::Format_RGBA8888);
 
@@ -32,12 +32,14 @@
 #include <libaudcore/runtime.h>
 
 #include "mptwrap.h"
+#include "../trace-common/trace.h"
 
 static bool force_apply = false;
 
 static constexpr const char *CFG_SECTION               = "openmpt";
 static constexpr const char *SETTING_STEREO_SEPARATION = "stereo_separation";
 static constexpr const char *SETTING_INTERPOLATOR      = "interpolator";
+static constexpr const char *SETTING_RENDER_FRAMES     = "render_frames";
 
 class MPTPlugin : public InputPlugin
 {
@@ -66,6 +68,7 @@ public:
         {
             SETTING_STEREO_SEPARATION, aud::numeric_string<MPTWrap::default_stereo_separation>::str,
             SETTING_INTERPOLATOR, aud::numeric_string<MPTWrap::default_interpolator>::str,
+            SETTING_RENDER_FRAMES, aud::numeric_string<MPTWrap::default_render_frames>::str,
             nullptr,
         };
 
@@ -76,14 +79,13 @@ public:
 
     bool is_our_file(const char *filename, VFSFile &file) override
     {
-        MPTWrap mpt;
-        return mpt.open(file);
+        return MPTWrap::probe(file);
     }
 
     bool read_tag(const char *filename, VFSFile &file, Tuple &tuple, Index<char> *) override
     {
         MPTWrap mpt;
-        if (!mpt.open(file))
+        if (!mpt.open(file, true))
             return false;
 
         tuple.set_filename(filename);
@@ -107,9 +109,17 @@ public:
 
         open_audio(FMT_FLOAT, mpt.rate(), mpt.channels());
 
+        /* libopenmpt renders straight into this, in the output format */
+        int frames = aud_get_int(CFG_SECTION, SETTING_RENDER_FRAMES);
+        if (!MPTWrap::is_valid_render_frames(frames))
+            frames = MPTWrap::default_render_frames;
+
+        Index<float> buffer;
+        buffer.resize(frames * mpt.channels());
+
         while (!check_stop())
         {
-            float buffer[16384];
+            TRACE_SPAN("OpenMPT play");
             int seek_value = check_seek();
 
             if (seek_value >= 0)
@@ -122,11 +132,11 @@ public:
                 force_apply = false;
             }
 
-            auto n = mpt.read(buffer, aud::n_elems(buffer));
+            auto n = mpt.read(buffer.begin(), buffer.len());
             if (n == 0)
                 break;
 
-            write_audio(buffer, n * sizeof buffer[0]);
+            write_audio(buffer.begin(), n * sizeof buffer[0]);
         }
 
         return true;
@@ -160,6 +170,11 @@ const PreferencesWidget MPTPlugin::widgets[] =
             N_("Interpolation:"),
             WidgetInt(CFG_SECTION, SETTING_INTERPOLATOR, values_changed),
             { MPTWrap::interpolators }
+    ),
+    WidgetSpin(
+            N_("Render chunk:"),
+            WidgetInt(CFG_SECTION, SETTING_RENDER_FRAMES),
+            { 256.0, 65536.0, 256.0, N_("samples per channel") }
     )
 };
 
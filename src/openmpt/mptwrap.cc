@@ -41,14 +41,54 @@ static String to_aud_str(const char * str)
     return aud_str;
 }
 
-bool MPTWrap::open(VFSFile &file)
+bool MPTWrap::probe(VFSFile &file)
+{
+#if OPENMPT_API_VERSION_MAJOR <= 0 && OPENMPT_API_VERSION_MINOR < 3
+    MPTWrap mpt;
+    return mpt.open(file, true);
+#else
+    Index<char> header;
+    header.resize(openmpt_probe_file_header_get_recommended_size());
+    header.resize(std::max<int64_t>(file.fread(header.begin(), 1, header.len()), 0));
+
+    int64_t size = file.fsize();
+    int result = (size >= 0) ?
+     openmpt_probe_file_header(OPENMPT_PROBE_FILE_HEADER_FLAGS_DEFAULT,
+      header.begin(), header.len(), size, openmpt_log_func_silent, nullptr,
+      openmpt_error_func_ignore, nullptr, nullptr, nullptr) :
+     openmpt_probe_file_header_without_filesize(OPENMPT_PROBE_FILE_HEADER_FLAGS_DEFAULT,
+      header.begin(), header.len(), openmpt_log_func_silent, nullptr,
+      openmpt_error_func_ignore, nullptr, nullptr, nullptr);
+
+    if (result == OPENMPT_PROBE_FILE_HEADER_RESULT_SUCCESS)
+        return true;
+    if (result == OPENMPT_PROBE_FILE_HEADER_RESULT_FAILURE)
+        return false;
+
+    /* too short to tell, or an error; load it to be sure */
+    if (file.fseek(0, VFS_SEEK_SET) < 0)
+        return false;
+
+    MPTWrap mpt;
+    return mpt.open(file, true);
+#endif
+}
+
+bool MPTWrap::open(VFSFile &file, bool tags_only)
 {
 #if OPENMPT_API_VERSION_MAJOR <= 0 && OPENMPT_API_VERSION_MINOR < 3
     auto m = openmpt_module_create(callbacks, &file, openmpt_log_func_silent,
      nullptr, nullptr);
 #else
+    static const openmpt_module_initial_ctl tag_ctls[] =
+    {
+        {"load.skip_samples", "1"},
+        {"load.skip_plugins", "1"},
+        {nullptr, nullptr}
+    };
+
     auto m = openmpt_module_create2(callbacks, &file, openmpt_log_func_silent,
-     nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+     nullptr, nullptr, nullptr, nullptr, nullptr, tags_only ? tag_ctls : nullptr);
 #endif
 
     if (m == nullptr)
@@ -106,6 +146,11 @@ void MPTWrap::set_stereo_separation(int separation)
          OPENMPT_MODULE_RENDER_STEREOSEPARATION_PERCENT, separation);
 }
 
+bool MPTWrap::is_valid_render_frames(int frames)
+{
+    return frames >= 256 && frames <= 65536;
+}
+
 int64_t MPTWrap::read(float *buf, int64_t bufcnt)
 {
     auto n = openmpt_module_read_interleaved_float_stereo(mod.get(), rate(),
@@ -43,6 +43,7 @@ public:
 
     static constexpr int default_interpolator = interp_windowed;
     static constexpr int default_stereo_separation = 100;
+    static constexpr int default_render_frames = 8192;
 
     static constexpr ComboItem interpolators[] =
     {
@@ -58,7 +59,14 @@ public:
     static bool is_valid_stereo_separation(int);
     void set_stereo_separation(int);
 
-    bool open(VFSFile &);
+    static bool is_valid_render_frames(int);
+
+    /* looks at the start of the file only; the whole module is loaded if
+     * that is not enough to tell */
+    static bool probe(VFSFile &);
+
+    /* for tags only, the samples and plugins are not loaded */
+    bool open(VFSFile &, bool tags_only = false);
     int64_t read(float *, int64_t);
     void seek(int pos);
 
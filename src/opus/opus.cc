@@ -31,6 +31,10 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/runtime.h>
 
+#include "../vfs-common/seek-index.h"
+#include "../vfs-common/track-prefetch.h"
+#include "../trace-common/trace.h"
+
 class OpusPlugin : public InputPlugin
 {
 public:
@@ -48,15 +52,18 @@ public:
         .with_exts(exts)
         .with_mimes(mimes)) {}
 
+    void cleanup() override;
+
     bool is_our_file(const char * filename, VFSFile & file) override;
     bool read_tag(const char * filename, VFSFile & file, Tuple & tuple,
                   Index<char> * image) override;
     bool play(const char * filename, VFSFile & file) override;
 
 private:
-    static constexpr int pcm_frames = 1024;
-    static constexpr int pcm_bufsize = 2 * pcm_frames;
+    static constexpr int max_frames = 5760;   /* 120 ms, the longest packet */
     static constexpr int sample_rate = 48000; /* Opus supports 48 kHz only */
+    static constexpr int seek_spacing = 2000; /* ms between seek checkpoints */
+    static constexpr int seek_margin = 1000;  /* ms, more than a page lasts */
 
     int m_bitrate = 0;
     int m_channels = 0;
@@ -324,20 +331,52 @@ bool OpusPlugin::read_tag(const char * filename, VFSFile & file, Tuple & tuple,
     return true;
 }
 
+/* Goes to the last checkpoint well before <target> (samples) and returns
+ * true if the audio decoded from there up to the target is to be dropped,
+ * or false if there is no checkpoint to use.  A checkpoint is the page that
+ * was to be read next when the audio decoded had got to its position, so
+ * restarting there can land up to a page later; hence the margin. */
+static bool seek_by_index(OggOpusFile * opus_file, const SeekIndex & index,
+                          ogg_int64_t target, int margin_ms, int rate)
+{
+    auto point = index.find(target / (rate / 1000) - margin_ms);
+    if (!point || op_raw_seek(opus_file, point->offset) < 0)
+        return false;
+
+    return op_pcm_tell(opus_file) <= target;
+}
+
+void OpusPlugin::cleanup()
+{
+    track_prefetch_cleanup();
+}
+
 bool OpusPlugin::play(const char * filename, VFSFile & file)
 {
     OggOpusFile * opus_file = open_file(file);
     if (!opus_file)
         return false;
 
+    /* read_tag() may have been called since for another file */
+    m_channels = op_channel_count(opus_file, -1);
+
+    /* room for a whole packet, so that op_read_float() decodes straight
+     * into it rather than into a buffer of its own */
     Index<float> pcm_out;
-    pcm_out.resize(pcm_bufsize * sizeof(float));
+    pcm_out.resize(max_frames * m_channels);
 
     bool error = false;
     int last_section = -1;
     Tuple tuple = get_playback_tuple();
+    TrackPrefetch prefetch(tuple.get_int(Tuple::Length));
+    SeekIndex seek_index(seek_spacing);
+    ogg_int64_t skip_to = -1;
     ReplayGainInfo rg_info;
 
+    bool stream = file.fsize() < 0;
+    if (!stream)
+        seek_index.load(filename);
+
     set_stream_bitrate(m_bitrate);
 
     if (update_tuple(opus_file, tuple))
@@ -347,21 +386,37 @@ bool OpusPlugin::play(const char * filename, VFSFile & file)
         set_replay_gain(rg_info);
 
     open_audio(FMT_FLOAT, sample_rate, m_channels);
+    prefetch.set_format(FMT_FLOAT, sample_rate, m_channels);
 
     while (!check_stop())
     {
+        TRACE_SPAN("Opus play");
         int seek_value = check_seek();
 
-        if (seek_value >= 0 &&
-            op_pcm_seek(opus_file, seek_value * (sample_rate / 1000)) < 0)
+        if (seek_value >= 0)
         {
-            AUDERR("Failed to seek Opus file\n");
-            error = true;
-            break;
+            ogg_int64_t target = seek_value * (sample_rate / 1000);
+            bool indexed = !stream && seek_by_index(opus_file, seek_index,
+                                                    target, seek_margin,
+                                                    sample_rate);
+            skip_to = indexed ? target : -1;
+
+            if (!indexed && op_pcm_seek(opus_file, target) < 0)
+            {
+                AUDERR("Failed to seek Opus file\n");
+                error = true;
+                break;
+            }
+
+            prefetch.seeked(seek_value);
         }
 
+        if (!stream)
+            seek_index.add(op_pcm_tell(opus_file) / (sample_rate / 1000),
+                           op_raw_tell(opus_file));
+
         int current_section = last_section;
-        int bytes = op_read_float(opus_file, pcm_out.begin(), pcm_frames,
+        int bytes = op_read_float(opus_file, pcm_out.begin(), pcm_out.len(),
                                   &current_section);
         if (bytes == OP_HOLE)
             continue;
@@ -369,6 +424,19 @@ bool OpusPlugin::play(const char * filename, VFSFile & file)
         if (bytes <= 0)
             break;
 
+        int start = 0;
+
+        /* after a seek by the index, up to the target is dropped */
+        if (skip_to >= 0)
+        {
+            ogg_int64_t keep = op_pcm_tell(opus_file) - skip_to;
+            if (keep <= 0)
+                continue;
+
+            start = aud::max<ogg_int64_t>(bytes - keep, 0);
+            skip_to = -1;
+        }
+
         if (update_tuple(opus_file, tuple))
             set_playback_tuple(tuple.ref());
 
@@ -384,10 +452,14 @@ bool OpusPlugin::play(const char * filename, VFSFile & file)
                     set_replay_gain(rg_info);
 
                 open_audio(FMT_FLOAT, sample_rate, m_channels);
+                prefetch.set_format(FMT_FLOAT, sample_rate, m_channels);
+                pcm_out.resize(max_frames * m_channels);
             }
         }
 
-        write_audio(pcm_out.begin(), bytes * m_channels * sizeof(float));
+        write_audio(pcm_out.begin() + start * m_channels,
+                    (bytes - start) * m_channels * sizeof(float));
+        prefetch.written((bytes - start) * m_channels * sizeof(float));
 
         if (current_section != last_section)
         {
@@ -0,0 +1,153 @@
+/*
+ * adaptive.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "adaptive.h"
+#include "telemetry.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+
+#include <libaudcore/runtime.h>
+#include <libaudcore/templates.h>
+
+#define CHECK_MS 1000       /* between decisions */
+#define WINDOW_MS 10000     /* over which the longest gap is remembered */
+#define QUIET_MS 30000      /* without underruns, before shrinking */
+#define SETTLE_MS 10000     /* between one shrink and the next */
+
+static const char * const adaptive_defaults[] = {
+    "enabled", "FALSE",
+    "min", "40",
+    nullptr
+};
+
+/* 0 while disabled */
+static std::atomic<int> target;
+static std::atomic<int64_t> last_underrun, last_change;
+static int min_ms, max_ms;
+
+/* only touched by adaptive_wakeup() */
+static int64_t last_wakeup, last_check, window_start;
+static int gap, prev_gap;   /* longest in this window and the last one */
+
+static int64_t now_ms ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void adaptive_init ()
+{
+    aud_config_set_defaults ("output_adaptive", adaptive_defaults);
+}
+
+/* fails if the target was changed from another thread in the meantime */
+static void change_target (int old, int ms, const char * reason)
+{
+    if (! target.compare_exchange_strong (old, ms, std::memory_order_relaxed))
+        return;
+
+    last_change.store (now_ms (), std::memory_order_relaxed);
+    telemetry_target (ms, reason);
+}
+
+int adaptive_open (int whole_ms)
+{
+    int64_t now = now_ms ();
+
+    max_ms = whole_ms;
+    min_ms = aud::clamp (aud_get_int ("output_adaptive", "min"), 1, whole_ms);
+
+    last_underrun = now;
+    last_wakeup = last_check = window_start = now;
+    gap = prev_gap = 0;
+
+    if (! aud_get_bool ("output_adaptive", "enabled"))
+    {
+        target = 0;
+        telemetry_target (0, nullptr);
+        return whole_ms;
+    }
+
+    target = min_ms;
+    last_change = now;
+    telemetry_target (min_ms, "start");
+    return min_ms;
+}
+
+int adaptive_target ()
+{
+    return target.load (std::memory_order_relaxed);
+}
+
+void adaptive_underrun ()
+{
+    int old = target.load (std::memory_order_relaxed);
+    if (! old)
+        return;
+
+    last_underrun.store (now_ms (), std::memory_order_relaxed);
+
+    int grown = aud::min (old * 2, max_ms);
+    if (grown > old)
+        change_target (old, grown, "underrun");
+}
+
+/* The target is kept at twice the longest time the audio thread was seen
+ * to sleep lately, plus the smallest fill, since that is about how much
+ * has to be buffered for it to come back in time.  A gap longer than the
+ * whole buffer is a pause or a stall rather than jitter, and is left out
+ * (a stall shows up as an underrun anyway). */
+void adaptive_wakeup ()
+{
+    int current = target.load (std::memory_order_relaxed);
+    if (! current)
+        return;
+
+    int64_t now = now_ms ();
+    int since = now - last_wakeup;
+    last_wakeup = now;
+
+    if (since <= max_ms)
+        gap = aud::max (gap, since);
+
+    if (now - window_start >= WINDOW_MS)
+    {
+        prev_gap = gap;
+        gap = 0;
+        window_start = now;
+    }
+
+    if (now - last_check < CHECK_MS)
+        return;
+
+    last_check = now;
+
+    int need = aud::min (2 * aud::max (gap, prev_gap) + min_ms, max_ms);
+
+    if (need > current)
+        change_target (current, need, "jitter");
+    else if (need < current &&
+     now - last_underrun.load (std::memory_order_relaxed) >= QUIET_MS &&
+     now - last_change.load (std::memory_order_relaxed) >= SETTLE_MS)
+        change_target (current, aud::max (need, current * 3 / 4), "quiet");
+}
@@ -0,0 +1,53 @@
+/*
+ * adaptive.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_OUTPUT_ADAPTIVE_H
+#define AUD_OUTPUT_ADAPTIVE_H
+
+/* Optional adaptive fill level for the output buffer.  Instead of always
+ * filling the buffer set in Audacious's settings, the plugin keeps only a
+ * target amount buffered, which starts small and grows when the sink runs
+ * dry or the audio thread is seen to sleep for long stretches, then slowly
+ * shrinks again while playback stays clean.  The settings are shared by the
+ * output plugins, in the "output_adaptive" section: "enabled" and "min"
+ * (the smallest target, in milliseconds).
+ *
+ * adaptive_wakeup() is called each time the audio thread wakes up, and
+ * adaptive_underrun() when the sink had too little; both are safe from any
+ * thread.  Each change of target is reported through telemetry_target(). */
+
+void adaptive_init ();
+
+/* max_ms is the whole buffer; returns the starting target */
+int adaptive_open (int max_ms);
+
+/* in milliseconds, or 0 when the whole buffer is to be used */
+int adaptive_target ();
+
+void adaptive_wakeup ();
+void adaptive_underrun ();
+
+#define ADAPTIVE_WIDGETS \
+    WidgetCheck (N_("Adapt buffer fill to system load"), \
+        WidgetBool ("output_adaptive", "enabled")), \
+    WidgetSpin (N_("Smallest fill:"), \
+        WidgetInt ("output_adaptive", "min"), \
+        {10, 1000, 10, N_("ms")}, WIDGET_CHILD)
+
+#endif
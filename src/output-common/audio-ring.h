@@ -0,0 +1,102 @@
+/*
+ * audio-ring.h
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_OUTPUT_AUDIO_RING_H
+#define AUD_OUTPUT_AUDIO_RING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <libaudcore/index.h>
+
+/* A ring buffer for one thread writing and one (the sink's audio thread)
+ * reading, without locking.
+ *
+ * The byte counts only ever grow; positions in the buffer are taken modulo
+ * its size.  Each side reads the other's count with acquire ordering and
+ * publishes its own with release ordering once it is done with the bytes. */
+class AudioRing
+{
+public:
+    void alloc (int size)
+    {
+        m_data.resize (size);
+        m_head = m_tail = 0;
+    }
+
+    void destroy () { m_data.clear (); }
+
+    const char * data () const { return m_data.begin (); }
+    int size () const { return m_data.len (); }
+    int len () const
+        { return m_head.load (std::memory_order_acquire) - m_tail.load (std::memory_order_acquire); }
+    int space () const { return size () - len (); }
+
+    /* producer side */
+    void copy_in (const char * data, int len)
+    {
+        int64_t head = m_head.load (std::memory_order_relaxed);
+        int pos = head % size ();
+        int part = aud::min (len, size () - pos);
+
+        memcpy (& m_data[pos], data, part);
+        memcpy (& m_data[0], data + part, len - part);
+        m_head.store (head + len, std::memory_order_release);
+    }
+
+    /* consumer side */
+    int linear () const
+    {
+        int64_t tail = m_tail.load (std::memory_order_relaxed);
+        return aud::min<int64_t> (m_head.load (std::memory_order_acquire) - tail,
+         size () - tail % size ());
+    }
+
+    const char * peek () const
+        { return & m_data[m_tail.load (std::memory_order_relaxed) % size ()]; }
+
+    void discard (int len)
+        { m_tail.store (m_tail.load (std::memory_order_relaxed) + len, std::memory_order_release); }
+    void discard ()
+        { m_tail.store (m_head.load (std::memory_order_acquire), std::memory_order_release); }
+
+    /* copies out up to len bytes, returning how many */
+    int move_out (char * data, int len)
+    {
+        int done = 0;
+        int part;
+
+        while (done < len && (part = aud::min (len - done, linear ())))
+        {
+            memcpy (data + done, peek (), part);
+            discard (part);
+            done += part;
+        }
+
+        return done;
+    }
+
+private:
+    Index<char> m_data;
+    std::atomic<int64_t> m_head {0}, m_tail {0};
+};
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * bitperfect.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "bitperfect.h"
+
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugins.h>
+#include <libaudcore/runtime.h>
+
+static const char * const bitperfect_defaults[] = {
+    "enabled", "FALSE",
+    nullptr
+};
+
+void bitperfect_init ()
+{
+    aud_config_set_defaults ("output_bitperfect", bitperfect_defaults);
+}
+
+bool bitperfect_enabled ()
+{
+    return aud_get_bool ("output_bitperfect", "enabled");
+}
+
+/* Integer samples of up to 24 bits survive the core's trip through floating
+ * point exactly, so the output of an untouched stream is the decoder's own,
+ * provided it leaves at the decoder's bit depth.  That last part cannot be
+ * checked from here. */
+const char * bitperfect_check ()
+{
+    if (! aud_get_int (nullptr, "output_bit_depth"))
+        return _("floating-point output");
+    if (aud_get_bool (nullptr, "software_volume_control"))
+        return _("software volume");
+    if (aud_get_bool (nullptr, "enable_replay_gain"))
+        return _("ReplayGain");
+
+    for (PluginHandle * plugin : aud_plugin_list (PluginType::Effect))
+    {
+        if (aud_plugin_get_enabled (plugin))
+            return _("effects enabled");
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,48 @@
+/*
+ * bitperfect.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_OUTPUT_BITPERFECT_H
+#define AUD_OUTPUT_BITPERFECT_H
+
+/* Bit-perfect output, for the ALSA and PipeWire plugins.  With the option
+ * set (shared, in the "output_bitperfect" section), the plugin asks for
+ * the audio to reach the device exactly as given: ALSA opens the PCM with
+ * every automatic conversion of its plug layer turned off, and PipeWire
+ * asks for an exclusive stream at the track's own rate, with resampling,
+ * channel mixing and stream volume left out.  A device that cannot take
+ * the format as it is then fails to open instead of being converted to.
+ *
+ * The core has a part in this too: the audio comes through its own float
+ * conversion unchanged only if no effect, software volume or ReplayGain
+ * touches it, and if the output bit depth is an integer one, matching the
+ * source.  bitperfect_check() looks at those settings.  Whatever it (or
+ * the plugin) finds is reported through telemetry_path(). */
+
+void bitperfect_init ();
+bool bitperfect_enabled ();
+
+/* nullptr if the core passes the audio through unchanged, else the first
+ * reason it does not */
+const char * bitperfect_check ();
+
+#define BITPERFECT_WIDGETS \
+    WidgetCheck (N_("Bit-perfect output (no resampling, mixing or volume)"), \
+        WidgetBool ("output_bitperfect", "enabled"))
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * realtime.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "realtime.h"
+
+#include <atomic>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <gio/gio.h>
+#endif
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+
+#define RTKIT_RTTIME 200000     /* us, the most rtkit allows by default */
+#define RTKIT_TIMEOUT_MS 1000
+
+static const char * const realtime_defaults[] = {
+    "enabled", "FALSE",
+    "priority", "20",
+    "cpu", "-1",
+    nullptr
+};
+
+/* read by realtime_prepare() on the player thread, for the audio thread */
+static std::atomic<bool> s_enabled {false};
+static std::atomic<int> s_priority {0}, s_cpu {-1};
+
+/* what realtime_enter() got, for the helper thread that finishes the job */
+struct Report {
+    const char * name;
+#ifdef __linux__
+    pid_t tid;
+#endif
+    int priority;       /* asked for, or held already */
+    bool already;       /* real-time before realtime_enter() */
+    int sched_error;    /* why SCHED_FIFO was refused, or 0 */
+    int64_t locked;     /* bytes, or 0 with no buffer */
+    int lock_error;
+    int cpu;            /* asked for, or -1 */
+    int cpu_error;      /* -1 if not supported */
+};
+
+static Report s_report;
+static pthread_t s_helper;
+static std::atomic<bool> s_helper_started {false};
+
+void realtime_init ()
+{
+    aud_config_set_defaults ("output_realtime", realtime_defaults);
+}
+
+static void join_helper ()
+{
+    if (s_helper_started.exchange (false))
+        pthread_join (s_helper, nullptr);
+}
+
+bool realtime_prepare ()
+{
+    join_helper ();
+
+    s_priority = aud::clamp (aud_get_int ("output_realtime", "priority"),
+     sched_get_priority_min (SCHED_FIFO), sched_get_priority_max (SCHED_FIFO));
+    s_cpu = aud_get_int ("output_realtime", "cpu");
+
+    bool enabled = aud_get_bool ("output_realtime", "enabled");
+    s_enabled = enabled;
+    return enabled;
+}
+
+#ifdef __linux__
+/* rtkit only serves processes that limit how long a real-time thread may
+ * run without sleeping, so that a runaway one is killed instead of hanging
+ * the machine.  It takes the thread by its ID, so this need not run on the
+ * thread itself. */
+static bool rtkit_make_realtime (pid_t tid, int priority)
+{
+    struct rlimit limit;
+    if (getrlimit (RLIMIT_RTTIME, & limit) == 0 && limit.rlim_max > RTKIT_RTTIME)
+    {
+        limit.rlim_cur = limit.rlim_max = RTKIT_RTTIME;
+        setrlimit (RLIMIT_RTTIME, & limit);
+    }
+
+    GError * error = nullptr;
+    GDBusConnection * bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, nullptr, & error);
+
+    if (! bus)
+    {
+        AUDWARN ("No system bus for rtkit: %s\n", error->message);
+        g_error_free (error);
+        return false;
+    }
+
+    GVariant * result = g_dbus_connection_call_sync (bus,
+     "org.freedesktop.RealtimeKit1", "/org/freedesktop/RealtimeKit1",
+     "org.freedesktop.RealtimeKit1", "MakeThreadRealtime",
+     g_variant_new ("(tu)", (guint64) tid, (guint32) priority),
+     nullptr, G_DBUS_CALL_FLAGS_NONE, RTKIT_TIMEOUT_MS, nullptr, & error);
+
+    g_object_unref (bus);
+
+    if (! result)
+    {
+        AUDWARN ("rtkit refused real-time priority: %s\n", error->message);
+        g_error_free (error);
+        return false;
+    }
+
+    g_variant_unref (result);
+    return true;
+}
+#endif
+
+/* Nothing on the audio thread may block: it may be real-time already, and
+ * the sound server then expects it back within the period.  The system
+ * calls below return at once; asking rtkit and logging are left to a
+ * thread of their own. */
+static void set_scheduling (Report & report)
+{
+    int policy;
+    sched_param param;
+
+    if (pthread_getschedparam (pthread_self (), & policy, & param) == 0 &&
+     (policy == SCHED_FIFO || policy == SCHED_RR))
+    {
+        report.already = true;
+        report.priority = param.sched_priority;
+        return;
+    }
+
+    param.sched_priority = report.priority;
+    report.sched_error = pthread_setschedparam (pthread_self (), SCHED_FIFO, & param);
+}
+
+static void lock_buffer (Report & report, const void * buffer, int64_t size)
+{
+    if (! buffer || size <= 0)
+        return;
+
+    if (mlock (buffer, size) < 0)
+        report.lock_error = errno;
+    else
+        report.locked = size;
+}
+
+static void set_affinity (Report & report)
+{
+    if (report.cpu < 0)
+        return;
+
+#ifdef __linux__
+    if (report.cpu < CPU_SETSIZE)
+    {
+        cpu_set_t set;
+        CPU_ZERO (& set);
+        CPU_SET (report.cpu, & set);
+
+        report.cpu_error = pthread_setaffinity_np (pthread_self (), sizeof set, & set);
+        return;
+    }
+#endif
+
+    report.cpu_error = -1;
+}
+
+static StringBuf describe_scheduling (const Report & report)
+{
+    if (report.already)
+        return str_printf ("already real-time (priority %d)", report.priority);
+    if (! report.sched_error)
+        return str_printf ("SCHED_FIFO priority %d", report.priority);
+
+#ifdef __linux__
+    if (report.sched_error == EPERM && rtkit_make_realtime (report.tid, report.priority))
+        return str_printf ("SCHED_FIFO priority %d through rtkit", report.priority);
+#endif
+
+    return str_printf ("not obtained (%s)", strerror (report.sched_error));
+}
+
+static StringBuf describe_buffer (const Report & report)
+{
+    if (report.lock_error)
+        return str_printf ("not locked (%s)", strerror (report.lock_error));
+    if (! report.locked)
+        return str_copy ("none");
+
+    return str_printf ("%d KiB locked", (int) (report.locked / 1024));
+}
+
+static StringBuf describe_affinity (const Report & report)
+{
+    if (report.cpu < 0)
+        return str_copy ("any CPU");
+    if (report.cpu_error < 0)
+        return str_printf ("CPU %d not supported", report.cpu);
+    if (report.cpu_error)
+        return str_printf ("CPU %d not obtained (%s)", report.cpu, strerror (report.cpu_error));
+
+    return str_printf ("CPU %d", report.cpu);
+}
+
+/* asks rtkit where the thread could not set SCHED_FIFO itself */
+static void * finish_enter (void *)
+{
+    StringBuf scheduling = describe_scheduling (s_report);
+    StringBuf locked = describe_buffer (s_report);
+    StringBuf affinity = describe_affinity (s_report);
+
+    AUDINFO ("Real-time mode for %s: scheduling %s; buffer %s; %s.\n", s_report.name,
+     (const char *) scheduling, (const char *) locked, (const char *) affinity);
+
+    return nullptr;
+}
+
+void realtime_enter (const char * name, const void * buffer, int64_t size)
+{
+    /* once per stream; the helper is joined before the next one */
+    if (! s_enabled.exchange (false))
+        return;
+
+    Report & report = s_report;
+
+    report = Report ();
+    report.name = name;
+#ifdef __linux__
+    report.tid = syscall (SYS_gettid);
+#endif
+    report.priority = s_priority;
+    report.cpu = s_cpu;
+
+    set_scheduling (report);
+    lock_buffer (report, buffer, size);
+    set_affinity (report);
+
+    if (! pthread_create (& s_helper, nullptr, finish_enter, nullptr))
+        s_helper_started = true;
+}
+
+void realtime_leave (const void * buffer, int64_t size)
+{
+    join_helper ();
+
+    /* harmless if the buffer was never locked */
+    if (buffer && size > 0)
+        munlock (buffer, size);
+}
@@ -0,0 +1,60 @@
+/*
+ * realtime.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_OUTPUT_REALTIME_H
+#define AUD_OUTPUT_REALTIME_H
+
+#include <stdint.h>
+
+/* Opt-in real-time treatment of the thread that feeds the sound card, for
+ * machines busy enough that it otherwise misses its deadlines now and then.
+ * The settings are shared by the output plugins, in the "output_realtime"
+ * section: "enabled", "priority" (SCHED_FIFO, 1 to 99) and "cpu" (the one
+ * to run on, or -1 for any).
+ *
+ * realtime_prepare() reads the settings on the player thread, before the
+ * audio thread starts, and returns whether real-time mode is enabled.
+ * realtime_enter() is then called on the audio thread itself, once.  It asks
+ * for SCHED_FIFO, locks the given buffer into memory and sets the CPU
+ * affinity, with system calls that do not block.  A thread already given
+ * real-time priority by the sound server is left as it is.  Where the
+ * process may not set SCHED_FIFO itself, a thread of its own asks rtkit,
+ * then logs what was got. */
+
+void realtime_init ();
+
+bool realtime_prepare ();
+
+void realtime_enter (const char * name, const void * buffer, int64_t size);
+
+/* after the audio thread is gone: waits for the rtkit request, if any, and
+ * unlocks the buffer given to realtime_enter(), before it is freed */
+void realtime_leave (const void * buffer, int64_t size);
+
+#define REALTIME_WIDGETS \
+    WidgetCheck (N_("Real-time priority for the audio thread"), \
+        WidgetBool ("output_realtime", "enabled")), \
+    WidgetSpin (N_("Priority:"), \
+        WidgetInt ("output_realtime", "priority"), \
+        {1, 99, 1}, WIDGET_CHILD), \
+    WidgetSpin (N_("Run on CPU:"), \
+        WidgetInt ("output_realtime", "cpu"), \
+        {-1, 1023, 1, N_("(-1 for any)")}, WIDGET_CHILD)
+
+#endif
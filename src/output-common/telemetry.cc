@@ -0,0 +1,192 @@
+/*
+ * telemetry.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "telemetry.h"
+
+#include <inttypes.h>
+#include <time.h>
+
+#include <atomic>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/hook.h>
+#include <libaudcore/objects.h>
+#include <libaudcore/runtime.h>
+
+#include "../trace-common/trace.h"
+
+/* Each plugin has its own copy of this (only one stream is open at a time
+ * anyway); the event and hook are what make the counters visible outside
+ * of it. */
+static const char * stats_plugin;
+
+static std::atomic<int64_t> stats_xruns, stats_underruns, stats_wakeups;
+static std::atomic<int64_t> stats_fill[OUTPUT_STATS_FILL_STEPS];
+static std::atomic<int> stats_latency, stats_rate, stats_target;
+static std::atomic<const char *> stats_path;
+static std::atomic<const char *> stats_target_reason; /* not logged yet */
+static int64_t stats_opened;
+
+/* only touched by telemetry_latency(), which get_delay() calls with the
+ * core's output lock held */
+static int64_t stats_published, stats_last_wakeups;
+
+static int64_t now_ms ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void fill_stats (OutputStats & stats, int64_t now)
+{
+    stats.plugin = stats_plugin;
+    stats.seconds = (now - stats_opened) / 1000;
+    stats.xruns = stats_xruns.load (std::memory_order_relaxed);
+    stats.underruns = stats_underruns.load (std::memory_order_relaxed);
+    stats.wakeups = stats_rate.load (std::memory_order_relaxed);
+    stats.latency = stats_latency.load (std::memory_order_relaxed);
+    stats.target = stats_target.load (std::memory_order_relaxed);
+    stats.path = stats_path.load (std::memory_order_relaxed);
+
+    for (int i = 0; i < OUTPUT_STATS_FILL_STEPS; i ++)
+        stats.fill[i] = stats_fill[i].load (std::memory_order_relaxed);
+}
+
+static void dump_cb (void *, void *)
+{
+    OutputStats stats;
+    fill_stats (stats, now_ms ());
+    telemetry_log (stats);
+}
+
+/* the target may change on a real-time thread, where there is to be no
+ * logging; it is logged from the player thread instead */
+static void log_target ()
+{
+    const char * reason = stats_target_reason.exchange (nullptr, std::memory_order_relaxed);
+    if (reason)
+        AUDINFO ("%s buffer target: %d ms (%s).\n", stats_plugin,
+         stats_target.load (std::memory_order_relaxed), reason);
+}
+
+void telemetry_open (const char * plugin)
+{
+    stats_plugin = plugin;
+
+    stats_xruns = 0;
+    stats_underruns = 0;
+    stats_wakeups = 0;
+    stats_latency = 0;
+    stats_path = nullptr;
+    stats_target_reason = nullptr;
+
+    for (auto & step : stats_fill)
+        step = 0;
+
+    stats_opened = stats_published = now_ms ();
+    stats_last_wakeups = 0;
+    stats_rate = 0;
+
+    hook_associate ("output stats dump", dump_cb, nullptr);
+}
+
+void telemetry_close ()
+{
+    hook_dissociate ("output stats dump", dump_cb);
+    log_target ();
+    dump_cb (nullptr, nullptr);
+}
+
+void telemetry_xrun ()
+{
+    TRACE_MARK ("output xrun");
+    stats_xruns.fetch_add (1, std::memory_order_relaxed);
+}
+
+void telemetry_underrun ()
+{
+    TRACE_MARK ("output underrun");
+    stats_underruns.fetch_add (1, std::memory_order_relaxed);
+}
+
+void telemetry_wakeup (int64_t fill, int64_t size)
+{
+    stats_wakeups.fetch_add (1, std::memory_order_relaxed);
+
+    if (size > 0)
+    {
+        int step = aud::clamp<int64_t> (fill * OUTPUT_STATS_FILL_STEPS / size,
+         0, OUTPUT_STATS_FILL_STEPS - 1);
+        stats_fill[step].fetch_add (1, std::memory_order_relaxed);
+    }
+}
+
+int telemetry_latency (int ms)
+{
+    stats_latency.store (ms, std::memory_order_relaxed);
+    log_target ();
+
+    int64_t now = now_ms ();
+    if (now - stats_published < 1000)
+        return ms;
+
+    int64_t wakeups = stats_wakeups.load (std::memory_order_relaxed);
+    stats_rate = (int) ((wakeups - stats_last_wakeups) * 1000 /
+     (now - stats_published));
+    stats_last_wakeups = wakeups;
+    stats_published = now;
+
+    auto stats = new OutputStats;
+    fill_stats (* stats, now);
+    event_queue ("output stats", stats, aud::delete_obj<OutputStats>);
+
+    return ms;
+}
+
+void telemetry_target (int ms, const char * reason)
+{
+    stats_target.store (ms, std::memory_order_relaxed);
+
+    if (reason)
+        stats_target_reason.store (reason, std::memory_order_relaxed);
+}
+
+void telemetry_path (const char * path)
+{
+    stats_path.store (path, std::memory_order_relaxed);
+    AUDINFO ("%s output path: %s.\n", stats_plugin, path);
+}
+
+void telemetry_log (const OutputStats & stats)
+{
+    int64_t total = 0;
+    for (int64_t n : stats.fill)
+        total += n;
+
+    StringBuf fill (0);
+    for (int64_t n : stats.fill)
+        fill.insert (-1, str_printf (" %d%%", total ? (int) (n * 100 / total) : 0));
+
+    AUDINFO ("%s after %d s: %" PRId64 " xruns, %" PRId64 " underruns, "
+     "%d wakeups/s, latency %d ms, target %d ms, path %s, "
+     "buffer fill by tenths:%s.\n", stats.plugin, stats.seconds, stats.xruns,
+     stats.underruns, stats.wakeups, stats.latency, stats.target,
+     stats.path ? stats.path : "unchecked", (const char *) fill);
+}
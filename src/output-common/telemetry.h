@@ -0,0 +1,80 @@
+/*
+ * telemetry.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_OUTPUT_TELEMETRY_H
+#define AUD_OUTPUT_TELEMETRY_H
+
+#include <stdint.h>
+
+/* Counters kept by the output plugins while a stream is open, so that
+ * stutter can be traced to the sink (or ruled out):
+ *
+ *   xruns       the device itself ran dry and had to be restarted
+ *   underruns   the sink asked for audio the plugin did not have yet
+ *   wakeups     times the audio thread woke up, per second
+ *   latency     the delay last reported by get_delay(), in milliseconds
+ *   target      the fill level aimed at, in milliseconds, where the plugin
+ *               adapts it (see adaptive.h), or 0
+ *   path        "bit-perfect", or why the audio is not (see bitperfect.h), or
+ *               nullptr where the plugin does not check
+ *   fill        wakeups counted by how full the plugin's buffer was at the
+ *               time, in tenths
+ *
+ * The telemetry_*() calls are cheap enough for the audio thread and safe
+ * from any thread.  About once a second, telemetry_latency() queues a copy
+ * of the counters as the "output stats" event (with a const OutputStats *
+ * as data); calling the "output stats dump" hook logs them, and they are
+ * logged once more when the stream is closed. */
+
+#define OUTPUT_STATS_FILL_STEPS 10
+
+struct OutputStats {
+    const char * plugin;
+    int seconds;            /* since the stream was opened */
+    int64_t xruns, underruns;
+    int wakeups;            /* per second, over the last second */
+    int latency;
+    int target;
+    const char * path;  /* a static string */
+    int64_t fill[OUTPUT_STATS_FILL_STEPS];
+};
+
+void telemetry_open (const char * plugin);
+void telemetry_close ();
+
+void telemetry_xrun ();
+void telemetry_underrun ();
+
+/* fill and size in any unit; size may be 0 where there is no buffer */
+void telemetry_wakeup (int64_t fill, int64_t size);
+
+/* returns ms, so that get_delay() can end with it */
+int telemetry_latency (int ms);
+
+/* logged with the reason, unless that is nullptr, by the next
+ * telemetry_latency() rather than here, so that it may be called from a
+ * real-time thread; the target is kept from one stream to the next */
+void telemetry_target (int ms, const char * reason);
+
+/* logged; path is kept until the stream is closed */
+void telemetry_path (const char * path);
+
+void telemetry_log (const OutputStats & stats);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * output-stats.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <QFormLayout>
+#include <QLabel>
+#include <QPainter>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/hook.h>
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/runtime.h>
+
+#include <libaudqt/libaudqt.h>
+
+#include "../output-common/telemetry.h"
+#include "../trace-common/trace.h"
+
+class OutputStatsQt : public GeneralPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("Output Statistics"),
+        PACKAGE,
+        nullptr, // about
+        nullptr, // prefs
+        PluginQtOnly
+    };
+
+    constexpr OutputStatsQt () : GeneralPlugin (info, false) {}
+    void * get_qt_widget () override;
+};
+
+/* one bar per tenth of buffer fill, as a share of the wakeups */
+class FillHistogram : public QWidget
+{
+public:
+    FillHistogram (QWidget * parent = nullptr) : QWidget (parent)
+        { setMinimumHeight (audqt::sizes.OneInch / 2); }
+
+    void set_fill (const int64_t * fill)
+    {
+        std::copy (fill, fill + OUTPUT_STATS_FILL_STEPS, m_fill);
+        update ();
+    }
+
+protected:
+    void paintEvent (QPaintEvent *) override
+    {
+        QPainter p (this);
+
+        int64_t max = 0;
+        for (int64_t n : m_fill)
+            max = aud::max (max, n);
+
+        int w = width () / OUTPUT_STATS_FILL_STEPS;
+        QColor color = palette ().color (QPalette::Highlight);
+
+        for (int i = 0; i < OUTPUT_STATS_FILL_STEPS; i ++)
+        {
+            int h = max ? (int) (m_fill[i] * height () / max) : 0;
+            p.fillRect (i * w + 1, height () - h, w - 2, h, color);
+        }
+    }
+
+private:
+    int64_t m_fill[OUTPUT_STATS_FILL_STEPS] {};
+};
+
+class OutputStatsWidget : public QWidget
+{
+public:
+    OutputStatsWidget ();
+
+private:
+    QLabel * m_plugin = new QLabel (this);
+    QLabel * m_latency = new QLabel (this);
+    QLabel * m_target = new QLabel (this);
+    QLabel * m_path = new QLabel (this);
+    QLabel * m_xruns = new QLabel (this);
+    QLabel * m_underruns = new QLabel (this);
+    QLabel * m_wakeups = new QLabel (this);
+    FillHistogram * m_histogram = new FillHistogram (this);
+
+    void update (const OutputStats * stats);
+    void clear ();
+
+    const HookReceiver<OutputStatsWidget, const OutputStats *>
+        stats_hook {"output stats", this, & OutputStatsWidget::update};
+    const HookReceiver<OutputStatsWidget>
+        stop_hook {"playback stop", this, & OutputStatsWidget::clear};
+};
+
+OutputStatsWidget::OutputStatsWidget ()
+{
+    auto form = new QFormLayout;
+    form->addRow (_("Output:"), m_plugin);
+    form->addRow (_("Latency:"), m_latency);
+    form->addRow (_("Target fill:"), m_target);
+    form->addRow (_("Path:"), m_path);
+    form->addRow (_("Xruns:"), m_xruns);
+    form->addRow (_("Underruns:"), m_underruns);
+    form->addRow (_("Wakeups:"), m_wakeups);
+
+    auto fill_label = new QLabel (_("Buffer fill (empty to full):"));
+    auto log_button = new QPushButton (_("Write to Log"));
+
+    auto layout = audqt::make_vbox (this);
+    layout->addLayout (form);
+    layout->addWidget (fill_label);
+    layout->addWidget (m_histogram, 1);
+
+#ifdef USE_TRACE
+    auto trace_button = new QPushButton (_("Save Trace"));
+    auto buttons = audqt::make_hbox (nullptr);
+    buttons->addStretch (1);
+    buttons->addWidget (trace_button);
+    buttons->addWidget (log_button);
+    layout->addLayout (buttons);
+
+    QObject::connect (trace_button, & QPushButton::clicked, [] () {
+        StringBuf path = filename_build ({aud_get_path (AudPath::UserDir), "trace.json"});
+        if (trace_dump (path))
+            AUDINFO ("Trace written to %s.\n", (const char *) path);
+        else
+            AUDERR ("Cannot write %s.\n", (const char *) path);
+    });
+#else
+    layout->addWidget (log_button, 0, Qt::AlignRight);
+#endif
+
+    QObject::connect (log_button, & QPushButton::clicked, [] () {
+        hook_call ("output stats dump", nullptr);
+    });
+
+    clear ();
+}
+
+void OutputStatsWidget::update (const OutputStats * stats)
+{
+    m_plugin->setText (stats->plugin);
+    m_latency->setText (QString (_("%1 ms")).arg (stats->latency));
+    m_target->setText (stats->target ?
+     QString (_("%1 ms")).arg (stats->target) : QString ("-"));
+    m_path->setText (stats->path ? QString (stats->path) : QString ("-"));
+    m_xruns->setText (QString::number (stats->xruns));
+    m_underruns->setText (QString::number (stats->underruns));
+    m_wakeups->setText (QString (_("%1 per second")).arg (stats->wakeups));
+    m_histogram->set_fill (stats->fill);
+}
+
+void OutputStatsWidget::clear ()
+{
+    static const int64_t empty[OUTPUT_STATS_FILL_STEPS] {};
+
+    for (QLabel * label : {m_plugin, m_latency, m_target, m_path, m_xruns, m_underruns, m_wakeups})
+        label->setText ("-");
+
+    m_histogram->set_fill (empty);
+}
+
+void * OutputStatsQt::get_qt_widget ()
+{
+    return new OutputStatsWidget;
+}
+
+EXPORT OutputStatsQt aud_plugin_instance;
@@ -20,7 +20,10 @@
  * the use of this software.
  */
 
+#include <algorithm>
 #include <cstring>
+#include <ctime>
+#include <pthread.h>
 
 #include <pipewire/pipewire.h>
 #include <spa/param/audio/format-utils.h>
@@ -28,9 +31,16 @@
 
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
 #include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
+#include "../output-common/adaptive.h"
+#include "../output-common/bitperfect.h"
+#include "../output-common/realtime.h"
+#include "../output-common/telemetry.h"
+#include "../trace-common/trace.h"
+
 #if !PW_CHECK_VERSION(0, 3, 50)
 static inline int pw_stream_get_time_n(struct pw_stream * stream,
                                        struct pw_time * time, size_t size)
@@ -40,7 +50,6 @@ static inline int pw_stream_get_time_n(struct pw_stream * stream,
 #endif
 
 #if !PW_CHECK_VERSION(1, 0, 4)
-#include <ctime>
 static uint64_t pw_stream_get_nsec(struct pw_stream * stream)
 {
     struct timespec ts;
@@ -54,12 +63,14 @@ class PipeWireOutput : public OutputPlugin
 public:
     static const char about[];
     static const char * const defaults[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
 
     static constexpr PluginInfo info = {
         N_("PipeWire Output"),
         PACKAGE,
         about,
-        nullptr
+        &prefs
     };
 
     constexpr PipeWireOutput() : OutputPlugin(info, 8) {}
@@ -98,6 +109,14 @@ private:
     static void on_process(void * data);
     static void on_drained(void * data);
 
+    int ring_space();
+    bool can_spill();
+    bool take_buffer();
+    int fill_buffers(const unsigned char * data, int length);
+    int drain_ring();
+    void queue_pending();
+    void timed_wait(int seconds);
+
     static enum spa_audio_format to_pipewire_format(int format);
     static void set_channel_map(struct spa_audio_info_raw * info, int channels);
 
@@ -114,13 +133,30 @@ private:
     bool m_inited = false;
     bool m_has_sinks = false;
     bool m_ignore_state_change = false;
+    bool m_realtime_entered = false;
+    bool m_bit_perfect = false;
+    bool m_rate_checked = false;
 
     int m_aud_format = 0;
     int m_core_init_seq = 0;
 
+    /* m_queue_mutex guards the ring buffer and the pending buffer, and
+     * serializes dequeueing between write_audio() and on_process(); the
+     * data thread only ever try-locks it */
+    pthread_mutex_t m_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_queue_cond = PTHREAD_COND_INITIALIZER;
+    bool m_waiting = false;
+    bool m_draining = false; /* from drain() until more is written */
+    bool m_primed = false;   /* written to since opening or flushing */
+
+    struct pw_buffer * m_pending = nullptr;
+    unsigned int m_pending_fill = 0;
+    unsigned int m_pending_size = 0;
+
     RingBuf<unsigned char> m_buffer;
     unsigned int m_pw_buffer_size = 0;
     unsigned int m_frames = 0;
+    unsigned int m_latency_frames = 0;
     unsigned int m_stride = 0;
     unsigned int m_rate = 0;
     unsigned int m_channels = 0;
@@ -128,6 +164,9 @@ private:
 
 EXPORT PipeWireOutput aud_plugin_instance;
 
+/* the ring only holds what is written before the stream has buffers */
+static constexpr int SPILL_MS = 20;
+
 const char PipeWireOutput::about[] =
  N_("PipeWire Output Plugin for Audacious\n"
     "Copyright 2022 Thomas Lange\n\n"
@@ -140,6 +179,14 @@ const char * const PipeWireOutput::defaults[] = {
     nullptr
 };
 
+const PreferencesWidget PipeWireOutput::widgets[] = {
+    BITPERFECT_WIDGETS,
+    ADAPTIVE_WIDGETS,
+    REALTIME_WIDGETS
+};
+
+const PluginPreferences PipeWireOutput::prefs = {{widgets}};
+
 StereoVolume PipeWireOutput::get_volume()
 {
     return {aud_get_int("pipewire", "volume_left"),
@@ -151,7 +198,8 @@ void PipeWireOutput::set_volume(StereoVolume v)
     aud_set_int("pipewire", "volume_left", v.left);
     aud_set_int("pipewire", "volume_right", v.right);
 
-    if (!m_loop)
+    /* with bit-perfect output, the stream volume stays at unity */
+    if (!m_loop || m_bit_perfect)
         return;
 
     // Re-use libaudcore's decibel-to-linear translation by passing
@@ -178,7 +226,11 @@ void PipeWireOutput::pause(bool pause)
 
 int PipeWireOutput::get_delay()
 {
-    int buff_time = ((m_buffer.len() / m_stride) * 1000) / m_rate;
+    pthread_mutex_lock(&m_queue_mutex);
+    int buffered = m_buffer.len() + m_pending_fill;
+    pthread_mutex_unlock(&m_queue_mutex);
+
+    int buff_time = ((buffered / m_stride) * 1000) / m_rate;
     int pw_buff_time = ((m_pw_buffer_size / m_stride) * 1000) / m_rate;
     int time_diff = 0;
     int add_delay = 0;
@@ -196,26 +248,40 @@ int PipeWireOutput::get_delay()
 #endif
         if (time.rate.denom > 0)
             add_delay += time.delay * 1000 * time.rate.num / time.rate.denom;
+
+        /* the graph clock gives away whether the stream is resampled */
+        if (m_bit_perfect && !m_rate_checked && time.rate.denom > 0)
+        {
+            m_rate_checked = true;
+            if (time.rate.num == 1 && time.rate.denom != m_rate)
+                telemetry_path(_("resampled by PipeWire"));
+        }
     }
 
-    return buff_time + pw_buff_time - time_diff + add_delay;
+    return telemetry_latency(buff_time + pw_buff_time - time_diff + add_delay);
 }
 
 void PipeWireOutput::drain()
 {
-    pw_thread_loop_lock(m_loop);
+    pthread_mutex_lock(&m_queue_mutex);
+    m_draining = true;
 
     int buflen;
-    while ((buflen = m_buffer.len()) > 0)
+    while ((buflen = m_buffer.len() + m_pending_fill) > 0)
     {
-        pw_thread_loop_timed_wait(m_loop, 1);
-        if (buflen <= m_buffer.len())
+        m_waiting = true;
+        timed_wait(1);
+        if (buflen <= m_buffer.len() + (int)m_pending_fill)
         {
             AUDERR("PipeWireOutput: buffer drain lock\n");
             break;
         }
     }
 
+    m_waiting = false;
+    pthread_mutex_unlock(&m_queue_mutex);
+
+    pw_thread_loop_lock(m_loop);
     pw_stream_flush(m_stream, true);
     pw_thread_loop_timed_wait(m_loop, 1); // trigger on_drained() callback
     pw_thread_loop_unlock(m_loop);
@@ -223,31 +289,192 @@ void PipeWireOutput::drain()
 
 void PipeWireOutput::flush()
 {
-    pw_thread_loop_lock(m_loop);
+    pthread_mutex_lock(&m_queue_mutex);
     m_buffer.discard();
-    pw_thread_loop_unlock(m_loop);
+    m_primed = false;
+
+    /* handed back empty */
+    if (m_pending)
+    {
+        m_pending_fill = 0;
+        queue_pending();
+    }
+
+    pthread_mutex_unlock(&m_queue_mutex);
     pw_stream_flush(m_stream, false);
 }
 
 void PipeWireOutput::period_wait()
 {
-    if (m_buffer.space())
-        return;
+    TRACE_SPAN("PipeWire period_wait");
+    pthread_mutex_lock(&m_queue_mutex);
 
-    pw_thread_loop_lock(m_loop);
-    pw_thread_loop_timed_wait(m_loop, 1);
-    pw_thread_loop_unlock(m_loop);
+    /* paced by the stream's own buffers: on_process() wakes us once the
+     * graph has handed one back */
+    if (!take_buffer() && !(can_spill() && ring_space()))
+    {
+        m_waiting = true;
+        timed_wait(1);
+        m_waiting = false;
+    }
+
+    pthread_mutex_unlock(&m_queue_mutex);
+}
+
+/* called with m_queue_mutex held */
+void PipeWireOutput::timed_wait(int seconds)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += seconds;
+    pthread_cond_timedwait(&m_queue_cond, &m_queue_mutex, &ts);
+}
+
+/* Hands the buffer being filled by write_audio() to the stream, however
+ * full it is.  Called with m_queue_mutex held. */
+void PipeWireOutput::queue_pending()
+{
+    struct spa_data * d = &m_pending->buffer->datas[0];
+
+    d->chunk->offset = 0;
+    d->chunk->size = m_pending_fill;
+    d->chunk->stride = m_stride;
+
+    /* summed up by the stream as pw_time.queued */
+    m_pending->size = m_pending_fill / m_stride;
+
+    if (m_pending_fill)
+        m_pw_buffer_size = m_pending_fill;
+
+    pw_stream_queue_buffer(m_stream, m_pending);
+
+    m_pending = nullptr;
+    m_pending_fill = 0;
+}
+
+/* Dequeues a buffer to be filled, unless one is being filled already, and
+ * returns whether there is one.  Called with m_queue_mutex held. */
+bool PipeWireOutput::take_buffer()
+{
+    if (m_pending)
+        return true;
+
+    if (!(m_pending = pw_stream_dequeue_buffer(m_stream)))
+        return false;
+
+    struct spa_data * d = &m_pending->buffer->datas[0];
+    if (!d->data)
+    {
+        m_pending_fill = 0;
+        queue_pending();
+        return false;
+    }
+
+    m_pending_size = d->maxsize - d->maxsize % m_stride;
+#if PW_CHECK_VERSION(0, 3, 49)
+    if (m_pending->requested)
+        m_pending_size = aud::min<uint64_t>(m_pending_size, m_pending->requested * m_stride);
+#endif
+    m_pending_size = aud::max(m_pending_size, m_stride);
+
+    return true;
 }
 
+/* Copies straight into buffers dequeued from the stream, each of them
+ * filled up to a quantum of the graph before it is queued, and returns
+ * how much was taken.  Called with m_queue_mutex held. */
+int PipeWireOutput::fill_buffers(const unsigned char * data, int length)
+{
+    int written = 0;
+
+    while (length >= (int)m_stride && take_buffer())
+    {
+        auto dst = static_cast<unsigned char *>(m_pending->buffer->datas[0].data);
+        int size = aud::min<int>(m_pending_size - m_pending_fill, length);
+        size -= size % m_stride;
+
+        memcpy(dst + m_pending_fill, data, size);
+        m_pending_fill += size;
+
+        data += size;
+        length -= size;
+        written += size;
+
+        if (m_pending_fill >= m_pending_size)
+            queue_pending();
+    }
+
+    return written;
+}
+
+/* Moves what was left in the ring into the stream's buffers; it goes ahead
+ * of anything written after it, and after anything in the buffer being
+ * filled.  Returns how much was moved.  Called with m_queue_mutex held. */
+int PipeWireOutput::drain_ring()
+{
+    int moved = 0;
+
+    while (m_buffer.len())
+    {
+        int linear = m_buffer.linear();
+        int taken = fill_buffers(&m_buffer[0], linear);
+
+        m_buffer.discard(taken);
+        moved += taken;
+
+        if (taken < linear)
+            break;
+    }
+
+    return moved;
+}
+
+/* Whether the ring may take what the stream's buffers cannot: only while
+ * nothing is queued in them, such as before the stream has started; with
+ * buffers queued, the writer waits for one of them instead.  Called with
+ * m_queue_mutex held. */
+bool PipeWireOutput::can_spill()
+{
+    struct pw_time time;
+    return pw_stream_get_time_n(m_stream, &time, sizeof time) != 0 || !time.queued;
+}
+
+/* With adaptive buffering, the ring is only filled up to the target, less
+ * what is held in the buffer being filled.  Called with m_queue_mutex
+ * held. */
+int PipeWireOutput::ring_space()
+{
+    int space = m_buffer.space();
+    int target = adaptive_target();
+
+    if (!target)
+        return space;
+
+    int limit = aud::rescale(target, 1000, (int)m_rate) * m_stride;
+    return aud::clamp(limit - m_buffer.len() - (int)m_pending_fill, 0, space);
+}
+
+/* The audio goes straight into the stream's own buffers, and a write they
+ * have no room for is cut short.  Only while none of ours is queued (the
+ * stream has no buffers to give out yet) is it kept in the ring, which is
+ * small; it is moved out on the next write, or by on_process() once the
+ * graph asks for it. */
 int PipeWireOutput::write_audio(const void * data, int length)
 {
-    pw_thread_loop_lock(m_loop);
+    TRACE_SPAN("PipeWire write_audio");
+    auto src = static_cast<const unsigned char *>(data);
+    pthread_mutex_lock(&m_queue_mutex);
 
-    length = aud::min(length, m_buffer.space());
-    m_buffer.copy_in(static_cast<const unsigned char *>(data), length);
+    drain_ring();
+    int written = m_buffer.len() ? 0 : fill_buffers(src, length);
 
-    pw_thread_loop_unlock(m_loop);
-    return length;
+    int rest = (!written && can_spill()) ? aud::min(length, ring_space()) : 0;
+    m_buffer.copy_in(src + written, rest);
+    m_draining = false;
+    m_primed = true;
+
+    pthread_mutex_unlock(&m_queue_mutex);
+    return written + rest;
 }
 
 void PipeWireOutput::close_audio()
@@ -263,6 +490,10 @@ void PipeWireOutput::close_audio()
         pw_thread_loop_unlock(m_loop);
     }
 
+    /* freed along with the stream */
+    m_pending = nullptr;
+    m_pending_fill = 0;
+
     if (m_loop)
         pw_thread_loop_stop(m_loop);
 
@@ -290,7 +521,9 @@ void PipeWireOutput::close_audio()
         m_loop = nullptr;
     }
 
+    realtime_leave(nullptr, 0);
     m_buffer.destroy();
+    telemetry_close();
 }
 
 bool PipeWireOutput::open_audio(int format, int rate, int channels, String & error)
@@ -298,6 +531,19 @@ bool PipeWireOutput::open_audio(int format, int rate, int channels, String & err
     m_aud_format = format;
     m_rate = rate;
     m_channels = channels;
+    m_realtime_entered = false;
+    m_primed = false;
+    realtime_prepare();
+    m_bit_perfect = bitperfect_enabled();
+    m_rate_checked = false;
+
+    telemetry_open("PipeWire");
+
+    if (m_bit_perfect)
+    {
+        const char * reason = bitperfect_check();
+        telemetry_path(reason ? reason : _("bit-perfect"));
+    }
 
     if (!init_core() || !init_stream())
     {
@@ -311,6 +557,9 @@ bool PipeWireOutput::open_audio(int format, int rate, int channels, String & err
 bool PipeWireOutput::init()
 {
     aud_config_set_defaults("pipewire", defaults);
+    adaptive_init();
+    bitperfect_init();
+    realtime_init();
     pw_init(nullptr, nullptr);
 
     /* try to create main loop to test if pipewire is available */
@@ -394,7 +643,10 @@ bool PipeWireOutput::init_core()
 
     m_frames = aud_get_int("output_buffer_size") * m_rate / 1000;
     m_stride = FMT_SIZEOF(m_aud_format) * m_channels;
-    m_buffer.alloc(m_frames * m_stride);
+    m_buffer.alloc(aud::min<int>(m_frames, SPILL_MS * m_rate / 1000) * m_stride);
+
+    /* the latency asked of the graph starts out at the target fill too */
+    m_latency_frames = adaptive_open(aud_get_int("output_buffer_size")) * m_rate / 1000;
 
     return true;
 }
@@ -435,6 +687,14 @@ bool PipeWireOutput::init_stream()
         return false;
     }
 
+    /* whatever volume the session manager restored for the stream */
+    if (m_bit_perfect)
+    {
+        float unity[SPA_AUDIO_MAX_CHANNELS];
+        std::fill(unity, unity + m_channels, 1.0f);
+        pw_stream_set_control(m_stream, SPA_PROP_channelVolumes, m_channels, unity, nullptr);
+    }
+
     pw_thread_loop_unlock(m_loop);
     return true;
 }
@@ -451,7 +711,16 @@ struct pw_stream * PipeWireOutput::create_stream()
                           nullptr);
 
     pw_properties_setf(props, PW_KEY_NODE_RATE, "1/%u", m_rate);
-    pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", m_frames, m_rate);
+    pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", m_latency_frames, m_rate);
+
+    /* ask the graph to switch to our rate, and leave the samples alone */
+    if (m_bit_perfect)
+    {
+        pw_properties_setf(props, "node.force-rate", "%u", m_rate);
+        pw_properties_set(props, "resample.disable", "true");
+        pw_properties_set(props, "channelmix.disable", "true");
+        pw_properties_set(props, "dither.method", "none");
+    }
 
     return pw_stream_new(m_core, _("Playback"), props);
 }
@@ -476,6 +745,8 @@ bool PipeWireOutput::connect_stream(enum spa_audio_format format)
     auto stream_flags = static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT |
                                                      PW_STREAM_FLAG_MAP_BUFFERS |
                                                      PW_STREAM_FLAG_RT_PROCESS);
+    if (m_bit_perfect)
+        stream_flags = static_cast<pw_stream_flags>(stream_flags | PW_STREAM_FLAG_EXCLUSIVE);
 
     return pw_stream_connect(m_stream, PW_DIRECTION_OUTPUT, PW_ID_ANY,
                              stream_flags, params, aud::n_elems(params)) == 0;
@@ -534,40 +805,55 @@ void PipeWireOutput::on_state_changed(void * data, enum pw_stream_state old,
 void PipeWireOutput::on_process(void * data)
 {
     PipeWireOutput * o = static_cast<PipeWireOutput *>(data);
-    struct pw_buffer * b;
-    struct spa_buffer * buf;
-    void * dst;
 
-    if (!o->m_buffer.len())
+    /* with PW_STREAM_FLAG_RT_PROCESS, this runs on the data thread; the ring
+     * buffer belongs to RingBuf and cannot be locked from here */
+    if (!o->m_realtime_entered)
     {
-        pw_thread_loop_signal(o->m_loop, false);
-        return;
+        o->m_realtime_entered = true;
+        realtime_enter("PipeWire output", nullptr, 0);
     }
 
-    if (!(b = pw_stream_dequeue_buffer(o->m_stream)))
+    /* if write_audio() holds the lock, it is filling a buffer right now */
+    if (pthread_mutex_trylock(&o->m_queue_mutex) != 0)
     {
-        AUDWARN("PipeWireOutput: out of buffers\n");
+        TRACE_MARK("PipeWire process skipped");
         return;
     }
 
-    buf = b->buffer;
+    TRACE_SPAN("PipeWire process");
 
-    if (!(dst = buf->datas[0].data))
+    telemetry_wakeup(o->m_buffer.len() + o->m_pending_fill, o->m_buffer.size());
+    adaptive_wakeup();
+
+    /* With something of ours still queued for the next cycle, the writer
+     * is not late, and the buffer it is filling is left for it to finish.
+     * Otherwise what it has so far goes now, short as it may be. */
+    struct pw_time time;
+    if (pw_stream_get_time_n(o->m_stream, &time, sizeof time) != 0 || !time.queued)
     {
-        AUDWARN("PipeWireOutput: no data pointer\n");
-        return;
-    }
+        bool sent = o->drain_ring() > 0;
 
-    auto size = aud::min<uint32_t>(buf->datas[0].maxsize, o->m_buffer.len());
-    o->m_pw_buffer_size = size;
-    o->m_buffer.move_out(static_cast<unsigned char *>(dst), size);
+        if (o->m_pending && o->m_pending_fill)
+        {
+            o->queue_pending();
+            sent = true;
+        }
+
+        if (o->m_buffer.len())
+            telemetry_xrun(); /* out of buffers */
+        else if (!sent && o->m_primed && !o->m_draining)
+        {
+            telemetry_underrun();
+            adaptive_underrun();
+        }
+    }
 
-    b->buffer->datas[0].chunk->offset = 0;
-    b->buffer->datas[0].chunk->size = size;
-    b->buffer->datas[0].chunk->stride = o->m_stride;
+    /* only wake the writer when it is actually waiting */
+    if (o->m_waiting)
+        pthread_cond_broadcast(&o->m_queue_cond);
 
-    pw_stream_queue_buffer(o->m_stream, b);
-    pw_thread_loop_signal(o->m_loop, false);
+    pthread_mutex_unlock(&o->m_queue_mutex);
 }
 
 void PipeWireOutput::on_drained(void * data)
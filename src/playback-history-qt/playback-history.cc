@@ -18,6 +18,9 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <utility>
 
 #include <QAbstractListModel>
@@ -34,6 +37,7 @@
 #include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/templates.h>
+#include <libaudcore/vfs.h>
 #include <libaudqt/treeview.h>
 
 /**
@@ -54,12 +58,14 @@ private:
            "This plugin tracks and provides access to playback history.\n\n"
 
            "History entries are stored only in memory and are lost\n"
-           "on Audacious exit. When the plugin is disabled,\n"
+           "on Audacious exit unless saving them is enabled in the\n"
+           "plugin's settings. When the plugin is disabled,\n"
            "playback history is not tracked at all.\n"
-           "History entries are only added, never removed automatically.\n"
+           "Once the configured maximum number of entries is reached,\n"
+           "the oldest entry is removed whenever a new one is added.\n"
            "The user can remove selected entries by pressing the Delete key.\n"
            "Restart Audacious or disable the plugin by closing\n"
-           "Playback History view to clear the entries.\n\n"
+           "Playback History view to clear the entries that are not saved.\n\n"
 
            "Two history item granularities (modes) are supported.\n"
            "The user can select a mode in the plugin's settings.\n"
@@ -79,6 +85,7 @@ public:
 
     constexpr PlaybackHistory() : GeneralPlugin(info, false) {}
 
+    bool init() override;
     void * get_qt_widget() override;
     int take_message(const char * code, const void *, int) override;
 };
@@ -87,6 +94,19 @@ EXPORT PlaybackHistory aud_plugin_instance;
 
 static constexpr const char * configSection = "playback-history";
 static constexpr const char * configEntryType = "entry_type";
+static constexpr const char * configMaxEntries = "max_entries";
+static constexpr const char * configSaveEntries = "save_entries";
+
+static constexpr int defaultMaxEntries = 1000;
+
+/**
+ * Returns the path of the file, to which history entries are appended when
+ * saving them is enabled.
+ */
+static StringBuf historyFilePath()
+{
+    return filename_build({aud_get_path(AudPath::UserDir), "playback-history"});
+}
 
 class HistoryEntry
 {
@@ -133,6 +153,21 @@ public:
      */
     void debugPrint(const char * prefix) const;
 
+    /**
+     * Returns a line, without the line break, that describes @c this in the
+     * history file.
+     */
+    StringBuf toLine() const;
+
+    /**
+     * Assigns the entry described by @p line, as returned from toLine(),
+     * to @c this.
+     *
+     * @return @c true if @p line is valid and the playlist it refers to exists.
+     * @note @c this remains or becomes invalid if @c false is returned.
+     */
+    bool assignFromLine(const char * line);
+
     Type type() const { return m_type; }
     /**
      * Returns a translated human-readable designation of text() based on
@@ -189,6 +224,19 @@ private:
 class HistoryModel : public QAbstractListModel
 {
 public:
+    /**
+     * Loads the saved history entries if saving them is enabled.
+     */
+    HistoryModel();
+
+    /**
+     * Removes the oldest entries that the configured maximum number of
+     * entries no longer leaves room for.
+     *
+     * Call this function when the maximum number of entries is changed.
+     */
+    void maxEntriesChanged();
+
     /**
      * Updates a cached font.
      *
@@ -233,7 +281,53 @@ private:
         NColumns
     };
 
-    // In this class the word "position" refers to an index into m_entries.
+    // In this class the word "position" refers to the index of an entry in
+    // the order of playback: the oldest entry is at position 0 and the most
+    // recently added entry is at position m_count - 1. slotFromPosition()
+    // maps a position to its index into m_entries.
+
+    /** Returns the configured maximum number of entries. */
+    static int maxEntries();
+
+    int slotFromPosition(int position) const;
+    HistoryEntry & entryAt(int position)
+    {
+        return m_entries[slotFromPosition(position)];
+    }
+    const HistoryEntry & entryAt(int position) const
+    {
+        return m_entries[slotFromPosition(position)];
+    }
+
+    /**
+     * Removes the @p count oldest entries, leaving their slots in
+     * @a m_entries to be reused by new entries.
+     */
+    void removeOldest(int count);
+
+    /**
+     * Moves the entries so that the oldest one is in the first slot of
+     * @a m_entries and frees the slots that hold no entry.
+     */
+    void linearize();
+
+    /**
+     * Appends @p entry to the history file if saving entries is enabled.
+     */
+    void saveEntry(const HistoryEntry & entry);
+
+    /**
+     * Replaces the history file with one that contains only the current
+     * entries if saving entries is enabled.
+     */
+    void saveAllEntries();
+
+    /**
+     * Loads the entries from the history file.
+     *
+     * Call this function only when the model is empty.
+     */
+    void loadEntries();
 
     bool isModelRowOutOfBounds(int row) const;
     bool isOutOfBounds(const QModelIndex & index) const;
@@ -257,7 +351,16 @@ private:
     const HookReceiver<HistoryModel> activate_hook{
         "playback ready", this, &HistoryModel::playbackStarted};
 
+    /** A ring buffer that holds m_count entries, the oldest of which is in
+     * slot m_first. Once it is full, the slot of the oldest entry is
+     * reused for each new entry, so that it never grows beyond the
+     * configured maximum number of entries. */
     Index<HistoryEntry> m_entries;
+    int m_first = 0;
+    int m_count = 0;
+    /** The number of entries in the history file, against which the file is
+     * compacted. */
+    int m_savedCount = 0;
     /** The position of the entry that is currently playing
      * or was played last. -1 means "none". */
     int m_playingPosition = -1;
@@ -277,6 +380,8 @@ class HistoryView : public audqt::TreeView
 public:
     HistoryView();
 
+    void maxEntriesChanged() { m_model.maxEntriesChanged(); }
+
 protected:
     void changeEvent(QEvent * event) override;
     void currentChanged(const QModelIndex & current,
@@ -364,6 +469,47 @@ void HistoryEntry::debugPrint(const char * prefix) const
            printable(playlistTitle()), entryNumber());
 }
 
+StringBuf HistoryEntry::toLine() const
+{
+    // The text is percent-encoded to keep tabs and line breaks out of it.
+    return str_printf("%d\t%d\t%d\t%s", static_cast<int>(m_type),
+                      m_playlist.index(), m_playlistPosition,
+                      static_cast<const char *>(str_encode_percent(printable(m_text))));
+}
+
+bool HistoryEntry::assignFromLine(const char * line)
+{
+    int type, playlistIndex, playlistPosition, textOffset = -1;
+    if (sscanf(line, "%d\t%d\t%d\t%n", &type, &playlistIndex,
+               &playlistPosition, &textOffset) < 3 ||
+        textOffset < 0)
+    {
+        AUDWARN("Invalid line in the history file: %s\n", line);
+        return false;
+    }
+
+    if ((type != static_cast<int>(Type::Song) &&
+         type != static_cast<int>(Type::Album)) ||
+        playlistPosition < 0)
+    {
+        AUDWARN("Invalid entry in the history file: %s\n", line);
+        return false;
+    }
+
+    // Playlists are identified by their index, which changes if the user
+    // reorders them. isAvailable() notices the resulting mismatch
+    // between the text and the song at m_playlistPosition in most cases.
+    if (playlistIndex < 0 || playlistIndex >= Playlist::n_playlists())
+        return false;
+
+    m_type = static_cast<Type>(type);
+    m_playlist = Playlist::by_index(playlistIndex);
+    m_playlistPosition = playlistPosition;
+    const char * text = line + textOffset;
+    m_text = *text ? String(str_decode_percent(text)) : String();
+    return true;
+}
+
 const char * HistoryEntry::translatedTextDesignation() const
 {
     switch (m_type)
@@ -453,6 +599,21 @@ bool HistoryEntry::isAvailable() const
     return true;
 }
 
+HistoryModel::HistoryModel()
+{
+    if (aud_get_bool(configSection, configSaveEntries))
+        loadEntries();
+}
+
+void HistoryModel::maxEntriesChanged()
+{
+    const int capacity = maxEntries();
+    if (m_count > capacity)
+        removeOldest(m_count - capacity);
+    if (m_entries.len() > capacity)
+        linearize();
+}
+
 void HistoryModel::setFont(const QFont & font)
 {
     m_currentlyPlaingFont = font;
@@ -467,7 +628,7 @@ void HistoryModel::makeCurrent(const QModelIndex & index) const
     if (isOutOfBounds(index))
         return;
     const int pos = positionFromIndex(index);
-    m_entries[pos].makeCurrent();
+    entryAt(pos).makeCurrent();
 }
 
 void HistoryModel::activate(const QModelIndex & index)
@@ -479,7 +640,7 @@ void HistoryModel::activate(const QModelIndex & index)
     // The "playback ready" hook is activated asynchronously, so
     // playbackStarted() for the playback initiated here will be invoked after
     // this function updates m_playingPosition and returns.
-    if (!m_entries[pos].play())
+    if (!entryAt(pos).play())
         return;
 
     // Update m_playingPosition here to prevent the imminent playbackStarted()
@@ -501,7 +662,7 @@ void HistoryModel::activate(const QModelIndex & index)
 
 int HistoryModel::rowCount(const QModelIndex & parent) const
 {
-    return parent.isValid() ? 0 : m_entries.len();
+    return parent.isValid() ? 0 : m_count;
 }
 
 int HistoryModel::columnCount(const QModelIndex & parent) const
@@ -518,10 +679,10 @@ QVariant HistoryModel::data(const QModelIndex & index, int role) const
     switch (role)
     {
     case Qt::DisplayRole:
-        return QString(m_entries[pos].text());
+        return QString(entryAt(pos).text());
     case Qt::ToolTipRole:
     {
-        const auto & entry = m_entries[pos];
+        const auto & entry = entryAt(pos);
         // The playlist title and entry number are rarely interesting and
         // therefore shown only in the tooltip.
         return QString(
@@ -566,20 +727,199 @@ bool HistoryModel::removeRows(int row, int count, const QModelIndex & parent)
         m_playingPosition -= count;
     }
 
+    // The user rarely removes entries, so the entries can be moved into
+    // order here to remove the range in one go.
+    linearize();
     m_entries.remove(pos, count);
+    m_count -= count;
 
     endRemoveRows();
     m_areRowsBeingRemoved = false;
 
+    // Removals cannot be appended to the history file.
+    saveAllEntries();
+
     return true;
 }
 
+int HistoryModel::maxEntries()
+{
+    return aud::max(aud_get_int(configSection, configMaxEntries), 1);
+}
+
+int HistoryModel::slotFromPosition(int position) const
+{
+    assert(position >= 0);
+    assert(position < m_count);
+    const int slot = m_first + position;
+    return slot < m_entries.len() ? slot : slot - m_entries.len();
+}
+
+void HistoryModel::removeOldest(int count)
+{
+    assert(count > 0);
+    assert(count <= m_count);
+
+    // Automatic removal is not an explicit selection of an item either.
+    m_areRowsBeingRemoved = true;
+    // The oldest entries are displayed at the bottom of the view.
+    beginRemoveRows(QModelIndex(), m_count - count, m_count - 1);
+
+    if (m_playingPosition >= count)
+        m_playingPosition -= count;
+    else
+        m_playingPosition = -1;
+
+    for (int i = 0; i < count; i++)
+    {
+        // Release the entry's strings but keep the slot.
+        m_entries[m_first] = HistoryEntry();
+        if (++m_first == m_entries.len())
+            m_first = 0;
+    }
+    m_count -= count;
+
+    endRemoveRows();
+    m_areRowsBeingRemoved = false;
+}
+
+void HistoryModel::linearize()
+{
+    if (m_first != 0)
+    {
+        std::rotate(m_entries.begin(), m_entries.begin() + m_first,
+                    m_entries.end());
+        m_first = 0;
+    }
+
+    if (m_entries.len() > m_count)
+        m_entries.remove(m_count, m_entries.len() - m_count);
+}
+
+void HistoryModel::saveEntry(const HistoryEntry & entry)
+{
+    if (!aud_get_bool(configSection, configSaveEntries))
+        return;
+
+    // The file holds up to twice as many entries as the model before it is
+    // written anew, so that a new entry is normally just appended.
+    if (m_savedCount >= 2 * maxEntries())
+    {
+        saveAllEntries();
+        return;
+    }
+
+    const StringBuf path = historyFilePath();
+    FILE * file = fopen(path, "a");
+    if (!file)
+    {
+        AUDERR("Cannot write %s: %s\n", static_cast<const char *>(path),
+               strerror(errno));
+        return;
+    }
+
+    const bool failed = fprintf(file, "%s\n",
+                                static_cast<const char *>(entry.toLine())) < 0;
+    if (fclose(file) < 0 || failed)
+    {
+        AUDERR("Cannot write %s: %s\n", static_cast<const char *>(path),
+               strerror(errno));
+        return;
+    }
+
+    m_savedCount++;
+}
+
+void HistoryModel::saveAllEntries()
+{
+    if (!aud_get_bool(configSection, configSaveEntries))
+        return;
+
+    // Write a new file and then replace the old one, so that a crash
+    // never leaves a truncated history.
+    const StringBuf path = historyFilePath();
+    const StringBuf temp = str_concat({path, ".tmp"});
+    FILE * file = fopen(temp, "w");
+    if (!file)
+    {
+        AUDERR("Cannot write %s: %s\n", static_cast<const char *>(temp),
+               strerror(errno));
+        return;
+    }
+
+    bool failed = false;
+    for (int pos = 0; pos < m_count && !failed; pos++)
+    {
+        failed = fprintf(file, "%s\n",
+                         static_cast<const char *>(entryAt(pos).toLine())) < 0;
+    }
+
+    if (fclose(file) < 0 || failed || rename(temp, path) < 0)
+    {
+        AUDERR("Cannot write %s: %s\n", static_cast<const char *>(path),
+               strerror(errno));
+        remove(temp);
+        return;
+    }
+
+    m_savedCount = m_count;
+}
+
+void HistoryModel::loadEntries()
+{
+    assert(m_count == 0);
+
+    const StringBuf path = historyFilePath();
+    auto data = VFSFile::read_file(filename_to_uri(path), VFS_APPEND_NULL);
+    if (!data.len())
+        return;
+
+    const int capacity = maxEntries();
+    int nLines = 0;
+
+    char * line = data.begin();
+    while (*line)
+    {
+        char * next = strchr(line, '\n');
+        if (next)
+            *next++ = 0;
+        else
+            next = line + strlen(line);
+        nLines++;
+
+        HistoryEntry entry;
+        if (entry.assignFromLine(line))
+        {
+            // Keep only the most recent entries, as playbackStarted() would.
+            if (m_count == capacity)
+            {
+                m_entries[m_first] = std::move(entry);
+                if (++m_first == m_entries.len())
+                    m_first = 0;
+            }
+            else
+            {
+                m_entries.append(std::move(entry));
+                m_count++;
+            }
+        }
+
+        line = next;
+    }
+
+    AUDDBG("Loaded %d of %d saved entries\n", m_count, nLines);
+
+    m_savedCount = nLines;
+    if (m_savedCount >= 2 * capacity)
+        saveAllEntries();
+}
+
 bool HistoryModel::isModelRowOutOfBounds(int row) const
 {
-    if (row >= 0 && row < m_entries.len())
+    if (row >= 0 && row < m_count)
         return false;
     AUDWARN("Model row is out of bounds: %d is not in the range [0, %d)\n", row,
-            m_entries.len());
+            m_count);
     return true;
 }
 
@@ -590,10 +930,10 @@ bool HistoryModel::isOutOfBounds(const QModelIndex & index) const
         AUDWARN("Invalid index.\n");
         return true;
     }
-    if (index.row() >= m_entries.len())
+    if (index.row() >= m_count)
     {
         AUDWARN("Index row is out of bounds: %d >= %d\n", index.row(),
-                m_entries.len());
+                m_count);
         return true;
     }
     return false;
@@ -602,13 +942,12 @@ bool HistoryModel::isOutOfBounds(const QModelIndex & index) const
 int HistoryModel::modelRowFromPosition(int position) const
 {
     assert(position >= 0);
-    assert(position < m_entries.len());
-    // Reverse the order of entries here in order to:
-    // 1) display most recently played entries at the top of the view and thus
-    // avoid scrolling to the bottom of the view each time a new entry is added;
-    // 2) efficiently append new elements to m_entries.
+    assert(position < m_count);
+    // Reverse the order of entries here in order to
+    // display most recently played entries at the top of the view and thus
+    // avoid scrolling to the bottom of the view each time a new entry is added.
     // This code must be kept in sync with playbackStarted().
-    return m_entries.len() - 1 - position;
+    return m_count - 1 - position;
 }
 
 int HistoryModel::positionFromModelRow(int row) const
@@ -649,12 +988,12 @@ void HistoryModel::playbackStarted()
 
     entry.debugPrint("Started playing ");
     AUDDBG("playing position=%d, entry count=%d\n", m_playingPosition,
-           m_entries.len());
+           m_count);
 
     const auto shouldAppendEntry = [this, &entry] {
         if (m_playingPosition < 0)
             return true;
-        const auto & prevPlayingEntry = m_entries[m_playingPosition];
+        const auto & prevPlayingEntry = entryAt(m_playingPosition);
 
         if (prevPlayingEntry.type() != entry.type() ||
             prevPlayingEntry.playlist() != entry.playlist())
@@ -692,6 +1031,14 @@ void HistoryModel::playbackStarted()
     if (!shouldAppendEntry)
         return;
 
+    // Make room for the new entry. The previous playing entry may be removed
+    // here if the maximum number of entries is 1.
+    const int capacity = maxEntries();
+    if (m_count >= capacity)
+        removeOldest(m_count - capacity + 1);
+    if (m_entries.len() > capacity)
+        linearize(); // the maximum number of entries has been lowered
+
     const int prevPlayingPosition = m_playingPosition;
 
     // The last played entry appears at the top of the view. Therefore, the new
@@ -700,10 +1047,25 @@ void HistoryModel::playbackStarted()
     beginInsertRows(QModelIndex(), 0, 0);
     // Update m_playingPosition during the row insertion to avoid
     // updating the font for the new playing position separately below.
-    m_playingPosition = m_entries.len();
-    m_entries.append(std::move(entry));
+    m_playingPosition = m_count;
+    if (m_count < m_entries.len())
+    {
+        // Reuse the slot of an entry removed by removeOldest().
+        m_count++;
+        entryAt(m_playingPosition) = std::move(entry);
+    }
+    else
+    {
+        // The ring buffer is full and has to grow, which it can only do at
+        // the end of m_entries.
+        linearize();
+        m_entries.append(std::move(entry));
+        m_count++;
+    }
     endInsertRows();
 
+    saveEntry(entryAt(m_playingPosition));
+
     if (prevPlayingPosition >= 0)
         updateFontForPosition(prevPlayingPosition);
 }
@@ -807,6 +1169,25 @@ void HistoryView::makeCurrent(const QModelIndex & index)
 
 static QPointer<HistoryView> s_history_view;
 
+static void maxEntriesChanged()
+{
+    if (s_history_view)
+        s_history_view->maxEntriesChanged();
+}
+
+static void saveEntriesChanged()
+{
+    // Do not leave behind the history that the user no longer wants saved.
+    if (!aud_get_bool(configSection, configSaveEntries))
+        remove(historyFilePath());
+}
+
+bool PlaybackHistory::init()
+{
+    aud_config_set_defaults(configSection, defaults);
+    return true;
+}
+
 void * PlaybackHistory::get_qt_widget()
 {
     assert(!s_history_view);
@@ -828,6 +1209,10 @@ int PlaybackHistory::take_message(const char * code, const void *, int)
 const char * const PlaybackHistory::defaults[] = {
     configEntryType,
     aud::numeric_string<static_cast<int>(HistoryEntry::defaultType)>::str,
+    configMaxEntries,
+    aud::numeric_string<defaultMaxEntries>::str,
+    configSaveEntries,
+    "FALSE",
     nullptr};
 
 const PreferencesWidget PlaybackHistory::widgets[] = {
@@ -835,6 +1220,13 @@ const PreferencesWidget PlaybackHistory::widgets[] = {
     WidgetRadio(N_("Song"), WidgetInt(configSection, configEntryType),
                 {static_cast<int>(HistoryEntry::Type::Song)}),
     WidgetRadio(N_("Album"), WidgetInt(configSection, configEntryType),
-                {static_cast<int>(HistoryEntry::Type::Album)})};
+                {static_cast<int>(HistoryEntry::Type::Album)}),
+    WidgetLabel(N_("<b>History Size</b>")),
+    WidgetSpin(N_("Maximum number of entries:"),
+               WidgetInt(configSection, configMaxEntries, maxEntriesChanged),
+               {1, 100000, 100}),
+    WidgetCheck(N_("Save entries across restarts"),
+                WidgetBool(configSection, configSaveEntries,
+                           saveEntriesChanged))};
 
 const PluginPreferences PlaybackHistory::prefs = {{widgets}};
@@ -29,6 +29,7 @@
 #include <QPointer>
 #include <QToolButton>
 
+#include <libaudcore/audstrings.h>
 #include <libaudcore/hook.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/playlist.h>
@@ -61,6 +62,7 @@ public:
     {
         ColumnTitle,
         ColumnEntries,
+        ColumnLength,
         NColumns
     };
 
@@ -68,6 +70,7 @@ public:
         : m_rows(Playlist::n_playlists()),
           m_playing(Playlist::playing_playlist().index())
     {
+        m_cache.insert(0, m_rows);
     }
 
     void setFont(const QFont & font)
@@ -81,6 +84,9 @@ public:
 
     void update(Playlist::UpdateLevel level);
 
+    // reorders the playlists themselves
+    void sort(int column, Qt::SortOrder order) override;
+
 protected:
     int rowCount(const QModelIndex & parent) const override
     {
@@ -106,6 +112,19 @@ protected:
                         int role) const override;
 
 private:
+    // what is shown for a playlist, read only once the row is shown
+    struct RowData
+    {
+        Playlist list;
+        String title;
+        int entries = 0;
+        int64_t length = 0;
+        bool valid = false;
+    };
+
+    const RowData & row_data(int row) const;
+    bool refresh_row(int row);
+
     void update_rows(int row, int count);
     void update_playing();
 
@@ -114,6 +133,7 @@ private:
 
     int m_rows, m_playing;
     QFont m_bold;
+    mutable Index<RowData> m_cache;
 };
 
 class PlaylistsView : public audqt::TreeView
@@ -139,6 +159,7 @@ private:
 
     void update(Playlist::UpdateLevel level);
     void update_sel();
+    void sort_by_column(int column);
 
     const HookReceiver<PlaylistsView, Playlist::UpdateLevel> //
         update_hook{"playlist update", this, &PlaylistsView::update};
@@ -146,21 +167,68 @@ private:
         activate_hook{"playlist activate", this, &PlaylistsView::update_sel};
 
     int m_in_update = 0;
+    int m_sort_column = -1;
+    Qt::SortOrder m_sort_order = Qt::AscendingOrder;
 };
 
+static void read_row(int row, Playlist & list, String & title, int & entries,
+                     int64_t & length)
+{
+    list = Playlist::by_index(row);
+    title = list.get_title();
+    entries = list.n_entries();
+    length = list.total_length_ms();
+}
+
+const PlaylistsModel::RowData & PlaylistsModel::row_data(int row) const
+{
+    auto & data = m_cache[row];
+
+    if (!data.valid)
+    {
+        read_row(row, data.list, data.title, data.entries, data.length);
+        data.valid = true;
+    }
+
+    return data;
+}
+
+// returns true if the row has changed since it was last read
+bool PlaylistsModel::refresh_row(int row)
+{
+    auto & data = m_cache[row];
+
+    // rows that have not been shown are read when they are
+    if (!data.valid)
+        return false;
+
+    RowData now;
+    read_row(row, now.list, now.title, now.entries, now.length);
+
+    if (now.list == data.list && now.title == data.title &&
+        now.entries == data.entries && now.length == data.length)
+        return false;
+
+    now.valid = true;
+    data = std::move(now);
+    return true;
+}
+
 QVariant PlaylistsModel::data(const QModelIndex & index, int role) const
 {
     switch (role)
     {
     case Qt::DisplayRole:
     {
-        auto list = Playlist::by_index(index.row());
+        auto & row = row_data(index.row());
         switch (index.column())
         {
         case ColumnTitle:
-            return QString(list.get_title());
+            return QString(row.title);
         case ColumnEntries:
-            return list.n_entries();
+            return row.entries;
+        case ColumnLength:
+            return QString(str_format_time(row.length));
         }
     }
     break;
@@ -171,7 +239,7 @@ QVariant PlaylistsModel::data(const QModelIndex & index, int role) const
         break;
 
     case Qt::TextAlignmentRole:
-        if (index.column() == ColumnEntries)
+        if (index.column() == ColumnEntries || index.column() == ColumnLength)
             return Qt::AlignRight;
         break;
     }
@@ -190,6 +258,8 @@ QVariant PlaylistsModel::headerData(int section, Qt::Orientation orientation,
             return QString(_("Title"));
         case ColumnEntries:
             return QString(_("Entries"));
+        case ColumnLength:
+            return QString(_("Length"));
         }
     }
 
@@ -230,24 +300,112 @@ void PlaylistsModel::update(const Playlist::UpdateLevel level)
         if (rows < m_rows)
         {
             beginRemoveRows(QModelIndex(), rows, m_rows - 1);
+            m_cache.remove(rows, m_rows - rows);
             m_rows = rows;
             endRemoveRows();
         }
         else if (rows > m_rows)
         {
             beginInsertRows(QModelIndex(), m_rows, rows - 1);
+            m_cache.insert(m_rows, rows - m_rows);
             m_rows = rows;
             endInsertRows();
         }
     }
 
+    // The hook does not tell which playlists have changed, so compare what
+    // is shown with what the playlists are now and redraw only the rows
+    // that differ.  Playlists inserted or moved elsewhere show up as a
+    // different playlist at the same row.
     if (level >= Playlist::Metadata)
     {
-        update_rows(0, m_rows);
-        m_playing = Playlist::playing_playlist().index();
+        int first = -1;
+
+        for (int row = 0; row < m_rows; row++)
+        {
+            bool changed = refresh_row(row);
+
+            if (changed && first < 0)
+                first = row;
+            else if (!changed && first >= 0)
+            {
+                update_rows(first, row - first);
+                first = -1;
+            }
+        }
+
+        if (first >= 0)
+            update_rows(first, m_rows - first);
+    }
+
+    update_playing();
+}
+
+struct SortItem
+{
+    Playlist list;
+    String title;
+    int entries;
+    int64_t length;
+};
+
+static int compare_titles(const SortItem & a, const SortItem & b)
+{
+    return str_compare(a.title, b.title);
+}
+
+static int compare_entries(const SortItem & a, const SortItem & b)
+{
+    if (a.entries != b.entries)
+        return (a.entries > b.entries) ? 1 : -1;
+
+    return compare_titles(a, b);
+}
+
+static int compare_lengths(const SortItem & a, const SortItem & b)
+{
+    if (a.length != b.length)
+        return (a.length > b.length) ? 1 : -1;
+
+    return compare_titles(a, b);
+}
+
+void PlaylistsModel::sort(int column, Qt::SortOrder order)
+{
+    Index<SortItem> items;
+
+    for (int row = 0; row < m_rows; row++)
+    {
+        auto & item = items.append();
+        read_row(row, item.list, item.title, item.entries, item.length);
+    }
+
+    switch (column)
+    {
+    case ColumnTitle:
+        items.sort(compare_titles);
+        break;
+    case ColumnEntries:
+        items.sort(compare_entries);
+        break;
+    case ColumnLength:
+        items.sort(compare_lengths);
+        break;
+    default:
+        return;
+    }
+
+    // Move each playlist into place in turn; the rows are updated by the
+    // "playlist update" hook that follows.
+    for (int i = 0; i < items.len(); i++)
+    {
+        int pos = (order == Qt::AscendingOrder) ? i : items.len() - 1 - i;
+        auto & item = items[pos];
+        int from = item.list.index();
+
+        if (from != i)
+            Playlist::reorder_playlists(from, i, 1);
     }
-    else
-        update_playing();
 }
 
 PlaylistsView::PlaylistsView()
@@ -266,6 +424,16 @@ PlaylistsView::PlaylistsView()
     hdr->setSectionResizeMode(PlaylistsModel::ColumnEntries,
                               QHeaderView::Interactive);
     hdr->resizeSection(PlaylistsModel::ColumnEntries, audqt::to_native_dpi(64));
+    hdr->setSectionResizeMode(PlaylistsModel::ColumnLength,
+                              QHeaderView::Interactive);
+    hdr->resizeSection(PlaylistsModel::ColumnLength, audqt::to_native_dpi(64));
+
+    // Sorting is not enabled in the view, which would sort the playlists as
+    // soon as it is shown.  A click on a column header sorts them instead,
+    // and a second click reverses the order.
+    hdr->setSectionsClickable(true);
+    connect(hdr, &QHeaderView::sectionClicked, this,
+            &PlaylistsView::sort_by_column);
 
     setAllColumnsShowFocus(true);
     setDragDropMode(InternalMove);
@@ -332,6 +500,17 @@ void PlaylistsView::update_sel()
     m_in_update--;
 }
 
+void PlaylistsView::sort_by_column(int column)
+{
+    if (column == m_sort_column && m_sort_order == Qt::AscendingOrder)
+        m_sort_order = Qt::DescendingOrder;
+    else
+        m_sort_order = Qt::AscendingOrder;
+
+    m_sort_column = column;
+    m_model.sort(column, m_sort_order);
+}
+
 static QPointer<PlaylistsView> s_playlists_view;
 
 static QToolButton * new_tool_button(const char * text, const char * icon)
@@ -3,6 +3,7 @@
  * Copyright (c) 2006 William Pitcock, Tony Vroon, George Averill,
  *                    Giacomo Lozito, Derek Pomery and Yoshiki Yazawa.
  * Copyright (c) 2011-2013 John Lindgren
+ * Copyright 2024 Audacious Plugins Authors
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -19,6 +20,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <stdlib.h>
+
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/audstrings.h>
@@ -41,6 +44,9 @@ public:
 
 EXPORT PLSLoader aud_plugin_instance;
 
+/* The title and length of an entry are kept only for streams, which would
+ * otherwise be connected to one by one just to find out what they are
+ * called; a local file is still read for its own tags. */
 class PLSParser : public IniParser
 {
 public:
@@ -49,22 +55,84 @@ public:
         items (items),
         valid_heading (false) {}
 
+    void parse (VFSFile & file)
+    {
+        IniParser::parse (file);
+
+        for (int i = 0; i < items.len (); i ++)
+        {
+            auto & info = infos[i];
+            if ((info.title || info.length > 0) && strncmp (items[i].filename, "file://", 7))
+            {
+                Tuple & tuple = items[i].tuple;
+                tuple.set_filename (items[i].filename);
+
+                if (info.title)
+                    tuple.set_str (Tuple::Title, info.title);
+                if (info.length > 0)
+                    tuple.set_int (Tuple::Length, info.length * 1000);
+
+                tuple.set_state (Tuple::Valid);
+            }
+        }
+    }
+
 private:
+    struct EntryInfo
+    {
+        int number = 0;
+        String title;
+        int length = -1;
+    };
+
     const char * filename;
     Index<PlaylistAddItem> & items;
+    Index<EntryInfo> infos;  /* one for each item */
     bool valid_heading;
 
+    /* entries almost always come in order, so the search is short */
+    EntryInfo * lookup (int number)
+    {
+        for (int i = infos.len (); i --; )
+        {
+            if (infos[i].number == number)
+                return & infos[i];
+        }
+
+        return nullptr;
+    }
+
     void handle_heading (const char * heading) override
         { valid_heading = ! strcmp_nocase (heading, "playlist"); }
 
     void handle_entry (const char * key, const char * value) override
     {
-        if (! valid_heading || strcmp_nocase (key, "file", 4))
+        if (! valid_heading)
             return;
 
-        StringBuf uri = uri_construct (value, filename);
-        if (uri)
-            items.append (String (uri));
+        if (! strcmp_nocase (key, "file", 4))
+        {
+            StringBuf uri = uri_construct (value, filename);
+            if (uri)
+            {
+                items.append (String (uri));
+
+                EntryInfo & info = infos.append ();
+                info.number = atoi (key + 4);
+            }
+        }
+        else if (! strcmp_nocase (key, "title", 5))
+        {
+            EntryInfo * info = lookup (atoi (key + 5));
+            if (info && value[0])
+                info->title = String (value);
+        }
+        else if (! strcmp_nocase (key, "length", 6))
+        {
+            EntryInfo * info = lookup (atoi (key + 6));
+            if (info)
+                info->length = atoi (value);
+        }
     }
 };
 
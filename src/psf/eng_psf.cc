@@ -51,6 +51,8 @@ int			psf_refresh  = -1;
 
 static uint32_t initialPC, initialGP, initialSP;
 
+static StateHistory history;
+
 int32_t psf_start(uint8_t *buffer, uint32_t length)
 {
 	uint8_t *file, *lib_decoded, *alib_decoded;
@@ -327,6 +329,12 @@ int32_t psf_start(uint8_t *buffer, uint32_t length)
 
 	mips_execute(5000);
 
+	Index<StateRegion> regions;
+	mips_state_regions(regions);
+	psx_hw_state_regions(regions);
+	SPUstateRegions(regions);
+	history.start(std::move(regions));
+
 	return AO_SUCCESS;
 }
 
@@ -335,6 +343,11 @@ int32_t psf_execute(void (*update)(const void *, int))
 	int i;
 
 	while (!stop_flag) {
+		if (history.pending())
+			SPUseek(history.restore());
+		else
+			history.frame(SPUsamples());
+
 		for (i = 0; i < 44100 / 60; i++) {
 			psx_hw_slice();
 			SPUasync(384, update);
@@ -346,8 +359,19 @@ int32_t psf_execute(void (*update)(const void *, int))
 	return AO_SUCCESS;
 }
 
+// forward, the SPU leaves out the samples up to the time; back, the last
+// snapshot before it is restored at the end of the frame
+int32_t psf_seek(uint32_t t)
+{
+	if (SPUseek(t))
+		return 1;
+
+	return history.seek(t);
+}
+
 int32_t psf_stop(void)
 {
+	history.clear();
 	SPUclose();
 	free(c);
 
@@ -81,6 +81,8 @@ static Index<char> lib_raw_file;
 static uint32_t fssize[MAX_FS];
 static int num_fs;
 
+static StateHistory history;
+
 static void do_iopmod(uint8_t *start, uint32_t offset)
 {
 	#if DEBUG_LOADER
@@ -558,6 +560,13 @@ int32_t psf2_start(uint8_t *buffer, uint32_t length)
 	SPU2init();
 	SPU2open(nullptr);
 
+	Index<StateRegion> regions;
+	state_add(regions, loadAddr);
+	mips_state_regions(regions);
+	psx_hw_state_regions(regions);
+	SPU2stateRegions(regions);
+	history.start(std::move(regions));
+
 	return AO_SUCCESS;
 }
 
@@ -567,6 +576,15 @@ int32_t psf2_execute(void (*update)(const void *, int))
 
 	while (!stop_flag)
 	{
+		// the data of open files is not in the snapshots
+		if (history.pending())
+		{
+			psx_hw_close_files();
+			SPU2seek(history.restore());
+		}
+		else if (!psx_hw_files_open())
+			history.frame(SPU2samples());
+
 		for (i = 0; i < 44100 / 60; i++)
 		{
 			SPU2async(update);
@@ -579,8 +597,18 @@ int32_t psf2_execute(void (*update)(const void *, int))
 	return AO_SUCCESS;
 }
 
+int32_t psf2_seek(uint32_t t)
+{
+	if (SPU2seek(t))
+		return 1;
+
+	return history.seek(t);
+}
+
 int32_t psf2_stop(void)
 {
+	history.clear();
+	psx_hw_close_files();
 	SPU2close();
 	lib_raw_file.clear();
 	free(c);
@@ -49,6 +49,8 @@ static uint32_t cur_tick, cur_event, num_events, next_tick, end_tick;
 static int old_fmt;
 static char name[128], song[128], company[128];
 
+static StateHistory history;
+
 int32_t spx_start(uint8_t *buffer, uint32_t length)
 {
 	int i;
@@ -111,6 +113,14 @@ int32_t spx_start(uint8_t *buffer, uint32_t length)
 	strncpy((char *)&buffer[0x44], song, 128);
 	strncpy((char *)&buffer[0x84], company, 128);
 
+	Index<StateRegion> regions;
+	state_add(regions, song_ptr);
+	state_add(regions, cur_tick);
+	state_add(regions, cur_event);
+	state_add(regions, next_tick);
+	SPUstateRegions(regions);
+	history.start(std::move(regions));
+
 	return AO_SUCCESS;
 }
 
@@ -208,26 +218,42 @@ int32_t spx_execute(void (*update)(const void *, int))
 
 	while (!stop_flag)
 	{
+		if (history.pending())
+		{
+			SPUseek(history.restore());
+			run = 1;
+		}
+		else
+			history.frame(SPUsamples());
+
 		if (old_fmt && (cur_event >= num_events))
 			run = 0;
-		else if (cur_tick >= end_tick)
+		else if (!old_fmt && cur_tick >= end_tick)
 			run = 0;
 
-		if (run)
+		// after the last event, the SPU goes on with the notes left playing
+		for (i = 0; i < 44100 / 60; i++)
 		{
-			for (i = 0; i < 44100 / 60; i++)
-			{
-			  	spx_tick();
-				SPUasync(384, update);
-			}
+			if (run)
+				spx_tick();
+			SPUasync(384, update);
 		}
 	}
 
 	return AO_SUCCESS;
 }
 
+int32_t spx_seek(uint32_t t)
+{
+	if (SPUseek(t))
+		return 1;
+
+	return history.seek(t);
+}
+
 int32_t spx_stop(void)
 {
+	history.clear();
 	SPUclose();
 
 	return AO_SUCCESS;
@@ -0,0 +1,121 @@
+/*
+ * length.cc
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <stdlib.h>
+
+#include "length.h"
+
+static constexpr int rate = 44100;
+static constexpr int window = 4096;
+static constexpr int quiet = 64;                    /* of 32767 */
+static constexpr uint64_t silenceEnd = 10 * rate;   /* of silence, emulated */
+static constexpr uint64_t minLoop = 10 * rate;
+static constexpr uint64_t maxPlayed = 10 * 60 * rate;
+
+static constexpr uint64_t hashBase = 0x100000001b3;
+
+static uint64_t power(uint64_t base, int exp)
+{
+    uint64_t result = 1;
+    while (exp--)
+        result *= base;
+    return result;
+}
+
+static const uint64_t hashOut = power(hashBase, window);
+
+static bool loud(unsigned x)
+{
+    return abs((int16_t)(x >> 16)) > quiet || abs((int16_t)x) > quiet;
+}
+
+LengthDetector::LengthDetector() :
+    m_ring(window) {}
+
+bool LengthDetector::add(const int16_t *data, int frames, uint32_t position)
+{
+    uint64_t first = (uint64_t)position - frames;
+
+    for (int i = 0; i < frames && !m_done; i++)
+    {
+        unsigned x = (uint16_t)data[2 * i] << 16 | (uint16_t)data[2 * i + 1];
+        unsigned &slot = m_ring[m_played % window];
+        unsigned out = slot;
+
+        m_hash = m_hash * hashBase + x - out * hashOut;
+        m_loud += (int)loud(x) - (int)loud(out);
+        slot = x;
+        m_played++;
+
+        if (loud(x))
+        {
+            m_heard = true;
+            m_sound = m_played;
+            m_sound_position = first + i + 1;
+        }
+
+        /* only stretches with sound in most of them, at a 1024th of the
+         * samples */
+        if (m_played < window || m_loud < window / 2 ||
+            (m_hash * 0x9e3779b97f4a7c15) >> 54)
+            continue;
+
+        auto it = m_seen.find(m_hash);
+        if (it == m_seen.end())
+        {
+            m_seen.emplace(m_hash, m_played);
+            m_loop_len = 0;
+            continue;
+        }
+
+        uint64_t len = m_played - it->second;
+        it->second = m_played;
+
+        /* a sound repeated now and then */
+        if (len < minLoop)
+            continue;
+
+        if (len != m_loop_len)
+        {
+            m_loop_len = len;
+            m_loop_start = m_loop_end = m_played;
+            continue;
+        }
+
+        m_loop_end = m_played;
+
+        /* the whole loop has come again */
+        if (m_loop_end - m_loop_start >= len)
+            found(m_loop_start - len - window + 2 * len);
+    }
+
+    if (!m_done && m_heard && position - m_sound_position >= silenceEnd)
+        found(m_sound);
+
+    if (m_played >= maxPlayed || position >= maxPlayed + silenceEnd)
+        m_done = true;
+
+    return m_done;
+}
+
+void LengthDetector::found(uint64_t frames)
+{
+    m_length = frames * 1000 / rate;
+    m_done = true;
+}
@@ -0,0 +1,73 @@
+/*
+ * length.h
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef PSF_LENGTH_H
+#define PSF_LENGTH_H
+
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+/* Finds where a song without a length tag ends, from its output: either
+ * where it falls silent for good, or, for one that loops, after the loop
+ * has played twice.  The loop is found by hashing each stretch of 4096
+ * samples and looking for those seen before; stretches are only compared
+ * at the samples where the hash has some bits clear, so that loops of any
+ * length are found the same. */
+class LengthDetector
+{
+public:
+    /* the fade that goes after the length found, over the silence or the
+     * third time through the loop */
+    static constexpr int fade = 10000;
+
+    LengthDetector();
+
+    /* frames of stereo output, as played; position is the time in samples
+     * emulated so far, which is ahead of what was played when silent
+     * buffers were left out.  Returns true once the end is found or the
+     * song has gone on for too long. */
+    bool add(const int16_t *data, int frames, uint32_t position);
+
+    /* in milliseconds, not counting the fade; -1 if not found */
+    int length() const { return m_length; }
+
+private:
+    void found(uint64_t frames);
+
+    uint64_t m_played = 0;
+    uint64_t m_sound = 0;           /* played up to the last sound */
+    uint64_t m_sound_position = 0;  /* emulated the same */
+    bool m_heard = false;
+
+    std::vector<unsigned> m_ring;    /* the last stretch, left and right in each */
+    uint64_t m_hash = 0;
+    int m_loud = 0;                 /* samples in the window that are not quiet */
+
+    std::unordered_map<uint64_t, uint64_t> m_seen;  /* the last time of each */
+    uint64_t m_loop_len = 0;
+    uint64_t m_loop_start = 0;      /* the first repeat */
+    uint64_t m_loop_end = 0;        /* the last one */
+
+    int m_length = -1;
+    bool m_done = false;
+};
+
+#endif // PSF_LENGTH_H
@@ -86,11 +86,13 @@ static inline void s_buffer1(int iOff,int iVal)                // set_buffer (+1
  *(p+iOff)=(s16)BFLIP16((s16)iVal);
 }
 
+// 22 khz down/upsampling filters, out here so that snapshots can see them
+static s32 downbuf[2][8];
+static s32 upbuf[2][8];
+static int dbpos=0,ubpos=0;
+
 static inline void MixREVERBLeftRight(s32 *oleft, s32 *oright, s32 inleft, s32 inright)
 {
-   static s32 downbuf[2][8];
-   static s32 upbuf[2][8];
-   static int dbpos=0,ubpos=0;
    static s32 downcoeffs[8]={ /* Symmetry is sexy. */
 				1283,5344,10895,15243,
 				15243,10895,5344,1283
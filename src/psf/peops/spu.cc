@@ -106,6 +106,8 @@ static u8 * pSpuBuffer;
 
 // user settings
 static int             iVolume;
+static int             iUseReverb=1;
+static int             iUseInterpolation=1;
 
 // MAIN infos struct for each channel
 
@@ -187,7 +189,7 @@ static u32 decaybegin;
 static u32 decayend;
 
 static u32 seektime;
-int psf_seek(u32 t)
+int SPUseek(u32 t)
 {
  seektime=t*441/10;
  if(seektime>=sampcount) return(1);
@@ -200,6 +202,13 @@ void setendless(int e)
  endless=e;
 }
 
+// no reverb or interpolation, for a quick run through a song
+void SPUsetFast(int fast)
+{
+ iUseReverb=!fast;
+ iUseInterpolation=!fast;
+}
+
 // Counting to 65536 results in full volume offage.
 void setlength(s32 stop, s32 fade)
 {
@@ -396,13 +405,17 @@ int SPUasync(u32 cycles, void (*update)(const void *, int))
          else                                         // NO NOISE (NORMAL SAMPLE DATA) HERE
           {
              int vl, vr, gpos;
-             vl = (s_chan[ch].spos >> 6) & ~3;
              gpos = s_chan[ch].SB[28];
-             vr=(gauss[vl]*gval0)>>9;
-             vr+=(gauss[vl+1]*gval(1))>>9;
-             vr+=(gauss[vl+2]*gval(2))>>9;
-             vr+=(gauss[vl+3]*gval(3))>>9;
-             fa = vr>>2;
+             if(iUseInterpolation)
+              {
+               vl = (s_chan[ch].spos >> 6) & ~3;
+               vr=(gauss[vl]*gval0)>>9;
+               vr+=(gauss[vl+1]*gval(1))>>9;
+               vr+=(gauss[vl+2]*gval(2))>>9;
+               vr+=(gauss[vl+3]*gval(3))>>9;
+               fa = vr>>2;
+              }
+             else fa = gval(3);                        // the last sample decoded
           }
 
          s_chan[ch].sval = (MixADSR(ch) * fa)>>10;     // / 1023;  // add adsr
@@ -445,7 +458,7 @@ int SPUasync(u32 cycles, void (*update)(const void *, int))
 	   sl+=tmpl;
 	   sr+=tmpr;
 
-	   if(((rvb.Enabled>>ch)&1) && (spuCtrl&0x80))
+	   if(iUseReverb && ((rvb.Enabled>>ch)&1) && (spuCtrl&0x80))
 	   {
 	    revLeft+=tmpl;
 	    revRight+=tmpr;
@@ -459,7 +472,7 @@ int SPUasync(u32 cycles, void (*update)(const void *, int))
 
   ///////////////////////////////////////////////////////
   // mix all channels (including reverb) into one buffer
-  MixREVERBLeftRight(&sl,&sr,revLeft,revRight);
+  if(iUseReverb) MixREVERBLeftRight(&sl,&sr,revLeft,revRight);
 //  printf("sampcount %d decaybegin %d decayend %d\n", sampcount, decaybegin, decayend);
   if(sampcount>=decaybegin)
   {
@@ -666,6 +679,37 @@ int SPUshutdown(void)
  return 0;
 }
 
+////////////////////////////////////////////////////////////////////////
+// STATE: the memory the SPU changes while playing, for snapshots
+////////////////////////////////////////////////////////////////////////
+
+void SPUstateRegions(Index<StateRegion> &regions)
+{
+ state_add(regions, regArea);
+ state_add(regions, spuMem);
+ state_add(regions, pSpuIrq);
+ state_add(regions, s_chan);
+ state_add(regions, rvb);
+ state_add(regions, downbuf);
+ state_add(regions, upbuf);
+ state_add(regions, dbpos);
+ state_add(regions, ubpos);
+ state_add(regions, dwNoiseVal);
+ state_add(regions, spuCtrl);
+ state_add(regions, spuStat);
+ state_add(regions, spuIrq);
+ state_add(regions, spuAddr);
+ state_add(regions, pS);
+ state_add(regions, ttemp);
+ state_add(regions, sampcount);
+ regions.append(StateRegion{pSpuBuffer, 32768});
+}
+
+u32 SPUsamples(void)
+{
+ return sampcount;
+}
+
 void SPUinjectRAMImage(u16 *pIncoming)
 {
 	int i;
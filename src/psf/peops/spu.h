@@ -24,10 +24,13 @@
 //
 //*************************************************************************//
 
+#include "../state.h"
+
 void SPUirq(void);
 
-int psf_seek(uint32_t t);
+int SPUseek(uint32_t t);
 void setendless(int e);
+void SPUsetFast(int fast);
 void setlength(int32_t stop, int32_t fade);
 
 int SPUasync(uint32_t cycles, void (*update)(const void *, int));
@@ -37,6 +40,8 @@ int SPUopen(void);
 int SPUclose(void);
 int SPUshutdown(void);
 void SPUinjectRAMImage(uint16_t *pIncoming);
+void SPUstateRegions(Index<StateRegion> &regions);
+uint32_t SPUsamples(void);
 void SPUreadDMAMem(uint32_t usPSXMem, int iSize);
 void SPUwriteDMAMem(uint32_t usPSXMem, int iSize);
 uint16_t SPUreadRegister(uint32_t reg);
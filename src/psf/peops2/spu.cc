@@ -330,7 +330,7 @@ static u32 decaybegin;
 static u32 decayend;
 
 static u32 seektime;
-int psf2_seek(u32 t)
+int SPU2seek(u32 t)
 {
  seektime=t*441/10;
  if(seektime>=sampcount) return(1);
@@ -343,6 +343,13 @@ void setendless2(int e)
  endless=e;
 }
 
+// no reverb or interpolation, for a quick run through a song
+void SPU2setFast(int fast)
+{
+ iUseReverb=fast ? 0 : 1;
+ iUseInterpolation=fast ? 0 : 2;
+}
+
 // Counting to 65536 results in full volume offage.
 void setlength2(s32 stop, s32 fade)
 {
@@ -791,8 +798,12 @@ ENDX:   ;
        break;
      }
 
+    // a buffer left out still goes to update(), empty, so that it can
+    // tell the time and stop or seek during long silences
     if(iSilenceCount < 20)
      update((u8*)pSpuBuffer,(u8*)pS-(u8*)pSpuBuffer);
+    else
+     update((u8*)pSpuBuffer,0);
 
     pS=(short *)pSpuBuffer;
    }
@@ -1000,6 +1011,45 @@ EXPORT_GCC void CALLBACK SPU2close(void)
  RemoveStreams();                                      // no more streaming
 }
 
+////////////////////////////////////////////////////////////////////////
+// STATE: the memory the SPU changes while playing, for snapshots
+////////////////////////////////////////////////////////////////////////
+
+void SPU2stateRegions(Index<StateRegion> &regions)
+{
+ state_add(regions, regArea);
+ state_add(regions, spuMem);
+ state_add(regions, pSpuIrq);
+ state_add(regions, s_chan);
+ state_add(regions, rvb);
+ state_add(regions, dwNoiseVal);
+ state_add(regions, spuCtrl2);
+ state_add(regions, spuStat2);
+ state_add(regions, spuIrq2);
+ state_add(regions, spuAddr2);
+ state_add(regions, spuRvbAddr2);
+ state_add(regions, spuRvbAEnd2);
+ state_add(regions, dwNewChannel2);
+ state_add(regions, dwEndChannel2);
+ state_add(regions, SSumR);
+ state_add(regions, SSumL);
+ state_add(regions, iCycle);
+ state_add(regions, pS);
+ state_add(regions, lastch);
+ state_add(regions, iSecureStart);
+ state_add(regions, iSpuAsyncWait);
+ state_add(regions, sRVBPlay);
+ state_add(regions, sampcount);
+ regions.append(StateRegion{pSpuBuffer, 32768});
+ regions.append(StateRegion{sRVBStart[0], NSSIZE*2*4});
+ regions.append(StateRegion{sRVBStart[1], NSSIZE*2*4});
+}
+
+u32 SPU2samples(void)
+{
+ return sampcount;
+}
+
 #if 0
 ////////////////////////////////////////////////////////////////////////
 // SPUSHUTDOWN: called by main emu on final exit
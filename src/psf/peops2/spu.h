@@ -1,38 +1,43 @@
-/***************************************************************************
-                            spu.h  -  description
-                             -------------------
-    begin                : Wed May 15 2002
-    copyright            : (C) 2002 by Pete Bernert
-    email                : BlackDove@addcom.de
- ***************************************************************************/
-
-/***************************************************************************
- *                                                                         *
- *   This program is free software; you can redistribute it and/or modify  *
- *   it under the terms of the GNU General Public License as published by  *
- *   the Free Software Foundation; either version 2 of the License, or     *
- *   (at your option) any later version. See also the license.txt file for *
- *   additional informations.                                              *
- *                                                                         *
- ***************************************************************************/
-
-//*************************************************************************//
-// History of changes:
-//
-// 2004/04/04 - Pete
-// - changed plugin to emulate PS2 spu
-//
-// 2002/05/15 - Pete
-// - generic cleanup for the Peops release
-//
-//*************************************************************************//
-
-void setendless2(int e);
-void setlength2(int32_t stop, int32_t fade);
-
-long SPU2init(void);
-long SPU2open(void *pDsp);
-void SPU2async(void (*update)(const void *, int));
-void SPU2close(void);
-
-int psf2_seek(uint32_t t);
+/***************************************************************************
+                            spu.h  -  description
+                             -------------------
+    begin                : Wed May 15 2002
+    copyright            : (C) 2002 by Pete Bernert
+    email                : BlackDove@addcom.de
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version. See also the license.txt file for *
+ *   additional informations.                                              *
+ *                                                                         *
+ ***************************************************************************/
+
+//*************************************************************************//
+// History of changes:
+//
+// 2004/04/04 - Pete
+// - changed plugin to emulate PS2 spu
+//
+// 2002/05/15 - Pete
+// - generic cleanup for the Peops release
+//
+//*************************************************************************//
+
+#include "../state.h"
+
+void setendless2(int e);
+void SPU2setFast(int fast);
+void setlength2(int32_t stop, int32_t fade);
+
+long SPU2init(void);
+long SPU2open(void *pDsp);
+void SPU2async(void (*update)(const void *, int));
+void SPU2close(void);
+
+int SPU2seek(uint32_t t);
+void SPU2stateRegions(Index<StateRegion> &regions);
+uint32_t SPU2samples(void);
@@ -27,6 +27,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <mutex>
+
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
@@ -35,6 +37,7 @@
 
 #include "ao.h"
 #include "corlett.h"
+#include "length.h"
 #include "psx.h"
 
 #include "peops/spu.h"
@@ -83,18 +86,20 @@ typedef struct {
     int32_t (*stop)(void);
     int32_t (*seek)(uint32_t);
     int32_t (*execute)(void (*update)(const void *, int));
+    uint32_t (*samples)(void);
 } PSFEngineFunctors;
 
 static PSFEngineFunctors psf_functor_map[ENG_COUNT] = {
-    {nullptr, nullptr, nullptr, nullptr},
-    {psf_start, psf_stop, psf_seek, psf_execute},
-    {psf2_start, psf2_stop, psf2_seek, psf2_execute},
-    {spx_start, spx_stop, psf_seek, spx_execute},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+    {psf_start, psf_stop, psf_seek, psf_execute, SPUsamples},
+    {psf2_start, psf2_stop, psf2_seek, psf2_execute, SPU2samples},
+    {spx_start, spx_stop, spx_seek, spx_execute, SPUsamples},
 };
 
 const char* const PSFPlugin::defaults[] =
 {
     "ignore_length", "FALSE",
+    "detect_length", "TRUE",
     nullptr
 };
 
@@ -104,13 +109,19 @@ bool PSFPlugin::init()
     return true;
 }
 
+/* The engines keep their state in globals, so only one song at a time can
+ * be played or have its length found. */
+static std::mutex engine_mutex;
+static std::mutex detect_mutex;
+
 static PSFEngineFunctors *f;
 static String dirpath;
 
 bool stop_flag = false;
 
-/* The emulation engine can only seek forward, not back.  This variable is set
- * a non-negative time (milliseconds) when the song is to be restarted in order
+/* The emulation engines seek back by going on from a snapshot of their state
+ * taken earlier in the song.  Should there be none, this variable is set a
+ * non-negative time (milliseconds) when the song is to be restarted in order
  * to seek backward. */
 static int reverse_seek;
 
@@ -134,6 +145,12 @@ static PSFEngine psf_probe(const char *buf, int len)
     return ENG_NONE;
 }
 
+static void set_dirpath(const char *filename)
+{
+    const char * slash = strrchr (filename, '/');
+    dirpath = slash ? String (str_copy (filename, slash + 1 - filename)) : String ();
+}
+
 /* ao_get_lib: called to load secondary files */
 Index<char> ao_get_lib(char *filename)
 {
@@ -141,17 +158,92 @@ Index<char> ao_get_lib(char *filename)
     return file ? file.read_all() : Index<char>();
 }
 
+static LengthDetector *detector;
+
+static void detect_update(const void *data, int bytes)
+{
+    if (!data || detector->add((const int16_t *)data, bytes / 4, f->samples()))
+        stop_flag = true;
+}
+
+/* Runs through a song without a length tag as fast as the emulation goes,
+ * without reverb or interpolation, to find where it ends.  Returns the
+ * length with the fade, or -1.  While a song plays, nothing is found. */
+static int detect_length(const char *filename, PSFEngine eng, Index<char> &buf)
+{
+    std::lock_guard<std::mutex> detect_lock(detect_mutex);
+    std::unique_lock<std::mutex> lock(engine_mutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return -1;
+
+    LengthDetector found;
+
+    set_dirpath(filename);
+    f = &psf_functor_map[eng];
+    detector = &found;
+
+    if (eng == ENG_PSF2)
+    {
+        setendless2(true);
+        SPU2setFast(true);
+    }
+    else
+    {
+        setendless(true);
+        SPUsetFast(true);
+    }
+
+    if (f->start((uint8_t *)buf.begin(), buf.len()) == AO_SUCCESS)
+    {
+        stop_flag = false;
+        f->execute(detect_update);
+        f->stop();
+    }
+
+    SPUsetFast(false);
+    SPU2setFast(false);
+
+    detector = nullptr;
+    f = nullptr;
+    dirpath = String ();
+
+    return (found.length() >= 0) ? found.length() + LengthDetector::fade : -1;
+}
+
 bool PSFPlugin::read_tag(const char *filename, VFSFile &file, Tuple &tuple, Index<char> *image)
 {
     Index<char> buf = file.read_all ();
     if (!buf.len())
         return false;
 
+    bool detect = aud_get_bool("psf", "detect_length");
+
+    /* SPX files have no tags */
+    if (psf_probe(buf.begin(), buf.len()) == ENG_SPX)
+    {
+        int length = detect ? detect_length(filename, ENG_SPX, buf) : -1;
+        if (length > 0)
+            tuple.set_int(Tuple::Length, length);
+
+        tuple.set_str(Tuple::Quality, _("sequenced"));
+        tuple.set_str(Tuple::Codec, "PlayStation Sound Unit Log");
+        tuple.set_int(Tuple::Channels, 2);
+        return true;
+    }
+
     corlett_t *c;
     if (corlett_decode((uint8_t *)buf.begin(), buf.len(), nullptr, nullptr, &c) != AO_SUCCESS)
         return false;
 
-    tuple.set_int(Tuple::Length, psfTimeToMS(c->inf_length) + psfTimeToMS(c->inf_fade));
+    int length = psfTimeToMS(c->inf_length);
+    if (length > 0)
+        length += psfTimeToMS(c->inf_fade);
+    else if (detect)
+        length = detect_length(filename, psf_probe(buf.begin(), buf.len()), buf);
+
+    if (length > 0)
+        tuple.set_int(Tuple::Length, length);
+
     tuple.set_str(Tuple::Artist, c->inf_artist);
     tuple.set_str(Tuple::Album, c->inf_game);
     tuple.set_str(Tuple::Title, c->inf_title);
@@ -165,15 +257,37 @@ bool PSFPlugin::read_tag(const char *filename, VFSFile &file, Tuple &tuple, Inde
     return true;
 }
 
+/* the length found by detect_length() if the song has no length tag */
+static int detected_length(PSFEngine eng, Index<char> &buf, const Tuple &tuple)
+{
+    if (eng != ENG_SPX)
+    {
+        corlett_t *c;
+        if (corlett_decode((uint8_t *)buf.begin(), buf.len(), nullptr, nullptr, &c) != AO_SUCCESS)
+            return -1;
+
+        bool tagged = psfTimeToMS(c->inf_length) > 0;
+        free(c);
+
+        if (tagged)
+            return -1;
+    }
+
+    int length = tuple.get_int(Tuple::Length);
+    return (length > LengthDetector::fade) ? length : -1;
+}
+
 bool PSFPlugin::play(const char *filename, VFSFile &file)
 {
     bool error = false;
+    int length = -1;
 
-    const char * slash = strrchr (filename, '/');
-    if (! slash)
+    std::lock_guard<std::mutex> lock(engine_mutex);
+
+    if (! strrchr (filename, '/'))
         return false;
 
-    dirpath = String (str_copy (filename, slash + 1 - filename));
+    set_dirpath(filename);
 
     Index<char> buf = file.read_all ();
 
@@ -186,6 +300,9 @@ bool PSFPlugin::play(const char *filename, VFSFile &file)
         goto cleanup;
     }
 
+    if (!ignore_len)
+        length = detected_length(eng, buf, get_playback_tuple());
+
     if(eng == ENG_PSF1 || eng == ENG_SPX)
         setendless(ignore_len);
 
@@ -209,6 +326,11 @@ bool PSFPlugin::play(const char *filename, VFSFile &file)
             goto cleanup;
         }
 
+        if (length > 0 && eng == ENG_PSF2)
+            setlength2(length - LengthDetector::fade, LengthDetector::fade);
+        else if (length > 0)
+            setlength(length - LengthDetector::fade, LengthDetector::fade);
+
         if (reverse_seek >= 0)
         {
             f->seek(reverse_seek); /* should never fail here */
@@ -250,7 +372,8 @@ void PSFPlugin::update(const void *data, int bytes)
         return;
     }
 
-    write_audio(data, bytes);
+    if (bytes)
+        write_audio(data, bytes);
 }
 
 bool PSFPlugin::is_our_file(const char *filename, VFSFile &file)
@@ -267,6 +390,7 @@ const char *const PSFPlugin::exts[] = { "psf", "minipsf", "psf2", "minipsf2", "s
 const PreferencesWidget PSFPlugin::widgets[] = {
     WidgetLabel(N_("<b>OpenPSF Configuration</b>")),
     WidgetCheck(N_("Ignore length from file"), WidgetBool("psf", "ignore_length")),
+    WidgetCheck(N_("Find the length of songs without one"), WidgetBool("psf", "detect_length")),
 };
 
 const PluginPreferences PSFPlugin::prefs = {{widgets}};
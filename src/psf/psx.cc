@@ -2975,6 +2975,12 @@ void mips_set_icount(int count)
 	mips_ICount = count;
 }
 
+void mips_state_regions(Index<StateRegion> &regions)
+{
+	state_add(regions, mipscpu);
+	state_add(regions, mips_ICount);
+}
+
 
 #if (HAS_PSXCPU)
 /**************************************************************************
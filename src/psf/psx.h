@@ -2,6 +2,7 @@
 #define _MIPS_H
 
 #include "ao.h"
+#include "state.h"
 //#include "driver.h"
 
 typedef void genf(void);
@@ -291,6 +292,7 @@ extern int psf_refresh;
 int32_t psf_start(uint8_t *buffer, uint32_t length);
 int32_t psf_execute(void (*update)(const void *, int));
 int32_t psf_stop(void);
+int32_t psf_seek(uint32_t t);
 
 /* eng_psf2.cc */
 uint32_t psf2_load_elf(uint8_t *start, uint32_t len);
@@ -298,6 +300,7 @@ uint32_t psf2_load_file(const char *file, uint8_t *buf, uint32_t buflen);
 int32_t psf2_start(uint8_t *, uint32_t length);
 int32_t psf2_execute(void (*update)(const void *, int));
 int32_t psf2_stop(void);
+int32_t psf2_seek(uint32_t t);
 int32_t psf2_command(int32_t, int32_t);
 uint32_t psf2_get_loadaddr(void);
 void psf2_set_loadaddr(uint32_t addr);
@@ -306,6 +309,7 @@ void psf2_set_loadaddr(uint32_t addr);
 int32_t spx_start(uint8_t *buffer, uint32_t length);
 int32_t spx_execute(void (*update)(const void *, int));
 int32_t spx_stop(void);
+int32_t spx_seek(uint32_t t);
 
 /* plugin.cc */
 extern bool stop_flag;
@@ -323,6 +327,7 @@ void mips_set_status(uint32_t status);
 uint32_t mips_get_ePC(void);
 int mips_get_icount(void);
 void mips_set_icount(int count);
+void mips_state_regions(Index<StateRegion> &regions);
 
 /* psx_hw.cc */
 extern uint32_t psx_ram[((2*1024*1024)/4)+4];
@@ -336,6 +341,9 @@ void psx_hw_frame(void);
 void ps2_hw_frame(void);
 
 void psx_hw_init(void);
+void psx_hw_state_regions(Index<StateRegion> &regions);
+bool psx_hw_files_open(void);
+void psx_hw_close_files(void);
 void psx_bios_hle(uint32_t pc);
 void psx_hw_runcounters(void);
 
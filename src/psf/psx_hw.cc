@@ -1313,6 +1313,84 @@ void psx_hw_init(void)
 	root_cnts[3].interrupt = 1;
 }
 
+// the HLE BIOS and IOP state, for snapshots; the open files are left out,
+// since their data is allocated, and snapshots are only taken with none open
+void psx_hw_state_regions(Index<StateRegion> &regions)
+{
+	state_add(regions, softcall_target);
+	state_add(regions, intr_susp);
+	state_add(regions, sys_time);
+	state_add(regions, timerexp);
+	state_add(regions, iNumLibs);
+	state_add(regions, reglibs);
+	state_add(regions, iNumFlags);
+	state_add(regions, evflags);
+	state_add(regions, iNumSema);
+	state_add(regions, semaphores);
+	state_add(regions, iNumThreads);
+	state_add(regions, iCurThread);
+	state_add(regions, threads);
+	state_add(regions, iop_timers);
+	state_add(regions, iNumTimers);
+	state_add(regions, root_cnts);
+	state_add(regions, Event);
+	state_add(regions, CounterEvent);
+	state_add(regions, psx_ram);
+	state_add(regions, psx_scratch);
+	state_add(regions, spu_delay);
+	state_add(regions, dma_icr);
+	state_add(regions, irq_data);
+	state_add(regions, irq_mask);
+	state_add(regions, dma_timer);
+	state_add(regions, WAI);
+	state_add(regions, dma4_madr);
+	state_add(regions, dma4_bcr);
+	state_add(regions, dma4_chcr);
+	state_add(regions, dma4_delay);
+	state_add(regions, dma7_madr);
+	state_add(regions, dma7_bcr);
+	state_add(regions, dma7_chcr);
+	state_add(regions, dma7_delay);
+	state_add(regions, dma4_cb);
+	state_add(regions, dma7_cb);
+	state_add(regions, dma4_fval);
+	state_add(regions, dma4_flag);
+	state_add(regions, dma7_fval);
+	state_add(regions, dma7_flag);
+	state_add(regions, irq9_cb);
+	state_add(regions, irq9_fval);
+	state_add(regions, irq9_flag);
+	state_add(regions, gpu_stat);
+	state_add(regions, fcnt);
+	state_add(regions, heap_addr);
+	state_add(regions, entry_int);
+	state_add(regions, irq_regs);
+	state_add(regions, irq_mutex);
+}
+
+bool psx_hw_files_open(void)
+{
+	for (int i = 0; i < MAX_FILE_SLOTS; i++)
+	{
+		if (filestat[i])
+			return true;
+	}
+
+	return false;
+}
+
+void psx_hw_close_files(void)
+{
+	for (int i = 0; i < MAX_FILE_SLOTS; i++)
+	{
+		free(filedata[i]);
+		filedata[i] = nullptr;
+		filepos[i] = 0;
+		filesize[i] = 0;
+		filestat[i] = 0;
+	}
+}
+
 void psx_bios_hle(uint32_t pc)
 {
 	uint32_t subcall, status;
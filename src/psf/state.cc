@@ -0,0 +1,173 @@
+/*
+ * state.cc
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <string.h>
+
+#include "state.h"
+
+static constexpr size_t blockSize = 16384;
+static constexpr uint32_t snapshotInterval = 44100 * 10;
+static constexpr int maxSnapshots = 32;
+
+/* calls func(offset, ptr, size) for each piece of the regions within each
+ * block, the blocks running on from one region to the next */
+template<class F>
+static void for_each_piece(const Index<StateRegion> &regions, F func)
+{
+    size_t offset = 0;
+
+    for (const StateRegion &region : regions)
+    {
+        uint8_t *ptr = (uint8_t *)region.ptr;
+        size_t left = region.size;
+
+        while (left)
+        {
+            size_t size = aud::min(left, blockSize - offset % blockSize);
+            func(offset, ptr, size);
+
+            offset += size;
+            ptr += size;
+            left -= size;
+        }
+    }
+}
+
+void StateSnapshot::save(const Index<StateRegion> &regions, const StateSnapshot *last)
+{
+    std::vector<uint8_t> block;
+    block.reserve(blockSize);
+    m_blocks.clear();
+
+    auto finish = [&]() {
+        size_t index = m_blocks.size();
+        bool zero = true;
+
+        for (uint8_t byte : block)
+        {
+            if (byte)
+            {
+                zero = false;
+                break;
+            }
+        }
+
+        if (zero)
+            m_blocks.emplace_back();
+        else if (last && index < last->m_blocks.size() && last->m_blocks[index] &&
+                 *last->m_blocks[index] == block)
+            m_blocks.push_back(last->m_blocks[index]);
+        else
+            m_blocks.push_back(std::make_shared<const std::vector<uint8_t>>(block));
+
+        block.clear();
+    };
+
+    for_each_piece(regions, [&](size_t offset, const uint8_t *ptr, size_t size) {
+        block.insert(block.end(), ptr, ptr + size);
+        if (block.size() == blockSize)
+            finish();
+    });
+
+    if (block.size())
+        finish();
+}
+
+void StateSnapshot::load(const Index<StateRegion> &regions) const
+{
+    for_each_piece(regions, [&](size_t offset, uint8_t *ptr, size_t size) {
+        const Block &block = m_blocks[offset / blockSize];
+        if (block)
+            memcpy(ptr, block->data() + offset % blockSize, size);
+        else
+            memset(ptr, 0, size);
+    });
+}
+
+void StateHistory::start(Index<StateRegion> &&regions)
+{
+    clear();
+    m_regions = std::move(regions);
+}
+
+void StateHistory::clear()
+{
+    m_regions.clear();
+    m_entries.clear();
+    m_interval = snapshotInterval;
+    m_chosen = -1;
+    m_seek = -1;
+}
+
+void StateHistory::frame(uint32_t samples)
+{
+    if (m_entries.size() && samples < m_entries.back().samples + m_interval)
+        return;
+
+    /* with too many, keep every other one and take them half as often */
+    if (m_entries.size() == maxSnapshots)
+    {
+        for (int i = 1; i < maxSnapshots / 2; i++)
+            m_entries[i] = std::move(m_entries[i * 2]);
+
+        m_entries.resize(maxSnapshots / 2);
+        m_interval *= 2;
+
+        if (samples < m_entries.back().samples + m_interval)
+            return;
+    }
+
+    const StateSnapshot *last = m_entries.size() ? &m_entries.back().state : nullptr;
+
+    Entry entry;
+    entry.samples = samples;
+    entry.state.save(m_regions, last);
+    m_entries.push_back(std::move(entry));
+}
+
+bool StateHistory::seek(uint32_t ms)
+{
+    uint64_t samples = (uint64_t)ms * 441 / 10;
+    int chosen = -1;
+
+    for (int i = 0; i < (int)m_entries.size(); i++)
+    {
+        if (m_entries[i].samples > samples)
+            break;
+        chosen = i;
+    }
+
+    if (chosen < 0)
+        return false;
+
+    m_chosen = chosen;
+    m_seek = ms;
+    return true;
+}
+
+uint32_t StateHistory::restore()
+{
+    uint32_t ms = m_seek;
+
+    m_entries[m_chosen].state.load(m_regions);
+    m_chosen = -1;
+    m_seek = -1;
+
+    return ms;
+}
@@ -0,0 +1,94 @@
+/*
+ * state.h
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef PSF_STATE_H
+#define PSF_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include <libaudcore/index.h>
+
+/* A piece of memory that holds emulator state: a variable, an array, or a
+ * buffer that stays allocated while the song plays.  Pointers in the state
+ * are copied as they are, so they must only point into memory that does. */
+struct StateRegion
+{
+    void *ptr;
+    size_t size;
+};
+
+template<class T>
+static inline void state_add(Index<StateRegion> &regions, T &var)
+{
+    regions.append(StateRegion{(void *)&var, sizeof var});
+}
+
+/* A copy of the state, kept in blocks.  Blocks that are all zero are not
+ * kept, and blocks that are the same as in the snapshot before are shared
+ * with it, so that most of the RAM is only stored once. */
+class StateSnapshot
+{
+public:
+    void save(const Index<StateRegion> &regions, const StateSnapshot *last);
+    void load(const Index<StateRegion> &regions) const;
+
+private:
+    typedef std::shared_ptr<const std::vector<uint8_t>> Block;
+    std::vector<Block> m_blocks;
+};
+
+/* Snapshots taken every so often while a song plays, so that a seek back
+ * goes on from the last one before it rather than from the beginning.  The
+ * engine calls frame() and restore() between frames, where the state is
+ * whole; seek() may be called from inside a frame. */
+class StateHistory
+{
+public:
+    void start(Index<StateRegion> &&regions);
+    void clear();
+
+    /* takes a snapshot if one is due; samples is the position */
+    void frame(uint32_t samples);
+
+    /* chooses the snapshot to go back to; false if there is none */
+    bool seek(uint32_t ms);
+    bool pending() const { return m_seek >= 0; }
+
+    /* goes back to the chosen snapshot and returns the time sought to */
+    uint32_t restore();
+
+private:
+    struct Entry
+    {
+        uint32_t samples;
+        StateSnapshot state;
+    };
+
+    Index<StateRegion> m_regions;
+    std::vector<Entry> m_entries;
+    uint32_t m_interval = 0;
+    int m_chosen = -1;
+    int64_t m_seek = -1;
+};
+
+#endif // PSF_STATE_H
@@ -24,10 +24,15 @@
 
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/threads.h>
 #include <libaudcore/preferences.h>
 
+#include "../output-common/adaptive.h"
+#include "../output-common/telemetry.h"
+#include "../trace-common/trace.h"
+
 class PulseOutput : public OutputPlugin
 {
 public:
@@ -73,6 +78,7 @@ const PreferencesWidget PulseOutput::widgets[] = {
         WidgetString ("pulse", "context_name")),
     WidgetEntry (N_("Stream name:"),
         WidgetString ("pulse", "stream_name")),
+    ADAPTIVE_WIDGETS
 };
 
 const PluginPreferences PulseOutput::prefs = {{widgets}};
@@ -86,20 +92,48 @@ const char * const PulseOutput::prefs_defaults[] = {
     nullptr
 };
 
+/* The PulseAudio objects belong to a main loop running in its own thread.
+ * Everything that touches them, and the ring buffer, does so with the
+ * main loop locked; waiting on the loop (pa_threaded_mainloop_wait) lets go
+ * of the lock until one of the callbacks signals.  pulse_mutex only guards
+ * the connection as a whole and the saved volume, which must be available
+ * while no loop is running.  It is always taken first. */
 static aud::mutex pulse_mutex;
-static aud::condvar pulse_cond;
 
 static pa_context * context = nullptr;
 static pa_stream * stream = nullptr;
-static pa_mainloop * mainloop = nullptr;
+static pa_threaded_mainloop * mainloop = nullptr;
+
+/* Audio from write_audio() waits here until the server asks for it; it is
+ * written from the stream's write callback, or straight away when there is
+ * room for it already. */
+static RingBuf<char> ring;
 
-static bool connected, flushed, polling;
+static bool connected, flushed;
+static bool expect_underflow; /* after drain() or flush() */
+static int applied_target; /* ms, as last given to the server */
 
 static pa_cvolume volume;
 
 static StereoVolume saved_volume = {0, 0};
 static bool saved_volume_changed = false;
 
+class LoopLock
+{
+public:
+    LoopLock () { pa_threaded_mainloop_lock (mainloop); }
+    ~LoopLock () { pa_threaded_mainloop_unlock (mainloop); }
+
+    LoopLock (const LoopLock &) = delete;
+    LoopLock & operator= (const LoopLock &) = delete;
+};
+
+/* Wake up any thread waiting on the main loop. */
+static void signal_waiters ()
+{
+    pa_threaded_mainloop_signal (mainloop, 0);
+}
+
 /* Check whether the connection is still alive. */
 static bool alive ()
 {
@@ -107,38 +141,13 @@ static bool alive ()
      pa_stream_get_state (stream) == PA_STREAM_READY;
 }
 
-/* Cooperative polling method.  Only one thread calls the actual poll function,
- * and dispatches the events received.  Any other threads simply wait for the
- * first thread to finish. */
-static void poll_events (aud::mutex::holder & lock)
-{
-    if (polling)
-        pulse_cond.wait (lock);
-    else
-    {
-        pa_mainloop_prepare (mainloop, -1);
-
-        polling = true;
-        lock.unlock ();
-
-        pa_mainloop_poll (mainloop);
-
-        lock.lock ();
-        polling = false;
-
-        pa_mainloop_dispatch (mainloop);
-
-        pulse_cond.notify_all ();
-    }
-}
-
 /* Wait for an asynchronous operation to complete.  Return immediately if the
  * connection dies. */
-static bool finish (pa_operation * op, aud::mutex::holder & lock)
+static bool finish (pa_operation * op)
 {
     pa_operation_state_t state;
     while ((state = pa_operation_get_state (op)) != PA_OPERATION_DONE && alive ())
-        poll_events (lock);
+        pa_threaded_mainloop_wait (mainloop);
 
     pa_operation_unref (op);
     return (state == PA_OPERATION_DONE);
@@ -150,14 +159,17 @@ static bool finish (pa_operation * op, aud::mutex::holder & lock)
 
 #define CHECK(function, ...) do { \
     auto op = function (__VA_ARGS__, & success); \
-    if (! op || ! finish (op, lock) || ! success) \
+    if (! op || ! finish (op) || ! success) \
         REPORT (#function); \
 } while (0)
 
 static void info_cb (pa_context *, const pa_sink_input_info * i, int, void * userdata)
 {
     if (! i)
+    {
+        signal_waiters ();
         return;
+    }
 
     volume = i->volume;
 
@@ -183,27 +195,96 @@ static void subscribe_cb (pa_context * c, pa_subscription_event_type t, uint32_t
     pa_operation_unref (o);
 }
 
+static void context_state_cb (pa_context *, void *)
+{
+    signal_waiters ();
+}
+
+static void stream_state_cb (pa_stream *, void *)
+{
+    signal_waiters ();
+}
+
+/* Move as much of the ring buffer to the server as it has asked for.  The
+ * server copies the data, so whole contiguous runs go out as they are. */
+static void write_buffered ()
+{
+    while (ring.len ())
+    {
+        size_t writable = pa_stream_writable_size (stream);
+        if (! writable || writable == (size_t) -1)
+            break;
+
+        int length = aud::min ((size_t) ring.linear (), writable);
+
+        if (pa_stream_write (stream, & ring[0], length, nullptr, 0, PA_SEEK_RELATIVE) < 0)
+        {
+            REPORT ("pa_stream_write");
+            break;
+        }
+
+        ring.discard (length);
+    }
+}
+
+static void write_cb (pa_stream *, size_t, void *)
+{
+    write_buffered ();
+    signal_waiters ();
+}
+
+static void underflow_cb (pa_stream *, void *)
+{
+    if (! expect_underflow)
+    {
+        telemetry_underrun ();
+        adaptive_underrun ();
+    }
+}
+
+/* With adaptive buffering, the server's target length follows the target
+ * fill.  The change takes effect whenever the server gets to it; nothing
+ * waits for it. */
+static void apply_target ()
+{
+    int ms = adaptive_target ();
+    if (! ms || ms == applied_target)
+        return;
+
+    pa_buffer_attr attr = * pa_stream_get_buffer_attr (stream);
+    attr.tlength = pa_usec_to_bytes ((pa_usec_t) 1000 * ms, pa_stream_get_sample_spec (stream));
+
+    auto op = pa_stream_set_buffer_attr (stream, & attr, nullptr, nullptr);
+    if (! op)
+    {
+        REPORT ("pa_stream_set_buffer_attr");
+        return;
+    }
+
+    pa_operation_unref (op);
+    applied_target = ms;
+}
+
 static void stream_success_cb (pa_stream *, int success, void * userdata)
 {
     if (userdata)
         * (int * ) userdata = success;
+
+    signal_waiters ();
 }
 
 static void context_success_cb (pa_context *, int success, void * userdata)
 {
     if (userdata)
         * (int * ) userdata = success;
+
+    signal_waiters ();
 }
 
-static void get_volume_locked (aud::mutex::holder & lock)
+/* called with the main loop locked; the loop thread keeps the volume up to
+ * date by itself */
+static void get_volume_locked ()
 {
-    if (! polling)
-    {
-        /* read any pending events to get the lastest volume */
-        while (pa_mainloop_iterate (mainloop, 0, nullptr) > 0)
-            continue;
-    }
-
     if (volume.channels == 2)
     {
         saved_volume.left = aud::rescale<int> (volume.values[0], PA_VOLUME_NORM, 100);
@@ -223,12 +304,16 @@ StereoVolume PulseOutput::get_volume ()
     auto lock = pulse_mutex.take ();
 
     if (connected)
-        get_volume_locked (lock);
+    {
+        LoopLock loop;
+        get_volume_locked ();
+    }
 
     return saved_volume;
 }
 
-static void set_volume_locked (aud::mutex::holder & lock)
+/* called with the main loop locked */
+static void set_volume_locked ()
 {
     if (volume.channels != 1)
     {
@@ -258,12 +343,15 @@ void PulseOutput::set_volume (StereoVolume v)
     saved_volume_changed = true;
 
     if (connected)
-        set_volume_locked (lock);
+    {
+        LoopLock loop;
+        set_volume_locked ();
+    }
 }
 
 void PulseOutput::pause (bool pause)
 {
-    auto lock = pulse_mutex.take ();
+    LoopLock loop;
 
     int success = 0;
     CHECK (pa_stream_cork, stream, pause, stream_success_cb);
@@ -271,20 +359,29 @@ void PulseOutput::pause (bool pause)
 
 int PulseOutput::get_delay ()
 {
-    auto lock = pulse_mutex.take ();
+    LoopLock loop;
 
     pa_usec_t usec;
     int neg;
 
-    if (pa_stream_get_latency (stream, & usec, & neg) == PA_OK)
-        return usec / 1000;
-    else
+    if (pa_stream_get_latency (stream, & usec, & neg) != PA_OK)
         return 0;
+
+    /* whatever is still in the ring buffer is yet to reach the server */
+    usec += pa_bytes_to_usec (ring.len (), pa_stream_get_sample_spec (stream));
+
+    return telemetry_latency (usec / 1000);
 }
 
 void PulseOutput::drain ()
 {
-    auto lock = pulse_mutex.take ();
+    LoopLock loop;
+
+    expect_underflow = true;
+
+    /* the write callback empties the ring buffer first */
+    while (ring.len () && alive ())
+        pa_threaded_mainloop_wait (mainloop);
 
     int success = 0;
     CHECK (pa_stream_drain, stream, stream_success_cb);
@@ -292,53 +389,69 @@ void PulseOutput::drain ()
 
 void PulseOutput::flush ()
 {
-    auto lock = pulse_mutex.take ();
+    LoopLock loop;
+
+    expect_underflow = true;
+    ring.discard ();
 
     int success = 0;
     CHECK (pa_stream_flush, stream, stream_success_cb);
 
     /* wake up period_wait() */
     flushed = true;
-    if (polling)
-        pa_mainloop_wakeup (mainloop);
+    signal_waiters ();
 }
 
 void PulseOutput::period_wait ()
 {
-    auto lock = pulse_mutex.take ();
+    TRACE_SPAN ("PulseAudio period_wait");
+    LoopLock loop;
 
     int success = 0;
     CHECK (pa_stream_trigger, stream, stream_success_cb);
 
+    if (alive ())
+        apply_target ();
+
     /* if the connection dies, wait until flush() is called */
-    while ((! pa_stream_writable_size (stream) || ! alive ()) && ! flushed)
-        poll_events (lock);
+    while ((! ring.space () || ! alive ()) && ! flushed)
+    {
+        pa_threaded_mainloop_wait (mainloop);
+        adaptive_wakeup ();
+
+        auto attr = pa_stream_get_buffer_attr (stream);
+        if (attr && alive ())
+            telemetry_wakeup (attr->tlength - pa_stream_writable_size (stream) +
+             ring.len (), attr->tlength + ring.size ());
+    }
 }
 
 int PulseOutput::write_audio (const void * ptr, int length)
 {
-    auto lock = pulse_mutex.take ();
-    int ret = 0;
+    TRACE_SPAN ("PulseAudio write_audio");
+    LoopLock loop;
 
-    length = aud::min ((size_t) length, pa_stream_writable_size (stream));
+    length = aud::min (length, ring.space ());
+    ring.copy_in ((const char *) ptr, length);
 
-    if (pa_stream_write (stream, ptr, length, nullptr, 0, PA_SEEK_RELATIVE) < 0)
-        REPORT ("pa_stream_write");
-    else
-        ret = length;
+    if (alive ())
+        write_buffered ();
 
     flushed = false;
-    return ret;
+    expect_underflow = false;
+    return length;
 }
 
-static void close_audio_locked (aud::mutex::holder & lock)
+/* called with pulse_mutex held and the main loop unlocked; once the loop
+ * thread has stopped, nothing else can be touching the objects below */
+static void close_audio_locked ()
 {
-    /* wait for any parallel tasks (e.g. set_volume()) to complete */
-    while (polling)
-        pulse_cond.wait (lock);
-
+    telemetry_close ();
     connected = false;
 
+    if (mainloop)
+        pa_threaded_mainloop_stop (mainloop);
+
     if (stream)
     {
         pa_stream_disconnect (stream);
@@ -355,15 +468,17 @@ static void close_audio_locked (aud::mutex::holder & lock)
 
     if (mainloop)
     {
-        pa_mainloop_free (mainloop);
+        pa_threaded_mainloop_free (mainloop);
         mainloop = nullptr;
     }
+
+    ring.destroy ();
 }
 
 void PulseOutput::close_audio ()
 {
     auto lock = pulse_mutex.take ();
-    close_audio_locked (lock);
+    close_audio_locked ();
 }
 
 static pa_sample_format_t to_pulse_format (int aformat)
@@ -400,9 +515,11 @@ static bool set_sample_spec (pa_sample_spec & ss, int fmt, int rate, int nch)
 
 static void set_buffer_attr (pa_buffer_attr & buffer, const pa_sample_spec & ss)
 {
-    int buffer_ms = aud_get_int ("output_buffer_size");
+    int buffer_ms = adaptive_open (aud_get_int ("output_buffer_size"));
     size_t buffer_size = pa_usec_to_bytes ((pa_usec_t) 1000 * buffer_ms, & ss);
 
+    applied_target = buffer_ms;
+
     buffer.maxlength = (uint32_t) -1;
     buffer.tlength = buffer_size;
     buffer.prebuf = (uint32_t) -1;
@@ -410,6 +527,17 @@ static void set_buffer_attr (pa_buffer_attr & buffer, const pa_sample_spec & ss)
     buffer.fragsize = buffer_size;
 }
 
+/* The ring buffer only has to bridge the time between two requests from
+ * the server, so a tenth of the buffer size is plenty; all of it adds to
+ * the latency. */
+static void alloc_ring (const pa_sample_spec & ss)
+{
+    int ring_ms = aud::max (aud_get_int ("output_buffer_size") / 10, 10);
+    size_t frames = aud::rescale<int64_t> (ring_ms, 1000, ss.rate);
+
+    ring.alloc (frames * pa_frame_size (& ss));
+}
+
 static String get_context_name ()
 {
     String context_name = aud_get_str ("pulse", "context_name");
@@ -420,9 +548,9 @@ static String get_context_name ()
     return context_name;
 }
 
-static bool create_context (aud::mutex::holder & lock)
+static bool create_context ()
 {
-    if (! (mainloop = pa_mainloop_new ()))
+    if (! (mainloop = pa_threaded_mainloop_new ()))
     {
         AUDERR ("Failed to allocate main loop\n");
         return false;
@@ -432,7 +560,7 @@ static bool create_context (aud::mutex::holder & lock)
     pa_proplist_sets (proplist, PA_PROP_APPLICATION_ID, "audacious");
     pa_proplist_sets (proplist, PA_PROP_APPLICATION_ICON_NAME, "audacious");
 
-    context = pa_context_new_with_proplist (pa_mainloop_get_api (mainloop),
+    context = pa_context_new_with_proplist (pa_threaded_mainloop_get_api (mainloop),
      get_context_name (), proplist);
 
     pa_proplist_free (proplist);
@@ -443,12 +571,26 @@ static bool create_context (aud::mutex::holder & lock)
         return false;
     }
 
+    pa_context_set_state_callback (context, context_state_cb, nullptr);
+
     if (pa_context_connect (context, nullptr, (pa_context_flags_t) 0, nullptr) < 0)
     {
         REPORT ("pa_context_connect");
         return false;
     }
 
+    if (pa_threaded_mainloop_start (mainloop) < 0)
+    {
+        AUDERR ("Failed to start main loop\n");
+        return false;
+    }
+
+    return true;
+}
+
+/* called with the main loop locked from here on */
+static bool wait_for_context ()
+{
     /* Wait until the context is ready */
     pa_context_state_t cstate;
     while ((cstate = pa_context_get_state (context)) != PA_CONTEXT_READY)
@@ -459,7 +601,7 @@ static bool create_context (aud::mutex::holder & lock)
             return false;
         }
 
-        poll_events (lock);
+        pa_threaded_mainloop_wait (mainloop);
     }
 
     return true;
@@ -475,7 +617,7 @@ static String get_stream_name ()
     return stream_name;
 }
 
-static bool create_stream (aud::mutex::holder & lock, const pa_sample_spec & ss)
+static bool create_stream (const pa_sample_spec & ss)
 {
     if (! (stream = pa_stream_new (context, get_stream_name (), & ss, nullptr)))
     {
@@ -487,6 +629,10 @@ static bool create_stream (aud::mutex::holder & lock, const pa_sample_spec & ss)
     pa_buffer_attr buffer;
     set_buffer_attr (buffer, ss);
 
+    pa_stream_set_state_callback (stream, stream_state_cb, nullptr);
+    pa_stream_set_write_callback (stream, write_cb, nullptr);
+    pa_stream_set_underflow_callback (stream, underflow_cb, nullptr);
+
     auto flags = pa_stream_flags_t (PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE);
     if (pa_stream_connect_playback (stream, nullptr, & buffer, flags, nullptr, nullptr) < 0)
     {
@@ -504,13 +650,13 @@ static bool create_stream (aud::mutex::holder & lock, const pa_sample_spec & ss)
             return false;
         }
 
-        poll_events (lock);
+        pa_threaded_mainloop_wait (mainloop);
     }
 
     return true;
 }
 
-static bool subscribe_events (aud::mutex::holder & lock)
+static bool subscribe_events ()
 {
     pa_context_set_subscribe_callback (context, subscribe_cb, nullptr);
 
@@ -537,28 +683,43 @@ bool PulseOutput::open_audio (int fmt, int rate, int nch, String & error)
     if (! set_sample_spec (ss, fmt, rate, nch))
         return false;
 
-    if (! create_context (lock) ||
-        ! create_stream (lock, ss) ||
-        ! subscribe_events (lock))
+    telemetry_open ("PulseAudio");
+    alloc_ring (ss);
+
+    if (! create_context ())
     {
-        close_audio_locked (lock);
+        close_audio_locked ();
         return false;
     }
 
-    connected = true;
-    flushed = true;
+    pa_threaded_mainloop_lock (mainloop);
 
-    if (saved_volume_changed)
-        set_volume_locked (lock);
-    else
-        get_volume_locked (lock);
+    bool ready = wait_for_context () && create_stream (ss) && subscribe_events ();
 
-    return true;
+    if (ready)
+    {
+        connected = true;
+        flushed = true;
+        expect_underflow = true;
+
+        if (saved_volume_changed)
+            set_volume_locked ();
+        else
+            get_volume_locked ();
+    }
+
+    pa_threaded_mainloop_unlock (mainloop);
+
+    if (! ready)
+        close_audio_locked ();
+
+    return ready;
 }
 
 bool PulseOutput::init ()
 {
     aud_config_set_defaults ("pulse", prefs_defaults);
+    adaptive_init ();
 
     /* check for a running server and get initial volume */
     String error;
@@ -0,0 +1,250 @@
+/*
+ * analyzer.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "analyzer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <libaudcore/objects.h>
+
+/* spectra waiting in the input beyond the one being worked on; if the
+ * thread falls further behind, the oldest data is dropped */
+#define MAX_BACKLOG 4
+
+SpectrumAnalyzer::SpectrumAnalyzer (void (* deliver) ()) :
+    m_deliver_func (deliver)
+{
+    m_thread = std::thread (& SpectrumAnalyzer::run, this);
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer ()
+{
+    std::unique_lock<std::mutex> lock (m_mutex);
+    m_quit = true;
+    m_cond.notify_all ();
+    lock.unlock ();
+
+    m_thread.join ();
+    m_deliver.stop ();
+}
+
+void SpectrumAnalyzer::configure (int size, FFTWindow window, int averages)
+{
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    m_size = FFTPlan::get (size)->size ();
+    m_window_type = window;
+    m_averages = aud::clamp (averages, 1, MAX_AVERAGES);
+    m_reset = true;
+    m_input.clear ();
+    m_cond.notify_all ();
+}
+
+void SpectrumAnalyzer::set_bands (int bands)
+{
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_bands = aud::clamp (bands, 0, (int) MAX_BANDS);
+}
+
+void SpectrumAnalyzer::clear ()
+{
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    m_reset = true;
+    m_input.clear ();
+    m_new_levels = false;
+    m_cond.notify_all ();
+}
+
+void SpectrumAnalyzer::add_pcm (const float * pcm, int channels)
+{
+    float mono[HOP];
+
+    for (int i = 0; i < HOP; i ++)
+    {
+        float sum = 0;
+        for (int c = 0; c < channels; c ++)
+            sum += pcm[i * channels + c];
+
+        mono[i] = sum / channels;
+    }
+
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    m_input.insert (mono, -1, HOP);
+
+    int excess = m_input.len () - (m_size + MAX_BACKLOG * HOP);
+    if (excess > 0)
+        m_input.remove (0, excess);
+
+    if (m_input.len () >= m_size)
+        m_cond.notify_all ();
+}
+
+bool SpectrumAnalyzer::get_levels (float * levels, int bands)
+{
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    if (! m_new_levels || m_n_levels != bands)
+        return false;
+
+    memcpy (levels, m_levels, sizeof (float) * bands);
+    m_new_levels = false;
+    return true;
+}
+
+/* called with m_mutex held */
+void SpectrumAnalyzer::setup ()
+{
+    int size = m_size;
+    int bins = size / 2;
+
+    m_plan = FFTPlan::get (size);
+
+    /* periodic windows, scaled so that a full-scale sine in the middle of a
+     * bin comes out at a power of 1 */
+    m_window.resize (size);
+
+    double sum = 0;
+    for (int i = 0; i < size; i ++)
+    {
+        double x = 2 * M_PI * i / size;
+
+        if (m_window_type == FFTWindow::BlackmanHarris)
+            m_window[i] = 0.35875 - 0.48829 * cos (x) + 0.14128 * cos (2 * x) - 0.01168 * cos (3 * x);
+        else
+            m_window[i] = 0.5 - 0.5 * cos (x);
+
+        sum += m_window[i];
+    }
+
+    for (float & w : m_window)
+        w *= 2 / sum;
+
+    m_segment.resize (size);
+    m_work.resize (bins);
+    m_spectrum.resize (bins);
+    m_history.resize (m_averages * bins);
+    m_history_pos = 0;
+    m_history_count = 0;
+    m_scale_bands = 0;
+    m_reset = false;
+}
+
+/* called without m_mutex, on the thread's own data */
+void SpectrumAnalyzer::analyze ()
+{
+    int size = m_plan->size ();
+    int bins = size / 2;
+    int averages = m_history.len () / bins;
+
+    for (int i = 0; i < size; i ++)
+        m_segment[i] *= m_window[i];
+
+    float * power = & m_history[m_history_pos * bins];
+    m_plan->power (m_segment.begin (), power, m_work.begin ());
+
+    m_history_pos = (m_history_pos + 1) % averages;
+    m_history_count = aud::min (m_history_count + 1, averages);
+
+    memcpy (m_spectrum.begin (), m_history.begin (), sizeof (float) * bins);
+
+    for (int a = 1; a < m_history_count; a ++)
+    {
+        const float * past = & m_history[a * bins];
+        for (int k = 0; k < bins; k ++)
+            m_spectrum[k] += past[k];
+    }
+
+    int bands = m_work_bands;
+
+    if (bands != m_scale_bands)
+    {
+        for (int i = 0; i <= bands; i ++)
+            m_xscale[i] = powf (bins, (float) i / bands) - 0.5f;
+
+        m_scale_bands = bands;
+    }
+
+    /* the same fudge factor as Visualizer::compute_freq_band(), so that the
+     * graph has the same overall height however many bands there are */
+    float offset = 20 * log10f ((float) bands / 12) - 10 * log10f (m_history_count);
+
+    for (int i = 0; i < bands; i ++)
+    {
+        float lo = m_xscale[i], hi = m_xscale[i + 1];
+        int a = ceilf (lo), b = floorf (hi);
+        float n = 0;
+
+        if (b < a)
+            n += m_spectrum[b] * (hi - lo);
+        else
+        {
+            if (a > 0)
+                n += m_spectrum[a - 1] * (a - lo);
+            for (; a < b; a ++)
+                n += m_spectrum[a];
+            if (b < bins)
+                n += m_spectrum[b] * (hi - b);
+        }
+
+        m_work_levels[i] = 10 * log10f (aud::max (n, 1e-20f)) + offset;
+    }
+}
+
+void SpectrumAnalyzer::run ()
+{
+    std::unique_lock<std::mutex> lock (m_mutex);
+
+    while (! m_quit)
+    {
+        if (m_reset)
+        {
+            setup ();
+            continue;
+        }
+
+        int size = m_plan->size ();
+
+        if (! m_bands || m_input.len () < size)
+        {
+            m_cond.wait (lock);
+            continue;
+        }
+
+        memcpy (m_segment.begin (), m_input.begin (), sizeof (float) * size);
+        m_input.remove (0, HOP);
+        m_work_bands = m_bands;
+
+        lock.unlock ();
+        analyze ();
+        lock.lock ();
+
+        /* the settings may have changed in the meantime */
+        if (m_reset || m_work_bands != m_bands)
+            continue;
+
+        memcpy (m_levels, m_work_levels, sizeof (float) * m_work_bands);
+        m_n_levels = m_work_bands;
+        m_new_levels = true;
+
+        m_deliver.queue (m_deliver_func);
+    }
+}
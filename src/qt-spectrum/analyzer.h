@@ -0,0 +1,100 @@
+/*
+ * analyzer.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef QT_SPECTRUM_ANALYZER_H
+#define QT_SPECTRUM_ANALYZER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <libaudcore/index.h>
+#include <libaudcore/mainloop.h>
+
+#include "fft.h"
+
+enum class FFTWindow {
+    Hann,
+    BlackmanHarris
+};
+
+/* Works out a spectrum of its own from the PCM data, in a thread, so that a
+ * large transform never holds up the visualizer.  The channels are mixed
+ * down, and a windowed FFT is taken of the last "size" samples every
+ * HOP samples, which is every buffer the visualizer passes in; the power of
+ * the last few transforms is averaged, and then summed into bands on a
+ * logarithmic scale like that of Visualizer::compute_log_xscale().
+ *
+ * The levels are handed to the given function in the main thread. */
+class SpectrumAnalyzer
+{
+public:
+    static constexpr int HOP = 512;
+    static constexpr int MAX_BANDS = 256;
+    static constexpr int MAX_AVERAGES = 16;
+
+    explicit SpectrumAnalyzer (void (* deliver) ());
+    ~SpectrumAnalyzer ();
+
+    SpectrumAnalyzer (const SpectrumAnalyzer &) = delete;
+    SpectrumAnalyzer & operator= (const SpectrumAnalyzer &) = delete;
+
+    void configure (int size, FFTWindow window, int averages);
+    void set_bands (int bands);
+    void clear ();
+
+    /* HOP frames */
+    void add_pcm (const float * pcm, int channels);
+
+    /* copies the last levels, in dB, if there are new ones for this many
+     * bands */
+    bool get_levels (float * levels, int bands);
+
+private:
+    void run ();
+    void setup ();
+    void analyze ();
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+
+    void (* m_deliver_func) ();
+    QueuedFunc m_deliver;
+
+    /* shared, under m_mutex */
+    int m_size = 4096, m_averages = 1, m_bands = 0;
+    FFTWindow m_window_type = FFTWindow::Hann;
+    bool m_reset = true, m_quit = false;
+    Index<float> m_input;
+    float m_levels[MAX_BANDS];
+    int m_n_levels = 0;
+    bool m_new_levels = false;
+
+    /* the thread's own */
+    const FFTPlan * m_plan = nullptr;
+    int m_history_pos = 0, m_history_count = 0;
+    int m_scale_bands = 0, m_work_bands = 0;
+    Index<float> m_window, m_segment, m_history, m_spectrum;
+    Index<FFTComplex> m_work;
+    float m_xscale[MAX_BANDS + 1];
+    float m_work_levels[MAX_BANDS];
+};
+
+#endif // QT_SPECTRUM_ANALYZER_H
@@ -0,0 +1,138 @@
+/*
+ * fft.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "fft.h"
+
+#include <math.h>
+
+#include <mutex>
+
+#define N_PLANS 5   /* MIN_SIZE to MAX_SIZE */
+
+static std::mutex plan_mutex;
+static const FFTPlan * plans[N_PLANS];
+
+static FFTComplex complex_mul (FFTComplex a, FFTComplex b)
+{
+    return {a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re};
+}
+
+static FFTComplex unit_root (int k, int n)
+{
+    double angle = -2 * M_PI * k / n;
+    return {(float) cos (angle), (float) sin (angle)};
+}
+
+FFTPlan::FFTPlan (int size) :
+    m_size (size)
+{
+    int half = size / 2;
+    int bits = 0;
+
+    while ((1 << bits) < half)
+        bits ++;
+
+    m_reverse.insert (0, half);
+
+    for (int i = 0; i < half; i ++)
+    {
+        int r = 0;
+        for (int b = 0; b < bits; b ++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+
+        m_reverse[i] = r;
+    }
+
+    m_twiddle.insert (0, half / 2);
+    for (int k = 0; k < half / 2; k ++)
+        m_twiddle[k] = unit_root (k, half);
+
+    m_split.insert (0, half);
+    for (int k = 0; k < half; k ++)
+        m_split[k] = unit_root (k, size);
+}
+
+const FFTPlan * FFTPlan::get (int size)
+{
+    int slot = 0;
+    while (slot < N_PLANS - 1 && (MIN_SIZE << slot) < size)
+        slot ++;
+
+    std::lock_guard<std::mutex> lock (plan_mutex);
+
+    if (! plans[slot])
+        plans[slot] = new FFTPlan (MIN_SIZE << slot);
+
+    return plans[slot];
+}
+
+void FFTPlan::clear_cache ()
+{
+    std::lock_guard<std::mutex> lock (plan_mutex);
+
+    for (const FFTPlan * & plan : plans)
+    {
+        delete plan;
+        plan = nullptr;
+    }
+}
+
+void FFTPlan::power (const float * in, float * out, FFTComplex * work) const
+{
+    int half = m_size / 2;
+
+    for (int i = 0; i < half; i ++)
+        work[m_reverse[i]] = {in[2 * i], in[2 * i + 1]};
+
+    /* radix-2 butterflies; the inner loop runs over contiguous values,
+     * which the compiler can vectorize */
+    for (int len = 2, step = half / 2; len <= half; len *= 2, step /= 2)
+    {
+        int mid = len / 2;
+
+        for (int start = 0; start < half; start += len)
+        {
+            FFTComplex * a = work + start;
+            FFTComplex * b = a + mid;
+
+            for (int j = 0; j < mid; j ++)
+            {
+                FFTComplex t = complex_mul (m_twiddle[j * step], b[j]);
+                b[j] = {a[j].re - t.re, a[j].im - t.im};
+                a[j] = {a[j].re + t.re, a[j].im + t.im};
+            }
+        }
+    }
+
+    /* the spectra of the even and odd samples are the symmetric and
+     * antisymmetric parts of the one just computed */
+    for (int k = 0; k < half; k ++)
+    {
+        FFTComplex z = work[k];
+        FFTComplex w = work[k ? half - k : 0];
+
+        FFTComplex even = {(z.re + w.re) * 0.5f, (z.im - w.im) * 0.5f};
+        FFTComplex odd = {(z.im + w.im) * 0.5f, (w.re - z.re) * 0.5f};
+        FFTComplex x = complex_mul (m_split[k], odd);
+
+        float re = even.re + x.re;
+        float im = even.im + x.im;
+        out[k] = re * re + im * im;
+    }
+}
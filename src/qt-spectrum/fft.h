@@ -0,0 +1,62 @@
+/*
+ * fft.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef QT_SPECTRUM_FFT_H
+#define QT_SPECTRUM_FFT_H
+
+#include <libaudcore/index.h>
+
+struct FFTComplex
+{
+    float re, im;
+};
+
+/* The power spectrum of a block of real samples, taken as a complex FFT of
+ * half the size on the even and odd samples and then split into the
+ * spectra of the two.  The bit-reversal table and the twiddle factors are
+ * worked out once per size; the plans are kept until clear_cache(), so
+ * that changing the size back and forth costs nothing. */
+class FFTPlan
+{
+public:
+    static constexpr int MIN_SIZE = 1024;
+    static constexpr int MAX_SIZE = 16384;
+
+    /* size is rounded to a power of two between MIN_SIZE and MAX_SIZE;
+     * may be called from any thread, but not at the same time as
+     * clear_cache() */
+    static const FFTPlan * get (int size);
+    static void clear_cache ();
+
+    int size () const { return m_size; }
+
+    /* |X[k]|^2 of the size / 2 bins below the Nyquist frequency, with work
+     * holding size / 2 values */
+    void power (const float * in, float * out, FFTComplex * work) const;
+
+private:
+    explicit FFTPlan (int size);
+
+    int m_size;
+    Index<int> m_reverse;           /* of the half-size FFT */
+    Index<FFTComplex> m_twiddle;    /* exp(-2 pi i k / (size / 2)) */
+    Index<FFTComplex> m_split;      /* exp(-2 pi i k / size) */
+};
+
+#endif // QT_SPECTRUM_FFT_H
@@ -16,6 +16,8 @@
  * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
  * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Copyright 2024 Audacious Plugins Authors
  */
 
 #include <math.h>
@@ -28,23 +30,77 @@
 #include <libaudcore/i18n.h>
 #include <libaudcore/interface.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
 #include <libaudqt/libaudqt.h>
 
+#include "../ui-common/vis-frame-qt.h"
+#include "analyzer.h"
+
 #define MAX_BANDS   (256)
 #define VIS_DELAY 2 /* delay before falloff in frames */
 #define VIS_FALLOFF 2 /* falloff in pixels per frame */
 
+#define CFG_ID "qt-spectrum"
+
 static float xscale[MAX_BANDS + 1];
 static int bands;
 static int bars[MAX_BANDS + 1];
 static int delay[MAX_BANDS + 1];
 
+/* only while the finer spectrum is wanted */
+static SpectrumAnalyzer * analyzer;
+static bool use_analyzer;
+
+static void analyzer_update ();
+
+static const char * const spectrum_defaults[] = {
+ "fft", "FALSE",
+ "fft_size", "4096",
+ "fft_window", aud::numeric_string<(int) FFTWindow::Hann>::str,
+ "fft_averages", "4",
+ nullptr};
+
+static const ComboItem fft_sizes[] = {
+    ComboItem ("1024", 1024),
+    ComboItem ("2048", 2048),
+    ComboItem ("4096", 4096),
+    ComboItem ("8192", 8192),
+    ComboItem ("16384", 16384)
+};
+
+static const ComboItem fft_windows[] = {
+    ComboItem (N_("Hann"), (int) FFTWindow::Hann),
+    ComboItem (N_("Blackman-Harris"), (int) FFTWindow::BlackmanHarris)
+};
+
+static const PreferencesWidget spectrum_widgets[] = {
+    WidgetCheck (N_("Compute a finer spectrum from the audio"),
+        WidgetBool (CFG_ID, "fft", analyzer_update)),
+    WidgetCombo (N_("FFT size:"),
+        WidgetInt (CFG_ID, "fft_size", analyzer_update),
+        {{fft_sizes}},
+        WIDGET_CHILD),
+    WidgetCombo (N_("Window:"),
+        WidgetInt (CFG_ID, "fft_window", analyzer_update),
+        {{fft_windows}},
+        WIDGET_CHILD),
+    WidgetSpin (N_("Average over:"),
+        WidgetInt (CFG_ID, "fft_averages", analyzer_update),
+        {1, SpectrumAnalyzer::MAX_AVERAGES, 1, N_("transforms")},
+        WIDGET_CHILD)
+};
+
+static const PluginPreferences spectrum_prefs = {{spectrum_widgets}};
+
 class SpectrumWidget : public QWidget
 {
 public:
     SpectrumWidget (QWidget * parent = nullptr);
     ~SpectrumWidget ();
 
+    void schedule_frame () { m_frame.schedule (); }
+
 protected:
     void resizeEvent (QResizeEvent *) override;
     void paintEvent (QPaintEvent *) override;
@@ -52,6 +108,8 @@ protected:
 private:
     void paint_background (QPainter &);
     void paint_spectrum (QPainter &);
+
+    VisFrame m_frame {this};
 };
 
 static SpectrumWidget * spect_widget = nullptr;
@@ -89,6 +147,10 @@ void SpectrumWidget::resizeEvent (QResizeEvent * event)
     bands = width () / 10;
     bands = aud::clamp(bands, 12, MAX_BANDS);
     Visualizer::compute_log_xscale (xscale, bands);
+
+    if (analyzer)
+        analyzer->set_bands (bands);
+
     update ();
 }
 
@@ -107,45 +169,110 @@ public:
         N_("Spectrum Analyzer"),
         PACKAGE,
         nullptr, // about
-        nullptr, // prefs
+        & spectrum_prefs,
         PluginQtOnly
     };
 
-    constexpr QtSpectrum () : VisPlugin (info, Visualizer::Freq) {}
+    constexpr QtSpectrum () : VisPlugin (info, Visualizer::Freq | Visualizer::MultiPCM) {}
+
+    bool init () override;
+    void cleanup () override;
 
     void * get_qt_widget () override;
 
     void clear () override;
+    void render_multi_pcm (const float * pcm, int channels) override;
     void render_freq (const float * freq) override;
 };
 
 EXPORT QtSpectrum aud_plugin_instance;
 
-void QtSpectrum::render_freq (const float * freq)
+static void update_bar (int i, float level)
 {
-    if (! bands)
+    /* 40 dB range */
+    int x = 40 + level;
+    x = aud::clamp (x, 0, 40);
+
+    bars[i] -= aud::max (0, VIS_FALLOFF - delay[i]);
+
+    if (delay[i])
+        delay[i]--;
+
+    if (x > bars[i])
+    {
+        bars[i] = x;
+        delay[i] = VIS_DELAY;
+    }
+}
+
+/* called in the main thread when the analyzer has new levels */
+static void analyzer_deliver ()
+{
+    float levels[MAX_BANDS];
+
+    if (! analyzer || ! analyzer->get_levels (levels, bands))
         return;
 
     for (int i = 0; i < bands; i ++)
-    {
-        /* 40 dB range */
-        int x = 40 + compute_freq_band (freq, xscale, i, bands);
-        x = aud::clamp (x, 0, 40);
+        update_bar (i, levels[i]);
+
+    if (spect_widget)
+        spect_widget->schedule_frame ();
+}
 
-        bars[i] -= aud::max (0, VIS_FALLOFF - delay[i]);
+static void analyzer_update ()
+{
+    use_analyzer = aud_get_bool (CFG_ID, "fft");
 
-        if (delay[i])
-            delay[i]--;
+    if (! use_analyzer)
+    {
+        delete analyzer;
+        analyzer = nullptr;
+        return;
+    }
 
-        if (x > bars[i])
-        {
-            bars[i] = x;
-            delay[i] = VIS_DELAY;
-        }
+    if (! analyzer)
+    {
+        analyzer = new SpectrumAnalyzer (analyzer_deliver);
+        analyzer->set_bands (bands);
     }
 
+    analyzer->configure (aud_get_int (CFG_ID, "fft_size"),
+     (FFTWindow) aud_get_int (CFG_ID, "fft_window"),
+     aud_get_int (CFG_ID, "fft_averages"));
+}
+
+bool QtSpectrum::init ()
+{
+    aud_config_set_defaults (CFG_ID, spectrum_defaults);
+    analyzer_update ();
+    return true;
+}
+
+void QtSpectrum::cleanup ()
+{
+    delete analyzer;
+    analyzer = nullptr;
+
+    FFTPlan::clear_cache ();
+}
+
+void QtSpectrum::render_multi_pcm (const float * pcm, int channels)
+{
+    if (analyzer)
+        analyzer->add_pcm (pcm, channels);
+}
+
+void QtSpectrum::render_freq (const float * freq)
+{
+    if (! bands || use_analyzer)
+        return;
+
+    for (int i = 0; i < bands; i ++)
+        update_bar (i, compute_freq_band (freq, xscale, i, bands));
+
     if (spect_widget)
-        spect_widget->update ();
+        spect_widget->schedule_frame ();
 }
 
 void QtSpectrum::clear ()
@@ -153,6 +280,9 @@ void QtSpectrum::clear ()
     memset (bars, 0, sizeof bars);
     memset (delay, 0, sizeof delay);
 
+    if (analyzer)
+        analyzer->clear ();
+
     if (spect_widget)
         spect_widget->update ();
 }
@@ -2,6 +2,7 @@
  * OpenGL Spectrum Analyzer for Audacious
  * Copyright 2013 Christophe Budé, John Lindgren, and Carlo Bramini
  * Copyright 2014, 2020 Ariadne Conill
+ * Copyright 2024 Audacious Plugins Authors
  *
  * Based on the XMMS plugin:
  * Copyright 1998-2000 Peter Alm, Mikael Alm, Olle Hallnas, Thomas Nilsson, and
@@ -23,13 +24,22 @@
  */
 
 #include <math.h>
+#include <stddef.h>
 #include <string.h>
 
 #include <libaudcore/i18n.h>
+#include <libaudcore/index.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/runtime.h>
 
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
 #include <QOpenGLWidget>
-#include <QOpenGLFunctions_2_0>
+
+#include "../ui-common/vis-frame-qt.h"
 
 #define NUM_BANDS 32
 #define DB_RANGE 40
@@ -37,6 +47,9 @@
 #define BAR_SPACING (3.2f / NUM_BANDS)
 #define BAR_WIDTH (0.8f * BAR_SPACING)
 
+#define NUM_BARS (NUM_BANDS * NUM_BANDS)
+#define BAR_VERTICES 24  /* four faces, of two triangles each */
+
 static const char gl_about[] =
  N_("OpenGL Spectrum Analyzer for Audacious\n"
     "Copyright 2013 Christophe Budé, John Lindgren, and Carlo Bramini\n"
@@ -70,27 +83,46 @@ public:
 EXPORT GLSpectrumQt aud_plugin_instance;
 
 static float logscale[NUM_BANDS + 1];
-static float colors[NUM_BANDS][NUM_BANDS][3];
 
 static int s_pos = 0;
 static float s_angle = 25, s_anglespeed = 0.05f;
 static float s_bars[NUM_BANDS][NUM_BANDS];
+static bool s_changed[NUM_BANDS];  /* rows not yet sent to the GPU */
 
-class GLSpectrumWidget : public QOpenGLWidget, protected QOpenGLFunctions_2_0
+/* The bars are drawn in one call from a buffer that never changes, which
+ * holds the corners of every bar along with its place in the history and
+ * in the spectrum.  The shader works out from those where the bar is and
+ * what color it has.  Only the heights are in a buffer of their own, of
+ * which one row is sent each frame.
+ *
+ * This needs nothing beyond OpenGL ES 2.0, so it runs on a desktop or a
+ * core profile as well as on GLES 2 or 3. */
+class GLSpectrumWidget : public QOpenGLWidget, protected QOpenGLFunctions
 {
 public:
     GLSpectrumWidget (QWidget *parent = nullptr);
     ~GLSpectrumWidget ();
 
+    void schedule_frame () { m_frame.schedule (); }
+
 private:
+    struct Vertex {
+        float corner[4];  /* 0 or 1 along x, height and z, then the shade */
+        float place[2];   /* row in the history, band */
+    };
+
     void paintGL () override;
-    void resizeGL (int w, int h) override;
     void initializeGL () override;
 
-    void draw_bars ();
-    void draw_bar (float x, float z, float h, float r, float g, float b);
-    void draw_rectangle (float x1, float y1, float z1, float x2, float y2,
-                         float z2, float r, float g, float b);
+    bool build_program ();
+    void build_bars ();
+    void upload_row (int row);
+    void cleanup ();
+
+    QOpenGLShaderProgram * m_program = nullptr;
+    QOpenGLVertexArrayObject m_vao;
+    QOpenGLBuffer m_vertices, m_heights;
+    VisFrame m_frame {this};
 };
 
 GLSpectrumWidget * s_widget = nullptr;
@@ -100,20 +132,6 @@ bool GLSpectrumQt::init ()
     for (int i = 0; i <= NUM_BANDS; i ++)
         logscale[i] = powf (256, (float) i / NUM_BANDS) - 0.5f;
 
-    for (int y = 0; y < NUM_BANDS; y ++)
-    {
-        float yf = (float) y / (NUM_BANDS - 1);
-
-        for (int x = 0; x < NUM_BANDS; x ++)
-        {
-            float xf = (float) x / (NUM_BANDS - 1);
-
-            colors[x][y][0] = (1 - xf) * (1 - yf);
-            colors[x][y][1] = xf;
-            colors[x][y][2] = yf;
-        }
-    }
-
     return true;
 }
 
@@ -158,6 +176,7 @@ static void make_log_graph (const float * freq, float * graph)
 void GLSpectrumQt::render_freq (const float * freq)
 {
     make_log_graph (freq, s_bars[s_pos]);
+    s_changed[s_pos] = true;
     s_pos = (s_pos + 1) % NUM_BANDS;
 
     s_angle += s_anglespeed;
@@ -165,83 +184,154 @@ void GLSpectrumQt::render_freq (const float * freq)
         s_anglespeed = -s_anglespeed;
 
     if (s_widget)
-        s_widget->update ();
+        s_widget->schedule_frame ();
 }
 
 void GLSpectrumQt::clear ()
 {
     memset (s_bars, 0, sizeof s_bars);
 
+    for (bool & changed : s_changed)
+        changed = true;
+
     if (s_widget)
         s_widget->update ();
 }
 
-void GLSpectrumWidget::draw_rectangle (float x1, float y1, float z1, float x2, float y2,
- float z2, float r, float g, float b)
+static const char vertex_shader[] =
+ "attribute vec4 corner;\n"
+ "attribute vec2 place;\n"
+ "attribute float height;\n"
+ "uniform mat4 matrix;\n"
+ "uniform float pos;\n"
+ "varying lowp vec3 color;\n"
+ "\n"
+ "void main ()\n"
+ "{\n"
+ "    /* the oldest row is at the back */\n"
+ "    float i = mod (place.x - pos + BANDS, BANDS);\n"
+ "    float j = place.y;\n"
+ "    float h = corner.y * height;\n"
+ "\n"
+ "    float x = 1.6 - BAR_SPACING * j + corner.x * BAR_WIDTH;\n"
+ "    float z = -1.6 + (BANDS - i) * BAR_SPACING + corner.z * BAR_WIDTH;\n"
+ "    gl_Position = matrix * vec4 (x, h, z, 1.0);\n"
+ "\n"
+ "    float xf = i / (BANDS - 1.0);\n"
+ "    float yf = j / (BANDS - 1.0);\n"
+ "    color = vec3 ((1.0 - xf) * (1.0 - yf), xf, yf) * (0.2 + 0.8 * height) * corner.w;\n"
+ "}\n";
+
+static const char fragment_shader[] =
+ "varying lowp vec3 color;\n"
+ "\n"
+ "void main ()\n"
+ "{\n"
+ "    gl_FragColor = vec4 (color, 1.0);\n"
+ "}\n";
+
+/* the same source serves GLSL ES 1.00, desktop GLSL 1.10, and with a few
+ * renames, the GLSL 1.50 that a core profile asks for */
+static QByteArray shader_source (QOpenGLContext * context, bool fragment)
 {
-    glColor4f (r, g, b, 1.0f);
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x1, y2, z1);
-    glVertex3f (x2, y2, z1);
-    glVertex3f (x2, y2, z2);
-    glVertex3f (x1, y2, z2);
-    glEnd ();
-
-    glColor4f (0.65f * r, 0.65f * g, 0.65f * b, 1.0f);
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x1, y1, z1);
-    glVertex3f (x1, y2, z1);
-    glVertex3f (x1, y2, z2);
-    glVertex3f (x1, y1, z2);
-    glEnd ();
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x2, y2, z1);
-    glVertex3f (x2, y1, z1);
-    glVertex3f (x2, y1, z2);
-    glVertex3f (x2, y2, z2);
-    glEnd ();
-
-    glColor4f (0.8f * r, 0.8f * g, 0.8f * b, 1.0f);
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x1, y1, z1);
-    glVertex3f (x2, y1, z1);
-    glVertex3f (x2, y2, z1);
-    glVertex3f (x1, y2, z1);
-    glEnd ();
+    QByteArray source;
+
+    if (! context->isOpenGLES () && context->format ().profile () == QSurfaceFormat::CoreProfile)
+    {
+        source = "#version 150\n";
+        if (fragment)
+            source += "#define varying in\nout vec4 frag_color;\n#define gl_FragColor frag_color\n";
+        else
+            source += "#define attribute in\n#define varying out\n";
+    }
+    else if (fragment)
+        source = "#ifdef GL_ES\nprecision mediump float;\n#endif\n";
+
+    source += "#define BANDS " + QByteArray::number (NUM_BANDS) + ".0\n";
+    source += "#define BAR_SPACING " + QByteArray::number (BAR_SPACING) + "\n";
+    source += "#define BAR_WIDTH " + QByteArray::number (BAR_WIDTH) + "\n";
+
+    return source + (fragment ? fragment_shader : vertex_shader);
 }
 
-void GLSpectrumWidget::draw_bar (float x, float z, float h, float r, float g, float b)
+bool GLSpectrumWidget::build_program ()
 {
-    draw_rectangle (x, 0, z, x + BAR_WIDTH, h, z + BAR_WIDTH,
-     r * (0.2f + 0.8f * h), g * (0.2f + 0.8f * h), b * (0.2f + 0.8f * h));
+    m_program = new QOpenGLShaderProgram;
+
+    if (! m_program->addShaderFromSourceCode (QOpenGLShader::Vertex,
+     shader_source (context (), false)) ||
+     ! m_program->addShaderFromSourceCode (QOpenGLShader::Fragment,
+     shader_source (context (), true)) ||
+     ! m_program->link ())
+    {
+        AUDERR ("Cannot build shaders: %s\n", m_program->log ().toUtf8 ().constData ());
+        delete m_program;
+        m_program = nullptr;
+        return false;
+    }
+
+    return true;
 }
 
-void GLSpectrumWidget::draw_bars ()
+void GLSpectrumWidget::build_bars ()
 {
-    glPushMatrix ();
-    glTranslatef (0.0f, -0.5f, -5.0f);
-    glRotatef (38.0f, 1.0f, 0.0f, 0.0f);
-    glRotatef (s_angle + 180.0f, 0.0f, 1.0f, 0.0f);
-    glPolygonMode (GL_FRONT_AND_BACK, GL_FILL);
+    /* x, height and z of each face's corners, as drawn before the
+     * days of shaders, then the shade of the face */
+    static const float faces[4][4][3] = {
+        {{0, 1, 0}, {1, 1, 0}, {1, 1, 1}, {0, 1, 1}},  /* top */
+        {{0, 0, 0}, {0, 1, 0}, {0, 1, 1}, {0, 0, 1}},  /* sides */
+        {{1, 1, 0}, {1, 0, 0}, {1, 0, 1}, {1, 1, 1}},
+        {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}}   /* front */
+    };
 
-    for (int i = 0; i < NUM_BANDS; i ++)
-    {
-        float z = -1.6f + (NUM_BANDS - i) * BAR_SPACING;
+    static const float shades[4] = {1, 0.65f, 0.65f, 0.8f};
+    static const int triangles[6] = {0, 1, 2, 0, 2, 3};
 
-        for (int j = 0; j < NUM_BANDS; j ++)
+    Index<Vertex> vertices;
+    vertices.insert (0, NUM_BARS * BAR_VERTICES);
+    Vertex * vertex = vertices.begin ();
+
+    for (int row = 0; row < NUM_BANDS; row ++)
+    {
+        for (int band = 0; band < NUM_BANDS; band ++)
         {
-            draw_bar (1.6f - BAR_SPACING * j, z,
-             s_bars[(s_pos + i) % NUM_BANDS][j] * 1.6,
-             colors[i][j][0], colors[i][j][1], colors[i][j][2]);
+            for (int face = 0; face < 4; face ++)
+            {
+                for (int corner : triangles)
+                {
+                    const float * c = faces[face][corner];
+                    * vertex ++ = {{c[0], c[1], c[2], shades[face]}, {(float) row, (float) band}};
+                }
+            }
         }
     }
 
-    glPolygonMode (GL_FRONT_AND_BACK, GL_FILL);
-    glPopMatrix ();
+    m_vertices.create ();
+    m_vertices.bind ();
+    m_vertices.allocate (vertices.begin (), vertices.len () * sizeof (Vertex));
+
+    m_heights.setUsagePattern (QOpenGLBuffer::DynamicDraw);
+    m_heights.create ();
+    m_heights.bind ();
+    m_heights.allocate (NUM_BARS * BAR_VERTICES * sizeof (float));
+
+    for (bool & changed : s_changed)
+        changed = true;
+}
+
+/* with m_heights bound */
+void GLSpectrumWidget::upload_row (int row)
+{
+    float heights[NUM_BANDS * BAR_VERTICES];
+
+    for (int band = 0; band < NUM_BANDS; band ++)
+    {
+        for (int i = 0; i < BAR_VERTICES; i ++)
+            heights[band * BAR_VERTICES + i] = s_bars[row][band] * 1.6f;
+    }
+
+    m_heights.write (row * sizeof heights, heights, sizeof heights);
+    s_changed[row] = false;
 }
 
 GLSpectrumWidget::GLSpectrumWidget (QWidget * parent) : QOpenGLWidget (parent)
@@ -254,45 +344,86 @@ GLSpectrumWidget::GLSpectrumWidget (QWidget * parent) : QOpenGLWidget (parent)
 
 GLSpectrumWidget::~GLSpectrumWidget ()
 {
+    cleanup ();
     s_widget = nullptr;
 }
 
+void GLSpectrumWidget::cleanup ()
+{
+    if (! m_program)
+        return;
+
+    makeCurrent ();
+
+    m_vao.destroy ();
+    m_vertices.destroy ();
+    m_heights.destroy ();
+
+    delete m_program;
+    m_program = nullptr;
+
+    doneCurrent ();
+}
+
 void GLSpectrumWidget::paintGL ()
 {
-    glDisable (GL_BLEND);
-    glMatrixMode (GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glFrustum (-1.1f, 1, -1.5f, 1, 2, 10);
-    glMatrixMode (GL_MODELVIEW);
-    glPushMatrix ();
-    glLoadIdentity ();
+    glClearColor (0, 0, 0, 1);
+    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (! m_program)
+        return;
+
+    QMatrix4x4 matrix;
+    matrix.frustum (-1.1f, 1, -1.5f, 1, 2, 10);
+    matrix.translate (0.0f, -0.5f, -5.0f);
+    matrix.rotate (38.0f, 1.0f, 0.0f, 0.0f);
+    matrix.rotate (s_angle + 180.0f, 0.0f, 1.0f, 0.0f);
+
     glEnable (GL_DEPTH_TEST);
     glDepthFunc (GL_LESS);
-    glPolygonMode (GL_FRONT, GL_FILL);
-    glEnable (GL_BLEND);
-    glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glClearColor (0, 0, 0, 1);
-    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_program->bind ();
+    m_program->setUniformValue ("matrix", matrix);
+    m_program->setUniformValue ("pos", (float) s_pos);
 
-    draw_bars ();
+    /* a no-op where vertex arrays are not supported */
+    QOpenGLVertexArrayObject::Binder binder (& m_vao);
 
-    glPopMatrix ();
-    glMatrixMode (GL_PROJECTION);
-    glPopMatrix ();
-    glDisable (GL_DEPTH_TEST);
-    glDisable (GL_BLEND);
-    glDepthMask (GL_TRUE);
-}
+    m_vertices.bind ();
+    m_program->enableAttributeArray ("corner");
+    m_program->enableAttributeArray ("place");
+    m_program->setAttributeBuffer ("corner", GL_FLOAT, offsetof (Vertex, corner), 4, sizeof (Vertex));
+    m_program->setAttributeBuffer ("place", GL_FLOAT, offsetof (Vertex, place), 2, sizeof (Vertex));
 
-void GLSpectrumWidget::resizeGL (int w, int h)
-{
+    m_heights.bind ();
+    m_program->enableAttributeArray ("height");
+    m_program->setAttributeBuffer ("height", GL_FLOAT, 0, 1);
+
+    for (int row = 0; row < NUM_BANDS; row ++)
+    {
+        if (s_changed[row])
+            upload_row (row);
+    }
+
+    glDrawArrays (GL_TRIANGLES, 0, NUM_BARS * BAR_VERTICES);
+
+    m_program->release ();
+    glDisable (GL_DEPTH_TEST);
 }
 
 void GLSpectrumWidget::initializeGL ()
 {
     initializeOpenGLFunctions ();
+
+    /* the context changes when the widget moves to another window */
+    connect (context (), & QOpenGLContext::aboutToBeDestroyed, this,
+     & GLSpectrumWidget::cleanup);
+
+    if (! build_program ())
+        return;
+
+    m_vao.create ();
+    build_bars ();
 }
 
 void * GLSpectrumQt::get_qt_widget ()
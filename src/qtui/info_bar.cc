@@ -23,6 +23,7 @@
 #include <libaudcore/interface.h>
 #include <libaudcore/runtime.h>
 #include <libaudqt/libaudqt.h>
+#include "../ui-common/art-cache-qt.h"
 
 #include <QEvent>
 #include <QPainter>
@@ -276,7 +277,7 @@ void InfoBar::update_title()
 
 void InfoBar::update_album_art()
 {
-    sd[Cur].art = audqt::art_request_current(ps.IconSize, ps.IconSize);
+    sd[Cur].art = ArtCache::pixmap_current(ps.IconSize, ps.IconSize);
 }
 
 void InfoBar::next_song()
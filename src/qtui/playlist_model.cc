@@ -17,6 +17,10 @@
  * the use of this software.
  */
 
+#include <string.h>
+#include <thread>
+#include <vector>
+
 #include <QApplication>
 #include <QDateTime>
 #include <QIcon>
@@ -97,51 +101,17 @@ QVariant PlaylistModel::data(const QModelIndex & index, int role) const
     if (col < 0 || col >= n_cols)
         return QVariant();
 
-    Tuple tuple;
-    int val = -1;
-
     switch (role)
     {
     case Qt::DisplayRole:
-        if (s_fields[col] != Tuple::Invalid)
-        {
-            tuple = m_playlist.entry_tuple(index.row(), Playlist::NoWait);
-
-            if (col == Filename)
-                return filename(tuple);
-
-            switch (tuple.get_value_type(s_fields[col]))
-            {
-            case Tuple::Empty:
-                return QVariant();
-            case Tuple::String:
-                return QString(tuple.get_str(s_fields[col]));
-            case Tuple::Int:
-                val = tuple.get_int(s_fields[col]);
-                break;
-            case Tuple::DateTime:
-                int64_t t = tuple.get_int64(s_fields[col]);
-                if (t > 0)
-                {
-                    QDateTime dt = QDateTime::fromSecsSinceEpoch(t).toLocalTime();
-                    return QLocale().toString(dt, QLocale::ShortFormat);
-                }
-                return QString();
-            }
-        }
-
         switch (col)
         {
         case EntryNumber:
             return QVariant(index.row() + 1);
         case QueuePos:
             return queuePos(index.row());
-        case Length:
-            return QString(str_format_time(val));
-        case Bitrate:
-            return QString(str_printf(_("%d kbit/s"), val));
         default:
-            return QVariant(val);
+            return cachedText(index.row(), col);
         }
 
     case Qt::FontRole:
@@ -179,6 +149,69 @@ QVariant PlaylistModel::data(const QModelIndex & index, int role) const
     return QVariant();
 }
 
+QVariant PlaylistModel::cachedText(int row, int col) const
+{
+    auto it = m_cache.find(row);
+    if (it != m_cache.end() && it->filled[col])
+        return it->cells[col];
+
+    Tuple tuple = m_playlist.entry_tuple(row, Playlist::NoWait);
+    QVariant text = displayText(tuple, col);
+
+    if (tuple.state() == Tuple::Valid)
+    {
+        if (it == m_cache.end())
+        {
+            if (m_cache.size() >= max_cached_rows)
+                m_cache.clear();
+
+            it = m_cache.insert(row, CachedRow());
+        }
+
+        it->cells[col] = text;
+        it->filled[col] = true;
+    }
+
+    return text;
+}
+
+QVariant PlaylistModel::displayText(const Tuple & tuple, int col) const
+{
+    int val = -1;
+
+    if (col == Filename)
+        return filename(tuple);
+
+    switch (tuple.get_value_type(s_fields[col]))
+    {
+    case Tuple::Empty:
+        return QVariant();
+    case Tuple::String:
+        return QString(tuple.get_str(s_fields[col]));
+    case Tuple::Int:
+        val = tuple.get_int(s_fields[col]);
+        break;
+    case Tuple::DateTime:
+        int64_t t = tuple.get_int64(s_fields[col]);
+        if (t > 0)
+        {
+            QDateTime dt = QDateTime::fromSecsSinceEpoch(t).toLocalTime();
+            return QLocale().toString(dt, QLocale::ShortFormat);
+        }
+        return QString();
+    }
+
+    switch (col)
+    {
+    case Length:
+        return QString(str_format_time(val));
+    case Bitrate:
+        return QString(str_printf(_("%d kbit/s"), val));
+    default:
+        return QVariant(val);
+    }
+}
+
 QVariant PlaylistModel::headerData(int section, Qt::Orientation orientation,
                                    int role) const
 {
@@ -275,6 +308,7 @@ void PlaylistModel::entriesAdded(int row, int count)
     int last = row + count - 1;
     beginInsertRows(QModelIndex(), row, last);
     m_rows += count;
+    m_cache.clear();
     endInsertRows();
 }
 
@@ -286,6 +320,7 @@ void PlaylistModel::entriesRemoved(int row, int count)
     int last = row + count - 1;
     beginRemoveRows(QModelIndex(), row, last);
     m_rows -= count;
+    m_cache.clear();
     endRemoveRows();
 }
 
@@ -295,6 +330,15 @@ void PlaylistModel::entriesChanged(int row, int count)
         return;
 
     int bottom = row + count - 1;
+
+    for (auto it = m_cache.begin(); it != m_cache.end();)
+    {
+        if (it.key() >= row && it.key() <= bottom)
+            it = m_cache.erase(it);
+        else
+            ++it;
+    }
+
     auto topLeft = createIndex(row, 0);
     auto bottomRight = createIndex(bottom, columnCount() - 1);
     emit dataChanged(topLeft, bottomRight);
@@ -324,13 +368,56 @@ QString PlaylistModel::filename(const Tuple & tuple) const
 
 /* ---------------------------------- */
 
+/* each new term contains one of the old ones, so that an entry that did not
+ * match before does not match now */
+static bool narrows(const Index<String> & terms, const Index<String> & old_terms)
+{
+    if (!old_terms.len())
+        return false;
+
+    for (auto & old_term : old_terms)
+    {
+        bool found = false;
+
+        for (auto & term : terms)
+        {
+            if (strstr(term, old_term))
+            {
+                found = true;
+                break;
+            }
+        }
+
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
 void PlaylistProxyModel::setFilter(const char * filter)
 {
 #if QT_VERSION >= QT_VERSION_CHECK(6, 10, 0)
     beginFilterChange();
 #endif
 
-    m_searchTerms = str_list_to_index(filter, " ");
+    Index<String> terms = str_list_to_index(str_tolower_utf8(filter), " ");
+    bool narrowing = narrows(terms, m_searchTerms);
+
+    m_searchTerms = std::move(terms);
+
+    int entries = m_playlist.n_entries();
+    if (m_folded.len() != entries)
+    {
+        m_folded.clear();
+        m_folded.insert(0, entries);
+        narrowing = false;
+    }
+
+    if (m_searchTerms.len())
+        evaluate(narrowing);
+    else
+        m_match.clear();
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 10, 0)
     endFilterChange(QSortFilterProxyModel::Direction::Rows);
@@ -339,35 +426,127 @@ void PlaylistProxyModel::setFilter(const char * filter)
 #endif
 }
 
-bool PlaylistProxyModel::filterAcceptsRow(int source_row,
-                                          const QModelIndex &) const
+void PlaylistProxyModel::entriesAdded(int row, int count)
 {
-    if (!m_searchTerms.len())
-        return true;
+    if (count < 1)
+        return;
 
-    Tuple tuple = m_playlist.entry_tuple(source_row);
+    m_folded.insert(row, count);
 
-    String strings[] = {tuple.get_str(Tuple::Title),
-                        tuple.get_str(Tuple::Artist),
-                        tuple.get_str(Tuple::Album),
-                        tuple.get_str(Tuple::Basename)};
+    if (m_match.len())
+    {
+        m_match.insert(row, count);
+        for (int i = row; i < row + count; i++)
+            m_match[i] = Unknown;
+    }
+}
 
-    for (auto & term : m_searchTerms)
+void PlaylistProxyModel::entriesRemoved(int row, int count)
+{
+    if (count < 1)
+        return;
+
+    m_folded.remove(row, count);
+
+    if (m_match.len())
+        m_match.remove(row, count);
+}
+
+void PlaylistProxyModel::entriesChanged(int row, int count)
+{
+    for (int i = row; i < row + count; i++)
     {
-        bool found = false;
+        m_folded[i] = String();
 
-        for (auto & s : strings)
-        {
-            if (s && strstr_nocase_utf8(s, term))
-            {
-                found = true;
-                break;
-            }
-        }
+        if (m_match.len())
+            m_match[i] = Unknown;
+    }
+}
 
-        if (!found)
+bool PlaylistProxyModel::matches(int row) const
+{
+    String & folded = m_folded[row];
+
+    if (!folded)
+    {
+        Tuple tuple = m_playlist.entry_tuple(row);
+
+        String strings[] = {tuple.get_str(Tuple::Title),
+                            tuple.get_str(Tuple::Artist),
+                            tuple.get_str(Tuple::Album),
+                            tuple.get_str(Tuple::Basename)};
+
+        /* the line breaks keep a term from matching across two fields */
+        StringBuf text = str_printf("%s\n%s\n%s\n%s",
+                                    strings[0] ? (const char *)strings[0] : "",
+                                    strings[1] ? (const char *)strings[1] : "",
+                                    strings[2] ? (const char *)strings[2] : "",
+                                    strings[3] ? (const char *)strings[3] : "");
+
+        folded = String(str_tolower_utf8(text));
+    }
+
+    for (auto & term : m_searchTerms)
+    {
+        if (!strstr(folded, term))
             return false;
     }
 
     return true;
 }
+
+/* Decides which entries match, on as many threads as there are cores.  An
+ * entry whose tuple has not been read yet holds up only the thread it is
+ * on.  When the search only narrows, the entries that did not match before
+ * are not looked at again. */
+void PlaylistProxyModel::evaluate(bool narrowing)
+{
+    int entries = m_folded.len();
+
+    if (!narrowing || m_match.len() != entries)
+    {
+        m_match.clear();
+        m_match.insert(0, entries);
+        for (auto & match : m_match)
+            match = Unknown;
+    }
+
+    auto work = [this](int first, int last) {
+        for (int row = first; row < last; row++)
+        {
+            if (m_match[row] != No)
+                m_match[row] = matches(row) ? Yes : No;
+        }
+    };
+
+    int n_threads = aud::clamp((int)std::thread::hardware_concurrency(), 1,
+                               entries / 4096 + 1);
+    std::vector<std::thread> threads(n_threads);
+
+    for (int i = 1; i < n_threads; i++)
+        threads[i] = std::thread(work, (int64_t)entries * i / n_threads,
+                                 (int64_t)entries * (i + 1) / n_threads);
+
+    work(0, entries / n_threads);
+
+    for (int i = 1; i < n_threads; i++)
+        threads[i].join();
+}
+
+bool PlaylistProxyModel::filterAcceptsRow(int source_row,
+                                          const QModelIndex &) const
+{
+    if (!m_searchTerms.len())
+        return true;
+
+    if (source_row >= m_folded.len())
+        return true;
+
+    if (m_match.len() != m_folded.len())
+        return matches(source_row);
+
+    if (m_match[source_row] == Unknown)
+        m_match[source_row] = matches(source_row) ? Yes : No;
+
+    return m_match[source_row] == Yes;
+}
@@ -21,6 +21,7 @@
 #define PLAYLIST_MODEL_H
 
 #include <QAbstractListModel>
+#include <QHash>
 #include <QSortFilterProxyModel>
 
 #include <libaudcore/playlist.h>
@@ -80,12 +81,25 @@ public:
     void setPlayingCol(int playing_col);
 
 private:
+    /* the display text of the rows that have been shown, as it is formatted
+     * from the tuple only once; a cell is kept once the tuple is valid */
+    struct CachedRow
+    {
+        QVariant cells[n_cols];
+        bool filled[n_cols] = {};
+    };
+
+    static constexpr int max_cached_rows = 1024;
+
     Playlist m_playlist;
     int m_rows;
     QFont m_bold;
     int m_playing_col = -1;
+    mutable QHash<int, CachedRow> m_cache;
 
     QVariant alignment(int col) const;
+    QVariant cachedText(int row, int col) const;
+    QVariant displayText(const Tuple & tuple, int col) const;
     QString queuePos(int row) const;
     QString filename(const Tuple & tuple) const;
 };
@@ -96,15 +110,37 @@ public:
     PlaylistProxyModel(QObject * parent, Playlist playlist)
         : QSortFilterProxyModel(parent), m_playlist(playlist)
     {
+        m_folded.insert(0, playlist.n_entries());
     }
 
     void setFilter(const char * filter);
 
+    /* to be called before the same calls on the source model, so that the
+     * folded text of the entries is kept in step with the playlist */
+    void entriesAdded(int row, int count);
+    void entriesRemoved(int row, int count);
+    void entriesChanged(int row, int count);
+
 private:
+    enum Match : signed char
+    {
+        Unknown = -1,
+        No,
+        Yes
+    };
+
     bool filterAcceptsRow(int source_row, const QModelIndex &) const override;
 
+    bool matches(int row) const;
+    void evaluate(bool narrowing);
+
     Playlist m_playlist;
-    Index<String> m_searchTerms;
+    Index<String> m_searchTerms; /* folded */
+
+    /* per entry, the title, artist, album and file name, folded, and
+     * whether they match the search terms; both are filled in as needed */
+    mutable Index<String> m_folded;
+    mutable Index<Match> m_match;
 };
 
 #endif
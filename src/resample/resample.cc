@@ -17,6 +17,7 @@
  * the use of this software.
  */
 
+#include <math.h>
 #include <samplerate.h>
 
 #include <libaudcore/i18n.h>
@@ -25,6 +26,8 @@
 #include <libaudcore/preferences.h>
 #include <libaudcore/audstrings.h>
 
+#include "../trace-common/trace.h"
+
 #define MIN_RATE 8000
 #define MAX_RATE 192000
 #define RATE_STEP 50
@@ -82,100 +85,436 @@ const char * const Resampler::defaults[] = {
  "192000", "48000",
  nullptr};
 
-static SRC_STATE * state;
-static int stored_channels;
-static double ratio;
-static Index<float> buffer;
+/* Method numbers for the built-in polyphase filter, well clear of the ones
+ * libsamplerate knows.  It handles ratios with a small numerator, such as
+ * 44.1 -> 48 kHz (160/147), and leaves everything else to fast sinc. */
+#define METHOD_POLYPHASE_FAST 100
+#define METHOD_POLYPHASE_MEDIUM 101
+#define METHOD_POLYPHASE_BEST 102
+
+#define MAX_PHASES 320
+#define BLOCK 8         /* filter lengths are a multiple of this */
+#define BANK_CACHE 4
+
+struct PolyphaseQuality {
+    int taps;           /* per phase, when not downsampling */
+    double cutoff;      /* of the lower of the two rates */
+    double beta;        /* of the Kaiser window */
+};
 
-bool Resampler::init ()
+static const PolyphaseQuality qualities[] = {
+    {16, 0.40, 6.0},
+    {32, 0.45, 8.0},
+    {64, 0.47, 10.0}
+};
+
+static int gcd (int a, int b)
 {
-    aud_config_set_defaults ("resample", defaults);
-    return true;
+    while (b)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
 }
 
-void Resampler::cleanup ()
+/* zeroth-order modified Bessel function, for the Kaiser window */
+static double bessel_i0 (double x)
 {
-    if (state)
+    double sum = 1, term = 1;
+
+    for (int k = 1; k < 50 && term > sum * 1e-12; k ++)
     {
-        src_delete (state);
-        state = nullptr;
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
     }
 
-    buffer.clear ();
+    return sum;
 }
 
-void Resampler::start (int & channels, int & rate)
+/* The filters for one ratio and quality.  The bank has a contiguous row of
+ * coefficients for each of the <up> phases, stored oldest input first. */
+struct CoefBank {
+    int up = 0, down = 0, quality = -1;
+    int taps = 0;
+    Index<float> coefs;
+
+    void build (int up, int down, int quality);
+};
+
+void CoefBank::build (int up, int down, int quality)
 {
-    if (state)
+    const PolyphaseQuality & q = qualities[quality];
+
+    this->up = up;
+    this->down = down;
+    this->quality = quality;
+
+    /* a longer filter when downsampling keeps the same transition width in
+     * input samples */
+    taps = q.taps * aud::max (1, (down + up - 1) / up);
+
+    /* windowed sinc at the upsampled rate, cut below the lower Nyquist */
+    double cutoff = q.cutoff * aud::min (1.0, (double) up / down) / up;
+    int length = up * taps;
+    double center = (length - 1) / 2.0;
+    double norm = bessel_i0 (q.beta);
+
+    coefs.resize (length);
+
+    for (int p = 0; p < up; p ++)
     {
-        src_delete (state);
-        state = nullptr;
+        float * row = & coefs[p * taps];
+        double sum = 0;
+
+        /* row[taps - 1 - k] weighs the input frame k frames back */
+        for (int k = 0; k < taps; k ++)
+        {
+            double t = p + k * up - center;
+            double x = 2 * t / (length - 1);
+            double sinc = t ? sin (2 * M_PI * cutoff * t) / (M_PI * t) : 2 * cutoff;
+            double window = bessel_i0 (q.beta * sqrt (aud::max (0.0, 1 - x * x))) / norm;
+
+            row[taps - 1 - k] = sinc * window;
+            sum += sinc * window;
+        }
+
+        /* unity gain at DC for every phase */
+        for (int k = 0; k < taps; k ++)
+            row[k] /= sum;
     }
+}
 
-    int new_rate = 0;
+/* Building a bank for a large ratio takes a moment, and playback usually
+ * switches between the same couple of rates, so the last few are kept. */
+static CoefBank banks[BANK_CACHE];
+static int next_bank;
 
-    if (aud_get_bool ("resample", "use-mappings"))
-        new_rate = aud_get_int ("resample", int_to_str (rate));
+static const CoefBank * get_bank (int up, int down, int quality)
+{
+    for (const CoefBank & bank : banks)
+    {
+        if (bank.up == up && bank.down == down && bank.quality == quality)
+            return & bank;
+    }
 
-    if (! new_rate)
-        new_rate = aud_get_int ("resample", "default-rate");
+    CoefBank & bank = banks[next_bank];
+    next_bank = (next_bank + 1) % BANK_CACHE;
 
-    new_rate = aud::clamp (new_rate, MIN_RATE, MAX_RATE);
+    bank.build (up, down, quality);
+    return & bank;
+}
 
-    if (new_rate == rate)
-        return;
+/* the inner loop: <len> is a multiple of BLOCK, so the compiler can keep
+ * BLOCK partial sums in a vector register */
+static float dot (const float * __restrict a, const float * __restrict b, int len)
+{
+    float sum[BLOCK] = {};
 
-    int method = aud_get_int ("resample", "method");
-    int error;
+    for (int i = 0; i < len; i += BLOCK)
+    {
+        for (int j = 0; j < BLOCK; j ++)
+            sum[j] += a[i + j] * b[i + j];
+    }
 
-    if ((state = src_new (method, channels, & error)) == nullptr)
+    float total = 0;
+    for (int j = 0; j < BLOCK; j ++)
+        total += sum[j];
+
+    return total;
+}
+
+/* A fixed-ratio polyphase FIR: upsampling by L and downsampling by M in one
+ * step, computing only the output samples actually needed.  The input is
+ * kept one channel per buffer, so every output sample is a plain dot
+ * product of a coefficient row with the latest input samples. */
+class Polyphase
+{
+public:
+    bool init (int channels, int in_rate, int out_rate, int quality)
     {
-        RESAMPLE_ERROR (error);
-        return;
+        int div = gcd (in_rate, out_rate);
+        int up = out_rate / div;
+        int down = in_rate / div;
+
+        if (up > MAX_PHASES)
+            return false;
+
+        m_bank = get_bank (up, down, quality);
+        m_channels = channels;
+
+        reset ();
+        return true;
+    }
+
+    void reset ()
+    {
+        for (int c = 0; c < m_channels; c ++)
+        {
+            m_history[c].resize (m_bank->taps - 1);
+            m_history[c].erase (0, -1);
+        }
+
+        m_phase = 0;
+        m_next = m_bank->taps - 1;
+    }
+
+    int max_output (int frames) const
+        { return (int) ((int64_t) (frames + 1) * m_bank->up / m_bank->down) + 1; }
+
+    /* Returns the number of frames written to <out>, which must have room for
+     * max_output (frames) of them. */
+    int process (const float * data, int frames, float * out)
+    {
+        int taps = m_bank->taps;
+        int up = m_bank->up, down = m_bank->down;
+        int total = m_history[0].len () + frames;
+
+        for (int c = 0; c < m_channels; c ++)
+        {
+            Index<float> & history = m_history[c];
+            int start = history.len ();
+
+            history.insert (-1, frames);
+            for (int i = 0; i < frames; i ++)
+                history[start + i] = data[i * m_channels + c];
+        }
+
+        int written = 0;
+
+        while (m_next < total)
+        {
+            const float * row = & m_bank->coefs[m_phase * taps];
+            int start = m_next - (taps - 1);
+
+            for (int c = 0; c < m_channels; c ++)
+                out[c] = dot (row, & m_history[c][start], taps);
+
+            out += m_channels;
+            written ++;
+
+            m_phase += down;
+            m_next += m_phase / up;
+            m_phase %= up;
+        }
+
+        /* keep the samples still needed by the next output sample */
+        int drop = aud::min (total, m_next) - (taps - 1);
+        if (drop > 0)
+        {
+            for (int c = 0; c < m_channels; c ++)
+                m_history[c].remove (0, drop);
+
+            m_next -= drop;
+        }
+
+        return written;
+    }
+
+    /* the filter delays the signal by about half its length */
+    int tail_frames () const
+        { return m_bank->taps / 2; }
+
+private:
+    const CoefBank * m_bank = nullptr;
+    int m_channels = 0;
+    Index<float> m_history[AUD_MAX_CHANNELS];
+    int m_phase = 0;  /* of the next output sample */
+    int m_next = 0;   /* input sample just before it */
+};
+
+/* The state of one converted stream.  The effect chain has a single
+ * resampler, but nothing here is shared between two of them. */
+class ResampleStream
+{
+public:
+    ~ResampleStream ()
+        { close (); }
+
+    bool open (int channels, int in_rate, int out_rate, int method);
+    void close ();
+    void reset ();
+
+    bool is_open () const
+        { return m_state || m_fast; }
+
+    Index<float> & process (Index<float> & data, bool finish);
+
+private:
+    void reserve (int frames);
+
+    SRC_STATE * m_state = nullptr;
+    bool m_fast = false;
+    Polyphase m_polyphase;
+    int m_channels = 0;
+    double m_ratio = 1;
+    Index<float> m_buffer;
+};
+
+bool ResampleStream::open (int channels, int in_rate, int out_rate, int method)
+{
+    close ();
+
+    m_channels = channels;
+    m_ratio = (double) out_rate / in_rate;
+
+    if (method >= METHOD_POLYPHASE_FAST && method <= METHOD_POLYPHASE_BEST)
+    {
+        m_fast = m_polyphase.init (channels, in_rate, out_rate, method - METHOD_POLYPHASE_FAST);
+        if (! m_fast)
+            method = SRC_SINC_FASTEST;
     }
 
-    stored_channels = channels;
-    ratio = (double) new_rate / rate;
-    rate = new_rate;
+    if (! m_fast)
+    {
+        int error;
+        if ((m_state = src_new (method, channels, & error)) == nullptr)
+        {
+            RESAMPLE_ERROR (error);
+            return false;
+        }
+    }
+
+    /* Plan for a quarter second per call; the buffer only grows from there,
+     * since resizing an Index down keeps its memory. */
+    reserve (in_rate / 4);
+    return true;
 }
 
-Index<float> & Resampler::resample (Index<float> & data, bool finish)
+void ResampleStream::close ()
 {
-    if (! state || ! data.len ())
-        return data;
+    if (m_state)
+    {
+        src_delete (m_state);
+        m_state = nullptr;
+    }
+
+    m_fast = false;
+    m_buffer.clear ();
+}
+
+void ResampleStream::reset ()
+{
+    int error;
+    if (m_state && (error = src_reset (m_state)))
+        RESAMPLE_ERROR (error);
+
+    if (m_fast)
+        m_polyphase.reset ();
+}
+
+void ResampleStream::reserve (int frames)
+{
+    int needed = m_fast ? m_polyphase.max_output (frames) : (int) (frames * m_ratio) + 256;
+    if (m_buffer.len () < needed * m_channels)
+        m_buffer.resize (needed * m_channels);
+}
+
+Index<float> & ResampleStream::process (Index<float> & data, bool finish)
+{
+    int frames = data.len () / m_channels;
+
+    if (m_fast)
+    {
+        /* push what is left in the filter out with silence */
+        int tail = finish ? m_polyphase.tail_frames () : 0;
+
+        reserve (frames + tail);
+
+        int written = m_polyphase.process (data.begin (), frames, m_buffer.begin ());
+
+        if (tail)
+        {
+            float silence[AUD_MAX_CHANNELS * 64] = {};
+            for (int left = tail; left > 0; left -= 64)
+            {
+                int n = aud::min (left, 64);
+                written += m_polyphase.process (silence, n, & m_buffer[written * m_channels]);
+            }
+        }
+
+        m_buffer.resize (written * m_channels);
+
+        if (finish)
+            reset ();
+
+        return m_buffer;
+    }
 
-    buffer.resize ((int) (data.len () * ratio) + 256);
+    reserve (frames);
 
     SRC_DATA d = SRC_DATA ();
 
     d.data_in = data.begin ();
-    d.input_frames = data.len () / stored_channels;
-    d.data_out = buffer.begin ();
-    d.output_frames = buffer.len () / stored_channels;
-    d.src_ratio = ratio;
+    d.input_frames = frames;
+    d.data_out = m_buffer.begin ();
+    d.output_frames = m_buffer.len () / m_channels;
+    d.src_ratio = m_ratio;
     d.end_of_input = finish;
 
     int error;
-    if ((error = src_process (state, & d)))
+    if ((error = src_process (m_state, & d)))
     {
         RESAMPLE_ERROR (error);
         return data;
     }
 
-    buffer.resize (stored_channels * d.output_frames_gen);
+    m_buffer.resize (m_channels * d.output_frames_gen);
 
     if (finish)
-        flush (true);
+        reset ();
 
-    return buffer;
+    return m_buffer;
 }
 
-bool Resampler::flush (bool force)
+static ResampleStream stream;
+
+bool Resampler::init ()
 {
-    int error;
-    if (state && (error = src_reset (state)))
-        RESAMPLE_ERROR (error);
+    aud_config_set_defaults ("resample", defaults);
+    return true;
+}
+
+void Resampler::cleanup ()
+{
+    stream.close ();
+}
+
+void Resampler::start (int & channels, int & rate)
+{
+    stream.close ();
+
+    int new_rate = 0;
+
+    if (aud_get_bool ("resample", "use-mappings"))
+        new_rate = aud_get_int ("resample", int_to_str (rate));
+
+    if (! new_rate)
+        new_rate = aud_get_int ("resample", "default-rate");
+
+    new_rate = aud::clamp (new_rate, MIN_RATE, MAX_RATE);
 
+    if (new_rate == rate)
+        return;
+
+    if (stream.open (channels, rate, new_rate, aud_get_int ("resample", "method")))
+        rate = new_rate;
+}
+
+Index<float> & Resampler::resample (Index<float> & data, bool finish)
+{
+    TRACE_SPAN ("Resample process");
+    if (! stream.is_open () || ! data.len ())
+        return data;
+
+    return stream.process (data, finish);
+}
+
+bool Resampler::flush (bool force)
+{
+    stream.reset ();
     return true;
 }
 
@@ -188,7 +527,10 @@ static const ComboItem method_list[] = {
     ComboItem(N_("Linear interpolation"), SRC_LINEAR),
     ComboItem(N_("Fast sinc interpolation"), SRC_SINC_FASTEST),
     ComboItem(N_("Medium sinc interpolation"), SRC_SINC_MEDIUM_QUALITY),
-    ComboItem(N_("Best sinc interpolation"), SRC_SINC_BEST_QUALITY)
+    ComboItem(N_("Best sinc interpolation"), SRC_SINC_BEST_QUALITY),
+    ComboItem(N_("Fast fixed-ratio filter"), METHOD_POLYPHASE_FAST),
+    ComboItem(N_("Medium fixed-ratio filter"), METHOD_POLYPHASE_MEDIUM),
+    ComboItem(N_("Best fixed-ratio filter"), METHOD_POLYPHASE_BEST)
 };
 
 const PreferencesWidget Resampler::widgets[] = {
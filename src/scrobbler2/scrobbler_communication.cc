@@ -8,12 +8,14 @@
  */
 
 //external includes
+#include <algorithm>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <sys/time.h>
 #include <curl/curl.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 
 //audacious includes
 #include <libaudcore/audstrings.h>
@@ -83,32 +85,21 @@ static char * scrobbler_get_signature (Index<API_Parameter> & params)
  *
  * Returns nullptr if an error occurrs
  */
-static String create_message_to_lastfm (const char * method_name, int n_args, ...)
+static String create_message_from_params (const char * method_name, Index<API_Parameter> & params)
 {
-    Index<API_Parameter> params;
-    params.append (String ("method"), String (method_name));
-
     StringBuf buf = str_concat ({"method=", method_name});
 
-    va_list vl;
-    va_start (vl, n_args);
-
-    for (int i = 0; i < n_args; i ++)
+    for (const API_Parameter & param : params)
     {
-        const char * name = va_arg (vl, const char *);
-        const char * arg = va_arg (vl, const char *);
-
-        params.append (String (name), String (arg));
-
-        char * esc = curl_easy_escape (curlHandle, arg, 0);
+        char * esc = curl_easy_escape (curlHandle, param.argument, 0);
         buf.insert (-1, "&");
-        buf.insert (-1, name);
+        buf.insert (-1, param.paramName);
         buf.insert (-1, "=");
         buf.insert (-1, esc ? esc : "");
         curl_free (esc);
     }
 
-    va_end (vl);
+    params.append (String ("method"), String (method_name));
 
     char * api_sig = scrobbler_get_signature (params);
     buf.insert (-1, "&api_sig=");
@@ -120,6 +111,26 @@ static String create_message_to_lastfm (const char * method_name, int n_args, ..
     return String (buf);
 }
 
+static String create_message_to_lastfm (const char * method_name, int n_args, ...)
+{
+    Index<API_Parameter> params;
+
+    va_list vl;
+    va_start (vl, n_args);
+
+    for (int i = 0; i < n_args; i ++)
+    {
+        const char * name = va_arg (vl, const char *);
+        const char * arg = va_arg (vl, const char *);
+
+        params.append (String (name), String (arg));
+    }
+
+    va_end (vl);
+
+    return create_message_from_params (method_name, params);
+}
+
 static gboolean send_message_to_lastfm (const char * data)
 {
     AUDDBG("This message will be sent to last.fm:\n%s\n%%%%End of message%%%%\n", data);//Enter?\n", data);
@@ -298,77 +309,105 @@ static void set_timestamp_to_current(char **line) {
     g_strfreev(split_line);
 }
 
-static void delete_lines_from_scrobble_log (GSList **lines_to_remove_ptr, GSList **lines_to_retry_ptr, char *queuepath) {
-    GSList *lines_to_remove = *lines_to_remove_ptr;
-    GSList *lines_to_retry = *lines_to_retry_ptr;
+/*
+ * The queue is scrobbler.log, to which tracks are only added.  The lines
+ * that are done with are written down, by where they start in the file, in
+ * scrobbler.done, so that a batch that has been sent is not sent again even
+ * if audacious quits before the queue has been gone through.  Once the
+ * lines done with are at least half of the log, it is written again without
+ * them and scrobbler.done is removed.  Both files are only touched with
+ * log_access_mutex held.
+ */
+
+//the most scrobbles track.scrobble takes at a time
+#define SCROBBLE_BATCH_SIZE 50
+
+typedef struct {
+    int64_t offset; //of the line in scrobbler.log
+    char **line;
+} Queued_Scrobble;
+
+static Index<int64_t> read_done_offsets (const char *donepath) {
+    Index<int64_t> done;
     char *contents = nullptr;
-    char **lines = nullptr;
-    char **finallines = g_new (char *, 1);
-    int n_finallines;
 
-    if (lines_to_remove != nullptr) {
-        lines_to_remove = g_slist_reverse(lines_to_remove);
+    if (g_file_get_contents(donepath, &contents, nullptr, nullptr)) {
+        char *p = contents;
+
+        while (*p) {
+            char *end;
+            int64_t offset = g_ascii_strtoll(p, &end, 10);
+            if (end == p)
+                break;
+
+            done.append(offset);
+            p = (*end == '\n') ? end + 1 : end;
+        }
+
+        g_free(contents);
     }
-    if (lines_to_retry != nullptr) {
-        lines_to_retry = g_slist_reverse(lines_to_retry);
+
+    done.sort([] (const int64_t & a, const int64_t & b)
+        { return (a > b) - (a < b); });
+
+    return done;
+}
+
+static gboolean is_done (const Index<int64_t> &done, int64_t offset) {
+    return std::binary_search(done.begin(), done.end(), offset);
+}
+
+static void append_lines (const char *path, const Index<String> &lines) {
+    FILE *f = g_fopen(path, "a");
+    if (f == nullptr) {
+        AUDERR("Could not write to %s!\n", path);
+        return;
     }
 
-    pthread_mutex_lock(&log_access_mutex);
+    for (const String &line : lines)
+        fprintf(f, "%s\n", (const char *)line);
 
-    gboolean success = g_file_get_contents(queuepath, &contents, nullptr, nullptr);
-    if (!success) {
+    fclose(f);
+}
+
+//writes the log again without the lines that are done with
+static void compact_scrobble_log (const char *queuepath, const char *donepath) {
+    char *contents = nullptr;
+
+    if (!g_file_get_contents(queuepath, &contents, nullptr, nullptr)) {
         AUDDBG("Could not read scrobbler.log contents.\n");
-    } else {
-        lines = g_strsplit(contents, "\n", 0);
+        return;
+    }
 
-        n_finallines = 0;
-        for (int i = 0 ; lines[i] != nullptr; i++) {
-            if (!strlen(lines[i])) continue;
+    Index<int64_t> done = read_done_offsets(donepath);
+    GString *kept = g_string_new(nullptr);
 
-            if (lines_to_remove != nullptr && *((int *) (lines_to_remove->data)) == i) {
-                //this line is to remove
-                lines_to_remove = g_slist_next(lines_to_remove);
-            } else {
-                //keep this line
-                AUDDBG("Going to keep line %i\n", i);
-                if (lines_to_retry != nullptr && *((int *) (lines_to_retry->data)) == i) {
-                  lines_to_retry = g_slist_next(lines_to_retry);
-                  //this line will be retried with a zero timestamp
-                  AUDDBG("Going to zero this line.\n");
-                  AUDDBG("Line before: %s.\n", lines[i]);
-                  set_timestamp_to_current(&(lines[i]));
-                  AUDDBG("Line after: %s.\n", lines[i]);
-                } else {
-                  AUDDBG("not zeroing this line\n");
-                }
-                n_finallines++;
-                finallines = g_renew (char *, finallines, n_finallines);
-                finallines[n_finallines-1] = g_strdup(lines[i]);
-            }
-        }
+    for (char *p = contents; *p; ) {
+        char *eol = strchr(p, '\n');
+        char *next = eol ? eol + 1 : p + strlen(p);
 
-        finallines = g_renew (char *, finallines, n_finallines + 2);
-        finallines[n_finallines] = g_strdup("");
-        finallines[n_finallines+1] = nullptr;
-        g_free(contents);
-        contents = g_strjoinv("\n", finallines);
-        success = g_file_set_contents(queuepath, contents, -1, nullptr);
-        if (!success) {
-            AUDERR("Could not write to scrobbler.log!\n");
-        }
+        if (*p != '\n' && !is_done(done, p - contents))
+            g_string_append_len(kept, p, next - p);
+
+        p = next;
     }
 
-    pthread_mutex_unlock(&log_access_mutex);
+    //scrobbler.done goes before the log is replaced: if audacious dies in
+    //between, the lines done with are sent again rather than the wrong
+    //ones being skipped
+    char *temppath = g_strconcat(queuepath, ".tmp", nullptr);
 
-    g_strfreev(finallines);
-    g_strfreev(lines);
-    g_free(contents);
-}
+    if (!g_file_set_contents(temppath, kept->str, kept->len, nullptr)) {
+        AUDERR("Could not write to scrobbler.log!\n");
+    } else {
+        g_remove(donepath);
+        if (g_rename(temppath, queuepath) < 0)
+            AUDERR("Could not write to scrobbler.log!\n");
+    }
 
-static void save_line_to_remove(GSList **lines_to_remove, int linenumber) {
-    int *rem = g_new (int, 1);
-    *rem = linenumber;
-    (*lines_to_remove) = g_slist_prepend((*lines_to_remove), rem);
+    g_free(temppath);
+    g_string_free(kept, true);
+    g_free(contents);
 }
 
 static gboolean is_valid_scrobble_format(char **line) {
@@ -389,118 +428,198 @@ static gboolean is_valid_scrobble_format(char **line) {
     return true;
 }
 
+/*
+ * Sends n scrobbles in one track.scrobble request.  The lines done with go
+ * in done, and those that are to be sent again with the current time in
+ * retry.  Returns FALSE if the queue is not to be gone on with.
+ */
+static gboolean submit_scrobbles (const Queued_Scrobble *batch, int n,
+ Index<int64_t> &done, Index<String> &retry) {
+    static const char * const names[] = {"artist", "album", "track",
+     "trackNumber", "duration", "timestamp", "albumArtist"};
+
+    Index<API_Parameter> params;
+
+    for (int i = 0; i < n; i++) {
+        char **line = batch[i].line;
+
+        //line[0] line[1] line[2] line[3] line[4] line[5] line[6]   line[7]      line[8]
+        //artist  album   title   number  length  "L"     timestamp album_artist nullptr
+        const char *values[] = {line[0], line[1], line[2], line[3], line[4], line[6],
+         line[7] != nullptr ? line[7] : ""};  //in case cache uses old format without album artist field
+
+        for (int f = 0; f < aud::n_elems(names); f++)
+            params.append(String(str_printf("%s[%d]", names[f], i)), String(values[f]));
+    }
+
+    params.append(String("api_key"), String(SCROBBLER_API_KEY));
+    params.append(String("sk"), session_key);
+
+    String scrobblemsg = create_message_from_params("track.scrobble", params);
+
+    if (send_message_to_lastfm(scrobblemsg) == false) {
+        AUDDBG("Could not scrobble a track on the queue. Network problem?\n");
+        //scrobbles to be retried
+        scrobbling_enabled = false;
+        return false;
+    }
+
+    String error_code;
+    String error_detail;
+    Index<String> ignored_codes;
+
+    if (read_scrobble_batch_result(error_code, error_detail, ignored_codes, n) == true) {
+        for (int i = 0; i < n; i++) {
+            const String &ignored_code = ignored_codes[i];
+            AUDDBG("SCROBBLE OK. ignored code: %s.\n", (const char *)ignored_code);
+
+            if (! ignored_code) {
+                //TODO: a track might not be scrobbled due to "daily scrobble limit exeeded".
+                //We are not dealing with this case currently; the scrobble is kept.
+            } else if (g_strcmp0(ignored_code, "3") == 0) { //3: Timestamp was too old
+                char *line = g_strjoinv("\t", batch[i].line);
+                set_timestamp_to_current(&line);
+                retry.append(String(line));
+                g_free(line);
+                done.append(batch[i].offset);
+            } else {
+                done.append(batch[i].offset);
+            }
+        }
+
+        return true;
+    }
+
+    AUDINFO("SCROBBLE NOT OK. Error code: %s. Error detail: %s.\n",
+     (const char *)error_code, (const char *)error_detail);
+
+    if (! error_code) { //net error(?) or the answer from last.fm was not well read
+        //scrobbles to be retried
+    }
+    else if (g_strcmp0(error_code, "11") == 0 ||
+             g_strcmp0(error_code, "16") == 0){
+        //error code 11: Service Offline - This service is temporarily offline. Try again later.
+        //error code 16: The service is temporarily unavailable, please try again.
+        //scrobbles to be retried
+    }
+    else if (g_strcmp0(error_code,  "9") == 0) {
+        //Bad Session. Reauth.
+        scrobbling_enabled = false;
+        session_key = String();
+        aud_set_str("scrobbler", "session_key", "");
+        return false;
+    }
+    else if (n > 1) {
+        //the request was refused; send the scrobbles one at a time so that
+        //only those at fault are dropped
+        for (int i = 0; i < n; i++) {
+            if (!submit_scrobbles(batch + i, 1, done, retry))
+                return false;
+        }
+    }
+    else {
+        done.append(batch[0].offset);
+    }
+
+    return true;
+}
+
+//sends a batch and writes down what became of it
+static gboolean flush_batch (Index<Queued_Scrobble> &batch, int64_t &n_done,
+ const char *queuepath, const char *donepath) {
+    Index<int64_t> done;
+    Index<String> retry;
+
+    gboolean carry_on = submit_scrobbles(batch.begin(), batch.len(), done, retry);
+
+    for (Queued_Scrobble &scrobble : batch)
+        g_strfreev(scrobble.line);
+
+    batch.clear();
+
+    if (done.len()) {
+        Index<String> offsets;
+        for (int64_t offset : done)
+            offsets.append(String(str_printf("%" G_GINT64_FORMAT, offset)));
+
+        pthread_mutex_lock(&log_access_mutex);
+        if (retry.len())
+            append_lines(queuepath, retry);
+        append_lines(donepath, offsets);
+        pthread_mutex_unlock(&log_access_mutex);
+
+        n_done += done.len();
+    }
+
+    return carry_on;
+}
+
 static void scrobble_cached_queue() {
     char *queuepath = g_build_filename(aud_get_path(AudPath::UserDir),"scrobbler.log", nullptr);
+    char *donepath = g_build_filename(aud_get_path(AudPath::UserDir),"scrobbler.done", nullptr);
     char *contents = nullptr;
     gboolean success;
-    char **lines = nullptr;
-    char **line;
-    GSList *lines_to_remove = nullptr; //lines to remove because they were scrobbled (or ignored, and will not be retried)
-    GSList *lines_to_retry = nullptr; //lines to retry later because they were too old TODO: or "daily scrobble limit reached"
+    Index<int64_t> done;
 
     pthread_mutex_lock(&log_access_mutex);
     success = g_file_get_contents(queuepath, &contents, nullptr, nullptr);
+    if (success)
+        done = read_done_offsets(donepath);
+    else
+        g_remove(donepath); //it would point into whatever log comes next
     pthread_mutex_unlock(&log_access_mutex);
 
     if (!success) {
         AUDDBG("Couldn't access the queue file.\n");
     } else {
-        lines = g_strsplit(contents, "\n", 0);
-
-        for (int i = 0; lines[i] != nullptr && scrobbling_enabled; i++) {
-            if (!strlen(lines[i])) continue;
-
-            line = g_strsplit(lines[i], "\t", 0);
-
-            //line[0] line[1] line[2] line[3] line[4] line[5] line[6]   line[7]      line[8]
-            //artist  album   title   number  length  "L"     timestamp album_artist nullptr
-
-            if (is_valid_scrobble_format(line))
-            {
-                String scrobblemsg = create_message_to_lastfm ("track.scrobble",
-                 9, "artist", line[0], "album", line[1], "track", line[2],
-                 "trackNumber", line[3], "duration", line[4],
-                 "timestamp", line[6],
-                 "albumArtist", line[7] != nullptr ? line[7] : "",  //in case cache uses old format without album artist field
-                 "api_key", SCROBBLER_API_KEY, "sk", (const char *) session_key);
-
-                if (send_message_to_lastfm(scrobblemsg) == true) {
-                    String error_code;
-                    String error_detail;
-                    gboolean ignored = false;
-                    String ignored_code;
-
-                    if (read_scrobble_result(error_code, error_detail, &ignored, ignored_code) == true) {
-                        AUDDBG("SCROBBLE OK. Error code: %s. Error detail: %s\n",
-                         (const char *)error_code, (const char *)error_detail);
-                        AUDDBG("SCROBBLE OK. ignored: %i.\n", ignored);
-                        AUDDBG("SCROBBLE OK. ignored code: %s.\n",
-                         (const char *)ignored_code);
-                        if (ignored == true && g_strcmp0(ignored_code, "3") == 0) { //3: Timestamp was too old
-                            AUDDBG("SCROBBLE IGNORED!!! %i, detail: %s\n",
-                             ignored, (const char *)ignored_code);
-                            save_line_to_remove(&lines_to_retry, i);
-                        } else if (ignored == true && g_strcmp0(ignored_code, "") == 0) { //5: Daily scrobble limit reached
-                           //TODO: a track might not be scrobbled due to "daily scrobble limit exeeded".
-                           //This message comes on the ignoredMessage attribute, inside the XML of the response.
-                           //We are not dealing with this case currently and are losing that scrobble.
-                           //TODO
-                        } else {
-                            AUDDBG("Not ignored. Carrying on...\n");
-                            save_line_to_remove(&lines_to_remove, i);
-                        }
+        Index<Queued_Scrobble> batch;
+        int64_t n_lines = 0, n_done = 0;
+
+        for (char *p = contents; *p; ) {
+            char *eol = strchr(p, '\n');
+            char *next = eol ? eol + 1 : p + strlen(p);
+            int64_t offset = p - contents;
+
+            if (eol)
+                *eol = 0;
+
+            if (*p) {
+                n_lines++;
+
+                if (is_done(done, offset)) {
+                    n_done++;
+                } else {
+                    char **line = g_strsplit(p, "\t", 0);
+
+                    if (is_valid_scrobble_format(line)) {
+                        batch.append(offset, line);
                     } else {
-                        AUDINFO("SCROBBLE NOT OK. Error code: %s. Error detail: %s.\n",
-                         (const char *)error_code, (const char *)error_detail);
-
-                        if (! error_code) { //net error(?) or the answer from last.fm was not well read
-                            //scrobble to be retried
-                        }
-                        else if (g_strcmp0(error_code, "11") == 0 ||
-                                 g_strcmp0(error_code, "16") == 0){
-                            //error code 11: Service Offline - This service is temporarily offline. Try again later.
-                            //error code 16: The service is temporarily unavailable, please try again.
-                            //scrobble to be retried
-                        }
-                        else if (g_strcmp0(error_code,  "9") == 0) {
-                            //Bad Session. Reauth.
-                            scrobbling_enabled = false;
-                            session_key = String();
-                            aud_set_str("scrobbler", "session_key", "");
-                        }
-                        else {
-                            save_line_to_remove(&lines_to_remove, i);
-                        }
+                        AUDDBG("Unscrobbable line.\n");
+                        //leave entry on the cache file
+                        g_strfreev(line);
                     }
-                } else {
-                    AUDDBG("Could not scrobble a track on the queue. Network problem?\n");
-                    //scrobble to be retried
-                    scrobbling_enabled = false;
-                }
 
-                //TODO: Avoid spamming last.fm --- It's not as simple as just adding a wait here:
-                //If audacious is closed while we're on this loop, tracks might be re-scrobbled.
-                //This shall be doable if we only pick one track at a time from the scrobbler.log
-            } else {
-                AUDDBG("Unscrobbable line.\n");
-                //leave entry on the cache file
+                    if (batch.len() == SCROBBLE_BATCH_SIZE &&
+                     !flush_batch(batch, n_done, queuepath, donepath))
+                        break;
+                }
             }
-            g_strfreev(line);
-        }//for
 
-        delete_lines_from_scrobble_log(&lines_to_remove, &lines_to_retry, queuepath);
-
-        if (lines_to_remove != nullptr) {
-            g_slist_free_full(lines_to_remove, g_free);
-        }
-        if (lines_to_retry != nullptr) {
-            g_slist_free_full(lines_to_retry, g_free);
+            p = next;
         }
 
-        g_strfreev(lines);
+        if (batch.len())
+            flush_batch(batch, n_done, queuepath, donepath);
+
+        if (n_done && n_done * 2 >= n_lines) {
+            pthread_mutex_lock(&log_access_mutex);
+            compact_scrobble_log(queuepath, donepath);
+            pthread_mutex_unlock(&log_access_mutex);
+        }
     }
 
     g_free(contents);
+    g_free(donepath);
     g_free(queuepath);
 }
 
@@ -7,6 +7,9 @@
  * It is licensed under the GNU General Public License, version 3.
  */
 
+//audacious includes
+#include <libaudcore/audstrings.h>
+
 //plugin includes
 #include "scrobbler.h"
 
@@ -188,6 +191,46 @@ gboolean read_scrobble_result(String &error_code, String &error_detail,
     return result;
 }
 
+/*
+ * Like read_scrobble_result, for a request with n_scrobbles scrobbles.
+ * When it returns TRUE, ignored_codes holds the code of the ignoredMessage
+ * of each scrobble, in the order they were sent: "0" if it was accepted,
+ * nullptr if the answer has none.
+ */
+gboolean read_scrobble_batch_result(String &error_code, String &error_detail,
+ Index<String> &ignored_codes, int n_scrobbles) {
+    ignored_codes.clear();
+
+    if (!prepare_data()) {
+        AUDDBG("Could not read received data from last.fm. What's up?\n");
+        return false;
+    }
+
+    String status = check_status(error_code, error_detail);
+
+    if (!status) {
+        AUDDBG("Status was nullptr. Invalid API answer.\n");
+        clean_data();
+        return false;
+    }
+
+    gboolean result = true;
+
+    if (!strcmp(status, "failed")) {
+        AUDDBG("Error code: %s. Detail: %s.\n", (const char *)error_code,
+         (const char *)error_detail);
+        result = false;
+    } else {
+        for (int i = 0; i < n_scrobbles; i++) {
+            StringBuf path = str_printf("/lfm/scrobbles/scrobble[%d]/ignoredMessage[@code]", i + 1);
+            ignored_codes.append(get_attribute_value(path, "code"));
+        }
+    }
+
+    clean_data();
+    return result;
+}
+
 //returns
 //FALSE if there was an error with the connection
 gboolean read_authentication_test_result (String &error_code, String &error_detail) {
@@ -20,7 +20,10 @@
 #include <math.h>
 #include <pthread.h>
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
 
 #if HAVE_LIBSDL3
 #include <SDL3/SDL.h>
@@ -31,10 +34,14 @@
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
-#include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
+#include "../output-common/audio-ring.h"
+#include "../output-common/telemetry.h"
+#include "../trace-common/trace.h"
+
 #define VOLUME_RANGE 40 /* decibels */
+#define WAIT_MS 10      /* longest wait for the callback to make room */
 
 class SDLOutput : public OutputPlugin
 {
@@ -81,10 +88,17 @@ const char * const SDLOutput::defaults[] = {
     nullptr
 };
 
+/* The callback never waits for the player thread: the audio passes through
+ * a lock-free ring, and everything else the callback needs, or leaves for
+ * get_delay(), is in atomics.  It wakes a waiting player thread only if it
+ * can do so without blocking; the player thread never waits longer than
+ * WAIT_MS, so a wakeup missed now and then costs no more than that.
+ * Only the player thread ever waits for sdlout_mutex, and a flush, which
+ * happens seldom, holds off the callback with SDL's own lock. */
 static pthread_mutex_t sdlout_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t sdlout_cond = PTHREAD_COND_INITIALIZER;
 
-static volatile int vol_left, vol_right;
+static std::atomic<int> vol_left, vol_right;
 
 static int sdlout_chan, sdlout_rate;
 
@@ -92,12 +106,42 @@ static int sdlout_chan, sdlout_rate;
 static SDL_AudioStream * sdlout_stream;
 #endif
 
-static RingBuf<unsigned char> buffer;
+static AudioRing buffer;
 
 static bool prebuffer_flag, paused_flag;
+static std::atomic<bool> drain_flag; /* from drain() until more is written */
+
+/* when the last block handed to SDL will have been played, in microseconds
+ * of the monotonic clock, or 0 */
+static std::atomic<int64_t> block_end;
+
+static int64_t now_us ()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+static void wake_player ()
+{
+    if (! pthread_mutex_trylock (& sdlout_mutex))
+    {
+        pthread_cond_broadcast (& sdlout_cond);
+        pthread_mutex_unlock (& sdlout_mutex);
+    }
+}
+
+/* with sdlout_mutex held */
+static void wait_callback ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_REALTIME, & ts);
+
+    ts.tv_nsec += WAIT_MS * 1000000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
 
-static int block_delay;
-static struct timeval block_time;
+    pthread_cond_timedwait (& sdlout_cond, & sdlout_mutex, & ts);
+}
 
 bool SDLOutput::init ()
 {
@@ -144,7 +188,8 @@ void SDLOutput::set_volume (StereoVolume v)
 
 static void apply_mono_volume (unsigned char * data, int len)
 {
-    int vol = aud::max (vol_left, vol_right);
+    int vol = aud::max (vol_left.load (std::memory_order_relaxed),
+     vol_right.load (std::memory_order_relaxed));
     int factor = (vol == 0) ? 0 : powf (10, (float) VOLUME_RANGE * (vol - 100)
      / 100 / 20) * 65536;
 
@@ -160,10 +205,13 @@ static void apply_mono_volume (unsigned char * data, int len)
 
 static void apply_stereo_volume (unsigned char * data, int len)
 {
-    int factor_left = (vol_left == 0) ? 0 : powf (10, (float) VOLUME_RANGE *
-     (vol_left - 100) / 100 / 20) * 65536;
-    int factor_right = (vol_right == 0) ? 0 : powf (10, (float) VOLUME_RANGE *
-     (vol_right - 100) / 100 / 20) * 65536;
+    int left = vol_left.load (std::memory_order_relaxed);
+    int right = vol_right.load (std::memory_order_relaxed);
+
+    int factor_left = (left == 0) ? 0 : powf (10, (float) VOLUME_RANGE *
+     (left - 100) / 100 / 20) * 65536;
+    int factor_right = (right == 0) ? 0 : powf (10, (float) VOLUME_RANGE *
+     (right - 100) / 100 / 20) * 65536;
 
     int16_t * i = (int16_t *) data;
     int16_t * end = (int16_t *) (data + len);
@@ -179,10 +227,11 @@ static void apply_stereo_volume (unsigned char * data, int len)
 
 static void callback (void * user, unsigned char * buf, int len)
 {
-    pthread_mutex_lock (& sdlout_mutex);
+    TRACE_SPAN ("SDL callback");
+
+    telemetry_wakeup (buffer.len (), buffer.size ());
 
-    int copy = aud::min (len, buffer.len ());
-    buffer.move_out (buf, copy);
+    int copy = buffer.move_out ((char *) buf, len);
 
     if (sdlout_chan == 2)
         apply_stereo_volume (buf, copy);
@@ -190,16 +239,20 @@ static void callback (void * user, unsigned char * buf, int len)
         apply_mono_volume (buf, copy);
 
     if (copy < len)
+    {
         memset (buf + copy, 0, len - copy);
 
+        if (! drain_flag.load (std::memory_order_relaxed))
+            telemetry_underrun ();
+    }
+
     /* At this moment, we know that there is a delay of (at least) the block of
-     * data just written.  We save the block size and the current time for
+     * data just written.  We save when it will have been played for
      * estimating the delay later on. */
-    block_delay = aud::rescale (copy / (2 * sdlout_chan), sdlout_rate, 1000);
-    gettimeofday (& block_time, nullptr);
+    int64_t block_us = aud::rescale<int64_t> (copy / (2 * sdlout_chan), sdlout_rate, 1000000);
+    block_end.store (copy ? now_us () + block_us : 0, std::memory_order_relaxed);
 
-    pthread_cond_broadcast (& sdlout_cond);
-    pthread_mutex_unlock (& sdlout_mutex);
+    wake_player ();
 }
 
 #if HAVE_LIBSDL3
@@ -237,6 +290,8 @@ bool SDLOutput::open_audio (int format, int rate, int chan, String & error)
 
     prebuffer_flag = true;
     paused_flag = false;
+    drain_flag = false;
+    block_end = 0;
 
 #if HAVE_LIBSDL3
     const SDL_AudioSpec spec = { SDL_AUDIO_S16, chan, rate };
@@ -261,6 +316,7 @@ bool SDLOutput::open_audio (int format, int rate, int chan, String & error)
         return false;
     }
 
+    telemetry_open ("SDL");
     return true;
 }
 
@@ -275,6 +331,7 @@ void SDLOutput::close_audio ()
     SDL_CloseAudio ();
 #endif
 
+    telemetry_close ();
     buffer.destroy ();
 }
 
@@ -285,7 +342,7 @@ static void check_started ()
 
     AUDDBG ("Starting playback.\n");
     prebuffer_flag = false;
-    block_delay = 0;
+    block_end = 0;
 
 #if HAVE_LIBSDL3
     SDL_ResumeAudioStreamDevice (sdlout_stream);
@@ -296,6 +353,7 @@ static void check_started ()
 
 void SDLOutput::period_wait ()
 {
+    TRACE_SPAN ("SDL period_wait");
     pthread_mutex_lock (& sdlout_mutex);
 
     while (! buffer.space ())
@@ -303,7 +361,7 @@ void SDLOutput::period_wait ()
         if (! paused_flag)
             check_started ();
 
-        pthread_cond_wait (& sdlout_cond, & sdlout_mutex);
+        wait_callback ();
     }
 
     pthread_mutex_unlock (& sdlout_mutex);
@@ -311,12 +369,12 @@ void SDLOutput::period_wait ()
 
 int SDLOutput::write_audio (const void * data, int len)
 {
-    pthread_mutex_lock (& sdlout_mutex);
+    TRACE_SPAN ("SDL write_audio");
 
     len = aud::min (len, buffer.space ());
-    buffer.copy_in ((const unsigned char *) data, len);
+    buffer.copy_in ((const char *) data, len);
+    drain_flag.store (false, std::memory_order_relaxed);
 
-    pthread_mutex_unlock (& sdlout_mutex);
     return len;
 }
 
@@ -326,33 +384,27 @@ void SDLOutput::drain ()
     pthread_mutex_lock (& sdlout_mutex);
 
     check_started ();
+    drain_flag = true;
 
     while (buffer.len ())
-        pthread_cond_wait (& sdlout_cond, & sdlout_mutex);
+        wait_callback ();
 
     pthread_mutex_unlock (& sdlout_mutex);
 }
 
 int SDLOutput::get_delay ()
 {
-    auto timediff = [] (const timeval & a, const timeval & b) -> int64_t
-        { return 1000 * (int64_t) (b.tv_sec - a.tv_sec) + (b.tv_usec - a.tv_usec) / 1000; };
-
     pthread_mutex_lock (& sdlout_mutex);
 
     int delay = aud::rescale (buffer.len (), 2 * sdlout_chan * sdlout_rate, 1000);
 
     /* Estimate the additional delay of the last block written. */
-    if (! prebuffer_flag && ! paused_flag && block_delay)
-    {
-        struct timeval cur;
-        gettimeofday (& cur, nullptr);
-
-        delay += aud::max (block_delay - timediff (block_time, cur), (int64_t) 0);
-    }
+    int64_t end = block_end.load (std::memory_order_relaxed);
+    if (! prebuffer_flag && ! paused_flag && end)
+        delay += aud::max (end - now_us (), (int64_t) 0) / 1000;
 
     pthread_mutex_unlock (& sdlout_mutex);
-    return delay;
+    return telemetry_latency (delay);
 }
 
 void SDLOutput::pause (bool pause)
@@ -383,7 +435,16 @@ void SDLOutput::flush ()
     AUDDBG ("Seek requested; discarding buffer.\n");
     pthread_mutex_lock (& sdlout_mutex);
 
+    /* the consumer's end of the ring, so the callback must not run */
+#if HAVE_LIBSDL3
+    SDL_LockAudioStream (sdlout_stream);
+    buffer.discard ();
+    SDL_UnlockAudioStream (sdlout_stream);
+#else
+    SDL_LockAudio ();
     buffer.discard ();
+    SDL_UnlockAudio ();
+#endif
 
     prebuffer_flag = true;
 
@@ -0,0 +1,499 @@
+/*
+ * database.cc
+ * Copyright 2011-2019 John Lindgren and René J.V. Bertin
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "database.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <libaudcore/audstrings.h>
+
+/* how many items are looked at between calls to the check function */
+#define CHECK_INTERVAL 4096
+
+int SearchRanking::operator() (const int & a, const int & b) const
+{
+    int a_len = database->m_items[a].matches.len ();
+    int b_len = database->m_items[b].matches.len ();
+
+    if (a_len > b_len)
+        return -1;
+    if (a_len < b_len)
+        return 1;
+
+    return database->item_compare (a, b);
+}
+
+/* There is no point in updating the database for a change to much of the
+ * playlist, or for one that is not known (a negative range). */
+bool SearchDatabase::can_update (int old_entries, int new_entries, int before,
+ int after)
+{
+    int old_end = old_entries - after;
+    int new_end = new_entries - after;
+
+    return before >= 0 && after >= 0 && before <= old_end && before <= new_end &&
+     (old_end - before) + (new_end - before) <= old_entries / 2;
+}
+
+void SearchDatabase::clear ()
+{
+    m_tuples.clear ();
+    rebuild ();
+}
+
+int SearchDatabase::add_item (int parent, SearchField field, const String & name)
+{
+    String folded = String (str_tolower_utf8 (name));
+
+    int * pos = m_text_pos.lookup (folded);
+    if (! pos)
+    {
+        pos = m_text_pos.add (folded, m_text.len ());
+        m_text.insert (folded, -1, strlen (folded) + 1);
+    }
+
+    int id = m_items.len ();
+    Item & item = m_items.append ();
+    Item & up = m_items[parent];
+
+    item.field = field;
+    item.name = name;
+    item.folded = * pos;
+    item.parent = parent;
+    item.first_child = 0;
+    item.next = up.first_child;
+    item.n_children = 0;
+    item.n_listed = 0;
+
+    up.first_child = id;
+    up.n_children ++;
+
+    m_lookup.add ({parent, field, name}, int (id));
+    m_trigrams.add (id, folded);
+
+    return id;
+}
+
+void SearchDatabase::add_to_database (int entry,
+ std::initializer_list<std::pair<SearchField, String>> keys)
+{
+    int parent = 0;
+
+    for (auto & key : keys)
+    {
+        if (! key.second)
+            continue;
+
+        int * found = m_lookup.lookup ({parent, key.first, key.second});
+        int id = found ? * found : add_item (parent, key.first, key.second);
+
+        m_items[id].matches.add (entry);
+        parent = id;
+    }
+}
+
+void SearchDatabase::add_entry (int e)
+{
+    const Tuple & tuple = m_tuples[e];
+    String album_artist = tuple.get_str (Tuple::AlbumArtist);
+    String artist = tuple.get_str (Tuple::Artist);
+
+    if (album_artist && album_artist != artist)
+    {
+        /* album and song have different artists;
+         * add separately under respective artists */
+        add_to_database (e,
+         {{SearchField::Artist, album_artist},
+          {SearchField::Album, tuple.get_str (Tuple::Album)}});
+        /* add Title node under a HiddenAlbum node so that it can
+         * still be searched by album name (without listing the
+         * album twice) */
+        add_to_database (e,
+         {{SearchField::Artist, artist},
+          {SearchField::HiddenAlbum, tuple.get_str (Tuple::Album)},
+          {SearchField::Title, tuple.get_str (Tuple::Title)}});
+    }
+    else
+    {
+        /* album and song have the same artist;
+         * add hierarchically under that artist */
+        add_to_database (e,
+         {{SearchField::Artist, artist},
+          {SearchField::Album, tuple.get_str (Tuple::Album)},
+          {SearchField::Title, tuple.get_str (Tuple::Title)}});
+    }
+
+    /* add separately under genre */
+    add_to_database (e,
+     {{SearchField::Genre, tuple.get_str (Tuple::Genre)}});
+}
+
+/* counts the items below (and including) each child of the parent that a
+ * search lists when they match */
+int SearchDatabase::count_listed (int parent)
+{
+    int total = 0;
+
+    for (int id = m_items[parent].first_child; id; id = m_items[id].next)
+    {
+        Item & item = m_items[id];
+        item.n_listed = count_listed (id) + (item.listed () ? 1 : 0);
+        total += item.n_listed;
+    }
+
+    return total;
+}
+
+void SearchDatabase::rebuild ()
+{
+    m_items.clear ();
+    m_removed = 0;
+    m_lookup.clear ();
+    m_text.clear ();
+    m_text_pos.clear ();
+    m_trigrams.clear ();
+    m_found.clear ();
+
+    /* the top level, with an empty name */
+    Item & top = m_items.append ();
+    top.field = SearchField::count;
+    m_text.append (0);
+
+    for (int e = 0; e < m_tuples.len (); e ++)
+        add_entry (e);
+
+    m_found.insert (0, m_items.len ());
+    count_listed (0);
+}
+
+void SearchDatabase::create (Index<Tuple> && tuples)
+{
+    m_tuples = std::move (tuples);
+    rebuild ();
+}
+
+/* drops the entries from start to end and moves the ones after them by
+ * delta, unlinking the items left with no entries at all */
+void SearchDatabase::remove_entries (int parent, int start, int end, int delta)
+{
+    int * link = & m_items[parent].first_child;
+
+    while (* link)
+    {
+        Item & item = m_items[* link];
+
+        /* a child's entries are a subset of its parent's */
+        if (item.matches.last () < start || (! delta && item.matches.first () >= end))
+        {
+            link = & item.next;
+            continue;
+        }
+
+        remove_entries (* link, start, end, delta);
+        item.matches.remove (start, end, delta);
+
+        if (item.matches.len ())
+        {
+            link = & item.next;
+            continue;
+        }
+
+        m_lookup.remove ({parent, item.field, item.name});
+        m_items[parent].n_children --;
+        m_removed ++;
+
+        item.name = String ();
+        * link = item.next;
+    }
+}
+
+/* Takes out the entries that were in the changed range and adds the ones
+ * that are there now.  The items removed stay in the array until there
+ * are so many of them that building it all again is worthwhile. */
+void SearchDatabase::update (int before, int after, Index<Tuple> && tuples)
+{
+    int old_end = m_tuples.len () - after;
+    int new_end = before + tuples.len ();
+
+    m_tuples.remove (before, old_end - before);
+    m_tuples.insert (before, tuples.len ());
+
+    for (int i = 0; i < tuples.len (); i ++)
+        m_tuples[before + i] = std::move (tuples[i]);
+
+    remove_entries (0, before, old_end, new_end - old_end);
+
+    if (m_removed > m_items.len () / 2)
+    {
+        rebuild ();
+        return;
+    }
+
+    for (int e = before; e < new_end; e ++)
+        add_entry (e);
+
+    m_found.insert (-1, m_items.len () - m_found.len ());
+    count_listed (0);
+}
+
+/* counts an item looked at; returns false if the search is to stop */
+bool SearchDatabase::visit (Search & search)
+{
+    if (search.stopped)
+        return false;
+
+    if (++ search.visited % CHECK_INTERVAL == 0 && search.check &&
+     ! search.check (search.results))
+        search.stopped = true;
+
+    return ! search.stopped;
+}
+
+/* Once the list is full, an item with fewer songs than the last one on it
+ * cannot make it, and neither can anything below it, since those have a
+ * subset of its songs.  If they all match, they are only counted. */
+bool SearchDatabase::skip_matching (const Item & item, SearchResults & results)
+{
+    if (! results.full () ||
+     item.matches.len () >= m_items[results.last ()].matches.len ())
+        return false;
+
+    results.add_hidden (item.n_listed);
+    return true;
+}
+
+void SearchDatabase::search_recurse (int parent, int mask, Search & search)
+{
+    for (int id = m_items[parent].first_child; id && visit (search);
+     id = m_items[id].next)
+    {
+        const Item & item = m_items[id];
+        int count = search.terms.len ();
+        int new_mask = mask;
+
+        for (int t = 0, bit = 1; t < count; t ++, bit <<= 1)
+        {
+            if (! (new_mask & bit))
+                continue; /* skip term if it is already found */
+
+            if (strstr (folded (item), search.terms[t]))
+                new_mask &= ~bit; /* we found it */
+            else if (! item.first_child)
+                break; /* quit early if there are no children to search */
+        }
+
+        if (! new_mask && skip_matching (item, search.results))
+            continue;
+
+        /* adding an item with exactly one child is redundant, so avoid it */
+        if (! new_mask && item.listed ())
+            search.results.add (id);
+
+        search_recurse (id, new_mask, search);
+    }
+}
+
+/* clears the bits of the terms that the item's own name contains */
+int SearchDatabase::clear_found (int id, int mask, const Index<String> & terms) const
+{
+    mask &= ~ m_found[id];
+
+    for (int t = 0, bit = 1; t < terms.len (); t ++, bit <<= 1)
+    {
+        /* terms too short for the index are still looked for directly */
+        if ((mask & bit) && ! TrigramIndex::can_search (terms[t]) &&
+         strstr (folded (m_items[id]), terms[t]))
+            mask &= ~bit;
+    }
+
+    return mask;
+}
+
+void SearchDatabase::search_subtree (int id, int mask, Search & search)
+{
+    if (! visit (search))
+        return;
+
+    const Item & item = m_items[id];
+    mask = clear_found (id, mask, search.terms);
+
+    if (! mask && skip_matching (item, search.results))
+        return;
+
+    if (! mask && item.listed ())
+        search.results.add (id);
+
+    for (int child = item.first_child; child; child = m_items[child].next)
+        search_subtree (child, mask, search);
+}
+
+/* Gives the same results as search_recurse(), without going through the
+ * whole database.  An item matches when each term is in its own name or in
+ * one of its parents', so every match is below (or is) one of the items
+ * whose names contain the term found in the fewest names.  Only those
+ * subtrees are searched.  Returns false if no term is long enough. */
+bool SearchDatabase::search_indexed (Search & search)
+{
+    auto & terms = search.terms;
+    int count = terms.len ();
+    int rarest = -1, rarest_count = 0;
+    Index<int> marked;
+
+    for (int t = 0, bit = 1; t < count && ! search.stopped; t ++, bit <<= 1)
+    {
+        if (! TrigramIndex::can_search (terms[t]))
+            continue;
+
+        int n_found = 0;
+
+        for (int id : m_trigrams.candidates (terms[t]))
+        {
+            if (! visit (search))
+                break;
+
+            /* an item removed by an update has no entries */
+            const Item & item = m_items[id];
+            if (! item.matches.len () || ! strstr (folded (item), terms[t]))
+                continue;
+
+            if (! m_found[id])
+                marked.append (id);
+
+            m_found[id] |= bit;
+            n_found ++;
+        }
+
+        if (rarest < 0 || n_found < rarest_count)
+        {
+            rarest = t;
+            rarest_count = n_found;
+        }
+    }
+
+    if (rarest >= 0)
+    {
+        int all = (1 << count) - 1;
+        int rarest_bit = 1 << rarest;
+
+        for (int id : marked)
+        {
+            if (search.stopped || ! (m_found[id] & rarest_bit))
+                continue;
+
+            int mask = all;
+            bool covered = false;
+
+            for (int parent = m_items[id].parent; parent; parent = m_items[parent].parent)
+            {
+                /* already searched below the parent */
+                if (m_found[parent] & rarest_bit)
+                    covered = true;
+
+                mask = clear_found (parent, mask, terms);
+            }
+
+            if (! covered)
+                search_subtree (id, mask, search);
+        }
+    }
+
+    for (int id : marked)
+        m_found[id] = 0;
+
+    return rarest >= 0;
+}
+
+bool SearchDatabase::search (const Index<String> & terms, SearchResults & results,
+ const CheckFunc & check)
+{
+    Search search = {terms, results, check, 0, false};
+
+    /* effectively limits number of search terms to 32 */
+    if (! search_indexed (search))
+        search_recurse (0, (1 << terms.len ()) - 1, search);
+
+    return ! search.stopped;
+}
+
+int SearchDatabase::item_compare (int a, int b) const
+{
+    const Item & x = m_items[a];
+    const Item & y = m_items[b];
+
+    if (x.field < y.field)
+        return -1;
+    if (x.field > y.field)
+        return 1;
+
+    int val = str_compare (x.name, y.name);
+    if (val)
+        return val;
+
+    if (x.parent)
+        return y.parent ? item_compare (x.parent, y.parent) : 1;
+    else
+        return y.parent ? -1 : 0;
+}
+
+Index<SearchResult> SearchDatabase::get_results (const SearchResults & results) const
+{
+    Index<int> ids;
+    ids.insert (results.items ().begin (), 0, results.items ().len ());
+
+    /* sort by item type, then item name */
+    std::sort (ids.begin (), ids.end (), [this] (int a, int b)
+        { return item_compare (a, b) < 0; });
+
+    Index<SearchResult> list;
+
+    for (int id : ids)
+    {
+        const Item & item = m_items[id];
+        SearchResult result = {item.field, item.name, SearchField::count,
+         String (), item.matches};
+
+        /* the artist, or the album if there is none */
+        if (item.parent)
+        {
+            int grandparent = m_items[item.parent].parent;
+            const Item & shown = m_items[grandparent ? grandparent : item.parent];
+
+            result.parent_field = shown.field;
+            result.parent_name = shown.name;
+        }
+
+        list.append (std::move (result));
+    }
+
+    return list;
+}
+
+Index<Tuple> get_entry_tuples (Playlist playlist, int start, int end)
+{
+    Index<Tuple> tuples;
+    tuples.insert (0, end - start);
+
+    for (int e = start; e < end; e ++)
+        tuples[e - start] = playlist.entry_tuple (e, Playlist::NoWait);
+
+    return tuples;
+}
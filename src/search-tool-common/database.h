@@ -0,0 +1,178 @@
+/*
+ * database.h
+ * Copyright 2011-2019 John Lindgren and René J.V. Bertin
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SEARCH_TOOL_DATABASE_H
+#define SEARCH_TOOL_DATABASE_H
+
+#include <functional>
+
+#include <libaudcore/index.h>
+#include <libaudcore/multihash.h>
+#include <libaudcore/playlist.h>
+#include <libaudcore/tuple.h>
+
+#include "entry-list.h"
+#include "top-list.h"
+#include "trigram-index.h"
+
+enum class SearchField {
+    Genre,
+    Artist,
+    Album,
+    HiddenAlbum,
+    Title,
+    count
+};
+
+/* What is shown of a matching item, copied out of the database. */
+struct SearchResult
+{
+    SearchField field;
+    String name;
+    SearchField parent_field;
+    String parent_name;  /* of the artist, or the album if there is none */
+    EntryList matches;
+};
+
+class SearchDatabase;
+
+/* items with more songs first, then as they are listed */
+struct SearchRanking
+{
+    const SearchDatabase * database;
+    int operator() (const int & a, const int & b) const;
+};
+
+typedef TopList<int, SearchRanking> SearchResults;
+
+/* The artists, albums, titles and genres of the library, built from the
+ * tuples of its entries, which it keeps.
+ *
+ * The items are in one array and refer to each other by their place in
+ * it, each holding the first of its children and the next of its
+ * siblings, so that an item allocates nothing but its name and, if its
+ * songs are scattered, its entry list.  The folded names are in one pool
+ * of text, each stored once however many items have it.  An item removed
+ * by an update is only unlinked from its parent and left without entries;
+ * the array is built again once half of it is unused.
+ *
+ * Not thread-safe. */
+class SearchDatabase
+{
+public:
+    /* called now and then while searching; returning false stops the
+     * search, leaving only some of the results */
+    typedef std::function<bool (const SearchResults & results)> CheckFunc;
+
+    /* true if the entries changed between the first "before" and the last
+     * "after" are better updated than built again */
+    static bool can_update (int old_entries, int new_entries, int before, int after);
+
+    SearchDatabase () { clear (); }
+
+    int n_entries () const { return m_tuples.len (); }
+
+    void clear ();
+    void create (Index<Tuple> && tuples);
+
+    /* replaces the entries between the first "before" and the last "after"
+     * with the given ones */
+    void update (int before, int after, Index<Tuple> && tuples);
+
+    /* returns false if stopped */
+    bool search (const Index<String> & terms, SearchResults & results,
+     const CheckFunc & check = nullptr);
+
+    /* sorted by field, then by name */
+    Index<SearchResult> get_results (const SearchResults & results) const;
+
+private:
+    struct Item
+    {
+        SearchField field;
+        String name;
+        int folded;         /* in m_text */
+        int parent;         /* 0 at the top */
+        int first_child, next;
+        int n_children;
+        int n_listed;       /* this and the items below that a search can list */
+        EntryList matches;
+
+        bool listed () const
+            { return n_children != 1 && field != SearchField::HiddenAlbum; }
+    };
+
+    struct Key
+    {
+        int parent;
+        SearchField field;
+        String name;
+
+        bool operator== (const Key & b) const
+            { return parent == b.parent && field == b.field && name == b.name; }
+        unsigned hash () const
+            { return parent * 31 + (unsigned) field + name.hash (); }
+    };
+
+    struct Search
+    {
+        const Index<String> & terms;
+        SearchResults & results;
+        const CheckFunc & check;
+        int visited;
+        bool stopped;
+    };
+
+    const char * folded (const Item & item) const
+        { return & m_text[item.folded]; }
+
+    int add_item (int parent, SearchField field, const String & name);
+    void add_to_database (int entry, std::initializer_list<std::pair<SearchField, String>> keys);
+    void add_entry (int entry);
+    void rebuild ();
+    void remove_entries (int parent, int start, int end, int delta);
+    int count_listed (int parent);
+
+    bool visit (Search & search);
+    bool skip_matching (const Item & item, SearchResults & results);
+    int clear_found (int id, int mask, const Index<String> & terms) const;
+    void search_recurse (int parent, int mask, Search & search);
+    void search_subtree (int id, int mask, Search & search);
+    bool search_indexed (Search & search);
+
+    int item_compare (int a, int b) const;
+
+    friend struct SearchRanking;
+
+    Index<Tuple> m_tuples;
+    Index<Item> m_items;        /* the first holds the top level */
+    int m_removed = 0;
+    SimpleHash<Key, int> m_lookup;
+    Index<char> m_text;
+    SimpleHash<String, int> m_text_pos;
+    TrigramIndex m_trigrams;
+    Index<int> m_found;         /* by item, bits of the terms found while searching */
+};
+
+/* taken by the caller, so that the tuples match the change that was
+ * signaled even if the playlist has changed again since */
+Index<Tuple> get_entry_tuples (Playlist playlist, int start, int end);
+
+#endif // SEARCH_TOOL_DATABASE_H
@@ -0,0 +1,117 @@
+/*
+ * entry-list.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "entry-list.h"
+
+/* appends a run, joining it to the last one if they meet */
+static void append_run (Index<EntryList::Run> & runs, int start, int len)
+{
+    if (len <= 0)
+        return;
+
+    if (runs.len ())
+    {
+        auto & last = runs[runs.len () - 1];
+        if (last.start + last.len == start)
+        {
+            last.len += len;
+            return;
+        }
+    }
+
+    runs.append (EntryList::Run {start, len});
+}
+
+void EntryList::set_runs (const Index<Run> & runs)
+{
+    m_len = 0;
+    m_more.clear ();
+
+    for (const Run & r : runs)
+        m_len += r.len;
+
+    if (runs.len ())
+    {
+        m_first = runs[0];
+        m_more.insert (& runs[1], 0, runs.len () - 1);
+    }
+    else
+        m_first = {0, 0};
+}
+
+void EntryList::add (int entry)
+{
+    if (! m_len)
+    {
+        m_first = {entry, 1};
+        m_len = 1;
+        return;
+    }
+
+    Run & last = m_more.len () ? m_more[m_more.len () - 1] : m_first;
+
+    if (entry == last.start + last.len)
+        last.len ++;
+    else if (entry > last.start + last.len)
+        m_more.append (Run {entry, 1});
+    else
+    {
+        /* only in an update, for an entry among the ones already here */
+        Index<Run> runs;
+        bool added = false;
+
+        for (int i = 0; i < n_runs (); i ++)
+        {
+            const Run & r = run (i);
+
+            if (! added && entry < r.start)
+            {
+                append_run (runs, entry, 1);
+                added = true;
+            }
+            else if (! added && entry < r.start + r.len)
+                return;  /* already here */
+
+            append_run (runs, r.start, r.len);
+        }
+
+        set_runs (runs);
+        return;
+    }
+
+    m_len ++;
+}
+
+void EntryList::remove (int start, int end, int delta)
+{
+    Index<Run> runs;
+
+    for (int i = 0; i < n_runs (); i ++)
+    {
+        const Run & r = run (i);
+        int r_end = r.start + r.len;
+
+        append_run (runs, r.start, aud::min (r_end, start) - r.start);
+
+        int after = aud::max (r.start, end);
+        append_run (runs, after + delta, r_end - after);
+    }
+
+    set_runs (runs);
+}
@@ -0,0 +1,99 @@
+/*
+ * entry-list.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SEARCH_TOOL_ENTRY_LIST_H
+#define SEARCH_TOOL_ENTRY_LIST_H
+
+#include <libaudcore/index.h>
+
+/* Playlist entry numbers in increasing order, stored as runs of numbers
+ * one after another.  The library is sorted by path, so the songs of an
+ * album, and often of an artist, are mostly in one run, which is held
+ * without allocating anything. */
+class EntryList
+{
+public:
+    struct Run {
+        int start, len;
+    };
+
+    class Iter
+    {
+    public:
+        Iter (const EntryList * list, int run) :
+            m_list (list), m_run (run), m_offset (0) {}
+
+        int operator* () const
+            { return m_list->run (m_run).start + m_offset; }
+        bool operator!= (const Iter & b) const
+            { return m_run != b.m_run || m_offset != b.m_offset; }
+
+        Iter & operator++ ()
+        {
+            if (++ m_offset == m_list->run (m_run).len)
+            {
+                m_run ++;
+                m_offset = 0;
+            }
+            return * this;
+        }
+
+    private:
+        const EntryList * m_list;
+        int m_run, m_offset;
+    };
+
+    EntryList () = default;
+    EntryList (EntryList &&) = default;
+    EntryList & operator= (EntryList &&) = default;
+
+    EntryList (const EntryList & b) :
+        m_len (b.m_len),
+        m_first (b.m_first)
+        { m_more.insert (b.m_more.begin (), 0, b.m_more.len ()); }
+
+    int len () const { return m_len; }
+    int first () const { return m_first.start; }
+    int last () const
+    {
+        const Run & r = run (n_runs () - 1);
+        return r.start + r.len - 1;
+    }
+
+    Iter begin () const { return Iter (this, 0); }
+    Iter end () const { return Iter (this, n_runs ()); }
+
+    void add (int entry);
+
+    /* drops the entries from start to end and moves the ones after them
+     * by delta */
+    void remove (int start, int end, int delta);
+
+private:
+    int n_runs () const { return m_len ? 1 + m_more.len () : 0; }
+    const Run & run (int i) const { return i ? m_more[i - 1] : m_first; }
+
+    void set_runs (const Index<Run> & runs);
+
+    int m_len = 0;
+    Run m_first = {0, 0};
+    Index<Run> m_more;
+};
+
+#endif // SEARCH_TOOL_ENTRY_LIST_H
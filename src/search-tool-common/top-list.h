@@ -0,0 +1,86 @@
+/*
+ * top-list.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SEARCH_TOOL_TOP_LIST_H
+#define SEARCH_TOOL_TOP_LIST_H
+
+#include <algorithm>
+
+#include <libaudcore/index.h>
+
+/* Keeps the first "size" of the items added, in the order given by the
+ * compare function (negative if a comes before b), and counts the rest.
+ * The items kept are in a heap with the one that would be dropped next on
+ * top, so adding an item costs log(size) however many there are in all. */
+template<class T, class Compare>
+class TopList
+{
+public:
+    TopList (int size, Compare compare) :
+        m_size (aud::max (size, 0)),
+        m_compare (compare) {}
+
+    /* true once an item has to beat last () to be kept */
+    bool full () const
+        { return m_size && m_items.len () == m_size; }
+    const T & last () const
+        { return m_items[0]; }
+
+    /* in no particular order */
+    const Index<T> & items () const
+        { return m_items; }
+    Index<T> take ()
+        { return std::move (m_items); }
+
+    int n_hidden () const
+        { return m_hidden; }
+
+    void add (const T & item)
+    {
+        auto before = [this] (const T & a, const T & b)
+            { return m_compare (a, b) < 0; };
+
+        if (m_items.len () < m_size)
+        {
+            m_items.append (item);
+            std::push_heap (m_items.begin (), m_items.end (), before);
+        }
+        else if (m_size && before (item, m_items[0]))
+        {
+            std::pop_heap (m_items.begin (), m_items.end (), before);
+            m_items[m_size - 1] = item;
+            std::push_heap (m_items.begin (), m_items.end (), before);
+            m_hidden ++;
+        }
+        else
+            m_hidden ++;
+    }
+
+    /* counts items known not to make the list without adding them */
+    void add_hidden (int count)
+        { m_hidden += count; }
+
+private:
+    int m_size;
+    Compare m_compare;
+    Index<T> m_items;
+    int m_hidden = 0;
+};
+
+#endif // SEARCH_TOOL_TOP_LIST_H
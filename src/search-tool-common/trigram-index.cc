@@ -0,0 +1,92 @@
+/*
+ * trigram-index.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "trigram-index.h"
+
+static unsigned trigram_at (const char * s)
+{
+    return (unsigned char) s[0] | (unsigned char) s[1] << 8 |
+     (unsigned char) s[2] << 16;
+}
+
+void TrigramIndex::add (int id, const char * text)
+{
+    int len = strlen (text);
+
+    for (int i = 0; i + 3 <= len; i ++)
+    {
+        Trigram key = {trigram_at (text + i)};
+        Index<int> * list = m_lists.lookup (key);
+
+        if (! list)
+            list = m_lists.add (key, Index<int> ());
+
+        /* a trigram repeated in the same string is listed once */
+        if (! list->len () || (* list)[list->len () - 1] != id)
+            list->append (id);
+    }
+}
+
+Index<int> TrigramIndex::candidates (const char * term)
+{
+    Index<const Index<int> *> lists;
+    int len = strlen (term);
+
+    for (int i = 0; i + 3 <= len; i ++)
+    {
+        Trigram key = {trigram_at (term + i)};
+        auto list = m_lists.lookup (key);
+
+        if (! list)
+            return Index<int> ();  /* no string has this trigram */
+
+        if (lists.find (list) < 0)
+            lists.append (list);
+    }
+
+    Index<int> result;
+    if (! lists.len ())
+        return result;
+
+    /* start from the shortest list, so that it only gets shorter */
+    lists.sort ([] (const Index<int> * const & a, const Index<int> * const & b)
+        { return a->len () - b->len (); });
+
+    result.insert (lists[0]->begin (), 0, lists[0]->len ());
+
+    for (int l = 1; l < lists.len () && result.len (); l ++)
+    {
+        const Index<int> & list = * lists[l];
+        int kept = 0, j = 0;
+
+        for (int id : result)
+        {
+            while (j < list.len () && list[j] < id)
+                j ++;
+            if (j == list.len ())
+                break;
+            if (list[j] == id)
+                result[kept ++] = id;
+        }
+
+        result.remove (kept, -1);
+    }
+
+    return result;
+}
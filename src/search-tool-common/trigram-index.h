@@ -0,0 +1,64 @@
+/*
+ * trigram-index.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SEARCH_TOOL_TRIGRAM_INDEX_H
+#define SEARCH_TOOL_TRIGRAM_INDEX_H
+
+#include <string.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/multihash.h>
+
+/* An inverted index from every three-byte sequence in a set of strings to
+ * the ids of the strings it occurs in.  Ids must be added in increasing
+ * order, which keeps each list sorted.
+ *
+ * A string containing a term contains all of its trigrams, so the ids
+ * common to those lists are a superset of the strings that match; the
+ * caller then checks the few ids left with strstr().  Terms shorter than
+ * a trigram cannot be looked up at all. */
+class TrigramIndex
+{
+public:
+    static bool can_search (const char * term)
+        { return strlen (term) >= 3; }
+
+    void clear ()
+        { m_lists.clear (); }
+
+    void add (int id, const char * text);
+
+    /* in increasing order */
+    Index<int> candidates (const char * term);
+
+private:
+    struct Trigram
+    {
+        unsigned code;
+
+        bool operator== (const Trigram & b) const
+            { return code == b.code; }
+        unsigned hash () const
+            { return code * 2654435761u; }
+    };
+
+    SimpleHash<Trigram, Index<int>> m_lists;
+};
+
+#endif // SEARCH_TOOL_TRIGRAM_INDEX_H
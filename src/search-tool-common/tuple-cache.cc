@@ -0,0 +1,269 @@
+/*
+ * tuple-cache.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "tuple-cache.h"
+#include "../vfs-common/atomic-file.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+/* The file is a series of nul-terminated strings, starting with the header:
+ *   <size> <mtime>, <URI>, <field>, <value>, <field>, <value>, ..., ""
+ * for each file, with fields named as in .audpl playlists and numbers
+ * written out in decimal.  Path, Basename and Suffix are left out, since
+ * they are set again from the URI when the tuple is read back. */
+#define CACHE_HEADER "Audacious tuple cache 1"
+
+static StringBuf cache_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "search-tool-tuples"});
+}
+
+bool get_file_stamp (const char * filename, FileStamp & stamp)
+{
+    if (strncmp (filename, "file://", 7))
+        return false;
+
+    StringBuf path = uri_to_filename (filename);
+    struct stat st;
+
+    if (! path || stat (path, & st) < 0 || ! S_ISREG (st.st_mode))
+        return false;
+
+    stamp.size = st.st_size;
+    stamp.mtime = st.st_mtime;
+    return true;
+}
+
+/* the string after the one at p, or nullptr if it is not terminated */
+static const char * next_string (const char * p, const char * end)
+{
+    auto nul = (const char *) memchr (p, 0, end - p);
+    return nul ? nul + 1 : nullptr;
+}
+
+void TupleCache::load ()
+{
+    unload ();
+
+    StringBuf path = cache_path ();
+
+#ifndef _WIN32
+    int fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat (fd, & st) == 0 && st.st_size > 0)
+    {
+        void * map = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            m_data = (const char *) map;
+            m_size = st.st_size;
+        }
+    }
+
+    close (fd);
+#else
+    VFSFile file (filename_to_uri (path), "r");
+    if (file)
+    {
+        m_buffer = file.read_all ();
+        m_data = m_buffer.begin ();
+        m_size = m_buffer.len ();
+    }
+#endif
+
+    if (! m_data)
+        return;
+
+    const char * end = m_data + m_size;
+    const char * p = next_string (m_data, end);
+
+    if (! p || strcmp (m_data, CACHE_HEADER))
+    {
+        AUDWARN ("Ignoring tuple cache in unknown format.\n");
+        unload ();
+        return;
+    }
+
+    /* only whole records are indexed, so lookups need no bounds checks */
+    while (p < end)
+    {
+        const char * record = p;
+        const char * uri = next_string (record, end);
+        const char * field = uri ? next_string (uri, end) : nullptr;
+
+        while (field && * field)
+        {
+            const char * value = next_string (field, end);
+            field = value ? next_string (value, end) : nullptr;
+        }
+
+        if (! field)
+            break;  /* truncated */
+
+        m_records.add (String (uri), record);
+        p = field + 1;
+    }
+
+    AUDINFO ("Loaded %d tuples from cache.\n", m_records.n_items ());
+}
+
+void TupleCache::unload ()
+{
+    m_records.clear ();
+
+#ifndef _WIN32
+    if (m_data)
+        munmap ((void *) m_data, m_size);
+#else
+    m_buffer.clear ();
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool TupleCache::lookup (const String & filename, const FileStamp & stamp, Tuple & tuple) const
+{
+    auto record = m_records.lookup (filename);
+    if (! record)
+        return false;
+
+    FileStamp cached;
+    if (sscanf (* record, "%" SCNd64 " %" SCNd64, & cached.size, & cached.mtime) != 2 ||
+     cached.size != stamp.size || cached.mtime != stamp.mtime)
+        return false;
+
+    const char * uri = * record + strlen (* record) + 1;
+    const char * key = uri + strlen (uri) + 1;
+
+    Tuple result;
+    result.set_filename (filename);
+
+    while (* key)
+    {
+        const char * value = key + strlen (key) + 1;
+        auto field = Tuple::field_by_name (key);
+
+        if (field != Tuple::Invalid)
+        {
+            auto type = Tuple::field_get_type (field);
+            if (type == Tuple::String)
+                result.set_str (field, value);
+            else if (type == Tuple::Int)
+                result.set_int (field, atoi (value));
+            else if (type == Tuple::DateTime)
+                result.set_int64 (field, str_to_int64 (value));
+        }
+
+        key = value + strlen (value) + 1;
+    }
+
+    result.set_state (Tuple::Valid);
+    tuple = std::move (result);
+    return true;
+}
+
+static void write_string (FILE * file, const char * str)
+{
+    fwrite (str, 1, strlen (str) + 1, file);
+}
+
+/* songs from container files (cue sheets and the like) are not cached,
+ * since their URIs do not stand for a file of their own */
+static bool is_cacheable (const char * filename, const Tuple & tuple)
+{
+    return tuple.state () == Tuple::Valid && ! strchr (filename, '?') &&
+     tuple.get_value_type (Tuple::Subtune) == Tuple::Empty;
+}
+
+void TupleCache::save (Playlist playlist, const SimpleHash<String, FileStamp> & stamps)
+{
+    int saved = 0;
+
+    bool written = write_file_atomic (cache_path (), [&] (FILE * file) {
+        write_string (file, CACHE_HEADER);
+
+        int entries = playlist.n_entries ();
+
+        for (int entry = 0; entry < entries; entry ++)
+        {
+            String filename = playlist.entry_filename (entry);
+            auto stamp = stamps.lookup (filename);
+            if (! stamp)
+                continue;
+
+            Tuple tuple = playlist.entry_tuple (entry, Playlist::NoWait);
+            if (! is_cacheable (filename, tuple))
+                continue;
+
+            char buf[64];
+            snprintf (buf, sizeof buf, "%" PRId64 " %" PRId64, stamp->size, stamp->mtime);
+            write_string (file, buf);
+            write_string (file, filename);
+
+            for (auto f : Tuple::all_fields ())
+            {
+                if (f == Tuple::Path || f == Tuple::Basename ||
+                 f == Tuple::Suffix || f == Tuple::FormattedTitle)
+                    continue;
+
+                Tuple::ValueType type = tuple.get_value_type (f);
+
+                if (type == Tuple::String)
+                {
+                    write_string (file, Tuple::field_get_name (f));
+                    write_string (file, tuple.get_str (f));
+                }
+                else if (type == Tuple::Int)
+                {
+                    write_string (file, Tuple::field_get_name (f));
+                    write_string (file, int_to_str (tuple.get_int (f)));
+                }
+                else if (type == Tuple::DateTime)
+                {
+                    write_string (file, Tuple::field_get_name (f));
+                    write_string (file, int64_to_str (tuple.get_int64 (f)));
+                }
+            }
+
+            write_string (file, "");
+            saved ++;
+        }
+    });
+
+    if (written)
+        AUDINFO ("Saved %d tuples to cache.\n", saved);
+}
@@ -0,0 +1,72 @@
+/*
+ * tuple-cache.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SEARCH_TOOL_TUPLE_CACHE_H
+#define SEARCH_TOOL_TUPLE_CACHE_H
+
+#include <stdint.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/multihash.h>
+#include <libaudcore/playlist.h>
+#include <libaudcore/tuple.h>
+
+struct FileStamp {
+    int64_t size, mtime;
+};
+
+/* false for anything but a regular local file */
+bool get_file_stamp (const char * filename, FileStamp & stamp);
+
+/* The metadata of every song in the library, as read by the input plugins,
+ * kept between sessions so that importing the library again only has to
+ * scan the files that are new or have changed since.  Entries are keyed by
+ * URI and hold the size and modification time the file had when it was
+ * read; an entry whose file no longer matches is ignored.
+ *
+ * The cache file is mapped into memory and only indexed when loaded; a
+ * tuple is built from it only when it is looked up.  Loading and saving
+ * must not overlap with lookups, which are otherwise safe from any thread. */
+class TupleCache
+{
+public:
+    TupleCache () = default;
+    ~TupleCache () { unload (); }
+
+    TupleCache (const TupleCache &) = delete;
+    TupleCache & operator= (const TupleCache &) = delete;
+
+    void load ();
+    void unload ();
+
+    bool lookup (const String & filename, const FileStamp & stamp, Tuple & tuple) const;
+
+    /* replaces the cache with the scanned entries of the playlist whose
+     * current stamp is known */
+    void save (Playlist playlist, const SimpleHash<String, FileStamp> & stamps);
+
+private:
+    const char * m_data = nullptr;
+    int64_t m_size = 0;
+    Index<char> m_buffer;   /* where the file cannot be mapped */
+
+    SimpleHash<String, const char *> m_records;
+};
+
+#endif // SEARCH_TOOL_TUPLE_CACHE_H
@@ -24,6 +24,8 @@
 #include <libaudcore/multihash.h>
 #include <libaudcore/playlist.h>
 
+#include "../search-tool-common/tuple-cache.h"
+
 class Library
 {
 public:
@@ -31,11 +33,21 @@ public:
     ~Library () { set_adding (false); }
 
     Playlist playlist () const { return m_playlist; }
+
+    /* true once the files have all been added, even if some are still
+     * being scanned; the entries scanned later are signaled as updates */
     bool is_ready () const { return m_is_ready; }
 
     void begin_add (const char * uri);
     void check_ready_and_update (bool force);
 
+    /* the unchanged entries at either end of the playlist, as of the
+     * update being signaled, or -1 if any entry may have changed */
+    void get_changes (int & before, int & after) const {
+        before = m_changed_before;
+        after = m_changed_after;
+    }
+
     void connect_update (void (* func) (void *), void * data) {
         update_func = func;
         update_data = data;
@@ -49,14 +61,22 @@ private:
 
     static bool filter_cb (const char * filename, void *);
 
+    void save_cache ();
+
     void add_complete (void);
     void scan_complete (void);
     void playlist_update (void);
 
     Playlist m_playlist;
     bool m_is_ready = false;
+    int m_changed_before = -1, m_changed_after = -1;
     SimpleHash<String, bool> m_added_table;
 
+    /* filled in from the playlist add thread */
+    TupleCache m_cache;
+    SimpleHash<String, FileStamp> m_stamps;
+    Index<PlaylistAddItem> m_cached_items;
+
     /* to allow safe callback access from playlist add thread */
     static aud::spinlock s_adding_lock;
     static Library * s_adding_library;
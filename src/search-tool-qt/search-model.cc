@@ -19,12 +19,16 @@
 
 #include "search-model.h"
 
+#include <chrono>
+
 #include <QMimeData>
 #include <QUrl>
 
 #include <libaudcore/i18n.h>
 
-static QString create_item_label (const Item & item)
+#define PARTIAL_DELAY 100  /* ms between partial results */
+
+static QString create_item_label (const SearchResult & item)
 {
     QString string = start_tags[item.field];
 
@@ -44,7 +48,7 @@ static QString create_item_label (const Item & item)
         string += str_printf (dngettext (PACKAGE, "%d song", "%d songs",
          item.matches.len ()), item.matches.len ());
 
-        if (item.field == SearchField::Genre || item.parent)
+        if (item.field == SearchField::Genre || item.parent_name)
             string += ' ';
     }
 
@@ -52,15 +56,13 @@ static QString create_item_label (const Item & item)
     {
         string += _("of this genre");
     }
-    else if (item.parent)
+    else if (item.parent_name)
     {
-        auto parent = (item.parent->parent ? item.parent->parent : item.parent);
-
-        string += parent_prefix (parent->field);
+        string += parent_prefix (item.parent_field);
         string += ' ';
-        string += start_tags[parent->field];
-        string += QString (parent->name).toHtmlEscaped ();
-        string += end_tags[parent->field];
+        string += start_tags[item.parent_field];
+        string += QString (item.parent_name).toHtmlEscaped ();
+        string += end_tags[item.parent_field];
     }
 
 #ifndef Q_OS_MAC  // Mac-specific font tweaks
@@ -78,7 +80,7 @@ QVariant SearchModel::data (const QModelIndex & index, int role) const
         if (row < 0 || row >= m_items.len ())
             return QVariant ();
 
-        return create_item_label (* m_items[row]);
+        return create_item_label (m_items[row]);
     }
 
     return QVariant ();
@@ -95,7 +97,7 @@ QMimeData * SearchModel::mimeData (const QModelIndexList & indexes) const
         if (row < 0 || row >= m_items.len ())
             continue;
 
-        for (int entry : m_items[row]->matches)
+        for (int entry : m_items[row].matches)
         {
             urls.append (QString (m_playlist.entry_filename (entry)));
             m_playlist.select_entry (entry, true);
@@ -135,153 +137,211 @@ void SearchModel::update ()
     }
 }
 
+SearchModel::SearchModel ()
+{
+    m_thread = std::thread (& SearchModel::run, this);
+}
+
+SearchModel::~SearchModel ()
+{
+    {
+        std::lock_guard<std::mutex> lock (m_mutex);
+        m_quit = true;
+        m_serial ++;
+        m_cond.notify_all ();
+    }
+
+    m_thread.join ();
+    m_deliver.stop ();
+}
+
+/* a search in progress is out of date once the database changes */
+void SearchModel::submit (DatabaseJob && job)
+{
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    if (job.type != DatabaseJob::Update)
+        m_jobs.clear ();
+
+    m_jobs.append (std::move (job));
+    m_serial ++;
+    m_cond.notify_all ();
+}
+
 void SearchModel::destroy_database ()
 {
     m_playlist = Playlist ();
+    m_entries = 0;
     m_items.clear ();
     m_hidden_items = 0;
-    m_database.clear ();
+
+    submit ({DatabaseJob::Clear, 0, 0, Index<Tuple> ()});
+}
+
+void SearchModel::create_database (Playlist playlist)
+{
+    m_playlist = playlist;
+    m_entries = playlist.n_entries ();
+
+    submit ({DatabaseJob::Create, 0, 0, get_entry_tuples (playlist, 0, m_entries)});
 }
 
-void SearchModel::add_to_database (int entry, std::initializer_list<Key> keys)
+/* Brings the database up to date after the playlist has changed between
+ * its first "before" and last "after" entries.  The whole database is
+ * built again instead if the change is not known (a negative range) or
+ * covers much of the playlist. */
+void SearchModel::update_database (Playlist playlist, int before, int after)
 {
-    Item * parent = nullptr;
-    auto hash = & m_database;
+    int entries = playlist.n_entries ();
+    int new_end = entries - after;
 
-    for (auto & key : keys)
+    if (playlist != m_playlist ||
+     ! SearchDatabase::can_update (m_entries, entries, before, after))
     {
-        if (! key.name)
-            continue;
+        create_database (playlist);
+        return;
+    }
 
-        Item * item = hash->lookup (key);
-        if (! item)
-            item = hash->add (key, Item (key.field, key.name, parent));
+    m_entries = entries;
 
-        item->matches.append (entry);
+    submit ({DatabaseJob::Update, before, after, get_entry_tuples (playlist, before, new_end)});
+}
 
-        parent = item;
-        hash = & item->children;
-    }
+void SearchModel::do_search (const Index<String> & terms, int max_results)
+{
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    m_terms.clear ();
+    for (const String & term : terms)
+        m_terms.append (term);
+
+    m_max_results = max_results;
+    m_search_wanted = true;
+    m_serial ++;
+    m_cond.notify_all ();
 }
 
-void SearchModel::create_database (Playlist playlist)
+void SearchModel::finish_search ()
 {
-    destroy_database ();
+    std::unique_lock<std::mutex> lock (m_mutex);
 
-    int entries = playlist.n_entries ();
+    while (m_jobs.len () || m_search_wanted || m_busy)
+        m_cond.wait (lock);
 
-    for (int e = 0; e < entries; e ++)
+    lock.unlock ();
+    take_results ();
+}
+
+void SearchModel::take_results ()
+{
     {
-        Tuple tuple = playlist.entry_tuple (e, Playlist::NoWait);
-        String album_artist = tuple.get_str (Tuple::AlbumArtist);
-        String artist = tuple.get_str (Tuple::Artist);
+        std::lock_guard<std::mutex> lock (m_mutex);
 
-        if (album_artist && album_artist != artist)
-        {
-            /* album and song have different artists;
-             * add separately under respective artists */
-            add_to_database (e,
-             {{SearchField::Artist, album_artist},
-              {SearchField::Album, tuple.get_str (Tuple::Album)}});
-            /* add Title node under a HiddenAlbum node so that it can
-             * still be searched by album name (without listing the
-             * album twice) */
-            add_to_database (e,
-             {{SearchField::Artist, artist},
-              {SearchField::HiddenAlbum, tuple.get_str (Tuple::Album)},
-              {SearchField::Title, tuple.get_str (Tuple::Title)}});
-        }
-        else
-        {
-            /* album and song have the same artist;
-             * add hierarchically under that artist */
-            add_to_database (e,
-             {{SearchField::Artist, artist},
-              {SearchField::Album, tuple.get_str (Tuple::Album)},
-              {SearchField::Title, tuple.get_str (Tuple::Title)}});
-        }
+        if (m_ready_serial != m_serial)
+            return;
 
-        /* add separately under genre */
-        add_to_database (e,
-         {{SearchField::Genre, tuple.get_str (Tuple::Genre)}});
+        m_items = std::move (m_ready);
+        m_hidden_items = m_ready_hidden;
+        m_ready_serial = -1;
     }
 
-    m_playlist = playlist;
+    update ();
+
+    if (m_results_func)
+        m_results_func (m_results_data);
 }
 
-static void search_recurse (SimpleHash<Key, Item> & domain,
- const Index<String> & terms, int mask, Index<const Item *> & results)
+void SearchModel::run ()
 {
-    domain.iterate ([&] (const Key & key, Item & item)
-    {
-        int count = terms.len ();
-        int new_mask = mask;
+    std::unique_lock<std::mutex> lock (m_mutex);
 
-        for (int t = 0, bit = 1; t < count; t ++, bit <<= 1)
+    while (! m_quit)
+    {
+        if (m_jobs.len ())
         {
-            if (! (new_mask & bit))
-                continue; /* skip term if it is already found */
-
-            if (strstr (item.folded, terms[t]))
-                new_mask &= ~bit; /* we found it */
-            else if (! item.children.n_items ())
-                break; /* quit early if there are no children to search */
+            DatabaseJob job = std::move (m_jobs[0]);
+            m_jobs.remove (0, 1);
+            m_busy = true;
+            lock.unlock ();
+
+            switch (job.type)
+            {
+            case DatabaseJob::Clear:
+                m_database.clear ();
+                break;
+            case DatabaseJob::Create:
+                m_database.create (std::move (job.tuples));
+                break;
+            case DatabaseJob::Update:
+                m_database.update (job.before, job.after, std::move (job.tuples));
+                break;
+            }
+
+            lock.lock ();
+            m_busy = false;
+            m_cond.notify_all ();
         }
+        else if (m_search_wanted)
+        {
+            Index<String> terms = std::move (m_terms);
+            int max_results = m_max_results;
+            int serial = m_serial;
 
-        /* adding an item with exactly one child is redundant, so avoid it */
-        if (! new_mask && item.children.n_items () != 1 &&
-         item.field != SearchField::HiddenAlbum)
-            results.append (& item);
+            m_search_wanted = false;
+            m_busy = true;
+            lock.unlock ();
 
-        search_recurse (item.children, terms, new_mask, results);
-    });
-}
+            run_search (terms, max_results, serial);
 
-static int item_compare (const Item * const & a, const Item * const & b)
-{
-    if (a->field < b->field)
-        return -1;
-    if (a->field > b->field)
-        return 1;
-
-    int val = str_compare (a->name, b->name);
-    if (val)
-        return val;
-
-    if (a->parent)
-        return b->parent ? item_compare (a->parent, b->parent) : 1;
-    else
-        return b->parent ? -1 : 0;
+            lock.lock ();
+            m_busy = false;
+            m_cond.notify_all ();
+        }
+        else
+            m_cond.wait (lock);
+    }
 }
 
-static int item_compare_pass1 (const Item * const & a, const Item * const & b)
+void SearchModel::run_search (const Index<String> & terms, int max_results, int serial)
 {
-    if (a->matches.len () > b->matches.len ())
-        return -1;
-    if (a->matches.len () < b->matches.len ())
-        return 1;
+    auto last = std::chrono::steady_clock::now ();
+
+    /* only the items with most songs are kept */
+    SearchResults found (max_results, {& m_database});
+
+    auto check = [&] (const SearchResults & so_far)
+    {
+        if (m_serial != serial)
+            return false;
+
+        auto now = std::chrono::steady_clock::now ();
+        if (now - last >= std::chrono::milliseconds (PARTIAL_DELAY))
+        {
+            publish (so_far, serial);
+            last = now;
+        }
 
-    return item_compare (a, b);
+        return true;
+    };
+
+    if (m_database.search (terms, found, check))
+        publish (found, serial);
 }
 
-void SearchModel::do_search (const Index<String> & terms, int max_results)
+/* called in the search thread, with the results so far or all of them */
+void SearchModel::publish (const SearchResults & found, int serial)
 {
-    m_items.clear ();
-    m_hidden_items = 0;
+    /* copied out, so that the thread can go on changing the database */
+    Index<SearchResult> results = m_database.get_results (found);
 
-    /* effectively limits number of search terms to 32 */
-    search_recurse (m_database, terms, (1 << terms.len ()) - 1, m_items);
+    std::lock_guard<std::mutex> lock (m_mutex);
 
-    /* first sort by number of songs per item */
-    m_items.sort (item_compare_pass1);
+    if (serial != m_serial)
+        return;
 
-    /* limit to items with most songs */
-    if (m_items.len () > max_results)
-    {
-        m_hidden_items = m_items.len () - max_results;
-        m_items.remove (max_results, -1);
-    }
+    m_ready = std::move (results);
+    m_ready_hidden = found.n_hidden ();
+    m_ready_serial = serial;
 
-    /* sort by item type, then item name */
-    m_items.sort (item_compare);
+    m_deliver.queue (aud::obj_member<SearchModel, & SearchModel::take_results>, this);
 }
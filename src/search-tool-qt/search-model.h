@@ -20,21 +20,19 @@
 #ifndef SEARCHMODEL_H
 #define SEARCHMODEL_H
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <QAbstractListModel>
 
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
-#include <libaudcore/multihash.h>
+#include <libaudcore/mainloop.h>
 #include <libaudcore/playlist.h>
 
-enum class SearchField {
-    Genre,
-    Artist,
-    Album,
-    HiddenAlbum,
-    Title,
-    count
-};
+#include "../search-tool-common/database.h"
 
 static constexpr aud::array<SearchField, const char *> start_tags =
     {"", "<b>", "<i>", "<i>", ""};
@@ -47,47 +45,36 @@ static inline const char * parent_prefix (SearchField parent)
      SearchField::HiddenAlbum) ? _("on") : _("by");
 }
 
-struct Key
-{
-    SearchField field;
-    String name;
-
-    bool operator== (const Key & b) const
-        { return field == b.field && name == b.name; }
-    unsigned hash () const
-        { return (unsigned) field + name.hash (); }
-};
-
-struct Item
-{
-    SearchField field;
-    String name, folded;
-    Item * parent;
-    SimpleHash<Key, Item> children;
-    Index<int> matches;
-
-    Item (SearchField field, const String & name, Item * parent) :
-        field (field),
-        name (name),
-        folded (str_tolower_utf8 (name)),
-        parent (parent) {}
-
-    Item (Item &&) = default;
-    Item & operator= (Item &&) = default;
-};
-
+/* The database is built and searched in a thread of its own, so that the
+ * window never waits for either.  It works on the tuples of the library
+ * playlist as they were when the change was signaled.  A new search stops
+ * the one in progress; while a search runs, the results found so far are
+ * sent every now and then. */
 class SearchModel : public QAbstractListModel
 {
 public:
+    SearchModel ();
+    ~SearchModel ();
+
     int num_items () const { return m_items.len (); }
-    const Item & item_at (int idx) const { return * m_items[idx]; }
+    const SearchResult & item_at (int idx) const { return m_items[idx]; }
     int num_hidden_items () const { return m_hidden_items; }
 
+    /* called when results come in, once update() has been */
+    void connect_results (void (* func) (void *), void * data) {
+        m_results_func = func;
+        m_results_data = data;
+    }
+
     void update ();
     void destroy_database ();
     void create_database (Playlist playlist);
+    void update_database (Playlist playlist, int before, int after);
     void do_search (const Index<String> & terms, int max_results);
 
+    /* waits for everything asked of the thread and takes the results */
+    void finish_search ();
+
 protected:
     int rowCount (const QModelIndex & parent) const override
     {
@@ -113,13 +100,50 @@ protected:
     QMimeData * mimeData (const QModelIndexList & indexes) const override;
 
 private:
-    void add_to_database (int entry, std::initializer_list<Key> keys);
+    struct DatabaseJob
+    {
+        enum {Clear, Create, Update} type;
+        int before, after;
+        Index<Tuple> tuples;
+    };
+
+    void submit (DatabaseJob && job);
+    void take_results ();
+
+    /* in the search thread */
+    void run ();
+    void run_search (const Index<String> & terms, int max_results, int serial);
+    void publish (const SearchResults & found, int serial);
 
     Playlist m_playlist;
-    SimpleHash<Key, Item> m_database;
-    Index<const Item *> m_items;
+    int m_entries = 0;
+    Index<SearchResult> m_items;
     int m_hidden_items = 0;
     int m_rows = 0;
+
+    void (* m_results_func) (void *) = nullptr;
+    void * m_results_data = nullptr;
+
+    /* shared with the search thread, under m_mutex */
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    Index<DatabaseJob> m_jobs;
+    Index<String> m_terms;
+    int m_max_results = 0;
+    bool m_search_wanted = false;
+    bool m_busy = false;
+    bool m_quit = false;
+    Index<SearchResult> m_ready;
+    int m_ready_hidden = 0;
+    int m_ready_serial = -1;
+
+    /* of the latest search; read by the thread without the lock, to stop
+     * a search once it is out of date */
+    std::atomic<int> m_serial {0};
+
+    SearchDatabase m_database;  /* only used in the thread */
+    QueuedFunc m_deliver;
+    std::thread m_thread;
 };
 
 #endif // SEARCHMODEL_H
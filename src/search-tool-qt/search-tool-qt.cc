@@ -122,6 +122,7 @@ private:
     void init_library ();
     void show_hide_widgets ();
     void search_timeout ();
+    void show_results ();
     void library_updated ();
     void location_changed ();
     void walk_library_paths ();
@@ -268,6 +269,9 @@ SearchWidget::SearchWidget () :
 
 void SearchWidget::init_library ()
 {
+    m_model.connect_results
+     (aud::obj_member<SearchWidget, & SearchWidget::show_results>, this);
+
     m_library.connect_update
      (aud::obj_member<SearchWidget, & SearchWidget::library_updated>, this);
 
@@ -310,8 +314,13 @@ void SearchWidget::search_timeout ()
     auto text = m_search_entry.text ().toUtf8 ();
     auto terms = str_list_to_index (str_tolower_utf8 (text), " ");
     m_model.do_search (terms, aud_get_int (CFG_ID, "max_results"));
-    m_model.update ();
 
+    m_search_timer.stop ();
+    m_search_pending = false;
+}
+
+void SearchWidget::show_results ()
+{
     int shown = m_model.num_items ();
     int hidden = m_model.num_hidden_items ();
     int total = shown + hidden;
@@ -329,9 +338,6 @@ void SearchWidget::search_timeout ()
     else
         m_stats_label.setText ((const char *)
          str_printf (dngettext (PACKAGE, "%d result", "%d results", total), total));
-
-    m_search_timer.stop ();
-    m_search_pending = false;
 }
 
 void SearchWidget::trigger_search ()
@@ -344,7 +350,9 @@ void SearchWidget::library_updated ()
 {
     if (m_library.is_ready ())
     {
-        m_model.create_database (m_library.playlist ());
+        int before, after;
+        m_library.get_changes (before, after);
+        m_model.update_database (m_library.playlist (), before, after);
         search_timeout ();
     }
     else
@@ -437,6 +445,8 @@ void SearchWidget::do_add (bool play, bool set_title)
     if (m_search_pending)
         search_timeout ();
 
+    m_model.finish_search ();
+
     int n_items = m_model.num_items ();
     int n_selected = 0;
 
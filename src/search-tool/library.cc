@@ -69,17 +69,34 @@ void Library::set_adding (bool adding)
     s_adding_library = adding ? this : nullptr;
 }
 
+/* Files found in the cache are held back and added with their tuples once
+ * the rest have been added, so that only the others are scanned. */
 bool Library::filter_cb (const char * filename, void *)
 {
+    FileStamp stamp;
+    bool have_stamp = get_file_stamp (filename, stamp);
+
     bool add = false;
     auto lh = s_adding_lock.take ();
 
     if (s_adding_library)
     {
-        bool * added = s_adding_library->m_added_table.lookup (String (filename));
+        String key (filename);
+        bool * added = s_adding_library->m_added_table.lookup (key);
+
+        if (have_stamp)
+            s_adding_library->m_stamps.add (key, stamp);
 
-        if ((add = ! added))
-            s_adding_library->m_added_table.add (String (filename), true);
+        if (! added)
+        {
+            s_adding_library->m_added_table.add (key, true);
+
+            Tuple tuple;
+            if (have_stamp && s_adding_library->m_cache.lookup (key, stamp, tuple))
+                s_adding_library->m_cached_items.append (key, std::move (tuple));
+            else
+                add = true;
+        }
         else
             (* added) = true;
     }
@@ -114,6 +131,10 @@ void Library::begin_add (const char * uri)
 
     m_playlist.remove_selected ();
 
+    m_stamps.clear ();
+    m_cached_items.clear ();
+    m_cache.load ();
+
     set_adding (true);
 
     Index<PlaylistAddItem> add;
@@ -129,6 +150,20 @@ void Library::check_ready_and_update (bool force)
         m_is_ready = now_ready;
         signal_update ();
     }
+
+    /* only known for the signal sent from playlist_update(); any other
+     * time, the playlist may have changed in ways not reported yet */
+    m_changed_before = m_changed_after = -1;
+}
+
+/* once the songs that were not in the cache have been scanned */
+void Library::save_cache ()
+{
+    if (! m_stamps.n_items () || s_adding_library || ! check_playlist (true, true))
+        return;
+
+    m_cache.save (m_playlist, m_stamps);
+    m_stamps.clear ();
 }
 
 void Library::add_complete ()
@@ -140,6 +175,9 @@ void Library::add_complete ()
     {
         set_adding (false);
 
+        m_cache.unload ();
+        m_playlist.insert_items (-1, std::move (m_cached_items), false);
+
         int entries = m_playlist.n_entries ();
 
         for (int entry = 0; entry < entries; entry ++)
@@ -161,17 +199,26 @@ void Library::add_complete ()
         m_playlist.sort_entries (Playlist::Path);
     }
 
+    save_cache ();
+
     if (! m_playlist.update_pending ())
         check_ready_and_update (false);
 }
 
 void Library::scan_complete ()
 {
+    save_cache ();
+
     if (! m_playlist.update_pending ())
         check_ready_and_update (false);
 }
 
 void Library::playlist_update ()
 {
-    check_ready_and_update (m_playlist.update_detail ().level >= Playlist::Metadata);
+    auto detail = m_playlist.update_detail ();
+
+    m_changed_before = detail.before;
+    m_changed_after = detail.after;
+
+    check_ready_and_update (detail.level >= Playlist::Metadata);
 }
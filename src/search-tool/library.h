@@ -24,6 +24,8 @@
 #include <libaudcore/multihash.h>
 #include <libaudcore/playlist.h>
 
+#include "../search-tool-common/tuple-cache.h"
+
 class Library
 {
 public:
@@ -36,6 +38,13 @@ public:
     void begin_add (const char * uri);
     void check_ready_and_update (bool force);
 
+    /* the unchanged entries at either end of the playlist, as of the
+     * update being signaled, or -1 if any entry may have changed */
+    void get_changes (int & before, int & after) const {
+        before = m_changed_before;
+        after = m_changed_after;
+    }
+
 private:
     void find_playlist ();
     void create_playlist ();
@@ -44,6 +53,8 @@ private:
 
     static bool filter_cb (const char * filename, void *);
 
+    void save_cache ();
+
     void add_complete (void);
     void scan_complete (void);
     void playlist_update (void);
@@ -52,8 +63,14 @@ private:
 
     Playlist m_playlist;
     bool m_is_ready = false;
+    int m_changed_before = -1, m_changed_after = -1;
     SimpleHash<String, bool> m_added_table;
 
+    /* filled in from the playlist add thread */
+    TupleCache m_cache;
+    SimpleHash<String, FileStamp> m_stamps;
+    Index<PlaylistAddItem> m_cached_items;
+
     /* to allow safe callback access from playlist add thread */
     static aud::spinlock s_adding_lock;
     static Library * s_adding_library;
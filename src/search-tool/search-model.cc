@@ -18,155 +18,54 @@
  */
 
 #include "search-model.h"
-#include <string.h>
 
 void SearchModel::destroy_database ()
 {
     m_playlist = Playlist ();
+    m_entries = 0;
+    m_database.clear ();
     m_items.clear ();
     m_hidden_items = 0;
-    m_database.clear ();
 }
 
-void SearchModel::add_to_database (int entry, std::initializer_list<Key> keys)
+void SearchModel::create_database (Playlist playlist)
 {
-    Item * parent = nullptr;
-    auto hash = & m_database;
-
-    for (auto & key : keys)
-    {
-        if (! key.name)
-            continue;
-
-        Item * item = hash->lookup (key);
-        if (! item)
-            item = hash->add (key, Item (key.field, key.name, parent));
-
-        item->matches.append (entry);
-
-        parent = item;
-        hash = & item->children;
-    }
+    m_playlist = playlist;
+    m_entries = playlist.n_entries ();
+    m_database.create (get_entry_tuples (playlist, 0, m_entries));
+    m_items.clear ();
+    m_hidden_items = 0;
 }
 
-void SearchModel::create_database (Playlist playlist)
+/* Brings the database up to date after the playlist has changed between
+ * its first "before" and last "after" entries.  The whole database is
+ * built again instead if the change is not known (a negative range) or
+ * covers much of the playlist. */
+void SearchModel::update_database (Playlist playlist, int before, int after)
 {
-    destroy_database ();
-
     int entries = playlist.n_entries ();
 
-    for (int e = 0; e < entries; e ++)
+    if (playlist != m_playlist ||
+     ! SearchDatabase::can_update (m_entries, entries, before, after))
     {
-        Tuple tuple = playlist.entry_tuple (e, Playlist::NoWait);
-        String album_artist = tuple.get_str (Tuple::AlbumArtist);
-        String artist = tuple.get_str (Tuple::Artist);
-
-        if (album_artist && album_artist != artist)
-        {
-            /* album and song have different artists;
-             * add separately under respective artists */
-            add_to_database (e,
-             {{SearchField::Artist, album_artist},
-              {SearchField::Album, tuple.get_str (Tuple::Album)}});
-            /* add Title node under a HiddenAlbum node so that it can
-             * still be searched by album name (without listing the
-             * album twice) */
-            add_to_database (e,
-             {{SearchField::Artist, artist},
-              {SearchField::HiddenAlbum, tuple.get_str (Tuple::Album)},
-              {SearchField::Title, tuple.get_str (Tuple::Title)}});
-        }
-        else
-        {
-            /* album and song have the same artist;
-             * add hierarchically under that artist */
-            add_to_database (e,
-             {{SearchField::Artist, artist},
-              {SearchField::Album, tuple.get_str (Tuple::Album)},
-              {SearchField::Title, tuple.get_str (Tuple::Title)}});
-        }
-
-        /* add separately under genre */
-        add_to_database (e,
-         {{SearchField::Genre, tuple.get_str (Tuple::Genre)}});
+        create_database (playlist);
+        return;
     }
 
-    m_playlist = playlist;
-}
-
-static void search_recurse (SimpleHash<Key, Item> & domain,
- const Index<String> & terms, int mask, Index<const Item *> & results)
-{
-    domain.iterate ([&] (const Key & key, Item & item)
-    {
-        int count = terms.len ();
-        int new_mask = mask;
-
-        for (int t = 0, bit = 1; t < count; t ++, bit <<= 1)
-        {
-            if (! (new_mask & bit))
-                continue; /* skip term if it is already found */
-
-            if (strstr (item.folded, terms[t]))
-                new_mask &= ~bit; /* we found it */
-            else if (! item.children.n_items ())
-                break; /* quit early if there are no children to search */
-        }
-
-        /* adding an item with exactly one child is redundant, so avoid it */
-        if (! new_mask && item.children.n_items () != 1 &&
-         item.field != SearchField::HiddenAlbum)
-            results.append (& item);
-
-        search_recurse (item.children, terms, new_mask, results);
-    });
-}
-
-static int item_compare (const Item * const & a, const Item * const & b)
-{
-    if (a->field < b->field)
-        return -1;
-    if (a->field > b->field)
-        return 1;
-
-    int val = str_compare (a->name, b->name);
-    if (val)
-        return val;
-
-    if (a->parent)
-        return b->parent ? item_compare (a->parent, b->parent) : 1;
-    else
-        return b->parent ? -1 : 0;
-}
-
-static int item_compare_pass1 (const Item * const & a, const Item * const & b)
-{
-    if (a->matches.len () > b->matches.len ())
-        return -1;
-    if (a->matches.len () < b->matches.len ())
-        return 1;
-
-    return item_compare (a, b);
+    m_entries = entries;
+    m_database.update (before, after,
+     get_entry_tuples (playlist, before, entries - after));
+    m_items.clear ();
+    m_hidden_items = 0;
 }
 
 void SearchModel::do_search (const Index<String> & terms, int max_results)
 {
-    m_items.clear ();
-    m_hidden_items = 0;
-
-    /* effectively limits number of search terms to 32 */
-    search_recurse (m_database, terms, (1 << terms.len ()) - 1, m_items);
-
-    /* first sort by number of songs per item */
-    m_items.sort (item_compare_pass1);
+    /* only the items with most songs are kept */
+    SearchResults results (max_results, {& m_database});
 
-    /* limit to items with most songs */
-    if (m_items.len () > max_results)
-    {
-        m_hidden_items = m_items.len () - max_results;
-        m_items.remove (max_results, -1);
-    }
+    m_database.search (terms, results);
 
-    /* sort by item type, then item name */
-    m_items.sort (item_compare);
+    m_items = m_database.get_results (results);
+    m_hidden_items = results.n_hidden ();
 }
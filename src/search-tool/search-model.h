@@ -22,17 +22,9 @@
 
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
-#include <libaudcore/multihash.h>
 #include <libaudcore/playlist.h>
 
-enum class SearchField {
-    Genre,
-    Artist,
-    Album,
-    HiddenAlbum,
-    Title,
-    count
-};
+#include "../search-tool-common/database.h"
 
 static constexpr aud::array<SearchField, const char *> start_tags =
     {"", "<b>", "<i>", "<i>", ""};
@@ -45,52 +37,23 @@ static inline const char * parent_prefix (SearchField parent)
      SearchField::HiddenAlbum) ? _("on") : _("by");
 }
 
-struct Key
-{
-    SearchField field;
-    String name;
-
-    bool operator== (const Key & b) const
-        { return field == b.field && name == b.name; }
-    unsigned hash () const
-        { return (unsigned) field + name.hash (); }
-};
-
-struct Item
-{
-    SearchField field;
-    String name, folded;
-    Item * parent;
-    SimpleHash<Key, Item> children;
-    Index<int> matches;
-
-    Item (SearchField field, const String & name, Item * parent) :
-        field (field),
-        name (name),
-        folded (str_tolower_utf8 (name)),
-        parent (parent) {}
-
-    Item (Item &&) = default;
-    Item & operator= (Item &&) = default;
-};
-
 class SearchModel
 {
 public:
     int num_items () const { return m_items.len (); }
-    const Item & item_at (int idx) const { return * m_items[idx]; }
+    const SearchResult & item_at (int idx) const { return m_items[idx]; }
     int num_hidden_items () const { return m_hidden_items; }
 
     void destroy_database ();
     void create_database (Playlist playlist);
+    void update_database (Playlist playlist, int before, int after);
     void do_search (const Index<String> & terms, int max_results);
 
 private:
-    void add_to_database (int entry, std::initializer_list<Key> keys);
-
     Playlist m_playlist;
-    SimpleHash<Key, Item> m_database;
-    Index<const Item *> m_items;
+    int m_entries = 0;
+    SearchDatabase m_database;
+    Index<SearchResult> m_items;
     int m_hidden_items = 0;
 };
 
@@ -173,7 +173,9 @@ void Library::signal_update ()
 {
     if (s_library->is_ready ())
     {
-        s_model.create_database (s_library->playlist ());
+        int before, after;
+        s_library->get_changes (before, after);
+        s_model.update_database (s_library->playlist (), before, after);
         search_timeout ();
     }
     else
@@ -293,16 +295,14 @@ static void list_get_value (void * user, int row, int column, GValue * value)
         desc.insert (-1, " ");
         desc.insert (-1, _("of this genre"));
     }
-    else if (item.parent)
+    else if (item.parent_name)
     {
-        auto parent = (item.parent->parent ? item.parent->parent : item.parent);
-
         desc.insert (-1, " ");
-        desc.insert (-1, parent_prefix (parent->field));
+        desc.insert (-1, parent_prefix (item.parent_field));
         desc.insert (-1, " ");
-        desc.insert (-1, start_tags[parent->field]);
-        desc.insert (-1, escape (parent->name));
-        desc.insert (-1, end_tags[parent->field]);
+        desc.insert (-1, start_tags[item.parent_field]);
+        desc.insert (-1, escape (item.parent_name));
+        desc.insert (-1, end_tags[item.parent_field]);
     }
 
     g_value_take_string (value, g_strdup_printf
@@ -32,6 +32,7 @@
 
 #include "xs_config.h"
 #include "xs_sidplay2.h"
+#include "../trace-common/trace.h"
 
 class SIDPlugin : public InputPlugin
 {
@@ -85,7 +86,7 @@ bool SIDPlugin::delayed_init()
 
     if (!m_initialized && !m_init_failed)
     {
-        /* Try to initialize emulator engine */
+        /* Load what the emulator engines share */
         m_initialized = xs_sidplayfp_init();
         if (!m_initialized)
             m_init_failed = true;
@@ -144,7 +145,8 @@ bool SIDPlugin::play(const char *filename, VFSFile &file)
         return false;
 
     /* Initialize the tune */
-    if (!xs_sidplayfp_load(buf.begin(), buf.len()))
+    SidEngine engine;
+    if (!engine.init() || !engine.load(buf.begin(), buf.len()))
         return false;
 
     /* Set general status information */
@@ -162,7 +164,7 @@ bool SIDPlugin::play(const char *filename, VFSFile &file)
     }
 
     /* Initialize song */
-    if (!xs_sidplayfp_initsong(subTune)) {
+    if (!engine.initsong(subTune)) {
         AUDERR("Couldn't initialize SID-tune '%s' (sub-tune #%i)!\n",
             filename, subTune);
         return false;
@@ -181,10 +183,11 @@ bool SIDPlugin::play(const char *filename, VFSFile &file)
 
     while (! check_stop ())
     {
+        TRACE_SPAN ("SID play");
         if (check_seek () >= 0)
             AUDWARN ("Seeking is not implemented, ignoring.\n");
 
-        int bufRemaining = xs_sidplayfp_fillbuffer(audioBuffer, audioBufSize);
+        int bufRemaining = engine.fillbuffer(audioBuffer, audioBufSize);
 
         write_audio (audioBuffer, bufRemaining);
         bytes_played += bufRemaining;
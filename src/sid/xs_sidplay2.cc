@@ -26,12 +26,12 @@
 
 #include "xs_config.h"
 #include "xs_sidplay2.h"
+#include "xs_songlengths.h"
 
 #include <pthread.h>
 #include <string.h>
 
 #include <sidplayfp/sidplayfp.h>
-#include <sidplayfp/SidDatabase.h>
 #include <sidplayfp/SidInfo.h>
 #include <sidplayfp/SidTune.h>
 #include <sidplayfp/SidTuneInfo.h>
@@ -41,13 +41,11 @@
 #include <libaudcore/vfs.h>
 
 struct SidState {
-    sidplayfp *currEng;
-    sidbuilder *currBuilder;
-    SidTune *currTune;
+    Index<char> kernal, basic, chargen;
+    bool roms_loaded = false;
 
-    SidDatabase database;
+    SongLengths database;
     bool database_loaded = false;
-    pthread_mutex_t database_mutex = PTHREAD_MUTEX_INITIALIZER;
 };
 
 static SidState state;
@@ -64,15 +62,57 @@ bool xs_sidplayfp_probe(const void *buf, int64_t bufSize)
 }
 
 
-/* Initialize SIDPlayFP
+/* Load the ROMs and the song length database
  */
 bool xs_sidplayfp_init()
+{
+    /* Load ROMs */
+    VFSFile kernal_file("file://" SIDDATADIR "/sidplayfp/kernal", "r");
+    VFSFile basic_file("file://" SIDDATADIR "/sidplayfp/basic", "r");
+    VFSFile chargen_file("file://" SIDDATADIR "/sidplayfp/chargen", "r");
+
+    if (kernal_file && basic_file && chargen_file)
+    {
+        state.kernal = kernal_file.read_all();
+        state.basic = basic_file.read_all();
+        state.chargen = chargen_file.read_all();
+
+        state.roms_loaded = (state.kernal.len() == 8192 &&
+         state.basic.len() == 8192 && state.chargen.len() == 4096);
+    }
+
+    /* Load song length database */
+    state.database_loaded = state.database.open(SIDDATADIR "/sidplayfp/Songlengths.md5");
+
+    return true;
+}
+
+
+/* Free the ROMs and the song length database
+ */
+void xs_sidplayfp_close()
+{
+    state.kernal.clear();
+    state.basic.clear();
+    state.chargen.clear();
+    state.roms_loaded = false;
+
+    if (state.database_loaded) {
+        state.database.close();
+        state.database_loaded = false;
+    }
+}
+
+
+/* Initialize the engine
+ */
+bool SidEngine::init()
 {
     /* Initialize the engine */
-    state.currEng = new sidplayfp;
+    currEng = new sidplayfp;
 
     /* Get current configuration */
-    SidConfig config = state.currEng->config();
+    SidConfig config = currEng->config();
 
     /* Configure channels and stuff */
     switch (xs_cfg.audioChannels)
@@ -90,24 +130,24 @@ bool xs_sidplayfp_init()
     config.frequency = xs_cfg.audioFrequency;
 
     /* Initialize builder object */
-    state.currBuilder = new ReSIDfpBuilder("ReSIDfp builder");
+    currBuilder = new ReSIDfpBuilder("ReSIDfp builder");
 
     /* Builder object created, initialize it */
-    state.currBuilder->create(state.currEng->info().maxsids());
-    if (!state.currBuilder->getStatus()) {
+    currBuilder->create(currEng->info().maxsids());
+    if (!currBuilder->getStatus()) {
         AUDERR("reSID->create() failed.\n");
         return false;
     }
 
 #if (LIBSIDPLAYFP_VERSION_MAJ << 8) + LIBSIDPLAYFP_VERSION_MIN < 0x020A
-    state.currBuilder->filter(xs_cfg.emulateFilters);
-    if (!state.currBuilder->getStatus()) {
+    currBuilder->filter(xs_cfg.emulateFilters);
+    if (!currBuilder->getStatus()) {
         AUDERR("reSID->filter(%d) failed.\n", xs_cfg.emulateFilters);
         return false;
     }
 #endif
 
-    config.sidEmulation = state.currBuilder;
+    config.sidEmulation = currBuilder;
 
     /* Clockspeed settings */
     switch (xs_cfg.clockSpeed) {
@@ -121,7 +161,6 @@ bool xs_sidplayfp_init()
 
     case XS_CLOCK_PAL:
         config.defaultC64Model = SidConfig::PAL;
-        xs_cfg.clockSpeed = XS_CLOCK_PAL;
         break;
     }
 
@@ -136,78 +175,49 @@ bool xs_sidplayfp_init()
     config.forceSidModel = xs_cfg.forceModel;
 
     /* Now set the emulator configuration */
-    if (!state.currEng->config(config)) {
+    if (!currEng->config(config)) {
         AUDERR("[SIDPlayFP] Emulator engine configuration failed!\n");
         return false;
     }
 
 #if (LIBSIDPLAYFP_VERSION_MAJ << 8) + LIBSIDPLAYFP_VERSION_MIN >= 0x020A
     /* Call filter() after config() to have an effect */
-    state.currEng->filter(0, xs_cfg.emulateFilters);
-    state.currEng->filter(1, xs_cfg.emulateFilters);
-    state.currEng->filter(2, xs_cfg.emulateFilters);
+    currEng->filter(0, xs_cfg.emulateFilters);
+    currEng->filter(1, xs_cfg.emulateFilters);
+    currEng->filter(2, xs_cfg.emulateFilters);
 #endif
 
-    /* Load ROMs */
-    VFSFile kernal_file("file://" SIDDATADIR "/sidplayfp/kernal", "r");
-    VFSFile basic_file("file://" SIDDATADIR "/sidplayfp/basic", "r");
-    VFSFile chargen_file("file://" SIDDATADIR "/sidplayfp/chargen", "r");
-
-    if (kernal_file && basic_file && chargen_file)
-    {
-        Index<char> kernal = kernal_file.read_all();
-        Index<char> basic = basic_file.read_all();
-        Index<char> chargen = chargen_file.read_all();
-
-        if (kernal.len() == 8192 && basic.len() == 8192 && chargen.len() == 4096)
-            state.currEng->setRoms((uint8_t*)kernal.begin(), (uint8_t*)basic.begin(), (uint8_t*)chargen.begin());
-    }
-
-    /* Load song length database */
-    state.database_loaded = state.database.open(SIDDATADIR "/sidplayfp/Songlengths.md5");
+    /* The engine copies the ROMs */
+    if (state.roms_loaded)
+        currEng->setRoms((uint8_t*)state.kernal.begin(), (uint8_t*)state.basic.begin(), (uint8_t*)state.chargen.begin());
 
     /* Create the sidtune */
-    state.currTune = new SidTune(0);
+    currTune = new SidTune(0);
 
     return true;
 }
 
 
-/* Close SIDPlayFP engine
+/* Close the engine
  */
-void xs_sidplayfp_close()
+SidEngine::~SidEngine()
 {
-    /* Free internals */
-    if (state.currBuilder) {
-        delete state.currBuilder;
-        state.currBuilder = nullptr;
-    }
-
-    if (state.currEng) {
-        delete state.currEng;
-        state.currEng = nullptr;
-    }
-
-    if (state.currTune) {
-        delete state.currTune;
-        state.currTune = nullptr;
-    }
-
-    if (state.database_loaded)
-        state.database.close();
+    delete currBuilder;
+    delete currEng;
+    delete currTune;
 }
 
 
 /* Initialize current song and sub-tune
  */
-bool xs_sidplayfp_initsong(int subtune)
+bool SidEngine::initsong(int subtune)
 {
-    if (!state.currTune->selectSong(subtune)) {
+    if (!currTune->selectSong(subtune)) {
         AUDERR("[SIDPlayFP] currTune->selectSong() failed\n");
         return false;
     }
 
-    if (!state.currEng->load(state.currTune)) {
+    if (!currEng->load(currTune)) {
         AUDERR("[SIDPlayFP] currEng->load() failed\n");
         return false;
     }
@@ -218,20 +228,20 @@ bool xs_sidplayfp_initsong(int subtune)
 
 /* Emulate and render audio data to given buffer
  */
-unsigned xs_sidplayfp_fillbuffer(char * audioBuffer, unsigned audioBufSize)
+unsigned SidEngine::fillbuffer(char * audioBuffer, unsigned audioBufSize)
 {
-    return state.currEng->play((short *)audioBuffer, audioBufSize / 2) * 2;
+    return currEng->play((short *)audioBuffer, audioBufSize / 2) * 2;
 }
 
 
 /* Load a given SID-tune file
  */
-bool xs_sidplayfp_load(const void *buf, int64_t bufSize)
+bool SidEngine::load(const void *buf, int64_t bufSize)
 {
     /* Try to get the tune */
-    state.currTune->read((const uint8_t*)buf, bufSize);
+    currTune->read((const uint8_t*)buf, bufSize);
 
-    return state.currTune->getStatus();
+    return currTune->getStatus();
 }
 
 
@@ -261,15 +271,11 @@ bool xs_sidplayfp_getinfo(xs_tuneinfo_t &ti, const void *buf, int64_t bufSize)
 
     if (state.database_loaded)
     {
-        pthread_mutex_lock(&state.database_mutex);
+        char md5[SidTune::MD5_LENGTH + 1];
+        myTune.createMD5New(md5);
 
         for (int i = 0; i < ti.nsubTunes; i++)
-        {
-            myTune.selectSong(i + 1);
-            ti.subTunes[i].tuneLength = state.database.lengthMs(myTune);
-        }
-
-        pthread_mutex_unlock(&state.database_mutex);
+            ti.subTunes[i].tuneLength = state.database.lengthMs(md5, i + 1);
     }
 
     return true;
@@ -5,12 +5,38 @@
 
 #include <stdint.h>
 
+class sidplayfp;
+class sidbuilder;
+class SidTune;
+
+/* State shared by all engines: the ROMs and the song length database.
+ * The other functions may be called from any thread once it is done.
+ */
 bool xs_sidplayfp_probe(const void *buf, int64_t bufSize);
 void xs_sidplayfp_close();
 bool xs_sidplayfp_init();
-bool xs_sidplayfp_initsong(int subtune);
-unsigned xs_sidplayfp_fillbuffer(char *, unsigned);
-bool xs_sidplayfp_load(const void *buf, int64_t bufSize);
 bool xs_sidplayfp_getinfo(xs_tuneinfo_t &ti, const void *buf, int64_t bufSize);
 
+/* An emulator with a tune loaded in it.  Each player has its own, so
+ * several can play at once.
+ */
+class SidEngine
+{
+public:
+    SidEngine() {}
+    SidEngine(const SidEngine &) = delete;
+    SidEngine &operator=(const SidEngine &) = delete;
+    ~SidEngine();
+
+    bool init();
+    bool load(const void *buf, int64_t bufSize);
+    bool initsong(int subtune);
+    unsigned fillbuffer(char *, unsigned);
+
+private:
+    sidplayfp *currEng = nullptr;
+    sidbuilder *currBuilder = nullptr;
+    SidTune *currTune = nullptr;
+};
+
 #endif /* XS_SIDPLAYFP_H */
@@ -0,0 +1,334 @@
+/*
+   XMMS-SID - SIDPlay input plugin for X MultiMedia System (XMMS)
+
+   Song length database index
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "xs_songlengths.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+#include "../vfs-common/atomic-file.h"
+
+/* The index is a header, then the slots of the hash table, then the
+ * lengths of all songs, which each slot points into.  A slot whose count
+ * is 0 is empty.  The table is at most half full, and a tune goes into the
+ * first empty slot from the one its MD5 starts with, so a lookup reads one
+ * slot most of the time.  Numbers are in the byte order of the machine.
+ */
+#define INDEX_MAGIC "SID lengths 1"
+
+struct IndexHeader {
+    char magic[16];
+    int64_t size, mtime;    /* of the text file it was compiled from */
+    uint32_t slots;         /* a power of two */
+    uint32_t lengths;
+};
+
+struct IndexSlot {
+    uint8_t md5[16];
+    uint32_t first, count;
+};
+
+static StringBuf index_path()
+{
+    return filename_build({aud_get_path(AudPath::UserDir), "sid-songlengths"});
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+/* 32 hex digits, as the database and SidTune write them */
+static bool parse_md5(const char *p, const char *end, uint8_t md5[16])
+{
+    if (end - p < 32)
+        return false;
+
+    for (int i = 0; i < 16; i++) {
+        int hi = hex_digit(p[2 * i]), lo = hex_digit(p[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+
+        md5[i] = (hi << 4) | lo;
+    }
+
+    return true;
+}
+
+/* A length as m:ss or m:ss.mmm, maybe followed by attributes such as (G)
+ * in older databases, which are skipped.
+ */
+static bool parse_length(const char *&p, const char *end, uint32_t &ms)
+{
+    uint32_t min = 0, sec = 0, frac = 0, scale = 1000;
+    const char *start = p;
+
+    while (p < end && *p >= '0' && *p <= '9')
+        min = min * 10 + (*p++ - '0');
+
+    if (p == start || p == end || *p++ != ':')
+        return false;
+
+    start = p;
+    while (p < end && *p >= '0' && *p <= '9')
+        sec = sec * 10 + (*p++ - '0');
+
+    if (p == start)
+        return false;
+
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (scale > 1) {
+                scale /= 10;
+                frac += (*p - '0') * scale;
+            }
+            p++;
+        }
+    }
+
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+        p++;
+
+    ms = (min * 60 + sec) * 1000 + frac;
+    return true;
+}
+
+static inline uint32_t slot_hash(const uint8_t md5[16])
+{
+    return md5[0] | (md5[1] << 8) | (md5[2] << 16) | ((uint32_t)md5[3] << 24);
+}
+
+static bool compile_index(const Index<char> &text, const struct stat &st, Index<char> &out)
+{
+    struct Entry {
+        uint8_t md5[16];
+        uint32_t first, count;
+    };
+
+    Index<Entry> entries;
+    Index<uint32_t> lengths;
+
+    const char *p = text.begin(), *end = text.end();
+
+    while (p < end) {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol)
+            eol = end;
+
+        /* md5=length length ...; comments start with ; and sections with [ */
+        Entry entry;
+        if (*p != ';' && *p != '[' && eol - p > 32 && parse_md5(p, eol, entry.md5) && p[32] == '=') {
+            const char *q = p + 33;
+            entry.first = lengths.len();
+
+            while (q < eol) {
+                uint32_t ms;
+
+                if (*q == ' ' || *q == '\t' || *q == '\r')
+                    q++;
+                else if (parse_length(q, eol, ms))
+                    lengths.append(ms);
+                else
+                    break;
+            }
+
+            entry.count = lengths.len() - entry.first;
+            if (entry.count)
+                entries.append(entry);
+        }
+
+        p = eol + 1;
+    }
+
+    if (!entries.len())
+        return false;
+
+    uint32_t slots = 1;
+    while (slots < 2 * (uint32_t)entries.len())
+        slots <<= 1;
+
+    out.resize(sizeof(IndexHeader) + slots * sizeof(IndexSlot) + lengths.len() * sizeof(uint32_t));
+    memset(out.begin(), 0, out.len());
+
+    auto header = (IndexHeader *)out.begin();
+    auto table = (IndexSlot *)(header + 1);
+
+    strcpy(header->magic, INDEX_MAGIC);
+    header->size = st.st_size;
+    header->mtime = st.st_mtime;
+    header->slots = slots;
+    header->lengths = lengths.len();
+
+    for (const Entry &entry : entries) {
+        uint32_t i = slot_hash(entry.md5) & (slots - 1);
+
+        while (table[i].count && memcmp(table[i].md5, entry.md5, 16))
+            i = (i + 1) & (slots - 1);
+
+        /* the first line for a tune wins, as in SidDatabase */
+        if (!table[i].count) {
+            memcpy(table[i].md5, entry.md5, 16);
+            table[i].first = entry.first;
+            table[i].count = entry.count;
+        }
+    }
+
+    memcpy(table + slots, lengths.begin(), lengths.len() * sizeof(uint32_t));
+
+    AUDINFO("Compiled song lengths of %d tunes.\n", entries.len());
+    return true;
+}
+
+bool SongLengths::map(const char *path)
+{
+#ifndef _WIN32
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            m_data = (const char *)map;
+            m_size = st.st_size;
+            m_mapped = true;
+        }
+    }
+
+    ::close(fd);
+#else
+    VFSFile file(filename_to_uri(path), "r");
+    if (file) {
+        m_buffer = file.read_all();
+        m_data = m_buffer.begin();
+        m_size = m_buffer.len();
+    }
+#endif
+
+    return m_data != nullptr;
+}
+
+/* Open the index of the database at path, compiling it if there is none
+ * or if the database has changed since.
+ */
+bool SongLengths::open(const char *path)
+{
+    close();
+
+    struct stat st;
+    if (stat(path, &st) < 0)
+        return false;
+
+    StringBuf cache = index_path();
+
+    if (map(cache)) {
+        auto header = (const IndexHeader *)m_data;
+
+        if (m_size >= sizeof(IndexHeader) &&
+            !memcmp(header->magic, INDEX_MAGIC, sizeof INDEX_MAGIC) &&
+            header->size == st.st_size && header->mtime == st.st_mtime &&
+            header->slots && !(header->slots & (header->slots - 1)) &&
+            m_size == sizeof(IndexHeader) + header->slots * (uint64_t)sizeof(IndexSlot) +
+                header->lengths * (uint64_t)sizeof(uint32_t))
+            return true;
+
+        close();
+    }
+
+    VFSFile file(filename_to_uri(path), "r");
+    if (!file)
+        return false;
+
+    if (!compile_index(file.read_all(), st, m_buffer))
+        return false;
+
+    write_file_atomic(cache, [this](FILE *file) {
+        fwrite(m_buffer.begin(), 1, m_buffer.len(), file);
+    });
+
+    m_data = m_buffer.begin();
+    m_size = m_buffer.len();
+    return true;
+}
+
+
+void SongLengths::close()
+{
+#ifndef _WIN32
+    if (m_mapped)
+        munmap((void *)m_data, m_size);
+#endif
+
+    m_buffer.clear();
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+}
+
+
+int SongLengths::lengthMs(const char *md5, int song) const
+{
+    uint8_t key[16];
+    if (!m_data || !md5 || !parse_md5(md5, md5 + strlen(md5), key))
+        return -1;
+
+    auto header = (const IndexHeader *)m_data;
+    auto table = (const IndexSlot *)(header + 1);
+    auto lengths = (const uint32_t *)(table + header->slots);
+
+    uint32_t i = slot_hash(key) & (header->slots - 1);
+
+    while (table[i].count) {
+        const IndexSlot &slot = table[i];
+
+        if (!memcmp(slot.md5, key, 16)) {
+            if (song < 1 || (uint32_t)song > slot.count ||
+                slot.first + (uint64_t)slot.count > header->lengths)
+                return -1;
+
+            return lengths[slot.first + song - 1];
+        }
+
+        i = (i + 1) & (header->slots - 1);
+    }
+
+    return -1;
+}
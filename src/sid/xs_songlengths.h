@@ -0,0 +1,58 @@
+/*
+   XMMS-SID - SIDPlay input plugin for X MultiMedia System (XMMS)
+
+   Song length database index
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef XS_SONGLENGTHS_H
+#define XS_SONGLENGTHS_H
+
+#include <stddef.h>
+
+#include <libaudcore/index.h>
+
+/* The lengths in HVSC's Songlengths.md5, compiled into a hash table keyed
+ * by the MD5 of each tune.  The table is saved in the user's directory and
+ * mapped from there, so the text file is only parsed again when it changes.
+ * Lookups only read the table and can be made from any thread.
+ */
+class SongLengths
+{
+public:
+    SongLengths() {}
+    SongLengths(const SongLengths &) = delete;
+    SongLengths &operator=(const SongLengths &) = delete;
+    ~SongLengths() { close(); }
+
+    bool open(const char *path);
+    void close();
+
+    /* Length of a song in milliseconds, or -1 if it is not known.  md5 is
+     * the tune's MD5 in hex, as SidTune::createMD5New() gives it; songs
+     * are counted from 1.
+     */
+    int lengthMs(const char *md5, int song) const;
+
+private:
+    bool map(const char *path);
+
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+    Index<char> m_buffer;
+};
+
+#endif /* XS_SONGLENGTHS_H */
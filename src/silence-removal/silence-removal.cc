@@ -25,7 +25,11 @@
 
 #include <math.h>
 
+#include "../trace-common/trace.h"
+
 #define MAX_BUFFER_SECS  10
+#define BLOCK            256  /* samples tested at once for the loudest one */
+#define LANES            8
 
 class SilenceRemoval : public EffectPlugin
 {
@@ -131,30 +135,82 @@ static void buffer_with_overflow (const float * data, int len)
     }
 }
 
-Index<float> & SilenceRemoval::process (Index<float> & data)
+/* the largest absolute value in a block, kept in LANES partial maxima so
+ * the compiler can use vector instructions */
+static float block_peak (const float * __restrict data, int len)
 {
-    const int threshold_db = aud_get_int ("silence-removal", "threshold");
-    const float threshold = powf (10.0f, threshold_db / 20.0f);
+    float lanes[LANES] = {};
+    int i = 0;
+
+    for (; i + LANES <= len; i += LANES)
+    {
+        for (int j = 0; j < LANES; j ++)
+        {
+            float a = fabsf (data[i + j]);
+            lanes[j] = (a > lanes[j]) ? a : lanes[j];
+        }
+    }
 
-    float * first_sample = nullptr;
-    float * last_sample = nullptr;
+    float peak = 0;
+    for (int j = 0; j < LANES; j ++)
+        peak = aud::max (peak, lanes[j]);
+    for (; i < len; i ++)
+        peak = aud::max (peak, fabsf (data[i]));
 
-    for (float & sample : data)
+    return peak;
+}
+
+/* Only the block containing the first or last sample above the threshold
+ * is tested sample by sample; for music that is the first and the last
+ * block of the buffer. */
+static float * find_first (float * begin, float * end, float threshold)
+{
+    for (float * block = begin; block < end; block += BLOCK)
     {
-        if (sample > threshold || sample < -threshold)
+        int len = aud::min ((int) (end - block), BLOCK);
+        if (block_peak (block, len) <= threshold)
+            continue;
+
+        for (float * sample = block; ; sample ++)
         {
-            if (! first_sample)
-                first_sample = & sample;
+            if (* sample > threshold || * sample < -threshold)
+                return sample;
+        }
+    }
 
-            last_sample = & sample;
+    return nullptr;
+}
+
+static float * find_last (float * begin, float * end, float threshold)
+{
+    for (float * block_end = end; block_end > begin; block_end -= BLOCK)
+    {
+        int len = aud::min ((int) (block_end - begin), BLOCK);
+        if (block_peak (block_end - len, len) <= threshold)
+            continue;
+
+        for (float * sample = block_end - 1; ; sample --)
+        {
+            if (* sample > threshold || * sample < -threshold)
+                return sample;
         }
     }
 
+    return nullptr;
+}
+
+Index<float> & SilenceRemoval::process (Index<float> & data)
+{
+    TRACE_SPAN ("Silence Removal process");
+    const int threshold_db = aud_get_int ("silence-removal", "threshold");
+    const float threshold = powf (10.0f, threshold_db / 20.0f);
+
+    float * first_sample = find_first (data.begin (), data.end (), threshold);
+    float * last_sample = first_sample ? find_last (first_sample, data.end (), threshold) : nullptr;
+
     first_sample = align_to_frame (data.begin (), first_sample, false);
     last_sample = align_to_frame (data.begin (), last_sample, true);
 
-    output.resize (0);
-
     if (first_sample)
     {
         /* do not skip leading silence if non-silence has been seen */
@@ -163,6 +219,20 @@ Index<float> & SilenceRemoval::process (Index<float> & data)
 
         initial_silence = false;
 
+        /* with no saved silence to insert, the non-silent portion is
+         * already in place: save the trailing silence and hand back the
+         * same buffer with it cut off */
+        int trailing = data.end () - last_sample;
+
+        if (! buffer.len () && first_sample == data.begin () && trailing <= buffer.size ())
+        {
+            buffer.copy_in (last_sample, trailing);
+            data.resize (data.len () - trailing);
+            return data;
+        }
+
+        output.resize (0);
+
         /* copy any saved silence from previous call */
         buffer.move_out (output, -1, -1);
 
@@ -174,6 +244,8 @@ Index<float> & SilenceRemoval::process (Index<float> & data)
     }
     else
     {
+        output.resize (0);
+
         /* if non-silence has been seen, save entire silent chunk */
         if (! initial_silence)
             buffer_with_overflow (data.begin (), data.len ());
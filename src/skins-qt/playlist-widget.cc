@@ -43,6 +43,9 @@
 #include <libaudcore/playlist.h>
 #include <libaudqt/libaudqt.h>
 
+#include <math.h>
+#include <stdlib.h>
+
 #include <QMimeData>
 
 enum {
@@ -126,141 +129,231 @@ void PlaylistWidget::cancel_all ()
 
     if (m_hover != -1)
     {
+        queue_draw_hover (m_hover);
         m_hover = -1;
-        queue_draw ();
     }
 
     popup_hide ();
 }
 
-void PlaylistWidget::draw (QPainter & cr)
+QStaticText PlaylistWidget::shape_text (const char * text) const
 {
-    int active_entry = m_playlist.get_position ();
-    int left = 3, right = 3;
-    int width;
-    QRect rect;
+    QStaticText shaped ((QString (text)));
+    shaped.setTextFormat (Qt::PlainText);
+    shaped.prepare (QTransform (), * m_font);
+    return shaped;
+}
 
-    cr.setFont (* m_font);
+static int text_width (const QStaticText & text)
+{
+    return (int) ceil (text.size ().width ());
+}
 
-    /* background */
+/* centered in the row, as drawText() does with Qt::AlignVCenter */
+void PlaylistWidget::draw_text (QPainter & cr, double x, int top,
+ const QStaticText & text) const
+{
+    cr.drawStaticText (QPointF (x, top + (m_row_height - text.size ().height ()) / 2), text);
+}
 
-    cr.fillRect (cr.window (), QColor (skin.colors[SKIN_PLEDIT_NORMALBG]));
+void PlaylistWidget::queue_draw_row (int row)
+{
+    update (0, m_offset + m_row_height * row - 1, m_width, m_row_height + 2);
+}
 
-    /* playlist title */
+void PlaylistWidget::queue_draw_hover (int hover)
+{
+    update (0, m_offset + m_row_height * (hover - m_first) - 1, m_width, 2);
+}
 
-    if (m_offset)
-    {
-        cr.setPen (QColor (skin.colors[SKIN_PLEDIT_NORMAL]));
-        cr.drawText (left, 0, m_width - left - right, m_row_height,
-         Qt::AlignCenter, (const char *) m_title_text);
-    }
+/* Brings the cached rows up to date with the playlist, shaping only the
+ * text that is new.  If queue is true, repaints what has changed: only
+ * the rows that look different, after moving the others by blitting if
+ * the list has scrolled, or everything if the columns have moved. */
+void PlaylistWidget::update_rows (bool queue)
+{
+    int active_entry = m_playlist.get_position ();
+    int focus = m_playlist.get_focus ();
+    bool numbers = aud_get_bool ("show_numbers_in_pl");
+    bool queued = m_playlist.n_queued () > 0;
 
-    /* selection highlight */
+    /* don't show rectangle if this is the only selected entry */
+    if (focus >= 0 && m_playlist.entry_selected (focus) && m_playlist.n_selected () <= 1)
+        focus = -1;
 
-    for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
-    {
-        if (m_playlist.entry_selected (i))
-            cr.fillRect (0, m_offset + m_row_height * (i - m_first), m_width,
-             m_row_height, QColor (skin.colors[SKIN_PLEDIT_SELECTEDBG]));
-    }
+    int n_rows = aud::clamp (m_length - m_first, 0, m_rows);
+    int number_width = 0, length_width = 0, queue_width = 0;
 
-    /* entry numbers */
+    Index<Row> rows;
+    rows.insert (0, n_rows);
 
-    if (aud_get_bool ("show_numbers_in_pl"))
+    for (int i = 0; i < n_rows; i ++)
     {
-        width = 0;
+        int entry = m_first + i;
+        int old = entry - m_cache_first;
+        auto prev = (old >= 0 && old < m_row_cache.len ()) ? & m_row_cache[old] : nullptr;
+        Row & row = rows[i];
+
+        Tuple tuple = m_playlist.entry_tuple (entry, Playlist::NoWait);
+        row.title = tuple.get_str (Tuple::FormattedTitle);
+        row.length = tuple.get_int (Tuple::Length);
+        row.queued = queued ? m_playlist.queue_find_entry (entry) : -1;
+        row.selected = m_playlist.entry_selected (entry);
+        row.current = (entry == active_entry);
+        row.focused = (entry == focus);
+
+        if (numbers)
+        {
+            if (prev && ! prev->number_text.text ().isEmpty ())
+                row.number_text = prev->number_text;
+            else
+                row.number_text = shape_text (str_printf ("%d.", 1 + entry));
 
-        for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+            number_width = aud::max (number_width, text_width (row.number_text));
+        }
+
+        if (row.length >= 0)
         {
-            char buf[16];
-            snprintf (buf, sizeof buf, "%d.", 1 + i);
+            if (prev && prev->length == row.length)
+                row.length_text = prev->length_text;
+            else
+                row.length_text = shape_text (str_format_time (row.length));
 
-            cr.setPen (QColor (skin.colors[(i == active_entry) ?
-             SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]));
-            cr.drawText (left, m_offset + m_row_height * (i - m_first),
-             m_width - left - right, m_row_height,
-             Qt::AlignLeft | Qt::AlignVCenter, buf, & rect);
+            length_width = aud::max (length_width, text_width (row.length_text));
+        }
 
-            width = aud::max (width, rect.width ());
+        if (row.queued >= 0)
+        {
+            if (prev && prev->queued == row.queued)
+                row.queue_text = prev->queue_text;
+            else
+                row.queue_text = shape_text (str_printf ("(#%d)", 1 + row.queued));
+
+            queue_width = aud::max (queue_width, text_width (row.queue_text));
         }
 
-        left += width + 4;
+        if (prev && prev->title == row.title)
+            row.title_text = prev->title_text;
+        else
+            row.title_text = shape_text (row.title);
     }
 
-    /* entry lengths */
+    int title_left = 3 + (numbers ? number_width + 4 : 0);
+    int queue_right = m_width - 3 - (length_width + 6);
+    int title_right = queue_right - (queued ? queue_width + 6 : 0);
 
-    width = 0;
+    bool moved = (title_left != m_title_left || title_right != m_title_right ||
+     queue_right != m_queue_right || m_offset != m_cache_offset ||
+     m_title_text != m_cache_title);
 
-    for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
-    {
-        Tuple tuple = m_playlist.entry_tuple (i, Playlist::NoWait);
-        int len = tuple.get_int (Tuple::Length);
-        if (len < 0)
-            continue;
+    Index<Row> old_rows = std::move (m_row_cache);
+    int scrolled = m_cache_first - m_first;
 
-        cr.setPen (QColor (skin.colors[(i == active_entry) ?
-         SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]));
-        cr.drawText (left, m_offset + m_row_height * (i - m_first),
-         m_width - left - right, m_row_height,
-         Qt::AlignRight | Qt::AlignVCenter,
-         (const char *) str_format_time (len), & rect);
+    m_row_cache = std::move (rows);
+    m_cache_first = m_first;
+    m_cache_offset = m_offset;
+    m_cache_title = m_title_text;
+    m_title_left = title_left;
+    m_title_right = title_right;
+    m_queue_right = queue_right;
 
-        width = aud::max (width, rect.width ());
-    }
+    if (! queue)
+        return;
 
-    right += width + 6;
+    /* the hover line would be blitted along with the rows */
+    if (moved || ! old_rows.len () || abs (scrolled) >= m_rows ||
+     (scrolled && m_hover != -1))
+    {
+        queue_draw ();
+        return;
+    }
 
-    /* queue positions */
+    /* the rows uncovered are repainted by Qt */
+    if (scrolled)
+        QWidget::scroll (0, scrolled * m_row_height,
+         QRect (0, m_offset, m_width, m_row_height * m_rows));
 
-    if (m_playlist.n_queued ())
+    for (int i = 0; i < m_rows; i ++)
     {
-        width = 0;
+        int old = i - scrolled;
+        bool had = (old >= 0 && old < old_rows.len ());
+        bool has = (i < n_rows);
 
-        for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
-        {
-            int pos = m_playlist.queue_find_entry (i);
-            if (pos < 0)
-                continue;
+        if (had != has || (has && ! m_row_cache[i].looks_like (old_rows[old])))
+            queue_draw_row (i);
+    }
+}
 
-            char buf[16];
-            snprintf (buf, sizeof buf, "(#%d)", 1 + pos);
+void PlaylistWidget::draw (QPainter & cr)
+{
+    QRect clip (0, 0, m_width, m_height);
 
-            cr.setPen (QColor (skin.colors[(i == active_entry) ?
-             SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]));
-            cr.drawText (left, m_offset + m_row_height * (i - m_first),
-             m_width - left - right, m_row_height,
-             Qt::AlignRight | Qt::AlignVCenter, buf, & rect);
+    /* a partial repaint is of rows already brought up to date */
+    if (cr.hasClipping ())
+        clip = cr.clipBoundingRect ().toAlignedRect ();
+    else
+        update_rows (false);
 
-            width = aud::max (width, rect.width ());
-        }
+    cr.setFont (* m_font);
 
-        right += width + 6;
-    }
+    /* background */
+
+    cr.fillRect (cr.window (), QColor (skin.colors[SKIN_PLEDIT_NORMALBG]));
+
+    /* playlist title */
 
-    /* titles */
+    if (m_offset && clip.top () < m_offset)
+    {
+        cr.setPen (QColor (skin.colors[SKIN_PLEDIT_NORMAL]));
+        cr.drawText (3, 0, m_width - 6, m_row_height, Qt::AlignCenter,
+         (const char *) m_title_text);
+    }
 
-    for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+    for (int i = 0; i < m_row_cache.len (); i ++)
     {
-        Tuple tuple = m_playlist.entry_tuple (i, Playlist::NoWait);
-        String title = tuple.get_str (Tuple::FormattedTitle);
+        const Row & row = m_row_cache[i];
+        int top = m_offset + m_row_height * i;
+
+        if (top > clip.bottom () || top + m_row_height <= clip.top ())
+            continue;
 
-        cr.setPen (QColor (skin.colors[(i == active_entry) ?
+        /* selection highlight */
+
+        if (row.selected)
+            cr.fillRect (0, top, m_width, m_row_height,
+             QColor (skin.colors[SKIN_PLEDIT_SELECTEDBG]));
+
+        cr.setPen (QColor (skin.colors[row.current ?
          SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]));
-        cr.drawText (left, m_offset + m_row_height * (i - m_first),
-         m_width - left - right, m_row_height,
-         Qt::AlignLeft | Qt::AlignVCenter, (const char *) title);
-    }
 
-    /* focus rectangle */
+        /* entry number, length and queue position */
 
-    int focus = m_playlist.get_focus ();
+        if (! row.number_text.text ().isEmpty ())
+            draw_text (cr, 3, top, row.number_text);
 
-    /* don't show rectangle if this is the only selected entry */
-    if (focus >= m_first && focus <= m_first + m_rows - 1 &&
-        (! m_playlist.entry_selected (focus) || m_playlist.n_selected () > 1))
-    {
-        cr.setPen (QColor (skin.colors[SKIN_PLEDIT_NORMAL]));
-        cr.drawRect (0, m_offset + m_row_height * (focus - m_first), m_width - 1, m_row_height - 1);
+        if (row.length >= 0)
+            draw_text (cr, m_width - 3 - row.length_text.size ().width (), top,
+             row.length_text);
+
+        if (row.queued >= 0)
+            draw_text (cr, m_queue_right - row.queue_text.size ().width (), top,
+             row.queue_text);
+
+        /* title */
+
+        cr.save ();
+        cr.setClipRect (m_title_left, top, m_title_right - m_title_left,
+         m_row_height, Qt::IntersectClip);
+        draw_text (cr, m_title_left, top, row.title_text);
+        cr.restore ();
+
+        /* focus rectangle */
+
+        if (row.focused)
+        {
+            cr.setPen (QColor (skin.colors[SKIN_PLEDIT_NORMAL]));
+            cr.drawRect (0, top, m_width - 1, m_row_height - 1);
+        }
     }
 
     /* hover line */
@@ -296,6 +389,9 @@ void PlaylistWidget::set_font (const char * font)
     m_font.capture (new QFont (audqt::qfont_from_string (font)));
     m_metrics.capture (new QFontMetrics (* m_font, this));
     m_row_height = m_metrics->height ();
+
+    /* shaped in the old font */
+    m_row_cache.clear ();
     refresh ();
 }
 
@@ -313,9 +409,10 @@ void PlaylistWidget::refresh ()
         cancel_all ();
         m_first = 0;
         ensure_visible (m_playlist.get_focus ());
+        m_row_cache.clear ();
     }
 
-    queue_draw ();
+    update_rows (true);
 
     if (m_slider)
         m_slider->refresh ();
@@ -548,7 +645,11 @@ void PlaylistWidget::scroll_to (int row)
 {
     cancel_all ();
     m_first = row;
-    refresh ();
+    calc_layout ();
+    update_rows (true);
+
+    if (m_slider)
+        m_slider->refresh ();
 }
 
 void PlaylistWidget::set_focused (int row)
@@ -575,17 +676,22 @@ void PlaylistWidget::hover (int x, int y)
 
     if (row != m_hover)
     {
+        if (m_hover != -1)
+            queue_draw_hover (m_hover);
+
         m_hover = row;
-        queue_draw ();
+        queue_draw_hover (m_hover);
     }
 }
 
 int PlaylistWidget::hover_end ()
 {
     int temp = m_hover;
-    m_hover = -1;
 
-    queue_draw ();
+    if (m_hover != -1)
+        queue_draw_hover (m_hover);
+
+    m_hover = -1;
     return temp;
 }
 
@@ -28,6 +28,8 @@
 #ifndef SKINS_UI_SKINNED_PLAYLIST_H
 #define SKINS_UI_SKINNED_PLAYLIST_H
 
+#include <QStaticText>
+
 #include <libaudcore/hook.h>
 #include <libaudcore/mainloop.h>
 #include <libaudcore/playlist.h>
@@ -56,6 +58,22 @@ public:
     int hover_end ();
 
 private:
+    /* what is drawn of a visible row, with its text shaped once and kept
+     * for as long as the row shows the same thing */
+    struct Row
+    {
+        String title;
+        int length = -1, queued = -1;
+        bool selected = false, current = false, focused = false;
+        QStaticText number_text, length_text, queue_text, title_text;
+
+        bool looks_like (const Row & b) const
+        {
+            return title == b.title && length == b.length && queued == b.queued &&
+             selected == b.selected && current == b.current && focused == b.focused;
+        }
+    };
+
     void draw (QPainter & cr) override;
     bool button_press (QMouseEvent * event) override;
     bool button_release (QMouseEvent * event) override;
@@ -68,6 +86,12 @@ private:
 
     void update_title ();
     void calc_layout ();
+    void update_rows (bool queue);
+
+    QStaticText shape_text (const char * text) const;
+    void draw_text (QPainter & cr, double x, int top, const QStaticText & text) const;
+    void queue_draw_row (int row);
+    void queue_draw_hover (int hover);
 
     int calc_position (int y) const;
     int adjust_position (bool relative, int position) const;
@@ -98,6 +122,12 @@ private:
     int m_length = 0;
     int m_width = 0, m_height = 0, m_row_height = 1, m_offset = 0, m_rows = 0, m_first = 0;
     int m_scroll = 0, m_hover = -1, m_drag = 0, m_popup_pos = -1;
+
+    /* as last drawn, starting from entry m_cache_first */
+    Index<Row> m_row_cache;
+    int m_cache_first = 0, m_cache_offset = 0;
+    String m_cache_title;
+    int m_title_left = 0, m_title_right = 0, m_queue_right = 0;
     QueuedFunc m_popup_timer;
 };
 
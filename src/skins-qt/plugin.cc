@@ -215,6 +215,7 @@ QtSkinsProxy::~QtSkinsProxy ()
     skins_cleanup_main ();
 
     skin = Skin ();
+    skin_cache_clear ();
 
     user_skin_dir = String ();
     skin_thumb_dir = String ();
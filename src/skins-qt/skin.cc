@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <QPainter>
 
 #include <libaudcore/audstrings.h>
@@ -89,11 +90,27 @@ static const uint32_t default_vis_colors[24] = {
     qRgb (200, 200, 200)
 };
 
+/* skins used before, so that switching back to one is instant */
+#define SKIN_CACHE_SIZE 4
+
+struct CachedSkin {
+    String path;
+    int64_t mtime;
+    Skin skin;
+
+    CachedSkin (const String & path, int64_t mtime, Skin && skin) :
+        path (path), mtime (mtime), skin (std::move (skin)) {}
+};
+
 Skin skin;
 
-static bool skin_load_pixmap_id (SkinPixmapId id, const char * path)
+static String skin_path;
+static int64_t skin_mtime;
+static Index<CachedSkin> skin_cache;  /* oldest first */
+
+static bool skin_load_pixmap_id (SkinPixmapId id, SkinFiles & files)
 {
-    StringBuf filename = skin_pixmap_locate (path, skin_pixmap_id_map[id].name,
+    StringBuf filename = files.locate_pixmap (skin_pixmap_id_map[id].name,
      skin_pixmap_id_map[id].alt_name);
 
     if (! filename)
@@ -103,7 +120,8 @@ static bool skin_load_pixmap_id (SkinPixmapId id, const char * path)
     }
 
     QImage & image = skin.pixmaps[id];
-    image.load ((const char *) filename);
+    Index<char> data = files.read (filename);
+    image.loadFromData ((const uchar *) data.begin (), data.len ());
 
     if (! image.isNull () && image.format () != QImage::Format_RGB32)
         image = image.convertToFormat (QImage::Format_RGB32);
@@ -157,15 +175,14 @@ static void skin_get_eq_spline_colors (const QImage & image)
         skin.eq_spline_colors[i] = image.pixel (115, i + 294);
 }
 
-static void skin_load_viscolor (const char * path)
+static void skin_load_viscolor (SkinFiles & files)
 {
     memcpy (skin.vis_colors, default_vis_colors, sizeof skin.vis_colors);
 
-    VFSFile file = open_local_file_nocase (path, "viscolor.txt");
-    if (! file)
+    Index<char> buffer = files.read ("viscolor.txt");
+    if (! buffer.len ())
         return;
 
-    Index<char> buffer = file.read_all ();
     buffer.append (0);  /* null-terminated */
 
     char * string = buffer.begin ();
@@ -201,13 +218,11 @@ static void skin_numbers_generate_dash (QImage & image)
     image = std::move (temp);
 }
 
-static bool skin_load_pixmaps (const char * path)
+static bool skin_load_pixmaps (SkinFiles & files)
 {
-    AUDDBG ("Loading pixmaps in %s\n", path);
-
     /* eq_ex.bmp was added after Winamp 2.0 so some skins do not include it */
     for (int i = 0; i < SKIN_PIXMAP_COUNT; i ++)
-        if (! skin_load_pixmap_id ((SkinPixmapId) i, path) && i != SKIN_EQ_EX)
+        if (! skin_load_pixmap_id ((SkinPixmapId) i, files) && i != SKIN_EQ_EX)
             return false;
 
     skin_get_textcolors (skin.pixmaps[SKIN_TEXT]);
@@ -224,49 +239,95 @@ static bool skin_load_data (const char * path)
     if (! g_file_test (path, G_FILE_TEST_EXISTS))
         return false;
 
-    StringBuf archive_path;
-    if (file_is_archive (path))
+    /* archives are read into memory rather than unpacked */
+    SkinFiles files;
+    if (! files.open (path))
     {
-        AUDDBG ("Attempt to load archive\n");
-        archive_path = archive_decompress (path);
-
-        if (! archive_path)
-        {
-            AUDDBG ("Unable to extract skin archive (%s)\n", path);
-            return false;
-        }
-
-        path = archive_path;
+        AUDDBG ("Unable to read skin (%s)\n", path);
+        return false;
     }
 
-    bool success = skin_load_pixmaps (path);
+    bool success = skin_load_pixmaps (files);
 
     if (success)
     {
-        skin_load_hints (path);
-        skin_load_pl_colors (path);
-        skin_load_viscolor (path);
-        skin_load_masks (path);
+        skin_load_hints (files);
+        skin_load_pl_colors (files);
+        skin_load_viscolor (files);
+        skin_load_masks (files);
     }
     else
         AUDDBG ("Skin loading failed\n");
 
-    if (archive_path)
-        del_directory (archive_path);
-
     return success;
 }
 
+/* -1 if there is no such file */
+static int64_t skin_get_mtime (const char * path)
+{
+    GStatBuf st;
+    return (g_stat (path, & st) < 0) ? -1 : (int64_t) st.st_mtime;
+}
+
+/* a skin changed on disk since it was cached is loaded again */
+static bool skin_take_cached (const char * path, int64_t mtime)
+{
+    for (int i = 0; i < skin_cache.len (); i ++)
+    {
+        CachedSkin & cached = skin_cache[i];
+        if (strcmp (cached.path, path))
+            continue;
+
+        bool found = (cached.mtime == mtime);
+        if (found)
+            skin = std::move (cached.skin);
+
+        skin_cache.remove (i, 1);
+        return found;
+    }
+
+    return false;
+}
+
+static void skin_put_cached (const String & path, int64_t mtime, Skin && old_skin)
+{
+    if (skin_cache.len () >= SKIN_CACHE_SIZE)
+        skin_cache.remove (0, skin_cache.len () - SKIN_CACHE_SIZE + 1);
+
+    skin_cache.append (path, mtime, std::move (old_skin));
+}
+
+void skin_cache_clear ()
+{
+    skin_cache.clear ();
+    skin_path = String ();
+}
+
 bool skin_load (const char * path)
 {
     /* save current skin data */
     Skin old_skin (std::move (skin));
 
-    /* reset to defaults */
-    skin = Skin ();
+    int64_t mtime = skin_get_mtime (path);
+    bool loaded = skin_take_cached (path, mtime);
 
-    if (skin_load_data (path))
+    if (! loaded)
     {
+        /* reset to defaults */
+        skin = Skin ();
+        loaded = skin_load_data (path);
+    }
+    else
+        AUDDBG ("Using cached skin \"%s\"\n", path);
+
+    if (loaded)
+    {
+        if (skin_path && strcmp (skin_path, path))
+            skin_put_cached (skin_path, skin_mtime, std::move (old_skin));
+
+        skin_path = String (path);
+        skin_mtime = mtime;
+
         aud_set_str ("skins", "skin", path);
         return true;
     }
@@ -188,9 +188,14 @@ void skin_draw_playlistwin_shaded (QPainter & cr, int width, bool focus);
 void skin_draw_playlistwin_frame (QPainter & cr, int width, int height, bool focus);
 void skin_draw_mainwin_titlebar (QPainter & cr, bool shaded, bool focus);
 
+/* forgets the skins kept for switching back to them */
+void skin_cache_clear ();
+
+class SkinFiles;
+
 /* ui_skin_load_ini.c */
-void skin_load_hints (const char * path);
-void skin_load_pl_colors (const char * path);
-void skin_load_masks (const char * path);
+void skin_load_hints (SkinFiles & files);
+void skin_load_pl_colors (SkinFiles & files);
+void skin_load_masks (SkinFiles & files);
 
 #endif
@@ -30,6 +30,7 @@
 #include <unistd.h>
 
 #include <glib/gstdio.h>
+#include <zlib.h>
 
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
@@ -40,6 +41,9 @@
 
 #include "skins_util.h"
 
+/* of a file in or out of an archive; skins are never near as large */
+#define MAX_FILE_SIZE (64 << 20)
+
 #ifdef S_IRGRP
 #define DIRMODE (S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH)
 #else
@@ -345,3 +349,304 @@ void make_directory (const char * path)
     if (g_mkdir_with_parents (path, DIRMODE) != 0)
         AUDWARN ("Error creating %s: %s\n", path, strerror (errno));
 }
+
+static unsigned get_le16 (const unsigned char * data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t get_le32 (const unsigned char * data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/* inflates a raw deflate stream or a gzip file, as window_bits says */
+static bool inflate_data (const char * data, int64_t len, int window_bits,
+ int64_t size_hint, Index<char> & out)
+{
+    z_stream stream {};
+    if (inflateInit2 (& stream, window_bits) != Z_OK)
+        return false;
+
+    stream.next_in = (Bytef *) data;
+    stream.avail_in = len;
+
+    int ret = Z_OK;
+    while (ret == Z_OK)
+    {
+        int pos = out.len ();
+        int room = aud::max ((int) size_hint - pos, 65536);
+
+        if (pos + room > MAX_FILE_SIZE)
+            break;
+
+        out.insert (-1, room);
+        stream.next_out = (Bytef *) & out[pos];
+        stream.avail_out = room;
+
+        ret = inflate (& stream, Z_NO_FLUSH);
+        out.remove (pos + room - stream.avail_out, -1);
+    }
+
+    inflateEnd (& stream);
+    return ret == Z_STREAM_END;
+}
+
+static void add_member (SimpleHash<String, Index<char>> & members,
+ const char * path, Index<char> && data)
+{
+    const char * base = path;
+    for (const char * c = path; * c; c ++)
+    {
+        if (* c == '/' || * c == '\\')
+            base = c + 1;
+    }
+
+    if (! base[0])
+        return;  /* a folder */
+
+    String key (str_tolower (base));
+    if (! members.lookup (key))
+        members.add (key, std::move (data));
+}
+
+/* stored and deflated files, as found in every .wsz */
+static bool read_zip (const Index<char> & archive, SimpleHash<String, Index<char>> & members)
+{
+    auto data = (const unsigned char *) archive.begin ();
+    int64_t len = archive.len ();
+
+    /* the end of central directory record, which may be followed by a comment */
+    int64_t end = -1;
+    for (int64_t pos = len - 22; pos >= 0 && pos >= len - 22 - 65535; pos --)
+    {
+        if (get_le32 (data + pos) == 0x06054b50)
+        {
+            end = pos;
+            break;
+        }
+    }
+
+    if (end < 0)
+        return false;
+
+    int n_files = get_le16 (data + end + 10);
+    int64_t pos = get_le32 (data + end + 16);
+
+    for (int i = 0; i < n_files; i ++)
+    {
+        if (pos + 46 > len || get_le32 (data + pos) != 0x02014b50)
+            return false;
+
+        int method = get_le16 (data + pos + 10);
+        int64_t packed = get_le32 (data + pos + 20);
+        int64_t size = get_le32 (data + pos + 24);
+        int name_len = get_le16 (data + pos + 28);
+        int64_t local = get_le32 (data + pos + 42);
+
+        if (pos + 46 + name_len > len)
+            return false;
+
+        String name (str_copy ((const char *) data + pos + 46, name_len));
+        pos += 46 + name_len + get_le16 (data + pos + 30) + get_le16 (data + pos + 32);
+
+        if (local + 30 > len || get_le32 (data + local) != 0x04034b50)
+            return false;
+
+        int64_t start = local + 30 + get_le16 (data + local + 26) + get_le16 (data + local + 28);
+        if (start + packed > len || size > MAX_FILE_SIZE)
+            continue;
+
+        Index<char> contents;
+
+        if (method == 0 && packed == size)
+            contents.insert ((const char *) data + start, 0, size);
+        else if (method != 8 || ! inflate_data ((const char *) data + start,
+         packed, -MAX_WBITS, size, contents))
+        {
+            AUDWARN ("Cannot read %s from skin archive\n", (const char *) name);
+            continue;
+        }
+
+        add_member (members, name, std::move (contents));
+    }
+
+    return true;
+}
+
+static int64_t parse_octal (const char * field, int len)
+{
+    int64_t value = 0;
+
+    for (int i = 0; i < len && field[i]; i ++)
+    {
+        if (field[i] == ' ')
+            continue;
+        if (field[i] < '0' || field[i] > '7')
+            return -1;
+
+        value = value * 8 + (field[i] - '0');
+    }
+
+    return value;
+}
+
+static bool read_tar (const Index<char> & archive, SimpleHash<String, Index<char>> & members)
+{
+    const char * data = archive.begin ();
+    int64_t len = archive.len ();
+    String long_name;
+
+    for (int64_t pos = 0; pos + 512 <= len; )
+    {
+        const char * header = data + pos;
+
+        /* the archive ends with blocks of zeros */
+        if (! header[0])
+            break;
+
+        int64_t size = parse_octal (header + 124, 12);
+        int64_t start = pos + 512;
+        char type = header[156];
+
+        if (size < 0 || start + size > len)
+            return false;
+
+        if (type == 'L')  /* GNU long name of the next file */
+            long_name = String (str_copy (data + start, strnlen (data + start, size)));
+        else
+        {
+            if ((type == '0' || type == 0) && size <= MAX_FILE_SIZE)
+            {
+                String name = long_name ? long_name :
+                 String (str_copy (header, strnlen (header, 100)));
+
+                Index<char> contents;
+                contents.insert (data + start, 0, size);
+                add_member (members, name, std::move (contents));
+            }
+
+            long_name = String ();
+        }
+
+        pos = start + (size + 511) / 512 * 512;
+    }
+
+    return true;
+}
+
+SkinFiles::~SkinFiles ()
+{
+    if (m_temp_folder)
+        del_directory (m_folder);
+}
+
+bool SkinFiles::open (const char * path)
+{
+    if (g_file_test (path, G_FILE_TEST_IS_DIR))
+    {
+        m_folder = String (path);
+        return true;
+    }
+
+    ArchiveType type = archive_get_type (path);
+    if (type == ARCHIVE_UNKNOWN)
+        return false;
+
+    /* there is no bzip2 decoder at hand, so these still go through the
+     * external commands */
+    if (type == ARCHIVE_TBZ2)
+    {
+        StringBuf folder = archive_decompress (path);
+        if (! folder)
+            return false;
+
+        m_folder = String (folder);
+        m_temp_folder = true;
+        return true;
+    }
+
+    VFSFile file (path, "r");
+    if (! file)
+        return false;
+
+    Index<char> data = file.read_all ();
+
+    if (type == ARCHIVE_TGZ)
+    {
+        Index<char> tar;
+        if (! inflate_data (data.begin (), data.len (), 16 + MAX_WBITS, 0, tar))
+        {
+            AUDWARN ("Cannot decompress %s\n", path);
+            return false;
+        }
+
+        data = std::move (tar);
+    }
+
+    bool valid = (type == ARCHIVE_ZIP) ? read_zip (data, m_members) : read_tar (data, m_members);
+
+    if (! valid)
+        AUDWARN ("Cannot read skin archive %s\n", path);
+
+    return valid && m_members.n_items ();
+}
+
+bool SkinFiles::has (const char * basename)
+{
+    if (m_folder)
+        return (bool) find_file_case_path (m_folder, basename);
+
+    return m_members.lookup (String (str_tolower (basename)));
+}
+
+Index<char> SkinFiles::read (const char * basename)
+{
+    Index<char> data;
+
+    if (m_folder)
+    {
+        VFSFile file = open_local_file_nocase (m_folder, basename);
+        if (file)
+            data = file.read_all ();
+    }
+    else
+    {
+        Index<char> * member = m_members.lookup (String (str_tolower (basename)));
+        if (member)
+            data.insert (member->begin (), 0, member->len ());
+    }
+
+    return data;
+}
+
+VFSFile SkinFiles::open_file (const char * basename)
+{
+    if (m_folder)
+        return open_local_file_nocase (m_folder, basename);
+
+    Index<char> * member = m_members.lookup (String (str_tolower (basename)));
+    if (! member)
+        return VFSFile ();
+
+    VFSFile file = VFSFile::tmpfile ();
+    if (! file || file.fwrite (member->begin (), 1, member->len ()) != member->len () ||
+     file.fseek (0, VFS_SEEK_SET) < 0)
+        return VFSFile ();
+
+    return file;
+}
+
+StringBuf SkinFiles::locate_pixmap (const char * basename, const char * altname)
+{
+    static const char * const exts[] = {".bmp", ".png", ".xpm"};
+
+    for (const char * ext : exts)
+    {
+        StringBuf name = str_concat ({basename, ext});
+        if (has (name))
+            return name;
+    }
+
+    return altname ? locate_pixmap (altname) : StringBuf ();
+}
@@ -26,6 +26,7 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <libaudcore/multihash.h>
 #include <libaudcore/vfs.h>
 
 typedef void (* DirForeachFunc) (const char * path, const char * basename);
@@ -49,4 +50,36 @@ bool file_is_archive (const char * filename);
 StringBuf archive_basename (const char * str);
 StringBuf archive_decompress (const char * path);
 
+/* The files of a skin, either in a folder or read into memory from an
+ * archive, without unpacking it anywhere.  Files are found by name
+ * without regard to case; in an archive, the folders they are in are
+ * ignored, as "unzip -j" did. */
+class SkinFiles
+{
+public:
+    SkinFiles () = default;
+    ~SkinFiles ();
+
+    SkinFiles (const SkinFiles &) = delete;
+    SkinFiles & operator= (const SkinFiles &) = delete;
+
+    bool open (const char * path);
+
+    bool has (const char * basename);
+
+    /* empty if there is no such file */
+    Index<char> read (const char * basename);
+
+    /* for the parsers that read from a file */
+    VFSFile open_file (const char * basename);
+
+    /* the name of the pixmap, with whichever extension it has */
+    StringBuf locate_pixmap (const char * basename, const char * altname = nullptr);
+
+private:
+    String m_folder;            /* unless read from an archive */
+    bool m_temp_folder = false; /* extracted by an external command */
+    SimpleHash<String, Index<char>> m_members;  /* by name, in lowercase */
+};
+
 #endif
@@ -287,6 +287,10 @@ TextBox::TextBox (int width, const char * font, bool scroll) :
 {
     /* size is computed by set_font() */
     add_input (1, 1, false, true);
+
+    /* the text covers all of it, so the window is not drawn underneath
+     * at every step of the scrolling */
+    setAttribute (Qt::WA_OpaquePaintEvent);
     set_font (font);
 
     textboxes.append (this);
@@ -239,6 +239,7 @@ SkinnedVis::SkinnedVis ()
 {
     set_scale (config.scale);
     add_drawable (76, 16);
+    setAttribute (Qt::WA_OpaquePaintEvent);
     clear ();
 }
 
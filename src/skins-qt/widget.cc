@@ -34,11 +34,36 @@ void Widget::add_drawable (int width, int height)
     m_drawable = true;
 }
 
-void Widget::paintEvent (QPaintEvent *)
+void Widget::paintEvent (QPaintEvent * event)
 {
-    if (m_drawable)
+    if (m_drawable && m_layered)
+    {
+        /* also drawn again after a move to a screen with another ratio */
+        qreal ratio = devicePixelRatioF ();
+        if (m_layer.isNull () || m_layer.devicePixelRatio () != ratio)
+        {
+            m_layer = QPixmap (size () * ratio);
+            m_layer.setDevicePixelRatio (ratio);
+
+            QPainter p (& m_layer);
+            if (m_scale != 1)
+                p.setTransform (QTransform ().scale (m_scale, m_scale));
+
+            draw (p);
+        }
+
+        QPainter p (this);
+        p.setClipRect (event->rect ());
+        p.drawPixmap (0, 0, m_layer);
+    }
+    else if (m_drawable)
     {
         QPainter p (this);
+
+        /* lets draw() skip what is outside of a partial repaint */
+        if (event->rect () != rect ())
+            p.setClipRect (event->rect ());
+
         if (m_scale != 1)
             p.setTransform (QTransform ().scale (m_scale, m_scale));
 
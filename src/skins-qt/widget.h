@@ -26,27 +26,35 @@
 #include <QKeyEvent>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QPixmap>
 #include <QWheelEvent>
 #include <QWidget>
 
 class Widget : public QWidget
 {
 public:
-    void queue_draw () { update (); }
+    void queue_draw () { m_layer = QPixmap (); update (); }
 
 protected:
     void add_input (int width, int height, bool track_motion, bool drawable);
     void add_drawable (int width, int height);
 
     void set_scale (int scale) { m_scale = scale; }
-    void resize (int w, int h) { QWidget::resize (w * m_scale, h * m_scale); }
+    void resize (int w, int h)
+        { m_layer = QPixmap (); QWidget::resize (w * m_scale, h * m_scale); }
+
+    /* Keeps what draw() painted until the next queue_draw() or draw_now(),
+     * so that when Qt repaints this widget under a child that changed, it
+     * only copies from the layer.  For a window, whose skin is redrawn at
+     * every scroll of the song title otherwise. */
+    void set_layered () { m_layered = true; }
 
 #ifdef Q_OS_MAC
     /* repaint() causes graphical glitches on OS X
      * https://github.com/audacious-media-player/audacious/issues/694 */
-    void draw_now () { update (); }
+    void draw_now () { queue_draw (); }
 #else
-    void draw_now () { repaint (); }
+    void draw_now () { m_layer = QPixmap (); repaint (); }
 #endif
 
     virtual void draw (QPainter & cr) {}
@@ -76,8 +84,9 @@ private:
     void closeEvent (QCloseEvent * event) override
         { event->setAccepted (close ()); }
 
-    bool m_drawable = false;
+    bool m_drawable = false, m_layered = false;
     int m_scale = 1;
+    QPixmap m_layer;
 };
 
 #endif // SKINS_WIDGET_H
@@ -101,6 +101,7 @@ Window::Window (int id, int * x, int * y, int w, int h, bool shaded) :
 
     set_scale (config.scale);
     add_input (w, h, true, true);
+    set_layered ();
 
     w *= config.scale;
     h *= config.scale;
@@ -160,6 +161,7 @@ void Window::set_shaded (bool shaded)
 
     m_is_shaded = shaded;
     apply_shape ();
+    queue_draw ();
 }
 
 void Window::put_widget (bool shaded, Widget * widget, int x, int y)
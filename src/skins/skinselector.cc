@@ -3,6 +3,7 @@
  * Copyright 1998-2003 XMMS Development Team
  * Copyright 2003-2004 BMP Development Team
  * Copyright 2011 John Lindgren
+ * Copyright 2024 Audacious Plugins Authors
  *
  * This file is part of Audacious.
  *
@@ -24,8 +25,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <mutex>
+#include <thread>
+
+#include <glib/gstdio.h>
+
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/mainloop.h>
 #include <libaudcore/runtime.h>
 #include <libaudgui/libaudgui-gtk.h>
 
@@ -46,8 +53,26 @@ struct SkinNode {
     String name, desc, path;
 };
 
+struct Thumbnail {
+    int row;
+    GdkPixbuf * pixbuf;  /* unscaled, owned */
+
+    Thumbnail (int row, GdkPixbuf * pixbuf) :
+        row (row), pixbuf (pixbuf) {}
+};
+
 static Index<SkinNode> skinlist;
 
+/* The previews are made in a thread of its own, which goes through the
+ * list in order and hands each one to the main thread to be shown as soon
+ * as it is ready, so that the list itself appears at once. */
+static std::thread thumb_thread;
+static std::mutex thumb_mutex;
+static bool thumb_quit;                 /* under thumb_mutex */
+static Index<Thumbnail> thumb_done;     /* under thumb_mutex */
+static QueuedFunc thumb_deliver;
+static GtkTreeView * thumb_view;
+
 static void skin_view_on_cursor_changed (GtkTreeView * treeview);
 
 static AudguiPixbuf skin_get_preview (const char * path)
@@ -74,32 +99,124 @@ static AudguiPixbuf skin_get_preview (const char * path)
     return preview;
 }
 
-static AudguiPixbuf skin_get_thumbnail (const char * path)
+/* -1 if there is no such file */
+static int64_t skin_get_mtime (const char * path)
 {
-    StringBuf base = filename_get_base (path);
-    base.insert (-1, ".png");
+    GStatBuf st;
+    return (g_stat (path, & st) < 0) ? -1 : (int64_t) st.st_mtime;
+}
 
-    StringBuf thumbname = filename_build ({skins_get_skin_thumb_dir (), base});
+/* Stored under a hash of the skin's path, along with the mtime of the
+ * skin, so that a skin replaced by another of the same name, or with the
+ * same name in another folder, does not show the wrong preview. */
+static GdkPixbuf * skin_get_thumbnail (const char * thumb_dir, const char * path)
+{
+    char * hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, path, -1);
+    StringBuf thumbname = filename_build ({thumb_dir, str_concat ({hash, ".png"})});
+    g_free (hash);
+
+    StringBuf mtime = int64_to_str (skin_get_mtime (path));
     AudguiPixbuf thumb;
 
     if (g_file_test (thumbname, G_FILE_TEST_EXISTS))
+    {
         thumb.capture (gdk_pixbuf_new_from_file (thumbname, nullptr));
 
+        const char * saved = thumb ?
+         gdk_pixbuf_get_option (thumb.get (), "tEXt::Thumb::MTime") : nullptr;
+        if (! saved || strcmp (saved, mtime))
+            thumb.clear ();
+    }
+
     if (! thumb)
     {
         thumb = skin_get_preview (path);
 
         if (thumb)
         {
-            make_directory (skins_get_skin_thumb_dir ());
-            gdk_pixbuf_save (thumb.get (), thumbname, "png", nullptr, nullptr);
+            make_directory (thumb_dir);
+            gdk_pixbuf_save (thumb.get (), thumbname, "png", nullptr,
+             "tEXt::Thumb::MTime", (const char *) mtime, nullptr);
         }
     }
 
-    if (thumb)
-        audgui_pixbuf_scale_within (thumb, audgui_get_dpi () * 3 / 2);
+    return thumb.release ();
+}
 
-    return thumb;
+/* in the main thread */
+static void thumb_take ()
+{
+    Index<Thumbnail> done;
+
+    {
+        std::lock_guard<std::mutex> lock (thumb_mutex);
+        done = std::move (thumb_done);
+    }
+
+    auto model = (GtkTreeModel *) gtk_tree_view_get_model (thumb_view);
+    int size = audgui_get_dpi () * 3 / 2;
+
+    for (Thumbnail & thumbnail : done)
+    {
+        AudguiPixbuf thumb;
+        thumb.capture (thumbnail.pixbuf);
+        audgui_pixbuf_scale_within (thumb, size);
+
+        GtkTreeIter iter;
+        if (gtk_tree_model_iter_nth_child (model, & iter, nullptr, thumbnail.row))
+            gtk_list_store_set ((GtkListStore *) model, & iter,
+             SKIN_VIEW_COL_PREVIEW, thumb.get (), -1);
+    }
+}
+
+static void thumb_run (String thumb_dir, Index<String> paths)
+{
+    for (int row = 0; row < paths.len (); row ++)
+    {
+        {
+            std::lock_guard<std::mutex> lock (thumb_mutex);
+            if (thumb_quit)
+                break;
+        }
+
+        GdkPixbuf * pixbuf = skin_get_thumbnail (thumb_dir, paths[row]);
+        if (! pixbuf)
+            continue;
+
+        std::lock_guard<std::mutex> lock (thumb_mutex);
+        thumb_done.append (row, pixbuf);
+        thumb_deliver.queue (thumb_take);
+    }
+}
+
+static void thumb_stop ()
+{
+    if (! thumb_thread.joinable ())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock (thumb_mutex);
+        thumb_quit = true;
+    }
+
+    thumb_thread.join ();
+    thumb_deliver.stop ();
+
+    for (Thumbnail & thumbnail : thumb_done)
+        g_object_unref (thumbnail.pixbuf);
+
+    thumb_done.clear ();
+    thumb_quit = false;
+}
+
+static void thumb_start (GtkTreeView * treeview)
+{
+    Index<String> paths;
+    for (const SkinNode & node : skinlist)
+        paths.append (node.path);
+
+    thumb_view = treeview;
+    thumb_thread = std::thread (thumb_run, String (skins_get_skin_thumb_dir ()), std::move (paths));
 }
 
 static void scan_skindir_func (const char * path, const char * basename)
@@ -139,6 +256,8 @@ static void skinlist_update ()
 
 void skin_view_update (GtkTreeView * treeview)
 {
+    thumb_stop ();
+
     g_signal_handlers_block_by_func (treeview, (void *) skin_view_on_cursor_changed, nullptr);
 
     auto store = (GtkListStore *) gtk_tree_view_get_model (treeview);
@@ -151,14 +270,12 @@ void skin_view_update (GtkTreeView * treeview)
 
     for (const SkinNode & node : skinlist)
     {
-        AudguiPixbuf thumbnail = skin_get_thumbnail (node.path);
         StringBuf formattedname = str_concat ({"<big><b>", node.name,
          "</b></big>\n<i>", node.desc, "</i>"});
 
         GtkTreeIter iter;
         gtk_list_store_append (store, & iter);
         gtk_list_store_set (store, & iter,
-         SKIN_VIEW_COL_PREVIEW, thumbnail.get (),
          SKIN_VIEW_COL_FORMATTEDNAME, (const char *) formattedname,
          SKIN_VIEW_COL_NAME, (const char *) node.name, -1);
 
@@ -175,6 +292,8 @@ void skin_view_update (GtkTreeView * treeview)
     }
 
     g_signal_handlers_unblock_by_func (treeview, (void *) skin_view_on_cursor_changed, nullptr);
+
+    thumb_start (treeview);
 }
 
 static void skin_view_on_cursor_changed (GtkTreeView * treeview)
@@ -229,4 +348,5 @@ void skin_view_realize (GtkTreeView * treeview)
 
     g_signal_connect (treeview, "cursor-changed",
      (GCallback) skin_view_on_cursor_changed, nullptr);
+    g_signal_connect (treeview, "destroy", (GCallback) thumb_stop, nullptr);
 }
@@ -27,6 +27,9 @@
 #include <libaudcore/i18n.h>
 #include <libaudcore/audstrings.h>
 
+#include "../vfs-common/local-reader.h"
+#include "../trace-common/trace.h"
+
 class SndfilePlugin : public InputPlugin
 {
 public:
@@ -112,6 +115,55 @@ static SF_VIRTUAL_IO sf_virtual_io_stream =
     sf_tell
 };
 
+/* The same for playback, through a LocalReader: libsndfile reads a few
+ * kilobytes at a time, which it serves from memory.
+ */
+static sf_count_t
+reader_get_filelen (void *user_data)
+{
+    int64_t size = ((LocalReader *) user_data)->fsize ();
+    return (size < 0) ? SF_COUNT_MAX : size;
+}
+
+static sf_count_t
+reader_seek (sf_count_t offset, int whence, void *user_data)
+{
+    if (((LocalReader *) user_data)->fseek (offset, to_vfs_seek_type (whence)) != 0)
+        return -1;
+
+    return ((LocalReader *) user_data)->ftell ();
+}
+
+static sf_count_t
+reader_read (void *ptr, sf_count_t count, void *user_data)
+{
+    return ((LocalReader *) user_data)->fread (ptr, 1, count);
+}
+
+static sf_count_t
+reader_tell (void *user_data)
+{
+    return ((LocalReader *) user_data)->ftell ();
+}
+
+static SF_VIRTUAL_IO reader_virtual_io =
+{
+    reader_get_filelen,
+    reader_seek,
+    reader_read,
+    sf_vwrite_dummy,
+    reader_tell
+};
+
+static SF_VIRTUAL_IO reader_virtual_io_stream =
+{
+    reader_get_filelen,
+    sf_vseek_dummy,
+    reader_read,
+    sf_vwrite_dummy,
+    reader_tell
+};
+
 static void copy_string (SNDFILE * sf, int sf_id, Tuple & tup, Tuple::Field field)
 {
     const char * str = sf_get_string (sf, sf_id);
@@ -316,20 +368,25 @@ bool SndfilePlugin::play (const char * filename, VFSFile & file)
 {
     SF_INFO sfinfo {}; // must be zeroed before sf_open()
 
-    bool stream = (file.fsize () < 0);
-    SNDFILE * sndfile = sf_open_virtual (stream ? & sf_virtual_io_stream :
-     & sf_virtual_io, SFM_READ, & sfinfo, & file);
+    LocalReader reader (file);
+
+    bool stream = (reader.fsize () < 0);
+    SNDFILE * sndfile = sf_open_virtual (stream ? & reader_virtual_io_stream :
+     & reader_virtual_io, SFM_READ, & sfinfo, & reader);
 
     if (sndfile == nullptr)
         return false;
 
     open_audio (FMT_FLOAT, sfinfo.samplerate, sfinfo.channels);
 
+    /* 100 ms at a time, whole frames only */
+    int frames = aud::max (sfinfo.samplerate / 10, 256);
     Index<float> buffer;
-    buffer.resize (sfinfo.channels * (sfinfo.samplerate / 50));
+    buffer.resize (sfinfo.channels * frames);
 
     while (! check_stop ())
     {
+        TRACE_SPAN ("sndfile play");
         int seek_value = check_seek ();
         if (seek_value != -1)
         {
@@ -337,11 +394,11 @@ bool SndfilePlugin::play (const char * filename, VFSFile & file)
             sf_seek (sndfile, aud::min (frames, (int64_t) sfinfo.frames), SEEK_SET);
         }
 
-        int samples = sf_read_float (sndfile, buffer.begin (), buffer.len ());
-        if (! samples)
+        int read = sf_readf_float (sndfile, buffer.begin (), frames);
+        if (read <= 0)
             break;
 
-        write_audio (buffer.begin (), sizeof (float) * samples);
+        write_audio (buffer.begin (), sizeof (float) * sfinfo.channels * read);
     }
 
     sf_close (sndfile);
@@ -0,0 +1,469 @@
+/*
+ * Audacious: A cross-platform multimedia player.
+ * Copyright (c) 2005-2026  Audacious Team
+ */
+
+#include "executor.h"
+
+#ifdef _WIN32
+
+#include "songchange_crossplatform.h"
+
+/* CreateProcess() does not wait for the command in the first place */
+
+void executor_start (const ExecutorConfig &) {}
+void executor_configure (const ExecutorConfig &) {}
+void executor_stop () {}
+
+void executor_run (SongEvent, const char * cmd)
+{
+    execute_command (cmd);
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <utility>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/index.h>
+#include <libaudcore/objects.h>
+#include <libaudcore/runtime.h>
+
+extern char * * environ;
+
+#define POLL_MS 20          /* between checks on a running command */
+#define KILL_GRACE_MS 500   /* from SIGTERM to SIGKILL */
+#define SHUTDOWN_MS 1000    /* left to the commands when the plugin stops */
+#define FIRST_FD 10         /* of our end of the pipes to the helper */
+
+struct Command
+{
+    SongEvent event;
+    String cmd;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_t thread;
+static bool running, quit;
+static int64_t quit_time;
+
+/* at most one command for each event, so never more than five */
+static Index<Command> queue;
+static ExecutorConfig config;
+
+/* only used on the thread */
+static pid_t helper_pid = -1;
+static int helper_in = -1, helper_done = -1;
+
+static int64_t now_ms ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms (int ms)
+{
+    timespec ts = {ms / 1000, (ms % 1000) * 1000000};
+    nanosleep (& ts, nullptr);
+}
+
+static int64_t deadline_for (int timeout)
+{
+    return timeout ? now_ms () + (int64_t) timeout * 1000 : INT64_MAX;
+}
+
+/* every deadline is brought forward to this once the plugin is stopping */
+static int64_t shutdown_deadline ()
+{
+    pthread_mutex_lock (& mutex);
+    int64_t deadline = quit ? quit_time + SHUTDOWN_MS : INT64_MAX;
+    pthread_mutex_unlock (& mutex);
+
+    return deadline;
+}
+
+static pid_t spawn_shell (const char * const * argv, int in_fd, int done_fd)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t signals;
+
+    posix_spawn_file_actions_init (& actions);
+    posix_spawnattr_init (& attr);
+
+    /* in a process group of its own, which a timeout kills as a whole,
+     * and without the signal mask of this thread */
+    posix_spawnattr_setflags (& attr, POSIX_SPAWN_SETPGROUP |
+     POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup (& attr, 0);
+
+    sigemptyset (& signals);
+    posix_spawnattr_setsigmask (& attr, & signals);
+    sigaddset (& signals, SIGPIPE);
+    posix_spawnattr_setsigdefault (& attr, & signals);
+
+    if (in_fd >= 0)
+        posix_spawn_file_actions_adddup2 (& actions, in_fd, 0);
+    if (done_fd >= 0)
+        posix_spawn_file_actions_adddup2 (& actions, done_fd, 3);
+
+    /* We don't want this process to hog the audio device etc */
+    for (int fd = (done_fd >= 0) ? 4 : 3; fd < 255; fd ++)
+        posix_spawn_file_actions_addclose (& actions, fd);
+
+    pid_t pid;
+    int error = posix_spawn (& pid, argv[0], & actions, & attr,
+     (char * const *) argv, environ);
+
+    posix_spawn_file_actions_destroy (& actions);
+    posix_spawnattr_destroy (& attr);
+
+    if (error)
+    {
+        AUDERR ("Cannot run %s: %s.\n", argv[0], strerror (error));
+        return -1;
+    }
+
+    return pid;
+}
+
+/* false if the process is still running at the deadline */
+static bool reap (pid_t pid, int64_t deadline)
+{
+    while (true)
+    {
+        pid_t result = waitpid (pid, nullptr, WNOHANG);
+
+        /* ECHILD if someone else has waited for it already */
+        if (result == pid || (result < 0 && errno != EINTR))
+            return true;
+
+        if (now_ms () >= aud::min (deadline, shutdown_deadline ()))
+            return false;
+
+        sleep_ms (POLL_MS);
+    }
+}
+
+static void kill_group (pid_t pid)
+{
+    kill (- pid, SIGTERM);
+
+    if (! reap (pid, now_ms () + KILL_GRACE_MS))
+    {
+        kill (- pid, SIGKILL);
+        waitpid (pid, nullptr, 0);
+    }
+}
+
+static void run_plain (const char * cmd, int timeout)
+{
+    const char * argv[] = {"/bin/sh", "-c", cmd, nullptr};
+
+    pid_t pid = spawn_shell (argv, -1, -1);
+    if (pid < 0)
+        return;
+
+    if (! reap (pid, deadline_for (timeout)))
+    {
+        AUDWARN ("Command did not finish in time: %s\n", cmd);
+        kill_group (pid);
+    }
+}
+
+/* both ends close-on-exec, and out of the way of 0 to 3 in the helper */
+static bool make_pipe (int fds[2])
+{
+    int low[2];
+    if (pipe (low) < 0)
+        return false;
+
+    fds[0] = fcntl (low[0], F_DUPFD_CLOEXEC, FIRST_FD);
+    fds[1] = fcntl (low[1], F_DUPFD_CLOEXEC, FIRST_FD);
+
+    close (low[0]);
+    close (low[1]);
+
+    if (fds[0] < 0 || fds[1] < 0)
+    {
+        if (fds[0] >= 0)
+            close (fds[0]);
+        if (fds[1] >= 0)
+            close (fds[1]);
+
+        return false;
+    }
+
+    return true;
+}
+
+/* The helper is a shell reading commands from a pipe, so the player does
+ * not start a process for each one.  After each command it writes a line
+ * to its fd 3, which is the other pipe. */
+static bool start_helper ()
+{
+    int in[2], done[2];
+
+    if (! make_pipe (in))
+        return false;
+
+    if (! make_pipe (done))
+    {
+        close (in[0]);
+        close (in[1]);
+        return false;
+    }
+
+    const char * argv[] = {"/bin/sh", nullptr};
+    helper_pid = spawn_shell (argv, in[0], done[1]);
+
+    close (in[0]);
+    close (done[1]);
+
+    if (helper_pid < 0)
+    {
+        close (in[1]);
+        close (done[0]);
+        return false;
+    }
+
+    helper_in = in[1];
+    helper_done = done[0];
+    return true;
+}
+
+static void stop_helper (bool force)
+{
+    /* the shell exits at the end of its input */
+    close (helper_in);
+
+    if (force || ! reap (helper_pid, now_ms () + SHUTDOWN_MS))
+        kill_group (helper_pid);
+
+    close (helper_done);
+
+    helper_pid = -1;
+    helper_in = helper_done = -1;
+}
+
+/* The command runs in a subshell, so that neither a syntax error nor an
+ * exit in it ends the helper, and reads /dev/null instead of the commands
+ * after it. */
+static StringBuf helper_line (const char * cmd)
+{
+    StringBuf line = str_copy ("( eval '");
+
+    for (const char * c = cmd; * c; c ++)
+    {
+        if (* c == '\'')
+            line.insert (-1, "'\\''");
+        else
+            line.insert (-1, c, 1);
+    }
+
+    line.insert (-1, "' ) </dev/null 3>&-; echo >&3\n");
+    return line;
+}
+
+static bool write_all (int fd, const char * data, int len)
+{
+    while (len > 0)
+    {
+        ssize_t written = write (fd, data, len);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+
+        data += written;
+        len -= written;
+    }
+
+    return true;
+}
+
+static void run_helper (const char * cmd, int timeout)
+{
+    StringBuf line = helper_line (cmd);
+
+    /* the helper may have died since the last command */
+    if (helper_pid >= 0 && ! write_all (helper_in, line, line.len ()))
+        stop_helper (true);
+
+    if (helper_pid < 0)
+    {
+        if (! start_helper ())
+        {
+            AUDWARN ("Cannot start the helper shell; running the command on its own.\n");
+            run_plain (cmd, timeout);
+            return;
+        }
+
+        if (! write_all (helper_in, line, line.len ()))
+        {
+            stop_helper (true);
+            return;
+        }
+    }
+
+    int64_t deadline = deadline_for (timeout);
+
+    while (true)
+    {
+        pollfd fd = {helper_done, POLLIN, 0};
+        int64_t left = aud::min (deadline, shutdown_deadline ()) - now_ms ();
+
+        if (left <= 0)
+        {
+            AUDWARN ("Command did not finish in time: %s\n", cmd);
+            stop_helper (true);
+            return;
+        }
+
+        int ready = poll (& fd, 1, (int) aud::min (left, (int64_t) 100));
+
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (ready <= 0)
+            continue;
+
+        char c;
+        ssize_t got = read (helper_done, & c, 1);
+
+        if (got == 1)
+            return;
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        break;
+    }
+
+    AUDWARN ("The helper shell has gone away.\n");
+    stop_helper (true);
+}
+
+static void * executor_thread (void *)
+{
+    /* a helper that has died must not take the player with it */
+    sigset_t signals;
+    sigemptyset (& signals);
+    sigaddset (& signals, SIGPIPE);
+    pthread_sigmask (SIG_BLOCK, & signals, nullptr);
+
+    pthread_mutex_lock (& mutex);
+
+    while (true)
+    {
+        if (! queue.len ())
+        {
+            if (quit)
+                break;
+
+            pthread_cond_wait (& cond, & mutex);
+            continue;
+        }
+
+        Command command = std::move (queue[0]);
+        queue.remove (0, 1);
+
+        ExecutorConfig current = config;
+        pthread_mutex_unlock (& mutex);
+
+        if (helper_pid >= 0 && ! current.helper)
+            stop_helper (false);
+
+        if (current.helper)
+            run_helper (command.cmd, current.timeout);
+        else
+            run_plain (command.cmd, current.timeout);
+
+        pthread_mutex_lock (& mutex);
+    }
+
+    pthread_mutex_unlock (& mutex);
+
+    if (helper_pid >= 0)
+        stop_helper (false);
+
+    return nullptr;
+}
+
+void executor_start (const ExecutorConfig & new_config)
+{
+    pthread_mutex_lock (& mutex);
+    config = new_config;
+    quit = false;
+    pthread_mutex_unlock (& mutex);
+}
+
+void executor_configure (const ExecutorConfig & new_config)
+{
+    pthread_mutex_lock (& mutex);
+    config = new_config;
+    pthread_mutex_unlock (& mutex);
+}
+
+/* what is still waiting is run, but given only SHUTDOWN_MS */
+void executor_stop ()
+{
+    pthread_mutex_lock (& mutex);
+    quit = true;
+    quit_time = now_ms ();
+    pthread_cond_broadcast (& cond);
+    pthread_mutex_unlock (& mutex);
+
+    if (running)
+        pthread_join (thread, nullptr);
+
+    running = false;
+    queue.clear ();
+}
+
+void executor_run (SongEvent event, const char * cmd)
+{
+    pthread_mutex_lock (& mutex);
+
+    /* while skipping, only the command for the latest song is run */
+    for (int i = 0; i < queue.len (); i ++)
+    {
+        if (queue[i].event == event)
+        {
+            AUDDBG ("Dropping superseded command: %s\n", (const char *) queue[i].cmd);
+            queue.remove (i, 1);
+            break;
+        }
+    }
+
+    queue.append (Command {event, String (cmd)});
+
+    if (! running)
+    {
+        running = ! pthread_create (& thread, nullptr, executor_thread, nullptr);
+
+        if (! running)
+        {
+            AUDERR ("Cannot start the thread to run commands.\n");
+            queue.clear ();
+        }
+    }
+
+    pthread_cond_broadcast (& cond);
+    pthread_mutex_unlock (& mutex);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+/* Commands are run one at a time, on a thread of their own, so that a slow
+ * one holds up neither the player nor the ones after it for longer than
+ * the timeout.  A command still waiting when another one for the same
+ * event comes is dropped in favor of the newer one. */
+
+enum class SongEvent
+{
+    Begin,
+    Stop,
+    After,
+    End,
+    TitleChange
+};
+
+struct ExecutorConfig
+{
+    int timeout;    /* seconds, 0 for none */
+    bool helper;    /* one long-lived shell, fed over a pipe */
+};
+
+void executor_start (const ExecutorConfig & config);
+void executor_configure (const ExecutorConfig & config);
+void executor_stop ();
+
+void executor_run (SongEvent event, const char * cmd);
+
+#endif
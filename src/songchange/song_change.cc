@@ -3,9 +3,6 @@
  * Copyright (c) 2005  Audacious Team
  */
 
-#include <sys/types.h>
-#include "songchange_crossplatform.h"
-
 #include <assert.h>
 
 #include <string.h>
@@ -18,6 +15,7 @@
 #include <libaudcore/audstrings.h>
 #include <libaudcore/tuple.h>
 
+#include "executor.h"
 #include "formatter.h"
 
 class SongChange : public GeneralPlugin
@@ -46,6 +44,13 @@ static String cmd_line_stop;
 static String cmd_line_after;
 static String cmd_line_end;
 static String cmd_line_ttc;
+static ExecutorConfig executor_config;
+
+static const char * const songchange_defaults[] = {
+    "timeout", "10",
+    "helper", "FALSE",
+    nullptr
+};
 
 /**
  * Escapes characters that are special to the shell inside double quotes.
@@ -98,8 +103,9 @@ static StringBuf escape_shell_chars (const char * string)
  *   r - track title
  */
 /* do_command(): do @cmd after replacing the format codes
+   @event: what @cmd is run for
    @cmd: command to run */
-static void do_command (const char * cmd)
+static void do_command (SongEvent event, const char * cmd)
 {
     if (cmd && strlen (cmd) > 0)
     {
@@ -174,33 +180,33 @@ static void do_command (const char * cmd)
 
         StringBuf shstring = formatter.format (cmd);
         if (shstring)
-            execute_command (shstring);
+            executor_run (event, shstring);
     }
 }
 
 static void songchange_playback_begin (void *, void *)
 {
-    do_command (cmd_line);
+    do_command (SongEvent::Begin, cmd_line);
 }
 
 static void songchange_playback_stop (void *, void *)
 {
-    do_command (cmd_line_stop);
+    do_command (SongEvent::Stop, cmd_line_stop);
 }
 
 static void songchange_playback_end (void *, void *)
 {
-    do_command (cmd_line_after);
+    do_command (SongEvent::After, cmd_line_after);
 }
 
 static void songchange_playback_ttc (void *, void *)
 {
-    do_command (cmd_line_ttc);
+    do_command (SongEvent::TitleChange, cmd_line_ttc);
 }
 
 static void songchange_playlist_eof (void *, void *)
 {
-    do_command (cmd_line_end);
+    do_command (SongEvent::End, cmd_line_end);
 }
 
 static void read_config ()
@@ -210,11 +216,16 @@ static void read_config ()
     cmd_line_after = aud_get_str ("song_change", "cmd_line_after");
     cmd_line_end = aud_get_str ("song_change", "cmd_line_end");
     cmd_line_ttc = aud_get_str ("song_change", "cmd_line_ttc");
+
+    executor_config.timeout = aud::clamp (aud_get_int ("song_change", "timeout"), 0, 3600);
+    executor_config.helper = aud_get_bool ("song_change", "helper");
 }
 
 bool SongChange::init ()
 {
+    aud_config_set_defaults ("song_change", songchange_defaults);
     read_config ();
+    executor_start (executor_config);
 
     hook_associate ("playback ready", songchange_playback_begin, nullptr);
     hook_associate ("playback stop", songchange_playback_stop, nullptr);
@@ -239,7 +250,7 @@ void SongChange::cleanup ()
     cmd_line_end = String ();
     cmd_line_ttc = String ();
 
-    signal_child ();
+    executor_stop ();
 }
 
 typedef struct {
@@ -248,6 +259,8 @@ typedef struct {
     String cmd_after;
     String cmd_end;
     String cmd_ttc;
+    int timeout;
+    bool helper;
 } SongChangeConfig;
 
 static SongChangeConfig config;
@@ -270,6 +283,13 @@ const PreferencesWidget SongChange::widgets[] = {
     WidgetLabel (N_("Command to run when song title changes (for network streams):")),
     WidgetEntry (0, WidgetString (config.cmd_ttc)),
 
+    WidgetLabel (N_("<b>Running</b>")),
+    WidgetSpin (N_("Stop a command after:"),
+        WidgetInt (config.timeout),
+        {0, 3600, 1, N_("seconds (0 for never)")}),
+    WidgetCheck (N_("Feed the commands to one long-lived shell"),
+        WidgetBool (config.helper)),
+
     WidgetLabel (N_("You can use the following format codes, which will be "
                     "replaced before running the command.\nNot all are useful "
                     "though for the song-stopped or end-of-playlist command.")),
@@ -296,6 +316,8 @@ static void configure_init ()
     config.cmd_after = cmd_line_after;
     config.cmd_end = cmd_line_end;
     config.cmd_ttc = cmd_line_ttc;
+    config.timeout = executor_config.timeout;
+    config.helper = executor_config.helper;
 }
 
 static void configure_ok_cb ()
@@ -305,12 +327,18 @@ static void configure_ok_cb ()
     aud_set_str ("song_change", "cmd_line_after", config.cmd_after);
     aud_set_str ("song_change", "cmd_line_end", config.cmd_end);
     aud_set_str ("song_change", "cmd_line_ttc", config.cmd_ttc);
+    aud_set_int ("song_change", "timeout", config.timeout);
+    aud_set_bool ("song_change", "helper", config.helper);
 
     cmd_line = config.cmd;
     cmd_line_stop = config.cmd_stop;
     cmd_line_after = config.cmd_after;
     cmd_line_end = config.cmd_end;
     cmd_line_ttc = config.cmd_ttc;
+
+    executor_config.timeout = config.timeout;
+    executor_config.helper = config.helper;
+    executor_configure (executor_config);
 }
 
 static void configure_cleanup ()
@@ -36,10 +36,6 @@
 #include <glib.h>
 
 
-static void signal_child() {
-   // signal (SIGCHLD, SIG_DFL);
-}
-
 static void execute_command(const char *cmd) {
     auto *windows_cmd = reinterpret_cast<wchar_t *>(g_utf8_to_utf16(cmd, -1, nullptr, nullptr, nullptr));
     g_return_if_fail (windows_cmd);
@@ -60,34 +56,6 @@ static void execute_command(const char *cmd) {
 }
 
 
-#else
-#include <signal.h>
-#include <unistd.h>
-#include <sys/wait.h>
-
-static void signal_child() {
-    signal (SIGCHLD, SIG_DFL);
-}
-
-static void bury_child (int signal)
-{
-    waitpid (-1, nullptr, WNOHANG);
-}
-
-static void execute_command (const char * cmd)
-{
-    const char * argv[4] = {"/bin/sh", "-c", nullptr, nullptr};
-    argv[2] = cmd;
-    signal (SIGCHLD, bury_child);
-
-    if (fork () == 0)
-    {
-        /* We don't want this process to hog the audio device etc */
-        for (int i = 3; i < 255; i ++)
-            close (i);
-        execv (argv[0], (char * *) argv);
-    }
-}
 #endif
 
 #endif //AUDACIOUS1_SONGCHANGE_CROSSPLATFORM_H
@@ -28,10 +28,15 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../trace-common/trace.h"
+
 #define MIN_RATE 8000
 #define MAX_RATE 192000
 #define RATE_STEP 50
 
+#define MAX_THREADS 64
+#define MAX_BLOCK 65536
+
 class SoXResampler : public EffectPlugin
 {
 public:
@@ -55,7 +60,9 @@ public:
 
     void start (int & channels, int & rate) override;
     Index<float> & process (Index<float> & data) override;
+    Index<float> & finish (Index<float> & data, bool end_of_playlist) override;
     bool flush (bool force) override;
+    int adjust_delay (int delay) override;
 };
 
 EXPORT SoXResampler aud_plugin_instance;
@@ -68,18 +75,29 @@ const char * const SoXResampler::defaults[] = {
     "allow_aliasing", "FALSE",
 #endif
     "use_steep_filter", "FALSE",
+    "threads", "1",
+    "coef_interp", aud::numeric_string<SOXR_COEF_INTERP_AUTO>::str,
+    "coef_cache", "400",
+    "log2_min_dft", "10",
+    "block_frames", "0",
     nullptr
 };
 
 static soxr_t soxr;
 static soxr_error_t error;
 static soxr_quality_spec_t q;
+static soxr_runtime_spec_t rt;
 static int stored_rate;
 static int target_rate;
 static int stored_channels;
 static double ratio;
 static Index<float> buffer;
 
+/* input held back until there is a whole block of it, so that soxr gets
+ * enough at once to split the work between its threads */
+static int block_frames;
+static Index<float> pending;
+
 bool SoXResampler::init ()
 {
     aud_config_set_defaults ("soxr", defaults);
@@ -91,12 +109,14 @@ void SoXResampler::cleanup ()
     soxr_delete (soxr);
     soxr = 0;
     buffer.clear ();
+    pending.clear ();
 }
 
 void SoXResampler::start (int & channels, int & rate)
 {
     soxr_delete (soxr);
     soxr = 0;
+    pending.resize (0);
 
     target_rate = aud_get_int ("soxr", "rate");
     target_rate = aud::clamp (target_rate, MIN_RATE, MAX_RATE);
@@ -115,7 +135,16 @@ void SoXResampler::start (int & channels, int & rate)
 
     q = soxr_quality_spec (recipe, 0);
 
-    soxr = soxr_create (rate, target_rate, channels, & error, nullptr, & q, nullptr);
+    /* 0 threads is one for each CPU */
+    rt = soxr_runtime_spec (aud::clamp (aud_get_int ("soxr", "threads"), 0, MAX_THREADS));
+    rt.flags = aud_get_int ("soxr", "coef_interp");
+    rt.coef_size_kbytes = aud::max (aud_get_int ("soxr", "coef_cache"), 0);
+    rt.log2_min_dft_size = aud::clamp (aud_get_int ("soxr", "log2_min_dft"),
+     8, (int) rt.log2_large_dft_size);
+
+    block_frames = aud::clamp (aud_get_int ("soxr", "block_frames"), 0, MAX_BLOCK);
+
+    soxr = soxr_create (rate, target_rate, channels, & error, nullptr, & q, & rt);
 
     if (error)
     {
@@ -128,11 +157,8 @@ void SoXResampler::start (int & channels, int & rate)
     rate = target_rate;
 }
 
-Index<float> & SoXResampler::process (Index<float> & data)
+static Index<float> & resample (Index<float> & data)
 {
-    if (! soxr)
-         return data;
-
     buffer.resize ((int) (data.len () * ratio) + 256);
 
     size_t samples_done;
@@ -150,14 +176,58 @@ Index<float> & SoXResampler::process (Index<float> & data)
     return buffer;
 }
 
+Index<float> & SoXResampler::process (Index<float> & data)
+{
+    TRACE_SPAN ("SoX Resampler process");
+    if (! soxr)
+         return data;
+
+    if (! block_frames)
+        return resample (data);
+
+    pending.insert (data.begin (), -1, data.len ());
+    data.resize (0);
+
+    if (pending.len () < block_frames * stored_channels)
+        return data;
+
+    Index<float> & out = resample (pending);
+
+    /* on error, what was pending goes out as it is */
+    if (& out == & pending)
+    {
+        data = std::move (pending);
+        return data;
+    }
+
+    pending.resize (0);
+    return out;
+}
+
+/* nothing may be held back at the end of a song */
+Index<float> & SoXResampler::finish (Index<float> & data, bool end_of_playlist)
+{
+    if (! soxr)
+        return data;
+
+    if (pending.len ())
+    {
+        pending.insert (data.begin (), -1, data.len ());
+        data = std::move (pending);
+    }
+
+    return resample (data);
+}
+
 bool SoXResampler::flush (bool force)
 {
     if (! soxr)
         return true;
 
     soxr_delete (soxr);
+    pending.resize (0);
 
-    soxr = soxr_create (stored_rate, target_rate, stored_channels, & error, nullptr, & q, nullptr);
+    soxr = soxr_create (stored_rate, target_rate, stored_channels, & error, nullptr, & q, & rt);
 
     if (error)
     {
@@ -168,6 +238,14 @@ bool SoXResampler::flush (bool force)
     return true;
 }
 
+int SoXResampler::adjust_delay (int delay)
+{
+    if (! soxr)
+        return delay;
+
+    return delay + aud::rescale<int64_t> (pending.len () / stored_channels, stored_rate, 1000);
+}
+
 const char SoXResampler::about[] =
  N_("SoX Resampler Plugin for Audacious\n"
     "Copyright 2013 Michał Lipski\n\n"
@@ -183,6 +261,12 @@ static const ComboItem method_list[] = {
     ComboItem (N_("Ultra High"), SOXR_32_BITQ)
 };
 
+static const ComboItem coef_interp_list[] = {
+    ComboItem (N_("Automatic"), SOXR_COEF_INTERP_AUTO),
+    ComboItem (N_("Low"), SOXR_COEF_INTERP_LOW),
+    ComboItem (N_("High"), SOXR_COEF_INTERP_HIGH)
+};
+
 static const ComboItem phase_response_list[] = {
     ComboItem (N_("Minimum"), SOXR_MINIMUM_PHASE),
     ComboItem (N_("Intermediate"), SOXR_INTERMEDIATE_PHASE),
@@ -202,7 +286,23 @@ const PreferencesWidget SoXResampler::widgets[] = {
     WidgetCheck (N_("Use steep filter"), WidgetBool ("soxr", "use_steep_filter")),
     WidgetSpin (N_("Rate:"),
         WidgetInt ("soxr", "rate"),
-        {MIN_RATE, MAX_RATE, RATE_STEP, N_("Hz")})
+        {MIN_RATE, MAX_RATE, RATE_STEP, N_("Hz")}),
+    WidgetLabel (N_("<b>Performance</b>")),
+    WidgetSpin (N_("Threads:"),
+        WidgetInt ("soxr", "threads"),
+        {0, MAX_THREADS, 1, N_("(0 = one per CPU)")}),
+    WidgetSpin (N_("Input blocks:"),
+        WidgetInt ("soxr", "block_frames"),
+        {0, MAX_BLOCK, 1024, N_("frames (0 = as they come)")}),
+    WidgetCombo (N_("Coefficient interpolation:"),
+        WidgetInt ("soxr", "coef_interp"),
+        {{coef_interp_list}}),
+    WidgetSpin (N_("Coefficient cache:"),
+        WidgetInt ("soxr", "coef_cache"),
+        {0, 65536, 100, N_("KiB")}),
+    WidgetSpin (N_("Smallest DFT:"),
+        WidgetInt ("soxr", "log2_min_dft"),
+        {8, 17, 1, N_("(log2 of size)")})
 };
 
 const PluginPreferences SoXResampler::prefs = {{widgets}};
@@ -26,6 +26,8 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../trace-common/trace.h"
+
 /* The general idea of the speed change algorithm is to divide the input signal
  * into pieces, spaced at a time interval A, using a cosine-shaped window
  * function.  The pieces are then reassembled by adding them together again,
@@ -35,6 +37,23 @@
 #define FREQ    10
 #define OVERLAP  3
 
+/* WSOLA (waveform similarity overlap-add) works the same way, but with shorter
+ * pieces, each of which is first moved by up to a few milliseconds to wherever
+ * it best continues the piece before it.  The best position is the one whose
+ * start correlates best with the audio that followed the previous piece in the
+ * input.  With the pieces lined up in phase, the overlaps add up without the
+ * phasey sound of plain overlap-add, and as the window function is applied per
+ * frame, all channels are cut at the same place. */
+
+#define WSOLA_FREQ 25   /* 40 ms pieces, half of each overlapping the next */
+#define SEEK_FREQ  100  /* moved by up to 10 ms either way */
+#define SEEK_STEP  4    /* coarse search step in frames, refined afterwards */
+
+enum {
+    ALGORITHM_OLA,
+    ALGORITHM_WSOLA
+};
+
 #define CFGSECT "speed-pitch"
 #define MINSPEED 0.25
 #define MAXSPEED 2.0
@@ -85,6 +104,26 @@ static Index<float> cosine;
 static Index<float> in, out;
 static int src, dst;
 
+/* settings, read when they change rather than for every buffer; the algorithm
+ * only changes on start or flush, when there is no state to carry over */
+static bool decouple;
+static float speed, pitch;
+static int algorithm;
+
+/* WSOLA state; positions are in frames, relative to in_start */
+static int seg_frames, hop_frames, seek_frames;
+static Index<float> hann;  /* interleaved, one weight per sample */
+static int in_start;       /* input before this has been used up */
+static double in_pos;      /* where the next piece would come from unmoved */
+static int last_pos;       /* where the previous piece came from, or -1 */
+
+static void update_settings ()
+{
+    decouple = aud_get_bool (CFGSECT, "decouple");
+    speed = aud_get_double (CFGSECT, "speed");
+    pitch = aud_get_double (CFGSECT, "pitch");
+}
+
 static void add_data (Index<float> & b, Index<float> & data, float ratio)
 {
     int oldlen = b.len ();
@@ -111,13 +150,24 @@ bool SpeedPitch::flush (bool force)
     in.resize (0);
     out.resize (0);
 
+    algorithm = aud_get_int (CFGSECT, "algorithm");
+
     /* The source and destination pointers give the center of the next cosine
-     * window to be copied, relative to the current input and output buffers. */
+     * window to be copied, relative to the current input and output buffers.
+     * For WSOLA, the destination pointer gives the start of the next piece, in
+     * frames. */
     src = dst = 0;
 
+    in_start = 0;
+    in_pos = 0;
+    last_pos = -1;
+
     /* The output buffer always extends right of the destination pointer by half
-     * the width of a cosine window. */
-    out.insert (0, width / 2);
+     * the width of a cosine window, or for WSOLA by a whole piece. */
+    if (algorithm == ALGORITHM_WSOLA)
+        out.insert (0, seg_frames * curchans);
+    else
+        out.insert (0, width / 2);
 
     return true;
 }
@@ -144,24 +194,184 @@ void SpeedPitch::start (int & chans, int & rate)
     for (int i = 0; i < width; i ++)
         cosine[i] = (1.0 - cos (2.0 * M_PI * i / width)) / OVERLAP;
 
+    /* A Hann window of even length adds up to exactly one when overlapped by
+     * half its width. */
+    seg_frames = (currate / WSOLA_FREQ) & ~1;
+    hop_frames = seg_frames / 2;
+    seek_frames = currate / SEEK_FREQ;
+
+    hann.resize (seg_frames * curchans);
+    for (int f = 0; f < seg_frames; f ++)
+    {
+        float w = 0.5 - 0.5 * cos (2.0 * M_PI * f / seg_frames);
+        for (int c = 0; c < curchans; c ++)
+            hann[f * curchans + c] = w;
+    }
+
     flush (true);
 }
 
+/* correlation of two stretches of interleaved audio (the sum over all the
+ * channels), normalized by the energy of the first */
+static float similarity (const float * a, const float * b, int samples)
+{
+    float corr = 0, energy = 0;
+
+    for (int i = 0; i < samples; i ++)
+    {
+        corr += a[i] * b[i];
+        energy += a[i] * a[i];
+    }
+
+    return corr / sqrtf (energy + 1e-9f);
+}
+
+/* the position within [lo, hi] whose start best matches <ref> */
+static int best_position (const float * base, const float * ref, int lo, int hi)
+{
+    int samples = hop_frames * curchans;
+    int best = lo;
+    float best_score = -INFINITY;
+
+    auto check = [&] (int pos) {
+        float score = similarity (base + pos * curchans, ref, samples);
+        if (score > best_score)
+        {
+            best_score = score;
+            best = pos;
+        }
+    };
+
+    for (int pos = lo; pos <= hi; pos += SEEK_STEP)
+        check (pos);
+
+    int coarse = best;
+    for (int pos = aud::max (lo, coarse - SEEK_STEP + 1);
+         pos <= aud::min (hi, coarse + SEEK_STEP - 1); pos ++)
+    {
+        if (pos != coarse)
+            check (pos);
+    }
+
+    return best;
+}
+
+#define BLOCK 8
+
+/* each piece is windowed as it is added to what the pieces before it left in
+ * the output; neither the piece nor the window overlaps the output, which
+ * __restrict tells the compiler */
+static void overlap_add (float * __restrict dest, const float * __restrict piece,
+ const float * __restrict window, int samples)
+{
+    int i = 0;
+
+    for (; i + BLOCK <= samples; i += BLOCK)
+    {
+        for (int j = 0; j < BLOCK; j ++)
+            dest[i + j] += piece[i + j] * window[i + j];
+    }
+
+    for (; i < samples; i ++)
+        dest[i] += piece[i] * window[i];
+}
+
+static Index<float> & process_wsola (Index<float> & data, bool ending)
+{
+    int chans = curchans;
+    int avail = in.len () / chans - in_start;
+    double in_step = hop_frames * speed / pitch;
+
+    while (avail > 0)
+    {
+        /* Wait until the whole search range is in (unless the song is
+         * ending, in which case pieces are cut short at the end). */
+        int nominal = (int) in_pos;
+        if (ending ? nominal >= avail : nominal + seek_frames + seg_frames > avail)
+            break;
+
+        const float * base = & in[in_start * chans];
+        int pos = nominal;
+
+        if (last_pos >= 0)
+        {
+            int lo = aud::max (0, nominal - seek_frames);
+            int hi = aud::min (nominal + seek_frames, avail - seg_frames);
+
+            if (lo <= hi)
+                pos = best_position (base, base + (last_pos + hop_frames) * chans, lo, hi);
+        }
+
+        int frames = aud::min (seg_frames, avail - pos);
+        overlap_add (& out[dst * chans], base + pos * chans, hann.begin (), frames * chans);
+
+        last_pos = pos;
+        in_pos += in_step;
+        dst += hop_frames;
+
+        out.insert (-1, hop_frames * chans);
+    }
+
+    /* Let go of the input that can no longer be part of a piece.  It is only
+     * removed once it outnumbers the rest, so the buffer is not shifted on
+     * every call. */
+    int keep = (int) in_pos - seek_frames;
+    if (last_pos >= 0)
+        keep = aud::min (keep, last_pos + hop_frames);
+
+    int used = aud::clamp (keep, 0, avail);
+    in_start += used;
+    in_pos -= used;
+    if (last_pos >= 0)
+        last_pos -= used;
+
+    if (in_start * chans >= in.len () / 2)
+    {
+        in.remove (0, in_start * chans);
+        in_start = 0;
+    }
+
+    data.resize (0);
+
+    /* Return output up to the destination pointer (or up to the end of the
+     * last piece if the song is ending, after which the next song starts
+     * afresh, all of this song's input having been used). */
+    int ret = (ending && last_pos >= 0) ? dst + hop_frames : dst;
+    data.move_from (out, 0, 0, ret * chans, true, true);
+    dst = 0;
+
+    if (ending)
+    {
+        out.resize (0);
+        out.insert (0, seg_frames * chans);
+
+        in.resize (0);
+        in_start = 0;
+        in_pos = 0;
+        last_pos = -1;
+    }
+
+    return data;
+}
+
 Index<float> & SpeedPitch::process (Index<float> & data, bool ending)
 {
+    TRACE_SPAN ("Speed and Pitch process");
     const float * cosine_center = & cosine[width / 2];
-    float pitch = aud_get_double (CFGSECT, "pitch");
-    float speed = aud_get_double (CFGSECT, "speed");
 
     /* Copy the passed audio to the input buffer, scaled to adjust pitch. */
     add_data (in, data, 1.0 / pitch);
 
-    if (! aud_get_bool (CFGSECT, "decouple"))
+    if (! decouple)
     {
         data = std::move (in);
+        in_start = 0;
         return data;
     }
 
+    if (algorithm == ALGORITHM_WSOLA)
+        return process_wsola (data, ending);
+
     /* Calculate the spacing interval for input. */
     int instep = (int) round ((outstep / curchans) * speed / pitch) * curchans;
 
@@ -203,13 +413,22 @@ Index<float> & SpeedPitch::process (Index<float> & data, bool ending)
 
 int SpeedPitch::adjust_delay (int delay)
 {
-    if (! aud_get_bool (CFGSECT, "decouple"))
+    if (! decouple)
         return delay;
 
     float samples_to_ms = 1000.0 / (curchans * currate);
-    float speed = aud_get_double (CFGSECT, "speed");
-    int in_samples = in.len () - src;
-    int out_samples = dst;
+    int in_samples, out_samples;
+
+    if (algorithm == ALGORITHM_WSOLA)
+    {
+        in_samples = in.len () - (in_start + (int) in_pos) * curchans;
+        out_samples = dst * curchans;
+    }
+    else
+    {
+        in_samples = in.len () - src;
+        out_samples = dst;
+    }
 
     return (delay + in_samples * samples_to_ms) * speed + out_samples * samples_to_ms;
 }
@@ -221,6 +440,8 @@ static void sync_speed ()
         aud_set_double (CFGSECT, "speed", aud_get_double (CFGSECT, "pitch"));
         hook_call ("speed-pitch set speed", nullptr);
     }
+
+    update_settings ();
 }
 
 static void pitch_changed ()
@@ -241,16 +462,26 @@ const char * const SpeedPitch::defaults[] = {
  "decouple", "TRUE",
  "speed", "1",
  "pitch", "1",
+ "algorithm", "0",
  nullptr};
 
+static const ComboItem algorithm_items[] = {
+    ComboItem (N_("Overlap-add"), ALGORITHM_OLA),
+    ComboItem (N_("WSOLA (better for speech)"), ALGORITHM_WSOLA)
+};
+
 const PreferencesWidget SpeedPitch::widgets[] = {
     WidgetLabel (N_("<b>Speed</b>")),
     WidgetCheck (N_("Decouple from pitch"),
         WidgetBool (CFGSECT, "decouple", sync_speed)),
     WidgetSpin (N_("Multiplier:"),
-        WidgetFloat (CFGSECT, "speed", nullptr, "speed-pitch set speed"),
+        WidgetFloat (CFGSECT, "speed", update_settings, "speed-pitch set speed"),
         {MINSPEED, MAXSPEED, 0.05},
         WIDGET_CHILD),
+    WidgetCombo (N_("Algorithm:"),
+        WidgetInt (CFGSECT, "algorithm"),
+        {{algorithm_items}},
+        WIDGET_CHILD),
     WidgetLabel (N_("<b>Pitch</b>")),
     WidgetSpin (nullptr,
         WidgetFloat (semitones, semitones_changed, "speed-pitch set semitones"),
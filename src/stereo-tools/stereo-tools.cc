@@ -0,0 +1,343 @@
+/*
+ * Stereo Tools Plugin for Audacious
+ * Copyright 2024 Stereo Tools Plugin Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* The bitcrusher, crystalizer, extra stereo and voice removal effects in a
+ * single plugin.  Each is a cheap loop on its own, so when several of them
+ * are enabled as separate plugins most of the time goes into walking the
+ * buffer again and looking up settings.  Here all the enabled stages run
+ * on one block of frames at a time while it is in the cache, and settings
+ * are read only after they change. */
+
+#include <atomic>
+#include <math.h>
+
+#include <libaudcore/audio.h>
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
+
+#include "../trace-common/trace.h"
+
+#define BLOCK 256   /* frames */
+
+static const char * const stereo_tools_defaults[] = {
+    "bitcrusher", "FALSE",
+    "depth", "32",
+    "downsample", "1.0",
+    "crystalizer", "FALSE",
+    "crystalizer_intensity", "1",
+    "extra_stereo", "FALSE",
+    "extra_stereo_intensity", "2.5",
+    "voice_removal", "FALSE",
+    nullptr
+};
+
+static std::atomic<bool> settings_changed;
+
+static void changed ()
+{
+    settings_changed = true;
+}
+
+static const PreferencesWidget stereo_tools_widgets[] = {
+    WidgetLabel (N_("<b>Stages</b> (applied in this order)")),
+    WidgetCheck (N_("Bitcrusher"),
+        WidgetBool ("stereo_tools", "bitcrusher", changed)),
+    WidgetSpin (N_("Bit depth:"),
+        WidgetFloat ("stereo_tools", "depth", changed),
+        {2, 32, 0.1},
+        WIDGET_CHILD),
+    WidgetSpin (N_("Downsample ratio:"),
+        WidgetFloat ("stereo_tools", "downsample", changed),
+        {0.02, 1.0, 0.02},
+        WIDGET_CHILD),
+    WidgetCheck (N_("Crystalizer"),
+        WidgetBool ("stereo_tools", "crystalizer", changed)),
+    WidgetSpin (N_("Intensity:"),
+        WidgetFloat ("stereo_tools", "crystalizer_intensity", changed),
+        {0, 10, 0.1},
+        WIDGET_CHILD),
+    WidgetCheck (N_("Extra stereo (stereo only)"),
+        WidgetBool ("stereo_tools", "extra_stereo", changed)),
+    WidgetSpin (N_("Intensity:"),
+        WidgetFloat ("stereo_tools", "extra_stereo_intensity", changed),
+        {0, 10, 0.1},
+        WIDGET_CHILD),
+    WidgetCheck (N_("Voice removal (stereo only)"),
+        WidgetBool ("stereo_tools", "voice_removal", changed))
+};
+
+static const PluginPreferences stereo_tools_prefs = {{stereo_tools_widgets}};
+
+static const char stereo_tools_about[] =
+ N_("Stereo Tools Plugin for Audacious\n"
+    "Copyright 2024 Stereo Tools Plugin Authors\n\n"
+    "Combines the Bitcrusher, Crystalizer, Extra Stereo and Voice Removal "
+    "effects in a single pass over the audio.");
+
+class StereoTools : public EffectPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("Stereo Tools"),
+        PACKAGE,
+        stereo_tools_about,
+        & stereo_tools_prefs
+    };
+
+    constexpr StereoTools () : EffectPlugin (info, 0, true) {}
+
+    bool init () override;
+
+    void start (int & channels, int & rate) override;
+    Index<float> & process (Index<float> & data) override;
+    bool flush (bool force) override;
+};
+
+EXPORT StereoTools aud_plugin_instance;
+
+/* only touched by the audio thread */
+static struct {
+    bool crush, cryst, extra, voice;
+    float crush_ratio, crush_scale, crush_unscale;
+    float cryst_amount, extra_amount;
+} s;
+
+static int st_channels;
+static float crush_accum;
+static float crush_hold[AUD_MAX_CHANNELS];
+static float cryst_prev[AUD_MAX_CHANNELS];
+
+static void update_settings ()
+{
+    s.crush = aud_get_bool ("stereo_tools", "bitcrusher");
+    s.cryst = aud_get_bool ("stereo_tools", "crystalizer");
+    s.extra = aud_get_bool ("stereo_tools", "extra_stereo");
+    s.voice = aud_get_bool ("stereo_tools", "voice_removal");
+
+    /* the same arithmetic as the bitcrusher plugin, folded into one
+     * scale factor each way */
+    float depth = aud_get_double ("stereo_tools", "depth");
+    float scale = pow (2., depth) / 2.;
+    float gain = (33. - depth) / 8.;
+
+    s.crush_ratio = aud_get_double ("stereo_tools", "downsample");
+    s.crush_scale = gain * scale;
+    s.crush_unscale = 1 / (scale * gain);
+
+    s.cryst_amount = aud_get_double ("stereo_tools", "crystalizer_intensity");
+    s.extra_amount = aud_get_double ("stereo_tools", "extra_stereo_intensity");
+}
+
+bool StereoTools::init ()
+{
+    aud_config_set_defaults ("stereo_tools", stereo_tools_defaults);
+    settings_changed = true;
+    return true;
+}
+
+void StereoTools::start (int & channels, int & rate)
+{
+    st_channels = aud::min (channels, AUD_MAX_CHANNELS);
+    flush (true);
+}
+
+bool StereoTools::flush (bool force)
+{
+    crush_accum = 0;
+
+    for (int c = 0; c < AUD_MAX_CHANNELS; c ++)
+    {
+        crush_hold[c] = 0;
+        cryst_prev[c] = 0;
+    }
+
+    return true;
+}
+
+static inline float crush (float x)
+{
+    return floorf (x * s.crush_scale + 0.5f) * s.crush_unscale;
+}
+
+static void crush_stereo (float * __restrict l, float * __restrict r, int frames)
+{
+    if (s.crush_ratio >= 1)
+    {
+        for (int i = 0; i < frames; i ++)
+        {
+            l[i] = crush (l[i]);
+            r[i] = crush (r[i]);
+        }
+
+        crush_hold[0] = l[frames - 1];
+        crush_hold[1] = r[frames - 1];
+        return;
+    }
+
+    /* sample and hold is serial */
+    for (int i = 0; i < frames; i ++)
+    {
+        crush_accum += s.crush_ratio;
+
+        if (crush_accum >= 1)
+        {
+            crush_hold[0] = crush (l[i]);
+            crush_hold[1] = crush (r[i]);
+            crush_accum -= 1;
+        }
+
+        l[i] = crush_hold[0];
+        r[i] = crush_hold[1];
+    }
+}
+
+static void crystalize (const float * __restrict in, float * __restrict out,
+ int frames, float amount)
+{
+    for (int i = 0; i < frames; i ++)
+        out[i] = in[i] + (in[i] - in[i - 1]) * amount;
+}
+
+static void widen (float * __restrict l, float * __restrict r, int frames, float amount)
+{
+    for (int i = 0; i < frames; i ++)
+    {
+        float center = (l[i] + r[i]) / 2;
+        l[i] = center + (l[i] - center) * amount;
+        r[i] = center + (r[i] - center) * amount;
+    }
+}
+
+static void remove_voice (float * __restrict l, float * __restrict r, int frames)
+{
+    for (int i = 0; i < frames; i ++)
+    {
+        l[i] -= r[i];
+        r[i] = l[i];
+    }
+}
+
+static void process_stereo (float * data, int frames)
+{
+    float in_l[BLOCK + 1], in_r[BLOCK + 1];
+    float out_l[BLOCK], out_r[BLOCK];
+
+    /* one past the start: l[-1] and r[-1] are for the crystalizer's
+     * previous input */
+    float * l = in_l + 1, * r = in_r + 1;
+
+    for (int i = 0; i < frames; i ++)
+    {
+        l[i] = data[2 * i];
+        r[i] = data[2 * i + 1];
+    }
+
+    if (s.crush)
+        crush_stereo (l, r, frames);
+
+    if (s.cryst)
+    {
+        l[-1] = cryst_prev[0];
+        r[-1] = cryst_prev[1];
+        cryst_prev[0] = l[frames - 1];
+        cryst_prev[1] = r[frames - 1];
+
+        crystalize (l, out_l, frames, s.cryst_amount);
+        crystalize (r, out_r, frames, s.cryst_amount);
+
+        l = out_l;
+        r = out_r;
+    }
+
+    if (s.extra)
+        widen (l, r, frames, s.extra_amount);
+    if (s.voice)
+        remove_voice (l, r, frames);
+
+    for (int i = 0; i < frames; i ++)
+    {
+        data[2 * i] = l[i];
+        data[2 * i + 1] = r[i];
+    }
+}
+
+/* any other channel count: only the bitcrusher and crystalizer apply */
+static void process_other (float * data, int frames)
+{
+    for (int i = 0; i < frames; i ++, data += st_channels)
+    {
+        bool hold = false;
+
+        if (s.crush)
+        {
+            crush_accum += s.crush_ratio;
+            if (crush_accum >= 1)
+            {
+                crush_accum -= 1;
+                hold = true;
+            }
+        }
+
+        for (int c = 0; c < st_channels; c ++)
+        {
+            float x = data[c];
+
+            if (s.crush)
+            {
+                if (hold)
+                    crush_hold[c] = crush (x);
+                x = crush_hold[c];
+            }
+
+            if (s.cryst)
+            {
+                float current = x;
+                x = current + (current - cryst_prev[c]) * s.cryst_amount;
+                cryst_prev[c] = current;
+            }
+
+            data[c] = x;
+        }
+    }
+}
+
+Index<float> & StereoTools::process (Index<float> & data)
+{
+    TRACE_SPAN ("Stereo Tools process");
+    if (settings_changed.exchange (false))
+        update_settings ();
+
+    if (! s.crush && ! s.cryst && (st_channels != 2 || (! s.extra && ! s.voice)))
+        return data;
+
+    float * f = data.begin ();
+    int frames = data.len () / st_channels;
+
+    if (st_channels == 2)
+    {
+        for (int done = 0; done < frames; done += BLOCK)
+            process_stereo (f + 2 * done, aud::min (frames - done, BLOCK));
+    }
+    else
+        process_other (f, frames);
+
+    return data;
+}
@@ -7,6 +7,8 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../trace-common/trace.h"
+
 class ExtraStereo : public EffectPlugin
 {
 public:
@@ -64,6 +66,7 @@ void ExtraStereo::start (int & channels, int & rate)
 
 Index<float> & ExtraStereo::process(Index<float> & data)
 {
+    TRACE_SPAN ("Extra Stereo process");
     float value = aud_get_double ("extra_stereo", "intensity");
     float * f, * end;
     float center;
@@ -8,12 +8,39 @@
 // implied.  In no event shall the authors be liable for any damages arising
 // from the use of this software.
 
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
 #include <QXmlStreamReader>
 
 #include "icecast-model.h"
 
 static const char *ICECAST_YP = "http://dir.xiph.org/yp.xml";
 
+// the directory as parsed last time, one station to a line, which is used
+// instead of fetching it again for a while
+static const char *CACHE_NAME = "icecast-directory";
+static const char *CACHE_MAGIC = "Icecast directory 1";
+static constexpr int CACHE_TTL = 3600;
+
+// stations are shown as they are parsed, this many at a time
+static constexpr int BATCH_SIZE = 500;
+
+static QString cache_path ()
+{
+    return QString (filename_build ({aud_get_path (AudPath::UserDir), CACHE_NAME}));
+}
+
+static QByteArray cache_field (const QString & str)
+{
+    QByteArray utf8 = str.toUtf8 ();
+    utf8.replace ('\t', ' ');
+    utf8.replace ('\n', ' ');
+    utf8.replace ('\r', ' ');
+    return utf8;
+}
+
 IcecastTunerModel::IcecastTunerModel (QObject * parent) :
     QAbstractListModel (parent)
 {
@@ -22,77 +49,241 @@ IcecastTunerModel::IcecastTunerModel (QObject * parent) :
 
 IcecastTunerModel::~IcecastTunerModel ()
 {
+    m_cancel = true;
+    if (m_thread.joinable ())
+        m_thread.join ();
+
     m_results.clear ();
 }
 
+// The directory is tens of megabytes, so it is read and parsed on a thread
+// of its own as it comes in, not after it has all been downloaded.
 void IcecastTunerModel::fetch_stations ()
 {
-    vfs_async_file_get_contents(ICECAST_YP, [&] (const char *, const Index<char> & buf) {
-        if (! buf.len ())
-            return;
+    if (m_thread.joinable ())
+        return;
 
-        beginResetModel ();
+    m_thread = std::thread ([this] () { load_stations (); });
+}
 
-        AUDINFO("icecast: got results from YP server\n");
+void IcecastTunerModel::add_station (const IcecastEntry & entry)
+{
+    m_batch.append (entry);
+
+    if (m_batch.len () >= BATCH_SIZE)
+        flush_stations ();
+}
+
+void IcecastTunerModel::flush_stations ()
+{
+    if (! m_batch.len ())
+        return;
+
+    bool was_empty;
+
+    {
+        std::lock_guard<std::mutex> lock (m_mutex);
+        was_empty = ! m_pending.len ();
+        m_pending.move_from (m_batch, 0, -1, -1, true, true);
+    }
+
+    // one call takes all that has been handed over by then
+    if (was_empty)
+        QMetaObject::invokeMethod (this, [this] () { take_stations (); }, Qt::QueuedConnection);
+}
+
+void IcecastTunerModel::take_stations ()
+{
+    Index<IcecastEntry> batch;
+
+    {
+        std::lock_guard<std::mutex> lock (m_mutex);
+        batch = std::move (m_pending);
+    }
+
+    if (! batch.len ())
+        return;
+
+    int first = m_results.len ();
+
+    beginInsertRows (QModelIndex (), first, first + batch.len () - 1);
+    m_results.move_from (batch, 0, -1, -1, true, true);
+    endInsertRows ();
+}
+
+bool IcecastTunerModel::load_cache (const QString & path)
+{
+    QFileInfo info (path);
+    if (! info.exists () || info.lastModified ().secsTo (QDateTime::currentDateTime ()) > CACHE_TTL)
+        return false;
+
+    QFile file (path);
+    if (! file.open (QIODevice::ReadOnly))
+        return false;
+
+    if (file.readLine ().trimmed () != CACHE_MAGIC)
+        return false;
+
+    int n_stations = 0;
+
+    while (! m_cancel && ! file.atEnd ())
+    {
+        QByteArray line = file.readLine ();
+        if (line.endsWith ('\n'))
+            line.chop (1);
+
+        QList<QByteArray> fields = line.split ('\t');
+        if (fields.size () != 6)
+            continue;
 
-        // oh, this is going to be fun... parse the XML as fast as possible
-        QXmlStreamReader reader (QByteArray (buf.begin (), buf.len ()));
         IcecastEntry entry;
+        entry.title = QString::fromUtf8 (fields[0]);
+        entry.genre = QString::fromUtf8 (fields[1]);
+        entry.current_song = QString::fromUtf8 (fields[2]);
+        entry.stream_uri = QString::fromUtf8 (fields[3]);
+        entry.type = (decltype (entry.type)) aud::clamp (fields[4].toInt (),
+         (int) IcecastEntry::MP3, (int) IcecastEntry::Other);
+        entry.bitrate = fields[5].toInt ();
+
+        add_station (entry);
+        n_stations ++;
+    }
+
+    flush_stations ();
+
+    AUDINFO ("icecast: got %d stations from cache\n", n_stations);
+    return true;
+}
+
+void IcecastTunerModel::load_stations ()
+{
+    QString path = cache_path ();
+    if (load_cache (path))
+        return;
+
+    VFSFile file (ICECAST_YP, "r");
+    if (! file)
+    {
+        AUDERR ("icecast: unable to fetch %s: %s\n", ICECAST_YP, file.error ());
+        return;
+    }
+
+    // written as the stations are parsed, and kept only if they all were
+    QSaveFile cache (path);
+    bool caching = cache.open (QIODevice::WriteOnly);
+    if (caching)
+        cache.write (QByteArray (CACHE_MAGIC) + '\n');
+
+    QXmlStreamReader reader;
+    IcecastEntry entry {};
+    QString text;
+
+    // lets prefab some atoms for fast comparisons
+    QString entry_atom = QString ("entry");
+    QString server_name_atom = QString ("server_name");
+    QString listen_url_atom = QString ("listen_url");
+    QString server_type_atom = QString ("server_type");
+    QString bitrate_atom = QString ("bitrate");
+    QString genre_atom = QString ("genre");
+    QString current_song_atom = QString ("current_song");
+    QString mp3_atom = QString ("audio/mpeg");
+    QString aac_atom = QString ("audio/aacp");
+    QString vorbis_atom = QString ("application/ogg");
+
+    char buf[65536];
+    int64_t len;
+    int n_stations = 0;
+
+    while (! m_cancel && (len = file.fread (buf, 1, sizeof buf)) > 0)
+    {
+        reader.addData (QByteArray (buf, len));
 
-        // lets prefab some atoms for fast comparisons
-        QString entry_atom = QString ("entry");
-        QString server_name_atom = QString ("server_name");
-        QString listen_url_atom = QString ("listen_url");
-        QString server_type_atom = QString ("server_type");
-        QString bitrate_atom = QString ("bitrate");
-        QString genre_atom = QString ("genre");
-        QString current_song_atom = QString ("current_song");
-        QString mp3_atom = QString ("audio/mpeg");
-        QString aac_atom = QString ("audio/aacp");
-        QString vorbis_atom = QString ("application/ogg");
-
-        while (! reader.atEnd ()) {
-            auto token_type = reader.readNext ();
-
-            switch (token_type) {
+        // the text of an element may be split between two reads, so it is
+        // collected here rather than with readElementText()
+        while (! m_cancel && ! reader.atEnd ())
+        {
+            switch (reader.readNext ()) {
             case QXmlStreamReader::StartElement:
+                if (! reader.name ().compare (entry_atom))
+                {
+                    entry = IcecastEntry ();
+                    entry.type = IcecastEntry::Other;
+                    entry.bitrate = 0;
+                }
+
+                text.clear ();
+                break;
+            case QXmlStreamReader::Characters:
+                text += reader.text ();
+                break;
+            case QXmlStreamReader::EndElement:
                 if (! reader.name ().compare (server_name_atom))
-                    entry.title = reader.readElementText ();
+                    entry.title = text;
                 else if (! reader.name ().compare (listen_url_atom))
-                    entry.stream_uri = reader.readElementText ();
+                    entry.stream_uri = text;
                 else if (! reader.name ().compare (current_song_atom))
-                    entry.current_song = reader.readElementText ();
+                    entry.current_song = text;
                 else if (! reader.name ().compare (genre_atom))
-                    entry.genre = reader.readElementText ();
+                    entry.genre = text;
                 else if (! reader.name ().compare (server_type_atom))
                 {
-                    auto server_type = reader.readElementText ();
-
-                    if (! server_type.compare (mp3_atom))
+                    if (! text.compare (mp3_atom))
                         entry.type = IcecastEntry::MP3;
-                    else if (! server_type.compare (aac_atom))
+                    else if (! text.compare (aac_atom))
                         entry.type = IcecastEntry::AAC;
-                    else if (! server_type.compare (vorbis_atom))
+                    else if (! text.compare (vorbis_atom))
                         entry.type = IcecastEntry::Vorbis;
                     else
                         entry.type = IcecastEntry::Other;
                 }
                 else if (! reader.name ().compare (bitrate_atom))
-                    entry.bitrate = reader.readElementText ().toInt ();
-
-                break;
-            case QXmlStreamReader::EndElement:
-                if (! reader.name ().compare (entry_atom))
-                    m_results.append (entry);
+                    entry.bitrate = text.toInt ();
+                else if (! reader.name ().compare (entry_atom))
+                {
+                    add_station (entry);
+                    n_stations ++;
+
+                    if (caching)
+                        cache.write (cache_field (entry.title) + '\t' +
+                         cache_field (entry.genre) + '\t' +
+                         cache_field (entry.current_song) + '\t' +
+                         cache_field (entry.stream_uri) + '\t' +
+                         QByteArray::number ((int) entry.type) + '\t' +
+                         QByteArray::number (entry.bitrate) + '\n');
+                }
 
+                text.clear ();
                 break;
             default:
                 break;
             }
         }
 
-        endResetModel ();
-    });
+        // wait for more data
+        if (reader.error () == QXmlStreamReader::PrematureEndOfDocumentError)
+            continue;
+
+        if (reader.hasError ())
+            break;
+    }
+
+    flush_stations ();
+
+    if (m_cancel)
+        return;
+
+    if (reader.hasError ())
+    {
+        AUDERR ("icecast: error in directory: %s\n",
+         (const char *) reader.errorString ().toUtf8 ());
+        return;
+    }
+
+    AUDINFO ("icecast: got %d stations from YP server\n", n_stations);
+
+    // an unfinished cache is dropped when it goes out of scope
+    if (caching && n_stations && ! cache.commit ())
+        AUDERR ("icecast: unable to write %s\n", (const char *) path.toUtf8 ());
 }
 
 const IcecastEntry & IcecastTunerModel::entry (int idx) const
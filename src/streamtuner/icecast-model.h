@@ -11,6 +11,10 @@
 #ifndef STREAMTUNER_ICECAST_MODEL_H
 #define STREAMTUNER_ICECAST_MODEL_H
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 #include <libaudcore/drct.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
@@ -21,7 +25,7 @@
 #include <libaudcore/runtime.h>
 #include <libaudcore/index.h>
 #include <libaudcore/playlist.h>
-#include <libaudcore/vfs_async.h>
+#include <libaudcore/vfs.h>
 
 #include <libaudqt/treeview.h>
 
@@ -71,7 +75,21 @@ public:
     const IcecastEntry & entry (int idx) const;
 
 private:
+    // these run on m_thread, which hands the stations over in batches
+    void load_stations ();
+    bool load_cache (const QString & path);
+    void add_station (const IcecastEntry & entry);
+    void flush_stations ();
+
+    void take_stations ();
+
     Index<IcecastEntry> m_results;
+
+    std::thread m_thread;
+    std::atomic<bool> m_cancel {false};
+
+    std::mutex m_mutex;
+    Index<IcecastEntry> m_batch, m_pending;
 };
 
 #endif
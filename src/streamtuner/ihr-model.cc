@@ -33,6 +33,7 @@
 #include <QJsonObject>
 
 #include "ihr-model.h"
+#include "../vfs-common/http-fetch.h"
 
 IHRMarketModel::IHRMarketModel (QObject * parent) :
     QAbstractListModel (parent)
@@ -82,7 +83,7 @@ static const char *URI_GET_MARKETS = "https://api.iheart.com/api/v2/content/mark
 
 void IHRMarketModel::fetch_markets ()
 {
-    vfs_async_file_get_contents (URI_GET_MARKETS, [&] (const char *, const Index<char> & buf) {
+    http_fetch (URI_GET_MARKETS, [this] (const char *, const Index<char> & buf) {
         if (! buf.len ())
             return;
 
@@ -192,7 +193,7 @@ void IHRTunerModel::fetch_stations (int market_id)
 {
     StringBuf uri = str_printf("https://api.iheart.com/api/v2/content/liveStations?limit=100&marketId=%d", market_id);
 
-    vfs_async_file_get_contents(uri, [&] (const char *, const Index<char> & buf) {
+    http_fetch(uri, [this, market_id] (const char *, const Index<char> & buf) {
         if (! buf.len ())
             return;
 
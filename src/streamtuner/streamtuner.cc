@@ -35,6 +35,7 @@
 #include "shoutcast-widget.h"
 #include "icecast-widget.h"
 #include "ihr-widget.h"
+#include "../vfs-common/http-fetch.h"
 
 class StreamTunerWidget : public QTabWidget {
 public:
@@ -77,6 +78,7 @@ public:
 
     constexpr StreamTunerPlugin () : GeneralPlugin (info, false) { }
 
+    void cleanup () override { http_fetch_cleanup (); }
     void * get_qt_widget () override;
 };
 
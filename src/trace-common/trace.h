@@ -0,0 +1,262 @@
+/*
+ * trace.h
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_TRACE_H
+#define AUD_TRACE_H
+
+/* Spans of time on the audio path (decoding, effects, output), for finding
+ * which stage was late when the audio drops out.  Built in only with
+ * "meson setup -Dtrace=true" or "./configure --enable-trace"; otherwise
+ * the macros are empty:
+ *
+ *   TRACE_SPAN ("ALSA write_audio");  times the rest of the enclosing scope
+ *   TRACE_MARK ("ALSA xrun");         a single moment
+ *
+ * Names must be string literals without quotes or backslashes, and there
+ * can be one TRACE_SPAN per scope.
+ *
+ * Every thread records into a buffer of its own, which holds its last
+ * TRACE_BUFFER_EVENTS events; only that thread writes to it, without
+ * locks, and only its first event allocates.  trace_dump() writes what
+ * all plugins have recorded as a Chrome trace (JSON), for Perfetto or
+ * chrome://tracing; the Output Statistics plugin has a button for that.
+ * Each plugin has its own copy of this code (it is all inline, so nothing
+ * else needs to be built), and the "trace dump" hook, with the FILE * as
+ * data, is how the events of the others get into the file.  A span in a
+ * decoder's loop holds the effects and the output, which run inside
+ * write_audio(); what is not covered by those is the decoding. */
+
+#ifdef USE_TRACE
+
+#include <atomic>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <libaudcore/hook.h>
+#include <libaudcore/objects.h>
+
+#define TRACE_BUFFER_EVENTS 16384
+
+#define TRACE_SPAN(name) TraceSpan trace_span_ (name)
+#define TRACE_MARK(name) trace_record (name, trace_now (), -1)
+
+struct TraceEvent {
+    std::atomic<const char *> name;
+    std::atomic<int64_t> start;     /* ns */
+    std::atomic<int64_t> length;    /* ns, or -1 for a mark */
+};
+
+struct TraceBuffer {
+    TraceBuffer * next;
+    std::atomic<bool> in_use;
+    int tid;
+    std::atomic<uint64_t> written;  /* events since the buffer was made */
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+/* while a thread lives, it keeps its buffer; then another thread can, and
+ * the events left in it are shown as that thread's */
+struct TraceThread {
+    TraceBuffer * buffer = nullptr;
+
+    ~TraceThread ()
+    {
+        if (buffer)
+            buffer->in_use.store (false, std::memory_order_release);
+    }
+};
+
+inline int64_t trace_now ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* buffers are never freed, only handed from one thread to another */
+inline std::atomic<TraceBuffer *> & trace_buffers ()
+{
+    static std::atomic<TraceBuffer *> first;
+    return first;
+}
+
+inline void trace_write_events (FILE * file)
+{
+    int pid = getpid ();
+    auto copy = new TraceEvent[TRACE_BUFFER_EVENTS];
+
+    for (TraceBuffer * buffer = trace_buffers ().load (std::memory_order_acquire);
+         buffer; buffer = buffer->next)
+    {
+        uint64_t end = buffer->written.load (std::memory_order_acquire);
+        uint64_t begin = (end > TRACE_BUFFER_EVENTS) ? end - TRACE_BUFFER_EVENTS : 0;
+
+        for (uint64_t i = begin; i < end; i ++)
+        {
+            TraceEvent & from = buffer->events[i % TRACE_BUFFER_EVENTS];
+            TraceEvent & to = copy[i % TRACE_BUFFER_EVENTS];
+            to.name.store (from.name.load (std::memory_order_relaxed), std::memory_order_relaxed);
+            to.start.store (from.start.load (std::memory_order_relaxed), std::memory_order_relaxed);
+            to.length.store (from.length.load (std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+        /* what the thread went on writing meanwhile may have torn the
+         * oldest events */
+        std::atomic_thread_fence (std::memory_order_acquire);
+        uint64_t now = buffer->written.load (std::memory_order_relaxed);
+        if (now >= TRACE_BUFFER_EVENTS)
+            begin = aud::max (begin, now - TRACE_BUFFER_EVENTS + 1);
+
+        for (uint64_t i = begin; i < end; i ++)
+        {
+            const TraceEvent & event = copy[i % TRACE_BUFFER_EVENTS];
+            int64_t length = event.length.load (std::memory_order_relaxed);
+
+            fprintf (file, ",\n{\"name\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,",
+             event.name.load (std::memory_order_relaxed),
+             event.start.load (std::memory_order_relaxed) / 1000.0, pid, buffer->tid);
+
+            if (length < 0)
+                fprintf (file, "\"ph\":\"i\",\"s\":\"t\"}");
+            else
+                fprintf (file, "\"ph\":\"X\",\"dur\":%.3f}", length / 1000.0);
+        }
+    }
+
+    delete[] copy;
+}
+
+inline void trace_dump_cb (void * file, void *)
+{
+    trace_write_events ((FILE *) file);
+}
+
+inline TraceBuffer * trace_claim ()
+{
+    auto & first = trace_buffers ();
+    TraceBuffer * buffer;
+
+    for (buffer = first.load (std::memory_order_acquire); buffer; buffer = buffer->next)
+    {
+        bool free = false;
+        if (buffer->in_use.compare_exchange_strong (free, true, std::memory_order_acquire))
+            break;
+    }
+
+    if (! buffer)
+    {
+        /* the first buffer of this plugin */
+        if (! first.load (std::memory_order_acquire))
+        {
+            static std::atomic<bool> hooked;
+            if (! hooked.exchange (true))
+                hook_associate ("trace dump", trace_dump_cb, nullptr);
+        }
+
+        buffer = new TraceBuffer ();
+        buffer->in_use.store (true, std::memory_order_relaxed);
+        buffer->next = first.load (std::memory_order_relaxed);
+
+        while (! first.compare_exchange_weak (buffer->next, buffer,
+         std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+#ifdef __linux__
+    buffer->tid = syscall (SYS_gettid);
+#else
+    static std::atomic<int> threads;
+    buffer->tid = ++ threads;
+#endif
+
+    return buffer;
+}
+
+inline void trace_record (const char * name, int64_t start, int64_t length)
+{
+    static thread_local TraceThread thread;
+
+    TraceBuffer * buffer = thread.buffer;
+    if (! buffer)
+        buffer = thread.buffer = trace_claim ();
+
+    uint64_t i = buffer->written.load (std::memory_order_relaxed);
+    TraceEvent & event = buffer->events[i % TRACE_BUFFER_EVENTS];
+
+    /* so that a dump which sees the new event also sees the count of
+     * events before it */
+    std::atomic_thread_fence (std::memory_order_release);
+
+    event.name.store (name, std::memory_order_relaxed);
+    event.start.store (start, std::memory_order_relaxed);
+    event.length.store (length, std::memory_order_relaxed);
+
+    buffer->written.store (i + 1, std::memory_order_release);
+}
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan (const char * name) :
+        m_name (name), m_start (trace_now ()) {}
+
+    ~TraceSpan ()
+        { trace_record (m_name, m_start, trace_now () - m_start); }
+
+    TraceSpan (const TraceSpan &) = delete;
+    TraceSpan & operator= (const TraceSpan &) = delete;
+
+private:
+    const char * m_name;
+    int64_t m_start;
+};
+
+/* writes the events of all plugins to path; false if it could not */
+inline bool trace_dump (const char * path)
+{
+    FILE * file = fopen (path, "w");
+    if (! file)
+        return false;
+
+    fprintf (file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+     "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+     "\"args\":{\"name\":\"Audacious\"}}", (int) getpid ());
+
+    hook_call ("trace dump", file);
+
+    fprintf (file, "\n]}\n");
+    return fclose (file) == 0;
+}
+
+#else
+
+#define TRACE_SPAN(name)
+#define TRACE_MARK(name)
+
+#endif
+
+#endif
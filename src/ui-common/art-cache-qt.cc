@@ -0,0 +1,188 @@
+/*
+ * art-cache-qt.cc
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "art-cache-qt.h"
+
+#include <QApplication>
+#include <QByteArray>
+#include <QHash>
+#include <QIcon>
+#include <QVariant>
+
+#include <libaudcore/drct.h>
+#include <libaudcore/index.h>
+#include <libaudcore/objects.h>
+#include <libaudcore/probe.h>
+#include <libaudqt/libaudqt.h>
+
+/* Each plugin has its own copy of this code, so the store is kept where they
+ * all find it: in a property of the QApplication, as a list of entries, most
+ * recently used first.  An entry is a list of the file name, the stamp of
+ * the art it was decoded from, the size the image was scaled to (an invalid
+ * size for the image as decoded) and the image.  Only Qt types go in, so the
+ * store outlives any plugin. */
+static const char * const STORE_PROPERTY = "audacious-art-cache";
+
+/* the originals of large art take megabytes each; the newest entry is kept
+ * whatever its size */
+static constexpr int max_entries = 12;
+static constexpr qint64 max_bytes = 64 << 20;
+
+static qint64 image_bytes (const QImage & image)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    return image.sizeInBytes ();
+#else
+    return image.byteCount ();
+#endif
+}
+
+/* The art of a file name changes when its tags are edited or the cover
+ * image beside it is replaced, so entries are found by the length and a
+ * hash of the undecoded art as well.  The undecoded art is at hand already:
+ * libaudcore keeps it for as long as the song is played. */
+static qulonglong art_stamp (const Index<char> & data)
+{
+    QByteArray bytes = QByteArray::fromRawData (data.begin (), data.len ());
+    return (qulonglong) data.len () << 32 | (quint32) qHash (bytes);
+}
+
+static QImage find (QVariantList & store, const QString & filename,
+ qulonglong stamp, const QSize & size)
+{
+    for (int i = 0; i < store.size (); i ++)
+    {
+        QVariantList entry = store[i].toList ();
+
+        if (entry.size () == 4 && entry[2].toSize () == size &&
+         entry[1].toULongLong () == stamp && entry[0].toString () == filename)
+        {
+            store.move (i, 0);
+            return entry[3].value<QImage> ();
+        }
+    }
+
+    return QImage ();
+}
+
+/* drops the images of art a file name no longer has */
+static void forget (QVariantList & store, const QString & filename)
+{
+    for (int i = store.size (); i --; )
+    {
+        if (store[i].toList ().value (0).toString () == filename)
+            store.removeAt (i);
+    }
+}
+
+static void insert (QVariantList & store, const QString & filename,
+ qulonglong stamp, const QSize & size, const QImage & image)
+{
+    store.prepend (QVariant (QVariantList {filename, stamp, size, QVariant::fromValue (image)}));
+
+    qint64 bytes = 0;
+    int keep = 0;
+
+    while (keep < store.size () && keep < max_entries)
+    {
+        bytes += image_bytes (store[keep].toList ().value (3).value<QImage> ());
+        if (keep > 0 && bytes > max_bytes)
+            break;
+
+        keep ++;
+    }
+
+    while (store.size () > keep)
+        store.removeLast ();
+}
+
+namespace ArtCache
+{
+
+QImage request (const char * filename, int w, int h, bool want_hidpi)
+{
+    AudArtPtr art = aud_art_request (filename, AUD_ART_DATA);
+    auto data = art.data ();
+
+    // nothing is kept for a song without art, as it may not be loaded yet
+    if (! data)
+        return QImage ();
+
+    QVariantList store = qApp->property (STORE_PROPERTY).toList ();
+    QString name = QString::fromUtf8 (filename);
+    qulonglong stamp = art_stamp (* data);
+
+    QImage image = find (store, name, stamp, QSize ());
+
+    if (image.isNull ())
+    {
+        image = QImage::fromData ((const uchar *) data->begin (), data->len ());
+        if (image.isNull ())
+            return image;
+
+        forget (store, name);
+        insert (store, name, stamp, QSize (), image);
+    }
+
+    // nothing is scaled up, as in audqt
+    if ((! w && ! h) || (image.width () <= w && image.height () <= h))
+    {
+        qApp->setProperty (STORE_PROPERTY, store);
+        return image;
+    }
+
+    qreal r = want_hidpi ? qApp->devicePixelRatio () : 1;
+    QSize size (w * r, h * r);
+    QImage scaled = find (store, name, stamp, size);
+
+    if (scaled.isNull ())
+    {
+        scaled = image.scaled (size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        scaled.setDevicePixelRatio (r);
+        insert (store, name, stamp, size, scaled);
+    }
+
+    qApp->setProperty (STORE_PROPERTY, store);
+    return scaled;
+}
+
+QImage request_current (int w, int h, bool want_hidpi)
+{
+    String filename = aud_drct_get_filename ();
+    if (! filename)
+        return QImage ();
+
+    return request (filename, w, h, want_hidpi);
+}
+
+QPixmap pixmap_current (int w, int h, bool want_hidpi)
+{
+    String filename = aud_drct_get_filename ();
+    if (! filename)
+        return QPixmap ();
+
+    QImage image = request (filename, w, h, want_hidpi);
+    if (! image.isNull ())
+        return QPixmap::fromImage (image);
+
+    int size = audqt::to_native_dpi (48);
+    return audqt::get_icon ("audio-x-generic").pixmap (aud::min (w, size), aud::min (h, size));
+}
+
+} // namespace ArtCache
@@ -0,0 +1,46 @@
+/*
+ * art-cache-qt.h
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef UI_COMMON_ART_CACHE_QT_H
+#define UI_COMMON_ART_CACHE_QT_H
+
+#include <QImage>
+#include <QPixmap>
+
+/* Album art as audqt::art_request() gives it, but decoded only once for all
+ * the plugins that show it: the images decoded last and the sizes they were
+ * scaled to are kept in a small store shared through the QApplication, so
+ * that the info bar, the album art window and the notifications of the same
+ * song take one decode between them.  Art that changes under the same file
+ * name is decoded again.  The images are implicitly shared, and
+ * free to keep.  To be called from the main thread only. */
+namespace ArtCache
+{
+
+/* scaled to fit within w by h, or as it is if it fits already or both are 0;
+ * a null image if the song has no art */
+QImage request (const char * filename, int w, int h, bool want_hidpi = true);
+QImage request_current (int w, int h, bool want_hidpi = true);
+
+/* as audqt::art_request_current(), with an icon if the song has no art */
+QPixmap pixmap_current (int w, int h, bool want_hidpi = true);
+
+} // namespace ArtCache
+
+#endif // UI_COMMON_ART_CACHE_QT_H
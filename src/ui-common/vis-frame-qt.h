@@ -0,0 +1,123 @@
+/*
+ * vis-frame-qt.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef UI_COMMON_VIS_FRAME_QT_H
+#define UI_COMMON_VIS_FRAME_QT_H
+
+#include <stdint.h>
+
+#include <chrono>
+
+#include <QGuiApplication>
+#include <QRect>
+#include <QScreen>
+#include <QTimer>
+#include <QWidget>
+#include <QWindow>
+
+#include <libaudcore/runtime.h>
+
+/* Repaints a visualization once per frame of the screen it is on, however
+ * often new data comes in, and no more often than the "max_fps" setting in
+ * the "vis" section says, if it is set.
+ *
+ * The frames of every VisFrame, in whichever plugin, fall on the same
+ * multiples of the frame time on the monotonic clock, so that all the
+ * visualizations in a window are painted in the same pass of the event
+ * loop and reach the screen together. */
+class VisFrame
+{
+public:
+    explicit VisFrame (QWidget * widget) :
+        m_widget (widget)
+    {
+        m_timer.setSingleShot (true);
+        m_timer.setTimerType (Qt::PreciseTimer);
+        QObject::connect (& m_timer, & QTimer::timeout, [this] () { next_frame (); });
+    }
+
+    VisFrame (const VisFrame &) = delete;
+    VisFrame & operator= (const VisFrame &) = delete;
+
+    /* repaints at the next frame */
+    void schedule ()
+    {
+        if (! m_timer.isActive ())
+            m_timer.start (ms_to_frame ());
+    }
+
+    /* repaints only this part of the widget at each frame, for one that
+     * has parts that never move; a null rect means the whole widget */
+    void set_rect (const QRect & rect) { m_rect = rect; }
+
+    /* repaints at every frame, for a widget that moves between data */
+    bool is_animated () const { return m_animated; }
+    void set_animated (bool animated)
+    {
+        m_animated = animated;
+        if (animated)
+            schedule ();
+    }
+
+private:
+    double frame_rate () const
+    {
+        QWindow * window = m_widget->window ()->windowHandle ();
+        QScreen * screen = window ? window->screen () : QGuiApplication::primaryScreen ();
+
+        double rate = screen ? screen->refreshRate () : 0;
+        if (rate < 1)
+            rate = 60;
+
+        int max_fps = aud_get_int ("vis", "max_fps");
+        if (max_fps > 0 && max_fps < rate)
+            rate = max_fps;
+
+        return rate;
+    }
+
+    int ms_to_frame () const
+    {
+        using namespace std::chrono;
+
+        int64_t period = 1e9 / frame_rate ();
+        int64_t now = duration_cast<nanoseconds> (steady_clock::now ().time_since_epoch ()).count ();
+        int64_t frame = (now / period + 1) * period;
+
+        return (frame - now + 999999) / 1000000;
+    }
+
+    void next_frame ()
+    {
+        if (m_rect.isNull ())
+            m_widget->update ();
+        else
+            m_widget->update (m_rect);
+
+        if (m_animated)
+            schedule ();
+    }
+
+    QWidget * m_widget;
+    QTimer m_timer;
+    QRect m_rect;
+    bool m_animated = false;
+};
+
+#endif // UI_COMMON_VIS_FRAME_QT_H
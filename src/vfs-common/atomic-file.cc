@@ -0,0 +1,63 @@
+/*
+ * atomic-file.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "atomic-file.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+
+bool write_file_atomic (const char * path, const std::function<void (FILE * file)> & write)
+{
+    StringBuf temp = str_concat ({path, ".tmp"});
+    FILE * file = fopen (temp, "wb");
+
+    if (! file)
+    {
+        AUDERR ("Cannot write %s: %s\n", (const char *) temp, strerror (errno));
+        return false;
+    }
+
+    write (file);
+
+    bool failed = ferror (file);
+
+    if (fclose (file) < 0 || failed)
+    {
+        AUDERR ("Cannot write %s: %s\n", (const char *) temp, strerror (errno));
+        remove (temp);
+        return false;
+    }
+
+#ifdef _WIN32
+    /* rename() does not replace an existing file there */
+    remove (path);
+#endif
+
+    if (rename (temp, path) < 0)
+    {
+        AUDERR ("Cannot write %s: %s\n", path, strerror (errno));
+        remove (temp);
+        return false;
+    }
+
+    return true;
+}
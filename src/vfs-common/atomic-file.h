@@ -0,0 +1,35 @@
+/*
+ * atomic-file.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_ATOMIC_FILE_H
+#define AUD_ATOMIC_FILE_H
+
+#include <stdio.h>
+
+#include <functional>
+
+/* Writes the file at <path> through <write>, which is handed an open stdio
+ * stream.  The data go to <path>.tmp, which is renamed over <path> only if
+ * all of it was written and the stream closed without error; otherwise it
+ * is removed.  Thus a crash or a full disk never leaves a truncated file in
+ * place of a good one, and a mapping of the old file stays valid.  Errors
+ * are logged.  Returns true if <path> was replaced. */
+bool write_file_atomic (const char * path, const std::function<void (FILE * file)> & write);
+
+#endif
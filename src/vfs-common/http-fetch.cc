@@ -0,0 +1,186 @@
+/*
+ * http-fetch.cc
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "http-fetch.h"
+
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <libaudcore/mainloop.h>
+#include <libaudcore/multihash.h>
+#include <libaudcore/runtime.h>
+
+#define MAX_BYTES (16 << 20)    /* of responses kept */
+
+typedef std::shared_ptr<const Index<char>> Response;
+
+struct CachedResponse
+{
+    Response data;                      /* null while pending */
+    int64_t expires = 0;                /* ms, steady clock */
+    std::vector<VFSConsumer> waiting;
+};
+
+struct Delivery
+{
+    String url;
+    Response data;
+    VFSConsumer consumer;
+};
+
+static SimpleHash<String, CachedResponse> s_responses;
+static int64_t s_bytes;
+
+static std::vector<Delivery> s_deliveries;
+static QueuedFunc s_deliver;
+
+static int64_t now_ms ()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+static void forget (const String & url)
+{
+    CachedResponse * cached = s_responses.lookup (url);
+    if (! cached)
+        return;
+
+    if (cached->data)
+        s_bytes -= cached->data->len ();
+
+    s_responses.remove (url);
+}
+
+/* the expired responses go, and then the ones that expire first until what
+ * is kept fits */
+static void trim (int64_t now)
+{
+    Index<String> expired;
+
+    s_responses.iterate ([&] (const String & url, CachedResponse & cached) {
+        if (cached.data && cached.expires <= now)
+            expired.append (url);
+    });
+
+    for (const String & url : expired)
+        forget (url);
+
+    while (s_bytes > MAX_BYTES)
+    {
+        const String * first = nullptr;
+        int64_t first_expires = 0;
+
+        s_responses.iterate ([&] (const String & url, CachedResponse & cached) {
+            if (cached.data && (! first || cached.expires < first_expires))
+            {
+                first = & url;
+                first_expires = cached.expires;
+            }
+        });
+
+        if (! first)
+            break;
+
+        forget (String (* first));
+    }
+}
+
+static void deliver (void *)
+{
+    /* a consumer may fetch again, which adds to s_deliveries */
+    std::vector<Delivery> deliveries = std::move (s_deliveries);
+    s_deliveries.clear ();
+
+    for (Delivery & delivery : deliveries)
+        delivery.consumer (delivery.url, * delivery.data);
+}
+
+static void fetched (const String & url, int ttl, const Index<char> & buf)
+{
+    CachedResponse * cached = s_responses.lookup (url);
+    if (! cached)
+        return;
+
+    std::vector<VFSConsumer> waiting = std::move (cached->waiting);
+    int64_t now = now_ms ();
+
+    if (buf.len ())
+    {
+        auto data = std::make_shared<Index<char>> ();
+        data->insert (buf.begin (), 0, buf.len ());
+
+        cached->data = data;
+        cached->expires = now + (int64_t) ttl * 1000;
+        s_bytes += buf.len ();
+
+        trim (now);
+    }
+    else
+        s_responses.remove (url);
+
+    AUDDBG ("Fetched %s for %d consumers\n", (const char *) url, (int) waiting.size ());
+
+    for (VFSConsumer & consumer : waiting)
+        consumer (url, buf);
+}
+
+void http_fetch (const char * url, VFSConsumer consumer, int ttl)
+{
+    String key (url);
+    CachedResponse * cached = s_responses.lookup (key);
+
+    if (cached && cached->data && cached->expires <= now_ms ())
+    {
+        forget (key);
+        cached = nullptr;
+    }
+
+    if (cached && cached->data)
+    {
+        AUDDBG ("Answering %s from memory\n", url);
+        s_deliveries.push_back ({key, cached->data, std::move (consumer)});
+        s_deliver.queue (deliver, nullptr);
+        return;
+    }
+
+    if (cached)
+    {
+        AUDDBG ("Waiting for the fetch of %s\n", url);
+        cached->waiting.push_back (std::move (consumer));
+        return;
+    }
+
+    cached = s_responses.add (key, CachedResponse ());
+    cached->waiting.push_back (std::move (consumer));
+
+    vfs_async_file_get_contents (url, [key, ttl] (const char *, const Index<char> & buf) {
+        fetched (key, ttl, buf);
+    });
+}
+
+void http_fetch_cleanup ()
+{
+    s_deliver.stop ();
+    s_deliveries.clear ();
+    s_responses.clear ();
+    s_bytes = 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * http-fetch.h
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_HTTP_FETCH_H
+#define AUD_HTTP_FETCH_H
+
+#include <libaudcore/vfs_async.h>
+
+/* Gets the contents of url, as vfs_async_file_get_contents() does, for
+ * plugins that look things up on the web.  A request for a URL that is
+ * being fetched already waits for that fetch instead of making another, and
+ * what comes back is kept for ttl seconds, so that asking again in that
+ * time is answered from memory.  Failed fetches are not kept.  The
+ * connections themselves are kept open between requests by the transport
+ * (neon keeps a pool of sessions).
+ *
+ * To be called from the main thread only.  The consumer is called from the
+ * main loop, also when the answer is in memory, never from inside
+ * http_fetch(). */
+void http_fetch (const char * url, VFSConsumer consumer, int ttl = 600);
+
+/* drops what is kept; to be called when the plugin is cleaned up */
+void http_fetch_cleanup ();
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * local-reader.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "local-reader.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+
+/* Reads start small, since probing a file needs only its first few
+ * kilobytes, and double up to WINDOW as the file is read on. */
+#define FIRST_WINDOW (16 * 1024)
+#define WINDOW (256 * 1024)
+#define AHEAD (4 * WINDOW)      /* asked for in advance */
+#define ALIGN 4096
+
+LocalReader::LocalReader (VFSFile & file) :
+    m_file (file)
+{
+#ifndef _WIN32
+    const char * uri = file.filename ();
+    if (! uri || strncmp (uri, "file://", 7))
+        return;
+
+    int64_t pos = file.ftell ();
+    if (pos < 0)
+        return;
+
+    StringBuf path = uri_to_filename (uri);
+    if (! path)
+        return;
+
+    int fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat (fd, & st) < 0 || ! S_ISREG (st.st_mode))
+    {
+        close (fd);
+        return;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    m_fd = fd;
+    m_window_size = FIRST_WINDOW;
+    m_size = st.st_size;
+    m_pos = pos;
+#endif
+}
+
+LocalReader::~LocalReader ()
+{
+#ifndef _WIN32
+    if (m_fd < 0)
+        return;
+
+    close (m_fd);
+
+    if (m_file.fseek (m_pos, VFS_SEEK_SET) < 0)
+        AUDWARN ("Cannot restore position in %s\n", m_file.filename ());
+#endif
+}
+
+/* reads the window that contains m_pos; false at the end of the file */
+bool LocalReader::fill ()
+{
+#ifndef _WIN32
+    int64_t start = m_pos - m_pos % ALIGN;
+    int want = m_window_size;
+
+    m_window_size = aud::min (2 * m_window_size, WINDOW);
+
+    m_window.resize (want);
+    ssize_t got = pread (m_fd, m_window.begin (), want, start);
+
+    if (got < 0)
+    {
+        AUDERR ("Read error in %s: %s\n", m_file.filename (), strerror (errno));
+        got = 0;
+    }
+
+    m_window.resize (got);
+    m_window_pos = start;
+
+    /* the size may have changed since the file was opened */
+    if (got < want)
+        m_size = start + got;
+
+#ifdef POSIX_FADV_WILLNEED
+    if (got == WINDOW)
+        posix_fadvise (m_fd, start + WINDOW, AHEAD, POSIX_FADV_WILLNEED);
+#endif
+
+    return m_pos < m_window_pos + m_window.len ();
+#else
+    return false;
+#endif
+}
+
+int64_t LocalReader::fread (void * ptr, int64_t size, int64_t nmemb)
+{
+    if (m_fd < 0)
+        return m_file.fread (ptr, size, nmemb);
+
+    int64_t total = size * nmemb, done = 0;
+
+    while (done < total)
+    {
+        int64_t offset = m_pos - m_window_pos;
+
+        if (offset < 0 || offset >= m_window.len ())
+        {
+            if (! fill ())
+                break;
+            offset = m_pos - m_window_pos;
+        }
+
+        int64_t copy = aud::min (total - done, m_window.len () - offset);
+        memcpy ((char *) ptr + done, & m_window[offset], copy);
+
+        done += copy;
+        m_pos += copy;
+    }
+
+    return size ? done / size : 0;
+}
+
+int LocalReader::fseek (int64_t offset, VFSSeekType whence)
+{
+    if (m_fd < 0)
+        return m_file.fseek (offset, whence);
+
+    int64_t pos = (whence == VFS_SEEK_CUR) ? m_pos + offset :
+                  (whence == VFS_SEEK_END) ? m_size + offset : offset;
+
+    if (pos < 0)
+        return -1;
+
+    m_pos = pos;
+    return 0;
+}
+
+int64_t LocalReader::ftell ()
+{
+    return (m_fd < 0) ? m_file.ftell () : m_pos;
+}
+
+int64_t LocalReader::fsize ()
+{
+    return (m_fd < 0) ? m_file.fsize () : m_size;
+}
+
+bool LocalReader::feof ()
+{
+    return (m_fd < 0) ? m_file.feof () : (m_pos >= m_size);
+}
@@ -0,0 +1,69 @@
+/*
+ * local-reader.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_LOCAL_READER_H
+#define AUD_LOCAL_READER_H
+
+#include <stdint.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/vfs.h>
+
+/* A read-only view of a VFSFile for decoders that pull their input through
+ * callbacks, a few bytes or kilobytes at a time.  For a local file, the
+ * data are read with pread() in large windows on a descriptor of its own,
+ * with the kernel told to read ahead sequentially, so most callbacks are
+ * served from memory without a system call.  Any other file is passed
+ * through to the VFSFile unchanged.
+ *
+ * The reader starts at the current position of the VFSFile and puts it back
+ * at its own position when it is destroyed.  The file is not mapped into
+ * memory: tags are written in place (audtag truncates and rewrites the file)
+ * while it may be playing, which would fault on a mapping. */
+class LocalReader
+{
+public:
+    explicit LocalReader (VFSFile & file);
+    ~LocalReader ();
+
+    LocalReader (const LocalReader &) = delete;
+    LocalReader & operator= (const LocalReader &) = delete;
+
+    /* the same as the VFSFile functions */
+    int64_t fread (void * ptr, int64_t size, int64_t nmemb);
+    int fseek (int64_t offset, VFSSeekType whence);
+    int64_t ftell ();
+    int64_t fsize ();
+    bool feof ();
+
+    VFSFile & file () { return m_file; }
+
+private:
+    bool fill ();
+
+    VFSFile & m_file;
+    int m_fd = -1;          /* -1 if passing through */
+    int64_t m_size = 0, m_pos = 0;
+
+    Index<char> m_window;
+    int64_t m_window_pos = 0;   /* file offset of m_window[0] */
+    int m_window_size = 0;      /* for the next read */
+};
+
+#endif
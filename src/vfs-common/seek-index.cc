@@ -0,0 +1,217 @@
+/*
+ * seek-index.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "seek-index.h"
+#include "atomic-file.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+
+/* One file per indexed song, named after a hash of its URI:
+ *   <header>, <URI>, <size> <mtime>, then <position> <offset> per checkpoint
+ * each on a line of its own, with numbers written out in decimal. */
+#define INDEX_HEADER "Audacious seek index 1"
+#define MAX_FILE_SIZE (4 * 1024 * 1024)
+
+static StringBuf index_dir ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "seek-index"});
+}
+
+static StringBuf index_path (const char * filename)
+{
+    char name[16];
+    snprintf (name, sizeof name, "%08x", (unsigned) str_calc_hash (filename));
+    return filename_build ({index_dir (), name});
+}
+
+/* false for anything but a regular local file */
+static bool get_stamp (const char * filename, int64_t & size, int64_t & mtime)
+{
+    if (strncmp (filename, "file://", 7))
+        return false;
+
+    /* a song from a cue sheet or the like is in the file before the '?' */
+    StringBuf uri = str_copy (filename, strcspn (filename, "?"));
+    StringBuf path = uri_to_filename (uri);
+    struct stat st;
+
+    if (! path || stat (path, & st) < 0 || ! S_ISREG (st.st_mode))
+        return false;
+
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+static Index<char> read_file (const char * path)
+{
+    Index<char> data;
+    FILE * file = fopen (path, "rb");
+    if (! file)
+        return data;
+
+    char buf[4096];
+    size_t got;
+
+    while ((got = fread (buf, 1, sizeof buf, file)) > 0 && data.len () < MAX_FILE_SIZE)
+        data.insert (buf, -1, got);
+
+    fclose (file);
+    data.append (0);
+    return data;
+}
+
+/* the next line, terminated in place, or nullptr at the end */
+static char * next_line (char * & p)
+{
+    if (! * p)
+        return nullptr;
+
+    char * line = p;
+    char * nl = strchr (p, '\n');
+
+    if (nl)
+    {
+        * nl = 0;
+        p = nl + 1;
+    }
+    else
+        p += strlen (p);
+
+    return line;
+}
+
+void SeekIndex::load (const char * filename)
+{
+    m_filename = String (filename);
+    m_points.clear ();
+    m_changed = false;
+
+    if (! get_stamp (filename, m_size, m_mtime))
+    {
+        m_size = m_mtime = -1;
+        return;
+    }
+
+    Index<char> data = read_file (index_path (filename));
+    if (! data.len ())
+        return;
+
+    char * p = data.begin ();
+    const char * header = next_line (p);
+    const char * uri = next_line (p);
+    const char * stamp = next_line (p);
+    int64_t size, mtime;
+
+    /* a hash collision or an old index of a changed file */
+    if (! stamp || strcmp (header, INDEX_HEADER) || strcmp (uri, filename) ||
+     sscanf (stamp, "%" SCNd64 " %" SCNd64, & size, & mtime) != 2 ||
+     size != m_size || mtime != m_mtime)
+        return;
+
+    while (const char * line = next_line (p))
+    {
+        Point point;
+        if (sscanf (line, "%" SCNd64 " %" SCNd64, & point.pos, & point.offset) != 2 ||
+         (m_points.len () && point.pos <= m_points[m_points.len () - 1].pos))
+            break;
+
+        m_points.append (point);
+    }
+
+    AUDDBG ("Loaded %d seek points for %s.\n", m_points.len (), filename);
+}
+
+/* the index of the first checkpoint after <pos> */
+static int upper_bound (const Index<SeekIndex::Point> & points, int64_t pos)
+{
+    int low = 0, high = points.len ();
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (points[mid].pos <= pos)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+const SeekIndex::Point * SeekIndex::find (int64_t pos) const
+{
+    int i = upper_bound (m_points, pos);
+    if (! i || pos - m_points[i - 1].pos > 2 * m_spacing)
+        return nullptr;
+
+    return & m_points[i - 1];
+}
+
+void SeekIndex::add (int64_t pos, int64_t offset)
+{
+    int i = upper_bound (m_points, pos);
+
+    if ((i > 0 && pos - m_points[i - 1].pos < m_spacing) ||
+     (i < m_points.len () && m_points[i].pos - pos < m_spacing))
+        return;
+
+    Point point = {pos, offset};
+    m_points.insert (& point, i, 1);
+    m_changed = true;
+}
+
+void SeekIndex::clear ()
+{
+    m_changed = m_changed || m_points.len ();
+    m_points.clear ();
+}
+
+void SeekIndex::save ()
+{
+    if (! m_changed || m_size < 0)
+        return;
+
+    m_changed = false;
+
+    StringBuf dir = index_dir ();
+#ifdef _WIN32
+    mkdir (dir);
+#else
+    mkdir (dir, 0755);
+#endif
+
+    write_file_atomic (index_path (m_filename), [this] (FILE * file) {
+        fprintf (file, "%s\n%s\n%" PRId64 " %" PRId64 "\n", INDEX_HEADER,
+         (const char *) m_filename, m_size, m_mtime);
+
+        for (const Point & point : m_points)
+            fprintf (file, "%" PRId64 " %" PRId64 "\n", point.pos, point.offset);
+    });
+}
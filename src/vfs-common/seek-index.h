@@ -0,0 +1,78 @@
+/*
+ * seek-index.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_SEEK_INDEX_H
+#define AUD_SEEK_INDEX_H
+
+#include <stdint.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/objects.h>
+
+/* Checkpoints of where in a file a decoder can be restarted to get to a
+ * given position, recorded while the file plays and kept between sessions.
+ * Without them, seeking in Ogg files means a bisection and in raw AAC or
+ * VBR MP3 files an estimate followed by reading on, all of which costs a
+ * round trip per read on a network share; with them, a seek is one read at
+ * the last checkpoint before the target and some decoding from there.
+ *
+ * Positions are in whatever unit the plugin counts (milliseconds, frames),
+ * and each plugin knows how far from a checkpoint its decoder really
+ * restarts.  Only local files are indexed.  The checkpoints of a file are
+ * forgotten when its size or modification time changes. */
+class SeekIndex
+{
+public:
+    struct Point {
+        int64_t pos, offset;
+    };
+
+    /* checkpoints closer than <spacing> to one already known are not kept */
+    explicit SeekIndex (int64_t spacing) :
+        m_spacing (spacing) {}
+    ~SeekIndex () { save (); }
+
+    SeekIndex (const SeekIndex &) = delete;
+    SeekIndex & operator= (const SeekIndex &) = delete;
+
+    /* reads the checkpoints stored for the file, if any */
+    void load (const char * filename);
+
+    /* the last checkpoint at or before <pos>, or nullptr if there is none
+     * within twice the spacing (in a part of the file not yet played, say,
+     * where decoding on from the last checkpoint would take too long) */
+    const Point * find (int64_t pos) const;
+
+    void add (int64_t pos, int64_t offset);
+    void clear ();
+
+    const Index<Point> & points () const { return m_points; }
+
+    /* writes the checkpoints out if any were added; called on destruction */
+    void save ();
+
+private:
+    int64_t m_spacing;
+    String m_filename;
+    int64_t m_size = -1, m_mtime = -1;  /* -1 if not a local file */
+    Index<Point> m_points;              /* sorted by position */
+    bool m_changed = false;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ * track-prefetch.cc
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "track-prefetch.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <libaudcore/audio.h>
+#include <libaudcore/audstrings.h>
+#include <libaudcore/index.h>
+#include <libaudcore/objects.h>
+#include <libaudcore/playlist.h>
+#include <libaudcore/runtime.h>
+
+#define LEAD_TIME 8000              /* ms before the end of the song */
+#define HEAD_BYTES (512 * 1024)     /* headers, ID3v2 tags, first frames */
+#define TAIL_BYTES (64 * 1024)      /* ID3v1 and APE tags, Ogg end pages */
+#define CHUNK (64 * 1024)
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t thread;
+static bool thread_started, thread_busy;
+static String last_warmed;
+
+/* the song that will be played after the current one, if it is known */
+static String next_filename ()
+{
+    if (aud_get_bool (nullptr, "shuffle") ||
+     aud_get_bool (nullptr, "no_playlist_advance") ||
+     aud_get_bool (nullptr, "stop_after_current_song"))
+        return String ();
+
+    auto playlist = Playlist::playing_playlist ();
+    int entry = playlist.get_position ();
+    if (entry < 0)
+        return String ();
+
+    if (++ entry >= playlist.n_entries ())
+    {
+        if (! aud_get_bool (nullptr, "repeat"))
+            return String ();
+
+        entry = 0;
+    }
+
+    return playlist.entry_filename (entry);
+}
+
+#ifndef _WIN32
+static void read_range (int fd, char * buf, int64_t offset, int64_t length)
+{
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise (fd, offset, length, POSIX_FADV_WILLNEED);
+#endif
+
+    /* the advice alone may be ignored by network filesystems */
+    while (length > 0)
+    {
+        ssize_t got = pread (fd, buf, aud::min<int64_t> (CHUNK, length), offset);
+        if (got <= 0)
+            break;
+
+        offset += got;
+        length -= got;
+    }
+}
+
+/* reads (and drops) the start and end of a local file */
+static void warm_file (const char * filename)
+{
+    /* a song from a cue sheet or the like is in the file before the '?' */
+    StringBuf uri = str_copy (filename, strcspn (filename, "?"));
+    StringBuf path = uri_to_filename (uri);
+    if (! path)
+        return;
+
+    int fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat (fd, & st) == 0 && S_ISREG (st.st_mode))
+    {
+        Index<char> buf;
+        buf.resize (CHUNK);
+
+        int64_t head = aud::min<int64_t> (HEAD_BYTES, st.st_size);
+        int64_t tail = aud::min<int64_t> (TAIL_BYTES, st.st_size - head);
+
+        read_range (fd, buf.begin (), 0, head);
+        read_range (fd, buf.begin (), st.st_size - tail, tail);
+    }
+
+    close (fd);
+}
+#endif
+
+static void * prefetch_worker (void *)
+{
+    String filename = next_filename ();
+
+    pthread_mutex_lock (& mutex);
+    bool skip = (! filename || filename == last_warmed);
+    if (! skip)
+        last_warmed = filename;
+    pthread_mutex_unlock (& mutex);
+
+#ifndef _WIN32
+    if (! skip && ! strncmp (filename, "file://", 7))
+    {
+        AUDDBG ("Prefetching %s.\n", (const char *) filename);
+        warm_file (filename);
+    }
+#endif
+
+    pthread_mutex_lock (& mutex);
+    thread_busy = false;
+    pthread_mutex_unlock (& mutex);
+
+    return nullptr;
+}
+
+/* a request while the last one is still running is dropped, since it would
+ * be for the same song */
+static void prefetch_start ()
+{
+    pthread_mutex_lock (& mutex);
+
+    if (! thread_busy)
+    {
+        if (thread_started)
+            pthread_join (thread, nullptr);
+
+        thread_started = ! pthread_create (& thread, nullptr, prefetch_worker, nullptr);
+        thread_busy = thread_started;
+    }
+
+    pthread_mutex_unlock (& mutex);
+}
+
+void track_prefetch_cleanup ()
+{
+    pthread_mutex_lock (& mutex);
+
+    if (thread_started)
+    {
+        /* the worker takes the lock only briefly */
+        pthread_mutex_unlock (& mutex);
+        pthread_join (thread, nullptr);
+        pthread_mutex_lock (& mutex);
+        thread_started = false;
+    }
+
+    last_warmed = String ();
+    pthread_mutex_unlock (& mutex);
+}
+
+void TrackPrefetch::set_format (int format, int rate, int channels)
+{
+    if (m_bytes_per_second)
+        m_base += m_bytes * 1000 / m_bytes_per_second;
+
+    m_bytes_per_second = (int64_t) FMT_SIZEOF (format) * rate * channels;
+    m_bytes = 0;
+}
+
+void TrackPrefetch::written (int64_t bytes)
+{
+    m_bytes += bytes;
+
+    if (m_started || m_length <= 0 || ! m_bytes_per_second)
+        return;
+
+    if (m_base + m_bytes * 1000 / m_bytes_per_second >= m_length - LEAD_TIME)
+    {
+        m_started = true;
+        prefetch_start ();
+    }
+}
+
+void TrackPrefetch::seeked (int time_ms)
+{
+    m_base = time_ms;
+    m_bytes = 0;
+}
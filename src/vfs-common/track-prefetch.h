@@ -0,0 +1,59 @@
+/*
+ * track-prefetch.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_TRACK_PREFETCH_H
+#define AUD_TRACK_PREFETCH_H
+
+#include <stdint.h>
+
+/* Gets the next song of the playing playlist ready in the last seconds of
+ * the current one, so that on slow storage (network shares, mostly) there
+ * is less of a gap between them.  Audacious opens the next file and picks
+ * its decoder itself, so nothing can be handed over from here; instead the
+ * start and end of the file (where the headers and tags are) are read in
+ * the background, which leaves them in the page cache for when the file is
+ * opened for real.  Only local files are warmed, and nothing is done in
+ * shuffle mode, where the next song is not known in advance.
+ *
+ * A TrackPrefetch follows one call of play(), told what the plugin passes
+ * to open_audio() and write_audio() and where it seeks to.  The reading is
+ * done on a thread of its own, one song at a time;
+ * track_prefetch_cleanup() waits for it and must be called before the
+ * plugin is unloaded. */
+class TrackPrefetch
+{
+public:
+    explicit TrackPrefetch (int length_ms) :
+        m_length (length_ms) {}
+
+    void set_format (int format, int rate, int channels);
+    void written (int64_t bytes);
+    void seeked (int time_ms);
+
+private:
+    int m_length;               /* ms, or -1 if unknown */
+    int64_t m_bytes_per_second = 0;
+    int64_t m_base = 0;         /* ms played before m_bytes */
+    int64_t m_bytes = 0;        /* since the last format change or seek */
+    bool m_started = false;
+};
+
+void track_prefetch_cleanup ();
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ * Visualization Export Plugin for Audacious
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/runtime.h>
+
+#include "vis-export.h"
+
+#define SLOT_SIZE (sizeof (VisExportSlot))
+#define MAP_SIZE (sizeof (VisExportHeader) + VIS_EXPORT_SLOTS * SLOT_SIZE)
+
+class VisExport : public VisPlugin
+{
+public:
+    static const char about[];
+
+    static constexpr PluginInfo info = {
+        N_("Visualization Export"),
+        PACKAGE,
+        about
+    };
+
+    constexpr VisExport () : VisPlugin (info, Visualizer::MultiPCM | Visualizer::Freq) {}
+
+    bool init () override;
+    void cleanup () override;
+
+    void clear () override;
+    void render_multi_pcm (const float * pcm, int channels) override;
+    void render_freq (const float * freq) override;
+};
+
+EXPORT VisExport aud_plugin_instance;
+
+const char VisExport::about[] =
+ N_("Publishes the audio data passed to visualizations in shared memory, "
+    "for other programs to show levels or a spectrum.  See vis-export.h "
+    "in the source code for the layout.");
+
+static StringBuf shm_name;
+static VisExportHeader * header;
+static VisExportSlot * slots;
+
+/* The PCM data and the spectrum of each update come in separate calls;
+ * the slot is opened by the first and closed once both are written. */
+static VisExportSlot * open_slot;
+static bool have_pcm, have_freq;
+static uint64_t serial;
+
+static int64_t monotonic_us ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void close_slot ()
+{
+    if (! open_slot)
+        return;
+
+    open_slot->time_us = monotonic_us ();
+
+    __atomic_store_n (& open_slot->seq, open_slot->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n (& header->serial, open_slot->serial, __ATOMIC_RELEASE);
+
+    open_slot = nullptr;
+    have_pcm = have_freq = false;
+}
+
+/* a second call of the same kind means that the other one never came, so
+ * the slot is published as it is */
+static VisExportSlot * get_slot (bool & have_part)
+{
+    if (open_slot && have_part)
+        close_slot ();
+
+    if (! open_slot)
+    {
+        serial ++;
+        open_slot = & slots[(serial - 1) % VIS_EXPORT_SLOTS];
+
+        __atomic_store_n (& open_slot->seq, open_slot->seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence (__ATOMIC_RELEASE);
+
+        open_slot->serial = serial;
+    }
+
+    have_part = true;
+    return open_slot;
+}
+
+bool VisExport::init ()
+{
+    shm_name = str_printf (VIS_EXPORT_NAME "%u", (unsigned) getuid ());
+
+    int fd = shm_open (shm_name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+    {
+        AUDERR ("Cannot create %s: %s\n", (const char *) shm_name, strerror (errno));
+        return false;
+    }
+
+    /* a copy left behind by a crash is started over */
+    void * map = MAP_FAILED;
+    if (ftruncate (fd, 0) == 0 && ftruncate (fd, MAP_SIZE) == 0)
+        map = mmap (nullptr, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close (fd);
+
+    if (map == MAP_FAILED)
+    {
+        AUDERR ("Cannot map %s: %s\n", (const char *) shm_name, strerror (errno));
+        shm_unlink (shm_name);
+        return false;
+    }
+
+    header = (VisExportHeader *) map;
+    slots = (VisExportSlot *) ((char *) map + sizeof (VisExportHeader));
+
+    header->version = VIS_EXPORT_VERSION;
+    header->header_size = sizeof (VisExportHeader);
+    header->slot_size = SLOT_SIZE;
+    header->n_slots = VIS_EXPORT_SLOTS;
+    header->frames = VIS_EXPORT_FRAMES;
+    header->bins = VIS_EXPORT_BINS;
+    header->max_channels = VIS_EXPORT_MAX_CHANNELS;
+    header->pid = getpid ();
+
+    /* last, so that a reader never sees the magic before the rest */
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    memcpy (header->magic, VIS_EXPORT_MAGIC, sizeof header->magic);
+
+    serial = 0;
+    return true;
+}
+
+void VisExport::cleanup ()
+{
+    open_slot = nullptr;
+    have_pcm = have_freq = false;
+
+    munmap (header, MAP_SIZE);
+    shm_unlink (shm_name);
+
+    header = nullptr;
+    slots = nullptr;
+    shm_name = StringBuf ();
+}
+
+void VisExport::clear ()
+{
+    close_slot ();
+    VisExportSlot * slot = get_slot (have_pcm);
+
+    slot->channels = 0;
+    memset (slot->peak, 0, sizeof slot->peak);
+    memset (slot->rms, 0, sizeof slot->rms);
+    memset (slot->freq, 0, sizeof slot->freq);
+    memset (slot->pcm, 0, sizeof slot->pcm);
+
+    close_slot ();
+}
+
+void VisExport::render_multi_pcm (const float * pcm, int channels)
+{
+    VisExportSlot * slot = get_slot (have_pcm);
+    int kept = aud::min (channels, VIS_EXPORT_MAX_CHANNELS);
+
+    slot->channels = kept;
+
+    if (kept == channels)
+        memcpy (slot->pcm, pcm, sizeof (float) * VIS_EXPORT_FRAMES * channels);
+    else
+    {
+        for (int f = 0; f < VIS_EXPORT_FRAMES; f ++)
+            memcpy (& slot->pcm[f * kept], & pcm[f * channels], sizeof (float) * kept);
+    }
+
+    float peak[VIS_EXPORT_MAX_CHANNELS] {};
+    float sum[VIS_EXPORT_MAX_CHANNELS] {};
+
+    for (int f = 0; f < VIS_EXPORT_FRAMES; f ++)
+    {
+        const float * frame = & slot->pcm[f * kept];
+
+        for (int c = 0; c < kept; c ++)
+        {
+            peak[c] = aud::max (peak[c], fabsf (frame[c]));
+            sum[c] += frame[c] * frame[c];
+        }
+    }
+
+    for (int c = 0; c < VIS_EXPORT_MAX_CHANNELS; c ++)
+    {
+        slot->peak[c] = peak[c];
+        slot->rms[c] = sqrtf (sum[c] / VIS_EXPORT_FRAMES);
+    }
+
+    if (have_freq)
+        close_slot ();
+}
+
+void VisExport::render_freq (const float * freq)
+{
+    VisExportSlot * slot = get_slot (have_freq);
+
+    memcpy (slot->freq, freq, sizeof slot->freq);
+
+    if (have_pcm)
+        close_slot ();
+}
@@ -0,0 +1,112 @@
+/*
+ * vis-export.h
+ * Copyright 2024 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef VIS_EXPORT_H
+#define VIS_EXPORT_H
+
+#include <stdint.h>
+
+/* The Visualization Export plugin publishes the data that the player
+ * passes to its visualizers in a POSIX shared memory object, so that
+ * another process can show levels or a spectrum without a GUI in the
+ * player.  This header is all that such a process needs; it is plain C.
+ *
+ * The object is named VIS_EXPORT_NAME followed by the user ID of the
+ * player, as printed by "%u" (for example "/audacious-vis-1000"), and is
+ * readable only by that user.  It holds a VisExportHeader followed by
+ * n_slots slots of slot_size bytes each, starting at header_size.  A
+ * reader should check magic and version and use the sizes given in the
+ * header rather than sizeof.
+ *
+ * The slots are a ring, written in turn about every 512 samples while
+ * audio is playing.  Each slot is guarded by a sequence lock: its seq is
+ * odd while the player is writing it and goes up by two for each update.
+ * Once a slot is complete, the header's serial is set to the serial of
+ * that slot, which is in slot (serial - 1) % n_slots.  Nothing is ever
+ * locked, so a reader can never hold up the player; instead it checks
+ * that it has read a consistent slot:
+ *
+ *     for (;;)
+ *     {
+ *         uint64_t serial = __atomic_load_n (& header->serial, __ATOMIC_ACQUIRE);
+ *         if (! serial)
+ *             break;  // nothing written yet
+ *
+ *         const VisExportSlot * slot = (const VisExportSlot *) ((const char *)
+ *          header + header->header_size + (serial - 1) % header->n_slots *
+ *          header->slot_size);
+ *
+ *         uint32_t seq = __atomic_load_n (& slot->seq, __ATOMIC_ACQUIRE);
+ *         if (seq & 1)
+ *             continue;
+ *
+ *         // read what is wanted from the slot, in place
+ *
+ *         __atomic_thread_fence (__ATOMIC_ACQUIRE);
+ *         if (__atomic_load_n (& slot->seq, __ATOMIC_RELAXED) == seq)
+ *             break;
+ *     }
+ *
+ * Since a slot is only written again n_slots updates later, a reader that
+ * keeps up is practically never made to retry.  A reader can use serial
+ * to tell whether there is anything new, and time_us (CLOCK_MONOTONIC)
+ * to tell how old it is.  The object is removed when the plugin is
+ * disabled or the player quits; pid tells which process wrote it. */
+
+#define VIS_EXPORT_NAME "/audacious-vis-"
+#define VIS_EXPORT_MAGIC "AUDVIS\0\0"  /* 8 bytes */
+#define VIS_EXPORT_VERSION 1
+
+#define VIS_EXPORT_SLOTS 8
+#define VIS_EXPORT_FRAMES 512           /* of PCM per slot */
+#define VIS_EXPORT_BINS 256             /* of the spectrum */
+#define VIS_EXPORT_MAX_CHANNELS 8       /* the rest are left out */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t slot_size;
+    uint32_t n_slots;
+    uint32_t frames;
+    uint32_t bins;
+    uint32_t max_channels;
+    uint32_t pid;
+    uint64_t serial;        /* of the last complete slot, or 0 */
+} VisExportHeader;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t channels;      /* 0 after playback has stopped */
+    uint64_t serial;        /* counts from 1 */
+    int64_t time_us;        /* when written, by CLOCK_MONOTONIC */
+
+    /* over the frames of this slot, linear, 1 being full scale */
+    float peak[VIS_EXPORT_MAX_CHANNELS];
+    float rms[VIS_EXPORT_MAX_CHANNELS];
+
+    /* magnitude of each band from 0 Hz to half the sample rate, linear,
+     * as passed to VisPlugin::render_freq() */
+    float freq[VIS_EXPORT_BINS];
+
+    /* interleaved, "channels" to a frame */
+    float pcm[VIS_EXPORT_FRAMES * VIS_EXPORT_MAX_CHANNELS];
+} VisExportSlot;
+
+#endif /* VIS_EXPORT_H */
@@ -21,6 +21,8 @@
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
 
+#include "../trace-common/trace.h"
+
 class VoiceRemoval : public EffectPlugin
 {
 public:
@@ -46,6 +48,7 @@ void VoiceRemoval::start (int & channels, int & rate)
 
 Index<float> & VoiceRemoval::process (Index<float> & data)
 {
+    TRACE_SPAN ("Voice Removal process");
     if (voice_channels != 2)
         return data;
 
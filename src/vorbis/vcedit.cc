@@ -17,6 +17,11 @@
 
 #define CHUNKSIZE 4096
 
+/* Zero bytes written after the framing bit of the comment header whenever
+ * the whole file is written anew, so that the comments can grow later and
+ * still be written in place.  Decoders stop reading at the framing bit. */
+#define PADDING 8192
+
 VCEdit::VCEdit()
 {
     ogg_sync_init(&oy);
@@ -45,7 +50,8 @@ _v_writestring(oggpack_buffer *o, const char *s, int len)
 }
 
 static void
-_commentheader_out(vorbis_comment *vc, const char *vendor, ogg_packet *op)
+_commentheader_out(vorbis_comment *vc, const char *vendor, ogg_packet *op,
+                   int64_t padding)
 {
     oggpack_buffer opb;
 
@@ -76,10 +82,11 @@ _commentheader_out(vorbis_comment *vc, const char *vendor, ogg_packet *op)
     }
     oggpack_write(&opb, 1, 1);
 
-    op->packet = (unsigned char *) _ogg_malloc(oggpack_bytes(&opb));
+    op->packet = (unsigned char *) _ogg_malloc(oggpack_bytes(&opb) + padding);
     memcpy(op->packet, opb.buffer, oggpack_bytes(&opb));
+    memset(op->packet + oggpack_bytes(&opb), 0, padding);
 
-    op->bytes = oggpack_bytes(&opb);
+    op->bytes = oggpack_bytes(&opb) + padding;
     op->b_o_s = 0;
     op->e_o_s = 0;
     op->granulepos = 0;
@@ -243,7 +250,7 @@ bool VCEdit::write(VFSFile &in, VFSFile &out)
 
     ogg_stream_init(&streamout, serial);
 
-    _commentheader_out(&vc, vendor, &header_comments);
+    _commentheader_out(&vc, vendor, &header_comments, PADDING);
 
     ogg_stream_packetin(&streamout, &header_main);
     ogg_stream_packetin(&streamout, &header_comments);
@@ -353,3 +360,182 @@ bool VCEdit::write(VFSFile &in, VFSFile &out)
 
     return true;
 }
+
+/* What write_in_place() needs to know of a page: where it is, whose it is,
+ * and where the packets on it end. */
+struct PageInfo {
+    int64_t offset, size;
+    long serial, pageno;
+    int segments;
+    unsigned char lacing[255];
+};
+
+static bool read_page_info(VFSFile &file, PageInfo &page)
+{
+    unsigned char header[27];
+
+    page.offset = file.ftell();
+    if (page.offset < 0 || file.fread(header, 1, 27) != 27 ||
+        memcmp(header, "OggS", 4))
+        return false;
+
+    page.serial = header[14] | (header[15] << 8) | (header[16] << 16) |
+                  ((unsigned long) header[17] << 24);
+    page.pageno = header[18] | (header[19] << 8) | (header[20] << 16) |
+                  ((unsigned long) header[21] << 24);
+    page.segments = header[26];
+
+    if (file.fread(page.lacing, 1, page.segments) != page.segments)
+        return false;
+
+    int64_t body = 0;
+    for (int i = 0; i < page.segments; i++)
+        body += page.lacing[i];
+
+    page.size = 27 + page.segments + body;
+    return file.fseek(body, VFS_SEEK_CUR) == 0;
+}
+
+/* The size of the pages ogg_stream_flush() makes of the comment and setup
+ * headers: there are never enough packets for it to end a page early, so
+ * it puts 255 segments on each, and a packet of n bytes takes n / 255 + 1.
+ */
+static int64_t header_pages_size(int64_t comment, int64_t setup, int &pages)
+{
+    int64_t segments = comment / 255 + 1 + (setup ? setup / 255 + 1 : 0);
+    pages = (segments + 254) / 255;
+    return 27 * pages + segments + comment + setup;
+}
+
+/* The padding after a comment header of the given size that fills exactly
+ * the given pages, or -1 if none does.  Each byte of padding makes the
+ * pages at least one byte bigger, so the most there can be is the room
+ * that is left, and counting down from there finds the right amount. */
+static int64_t fit_padding(int64_t comment, int64_t setup, int pages, int64_t size)
+{
+    int got_pages;
+
+    for (int64_t padding = size - header_pages_size(comment, setup, got_pages);
+         padding >= 0; padding--) {
+        int64_t got = header_pages_size(comment + padding, setup, got_pages);
+
+        if (got < size)
+            break;
+        if (got == size && got_pages == pages)
+            return padding;
+    }
+
+    return -1;
+}
+
+/* The identification header is alone on the first page.  The comment
+ * header follows, either on pages of its own or sharing the last one with
+ * the setup header; in that case both are written again.  The pages in
+ * between must not carry anything else. */
+bool VCEdit::rewrite_header_pages(VFSFile &file)
+{
+    PageInfo page;
+
+    if (file.fseek(0, VFS_SEEK_SET) < 0 || !read_page_info(file, page) ||
+        page.serial != serial)
+        return false;
+
+    int64_t start = page.offset + page.size, end = start;
+    long pageno = page.pageno + 1;
+    int pages = 0, packets = 0;
+    bool with_setup = true;
+
+    while (packets < 2) {
+        if (!read_page_info(file, page) || page.serial != serial ||
+            page.pageno != pageno + pages)
+            return false;
+
+        pages++;
+        end = page.offset + page.size;
+
+        for (int i = 0; i < page.segments; i++) {
+            if (page.lacing[i] == 255)
+                continue;
+
+            /* audio on the same page as a header */
+            if (++packets == 2 && i < page.segments - 1)
+                return false;
+
+            if (packets == 1 && i == page.segments - 1)
+                with_setup = false;
+        }
+
+        if (!with_setup)
+            break;
+    }
+
+    ogg_packet header_comments;
+    ogg_packet header_codebooks;
+    int64_t setup = with_setup ? bookbuf.len() : 0;
+
+    _commentheader_out(&vc, vendor, &header_comments, 0);
+    int64_t padding = fit_padding(header_comments.bytes, setup, pages, end - start);
+    ogg_packet_clear(&header_comments);
+
+    if (padding < 0)
+        return false;
+
+    header_codebooks.bytes = bookbuf.len();
+    header_codebooks.packet = bookbuf.begin();
+    header_codebooks.b_o_s = 0;
+    header_codebooks.e_o_s = 0;
+    header_codebooks.granulepos = 0;
+
+    ogg_stream_state streamout;
+    ogg_stream_init(&streamout, serial);
+
+    /* these are not the first pages of the stream */
+    streamout.b_o_s = 1;
+    streamout.pageno = pageno;
+
+    _commentheader_out(&vc, vendor, &header_comments, padding);
+    ogg_stream_packetin(&streamout, &header_comments);
+    if (with_setup)
+        ogg_stream_packetin(&streamout, &header_codebooks);
+
+    Index<unsigned char> data;
+    ogg_page ogout;
+
+    while (ogg_stream_flush(&streamout, &ogout)) {
+        data.insert(ogout.header, -1, ogout.header_len);
+        data.insert(ogout.body, -1, ogout.body_len);
+    }
+
+    ogg_stream_clear(&streamout);
+    ogg_packet_clear(&header_comments);
+
+    if (data.len() != end - start)
+        return false;
+
+    if (file.fseek(start, VFS_SEEK_SET) < 0 ||
+        file.fwrite(data.begin(), 1, data.len()) != data.len() ||
+        file.fflush() < 0) {
+        lasterror = "Error writing comment header. File may be corrupted.";
+        return false;
+    }
+
+    return true;
+}
+
+bool VCEdit::write_in_place(VFSFile &file)
+{
+    int64_t resume = file.ftell();
+
+    lasterror = nullptr;
+    if (resume < 0)
+        return false;
+
+    if (rewrite_header_pages(file))
+        return true;
+
+    /* write() goes on reading where open() stopped */
+    if (!lasterror && file.fseek(resume, VFS_SEEK_SET) < 0)
+        lasterror = "Error seeking in input.";
+
+    return false;
+}
@@ -29,6 +29,11 @@ public:
     bool open(VFSFile &in);
     bool write(VFSFile &in, VFSFile &out);
 
+    /* Rewrites only the pages of the comment header, if the new comments
+     * fit in them.  Returns false, with lasterror unset and the file as it
+     * was, if they do not. */
+    bool write_in_place(VFSFile &file);
+
 private:
     ogg_sync_state   oy;
     ogg_stream_state os;
@@ -45,6 +50,7 @@ private:
     Index<unsigned char> bookbuf;
 
     int blocksize(ogg_packet *p);
+    bool rewrite_header_pages(VFSFile &file);
     bool fetch_next_packet(VFSFile &in, ogg_packet *p, ogg_page *page);
 };
 
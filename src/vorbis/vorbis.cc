@@ -41,6 +41,9 @@
 #include <libaudcore/runtime.h>
 
 #include "vorbis.h"
+#include "../vfs-common/seek-index.h"
+#include "../vfs-common/track-prefetch.h"
+#include "../trace-common/trace.h"
 
 EXPORT VorbisPlugin aud_plugin_instance;
 
@@ -227,20 +230,50 @@ static bool update_replay_gain (OggVorbis_File * vf, ReplayGainInfo * rg_info)
     return true;
 }
 
-static long
-vorbis_interleave_buffer(float **pcm, int samples, int ch, float *pcmout)
+#define PCM_FRAMES 1024
+
+/* Returns the decoded audio from <start> on, interleaved.  Mono is that
+ * already and is left where libvorbis put it; otherwise it is copied into
+ * <pcmout>, which holds PCM_FRAMES for each channel. */
+static const float *
+vorbis_interleave_buffer(float **pcm, int start, int samples, int ch, Index<float> &pcmout)
 {
-    int i, j;
-    for (i = 0; i < samples; i++)
-        for (j = 0; j < ch; j++)
-            *pcmout++ = pcm[j][i];
+    if (ch == 1)
+        return pcm[0] + start;
 
-    return ch * samples * sizeof(float);
+    float *out = pcmout.begin();
+
+    for (int j = 0; j < ch; j++) {
+        const float *in = pcm[j] + start;
+        for (int i = j; i < ch * (samples - start); i += ch)
+            out[i] = *in++;
+    }
+
+    return out;
 }
 
+#define SEEK_SPACING 2000   /* ms between seek index checkpoints */
+#define SEEK_MARGIN 1000    /* ms, more than an Ogg page lasts */
 
-#define PCM_FRAMES 1024
-#define PCM_BUFSIZE (PCM_FRAMES * 2)
+/* Goes to the last checkpoint well before <time> (ms) and returns the time
+ * (s) from which the audio decoded is to be played, or -1 if there is no
+ * checkpoint to use.  A checkpoint is the page that was to be read next
+ * when the audio decoded had got to its position, so restarting there can
+ * land up to a page later; hence the margin. */
+static double seek_by_index (OggVorbis_File * vf, const SeekIndex & index, int time)
+{
+    auto point = index.find (time - SEEK_MARGIN);
+    if (! point || ov_raw_seek (vf, point->offset) < 0)
+        return -1;
+
+    double target = (double) time / 1000;
+    return (ov_time_tell (vf) <= target) ? target : -1;
+}
+
+void VorbisPlugin::cleanup ()
+{
+    track_prefetch_cleanup ();
+}
 
 bool VorbisPlugin::play (const char * filename, VFSFile & file)
 {
@@ -248,8 +281,12 @@ bool VorbisPlugin::play (const char * filename, VFSFile & file)
     OggVorbis_File vf;
     int last_section = -1;
     Tuple tuple = get_playback_tuple ();
+    TrackPrefetch prefetch (tuple.get_int (Tuple::Length));
+    SeekIndex seek_index (SEEK_SPACING);
+    double skip_to = -1;
     ReplayGainInfo rg_info;
-    float pcmout[PCM_BUFSIZE*sizeof(float)], **pcm;
+    Index<float> pcmout;
+    float **pcm;
     int bytes, channels, samplerate, br;
 
     memset(&vf, 0, sizeof(vf));
@@ -264,6 +301,9 @@ bool VorbisPlugin::play (const char * filename, VFSFile & file)
         goto play_cleanup;
     }
 
+    if (! stream)
+        seek_index.load (filename);
+
     vi = ov_info(&vf, -1);
 
     br = vi->bitrate_nominal;
@@ -279,6 +319,8 @@ bool VorbisPlugin::play (const char * filename, VFSFile & file)
         set_replay_gain (rg_info);
 
     open_audio (FMT_FLOAT, samplerate, channels);
+    prefetch.set_format (FMT_FLOAT, samplerate, channels);
+    pcmout.resize (PCM_FRAMES * channels);
 
     /*
      * Note that chaining changes things here; A vorbis file may
@@ -289,15 +331,26 @@ bool VorbisPlugin::play (const char * filename, VFSFile & file)
 
     while (! check_stop ())
     {
+        TRACE_SPAN ("Vorbis play");
         int seek_value = check_seek ();
 
-        if (seek_value >= 0 && ov_time_seek (& vf, (double) seek_value / 1000) < 0)
+        if (seek_value >= 0)
         {
-            AUDERR ("seek failed\n");
-            error = true;
-            break;
+            skip_to = stream ? -1 : seek_by_index (& vf, seek_index, seek_value);
+
+            if (skip_to < 0 && ov_time_seek (& vf, (double) seek_value / 1000) < 0)
+            {
+                AUDERR ("seek failed\n");
+                error = true;
+                break;
+            }
+
+            prefetch.seeked (seek_value);
         }
 
+        if (! stream)
+            seek_index.add (ov_time_tell (& vf) * 1000, ov_raw_tell (& vf));
+
         int current_section = last_section;
         bytes = ov_read_float(&vf, &pcm, PCM_FRAMES, &current_section);
         if (bytes == OV_HOLE)
@@ -306,7 +359,18 @@ bool VorbisPlugin::play (const char * filename, VFSFile & file)
         if (bytes <= 0)
             break;
 
-        bytes = vorbis_interleave_buffer (pcm, bytes, channels, pcmout);
+        int start = 0;
+
+        /* after a seek by the index, up to the target is dropped */
+        if (skip_to >= 0)
+        {
+            int64_t keep = (ov_time_tell (& vf) - skip_to) * ov_info (& vf, -1)->rate;
+            if (keep <= 0)
+                continue;
+
+            start = aud::max<int64_t> (bytes - keep, 0);
+            skip_to = -1;
+        }
 
         if (update_tuple (& vf, tuple))
             set_playback_tuple (tuple.ref ());
@@ -329,10 +393,16 @@ bool VorbisPlugin::play (const char * filename, VFSFile & file)
                     set_replay_gain (rg_info);
 
                 open_audio (FMT_FLOAT, vi->rate, vi->channels);
+                prefetch.set_format (FMT_FLOAT, vi->rate, vi->channels);
+                pcmout.resize (PCM_FRAMES * channels);
             }
         }
 
-        write_audio (pcmout, bytes);
+        const float * out = vorbis_interleave_buffer (pcm, start, bytes, channels, pcmout);
+        bytes = channels * (bytes - start) * sizeof (float);
+
+        write_audio (out, bytes);
+        prefetch.written (bytes);
 
         if (current_section != last_section)
         {
@@ -25,6 +25,8 @@ public:
         .with_exts (exts)
         .with_mimes (mimes)) {}
 
+    void cleanup () override;
+
     bool is_our_file (const char * filename, VFSFile & file) override;
     bool read_tag (const char * filename, VFSFile & file, Tuple & tuple, Index<char> * image) override;
     bool write_tuple (const char * filename, VFSFile & file, const Tuple & tuple) override;
@@ -4,6 +4,7 @@
 
 #include <inttypes.h>
 #include <libaudcore/runtime.h>
+#include <libaudcore/templates.h>
 
 const char * ayemu_err;
 
@@ -427,18 +428,134 @@ static void prepare_generation(ayemu_ay_t * ay)
     ay->dirty = 0;
 }
 
+/* Tacts until a counter reaches its period, counting the tact it does so
+ * in; a counter already past a period just lowered wraps on the next one.
+ */
+static inline int tacts_to_wrap(int cnt, int period)
+{
+    return (period - cnt > 1) ? period - cnt : 1;
+}
+
+/* The sum of the three channels in the current state of the generators */
+static void mix_channels(ayemu_ay_t * ay, int * mix_l, int * mix_r)
+{
+    int tmpvol;
+
+    *mix_l = *mix_r = 0;
+
+#define ENVVOL Envelope[ay->regs.env_style][ay->env_pos]
+
+    if ((ay->bit_a | !ay->regs.R7_tone_a) &
+        (ay->bit_n | !ay->regs.R7_noise_a))
+    {
+        tmpvol = (ay->regs.env_a) ? ENVVOL : ay->regs.vol_a * 2 + 1;
+        *mix_l += ay->vols[0][tmpvol];
+        *mix_r += ay->vols[1][tmpvol];
+    }
+
+    if ((ay->bit_b | !ay->regs.R7_tone_b) &
+        (ay->bit_n | !ay->regs.R7_noise_b))
+    {
+        tmpvol = (ay->regs.env_b) ? ENVVOL : ay->regs.vol_b * 2 + 1;
+        *mix_l += ay->vols[2][tmpvol];
+        *mix_r += ay->vols[3][tmpvol];
+    }
+
+    if ((ay->bit_c | !ay->regs.R7_tone_c) &
+        (ay->bit_n | !ay->regs.R7_noise_c))
+    {
+        tmpvol = (ay->regs.env_c) ? ENVVOL : ay->regs.vol_c * 2 + 1;
+        *mix_l += ay->vols[4][tmpvol];
+        *mix_r += ay->vols[5][tmpvol];
+    }
+}
+
+/* Step every generator by one chip tact */
+static void step_generators(ayemu_ay_t * ay)
+{
+    if (++ay->cnt_a >= ay->regs.tone_a)
+    {
+        ay->cnt_a = 0;
+        ay->bit_a = !ay->bit_a;
+    }
+
+    if (++ay->cnt_b >= ay->regs.tone_b)
+    {
+        ay->cnt_b = 0;
+        ay->bit_b = !ay->bit_b;
+    }
+
+    if (++ay->cnt_c >= ay->regs.tone_c)
+    {
+        ay->cnt_c = 0;
+        ay->bit_c = !ay->bit_c;
+    }
+
+    /* GenNoise (c) Hacker KAY & Sergey Bulba */
+    if (++ay->cnt_n >= (ay->regs.noise * 2))
+    {
+        ay->cnt_n = 0;
+        ay->Cur_Seed =
+            (ay->Cur_Seed * 2 + 1) ^
+            (((ay->Cur_Seed >> 16) ^ (ay->Cur_Seed >> 13)) & 1);
+        ay->bit_n = ((ay->Cur_Seed >> 16) & 1);
+    }
+
+    if (++ay->cnt_e >= ay->regs.env_freq)
+    {
+        ay->cnt_e = 0;
+        if (++ay->env_pos > 127)
+            ay->env_pos = 64;
+    }
+}
+
+static unsigned char * put_sample(ayemu_ay_t * ay, unsigned char * sound_buf,
+                                  int mix_l, int mix_r)
+{
+    mix_l /= ay->Amp_Global;
+    mix_r /= ay->Amp_Global;
+
+    if (ay->sndfmt.bpc == 8)
+    {
+        /* 8 bit sound */
+        mix_l = (mix_l >> 8) | 128;
+        mix_r = (mix_r >> 8) | 128;
+        *sound_buf++ = mix_l;
+
+        if (ay->sndfmt.channels != 1)
+            *sound_buf++ = mix_r;
+    }
+    else
+    {
+        /* 16 bit sound */
+        *sound_buf++ = mix_l & 0x00ff;
+        *sound_buf++ = (mix_l >> 8);
+
+        if (ay->sndfmt.channels != 1)
+        {
+            *sound_buf++ = mix_r & 0x00ff;
+            *sound_buf++ = (mix_r >> 8);
+        }
+    }
+
+    return sound_buf;
+}
+
 /**
  * Generate sound: Fill sound buffer with current register data.
  * \arg \c ay - pointer to ayemu_t structure.
  * \arg \c buf - pointer to sound buffer.
  * \arg \c sound_bufsize - size of buffer.
  * \return pointer to next data in output sound buffer.
+ *
+ * The output only changes in the tacts where a generator wraps, which for
+ * most register values is far less than once per sample.  The tacts in
+ * between are added in one go, however many samples they span.
  */
 void * ayemu_gen_sound(ayemu_ay_t * ay, void * buf, size_t sound_bufsize)
 {
-    int mix_l, mix_r;
-    int tmpvol;
-    int m;
+    int mix_l, mix_r;   /* sum for the current sample */
+    int chan_l, chan_r; /* what each tact adds to it */
     int snd_numcount;
     unsigned char * sound_buf = (unsigned char *)buf;
 
@@ -449,98 +566,64 @@ void * ayemu_gen_sound(ayemu_ay_t * ay, void * buf, size_t sound_bufsize)
 
     snd_numcount = sound_bufsize / (ay->sndfmt.channels * (ay->sndfmt.bpc >> 3));
 
-    while (snd_numcount-- > 0)
+    int tacts = ay->ChipTacts_per_outcount;
+    if (tacts <= 0)
     {
-        mix_l = mix_r = 0;
-
-        for (m = 0; m < ay->ChipTacts_per_outcount; m++)
-        {
-            if (++ay->cnt_a >= ay->regs.tone_a)
-            {
-                ay->cnt_a = 0;
-                ay->bit_a = !ay->bit_a;
-            }
-
-            if (++ay->cnt_b >= ay->regs.tone_b)
-            {
-                ay->cnt_b = 0;
-                ay->bit_b = !ay->bit_b;
-            }
-
-            if (++ay->cnt_c >= ay->regs.tone_c)
-            {
-                ay->cnt_c = 0;
-                ay->bit_c = !ay->bit_c;
-            }
-
-            /* GenNoise (c) Hacker KAY & Sergey Bulba */
-            if (++ay->cnt_n >= (ay->regs.noise * 2))
-            {
-                ay->cnt_n = 0;
-                ay->Cur_Seed =
-                    (ay->Cur_Seed * 2 + 1) ^
-                    (((ay->Cur_Seed >> 16) ^ (ay->Cur_Seed >> 13)) & 1);
-                ay->bit_n = ((ay->Cur_Seed >> 16) & 1);
-            }
-
-            if (++ay->cnt_e >= ay->regs.env_freq)
-            {
-                ay->cnt_e = 0;
-                if (++ay->env_pos > 127)
-                    ay->env_pos = 64;
-            }
-
-#define ENVVOL Envelope[ay->regs.env_style][ay->env_pos]
+        AUDERR("Chip frequency %d is too low\n", (int)ay->ChipFreq);
+        return 0;
+    }
 
-            if ((ay->bit_a | !ay->regs.R7_tone_a) &
-                (ay->bit_n | !ay->regs.R7_noise_a))
-            {
-                tmpvol = (ay->regs.env_a) ? ENVVOL : ay->regs.vol_a * 2 + 1;
-                mix_l += ay->vols[0][tmpvol];
-                mix_r += ay->vols[1][tmpvol];
-            }
+    int left = tacts; /* tacts still to add to the current sample */
+    mix_l = mix_r = 0;
+    mix_channels(ay, &chan_l, &chan_r);
 
-            if ((ay->bit_b | !ay->regs.R7_tone_b) &
-                (ay->bit_n | !ay->regs.R7_noise_b))
-            {
-                tmpvol = (ay->regs.env_b) ? ENVVOL : ay->regs.vol_b * 2 + 1;
-                mix_l += ay->vols[2][tmpvol];
-                mix_r += ay->vols[3][tmpvol];
-            }
-
-            if ((ay->bit_c | !ay->regs.R7_tone_c) &
-                (ay->bit_n | !ay->regs.R7_noise_c))
+    while (snd_numcount > 0)
+    {
+        int quiet = tacts_to_wrap(ay->cnt_a, ay->regs.tone_a);
+        quiet = aud::min(quiet, tacts_to_wrap(ay->cnt_b, ay->regs.tone_b));
+        quiet = aud::min(quiet, tacts_to_wrap(ay->cnt_c, ay->regs.tone_c));
+        quiet = aud::min(quiet, tacts_to_wrap(ay->cnt_n, ay->regs.noise * 2));
+        quiet = aud::min(quiet, tacts_to_wrap(ay->cnt_e, ay->regs.env_freq));
+        quiet--;
+
+        while (quiet > 0 && snd_numcount > 0)
+        {
+            int n = aud::min(quiet, left);
+
+            mix_l += n * chan_l;
+            mix_r += n * chan_r;
+            ay->cnt_a += n;
+            ay->cnt_b += n;
+            ay->cnt_c += n;
+            ay->cnt_n += n;
+            ay->cnt_e += n;
+            quiet -= n;
+            left -= n;
+
+            if (!left)
             {
-                tmpvol = (ay->regs.env_c) ? ENVVOL : ay->regs.vol_c * 2 + 1;
-                mix_l += ay->vols[4][tmpvol];
-                mix_r += ay->vols[5][tmpvol];
+                sound_buf = put_sample(ay, sound_buf, mix_l, mix_r);
+                snd_numcount--;
+                left = tacts;
+                mix_l = mix_r = 0;
             }
         }
 
-        mix_l /= ay->Amp_Global;
-        mix_r /= ay->Amp_Global;
+        if (!snd_numcount)
+            break;
 
-        if (ay->sndfmt.bpc == 8)
-        {
-            /* 8 bit sound */
-            mix_l = (mix_l >> 8) | 128;
-            mix_r = (mix_r >> 8) | 128;
-            *sound_buf++ = mix_l;
+        step_generators(ay);
+        mix_channels(ay, &chan_l, &chan_r);
 
-            if (ay->sndfmt.channels != 1)
-                *sound_buf++ = mix_r;
-        }
-        else
-        {
-            /* 16 bit sound */
-            *sound_buf++ = mix_l & 0x00ff;
-            *sound_buf++ = (mix_l >> 8);
+        mix_l += chan_l;
+        mix_r += chan_r;
 
-            if (ay->sndfmt.channels != 1)
-            {
-                *sound_buf++ = mix_r & 0x00ff;
-                *sound_buf++ = (mix_r >> 8);
-            }
+        if (!--left)
+        {
+            sound_buf = put_sample(ay, sound_buf, mix_l, mix_r);
+            snd_numcount--;
+            left = tacts;
+            mix_l = mix_r = 0;
         }
     }
 
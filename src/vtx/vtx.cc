@@ -33,6 +33,7 @@
 #include "ayemu_8912.h"
 #include "ayemu_vtxfile.h"
 #include "vtx.h"
+#include "../trace-common/trace.h"
 
 class VTXPlugin : public InputPlugin
 {
@@ -66,7 +67,6 @@ public:
 EXPORT VTXPlugin aud_plugin_instance;
 
 #define SNDBUFSIZE 1024
-static char sndbuf[SNDBUFSIZE];
 static constexpr int freq = 44100;
 static constexpr int chans = 2;
 static constexpr int bits = 16;
@@ -111,6 +111,7 @@ bool VTXPlugin::play(const char * filename, VFSFile & file)
 {
     ayemu_ay_t ay;
     ayemu_vtx_t vtx;
+    char sndbuf[SNDBUFSIZE];
 
     bool eof = false;
     void * stream; /* pointer to current position in sound buffer */
@@ -147,6 +148,7 @@ bool VTXPlugin::play(const char * filename, VFSFile & file)
 
     while (!check_stop() && !eof)
     {
+        TRACE_SPAN("VTX play");
         /* (time in sec) * 50 = offset in AY register data frames */
         int seek_value = check_seek();
         if (seek_value >= 0)
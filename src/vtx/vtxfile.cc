@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -144,14 +145,49 @@ bool ayemu_vtx_t::read_header(VFSFile & file)
  * Read and decode lha data from .vtx file.
  * \return true on success, false when decoding failed.
  */
+/* The register data of the file loaded last, so that playing it again
+ * does not decode it again */
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static String cache_filename;
+static int64_t cache_filesize;
+static Index<unsigned char> cache_regdata;
+
 bool ayemu_vtx_t::load_data(VFSFile & file)
 {
-    /* read packed AY register data to end of file */
-    Index<char> packed_data = file.read_all();
+    int64_t filesize = file.fsize();
+    bool cached = false;
 
-    regdata.resize(hdr.regdata_size);
-    if (!lh5_decode(packed_data, regdata))
-        return false;
+    regdata.clear();
+
+    pthread_mutex_lock(&cache_mutex);
+
+    if (cache_filename && !strcmp(cache_filename, file.filename()) &&
+        cache_filesize == filesize && (size_t)cache_regdata.len() == hdr.regdata_size)
+    {
+        regdata.insert(cache_regdata.begin(), 0, cache_regdata.len());
+        cached = true;
+    }
+
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (!cached)
+    {
+        /* read packed AY register data to end of file */
+        Index<char> packed_data = file.read_all();
+
+        regdata.resize(hdr.regdata_size);
+        if (!lh5_decode(packed_data, regdata))
+            return false;
+
+        pthread_mutex_lock(&cache_mutex);
+
+        cache_filename = String(file.filename());
+        cache_filesize = filesize;
+        cache_regdata.clear();
+        cache_regdata.insert(regdata.begin(), 0, regdata.len());
+
+        pthread_mutex_unlock(&cache_mutex);
+    }
 
     pos = 0;
     return true;
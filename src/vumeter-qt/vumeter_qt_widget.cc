@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2017-2019 Marc Sanchez Fauste.
+ * Copyright 2024 Audacious Plugins Authors
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -21,13 +22,16 @@
 #include "vumeter_qt_widget.h"
 
 #include <math.h>
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#endif
+#include <QPaintEvent>
 #include <libaudcore/runtime.h>
 
 const QColor VUMeterQtWidget::backgroundColor = QColor(16, 16, 16, 255);
 const QColor VUMeterQtWidget::text_color = QColor(255, 255, 255);
 const QColor VUMeterQtWidget::db_line_color = QColor(120, 120, 120);
 const float VUMeterQtWidget::legend_line_width = 1.0f;
-const int VUMeterQtWidget::redraw_interval = 25; // ms
 
 float VUMeterQtWidget::get_db_on_range(float db)
 {
@@ -58,6 +62,68 @@ float VUMeterQtWidget::get_db_factor(float db)
     return factor / 100.0f;
 }
 
+static constexpr int frames_per_block = 512;
+
+#if defined(__SSE2__) || defined(__x86_64__)
+// Reads the block four samples at a time into N registers, N * 4 being the
+// number of samples after which the channels line up with the lanes again
+template<int N>
+static void get_lane_peaks(const float * pcm, int samples, float * lanes)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 acc[N];
+
+    for (int k = 0; k < N; k++)
+        acc[k] = _mm_setzero_ps();
+
+    for (int i = 0; i < samples; i += N * 4)
+    {
+        for (int k = 0; k < N; k++)
+            acc[k] = _mm_max_ps(acc[k], _mm_andnot_ps(sign, _mm_loadu_ps(pcm + i + k * 4)));
+    }
+
+    for (int k = 0; k < N; k++)
+        _mm_storeu_ps(lanes + k * 4, acc[k]);
+}
+#endif
+
+// Peak level of each channel of a block of interleaved frames
+static void get_peaks(const float * pcm, int channels, float * peaks)
+{
+    int samples = frames_per_block * channels;
+
+    for (int channel = 0; channel < channels; channel++)
+        peaks[channel] = 0;
+
+#if defined(__SSE2__) || defined(__x86_64__)
+    if (channels <= 8)
+    {
+        int n = (channels % 4 == 0) ? channels / 4 : (channels % 2 == 0) ? channels / 2 : channels;
+        float lanes[8 * 4];
+
+        switch (n)
+        {
+        case 1: get_lane_peaks<1>(pcm, samples, lanes); break;
+        case 2: get_lane_peaks<2>(pcm, samples, lanes); break;
+        case 3: get_lane_peaks<3>(pcm, samples, lanes); break;
+        case 5: get_lane_peaks<5>(pcm, samples, lanes); break;
+        case 7: get_lane_peaks<7>(pcm, samples, lanes); break;
+        }
+
+        for (int j = 0; j < n * 4; j++)
+            peaks[j % channels] = fmaxf(peaks[j % channels], lanes[j]);
+
+        return;
+    }
+#endif
+
+    for (int i = 0; i < samples;)
+    {
+        for (int channel = 0; channel < channels; channel++)
+            peaks[channel] = fmaxf(peaks[channel], fabsf(pcm[i++]));
+    }
+}
+
 float VUMeterQtWidget::get_height_from_db(float db)
 {
     return get_db_factor(db) * vumeter_height;
@@ -72,19 +138,8 @@ void VUMeterQtWidget::render_multi_pcm (const float * pcm, int channels)
 {
     nchannels = aud::clamp(channels, 1, max_channels);
 
-    float * peaks = new float[nchannels];
-    for (int channel = 0; channel < nchannels; channel++)
-    {
-        peaks[channel] = fabsf(pcm[channel]);
-    }
-
-    for (int i = 0; i < 512 * nchannels;)
-    {
-        for (int channel = 0; channel < nchannels; channel++)
-        {
-            peaks[channel] = fmaxf(peaks[channel], fabsf(pcm[i++]));
-        }
-    }
+    float peaks[max_channels];
+    get_peaks(pcm, nchannels, peaks);
 
     for (int i = 0; i < nchannels; i++)
     {
@@ -103,10 +158,16 @@ void VUMeterQtWidget::render_multi_pcm (const float * pcm, int channels)
         }
     }
 
-    delete[] peaks;
+    // nothing has fallen while the meter was at rest
+    if (!frame.is_animated())
+        redraw_elapsed_timer.restart();
+
+    frame.set_animated(true);
 }
 
-void VUMeterQtWidget::redraw_timer_expired()
+// Lets the levels and peaks fall for the time since the last frame,
+// returns false once all of them are down
+bool VUMeterQtWidget::update_levels()
 {
     qint64 elapsed_render_time = redraw_elapsed_timer.restart();
     float falloff = aud_get_double ("vumeter", "falloff") / 1000.0;
@@ -125,7 +186,13 @@ void VUMeterQtWidget::redraw_timer_expired()
         }
     }
 
-    update();
+    for (int i = 0; i < nchannels; i++)
+    {
+        if (channels_db_level[i] > -db_range || channels_peaks[i] > -db_range)
+            return true;
+    }
+
+    return false;
 }
 
 void VUMeterQtWidget::reset()
@@ -248,39 +315,65 @@ void VUMeterQtWidget::draw_visualizer_peaks(QPainter &p)
     }
 }
 
+QRectF VUMeterQtWidget::get_bar_rect(int channel)
+{
+    float bar_width = get_bar_width(nchannels);
+    float x = legend_width + (bar_width * channel);
+    if (channel > 0)
+    {
+         x += 1;
+         bar_width -= 1;
+    }
+
+    return QRectF(x, vumeter_top_padding, bar_width, vumeter_height);
+}
+
+void VUMeterQtWidget::draw_visualizer_background(QPainter & p)
+{
+    for (int i = 0; i < nchannels; i++)
+        p.fillRect(get_bar_rect(i), background_vumeter_pattern);
+}
+
 void VUMeterQtWidget::draw_visualizer(QPainter & p)
 {
     for (int i = 0; i < nchannels; i++)
     {
-        float bar_width = get_bar_width(nchannels);
-        float x = legend_width + (bar_width * i);
-        if (i > 0)
-        {
-             x += 1;
-             bar_width -= 1;
-        }
-
-        p.fillRect (
-            QRectF(x, vumeter_top_padding, bar_width, vumeter_height),
-            background_vumeter_pattern
-        );
+        QRectF bar = get_bar_rect(i);
 
         p.fillRect (
-            QRectF(x, get_y_from_db(channels_db_level[i]),
-                bar_width, (get_height_from_db(channels_db_level[i]))),
+            QRectF(bar.x(), get_y_from_db(channels_db_level[i]),
+                bar.width(), (get_height_from_db(channels_db_level[i]))),
             vumeter_pattern
         );
 
         if (channels_peaks[i] > -db_range)
         {
             p.fillRect (
-                QRectF(x, get_y_from_db(channels_peaks[i]), bar_width, 1),
+                QRectF(bar.x(), get_y_from_db(channels_peaks[i]), bar.width(), 1),
                 vumeter_pattern
             );
         }
     }
 }
 
+// Everything that only changes with the size or the number of channels,
+// drawn once into a pixmap at the resolution of the screen
+void VUMeterQtWidget::draw_static_layer()
+{
+    qreal ratio = devicePixelRatioF();
+    static_layer = QPixmap(size() * ratio);
+    static_layer.setDevicePixelRatio(ratio);
+    static_layer_channels = nchannels;
+
+    QPainter p(&static_layer);
+    p.setFont(font());
+
+    draw_background(p);
+    if (must_draw_vu_legend)
+        draw_vu_legend(p);
+    draw_visualizer_background(p);
+}
+
 QString VUMeterQtWidget::format_db(const float val)
 {
     if (val > -10)
@@ -318,15 +411,21 @@ void VUMeterQtWidget::update_sizes()
     }
     vumeter_pattern = get_vumeter_pattern();
     background_vumeter_pattern = get_vumeter_pattern(30);
+
+    static_layer = QPixmap();
+
+    // the legend on either side stays as it is from frame to frame
+    if (must_draw_vu_legend)
+        frame.set_rect(QRectF(legend_width, 0, vumeter_width, height()).toAlignedRect());
+    else
+        frame.set_rect(QRect());
 }
 
 VUMeterQtWidget::VUMeterQtWidget (QWidget * parent)
-    : QWidget (parent),
-    redraw_timer(new QTimer(this))
+    : QWidget (parent)
 {
+    setAttribute(Qt::WA_OpaquePaintEvent);
     reset();
-    connect(redraw_timer, &QTimer::timeout, this, &VUMeterQtWidget::redraw_timer_expired);
-    redraw_timer->start(redraw_interval);
     redraw_elapsed_timer.start();
     update_sizes();
 }
@@ -348,16 +447,22 @@ void VUMeterQtWidget::resizeEvent (QResizeEvent *)
     update_sizes();
 }
 
-void VUMeterQtWidget::paintEvent (QPaintEvent *)
+void VUMeterQtWidget::paintEvent (QPaintEvent * event)
 {
+    // falls at the same speed whatever the frame rate
+    frame.set_animated(update_levels());
+
+    // also drawn again after a move to a screen with another ratio
+    if (static_layer.isNull() || static_layer_channels != nchannels ||
+        static_layer.devicePixelRatio() != devicePixelRatioF())
+        draw_static_layer();
+
     QPainter p(this);
+    p.setClipRect(event->rect());
+    p.drawPixmap(0, 0, static_layer);
 
-    draw_background(p);
     if (must_draw_vu_legend)
-    {
-        draw_vu_legend(p);
         draw_visualizer_peaks(p);
-    }
     draw_visualizer(p);
 }
 
@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2017-2019 Marc Sanchez Fauste.
+ * Copyright 2024 Audacious Plugins Authors
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -25,10 +26,12 @@
 #include <QPainter>
 #include <QLinearGradient>
 #include <QColor>
+#include <QPixmap>
 #include <QString>
-#include <QTimer>
 #include <QElapsedTimer>
 
+#include "../ui-common/vis-frame-qt.h"
+
 class VUMeterQtWidget : public QWidget
 {
 private:
@@ -39,7 +42,6 @@ private:
     static const QColor text_color;
     static const QColor db_line_color;
     static const float legend_line_width;
-    static const int redraw_interval;
 
     int nchannels = 2;
     float channels_db_level[max_channels];
@@ -53,11 +55,16 @@ private:
     float vumeter_top_padding;
     float vumeter_bottom_padding;
     bool must_draw_vu_legend;
-    QTimer *redraw_timer;
+    QPixmap static_layer; // background, legend and unlit bars
+    int static_layer_channels = 0;
+    VisFrame frame {this};
     QElapsedTimer redraw_elapsed_timer;
 
     void draw_background (QPainter &p);
     void draw_visualizer (QPainter &p);
+    void draw_visualizer_background(QPainter &p);
+    void draw_static_layer();
+    QRectF get_bar_rect(int channel);
     void draw_vu_legend(QPainter &p);
     float get_height_from_db(float db);
     float get_y_from_db(float db);
@@ -67,14 +74,12 @@ private:
     void draw_vu_legend_line(QPainter &p, float db, float line_width_factor = 1.0f);
     void draw_visualizer_peaks(QPainter &p);
     void update_sizes();
+    bool update_levels();
 
     static QString format_db(const float val);
     static float get_db_on_range(float db);
     static float get_db_factor(float db);
 
-public slots:
-    void redraw_timer_expired();
-
 public:
     VUMeterQtWidget (QWidget * parent = nullptr);
 
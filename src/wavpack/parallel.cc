@@ -0,0 +1,277 @@
+/*
+ * WavPack decoder plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <thread>
+
+#include <libaudcore/objects.h>
+#include <libaudcore/runtime.h>
+
+#include "parallel.h"
+
+/* samples of all channels in a job, 2 MiB of them */
+#define JOB_SIZE (1 << 19)
+
+struct ParallelWorker
+{
+    ParallelDecoder * owner = nullptr;
+    VFSFile file, wvc_file;
+    WavpackContext * ctx = nullptr;
+    pthread_t thread;
+};
+
+int wv_narrow (int32_t * samples, int count, int bits_per_sample)
+{
+    if (bits_per_sample <= 8)
+    {
+        auto out = (int8_t *) samples;
+        for (int i = 0; i < count; i ++)
+            out[i] = samples[i];
+
+        return count;
+    }
+
+    if (bits_per_sample <= 16)
+    {
+        auto out = (int16_t *) samples;
+        for (int i = 0; i < count; i ++)
+            out[i] = samples[i];
+
+        return count * 2;
+    }
+
+    /* 24 and 32 bits, and floats, are played as they are */
+    return count * 4;
+}
+
+static void * worker_thread (void * data)
+{
+    auto worker = (ParallelWorker *) data;
+    worker->owner->work (worker);
+    return nullptr;
+}
+
+static void delete_worker (ParallelWorker * worker)
+{
+    if (worker->ctx)
+        WavpackCloseFile (worker->ctx);
+
+    delete worker;
+}
+
+ParallelDecoder::ParallelDecoder (const char * filename, int flags, int channels,
+ int bits_per_sample, uint32_t num_samples, int threads) :
+    m_channels (channels),
+    m_bits_per_sample (bits_per_sample),
+    m_num_samples (num_samples),
+    m_job_samples (aud::max (JOB_SIZE / aud::max (channels, 1), 1))
+{
+    for (int i = 0; i < aud::min (threads, PARALLEL_MAX_THREADS); i ++)
+    {
+        auto worker = new ParallelWorker;
+        worker->owner = this;
+        worker->file = VFSFile (filename, "r");
+
+        if (! worker->file ||
+            ! wv_attach (filename, worker->file, worker->wvc_file, & worker->ctx, nullptr, flags) ||
+            WavpackGetNumChannels (worker->ctx) != channels ||
+            pthread_create (& worker->thread, nullptr, worker_thread, worker))
+        {
+            AUDERR ("Could not start a WavPack decoder thread.\n");
+            delete_worker (worker);
+            break;
+        }
+
+        m_workers.append (worker);
+    }
+
+    AUDDBG ("Decoding on %d threads.\n", m_workers.len ());
+}
+
+ParallelDecoder::~ParallelDecoder ()
+{
+    stop ();
+
+    pthread_mutex_lock (& m_mutex);
+    m_quit = true;
+    pthread_cond_broadcast (& m_cond);
+    pthread_mutex_unlock (& m_mutex);
+
+    for (ParallelWorker * worker : m_workers)
+    {
+        pthread_join (worker->thread, nullptr);
+        delete_worker (worker);
+    }
+}
+
+void ParallelDecoder::start (uint32_t sample)
+{
+    stop ();
+    m_next_sample = aud::min (sample, m_num_samples);
+}
+
+void ParallelDecoder::stop ()
+{
+    pthread_mutex_lock (& m_mutex);
+
+    for (Job & job : m_jobs)
+    {
+        if (job.state == Job::Queued)
+            job.state = Job::Free;
+    }
+
+    for (Job & job : m_jobs)
+    {
+        while (job.state == Job::Busy)
+            pthread_cond_wait (& m_cond, & m_mutex);
+
+        job.state = Job::Free;
+    }
+
+    m_head = m_tail = 0;
+    m_returned = false;
+
+    pthread_mutex_unlock (& m_mutex);
+
+    m_next_sample = m_num_samples;
+}
+
+ParallelDecoder::Result ParallelDecoder::next (const Index<int32_t> * & audio,
+ int & bytes, uint32_t & resume)
+{
+    pthread_mutex_lock (& m_mutex);
+
+    if (m_returned)
+    {
+        m_jobs[m_head].state = Job::Free;
+        m_head = (m_head + 1) % PARALLEL_QUEUE;
+        m_returned = false;
+    }
+
+    /* keep the queue full */
+    while (m_jobs[m_tail].state == Job::Free && m_next_sample < m_num_samples)
+    {
+        Job & job = m_jobs[m_tail];
+
+        job.first_sample = m_next_sample;
+        job.samples = aud::min (m_job_samples, m_num_samples - m_next_sample);
+        job.state = Job::Queued;
+
+        m_next_sample += job.samples;
+        m_tail = (m_tail + 1) % PARALLEL_QUEUE;
+        pthread_cond_broadcast (& m_cond);
+    }
+
+    Job & job = m_jobs[m_head];
+
+    while (job.state == Job::Queued || job.state == Job::Busy)
+        pthread_cond_wait (& m_cond, & m_mutex);
+
+    bool done = (job.state == Job::Done);
+
+    pthread_mutex_unlock (& m_mutex);
+
+    if (! done)
+        return End;
+
+    if (! job.ok)
+    {
+        AUDWARN ("WavPack blocks at sample %u did not decode.\n", job.first_sample);
+        resume = job.first_sample;
+        return Fallback;
+    }
+
+    audio = & job.output;
+    bytes = job.bytes;
+    m_returned = true;
+    return Audio;
+}
+
+void ParallelDecoder::work (ParallelWorker * worker)
+{
+    pthread_mutex_lock (& m_mutex);
+
+    while (! m_quit)
+    {
+        /* the oldest job first */
+        Job * job = nullptr;
+
+        for (int i = 0; i < PARALLEL_QUEUE && ! job; i ++)
+        {
+            Job & queued = m_jobs[(m_head + i) % PARALLEL_QUEUE];
+            if (queued.state == Job::Queued)
+                job = & queued;
+        }
+
+        if (! job)
+        {
+            pthread_cond_wait (& m_cond, & m_mutex);
+            continue;
+        }
+
+        job->state = Job::Busy;
+        pthread_mutex_unlock (& m_mutex);
+
+        decode (worker, * job);
+
+        pthread_mutex_lock (& m_mutex);
+        job->state = Job::Done;
+        pthread_cond_broadcast (& m_cond);
+    }
+
+    pthread_mutex_unlock (& m_mutex);
+}
+
+/* A worker that takes the job after its last one goes straight on.  Any
+ * other seeks, and WavpackSeekSample() decodes from the start of the block
+ * holding the first sample, so at most a block of the job before is decoded
+ * twice, a small part of a job of several seconds. */
+void ParallelDecoder::decode (ParallelWorker * worker, Job & job)
+{
+    job.output.resize (job.samples * m_channels);
+    job.ok = false;
+
+    if (WavpackGetSampleIndex (worker->ctx) != job.first_sample &&
+        ! WavpackSeekSample (worker->ctx, job.first_sample))
+        return;
+
+    uint32_t done = 0;
+
+    while (done < job.samples)
+    {
+        uint32_t got = WavpackUnpackSamples (worker->ctx,
+         & job.output[done * m_channels], job.samples - done);
+
+        if (! got)
+            return;
+
+        done += got;
+    }
+
+    job.bytes = wv_narrow (job.output.begin (), job.samples * m_channels, m_bits_per_sample);
+    job.ok = true;
+}
+
+int parallel_threads ()
+{
+    if (! aud_get_bool ("wavpack", "parallel_decode"))
+        return 0;
+
+    int cpus = std::thread::hardware_concurrency ();
+    return (cpus > 1) ? aud::min (cpus, PARALLEL_MAX_THREADS) : 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * WavPack decoder plugin for Audacious
+ * Copyright 2026 Audacious Plugins Authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef WAVPACK_PARALLEL_H
+#define WAVPACK_PARALLEL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <wavpack/wavpack.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/vfs.h>
+
+#define PARALLEL_MAX_THREADS 4
+#define PARALLEL_QUEUE (2 * PARALLEL_MAX_THREADS)
+
+bool wv_attach (const char * filename, VFSFile & wv_input,
+ VFSFile & wvc_input, WavpackContext * * ctx, char * error, int flags);
+
+/* Turns what WavpackUnpackSamples() left in the buffer into samples of
+ * the output format, in place, and returns their size in bytes. */
+int wv_narrow (int32_t * samples, int count, int bits_per_sample);
+
+struct ParallelWorker;
+
+/* Decodes a seekable WavPack file several seconds at a time on worker
+ * threads.  WavPack blocks can be decoded each on their own, so every
+ * worker opens the file (and the correction file) for itself and seeks to
+ * the part it was given; the audio comes back in order, already narrowed
+ * to the output format. */
+class ParallelDecoder
+{
+public:
+    enum Result {
+        Audio,      /* the next part of the stream */
+        End,
+        Fallback    /* decode serially from the given sample on */
+    };
+
+    ParallelDecoder (const char * filename, int flags, int channels,
+     int bits_per_sample, uint32_t num_samples, int threads);
+    ~ParallelDecoder ();
+
+    /* false if no worker could open the file */
+    bool ready () const { return m_workers.len () > 0; }
+
+    /* decodes from the given sample on */
+    void start (uint32_t sample);
+
+    /* the audio stays valid until the next call */
+    Result next (const Index<int32_t> * & audio, int & bytes, uint32_t & resume);
+
+    /* drops the audio decoded so far */
+    void stop ();
+
+    /* for the workers */
+    void work (ParallelWorker * worker);
+
+private:
+    struct Job
+    {
+        enum { Free, Queued, Busy, Done } state = Free;
+        uint32_t first_sample = 0;
+        uint32_t samples = 0;   /* per channel */
+        Index<int32_t> output;
+        int bytes = 0;
+        bool ok = false;
+    };
+
+    void decode (ParallelWorker * worker, Job & job);
+
+    int m_channels, m_bits_per_sample;
+    uint32_t m_num_samples, m_job_samples;
+    uint32_t m_next_sample = 0;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_cond = PTHREAD_COND_INITIALIZER;
+    bool m_quit = false;
+
+    Job m_jobs[PARALLEL_QUEUE];
+    int m_head = 0, m_tail = 0;     /* oldest job, next free slot */
+    bool m_returned = false;        /* the oldest job is being played */
+
+    Index<ParallelWorker *> m_workers;
+};
+
+int parallel_threads ();
+
+#endif
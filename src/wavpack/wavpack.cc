@@ -6,11 +6,15 @@
 #include <audacious/audtag.h>
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/objects.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 
+#include "parallel.h"
+#include "../trace-common/trace.h"
+
 #define BUFFER_SIZE 256 /* read buffer size, in samples / frames */
-#define SAMPLE_SIZE(a) (a <= 8 ? sizeof (uint8_t) : (a <= 16 ? sizeof (uint16_t) : sizeof (uint32_t)))
 #define SAMPLE_FMT(a) (a <= 8 ? FMT_S8 : (a <= 16 ? FMT_S16_NE : (a <= 24 ? FMT_S24_NE : FMT_S32_NE)))
 
 class WavpackPlugin : public InputPlugin
@@ -19,17 +23,22 @@ public:
     static const char about[];
     static const char * const exts[];
     static const char * const mimes[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
 
     static constexpr PluginInfo info = {
         N_("WavPack Decoder"),
         PACKAGE,
-        about
+        about,
+        & prefs
     };
 
     constexpr WavpackPlugin () : InputPlugin (info, InputInfo (FlagWritesTag)
         .with_exts (exts)
         .with_mimes (mimes)) {}
 
+    bool init () override;
+
     bool is_our_file (const char * filename, VFSFile & file) override
         { return false; }
 
@@ -40,6 +49,18 @@ public:
 
 EXPORT WavpackPlugin aud_plugin_instance;
 
+static const char * const wavpack_defaults[] = {
+    "parallel_decode", "FALSE",
+    "skip_correction", "FALSE",
+    nullptr
+};
+
+bool WavpackPlugin::init ()
+{
+    aud_config_set_defaults ("wavpack", wavpack_defaults);
+    return true;
+}
+
 /* Audacious VFS wrappers for WavPack stream reading */
 
 static int32_t wv_read_bytes (void * id, void * data, int32_t bcount)
@@ -93,7 +114,7 @@ WavpackStreamReader wv_readers = {
     wv_write_bytes
 };
 
-static bool wv_attach (const char * filename, VFSFile & wv_input,
+bool wv_attach (const char * filename, VFSFile & wv_input,
  VFSFile & wvc_input, WavpackContext * * ctx, char * error, int flags)
 {
     if (flags & OPEN_WVC)
@@ -118,8 +139,15 @@ bool WavpackPlugin::play (const char * filename, VFSFile & file)
 {
     VFSFile wvc_input;
     WavpackContext * ctx = nullptr;
+    SmartPtr<ParallelDecoder> parallel;
+    int threads;
 
-    if (! wv_attach (filename, file, wvc_input, & ctx, nullptr, OPEN_TAGS | OPEN_WVC))
+    /* hybrid files then play lossy, with no second file to read */
+    int flags = OPEN_TAGS;
+    if (! aud_get_bool ("wavpack", "skip_correction"))
+        flags |= OPEN_WVC;
+
+    if (! wv_attach (filename, file, wvc_input, & ctx, nullptr, flags))
     {
         AUDERR ("Error opening Wavpack file '%s'.\n", filename);
         return false;
@@ -140,14 +168,57 @@ bool WavpackPlugin::play (const char * filename, VFSFile & file)
     Index<int32_t> input;
     input.resize (BUFFER_SIZE * num_channels);
 
-    Index<char> output;
-    output.resize (BUFFER_SIZE * num_channels * SAMPLE_SIZE (bits_per_sample));
+    if (file.fsize () >= 0 && num_samples != (uint32_t) -1 &&
+        (threads = parallel_threads ()))
+    {
+        parallel.capture (new ParallelDecoder (filename, flags, num_channels,
+         bits_per_sample, num_samples, threads));
+
+        if (parallel->ready ())
+            parallel->start (WavpackGetSampleIndex (ctx));
+        else
+            parallel.clear ();
+    }
 
     while (! check_stop ())
     {
+        TRACE_SPAN ("WavPack play");
         int seek_value = check_seek ();
         if (seek_value >= 0)
-            WavpackSeekSample (ctx, (int64_t) seek_value * sample_rate / 1000);
+        {
+            uint32_t sample = (int64_t) seek_value * sample_rate / 1000;
+
+            if (parallel)
+                parallel->start (sample);
+            else
+                WavpackSeekSample (ctx, sample);
+        }
+
+        if (parallel)
+        {
+            const Index<int32_t> * audio;
+            int bytes;
+            uint32_t resume;
+
+            auto result = parallel->next (audio, bytes, resume);
+            if (result == ParallelDecoder::End)
+                break;
+
+            if (result == ParallelDecoder::Audio)
+            {
+                write_audio (audio->begin (), bytes);
+                continue;
+            }
+
+            /* go on serially from the first sample not played */
+            parallel.clear ();
+
+            if (! WavpackSeekSample (ctx, resume))
+            {
+                AUDERR ("Error seeking in file.\n");
+                break;
+            }
+        }
 
         /* Decode audio data */
         unsigned samples_left = num_samples - WavpackGetSampleIndex (ctx);
@@ -164,33 +235,12 @@ bool WavpackPlugin::play (const char * filename, VFSFile & file)
         }
         else
         {
-            /* Perform audio data conversion and output */
-            int32_t * rp = input.begin ();
-            int8_t * wp = (int8_t *) output.begin ();
-            int16_t * wp2 = (int16_t *) output.begin ();
-            int32_t * wp4 = (int32_t *) output.begin ();
-
-            if (bits_per_sample <= 8)
-            {
-                for (int i = 0; i < ret * num_channels; i++, wp++, rp++)
-                    * wp = * rp & 0xff;
-            }
-            else if (bits_per_sample <= 16)
-            {
-                for (int i = 0; i < ret * num_channels; i++, wp2++, rp++)
-                    * wp2 = * rp & 0xffff;
-            }
-            else
-            {
-                for (int i = 0; i < ret * num_channels; i++, wp4++, rp++)
-                    * wp4 = * rp;
-            }
-
-            write_audio (output.begin (),
-             ret * num_channels * SAMPLE_SIZE (bits_per_sample));
+            int bytes = wv_narrow (input.begin (), ret * num_channels, bits_per_sample);
+            write_audio (input.begin (), bytes);
         }
     }
 
+    parallel.clear ();
     wv_deattach (ctx);
     return true;
 }
@@ -246,5 +296,14 @@ const char WavpackPlugin::about[] =
  N_("Copyright 2006 William Pitcock <nenolod@nenolod.net>\n\n"
     "Some of the plugin code was by Miles Egan.");
 
+const PreferencesWidget WavpackPlugin::widgets[] = {
+    WidgetCheck (N_("Decode on several threads (for high-resolution files)"),
+        WidgetBool ("wavpack", "parallel_decode")),
+    WidgetCheck (N_("Ignore correction files (hybrid files play lossy)"),
+        WidgetBool ("wavpack", "skip_correction"))
+};
+
+const PluginPreferences WavpackPlugin::prefs = {{widgets}};
+
 const char * const WavpackPlugin::exts[] = { "wv", nullptr };
 const char * const WavpackPlugin::mimes[] = { "audio/x-wavpack", nullptr };
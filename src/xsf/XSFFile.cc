@@ -40,14 +40,6 @@
 #include <zlib.h>
 #include "XSFFile.h"
 
-static inline void Set32BitsLE(uint32_t input, uint8_t *output)
-{
-	output[0] = input & 0xFF;
-	output[1] = (input >> 8) & 0xFF;
-	output[2] = (input >> 16) & 0xFF;
-	output[3] = (input >> 24) & 0xFF;
-}
-
 // The whitespace trimming is from the following answer on Stack Overflow:
 // https://stackoverflow.com/a/17976541
 
@@ -58,130 +50,194 @@ static inline std::string TrimWhitespace(const std::string &s)
 	return (wsback <= wsfront ? std::string() : std::string(wsfront, wsback));
 }
 
-XSFFile::XSFFile() : xSFType(0), hasFile(false), rawData(), reservedSection(), programSection(), tags()
+XSFFile::XSFFile() : xSFType(0), hasFile(false), reservedSection(), programSection(), tags(), compressedProgram(nullptr), compressedProgramSize(0), programHeaderSize(0)
 {
 }
 
-XSFFile::XSFFile(std::istream &inFile, uint32_t programSizeOffset, uint32_t programHeaderSize, bool readTagsOnly) : xSFType(0), hasFile(true), rawData(), reservedSection(), programSection(), tags()
+XSFFile::XSFFile(std::istream &inFile, uint32_t programSizeOffset, uint32_t programHeaderSize, bool readTagsOnly) : xSFType(0), hasFile(true), reservedSection(), programSection(), tags(), compressedProgram(nullptr), compressedProgramSize(0), programHeaderSize(0)
 {
 	this->ReadXSF(inFile, programSizeOffset, programHeaderSize, readTagsOnly);
 }
 
-void XSFFile::ReadXSF(std::istream &xSF, uint32_t programSizeOffset, uint32_t programHeaderSize, bool readTagsOnly)
+XSFFile::XSFFile(const uint8_t *data, size_t size, uint32_t programSizeOffset, uint32_t programHeaderSize, bool deferProgram) : xSFType(0), hasFile(true), reservedSection(), programSection(), tags(), compressedProgram(nullptr), compressedProgramSize(0), programHeaderSize(0)
 {
-	xSF.seekg(0, std::istream::end);
-	auto filesize = xSF.tellg();
-	xSF.seekg(0, std::istream::beg);
+	this->ParseXSF(data, size, programSizeOffset, programHeaderSize, deferProgram);
+}
 
+// Checks the 16 byte header against the size of the file and returns the
+// sizes of the reserved and (compressed) program sections
+static void CheckHeader(const uint8_t *header, uint64_t filesize, uint64_t &reservedSize, uint64_t &programCompressedSize)
+{
 	if (filesize < 4)
 		throw std::runtime_error("File is too small.");
 
-	char PSFHeader[4];
-	xSF.read(PSFHeader, 4);
-
-	if (PSFHeader[0] != 'P' || PSFHeader[1] != 'S' || PSFHeader[2] != 'F')
+	if (header[0] != 'P' || header[1] != 'S' || header[2] != 'F')
 		throw std::runtime_error("Not a PSF file.");
 
-	this->xSFType = PSFHeader[3];
+	if (filesize < 16)
+		throw std::runtime_error("File is too small.");
 
-	this->rawData.resize(4);
-  std::memcpy(&this->rawData[0], PSFHeader, 4);
+	reservedSize = Get32BitsLE(&header[4]);
+	programCompressedSize = Get32BitsLE(&header[8]);
 
-	if (filesize < 16)
+	if (filesize < reservedSize + programCompressedSize + 16)
 		throw std::runtime_error("File is too small.");
+}
+
+// Inflates until dest is full or the stream ends.  Like uncompress(), a
+// corrupt or truncated stream leaves what could be inflated before it.
+static void InflateInto(z_stream &zs, uint8_t *dest, size_t size)
+{
+	zs.next_out = dest;
+	zs.avail_out = size;
+	while (zs.avail_out)
+	{
+		if (inflate(&zs, Z_NO_FLUSH) != Z_OK)
+			break;
+	}
+}
 
-	uint32_t reservedSize = Get32BitsLE(xSF), programCompressedSize = Get32BitsLE(xSF);
-	this->rawData.resize(reservedSize + programCompressedSize + 16);
-	Set32BitsLE(reservedSize, &this->rawData[4]);
-	Set32BitsLE(programCompressedSize, &this->rawData[8]);
-	xSF.read(reinterpret_cast<char *>(&this->rawData[12]), 4);
+void XSFFile::ReadXSF(std::istream &xSF, uint32_t programSizeOffset, uint32_t programHeaderSize, bool readTagsOnly)
+{
+	xSF.seekg(0, std::istream::end);
+	uint64_t filesize = xSF.tellg();
+	xSF.seekg(0, std::istream::beg);
 
-	if (reservedSize)
+	// The whole file at once, rather than a section at a time
+	if (!readTagsOnly)
 	{
-		if (filesize < reservedSize + 16)
-			throw std::runtime_error("File is too small.");
+		auto data = std::vector<uint8_t>(filesize);
+		if (filesize)
+			xSF.read(reinterpret_cast<char *>(&data[0]), filesize);
+		this->ParseXSF(data.data(), xSF.gcount(), programSizeOffset, programHeaderSize, false);
+		return;
+	}
 
-		if (readTagsOnly)
-			xSF.read(reinterpret_cast<char *>(&this->rawData[16]), reservedSize);
-		else
-		{
-			this->reservedSection.resize(reservedSize);
-			xSF.read(reinterpret_cast<char *>(&this->reservedSection[0]), reservedSize);
-      std::memcpy(&this->rawData[16], &this->reservedSection[0], reservedSize);
-		}
+	uint8_t header[16] = {};
+	xSF.read(reinterpret_cast<char *>(header), std::min<uint64_t>(filesize, 16));
+
+	uint64_t reservedSize, programCompressedSize;
+	CheckHeader(header, filesize, reservedSize, programCompressedSize);
+	this->xSFType = header[3];
+
+	// Only the tags are wanted; the sections before them are not read at all
+	uint64_t startOfTags = reservedSize + programCompressedSize + 16;
+	if (filesize > startOfTags)
+	{
+		auto rawtags = std::vector<char>(filesize - startOfTags);
+		xSF.seekg(startOfTags, std::istream::beg);
+		xSF.read(&rawtags[0], rawtags.size());
+		this->ParseTags(rawtags.data(), xSF.gcount());
 	}
 
-	if (programCompressedSize)
+	this->hasFile = true;
+}
+
+void XSFFile::ParseXSF(const uint8_t *data, size_t size, uint32_t programSizeOffset, uint32_t programHeaderSize, bool deferProgram)
+{
+	uint64_t reservedSize, programCompressedSize;
+	CheckHeader(data, size, reservedSize, programCompressedSize);
+	this->xSFType = data[3];
+
+	this->reservedSection.assign(data + 16, data + 16 + reservedSize);
+
+	const uint8_t *program = data + 16 + reservedSize;
+	if (programCompressedSize && programHeaderSize)
 	{
-		if (filesize < reservedSize + programCompressedSize + 16)
-			throw std::runtime_error("File is too small.");
+		z_stream zs = {};
+		if (inflateInit(&zs) != Z_OK)
+			throw std::runtime_error("Cannot inflate the program section.");
 
-		if (readTagsOnly)
-			xSF.read(reinterpret_cast<char *>(&this->rawData[reservedSize + 16]), programCompressedSize);
+		zs.next_in = const_cast<uint8_t *>(program);
+		zs.avail_in = programCompressedSize;
+
+		// The header gives the size of the rest; the same stream goes on
+		// to inflate the rest unless that is left for InflateProgramTo()
+		this->programSection.resize(programHeaderSize);
+		InflateInto(zs, &this->programSection[0], programHeaderSize);
+
+		if (deferProgram)
+		{
+			this->compressedProgram = program;
+			this->compressedProgramSize = programCompressedSize;
+			this->programHeaderSize = zs.total_out;
+			this->programSection.resize(zs.total_out);
+		}
+		else if (!zs.total_out)
+			this->programSection.clear();
 		else
 		{
-			auto programSectionCompressed = std::vector<uint8_t>(programCompressedSize);
-			xSF.read(reinterpret_cast<char *>(&programSectionCompressed[0]), programCompressedSize);
-      std::memcpy(&this->rawData[reservedSize + 16], &programSectionCompressed[0], programCompressedSize);
-
-			auto programSectionUncompressed = std::vector<uint8_t>(programHeaderSize);
-			unsigned long programUncompressedSize = programHeaderSize;
-			uncompress(&programSectionUncompressed[0], &programUncompressedSize, &programSectionCompressed[0], programCompressedSize);
-      if (programUncompressedSize) {
-        programUncompressedSize = Get32BitsLE(&programSectionUncompressed[programSizeOffset]) + programHeaderSize;
-      }
+			// Short of the declared size, the rest is left zeroed
+			uint64_t programUncompressedSize = Get32BitsLE(&this->programSection[programSizeOffset]) + uint64_t(zs.total_out);
 			this->programSection.resize(programUncompressedSize);
-			uncompress(&this->programSection[0], &programUncompressedSize, &programSectionCompressed[0], programCompressedSize);
+			InflateInto(zs, &this->programSection[zs.total_out], programUncompressedSize - zs.total_out);
 		}
+
+		inflateEnd(&zs);
 	}
 
-	if (xSF.tellg() != filesize && filesize >= reservedSize + programCompressedSize + 21)
+	const uint8_t *tags = program + programCompressedSize;
+	this->ParseTags(reinterpret_cast<const char *>(tags), data + size - tags);
+
+	this->hasFile = true;
+}
+
+void XSFFile::ParseTags(const char *rawtags, size_t size)
+{
+	if (size < 5 || std::string(rawtags, 5) != "[TAG]")
+		return;
+
+	std::string name, value;
+	bool onName = true;
+	for (size_t x = 5; x < size; ++x)
 	{
-		char tagheader[6] = "";
-		xSF.read(tagheader, 5);
-		if (std::string(tagheader) == "[TAG]")
+		char curr = rawtags[x];
+		if (curr == 0x0A)
 		{
-			auto startOfTags = xSF.tellg();
-			unsigned lengthOfTags = static_cast<unsigned>(filesize - startOfTags);
-			if (lengthOfTags)
+			if (!name.empty() && !value.empty())
 			{
-				auto rawtags = std::vector<char>(lengthOfTags);
-				xSF.read(&rawtags[0], lengthOfTags);
-				std::string name, value;
-				bool onName = true;
-				for (unsigned x = 0; x < lengthOfTags; ++x)
-				{
-					char curr = rawtags[x];
-					if (curr == 0x0A)
-					{
-						if (!name.empty() && !value.empty())
-						{
-							name = TrimWhitespace(name);
-							value = TrimWhitespace(value);
-							if (this->tags.find(name) != this->tags.end())
-								this->tags[name] += "\n" + value;
-							else
-								this->tags[name] = value;
-						}
-						name = value = "";
-						onName = true;
-						continue;
-					}
-					if (curr == '=')
-					{
-						onName = false;
-						continue;
-					}
-					if (onName)
-						name += curr;
-					else
-						value += curr;
-				}
+				name = TrimWhitespace(name);
+				value = TrimWhitespace(value);
+				if (this->tags.find(name) != this->tags.end())
+					this->tags[name] += "\n" + value;
+				else
+					this->tags[name] = value;
 			}
+			name = value = "";
+			onName = true;
+			continue;
 		}
+		if (curr == '=')
+		{
+			onName = false;
+			continue;
+		}
+		if (onName)
+			name += curr;
+		else
+			value += curr;
 	}
+}
 
-	this->hasFile = true;
+size_t XSFFile::InflateProgramTo(uint8_t *dest, size_t size) const
+{
+	if (!this->compressedProgram)
+		return 0;
+
+	z_stream zs = {};
+	if (inflateInit(&zs) != Z_OK)
+		return 0;
+
+	zs.next_in = const_cast<uint8_t *>(this->compressedProgram);
+	zs.avail_in = this->compressedProgramSize;
+
+	auto header = std::vector<uint8_t>(this->programHeaderSize);
+	InflateInto(zs, header.data(), header.size());
+	InflateInto(zs, dest, size);
+
+	size_t inflated = zs.total_out - header.size();
+	inflateEnd(&zs);
+	return inflated;
 }
 
 bool XSFFile::IsValidType(uint8_t type) const
@@ -196,6 +252,9 @@ void XSFFile::Clear()
 	this->reservedSection.clear();
 	this->programSection.clear();
 	this->tags.clear();
+	this->compressedProgram = nullptr;
+	this->compressedProgramSize = 0;
+	this->programHeaderSize = 0;
 }
 
 bool XSFFile::HasFile() const
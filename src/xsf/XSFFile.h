@@ -44,12 +44,21 @@ class XSFFile
 protected:
 	uint8_t xSFType;
 	bool hasFile;
-	std::vector<uint8_t> rawData, reservedSection, programSection;
+	std::vector<uint8_t> reservedSection, programSection;
   std::map<std::string, std::string> tags;
+	const uint8_t *compressedProgram;
+	size_t compressedProgramSize;
+	uint32_t programHeaderSize;
 	void ReadXSF(std::istream &xSF, uint32_t programSizeOffset, uint32_t programHeaderSize, bool readTagsOnly = false);
+	void ParseXSF(const uint8_t *data, size_t size, uint32_t programSizeOffset, uint32_t programHeaderSize, bool deferProgram);
+	void ParseTags(const char *rawtags, size_t size);
 public:
 	XSFFile();
 	XSFFile(std::istream& xSF, uint32_t programSizeOffset = 0, uint32_t programHeaderSize = 0, bool readTagsOnly = false);
+	// From a file already in memory.  With deferProgram, the program section
+	// holds only its header, and the rest stays compressed in data (which
+	// must outlive the XSFFile) until InflateProgramTo() puts it in place.
+	XSFFile(const uint8_t *data, size_t size, uint32_t programSizeOffset, uint32_t programHeaderSize, bool deferProgram = false);
 	bool IsValidType(uint8_t type) const;
 	void Clear();
 	bool HasFile() const;
@@ -71,6 +80,9 @@ public:
 	}
 	unsigned long GetLengthMS(unsigned long defaultLength) const;
 	unsigned long GetFadeMS(unsigned long defaultFade) const;
+	// Inflates a deferred program section, past its header, into dest;
+	// returns the bytes inflated
+	size_t InflateProgramTo(uint8_t *dest, size_t size) const;
 	void SaveFile() const;
 };
 
@@ -829,6 +829,34 @@ void MMU_Reset()
 	MMU_timing.arm9dataCache.Reset();
 }
 
+// Everything is saved in place, so the pointers that the MMU keeps into
+// itself stay right.  Main memory beyond the mask is never used, and the
+// firmware and backup devices are left out but for the state of the
+// firmware's SPI transfer.
+void MMU_StateRegions(std::vector<std::pair<void *, size_t>> &regions)
+{
+	uint8_t *start = reinterpret_cast<uint8_t *>(&MMU);
+	uint8_t *fw = reinterpret_cast<uint8_t *>(&MMU.fw);
+
+	regions.emplace_back(start, MMU.MAIN_MEM + _MMU_MAIN_MEM_MASK + 1 - start);
+	regions.emplace_back(MMU.ARM9_REG, fw - MMU.ARM9_REG);
+	regions.emplace_back(fw, reinterpret_cast<uint8_t *>(&MMU.fw.data) - fw);
+	regions.emplace_back(MMU.dscard, sizeof MMU.dscard);
+
+	regions.emplace_back(MMU_new.dma, sizeof MMU_new.dma);
+	regions.emplace_back(&MMU_new.gxstat, sizeof MMU_new.gxstat);
+	regions.emplace_back(&MMU_new.sqrt, sizeof MMU_new.sqrt);
+	regions.emplace_back(&MMU_new.div, sizeof MMU_new.div);
+	regions.emplace_back(&MMU_new.dsi_tsc, sizeof MMU_new.dsi_tsc);
+	regions.emplace_back(&MMU_timing, sizeof MMU_timing);
+
+	regions.emplace_back(vram_lcdc_map, sizeof vram_lcdc_map);
+	regions.emplace_back(vram_arm9_map, sizeof vram_arm9_map);
+	regions.emplace_back(vram_arm7_map, sizeof vram_arm7_map);
+	regions.emplace_back(&vramConfiguration, sizeof vramConfiguration);
+	regions.emplace_back(ipc_fifo, sizeof ipc_fifo);
+}
+
 void SetupMMU(bool debugConsole, bool dsi)
 {
 	if (debugConsole)
@@ -1677,6 +1705,9 @@ void FASTCALL _MMU_ARM9_write08(uint32_t adr, uint8_t val)
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20][adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20]] = val;
+
+	if ((adr >> 24) == 3)
+		arm7CodeCache.writtenShared(adr);
 }
 
 // ================================================= MMU ARM9 write 16
@@ -1815,6 +1846,9 @@ void FASTCALL _MMU_ARM9_write16(uint32_t adr, uint16_t val)
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20], val);
+
+	if ((adr >> 24) == 3)
+		arm7CodeCache.writtenShared(adr);
 }
 
 // ================================================= MMU ARM9 write 32
@@ -1955,6 +1989,9 @@ void FASTCALL _MMU_ARM9_write32(uint32_t adr, uint32_t val)
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20], val);
+
+	if ((adr >> 24) == 3)
+		arm7CodeCache.writtenShared(adr);
 }
 
 // ================================================= MMU ARM9 read 08
@@ -2244,6 +2281,9 @@ void FASTCALL _MMU_ARM7_write08(uint32_t adr, uint8_t val)
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	MMU.MMU_MEM[ARMCPU_ARM7][adr >> 20][adr & MMU.MMU_MASK[ARMCPU_ARM7][adr >> 20]] = val;
+
+	if ((adr >> 24) == 3)
+		arm7CodeCache.writtenARM7WRAM(adr);
 }
 
 // ================================================= MMU ARM7 write 16
@@ -2540,6 +2580,9 @@ void FASTCALL _MMU_ARM7_write16(uint32_t adr, uint16_t val)
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM7][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM7][adr >> 20], val);
+
+	if ((adr >> 24) == 3)
+		arm7CodeCache.writtenARM7WRAM(adr);
 }
 
 // ================================================= MMU ARM7 write 32
@@ -2620,6 +2663,9 @@ void FASTCALL _MMU_ARM7_write32(uint32_t adr, uint32_t val)
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM7][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM7][adr >> 20], val);
+
+	if ((adr >> 24) == 3)
+		arm7CodeCache.writtenARM7WRAM(adr);
 }
 
 // ================================================= MMU ARM7 read 08
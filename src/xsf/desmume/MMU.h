@@ -25,6 +25,7 @@
 #include "mc.h"
 #include "bits.h"
 #include "readwrite.h"
+#include "codecache.h"
 
 #ifdef HAVE_LUA
 #include "lua-engine.h"
@@ -452,6 +453,9 @@ void MMU_DeInit();
 
 void MMU_Reset();
 
+// the parts of memory that hold the state of the MMU, for NDS_Snapshot
+void MMU_StateRegions(std::vector<std::pair<void *, size_t>> &regions);
+
 void MMU_setRom(uint8_t *rom, uint32_t mask);
 void MMU_unsetRom();
 
@@ -698,6 +702,7 @@ inline void _MMU_write08(int PROCNUM, MMU_ACCESS_TYPE AT, uint32_t addr, uint8_t
 	if ((addr & 0x0F000000) == 0x02000000)
 	{
 		T1WriteByte( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK, val);
+		arm7CodeCache.writtenMain(addr & _MMU_MAIN_MEM_MASK);
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 1, val, LUAMEMHOOK_WRITE);
 #endif
@@ -736,6 +741,7 @@ inline void _MMU_write16(int PROCNUM, MMU_ACCESS_TYPE AT, uint32_t addr, uint16_
 	if ((addr & 0x0F000000) == 0x02000000)
 	{
 		T1WriteWord( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK16, val);
+		arm7CodeCache.writtenMain(addr & _MMU_MAIN_MEM_MASK16);
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 2, val, LUAMEMHOOK_WRITE);
 #endif
@@ -774,6 +780,7 @@ inline void _MMU_write32(int PROCNUM, MMU_ACCESS_TYPE AT, uint32_t addr, uint32_
 	if ((addr & 0x0F000000) == 0x02000000)
 	{
 		T1WriteLong( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK32, val);
+		arm7CodeCache.writtenMain(addr & _MMU_MAIN_MEM_MASK32);
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 4, val, LUAMEMHOOK_WRITE);
 #endif
@@ -998,6 +998,7 @@ void NDS_Reset()
 
 	PrepareBiosARM7();
 	PrepareBiosARM9();
+	arm7CodeCache.clear();
 
 	// according to smea, this is initialized to 3 by the time we get into a user game program. who does this?
 	// well, the firmware load process is about to write a boot program into SIWRAM for the arm7. so we need it setup by now.
@@ -1155,6 +1156,80 @@ void NDS_Reset()
 	SPU_ReInit();
 }
 
+typedef std::vector<std::pair<void *, size_t>> StateRegions;
+
+static StateRegions stateRegions()
+{
+	StateRegions regions;
+	MMU_StateRegions(regions);
+	SPU_StateRegions(regions);
+
+	regions.emplace_back(&nds, sizeof nds);
+	regions.emplace_back(&nds_timer, sizeof nds_timer);
+	regions.emplace_back(&nds_arm9_timer, sizeof nds_arm9_timer);
+	regions.emplace_back(&nds_arm7_timer, sizeof nds_arm7_timer);
+	regions.emplace_back(&sequencer, sizeof sequencer);
+	regions.emplace_back(&NDS_ARM9, sizeof NDS_ARM9);
+	regions.emplace_back(&NDS_ARM7, sizeof NDS_ARM7);
+	regions.emplace_back(&cp15, sizeof cp15);
+
+	return regions;
+}
+
+static const size_t kSnapshotBlockSize = 16384;
+
+void NDS_Snapshot::save(const NDS_Snapshot *last)
+{
+	static const uint8_t zero[kSnapshotBlockSize] = {};
+
+	this->blocks.clear();
+
+	for (auto &region : stateRegions())
+	{
+		const uint8_t *data = static_cast<const uint8_t *>(region.first);
+
+		for (size_t pos = 0; pos < region.second; pos += kSnapshotBlockSize)
+		{
+			size_t size = std::min(kSnapshotBlockSize, region.second - pos);
+			size_t index = this->blocks.size();
+
+			if (!memcmp(data + pos, zero, size))
+				this->blocks.emplace_back();
+			else if (last && index < last->blocks.size() && last->blocks[index] &&
+				last->blocks[index]->size() == size && !memcmp(data + pos, last->blocks[index]->data(), size))
+				this->blocks.push_back(last->blocks[index]);
+			else
+				this->blocks.push_back(std::make_shared<const std::vector<uint8_t>>(data + pos, data + pos + size));
+		}
+	}
+
+	SPU_SaveOutputBuffer(this->output);
+}
+
+void NDS_Snapshot::load() const
+{
+	size_t index = 0;
+
+	for (auto &region : stateRegions())
+	{
+		uint8_t *data = static_cast<uint8_t *>(region.first);
+
+		for (size_t pos = 0; pos < region.second; pos += kSnapshotBlockSize)
+		{
+			size_t size = std::min(kSnapshotBlockSize, region.second - pos);
+			auto &block = this->blocks[index++];
+
+			if (block)
+				memcpy(data + pos, block->data(), size);
+			else
+				memset(data + pos, 0, size);
+		}
+	}
+
+	arm7CodeCache.clear();
+	SPU_LoadOutputBuffer(this->output);
+}
+
 // these templates needed to be instantiated manually
 template void NDS_exec<false>(int32_t nb);
 template void NDS_exec<true>(int32_t nb);
@@ -20,6 +20,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include <cstring>
 #include <stdlib.h>
 #include "armcpu.h"
@@ -274,6 +275,22 @@ struct UserInput
 void NDS_FreeROM();
 void NDS_Reset();
 
+// A copy of the emulated system taken between frames, which load() puts
+// back.  It is kept in blocks; blocks that are all zero, or the same as in
+// the last snapshot given to save(), take no memory of their own.  The
+// samples made but not yet output are kept too; the backup memory of the
+// card is not.
+class NDS_Snapshot
+{
+public:
+	void save(const NDS_Snapshot *last = nullptr);
+	void load() const;
+
+private:
+	std::vector<std::shared_ptr<const std::vector<uint8_t>>> blocks;
+	std::vector<s16> output;
+};
+
 void NDS_Sleep();
 
 void execHardware_doAllDma(EDMAMode modeNum);
@@ -282,7 +299,7 @@ template<bool FORCE> void NDS_exec(int32_t nb = 560190 << 1);
 
 extern struct TCommonSettings
 {
-	TCommonSettings() : UseExtBIOS(false), SWIFromBIOS(false), PatchSWI3(false), UseExtFirmware(false), BootFromFirmware(false), ConsoleType(NDS_CONSOLE_TYPE_FAT), rigorous_timing(false), advanced_timing(true),
+	TCommonSettings() : UseExtBIOS(false), SWIFromBIOS(false), PatchSWI3(false), UseExtFirmware(false), BootFromFirmware(false), ConsoleType(NDS_CONSOLE_TYPE_FAT), rigorous_timing(false), advanced_timing(true), arm7_code_cache(false),
 		spuInterpolationMode(SPUInterpolation_Linear), manualBackupType(0), spu_captureMuted(false), spu_advanced(false)
 	{
 		strcpy(this->ARM9BIOS, "biosnds9.bin");
@@ -337,6 +354,9 @@ extern struct TCommonSettings
 
 	bool advanced_timing;
 
+	// keep the code of the ARM7 decoded; see codecache.h
+	bool arm7_code_cache;
+
 	SPUInterpolationMode spuInterpolationMode;
 
 	// this is the user's choice of manual backup type, for cases when the autodetection can't be trusted
@@ -91,6 +91,8 @@ void SetDesmumeSampleRate(double rate) {
 }
 
 static double samples = 0;
+static bool skipping = false;
+static size_t skippedSamples = 0;
 
 template<typename T>
 static FORCEINLINE T MinMax(T val, T min, T max)
@@ -230,6 +232,9 @@ void SPU_Reset(void)
     T1WriteByte(MMU.ARM7_REG, i, 0);
 
   samples = 0;
+
+  //samples made before the reset are not output after it
+  synchronizer->load_samples(std::vector<s16>());
 }
 
 //------------------------------------------
@@ -1039,6 +1044,11 @@ template<int CHANNELS> FORCEINLINE static void SPU_Mix(SPU_struct* SPU, channel_
   template<int FORMAT, int CHANNELS>
 FORCEINLINE static void ____SPU_ChanUpdate(SPU_struct* const SPU, channel_struct* const chan)
 {
+  // the registers of the channel cannot change while it is being mixed, so
+  // the sample is only looked up once, when it is first played from
+  const SampleData* sample = nullptr;
+  IInterpolator* const interp = IInterpolator::allInterpolators[CommonSettings.spuInterpolationMode];
+
   for (; SPU->bufpos < SPU->buflength; SPU->bufpos++)
   {
     if(CHANNELS != -1)
@@ -1049,8 +1059,9 @@ FORCEINLINE static void ____SPU_ChanUpdate(SPU_struct* const SPU, channel_struct
       } else if (FORMAT == 3) {
         FetchPSGData(chan, &data);
       } else {
-        const SampleData& sample = spuSampleCache.getSample(chan->addr, chan->loopstart, chan->length, SampleData::Format(FORMAT));
-        data = sample.sampleAt(chan->sampcnt, IInterpolator::allInterpolators[CommonSettings.spuInterpolationMode]);
+        if (!sample)
+          sample = &spuSampleCache.getSample(chan->addr, chan->loopstart, chan->length, SampleData::Format(FORMAT));
+        data = sample->sampleAt(chan->sampcnt, interp);
       }
       SPU_Mix<CHANNELS>(SPU, chan, data);
     }
@@ -1108,6 +1119,47 @@ static void SPU_MixAudio_Advanced(bool actuallyMix, SPU_struct *SPU, int length)
 
   s32 samp0[2] = {0,0};
 
+  //without capture, the channels do not depend on each other, so each can
+  //be stepped through the whole length at once
+  if (!actuallyMix && !SPU->regs.cap[0].runtime.running && !SPU->regs.cap[1].runtime.running)
+  {
+    for (int i = 0; i < 16; i++)
+    {
+      channel_struct *chan = &SPU->channels[i];
+      if (chan->status != CHANSTAT_PLAY)
+        continue;
+
+      SPU->bufpos = 0;
+      SPU->buflength = length;
+      _SPU_ChanUpdate(false, SPU, chan);
+    }
+    return;
+  }
+
+  //nor do they when both outputs come from the mixer, which is then only
+  //the sum of the channels; each is mixed into the buffer for the whole
+  //length, rather than all of them one sample at a time
+  if (!SPU->regs.cap[0].runtime.running && !SPU->regs.cap[1].runtime.running &&
+      SPU->regs.ctl_left == SPU_struct::REGS::LOM_LEFT_MIXER && SPU->regs.ctl_right == SPU_struct::REGS::ROM_RIGHT_MIXER)
+  {
+    for (int i = 0; i < 16; i++)
+    {
+      channel_struct *chan = &SPU->channels[i];
+      if (chan->status != CHANSTAT_PLAY)
+        continue;
+
+      bool bypass = false;
+      if (i==1 && SPU->regs.ctl_ch1bypass) bypass=true;
+      if (i==3 && SPU->regs.ctl_ch3bypass) bypass=true;
+
+      //sndbuf was cleared by SPU_MixAudio, so the channels accumulate into it
+      SPU->bufpos = 0;
+      SPU->buflength = length;
+      _SPU_ChanUpdate(!CommonSettings.spu_muteChannels[i] && !bypass, SPU, chan);
+    }
+    return;
+  }
+
   //believe it or not, we are going to do this one sample at a time.
   //like i said, it is slower.
   for (int samp = 0; samp < length; samp++)
@@ -1344,6 +1396,13 @@ void SPU_Emulate_core()
   spu_core_samples = (int)(samples);
   samples -= spu_core_samples;
 
+  if (skipping)
+  {
+    SPU_MixAudio(false, SPU_core, spu_core_samples);
+    skippedSamples += spu_core_samples;
+    return;
+  }
+
   SPU_MixAudio(needToMix, SPU_core, spu_core_samples);
 
   if (soundProcessor == NULL)
@@ -1407,6 +1466,44 @@ void SPU_Emulate_user(bool mix)
   soundProcessor->UpdateAudio(postProcessBuffer, processedSampleCount);
 }
 
+void SPU_SetSkip(bool skip)
+{
+  skipping = skip;
+  skippedSamples = 0;
+
+  //the samples still waiting to be output are skipped too
+  if (skip)
+  {
+    std::vector<s16> queued;
+    synchronizer->save_samples(queued);
+    synchronizer->load_samples(std::vector<s16>());
+    skippedSamples = queued.size() / 2;
+  }
+}
+
+size_t SPU_SkippedSamples()
+{
+  return skippedSamples;
+}
+
+void SPU_SaveOutputBuffer(std::vector<s16> &samples)
+{
+  synchronizer->save_samples(samples);
+}
+
+void SPU_LoadOutputBuffer(const std::vector<s16> &samples)
+{
+  synchronizer->load_samples(samples);
+}
+
+void SPU_StateRegions(std::vector<std::pair<void *, size_t>> &regions)
+{
+  regions.emplace_back(SPU_core->channels, sizeof SPU_core->channels);
+  regions.emplace_back(&SPU_core->regs, sizeof SPU_core->regs);
+  regions.emplace_back(&SPU_core->lastdata, sizeof SPU_core->lastdata);
+  regions.emplace_back(&samples, sizeof samples);
+}
+
 void SPU_DefaultFetchSamples(s16 *sampleBuffer, size_t sampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer)
 {
   theSynchronizer->enqueue_samples(sampleBuffer, sampleCount);
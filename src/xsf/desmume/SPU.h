@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <memory>
+#include <vector>
 
 #include "types.h"
 #include "matrix.h"
@@ -259,6 +260,19 @@ static FORCEINLINE u16 SPU_ReadWord(u32 addr) { return SPU_core->ReadWord(addr &
 static FORCEINLINE u32 SPU_ReadLong(u32 addr) { return SPU_core->ReadLong(addr & 0x0FFF); }
 void SPU_Emulate_core(void);
 void SPU_Emulate_user(bool mix = true);
+
+// while skipping, the channels go on playing but no samples are mixed or
+// output, unless sound is being captured; for getting quickly to a later
+// point of a song
+void SPU_SetSkip(bool skip);
+// the samples not output since skipping was last turned on
+size_t SPU_SkippedSamples();
+
+// the parts of memory that hold the state of the SPU, for NDS_Snapshot
+void SPU_StateRegions(std::vector<std::pair<void *, size_t>> &regions);
+// the samples made but not yet output, for NDS_Snapshot
+void SPU_SaveOutputBuffer(std::vector<s16> &samples);
+void SPU_LoadOutputBuffer(const std::vector<s16> &samples);
 void SPU_DefaultFetchSamples(s16 *sampleBuffer, size_t sampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer);
 size_t SPU_DefaultPostProcessSamples(s16 *postProcessBuffer, size_t requestedSampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer);
 
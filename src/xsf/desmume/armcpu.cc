@@ -193,6 +193,31 @@ uint32_t armcpu_Wait4IRQ(armcpu_t *cpu)
 	return 1;
 }
 
+// the ARM7 takes its code from the code cache where it can
+template<uint32_t PROCNUM> static inline uint32_t armcpu_fetch32(uint32_t adr)
+{
+	if (PROCNUM == ARMCPU_ARM7 && CommonSettings.arm7_code_cache)
+	{
+		const CodeCache::Op *op = arm7CodeCache.fetch(adr, false);
+		if (op)
+			return op->instruction;
+	}
+
+	return _MMU_read32<PROCNUM, MMU_AT_CODE>(adr);
+}
+
+template<uint32_t PROCNUM> static inline uint16_t armcpu_fetch16(uint32_t adr)
+{
+	if (PROCNUM == ARMCPU_ARM7 && CommonSettings.arm7_code_cache)
+	{
+		const CodeCache::Op *op = arm7CodeCache.fetch(adr, true);
+		if (op)
+			return op->instruction;
+	}
+
+	return _MMU_read16<PROCNUM, MMU_AT_CODE>(adr);
+}
+
 template<uint32_t PROCNUM> static inline uint32_t armcpu_prefetch()
 {
 	armcpu_t *const armcpu = &ARMPROC;
@@ -206,7 +231,7 @@ template<uint32_t PROCNUM> static inline uint32_t armcpu_prefetch()
 		armcpu->instruct_adr = curInstruction;
 		armcpu->next_instruction = curInstruction + 4;
 		armcpu->R[15] = curInstruction + 8;
-		armcpu->instruction = _MMU_read32<PROCNUM, MMU_AT_CODE>(curInstruction);
+		armcpu->instruction = armcpu_fetch32<PROCNUM>(curInstruction);
 
 		return MMU_codeFetchCycles<PROCNUM, 32>(curInstruction);
 	}
@@ -216,7 +241,7 @@ template<uint32_t PROCNUM> static inline uint32_t armcpu_prefetch()
 	armcpu->instruct_adr = curInstruction;
 	armcpu->next_instruction = curInstruction + 2;
 	armcpu->R[15] = curInstruction + 4;
-	armcpu->instruction = _MMU_read16<PROCNUM, MMU_AT_CODE>(curInstruction);
+	armcpu->instruction = armcpu_fetch16<PROCNUM>(curInstruction);
 
 	if (!PROCNUM)
 	{
@@ -328,9 +353,21 @@ template<int PROCNUM> uint32_t armcpu_exec()
 
 	//fprintf(stderr, "%d: %08X\n",PROCNUM,ARMPROC.instruct_adr);
 
+	// the instruction as the code cache decoded it, if it came from there
+	const CodeCache::Op *op = PROCNUM == ARMCPU_ARM7 ? arm7CodeCache.current() : nullptr;
+	if (op && op->instruction != ARMPROC.instruction)
+		op = nullptr;
+
 	if (!ARMPROC.CPSR.bits.T)
 	{
-		if (
+		if (op && (op->kind & CodeCache::ARM))
+		{
+			if (op->kind == CodeCache::ARM_ALWAYS || TEST_COND(CONDITION(op->instruction), CODE(op->instruction), ARMPROC.CPSR))
+				cExecute = op->func(op->instruction);
+			else
+				cExecute = 1;
+		}
+		else if (
 			CONDITION(ARMPROC.instruction) == 0x0E  // fast path for unconditional instructions
 			|| (TEST_COND(CONDITION(ARMPROC.instruction), CODE(ARMPROC.instruction), ARMPROC.CPSR)) // handles any condition
 		)
@@ -349,7 +386,10 @@ template<int PROCNUM> uint32_t armcpu_exec()
 #ifdef HAVE_LUA
 	CallRegisteredLuaMemHook(ARMPROC.instruct_adr, 2, ARMPROC.instruction, LUAMEMHOOK_EXEC);
 #endif
-	cExecute = thumb_instructions_set[PROCNUM][ARMPROC.instruction>>6](ARMPROC.instruction);
+	if (op && op->kind == CodeCache::THUMB)
+		cExecute = op->func(op->instruction);
+	else
+		cExecute = thumb_instructions_set[PROCNUM][ARMPROC.instruction>>6](ARMPROC.instruction);
 
 	cFetch = armcpu_prefetch<PROCNUM>();
 	return MMU_fetchExecuteCycles<PROCNUM>(cExecute, cFetch);
@@ -0,0 +1,120 @@
+/*
+	Copyright (C) 2026 Audacious Plugins Authors
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "codecache.h"
+#include "armcpu.h"
+
+CodeCache arm7CodeCache;
+
+void CodeCache::clear()
+{
+	for (uint32_t index = 0; index < NUM_PAGES; ++index)
+	{
+		this->pages[index].reset();
+		this->used[index] = false;
+	}
+
+	this->cur = nullptr;
+	this->curPage = nullptr;
+}
+
+// the page that holds adr, made if there is none yet; it points into the same
+// memory that _MMU_read32 and _MMU_read16 read the code of the ARM7 from
+CodeCache::Page *CodeCache::lookup(uint32_t adr)
+{
+	uint32_t first, offset;
+	const uint8_t *mem;
+
+	switch ((adr >> 24) & 0xF)
+	{
+		case 0x0:
+			// the BIOS can only be read by code running in it
+			if (adr >= 0x4000)
+				return nullptr;
+			first = BIOS_PAGES;
+			offset = adr;
+			mem = MMU.ARM7_BIOS;
+			break;
+
+		case 0x2:
+			first = MAIN_PAGES;
+			offset = adr & _MMU_MAIN_MEM_MASK;
+			mem = MMU.MAIN_MEM;
+			break;
+
+		case 0x3:
+			if (adr & 0x00800000)
+			{
+				first = ERAM_PAGES;
+				offset = adr & 0xFFFF;
+				mem = MMU.ARM7_ERAM;
+			}
+			else
+			{
+				first = SWIRAM_PAGES;
+				offset = adr & 0x7FFF;
+				mem = MMU.SWIRAM;
+			}
+			break;
+
+		default:
+			return nullptr;
+	}
+
+	uint32_t index = first + (offset >> PAGE_SHIFT);
+	Page *page = this->pages[index].get();
+
+	if (!page)
+	{
+		page = new Page();
+		page->mem = mem + (offset & ~PAGE_MASK);
+		page->index = index;
+		this->pages[index].reset(page);
+	}
+
+	return page;
+}
+
+void CodeCache::decode(Page *page, Op *op, bool thumb)
+{
+	const uint8_t *mem = page->mem + ((op - page->ops) << 1);
+
+	if (thumb)
+	{
+		op->instruction = T1ReadWord_guaranteedAligned(mem, 0);
+		op->func = thumb_instructions_set[ARMCPU_ARM7][op->instruction >> 6];
+		op->kind = THUMB;
+	}
+	else
+	{
+		op->instruction = T1ReadLong_guaranteedAligned(mem, 0);
+		op->func = arm_instructions_set[ARMCPU_ARM7][INSTRUCTION_INDEX(op->instruction)];
+		op->kind = CONDITION(op->instruction) == 0x0E ? ARM_ALWAYS : ARM;
+	}
+
+	this->used[page->index] = true;
+}
+
+void CodeCache::drop(uint32_t index)
+{
+	Op *ops = this->pages[index]->ops;
+
+	for (int i = 0; i < PAGE_OPS; ++i)
+		ops[i].kind = EMPTY;
+
+	this->used[index] = false;
+}
@@ -0,0 +1,139 @@
+/*
+	Copyright (C) 2026 Audacious Plugins Authors
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <memory>
+#include "types.h"
+#include "instructions.h"
+
+// The ARM7 spends its time in the same few loops of the sound driver.
+// This keeps the instructions it has fetched, each with its handler looked
+// up, in pages of 256 bytes of the memory they came from, so that running
+// them again takes neither a memory read nor a table lookup.  Only the
+// BIOS, main memory and WRAM are cached; code anywhere else is fetched as
+// before.
+//
+// Every write to main memory or WRAM, by either CPU or by DMA, must be
+// told with one of the written functions, which drop the page written to.
+// The instruction already fetched is kept, as the pipeline would.
+//
+// The memory reads it saves are cheap ones already, and on the drivers it
+// was tried with it ran no faster, so CommonSettings.arm7_code_cache is off
+// unless set (by the plugin's hidden arm7_code_cache setting).  The xsf
+// benchmarks of decoder-bench time it both ways and compare the output.
+class CodeCache
+{
+public:
+	enum Kind : uint32_t
+	{
+		EMPTY = 0,
+		THUMB = 1,
+		ARM = 2,
+		ARM_ALWAYS = 3 // an ARM instruction whose condition is AL
+	};
+
+	struct Op
+	{
+		OpFunc func;
+		uint32_t instruction;
+		uint32_t kind;
+	};
+
+	static const int PAGE_SHIFT = 8;
+
+	// the pages of each kind of memory, one after the other
+	static const uint32_t BIOS_PAGES = 0;
+	static const uint32_t SWIRAM_PAGES = BIOS_PAGES + (0x4000 >> PAGE_SHIFT);
+	static const uint32_t ERAM_PAGES = SWIRAM_PAGES + (0x8000 >> PAGE_SHIFT);
+	static const uint32_t MAIN_PAGES = ERAM_PAGES + (0x10000 >> PAGE_SHIFT);
+	static const uint32_t NUM_PAGES = MAIN_PAGES + (0x1000000 >> PAGE_SHIFT);
+
+	void clear();
+
+	// the instruction fetched last, or null if it is not cached
+	const Op *current() const { return this->cur; }
+
+	// the instruction at adr, decoded now if it has not been;
+	// null if adr is not in memory that is cached
+	const Op *fetch(uint32_t adr, bool thumb)
+	{
+		Page *page = this->curPage;
+
+		// most jumps stay in the page
+		if (!page || (adr & ~PAGE_MASK) != this->curBase)
+		{
+			page = this->curPage = this->lookup(adr);
+			this->curBase = adr & ~PAGE_MASK;
+			if (!page)
+				return this->cur = nullptr;
+		}
+
+		Op *op = &page->ops[(adr & PAGE_MASK) >> 1];
+		if (thumb ? op->kind != THUMB : !(op->kind & ARM))
+			this->decode(page, op, thumb);
+
+		return this->cur = op;
+	}
+
+	// main memory at the given offset has been written to
+	void writtenMain(uint32_t offset) { this->written(MAIN_PAGES + (offset >> PAGE_SHIFT)); }
+
+	// shared WRAM at the given offset has been written to
+	void writtenShared(uint32_t offset) { this->written(SWIRAM_PAGES + ((offset & 0x7FFF) >> PAGE_SHIFT)); }
+
+	// the ARM7 has written to WRAM, at an address from 0x03000000 to 0x03FFFFFF
+	void writtenARM7WRAM(uint32_t adr)
+	{
+		if (adr & 0x00800000)
+			this->written(ERAM_PAGES + ((adr & 0xFFFF) >> PAGE_SHIFT));
+		else
+			this->writtenShared(adr);
+	}
+
+private:
+	static const uint32_t PAGE_MASK = (1 << PAGE_SHIFT) - 1;
+	static const int PAGE_OPS = 1 << (PAGE_SHIFT - 1);
+
+	// an instruction for every halfword
+	struct Page
+	{
+		Op ops[PAGE_OPS];
+		const uint8_t *mem;
+		uint32_t index;
+	};
+
+	Page *lookup(uint32_t adr);
+	void decode(Page *page, Op *op, bool thumb);
+
+	void written(uint32_t index)
+	{
+		if (this->used[index])
+			this->drop(index);
+	}
+
+	void drop(uint32_t index);
+
+	Op *cur = nullptr;
+	Page *curPage = nullptr;
+	uint32_t curBase = 0;
+
+	std::unique_ptr<Page> pages[NUM_PAGES];
+	bool used[NUM_PAGES] = {};
+};
+
+extern CodeCache arm7CodeCache;
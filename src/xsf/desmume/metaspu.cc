@@ -19,35 +19,66 @@
 
 #include "metaspu.h"
 
-#include <queue>
 #include <vector>
 #include <list>
 #include <cstring>
 #include <assert.h>
 
+//the samples are kept in a ring, which only grows when it is full
 class NullSynchronizer : public ISynchronizingAudioBuffer
 {
 public:
-  std::queue<uint32_t> buffer;
-  NullSynchronizer() {}
+  std::vector<uint32_t> buffer;
+  size_t head, count;
+  NullSynchronizer() : head(0), count(0) {}
+
+  uint32_t& at(size_t i) { return buffer[(head + i) % buffer.size()]; }
+  const uint32_t& at(size_t i) const { return buffer[(head + i) % buffer.size()]; }
+
+  void reserve(size_t size) {
+    if (size <= buffer.size())
+      return;
+    std::vector<uint32_t> bigger(std::max(size, buffer.size() * 2));
+    for (size_t i = 0; i < count; i++)
+      bigger[i] = at(i);
+    buffer.swap(bigger);
+    head = 0;
+  }
 
 	virtual void enqueue_samples(s16* buf, int samples_provided) {
+    reserve(count + samples_provided);
     for (int i = 0; i < samples_provided * 2; i += 2) {
       uint16_t left = buf[i];
       uint16_t right = buf[i + 1];
-      buffer.push(left << 16 | right);
+      at(count++) = left << 16 | right;
     }
   }
 
 	virtual int output_samples(s16* buf, int samples_requested) {
-    int samples = ((samples_requested < buffer.size()) ? samples_requested : buffer.size()) & ~1;
+    int samples = ((samples_requested < count) ? samples_requested : count) & ~1;
     for (int offset = 0, i = 0; i < samples; i++) {
-      uint32_t sample = buffer.front();
-      buffer.pop();
+      uint32_t sample = at(i);
       buf[offset++] = (sample >> 16) & 0xFFFF;
       buf[offset++] = sample & 0xFFFF;
     }
+    if (samples) {
+      head = (head + samples) % buffer.size();
+      count -= samples;
+    }
     return samples;
+  }
+
+	virtual void save_samples(std::vector<s16>& samples) const {
+    samples.clear();
+    for (size_t i = 0; i < count; i++) {
+      samples.push_back((at(i) >> 16) & 0xFFFF);
+      samples.push_back(at(i) & 0xFFFF);
+    }
+  }
+
+	virtual void load_samples(const std::vector<s16>& samples) {
+    head = count = 0;
+    enqueue_samples(const_cast<s16*>(samples.data()), samples.size() / 2);
   }
 };
 
@@ -25,6 +25,7 @@
 #define _METASPU_H_
 
 #include <algorithm>
+#include <vector>
 
 #include "types.h"
 
@@ -37,6 +38,10 @@ public:
 
 	//returns the number of samples actually supplied, which may not match the number requested
 	virtual int output_samples(s16* buf, int samples_requested) = 0;
+
+	//copies out the samples waiting to be output, or replaces them
+	virtual void save_samples(std::vector<s16>& samples) const = 0;
+	virtual void load_samples(const std::vector<s16>& samples) = 0;
 };
 
 enum ESynchMode
@@ -39,7 +39,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <iostream>
 
@@ -53,13 +55,7 @@
 #include "spu/samplecache.h"
 #include "sndif2sf.h"
 #include "XSFFile.h"
-
-#if _WIN32
-#include <windows.h>
-#define sleep Sleep
-#else
-#include <unistd.h>
-#endif
+#include "../trace-common/trace.h"
 
 class XSFPlugin : public InputPlugin
 {
@@ -161,6 +157,8 @@ public:
 /* xsf_get_lib: called to load secondary files */
 static String dirpath;
 
+static std::mutex emulatorMutex;
+
 bool ignore_length;
 
 #define CFG_ID "xsf"
@@ -171,6 +169,7 @@ const char* const XSFPlugin::defaults[] =
   "fade", "5000",
   "sample_rate", "32728",
   "interpolation_mode", "none",
+  "arm7_code_cache", "FALSE",
   nullptr
 };
 
@@ -230,58 +229,164 @@ static void xsf_reset(int frameSkip)
       NDS_exec<false>();
     }
   }
-  buffer_rope.clear();
+  SNDIF2SF_Clear();
+}
+
+/* A seek goes on from the last snapshot before the point sought, and makes
+ * no samples on the way there.  Snapshots are taken every so often while
+ * playing or seeking; when there get to be too many, every other one is
+ * dropped and they are taken half as often. */
+struct XSFSnapshot
+{
+  float pos;
+  NDS_Snapshot state;
+};
+
+static const int snapshotInterval = 10000;
+static const int maxSnapshots = 32;
+
+static void xsf_snapshot(std::vector<XSFSnapshot>& snapshots, int& interval, float pos)
+{
+  if (snapshots.size() && pos < snapshots.back().pos + interval)
+    return;
+
+  snapshots.push_back({ pos });
+  snapshots.back().state.save(snapshots.size() > 1 ? &snapshots[snapshots.size() - 2].state : nullptr);
+
+  if ((int)snapshots.size() > maxSnapshots) {
+    for (unsigned i = 1; i < snapshots.size(); ++i)
+      snapshots.erase(snapshots.begin() + i);
+    interval *= 2;
+  }
+}
+
+/* goes back to the snapshot to start from if it is nearer than pos */
+static void xsf_load_snapshot(std::vector<XSFSnapshot>& snapshots, float& pos, int seek_value)
+{
+  auto snapshot = snapshots.begin();
+  while (snapshot + 1 != snapshots.end() && (snapshot + 1)->pos <= seek_value)
+    ++snapshot;
+
+  if (seek_value < pos || snapshot->pos > pos) {
+    snapshot->state.load();
+    spuSampleCache.clear();
+    pos = snapshot->pos;
+  }
 }
 
-bool map2SF(std::vector<uint8_t>& rom, XSFFile* xsf)
+/* Where the program of a file goes in the ROM, from its header */
+struct RomSection
+{
+  XSFFile* xsf;
+  uint32_t offset, size;
+};
+
+bool map2SF(std::vector<RomSection>& sections, XSFFile* xsf)
 {
   if (!xsf->IsValidType(0x24))
     return false;
   const auto& programSection = xsf->GetProgramSection();
-  if (programSection.size()) {
+  if (programSection.size() >= 8) {
     uint32_t offset = Get32BitsLE(&programSection[0]);
     uint32_t size = Get32BitsLE(&programSection[4]);
-    uint32_t finalSize = size + offset;
-    if (rom.size() < finalSize) {
-      rom.resize(finalSize + 10);
-    }
-    memcpy(&rom[offset], &programSection[8], size);
+    sections.push_back({ xsf, offset, size });
   }
   return true;
 }
 
-bool recursiveLoad2SF(std::vector<uint8_t>& rom, XSFFile* xsf, int level)
+/* The libraries of a set are read and inflated once and shared by its
+ * files, which often all use one large library.  Those used by the last
+ * file played are kept, by path and size, until a file uses others. */
+struct CachedLib
+{
+  String path;
+  int64_t size;
+  std::shared_ptr<XSFFile> xsf;
+};
+
+static std::vector<CachedLib> cachedLibs;
+
+static std::shared_ptr<XSFFile> loadLib(const std::string& name, std::vector<CachedLib>& used)
+{
+  String path(filename_build({ dirpath, name.c_str() }));
+  VFSFile file(path, "r");
+  if (!file)
+    return nullptr;
+
+  int64_t size = file.fsize();
+  for (auto& lib : used)
+    if (lib.path == path && lib.size == size)
+      return lib.xsf;
+
+  for (auto& lib : cachedLibs) {
+    if (lib.path == path && lib.size == size) {
+      used.push_back(lib);
+      return lib.xsf;
+    }
+  }
+
+  vfsfile_istream vs(&file);
+  if (!vs)
+    return nullptr;
+
+  auto xsf = std::make_shared<XSFFile>(vs, 4, 8);
+  used.push_back({ path, size, xsf });
+  return xsf;
+}
+
+/* Lists the sections in the order they are laid on the ROM, each over
+ * those before it, so that the ROM can be sized once before any is copied */
+bool recursiveLoad2SF(std::vector<RomSection>& sections, XSFFile* xsf, int level, std::vector<CachedLib>& used)
 {
   if (level <= 10 && xsf->GetTagExists("_lib"))
   {
-    vfsfile_istream vs(filename_build({ dirpath, xsf->GetTagValue("_lib").c_str() }));
-    if (!vs)
-      return false;
-    XSFFile libxsf(vs, 4, 8);
-    if (!recursiveLoad2SF(rom, &libxsf, level + 1))
+    auto libxsf = loadLib(xsf->GetTagValue("_lib"), used);
+    if (!libxsf || !recursiveLoad2SF(sections, libxsf.get(), level + 1, used))
       return false;
   }
 
-  if (!map2SF(rom, xsf))
+  if (!map2SF(sections, xsf))
     return false;
 
   bool found = true;
   for (int n = 2; found; n++) {
     std::ostringstream ss;
-    ss << "_lib" << (n++);
+    ss << "_lib" << n;
     found = xsf->GetTagExists(ss.str());
     if (found) {
-      vfsfile_istream vs(filename_build({ dirpath, xsf->GetTagValue(ss.str()).c_str() }));
-      if (!vs)
-        return false;
-      XSFFile libxsf(vs, 4, 8);
-      if (!recursiveLoad2SF(rom, &libxsf, level + 1))
+      auto libxsf = loadLib(xsf->GetTagValue(ss.str()), used);
+      if (!libxsf || !recursiveLoad2SF(sections, libxsf.get(), level + 1, used))
         return false;
     }
   }
   return true;
 }
 
+/* The main file's program is inflated straight into the ROM; the
+ * libraries, inflated once for the whole set, are copied */
+static bool build2SF(std::vector<uint8_t>& rom, XSFFile* xsf, std::vector<CachedLib>& used)
+{
+  std::vector<RomSection> sections;
+  if (!recursiveLoad2SF(sections, xsf, 0, used))
+    return false;
+
+  uint64_t romSize = 0;
+  for (auto& section : sections)
+    romSize = std::max(romSize, uint64_t(section.offset) + section.size);
+  if (!romSize)
+    return false;
+
+  rom.assign(romSize + 10, 0);
+  for (auto& section : sections) {
+    if (section.xsf == xsf)
+      xsf->InflateProgramTo(&rom[section.offset], section.size);
+    else
+      memcpy(&rom[section.offset], &section.xsf->GetProgramSection()[8],
+             std::min<size_t>(section.size, section.xsf->GetProgramSection().size() - 8));
+  }
+  return true;
+}
+
 void setInterp() {
   std::string interp = (const char*)aud_get_str(CFG_ID, "interpolation_mode");
   int interpMode = 0;
@@ -308,26 +413,26 @@ bool XSFPlugin::play(const char *filename, VFSFile &file)
 	if (!slash)
 		return false;
 
-  while (execute && !check_stop()) {
-    std::cerr << "waiting for thread to finish..." << std::endl;
-    sleep(100);
-  }
+  /* the emulator is global, so a track waits for the last one to finish */
+  std::lock_guard<std::mutex> lock(emulatorMutex);
 
 	dirpath = String(str_copy(filename, slash + 1 - filename));
 
-	Index<char> buf = file.read_all();
   try {
-    vfsfile_istream vs(&file);
-    if (!vs) {
+    /* read once; the program stays compressed in data until it is
+     * inflated into the ROM */
+    if (file.fseek(0, VFS_SEEK_SET))
       return false;
-    }
-
-    XSFFile xsf(vs, 4, 8);
+    Index<char> data = file.read_all();
+    XSFFile xsf((const uint8_t*)data.begin(), data.len(), 4, 8, true);
     fade = xsf.GetFadeMS(5000);
     length = xsf.GetLengthMS(115000) + fade;
 
     std::vector<uint8_t> rom;
-    if (!recursiveLoad2SF(rom, &xsf, 0) || !rom.size())
+    std::vector<CachedLib> usedLibs;
+    bool loaded = build2SF(rom, &xsf, usedLibs);
+    cachedLibs = std::move(usedLibs);
+    if (!loaded)
       return false;
 
     if (NDS_Init())
@@ -338,7 +443,9 @@ bool XSFPlugin::play(const char *filename, VFSFile &file)
       sampleRate = 32728;
     SetDesmumeSampleRate(sampleRate); // TODO: config
     int BUFFERSIZE = DESMUME_SAMPLE_RATE / 59.837; //truncates to 737, the traditional value, for 44100
-    SPU_ChangeSoundCore(SNDIFID_2SF, BUFFERSIZE);
+    // room for two frames, so that all that a frame makes goes out after it
+    SPU_ChangeSoundCore(SNDIFID_2SF, BUFFERSIZE * 2);
+    std::vector<int16_t> samples(BUFFERSIZE * 2 * 2);
 
     execute = false;
 
@@ -350,53 +457,55 @@ bool XSFPlugin::play(const char *filename, VFSFile &file)
     CommonSettings.rigorous_timing = true;
     CommonSettings.spu_advanced = true;
     CommonSettings.advanced_timing = true;
+    CommonSettings.arm7_code_cache = aud_get_bool(CFG_ID, "arm7_code_cache");
 
     xsf_reset(frameSkip);
 
+    std::vector<XSFSnapshot> snapshots;
+    int interval = snapshotInterval;
+    xsf_snapshot(snapshots, interval, pos);
+
     set_stream_bitrate(DESMUME_SAMPLE_RATE*2*2*8);
     open_audio(FMT_S16_NE, DESMUME_SAMPLE_RATE, 2);
 
     ignore_length = aud_get_bool(CFG_ID, "ignore_length");
     while (!check_stop() && (pos < length || ignore_length))
     {
+      TRACE_SPAN("xSF play");
       int seek_value = check_seek();
 
       if (seek_value >= 0)
       {
-        if (seek_value < pos) {
-          xsf_reset(frameSkip);
-          pos = 0;
-        }
-        while (pos < seek_value)
-        {
-          while (buffer_rope.size()) {
-            pos += buffer_rope.front().size() * 1000 / DESMUME_SAMPLE_RATE / 4;
-            buffer_rope.pop_front();
-          }
+        xsf_load_snapshot(snapshots, pos, seek_value);
+        SNDIF2SF_Clear();
+        SPU_SetSkip(true);
+
+        float start = pos;
+        while (pos < seek_value && !check_stop()) {
           NDS_exec<false>();
-          SPU_Emulate_user();
+          pos = start + SPU_SkippedSamples() * 1000 / DESMUME_SAMPLE_RATE;
+          xsf_snapshot(snapshots, interval, pos);
         }
-        buffer_rope.clear();
+
+        SPU_SetSkip(false);
       }
 
-      while (!buffer_rope.size() && !check_stop()) {
+      while (!SNDIF2SF_Frames() && !check_stop()) {
         NDS_exec<false>();
         SPU_Emulate_user();
       }
-      while (buffer_rope.size() && !check_stop()) {
-        auto& front = buffer_rope.front();
+      while (SNDIF2SF_Frames() && !check_stop()) {
+        size_t frames = SNDIF2SF_Read(samples.data(), samples.size() / 2);
         if (pos > length - fade && !ignore_length) {
           float fadeFactor = (length - pos) / (1.0 * fade);
-          int sampleCount = front.size() / 2;
-          int16_t* sampleBuffer = reinterpret_cast<int16_t*>(front.data());
-          for (int i = 0; i < sampleCount; i++) {
-            sampleBuffer[i] *= fadeFactor;
+          for (size_t i = 0; i < frames * 2; i++) {
+            samples[i] *= fadeFactor;
           }
         }
-        write_audio(front.data(), front.size());
-        pos += front.size() * 1000 / DESMUME_SAMPLE_RATE / 4;
-        buffer_rope.pop_front();
+        write_audio(samples.data(), frames * 4);
+        pos += frames * 1000 / DESMUME_SAMPLE_RATE;
       }
+      xsf_snapshot(snapshots, interval, pos);
     }
   } catch (std::exception& e) {
     std::cerr << "Exception: " << e.what() << std::endl;
@@ -30,33 +30,25 @@
 
 #include "sndif2sf.h"
 #include "desmume/NDSSystem.h"
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
-std::list<std::vector<std::uint8_t>> buffer_rope;
-
 static struct
 {
-  std::vector<uint8_t> buf;
-  unsigned filled, used;
-  uint32_t bufferbytes, cycles;
-  int xfs_load, sync_type;
-} sndifwork = {std::vector<uint8_t>(), 0, 0, 0, 0, 0, 0};
+  std::vector<int16_t> ring;
+  size_t head, frames;
+} sndifwork = {std::vector<int16_t>(), 0, 0};
 
 static void SNDIFDeInit() {
-  int buffersize = sndifwork.buf.size();
-  sndifwork.buf.resize(0);
-  sndifwork.buf.resize(buffersize);
-  buffer_rope.clear();
+  sndifwork.head = sndifwork.frames = 0;
 }
 
 static int SNDIFInit(int buffersize)
 {
-  uint32_t bufferbytes = buffersize * sizeof(int16_t);
-  SNDIFDeInit();
-  sndifwork.buf.resize(bufferbytes + 3);
-  sndifwork.bufferbytes = bufferbytes;
-  sndifwork.filled = sndifwork.used = 0;
-  sndifwork.cycles = 0;
+  // buffersize counts both channels
+  sndifwork.ring.assign(buffersize & ~1, 0);
+  sndifwork.head = sndifwork.frames = 0;
   return 0;
 }
 
@@ -66,21 +58,48 @@ static void SNDIFSetVolume(int) { }
 
 static uint32_t SNDIFGetAudioSpace()
 {
-  return sndifwork.bufferbytes >> 2; // bytes to samples
+  return sndifwork.ring.size() / 2 - sndifwork.frames;
 }
 
 static void SNDIFUpdateAudio(int16_t *buffer, uint32_t num_samples)
 {
-  num_samples <<= 1; // stereo
-  uint32_t num_bytes = num_samples << 1;
-  if (num_bytes > sndifwork.bufferbytes) {
-    num_bytes = sndifwork.bufferbytes;
-    num_samples = num_bytes >> 1;
-  }
-  memcpy(&sndifwork.buf[0], buffer, num_bytes);
-  buffer_rope.push_back(std::vector<uint8_t>(reinterpret_cast<uint8_t*>(buffer), reinterpret_cast<uint8_t*>(buffer) + num_bytes));
-  sndifwork.filled = num_bytes;
-  sndifwork.used = 0;
+  size_t capacity = sndifwork.ring.size() / 2;
+  if (num_samples > capacity - sndifwork.frames)
+    num_samples = capacity - sndifwork.frames;
+  if (!num_samples)
+    return;
+
+  size_t tail = (sndifwork.head + sndifwork.frames) % capacity;
+  size_t part = std::min<size_t>(num_samples, capacity - tail);
+  memcpy(&sndifwork.ring[tail * 2], buffer, part * 4);
+  memcpy(&sndifwork.ring[0], buffer + part * 2, (num_samples - part) * 4);
+  sndifwork.frames += num_samples;
+}
+
+size_t SNDIF2SF_Frames()
+{
+  return sndifwork.frames;
+}
+
+size_t SNDIF2SF_Read(int16_t *buffer, size_t frames)
+{
+  size_t capacity = sndifwork.ring.size() / 2;
+  frames = std::min(frames, sndifwork.frames);
+  if (!frames)
+    return 0;
+
+  size_t part = std::min(frames, capacity - sndifwork.head);
+  memcpy(buffer, &sndifwork.ring[sndifwork.head * 2], part * 4);
+  memcpy(buffer + part * 2, &sndifwork.ring[0], (frames - part) * 4);
+
+  sndifwork.head = (sndifwork.head + frames) % capacity;
+  sndifwork.frames -= frames;
+  return frames;
+}
+
+void SNDIF2SF_Clear()
+{
+  sndifwork.head = sndifwork.frames = 0;
 }
 
 const int SNDIFID_2SF = 1;
@@ -30,10 +30,14 @@
 #pragma once
 
 #include "desmume/SPU.h"
-#include <list>
-#include <vector>
+#include <cstddef>
 #include <cstdint>
 
 extern const int SNDIFID_2SF;
 extern SoundInterface_struct SNDIF_2SF;
-extern std::list<std::vector<std::uint8_t>> buffer_rope;
+
+// The output goes into a ring of stereo frames, allocated when the sound
+// core is set up and emptied by the player as it goes.
+size_t SNDIF2SF_Frames();
+size_t SNDIF2SF_Read(std::int16_t *buffer, size_t frames);
+void SNDIF2SF_Clear();